@@ -0,0 +1,88 @@
+#include <stdio.h>
+
+#include "lwip/tcpip.h"
+
+#include "iperf_bench.h"
+
+static const char* iperf_bench_result(enum lwiperf_report_type report_type)
+{
+    switch (report_type) {
+    case LWIPERF_TCP_DONE_SERVER:
+    case LWIPERF_UDP_DONE_SERVER:
+        return "server done";
+    case LWIPERF_TCP_DONE_CLIENT:
+    case LWIPERF_UDP_DONE_CLIENT:
+        return "client done";
+    case LWIPERF_UDP_ABORTED_IDLE:
+        return "idle";
+    default:
+        return "aborted";
+    }
+}
+
+static void iperf_bench_tcp_report(void* arg, enum lwiperf_report_type report_type,
+    const ip_addr_t* local_addr, u16_t local_port, const ip_addr_t* remote_addr, u16_t remote_port,
+    u32_t bytes_transferred, u32_t ms_duration, u32_t bandwidth_kbitpsec)
+{
+    (void)arg;
+    (void)local_addr;
+    printf("iperf tcp %s: %u -> %s:%u, %lu bytes in %lu ms, %lu kbit/s\n",
+        iperf_bench_result(report_type), local_port, ipaddr_ntoa(remote_addr), remote_port,
+        (unsigned long)bytes_transferred, (unsigned long)ms_duration, (unsigned long)bandwidth_kbitpsec);
+}
+
+#if LWIPERF_UDP
+static void iperf_bench_udp_report(void* arg, enum lwiperf_report_type report_type,
+    const ip_addr_t* local_addr, u16_t local_port, const ip_addr_t* remote_addr, u16_t remote_port,
+    u32_t bytes_transferred, u32_t ms_duration, u32_t bandwidth_kbitpsec,
+    const struct lwiperf_udp_report* udp)
+{
+    (void)arg;
+    (void)local_addr;
+    printf("iperf udp %s: %u -> %s:%u, %lu bytes in %lu ms, %lu kbit/s, %lu datagrams",
+        iperf_bench_result(report_type), local_port, ipaddr_ntoa(remote_addr), remote_port,
+        (unsigned long)bytes_transferred, (unsigned long)ms_duration, (unsigned long)bandwidth_kbitpsec,
+        (unsigned long)udp->datagrams);
+    if (report_type == LWIPERF_UDP_DONE_CLIENT && !udp->server_report) {
+        printf(", no server report\n");
+    } else {
+        printf(", %lu lost, %lu out of order, jitter %lu us\n", (unsigned long)udp->lost,
+            (unsigned long)udp->out_of_order, (unsigned long)udp->jitter_us);
+    }
+}
+#endif
+
+void* iperf_bench_start(const struct iperf_bench_config* config)
+{
+    void* handle = NULL;
+    u16_t port = config->port ? config->port : LWIPERF_TCP_PORT_DEFAULT;
+    u8_t streams = config->streams ? config->streams : 1;
+    u32_t duration_ms = config->duration_ms ? config->duration_ms : 10000;
+
+    LOCK_TCPIP_CORE();
+    if (config->udp) {
+#if LWIPERF_UDP
+        if (config->server) {
+            handle = lwiperf_start_udp_server(IP_ANY_TYPE, port, iperf_bench_udp_report, NULL);
+        } else {
+            handle = lwiperf_start_udp_client(&config->remote, port, config->type, streams, duration_ms,
+                config->rate_bps, iperf_bench_udp_report, NULL);
+        }
+#endif
+    } else if (config->server) {
+        handle = lwiperf_start_tcp_server(IP_ANY_TYPE, port, iperf_bench_tcp_report, NULL);
+    } else {
+        handle = lwiperf_start_tcp_client_streams(&config->remote, port, config->type, streams, duration_ms,
+            iperf_bench_tcp_report, NULL);
+    }
+    UNLOCK_TCPIP_CORE();
+
+    return handle;
+}
+
+void iperf_bench_stop(void* handle)
+{
+    LOCK_TCPIP_CORE();
+    lwiperf_abort(handle);
+    UNLOCK_TCPIP_CORE();
+}
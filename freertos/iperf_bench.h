@@ -0,0 +1,23 @@
+#pragma once
+
+#include "lwip/ip_addr.h"
+#include "lwip/apps/lwiperf.h"
+
+/* One lwiperf test over the rpmsg link, the counterpart of an iperf2 run on the Linux side */
+struct iperf_bench_config {
+    u8_t udp;                       // 0: TCP, 1: UDP (-u)
+    u8_t server;                    // 1: wait for `iperf -c`, 0: connect to `iperf -s` at remote
+    enum lwiperf_client_type type;  // client: LWIPERF_CLIENT, LWIPERF_DUAL (-d) or LWIPERF_TRADEOFF (-r)
+    ip_addr_t remote;               // client only
+    u16_t port;                     // 0: 5001 (-p)
+    u8_t streams;                   // client, 0: 1 (-P)
+    u32_t duration_ms;              // client, 0: 10 s (-t)
+    u32_t rate_bps;                 // UDP client, 0: 1 Mbit/s (-b)
+};
+
+/* Start a test, results are printed when each stream is done. Call after network_init(), from
+ * any task. Returns a handle for iperf_bench_stop(), or NULL on failure. */
+void* iperf_bench_start(const struct iperf_bench_config* config);
+
+/* Abort a test (and all its streams) started by iperf_bench_start() */
+void iperf_bench_stop(void* handle);
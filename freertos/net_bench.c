@@ -0,0 +1,316 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "rpmsg_eth.h"
+
+#include "net_bench.h"
+
+/* Control protocol, all fields in network order. Keep in sync with linux/bench/rpmsg_bench.c. */
+#define NET_BENCH_MAGIC 0x52424354UL    // "RBCT"
+#define NET_BENCH_CMD_RESET 1           // zero the counters, then report
+#define NET_BENCH_CMD_QUERY 2
+#define NET_BENCH_CMD_PERF 3            // statistics of PERF_STOP probe arg, see arch/perf.h
+#define NET_BENCH_CMD_TRACE 4           // perf trace entries from position arg on
+
+#define NET_BENCH_F_CPU 0x01            // cpu_idle and cpu_total are valid
+#define NET_BENCH_F_LINK 0x02           // the rpmsg_eth counters are valid
+#define NET_BENCH_F_PERF 0x04           // the probe exists, or LWIP_PERF is on for traces
+
+#define NET_BENCH_PERF_NAME_LEN 16
+#define NET_BENCH_PERF_BUCKETS 24
+#define NET_BENCH_TRACE_MAX 64          // entries per reply
+
+struct net_bench_request {
+    u32_t magic;
+    u32_t cmd;
+    u32_t seq;
+    u32_t arg;
+};
+
+struct net_bench_reply {
+    u32_t magic;
+    u32_t cmd;
+    u32_t seq;
+    u32_t flags;            // NET_BENCH_F_*
+    u32_t sink_packets;
+    u32_t sink_bytes_lo;
+    u32_t sink_bytes_hi;
+    u32_t echo_packets;
+    u32_t rx_msgs;          // struct rpmsg_eth_counters of the interface the request came in on
+    u32_t rx_frames;
+    u32_t tx_msgs;
+    u32_t tx_frames;
+    u32_t cpu_idle;         // run time counter ticks, free running, only differences mean anything
+    u32_t cpu_total;
+};
+
+struct net_bench_perf_reply {
+    u32_t magic;
+    u32_t cmd;
+    u32_t seq;
+    u32_t flags;
+    u32_t count;
+    u32_t min;              // cycles
+    u32_t max;
+    u32_t sum_lo;
+    u32_t sum_hi;
+    char name[NET_BENCH_PERF_NAME_LEN];
+    u32_t hist[NET_BENCH_PERF_BUCKETS];  // bucket n: 2^n up to 2^(n+1)-1 cycles
+};
+
+struct net_bench_trace_reply {
+    u32_t magic;
+    u32_t cmd;
+    u32_t seq;
+    u32_t flags;
+    u32_t next;             // arg of the request for the following entries
+    u32_t count;
+    struct {
+        u32_t probe;        // arg of NET_BENCH_CMD_PERF
+        u32_t start;        // cycle counter
+        u32_t cycles;
+    } entries[NET_BENCH_TRACE_MAX];
+};
+
+struct net_bench {
+    struct udp_pcb* echo_pcb;
+    struct udp_pcb* sink_pcb;
+    u32_t sink_packets;
+    u64_t sink_bytes;
+    u32_t echo_packets;
+};
+
+static struct net_bench net_bench;
+
+static void net_bench_echo_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    (void)arg;
+
+    net_bench.echo_packets++;
+    udp_sendto(pcb, p, addr, port);
+    pbuf_free(p);
+}
+
+static u32_t net_bench_cpu(u32_t* idle, u32_t* total)
+{
+#if configGENERATE_RUN_TIME_STATS && INCLUDE_xTaskGetIdleTaskHandle
+#ifdef portALT_GET_RUN_TIME_COUNTER_VALUE
+    portALT_GET_RUN_TIME_COUNTER_VALUE(*total);
+#else
+    *total = (u32_t)portGET_RUN_TIME_COUNTER_VALUE();
+#endif
+    *idle = (u32_t)ulTaskGetIdleRunTimeCounter();
+    return NET_BENCH_F_CPU;
+#else
+    *idle = 0;
+    *total = 0;
+    return 0;
+#endif
+}
+
+static void net_bench_send(struct udp_pcb* pcb, const void* reply, u16_t len, const ip_addr_t* addr, u16_t port)
+{
+    struct pbuf* q = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+
+    if (q == NULL) {
+        return;
+    }
+    memcpy(q->payload, reply, len);
+    udp_sendto(pcb, q, addr, port);
+    pbuf_free(q);
+}
+
+#if LWIP_PERF
+static void net_bench_perf(struct udp_pcb* pcb, const struct net_bench_request* req,
+                           const ip_addr_t* addr, u16_t port)
+{
+    struct net_bench_perf_reply reply;
+    struct perf_probe probe;
+    u32_t i;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.magic = lwip_htonl(NET_BENCH_MAGIC);
+    reply.cmd = req->cmd;
+    reply.seq = req->seq;
+    if (lwip_ntohl(req->arg) < 0xFF && perf_get_probe((u8_t)lwip_ntohl(req->arg), &probe)) {
+        reply.flags = lwip_htonl(NET_BENCH_F_PERF);
+        reply.count = lwip_htonl(probe.count);
+        reply.min = lwip_htonl(probe.min);
+        reply.max = lwip_htonl(probe.max);
+        reply.sum_lo = lwip_htonl((u32_t)probe.sum);
+        reply.sum_hi = lwip_htonl((u32_t)(probe.sum >> 32));
+        strncpy(reply.name, probe.name, sizeof(reply.name) - 1);
+        for (i = 0; i < NET_BENCH_PERF_BUCKETS && i < PERF_HIST_BUCKETS; i++) {
+            reply.hist[i] = lwip_htonl(probe.hist[i]);
+        }
+    }
+    net_bench_send(pcb, &reply, sizeof(reply), addr, port);
+}
+
+static void net_bench_trace(struct udp_pcb* pcb, const struct net_bench_request* req,
+                            const ip_addr_t* addr, u16_t port)
+{
+    static struct net_bench_trace_reply reply;  // too big for the tcpip thread's stack
+    struct perf_trace_entry entries[8];
+    u32_t pos = lwip_ntohl(req->arg);
+    u32_t count = 0, n, i;
+
+    reply.magic = lwip_htonl(NET_BENCH_MAGIC);
+    reply.cmd = req->cmd;
+    reply.seq = req->seq;
+    reply.flags = lwip_htonl(NET_BENCH_F_PERF);
+    do {
+        n = perf_get_trace(&pos, entries, LWIP_MIN(LWIP_ARRAYSIZE(entries), NET_BENCH_TRACE_MAX - count));
+        for (i = 0; i < n; i++, count++) {
+            reply.entries[count].probe = lwip_htonl(entries[i].probe);
+            reply.entries[count].start = lwip_htonl(entries[i].start);
+            reply.entries[count].cycles = lwip_htonl(entries[i].cycles);
+        }
+    } while (n > 0 && count < NET_BENCH_TRACE_MAX);
+    reply.next = lwip_htonl(pos);
+    reply.count = lwip_htonl(count);
+
+    net_bench_send(pcb, &reply, (u16_t)(offsetof(struct net_bench_trace_reply, entries) +
+                                        count * sizeof(reply.entries[0])), addr, port);
+}
+#endif /* LWIP_PERF */
+
+static void net_bench_control(struct udp_pcb* pcb, const struct net_bench_request* req,
+                              const ip_addr_t* addr, u16_t port)
+{
+    struct netif* netif = ip_current_input_netif();
+    struct rpmsg_eth_counters counters;
+    struct net_bench_reply reply;
+    u32_t cmd = lwip_ntohl(req->cmd);
+    u32_t flags, idle, total;
+    int reset = (cmd == NET_BENCH_CMD_RESET);
+
+    if (cmd == NET_BENCH_CMD_PERF || cmd == NET_BENCH_CMD_TRACE) {
+#if LWIP_PERF
+        if (cmd == NET_BENCH_CMD_PERF) {
+            net_bench_perf(pcb, req, addr, port);
+        } else {
+            net_bench_trace(pcb, req, addr, port);
+        }
+#else
+        /* flags 0 tells that there are no probes */
+        memset(&reply, 0, sizeof(reply));
+        reply.magic = lwip_htonl(NET_BENCH_MAGIC);
+        reply.cmd = req->cmd;
+        reply.seq = req->seq;
+        net_bench_send(pcb, &reply, sizeof(reply), addr, port);
+#endif
+        return;
+    }
+
+    if (reset) {
+        net_bench.sink_packets = 0;
+        net_bench.sink_bytes = 0;
+        net_bench.echo_packets = 0;
+#if LWIP_PERF
+        perf_reset();
+#endif
+    }
+
+    memset(&counters, 0, sizeof(counters));
+    flags = net_bench_cpu(&idle, &total);
+    /* the counters are only there if the request came in over rpmsg_eth */
+    if (netif != NULL && netif->name[0] == 'e' && netif->name[1] == 'n') {
+        rpmsg_eth_get_counters(netif, &counters, reset);
+        flags |= NET_BENCH_F_LINK;
+    }
+
+    reply.magic = lwip_htonl(NET_BENCH_MAGIC);
+    reply.cmd = req->cmd;
+    reply.seq = req->seq;
+    reply.flags = lwip_htonl(flags);
+    reply.sink_packets = lwip_htonl(net_bench.sink_packets);
+    reply.sink_bytes_lo = lwip_htonl((u32_t)net_bench.sink_bytes);
+    reply.sink_bytes_hi = lwip_htonl((u32_t)(net_bench.sink_bytes >> 32));
+    reply.echo_packets = lwip_htonl(net_bench.echo_packets);
+    reply.rx_msgs = lwip_htonl(counters.rx_msgs);
+    reply.rx_frames = lwip_htonl(counters.rx_frames);
+    reply.tx_msgs = lwip_htonl(counters.tx_msgs);
+    reply.tx_frames = lwip_htonl(counters.tx_frames);
+    reply.cpu_idle = lwip_htonl(idle);
+    reply.cpu_total = lwip_htonl(total);
+
+    net_bench_send(pcb, &reply, sizeof(reply), addr, port);
+}
+
+static void net_bench_sink_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    struct net_bench_request req;
+
+    (void)arg;
+
+    if (p->tot_len == sizeof(req) && pbuf_copy_partial(p, &req, sizeof(req), 0) == sizeof(req) &&
+        lwip_ntohl(req.magic) == NET_BENCH_MAGIC) {
+        pbuf_free(p);
+        net_bench_control(pcb, &req, addr, port);
+        return;
+    }
+
+    net_bench.sink_packets++;
+    net_bench.sink_bytes += p->tot_len;
+    pbuf_free(p);
+}
+
+static struct udp_pcb* net_bench_bind(u16_t port, udp_recv_fn recv)
+{
+    struct udp_pcb* pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+
+    if (pcb == NULL) {
+        return NULL;
+    }
+    if (udp_bind(pcb, IP_ANY_TYPE, port) != ERR_OK) {
+        udp_remove(pcb);
+        return NULL;
+    }
+    udp_recv(pcb, recv, NULL);
+
+    return pcb;
+}
+
+int net_bench_start(u16_t echo_port, u16_t sink_port)
+{
+    int ret = 0;
+
+    LOCK_TCPIP_CORE();
+    if (net_bench.echo_pcb == NULL) {
+        memset(&net_bench, 0, sizeof(net_bench));
+        net_bench.echo_pcb = net_bench_bind(echo_port ? echo_port : NET_BENCH_ECHO_PORT, net_bench_echo_recv);
+        net_bench.sink_pcb = net_bench_bind(sink_port ? sink_port : NET_BENCH_SINK_PORT, net_bench_sink_recv);
+        if (net_bench.echo_pcb == NULL || net_bench.sink_pcb == NULL) {
+            if (net_bench.echo_pcb != NULL) {
+                udp_remove(net_bench.echo_pcb);
+                net_bench.echo_pcb = NULL;
+            }
+            if (net_bench.sink_pcb != NULL) {
+                udp_remove(net_bench.sink_pcb);
+                net_bench.sink_pcb = NULL;
+            }
+            ret = -1;
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+
+    return ret;
+}
+
+void net_bench_stop(void)
+{
+    LOCK_TCPIP_CORE();
+    if (net_bench.echo_pcb != NULL) {
+        udp_remove(net_bench.echo_pcb);
+        udp_remove(net_bench.sink_pcb);
+        net_bench.echo_pcb = NULL;
+        net_bench.sink_pcb = NULL;
+    }
+    UNLOCK_TCPIP_CORE();
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "lwip/arch.h"
+
+/* UDP services for linux/bench/rpmsg_bench: datagrams to the echo port are sent back as they are,
+ * datagrams to the sink port are counted and dropped. Control requests on the sink port reset or
+ * report the counters, the rpmsg_eth counters of the receiving interface and the idle time of
+ * this core. */
+#define NET_BENCH_ECHO_PORT 7007
+#define NET_BENCH_SINK_PORT 7009
+
+/* Start both services, 0 picks the default port. Call after network_init(), from any task.
+ * Returns 0 on success. */
+int net_bench_start(u16_t echo_port, u16_t sink_port);
+
+void net_bench_stop(void);
@@ -0,0 +1,331 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <openamp/open_amp.h>
+
+#include "lwip/mem.h"
+#include "lwip/netif.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include "arch/capture.h"
+
+#include "net_capture.h"
+
+// How long the drain thread sleeps when the ring is empty. Records wait at most this long
+// before they are sent, the ring has to hold what arrives in that time.
+#ifndef NET_CAPTURE_POLL_MS
+#define NET_CAPTURE_POLL_MS 10
+#endif
+
+#ifndef NET_CAPTURE_THREAD_STACKSIZE
+#define NET_CAPTURE_THREAD_STACKSIZE 1024
+#endif
+
+// Below the network threads: capturing must not take time from the traffic it looks at.
+#ifndef NET_CAPTURE_THREAD_PRIO
+#define NET_CAPTURE_THREAD_PRIO (tskIDLE_PRIORITY + 1)
+#endif
+
+/* Protocol, all fields in network order. Keep in sync with linux/capture/rpmsg_pcap.c. */
+#define NET_CAPTURE_MAGIC 0x52434150UL      // "RCAP", requests and replies
+#define NET_CAPTURE_DATA_MAGIC 0x52434144UL // "RCAD", captured frames
+#define NET_CAPTURE_CMD_START 1
+#define NET_CAPTURE_CMD_STOP 2
+
+#define NET_CAPTURE_OK 0
+#define NET_CAPTURE_EINVAL 1                // malformed request
+#define NET_CAPTURE_ENODEV 2                // no netif with that index
+#define NET_CAPTURE_EFILTER 3               // filter program rejected
+#define NET_CAPTURE_ENOTSUP 4               // firmware built without LWIP_CAPTURE
+
+#define NET_CAPTURE_LINKTYPE_ETHERNET 1
+#define NET_CAPTURE_LINKTYPE_RAW 101
+
+struct net_capture_insn {
+    u16_t code;
+    u8_t jt;
+    u8_t jf;
+    u32_t k;
+};
+
+struct net_capture_request {
+    u32_t magic;
+    u16_t cmd;
+    u16_t ifindex;          // START: netif_get_index()
+    u16_t snaplen;          // START: 0 for as much as fits a message
+    u16_t count;            // START: length of the filter, 0 takes everything
+    struct net_capture_insn insns[];
+};
+
+struct net_capture_reply {
+    u32_t magic;
+    u16_t cmd;
+    u16_t status;           // NET_CAPTURE_OK or NET_CAPTURE_E*
+    u16_t linktype;         // pcap LINKTYPE_* of the netif
+    u16_t snaplen;          // what is actually kept of a frame
+    u32_t captured;
+    u32_t dropped;          // frames that matched but found the ring full
+    u32_t now_hi;           // capture clock in microseconds, to line records up with the host
+    u32_t now_lo;
+};
+
+/* Data messages are a header followed by records, each padded to 4 bytes */
+struct net_capture_data {
+    u32_t magic;
+    u32_t dropped;          // since START
+};
+
+struct net_capture_rec {
+    u32_t ts_sec;
+    u32_t ts_usec;
+    u16_t caplen;
+    u16_t len;
+    u8_t dir;               // 0 received, 1 sent
+    u8_t pad[3];
+};
+
+struct net_capture {
+    struct rpmsg_endpoint ept;
+    sys_sem_t wakeup;
+    u8_t* msg;
+    u16_t msg_size;
+    u16_t snaplen;
+    u8_t running;
+    u32_t dst;              // the Linux endpoint, RPMSG_ADDR_ANY until it talked to us
+    /* one request at a time, handed from the endpoint callback to the thread */
+    volatile u16_t req_len;
+    u8_t* req;
+};
+
+static struct net_capture net_capture;
+
+static void net_capture_reply(u16_t cmd, u16_t status, u16_t linktype)
+{
+    struct net_capture_reply reply;
+#if LWIP_CAPTURE
+    struct capture_stats stats;
+    u64_t now = CAPTURE_NOW_US();
+
+    capture_get_stats(&stats, 0);
+#else
+    struct capture_stats stats = { 0, 0 };
+    u64_t now = 0;
+#endif
+
+    reply.magic = lwip_htonl(NET_CAPTURE_MAGIC);
+    reply.cmd = lwip_htons(cmd);
+    reply.status = lwip_htons(status);
+    reply.linktype = lwip_htons(linktype);
+    reply.snaplen = lwip_htons(net_capture.snaplen);
+    reply.captured = lwip_htonl(stats.captured);
+    reply.dropped = lwip_htonl(stats.dropped);
+    reply.now_hi = lwip_htonl((u32_t)(now >> 32));
+    reply.now_lo = lwip_htonl((u32_t)now);
+    rpmsg_sendto(&net_capture.ept, &reply, sizeof(reply), net_capture.dst);
+}
+
+#if LWIP_CAPTURE
+/* Send what has been collected in net_capture.msg, if anything */
+static void net_capture_flush(u16_t* off)
+{
+    struct net_capture_data* data = (struct net_capture_data*)net_capture.msg;
+    struct capture_stats stats;
+
+    if (*off <= sizeof(*data)) {
+        return;
+    }
+    capture_get_stats(&stats, 0);
+    data->magic = lwip_htonl(NET_CAPTURE_DATA_MAGIC);
+    data->dropped = lwip_htonl(stats.dropped);
+    rpmsg_sendto(&net_capture.ept, net_capture.msg, *off, net_capture.dst);
+    *off = sizeof(*data);
+}
+
+/* Move everything in the ring to the host, as few messages as possible */
+static void net_capture_drain(void)
+{
+    struct capture_record record;
+    struct net_capture_rec* rec;
+    u16_t off = sizeof(struct net_capture_data);
+
+    for (;;) {
+        /* there must be room for the longest record before one is taken out of the ring */
+        if ((size_t)(net_capture.msg_size - off) < sizeof(*rec) + net_capture.snaplen) {
+            net_capture_flush(&off);
+        }
+        rec = (struct net_capture_rec*)(net_capture.msg + off);
+        if (!capture_read(&record, rec + 1, net_capture.snaplen)) {
+            break;
+        }
+        rec->ts_sec = lwip_htonl((u32_t)(record.ts_us / 1000000));
+        rec->ts_usec = lwip_htonl((u32_t)(record.ts_us % 1000000));
+        rec->caplen = lwip_htons(record.caplen);
+        rec->len = lwip_htons(record.len);
+        rec->dir = record.dir;
+        memset(rec->pad, 0, sizeof(rec->pad));
+        off = (u16_t)(off + ((sizeof(*rec) + record.caplen + 3) & ~3U));
+    }
+    net_capture_flush(&off);
+}
+
+static u16_t net_capture_start_cmd(const struct net_capture_request* req, u16_t len, u16_t* linktype)
+{
+    static struct capture_insn prog[CAPTURE_MAX_INSNS];
+    struct capture_record record;
+    u16_t count = lwip_ntohs(req->count);
+    u16_t snaplen = lwip_ntohs(req->snaplen);
+    u16_t max = (u16_t)(net_capture.msg_size - sizeof(struct net_capture_data) - sizeof(struct net_capture_rec));
+    struct netif* netif;
+    u16_t i;
+    int ret;
+
+    if (count > CAPTURE_MAX_INSNS || len < sizeof(*req) + count * sizeof(req->insns[0])) {
+        return NET_CAPTURE_EINVAL;
+    }
+    for (i = 0; i < count; i++) {
+        prog[i].code = lwip_ntohs(req->insns[i].code);
+        prog[i].jt = req->insns[i].jt;
+        prog[i].jf = req->insns[i].jf;
+        prog[i].k = lwip_ntohl(req->insns[i].k);
+    }
+    if (snaplen == 0 || snaplen > max) {
+        snaplen = max;
+    }
+
+    LOCK_TCPIP_CORE();
+    netif = netif_get_by_index((u8_t)lwip_ntohs(req->ifindex));
+    if (netif == NULL) {
+        UNLOCK_TCPIP_CORE();
+        return NET_CAPTURE_ENODEV;
+    }
+    *linktype = (netif->flags & NETIF_FLAG_ETHARP) ? NET_CAPTURE_LINKTYPE_ETHERNET : NET_CAPTURE_LINKTYPE_RAW;
+    /* records of an earlier capture are of no use to anyone */
+    capture_stop();
+    while (capture_read(&record, net_capture.msg, net_capture.msg_size)) {
+        continue;
+    }
+    ret = capture_start(netif, prog, count, snaplen);
+    UNLOCK_TCPIP_CORE();
+    if (ret != 0) {
+        return NET_CAPTURE_EFILTER;
+    }
+
+    net_capture.snaplen = snaplen;
+    net_capture.running = 1;
+    return NET_CAPTURE_OK;
+}
+#endif /* LWIP_CAPTURE */
+
+static void net_capture_control(const struct net_capture_request* req, u16_t len)
+{
+    u16_t status = NET_CAPTURE_EINVAL;
+    u16_t linktype = 0;
+    u16_t cmd = 0;
+
+    if (len >= sizeof(*req) && lwip_ntohl(req->magic) == NET_CAPTURE_MAGIC) {
+        cmd = lwip_ntohs(req->cmd);
+#if LWIP_CAPTURE
+        if (cmd == NET_CAPTURE_CMD_START) {
+            status = net_capture_start_cmd(req, len, &linktype);
+        } else if (cmd == NET_CAPTURE_CMD_STOP) {
+            capture_stop();
+            net_capture.running = 0;
+            /* the reply comes after the last record */
+            net_capture_drain();
+            status = NET_CAPTURE_OK;
+        }
+#else
+        status = NET_CAPTURE_ENOTSUP;
+#endif
+    }
+    net_capture_reply(cmd, status, linktype);
+}
+
+static void net_capture_thread(void* arg)
+{
+    (void)arg;
+
+    for (;;) {
+        sys_arch_sem_wait(&net_capture.wakeup, NET_CAPTURE_POLL_MS);
+        if (net_capture.req_len != 0) {
+            net_capture_control((const struct net_capture_request*)net_capture.req, net_capture.req_len);
+            net_capture.req_len = 0;
+        }
+#if LWIP_CAPTURE
+        if (net_capture.running) {
+            net_capture_drain();
+        }
+#endif
+    }
+}
+
+static int net_capture_ept_cb(struct rpmsg_endpoint* ept, void* data, size_t len, uint32_t src, void* priv)
+{
+    (void)ept;
+    (void)priv;
+
+    /* a request while the last one is still being handled is dropped, the tool retries */
+    if (net_capture.req_len == 0 && len > 0 && len <= net_capture.msg_size) {
+        memcpy(net_capture.req, data, len);
+        net_capture.dst = src;
+        net_capture.req_len = (u16_t)len;
+        sys_sem_signal(&net_capture.wakeup);
+    }
+    return RPMSG_SUCCESS;
+}
+
+static void net_capture_ept_unbind(struct rpmsg_endpoint* ept)
+{
+    (void)ept;
+
+    /* the tool went away without STOP */
+#if LWIP_CAPTURE
+    capture_stop();
+#endif
+    net_capture.running = 0;
+    net_capture.dst = RPMSG_ADDR_ANY;
+}
+
+int net_capture_start(struct rpmsg_device* rpdev)
+{
+    int buf_size;
+
+    if (net_capture.msg != NULL) {
+        return 0;
+    }
+
+    buf_size = rpmsg_virtio_get_buffer_size(rpdev);
+    if (buf_size <= (int)(sizeof(struct net_capture_data) + sizeof(struct net_capture_rec))) {
+        return -1;
+    }
+    net_capture.msg_size = (u16_t)LWIP_MIN(buf_size, 0xFFFF);
+    net_capture.dst = RPMSG_ADDR_ANY;
+    net_capture.msg = mem_malloc(net_capture.msg_size);
+    net_capture.req = mem_malloc(net_capture.msg_size);
+    if (net_capture.msg == NULL || net_capture.req == NULL ||
+        sys_sem_new(&net_capture.wakeup, 0) != ERR_OK) {
+        goto err;
+    }
+    if (rpmsg_create_ept(&net_capture.ept, rpdev, "rpmsg-capture", NET_CAPTURE_EPT_ADDR, RPMSG_ADDR_ANY,
+                         net_capture_ept_cb, net_capture_ept_unbind) != RPMSG_SUCCESS) {
+        sys_sem_free(&net_capture.wakeup);
+        goto err;
+    }
+    if (sys_thread_new("net_capture", net_capture_thread, NULL, NET_CAPTURE_THREAD_STACKSIZE,
+                       NET_CAPTURE_THREAD_PRIO) == NULL) {
+        rpmsg_destroy_ept(&net_capture.ept);
+        sys_sem_free(&net_capture.wakeup);
+        goto err;
+    }
+    return 0;
+
+err:
+    mem_free(net_capture.msg);
+    mem_free(net_capture.req);
+    net_capture.msg = NULL;
+    net_capture.req = NULL;
+    return -1;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "lwip/arch.h"
+
+struct rpmsg_device;
+
+/* Packet capture for linux/capture/rpmsg_pcap: the tool asks over a dedicated RPMsg endpoint for
+ * the frames of one netif, with a tcpdump -ddd filter, and gets them back as pcap records. The
+ * tap itself is arch/capture.h, so the firmware must be built with LWIP_CAPTURE. The endpoint
+ * has a fixed address, the Linux side binds to it through /dev/rpmsg_ctrl. */
+#define NET_CAPTURE_EPT_ADDR 0x4350
+
+/* Create the endpoint and the thread that drains the trace ring. Call after network_init(),
+ * from any task. Returns 0 on success. */
+int net_capture_start(struct rpmsg_device* rpdev);
@@ -0,0 +1,265 @@
+#include <stddef.h>
+#include <string.h>
+
+#include <openamp/open_amp.h>
+
+#include "lwip/mem.h"
+#include "lwip/memp.h"
+#include "lwip/priv/memp_priv.h"
+#include "lwip/stats.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+
+#include "net_footprint.h"
+
+/* Protocol, all fields in network order. Keep in sync with linux/footprint/rpmsg_footprint.c. */
+#define NET_FOOTPRINT_MAGIC 0x52465054UL    // "RFPT", requests and replies
+#define NET_FOOTPRINT_CMD_GET 1             // entries from index on, as many as fit a message
+#define NET_FOOTPRINT_CMD_RESET 2           // start the high-water marks and errors over
+
+#define NET_FOOTPRINT_OK 0
+#define NET_FOOTPRINT_EINVAL 1              // malformed request
+
+#define NET_FOOTPRINT_POOL 0                // memp pool: size of an element, avail elements
+#define NET_FOOTPRINT_HEAP 1                // mem_malloc heap: size 1, avail bytes
+#define NET_FOOTPRINT_MBOX 2                // mailboxes of one depth created by one task: size the
+                                            // depth, avail the number of them, used not tracked
+
+#define NET_FOOTPRINT_NAME_LEN 16           // not NUL terminated when the name fills it
+
+struct net_footprint_request {
+    u32_t magic;
+    u16_t cmd;
+    u16_t index;            // GET: first entry wanted
+};
+
+struct net_footprint_entry {
+    char name[NET_FOOTPRINT_NAME_LEN];
+    u8_t kind;              // NET_FOOTPRINT_POOL/HEAP/MBOX
+    u8_t reserved;
+    u16_t size;
+    u32_t avail;
+    u32_t used;
+    u32_t max;              // high-water mark of used since boot or the last RESET
+    u32_t err;              // failed allocations or posts since then
+};
+
+struct net_footprint_reply {
+    u32_t magic;
+    u16_t cmd;
+    u16_t status;           // NET_FOOTPRINT_OK or NET_FOOTPRINT_E*
+    u16_t index;            // of the first entry in this reply
+    u16_t count;            // entries in this reply
+    u16_t total;            // entries there are
+    u16_t reserved;
+    struct net_footprint_entry entries[];
+};
+
+struct net_footprint {
+    struct rpmsg_endpoint ept;
+    u8_t* msg;
+    u16_t msg_size;
+    u32_t dst;
+    /* one request at a time, handed from the endpoint callback to the tcpip thread */
+    volatile u8_t pending;
+    struct net_footprint_request req;
+};
+
+static struct net_footprint net_footprint;
+
+#if MEMP_STATS
+static const char* const net_footprint_pool_names[] = {
+#define LWIP_MEMPOOL(name, num, size, desc) #name,
+#include "lwip/priv/memp_std.h"
+};
+#define NET_FOOTPRINT_NUM_POOLS MEMP_MAX
+#else
+#define NET_FOOTPRINT_NUM_POOLS 0
+#endif
+
+#define NET_FOOTPRINT_NUM_HEAP MEM_STATS
+
+static void net_footprint_fill(struct net_footprint_entry* e, const char* name, u8_t kind, u16_t size,
+                               u32_t avail, u32_t used, u32_t max, u32_t err)
+{
+    memset(e, 0, sizeof(*e));
+    strncpy(e->name, name, sizeof(e->name));
+    e->kind = kind;
+    e->size = lwip_htons(size);
+    e->avail = lwip_htonl(avail);
+    e->used = lwip_htonl(used);
+    e->max = lwip_htonl(max);
+    e->err = lwip_htonl(err);
+}
+
+#if SYS_ARCH_STATS
+/* The n-th sys_arch statistics entry that counts mailboxes */
+static int net_footprint_mbox(int n, struct sys_arch_stats* stats)
+{
+    int i;
+
+    for (i = 0; sys_arch_stats_get(i, stats) == 0; i++) {
+        if (stats->type == SYS_ARCH_STATS_MBOX && n-- == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+#endif
+
+static u16_t net_footprint_total(void)
+{
+    u16_t total = NET_FOOTPRINT_NUM_POOLS + NET_FOOTPRINT_NUM_HEAP;
+#if SYS_ARCH_STATS
+    struct sys_arch_stats stats;
+
+    while (net_footprint_mbox(total - NET_FOOTPRINT_NUM_POOLS - NET_FOOTPRINT_NUM_HEAP, &stats) == 0) {
+        total++;
+    }
+#endif
+    return total;
+}
+
+/* Entry index of the report, returns 0 past the last one */
+static int net_footprint_entry(u16_t index, struct net_footprint_entry* e)
+{
+#if MEMP_STATS
+    if (index < NET_FOOTPRINT_NUM_POOLS) {
+        const struct memp_desc* desc = memp_pools[index];
+        struct stats_mem stats;
+        SYS_ARCH_DECL_PROTECT(lev);
+
+        SYS_ARCH_PROTECT(lev);
+        stats = *desc->stats;
+        SYS_ARCH_UNPROTECT(lev);
+        net_footprint_fill(e, net_footprint_pool_names[index], NET_FOOTPRINT_POOL, desc->size, stats.avail,
+                           stats.used, stats.max, stats.err);
+        return 1;
+    }
+#endif
+    index = (u16_t)(index - NET_FOOTPRINT_NUM_POOLS);
+#if MEM_STATS
+    if (index == 0) {
+        net_footprint_fill(e, "MEM_HEAP", NET_FOOTPRINT_HEAP, 1, (u32_t)lwip_stats.mem.avail,
+                           (u32_t)lwip_stats.mem.used, (u32_t)lwip_stats.mem.max, lwip_stats.mem.err);
+        return 1;
+    }
+#endif
+    index = (u16_t)(index - NET_FOOTPRINT_NUM_HEAP);
+#if SYS_ARCH_STATS
+    {
+        struct sys_arch_stats stats;
+
+        if (net_footprint_mbox(index, &stats) == 0) {
+            net_footprint_fill(e, stats.name, NET_FOOTPRINT_MBOX, stats.size, stats.created, 0,
+                               stats.max_used, stats.full);
+            return 1;
+        }
+    }
+#endif
+    return 0;
+}
+
+static void net_footprint_reset(void)
+{
+#if MEMP_STATS
+    SYS_ARCH_DECL_PROTECT(lev);
+    u16_t i;
+
+    SYS_ARCH_PROTECT(lev);
+    for (i = 0; i < NET_FOOTPRINT_NUM_POOLS; i++) {
+        memp_pools[i]->stats->max = memp_pools[i]->stats->used;
+        memp_pools[i]->stats->err = 0;
+    }
+    SYS_ARCH_UNPROTECT(lev);
+#endif
+#if MEM_STATS
+    lwip_stats.mem.max = lwip_stats.mem.used;
+    lwip_stats.mem.err = 0;
+#endif
+#if SYS_ARCH_STATS
+    sys_arch_stats_reset();
+#endif
+}
+
+/* Runs in the tcpip thread, the heap statistics are only touched there or under its lock */
+static void net_footprint_handle(void* arg)
+{
+    struct net_footprint_reply* reply = (struct net_footprint_reply*)net_footprint.msg;
+    const struct net_footprint_request* req = &net_footprint.req;
+    u16_t max = (u16_t)((net_footprint.msg_size - sizeof(*reply)) / sizeof(reply->entries[0]));
+    u16_t cmd = lwip_ntohs(req->cmd);
+    u16_t index = lwip_ntohs(req->index);
+    u16_t count = 0;
+    u16_t status = NET_FOOTPRINT_OK;
+
+    LWIP_UNUSED_ARG(arg);
+
+    if (lwip_ntohl(req->magic) != NET_FOOTPRINT_MAGIC) {
+        status = NET_FOOTPRINT_EINVAL;
+    } else if (cmd == NET_FOOTPRINT_CMD_RESET) {
+        net_footprint_reset();
+    } else if (cmd == NET_FOOTPRINT_CMD_GET) {
+        while (count < max && net_footprint_entry((u16_t)(index + count), &reply->entries[count])) {
+            count++;
+        }
+    } else {
+        status = NET_FOOTPRINT_EINVAL;
+    }
+
+    reply->magic = lwip_htonl(NET_FOOTPRINT_MAGIC);
+    reply->cmd = lwip_htons(cmd);
+    reply->status = lwip_htons(status);
+    reply->index = lwip_htons(index);
+    reply->count = lwip_htons(count);
+    reply->total = lwip_htons(net_footprint_total());
+    reply->reserved = 0;
+    rpmsg_sendto(&net_footprint.ept, reply, (int)(sizeof(*reply) + count * sizeof(reply->entries[0])),
+                 net_footprint.dst);
+    net_footprint.pending = 0;
+}
+
+static int net_footprint_ept_cb(struct rpmsg_endpoint* ept, void* data, size_t len, uint32_t src, void* priv)
+{
+    (void)ept;
+    (void)priv;
+
+    /* a request while the last one is still being handled is dropped, the tool retries */
+    if (net_footprint.pending || len < sizeof(net_footprint.req)) {
+        return RPMSG_SUCCESS;
+    }
+    memcpy(&net_footprint.req, data, sizeof(net_footprint.req));
+    net_footprint.dst = src;
+    net_footprint.pending = 1;
+    if (tcpip_try_callback(net_footprint_handle, NULL) != ERR_OK) {
+        net_footprint.pending = 0;
+    }
+    return RPMSG_SUCCESS;
+}
+
+int net_footprint_start(struct rpmsg_device* rpdev)
+{
+    int buf_size;
+
+    if (net_footprint.msg != NULL) {
+        return 0;
+    }
+
+    buf_size = rpmsg_virtio_get_buffer_size(rpdev);
+    if (buf_size < (int)(sizeof(struct net_footprint_reply) + sizeof(struct net_footprint_entry))) {
+        return -1;
+    }
+    net_footprint.msg_size = (u16_t)LWIP_MIN(buf_size, 0xFFFF);
+    net_footprint.dst = RPMSG_ADDR_ANY;
+    net_footprint.msg = mem_malloc(net_footprint.msg_size);
+    if (net_footprint.msg == NULL) {
+        return -1;
+    }
+    if (rpmsg_create_ept(&net_footprint.ept, rpdev, "rpmsg-footprint", NET_FOOTPRINT_EPT_ADDR,
+                         RPMSG_ADDR_ANY, net_footprint_ept_cb, NULL) != RPMSG_SUCCESS) {
+        mem_free(net_footprint.msg);
+        net_footprint.msg = NULL;
+        return -1;
+    }
+    return 0;
+}
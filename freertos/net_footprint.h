@@ -0,0 +1,16 @@
+#pragma once
+
+#include "lwip/arch.h"
+
+struct rpmsg_device;
+
+/* Memory footprint report for linux/footprint/rpmsg_footprint: used, high-water mark and
+ * allocation failures of every memp pool, of the mem_malloc heap and, with SYS_ARCH_STATS, of the
+ * sys_arch mailboxes, read over a dedicated RPMsg endpoint. The pools need MEMP_STATS and the
+ * heap MEM_STATS, both on by default with LWIP_STATS. The endpoint has a fixed address, the Linux
+ * side binds to it through /dev/rpmsg_ctrl. */
+#define NET_FOOTPRINT_EPT_ADDR 0x4650
+
+/* Create the endpoint. Requests are answered from the tcpip thread, so call after
+ * network_init(), from any task. Returns 0 on success. */
+int net_footprint_start(struct rpmsg_device* rpdev);
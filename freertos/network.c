@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -9,33 +10,57 @@
 
 #include "network.h"
 
-static struct netif server_netif;
+static struct netif server_netifs[NETWORK_MAX_NETIFS];
 
-int network_init(struct rpmsg_device *rdev)
+int network_init_multi(const struct network_if_config* configs, int count)
 {
+    int i;
+
+    if (configs == NULL || count <= 0 || count > NETWORK_MAX_NETIFS) {
+        return -1;
+    }
+
     /* initialize lwIP before calling sys_thread_new */
     lwip_init();
 
-    struct netif* netif = &server_netif;
+    /* tcpip_thread is running from here on, the netif calls need the core lock */
+    LOCK_TCPIP_CORE();
+    for (i = 0; i < count; i++) {
+        struct netif* netif = &server_netifs[i];
 
-    ip_addr_t ipaddr, netmask, gw;
-    IP4_ADDR(&ipaddr, 10, 43, 0, 3);
-    IP4_ADDR(&netmask, 255, 255, 0, 0);
-    IP4_ADDR(&gw, 10, 43, 0, 1);
+        /* Add network interface to the netif_list, each one gets its own endpoints and queues */
+        if (netif_add(netif,
+                ip_2_ip4(&configs[i].ipaddr),
+                ip_2_ip4(&configs[i].netmask),
+                ip_2_ip4(&configs[i].gw),
+                (void*)&configs[i].eth,
+                rpmsg_eth_init,
+                tcpip_input) == NULL) {
+            UNLOCK_TCPIP_CORE();
+            return -1;
+        }
 
-    /* Add network interface to the netif_list */
-    netif_add(netif,
-        &ipaddr,
-        &netmask,
-        &gw,
-        rdev,
-        rpmsg_eth_init,
-        tcpip_input);
+        if (i == 0) {
+            netif_set_default(netif);
+        }
 
-    netif_set_default(netif);
-
-    /* specify that the network if is up */
-    netif_set_up(netif);
+        /* specify that the network if is up */
+        netif_set_up(netif);
+    }
+    UNLOCK_TCPIP_CORE();
 
     return 0;
 }
+
+int network_init(struct rpmsg_device *rdev)
+{
+    struct network_if_config config;
+
+    memset(&config, 0, sizeof(config));
+    config.eth.rdev = rdev;
+    IP4_ADDR(ip_2_ip4(&config.ipaddr), 10, 43, 0, 3);
+    IP4_ADDR(ip_2_ip4(&config.netmask), 255, 255, 0, 0);
+    IP4_ADDR(ip_2_ip4(&config.gw), 10, 43, 0, 1);
+
+    return network_init_multi(&config, 1);
+}
@@ -2,4 +2,23 @@
 
 #include <openamp/open_amp.h>
 
-int network_init(struct rpmsg_device *rdev);
\ No newline at end of file
+#include "lwip/ip_addr.h"
+#include "rpmsg_eth.h"
+
+/* Upper bound on rpmsg_eth interfaces, one per remoteproc channel */
+#ifndef NETWORK_MAX_NETIFS
+#define NETWORK_MAX_NETIFS 4
+#endif
+
+struct network_if_config {
+    struct rpmsg_eth_config eth;    // link settings, eth.rdev is the channel
+    ip_addr_t ipaddr;
+    ip_addr_t netmask;
+    ip_addr_t gw;
+};
+
+/* Bring up one rpmsg_eth netif per entry, the first one becomes the default */
+int network_init_multi(const struct network_if_config* configs, int count);
+
+/* Single interface on 10.43.0.3/16 */
+int network_init(struct rpmsg_device *rdev);
@@ -2,6 +2,7 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -14,55 +15,862 @@
 #include <metal/version.h>
 
 #include "lwip/etharp.h"
+#include "lwip/ethip6.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/memp.h"
 #include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/snmp.h"
+#include "lwip/stats.h"
 #include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/priv/tcpip_priv.h"
+#include "lwip/prot/icmp.h"
+#include "lwip/prot/icmp6.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/ip6.h"
+#include "lwip/prot/udp.h"
+#include "netif/ethernet.h"
+#include "arch/capture.h"
 
 // The OpenAMP message size is limited by the buffer size defined in the rpmsg kernel module.
 // For the Linux 4.19 kernel, this is currently defined as 512 bytes with 16 bytes
-// for the message header and 496 bytes of payload.
+// for the message header and 496 bytes of payload. The actual size is taken from
+// rpmsg_virtio_get_buffer_size() at init time; this is only the fallback if that fails.
 #define RPMSG_SIZE 496
 
-//MAC ADDRESS is 6 (DEST MAC ADDRESS) +6 (SORUCE MAC ADDRESS) +2 (EtherTYPE)
-//Next release will remove the MAC ADDRESS info, it is not needed
-#define MTU_RPMSG (RPMSG_SIZE - 6 - 6 - 2)
+// Every RPMsg message starts with this link header, so that one Ethernet frame can be spread over
+// several RPMsg buffers. Fragments of a frame are always sent back to back and in offset order.
+// Must match struct rpmsg_eth_frag_hdr in the Linux driver.
+struct rpmsg_eth_frag_hdr {
+    uint16_t frame_len; // total length of the Ethernet frame, network byte order
+    uint16_t offset;    // offset of this fragment's payload inside the frame, network byte order
+};
+
+// Instead of 0, the offset of a frame's first record when a 32 bit flow hash in network byte order
+// follows the link header, ahead of the payload. No real fragment has it, frame_len being at most
+// 0xFFFF. Only sent to a host that advertised RPMSG_ETH_F_HASH; the hash is never 0.
+#define RPMSG_ETH_HASH_OFFSET 0xFFFF
+
+// A link header with frame_len 0 starts a control message instead of a frame; the 32 bit magic
+// after it tells which one, see the *_MAGIC defines below. The first is the hello: the host sends
+// it on every endpoint at probe time and we answer on queue 0 with our own. Each side only turns
+// on what the other one advertised. All fields are in network byte order. Must match struct
+// rpmsg_eth_hello in the Linux driver; later versions may append fields.
+#define RPMSG_ETH_HELLO_MAGIC   0x52455448 // "RETH"
+#define RPMSG_ETH_HELLO_VERSION 1
+
+// feature bits, each telling what the sender of the hello is able to receive
+#define RPMSG_ETH_F_PACK 0x00000001UL // several whole frames packed into one message
+#define RPMSG_ETH_F_CSUM 0x00000002UL // checksum-free mode, active only when both hellos carry it
+#define RPMSG_ETH_F_TSO  0x00000004UL // TCP super-frames larger than the MTU, up to tso_max
+#define RPMSG_ETH_F_RAW  0x00000008UL // bare IP packets instead of frames, active only when both hellos carry it
+#define RPMSG_ETH_F_TSTAMP 0x00000010UL // timestamp messages are understood
+#define RPMSG_ETH_F_MCAST  0x00000020UL // multicast filter messages are understood and applied
+#define RPMSG_ETH_F_STATS  0x00000040UL // statistics requests are understood
+#define RPMSG_ETH_F_COALESCE 0x00000080UL // coalescing messages are understood and applied
+#define RPMSG_ETH_F_PRIO   0x00000100UL // frames from urgent queues overtake the others
+#define RPMSG_ETH_F_HASH   0x00000200UL // first records may carry a flow hash, see RPMSG_ETH_HASH_OFFSET
+#define RPMSG_ETH_F_MTU    0x00000400UL // MTU messages are understood and applied
+
+PACK_STRUCT_BEGIN
+struct rpmsg_eth_hello {
+    PACK_STRUCT_FIELD(struct rpmsg_eth_frag_hdr hdr); // frame_len and offset are 0
+    PACK_STRUCT_FIELD(uint32_t magic);
+    PACK_STRUCT_FIELD(uint16_t version);
+    PACK_STRUCT_FIELD(uint16_t mtu);        // link MTU of the sender
+    PACK_STRUCT_FIELD(uint16_t buf_size);   // largest message the sender can receive, link header included
+    PACK_STRUCT_FLD_8(uint8_t num_queues);  // number of endpoints of the sender
+    PACK_STRUCT_FLD_8(uint8_t reserved);
+    PACK_STRUCT_FIELD(uint32_t features);   // RPMSG_ETH_F_*
+    PACK_STRUCT_FLD_8(uint8_t mac[6]);      // MAC address of the sender's interface
+    PACK_STRUCT_FIELD(uint16_t tso_max);    // largest frame accepted with RPMSG_ETH_F_TSO, Ethernet header included
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+// Shared-memory transport, see RPMSG_ETH_SHM below. Ring 0 carries frames from the host to us,
+// ring 1 the other way. The offer and the doorbell are control messages in network byte order;
+// the control blocks and slots in the region are in CPU byte order, i.e. little endian like the
+// host. Must match the shared-memory part of the Linux driver.
+#define RPMSG_ETH_SHM_MAGIC      0x5253484D // "RSHM"
+#define RPMSG_ETH_DOORBELL_MAGIC 0x5244424C // "RDBL"
+
+PACK_STRUCT_BEGIN
+struct rpmsg_eth_shm_offer {
+    PACK_STRUCT_FIELD(struct rpmsg_eth_frag_hdr hdr); // frame_len and offset are 0
+    PACK_STRUCT_FIELD(uint32_t magic);
+    PACK_STRUCT_FIELD(uint32_t addr_lo);    // physical address of the region, as seen by the host
+    PACK_STRUCT_FIELD(uint32_t addr_hi);
+    PACK_STRUCT_FIELD(uint32_t size);       // size of the whole region
+    PACK_STRUCT_FIELD(uint32_t ring_size);  // data bytes per ring, a power of two
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+// "look at the rings": new frames on a ring whose consumer asked for it, or room on a ring whose
+// producer asked for it
+PACK_STRUCT_BEGIN
+struct rpmsg_eth_doorbell {
+    PACK_STRUCT_FIELD(struct rpmsg_eth_frag_hdr hdr); // frame_len and offset are 0
+    PACK_STRUCT_FIELD(uint32_t magic);
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+// Timestamps of the next frame completed on the same endpoint, in ticks of the ARM generic timer's
+// system counter, which both cores read. Sent for sampled frames right before their first message,
+// never for frames going through the shared-memory rings.
+#define RPMSG_ETH_TSTAMP_MAGIC 0x52545350 // "RTSP"
+
+PACK_STRUCT_BEGIN
+struct rpmsg_eth_tstamp {
+    PACK_STRUCT_FIELD(struct rpmsg_eth_frag_hdr hdr); // frame_len and offset are 0
+    PACK_STRUCT_FIELD(uint32_t magic);
+    PACK_STRUCT_FIELD(uint32_t hz);         // counter frequency, stamps are dropped if it differs
+    PACK_STRUCT_FIELD(uint32_t xmit_hi);    // frame handed to the driver
+    PACK_STRUCT_FIELD(uint32_t xmit_lo);
+    PACK_STRUCT_FIELD(uint32_t send_hi);    // first message of the frame handed to RPMsg
+    PACK_STRUCT_FIELD(uint32_t send_lo);
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+// The multicast addresses we want to receive, replacing the list sent before. The host drops other
+// multicast frames before they take a buffer on the link; broadcasts always pass. With
+// RPMSG_ETH_MCAST_ALL, or until the first list arrives, it passes all of them. Sent when the host
+// advertised RPMSG_ETH_F_MCAST, after every hello and every change.
+#define RPMSG_ETH_MCAST_MAGIC 0x524D4346 // "RMCF"
+#define RPMSG_ETH_MCAST_ALL   0x01
+
+PACK_STRUCT_BEGIN
+struct rpmsg_eth_mcast_filter {
+    PACK_STRUCT_FIELD(struct rpmsg_eth_frag_hdr hdr); // frame_len and offset are 0
+    PACK_STRUCT_FIELD(uint32_t magic);
+    PACK_STRUCT_FIELD(uint16_t count);      // number of addresses following
+    PACK_STRUCT_FLD_8(uint8_t flags);       // RPMSG_ETH_MCAST_*
+    PACK_STRUCT_FLD_8(uint8_t reserved);
+    /* count MAC addresses of 6 bytes follow */
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+// Statistics of our stack, for the host's ethtool -S. The host sends the bare header, on queue 0
+// and only if we advertised RPMSG_ETH_F_STATS, and we answer with count counters in the order of
+// rpmsg_eth_stats_fill(). A host that knows fewer ignores the rest, one that knows more reads 0.
+#define RPMSG_ETH_STATS_MAGIC 0x52535441 // "RSTA"
+
+PACK_STRUCT_BEGIN
+struct rpmsg_eth_stats {
+    PACK_STRUCT_FIELD(struct rpmsg_eth_frag_hdr hdr); // frame_len and offset are 0
+    PACK_STRUCT_FIELD(uint32_t magic);
+    PACK_STRUCT_FIELD(uint16_t count);      // number of 32 bit counters following, 0 in a request
+    PACK_STRUCT_FIELD(uint16_t reserved);
+    /* count counters follow */
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+// The host's ethtool -C rx-usecs and rx-frames, i.e. how we coalesce what we send it, see
+// rpmsg_eth_set_tx_coalesce(). Sent after every hello that advertised RPMSG_ETH_F_COALESCE and
+// on every change.
+#define RPMSG_ETH_COALESCE_MAGIC 0x52434F41 // "RCOA"
+
+PACK_STRUCT_BEGIN
+struct rpmsg_eth_coalesce {
+    PACK_STRUCT_FIELD(struct rpmsg_eth_frag_hdr hdr); // frame_len and offset are 0
+    PACK_STRUCT_FIELD(uint32_t magic);
+    PACK_STRUCT_FIELD(uint32_t usecs);      // hold frames back at most this long, 0 for off
+    PACK_STRUCT_FIELD(uint16_t frames);     // or until this many are queued
+    PACK_STRUCT_FIELD(uint16_t reserved);
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+// Which of our endpoints carry the host's urgent traffic, the top class of its mqprio setup. Sent
+// after every hello that advertised RPMSG_ETH_F_PRIO and on every change.
+#define RPMSG_ETH_PRIO_MAGIC 0x52505249 // "RPRI"
+
+PACK_STRUCT_BEGIN
+struct rpmsg_eth_prio {
+    PACK_STRUCT_FIELD(struct rpmsg_eth_frag_hdr hdr); // frame_len and offset are 0
+    PACK_STRUCT_FIELD(uint32_t magic);
+    PACK_STRUCT_FIELD(uint32_t urgent);     // bit N set for queue N, 0 for none
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+// The host's MTU after ip link set mtu, which our netif follows up to our own. Sent on every
+// change and after every hello that advertised RPMSG_ETH_F_MTU.
+#define RPMSG_ETH_MTU_MAGIC 0x524D5455 // "RMTU"
+
+PACK_STRUCT_BEGIN
+struct rpmsg_eth_mtu {
+    PACK_STRUCT_FIELD(struct rpmsg_eth_frag_hdr hdr); // frame_len and offset are 0
+    PACK_STRUCT_FIELD(uint32_t magic);
+    PACK_STRUCT_FIELD(uint16_t mtu);
+    PACK_STRUCT_FIELD(uint16_t reserved);
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+// Control block of one ring; ring 0's is at the start of the region, ring 1's right after it, then
+// the data areas of ring 0 and ring 1. head and tail are free running byte counters.
+struct rpmsg_eth_shm_ring {
+    uint32_t head;          // written by the producer only
+    uint32_t prod_wait;     // set by the producer when the ring was full, cleared by the consumer
+    uint32_t reserved0[14];
+    uint32_t tail;          // written by the consumer only
+    uint32_t cons_wait;     // set by the consumer when the ring was empty, cleared by the producer
+    uint32_t reserved1[14];
+};
+
+// Every frame in a data area is a slot header followed by the frame, padded to
+// RPMSG_ETH_SHM_ALIGN. A slot with RPMSG_ETH_SHM_WRAP has no frame; the rest of the data area up
+// to its end is unused.
+struct rpmsg_eth_shm_slot {
+    uint16_t len;
+    uint16_t flags;
+};
+
+#define RPMSG_ETH_SHM_ALIGN 8
+#define RPMSG_ETH_SHM_WRAP  0x0001
+
+// Since frames are fragmented, the MTU is no longer bound to the RPMsg buffer size. The netif
+// MTU is lowered to the host's once its hello arrives, if that is smaller. 0 derives it from the
+// buffer size: the largest frame that fits into one message, but never below 1500.
+#ifndef RPMSG_ETH_MTU
+#define RPMSG_ETH_MTU 0
+#endif
+
+// When set, received fragments are not copied out of shared memory. The RPMsg buffer is held and
+// wrapped in a custom pbuf, and handed back to the vring once lwIP frees that pbuf. Needs an
+// OpenAMP release with rpmsg_hold_rx_buffer().
+#ifndef RPMSG_ETH_ZERO_COPY_RX
+#define RPMSG_ETH_ZERO_COPY_RX 0
+#endif
+
+// Maximum number of RPMsg RX buffers lwIP may hold at once in zero-copy mode. Every held buffer is
+// one less buffer the host can transmit into, so keep this well below the vring size. Fragments
+// arriving while all of them are in use are copied instead.
+#ifndef RPMSG_ETH_RX_PBUF_NUM
+#define RPMSG_ETH_RX_PBUF_NUM 32
+#endif
+
+// When set, outgoing fragments are gathered straight into a vring TX buffer obtained with
+// rpmsg_get_tx_payload_buffer() and committed with rpmsg_send_nocopy(), instead of being staged
+// in tx_buf and copied again by rpmsg_send().
+#ifndef RPMSG_ETH_NOCOPY_TX
+#define RPMSG_ETH_NOCOPY_TX 0
+#endif
+
+// Frames that find the vring full are queued (and pbuf_ref'd) instead of dropped. Once the queue
+// is full, low_level_output() returns ERR_MEM so TCP keeps the segment and retries it later.
+// The queue is flushed on the next output and every RPMSG_ETH_TX_RETRY_MS while non-empty;
+// OpenAMP gives the remote side no notification when the host gives TX buffers back.
+// rpmsg_eth_config.tx_queue_len may lower this per interface.
+#ifndef RPMSG_ETH_TX_QUEUE_LEN
+#define RPMSG_ETH_TX_QUEUE_LEN 32
+#endif
+
+#ifndef RPMSG_ETH_TX_RETRY_MS
+#define RPMSG_ETH_TX_RETRY_MS 1
+#endif
+
+// When set, the queued frames that fit are packed back to back into one RPMsg buffer when the
+// TX queue is drained, each behind its own link header, once the host has advertised
+// RPMSG_ETH_F_PACK in its hello. Received packed messages are always accepted.
+#ifndef RPMSG_ETH_TX_PACK
+#define RPMSG_ETH_TX_PACK 1
+#endif
+
+// When set, the first record of every TCP or UDP frame we send carries a hash of its flow, once
+// the host has advertised RPMSG_ETH_F_HASH. The host sets it as the skb's L4 hash, which steers
+// RPS and RFS without a flow dissection of its own. Frames through the shared-memory rings go
+// without.
+#ifndef RPMSG_ETH_FLOW_HASH
+#define RPMSG_ETH_FLOW_HASH 1
+#endif
+
+// The link is shared memory and cannot corrupt frames. In checksum-free mode neither side fills in
+// TCP/UDP checksums for the other; the host fills them in for frames it forwards. Needs
+// LWIP_CHECKSUM_CTRL_PER_NETIF, so that only this netif stops generating and checking them.
+#ifndef RPMSG_ETH_CSUM_OFFLOAD
+#define RPMSG_ETH_CSUM_OFFLOAD LWIP_CHECKSUM_CTRL_PER_NETIF
+#endif
+
+// When set, the host may send TCP super-frames of up to RPMSG_ETH_TSO_MAX_FRAME bytes instead of
+// segmenting them to the MTU itself. They are reassembled into a pbuf chain like any other frame
+// and lwIP takes them as one large segment. Needs the checksum-free mode.
+#ifndef RPMSG_ETH_TSO
+#define RPMSG_ETH_TSO RPMSG_ETH_CSUM_OFFLOAD
+#endif
+
+#ifndef RPMSG_ETH_TSO_MAX_FRAME
+#define RPMSG_ETH_TSO_MAX_FRAME 16384
+#endif
+
+// The host is the only neighbour on the link. When set, its MAC address is learned from its hello
+// and unicasts are framed for it directly, without an ARP table or neighbor cache lookup.
+// Broadcasts, multicasts and everything sent before the hello still go through etharp_output()
+// or ethip6_output(), and ARP requests and neighbor solicitations from the host are still
+// answered. Nobody else can hold our IPv6 addresses, so they skip duplicate address detection.
+#ifndef RPMSG_ETH_POINT_TO_POINT
+#define RPMSG_ETH_POINT_TO_POINT (LWIP_IPV4 || LWIP_IPV6)
+#endif
+
+// When set, and the host's hello asks for it too, the link carries bare IP packets: no Ethernet
+// header, no ARP. netif->output hands packets straight to low_level_output() and received ones go
+// to ip_input(). The interface goes back to Ethernet framing when the host goes away.
+#ifndef RPMSG_ETH_RAW_IP
+#define RPMSG_ETH_RAW_IP LWIP_IPV4
+#endif
+
+// Every ACK costs the host an RPMsg buffer and an interrupt. With TCP_ACK_STRETCH, TCP data
+// received on this netif is acked once per RPMSG_ETH_ACK_STRETCH_SEGS segments or
+// RPMSG_ETH_ACK_STRETCH_BYTES bytes, within TCP_ACK_STRETCH_DELAY ms. The link does not lose
+// frames, so the slower cwnd growth this causes on lossy paths does not apply.
+#if LWIP_TCP && TCP_ACK_STRETCH
+#ifndef RPMSG_ETH_ACK_STRETCH_SEGS
+#define RPMSG_ETH_ACK_STRETCH_SEGS 16
+#endif
+
+#ifndef RPMSG_ETH_ACK_STRETCH_BYTES
+#define RPMSG_ETH_ACK_STRETCH_BYTES (TCP_WND / 4)
+#endif
+#endif
+
+// Number of endpoints, one per TX queue of the Linux driver (its num_queues parameter may not be
+// larger). Queue 0 is "rpmsg-eth"; queue N is "rpmsg-eth-qN" at the address of queue 0 plus N.
+// Only queue 0 is used for transmitting.
+#ifndef RPMSG_ETH_NUM_QUEUES
+#define RPMSG_ETH_NUM_QUEUES 1
+#endif
+
+// When set, completed frames are not passed to netif->input from the RPMsg callback. They are
+// pushed onto a single-producer/single-consumer ring instead, and a dedicated task feeds them to
+// the stack in batches of up to RPMSG_ETH_RX_BATCH frames per tcpip_api_call(). With
+// LWIP_TCPIP_CORE_LOCKING that call takes the core lock and runs ethernet_input() in the task
+// itself, without a message to tcpip_thread. Without the RX task, inputs may come from an ISR
+// and LWIP_TCPIP_CORE_LOCKING_INPUT must stay off.
+#ifndef RPMSG_ETH_RX_THREAD
+#define RPMSG_ETH_RX_THREAD 0
+#endif
+
+#if RPMSG_ETH_RX_THREAD
+// Must be a power of two
+#ifndef RPMSG_ETH_RX_RING_SIZE
+#define RPMSG_ETH_RX_RING_SIZE 64
+#endif
+
+#ifndef RPMSG_ETH_RX_BATCH
+#define RPMSG_ETH_RX_BATCH 16
+#endif
+
+#ifndef RPMSG_ETH_RX_THREAD_STACKSIZE
+#define RPMSG_ETH_RX_THREAD_STACKSIZE 1024
+#endif
+
+#ifndef RPMSG_ETH_RX_THREAD_PRIO
+#define RPMSG_ETH_RX_THREAD_PRIO TCPIP_THREAD_PRIO
+#endif
+
+#if (RPMSG_ETH_RX_RING_SIZE & (RPMSG_ETH_RX_RING_SIZE - 1)) != 0
+#error "RPMSG_ETH_RX_RING_SIZE must be a power of two"
+#endif
+
+// When set, frames from the queues the host marks urgent (see RPMSG_ETH_PRIO_MAGIC) get a ring
+// and task of their own, at RPMSG_ETH_RX_URGENT_PRIO. They then reach the stack ahead of a
+// backlog of bulk frames instead of behind it. Of use only with RPMSG_ETH_NUM_QUEUES > 1.
+#ifndef RPMSG_ETH_RX_URGENT
+#define RPMSG_ETH_RX_URGENT 0
+#endif
+
+#if RPMSG_ETH_RX_URGENT
+#ifndef RPMSG_ETH_RX_URGENT_PRIO
+#define RPMSG_ETH_RX_URGENT_PRIO (RPMSG_ETH_RX_THREAD_PRIO + 1)
+#endif
+
+#define RPMSG_ETH_RX_RINGS 2
+#else
+#define RPMSG_ETH_RX_RINGS 1
+#endif
+
+// When set, runs of in-order TCP segments of one connection within an RX batch are merged into a
+// single pbuf chain before they reach the stack, so that tcp_input(), the ACK decision and the
+// application's recv callback run once per run instead of once per segment. Only pure ACK
+// segments with data and identical TCP options are merged. The merged segment's checksum is
+// derived from the headers alone: it is valid exactly when all merged segments were.
+#ifndef RPMSG_ETH_RX_GRO
+#define RPMSG_ETH_RX_GRO (LWIP_IPV4 && LWIP_TCP)
+#endif
+#endif /* RPMSG_ETH_RX_THREAD */
+
+// When set, a dedicated task spins on the receive vring and dispatches messages itself, instead
+// of waiting for the mailbox interrupt to get rpmsg_endpoint_cb called. The application must then
+// not dispatch vring notifications for this rpmsg device on its own. The task yields after every
+// pass, so at a low priority it only burns otherwise idle time.
+#ifndef RPMSG_ETH_BUSY_POLL
+#define RPMSG_ETH_BUSY_POLL 0
+#endif
+
+#if RPMSG_ETH_BUSY_POLL
+#ifndef RPMSG_ETH_BUSY_POLL_STACKSIZE
+#define RPMSG_ETH_BUSY_POLL_STACKSIZE 512
+#endif
+
+#ifndef RPMSG_ETH_BUSY_POLL_PRIO
+#define RPMSG_ETH_BUSY_POLL_PRIO (tskIDLE_PRIORITY + 1)
+#endif
+
+// When nonzero, the poll task only spins while there is traffic, the way NAPI does: after this
+// many passes in a row that found no message it re-enables vring notifications and sleeps until
+// the application's IPI handler calls rpmsg_eth_rx_notify(), which the host's next kick raises.
+// It then turns notifications off again and polls until the ring stays empty as long, so under
+// load the remote takes one interrupt per burst instead of one per buffer. 0 spins forever.
+#ifndef RPMSG_ETH_BUSY_POLL_IDLE
+#define RPMSG_ETH_BUSY_POLL_IDLE 0
+#endif
+#endif /* RPMSG_ETH_BUSY_POLL */
+
+// When set, RPMSG_ETH_SHM_SIZE bytes at RPMSG_ETH_SHM_BASE hold a pair of packet rings with
+// variable-length slots. They are offered to the host after every hello, and once it echoes the
+// offer, frames to it go through ring 1 instead of RPMsg buffers; RPMsg is then only used for
+// control messages and doorbells. The region must be non-cacheable on this core, e.g. with
+// Xil_SetTlbAttributes(), and reserved memory on the host. RPMSG_ETH_SHM_HOST_ADDR is where the
+// host finds it, if that differs from our own address.
+#ifndef RPMSG_ETH_SHM
+#define RPMSG_ETH_SHM 0
+#endif
+
+#if RPMSG_ETH_SHM
+#if !defined(RPMSG_ETH_SHM_BASE) || !defined(RPMSG_ETH_SHM_SIZE)
+#error "RPMSG_ETH_SHM needs RPMSG_ETH_SHM_BASE and RPMSG_ETH_SHM_SIZE"
+#endif
+
+#ifndef RPMSG_ETH_SHM_HOST_ADDR
+#define RPMSG_ETH_SHM_HOST_ADDR RPMSG_ETH_SHM_BASE
+#endif
+#endif /* RPMSG_ETH_SHM */
+
+// When set, a sample of the frames is timestamped on both cores to see where the latency goes.
+// Every RPMSG_ETH_TSTAMP_RATE-th frame we send is preceded by the times it was handed to us and to
+// RPMsg, if the host's hello carries RPMSG_ETH_F_TSTAMP; frames the host stamps the same way are
+// broken down into stages here, see rpmsg_eth_get_tstamp_stats(). RPMSG_ETH_TSTAMP_NOW() reads
+// the system counter shared with the host and RPMSG_ETH_TSTAMP_HZ is its frequency. A Cortex-A53
+// reads CNTVCT_EL0; a Cortex-R5 has no generic timer registers and has to define both, e.g. from
+// the memory-mapped IOU_SCNTRS counter of the ZynqMP. A rate of 1 stamps every frame, which gives
+// hardware RX timestamps on the host for all of them.
+#ifndef RPMSG_ETH_TSTAMP
+#define RPMSG_ETH_TSTAMP 0
+#endif
+
+#if RPMSG_ETH_TSTAMP
+#ifndef RPMSG_ETH_TSTAMP_RATE
+#define RPMSG_ETH_TSTAMP_RATE 64
+#endif
+
+#if defined(__aarch64__)
+static inline u64_t rpmsg_eth_cntvct(void)
+{
+    u64_t v;
+
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(v) : : "memory");
+    return v;
+}
+
+static inline u32_t rpmsg_eth_cntfrq(void)
+{
+    u64_t v;
+
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(v));
+    return (u32_t)v;
+}
+
+#ifndef RPMSG_ETH_TSTAMP_NOW
+#define RPMSG_ETH_TSTAMP_NOW() rpmsg_eth_cntvct()
+#endif
+#ifndef RPMSG_ETH_TSTAMP_HZ
+#define RPMSG_ETH_TSTAMP_HZ rpmsg_eth_cntfrq()
+#endif
+#endif /* __aarch64__ */
+
+#if !defined(RPMSG_ETH_TSTAMP_NOW) || !defined(RPMSG_ETH_TSTAMP_HZ)
+#error "RPMSG_ETH_TSTAMP needs RPMSG_ETH_TSTAMP_NOW() and RPMSG_ETH_TSTAMP_HZ on this CPU"
+#endif
+#endif /* RPMSG_ETH_TSTAMP */
+
+// When set, the groups lwIP joins are passed on to the host, which then only forwards the
+// multicast frames we asked for instead of all of them. RPMSG_ETH_MCAST_FILTER_MAX different MAC
+// addresses are tracked; past that, the host is told to pass all multicast again. IPv6 needs MLD
+// for this, since without it the stack never tells the driver its solicited-node groups.
+// RPMSG_ETH_CFG_NO_MCAST_FILTER turns it off per interface, e.g. for a bridge port.
+#ifndef RPMSG_ETH_MCAST_FILTER
+#define RPMSG_ETH_MCAST_FILTER ((LWIP_IGMP || LWIP_IPV6_MLD) && (!LWIP_IPV6 || LWIP_IPV6_MLD))
+#endif
+
+#ifndef RPMSG_ETH_MCAST_FILTER_MAX
+#define RPMSG_ETH_MCAST_FILTER_MAX 16
+#endif
+
+// When set, the host can read the lwIP statistics of this core: drops and errors of the link,
+// IP, UDP and TCP, the PBUF_POOL, the heap and posts to full mailboxes, the tcpip thread's among
+// them. Answered straight from the RPMsg callback, so a stuck tcpip thread can still be seen.
+#ifndef RPMSG_ETH_STATS
+#define RPMSG_ETH_STATS LWIP_STATS
+#endif
+
+// With PBUF_POOL_QUOTAS, every interface copies received frames into pbufs from its own partition
+// of the PBUF_POOL: RPMSG_ETH_POOL_RESERVED of them are kept for it, and it holds at most
+// RPMSG_ETH_POOL_LIMIT (0: no limit) at once, so a host flooding us cannot take the buffers the
+// EMAC needs to refill its RX ring. When the pool cannot spare the reservation, or all
+// PBUF_POOL_QUOTAS partitions are taken, the interface draws from the shared part like anyone.
+#ifndef RPMSG_ETH_POOL_RESERVED
+#define RPMSG_ETH_POOL_RESERVED 8
+#endif
+
+#ifndef RPMSG_ETH_POOL_LIMIT
+#define RPMSG_ETH_POOL_LIMIT (PBUF_POOL_SIZE / 2)
+#endif
+
+// When set, rpmsg_eth_udp_claim() lets the application take IPv4 UDP datagrams to one of our
+// ports straight from the RPMsg callback, before they are queued for the stack: no tcpip_thread,
+// no netconn mailbox. Only unfragmented unicasts to the interface's own address are claimed;
+// their checksum is not verified, the link is memory. Up to RPMSG_ETH_EARLY_DEMUX_PORTS ports per
+// interface.
+#ifndef RPMSG_ETH_EARLY_DEMUX
+#define RPMSG_ETH_EARLY_DEMUX 0
+#endif
+
+#ifndef RPMSG_ETH_EARLY_DEMUX_PORTS
+#define RPMSG_ETH_EARLY_DEMUX_PORTS 4
+#endif
+
+// When set, ICMP echo requests to the interface's own IPv4 address are answered straight from the
+// RPMsg callback: the request is turned around in its own pbuf and sent back, so ping across the
+// link measures the link rather than the tcpip thread and its mailboxes. Requests with IP options
+// or too big for one message, and any that find no free vring buffer, are left to the stack as
+// before. lwIP's ICMP statistics do not see the ones answered here.
+#ifndef RPMSG_ETH_ICMP_ECHO
+#define RPMSG_ETH_ICMP_ECHO 0
+#endif
 
 
 #define IFNAME0 'e'
 #define IFNAME1 'n'
 
+struct rpmsg_eth_priv;
+
+/* The host transmits on all queues in parallel, so every endpoint reassembles on its own */
+struct rpmsg_eth_queue {
+    struct rpmsg_endpoint ept;
+    struct rpmsg_eth_priv* priv;
+    struct pbuf* rx_pbuf;   // frame being reassembled, NULL if none
+    u16_t rx_frame_len;     // total length announced for rx_pbuf by its first fragment
+    u16_t rx_offset;        // number of bytes of rx_pbuf received so far
+#if RPMSG_ETH_TSTAMP
+    u8_t ts_state;          // RPMSG_ETH_TS_*, for the next frame completed on this queue
+    u64_t ts_xmit;          // host stamps from the last RPMSG_ETH_TSTAMP_MAGIC message
+    u64_t ts_send;
+    u64_t ts_cb;            // arrival of the frame's first message
+#endif
+#if RPMSG_ETH_RX_URGENT
+    volatile u8_t urgent;   // set by the host, its frames go to the urgent RX ring
+#endif
+};
+
+/* The RX ring frames completed on q go through */
+#if RPMSG_ETH_RX_URGENT
+#define RPMSG_ETH_RX_RING_OF(q) ((q)->urgent)
+#else
+#define RPMSG_ETH_RX_RING_OF(q) 0
+#endif
+
+#if RPMSG_ETH_RX_THREAD
+/* Frames on their way from the RPMsg callback to the stack, with the task feeding them */
+struct rpmsg_eth_rx_ring {
+    struct rpmsg_eth_priv* priv;
+    sys_thread_t thread;
+    u32_t head;             // written by the RPMsg callback only
+    u32_t tail;             // written by thread only
+    struct pbuf* ring[RPMSG_ETH_RX_RING_SIZE];
+};
+#endif
+
+#define RPMSG_ETH_TS_NONE    0
+#define RPMSG_ETH_TS_PENDING 1  // stamps received, the frame has not started yet
+#define RPMSG_ETH_TS_FRAME   2  // the frame started, ts_cb is valid
+
+#if RPMSG_ETH_EARLY_DEMUX
+/* A UDP port claimed with rpmsg_eth_udp_claim() */
+struct rpmsg_eth_udp_claim {
+    volatile u16_t port;    // host order, 0 for a free entry
+    volatile u16_t busy;    // RX paths between their check of port and the return of recv
+    rpmsg_eth_udp_recv_fn recv;
+    void* arg;
+};
+#endif
+
+#if RPMSG_ETH_MCAST_FILTER
+/* A multicast MAC address some joined groups map to */
+struct rpmsg_eth_mcast {
+    struct eth_addr addr;
+    u8_t refs;              // groups using addr, 0 for a free entry
+};
+#endif
+
 struct rpmsg_eth_priv {
-    struct rpmsg_endpoint lept;
+    struct rpmsg_eth_queue queues[RPMSG_ETH_NUM_QUEUES];
+    struct netif* netif;
+#if !RPMSG_ETH_NOCOPY_TX
+    uint8_t* tx_buf;        // buf_size bytes
+#endif
+    struct pbuf* tx_queue[RPMSG_ETH_TX_QUEUE_LEN];
+    u16_t tx_queue_head;    // index of the oldest queued frame
+    u16_t tx_queue_count;
+    u16_t tx_offset;        // bytes of the oldest queued frame already sent
+    u8_t tx_timer_armed;
+    u8_t tx_stalled;        // ERR_MEM was returned since the last tx_ready notification
+    rpmsg_eth_tx_ready_fn tx_ready;
+    u32_t tx_coalesce_ms;   // see rpmsg_eth_set_tx_coalesce()
+    u16_t tx_coalesce_frames;
+    u32_t host_coalesce_ms; // from the host's last coalescing message, applied in the tcpip thread
+    u16_t host_coalesce_frames;
+    u32_t peer_features;    // RPMSG_ETH_F_* advertised by the host's hello, 0 until it arrives
+    u16_t buf_size;         // payload size of our RPMsg buffers, what we can send or receive at most
+    u16_t mtu;              // our own link MTU, advertised in the hello
+    u16_t rx_max_frame;     // largest frame accepted from the host, Ethernet header included
+    u16_t tx_msg_size;      // largest message we send, link header included
+    u16_t peer_mtu;         // MTU from the host's hello or MTU message, applied to netif in the tcpip thread
+#if RPMSG_ETH_POINT_TO_POINT
+    struct eth_addr peer_hwaddr;  // MAC address from the host's hello, applied like peer_mtu
+    struct eth_addr p2p_hwaddr;   // destination of all unicasts while p2p_valid
+    u8_t p2p_valid;
+#endif
+#if RPMSG_ETH_RAW_IP
+    volatile u8_t raw_ip;   // both hellos carry RPMSG_ETH_F_RAW, set before we answer the host's
+    netif_output_fn eth_output;  // netif->output for Ethernet framing
+#if LWIP_IPV6
+    netif_output_ip6_fn eth_output_ip6;  // netif->output_ip6 for Ethernet framing
+#endif
+#endif
+    u16_t tx_queue_len;     // usable entries of tx_queue
+    u8_t flags;             // RPMSG_ETH_CFG_* from the config
+    u8_t pool_quota;        // partition of the PBUF_POOL received frames are copied into
+    struct rpmsg_eth_counters counters;  // see rpmsg_eth_get_counters()
+#if RPMSG_ETH_TSTAMP
+    u64_t tx_stamp[RPMSG_ETH_TX_QUEUE_LEN];  // when each tx_queue entry was handed to us
+    u16_t ts_count;         // frames sent since the last stamped one
+    struct rpmsg_eth_tstamp_stats ts_stats;  // see rpmsg_eth_get_tstamp_stats()
+#if RPMSG_ETH_RX_THREAD
+    struct pbuf* volatile ts_pbuf;  // stamped frame on its way to the stack, NULL if none
+    u64_t ts_input;         // when ts_pbuf was handed to rx_thread
+#endif
+#endif
+#if RPMSG_ETH_BUSY_POLL
+    struct rpmsg_device* rpdev;
+    sys_thread_t busy_poll_thread;
+#endif
+#if RPMSG_ETH_SHM
+    volatile struct rpmsg_eth_shm_ring* shm_rx;  // ring 0, the host produces
+    volatile struct rpmsg_eth_shm_ring* shm_tx;  // ring 1, we produce
+    u8_t* shm_rx_data;
+    u8_t* shm_tx_data;
+    u32_t shm_ring_size;
+    u32_t shm_rx_tail;      // our copy of shm_rx->tail
+    u32_t shm_tx_head;      // our copy of shm_tx->head
+    volatile u8_t shm_offered;  // control blocks reset and offered, ring 0 is consumed
+    volatile u8_t shm_active;   // the host accepted, ring 1 is produced
+#endif
+#if RPMSG_ETH_MCAST_FILTER
+    struct rpmsg_eth_mcast mcast[RPMSG_ETH_MCAST_FILTER_MAX];
+    u8_t mcast_overflow;    // groups that found no free entry; the host passes all multicast
+    u8_t mcast_retry;       // the last list could not be sent, a timer tries again
+#endif
+#if RPMSG_ETH_EARLY_DEMUX
+    struct rpmsg_eth_udp_claim udp_claims[RPMSG_ETH_EARLY_DEMUX_PORTS];
+#endif
+#if RPMSG_ETH_RX_THREAD
+    struct rpmsg_eth_rx_ring rx[RPMSG_ETH_RX_RINGS];  // the urgent one last
+#endif
+};
+
+#if RPMSG_ETH_RX_THREAD
+struct rpmsg_eth_rx_batch {
+    struct tcpip_api_call_data call;
     struct netif* netif;
-    struct pbuf* rx_pbuf;
+    u16_t count;
+    struct pbuf* p[RPMSG_ETH_RX_BATCH];
+};
+
+#if RPMSG_ETH_RX_GRO
+// The TCP segment being merged, inside the first frame of the run
+struct rpmsg_eth_gro {
+    struct pbuf* p;         // the run so far, NULL if none
+    struct ip_hdr* iphdr;
+    struct tcp_hdr* tcphdr;
+    u32_t next_seqno;       // sequence number the next segment must start with
+    u32_t csum;             // one's complement sum of the pseudo and TCP headers of every merged segment
+    u16_t hdr_len;          // link, IP and TCP header length of each frame
+    u16_t data_len;         // TCP payload of the whole run
+    u8_t segs;
+};
+#endif
+#endif
+
+#if RPMSG_ETH_ZERO_COPY_RX
+struct rpmsg_eth_rx_pbuf {
+    struct pbuf_custom pc;
+    struct rpmsg_endpoint* ept;
+    void* rxbuf;
 };
 
-u32 xInsideISR = 0; // Used by lwip stack
+LWIP_MEMPOOL_DECLARE(RPMSG_ETH_RX_PBUF, RPMSG_ETH_RX_PBUF_NUM, sizeof(struct rpmsg_eth_rx_pbuf), "RPMSG_ETH_RX_PBUF")
+static u8_t rpmsg_eth_rx_pool_ready;
+#endif /* RPMSG_ETH_ZERO_COPY_RX */
+
+#if RPMSG_ETH_SHM
+static u8_t rpmsg_eth_shm_claimed; // the region belongs to the first interface
+#endif
 
 
 static int rpmsg_endpoint_cb(struct rpmsg_endpoint *ept, void *data, size_t len, uint32_t src, void *priv);
 static void rpmsg_service_unbind(struct rpmsg_endpoint *ept);
 static void rpmsg_func(void *unused_arg);
 static err_t low_level_output(struct netif* netif, struct pbuf* p);
+#if LWIP_NETIF_LINKOUTPUT_BURST
+static err_t low_level_output_burst(struct netif* netif, struct pbuf** frames, u16_t n);
+#endif
+#if RPMSG_ETH_POINT_TO_POINT && LWIP_IPV4
+static err_t rpmsg_eth_output(struct netif* netif, struct pbuf* p, const ip4_addr_t* ipaddr);
+#endif
+#if RPMSG_ETH_POINT_TO_POINT && LWIP_IPV6
+static err_t rpmsg_eth_output_ip6(struct netif* netif, struct pbuf* p, const ip6_addr_t* ipaddr);
+#endif
+#if RPMSG_ETH_RAW_IP
+static err_t rpmsg_eth_ip_output(struct netif* netif, struct pbuf* p, const ip4_addr_t* ipaddr);
+#if LWIP_IPV6
+static err_t rpmsg_eth_ip6_output(struct netif* netif, struct pbuf* p, const ip6_addr_t* ipaddr);
+#endif
+static err_t rpmsg_eth_raw_input(struct pbuf* p, struct netif* netif);
+#endif
+#if LWIP_IPV6 && (RPMSG_ETH_POINT_TO_POINT || RPMSG_ETH_RAW_IP)
+static int rpmsg_eth_ip6_no_dad(struct rpmsg_eth_priv* rpmsg_eth);
+static void rpmsg_eth_ip6_settle(struct netif* netif);
+#endif
+static void rpmsg_eth_tx_timeout(void* arg);
+#if RPMSG_ETH_ICMP_ECHO
+static void rpmsg_eth_tx_count(struct rpmsg_eth_priv* rpmsg_eth, struct pbuf* p, err_t err);
+#endif
+static void rpmsg_eth_link_down(void* arg);
+#if RPMSG_ETH_MCAST_FILTER
+#if LWIP_IGMP
+static err_t rpmsg_eth_igmp_mac_filter(struct netif* netif, const ip4_addr_t* group,
+                                       enum netif_mac_filter_action action);
+#endif
+#if LWIP_IPV6_MLD
+static err_t rpmsg_eth_mld_mac_filter(struct netif* netif, const ip6_addr_t* group,
+                                      enum netif_mac_filter_action action);
+#endif
+#endif
+#if RPMSG_ETH_RX_THREAD
+static void rpmsg_eth_rx_thread(void* arg);
+#endif
+#if RPMSG_ETH_BUSY_POLL
+static void rpmsg_eth_busy_poll_thread(void* arg);
+#endif
 
 err_t rpmsg_eth_init(struct netif* netif)
 {
-    struct rpmsg_device *rpdev = netif->state;
+    static const u8_t default_hwaddr[6] = { 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFE };
+    const struct rpmsg_eth_config* config;
+    struct rpmsg_device *rpdev;
 
     struct rpmsg_eth_priv* mailboxif;
+    int buf_size;
+    int i;
 
     LWIP_ASSERT("netif != NULL", (netif != NULL));
+    LWIP_ASSERT("netif->state != NULL", (netif->state != NULL));
+    config = (const struct rpmsg_eth_config*)netif->state;
+    rpdev = config->rdev;
 
-    mailboxif = mem_malloc(sizeof(struct rpmsg_eth_priv));
+#if RPMSG_ETH_ZERO_COPY_RX
+    /* the pool is shared by all interfaces */
+    if (!rpmsg_eth_rx_pool_ready) {
+        LWIP_MEMPOOL_INIT(RPMSG_ETH_RX_PBUF);
+        rpmsg_eth_rx_pool_ready = 1;
+    }
+#endif
+
+    /* the interface lives as long as the system, keep it out of the heap */
+    mailboxif = mem_arena_malloc(sizeof(struct rpmsg_eth_priv));
     if (mailboxif == NULL) {
         LWIP_DEBUGF(NETIF_DEBUG, ("ipc_context: out of memory\n"));
         return ERR_MEM;
     }
 
+    buf_size = rpmsg_virtio_get_buffer_size(rpdev);
+    if (buf_size <= (int)sizeof(struct rpmsg_eth_frag_hdr)) {
+        buf_size = RPMSG_SIZE;
+    }
+    mailboxif->buf_size = (u16_t)LWIP_MIN(buf_size, 0xFFFF);
+    mailboxif->flags = config->flags;
+    if (config->mtu) {
+        mailboxif->mtu = config->mtu;
+    } else {
+#if RPMSG_ETH_MTU
+        mailboxif->mtu = RPMSG_ETH_MTU;
+#else
+        mailboxif->mtu = (u16_t)LWIP_MAX(1500, (int)mailboxif->buf_size -
+                                         (int)sizeof(struct rpmsg_eth_frag_hdr) - SIZEOF_ETH_HDR);
+#endif
+    }
+    mailboxif->rx_max_frame = (u16_t)(mailboxif->mtu + SIZEOF_ETH_HDR);
+#if RPMSG_ETH_TSO
+    if (!(mailboxif->flags & RPMSG_ETH_CFG_NO_CSUM_OFFLOAD)) {
+        mailboxif->rx_max_frame = (u16_t)LWIP_MAX(mailboxif->rx_max_frame, RPMSG_ETH_TSO_MAX_FRAME);
+    }
+#endif
+#if PBUF_POOL_QUOTAS
+    mailboxif->pool_quota = pbuf_pool_quota_new(RPMSG_ETH_POOL_RESERVED, RPMSG_ETH_POOL_LIMIT);
+#else
+    mailboxif->pool_quota = 0;
+#endif
+    mailboxif->tx_queue_len = RPMSG_ETH_TX_QUEUE_LEN;
+    if (config->tx_queue_len && config->tx_queue_len < RPMSG_ETH_TX_QUEUE_LEN) {
+        mailboxif->tx_queue_len = config->tx_queue_len;
+    }
+#if !RPMSG_ETH_NOCOPY_TX
+    mailboxif->tx_buf = mem_arena_malloc(mailboxif->buf_size);
+    if (mailboxif->tx_buf == NULL) {
+#if !MEM_ARENA_SIZE
+        mem_free(mailboxif);
+#endif
+        return ERR_MEM;
+    }
+#endif
+#if RPMSG_ETH_SHM
+    mailboxif->shm_offered = 0;
+    mailboxif->shm_active = 0;
+    /* there is a single region, the first interface takes it and the others stay on RPMsg */
+    mailboxif->shm_rx = NULL;
+    if (!rpmsg_eth_shm_claimed) {
+        rpmsg_eth_shm_claimed = 1;
+        mailboxif->shm_rx = (volatile struct rpmsg_eth_shm_ring*)(RPMSG_ETH_SHM_BASE);
+        mailboxif->shm_tx = mailboxif->shm_rx + 1;
+        /* the largest power of two that leaves room for both data areas */
+        mailboxif->shm_ring_size = 1;
+        while (mailboxif->shm_ring_size * 4 <= RPMSG_ETH_SHM_SIZE - 2 * sizeof(struct rpmsg_eth_shm_ring)) {
+            mailboxif->shm_ring_size *= 2;
+        }
+        mailboxif->shm_rx_data = (u8_t*)(uintptr_t)(mailboxif->shm_tx + 1);
+        mailboxif->shm_tx_data = mailboxif->shm_rx_data + mailboxif->shm_ring_size;
+    }
+#endif
+
 #if LWIP_NETIF_HOSTNAME
     /* Initialize interface hostname */
-    netif->hostname = "nuc472";
+    netif->hostname = config->hostname != NULL ? config->hostname : "nuc472";
 #endif /* LWIP_NETIF_HOSTNAME */
 
+#if RPMSG_ETH_BUSY_POLL
+    /* rpmsg_eth_rx_notify() may run as soon as netif->state is ours */
+    mailboxif->busy_poll_thread = NULL;
+#endif
     netif->state = mailboxif;
 
     netif->name[0] = IFNAME0;
@@ -72,22 +880,130 @@ err_t rpmsg_eth_init(struct netif* netif)
      * from it if you have to do some checks before sending (e.g. if link
      * is available...) */
     netif->output = etharp_output;
+#if RPMSG_ETH_POINT_TO_POINT && LWIP_IPV4
+    if (!(mailboxif->flags & RPMSG_ETH_CFG_NO_POINT_TO_POINT)) {
+        netif->output = rpmsg_eth_output;
+    }
+#endif
+#if LWIP_IPV6
+    netif->output_ip6 = ethip6_output;
+#if RPMSG_ETH_POINT_TO_POINT
+    if (!(mailboxif->flags & RPMSG_ETH_CFG_NO_POINT_TO_POINT)) {
+        netif->output_ip6 = rpmsg_eth_output_ip6;
+    }
+#endif
+#endif
+#if RPMSG_ETH_RAW_IP
+    mailboxif->raw_ip = 0;
+    mailboxif->eth_output = netif->output;
+#if LWIP_IPV6
+    mailboxif->eth_output_ip6 = netif->output_ip6;
+#endif
+#endif
     netif->linkoutput = low_level_output;
-    netif->mtu = MTU_RPMSG;
+#if LWIP_NETIF_LINKOUTPUT_BURST
+    netif->linkoutput_burst = low_level_output_burst;
+#endif
+    netif->mtu = mailboxif->mtu;
     netif->hwaddr_len = 6;
+#if LWIP_TCP && TCP_ACK_STRETCH
+    netif_set_ack_stretch(netif, RPMSG_ETH_ACK_STRETCH_SEGS, RPMSG_ETH_ACK_STRETCH_BYTES);
+#endif
 
-    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_IGMP | NETIF_FLAG_LINK_UP;
+    /* the link comes up with the host's hello, before that there is nobody to send to */
+    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_IGMP;
+#if LWIP_IPV6_MLD
+    /* solicited-node groups, the host's filter only lets through what we joined */
+    netif->flags |= NETIF_FLAG_MLD6;
+#endif
 
-    uint8_t hwaddr[6] = { 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF };
-    netif->hwaddr[0] = hwaddr[0];
-    netif->hwaddr[1] = hwaddr[1];
-    netif->hwaddr[2] = hwaddr[2];
-    netif->hwaddr[3] = hwaddr[3];
-    netif->hwaddr[4] = hwaddr[4];
-    netif->hwaddr[5] = hwaddr[5] ^ 1;
+    for (i = 0; i < 6 && config->hwaddr[i] == 0; i++) {
+    }
+    memcpy(netif->hwaddr, i < 6 ? config->hwaddr : default_hwaddr, 6);
     netif->hwaddr_len = 6;
 
-    int status = rpmsg_create_ept(&mailboxif->lept, rpdev, "rpmsg-eth",
+    mailboxif->netif = netif;
+    for (i = 0; i < RPMSG_ETH_NUM_QUEUES; i++) {
+        mailboxif->queues[i].priv = mailboxif;
+        mailboxif->queues[i].rx_pbuf = NULL;
+        mailboxif->queues[i].rx_frame_len = 0;
+        mailboxif->queues[i].rx_offset = 0;
+#if RPMSG_ETH_TSTAMP
+        mailboxif->queues[i].ts_state = RPMSG_ETH_TS_NONE;
+#endif
+#if RPMSG_ETH_RX_URGENT
+        mailboxif->queues[i].urgent = 0;
+#endif
+    }
+    memset(mailboxif->tx_queue, 0, sizeof(mailboxif->tx_queue));
+    mailboxif->tx_queue_head = 0;
+    mailboxif->tx_queue_count = 0;
+    mailboxif->tx_offset = 0;
+    mailboxif->tx_timer_armed = 0;
+    mailboxif->tx_stalled = 0;
+    mailboxif->tx_ready = NULL;
+    mailboxif->tx_coalesce_ms = 0;
+    mailboxif->tx_coalesce_frames = 0;
+    mailboxif->host_coalesce_ms = 0;
+    mailboxif->host_coalesce_frames = 0;
+    mailboxif->peer_features = 0;
+    mailboxif->tx_msg_size = mailboxif->buf_size;
+    mailboxif->peer_mtu = mailboxif->mtu;
+    memset(&mailboxif->counters, 0, sizeof(mailboxif->counters));
+#if RPMSG_ETH_TSTAMP
+    mailboxif->ts_count = 0;
+    memset(&mailboxif->ts_stats, 0, sizeof(mailboxif->ts_stats));
+#if RPMSG_ETH_RX_THREAD
+    mailboxif->ts_pbuf = NULL;
+#endif
+#endif
+#if RPMSG_ETH_POINT_TO_POINT
+    mailboxif->p2p_valid = 0;
+#endif
+#if RPMSG_ETH_EARLY_DEMUX
+    memset(mailboxif->udp_claims, 0, sizeof(mailboxif->udp_claims));
+#endif
+#if RPMSG_ETH_MCAST_FILTER
+    memset(mailboxif->mcast, 0, sizeof(mailboxif->mcast));
+    mailboxif->mcast_overflow = 0;
+    mailboxif->mcast_retry = 0;
+    if (!(mailboxif->flags & RPMSG_ETH_CFG_NO_MCAST_FILTER)) {
+#if LWIP_IGMP
+        /* igmp_start() adds the all-systems group once we return */
+        netif->igmp_mac_filter = rpmsg_eth_igmp_mac_filter;
+#endif
+#if LWIP_IPV6_MLD
+        ip6_addr_t allnodes;
+
+        /* all-nodes is assumed to be received, MLD never adds it */
+        netif->mld_mac_filter = rpmsg_eth_mld_mac_filter;
+        ip6_addr_set_allnodes_linklocal(&allnodes);
+        rpmsg_eth_mld_mac_filter(netif, &allnodes, NETIF_ADD_MAC_FILTER);
+#endif
+    }
+#endif
+
+#if RPMSG_ETH_RX_THREAD
+    for (i = 0; i < RPMSG_ETH_RX_RINGS; i++) {
+        mailboxif->rx[i].priv = mailboxif;
+        mailboxif->rx[i].head = 0;
+        mailboxif->rx[i].tail = 0;
+    }
+    mailboxif->rx[0].thread = sys_thread_new("rpmsg_eth_rx", rpmsg_eth_rx_thread, &mailboxif->rx[0],
+                                             RPMSG_ETH_RX_THREAD_STACKSIZE, RPMSG_ETH_RX_THREAD_PRIO);
+    if (mailboxif->rx[0].thread == NULL) {
+        return ERR_MEM;
+    }
+#if RPMSG_ETH_RX_URGENT
+    mailboxif->rx[1].thread = sys_thread_new("rpmsg_eth_rxu", rpmsg_eth_rx_thread, &mailboxif->rx[1],
+                                             RPMSG_ETH_RX_THREAD_STACKSIZE, RPMSG_ETH_RX_URGENT_PRIO);
+    if (mailboxif->rx[1].thread == NULL) {
+        return ERR_MEM;
+    }
+#endif
+#endif
+
+    int status = rpmsg_create_ept(&mailboxif->queues[0].ept, rpdev, "rpmsg-eth",
 				       RPMSG_ADDR_ANY, RPMSG_ADDR_ANY,
 				       rpmsg_endpoint_cb,
 				       rpmsg_service_unbind);
@@ -95,40 +1011,83 @@ err_t rpmsg_eth_init(struct netif* netif)
         return ERR_IF;
     }
 
-    mailboxif->netif = netif;
-    mailboxif->lept.priv = mailboxif;
+    mailboxif->queues[0].ept.priv = &mailboxif->queues[0];
+
+    /* the host finds the other queues next to the channel address */
+    for (i = 1; i < RPMSG_ETH_NUM_QUEUES; i++) {
+        char name[16];
+
+        snprintf(name, sizeof(name), "rpmsg-eth-q%d", i);
+        status = rpmsg_create_ept(&mailboxif->queues[i].ept, rpdev, name,
+                                  mailboxif->queues[0].ept.addr + i, RPMSG_ADDR_ANY,
+                                  rpmsg_endpoint_cb,
+                                  rpmsg_service_unbind);
+        if (status) {
+            return ERR_IF;
+        }
+
+        mailboxif->queues[i].ept.priv = &mailboxif->queues[i];
+    }
+
+#if RPMSG_ETH_BUSY_POLL
+    /* only once every endpoint exists, since it may dispatch to any of them */
+    mailboxif->rpdev = rpdev;
+    mailboxif->busy_poll_thread = sys_thread_new("rpmsg_eth_poll", rpmsg_eth_busy_poll_thread, mailboxif,
+                                                 RPMSG_ETH_BUSY_POLL_STACKSIZE, RPMSG_ETH_BUSY_POLL_PRIO);
+    if (mailboxif->busy_poll_thread == NULL) {
+        return ERR_MEM;
+    }
+#endif
 
     return ERR_OK;
 }
 
-static int rpmsg_endpoint_cb(struct rpmsg_endpoint *ept, void *data, size_t len,
-			     uint32_t src, void *priv)
+#if RPMSG_ETH_TSTAMP
+/* Count the time from one stamp to another into its log2 microsecond bucket */
+static void rpmsg_eth_ts_hist(u32_t* hist, u64_t from, u64_t to)
 {
-    (void)ept;
-	(void)src;
-    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)priv;
-    struct netif* netif = rpmsg_eth->netif;
-    struct eth_hdr* ethhdr;
-    struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
-    if (p == NULL) {
-        return ERR_MEM;
+    u64_t us = (to - from) * 1000000 / RPMSG_ETH_TSTAMP_HZ;
+    u32_t bucket = 0;
+
+    /* a stamp from the future lands in the last bucket, rather than skewing the first */
+    while (us != 0 && bucket < RPMSG_ETH_TSTAMP_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
     }
+    hist[bucket]++;
+}
+#endif /* RPMSG_ETH_TSTAMP */
 
-    pbuf_take(p, data, len);
+static LWIP_HOT_TEXT void rpmsg_eth_input(struct netif* netif, struct pbuf* p, netif_input_fn input)
+{
+    struct eth_hdr* ethhdr = (struct eth_hdr*)p->payload;
+
+#if RPMSG_ETH_RAW_IP
+    if (((struct rpmsg_eth_priv*)netif->state)->raw_ip) {
+        /* a bare IP packet, input is the IP layer's */
+        u8_t version = (u8_t)(((const u8_t*)p->payload)[0] >> 4);
 
-    ethhdr = (struct eth_hdr*)p->payload;
+        if ((version != 4 && version != 6) || input(p, netif) != ERR_OK) {
+            pbuf_free(p);
+        }
+        return;
+    }
+#endif
 
     switch (htons(ethhdr->type)) {
     /* IP or ARP packet? */
     case ETHTYPE_IP:
     case ETHTYPE_ARP:
+#if LWIP_IPV6
+    case ETHTYPE_IPV6:
+#endif
 #if PPPOE_SUPPORT
     /* PPPoE packet? */
     case ETHTYPE_PPPOEDISC:
     case ETHTYPE_PPPOE:
 #endif /* PPPOE_SUPPORT */
         /* full packet send to tcpip_thread to process */
-        if (netif->input(p, netif) != ERR_OK) {
+        if (input(p, netif) != ERR_OK) {
             LWIP_DEBUGF(NETIF_DEBUG, ("ethernetif_input: IP input error\n"));
             pbuf_free(p);
             p = NULL;
@@ -138,39 +1097,2341 @@ static int rpmsg_endpoint_cb(struct rpmsg_endpoint *ept, void *data, size_t len,
         pbuf_free(p);
         break;
     }
-
-
-	return RPMSG_SUCCESS;
 }
 
-static void rpmsg_service_unbind(struct rpmsg_endpoint *ept)
+#if RPMSG_ETH_RX_THREAD
+static void rpmsg_eth_rx_enqueue(struct rpmsg_eth_rx_ring* rx, struct pbuf* p)
 {
-	(void)ept;
-}
+    u32_t head = rx->head;
+    u32_t tail = __atomic_load_n(&rx->tail, __ATOMIC_ACQUIRE);
 
-static err_t low_level_output(struct netif* netif, struct pbuf* p)
+    if (head - tail == RPMSG_ETH_RX_RING_SIZE) {
+        LINK_STATS_INC(link.drop);
+        pbuf_free(p);
+        return;
+    }
+
+    rx->ring[head & (RPMSG_ETH_RX_RING_SIZE - 1)] = p;
+    __atomic_store_n(&rx->head, head + 1, __ATOMIC_RELEASE);
+
+    if (sys_arch_in_isr()) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(rx->thread, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    } else {
+        xTaskNotifyGive(rx->thread);
+    }
+}
+
+#if RPMSG_ETH_RX_GRO
+/* One's complement sum of the pseudo header and the TCP header (checksum included), folded */
+static u32_t rpmsg_eth_gro_hdr_sum(const struct ip_hdr* iphdr, const struct tcp_hdr* tcphdr, u16_t tcp_len)
+{
+    u32_t sum;
+
+    sum = (u16_t)~inet_chksum(&iphdr->src, 2 * sizeof(ip4_addr_p_t));
+    sum += lwip_htons(IP_PROTO_TCP);
+    sum += lwip_htons(tcp_len);
+    sum += (u16_t)~inet_chksum(tcphdr, (u16_t)(TCPH_HDRLEN_BYTES(tcphdr)));
+    sum = FOLD_U32T(sum);
+    return FOLD_U32T(sum);
+}
+
+/* Pass the run on, with its headers fixed up if more than one segment was merged */
+static void rpmsg_eth_gro_flush(struct netif* netif, struct rpmsg_eth_gro* gro, netif_input_fn input)
+{
+    struct ip_hdr* iphdr = gro->iphdr;
+    struct tcp_hdr* tcphdr = gro->tcphdr;
+    u16_t tcp_len;
+    u32_t sum;
+
+    if (gro->p == NULL) {
+        return;
+    }
+
+    if (gro->segs > 1) {
+        tcp_len = (u16_t)(TCPH_HDRLEN_BYTES(tcphdr) + gro->data_len);
+        IPH_LEN_SET(iphdr, lwip_htons((u16_t)(IP_HLEN + tcp_len)));
+        IPH_CHKSUM_SET(iphdr, 0);
+        IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+
+        /* checksum = (sum of the merged segments' headers) - (pseudo and TCP header of the run);
+         * with the payloads added, the run sums to what all segments summed to together */
+        tcphdr->chksum = 0;
+        sum = FOLD_U32T(gro->csum);
+        sum = FOLD_U32T(sum) + (u16_t)~rpmsg_eth_gro_hdr_sum(iphdr, tcphdr, tcp_len);
+        tcphdr->chksum = (u16_t)FOLD_U32T(FOLD_U32T(sum));
+    }
+
+    rpmsg_eth_input(netif, gro->p, input);
+    gro->p = NULL;
+}
+
+/* Merge p into the run, or start a new run with it. Returns 0 if p is not a candidate at all. */
+static int rpmsg_eth_gro_receive(struct netif* netif, struct rpmsg_eth_gro* gro, struct pbuf* p,
+                                 netif_input_fn input, u16_t link_len)
+{
+    struct ip_hdr* iphdr;
+    struct tcp_hdr* tcphdr;
+    u16_t ip_len, hdr_len, data_len;
+    u8_t flags;
+
+    if (link_len > 0 &&
+        (p->len < SIZEOF_ETH_HDR || ((struct eth_hdr*)p->payload)->type != PP_HTONS(ETHTYPE_IP))) {
+        return 0;
+    }
+    if (p->len < link_len + IP_HLEN + TCP_HLEN) {
+        return 0;
+    }
+    iphdr = (struct ip_hdr*)((u8_t*)p->payload + link_len);
+    ip_len = lwip_ntohs(IPH_LEN(iphdr));
+    if (IPH_V(iphdr) != 4 || IPH_HL_BYTES(iphdr) != IP_HLEN || IPH_PROTO(iphdr) != IP_PROTO_TCP ||
+        (IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0 || ip_len != p->tot_len - link_len) {
+        return 0;
+    }
+    tcphdr = (struct tcp_hdr*)(iphdr + 1);
+    hdr_len = (u16_t)(link_len + IP_HLEN + TCPH_HDRLEN_BYTES(tcphdr));
+    flags = TCPH_FLAGS(tcphdr);
+    if (TCPH_HDRLEN_BYTES(tcphdr) < TCP_HLEN || p->len < hdr_len || hdr_len >= p->tot_len ||
+        (flags & ~(TCP_ACK | TCP_PSH)) != 0 || (flags & TCP_ACK) == 0) {
+        return 0;
+    }
+#if CHECKSUM_CHECK_IP
+    IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_CHECK_IP) {
+        /* the merged header gets a fresh checksum, so check this one now */
+        if (inet_chksum(iphdr, IP_HLEN) != 0) {
+            return 0;
+        }
+    }
+#endif
+    data_len = (u16_t)(p->tot_len - hdr_len);
+
+    if (gro->p != NULL && gro->hdr_len == hdr_len && (gro->data_len & 1) == 0 &&
+        (u32_t)IP_HLEN + TCPH_HDRLEN_BYTES(gro->tcphdr) + gro->data_len + data_len <= 0xFFFF &&
+        ip4_addr_cmp(&iphdr->src, &gro->iphdr->src) && ip4_addr_cmp(&iphdr->dest, &gro->iphdr->dest) &&
+        IPH_TOS(iphdr) == IPH_TOS(gro->iphdr) &&
+        tcphdr->src == gro->tcphdr->src && tcphdr->dest == gro->tcphdr->dest &&
+        lwip_ntohl(tcphdr->seqno) == gro->next_seqno && tcphdr->ackno == gro->tcphdr->ackno &&
+        tcphdr->wnd == gro->tcphdr->wnd &&
+        memcmp(tcphdr + 1, gro->tcphdr + 1, TCPH_HDRLEN_BYTES(tcphdr) - TCP_HLEN) == 0) {
+        /* the next segment of the run: append its payload */
+        gro->csum += rpmsg_eth_gro_hdr_sum(iphdr, tcphdr, (u16_t)(ip_len - IP_HLEN));
+        gro->data_len = (u16_t)(gro->data_len + data_len);
+        gro->next_seqno += data_len;
+        gro->segs++;
+        pbuf_remove_header(p, hdr_len);
+        pbuf_cat(gro->p, p);
+        if (flags & TCP_PSH) {
+            TCPH_SET_FLAG(gro->tcphdr, TCP_PSH);
+            rpmsg_eth_gro_flush(netif, gro, input);
+        }
+        return 1;
+    }
+
+    rpmsg_eth_gro_flush(netif, gro, input);
+    if (flags & TCP_PSH) {
+        /* nothing may follow it */
+        return 0;
+    }
+    gro->p = p;
+    gro->iphdr = iphdr;
+    gro->tcphdr = tcphdr;
+    gro->next_seqno = lwip_ntohl(tcphdr->seqno) + data_len;
+    gro->csum = rpmsg_eth_gro_hdr_sum(iphdr, tcphdr, (u16_t)(ip_len - IP_HLEN));
+    gro->hdr_len = hdr_len;
+    gro->data_len = data_len;
+    gro->segs = 1;
+    return 1;
+}
+#endif /* RPMSG_ETH_RX_GRO */
+
+/* Runs in tcpip_thread context, or with the core lock held */
+static err_t rpmsg_eth_rx_batch_fn(struct tcpip_api_call_data* call)
+{
+    struct rpmsg_eth_rx_batch* batch = (struct rpmsg_eth_rx_batch*)call;
+    netif_input_fn input = ethernet_input;
+    u16_t i;
+#if RPMSG_ETH_RX_GRO
+    struct rpmsg_eth_gro gro;
+    u16_t link_len = SIZEOF_ETH_HDR;
+
+    gro.p = NULL;
+#endif
+
+#if RPMSG_ETH_RAW_IP
+    if (((struct rpmsg_eth_priv*)batch->netif->state)->raw_ip) {
+        input = ip_input;
+#if RPMSG_ETH_RX_GRO
+        link_len = 0;
+#endif
+    }
+#endif
+
+#if LWIP_IPV4
+    /* frames routed to the same netif go out together */
+    ip4_forward_batch_begin();
+#endif
+    for (i = 0; i < batch->count; i++) {
+#if RPMSG_ETH_TSTAMP
+        struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)batch->netif->state;
+
+        if (batch->p[i] == rpmsg_eth->ts_pbuf) {
+            rpmsg_eth->ts_pbuf = NULL;
+            rpmsg_eth_ts_hist(rpmsg_eth->ts_stats.stack, rpmsg_eth->ts_input, RPMSG_ETH_TSTAMP_NOW());
+        }
+#endif
+#if RPMSG_ETH_RX_GRO
+        if (rpmsg_eth_gro_receive(batch->netif, &gro, batch->p[i], input, link_len)) {
+            continue;
+        }
+        /* keep the order: what was merged so far goes first */
+        rpmsg_eth_gro_flush(batch->netif, &gro, input);
+#endif
+        rpmsg_eth_input(batch->netif, batch->p[i], input);
+    }
+#if RPMSG_ETH_RX_GRO
+    rpmsg_eth_gro_flush(batch->netif, &gro, input);
+#endif
+#if LWIP_IPV4
+    ip4_forward_batch_end();
+#endif
+
+    return ERR_OK;
+}
+
+/* One per RX ring; the urgent ring's runs at a higher priority and preempts the other between
+ * frames, or inherits the core lock from it */
+static void rpmsg_eth_rx_thread(void* arg)
+{
+    struct rpmsg_eth_rx_ring* rx = (struct rpmsg_eth_rx_ring*)arg;
+    struct rpmsg_eth_rx_batch batch;
+    u32_t head, tail;
+
+    batch.netif = rx->priv->netif;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        tail = rx->tail;
+        for (;;) {
+            head = __atomic_load_n(&rx->head, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                break;
+            }
+
+            for (batch.count = 0; batch.count < RPMSG_ETH_RX_BATCH && tail != head; batch.count++, tail++) {
+                batch.p[batch.count] = rx->ring[tail & (RPMSG_ETH_RX_RING_SIZE - 1)];
+            }
+            __atomic_store_n(&rx->tail, tail, __ATOMIC_RELEASE);
+
+            tcpip_api_call(rpmsg_eth_rx_batch_fn, &batch.call);
+        }
+    }
+}
+#endif /* RPMSG_ETH_RX_THREAD */
+
+#if RPMSG_ETH_BUSY_POLL
+static void rpmsg_eth_busy_poll_thread(void* arg)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)arg;
+    struct rpmsg_virtio_device* rvdev = metal_container_of(rpmsg_eth->rpdev, struct rpmsg_virtio_device, rdev);
+#if MEMP_MAGAZINE
+    /* the RX callback allocates every received pbuf from this thread */
+    struct memp_magazine magazine;
+
+    memp_magazine_thread_init(&magazine);
+#endif
+
+#if RPMSG_ETH_BUSY_POLL_IDLE
+    u32_t seen = rpmsg_eth->counters.rx_msgs;
+    u32_t idle = RPMSG_ETH_BUSY_POLL_IDLE;  // start out waiting for the first kick
+#endif
+
+    for (;;) {
+#if RPMSG_ETH_BUSY_POLL_IDLE
+        if (idle >= RPMSG_ETH_BUSY_POLL_IDLE) {
+            /* a buffer the host queued before the notifications came back on would not kick us */
+            if (virtqueue_enable_cb(rvdev->rvq) == 0) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+            virtqueue_disable_cb(rvdev->rvq);
+            idle = 0;
+        }
+#endif
+        /* runs the rpmsg_virtio RX callback, which drains every used buffer in the vring */
+        virtqueue_notification(rvdev->rvq);
+#if RPMSG_ETH_BUSY_POLL_IDLE
+        /* only our own endpoints count, a pass that just served another one is idle for us */
+        idle = rpmsg_eth->counters.rx_msgs == seen ? idle + 1 : 0;
+        seen = rpmsg_eth->counters.rx_msgs;
+#endif
+        taskYIELD();
+    }
+}
+#endif /* RPMSG_ETH_BUSY_POLL */
+
+#if RPMSG_ETH_ZERO_COPY_RX
+static void rpmsg_eth_rx_pbuf_free(struct pbuf* p)
+{
+    struct rpmsg_eth_rx_pbuf* rx = (struct rpmsg_eth_rx_pbuf*)p;
+
+    rpmsg_release_rx_buffer(rx->ept, rx->rxbuf);
+    LWIP_MEMPOOL_FREE(RPMSG_ETH_RX_PBUF, rx);
+}
+
+/* Wrap one received fragment in a pbuf that references the RPMsg buffer it lives in. Falls back
+ * to a copy when no more buffers may be held, and when asked to, as for packed messages: a held
+ * buffer is not reference counted, so only one pbuf may point into it. */
+static struct pbuf* rpmsg_eth_rx_fragment(struct rpmsg_endpoint* ept, void* rxbuf,
+                                          const void* payload, u16_t len, int copy, u8_t quota)
+{
+    struct rpmsg_eth_rx_pbuf* rx = NULL;
+    struct pbuf* p;
+
+    LWIP_UNUSED_ARG(quota);
+    if (!copy) {
+        rx = (struct rpmsg_eth_rx_pbuf*)LWIP_MEMPOOL_ALLOC(RPMSG_ETH_RX_PBUF);
+    }
+    if (rx == NULL) {
+        p = pbuf_alloc_quota(PBUF_RAW, len, quota);
+        if (p != NULL) {
+            pbuf_take(p, payload, len);
+        }
+        return p;
+    }
+
+    rx->pc.custom_free_function = rpmsg_eth_rx_pbuf_free;
+    rx->ept = ept;
+    rx->rxbuf = rxbuf;
+
+    rpmsg_hold_rx_buffer(ept, rxbuf);
+    return pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rx->pc, (void*)payload, len);
+}
+#endif /* RPMSG_ETH_ZERO_COPY_RX */
+
+/* Whether a frame, or with raw_ip a bare IP packet, is for more than one host */
+static int rpmsg_eth_is_nucast(const struct rpmsg_eth_priv* rpmsg_eth, const u8_t* frame)
+{
+#if RPMSG_ETH_RAW_IP
+    if (rpmsg_eth->raw_ip) {
+        /* IPv4 multicast or broadcast destination, or IPv6 multicast */
+        if ((frame[0] >> 4) == 4) {
+            return (frame[16] & 0xF0) == 0xE0 || frame[16] == 0xFF;
+        }
+        return frame[24] == 0xFF;
+    }
+#else
+    LWIP_UNUSED_ARG(rpmsg_eth);
+#endif
+    return frame[0] & 0x01;
+}
+
+#if RPMSG_ETH_EARLY_DEMUX
+/* Give p to the application if it is a UDP datagram to a claimed port. Returns 1 if it took p. */
+static int rpmsg_eth_early_demux(struct rpmsg_eth_priv* rpmsg_eth, struct pbuf* p)
+{
+    struct netif* netif = rpmsg_eth->netif;
+    const struct ip_hdr* iphdr;
+    const struct udp_hdr* udphdr;
+    struct rpmsg_eth_udp_claim* claim = NULL;
+    rpmsg_eth_udp_recv_fn recv;
+    void* arg;
+    ip4_addr_t src;
+    u16_t link_len = SIZEOF_ETH_HDR;
+    u16_t iphl, dport, sport, udp_len;
+    int i;
+
+#if RPMSG_ETH_RAW_IP
+    if (rpmsg_eth->raw_ip) {
+        link_len = 0;
+    }
+#endif
+    /* the headers must be in the first pbuf, anything unusual goes the normal way */
+    if (p->len < link_len + IP_HLEN + UDP_HLEN ||
+        (link_len > 0 && ((const struct eth_hdr*)p->payload)->type != PP_HTONS(ETHTYPE_IP))) {
+        return 0;
+    }
+    iphdr = (const struct ip_hdr*)((const u8_t*)p->payload + link_len);
+    iphl = IPH_HL_BYTES(iphdr);
+    if (IPH_V(iphdr) != 4 || IPH_PROTO(iphdr) != IP_PROTO_UDP || iphl < IP_HLEN ||
+        p->len < link_len + iphl + UDP_HLEN ||
+        (IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0 ||
+        !ip4_addr_cmp(&iphdr->dest, netif_ip4_addr(netif))) {
+        return 0;
+    }
+    udphdr = (const struct udp_hdr*)((const u8_t*)iphdr + iphl);
+    dport = lwip_ntohs(udphdr->dest);
+    udp_len = lwip_ntohs(udphdr->len);
+    if (dport == 0 || udp_len < UDP_HLEN || lwip_ntohs(IPH_LEN(iphdr)) != iphl + udp_len ||
+        p->tot_len < link_len + iphl + udp_len) {
+        return 0;
+    }
+    for (i = 0; i < RPMSG_ETH_EARLY_DEMUX_PORTS; i++) {
+        if (rpmsg_eth->udp_claims[i].port == dport) {
+            claim = &rpmsg_eth->udp_claims[i];
+            break;
+        }
+    }
+    if (claim == NULL) {
+        return 0;
+    }
+
+    /* Mark the claim busy before checking the port again: either rpmsg_eth_udp_release() sees us
+     * and waits for recv to return, or we see the port it cleared and leave p to the stack. The
+     * load pairs with the release store of rpmsg_eth_udp_claim(), recv and arg are those the
+     * port was claimed with. */
+    __atomic_fetch_add(&claim->busy, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&claim->port, __ATOMIC_SEQ_CST) != dport) {
+        __atomic_fetch_sub(&claim->busy, 1, __ATOMIC_RELEASE);
+        return 0;
+    }
+    recv = claim->recv;
+    arg = claim->arg;
+    ip4_addr_copy(src, iphdr->src);
+    sport = lwip_ntohs(udphdr->src);
+    /* drop the headers and any Ethernet padding */
+    pbuf_remove_header(p, (size_t)(link_len + iphl + UDP_HLEN));
+    pbuf_realloc(p, (u16_t)(udp_len - UDP_HLEN));
+    recv(arg, netif, p, &src, sport);
+    __atomic_fetch_sub(&claim->busy, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+#endif /* RPMSG_ETH_EARLY_DEMUX */
+
+#if RPMSG_ETH_ICMP_ECHO
+/* RFC 1624 update of Internet checksum sum for one 16 bit word going from old_word to new_word,
+ * all three as they are in the frame */
+static u16_t rpmsg_eth_chksum_adjust(u16_t sum, u16_t old_word, u16_t new_word)
+{
+    u32_t acc = (u32_t)(u16_t)~sum + (u16_t)~old_word + new_word;
+
+    acc = (acc >> 16) + (acc & 0xFFFFUL);
+    acc += acc >> 16;
+    return (u16_t)~acc;
+}
+
+/* Answer p if it is an ICMP echo request to our address. Returns 1 if it took p. */
+static int rpmsg_eth_icmp_echo(struct rpmsg_eth_priv* rpmsg_eth, struct pbuf* p)
+{
+    struct netif* netif = rpmsg_eth->netif;
+    struct rpmsg_eth_frag_hdr* hdr;
+    struct ip_hdr* iphdr;
+    struct icmp_echo_hdr* icmphdr;
+    ip4_addr_p_t addr;
+    uint32_t buf_len;
+    u16_t link_len = SIZEOF_ETH_HDR;
+    u16_t ip_len, old_word, new_word;
+
+#if RPMSG_ETH_RAW_IP
+    if (rpmsg_eth->raw_ip) {
+        link_len = 0;
+    }
+#endif
+    /* the headers must be in the first pbuf, anything unusual goes the normal way */
+    if (p->len < link_len + IP_HLEN + sizeof(struct icmp_echo_hdr) ||
+        (link_len > 0 && ((const struct eth_hdr*)p->payload)->type != PP_HTONS(ETHTYPE_IP))) {
+        return 0;
+    }
+    iphdr = (struct ip_hdr*)((u8_t*)p->payload + link_len);
+    icmphdr = (struct icmp_echo_hdr*)((u8_t*)iphdr + IP_HLEN);
+    ip_len = lwip_ntohs(IPH_LEN(iphdr));
+    if (IPH_V(iphdr) != 4 || IPH_HL_BYTES(iphdr) != IP_HLEN || IPH_PROTO(iphdr) != IP_PROTO_ICMP ||
+        (IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0 ||
+        ICMPH_TYPE(icmphdr) != ICMP_ECHO || ICMPH_CODE(icmphdr) != 0 ||
+        ip_len < IP_HLEN + sizeof(struct icmp_echo_hdr) || p->tot_len < link_len + ip_len ||
+        ip4_addr_isany(netif_ip4_addr(netif)) || !ip4_addr_cmp(&iphdr->dest, netif_ip4_addr(netif)) ||
+        ip4_addr_isbroadcast(&iphdr->src, netif) || ip4_addr_ismulticast(&iphdr->src)) {
+        return 0;
+    }
+    if (sizeof(*hdr) + link_len + ip_len > rpmsg_eth->tx_msg_size || !netif_is_link_up(netif)) {
+        return 0;
+    }
+
+    /* take the TX buffer first: without one p is still untouched and the stack queues the reply */
+    hdr = (struct rpmsg_eth_frag_hdr*)rpmsg_get_tx_payload_buffer(&rpmsg_eth->queues[0].ept, &buf_len, 0);
+    if (hdr == NULL) {
+        return 0;
+    }
+    LWIP_ASSERT("RPMsg TX buffer too small", buf_len >= sizeof(*hdr) + link_len + ip_len);
+
+    /* drop any Ethernet padding, then turn the request around where it is */
+    pbuf_realloc(p, (u16_t)(link_len + ip_len));
+    if (link_len > 0) {
+        struct eth_hdr* ethhdr = (struct eth_hdr*)p->payload;
+
+        SMEMCPY(&ethhdr->dest, &ethhdr->src, ETH_HWADDR_LEN);
+        SMEMCPY(&ethhdr->src, netif->hwaddr, ETH_HWADDR_LEN);
+    }
+    ip4_addr_copy(addr, iphdr->src);
+    ip4_addr_copy(iphdr->src, iphdr->dest);
+    ip4_addr_copy(iphdr->dest, addr);
+
+    /* TTL and protocol share a checksum word, as do ICMP type and code */
+    SMEMCPY(&old_word, &iphdr->_ttl, sizeof(old_word));
+    IPH_TTL_SET(iphdr, ICMP_TTL);
+    SMEMCPY(&new_word, &iphdr->_ttl, sizeof(new_word));
+    IPH_CHKSUM_SET(iphdr, rpmsg_eth_chksum_adjust(IPH_CHKSUM(iphdr), old_word, new_word));
+
+    SMEMCPY(&old_word, icmphdr, sizeof(old_word));
+    ICMPH_TYPE_SET(icmphdr, ICMP_ER);
+    SMEMCPY(&new_word, icmphdr, sizeof(new_word));
+    icmphdr->chksum = rpmsg_eth_chksum_adjust(icmphdr->chksum, old_word, new_word);
+
+    CAPTURE_TX(netif, p);
+    hdr->frame_len = lwip_htons(p->tot_len);
+    hdr->offset = 0;
+    pbuf_copy_partial(p, hdr + 1, p->tot_len, 0);
+    /* counted like the statistics replies, racing the tcpip thread's TX accounting */
+    if (rpmsg_send_nocopy(&rpmsg_eth->queues[0].ept, hdr, (int)(sizeof(*hdr) + p->tot_len)) < 0) {
+        rpmsg_eth_tx_count(rpmsg_eth, p, ERR_BUF);
+    } else {
+        rpmsg_eth->counters.tx_msgs++;
+        rpmsg_eth_tx_count(rpmsg_eth, p, ERR_OK);
+    }
+    pbuf_free(p);
+    return 1;
+}
+#endif /* RPMSG_ETH_ICMP_ECHO */
+
+/* Hand a complete frame to the stack, through RX ring ring with RPMSG_ETH_RX_THREAD. LINK_STATS
+ * are shared by all interfaces; the MIB2 counters are the netif's own. */
+static LWIP_HOT_TEXT void rpmsg_eth_rx_deliver(struct rpmsg_eth_priv* rpmsg_eth, struct pbuf* p, u8_t ring)
+{
+    LWIP_UNUSED_ARG(ring);
+    PBUF_SET_RX_TIME(p);
+    CAPTURE_RX(rpmsg_eth->netif, p);
+    rpmsg_eth->counters.rx_frames++;
+    LINK_STATS_INC(link.recv);
+    MIB2_STATS_NETIF_ADD(rpmsg_eth->netif, ifinoctets, p->tot_len);
+    if (rpmsg_eth_is_nucast(rpmsg_eth, (const u8_t*)p->payload)) {
+        MIB2_STATS_NETIF_INC(rpmsg_eth->netif, ifinnucastpkts);
+    } else {
+        MIB2_STATS_NETIF_INC(rpmsg_eth->netif, ifinucastpkts);
+    }
+#if RPMSG_ETH_ICMP_ECHO
+    if (rpmsg_eth_icmp_echo(rpmsg_eth, p)) {
+        return;
+    }
+#endif
+#if RPMSG_ETH_EARLY_DEMUX
+    if (rpmsg_eth_early_demux(rpmsg_eth, p)) {
+        return;
+    }
+#endif
+#if RPMSG_ETH_RX_THREAD
+    rpmsg_eth_rx_enqueue(&rpmsg_eth->rx[ring], p);
+#elif RPMSG_ETH_RAW_IP
+    rpmsg_eth_input(rpmsg_eth->netif, p, rpmsg_eth->raw_ip ? rpmsg_eth_raw_input : rpmsg_eth->netif->input);
+#else
+    rpmsg_eth_input(rpmsg_eth->netif, p, rpmsg_eth->netif->input);
+#endif
+}
+
+/* Copy len bytes of frame p from offset on to dst, the one copy into a message or a ring slot. A
+ * range inside the first pbuf, i.e. any frame lwIP built in one pbuf, is a plain memcpy; a chain,
+ * e.g. a TCP segment whose header pbuf is followed by PBUF_REF data, is gathered pbuf by pbuf. */
+static LWIP_HOT_TEXT void rpmsg_eth_tx_gather(const struct pbuf* p, void* dst, u16_t len, u16_t offset)
+{
+    if ((u32_t)offset + len <= p->len) {
+        MEMCPY(dst, (const u8_t*)p->payload + offset, len);
+    } else {
+        pbuf_copy_partial(p, dst, len, offset);
+    }
+}
+
+#if RPMSG_ETH_SHM
+#define RPMSG_ETH_SHM_SLOT_SIZE(len) \
+    ((sizeof(struct rpmsg_eth_shm_slot) + (len) + RPMSG_ETH_SHM_ALIGN - 1) & ~(u32_t)(RPMSG_ETH_SHM_ALIGN - 1))
+
+/* the control blocks and slots live in non-cacheable memory shared with the host */
+#define RPMSG_ETH_SHM_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/* Returns 0 when the vring is full */
+static int rpmsg_eth_shm_doorbell(struct rpmsg_eth_priv* rpmsg_eth)
+{
+    struct rpmsg_eth_doorbell db;
+
+    memset(&db, 0, sizeof(db));
+    db.magic = lwip_htonl(RPMSG_ETH_DOORBELL_MAGIC);
+    if (rpmsg_trysend(&rpmsg_eth->queues[0].ept, &db, sizeof(db)) < 0) {
+        return 0;
+    }
+    rpmsg_eth->counters.tx_msgs++;
+    return 1;
+}
+
+/* Frames taking more than half a data area go through RPMsg buffers, so a frame that is let into
+ * the ring is sure to fit once the host has drained it */
+static int rpmsg_eth_shm_takes(struct rpmsg_eth_priv* rpmsg_eth, u16_t len)
+{
+    return rpmsg_eth->shm_active && RPMSG_ETH_SHM_SLOT_SIZE(len) <= rpmsg_eth->shm_ring_size / 2;
+}
+
+/* Reset both control blocks and offer the region to the host. Runs in the tcpip thread, the only
+ * producer on ring 1, after every hello since the host may have been restarted. */
+static void rpmsg_eth_shm_offer(struct rpmsg_eth_priv* rpmsg_eth)
+{
+    struct rpmsg_eth_shm_offer offer;
+
+    if (rpmsg_eth->shm_rx == NULL) {
+        return;
+    }
+
+    rpmsg_eth->shm_offered = 0;
+    rpmsg_eth->shm_active = 0;
+    RPMSG_ETH_SHM_BARRIER();
+
+    memset((void*)rpmsg_eth->shm_rx, 0, 2 * sizeof(struct rpmsg_eth_shm_ring));
+    rpmsg_eth->shm_rx_tail = 0;
+    rpmsg_eth->shm_tx_head = 0;
+    /* the host rings the doorbell on its first frame */
+    rpmsg_eth->shm_rx->cons_wait = 1;
+    RPMSG_ETH_SHM_BARRIER();
+    rpmsg_eth->shm_offered = 1;
+
+    memset(&offer, 0, sizeof(offer));
+    offer.magic = lwip_htonl(RPMSG_ETH_SHM_MAGIC);
+    offer.addr_lo = lwip_htonl((u32_t)((uint64_t)RPMSG_ETH_SHM_HOST_ADDR & 0xFFFFFFFFUL));
+    offer.addr_hi = lwip_htonl((u32_t)((uint64_t)RPMSG_ETH_SHM_HOST_ADDR >> 32));
+    offer.size = lwip_htonl(RPMSG_ETH_SHM_SIZE);
+    offer.ring_size = lwip_htonl(rpmsg_eth->shm_ring_size);
+
+    if (rpmsg_trysend(&rpmsg_eth->queues[0].ept, &offer, sizeof(offer)) < 0) {
+        LWIP_DEBUGF(NETIF_DEBUG, ("rpmsg_eth: cannot offer shared memory to the host\n"));
+    }
+}
+
+/* The host echoed our offer */
+static void rpmsg_eth_rx_shm_accept(struct rpmsg_eth_priv* rpmsg_eth, const void* data, size_t len)
+{
+    const struct rpmsg_eth_shm_offer* offer = (const struct rpmsg_eth_shm_offer*)data;
+
+    if (len < sizeof(*offer) || !rpmsg_eth->shm_offered ||
+        lwip_ntohl(offer->ring_size) != rpmsg_eth->shm_ring_size) {
+        LINK_STATS_INC(link.proterr);
+        return;
+    }
+
+    rpmsg_eth->shm_active = 1;
+}
+
+/* Copy frame p into ring 1. Runs in the tcpip thread. On ERR_WOULDBLOCK the ring is full and
+ * the caller retries from its TX timer. */
+static err_t rpmsg_eth_shm_tx(struct rpmsg_eth_priv* rpmsg_eth, struct pbuf* p, u16_t len)
+{
+    volatile struct rpmsg_eth_shm_ring* ring = rpmsg_eth->shm_tx;
+    struct rpmsg_eth_shm_slot* slot;
+    u32_t head = rpmsg_eth->shm_tx_head;
+    u32_t off = head & (rpmsg_eth->shm_ring_size - 1);
+    u32_t size = RPMSG_ETH_SHM_SLOT_SIZE(len);
+    u32_t contig = rpmsg_eth->shm_ring_size - off;
+    u32_t need = size <= contig ? size : contig + size;
+
+    if (need > rpmsg_eth->shm_ring_size - (head - ring->tail)) {
+        return ERR_WOULDBLOCK;
+    }
+
+    if (need != size) {
+        slot = (struct rpmsg_eth_shm_slot*)(rpmsg_eth->shm_tx_data + off);
+        slot->len = 0;
+        slot->flags = RPMSG_ETH_SHM_WRAP;
+        head += contig;
+        off = 0;
+    }
+
+    slot = (struct rpmsg_eth_shm_slot*)(rpmsg_eth->shm_tx_data + off);
+    slot->len = len;
+    slot->flags = 0;
+    rpmsg_eth_tx_gather(p, slot + 1, len, ETH_PAD_SIZE);
+    head += size;
+
+    /* the slot must be visible before the head that covers it */
+    RPMSG_ETH_SHM_BARRIER();
+    ring->head = head;
+    rpmsg_eth->shm_tx_head = head;
+
+    /* the host only needs a doorbell if it has drained the ring and went to sleep */
+    RPMSG_ETH_SHM_BARRIER();
+    if (ring->cons_wait) {
+        ring->cons_wait = 0;
+        if (!rpmsg_eth_shm_doorbell(rpmsg_eth)) {
+            /* try again with the next frame */
+            ring->cons_wait = 1;
+        }
+    }
+
+    return ERR_OK;
+}
+
+/* Next frame from ring 0, or NULL once it is empty. Frames that cannot be delivered are dropped
+ * and counted here. */
+static struct pbuf* rpmsg_eth_shm_rx_one(struct rpmsg_eth_priv* rpmsg_eth)
+{
+    volatile struct rpmsg_eth_shm_ring* ring = rpmsg_eth->shm_rx;
+    const struct rpmsg_eth_shm_slot* slot;
+    struct pbuf* p;
+    u32_t head, off;
+    u16_t len;
+
+    for (;;) {
+        head = ring->head;
+        if (head == rpmsg_eth->shm_rx_tail) {
+            return NULL;
+        }
+        /* read the slot only after the head that covers it */
+        RPMSG_ETH_SHM_BARRIER();
+
+        p = NULL;
+        off = rpmsg_eth->shm_rx_tail & (rpmsg_eth->shm_ring_size - 1);
+        slot = (const struct rpmsg_eth_shm_slot*)(rpmsg_eth->shm_rx_data + off);
+        len = slot->len;
+        if (slot->flags & RPMSG_ETH_SHM_WRAP) {
+            rpmsg_eth->shm_rx_tail += rpmsg_eth->shm_ring_size - off;
+        } else if (RPMSG_ETH_SHM_SLOT_SIZE(len) > rpmsg_eth->shm_ring_size - off) {
+            /* the host wrote garbage; skip whatever it has produced so far */
+            LINK_STATS_INC(link.proterr);
+            rpmsg_eth->shm_rx_tail = head;
+        } else {
+            if (len < SIZEOF_ETH_HDR || len > rpmsg_eth->rx_max_frame) {
+                LINK_STATS_INC(link.lenerr);
+            } else if ((p = pbuf_alloc_quota(PBUF_RAW, len, rpmsg_eth->pool_quota)) == NULL) {
+                LINK_STATS_INC(link.memerr);
+                MIB2_STATS_NETIF_INC(rpmsg_eth->netif, ifindiscards);
+            } else {
+                pbuf_take(p, slot + 1, len);
+            }
+            rpmsg_eth->shm_rx_tail += RPMSG_ETH_SHM_SLOT_SIZE(len);
+        }
+
+        /* done reading the slot before handing it back */
+        RPMSG_ETH_SHM_BARRIER();
+        ring->tail = rpmsg_eth->shm_rx_tail;
+        if (p != NULL) {
+            return p;
+        }
+    }
+}
+
+/* The host produced on ring 0 or made room on ring 1. Ring 1 needs nothing: we never wait for a
+ * doorbell there and retry from the TX timer instead. */
+static void rpmsg_eth_rx_doorbell(struct rpmsg_eth_priv* rpmsg_eth)
+{
+    volatile struct rpmsg_eth_shm_ring* ring = rpmsg_eth->shm_rx;
+    struct pbuf* p;
+
+    if (!rpmsg_eth->shm_offered) {
+        return;
+    }
+
+    do {
+        while ((p = rpmsg_eth_shm_rx_one(rpmsg_eth)) != NULL) {
+            rpmsg_eth_rx_deliver(rpmsg_eth, p, 0);
+        }
+
+        /* wake the host if it waits for room */
+        RPMSG_ETH_SHM_BARRIER();
+        if (ring->prod_wait) {
+            ring->prod_wait = 0;
+            rpmsg_eth_shm_doorbell(rpmsg_eth);
+        }
+
+        /* ask for a doorbell on the next frame, and look again in case it came in before the
+         * host could see that */
+        ring->cons_wait = 1;
+        RPMSG_ETH_SHM_BARRIER();
+    } while (ring->head != rpmsg_eth->shm_rx_tail);
+}
+#else
+#define rpmsg_eth_shm_takes(rpmsg_eth, len) 0
+#endif /* RPMSG_ETH_SHM */
+
+#if RPMSG_ETH_MCAST_FILTER
+static void rpmsg_eth_mcast_timeout(void* arg);
+
+/* Tell the host which multicast addresses to forward. Runs in the tcpip thread. */
+static void rpmsg_eth_mcast_send(struct rpmsg_eth_priv* rpmsg_eth)
+{
+    u8_t msg[sizeof(struct rpmsg_eth_mcast_filter) + RPMSG_ETH_MCAST_FILTER_MAX * ETH_HWADDR_LEN];
+    struct rpmsg_eth_mcast_filter* filter = (struct rpmsg_eth_mcast_filter*)msg;
+    u16_t count = 0;
+    u16_t len;
+    int i;
+
+    if (!(rpmsg_eth->peer_features & RPMSG_ETH_F_MCAST)) {
+        /* an older host forwards everything; this one gets the list with its hello */
+        return;
+    }
+
+    memset(filter, 0, sizeof(*filter));
+    filter->magic = lwip_htonl(RPMSG_ETH_MCAST_MAGIC);
+    if (rpmsg_eth->mcast_overflow) {
+        filter->flags = RPMSG_ETH_MCAST_ALL;
+    } else {
+        for (i = 0; i < RPMSG_ETH_MCAST_FILTER_MAX; i++) {
+            if (rpmsg_eth->mcast[i].refs != 0) {
+                memcpy(msg + sizeof(*filter) + count * ETH_HWADDR_LEN, &rpmsg_eth->mcast[i].addr, ETH_HWADDR_LEN);
+                count++;
+            }
+        }
+    }
+    len = (u16_t)(sizeof(*filter) + count * ETH_HWADDR_LEN);
+    if (len > rpmsg_eth->tx_msg_size) {
+        filter->flags = RPMSG_ETH_MCAST_ALL;
+        count = 0;
+        len = sizeof(*filter);
+    }
+    filter->count = lwip_htons(count);
+
+    if (rpmsg_trysend(&rpmsg_eth->queues[0].ept, msg, len) < 0) {
+        /* the list is rebuilt on the next try, changes in between are not lost */
+        if (!rpmsg_eth->mcast_retry) {
+            rpmsg_eth->mcast_retry = 1;
+            sys_timeout(RPMSG_ETH_TX_RETRY_MS, rpmsg_eth_mcast_timeout, rpmsg_eth);
+        }
+        return;
+    }
+    rpmsg_eth->counters.tx_msgs++;
+}
+
+static void rpmsg_eth_mcast_timeout(void* arg)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)arg;
+
+    rpmsg_eth->mcast_retry = 0;
+    rpmsg_eth_mcast_send(rpmsg_eth);
+}
+
+/* Count one more or one less group on a multicast MAC address */
+static err_t rpmsg_eth_mcast_update(struct netif* netif, const struct eth_addr* addr,
+                                    enum netif_mac_filter_action action)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
+    struct rpmsg_eth_mcast* free_entry = NULL;
+    int i;
+
+    for (i = 0; i < RPMSG_ETH_MCAST_FILTER_MAX; i++) {
+        struct rpmsg_eth_mcast* entry = &rpmsg_eth->mcast[i];
+
+        if (entry->refs == 0) {
+            if (free_entry == NULL) {
+                free_entry = entry;
+            }
+        } else if (eth_addr_cmp(&entry->addr, addr)) {
+            if (action == NETIF_ADD_MAC_FILTER) {
+                entry->refs++;
+                return ERR_OK;
+            }
+            if (--entry->refs == 0) {
+                rpmsg_eth_mcast_send(rpmsg_eth);
+            }
+            return ERR_OK;
+        }
+    }
+
+    if (action == NETIF_ADD_MAC_FILTER) {
+        if (free_entry == NULL) {
+            /* nothing is lost, the host just has to pass everything */
+            if (rpmsg_eth->mcast_overflow++ == 0) {
+                rpmsg_eth_mcast_send(rpmsg_eth);
+            }
+            return ERR_OK;
+        }
+        free_entry->addr = *addr;
+        free_entry->refs = 1;
+    } else if (rpmsg_eth->mcast_overflow == 0 || --rpmsg_eth->mcast_overflow != 0) {
+        /* an address we never had; or one of several that did not fit */
+        return ERR_OK;
+    }
+    rpmsg_eth_mcast_send(rpmsg_eth);
+    return ERR_OK;
+}
+
+#if LWIP_IGMP
+static err_t rpmsg_eth_igmp_mac_filter(struct netif* netif, const ip4_addr_t* group,
+                                       enum netif_mac_filter_action action)
+{
+    struct eth_addr addr;
+
+    /* 01:00:5e followed by the low 23 bits of the group */
+    addr.addr[0] = LL_IP4_MULTICAST_ADDR_0;
+    addr.addr[1] = LL_IP4_MULTICAST_ADDR_1;
+    addr.addr[2] = LL_IP4_MULTICAST_ADDR_2;
+    addr.addr[3] = ip4_addr2(group) & 0x7f;
+    addr.addr[4] = ip4_addr3(group);
+    addr.addr[5] = ip4_addr4(group);
+    return rpmsg_eth_mcast_update(netif, &addr, action);
+}
+#endif /* LWIP_IGMP */
+
+#if LWIP_IPV6_MLD
+static err_t rpmsg_eth_mld_mac_filter(struct netif* netif, const ip6_addr_t* group,
+                                      enum netif_mac_filter_action action)
+{
+    struct eth_addr addr;
+    u32_t low = lwip_ntohl(group->addr[3]);
+
+    /* 33:33 followed by the low 32 bits of the group */
+    addr.addr[0] = LL_IP6_MULTICAST_ADDR_0;
+    addr.addr[1] = LL_IP6_MULTICAST_ADDR_1;
+    addr.addr[2] = (u8_t)(low >> 24);
+    addr.addr[3] = (u8_t)(low >> 16);
+    addr.addr[4] = (u8_t)(low >> 8);
+    addr.addr[5] = (u8_t)low;
+    return rpmsg_eth_mcast_update(netif, &addr, action);
+}
+#endif /* LWIP_IPV6_MLD */
+#endif /* RPMSG_ETH_MCAST_FILTER */
+
+/* Runs in the tcpip thread. The netif takes the host's MTU as long as it is not above our own;
+ * TCP connections opened from then on derive their MSS from it. */
+static void rpmsg_eth_mtu_apply(void* arg)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)arg;
+
+    rpmsg_eth->netif->mtu = LWIP_MIN(rpmsg_eth->mtu, rpmsg_eth->peer_mtu);
+#if LWIP_IPV6 && LWIP_ND6_ALLOW_RA_UPDATES
+    rpmsg_eth->netif->mtu6 = rpmsg_eth->netif->mtu;
+#endif
+}
+
+/* Runs in the tcpip thread, where netif may be changed */
+static void rpmsg_eth_hello_apply(void* arg)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)arg;
+
+    rpmsg_eth_mtu_apply(rpmsg_eth);
+
+#if RPMSG_ETH_POINT_TO_POINT
+    /* a host without an address in its hello keeps being resolved by ARP */
+    rpmsg_eth->p2p_hwaddr = rpmsg_eth->peer_hwaddr;
+    rpmsg_eth->p2p_valid = !eth_addr_cmp(&rpmsg_eth->p2p_hwaddr, &ethzero) &&
+                           !(rpmsg_eth->p2p_hwaddr.addr[0] & 0x01);
+#endif
+
+#if RPMSG_ETH_RAW_IP
+    if (rpmsg_eth->raw_ip) {
+        /* no Ethernet header and no ARP on the link from now on */
+        rpmsg_eth->netif->output = rpmsg_eth_ip_output;
+#if LWIP_IPV6
+        rpmsg_eth->netif->output_ip6 = rpmsg_eth_ip6_output;
+#endif
+        netif_clear_flags(rpmsg_eth->netif, NETIF_FLAG_ETHARP);
+    }
+#endif
+
+#if LWIP_IPV6 && (RPMSG_ETH_POINT_TO_POINT || RPMSG_ETH_RAW_IP)
+    if (rpmsg_eth_ip6_no_dad(rpmsg_eth)) {
+        rpmsg_eth_ip6_settle(rpmsg_eth->netif);
+    }
+#endif
+
+#if RPMSG_ETH_CSUM_OFFLOAD
+    if ((rpmsg_eth->peer_features & RPMSG_ETH_F_CSUM) && !(rpmsg_eth->flags & RPMSG_ETH_CFG_NO_CSUM_OFFLOAD)) {
+        NETIF_SET_CHECKSUM_CTRL(rpmsg_eth->netif, NETIF_CHECKSUM_ENABLE_ALL &
+                                ~(NETIF_CHECKSUM_GEN_UDP | NETIF_CHECKSUM_GEN_TCP |
+                                  NETIF_CHECKSUM_CHECK_UDP | NETIF_CHECKSUM_CHECK_TCP));
+    }
+#endif
+
+#if RPMSG_ETH_SHM
+    rpmsg_eth_shm_offer(rpmsg_eth);
+#endif
+#if RPMSG_ETH_MCAST_FILTER
+    /* the host starts out passing everything */
+    rpmsg_eth_mcast_send(rpmsg_eth);
+#endif
+
+    /* the host's endpoint is known now */
+    netif_set_link_up(rpmsg_eth->netif);
+}
+
+/* The host's hello: note what it supports and answer with ours */
+static void rpmsg_eth_rx_hello(struct rpmsg_eth_queue* q, const void* data, size_t len)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = q->priv;
+    const struct rpmsg_eth_hello* hello = (const struct rpmsg_eth_hello*)data;
+    struct rpmsg_eth_hello reply;
+    u32_t features;
+    u16_t buf_size;
+
+    if (len < sizeof(*hello) || lwip_ntohl(hello->magic) != RPMSG_ETH_HELLO_MAGIC ||
+        lwip_ntohs(hello->version) < RPMSG_ETH_HELLO_VERSION) {
+        LINK_STATS_INC(link.proterr);
+        return;
+    }
+
+    /* the hellos on the other endpoints only teach them the host's address */
+    if (q != &rpmsg_eth->queues[0]) {
+        return;
+    }
+
+    buf_size = lwip_ntohs(hello->buf_size);
+    if (buf_size <= sizeof(struct rpmsg_eth_frag_hdr)) {
+        LINK_STATS_INC(link.proterr);
+        return;
+    }
+
+    rpmsg_eth->tx_msg_size = (u16_t)LWIP_MIN(buf_size, rpmsg_eth->buf_size);
+    rpmsg_eth->peer_features = lwip_ntohl(hello->features);
+#if RPMSG_ETH_RAW_IP
+    /* before our answer, after which the host may send bare packets */
+    rpmsg_eth->raw_ip = (rpmsg_eth->peer_features & RPMSG_ETH_F_RAW) &&
+                        !(rpmsg_eth->flags & RPMSG_ETH_CFG_NO_RAW_IP);
+#endif
+    rpmsg_eth->peer_mtu = lwip_ntohs(hello->mtu);
+#if RPMSG_ETH_POINT_TO_POINT
+    memcpy(&rpmsg_eth->peer_hwaddr, hello->mac, sizeof(rpmsg_eth->peer_hwaddr));
+#endif
+    if (hello->num_queues > RPMSG_ETH_NUM_QUEUES) {
+        LWIP_DEBUGF(NETIF_DEBUG, ("rpmsg_eth: host uses %u queues, only %u exist\n",
+                                  (unsigned)hello->num_queues, (unsigned)RPMSG_ETH_NUM_QUEUES));
+    }
+    tcpip_try_callback(rpmsg_eth_hello_apply, rpmsg_eth);
+
+    memset(&reply, 0, sizeof(reply));
+    reply.magic = lwip_htonl(RPMSG_ETH_HELLO_MAGIC);
+    reply.version = lwip_htons(RPMSG_ETH_HELLO_VERSION);
+    reply.mtu = lwip_htons(rpmsg_eth->mtu);
+    reply.buf_size = lwip_htons(rpmsg_eth->buf_size);
+    reply.num_queues = RPMSG_ETH_NUM_QUEUES;
+    features = RPMSG_ETH_F_PACK;
+#if RPMSG_ETH_RAW_IP
+    if (!(rpmsg_eth->flags & RPMSG_ETH_CFG_NO_RAW_IP)) {
+        features |= RPMSG_ETH_F_RAW;
+    }
+#endif
+#if RPMSG_ETH_CSUM_OFFLOAD
+    if (!(rpmsg_eth->flags & RPMSG_ETH_CFG_NO_CSUM_OFFLOAD)) {
+        features |= RPMSG_ETH_F_CSUM;
+#if RPMSG_ETH_TSO
+        features |= RPMSG_ETH_F_TSO;
+        reply.tso_max = lwip_htons(RPMSG_ETH_TSO_MAX_FRAME);
+#endif
+    }
+#endif
+#if RPMSG_ETH_TSTAMP
+    features |= RPMSG_ETH_F_TSTAMP;
+#endif
+#if RPMSG_ETH_STATS
+    features |= RPMSG_ETH_F_STATS;
+#endif
+    features |= RPMSG_ETH_F_COALESCE | RPMSG_ETH_F_MTU;
+#if RPMSG_ETH_RX_URGENT
+    features |= RPMSG_ETH_F_PRIO;
+#endif
+    reply.features = lwip_htonl(features);
+    memcpy(reply.mac, rpmsg_eth->netif->hwaddr, sizeof(reply.mac));
+
+    if (rpmsg_trysend(&q->ept, &reply, sizeof(reply)) < 0) {
+        LWIP_DEBUGF(NETIF_DEBUG, ("rpmsg_eth: cannot answer the host's hello\n"));
+    }
+}
+
+#if RPMSG_ETH_TSTAMP
+static void rpmsg_eth_rx_tstamp(struct rpmsg_eth_queue* q, const void* data, size_t len)
+{
+    const struct rpmsg_eth_tstamp* ts = (const struct rpmsg_eth_tstamp*)data;
+
+    if (len < sizeof(*ts)) {
+        LINK_STATS_INC(link.proterr);
+        return;
+    }
+    /* stamps of another clock cannot be compared with ours */
+    if (lwip_ntohl(ts->hz) != RPMSG_ETH_TSTAMP_HZ) {
+        q->ts_state = RPMSG_ETH_TS_NONE;
+        return;
+    }
+    q->ts_xmit = ((u64_t)lwip_ntohl(ts->xmit_hi) << 32) | lwip_ntohl(ts->xmit_lo);
+    q->ts_send = ((u64_t)lwip_ntohl(ts->send_hi) << 32) | lwip_ntohl(ts->send_lo);
+    q->ts_state = RPMSG_ETH_TS_PENDING;
+}
+
+/* Deliver a frame the host stamped and account its stages; the last one, up to the stack taking
+ * it, is only seen with RPMSG_ETH_RX_THREAD */
+static void rpmsg_eth_rx_deliver_stamped(struct rpmsg_eth_queue* q, struct pbuf* p)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = q->priv;
+    struct rpmsg_eth_tstamp_stats* stats = &rpmsg_eth->ts_stats;
+    u64_t now = RPMSG_ETH_TSTAMP_NOW();
+
+    stats->samples++;
+    rpmsg_eth_ts_hist(stats->host_queue, q->ts_xmit, q->ts_send);
+    rpmsg_eth_ts_hist(stats->link, q->ts_send, q->ts_cb);
+    rpmsg_eth_ts_hist(stats->rx, q->ts_cb, now);
+#if RPMSG_ETH_RX_THREAD
+    /* one frame at a time; a frame dropped on the way just leaves the slot until the next one */
+    rpmsg_eth->ts_input = now;
+    rpmsg_eth->ts_pbuf = p;
+#endif
+    rpmsg_eth_rx_deliver(rpmsg_eth, p, RPMSG_ETH_RX_RING_OF(q));
+}
+
+/* Precede the frame about to be sent with its stamps, if it is a sampled one. xmit is when it was
+ * handed to us. */
+static void rpmsg_eth_tx_tstamp(struct rpmsg_eth_priv* rpmsg_eth, u64_t xmit)
+{
+    struct rpmsg_eth_tstamp ts;
+    u64_t now;
+
+    if (!(rpmsg_eth->peer_features & RPMSG_ETH_F_TSTAMP) || ++rpmsg_eth->ts_count < RPMSG_ETH_TSTAMP_RATE) {
+        return;
+    }
+    rpmsg_eth->ts_count = 0;
+
+    now = RPMSG_ETH_TSTAMP_NOW();
+    memset(&ts, 0, sizeof(ts));
+    ts.magic = lwip_htonl(RPMSG_ETH_TSTAMP_MAGIC);
+    ts.hz = lwip_htonl(RPMSG_ETH_TSTAMP_HZ);
+    ts.xmit_hi = lwip_htonl((u32_t)(xmit >> 32));
+    ts.xmit_lo = lwip_htonl((u32_t)xmit);
+    ts.send_hi = lwip_htonl((u32_t)(now >> 32));
+    ts.send_lo = lwip_htonl((u32_t)now);
+    /* frames go out on the first endpoint, which keeps the two in order */
+    if (rpmsg_trysend(&rpmsg_eth->queues[0].ept, &ts, sizeof(ts)) >= 0) {
+        rpmsg_eth->counters.tx_msgs++;
+    }
+}
+#endif /* RPMSG_ETH_TSTAMP */
+
+/* Append one record of a received message to the frame being reassembled on q */
+static LWIP_HOT_TEXT void rpmsg_eth_rx_record(struct rpmsg_eth_queue* q, struct rpmsg_endpoint* ept,
+                                              void* rxbuf, u16_t frame_len, u16_t offset,
+                                              const void* payload, u16_t frag_len, int packed)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = q->priv;
+
+    if (offset == 0) {
+        /* start of a new frame; anything still pending was never completed */
+        if (q->rx_pbuf != NULL) {
+            LINK_STATS_INC(link.drop);
+            pbuf_free(q->rx_pbuf);
+            q->rx_pbuf = NULL;
+        }
+
+        if (frame_len < SIZEOF_ETH_HDR || frame_len > rpmsg_eth->rx_max_frame) {
+            LINK_STATS_INC(link.lenerr);
+            return;
+        }
+
+#if !RPMSG_ETH_ZERO_COPY_RX
+        q->rx_pbuf = pbuf_alloc_quota(PBUF_RAW, frame_len, rpmsg_eth->pool_quota);
+        if (q->rx_pbuf == NULL) {
+            LINK_STATS_INC(link.memerr);
+            MIB2_STATS_NETIF_INC(rpmsg_eth->netif, ifindiscards);
+            return;
+        }
+#endif
+        q->rx_frame_len = frame_len;
+        q->rx_offset = 0;
+    } else if (q->rx_pbuf == NULL) {
+        /* tail of a frame whose head we dropped */
+        return;
+    }
+
+    if (offset != q->rx_offset || frame_len != q->rx_frame_len) {
+        LINK_STATS_INC(link.lenerr);
+        if (q->rx_pbuf != NULL) {
+            pbuf_free(q->rx_pbuf);
+            q->rx_pbuf = NULL;
+        }
+        return;
+    }
+
+#if RPMSG_ETH_ZERO_COPY_RX
+    struct pbuf* frag = rpmsg_eth_rx_fragment(ept, rxbuf, payload, frag_len,
+                                              packed || (rpmsg_eth->flags & RPMSG_ETH_CFG_NO_ZERO_COPY_RX),
+                                              rpmsg_eth->pool_quota);
+    if (frag == NULL) {
+        LINK_STATS_INC(link.memerr);
+        MIB2_STATS_NETIF_INC(rpmsg_eth->netif, ifindiscards);
+        if (q->rx_pbuf != NULL) {
+            pbuf_free(q->rx_pbuf);
+            q->rx_pbuf = NULL;
+        }
+        return;
+    }
+
+    if (q->rx_pbuf == NULL) {
+        q->rx_pbuf = frag;
+    } else {
+        pbuf_cat(q->rx_pbuf, frag);
+    }
+#else
+    (void)ept;
+    (void)rxbuf;
+    (void)packed;
+    pbuf_take_at(q->rx_pbuf, payload, frag_len, offset);
+#endif
+    q->rx_offset = (u16_t)(offset + frag_len);
+
+    if (q->rx_offset == frame_len) {
+        struct pbuf* p = q->rx_pbuf;
+
+        q->rx_pbuf = NULL;
+#if RPMSG_ETH_TSTAMP
+        if (q->ts_state == RPMSG_ETH_TS_FRAME) {
+            q->ts_state = RPMSG_ETH_TS_NONE;
+            rpmsg_eth_rx_deliver_stamped(q, p);
+            return;
+        }
+#endif
+        rpmsg_eth_rx_deliver(rpmsg_eth, p, RPMSG_ETH_RX_RING_OF(q));
+    }
+}
+
+#if RPMSG_ETH_STATS
+#define RPMSG_ETH_STATS_COUNT 38
+
+#define RPMSG_ETH_STATS_PROTO(v, n, proto) do { \
+        (v)[(n)++] = (proto).xmit;      \
+        (v)[(n)++] = (proto).recv;      \
+        (v)[(n)++] = (proto).drop;      \
+        (v)[(n)++] = (proto).chkerr;    \
+        (v)[(n)++] = (proto).memerr;    \
+        (v)[(n)++] = (proto).proterr;   \
+        (v)[(n)++] = (proto).err;       \
+    } while (0)
+
+/* The counters in the order of rpmsg_eth_remote_gstrings in the Linux driver: xmit, recv, drop,
+ * chkerr, memerr, proterr and err of the link, IP, UDP and TCP; failed allocations from all memp
+ * pools; used, max and err of the PBUF_POOL, the heap and the mailboxes. What is not counted in
+ * this build stays 0. */
+static void rpmsg_eth_stats_fill(u32_t* v)
+{
+    u16_t n = 0;
+#if MEMP_STATS
+    u32_t memp_err = 0;
+    int i;
+#endif
+
+    memset(v, 0, RPMSG_ETH_STATS_COUNT * sizeof(*v));
+    stats_collect();
+#if LINK_STATS
+    RPMSG_ETH_STATS_PROTO(v, n, lwip_stats.link);
+#else
+    n += 7;
+#endif
+#if IP_STATS
+    RPMSG_ETH_STATS_PROTO(v, n, lwip_stats.ip);
+#else
+    n += 7;
+#endif
+#if UDP_STATS
+    RPMSG_ETH_STATS_PROTO(v, n, lwip_stats.udp);
+#else
+    n += 7;
+#endif
+#if TCP_STATS
+    RPMSG_ETH_STATS_PROTO(v, n, lwip_stats.tcp);
+#else
+    n += 7;
+#endif
+#if MEMP_STATS
+    for (i = 0; i < MEMP_MAX; i++) {
+        memp_err += lwip_stats.memp[i]->err;
+    }
+    v[n++] = memp_err;
+    v[n++] = lwip_stats.memp[MEMP_PBUF_POOL]->used;
+    v[n++] = lwip_stats.memp[MEMP_PBUF_POOL]->max;
+    v[n++] = lwip_stats.memp[MEMP_PBUF_POOL]->err;
+#else
+    n += 4;
+#endif
+#if MEM_STATS
+    v[n++] = (u32_t)lwip_stats.mem.used;
+    v[n++] = (u32_t)lwip_stats.mem.max;
+    v[n++] = lwip_stats.mem.err;
+#else
+    n += 3;
+#endif
+#if SYS_STATS
+    v[n++] = lwip_stats.sys.mbox.used;
+    v[n++] = lwip_stats.sys.mbox.max;
+    v[n++] = lwip_stats.sys.mbox.err;
+#else
+    n += 3;
+#endif
+    LWIP_ASSERT("RPMSG_ETH_STATS_COUNT", n == RPMSG_ETH_STATS_COUNT);
+}
+
+/* The host's request for our statistics. The counters are read without a lock; each of them is
+ * a single word, so at worst they are a moment apart. */
+static void rpmsg_eth_rx_stats(struct rpmsg_eth_queue* q)
+{
+    u8_t msg[sizeof(struct rpmsg_eth_stats) + RPMSG_ETH_STATS_COUNT * sizeof(u32_t)];
+    struct rpmsg_eth_stats* stats = (struct rpmsg_eth_stats*)msg;
+    u32_t v[RPMSG_ETH_STATS_COUNT];
+    u16_t count = RPMSG_ETH_STATS_COUNT;
+    int i;
+
+    if (q != &q->priv->queues[0] || q->priv->tx_msg_size < sizeof(*stats)) {
+        LINK_STATS_INC(link.proterr);
+        return;
+    }
+    if (sizeof(msg) > q->priv->tx_msg_size) {
+        count = (u16_t)((q->priv->tx_msg_size - sizeof(*stats)) / sizeof(u32_t));
+    }
+
+    rpmsg_eth_stats_fill(v);
+    memset(stats, 0, sizeof(*stats));
+    stats->magic = lwip_htonl(RPMSG_ETH_STATS_MAGIC);
+    stats->count = lwip_htons(count);
+    for (i = 0; i < count; i++) {
+        u32_t be = lwip_htonl(v[i]);
+
+        memcpy(msg + sizeof(*stats) + i * sizeof(be), &be, sizeof(be));
+    }
+    /* the host asks again if this one is lost */
+    if (rpmsg_trysend(&q->ept, msg, (int)(sizeof(*stats) + count * sizeof(u32_t))) >= 0) {
+        q->priv->counters.tx_msgs++;
+    }
+}
+#endif /* RPMSG_ETH_STATS */
+
+/* Runs in the tcpip thread, where the TX queue lives */
+static void rpmsg_eth_coalesce_apply(void* arg)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)arg;
+
+    rpmsg_eth_set_tx_coalesce(rpmsg_eth->netif, rpmsg_eth->host_coalesce_ms, rpmsg_eth->host_coalesce_frames);
+}
+
+/* The host's ethtool -C for the frames we send it. The timer ticks in milliseconds, anything
+ * shorter waits a full one. */
+static void rpmsg_eth_rx_coalesce(struct rpmsg_eth_queue* q, const void* data, size_t len)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = q->priv;
+    const struct rpmsg_eth_coalesce* coalesce = (const struct rpmsg_eth_coalesce*)data;
+    u32_t usecs;
+
+    if (len < sizeof(*coalesce)) {
+        LINK_STATS_INC(link.proterr);
+        return;
+    }
+    usecs = lwip_ntohl(coalesce->usecs);
+    rpmsg_eth->host_coalesce_ms = (usecs + 999) / 1000;
+    /* no timer means no coalescing, as on the host */
+    rpmsg_eth->host_coalesce_frames = usecs != 0 ? lwip_ntohs(coalesce->frames) : 0;
+    tcpip_try_callback(rpmsg_eth_coalesce_apply, rpmsg_eth);
+}
+
+/* The host's ip link set mtu. Frames it already sent at the old size are still accepted: we take
+ * anything up to our own MTU. */
+static void rpmsg_eth_rx_mtu(struct rpmsg_eth_priv* rpmsg_eth, const void* data, size_t len)
+{
+    const struct rpmsg_eth_mtu* msg = (const struct rpmsg_eth_mtu*)data;
+
+    /* below the IPv4 minimum the netif would be unusable */
+    if (len < sizeof(*msg) || lwip_ntohs(msg->mtu) < 68) {
+        LINK_STATS_INC(link.proterr);
+        return;
+    }
+    rpmsg_eth->peer_mtu = lwip_ntohs(msg->mtu);
+    tcpip_try_callback(rpmsg_eth_mtu_apply, rpmsg_eth);
+}
+
+#if RPMSG_ETH_RX_URGENT
+/* The host's mqprio setup changed, or it repeats it after a hello. Frames of a queue still being
+ * reassembled go to the ring the queue is switched to. */
+static void rpmsg_eth_rx_prio(struct rpmsg_eth_priv* rpmsg_eth, const void* data, size_t len)
+{
+    const struct rpmsg_eth_prio* prio = (const struct rpmsg_eth_prio*)data;
+    u32_t urgent;
+    int i;
+
+    if (len < sizeof(*prio)) {
+        LINK_STATS_INC(link.proterr);
+        return;
+    }
+    urgent = lwip_ntohl(prio->urgent);
+    for (i = 0; i < RPMSG_ETH_NUM_QUEUES; i++) {
+        rpmsg_eth->queues[i].urgent = (u8_t)((urgent >> i) & 1);
+    }
+}
+#endif
+
+static void rpmsg_eth_rx_control(struct rpmsg_eth_queue* q, const void* data, size_t len)
+{
+    /* every control message starts like a doorbell */
+    const struct rpmsg_eth_doorbell* ctrl = (const struct rpmsg_eth_doorbell*)data;
+
+    if (len < sizeof(*ctrl)) {
+        LINK_STATS_INC(link.proterr);
+        return;
+    }
+
+    switch (lwip_ntohl(ctrl->magic)) {
+    case RPMSG_ETH_HELLO_MAGIC:
+        rpmsg_eth_rx_hello(q, data, len);
+        break;
+#if RPMSG_ETH_TSTAMP
+    case RPMSG_ETH_TSTAMP_MAGIC:
+        rpmsg_eth_rx_tstamp(q, data, len);
+        break;
+#endif
+#if RPMSG_ETH_SHM
+    case RPMSG_ETH_SHM_MAGIC:
+        rpmsg_eth_rx_shm_accept(q->priv, data, len);
+        break;
+    case RPMSG_ETH_DOORBELL_MAGIC:
+        rpmsg_eth_rx_doorbell(q->priv);
+        break;
+#endif
+#if RPMSG_ETH_STATS
+    case RPMSG_ETH_STATS_MAGIC:
+        rpmsg_eth_rx_stats(q);
+        break;
+#endif
+    case RPMSG_ETH_COALESCE_MAGIC:
+        rpmsg_eth_rx_coalesce(q, data, len);
+        break;
+    case RPMSG_ETH_MTU_MAGIC:
+        rpmsg_eth_rx_mtu(q->priv, data, len);
+        break;
+#if RPMSG_ETH_RX_URGENT
+    case RPMSG_ETH_PRIO_MAGIC:
+        rpmsg_eth_rx_prio(q->priv, data, len);
+        break;
+#endif
+    default:
+        LINK_STATS_INC(link.proterr);
+        break;
+    }
+}
+
+static LWIP_HOT_TEXT int rpmsg_endpoint_cb(struct rpmsg_endpoint *ept, void *data, size_t len,
+					   uint32_t src, void *priv)
+{
+	(void)src;
+    struct rpmsg_eth_queue* q = (struct rpmsg_eth_queue*)priv;
+    const struct rpmsg_eth_frag_hdr* hdr;
+    const u8_t* cur = (const u8_t*)data;
+    size_t remain = len;
+    u16_t frame_len, offset, frag_len;
+    int packed;
+
+    PERF_START;
+
+    q->priv->counters.rx_msgs++;
+
+    /* control message */
+    if (len >= sizeof(*hdr) && ((const struct rpmsg_eth_frag_hdr*)data)->frame_len == 0) {
+        rpmsg_eth_rx_control(q, data, len);
+        return RPMSG_SUCCESS;
+    }
+
+#if RPMSG_ETH_TSTAMP
+    if (q->ts_state == RPMSG_ETH_TS_PENDING) {
+        q->ts_cb = RPMSG_ETH_TSTAMP_NOW();
+        q->ts_state = RPMSG_ETH_TS_FRAME;
+    }
+#endif
+
+    /* A message carries either one fragment, or several whole frames packed back to back. Each
+     * record's payload ends at its frame's end or at the end of the message, whichever is first. */
+    while (remain >= sizeof(*hdr)) {
+        hdr = (const struct rpmsg_eth_frag_hdr*)cur;
+        frame_len = lwip_ntohs(hdr->frame_len);
+        offset = lwip_ntohs(hdr->offset);
+        remain -= sizeof(*hdr);
+
+        if (offset >= frame_len) {
+            LINK_STATS_INC(link.lenerr);
+            if (q->rx_pbuf != NULL) {
+                pbuf_free(q->rx_pbuf);
+                q->rx_pbuf = NULL;
+            }
+            break;
+        }
+        frag_len = (u16_t)LWIP_MIN(remain, (size_t)(frame_len - offset));
+        packed = (cur != data) || (frag_len != remain);
+
+        rpmsg_eth_rx_record(q, ept, data, frame_len, offset, hdr + 1, frag_len, packed);
+
+        cur = (const u8_t*)(hdr + 1) + frag_len;
+        remain -= frag_len;
+    }
+
+    PERF_STOP("rpmsg_endpoint_cb");
+	return RPMSG_SUCCESS;
+}
+
+/* The host destroyed the channel, e.g. because it rebooted or reloaded its driver. Its next hello
+ * finds our endpoints again and brings the link back up. */
+static void rpmsg_service_unbind(struct rpmsg_endpoint *ept)
+{
+    struct rpmsg_eth_queue* q = (struct rpmsg_eth_queue*)ept->priv;
+    struct rpmsg_eth_priv* rpmsg_eth = q->priv;
+
+    if (q->rx_pbuf != NULL) {
+        pbuf_free(q->rx_pbuf);
+        q->rx_pbuf = NULL;
+    }
+#if RPMSG_ETH_TSTAMP
+    q->ts_state = RPMSG_ETH_TS_NONE;
+#endif
+
+    if (q != &rpmsg_eth->queues[0]) {
+        return;
+    }
+
+    /* forget the host's hello here, before a new one can arrive in this context */
+    rpmsg_eth->peer_features = 0;
+    rpmsg_eth->tx_msg_size = rpmsg_eth->buf_size;
+    rpmsg_eth->peer_mtu = rpmsg_eth->mtu;
+#if RPMSG_ETH_RAW_IP
+    rpmsg_eth->raw_ip = 0;
+#endif
+#if RPMSG_ETH_SHM
+    rpmsg_eth->shm_offered = 0;
+    rpmsg_eth->shm_active = 0;
+#endif
+
+    if (tcpip_try_callback(rpmsg_eth_link_down, rpmsg_eth) != ERR_OK) {
+        LWIP_DEBUGF(NETIF_DEBUG, ("rpmsg_eth: cannot take the link down\n"));
+    }
+}
+
+#if RPMSG_ETH_FLOW_HASH
+#define RPMSG_ETH_HASH_MIX(h, v) ((h) = ((h) ^ (u32_t)(v)) * 0x9E3779B1UL, (h) ^= (h) >> 15)
+
+/* Hash of the TCP or UDP flow of a frame, whose link header starts at off in p; 0 for anything
+ * else, IP fragments included, and for headers beyond the first pbuf, where lwIP does not put
+ * them. Only needs to be the same for all frames of a flow. */
+static u32_t rpmsg_eth_flow_hash(struct rpmsg_eth_priv* rpmsg_eth, const struct pbuf* p, u16_t off)
+{
+    const u8_t* b = (const u8_t*)p->payload + off;
+    u16_t len = (u16_t)(p->len - off);
+    u16_t type, l4;
+    u8_t proto;
+    u32_t h = 0, w;
+    int i;
+
+    if (p->len < off) {
+        return 0;
+    }
+#if RPMSG_ETH_RAW_IP
+    if (rpmsg_eth->raw_ip) {
+        type = (len > 0 && (b[0] >> 4) == 6) ? PP_HTONS(ETHTYPE_IPV6) : PP_HTONS(ETHTYPE_IP);
+    } else
+#else
+    LWIP_UNUSED_ARG(rpmsg_eth);
+#endif
+    {
+        /* off is past the padding word already */
+        if (len < 2 * ETH_HWADDR_LEN + 2) {
+            return 0;
+        }
+        memcpy(&type, b + 2 * ETH_HWADDR_LEN, sizeof(type));
+        b += 2 * ETH_HWADDR_LEN + 2;
+        len = (u16_t)(len - (2 * ETH_HWADDR_LEN + 2));
+    }
+
+    if (type == PP_HTONS(ETHTYPE_IP)) {
+        const struct ip_hdr* iphdr = (const struct ip_hdr*)b;
+
+        if (len < IP_HLEN || IPH_V(iphdr) != 4 || (IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0) {
+            return 0;
+        }
+        proto = IPH_PROTO(iphdr);
+        l4 = IPH_HL_BYTES(iphdr);
+        RPMSG_ETH_HASH_MIX(h, iphdr->src.addr);
+        RPMSG_ETH_HASH_MIX(h, iphdr->dest.addr);
+    } else if (type == PP_HTONS(ETHTYPE_IPV6)) {
+        if (len < IP6_HLEN) {
+            return 0;
+        }
+        /* extension headers are left alone, the flow is hashed only when L4 follows directly */
+        proto = IP6H_NEXTH((const struct ip6_hdr*)b);
+        l4 = IP6_HLEN;
+        for (i = 0; i < 8; i++) {
+            memcpy(&w, b + 8 + 4 * i, sizeof(w));
+            RPMSG_ETH_HASH_MIX(h, w);
+        }
+    } else {
+        return 0;
+    }
+
+    if ((proto != IP_PROTO_TCP && proto != IP_PROTO_UDP) || len < l4 + 4) {
+        return 0;
+    }
+    memcpy(&w, b + l4, sizeof(w));  /* both ports */
+    RPMSG_ETH_HASH_MIX(h, w);
+    RPMSG_ETH_HASH_MIX(h, proto);
+    return h != 0 ? h : 1;
+}
+
+/* Put the flow hash of a frame's first record at dst for a host that takes it. Returns how many
+ * bytes it takes, 0 if there is none, and sets hdr->offset to match. */
+static u16_t rpmsg_eth_tx_hash(struct rpmsg_eth_priv* rpmsg_eth, const struct pbuf* p, u16_t off,
+                               struct rpmsg_eth_frag_hdr* hdr)
+{
+    u32_t hash;
+
+    hdr->offset = 0;
+    if (!(rpmsg_eth->peer_features & RPMSG_ETH_F_HASH)) {
+        return 0;
+    }
+    hash = lwip_htonl(rpmsg_eth_flow_hash(rpmsg_eth, p, off));
+    if (hash == 0) {
+        return 0;
+    }
+    hdr->offset = PP_HTONS(RPMSG_ETH_HASH_OFFSET);
+    memcpy(hdr + 1, &hash, sizeof(hash));
+    return sizeof(hash);
+}
+#else
+#define rpmsg_eth_tx_hash(rpmsg_eth, p, off, hdr) ((void)(rpmsg_eth), (hdr)->offset = 0, (u16_t)0)
+#endif /* RPMSG_ETH_FLOW_HASH */
+
+/* The link header of the fragment at offset of a frame sent in messages of msg_size, with the
+ * flow hash if it is the first and the hash does not take one more message. Returns the length of
+ * both. */
+static u16_t rpmsg_eth_tx_hdr(struct rpmsg_eth_priv* rpmsg_eth, struct pbuf* p, u16_t offset,
+                              struct rpmsg_eth_frag_hdr* hdr, u32_t msg_size)
+{
+    u32_t room = msg_size - sizeof(*hdr);
+    u16_t hash_len;
+
+    hdr->frame_len = lwip_htons(p->tot_len);
+    if (offset != 0) {
+        hdr->offset = lwip_htons(offset);
+        return sizeof(*hdr);
+    }
+    hash_len = rpmsg_eth_tx_hash(rpmsg_eth, p, 0, hdr);
+    if ((p->tot_len + hash_len + room - 1) / room != (p->tot_len + room - 1) / room) {
+        hdr->offset = 0;
+        hash_len = 0;
+    }
+    return (u16_t)(sizeof(*hdr) + hash_len);
+}
+
+#if RPMSG_ETH_NOCOPY_TX
+static err_t rpmsg_eth_tx_fragment(struct rpmsg_eth_priv* rpmsg_eth, struct pbuf* p, u16_t offset,
+                                   u16_t* frag_len)
 {
-    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
-    struct pbuf *q;
+    struct rpmsg_eth_frag_hdr* hdr;
+    uint32_t buf_len;
+    u16_t hdr_len;
+
+    hdr = (struct rpmsg_eth_frag_hdr*)rpmsg_get_tx_payload_buffer(&rpmsg_eth->queues[0].ept, &buf_len, 0);
+    if (hdr == NULL) {
+        return ERR_WOULDBLOCK;
+    }
+    LWIP_ASSERT("RPMsg TX buffer too small", buf_len > sizeof(*hdr));
+    buf_len = LWIP_MIN(buf_len, rpmsg_eth->tx_msg_size);
+    hdr_len = rpmsg_eth_tx_hdr(rpmsg_eth, p, offset, hdr, buf_len);
+
+    *frag_len = (u16_t)LWIP_MIN(p->tot_len - offset, buf_len - hdr_len);
+    rpmsg_eth_tx_gather(p, (u8_t*)hdr + hdr_len, *frag_len, offset);
+
+    if (rpmsg_send_nocopy(&rpmsg_eth->queues[0].ept, hdr, (int)(hdr_len + *frag_len)) < 0) {
+        return ERR_BUF;
+    }
+    rpmsg_eth->counters.tx_msgs++;
+
+    return ERR_OK;
+}
+#else
+static err_t rpmsg_eth_tx_fragment(struct rpmsg_eth_priv* rpmsg_eth, struct pbuf* p, u16_t offset,
+                                   u16_t* frag_len)
+{
+    struct rpmsg_eth_frag_hdr* hdr = (struct rpmsg_eth_frag_hdr*)rpmsg_eth->tx_buf;
+    u16_t hdr_len = rpmsg_eth_tx_hdr(rpmsg_eth, p, offset, hdr, rpmsg_eth->tx_msg_size);
+    u8_t* msg = rpmsg_eth->tx_buf;
+
+    *frag_len = (u16_t)LWIP_MIN(p->tot_len - offset, rpmsg_eth->tx_msg_size - hdr_len);
+
+    /* A message that is exactly the first pbuf, e.g. a whole frame in one pbuf, goes out from
+     * where it lies with the link header in its headroom (PBUF_LINK_ENCAPSULATION_HLEN), and the
+     * copy by rpmsg_send() is the only one. Anything else is gathered into tx_buf. */
+    if (offset == 0 && *frag_len == p->len && pbuf_add_header(p, hdr_len) == 0) {
+        MEMCPY(p->payload, hdr, hdr_len);
+        msg = (u8_t*)p->payload;
+    } else {
+        rpmsg_eth_tx_gather(p, rpmsg_eth->tx_buf + hdr_len, *frag_len, offset);
+    }
+
+    // /* Send data back to master */
+    int status = rpmsg_trysend(&rpmsg_eth->queues[0].ept, msg, (int)(hdr_len + *frag_len));
+    if (msg != rpmsg_eth->tx_buf) {
+        pbuf_remove_header(p, hdr_len);
+    }
+    if (status == RPMSG_ERR_NO_BUFF) {
+        return ERR_WOULDBLOCK;
+    } else if (status < 0) {
+        //ML_ERR("rpmsg_send failed\r\n");
+        return ERR_BUF;
+    }
+    rpmsg_eth->counters.tx_msgs++;
+
+    return ERR_OK;
+}
+#endif /* RPMSG_ETH_NOCOPY_TX */
+
+/* Length of a queued frame on the wire, without the padding word */
+#define RPMSG_ETH_TX_WIRE_LEN(p) ((u16_t)((p)->tot_len - ETH_PAD_SIZE))
+
+/* Count a frame that went out, or was dropped, in the link stats and the netif's own counters */
+static void rpmsg_eth_tx_count(struct rpmsg_eth_priv* rpmsg_eth, struct pbuf* p, err_t err)
+{
+    LWIP_UNUSED_ARG(rpmsg_eth);
+    LWIP_UNUSED_ARG(p);
+
+    if (err != ERR_OK) {
+        LINK_STATS_INC(link.drop);
+        MIB2_STATS_NETIF_INC(rpmsg_eth->netif, ifoutdiscards);
+        return;
+    }
+
+    rpmsg_eth->counters.tx_frames++;
+    LINK_STATS_INC(link.xmit);
+    MIB2_STATS_NETIF_ADD(rpmsg_eth->netif, ifoutoctets, RPMSG_ETH_TX_WIRE_LEN(p));
+    if (rpmsg_eth_is_nucast(rpmsg_eth, (const u8_t*)p->payload + ETH_PAD_SIZE)) {
+        MIB2_STATS_NETIF_INC(rpmsg_eth->netif, ifoutnucastpkts);
+    } else {
+        MIB2_STATS_NETIF_INC(rpmsg_eth->netif, ifoutucastpkts);
+    }
+}
+
+/* Send p from *offset on. On ERR_WOULDBLOCK the vring is full and *offset tells how far we got. */
+static err_t rpmsg_eth_tx_frame(struct rpmsg_eth_priv* rpmsg_eth, struct pbuf* p, u16_t* offset)
+{
+    u16_t frag_len;
+    err_t err = ERR_OK;
+
+#if RPMSG_ETH_SHM
+    /* whole frames only; one that was started in fragments is finished that way */
+    if (*offset == 0 && rpmsg_eth_shm_takes(rpmsg_eth, RPMSG_ETH_TX_WIRE_LEN(p))) {
+        return rpmsg_eth_shm_tx(rpmsg_eth, p, RPMSG_ETH_TX_WIRE_LEN(p));
+    }
+#endif
 
 #if ETH_PAD_SIZE
     pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
 #endif
 
-    for (q = p; q != NULL; q = q->next)
+    /* gather the frame into as many RPMsg buffers as needed, one fragment per message */
+    while (*offset < p->tot_len)
     {
-        // /* Send data back to master */
-        if (rpmsg_send(&rpmsg_eth->lept, q->payload, q->len) < 0) {
-            //ML_ERR("rpmsg_send failed\r\n");
-            return ERR_BUF;
+        err = rpmsg_eth_tx_fragment(rpmsg_eth, p, *offset, &frag_len);
+        if (err != ERR_OK) {
+            break;
         }
+        *offset = (u16_t)(*offset + frag_len);
     }
 
 #if ETH_PAD_SIZE
     pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
 #endif
 
-    LINK_STATS_INC(link.xmit);
+    return err;
+}
+
+#if RPMSG_ETH_TX_PACK
+/* Send as many whole frames from the head of tx_queue as fit into one message. The caller made
+ * sure the first one fits. On ERR_OK *count tells how many frames went out. */
+static err_t rpmsg_eth_tx_packed(struct rpmsg_eth_priv* rpmsg_eth, u16_t* count)
+{
+    struct rpmsg_eth_frag_hdr* hdr;
+    struct pbuf* p;
+    u8_t* buf;
+    uint32_t buf_len;
+    u16_t used = 0, n = 0, frame_len, hash_len;
+
+#if RPMSG_ETH_NOCOPY_TX
+    buf = (u8_t*)rpmsg_get_tx_payload_buffer(&rpmsg_eth->queues[0].ept, &buf_len, 0);
+    if (buf == NULL) {
+        return ERR_WOULDBLOCK;
+    }
+    buf_len = LWIP_MIN(buf_len, rpmsg_eth->tx_msg_size);
+#else
+    buf = rpmsg_eth->tx_buf;
+    buf_len = rpmsg_eth->tx_msg_size;
+#endif
+
+    while (n < rpmsg_eth->tx_queue_count) {
+        p = rpmsg_eth->tx_queue[(rpmsg_eth->tx_queue_head + n) % rpmsg_eth->tx_queue_len];
+        frame_len = RPMSG_ETH_TX_WIRE_LEN(p);
+        if (used + sizeof(*hdr) + frame_len > buf_len) {
+            break;
+        }
+
+        /* the hash goes in only if it fits too, the frame goes without otherwise */
+        hdr = (struct rpmsg_eth_frag_hdr*)(buf + used);
+        hash_len = rpmsg_eth_tx_hash(rpmsg_eth, p, ETH_PAD_SIZE, hdr);
+        if (used + sizeof(*hdr) + hash_len + frame_len > buf_len) {
+            hdr->offset = 0;
+            hash_len = 0;
+        }
+        hdr->frame_len = lwip_htons(frame_len);
+        rpmsg_eth_tx_gather(p, (u8_t*)(hdr + 1) + hash_len, frame_len, ETH_PAD_SIZE);
+
+        used = (u16_t)(used + sizeof(*hdr) + hash_len + frame_len);
+        n++;
+    }
+    LWIP_ASSERT("RPMsg TX buffer too small", n > 0);
+
+#if RPMSG_ETH_NOCOPY_TX
+    if (rpmsg_send_nocopy(&rpmsg_eth->queues[0].ept, buf, used) < 0) {
+        return ERR_BUF;
+    }
+#else
+    int status = rpmsg_trysend(&rpmsg_eth->queues[0].ept, buf, used);
+    if (status == RPMSG_ERR_NO_BUFF) {
+        return ERR_WOULDBLOCK;
+    } else if (status < 0) {
+        return ERR_BUF;
+    }
+#endif
+    rpmsg_eth->counters.tx_msgs++;
+
+    *count = n;
+    return ERR_OK;
+}
+#endif /* RPMSG_ETH_TX_PACK */
+
+/* Push queued frames out in order, until the queue is empty or the vring is full */
+static void rpmsg_eth_tx_drain(struct rpmsg_eth_priv* rpmsg_eth)
+{
+    struct pbuf* p;
+    err_t err;
+
+    while (rpmsg_eth->tx_queue_count > 0) {
+        p = rpmsg_eth->tx_queue[rpmsg_eth->tx_queue_head];
+
+#if RPMSG_ETH_TX_PACK
+        /* frames the shared-memory ring takes are left to rpmsg_eth_tx_frame() */
+        if (!rpmsg_eth_shm_takes(rpmsg_eth, RPMSG_ETH_TX_WIRE_LEN(p)) &&
+            (rpmsg_eth->peer_features & RPMSG_ETH_F_PACK) && rpmsg_eth->tx_offset == 0 &&
+            sizeof(struct rpmsg_eth_frag_hdr) + RPMSG_ETH_TX_WIRE_LEN(p) <= rpmsg_eth->tx_msg_size) {
+            u16_t count = 0;
+
+#if RPMSG_ETH_TSTAMP
+            rpmsg_eth_tx_tstamp(rpmsg_eth, rpmsg_eth->tx_stamp[rpmsg_eth->tx_queue_head]);
+#endif
+            err = rpmsg_eth_tx_packed(rpmsg_eth, &count);
+            if (err == ERR_WOULDBLOCK) {
+                break;
+            }
+            if (err != ERR_OK) {
+                /* drop only the head frame, the rest gets another chance */
+                count = 1;
+            }
+
+            while (count--) {
+                rpmsg_eth_tx_count(rpmsg_eth, rpmsg_eth->tx_queue[rpmsg_eth->tx_queue_head], err);
+                pbuf_free(rpmsg_eth->tx_queue[rpmsg_eth->tx_queue_head]);
+                rpmsg_eth->tx_queue[rpmsg_eth->tx_queue_head] = NULL;
+                rpmsg_eth->tx_queue_head = (u16_t)((rpmsg_eth->tx_queue_head + 1) % rpmsg_eth->tx_queue_len);
+                rpmsg_eth->tx_queue_count--;
+            }
+            continue;
+        }
+#endif
+
+#if RPMSG_ETH_TSTAMP
+        if (rpmsg_eth->tx_offset == 0 && !rpmsg_eth_shm_takes(rpmsg_eth, RPMSG_ETH_TX_WIRE_LEN(p))) {
+            rpmsg_eth_tx_tstamp(rpmsg_eth, rpmsg_eth->tx_stamp[rpmsg_eth->tx_queue_head]);
+        }
+#endif
+        err = rpmsg_eth_tx_frame(rpmsg_eth, p, &rpmsg_eth->tx_offset);
+        if (err == ERR_WOULDBLOCK) {
+            break;
+        }
+
+        rpmsg_eth_tx_count(rpmsg_eth, p, err);
+
+        pbuf_free(p);
+        rpmsg_eth->tx_queue[rpmsg_eth->tx_queue_head] = NULL;
+        rpmsg_eth->tx_queue_head = (u16_t)((rpmsg_eth->tx_queue_head + 1) % rpmsg_eth->tx_queue_len);
+        rpmsg_eth->tx_queue_count--;
+        rpmsg_eth->tx_offset = 0;
+    }
+}
+
+/* Arm the TX timer, if not yet. While coalescing it fires after the coalescing delay. */
+static void rpmsg_eth_tx_arm(struct rpmsg_eth_priv* rpmsg_eth)
+{
+    if (!rpmsg_eth->tx_timer_armed) {
+        rpmsg_eth->tx_timer_armed = 1;
+        sys_timeout(rpmsg_eth->tx_coalesce_frames > 1 ? LWIP_MAX(rpmsg_eth->tx_coalesce_ms, 1) : RPMSG_ETH_TX_RETRY_MS,
+                    rpmsg_eth_tx_timeout, rpmsg_eth);
+    }
+}
+
+static void rpmsg_eth_tx_timeout(void* arg)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)arg;
+
+    rpmsg_eth->tx_timer_armed = 0;
+    rpmsg_eth_tx_drain(rpmsg_eth);
+
+    /* Tell senders that were turned away that there is room again. This is only done from here,
+     * never from low_level_output(), since it may re-enter tcp_output(). */
+    if (rpmsg_eth->tx_stalled && rpmsg_eth->tx_queue_count < rpmsg_eth->tx_queue_len) {
+        rpmsg_eth->tx_stalled = 0;
+        if (rpmsg_eth->tx_ready != NULL) {
+            rpmsg_eth->tx_ready(rpmsg_eth->netif);
+        }
+#if LWIP_TCP
+        tcp_txnow();
+#endif
+    }
+
+    if (rpmsg_eth->tx_queue_count > 0 || rpmsg_eth->tx_stalled) {
+        rpmsg_eth_tx_arm(rpmsg_eth);
+    }
+}
+
+/* Runs in the tcpip thread after the host went away. Queued frames can no longer reach it; the
+ * stack stops routing through the netif and forgets the host's MAC. */
+static void rpmsg_eth_link_down(void* arg)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)arg;
+
+    if (rpmsg_eth->tx_timer_armed) {
+        sys_untimeout(rpmsg_eth_tx_timeout, rpmsg_eth);
+        rpmsg_eth->tx_timer_armed = 0;
+    }
+
+    while (rpmsg_eth->tx_queue_count > 0) {
+        rpmsg_eth_tx_count(rpmsg_eth, rpmsg_eth->tx_queue[rpmsg_eth->tx_queue_head], ERR_CONN);
+        pbuf_free(rpmsg_eth->tx_queue[rpmsg_eth->tx_queue_head]);
+        rpmsg_eth->tx_queue[rpmsg_eth->tx_queue_head] = NULL;
+        rpmsg_eth->tx_queue_head = (u16_t)((rpmsg_eth->tx_queue_head + 1) % rpmsg_eth->tx_queue_len);
+        rpmsg_eth->tx_queue_count--;
+    }
+    rpmsg_eth->tx_offset = 0;
+    rpmsg_eth->tx_stalled = 0;
+
+    rpmsg_eth->netif->mtu = rpmsg_eth->mtu;
+#if LWIP_IPV6 && LWIP_ND6_ALLOW_RA_UPDATES
+    rpmsg_eth->netif->mtu6 = rpmsg_eth->mtu;
+#endif
+#if RPMSG_ETH_POINT_TO_POINT
+    rpmsg_eth->p2p_valid = 0;
+#endif
+#if RPMSG_ETH_RAW_IP
+    /* the next host may want frames */
+    if (rpmsg_eth->netif->output == rpmsg_eth_ip_output) {
+        rpmsg_eth->netif->output = rpmsg_eth->eth_output;
+#if LWIP_IPV6
+        rpmsg_eth->netif->output_ip6 = rpmsg_eth->eth_output_ip6;
+#endif
+        netif_set_flags(rpmsg_eth->netif, NETIF_FLAG_ETHARP);
+    }
+#endif
+#if RPMSG_ETH_CSUM_OFFLOAD
+    /* the next host may not offload checksums */
+    NETIF_SET_CHECKSUM_CTRL(rpmsg_eth->netif, NETIF_CHECKSUM_ENABLE_ALL);
+#endif
+    netif_set_link_down(rpmsg_eth->netif);
+    etharp_cleanup_netif(rpmsg_eth->netif);
+}
+
+#if LWIP_IPV6 && (RPMSG_ETH_POINT_TO_POINT || RPMSG_ETH_RAW_IP)
+/* Whether the host is the only other node on the link, which then cannot hold our addresses */
+static int rpmsg_eth_ip6_no_dad(struct rpmsg_eth_priv* rpmsg_eth)
+{
+#if RPMSG_ETH_RAW_IP
+    if (rpmsg_eth->raw_ip) {
+        return 1;
+    }
+#endif
+#if RPMSG_ETH_POINT_TO_POINT
+    return !(rpmsg_eth->flags & RPMSG_ETH_CFG_NO_POINT_TO_POINT);
+#else
+    return 0;
+#endif
+}
+
+/* Takes tentative addresses to where duplicate address detection would have left them */
+static void rpmsg_eth_ip6_settle(struct netif* netif)
+{
+    s8_t i;
+    u8_t state;
+
+    for (i = 0; i < LWIP_IPV6_NUM_ADDRESSES; i++) {
+        if (!ip6_addr_istentative(netif_ip6_addr_state(netif, i))) {
+            continue;
+        }
+        state = IP6_ADDR_PREFERRED;
+#if LWIP_IPV6_ADDRESS_LIFETIMES
+        if (!netif_ip6_addr_isstatic(netif, i) && netif_ip6_addr_pref_life(netif, i) == 0) {
+            state = IP6_ADDR_DEPRECATED;
+        }
+#endif
+        netif_ip6_addr_set_state(netif, i, state);
+    }
+}
+
+/* nd6 probes addresses added while the link is up from the unspecified address. Instead of
+ * sending the probe, which nobody would answer, settle the address right away. */
+static int rpmsg_eth_ip6_dad_probe(struct netif* netif, struct pbuf* p)
+{
+    const struct ip6_hdr* ip6hdr = (const struct ip6_hdr*)p->payload;
+    const struct icmp6_hdr* icmp6hdr;
+
+    if (p->len < IP6_HLEN + sizeof(struct icmp6_hdr) || IP6H_NEXTH(ip6hdr) != IP6_NEXTH_ICMP6 ||
+        (ip6hdr->src.addr[0] | ip6hdr->src.addr[1] | ip6hdr->src.addr[2] | ip6hdr->src.addr[3]) != 0) {
+        return 0;
+    }
+    icmp6hdr = (const struct icmp6_hdr*)((const u8_t*)p->payload + IP6_HLEN);
+    if (icmp6hdr->type != ICMP6_TYPE_NS) {
+        return 0;
+    }
+    rpmsg_eth_ip6_settle(netif);
+    return 1;
+}
+#endif
+
+#if RPMSG_ETH_POINT_TO_POINT && LWIP_IPV4
+/* netif->output: every unicast goes to the host, whatever its IP address, so skip etharp */
+static err_t rpmsg_eth_output(struct netif* netif, struct pbuf* p, const ip4_addr_t* ipaddr)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
 
+    if (!rpmsg_eth->p2p_valid || ip4_addr_isbroadcast(ipaddr, netif) || ip4_addr_ismulticast(ipaddr)) {
+        return etharp_output(netif, p, ipaddr);
+    }
+    return ethernet_output(netif, p, (const struct eth_addr*)netif->hwaddr, &rpmsg_eth->p2p_hwaddr,
+                           ETHTYPE_IP);
+}
+#endif /* RPMSG_ETH_POINT_TO_POINT && LWIP_IPV4 */
+
+#if RPMSG_ETH_POINT_TO_POINT && LWIP_IPV6
+/* netif->output_ip6: the host is the static neighbor of every unicast, so skip nd6 */
+static err_t rpmsg_eth_output_ip6(struct netif* netif, struct pbuf* p, const ip6_addr_t* ipaddr)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
+
+    if (rpmsg_eth_ip6_dad_probe(netif, p)) {
+        return ERR_OK;
+    }
+    if (!rpmsg_eth->p2p_valid || ip6_addr_ismulticast(ipaddr)) {
+        return ethip6_output(netif, p, ipaddr);
+    }
+    return ethernet_output(netif, p, (const struct eth_addr*)netif->hwaddr, &rpmsg_eth->p2p_hwaddr,
+                           ETHTYPE_IPV6);
+}
+#endif /* RPMSG_ETH_POINT_TO_POINT && LWIP_IPV6 */
+
+#if RPMSG_ETH_RAW_IP
+/* netif->output while raw_ip: the packet goes out as it is, there is no link address to find */
+static err_t rpmsg_eth_ip_output(struct netif* netif, struct pbuf* p, const ip4_addr_t* ipaddr)
+{
+    LWIP_UNUSED_ARG(ipaddr);
+
+#if ETH_PAD_SIZE
+    /* low_level_output() takes the padding word off again */
+    if (pbuf_add_header(p, ETH_PAD_SIZE)) {
+        return ERR_BUF;
+    }
+#endif
+    return netif_linkoutput(netif, p);
+}
+
+#if LWIP_IPV6
+/* netif->output_ip6 while raw_ip, like rpmsg_eth_ip_output() */
+static err_t rpmsg_eth_ip6_output(struct netif* netif, struct pbuf* p, const ip6_addr_t* ipaddr)
+{
+    LWIP_UNUSED_ARG(ipaddr);
+
+    if (rpmsg_eth_ip6_dad_probe(netif, p)) {
+        return ERR_OK;
+    }
+#if ETH_PAD_SIZE
+    if (pbuf_add_header(p, ETH_PAD_SIZE)) {
+        return ERR_BUF;
+    }
+#endif
+    return netif_linkoutput(netif, p);
+}
+#endif /* LWIP_IPV6 */
+
+/* netif->input for bare IP packets. Unlike tcpip_input(), it does not go by NETIF_FLAG_ETHARP,
+ * which the tcpip thread only clears after the host may have sent the first ones. */
+static err_t rpmsg_eth_raw_input(struct pbuf* p, struct netif* netif)
+{
+    return tcpip_inpkt(p, netif, ip_input);
+}
+#endif /* RPMSG_ETH_RAW_IP */
+
+static LWIP_HOT_TEXT err_t low_level_output(struct netif* netif, struct pbuf* p)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
+    u16_t slot;
+    err_t err;
+#if RPMSG_ETH_TSTAMP
+    u64_t xmit = RPMSG_ETH_TSTAMP_NOW();
+#endif
+
+    PERF_START;
+
+    /* fail fast while there is no host, e.g. for frames etharp queued before the link went down */
+    if (!netif_is_link_up(netif)) {
+        rpmsg_eth_tx_count(rpmsg_eth, p, ERR_CONN);
+        return ERR_CONN;
+    }
+
+    CAPTURE_TX(netif, p);
+
+    /* coalescing: hold frames back until enough are queued or the timer fires, so they go out
+     * packed and the host is notified less often */
+    if (rpmsg_eth->tx_coalesce_frames > 1 && rpmsg_eth->tx_queue_count < rpmsg_eth->tx_queue_len) {
+        pbuf_ref(p);
+        slot = (u16_t)((rpmsg_eth->tx_queue_head + rpmsg_eth->tx_queue_count) % rpmsg_eth->tx_queue_len);
+        rpmsg_eth->tx_queue[slot] = p;
+#if RPMSG_ETH_TSTAMP
+        rpmsg_eth->tx_stamp[slot] = xmit;
+#endif
+        rpmsg_eth->tx_queue_count++;
+
+        if (rpmsg_eth->tx_queue_count >= rpmsg_eth->tx_coalesce_frames) {
+            rpmsg_eth_tx_drain(rpmsg_eth);
+        }
+        if (rpmsg_eth->tx_queue_count > 0) {
+            rpmsg_eth_tx_arm(rpmsg_eth);
+        }
+        PERF_STOP("low_level_output");
+        return ERR_OK;
+    }
+
+    /* anything already queued goes first, to keep frames in order */
+    rpmsg_eth_tx_drain(rpmsg_eth);
+
+    if (rpmsg_eth->tx_queue_count == 0) {
+        u16_t offset = 0;
+
+#if RPMSG_ETH_TSTAMP
+        if (!rpmsg_eth_shm_takes(rpmsg_eth, RPMSG_ETH_TX_WIRE_LEN(p))) {
+            rpmsg_eth_tx_tstamp(rpmsg_eth, xmit);
+        }
+#endif
+        err = rpmsg_eth_tx_frame(rpmsg_eth, p, &offset);
+        if (err != ERR_WOULDBLOCK) {
+            rpmsg_eth_tx_count(rpmsg_eth, p, err);
+            PERF_STOP("low_level_output");
+            return err;
+        }
+
+        /* vring is full; p becomes the head of the queue with part of it already sent */
+        rpmsg_eth->tx_offset = offset;
+    } else if (rpmsg_eth->tx_queue_count == rpmsg_eth->tx_queue_len) {
+        /* push back on the sender instead of dropping */
+        rpmsg_eth->tx_stalled = 1;
+        return ERR_MEM;
+    }
+
+    pbuf_ref(p);
+    slot = (u16_t)((rpmsg_eth->tx_queue_head + rpmsg_eth->tx_queue_count) % rpmsg_eth->tx_queue_len);
+    rpmsg_eth->tx_queue[slot] = p;
+#if RPMSG_ETH_TSTAMP
+    rpmsg_eth->tx_stamp[slot] = xmit;
+#endif
+    rpmsg_eth->tx_queue_count++;
+
+    rpmsg_eth_tx_arm(rpmsg_eth);
+
+    PERF_STOP("low_level_output");
     return ERR_OK;
+}
+
+#if LWIP_NETIF_LINKOUTPUT_BURST
+/* netif->linkoutput_burst: queue the whole burst before draining, so that the frames go out packed
+ * and the host is notified once for them rather than once per frame */
+static err_t low_level_output_burst(struct netif* netif, struct pbuf** frames, u16_t n)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
+    err_t err = ERR_OK;
+    u16_t i, slot;
+#if RPMSG_ETH_TSTAMP
+    u64_t xmit = RPMSG_ETH_TSTAMP_NOW();
+#endif
+
+    if (!netif_is_link_up(netif)) {
+        for (i = 0; i < n; i++) {
+            rpmsg_eth_tx_count(rpmsg_eth, frames[i], ERR_CONN);
+        }
+        return ERR_CONN;
+    }
+
+    for (i = 0; i < n; i++) {
+        CAPTURE_TX(netif, frames[i]);
+        if (rpmsg_eth->tx_queue_count == rpmsg_eth->tx_queue_len) {
+            rpmsg_eth_tx_drain(rpmsg_eth);
+        }
+        if (rpmsg_eth->tx_queue_count == rpmsg_eth->tx_queue_len) {
+            /* the sender already took these as sent; tx_ready and tcp_txnow() tell it when
+             * there is room again, and TCP recovers the segments by retransmission */
+            rpmsg_eth->tx_stalled = 1;
+            rpmsg_eth_tx_count(rpmsg_eth, frames[i], ERR_MEM);
+            err = ERR_MEM;
+            continue;
+        }
+
+        pbuf_ref(frames[i]);
+        slot = (u16_t)((rpmsg_eth->tx_queue_head + rpmsg_eth->tx_queue_count) % rpmsg_eth->tx_queue_len);
+        rpmsg_eth->tx_queue[slot] = frames[i];
+#if RPMSG_ETH_TSTAMP
+        rpmsg_eth->tx_stamp[slot] = xmit;
+#endif
+        rpmsg_eth->tx_queue_count++;
+    }
+
+    /* while coalescing, the burst waits like single frames do */
+    if (rpmsg_eth->tx_coalesce_frames <= 1 || rpmsg_eth->tx_queue_count >= rpmsg_eth->tx_coalesce_frames) {
+        rpmsg_eth_tx_drain(rpmsg_eth);
+    }
+    if (rpmsg_eth->tx_queue_count > 0 || rpmsg_eth->tx_stalled) {
+        rpmsg_eth_tx_arm(rpmsg_eth);
+    }
+
+    return err;
+}
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
+
+void rpmsg_eth_set_tx_ready_callback(struct netif* netif, rpmsg_eth_tx_ready_fn fn)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
+
+    rpmsg_eth->tx_ready = fn;
+}
+
+void rpmsg_eth_get_counters(struct netif* netif, struct rpmsg_eth_counters* counters, int reset)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
+
+    *counters = rpmsg_eth->counters;
+    if (reset) {
+        memset(&rpmsg_eth->counters, 0, sizeof(rpmsg_eth->counters));
+    }
+}
+
+int rpmsg_eth_rx_notify(struct netif* netif)
+{
+#if RPMSG_ETH_BUSY_POLL && RPMSG_ETH_BUSY_POLL_IDLE
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
+
+    /* an IPI from before the poll task exists is dispatched by the caller */
+    if (rpmsg_eth == NULL || rpmsg_eth->busy_poll_thread == NULL) {
+        return -1;
+    }
+    if (sys_arch_in_isr()) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(rpmsg_eth->busy_poll_thread, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    } else {
+        xTaskNotifyGive(rpmsg_eth->busy_poll_thread);
+    }
+    return 0;
+#else
+    (void)netif;
+    return -1;
+#endif
+}
+
+void rpmsg_eth_get_tstamp_stats(struct netif* netif, struct rpmsg_eth_tstamp_stats* stats, int reset)
+{
+#if RPMSG_ETH_TSTAMP
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
+
+    *stats = rpmsg_eth->ts_stats;
+    if (reset) {
+        memset(&rpmsg_eth->ts_stats, 0, sizeof(rpmsg_eth->ts_stats));
+    }
+#else
+    (void)netif;
+    (void)reset;
+    memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+err_t rpmsg_eth_udp_claim(struct netif* netif, u16_t port, rpmsg_eth_udp_recv_fn recv, void* arg)
+{
+#if RPMSG_ETH_EARLY_DEMUX
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
+    struct rpmsg_eth_udp_claim* free_claim = NULL;
+    err_t err = ERR_OK;
+    int i;
+    SYS_ARCH_DECL_PROTECT(old_level);
+
+    if (port == 0 || recv == NULL) {
+        return ERR_ARG;
+    }
+    SYS_ARCH_PROTECT(old_level);
+    for (i = 0; i < RPMSG_ETH_EARLY_DEMUX_PORTS; i++) {
+        if (rpmsg_eth->udp_claims[i].port == port) {
+            err = ERR_USE;
+            break;
+        }
+        /* an entry is free once the RX paths that saw its last port are done with it */
+        if (rpmsg_eth->udp_claims[i].port == 0 && free_claim == NULL &&
+            __atomic_load_n(&rpmsg_eth->udp_claims[i].busy, __ATOMIC_SEQ_CST) == 0) {
+            free_claim = &rpmsg_eth->udp_claims[i];
+        }
+    }
+    if (err == ERR_OK && free_claim == NULL) {
+        err = ERR_MEM;
+    }
+    if (err == ERR_OK) {
+        free_claim->recv = recv;
+        free_claim->arg = arg;
+        /* the RX path reads recv and arg once it sees the port */
+        __atomic_store_n(&free_claim->port, port, __ATOMIC_RELEASE);
+    }
+    SYS_ARCH_UNPROTECT(old_level);
+    return err;
+#else
+    (void)netif;
+    (void)port;
+    (void)recv;
+    (void)arg;
+    return ERR_VAL;
+#endif
+}
+
+void rpmsg_eth_udp_release(struct netif* netif, u16_t port)
+{
+#if RPMSG_ETH_EARLY_DEMUX
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
+    struct rpmsg_eth_udp_claim* claim = NULL;
+    int i;
+    SYS_ARCH_DECL_PROTECT(old_level);
+
+    if (port == 0) {
+        return;
+    }
+    SYS_ARCH_PROTECT(old_level);
+    for (i = 0; i < RPMSG_ETH_EARLY_DEMUX_PORTS; i++) {
+        if (rpmsg_eth->udp_claims[i].port == port) {
+            claim = &rpmsg_eth->udp_claims[i];
+            __atomic_store_n(&claim->port, 0, __ATOMIC_SEQ_CST);
+            break;
+        }
+    }
+    SYS_ARCH_UNPROTECT(old_level);
+
+    /* wait for the RX paths that took the port before we cleared it, see rpmsg_eth_early_demux() */
+    while (claim != NULL && __atomic_load_n(&claim->busy, __ATOMIC_ACQUIRE) != 0) {
+        sys_msleep(1);
+    }
+#else
+    (void)netif;
+    (void)port;
+#endif
+}
+
+void rpmsg_eth_set_tx_coalesce(struct netif* netif, u32_t msecs, u16_t frames)
+{
+    struct rpmsg_eth_priv* rpmsg_eth = (struct rpmsg_eth_priv*)netif->state;
+
+    rpmsg_eth->tx_coalesce_ms = msecs;
+    rpmsg_eth->tx_coalesce_frames = (u16_t)LWIP_MIN(frames, rpmsg_eth->tx_queue_len);
+
+    /* whatever is held back now goes out with the next timeout */
+    if (rpmsg_eth->tx_queue_count > 0) {
+        rpmsg_eth_tx_arm(rpmsg_eth);
+    }
 }
\ No newline at end of file
@@ -3,6 +3,86 @@
 
 #include "lwip/netif.h"
 
+#include <openamp/open_amp.h>
+
+
+/* rpmsg_eth_config.flags */
+#define RPMSG_ETH_CFG_NO_ZERO_COPY_RX 0x01 // copy received fragments even with RPMSG_ETH_ZERO_COPY_RX
+#define RPMSG_ETH_CFG_NO_CSUM_OFFLOAD 0x02 // keep TCP/UDP checksums, and with them TSO, turned off
+#define RPMSG_ETH_CFG_NO_POINT_TO_POINT 0x04 // resolve the host by ARP even with RPMSG_ETH_POINT_TO_POINT
+#define RPMSG_ETH_CFG_NO_RAW_IP 0x08 // keep Ethernet framing even when the host asks for raw IP
+#define RPMSG_ETH_CFG_NO_MCAST_FILTER 0x10 // have the host forward all multicast, e.g. for a bridge port
+
+/* Per-interface settings, passed as the state argument of netif_add(). Zero fields keep the
+ * compile-time defaults. Only read by rpmsg_eth_init(), except hostname, which must stay valid. */
+struct rpmsg_eth_config {
+    struct rpmsg_device* rdev;
+    u8_t hwaddr[6];         // all zero: AA:BB:CC:DD:EE:FE
+    const char* hostname;   // NULL: "nuc472"
+    u16_t mtu;              // 0: RPMSG_ETH_MTU
+    u16_t tx_queue_len;     // 0 or above RPMSG_ETH_TX_QUEUE_LEN: RPMSG_ETH_TX_QUEUE_LEN
+    u8_t flags;             // RPMSG_ETH_CFG_*
+};
 
 err_t rpmsg_eth_init(struct netif* netif);
 
+/* Called from the tcpip thread when the TX queue, after having been full, has room again */
+typedef void (*rpmsg_eth_tx_ready_fn)(struct netif* netif);
+
+void rpmsg_eth_set_tx_ready_callback(struct netif* netif, rpmsg_eth_tx_ready_fn fn);
+
+/* TX coalescing: frames are held back until frames of them are queued or msecs have passed since
+ * the timer was armed, and then sent packed. frames of 0 or 1 turns it off. Call from the tcpip
+ * thread. */
+void rpmsg_eth_set_tx_coalesce(struct netif* netif, u32_t msecs, u16_t frames);
+
+/* Data path counters. Messages are RPMsg buffers, each of which may kick the other core, frames
+ * are what the stack sent or got; packing, fragmenting and the shared memory rings make the two
+ * differ. */
+struct rpmsg_eth_counters {
+    u32_t rx_msgs;
+    u32_t rx_frames;
+    u32_t tx_msgs;          // doorbells included
+    u32_t tx_frames;
+};
+
+/* Copy the counters and optionally zero them. Call from the tcpip thread. */
+void rpmsg_eth_get_counters(struct netif* netif, struct rpmsg_eth_counters* counters, int reset);
+
+/* With RPMSG_ETH_BUSY_POLL and RPMSG_ETH_BUSY_POLL_IDLE, the IPI handler calls this for the rpmsg
+ * device of netif instead of dispatching its vring notification: it wakes the poll task, which
+ * does the dispatching. Returns 0, or -1 when the caller must dispatch as usual, always so without
+ * the options. Safe from an interrupt, once rpmsg_eth_init() has returned. */
+int rpmsg_eth_rx_notify(struct netif* netif);
+
+/* Latency of the frames the host stamped, with RPMSG_ETH_TSTAMP; see the same option for the
+ * frames we stamp. Bucket 0 counts stages under 1 us, bucket n those from 2^(n-1) us up to
+ * 2^n us, the last one everything longer. */
+#define RPMSG_ETH_TSTAMP_BUCKETS 16
+
+struct rpmsg_eth_tstamp_stats {
+    u32_t samples;
+    u32_t host_queue[RPMSG_ETH_TSTAMP_BUCKETS];  // host driver got the frame -> handed to RPMsg
+    u32_t link[RPMSG_ETH_TSTAMP_BUCKETS];        // -> its first message arrived here
+    u32_t rx[RPMSG_ETH_TSTAMP_BUCKETS];          // -> reassembled and handed on
+    u32_t stack[RPMSG_ETH_TSTAMP_BUCKETS];       // -> taken by the stack, RPMSG_ETH_RX_THREAD only
+};
+
+/* Copy the statistics and optionally zero them, all zeros without RPMSG_ETH_TSTAMP. Call from the
+ * tcpip thread. */
+void rpmsg_eth_get_tstamp_stats(struct netif* netif, struct rpmsg_eth_tstamp_stats* stats, int reset);
+
+/* Gets the payload of a claimed UDP datagram and owns p, which it must pbuf_free(). Runs in the
+ * RPMsg callback, so it must not block or call into the stack other than through the tcpip thread
+ * (tcpip_callback() and the like). */
+typedef void (*rpmsg_eth_udp_recv_fn)(void* arg, struct netif* netif, struct pbuf* p,
+                                      const ip4_addr_t* src, u16_t src_port);
+
+/* Early demux, with RPMSG_ETH_EARLY_DEMUX: IPv4 UDP datagrams to port on this interface go to
+ * recv straight from the RPMsg callback instead of through the stack, so no socket or pcb bound
+ * to port sees them. ERR_USE if port is claimed already, ERR_MEM if all
+ * RPMSG_ETH_EARLY_DEMUX_PORTS are, ERR_VAL without the option. rpmsg_eth_udp_release() returns once
+ * recv is done with the datagrams it was given for port, so arg may be freed then; it sleeps
+ * while it waits and must not be called from recv or with interrupts off. */
+err_t rpmsg_eth_udp_claim(struct netif* netif, u16_t port, rpmsg_eth_udp_recv_fn recv, void* arg);
+void rpmsg_eth_udp_release(struct netif* netif, u16_t port);
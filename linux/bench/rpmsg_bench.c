@@ -0,0 +1,681 @@
+// Benchmark of the rpmsg_eth link, the Linux half. The remote runs freertos/net_bench.c, which
+// echoes datagrams on one UDP port and counts them on another. For every packet size we measure
+// one-way throughput into the sink and round-trip latency against the echo, together with what
+// each packet cost: interrupts taken here, RPMsg messages on the remote, and CPU time on both
+// sides. Every result is one JSON object per line on stdout, everything else goes to stderr.
+//
+// With -P, the remote's PERF_STOP probes (a build with LWIP_PERF) are listed after every run, as
+// cycle histograms; -D adds their trace.
+//
+// With -b, results are compared against an earlier run and the exit status is 1 when the
+// throughput or the p99 latency of any size got worse by more than the tolerance.
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+// Control protocol, all fields in network order. Must match freertos/net_bench.c.
+#define NET_BENCH_MAGIC 0x52424354 // "RBCT"
+#define NET_BENCH_CMD_RESET 1
+#define NET_BENCH_CMD_QUERY 2
+#define NET_BENCH_CMD_PERF 3
+#define NET_BENCH_CMD_TRACE 4
+
+#define NET_BENCH_F_CPU 0x01
+#define NET_BENCH_F_LINK 0x02
+#define NET_BENCH_F_PERF 0x04
+
+#define NET_BENCH_PERF_NAME_LEN 16
+#define NET_BENCH_PERF_BUCKETS 24
+#define NET_BENCH_TRACE_MAX 64
+
+struct net_bench_request {
+    uint32_t magic;
+    uint32_t cmd;
+    uint32_t seq;
+    uint32_t arg;
+};
+
+struct net_bench_reply {
+    uint32_t magic;
+    uint32_t cmd;
+    uint32_t seq;
+    uint32_t flags;
+    uint32_t sink_packets;
+    uint32_t sink_bytes_lo;
+    uint32_t sink_bytes_hi;
+    uint32_t echo_packets;
+    uint32_t rx_msgs;
+    uint32_t rx_frames;
+    uint32_t tx_msgs;
+    uint32_t tx_frames;
+    uint32_t cpu_idle;
+    uint32_t cpu_total;
+};
+
+struct net_bench_perf_reply {
+    uint32_t magic;
+    uint32_t cmd;
+    uint32_t seq;
+    uint32_t flags;
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t sum_lo;
+    uint32_t sum_hi;
+    char name[NET_BENCH_PERF_NAME_LEN];
+    uint32_t hist[NET_BENCH_PERF_BUCKETS];
+};
+
+struct net_bench_trace_reply {
+    uint32_t magic;
+    uint32_t cmd;
+    uint32_t seq;
+    uint32_t flags;
+    uint32_t next;
+    uint32_t count;
+    struct {
+        uint32_t probe;
+        uint32_t start;
+        uint32_t cycles;
+    } entries[NET_BENCH_TRACE_MAX];
+};
+
+#define MAX_PROBES 64
+
+#define MAX_SIZES 32
+#define UDP_IP_HDR_LEN 28
+#define CTL_HDR_LEN 16 // magic, cmd, seq and flags start every reply
+
+struct bench_opts {
+    const char* host;
+    int echo_port;
+    int sink_port;
+    int mtu;
+    int sizes[MAX_SIZES];
+    int num_sizes;
+    double duration;        // seconds per throughput run
+    int samples;            // round trips per latency run
+    int timeout_ms;         // a round trip taking longer is lost
+    const char* irq;        // substring of the /proc/interrupts lines to count, NULL: none
+    int run_throughput;
+    int run_latency;
+    int perf;               // list the remote's probes after each run
+    int trace;              // and their trace
+    const char* baseline;
+    double tolerance;       // percent
+};
+
+// Host side resources, sampled before and after a run
+struct host_sample {
+    unsigned long long cpu_busy;  // jiffies over all CPUs
+    unsigned long long cpu_total;
+    unsigned long long irqs;
+    struct timespec ts;
+};
+
+static struct sockaddr_in remote_addr;
+static uint32_t ctl_seq;
+static int regressions;
+
+static double ts_diff(const struct timespec* a, const struct timespec* b)
+{
+    return (double)(b->tv_sec - a->tv_sec) + (double)(b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static int read_proc_stat(unsigned long long* busy, unsigned long long* total)
+{
+    unsigned long long v[8] = { 0 };
+    FILE* f = fopen("/proc/stat", "r");
+    int n;
+
+    if (f == NULL) {
+        return -1;
+    }
+    n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+    fclose(f);
+    if (n < 4) {
+        return -1;
+    }
+    // idle and iowait are the only ones that are not busy
+    *total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+    *busy = *total - v[3] - v[4];
+    return 0;
+}
+
+// Sum of all CPUs' counts on every /proc/interrupts line containing name
+static unsigned long long read_irqs(const char* name)
+{
+    unsigned long long sum = 0;
+    char line[4096];
+    FILE* f;
+
+    if (name == NULL || (f = fopen("/proc/interrupts", "r")) == NULL) {
+        return 0;
+    }
+    if (fgets(line, sizeof(line), f) == NULL) { // CPU header
+        fclose(f);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char* p = strchr(line, ':');
+
+        if (p == NULL || strstr(p, name) == NULL) {
+            continue;
+        }
+        for (p++;;) {
+            char* end;
+            unsigned long long v = strtoull(p, &end, 10);
+
+            if (end == p) {
+                break;
+            }
+            sum += v;
+            p = end;
+        }
+    }
+    fclose(f);
+    return sum;
+}
+
+static void host_sample(const struct bench_opts* opts, struct host_sample* s)
+{
+    s->cpu_busy = 0;
+    s->cpu_total = 0;
+    read_proc_stat(&s->cpu_busy, &s->cpu_total);
+    s->irqs = read_irqs(opts->irq);
+    clock_gettime(CLOCK_MONOTONIC, &s->ts);
+}
+
+static int udp_socket(int port, int timeout_ms)
+{
+    struct sockaddr_in addr = remote_addr;
+    struct timeval tv;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    addr.sin_port = htons((uint16_t)port);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// One control request, retried a few times since it travels over the link being measured.
+// Returns the length of the reply, which is zero padded to size.
+static int ctl_request(const struct bench_opts* opts, uint32_t cmd, uint32_t arg, void* reply, size_t size)
+{
+    struct net_bench_request req;
+    const struct net_bench_reply* hdr = reply;
+    int fd, tries, ret = -1;
+    ssize_t len;
+
+    fd = udp_socket(opts->sink_port, 500);
+    if (fd < 0) {
+        return -1;
+    }
+    for (tries = 0; tries < 5 && ret < 0; tries++) {
+        req.magic = htonl(NET_BENCH_MAGIC);
+        req.cmd = htonl(cmd);
+        req.seq = htonl(++ctl_seq);
+        req.arg = htonl(arg);
+        if (send(fd, &req, sizeof(req), 0) < 0) {
+            continue;
+        }
+        memset(reply, 0, size);
+        while ((len = recv(fd, reply, size, 0)) >= CTL_HDR_LEN) {
+            if (ntohl(hdr->magic) == NET_BENCH_MAGIC && hdr->seq == req.seq) {
+                ret = (int)len;
+                break;
+            }
+        }
+    }
+    close(fd);
+    if (ret < 0) {
+        fprintf(stderr, "rpmsg_bench: no answer from net_bench on %s:%d\n", opts->host, opts->sink_port);
+    }
+    return ret;
+}
+
+// Wait for stragglers, then collect the remote's counters. The reset reply and the query itself
+// each took one message and one frame, which are not part of the run.
+static int ctl_finish(const struct bench_opts* opts, struct net_bench_reply* r)
+{
+    struct timespec drain = { 0, 200 * 1000 * 1000 };
+
+    nanosleep(&drain, NULL);
+    if (ctl_request(opts, NET_BENCH_CMD_QUERY, 0, r, sizeof(*r)) < 0) {
+        return -1;
+    }
+    r->rx_msgs = ntohl(r->rx_msgs);
+    r->rx_frames = ntohl(r->rx_frames);
+    r->tx_msgs = ntohl(r->tx_msgs);
+    r->tx_frames = ntohl(r->tx_frames);
+    r->rx_msgs -= r->rx_msgs > 0;
+    r->rx_frames -= r->rx_frames > 0;
+    r->tx_msgs -= r->tx_msgs > 0;
+    r->tx_frames -= r->tx_frames > 0;
+    return 0;
+}
+
+static void print_null_or(const char* key, int valid, double v)
+{
+    if (valid) {
+        printf(",\"%s\":%.3f", key, v);
+    } else {
+        printf(",\"%s\":null", key);
+    }
+}
+
+// The fields shared by all tests: what the run cost on both sides, per packet where it makes sense
+static void print_costs(const struct bench_opts* opts, const struct host_sample* h0,
+                        const struct host_sample* h1, const struct net_bench_reply* r0,
+                        const struct net_bench_reply* r1, unsigned long long packets)
+{
+    double seconds = ts_diff(&h0->ts, &h1->ts);
+    unsigned long long busy = h1->cpu_busy - h0->cpu_busy;
+    unsigned long long total = h1->cpu_total - h0->cpu_total;
+    long hz = sysconf(_SC_CLK_TCK);
+    uint32_t flags = ntohl(r1->flags);
+    uint32_t idle = ntohl(r1->cpu_idle) - ntohl(r0->cpu_idle);
+    uint32_t rtotal = ntohl(r1->cpu_total) - ntohl(r0->cpu_total);
+    double pkts = packets ? (double)packets : 1.0;
+
+    // host: CPUs kept busy on average, and CPU time per packet
+    print_null_or("host_cpus", total > 0 && seconds > 0, (double)busy / (double)hz / seconds);
+    print_null_or("host_cpu_us_per_pkt", packets > 0, (double)busy * 1e6 / (double)hz / pkts);
+    print_null_or("host_irqs_per_pkt", opts->irq != NULL, (double)(h1->irqs - h0->irqs) / pkts);
+    // remote: share of its core not spent idle
+    print_null_or("remote_cpu", (flags & NET_BENCH_F_CPU) && rtotal > 0,
+                  rtotal ? 1.0 - (double)idle / (double)rtotal : 0.0);
+    // messages from the host each raised an interrupt on the remote, ours one on the host
+    print_null_or("remote_rx_msgs_per_pkt", flags & NET_BENCH_F_LINK, (double)r1->rx_msgs / pkts);
+    print_null_or("remote_tx_msgs_per_pkt", flags & NET_BENCH_F_LINK, (double)r1->tx_msgs / pkts);
+}
+
+// The remote's probes, one line each, then with -D every trace entry still in its ring
+static void print_perf(const struct bench_opts* opts, const char* test, int size)
+{
+    static struct net_bench_trace_reply tr;
+    struct net_bench_perf_reply pr;
+    char names[MAX_PROBES][NET_BENCH_PERF_NAME_LEN + 1];
+    uint32_t probe, num_probes, pos, i;
+
+    for (num_probes = 0; num_probes < MAX_PROBES; num_probes++) {
+        unsigned long long sum;
+        uint32_t count;
+
+        if (ctl_request(opts, NET_BENCH_CMD_PERF, num_probes, &pr, sizeof(pr)) < 0 ||
+            !(ntohl(pr.flags) & NET_BENCH_F_PERF)) {
+            break;
+        }
+        memcpy(names[num_probes], pr.name, NET_BENCH_PERF_NAME_LEN);
+        names[num_probes][NET_BENCH_PERF_NAME_LEN] = '\0';
+        count = ntohl(pr.count);
+        sum = ((unsigned long long)ntohl(pr.sum_hi) << 32) | ntohl(pr.sum_lo);
+
+        printf("{\"test\":\"perf\",\"run\":\"%s\",\"size\":%d,\"probe\":\"%s\",\"count\":%u,"
+               "\"min_cycles\":%u,\"mean_cycles\":%llu,\"max_cycles\":%u,\"hist_log2\":[",
+               test, size, names[num_probes], count, ntohl(pr.min), count ? sum / count : 0, ntohl(pr.max));
+        for (i = 0; i < NET_BENCH_PERF_BUCKETS; i++) {
+            printf("%s%u", i ? "," : "", ntohl(pr.hist[i]));
+        }
+        printf("]}\n");
+    }
+
+    for (pos = 0; opts->trace && num_probes > 0;) {
+        uint32_t count;
+
+        if (ctl_request(opts, NET_BENCH_CMD_TRACE, pos, &tr, sizeof(tr)) < 0 ||
+            !(ntohl(tr.flags) & NET_BENCH_F_PERF) || (count = ntohl(tr.count)) == 0) {
+            break;
+        }
+        for (i = 0; i < count && i < NET_BENCH_TRACE_MAX; i++) {
+            probe = ntohl(tr.entries[i].probe);
+            printf("{\"test\":\"trace\",\"run\":\"%s\",\"size\":%d,\"probe\":\"%s\",\"start\":%u,"
+                   "\"cycles\":%u}\n", test, size, probe < num_probes ? names[probe] : "?",
+                   ntohl(tr.entries[i].start), ntohl(tr.entries[i].cycles));
+        }
+        pos = ntohl(tr.next);
+    }
+    fflush(stdout);
+}
+
+// Compare one metric with the line of the baseline for the same test and size
+static void check_baseline(const struct bench_opts* opts, const char* test, int size, const char* key,
+                           double value, int higher_is_better)
+{
+    char line[1024], prefix[64], field[64];
+    FILE* f;
+
+    if (opts->baseline == NULL || (f = fopen(opts->baseline, "r")) == NULL) {
+        return;
+    }
+    snprintf(prefix, sizeof(prefix), "{\"test\":\"%s\",\"size\":%d,", test, size);
+    snprintf(field, sizeof(field), "\"%s\":", key);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char* p;
+        double base, change;
+
+        if (strncmp(line, prefix, strlen(prefix)) != 0 || (p = strstr(line, field)) == NULL) {
+            continue;
+        }
+        base = strtod(p + strlen(field), NULL);
+        if (base <= 0) {
+            break;
+        }
+        change = (value - base) * 100.0 / base;
+        if (higher_is_better ? change < -opts->tolerance : change > opts->tolerance) {
+            fprintf(stderr, "rpmsg_bench: %s %d bytes: %s %.3f against %.3f (%+.1f%%)\n",
+                    test, size, key, value, base, change);
+            regressions++;
+        }
+        break;
+    }
+    fclose(f);
+}
+
+static int run_throughput(const struct bench_opts* opts, int size)
+{
+    struct net_bench_reply r0, r1;
+    struct host_sample h0, h1;
+    struct timespec now;
+    unsigned long long sent = 0, received, rx_bytes;
+    double seconds;
+    char* buf;
+    int fd;
+
+    buf = calloc(1, (size_t)size);
+    fd = udp_socket(opts->sink_port, 1000);
+    if (buf == NULL || fd < 0 || ctl_request(opts, NET_BENCH_CMD_RESET, 0, &r0, sizeof(r0)) < 0) {
+        free(buf);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    host_sample(opts, &h0);
+    do {
+        // the clock is only read every so often, it would cost more than the send
+        for (int i = 0; i < 64; i++) {
+            memcpy(buf, &sent, sizeof(sent) < (size_t)size ? sizeof(sent) : (size_t)size);
+            if (send(fd, buf, (size_t)size, 0) == size) {
+                sent++;
+            } else if (errno != ENOBUFS && errno != EAGAIN) {
+                perror("send");
+                break;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (ts_diff(&h0.ts, &now) < opts->duration);
+    host_sample(opts, &h1);
+    close(fd);
+    free(buf);
+
+    if (ctl_finish(opts, &r1) < 0) {
+        return -1;
+    }
+    received = ntohl(r1.sink_packets);
+    rx_bytes = ((unsigned long long)ntohl(r1.sink_bytes_hi) << 32) | ntohl(r1.sink_bytes_lo);
+    seconds = ts_diff(&h0.ts, &h1.ts);
+
+    printf("{\"test\":\"throughput\",\"size\":%d,\"seconds\":%.3f,\"sent\":%llu,\"received\":%llu,"
+           "\"lost\":%llu,\"tx_pps\":%.0f,\"rx_pps\":%.0f,\"rx_mbps\":%.3f",
+           size, seconds, sent, received, sent > received ? sent - received : 0,
+           (double)sent / seconds, (double)received / seconds, (double)rx_bytes * 8 / seconds / 1e6);
+    print_costs(opts, &h0, &h1, &r0, &r1, received);
+    printf("}\n");
+    fflush(stdout);
+    if (opts->perf) {
+        print_perf(opts, "throughput", size);
+    }
+
+    check_baseline(opts, "throughput", size, "rx_mbps", (double)rx_bytes * 8 / seconds / 1e6, 1);
+    return 0;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// Nearest rank percentile of sorted samples, permille out of 1000
+static double percentile_us(const uint64_t* ns, int n, int permille)
+{
+    int rank = (int)(((long long)n * permille + 999) / 1000);
+
+    return (double)ns[rank > 0 ? rank - 1 : 0] / 1000.0;
+}
+
+static int run_latency(const struct bench_opts* opts, int size)
+{
+    struct net_bench_reply r0, r1;
+    struct host_sample h0, h1;
+    struct timespec t0, t1;
+    uint64_t* ns;
+    char *buf, *rbuf;
+    int fd, n = 0, lost = 0;
+    uint32_t seq;
+
+    ns = calloc((size_t)opts->samples, sizeof(*ns));
+    buf = calloc(1, (size_t)size);
+    rbuf = malloc((size_t)size);
+    fd = udp_socket(opts->echo_port, opts->timeout_ms);
+    if (ns == NULL || buf == NULL || rbuf == NULL || fd < 0 ||
+        ctl_request(opts, NET_BENCH_CMD_RESET, 0, &r0, sizeof(r0)) < 0) {
+        goto fail;
+    }
+
+    host_sample(opts, &h0);
+    for (seq = 0; seq < (uint32_t)opts->samples; seq++) {
+        ssize_t len;
+
+        memcpy(buf, &seq, sizeof(seq) < (size_t)size ? sizeof(seq) : (size_t)size);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (send(fd, buf, (size_t)size, 0) != size) {
+            lost++;
+            continue;
+        }
+        // answers to round trips that already timed out are skipped
+        while ((len = recv(fd, rbuf, (size_t)size, 0)) >= 0) {
+            if (len == size && memcmp(rbuf, buf, sizeof(seq) < (size_t)size ? sizeof(seq) : (size_t)size) == 0) {
+                break;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (len < 0) {
+            lost++;
+            continue;
+        }
+        ns[n++] = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000ULL + (uint64_t)(t1.tv_nsec - t0.tv_nsec);
+    }
+    host_sample(opts, &h1);
+
+    if (ctl_finish(opts, &r1) < 0 || n == 0) {
+        goto fail;
+    }
+    qsort(ns, (size_t)n, sizeof(*ns), cmp_u64);
+
+    printf("{\"test\":\"latency\",\"size\":%d,\"seconds\":%.3f,\"samples\":%d,\"lost\":%d,"
+           "\"min_us\":%.3f,\"p50_us\":%.3f,\"p99_us\":%.3f,\"p999_us\":%.3f,\"max_us\":%.3f",
+           size, ts_diff(&h0.ts, &h1.ts), n, lost, (double)ns[0] / 1000.0,
+           percentile_us(ns, n, 500), percentile_us(ns, n, 990), percentile_us(ns, n, 999),
+           (double)ns[n - 1] / 1000.0);
+    print_costs(opts, &h0, &h1, &r0, &r1, (unsigned long long)n);
+    printf("}\n");
+    fflush(stdout);
+    if (opts->perf) {
+        print_perf(opts, "latency", size);
+    }
+
+    check_baseline(opts, "latency", size, "p99_us", percentile_us(ns, n, 990), 0);
+
+    close(fd);
+    free(ns);
+    free(buf);
+    free(rbuf);
+    return 0;
+
+fail:
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(ns);
+    free(buf);
+    free(rbuf);
+    return -1;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] [remote]\n"
+            "  remote           address of the FreeRTOS side, default 10.43.0.3\n"
+            "  -m MODE          throughput, latency or all (default)\n"
+            "  -s SIZES         comma separated UDP payload sizes, default 64 up to the MTU\n"
+            "  -M MTU           link MTU the default sizes go up to, default 1500\n"
+            "  -t SECONDS       length of each throughput run, default 2\n"
+            "  -n COUNT         round trips per latency run, default 10000\n"
+            "  -w MS            a round trip taking longer is lost, default 100\n"
+            "  -i NAME          count interrupts of the /proc/interrupts lines containing NAME\n"
+            "  -e PORT, -k PORT echo and sink port, default 7007 and 7009\n"
+            "  -P               list the remote's PERF_STOP probes after each run\n"
+            "  -D               with -P, also dump their trace\n"
+            "  -b FILE          compare with the output of an earlier run, exit 1 on a regression\n"
+            "  -T PERCENT       tolerance for -b, default 5\n",
+            prog);
+}
+
+int main(int argc, char** argv)
+{
+    struct bench_opts opts = {
+        .host = "10.43.0.3",
+        .echo_port = 7007,
+        .sink_port = 7009,
+        .mtu = 1500,
+        .duration = 2.0,
+        .samples = 10000,
+        .timeout_ms = 100,
+        .run_throughput = 1,
+        .run_latency = 1,
+        .tolerance = 5.0,
+    };
+    const char* sizes = NULL;
+    int c, i, failed = 0;
+
+    while ((c = getopt(argc, argv, "m:s:M:t:n:w:i:e:k:PDb:T:h")) != -1) {
+        switch (c) {
+        case 'm':
+            opts.run_throughput = strcmp(optarg, "latency") != 0;
+            opts.run_latency = strcmp(optarg, "throughput") != 0;
+            break;
+        case 's':
+            sizes = optarg;
+            break;
+        case 'M':
+            opts.mtu = atoi(optarg);
+            break;
+        case 't':
+            opts.duration = atof(optarg);
+            break;
+        case 'n':
+            opts.samples = atoi(optarg);
+            break;
+        case 'w':
+            opts.timeout_ms = atoi(optarg);
+            break;
+        case 'i':
+            opts.irq = optarg;
+            break;
+        case 'e':
+            opts.echo_port = atoi(optarg);
+            break;
+        case 'k':
+            opts.sink_port = atoi(optarg);
+            break;
+        case 'P':
+            opts.perf = 1;
+            break;
+        case 'D':
+            opts.trace = 1;
+            break;
+        case 'b':
+            opts.baseline = optarg;
+            break;
+        case 'T':
+            opts.tolerance = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc) {
+        opts.host = argv[optind];
+    }
+    if (opts.samples <= 0 || opts.duration <= 0 || opts.mtu <= UDP_IP_HDR_LEN + 64) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (sizes != NULL) {
+        for (char* p = (char*)sizes; *p != '\0' && opts.num_sizes < MAX_SIZES; p++) {
+            int size = (int)strtol(p, &p, 10);
+
+            if (size <= 0 || size > 65507) {
+                fprintf(stderr, "rpmsg_bench: bad size list %s\n", sizes);
+                return 2;
+            }
+            opts.sizes[opts.num_sizes++] = size;
+            if (*p != ',') {
+                break;
+            }
+        }
+    } else {
+        // powers of two from 64, then the largest datagram that is not fragmented
+        for (int size = 64; size < opts.mtu - UDP_IP_HDR_LEN; size *= 2) {
+            opts.sizes[opts.num_sizes++] = size;
+        }
+        opts.sizes[opts.num_sizes++] = opts.mtu - UDP_IP_HDR_LEN;
+    }
+
+    memset(&remote_addr, 0, sizeof(remote_addr));
+    remote_addr.sin_family = AF_INET;
+    if (inet_pton(AF_INET, opts.host, &remote_addr.sin_addr) != 1) {
+        fprintf(stderr, "rpmsg_bench: bad address %s\n", opts.host);
+        return 2;
+    }
+
+    for (i = 0; i < opts.num_sizes; i++) {
+        if (opts.run_throughput && run_throughput(&opts, opts.sizes[i]) < 0) {
+            failed = 1;
+        }
+        if (opts.run_latency && run_latency(&opts, opts.sizes[i]) < 0) {
+            failed = 1;
+        }
+    }
+
+    return failed ? 2 : regressions ? 1 : 0;
+}
@@ -0,0 +1,458 @@
+// Capture on a netif of the FreeRTOS side, the Linux half. The remote runs freertos/net_capture.c
+// and is built with LWIP_CAPTURE; its drivers copy the matching frames into a trace ring that is
+// sent over here through a dedicated RPMsg endpoint. The result is a pcap file, or a stream on
+// stdout for `tcpdump -r -` or wireshark -k -i -.
+//
+// Filters are compiled here by tcpdump and run there:
+//   tcpdump -ddd -y EN10MB udp port 53 > dns.bpf
+//   rpmsg_pcap -i 2 -F dns.bpf -w dns.pcap
+// Use -y RAW for a netif without Ethernet header (rpmsg_eth in raw IP mode).
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/rpmsg.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Protocol, all fields in network order. Must match freertos/net_capture.c.
+#define NET_CAPTURE_EPT_ADDR 0x4350
+#define NET_CAPTURE_EPT_NAME "rpmsg-capture"
+#define NET_CAPTURE_MAGIC 0x52434150 // "RCAP"
+#define NET_CAPTURE_DATA_MAGIC 0x52434144 // "RCAD"
+#define NET_CAPTURE_CMD_START 1
+#define NET_CAPTURE_CMD_STOP 2
+
+#define NET_CAPTURE_MAX_INSNS 64
+#define NET_CAPTURE_MSG_MAX 4096
+
+struct net_capture_insn {
+    uint16_t code;
+    uint8_t jt;
+    uint8_t jf;
+    uint32_t k;
+};
+
+struct net_capture_request {
+    uint32_t magic;
+    uint16_t cmd;
+    uint16_t ifindex;
+    uint16_t snaplen;
+    uint16_t count;
+    struct net_capture_insn insns[NET_CAPTURE_MAX_INSNS];
+};
+
+struct net_capture_reply {
+    uint32_t magic;
+    uint16_t cmd;
+    uint16_t status;
+    uint16_t linktype;
+    uint16_t snaplen;
+    uint32_t captured;
+    uint32_t dropped;
+    uint32_t now_hi;
+    uint32_t now_lo;
+};
+
+struct net_capture_data {
+    uint32_t magic;
+    uint32_t dropped;
+};
+
+struct net_capture_rec {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint16_t caplen;
+    uint16_t len;
+    uint8_t dir;
+    uint8_t pad[3];
+};
+
+struct pcap_file_header {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct pcap_rec_header {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t caplen;
+    uint32_t len;
+};
+
+static const char* const status_names[] = {
+    "ok", "malformed request", "no such netif", "filter rejected", "firmware built without LWIP_CAPTURE",
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+// Read the output of tcpdump -ddd: the number of instructions, then one "code jt jf k" per line
+static int read_filter(const char* path, struct net_capture_request* req)
+{
+    FILE* f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    unsigned int n, i, code, jt, jf;
+    unsigned long k;
+
+    if (f == NULL) {
+        fprintf(stderr, "rpmsg_pcap: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fscanf(f, "%u", &n) != 1 || n > NET_CAPTURE_MAX_INSNS) {
+        fprintf(stderr, "rpmsg_pcap: %s: not tcpdump -ddd output, or longer than %d instructions\n", path,
+                NET_CAPTURE_MAX_INSNS);
+        goto err;
+    }
+    for (i = 0; i < n; i++) {
+        if (fscanf(f, "%u %u %u %lu", &code, &jt, &jf, &k) != 4 || code > 0xFFFF || jt > 0xFF || jf > 0xFF) {
+            fprintf(stderr, "rpmsg_pcap: %s: bad instruction %u\n", path, i);
+            goto err;
+        }
+        req->insns[i].code = htons(code);
+        req->insns[i].jt = jt;
+        req->insns[i].jf = jf;
+        req->insns[i].k = htonl(k);
+    }
+    req->count = htons(n);
+    if (f != stdin) {
+        fclose(f);
+    }
+    return 0;
+
+err:
+    if (f != stdin) {
+        fclose(f);
+    }
+    return -1;
+}
+
+// The endpoint device the kernel made for our endpoint, found by its name in sysfs
+static int find_ept_dev(char* dev, size_t size)
+{
+    DIR* dir = opendir("/sys/class/rpmsg");
+    struct dirent* d;
+    char path[512], name[64];
+    int found = 0;
+
+    if (dir == NULL) {
+        return -1;
+    }
+    while (!found && (d = readdir(dir)) != NULL) {
+        FILE* f;
+
+        if (strncmp(d->d_name, "rpmsg", 5) != 0 || strncmp(d->d_name, "rpmsg_ctrl", 10) == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/sys/class/rpmsg/%s/name", d->d_name);
+        f = fopen(path, "r");
+        if (f == NULL) {
+            continue;
+        }
+        if (fgets(name, sizeof(name), f) != NULL && strncmp(name, NET_CAPTURE_EPT_NAME "\n", sizeof(NET_CAPTURE_EPT_NAME)) == 0) {
+            snprintf(dev, size, "/dev/%s", d->d_name);
+            found = 1;
+        }
+        fclose(f);
+    }
+    closedir(dir);
+    return found ? 0 : -1;
+}
+
+static int open_ept(const char* ctrl, const char* dev_arg, int* ctrl_fd)
+{
+    struct rpmsg_endpoint_info info;
+    char dev[300];
+    int fd, i;
+
+    *ctrl_fd = -1;
+    if (dev_arg != NULL) {
+        fd = open(dev_arg, O_RDWR);
+        if (fd < 0) {
+            fprintf(stderr, "rpmsg_pcap: %s: %s\n", dev_arg, strerror(errno));
+        }
+        return fd;
+    }
+
+    *ctrl_fd = open(ctrl, O_RDWR);
+    if (*ctrl_fd < 0) {
+        fprintf(stderr, "rpmsg_pcap: %s: %s\n", ctrl, strerror(errno));
+        return -1;
+    }
+    memset(&info, 0, sizeof(info));
+    strncpy(info.name, NET_CAPTURE_EPT_NAME, sizeof(info.name) - 1);
+    info.src = RPMSG_ADDR_ANY;
+    info.dst = NET_CAPTURE_EPT_ADDR;
+    if (ioctl(*ctrl_fd, RPMSG_CREATE_EPT_IOCTL, &info) < 0) {
+        fprintf(stderr, "rpmsg_pcap: creating the endpoint: %s\n", strerror(errno));
+        return -1;
+    }
+    // udev needs a moment to make the node
+    for (i = 0; i < 50; i++) {
+        if (find_ept_dev(dev, sizeof(dev)) == 0 && (fd = open(dev, O_RDWR)) >= 0) {
+            return fd;
+        }
+        usleep(20000);
+    }
+    fprintf(stderr, "rpmsg_pcap: no device for the endpoint, pass it with -d\n");
+    return -1;
+}
+
+// Send a request and wait for its reply; data messages in between are passed to on_data
+static int request(int fd, const struct net_capture_request* req, size_t len, struct net_capture_reply* reply,
+                   int (*on_data)(const uint8_t*, ssize_t))
+{
+    uint8_t buf[NET_CAPTURE_MSG_MAX];
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    ssize_t n;
+
+    if (write(fd, req, len) != (ssize_t)len) {
+        fprintf(stderr, "rpmsg_pcap: sending the request: %s\n", strerror(errno));
+        return -1;
+    }
+    for (;;) {
+        if (poll(&pfd, 1, 2000) <= 0) {
+            fprintf(stderr, "rpmsg_pcap: no answer from net_capture\n");
+            return -1;
+        }
+        n = read(fd, buf, sizeof(buf));
+        if (n < (ssize_t)sizeof(uint32_t)) {
+            continue;
+        }
+        if (ntohl(*(uint32_t*)buf) == NET_CAPTURE_DATA_MAGIC) {
+            if (on_data != NULL) {
+                on_data(buf, n);
+            }
+        } else if (n >= (ssize_t)sizeof(*reply) && ntohl(*(uint32_t*)buf) == NET_CAPTURE_MAGIC) {
+            memcpy(reply, buf, sizeof(*reply));
+            return ntohs(reply->cmd) == ntohs(req->cmd) ? 0 : -1;
+        }
+    }
+}
+
+static FILE* out;
+static int64_t ts_offset_us;
+static int dir_mask = 3;
+static long limit;
+static long written;
+
+// Turn the records of one data message into pcap records, returns 1 when the count is reached
+static int write_records(const uint8_t* buf, ssize_t n)
+{
+    const struct net_capture_data* data = (const struct net_capture_data*)buf;
+    ssize_t off = sizeof(*data);
+
+    if (n < (ssize_t)sizeof(*data)) {
+        return 0;
+    }
+    while (off + (ssize_t)sizeof(struct net_capture_rec) <= n) {
+        const struct net_capture_rec* rec = (const struct net_capture_rec*)(buf + off);
+        uint16_t caplen = ntohs(rec->caplen);
+        struct pcap_rec_header hdr;
+        int64_t ts;
+
+        if (off + (ssize_t)sizeof(*rec) + caplen > n) {
+            break;
+        }
+        off += (sizeof(*rec) + caplen + 3) & ~3;
+        if (!(dir_mask & (1 << rec->dir))) {
+            continue;
+        }
+        ts = (int64_t)ntohl(rec->ts_sec) * 1000000 + ntohl(rec->ts_usec) + ts_offset_us;
+        hdr.ts_sec = (uint32_t)(ts / 1000000);
+        hdr.ts_usec = (uint32_t)(ts % 1000000);
+        hdr.caplen = caplen;
+        hdr.len = ntohs(rec->len);
+        fwrite(&hdr, sizeof(hdr), 1, out);
+        fwrite(rec + 1, caplen, 1, out);
+        if (++written == limit) {
+            fflush(out);
+            return 1;
+        }
+    }
+    fflush(out);
+    return 0;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -i INDEX         netif to capture on, netif_get_index() on the remote, default 1\n"
+            "  -F FILE          filter, as printed by tcpdump -ddd; - for stdin. Default: everything\n"
+            "  -s SNAPLEN       bytes kept of each frame, default as many as fit an RPMsg buffer\n"
+            "  -w FILE          pcap output, default stdout\n"
+            "  -c COUNT         stop after COUNT frames\n"
+            "  -Q in|out|inout  direction of the frames to keep, default inout\n"
+            "  -C DEVICE        rpmsg control device, default /dev/rpmsg_ctrl0\n"
+            "  -d DEVICE        use this endpoint device instead of creating one\n",
+            prog);
+}
+
+int main(int argc, char** argv)
+{
+    struct net_capture_request req;
+    struct net_capture_reply reply;
+    struct pcap_file_header fh;
+    struct sigaction sa;
+    struct timeval now;
+    const char* ctrl = "/dev/rpmsg_ctrl0";
+    const char* dev = NULL;
+    const char* filter = NULL;
+    const char* path = NULL;
+    unsigned int ifindex = 1, snaplen = 0;
+    uint8_t buf[NET_CAPTURE_MSG_MAX];
+    int c, fd, ctrl_fd, status, ret = 1;
+    uint64_t remote_now;
+
+    while ((c = getopt(argc, argv, "i:F:s:w:c:Q:C:d:h")) != -1) {
+        switch (c) {
+        case 'i':
+            ifindex = atoi(optarg);
+            break;
+        case 'F':
+            filter = optarg;
+            break;
+        case 's':
+            snaplen = atoi(optarg);
+            break;
+        case 'w':
+            path = optarg;
+            break;
+        case 'c':
+            limit = atol(optarg);
+            break;
+        case 'Q':
+            dir_mask = strcmp(optarg, "in") == 0 ? 1 : strcmp(optarg, "out") == 0 ? 2 : 3;
+            break;
+        case 'C':
+            ctrl = optarg;
+            break;
+        case 'd':
+            dev = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc || ifindex == 0 || ifindex > 255 || snaplen > 0xFFFF) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.magic = htonl(NET_CAPTURE_MAGIC);
+    req.cmd = htons(NET_CAPTURE_CMD_START);
+    req.ifindex = htons(ifindex);
+    req.snaplen = htons(snaplen);
+    if (filter != NULL && read_filter(filter, &req) < 0) {
+        return 2;
+    }
+
+    fd = open_ept(ctrl, dev, &ctrl_fd);
+    if (fd < 0) {
+        goto out;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (request(fd, &req, offsetof(struct net_capture_request, insns) + ntohs(req.count) * sizeof(req.insns[0]),
+                &reply, NULL) < 0) {
+        goto out;
+    }
+    status = ntohs(reply.status);
+    if (status != 0) {
+        fprintf(stderr, "rpmsg_pcap: %s\n",
+                status < (int)(sizeof(status_names) / sizeof(status_names[0])) ? status_names[status] : "error");
+        goto out;
+    }
+    // the remote stamps with its own clock, line it up with ours
+    gettimeofday(&now, NULL);
+    remote_now = (uint64_t)ntohl(reply.now_hi) << 32 | ntohl(reply.now_lo);
+    ts_offset_us = (int64_t)now.tv_sec * 1000000 + now.tv_usec - (int64_t)remote_now;
+
+    out = path == NULL ? stdout : fopen(path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "rpmsg_pcap: %s: %s\n", path, strerror(errno));
+        goto stop;
+    }
+    fh.magic = 0xa1b2c3d4;
+    fh.version_major = 2;
+    fh.version_minor = 4;
+    fh.thiszone = 0;
+    fh.sigfigs = 0;
+    fh.snaplen = ntohs(reply.snaplen);
+    fh.linktype = ntohs(reply.linktype);
+    fwrite(&fh, sizeof(fh), 1, out);
+    fflush(out);
+    fprintf(stderr, "rpmsg_pcap: capturing on netif %u, linktype %u, snaplen %u\n", ifindex, fh.linktype,
+            fh.snaplen);
+
+    while (!stop) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        ssize_t n;
+
+        if (poll(&pfd, 1, 500) <= 0) {
+            continue;
+        }
+        n = read(fd, buf, sizeof(buf));
+        if (n >= (ssize_t)sizeof(uint32_t) && ntohl(*(uint32_t*)buf) == NET_CAPTURE_DATA_MAGIC &&
+            write_records(buf, n)) {
+            break;
+        }
+    }
+
+stop:
+    memset(&req, 0, sizeof(req));
+    req.magic = htonl(NET_CAPTURE_MAGIC);
+    req.cmd = htons(NET_CAPTURE_CMD_STOP);
+    if (request(fd, &req, offsetof(struct net_capture_request, insns), &reply,
+                (limit > 0 && written >= limit) || out == NULL ? NULL : write_records) == 0) {
+        fprintf(stderr, "rpmsg_pcap: %ld frames written, %u captured, %u dropped by the remote\n", written,
+                ntohl(reply.captured), ntohl(reply.dropped));
+        ret = out == NULL;
+    }
+    if (out != NULL) {
+        fflush(out);
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+
+out:
+    if (fd >= 0 && ctrl_fd >= 0) {
+        ioctl(fd, RPMSG_DESTROY_EPT_IOCTL);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (ctrl_fd >= 0) {
+        close(ctrl_fd);
+    }
+    return ret;
+}
@@ -0,0 +1,287 @@
+// Memory footprint of the FreeRTOS side, the Linux half. The remote runs freertos/net_footprint.c
+// and answers on a dedicated RPMsg endpoint with what every lwIP memp pool, the mem_malloc heap
+// and, with SYS_ARCH_STATS, the sys_arch mailboxes hold: in use now, the most ever in use since
+// boot or the last reset, and failed allocations. Run it after a stretch of production traffic
+// to size PBUF_POOL_SIZE, MEMP_NUM_TCP_SEG, MEM_SIZE and the mailbox depths from real peaks:
+//
+//   rpmsg_footprint -r        # start the high-water marks over
+//   ...traffic...
+//   rpmsg_footprint           # one line per pool
+//   rpmsg_footprint -j        # the same as JSON, one object per line
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/rpmsg.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// Protocol, all fields in network order. Must match freertos/net_footprint.c.
+#define NET_FOOTPRINT_EPT_ADDR 0x4650
+#define NET_FOOTPRINT_EPT_NAME "rpmsg-footprint"
+#define NET_FOOTPRINT_MAGIC 0x52465054 // "RFPT"
+#define NET_FOOTPRINT_CMD_GET 1
+#define NET_FOOTPRINT_CMD_RESET 2
+
+#define NET_FOOTPRINT_NAME_LEN 16
+#define NET_FOOTPRINT_MSG_MAX 4096
+
+struct net_footprint_request {
+    uint32_t magic;
+    uint16_t cmd;
+    uint16_t index;
+};
+
+struct net_footprint_entry {
+    char name[NET_FOOTPRINT_NAME_LEN];
+    uint8_t kind;
+    uint8_t reserved;
+    uint16_t size;
+    uint32_t avail;
+    uint32_t used;
+    uint32_t max;
+    uint32_t err;
+};
+
+struct net_footprint_reply {
+    uint32_t magic;
+    uint16_t cmd;
+    uint16_t status;
+    uint16_t index;
+    uint16_t count;
+    uint16_t total;
+    uint16_t reserved;
+    struct net_footprint_entry entries[];
+};
+
+static const char* const kind_names[] = { "pool", "heap", "mbox" };
+
+// The endpoint device the kernel made for our endpoint, found by its name in sysfs
+static int find_ept_dev(char* dev, size_t size)
+{
+    DIR* dir = opendir("/sys/class/rpmsg");
+    struct dirent* d;
+    char path[512], name[64];
+    int found = 0;
+
+    if (dir == NULL) {
+        return -1;
+    }
+    while (!found && (d = readdir(dir)) != NULL) {
+        FILE* f;
+
+        if (strncmp(d->d_name, "rpmsg", 5) != 0 || strncmp(d->d_name, "rpmsg_ctrl", 10) == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/sys/class/rpmsg/%s/name", d->d_name);
+        f = fopen(path, "r");
+        if (f == NULL) {
+            continue;
+        }
+        if (fgets(name, sizeof(name), f) != NULL &&
+            strncmp(name, NET_FOOTPRINT_EPT_NAME "\n", sizeof(NET_FOOTPRINT_EPT_NAME)) == 0) {
+            snprintf(dev, size, "/dev/%s", d->d_name);
+            found = 1;
+        }
+        fclose(f);
+    }
+    closedir(dir);
+    return found ? 0 : -1;
+}
+
+static int open_ept(const char* ctrl, const char* dev_arg, int* ctrl_fd)
+{
+    struct rpmsg_endpoint_info info;
+    char dev[300];
+    int fd, i;
+
+    *ctrl_fd = -1;
+    if (dev_arg != NULL) {
+        fd = open(dev_arg, O_RDWR);
+        if (fd < 0) {
+            fprintf(stderr, "rpmsg_footprint: %s: %s\n", dev_arg, strerror(errno));
+        }
+        return fd;
+    }
+
+    *ctrl_fd = open(ctrl, O_RDWR);
+    if (*ctrl_fd < 0) {
+        fprintf(stderr, "rpmsg_footprint: %s: %s\n", ctrl, strerror(errno));
+        return -1;
+    }
+    memset(&info, 0, sizeof(info));
+    strncpy(info.name, NET_FOOTPRINT_EPT_NAME, sizeof(info.name) - 1);
+    info.src = RPMSG_ADDR_ANY;
+    info.dst = NET_FOOTPRINT_EPT_ADDR;
+    if (ioctl(*ctrl_fd, RPMSG_CREATE_EPT_IOCTL, &info) < 0) {
+        fprintf(stderr, "rpmsg_footprint: creating the endpoint: %s\n", strerror(errno));
+        return -1;
+    }
+    // udev needs a moment to make the node
+    for (i = 0; i < 50; i++) {
+        if (find_ept_dev(dev, sizeof(dev)) == 0 && (fd = open(dev, O_RDWR)) >= 0) {
+            return fd;
+        }
+        usleep(20000);
+    }
+    fprintf(stderr, "rpmsg_footprint: no device for the endpoint, pass it with -d\n");
+    return -1;
+}
+
+// Send a request and wait for its reply. The remote drops a request while it is busy with the
+// last one, so it is sent again a few times.
+static int request(int fd, uint16_t cmd, uint16_t index, uint8_t* buf, size_t size)
+{
+    struct net_footprint_request req;
+    struct net_footprint_reply* reply = (struct net_footprint_reply*)buf;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int tries;
+
+    req.magic = htonl(NET_FOOTPRINT_MAGIC);
+    req.cmd = htons(cmd);
+    req.index = htons(index);
+    for (tries = 0; tries < 5; tries++) {
+        ssize_t n;
+
+        if (write(fd, &req, sizeof(req)) != (ssize_t)sizeof(req)) {
+            fprintf(stderr, "rpmsg_footprint: sending the request: %s\n", strerror(errno));
+            return -1;
+        }
+        while (poll(&pfd, 1, 500) > 0) {
+            n = read(fd, buf, size);
+            if (n >= (ssize_t)sizeof(*reply) && ntohl(reply->magic) == NET_FOOTPRINT_MAGIC &&
+                ntohs(reply->cmd) == cmd && ntohs(reply->index) == index &&
+                (size_t)n >= sizeof(*reply) + ntohs(reply->count) * sizeof(reply->entries[0])) {
+                if (ntohs(reply->status) != 0) {
+                    fprintf(stderr, "rpmsg_footprint: request rejected\n");
+                    return -1;
+                }
+                return 0;
+            }
+        }
+    }
+    fprintf(stderr, "rpmsg_footprint: no answer from net_footprint\n");
+    return -1;
+}
+
+static void print_entry(const struct net_footprint_entry* e, int json)
+{
+    char name[NET_FOOTPRINT_NAME_LEN + 1];
+    const char* kind = e->kind < sizeof(kind_names) / sizeof(kind_names[0]) ? kind_names[e->kind] : "?";
+    uint32_t avail = ntohl(e->avail), max = ntohl(e->max);
+
+    memcpy(name, e->name, NET_FOOTPRINT_NAME_LEN);
+    name[NET_FOOTPRINT_NAME_LEN] = '\0';
+    if (json) {
+        printf("{\"kind\":\"%s\",\"name\":\"%s\",\"size\":%u,\"avail\":%u,\"used\":%u,\"max\":%u,\"err\":%u}\n",
+               kind, name, ntohs(e->size), avail, ntohl(e->used), max, ntohl(e->err));
+    } else if (e->kind == 2) {
+        // a mailbox entry counts avail mailboxes of depth size, max is the fullest any got
+        printf("%-5s %-16s %7u %9u %9s %9u %5.1f%% %7u\n", kind, name, ntohs(e->size), avail, "-", max,
+               ntohs(e->size) ? max * 100.0 / ntohs(e->size) : 0.0, ntohl(e->err));
+    } else {
+        printf("%-5s %-16s %7u %9u %9u %9u %5.1f%% %7u\n", kind, name, ntohs(e->size), avail, ntohl(e->used),
+               max, avail ? max * 100.0 / avail : 0.0, ntohl(e->err));
+    }
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -j               JSON output, one object per line\n"
+            "  -r               start the high-water marks and error counts over, after listing\n"
+            "                   them unless -q is given too\n"
+            "  -q               do not list anything\n"
+            "  -C DEVICE        rpmsg control device, default /dev/rpmsg_ctrl0\n"
+            "  -d DEVICE        use this endpoint device instead of creating one\n",
+            prog);
+}
+
+int main(int argc, char** argv)
+{
+    static uint8_t buf[NET_FOOTPRINT_MSG_MAX];
+    const struct net_footprint_reply* reply = (const struct net_footprint_reply*)buf;
+    const char* ctrl = "/dev/rpmsg_ctrl0";
+    const char* dev = NULL;
+    int c, fd, ctrl_fd, json = 0, reset = 0, quiet = 0, ret = 1;
+    uint16_t index = 0, total;
+
+    while ((c = getopt(argc, argv, "jrqC:d:h")) != -1) {
+        switch (c) {
+        case 'j':
+            json = 1;
+            break;
+        case 'r':
+            reset = 1;
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        case 'C':
+            ctrl = optarg;
+            break;
+        case 'd':
+            dev = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    fd = open_ept(ctrl, dev, &ctrl_fd);
+    if (fd < 0) {
+        goto out;
+    }
+
+    if (!quiet && !json) {
+        printf("%-5s %-16s %7s %9s %9s %9s %6s %7s\n", "kind", "name", "size", "avail", "used", "max", "peak",
+               "err");
+    }
+    do {
+        uint16_t i;
+
+        if (quiet || request(fd, NET_FOOTPRINT_CMD_GET, index, buf, sizeof(buf)) < 0) {
+            break;
+        }
+        for (i = 0; i < ntohs(reply->count); i++) {
+            print_entry(&reply->entries[i], json);
+        }
+        total = ntohs(reply->total);
+        index = (uint16_t)(index + ntohs(reply->count));
+        if (ntohs(reply->count) == 0) {
+            break;
+        }
+    } while (index < total);
+    fflush(stdout);
+
+    if (reset && request(fd, NET_FOOTPRINT_CMD_RESET, 0, buf, sizeof(buf)) < 0) {
+        goto out;
+    }
+    ret = quiet || index > 0 ? 0 : 1;
+
+out:
+    if (fd >= 0 && ctrl_fd >= 0) {
+        ioctl(fd, RPMSG_DESTROY_EPT_IOCTL);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (ctrl_fd >= 0) {
+        close(ctrl_fd);
+    }
+    return ret;
+}
@@ -14,296 +14,3880 @@
 #include <linux/errno.h>
 #include <linux/types.h>
 #include <linux/in.h>
+#include <linux/tcp.h>
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
+#include <linux/if_arp.h>
 #include <linux/skbuff.h>
+#include <linux/circ_buf.h>
+#include <linux/log2.h>
+#include <linux/io.h>
+#include <linux/version.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/rtnetlink.h>
+#include <linux/hrtimer.h>
+#include <linux/ethtool.h>
+#include <linux/pkt_sched.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/math64.h>
+#include <linux/net_tstamp.h>
+#include <linux/uaccess.h>
+#include <net/xdp.h>
+#include <net/xdp_sock_drv.h>
+#include <net/ip.h>
+#include <net/if_inet6.h>
+#ifdef CONFIG_ARM_ARCH_TIMER
+#include <clocksource/arm_arch_timer.h>
+#endif
+
+#define CREATE_TRACE_POINTS
+#include "rpmsg_eth_trace.h"
 
 
 // The OpenAMP message size is limited by the buffer size defined in the rpmsg kernel module.
 // For the Linux 4.19 kernel, this is currently defined as 512 bytes with 16 bytes
-// for the message header and 496 bytes of payload.
+// for the message header and 496 bytes of payload. Newer kernels report the actual payload size
+// through rpmsg_get_mtu(); this is only the fallback for older ones.
 #define RPMSG_SIZE 496
 
-//MAC ADDRESS is 6 (DEST MAC ADDRESS) +6 (SORUCE MAC ADDRESS) +2 (EtherTYPE)
-//Next release will remove the MAC ADDRESS info, it is not needed
-#define MTU_RPMSG (RPMSG_SIZE - 6 - 6 - 2)
+// Every RPMsg message starts with this link header, so that one Ethernet frame can be spread over
+// several RPMsg buffers. Fragments of a frame are always sent back to back and in offset order.
+// Must match struct rpmsg_eth_frag_hdr on the remote side.
+struct rpmsg_eth_frag_hdr {
+    __be16 frame_len; // total length of the Ethernet frame
+    __be16 offset;    // offset of this fragment's payload inside the frame
+} __packed;
+
+// Instead of 0, the offset of a frame's first record when a __be32 flow hash follows the link
+// header, ahead of the payload. No real fragment has it, frame_len being at most 0xffff. Sent by a
+// remote we advertised RPMSG_ETH_F_HASH to; the hash is never 0.
+#define RPMSG_ETH_HASH_OFFSET 0xffff
+
+// A link header with frame_len 0 starts a control message instead of a frame; the __be32 magic
+// after it tells which one. The first is the hello: we send it on every endpoint from probe time
+// on until the remote answers, which also tells the remote our return address, and the remote
+// answers on queue 0 with its own. We never answer a hello. Each side only turns on what the other
+// one advertised. Must match struct rpmsg_eth_hello on the remote side; later versions may append
+// fields.
+#define RPMSG_ETH_HELLO_MAGIC   0x52455448 // "RETH"
+#define RPMSG_ETH_HELLO_VERSION 1
+
+// feature bits, each telling what the sender of the hello is able to receive
+#define RPMSG_ETH_F_PACK BIT(0) // several whole frames packed into one message
+#define RPMSG_ETH_F_CSUM BIT(1) // checksum-free mode, active only when both hellos carry it
+#define RPMSG_ETH_F_TSO  BIT(2) // TCP super-frames larger than the MTU, up to tso_max
+#define RPMSG_ETH_F_RAW  BIT(3) // bare IP packets instead of frames, active only when both hellos carry it
+#define RPMSG_ETH_F_TSTAMP BIT(4) // timestamp messages are understood
+#define RPMSG_ETH_F_MCAST  BIT(5) // multicast filter messages are understood and applied
+#define RPMSG_ETH_F_STATS  BIT(6) // statistics requests are understood
+#define RPMSG_ETH_F_COALESCE BIT(7) // coalescing messages are understood and applied
+#define RPMSG_ETH_F_PRIO   BIT(8) // frames from urgent queues overtake the others
+#define RPMSG_ETH_F_HASH   BIT(9) // first records may carry a flow hash, see RPMSG_ETH_HASH_OFFSET
+#define RPMSG_ETH_F_MTU    BIT(10) // MTU messages are understood and applied
+
+struct rpmsg_eth_hello {
+    struct rpmsg_eth_frag_hdr hdr; // frame_len and offset are 0
+    __be32 magic;
+    __be16 version;
+    __be16 mtu;          // link MTU of the sender
+    __be16 buf_size;     // largest message the sender can receive, link header included
+    u8 num_queues;       // number of endpoints of the sender
+    u8 reserved;
+    __be32 features;     // RPMSG_ETH_F_*
+    u8 mac[ETH_ALEN];    // MAC address of the sender's interface
+    __be16 tso_max;      // largest frame accepted with RPMSG_ETH_F_TSO, Ethernet header included
+} __packed;
+
+// tso_max of our hello with rx_gso: anything frame_len can describe
+#define RPMSG_ETH_RX_TSO_MAX 0xffff
+
+// Shared-memory transport. The remote may offer a carved-out region, right after answering our
+// hello, that holds a pair of SPSC packet rings: ring 0 carries frames from us to the remote,
+// ring 1 the other way. We echo the offer back once the region is mapped, and from then on queue 0
+// sends through ring 0 instead of RPMsg buffers. RPMsg only carries control messages and doorbells.
+// Must match the RPMSG_ETH_SHM part of the remote side.
+#define RPMSG_ETH_SHM_MAGIC      0x5253484d // "RSHM"
+#define RPMSG_ETH_DOORBELL_MAGIC 0x5244424c // "RDBL"
+
+struct rpmsg_eth_shm_offer {
+    struct rpmsg_eth_frag_hdr hdr; // frame_len and offset are 0
+    __be32 magic;
+    __be32 addr_lo;      // physical address of the region, as seen by us
+    __be32 addr_hi;
+    __be32 size;         // size of the whole region
+    __be32 ring_size;    // data bytes per ring, a power of two
+} __packed;
+
+// "look at the rings": new frames were produced on a ring whose consumer asked for it, or room
+// was made on a ring whose producer asked for it
+struct rpmsg_eth_doorbell {
+    struct rpmsg_eth_frag_hdr hdr; // frame_len and offset are 0
+    __be32 magic;
+} __packed;
+
+// Timestamps of the next frame completed on the same endpoint, in ticks of the ARM generic timer's
+// counter, which both cores read. Sent for sampled frames right before their first message, never
+// for frames going through the shared-memory rings. Must match struct rpmsg_eth_tstamp on the
+// remote side.
+#define RPMSG_ETH_TSTAMP_MAGIC 0x52545350 // "RTSP"
+
+struct rpmsg_eth_tstamp {
+    struct rpmsg_eth_frag_hdr hdr; // frame_len and offset are 0
+    __be32 magic;
+    __be32 hz;           // counter frequency, stamps are dropped if it differs
+    __be32 xmit_hi;      // frame handed to the driver
+    __be32 xmit_lo;
+    __be32 send_hi;      // first message of the frame handed to RPMsg
+    __be32 send_lo;
+} __packed;
+
+// The multicast addresses the remote wants to receive, replacing the list it sent before. Other
+// multicast frames are dropped by rpmsg_eth_xmit() instead of taking a buffer and an interrupt;
+// broadcasts always pass. With RPMSG_ETH_MCAST_ALL, and until the first list after a hello
+// arrives, all of them pass. Must match struct rpmsg_eth_mcast_filter on the remote side.
+#define RPMSG_ETH_MCAST_MAGIC 0x524d4346 // "RMCF"
+#define RPMSG_ETH_MCAST_ALL   BIT(0)
+
+// A longer list is taken as RPMSG_ETH_MCAST_ALL
+#define RPMSG_ETH_MCAST_MAX 64
+
+struct rpmsg_eth_mcast_filter {
+    struct rpmsg_eth_frag_hdr hdr; // frame_len and offset are 0
+    __be32 magic;
+    __be16 count;        // number of addresses following
+    u8 flags;            // RPMSG_ETH_MCAST_*
+    u8 reserved;
+    u8 addr[][ETH_ALEN];
+} __packed;
+
+// The remote's lwIP statistics for ethtool -S. We send the bare header on queue 0, only if the
+// remote advertised RPMSG_ETH_F_STATS, and it later answers with count counters in the order of
+// rpmsg_eth_remote_gstrings; extra ones are ignored, missing ones read 0. Must match struct
+// rpmsg_eth_stats on the remote side.
+#define RPMSG_ETH_STATS_MAGIC 0x52535441 // "RSTA"
+
+struct rpmsg_eth_stats {
+    struct rpmsg_eth_frag_hdr hdr; // frame_len and offset are 0
+    __be32 magic;
+    __be16 count;        // number of counters following, 0 in a request
+    __be16 reserved;
+    __be32 values[];
+} __packed;
+
+#define RPMSG_ETH_REMOTE_NSTATS 38
+
+// ethtool -C rx-usecs and rx-frames, for the remote to coalesce what it sends us. Sent after every
+// hello that advertised RPMSG_ETH_F_COALESCE and on every change. Must match struct
+// rpmsg_eth_coalesce on the remote side.
+#define RPMSG_ETH_COALESCE_MAGIC 0x52434f41 // "RCOA"
+
+struct rpmsg_eth_coalesce {
+    struct rpmsg_eth_frag_hdr hdr; // frame_len and offset are 0
+    __be32 magic;
+    __be32 usecs;        // hold frames back at most this long, 0 for off
+    __be16 frames;       // or until this many are queued
+    __be16 reserved;
+} __packed;
+
+// The queues of the top mqprio traffic class, whose frames the remote feeds to its stack ahead of
+// the others. Sent after every hello that advertised RPMSG_ETH_F_PRIO and on every change. Must
+// match struct rpmsg_eth_prio on the remote side.
+#define RPMSG_ETH_PRIO_MAGIC 0x52505249 // "RPRI"
+
+struct rpmsg_eth_prio {
+    struct rpmsg_eth_frag_hdr hdr; // frame_len and offset are 0
+    __be32 magic;
+    __be32 urgent;       // bit N set for queue N, 0 for none
+} __packed;
+
+// Our MTU after ip link set mtu, for the remote's netif to follow up to the MTU in its hello. Sent
+// on every change and after every hello that advertised RPMSG_ETH_F_MTU. Must match struct
+// rpmsg_eth_mtu on the remote side.
+#define RPMSG_ETH_MTU_MAGIC 0x524d5455 // "RMTU"
+
+struct rpmsg_eth_mtu {
+    struct rpmsg_eth_frag_hdr hdr; // frame_len and offset are 0
+    __be32 magic;
+    __be16 mtu;
+    __be16 reserved;
+} __packed;
+
+// Largest MTU whose frames frame_len can describe
+#define RPMSG_ETH_MAX_MTU (U16_MAX - ETH_HLEN)
+
+// Ring control block, at the start of the region for ring 0 and right after it for ring 1. The
+// data areas of ring 0 and ring 1 follow. All fields are little endian. head and tail are free
+// running byte counters, head is written by the producer only and tail by the consumer only.
+struct rpmsg_eth_shm_ring {
+    __le32 head;
+    __le32 prod_wait;    // set by the producer when the ring was full, cleared by the consumer
+    __le32 reserved0[14];
+    __le32 tail;
+    __le32 cons_wait;    // set by the consumer when the ring was empty, cleared by the producer
+    __le32 reserved1[14];
+};
+
+// Every frame in a data area is a slot header followed by the frame, padded to
+// RPMSG_ETH_SHM_ALIGN. A slot with RPMSG_ETH_SHM_WRAP has no frame; the producer skipped the rest
+// of the data area because the next frame did not fit before its end.
+struct rpmsg_eth_shm_slot {
+    __le16 len;
+    __le16 flags;
+};
+
+#define RPMSG_ETH_SHM_ALIGN 8
+#define RPMSG_ETH_SHM_WRAP  BIT(0)
+
+// The link is point-to-point, so the Ethernet header and ARP carry nothing the two sides do not
+// already know. With raw_ip the device has no link-layer header at all, like a tun device, and
+// the link carries bare IP packets. The remote has to agree in its hello, or the carrier stays off.
+static bool raw_ip;
+module_param(raw_ip, bool, 0444);
+MODULE_PARM_DESC(raw_ip, "Register a point-to-point device without Ethernet header and ARP; needs a remote with RPMSG_ETH_RAW_IP");
+
+static char *mac_addr;
+module_param(mac_addr, charp, 0444);
+MODULE_PARM_DESC(mac_addr, "MAC address of the interface, 00:00:00:00:00:01 if unset; it can also be changed at runtime");
+
+static bool shm;
+module_param(shm, bool, 0444);
+MODULE_PARM_DESC(shm, "Use the shared-memory packet rings the remote offers, instead of RPMsg buffers, for TX queue 0 and RX");
+
+// Since frames are fragmented, the MTU is no longer bound to the RPMsg buffer size. This is the
+// MTU at probe time; ip link set mtu changes it at runtime up to the one in the remote's hello, to
+// which it is also lowered once that arrives, if that is smaller. 0 derives it from
+// the buffer size: the largest frame that fits into one message, but never below ETH_DATA_LEN.
+static unsigned int mtu;
+module_param(mtu, uint, 0444);
+MODULE_PARM_DESC(mtu, "Link MTU, 0 to derive it from the RPMsg buffer size (default), lowered to the remote's if that is smaller");
+
+static unsigned int tx_ring_size = 64;
+module_param(tx_ring_size, uint, 0444);
+MODULE_PARM_DESC(tx_ring_size, "Number of in-flight TX packets (rounded up to a power of two)");
+
+// Queue 0 is the "rpmsg-eth" channel itself. Queue N talks to the remote endpoint at the channel
+// address + N, which the remote creates as "rpmsg-eth-qN". Must not exceed RPMSG_ETH_NUM_QUEUES
+// on the remote side.
+#define RPMSG_ETH_MAX_QUEUES 8
+
+static unsigned int num_queues = 1;
+module_param(num_queues, uint, 0444);
+MODULE_PARM_DESC(num_queues, "Number of TX queues, each with its own RPMsg endpoint (max 8)");
+
+static bool tx_thread = false;
+module_param(tx_thread, bool, 0444);
+MODULE_PARM_DESC(tx_thread, "Transmit from a per-device real-time kthread that sleeps in rpmsg_send() until the vring has room, instead of the workqueue with a 10ms retry");
+
+static bool use_napi = true;
+module_param(use_napi, bool, 0444);
+MODULE_PARM_DESC(use_napi, "Deliver received packets from a NAPI poll loop with GRO instead of netif_rx()");
+
+static unsigned int rx_ring_size = 256;
+module_param(rx_ring_size, uint, 0444);
+MODULE_PARM_DESC(rx_ring_size, "Number of received packets queued for NAPI before dropping");
+
+// Keep the remote's traffic off the CPUs of latency-critical applications. With rx_cpu, the NAPI
+// poll loop, and with it GRO, XDP and the stack's RX processing, runs as a kthread bound to that
+// CPU (threaded NAPI, Linux 5.12 and later). With tx_cpu, the tx_thread kthreads are bound to it,
+// or the drain work is queued on it. rpmsg_eth_rx_cb() itself, which only copies frames out of the
+// vring, still runs where the remoteproc mailbox interrupt is taken; steer that one through
+// /proc/irq/<n>/smp_affinity. -1 leaves the choice to the scheduler.
+static int rx_cpu = -1;
+module_param(rx_cpu, int, 0444);
+MODULE_PARM_DESC(rx_cpu, "CPU to run the NAPI poll loop on, as a threaded NAPI kthread (-1: softirq wherever the RPMsg callback ran)");
+
+static int tx_cpu = -1;
+module_param(tx_cpu, int, 0444);
+MODULE_PARM_DESC(tx_cpu, "CPU to bind the TX kthreads to, or to queue the TX drain work on (-1: any)");
+
+// The RPMsg callback takes its skbs from a pool kept full by the NAPI poll loop, instead of
+// allocating one per frame in interrupt context
+static unsigned int rx_pool_size = 64;
+module_param(rx_pool_size, uint, 0444);
+MODULE_PARM_DESC(rx_pool_size, "Number of MTU-sized RX skbs kept pre-allocated (0 to allocate per frame)");
+
+// Whole frames that fit are packed back to back into one RPMsg buffer, each behind its own link
+// header, once the remote has advertised RPMSG_ETH_F_PACK in its hello.
+static bool tx_pack = true;
+module_param(tx_pack, bool, 0444);
+MODULE_PARM_DESC(tx_pack, "Pack several small queued frames into one RPMsg buffer when the remote supports it");
+
+// The link is shared memory and cannot corrupt frames. In checksum-free mode neither side fills
+// in TCP/UDP checksums for the other: we advertise NETIF_F_HW_CSUM, and frames from the remote
+// are turned into CHECKSUM_PARTIAL, so they only get a checksum if they leave the box.
+static bool csum_offload = true;
+module_param(csum_offload, bool, 0444);
+MODULE_PARM_DESC(csum_offload, "Leave out TCP/UDP checksums on the link when the remote agrees");
+
+// With checksum-free mode on and RPMSG_ETH_F_TSO from the remote, TCP super-frames go over the
+// link whole, fragmented like any other frame, instead of being segmented to the MTU here.
+static bool tso = true;
+module_param(tso, bool, 0444);
+MODULE_PARM_DESC(tso, "Send TCP super-frames unsegmented when the remote accepts them");
+
+// With checksum-free mode on, we advertise RPMSG_ETH_F_TSO ourselves. A TCP super-frame from the
+// remote is reassembled into one skb, the headers in its linear part and the payload in page
+// frags, and goes up as a GSO skb instead of MTU-sized frames for GRO to merge again.
+static bool rx_gso = true;
+module_param(rx_gso, bool, 0444);
+MODULE_PARM_DESC(rx_gso, "Take TCP super-frames from the remote and pass them up as GSO skbs");
+
+// Every tstamp_rate-th frame sent is preceded by the times it was handed to rpmsg_eth_xmit() and
+// to RPMsg, if the remote understands them, and the frames the remote stamps the same way are
+// broken down into stages for ethtool -S. Both sides read the ARM generic timer's counter, so the
+// stamps compare across cores. Stamps from the remote are accepted regardless, for hardware RX
+// timestamps.
+static unsigned int tstamp_rate;
+module_param(tstamp_rate, uint, 0444);
+MODULE_PARM_DESC(tstamp_rate, "Timestamp one frame in this many across both cores for ethtool -S latency histograms (0 = off)");
+
+
+struct rpmsg_eth_private;
+
+// Our view of the mapped shared-memory region
+struct rpmsg_eth_shm {
+    void *base;
+    struct rpmsg_eth_shm_ring *tx;  // ring 0, we produce
+    struct rpmsg_eth_shm_ring *rx;  // ring 1, we consume
+    u8 *tx_data;
+    u8 *rx_data;
+    u32 ring_size;
+    u32 tx_head;                    // our copy of tx->head
+    u32 rx_tail;                    // our copy of rx->tail
+};
+
+// Buckets of the xmit to vring latency histogram: < 10us, < 100us, < 1ms, < 10ms, >= 10ms
+#define RPMSG_ETH_LAT_BUCKETS 5
+
+// Stages of a frame the remote stamped: its driver got the frame -> handed it to RPMsg -> the
+// first message arrived here -> the stack took it. Bucket 0 counts stages under 1us, bucket n those
+// from 2^(n-1) up to 2^n us, the last one everything longer.
+#define RPMSG_ETH_TS_STAGES  3
+#define RPMSG_ETH_TS_BUCKETS 16
+
+#define RPMSG_ETH_TS_NONE    0
+#define RPMSG_ETH_TS_PENDING 1  // stamps received, the frame has not started yet
+#define RPMSG_ETH_TS_FRAME   2  // the frame started, ts_cb is valid
+
+/** Per queue counters reported by ethtool -S, see rpmsg_eth_gstrings */
+struct rpmsg_eth_queue_stats {
+    u64 send_fail;      /** RPMsg sends that failed, whether retried or not */
+    u64 retries;        /** delayed retries scheduled after a failed send */
+    u64 retry_drops;    /** packets dropped because the retry or blocking send failed too */
+    u64 shutdown_drops; /** packets dropped by rpmsg_eth_xmit() during shutdown */
+    u64 ring_full;      /** times the subqueue was stopped on a full tx_ring */
+    u64 packed;         /** messages that carried more than one frame */
+    u64 lat_hist[RPMSG_ETH_LAT_BUCKETS];
+};
+
+/** Per TX queue state. Every queue owns one RPMsg endpoint and transmits independently. */
+struct rpmsg_eth_queue {
+    struct rpmsg_eth_private *priv;
+
+    /** Index of this queue, also the net device TX subqueue */
+    unsigned int index;
+
+    /** Local endpoint of this queue. Queue 0 uses the channel's own endpoint. */
+    struct rpmsg_endpoint *ept;
+
+    /** Remote address this queue sends to */
+    u32 dst;
+
+    /**
+     * A work queue to process net device transmit events (Net->RPMsg) packets in a process context,
+     * rather than the ISR context provided by the net xmit callback.
+     */
+    struct work_struct immediate;
+
+    /**
+     * A work queue to provide for net device transmit retries in the event that the RPMsg ring
+     * buffer is full at the time we attempt to transmit.
+     */
+    struct delayed_work delayed;
+
+    /**
+     * Ring of skbs handed over by the net device and waiting to be transmitted to RPMsg. Filled by
+     * rpmsg_eth_xmit() at tx_head and drained by net_xmit_work_handler() from tx_tail. Sent skbs
+     * stay between tx_clean and tx_tail until the remote is done with them. No lock: tx_head is
+     * only written by rpmsg_eth_xmit(), which the stack serializes per queue, tx_tail and tx_clean
+     * only by the drain side. tx_head and tx_clean are published with a release store once the
+     * slots they hand over are filled or emptied, and read with an acquire load on the other side.
+     */
+    struct sk_buff **tx_ring;
+
+    /** Number of slots in tx_ring. Always a power of two. */
+    unsigned int tx_ring_size;
+
+    /** Index of the next free slot in tx_ring */
+    unsigned int tx_head;
+
+    /** Index of the oldest skb in tx_ring not sent yet, i.e. the one being transmitted */
+    unsigned int tx_tail;
+
+    /** Index of the oldest skb in tx_ring, which may already be sent but not yet consumed */
+    unsigned int tx_clean;
+
+    /** Number of bytes of the skb at tx_tail already sent as fragments */
+    unsigned int tx_offset;
+
+    /** Bounce buffer of buf_size bytes holding the link header plus one fragment */
+    u8 *tx_buf;
+
+    /** The frame being reassembled from fragments received on this endpoint, NULL if none */
+    struct sk_buff *rx_skb;
+
+    /** Total length announced for rx_skb by its first fragment */
+    unsigned int rx_frame_len;
+
+    /** RPMSG_ETH_TS_*, for the next frame completed on this endpoint */
+    unsigned int ts_state;
+
+    /** Remote stamps of that frame, and when its first message arrived */
+    u64 ts_xmit;
+    u64 ts_send;
+    u64 ts_cb;
+
+    /** Frames sent since the last stamped one */
+    unsigned int ts_count;
+
+    /** The TX kthread, when tx_thread is set. Used instead of immediate/delayed. */
+    struct task_struct *tx_task;
+
+    /** Wakes tx_task when rpmsg_eth_xmit() queues a packet */
+    wait_queue_head_t tx_wq;
+
+    /** When each skb in tx_ring was handed to rpmsg_eth_xmit(), for the latency histogram */
+    ktime_t *tx_stamp;
+
+    /**
+     * For each sent skb, the ring 0 head right after its frame. The remote has consumed the
+     * frame, or for one sent through RPMsg everything before it, once its tail gets there.
+     */
+    u32 *tx_mark;
+
+    /** Set by a doorbell, so tx_task looks for skbs the remote has consumed */
+    bool tx_reclaim;
+
+    /** Counters for ethtool -S */
+    struct rpmsg_eth_queue_stats xstats;
+
+    /** Kicks the transmitter once tx_coalesce_usecs have passed since the first held back packet */
+    struct hrtimer tx_timer;
+
+    /** A boolean indicating that we are retrying a failed skb transmission */
+    bool is_delayed;
+
+    /**
+     * In the top traffic class of an mqprio setup: drained from system_highpri_wq, or by a tx_task
+     * of a higher priority, and the other queues hold back while it has packets waiting
+     */
+    bool urgent;
+
+    /**
+     * Buffer pool of the AF_XDP socket bound to this queue, NULL if none. The drain side sends
+     * what its TX ring holds; on queue 0 its fill ring also takes the frames rpmsg_eth_poll()
+     * redirects to the socket.
+     */
+    struct xsk_buff_pool __rcu *xsk_pool;
+
+    /** The descriptor taken from xsk_pool's TX ring and not sent yet, valid while xsk_busy */
+    struct xdp_desc xsk_desc;
+    bool xsk_busy;
+
+    /** Attempts in a row that found the vring full, see RPMSG_ETH_XSK_RETRIES */
+    unsigned int xsk_retries;
+
+    /** Set by ndo_xsk_wakeup(), so tx_task looks at xsk_pool's TX ring */
+    bool xsk_wake;
+
+    /**
+     * Orders is_shutdown against the retry and the doorbell, which schedule the drain work from
+     * outside the transmitter. The packet path does not take it.
+     */
+    spinlock_t shutdown_lock;
+};
+
+struct rpmsg_eth_private {
+    struct rpmsg_device *rpdev;
+    struct net_device *netdev;
+
+    /**
+     * Drop and error counters only. Packets and bytes, which change on every frame, are counted
+     * per CPU in netdev->tstats.
+     */
+    struct net_device_stats stats;
+
+    /**
+     * A flag indicating whether the interface is shutdown, or not. Set under each queue's
+     * shutdown_lock in turn, for the retry and the doorbell, and before netif_tx_disable(), which
+     * takes every TX queue lock, so rpmsg_eth_xmit() sees it from its next call on.
+     */
+    bool is_shutdown;
+
+    /** NAPI context used to deliver received packets when use_napi is set */
+    struct napi_struct napi;
+
+    /**
+     * Packets copied out of RPMsg buffers by rpmsg_eth_rx_cb() and waiting for rpmsg_eth_poll().
+     * Bounded by rx_ring_size.
+     */
+    struct sk_buff_head rx_queue;
+
+    /** Pre-allocated skbs of rx_buf_len bytes for rpmsg_eth_rx_record(), refilled by rpmsg_eth_poll() */
+    struct sk_buff_head rx_pool;
+    unsigned int rx_buf_len;
+
+    /** Number of entries used in queues */
+    unsigned int num_queues;
+
+    /** rx_cpu and tx_cpu once checked against the online CPUs, -1 for none */
+    int rx_cpu;
+    int tx_cpu;
+
+    /**
+     * TX coalescing from ethtool -C: the transmitter is kicked once tx_coalesce_frames packets are
+     * queued, or tx_coalesce_usecs after the first one. Off while tx_coalesce_usecs is 0.
+     */
+    u32 tx_coalesce_usecs;
+    u32 tx_coalesce_frames;
+
+    /** RX coalescing from ethtool -C, carried out by the remote, see RPMSG_ETH_COALESCE_MAGIC */
+    u32 rx_coalesce_usecs;
+    u32 rx_coalesce_frames;
+
+    /** rx_ring_size, then ethtool -G rx */
+    unsigned int rx_ring_size;
+
+    /** TX queues in use, from ethtool -L tx; the remote's hello may allow fewer */
+    unsigned int tx_queues;
+
+    /** Bit N set when queues[N] is urgent, see rpmsg_eth_setup_tc() */
+    u32 urgent_queues;
+
+    /** RX counters for ethtool -S */
+    u64 rx_alloc_fail;
+    u64 rx_backlog_drops;
+    u64 rx_pool_empty;
+    u64 xdp_drop;
+    u64 xdp_tx;
+    u64 xdp_redirect;
+    u64 xsk_fill_empty;
+    u64 rx_gso_frames;
+
+    /** Latency of the frames the remote stamped, see tstamp_rate */
+    u64 ts_samples;
+    u64 ts_hist[RPMSG_ETH_TS_STAGES][RPMSG_ETH_TS_BUCKETS];
+
+    /** SIOCSHWTSTAMP configuration; hwts_tx and hwts_rx are what the data path looks at */
+    struct hwtstamp_config hwts_config;
+    bool hwts_tx;
+    bool hwts_rx;
+
+    /** The last stamped frame until the stack takes it, and when its first message arrived */
+    struct sk_buff *ts_skb;
+    u64 ts_cb;
+    spinlock_t ts_lock;
+
+    /** XDP program run by rpmsg_eth_poll() on every frame before GRO, NULL if none */
+    struct bpf_prog __rcu *xdp_prog;
+    struct xdp_rxq_info xdp_rxq;
+
+    /** Extra headroom reserved in new RX skbs, so XDP programs can push headers */
+    unsigned int rx_headroom;
+
+    /** rxq of the frames rpmsg_eth_poll() copies into the UMEM of an AF_XDP socket on queue 0 */
+    struct xdp_rxq_info xsk_rxq;
+
+    /** RPMSG_ETH_F_* advertised by the remote's hello, 0 until it arrives */
+    u32 remote_features;
+
+    /** Both sides agreed on RPMSG_ETH_F_CSUM */
+    bool csum_free;
+
+    /**
+     * Multicast addresses from the remote's last filter message, see RPMSG_ETH_MCAST_MAGIC.
+     * mcast_all is set until one arrives. tx_mcast_filtered counts the frames dropped for it.
+     */
+    spinlock_t mcast_lock;
+    bool mcast_all;
+    unsigned int mcast_count;
+    u8 mcast_addr[RPMSG_ETH_MCAST_MAX][ETH_ALEN];
+    u64 tx_mcast_filtered;
+
+    /** The remote's counters from its last RPMSG_ETH_STATS_MAGIC answer */
+    u32 remote_stats[RPMSG_ETH_REMOTE_NSTATS];
+
+    /** Payload size of our RPMsg buffers, i.e. the largest message we can send or receive */
+    unsigned int buf_size;
+
+    /** Largest message we send, link header included. Lowered by the remote's hello. */
+    unsigned int tx_msg_size;
+
+    /** The shared-memory rings once attached, NULL while frames go through RPMsg buffers */
+    struct rpmsg_eth_shm *shm;
+
+    /** The remote's offer of a shared-memory region, mapped by shm_work */
+    struct rpmsg_eth_shm_offer shm_offer;
+    struct work_struct shm_work;
+
+    /**
+     * Set when the remote is lost with the rings attached. Its answer to our hello resets both
+     * control blocks, so ring 0 is left alone until shm_work has taken its next offer.
+     */
+    bool shm_resync;
+
+    /** MTU, number of queues and TSO limit from the remote's hello, applied by hello_work under RTNL */
+    unsigned int remote_mtu;
+    unsigned int remote_queues;
+    unsigned int remote_tso_max;
+    struct work_struct hello_work;
+
+    /** Sends our hello until the remote answers, backing off up to RPMSG_ETH_HELLO_RETRY_MAX */
+    struct delayed_work hello_retry;
+    unsigned long hello_delay;
+    bool hello_done;
+
+    /**
+     * Set by rpmsg_eth_peer_lost() once the remote stops taking frames: the carrier is off, queued
+     * frames are dropped and hello_retry probes until the remote answers, which clears it
+     */
+    atomic_t peer_lost;
+
+    struct rpmsg_eth_queue queues[RPMSG_ETH_MAX_QUEUES];
+};
+
+static void net_xmit_delayed_work_handler(struct work_struct *work);
+static void net_xmit_work_handler(struct work_struct *work);
+static netdev_tx_t rpmsg_eth_xmit(struct sk_buff *skb, struct net_device *ndev);
+static void rpmsg_eth_peer_lost(struct rpmsg_eth_private *priv);
+
+
+static inline bool rpmsg_eth_xmit_more(struct sk_buff *skb)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 2, 0)
+    return netdev_xmit_more();
+#else
+    return skb->xmit_more;
+#endif
+}
+
+#ifdef CONFIG_ARM_ARCH_TIMER
+static inline u64 rpmsg_eth_ts_now(void)
+{
+    return arch_timer_read_counter();
+}
+
+static inline u32 rpmsg_eth_ts_hz(void)
+{
+    return arch_timer_get_rate();
+}
+#else
+// no counter shared with the remote; only the host side stages mean anything
+static inline u64 rpmsg_eth_ts_now(void)
+{
+    return ktime_get_ns();
+}
+
+static inline u32 rpmsg_eth_ts_hz(void)
+{
+    return NSEC_PER_SEC;
+}
+#endif
+
+// The counter is our "hardware" clock; there is no PHC, stamps are the counter in nanoseconds
+static inline ktime_t rpmsg_eth_ts_ktime(u64 cnt)
+{
+    return ns_to_ktime(mul_u64_u32_div(cnt, NSEC_PER_SEC, rpmsg_eth_ts_hz()));
+}
+
+// Count the time from one stamp to another into its log2 microsecond bucket. A stamp from the
+// future lands in the last bucket, rather than skewing the first. Called with ts_lock held.
+static void rpmsg_eth_ts_hist(u64 *hist, u64 from, u64 to)
+{
+    u64 us = mul_u64_u32_div(to - from, USEC_PER_SEC, rpmsg_eth_ts_hz());
+
+    hist[us ? min_t(unsigned int, fls64(us), RPMSG_ETH_TS_BUCKETS - 1) : 0]++;
+}
+
+// Precede the frame at tx_tail with its stamps, if it is a sampled one
+static void rpmsg_eth_ts_tx(struct rpmsg_eth_queue *q)
+{
+    struct rpmsg_eth_tstamp ts = {
+        .magic = cpu_to_be32(RPMSG_ETH_TSTAMP_MAGIC),
+        .hz = cpu_to_be32(rpmsg_eth_ts_hz()),
+    };
+    u64 now, xmit;
+
+    if (++q->ts_count < tstamp_rate) {
+        return;
+    }
+    q->ts_count = 0;
+
+    // tx_stamp is ktime, move it over to the counter
+    now = rpmsg_eth_ts_now();
+    xmit = now - mul_u64_u32_div(ktime_to_ns(ktime_sub(ktime_get(), q->tx_stamp[q->tx_tail])),
+                                 rpmsg_eth_ts_hz(), NSEC_PER_SEC);
+    ts.xmit_hi = cpu_to_be32(upper_32_bits(xmit));
+    ts.xmit_lo = cpu_to_be32(lower_32_bits(xmit));
+    ts.send_hi = cpu_to_be32(upper_32_bits(now));
+    ts.send_lo = cpu_to_be32(lower_32_bits(now));
+
+    // without the stamps the frame is just not sampled
+    rpmsg_trysendto(q->ept, &ts, sizeof(ts), q->dst);
+}
+
+// The frame the remote stamped is complete; account the stages up to here
+static void rpmsg_eth_ts_rx(struct rpmsg_eth_queue *q, struct sk_buff *skb)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+    unsigned long flags;
+
+    spin_lock_irqsave(&priv->ts_lock, flags);
+    priv->ts_samples++;
+    rpmsg_eth_ts_hist(priv->ts_hist[0], q->ts_xmit, q->ts_send);
+    rpmsg_eth_ts_hist(priv->ts_hist[1], q->ts_send, q->ts_cb);
+    // one frame at a time; one that is dropped on the way leaves the slot to the next
+    priv->ts_skb = skb;
+    priv->ts_cb = q->ts_cb;
+    spin_unlock_irqrestore(&priv->ts_lock, flags);
+}
+
+// skb goes up the stack; account the last stage if it is the stamped frame
+static void rpmsg_eth_ts_deliver(struct rpmsg_eth_private *priv, struct sk_buff *skb)
+{
+    unsigned long flags;
+
+    if (likely(READ_ONCE(priv->ts_skb) != skb)) {
+        return;
+    }
+
+    spin_lock_irqsave(&priv->ts_lock, flags);
+    if (priv->ts_skb == skb) {
+        priv->ts_skb = NULL;
+        rpmsg_eth_ts_hist(priv->ts_hist[2], priv->ts_cb, rpmsg_eth_ts_now());
+    }
+    spin_unlock_irqrestore(&priv->ts_lock, flags);
+}
+
+// Schedule the drain work; an urgent queue's runs ahead of the normal workers
+static void rpmsg_eth_tx_schedule(struct rpmsg_eth_queue *q)
+{
+    queue_work_on(q->priv->tx_cpu >= 0 ? q->priv->tx_cpu : WORK_CPU_UNBOUND,
+                  READ_ONCE(q->urgent) ? system_highpri_wq : system_wq, &q->immediate);
+}
+
+// Kick the drain worker, unless a retry is already pending; the delayed work will kick it
+static void rpmsg_eth_tx_kick(struct rpmsg_eth_queue *q)
+{
+    if (tx_thread) {
+        wake_up(&q->tx_wq);
+    } else if (!READ_ONCE(q->is_delayed)) {
+        rpmsg_eth_tx_schedule(q);
+    }
+}
+
+static enum hrtimer_restart rpmsg_eth_tx_timer(struct hrtimer *timer)
+{
+    struct rpmsg_eth_queue *q = container_of(timer, struct rpmsg_eth_queue, tx_timer);
+
+    // rpmsg_eth_remove() cancels the timer before the work it kicks
+    if (!READ_ONCE(q->priv->is_shutdown)) {
+        // it also brings tx_task back to an AF_XDP frame that met a full vring
+        WRITE_ONCE(q->xsk_wake, true);
+        rpmsg_eth_tx_kick(q);
+    }
+
+    return HRTIMER_NORESTART;
+}
+
+// The multicast MAC address a frame goes to, false for unicasts and broadcasts. With raw_ip it is
+// derived from the IP destination, the way the remote maps its groups.
+static bool rpmsg_eth_mcast_dest(const struct sk_buff *skb, u8 *addr)
+{
+    if (raw_ip) {
+        if (skb->protocol == htons(ETH_P_IP) && skb_headlen(skb) >= sizeof(struct iphdr) &&
+            ipv4_is_multicast(((const struct iphdr *)skb->data)->daddr)) {
+            ip_eth_mc_map(((const struct iphdr *)skb->data)->daddr, (char *)addr);
+            return true;
+        }
+        if (skb->protocol == htons(ETH_P_IPV6) && skb_headlen(skb) >= sizeof(struct ipv6hdr) &&
+            ipv6_addr_is_multicast(&((const struct ipv6hdr *)skb->data)->daddr)) {
+            ipv6_eth_mc_map(&((const struct ipv6hdr *)skb->data)->daddr, (char *)addr);
+            return true;
+        }
+        return false;
+    }
+    if (skb_headlen(skb) < ETH_HLEN || !is_multicast_ether_addr(skb->data) ||
+        is_broadcast_ether_addr(skb->data)) {
+        return false;
+    }
+    ether_addr_copy(addr, skb->data);
+    return true;
+}
+
+// Whether the remote asked for the frame: anything but a multicast it has not joined
+static bool rpmsg_eth_mcast_wanted(struct rpmsg_eth_private *priv, const struct sk_buff *skb)
+{
+    u8 addr[ETH_ALEN];
+    unsigned long flags;
+    unsigned int i;
+    bool wanted;
+
+    if (READ_ONCE(priv->mcast_all) || !rpmsg_eth_mcast_dest(skb, addr)) {
+        return true;
+    }
+
+    spin_lock_irqsave(&priv->mcast_lock, flags);
+    wanted = priv->mcast_all;
+    for (i = 0; !wanted && i < priv->mcast_count; i++) {
+        wanted = ether_addr_equal(addr, priv->mcast_addr[i]);
+    }
+    if (!wanted) {
+        priv->tx_mcast_filtered++;
+    }
+    spin_unlock_irqrestore(&priv->mcast_lock, flags);
+    return wanted;
+}
+
+static netdev_tx_t rpmsg_eth_xmit(struct sk_buff *skb,
+                            struct net_device *dev)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(dev);
+    struct rpmsg_eth_queue *q = &priv->queues[skb_get_queue_mapping(skb)];
+    struct netdev_queue *txq = netdev_get_tx_queue(dev, q->index);
+    unsigned int len = skb->len;
+    unsigned int head = q->tx_head;
+    u32 prio = skb->priority;
+    u32 usecs, frames;
+    bool kick;
+
+    // the hardware stamp is taken once the frame is handed to RPMsg, see rpmsg_eth_tx_complete()
+    if (unlikely(skb_shinfo(skb)->tx_flags & SKBTX_HW_TSTAMP) && READ_ONCE(priv->hwts_tx)) {
+        skb_shinfo(skb)->tx_flags |= SKBTX_IN_PROGRESS;
+    }
+    // before the skb is in tx_ring, where the drain side may free it any time
+    skb_tx_timestamp(skb);
+
+    // not worth a vring slot and an interrupt on the remote, which would only drop it
+    if (!rpmsg_eth_mcast_wanted(priv, skb)) {
+        trace_rpmsg_eth_drop(q->index, 1, len, CIRC_CNT(q->tx_head, q->tx_tail, q->tx_ring_size),
+                             RPMSG_ETH_DROP_MCAST);
+        dev_consume_skb_any(skb);
+        return NETDEV_TX_OK;
+    }
+
+    // No lock: the stack holds this queue's TX lock, and rpmsg_eth_remove() sets is_shutdown before
+    // it takes that lock in netif_tx_disable().
+    if (READ_ONCE(priv->is_shutdown)) {
+        // we're shut down. drop packet. leave queue stopped.
+        q->xstats.shutdown_drops++;
+        trace_rpmsg_eth_drop(q->index, 1, len, CIRC_CNT(head, q->tx_tail, q->tx_ring_size),
+                             RPMSG_ETH_DROP_SHUTDOWN);
+        netif_stop_subqueue(dev, q->index);
+
+        dev_consume_skb_any(skb);
+        dev_info_ratelimited(&priv->rpdev->dev, "net_xmit: dropping packet due to shutdown request (race)\n");
+        return NETDEV_TX_OK;
+    }
+
+    // until the carrier is down and the qdisc deactivated; nothing queues up for a remote that is gone
+    if (unlikely(atomic_read(&priv->peer_lost))) {
+        trace_rpmsg_eth_drop(q->index, 1, len, CIRC_CNT(head, q->tx_tail, q->tx_ring_size),
+                             RPMSG_ETH_DROP_PEER_LOST);
+        priv->stats.tx_dropped++;
+        dev_kfree_skb_any(skb);
+        return NETDEV_TX_OK;
+    }
+
+    if (unlikely(len > U16_MAX)) {
+        // does not fit frame_len of the link header; the TSO limit normally prevents this
+        trace_rpmsg_eth_drop(q->index, 1, len, CIRC_CNT(head, q->tx_tail, q->tx_ring_size),
+                             RPMSG_ETH_DROP_TOO_LONG);
+
+        priv->stats.tx_dropped++;
+        dev_kfree_skb_any(skb);
+        return NETDEV_TX_OK;
+    }
+
+    if (CIRC_SPACE(head, smp_load_acquire(&q->tx_clean), q->tx_ring_size) == 0) {
+        // can't normally happen, the queue is stopped as soon as the last slot is taken
+        netif_stop_subqueue(dev, q->index);
+        return NETDEV_TX_BUSY;
+    }
+
+    q->tx_ring[head] = skb;
+    q->tx_stamp[head] = ktime_get();
+    head = (head + 1) & (q->tx_ring_size - 1);
+    // the slot is filled before the drain side can see it
+    smp_store_release(&q->tx_head, head);
+    trace_rpmsg_eth_xmit(q->index, len, CIRC_CNT(head, q->tx_tail, q->tx_ring_size));
+
+    // stop the net device transmitter only when the ring is full. will be re-enabled by the work
+    // queue once it has released a slot. It may have just done so without seeing the queue
+    // stopped, so look again after stopping; rpmsg_eth_tx_clean() pairs with the barrier.
+    if (CIRC_SPACE(head, q->tx_clean, q->tx_ring_size) == 0) {
+        netif_stop_subqueue(dev, q->index);
+        q->xstats.ring_full++;
+        smp_mb();
+        if (CIRC_SPACE(head, READ_ONCE(q->tx_clean), q->tx_ring_size) != 0) {
+            netif_start_subqueue(dev, q->index);
+        }
+    }
+
+    // While the stack tells us more packets follow, just queue them and kick the drain worker
+    // once for the whole burst. A stopped queue ends the burst early since nothing more will come.
+    // At the end of a burst BQL may stop the queue itself, so that packets wait in the qdisc, where
+    // fq_codel can schedule them, instead of in tx_ring.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
+    kick = __netdev_tx_sent_queue(txq, len, rpmsg_eth_xmit_more(skb));
+#else
+    netdev_tx_sent_queue(txq, len);
+    kick = !rpmsg_eth_xmit_more(skb) || netif_xmit_stopped(txq);
+#endif
+    if (!kick) {
+        goto out;
+    }
+
+    // coalescing: hold the kick back until enough packets are queued or the timer fires, so they
+    // go out packed and the peer is notified less often. Interactive and control traffic is never
+    // held back.
+    usecs = READ_ONCE(priv->tx_coalesce_usecs);
+    frames = READ_ONCE(priv->tx_coalesce_frames);
+    if (usecs && (!frames || CIRC_CNT(head, READ_ONCE(q->tx_tail), q->tx_ring_size) < frames) &&
+        prio < TC_PRIO_INTERACTIVE && !netif_xmit_stopped(txq)) {
+        if (!hrtimer_is_queued(&q->tx_timer)) {
+            hrtimer_start(&q->tx_timer, ns_to_ktime((u64)usecs * NSEC_PER_USEC), HRTIMER_MODE_REL);
+        }
+        goto out;
+    }
+
+    rpmsg_eth_tx_kick(q);
+
+out:
+    // tx_packets and tx_bytes are counted by rpmsg_eth_tx_complete() once the packet is sent
+    return NETDEV_TX_OK;
+}
+
+static void net_xmit_delayed_work_handler(struct work_struct *work)
+{
+    struct rpmsg_eth_queue *q = container_of(work, struct rpmsg_eth_queue, delayed.work);
+    struct rpmsg_eth_private *priv = q->priv;
+    unsigned long flags;
+
+    spin_lock_irqsave(&q->shutdown_lock, flags);
+    if (q->is_delayed && !priv->is_shutdown) {
+        rpmsg_eth_tx_schedule(q);
+        spin_unlock_irqrestore(&q->shutdown_lock, flags);
+    } else {
+        spin_unlock_irqrestore(&q->shutdown_lock, flags);
+
+        dev_info(&priv->rpdev->dev, "delayed work handler skipping kick of immediate due to shutdown request\n");
+    }
+}
+
+static int rpmsg_eth_send_buf(struct rpmsg_eth_queue *q, unsigned int len, bool wait)
+{
+    int err;
+
+    if (wait) {
+        err = rpmsg_sendto(q->ept, q->tx_buf, len, q->dst);
+    } else {
+        err = rpmsg_trysendto(q->ept, q->tx_buf, len, q->dst);
+    }
+    trace_rpmsg_eth_send(q->index, len, CIRC_CNT(READ_ONCE(q->tx_head), q->tx_tail, q->tx_ring_size), err);
+    if (err) {
+        q->xstats.send_fail++;
+    }
+    return err;
+}
+
+static int rpmsg_eth_send_frags(struct rpmsg_eth_queue *q, struct sk_buff *skb, bool wait)
+{
+    struct rpmsg_eth_frag_hdr *hdr = (struct rpmsg_eth_frag_hdr *)q->tx_buf;
+    unsigned int frag_len;
+    int err;
+
+    // resume at tx_offset, the fragments before it went out on an earlier attempt
+    hdr->frame_len = cpu_to_be16(skb->len);
+    while (q->tx_offset < skb->len) {
+        frag_len = min_t(unsigned int, skb->len - q->tx_offset, READ_ONCE(q->priv->tx_msg_size) - sizeof(*hdr));
+        hdr->offset = cpu_to_be16(q->tx_offset);
+        // gathers from the linear part, the page frags and the frag_list alike
+        skb_copy_bits(skb, q->tx_offset, hdr + 1, frag_len);
+
+        err = rpmsg_eth_send_buf(q, sizeof(*hdr) + frag_len, wait);
+        if (err) {
+            return err;
+        }
+
+        // progress was made, so a later failure counts as a first attempt again
+        q->tx_offset += frag_len;
+        WRITE_ONCE(q->is_delayed, false);
+    }
+
+    return 0;
+}
+
+// Copy as many whole frames as fit, starting at tx_tail, into tx_buf. The caller made sure the
+// first one fits. Returns the number of frames packed.
+static unsigned int rpmsg_eth_tx_pack(struct rpmsg_eth_queue *q, unsigned int avail, unsigned int *msg_len)
+{
+    struct rpmsg_eth_frag_hdr *hdr;
+    struct sk_buff *skb;
+    unsigned int idx = q->tx_tail;
+    unsigned int used = 0, count = 0;
+    unsigned int size = READ_ONCE(q->priv->tx_msg_size);
+
+    // slots between tx_tail and the tx_head snapshot are not touched by rpmsg_eth_xmit()
+    while (count < avail) {
+        skb = q->tx_ring[idx];
+        if (used + sizeof(*hdr) + skb->len > size) {
+            break;
+        }
+
+        hdr = (struct rpmsg_eth_frag_hdr *)(q->tx_buf + used);
+        hdr->frame_len = cpu_to_be16(skb->len);
+        hdr->offset = 0;
+        skb_copy_bits(skb, 0, hdr + 1, skb->len);
+
+        used += sizeof(*hdr) + skb->len;
+        idx = (idx + 1) & (q->tx_ring_size - 1);
+        count++;
+    }
+
+    *msg_len = used;
+    return count;
+}
+
+// Ring the remote's doorbell on queue 0. Returns false when the vring is full.
+static bool rpmsg_eth_shm_doorbell(struct rpmsg_eth_private *priv)
+{
+    struct rpmsg_eth_queue *q = &priv->queues[0];
+    struct rpmsg_eth_doorbell db = {
+        .magic = cpu_to_be32(RPMSG_ETH_DOORBELL_MAGIC),
+    };
+
+    if (rpmsg_trysendto(q->ept, &db, sizeof(db), q->dst)) {
+        q->xstats.send_fail++;
+        return false;
+    }
+    return true;
+}
+
+static inline u32 rpmsg_eth_shm_slot_size(unsigned int len)
+{
+    return ALIGN(sizeof(struct rpmsg_eth_shm_slot) + len, RPMSG_ETH_SHM_ALIGN);
+}
+
+// Bytes a frame of len bytes takes at head, including the wrap slot if it does not fit before the
+// end of the data area
+static inline u32 rpmsg_eth_shm_need(struct rpmsg_eth_shm *shm, u32 head, unsigned int len)
+{
+    u32 size = rpmsg_eth_shm_slot_size(len);
+    u32 contig = shm->ring_size - (head & (shm->ring_size - 1));
+
+    return size <= contig ? size : contig + size;
+}
+
+// Frames taking more than half the data area always go through RPMsg buffers, so that a frame
+// which is let into the ring is sure to fit once the remote has drained it
+static inline bool rpmsg_eth_shm_fits(struct rpmsg_eth_shm *shm, unsigned int len)
+{
+    return rpmsg_eth_shm_slot_size(len) <= shm->ring_size / 2;
+}
+
+// Ring 0 for the drain side, NULL while it is not attached or waits for rpmsg_eth_shm_resync()
+static inline struct rpmsg_eth_shm *rpmsg_eth_shm_tx_ring(struct rpmsg_eth_private *priv)
+{
+    return READ_ONCE(priv->shm_resync) ? NULL : READ_ONCE(priv->shm);
+}
+
+// Copy as many frames as fit, starting at tx_tail, into ring 0 and publish them. Returns the
+// number of frames copied.
+static unsigned int rpmsg_eth_shm_tx_fill(struct rpmsg_eth_queue *q, struct rpmsg_eth_shm *shm, unsigned int avail)
+{
+    struct rpmsg_eth_shm_slot *slot;
+    struct sk_buff *skb;
+    unsigned int idx = q->tx_tail;
+    unsigned int count = 0;
+    u32 tail = le32_to_cpu(READ_ONCE(shm->tx->tail));
+    u32 head = shm->tx_head;
+    u32 off, need;
+
+    while (count < avail) {
+        skb = q->tx_ring[idx];
+        if (!rpmsg_eth_shm_fits(shm, skb->len)) {
+            break;
+        }
+        need = rpmsg_eth_shm_need(shm, head, skb->len);
+        if (need > shm->ring_size - (head - tail)) {
+            break;
+        }
+
+        off = head & (shm->ring_size - 1);
+        if (need != rpmsg_eth_shm_slot_size(skb->len)) {
+            slot = (struct rpmsg_eth_shm_slot *)(shm->tx_data + off);
+            slot->len = 0;
+            slot->flags = cpu_to_le16(RPMSG_ETH_SHM_WRAP);
+            head += shm->ring_size - off;
+            off = 0;
+        }
+
+        slot = (struct rpmsg_eth_shm_slot *)(shm->tx_data + off);
+        slot->len = cpu_to_le16(skb->len);
+        slot->flags = 0;
+        skb_copy_bits(skb, 0, slot + 1, skb->len);
+        head += rpmsg_eth_shm_slot_size(skb->len);
+
+        idx = (idx + 1) & (q->tx_ring_size - 1);
+        count++;
+    }
+
+    if (count > 0) {
+        // the slots must be visible before the head that covers them
+        wmb();
+        WRITE_ONCE(shm->tx->head, cpu_to_le32(head));
+        shm->tx_head = head;
+    }
+    return count;
+}
+
+// Send the frames at tx_tail through ring 0. The first one is known to fit the ring.
+static int rpmsg_eth_shm_tx(struct rpmsg_eth_queue *q, struct rpmsg_eth_shm *shm, unsigned int avail,
+                            bool wait, unsigned int *count)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+
+    *count = rpmsg_eth_shm_tx_fill(q, shm, avail);
+    if (*count == 0) {
+        // full: ask for a doorbell once the remote has made room, then look again in case it
+        // already did in the meantime
+        WRITE_ONCE(shm->tx->prod_wait, cpu_to_le32(1));
+        mb();
+        *count = rpmsg_eth_shm_tx_fill(q, shm, avail);
+        if (*count == 0 && wait) {
+            wait_event_interruptible_timeout(q->tx_wq, kthread_should_stop() || !READ_ONCE(shm->tx->prod_wait),
+                                             HZ / 10);
+            *count = rpmsg_eth_shm_tx_fill(q, shm, avail);
+        }
+        if (*count == 0) {
+            q->xstats.send_fail++;
+            return -ENOBUFS;
+        }
+    }
+
+    // the remote only needs a doorbell if it has drained the ring and went to sleep
+    mb();
+    if (READ_ONCE(shm->tx->cons_wait)) {
+        WRITE_ONCE(shm->tx->cons_wait, 0);
+        if (!rpmsg_eth_shm_doorbell(priv)) {
+            // try again with the next frame
+            WRITE_ONCE(shm->tx->cons_wait, cpu_to_le32(1));
+        }
+    }
+    return 0;
+}
+
+// Send the frame at tx_tail, packed together with the frames behind it when packing is on.
+// avail is the number of occupied slots; *count is set to how many of them this message covers.
+static int rpmsg_eth_tx_next(struct rpmsg_eth_queue *q, unsigned int avail, bool wait, unsigned int *count)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+    struct sk_buff *skb = q->tx_ring[q->tx_tail];
+    struct rpmsg_eth_shm *shm = rpmsg_eth_shm_tx_ring(priv);
+    unsigned int len;
+
+    if (shm && q->index == 0 && q->tx_offset == 0 && rpmsg_eth_shm_fits(shm, skb->len)) {
+        return rpmsg_eth_shm_tx(q, shm, avail, wait, count);
+    }
+
+    if (tstamp_rate && (READ_ONCE(priv->remote_features) & RPMSG_ETH_F_TSTAMP) && q->tx_offset == 0) {
+        rpmsg_eth_ts_tx(q);
+    }
+
+    if (tx_pack && (READ_ONCE(priv->remote_features) & RPMSG_ETH_F_PACK) && q->tx_offset == 0 &&
+        sizeof(struct rpmsg_eth_frag_hdr) + skb->len <= READ_ONCE(priv->tx_msg_size)) {
+        *count = rpmsg_eth_tx_pack(q, avail, &len);
+        if (*count > 1) {
+            q->xstats.packed++;
+        }
+        return rpmsg_eth_send_buf(q, len, wait);
+    }
+
+    *count = 1;
+    return rpmsg_eth_send_frags(q, skb, wait);
+}
+
+// Move tx_tail past its skb once it is sent or dropped; rpmsg_eth_tx_clean() frees it later.
+// Drain side only.
+static void rpmsg_eth_tx_complete(struct rpmsg_eth_queue *q, struct sk_buff *skb, bool sent)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+    struct rpmsg_eth_shm *shm = rpmsg_eth_shm_tx_ring(priv);
+    s64 us;
+
+    if (sent) {
+        dev_sw_netstats_tx_add(priv->netdev, 1, skb->len);
+
+        if (unlikely(skb_shinfo(skb)->tx_flags & SKBTX_IN_PROGRESS)) {
+            struct skb_shared_hwtstamps hwts = {
+                .hwtstamp = rpmsg_eth_ts_ktime(rpmsg_eth_ts_now()),
+            };
+
+            skb_tstamp_tx(skb, &hwts);
+        }
+
+        us = ktime_us_delta(ktime_get(), q->tx_stamp[q->tx_tail]);
+        if (us < 10) {
+            q->xstats.lat_hist[0]++;
+        } else if (us < 100) {
+            q->xstats.lat_hist[1]++;
+        } else if (us < 1000) {
+            q->xstats.lat_hist[2]++;
+        } else if (us < 10000) {
+            q->xstats.lat_hist[3]++;
+        } else {
+            q->xstats.lat_hist[4]++;
+        }
+    }
+
+    q->tx_mark[q->tx_tail] = shm ? shm->tx_head : 0;
+    WRITE_ONCE(q->tx_tail, (q->tx_tail + 1) & (q->tx_ring_size - 1));
+    q->tx_offset = 0;
+    WRITE_ONCE(q->is_delayed, false);
+}
+
+// Free the sent skbs the remote is done with, in one batch, and re-activate the network stack
+// xmit queue. Frames that went through RPMsg buffers were copied out already, but those in ring 0
+// hold their slot until the remote has consumed them, and their skb holds its tx_ring slot and BQL
+// bytes until then too. That keeps what is queued below the qdisc bounded by what the remote
+// actually takes. Called from the drain side only; returns the number of skbs left waiting.
+static unsigned int rpmsg_eth_tx_clean(struct rpmsg_eth_queue *q)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+    // a lost remote may never consume ring 0; its frames were copied there already anyway
+    struct rpmsg_eth_shm *shm = q->index == 0 ? rpmsg_eth_shm_tx_ring(priv) : NULL;
+    unsigned int clean = q->tx_clean;
+    unsigned int pkts = 0, bytes = 0;
+    struct sk_buff *skb;
+    u32 consumed = 0;
+
+again:
+    if (shm) {
+        consumed = le32_to_cpu(READ_ONCE(shm->tx->tail));
+    }
+
+    // tx_tail only moves on the drain side, i.e. under our feet
+    while (clean != q->tx_tail) {
+        if (shm && (s32)(consumed - q->tx_mark[clean]) < 0) {
+            break;
+        }
+
+        skb = q->tx_ring[clean];
+        q->tx_ring[clean] = NULL;
+        pkts++;
+        bytes += skb->len;
+        // return the skb to the network stack
+        dev_consume_skb_any(skb);
+        clean = (clean + 1) & (q->tx_ring_size - 1);
+    }
+
+    if (shm && clean != q->tx_tail && !READ_ONCE(shm->tx->prod_wait)) {
+        // have the remote ring the doorbell once it consumes more, in case it did meanwhile
+        WRITE_ONCE(shm->tx->prod_wait, cpu_to_le32(1));
+        mb();
+        if (le32_to_cpu(READ_ONCE(shm->tx->tail)) != consumed) {
+            goto again;
+        }
+    }
+
+    if (pkts) {
+        netdev_tx_completed_queue(netdev_get_tx_queue(priv->netdev, q->index), pkts, bytes);
+
+        // the slots are empty before rpmsg_eth_xmit() can reuse them. It stops the queue and then
+        // looks at tx_clean again, we publish tx_clean and then look at the queue: one of the two
+        // sees the other.
+        smp_store_release(&q->tx_clean, clean);
+        smp_mb();
+        if (__netif_subqueue_stopped(priv->netdev, q->index) && !READ_ONCE(priv->is_shutdown)) {
+            netif_wake_subqueue(priv->netdev, q->index);
+        }
+    }
+
+    return CIRC_CNT(q->tx_tail, clean, q->tx_ring_size);
+}
+
+// Number of queued skbs, or 0 once shutdown has started
+static unsigned int rpmsg_eth_tx_pending(struct rpmsg_eth_queue *q)
+{
+    if (READ_ONCE(q->priv->is_shutdown)) {
+        return 0;
+    }
+    return CIRC_CNT(smp_load_acquire(&q->tx_head), q->tx_tail, q->tx_ring_size);
+}
+
+// Whether an urgent queue other than q has packets waiting for the vring
+static bool rpmsg_eth_urgent_waiting(struct rpmsg_eth_queue *q)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+    unsigned long urgent = READ_ONCE(priv->urgent_queues) & ~BIT(q->index);
+    unsigned int i;
+
+    for_each_set_bit(i, &urgent, priv->num_queues) {
+        struct rpmsg_eth_queue *u = &priv->queues[i];
+
+        if (CIRC_CNT(READ_ONCE(u->tx_head), READ_ONCE(u->tx_tail), u->tx_ring_size) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drop everything q has queued while the remote is lost, freeing the skbs and their tx_ring slots.
+// Drain side only.
+static void rpmsg_eth_tx_flush(struct rpmsg_eth_queue *q)
+{
+    unsigned int avail = rpmsg_eth_tx_pending(q);
+
+    if (avail) {
+        trace_rpmsg_eth_drop(q->index, avail, 0, avail, RPMSG_ETH_DROP_PEER_LOST);
+        q->priv->stats.tx_dropped += avail;
+        while (avail--) {
+            rpmsg_eth_tx_complete(q, q->tx_ring[q->tx_tail], false);
+        }
+    }
+    rpmsg_eth_tx_clean(q);
+}
+
+// How long an AF_XDP frame that met a full vring waits before it is sent again, and how many times
+// in a row, about the 10 ms of an skb's retry, before the remote counts as lost
+#define RPMSG_ETH_XSK_RETRY_US 100
+#define RPMSG_ETH_XSK_RETRIES  100
+
+// Send what the AF_XDP socket bound to q has in its TX ring, copied from the UMEM straight into
+// RPMsg buffers, with no skb in between. Waits for a frame of tx_ring that is halfway out, as
+// fragments of two frames must not interleave on the endpoint. A frame that meets a full vring is
+// sent again from its start on the next kick; the remote drops the fragments it already has.
+// Drain side only.
+static void rpmsg_eth_xsk_tx(struct rpmsg_eth_queue *q)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+    struct rpmsg_eth_frag_hdr *hdr = (struct rpmsg_eth_frag_hdr *)q->tx_buf;
+    struct xsk_buff_pool *pool;
+    unsigned int done = 0, peeked = 0;
+    unsigned int len, off, frag_len;
+    const u8 *data;
+    int err = 0;
+
+    rcu_read_lock();
+    pool = rcu_dereference(q->xsk_pool);
+    if (pool == NULL || q->tx_offset != 0 || atomic_read(&priv->peer_lost)) {
+        goto out;
+    }
+
+    while (done < q->tx_ring_size && !READ_ONCE(priv->is_shutdown)) {
+        if (!q->xsk_busy) {
+            if (!xsk_tx_peek_desc(pool, &q->xsk_desc)) {
+                break;
+            }
+            q->xsk_busy = true;
+            peeked++;
+        }
+
+        len = q->xsk_desc.len;
+        data = xsk_buff_raw_get_data(pool, q->xsk_desc.addr);
+        if (len < ETH_HLEN || len > priv->netdev->mtu + ETH_HLEN) {
+            trace_rpmsg_eth_drop(q->index, 1, len, 0, RPMSG_ETH_DROP_TOO_LONG);
+            priv->stats.tx_dropped++;
+        } else {
+            hdr->frame_len = cpu_to_be16(len);
+            for (off = 0; off < len; off += frag_len) {
+                frag_len = min_t(unsigned int, len - off, READ_ONCE(priv->tx_msg_size) - sizeof(*hdr));
+                hdr->offset = cpu_to_be16(off);
+                memcpy(hdr + 1, data + off, frag_len);
+                err = rpmsg_eth_send_buf(q, sizeof(*hdr) + frag_len, false);
+                if (err) {
+                    break;
+                }
+            }
+            if (err) {
+                break;
+            }
+            dev_sw_netstats_tx_add(priv->netdev, 1, len);
+        }
+
+        q->xsk_busy = false;
+        done++;
+    }
+
+    // the data was copied out, so the frames are complete as soon as they are sent
+    if (done) {
+        xsk_tx_completed(pool, done);
+    }
+    if (peeked) {
+        xsk_tx_release(pool);
+    }
+
+    if (err && ++q->xsk_retries > RPMSG_ETH_XSK_RETRIES) {
+        // the frame stays with us until the remote is back
+        q->xsk_retries = 0;
+        rpmsg_eth_peer_lost(priv);
+    } else if (err) {
+        q->xstats.retries++;
+        trace_rpmsg_eth_retry(q->index, 0, err);
+        hrtimer_start(&q->tx_timer, ns_to_ktime(RPMSG_ETH_XSK_RETRY_US * NSEC_PER_USEC), HRTIMER_MODE_REL);
+    } else if (done) {
+        q->xsk_retries = 0;
+    }
+    if (!err && done == q->tx_ring_size) {
+        // there may be more, come back after the skbs queued meanwhile
+        WRITE_ONCE(q->xsk_wake, true);
+        rpmsg_eth_tx_kick(q);
+    }
+
+out:
+    rcu_read_unlock();
+}
+
+static int rpmsg_eth_tx_thread(void *data)
+{
+    struct rpmsg_eth_queue *q = data;
+    struct rpmsg_eth_private *priv = q->priv;
+    unsigned int avail, count;
+    int err;
+
+    while (!kthread_should_stop()) {
+        wait_event_interruptible(q->tx_wq, kthread_should_stop() || rpmsg_eth_tx_pending(q) ||
+                                           READ_ONCE(q->tx_reclaim) || READ_ONCE(q->xsk_wake));
+        WRITE_ONCE(q->tx_reclaim, false);
+        WRITE_ONCE(q->xsk_wake, false);
+        rpmsg_eth_tx_clean(q);
+
+        // the only consumer of tx_ring, so tx_tail is stable outside the lock
+        while ((avail = rpmsg_eth_tx_pending(q)) > 0) {
+            // rpmsg_sendto() sleeps until the remote returns a buffer, so there is no retry timer.
+            // It only fails once it has waited for the rpmsg core's own timeout.
+            if (atomic_read(&priv->peer_lost)) {
+                rpmsg_eth_tx_flush(q);
+                break;
+            }
+
+            err = rpmsg_eth_tx_next(q, avail, true, &count);
+            if (err) {
+                dev_err_ratelimited(&priv->rpdev->dev, "RPMsg send failed with error %d; dropping packet\n", err);
+                trace_rpmsg_eth_drop(q->index, count, 0, avail, RPMSG_ETH_DROP_SEND_FAIL);
+                priv->stats.tx_dropped += count;
+                q->xstats.retry_drops += count;
+                // that took the rpmsg core's whole timeout
+                rpmsg_eth_peer_lost(priv);
+            }
+
+            while (count--) {
+                rpmsg_eth_tx_complete(q, q->tx_ring[q->tx_tail], !err);
+            }
+            rpmsg_eth_tx_clean(q);
+        }
+
+        rpmsg_eth_xsk_tx(q);
+    }
+
+    return 0;
+}
+
+static void net_xmit_work_handler(struct work_struct *work)
+{
+    struct rpmsg_eth_queue *q = container_of(work, struct rpmsg_eth_queue, immediate);
+    struct rpmsg_eth_private *priv = q->priv;
+    unsigned int avail, count;
+    unsigned long flags;
+    int err;
+
+    // a doorbell may have brought us here just to free what the remote has consumed
+    rpmsg_eth_tx_clean(q);
+
+    // drain everything queued so far. rpmsg_eth_xmit() may keep appending while we are sending.
+    while ((avail = rpmsg_eth_tx_pending(q)) > 0) {
+        // nothing goes out until the remote answers a hello again
+        if (atomic_read(&priv->peer_lost)) {
+            rpmsg_eth_tx_flush(q);
+            return;
+        }
+
+        err = rpmsg_eth_tx_next(q, avail, false, &count);
+        if (err) {
+            if (q->is_delayed) {
+                // this is already our second attempt
+                dev_err_ratelimited(&priv->rpdev->dev, "RPMsg send retry failed with error %d; dropping packet\n",
+                                    err);
+                trace_rpmsg_eth_drop(q->index, count, 0, avail, RPMSG_ETH_DROP_SEND_FAIL);
+                priv->stats.tx_dropped += count;
+                q->xstats.retry_drops += count;
+                // rather than retry and drop every frame queued after it the same way
+                rpmsg_eth_peer_lost(priv);
+
+                // fall through to normal cleanup of these slots
+            } else {
+                // first attempt failed; attempt retry if not shutdown
+                spin_lock_irqsave(&q->shutdown_lock, flags);
+                if (!priv->is_shutdown) {
+                    WRITE_ONCE(q->is_delayed, true);
+                    q->xstats.retries++;
+                    trace_rpmsg_eth_retry(q->index, avail, err);
+                    // Our goal is to sleep long enough to free at least one (1) packet in the RPMsg
+                    // ring buffer. When HZ is 100 (lowest setting), our minimum resolution is 10ms (1
+                    // jiffy). On Kestrel-M4, flood ping clocked in at ~600 1400-bytes packets per
+                    // second on an unloaded system, and ~200 packets/sec on a loaded system. So, 10ms
+                    // should give us at least one packet.
+                    queue_delayed_work_on(priv->tx_cpu >= 0 ? priv->tx_cpu : WORK_CPU_UNBOUND,
+                                          q->urgent ? system_highpri_wq : system_wq, &q->delayed,
+                                          (unsigned long)(0.5 + (0.010 * HZ)));
+                    spin_unlock_irqrestore(&q->shutdown_lock, flags);
+
+                    dev_err_ratelimited(&priv->rpdev->dev, "RPMsg send failed with error %d; will retry\n", err);
+                } else {
+                    spin_unlock_irqrestore(&q->shutdown_lock, flags);
+
+                    dev_info(&priv->rpdev->dev, "skipping RPMsg send retry due to shutdown request\n");
+                }
+
+                // leave the skb in the ring, either for retry, or if under shutdown, to be freed
+                // by rpmsg_remove()
+                return;
+            }
+        }
+
+        while (count--) {
+            rpmsg_eth_tx_complete(q, q->tx_ring[q->tx_tail], !err);
+        }
+        rpmsg_eth_tx_clean(q);
+
+        // leave the vring buffers to the urgent queues' workers, and come back after them
+        if (!q->urgent && rpmsg_eth_urgent_waiting(q)) {
+            rpmsg_eth_tx_schedule(q);
+            return;
+        }
+    }
+
+    rpmsg_eth_xsk_tx(q);
+}
+
+static int rpmsg_eth_open(struct net_device *ndev)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    struct sk_buff *skb;
+
+    // fill the RX pool up front; rpmsg_eth_poll() keeps it topped up from then on
+    WRITE_ONCE(priv->rx_buf_len, ndev->mtu + ETH_HLEN);
+    while (use_napi && skb_queue_len(&priv->rx_pool) < rx_pool_size) {
+        skb = __netdev_alloc_skb_ip_align(ndev, priv->rx_headroom + priv->rx_buf_len, GFP_KERNEL);
+        if (skb == NULL) {
+            break;
+        }
+        skb_reserve(skb, priv->rx_headroom);
+        skb_queue_tail(&priv->rx_pool, skb);
+    }
+
+    if (use_napi) {
+        napi_enable(&priv->napi);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)
+        // newer kernels start the NAPI kthread here rather than in dev_set_threaded()
+        if (priv->rx_cpu >= 0 && priv->napi.thread) {
+            set_cpus_allowed_ptr(priv->napi.thread, cpumask_of(priv->rx_cpu));
+        }
+#endif
+        // pick up what the remote put into ring 1 while we were down
+        if (READ_ONCE(priv->shm)) {
+            napi_schedule(&priv->napi);
+        }
+    }
+    netif_tx_start_all_queues(ndev);
+    return 0;
+}
+
+int rpmsg_eth_stop (struct net_device *dev)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(dev);
+
+    netif_tx_stop_all_queues(dev);
+    if (use_napi) {
+        napi_disable(&priv->napi);
+        skb_queue_purge(&priv->rx_queue);
+    }
+    skb_queue_purge(&priv->rx_pool);
+    return 0;
+}
+
+
+static void rpmsg_eth_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *stats)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(dev);
+
+    dev_fetch_sw_netstats(stats, dev->tstats);
+
+    stats->tx_dropped = READ_ONCE(priv->stats.tx_dropped);
+    stats->rx_dropped = READ_ONCE(priv->stats.rx_dropped);
+    stats->rx_length_errors = READ_ONCE(priv->stats.rx_length_errors);
+    stats->rx_frame_errors = READ_ONCE(priv->stats.rx_frame_errors);
+    stats->rx_errors = stats->rx_length_errors + stats->rx_frame_errors;
+}
+
+// The protocol of a bare IP packet, from its version field; 0 makes the stack drop it
+static __be16 rpmsg_eth_raw_protocol(const struct sk_buff *skb)
+{
+    switch (skb->data[0] & 0xf0) {
+    case 0x40:
+        return htons(ETH_P_IP);
+    case 0x60:
+        return htons(ETH_P_IPV6);
+    default:
+        return 0;
+    }
+}
+
+// Turn a TCP super-frame from the remote into a GSO skb, which is cut into segments only if it is
+// forwarded. gso_size is the MSS the remote would have cut it at: the link MTU less the frame's
+// own IP and TCP headers. skb_checksum_setup() has found the TCP header by now; anything else is
+// left as one large packet.
+static void rpmsg_eth_rx_gso(struct rpmsg_eth_private *priv, struct sk_buff *skb)
+{
+    unsigned int hdr_len, mss;
+
+    if (skb->ip_summed != CHECKSUM_PARTIAL || skb->csum_offset != offsetof(struct tcphdr, check)) {
+        return;
+    }
+    hdr_len = skb_transport_offset(skb) + tcp_hdrlen(skb);
+    if (hdr_len >= priv->netdev->mtu) {
+        return;
+    }
+    mss = priv->netdev->mtu - hdr_len;
+
+    skb_shinfo(skb)->gso_size = mss;
+    skb_shinfo(skb)->gso_type = skb->protocol == htons(ETH_P_IPV6) ? SKB_GSO_TCPV6 : SKB_GSO_TCPV4;
+    skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(skb->len - hdr_len, mss);
+    priv->rx_gso_frames++;
+}
+
+// Set protocol and checksum state of a received frame before it goes up the stack
+static void rpmsg_eth_rx_prepare(struct rpmsg_eth_private *priv, struct sk_buff *skb)
+{
+    if (raw_ip) {
+        skb->dev = priv->netdev;
+        skb->pkt_type = PACKET_HOST;
+        skb_reset_mac_header(skb);
+        skb->protocol = rpmsg_eth_raw_protocol(skb);
+    } else {
+        skb->protocol = eth_type_trans(skb, priv->netdev);
+    }
+    skb->ip_summed = CHECKSUM_UNNECESSARY; /* don't check it */
+
+    if (READ_ONCE(priv->csum_free)) {
+        // the remote left TCP/UDP checksums out; have them filled in if the frame is forwarded
+        skb_reset_network_header(skb);
+        skb_checksum_setup(skb, true);
+    }
+
+    if (skb->len > priv->netdev->mtu) {
+        rpmsg_eth_rx_gso(priv, skb);
+    }
+}
+
+// Run prog on a received frame, which has not been through eth_type_trans() yet. The skb is
+// consumed unless XDP_PASS is returned.
+static u32 rpmsg_eth_run_xdp(struct rpmsg_eth_private *priv, struct bpf_prog *prog, struct sk_buff *skb)
+{
+    struct xdp_buff xdp;
+    void *orig_data;
+    u32 frame_sz;
+    u32 act;
+    int off;
+
+    // skbs allocated before the program was attached lack the headroom
+    if (skb_headroom(skb) < XDP_PACKET_HEADROOM &&
+        pskb_expand_head(skb, XDP_PACKET_HEADROOM - skb_headroom(skb), 0, GFP_ATOMIC)) {
+        act = XDP_DROP;
+        goto drop;
+    }
+
+    frame_sz = (unsigned char *)skb_end_pointer(skb) - skb->head;
+    frame_sz += SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+    xdp_init_buff(&xdp, frame_sz, &priv->xdp_rxq);
+    xdp_prepare_buff(&xdp, skb->head, skb_headroom(skb), skb->len, false);
+    orig_data = xdp.data;
+
+    act = bpf_prog_run_xdp(prog, &xdp);
+
+    // follow bpf_xdp_adjust_head() and bpf_xdp_adjust_tail()
+    off = xdp.data - orig_data;
+    if (off > 0) {
+        __skb_pull(skb, off);
+    } else if (off < 0) {
+        __skb_push(skb, -off);
+    }
+    skb->len = xdp.data_end - xdp.data;
+    skb_set_tail_pointer(skb, skb->len);
+    skb_reset_mac_header(skb);
+
+    switch (act) {
+    case XDP_PASS:
+        return act;
+    case XDP_TX:
+        // straight back to the remote, through rpmsg_eth_xmit()
+        priv->xdp_tx++;
+        generic_xdp_tx(skb, prog);
+        return act;
+    case XDP_REDIRECT:
+        if (xdp_do_generic_redirect(priv->netdev, skb, &xdp, prog)) {
+            goto drop;
+        }
+        priv->xdp_redirect++;
+        return act;
+    default:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+        bpf_warn_invalid_xdp_action(priv->netdev, prog, act);
+#else
+        bpf_warn_invalid_xdp_action(act);
+#endif
+        fallthrough;
+    case XDP_ABORTED:
+    case XDP_DROP:
+        break;
+    }
+
+drop:
+    priv->xdp_drop++;
+    kfree_skb(skb);
+    return XDP_DROP;
+}
+
+// Run prog on a frame copied into a buffer from the fill ring of the AF_XDP socket on queue 0, so
+// XDP_REDIRECT to the socket hands it to userspace without an skb. Returns an skb for the stack on
+// XDP_PASS, NULL once the frame is consumed. *flush is set when xdp_do_flush() is needed.
+static struct sk_buff *rpmsg_eth_run_xsk(struct rpmsg_eth_private *priv, struct bpf_prog *prog,
+                                         struct xsk_buff_pool *pool, const void *data, unsigned int len,
+                                         bool *flush)
+{
+    struct xdp_buff *xdp;
+    struct sk_buff *skb;
+    u32 act;
+
+    if (len > xsk_pool_get_rx_frame_size(pool)) {
+        priv->stats.rx_length_errors++;
+        return NULL;
+    }
+    xdp = xsk_buff_alloc(pool);
+    if (xdp == NULL) {
+        // userspace is not giving the buffers back fast enough; a NIC would drop it too
+        priv->stats.rx_dropped++;
+        priv->xsk_fill_empty++;
+        return NULL;
+    }
+    memcpy(xdp->data, data, len);
+    xdp->data_end = xdp->data + len;
+
+    act = bpf_prog_run_xdp(prog, xdp);
+    switch (act) {
+    case XDP_REDIRECT:
+        if (xdp_do_redirect(priv->netdev, xdp, prog)) {
+            break;
+        }
+        priv->xdp_redirect++;
+        *flush = true;
+        return NULL;
+    case XDP_PASS:
+    case XDP_TX:
+        // rare next to the socket's traffic, so both go the skb way
+        len = xdp->data_end - xdp->data;
+        skb = napi_alloc_skb(&priv->napi, len);
+        if (skb != NULL) {
+            skb_put_data(skb, xdp->data, len);
+        }
+        xsk_buff_free(xdp);
+        if (skb == NULL) {
+            priv->stats.rx_dropped++;
+            priv->rx_alloc_fail++;
+            return NULL;
+        }
+        if (act == XDP_PASS) {
+            return skb;
+        }
+        priv->xdp_tx++;
+        generic_xdp_tx(skb, prog);
+        return NULL;
+    default:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+        bpf_warn_invalid_xdp_action(priv->netdev, prog, act);
+#else
+        bpf_warn_invalid_xdp_action(act);
+#endif
+        fallthrough;
+    case XDP_ABORTED:
+    case XDP_DROP:
+        break;
+    }
+
+    xsk_buff_free(xdp);
+    priv->xdp_drop++;
+    return NULL;
+}
+
+static int rpmsg_eth_xdp_setup(struct net_device *ndev, struct bpf_prog *prog, struct netlink_ext_ack *extack)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    struct bpf_prog *old;
+
+    if (!use_napi) {
+        NL_SET_ERR_MSG_MOD(extack, "XDP runs in the NAPI poll loop, load with use_napi=1");
+        return -EOPNOTSUPP;
+    }
+    if (raw_ip && prog) {
+        NL_SET_ERR_MSG_MOD(extack, "XDP programs expect Ethernet frames, load with raw_ip=0");
+        return -EOPNOTSUPP;
+    }
+
+    old = rtnl_dereference(priv->xdp_prog);
+    rcu_assign_pointer(priv->xdp_prog, prog);
+    WRITE_ONCE(priv->rx_headroom, prog ? XDP_PACKET_HEADROOM : 0);
+    if (old) {
+        bpf_prog_put(old);
+    }
+
+    return 0;
+}
+
+// The device the vring buffers are allocated for, the virtio device's parent, as virtio_rpmsg_bus
+// does. AF_XDP maps the UMEM for it, although we only ever copy into it with the CPU.
+static struct device *rpmsg_eth_dma_dev(struct rpmsg_eth_private *priv)
+{
+    struct device *vdev = priv->rpdev->dev.parent;
+
+    return vdev && vdev->parent ? vdev->parent : &priv->rpdev->dev;
+}
+
+// Bind the buffer pool of an AF_XDP socket to queue_id, or unbind it when pool is NULL. Frames are
+// received on queue 0 only, the one RX channel; any queue sends from its own endpoint.
+static int rpmsg_eth_xsk_setup(struct net_device *ndev, struct xsk_buff_pool *pool, u16 queue_id)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    struct xsk_buff_pool *old;
+    struct rpmsg_eth_queue *q;
+    int err;
+
+    if (queue_id >= priv->num_queues) {
+        return -EINVAL;
+    }
+    q = &priv->queues[queue_id];
+    old = rtnl_dereference(q->xsk_pool);
+
+    if (pool == NULL) {
+        if (old == NULL) {
+            return -EINVAL;
+        }
+        RCU_INIT_POINTER(q->xsk_pool, NULL);
+        // rpmsg_eth_poll() and the drain side are done with it after this
+        synchronize_net();
+        q->xsk_busy = false;
+        xsk_pool_dma_unmap(old, 0);
+        return 0;
+    }
+
+    // the socket only gets frames through an XDP program, see rpmsg_eth_xdp_setup()
+    if (!use_napi || raw_ip) {
+        return -EOPNOTSUPP;
+    }
+    if (old != NULL) {
+        return -EBUSY;
+    }
+    if (queue_id == 0 && xsk_pool_get_rx_frame_size(pool) < ndev->mtu + ETH_HLEN) {
+        return -EINVAL;
+    }
+
+    err = xsk_pool_dma_map(pool, rpmsg_eth_dma_dev(priv), 0);
+    if (err) {
+        return err;
+    }
+    xsk_pool_set_rxq_info(pool, &priv->xsk_rxq);
+    // nothing but a kick sends what the socket queues, there is no TX completion interrupt
+    if (xsk_uses_need_wakeup(pool)) {
+        xsk_set_tx_need_wakeup(pool);
+    }
+    q->xsk_busy = false;
+    rcu_assign_pointer(q->xsk_pool, pool);
+    return 0;
+}
+
+static int rpmsg_eth_xsk_wakeup(struct net_device *ndev, u32 queue_id, u32 flags)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    struct rpmsg_eth_queue *q;
+
+    if (!netif_running(ndev) || READ_ONCE(priv->is_shutdown)) {
+        return -ENETDOWN;
+    }
+    if (queue_id >= priv->num_queues || !rcu_access_pointer(priv->queues[queue_id].xsk_pool)) {
+        return -ENXIO;
+    }
+    q = &priv->queues[queue_id];
+
+    if (flags & XDP_WAKEUP_TX) {
+        WRITE_ONCE(q->xsk_wake, true);
+        rpmsg_eth_tx_kick(q);
+    }
+    if ((flags & XDP_WAKEUP_RX) && queue_id == 0) {
+        napi_schedule(&priv->napi);
+    }
+    return 0;
+}
+
+static int rpmsg_eth_bpf(struct net_device *ndev, struct netdev_bpf *bpf)
+{
+    switch (bpf->command) {
+    case XDP_SETUP_PROG:
+        return rpmsg_eth_xdp_setup(ndev, bpf->prog, bpf->extack);
+    case XDP_SETUP_XSK_POOL:
+        return rpmsg_eth_xsk_setup(ndev, bpf->xsk.pool, bpf->xsk.queue_id);
+    default:
+        return -EINVAL;
+    }
+}
+
+// Take an skb for a frame of len bytes from the RX pool, or allocate one if the pool ran dry
+static struct sk_buff *rpmsg_eth_rx_alloc(struct rpmsg_eth_private *priv, unsigned int len)
+{
+    struct sk_buff *skb = skb_dequeue(&priv->rx_pool);
+    unsigned int headroom;
+
+    if (skb != NULL) {
+        if (likely(skb_tailroom(skb) >= len)) {
+            return skb;
+        }
+        // allocated before the MTU was raised
+        dev_kfree_skb_any(skb);
+    } else if (rx_pool_size > 0 && use_napi) {
+        priv->rx_pool_empty++;
+    }
+
+    headroom = READ_ONCE(priv->rx_headroom);
+    skb = netdev_alloc_skb_ip_align(priv->netdev, headroom + len);
+    if (skb != NULL) {
+        skb_reserve(skb, headroom);
+    }
+    return skb;
+}
+
+// Linear part of the skb for a super-frame, which takes the headers; the rest goes in page frags
+#define RPMSG_ETH_GSO_HEAD 256
+
+static struct sk_buff *rpmsg_eth_rx_alloc_gso(struct rpmsg_eth_private *priv)
+{
+    unsigned int headroom = READ_ONCE(priv->rx_headroom);
+    struct sk_buff *skb;
+
+    skb = netdev_alloc_skb_ip_align(priv->netdev, headroom + RPMSG_ETH_GSO_HEAD);
+    if (skb != NULL) {
+        skb_reserve(skb, headroom);
+    }
+    return skb;
+}
+
+// Append len bytes to a frame being reassembled: into the linear part while it has room, then
+// into page frags, filling the last page before taking a new one
+static int rpmsg_eth_rx_put(struct sk_buff *skb, const u8 *data, unsigned int len)
+{
+    struct skb_shared_info *shinfo = skb_shinfo(skb);
+    struct page *page;
+    skb_frag_t *frag;
+    unsigned int n;
+
+    if (!skb_is_nonlinear(skb)) {
+        n = min_t(unsigned int, len, skb_tailroom(skb));
+        skb_put_data(skb, data, n);
+        data += n;
+        len -= n;
+    }
+
+    while (len > 0) {
+        frag = shinfo->nr_frags ? &shinfo->frags[shinfo->nr_frags - 1] : NULL;
+        if (frag != NULL && skb_frag_size(frag) < PAGE_SIZE) {
+            // our pages are filled from offset 0
+            n = min_t(unsigned int, len, PAGE_SIZE - skb_frag_size(frag));
+            memcpy((u8 *)page_address(skb_frag_page(frag)) + skb_frag_size(frag), data, n);
+            skb_coalesce_rx_frag(skb, shinfo->nr_frags - 1, n, 0);
+        } else {
+            if (shinfo->nr_frags == MAX_SKB_FRAGS) {
+                return -EMSGSIZE;
+            }
+            page = dev_alloc_page();
+            if (page == NULL) {
+                return -ENOMEM;
+            }
+            n = min_t(unsigned int, len, PAGE_SIZE);
+            memcpy(page_address(page), data, n);
+            skb_add_rx_frag(skb, shinfo->nr_frags, page, 0, n, PAGE_SIZE);
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Take the next frame from ring 1, false once the ring is empty. *skbp is the frame as an skb, or
+// NULL when it went to the AF_XDP socket: with a pool, prog runs here on the frame copied straight
+// from shared memory into the UMEM, and *skbp is what it passed. Frames that cannot be delivered
+// are dropped and counted here.
+static bool rpmsg_eth_shm_rx_one(struct rpmsg_eth_private *priv, struct rpmsg_eth_shm *shm, struct bpf_prog *prog,
+                                 struct xsk_buff_pool *pool, bool *flush, struct sk_buff **skbp)
+{
+    struct rpmsg_eth_shm_slot *slot;
+    struct sk_buff *skb;
+    unsigned int len;
+    bool taken;
+    u32 head, off;
+
+    for (;;) {
+        head = le32_to_cpu(READ_ONCE(shm->rx->head));
+        if (head == shm->rx_tail) {
+            return false;
+        }
+        // read the slot only after the head that covers it
+        rmb();
+
+        skb = NULL;
+        taken = false;
+        off = shm->rx_tail & (shm->ring_size - 1);
+        slot = (struct rpmsg_eth_shm_slot *)(shm->rx_data + off);
+        len = le16_to_cpu(slot->len);
+        if (le16_to_cpu(slot->flags) & RPMSG_ETH_SHM_WRAP) {
+            shm->rx_tail += shm->ring_size - off;
+        } else if (rpmsg_eth_shm_slot_size(len) > shm->ring_size - off) {
+            // the remote wrote garbage; skip whatever it has produced so far
+            priv->stats.rx_frame_errors++;
+            shm->rx_tail = head;
+        } else {
+            if (len < ETH_HLEN || len > priv->netdev->mtu + ETH_HLEN) {
+                priv->stats.rx_length_errors++;
+            } else if (pool != NULL) {
+                skb = rpmsg_eth_run_xsk(priv, prog, pool, slot + 1, len, flush);
+                taken = true;
+            } else if ((skb = rpmsg_eth_rx_alloc(priv, len)) == NULL) {
+                priv->stats.rx_dropped++;
+                priv->rx_alloc_fail++;
+            } else {
+                skb_put_data(skb, slot + 1, len);
+            }
+            shm->rx_tail += rpmsg_eth_shm_slot_size(len);
+        }
+
+        // done reading the slot before handing it back
+        mb();
+        WRITE_ONCE(shm->rx->tail, cpu_to_le32(shm->rx_tail));
+        if (skb != NULL || taken) {
+            *skbp = skb;
+            return true;
+        }
+    }
+}
+
+// Done consuming ring 1 for now: wake the remote if it waits for room
+static void rpmsg_eth_shm_rx_done(struct rpmsg_eth_private *priv, struct rpmsg_eth_shm *shm)
+{
+    mb();
+    if (READ_ONCE(shm->rx->prod_wait)) {
+        WRITE_ONCE(shm->rx->prod_wait, 0);
+        rpmsg_eth_shm_doorbell(priv);
+    }
+}
+
+// Ask for a doorbell on the next frame produced on ring 1. Returns false if frames arrived before
+// the remote could see the request, in which case the caller has to consume again.
+static bool rpmsg_eth_shm_rx_arm(struct rpmsg_eth_shm *shm)
+{
+    WRITE_ONCE(shm->rx->cons_wait, cpu_to_le32(1));
+    mb();
+    return le32_to_cpu(READ_ONCE(shm->rx->head)) == shm->rx_tail;
+}
+
+static void rpmsg_eth_poll_pass(struct rpmsg_eth_private *priv, struct sk_buff *skb)
+{
+    dev_sw_netstats_rx_add(priv->netdev, skb->len);
+
+    rpmsg_eth_rx_prepare(priv, skb);
+    napi_gro_receive(&priv->napi, skb);
+}
+
+static void rpmsg_eth_poll_skb(struct rpmsg_eth_private *priv, struct bpf_prog *prog, struct xsk_buff_pool *pool,
+                               struct sk_buff *skb, bool *flush)
+{
+    struct sk_buff *pass;
+
+    rpmsg_eth_ts_deliver(priv, skb);
+
+    // XDP sees a frame as one buffer
+    if ((prog || pool) && skb_is_nonlinear(skb) && skb_linearize(skb)) {
+        priv->stats.rx_dropped++;
+        kfree_skb(skb);
+        return;
+    }
+
+    if (pool) {
+        // the skb only reassembled the RPMsg fragments; the frame moves on in the socket's UMEM
+        pass = rpmsg_eth_run_xsk(priv, prog, pool, skb->data, skb->len, flush);
+        consume_skb(skb);
+        if (pass == NULL) {
+            return;
+        }
+        skb = pass;
+    } else if (prog && rpmsg_eth_run_xdp(priv, prog, skb) != XDP_PASS) {
+        return;
+    }
+
+    rpmsg_eth_poll_pass(priv, skb);
+}
+
+static int rpmsg_eth_poll(struct napi_struct *napi, int budget)
+{
+    struct rpmsg_eth_private *priv = container_of(napi, struct rpmsg_eth_private, napi);
+    unsigned int headroom = READ_ONCE(priv->rx_headroom);
+    struct rpmsg_eth_shm *shm = READ_ONCE(priv->shm);
+    u64 fill_empty = priv->xsk_fill_empty;
+    struct xsk_buff_pool *pool = NULL;
+    struct bpf_prog *prog;
+    struct sk_buff *skb;
+    bool flush = false;
+    int work_done = 0;
+    int i;
+
+    rcu_read_lock();
+    prog = rcu_dereference(priv->xdp_prog);
+    // an AF_XDP socket on queue 0 gets frames once the program redirects them to it
+    if (prog) {
+        pool = rcu_dereference(priv->queues[0].xsk_pool);
+    }
+
+    while (work_done < budget) {
+        skb = skb_dequeue(&priv->rx_queue);
+        if (skb == NULL) {
+            break;
+        }
+
+        work_done++;
+        rpmsg_eth_poll_skb(priv, prog, pool, skb, &flush);
+    }
+
+    // frames from ring 1 come straight out of shared memory, there is no rx_queue in between
+    if (shm) {
+        while (work_done < budget && rpmsg_eth_shm_rx_one(priv, shm, prog, pool, &flush, &skb)) {
+            work_done++;
+            if (skb == NULL) {
+                continue;
+            }
+            if (pool) {
+                rpmsg_eth_poll_pass(priv, skb);
+            } else {
+                rpmsg_eth_poll_skb(priv, prog, NULL, skb, &flush);
+            }
+        }
+        rpmsg_eth_shm_rx_done(priv, shm);
+    }
+
+    if (flush) {
+        xdp_do_flush();
+    }
+    // have userspace kick us once it refills a fill ring that ran dry
+    if (pool && xsk_uses_need_wakeup(pool)) {
+        if (priv->xsk_fill_empty != fill_empty) {
+            xsk_set_rx_need_wakeup(pool);
+        } else {
+            xsk_clear_rx_need_wakeup(pool);
+        }
+    }
+
+    rcu_read_unlock();
+
+    // top up the RX pool, within the same budget
+    for (i = 0; i < budget && skb_queue_len(&priv->rx_pool) < rx_pool_size; i++) {
+        skb = napi_alloc_skb(napi, headroom + READ_ONCE(priv->rx_buf_len));
+        if (skb == NULL) {
+            break;
+        }
+        skb_reserve(skb, headroom);
+        skb_queue_tail(&priv->rx_pool, skb);
+    }
+
+    if (work_done < budget) {
+        napi_complete_done(napi, work_done);
+
+        if (shm && !rpmsg_eth_shm_rx_arm(shm)) {
+            napi_schedule(napi);
+        }
+    }
+
+    return work_done;
+}
+
+static void rpmsg_eth_rx_frame(struct rpmsg_eth_private *priv, struct sk_buff *skb)
+{
+    if (use_napi) {
+        skb_queue_tail(&priv->rx_queue, skb);
+        napi_schedule(&priv->napi);
+        return;
+    }
+
+    rpmsg_eth_ts_deliver(priv, skb);
+    dev_sw_netstats_rx_add(priv->netdev, skb->len);
+    rpmsg_eth_rx_prepare(priv, skb);
+    netif_rx(skb);
+}
+
+static void rpmsg_eth_rx_abort(struct rpmsg_eth_queue *q)
+{
+    if (q->rx_skb != NULL) {
+        dev_kfree_skb_any(q->rx_skb);
+        q->rx_skb = NULL;
+    }
+}
+
+// Append one record of a received message to the frame being reassembled. hash is the remote's
+// flow hash of a new frame, 0 if it sent none.
+static void rpmsg_eth_rx_record(struct rpmsg_eth_queue *q, unsigned int frame_len, unsigned int offset,
+                                u32 hash, const void *payload, unsigned int frag_len)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+    struct sk_buff *skb;
+    bool gso;
+    int err;
+
+    if (offset == 0) {
+        // start of a new frame; anything still pending was never completed
+        if (q->rx_skb != NULL) {
+            rpmsg_eth_rx_abort(q);
+            priv->stats.rx_dropped++;
+        }
+
+        gso = frame_len > priv->netdev->mtu + ETH_HLEN;
+        if (frame_len < ETH_HLEN || (gso && !(rx_gso && READ_ONCE(priv->csum_free)))) {
+            priv->stats.rx_length_errors++;
+            return;
+        }
+
+        if (use_napi && skb_queue_len(&priv->rx_queue) >= READ_ONCE(priv->rx_ring_size)) {
+            // the poll loop is not keeping up; drop rather than grow without bound
+            priv->stats.rx_dropped++;
+            priv->rx_backlog_drops++;
+            return;
+        }
+
+        q->rx_skb = gso ? rpmsg_eth_rx_alloc_gso(priv) : rpmsg_eth_rx_alloc(priv, frame_len);
+        if (q->rx_skb == NULL) {
+            priv->stats.rx_dropped++;
+            priv->rx_alloc_fail++;
+            return;
+        }
+        // software RX stamp on arrival, rather than when the poll loop gets to the frame
+        __net_timestamp(q->rx_skb);
+        // RPS and RFS pick the CPU by it instead of dissecting the frame
+        if (hash && (priv->netdev->features & NETIF_F_RXHASH)) {
+            skb_set_hash(q->rx_skb, hash, PKT_HASH_TYPE_L4);
+        }
+        q->rx_frame_len = frame_len;
+    }
+
+    skb = q->rx_skb;
+    if (skb == NULL) {
+        // tail of a frame whose head we dropped
+        return;
+    }
+
+    if (offset != skb->len || frame_len != q->rx_frame_len) {
+        rpmsg_eth_rx_abort(q);
+        priv->stats.rx_frame_errors++;
+        return;
+    }
+
+    // the RPMsg buffer is handed back to the vring as soon as we return, so copy it out now
+    err = rpmsg_eth_rx_put(skb, payload, frag_len);
+    if (err) {
+        rpmsg_eth_rx_abort(q);
+        if (err == -ENOMEM) {
+            priv->stats.rx_dropped++;
+            priv->rx_alloc_fail++;
+        } else {
+            priv->stats.rx_length_errors++;
+        }
+        return;
+    }
+    if (skb->len < frame_len) {
+        return;
+    }
+
+    q->rx_skb = NULL;
+    if (q->ts_state == RPMSG_ETH_TS_FRAME) {
+        q->ts_state = RPMSG_ETH_TS_NONE;
+        // the remote handing the frame to RPMsg is what putting it on the wire is for a NIC
+        if (READ_ONCE(priv->hwts_rx)) {
+            skb_hwtstamps(skb)->hwtstamp = rpmsg_eth_ts_ktime(q->ts_send);
+        }
+        if (tstamp_rate) {
+            rpmsg_eth_ts_rx(q, skb);
+        }
+    }
+    rpmsg_eth_rx_frame(priv, skb);
+}
+
+// Have the remote coalesce what it sends us. Returns 0 also when it cannot, lacking
+// RPMSG_ETH_F_COALESCE; then rx-usecs and rx-frames are only remembered.
+static int rpmsg_eth_send_coalesce(struct rpmsg_eth_private *priv, u32 usecs, u32 frames)
+{
+    struct rpmsg_eth_queue *q = &priv->queues[0];
+    struct rpmsg_eth_coalesce msg = {
+        .magic = cpu_to_be32(RPMSG_ETH_COALESCE_MAGIC),
+        .usecs = cpu_to_be32(usecs),
+        .frames = cpu_to_be16(min_t(u32, frames, U16_MAX)),
+    };
+
+    if (!(READ_ONCE(priv->remote_features) & RPMSG_ETH_F_COALESCE)) {
+        return 0;
+    }
+    return rpmsg_trysendto(q->ept, &msg, sizeof(msg), q->dst);
+}
+
+// Tell the remote which queues are urgent. Returns 0 also when it cannot tell them apart, lacking
+// RPMSG_ETH_F_PRIO.
+static int rpmsg_eth_send_prio(struct rpmsg_eth_private *priv, u32 urgent)
+{
+    struct rpmsg_eth_queue *q = &priv->queues[0];
+    struct rpmsg_eth_prio msg = {
+        .magic = cpu_to_be32(RPMSG_ETH_PRIO_MAGIC),
+        .urgent = cpu_to_be32(urgent),
+    };
+
+    if (!(READ_ONCE(priv->remote_features) & RPMSG_ETH_F_PRIO)) {
+        return 0;
+    }
+    return rpmsg_trysendto(q->ept, &msg, sizeof(msg), q->dst);
+}
+
+// Have the remote's netif follow our MTU. Returns 0 also when it cannot, lacking RPMSG_ETH_F_MTU;
+// then it keeps the MTU it took from our last hello.
+static int rpmsg_eth_send_mtu(struct rpmsg_eth_private *priv, unsigned int mtu)
+{
+    struct rpmsg_eth_queue *q = &priv->queues[0];
+    struct rpmsg_eth_mtu msg = {
+        .magic = cpu_to_be32(RPMSG_ETH_MTU_MAGIC),
+        .mtu = cpu_to_be16(mtu),
+    };
+
+    if (!(READ_ONCE(priv->remote_features) & RPMSG_ETH_F_MTU)) {
+        return 0;
+    }
+    return rpmsg_trysendto(q->ept, &msg, sizeof(msg), q->dst);
+}
+
+// Apply the parts of the remote's hello that need RTNL, then let the stack use the link
+static void rpmsg_eth_hello_work(struct work_struct *work)
+{
+    struct rpmsg_eth_private *priv = container_of(work, struct rpmsg_eth_private, hello_work);
+    struct net_device *ndev = priv->netdev;
+    netdev_features_t features;
+    unsigned int i;
+    int err;
+
+    rtnl_lock();
+    if (raw_ip && !(priv->remote_features & RPMSG_ETH_F_RAW)) {
+        netdev_err(ndev, "the remote only sends Ethernet frames, reload with raw_ip=0\n");
+        rtnl_unlock();
+        return;
+    }
+    // a restarted remote may come back with a different one
+    ndev->max_mtu = clamp_t(unsigned int, priv->remote_mtu, ETH_MIN_MTU, RPMSG_ETH_MAX_MTU);
+    if (ndev->mtu > ndev->max_mtu) {
+        err = dev_set_mtu(ndev, ndev->max_mtu);
+        if (err) {
+            netdev_warn(ndev, "cannot lower MTU to the remote's %u: %d\n", ndev->max_mtu, err);
+        }
+    }
+    features = 0;
+    if (priv->csum_free) {
+        features |= NETIF_F_HW_CSUM;
+
+        // TSO needs the checksum left for later too; the remote gets one large TCP segment
+        if (tso && (priv->remote_features & RPMSG_ETH_F_TSO) &&
+            priv->remote_tso_max > ndev->mtu + ETH_HLEN) {
+            features |= NETIF_F_SG | NETIF_F_TSO | NETIF_F_TSO6;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+            netif_set_tso_max_size(ndev, priv->remote_tso_max - ETH_HLEN);
+#else
+            netif_set_gso_max_size(ndev, priv->remote_tso_max - ETH_HLEN);
+#endif
+        }
+    }
+    if ((ndev->hw_features & features) != features) {
+        ndev->hw_features |= features;
+        ndev->wanted_features |= features;
+        netdev_update_features(ndev);
+    }
+    if (min(priv->remote_queues, priv->tx_queues) != ndev->real_num_tx_queues) {
+        err = netif_set_real_num_tx_queues(ndev, min(priv->remote_queues, priv->tx_queues));
+        if (err) {
+            netdev_warn(ndev, "cannot switch to the remote's %u queues: %d\n", priv->remote_queues, err);
+        }
+    }
+    // the remote may have restarted and forgotten it
+    if (priv->rx_coalesce_usecs && rpmsg_eth_send_coalesce(priv, priv->rx_coalesce_usecs, priv->rx_coalesce_frames)) {
+        netdev_warn(ndev, "cannot pass RX coalescing on to the remote\n");
+    }
+    if (priv->urgent_queues && rpmsg_eth_send_prio(priv, priv->urgent_queues)) {
+        netdev_warn(ndev, "cannot pass the urgent queues on to the remote\n");
+    }
+    // our hello may predate the last ip link set mtu
+    if (rpmsg_eth_send_mtu(priv, ndev->mtu)) {
+        netdev_warn(ndev, "cannot pass the MTU on to the remote\n");
+    }
+    netif_carrier_on(ndev);
+    rtnl_unlock();
+
+    // AF_XDP frames held back while the remote was lost
+    for (i = 0; i < priv->num_queues; i++) {
+        WRITE_ONCE(priv->queues[i].xsk_wake, true);
+        rpmsg_eth_tx_kick(&priv->queues[i]);
+    }
+}
+
+static void rpmsg_eth_rx_hello(struct rpmsg_eth_queue *q, const void *data, int len)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+    const struct rpmsg_eth_hello *hello = data;
+    unsigned int buf_size;
+
+    if (len < (int)sizeof(*hello) || be32_to_cpu(hello->magic) != RPMSG_ETH_HELLO_MAGIC ||
+        be16_to_cpu(hello->version) < RPMSG_ETH_HELLO_VERSION) {
+        priv->stats.rx_frame_errors++;
+        return;
+    }
+
+    // the remote answers on queue 0 only
+    if (q->index != 0) {
+        return;
+    }
+
+    buf_size = be16_to_cpu(hello->buf_size);
+    if (buf_size <= sizeof(struct rpmsg_eth_frag_hdr)) {
+        priv->stats.rx_frame_errors++;
+        return;
+    }
+
+    WRITE_ONCE(priv->tx_msg_size, min(buf_size, priv->buf_size));
+    WRITE_ONCE(priv->remote_features, be32_to_cpu(hello->features));
+    WRITE_ONCE(priv->csum_free, csum_offload && (priv->remote_features & RPMSG_ETH_F_CSUM));
+    // the remote may have restarted, and may not filter at all this time; its list follows
+    WRITE_ONCE(priv->mcast_all, true);
+    priv->remote_mtu = be16_to_cpu(hello->mtu);
+    priv->remote_queues = clamp_t(unsigned int, hello->num_queues, 1, priv->num_queues);
+    priv->remote_tso_max = be16_to_cpu(hello->tso_max);
+
+    WRITE_ONCE(priv->hello_done, true);
+    if (atomic_xchg(&priv->peer_lost, 0)) {
+        netdev_info(priv->netdev, "the remote answers again\n");
+    }
+
+    dev_info(&priv->rpdev->dev, "remote hello v%u: mtu %u, %u queues, buffer %u, features 0x%x, mac %pM\n",
+             be16_to_cpu(hello->version), priv->remote_mtu, hello->num_queues, buf_size,
+             priv->remote_features, hello->mac);
+
+    if (!READ_ONCE(priv->is_shutdown)) {
+        schedule_work(&priv->hello_work);
+    }
+}
+
+static void rpmsg_eth_rx_shm_offer(struct rpmsg_eth_queue *q, const void *data, int len)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+
+    if (len < (int)sizeof(priv->shm_offer)) {
+        priv->stats.rx_frame_errors++;
+        return;
+    }
+
+    // mapping the region may sleep, so it is left to shm_work
+    if (shm && q->index == 0 && (!READ_ONCE(priv->shm) || READ_ONCE(priv->shm_resync)) &&
+        !READ_ONCE(priv->is_shutdown)) {
+        memcpy(&priv->shm_offer, data, sizeof(priv->shm_offer));
+        schedule_work(&priv->shm_work);
+    }
+}
+
+// The remote produced on ring 1 or made room on ring 0
+static void rpmsg_eth_rx_doorbell(struct rpmsg_eth_private *priv)
+{
+    struct rpmsg_eth_shm *shm = READ_ONCE(priv->shm);
+    struct rpmsg_eth_queue *q = &priv->queues[0];
+    struct sk_buff *skb;
+    unsigned long flags;
+
+    if (shm == NULL) {
+        return;
+    }
+
+    // the remote consumed from ring 0: free what it is done with, and do not let a drain that
+    // found the ring full wait out its retry delay
+    spin_lock_irqsave(&q->shutdown_lock, flags);
+    if (!priv->is_shutdown && CIRC_CNT(q->tx_head, q->tx_clean, q->tx_ring_size) > 0) {
+        if (tx_thread) {
+            WRITE_ONCE(q->tx_reclaim, true);
+            wake_up(&q->tx_wq);
+        } else {
+            rpmsg_eth_tx_schedule(q);
+        }
+    }
+    spin_unlock_irqrestore(&q->shutdown_lock, flags);
+
+    if (!netif_running(priv->netdev)) {
+        return;
+    }
+
+    if (use_napi) {
+        napi_schedule(&priv->napi);
+        return;
+    }
+
+    do {
+        // no XDP without NAPI, so every frame comes back as an skb
+        while (rpmsg_eth_shm_rx_one(priv, shm, NULL, NULL, NULL, &skb)) {
+            rpmsg_eth_rx_frame(priv, skb);
+        }
+        rpmsg_eth_shm_rx_done(priv, shm);
+    } while (!rpmsg_eth_shm_rx_arm(shm));
+}
+
+static void rpmsg_eth_rx_tstamp(struct rpmsg_eth_queue *q, const void *data, int len)
+{
+    const struct rpmsg_eth_tstamp *ts = data;
+
+    if (len < (int)sizeof(*ts)) {
+        q->priv->stats.rx_frame_errors++;
+        return;
+    }
+    // stamps of another clock cannot be compared with ours
+    if (be32_to_cpu(ts->hz) != rpmsg_eth_ts_hz()) {
+        q->ts_state = RPMSG_ETH_TS_NONE;
+        return;
+    }
+    q->ts_xmit = (u64)be32_to_cpu(ts->xmit_hi) << 32 | be32_to_cpu(ts->xmit_lo);
+    q->ts_send = (u64)be32_to_cpu(ts->send_hi) << 32 | be32_to_cpu(ts->send_lo);
+    q->ts_state = RPMSG_ETH_TS_PENDING;
+}
+
+static void rpmsg_eth_rx_mcast(struct rpmsg_eth_queue *q, const void *data, int len)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+    const struct rpmsg_eth_mcast_filter *filter = data;
+    unsigned int count;
+    unsigned long flags;
+
+    if (len < (int)sizeof(*filter)) {
+        priv->stats.rx_frame_errors++;
+        return;
+    }
+    count = be16_to_cpu(filter->count);
+    if (len < (int)struct_size(filter, addr, count)) {
+        priv->stats.rx_frame_errors++;
+        return;
+    }
+
+    spin_lock_irqsave(&priv->mcast_lock, flags);
+    if ((filter->flags & RPMSG_ETH_MCAST_ALL) || count > RPMSG_ETH_MCAST_MAX) {
+        WRITE_ONCE(priv->mcast_all, true);
+        priv->mcast_count = 0;
+    } else {
+        memcpy(priv->mcast_addr, filter->addr, count * ETH_ALEN);
+        priv->mcast_count = count;
+        WRITE_ONCE(priv->mcast_all, false);
+    }
+    spin_unlock_irqrestore(&priv->mcast_lock, flags);
+}
+
+static void rpmsg_eth_rx_stats(struct rpmsg_eth_queue *q, const void *data, int len)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+    const struct rpmsg_eth_stats *stats = data;
+    unsigned int count, i;
+
+    if (len < (int)sizeof(*stats)) {
+        priv->stats.rx_frame_errors++;
+        return;
+    }
+    count = be16_to_cpu(stats->count);
+    if (len < (int)struct_size(stats, values, count)) {
+        priv->stats.rx_frame_errors++;
+        return;
+    }
+
+    count = min_t(unsigned int, count, RPMSG_ETH_REMOTE_NSTATS);
+    for (i = 0; i < count; i++) {
+        WRITE_ONCE(priv->remote_stats[i], be32_to_cpu(stats->values[i]));
+    }
+}
+
+static void rpmsg_eth_rx_ctrl(struct rpmsg_eth_queue *q, const void *data, int len)
+{
+    const struct rpmsg_eth_doorbell *ctrl = data; // every control message starts like a doorbell
+
+    if (len < (int)sizeof(*ctrl)) {
+        q->priv->stats.rx_frame_errors++;
+        return;
+    }
+
+    switch (be32_to_cpu(ctrl->magic)) {
+    case RPMSG_ETH_HELLO_MAGIC:
+        rpmsg_eth_rx_hello(q, data, len);
+        break;
+    case RPMSG_ETH_SHM_MAGIC:
+        rpmsg_eth_rx_shm_offer(q, data, len);
+        break;
+    case RPMSG_ETH_DOORBELL_MAGIC:
+        rpmsg_eth_rx_doorbell(q->priv);
+        break;
+    case RPMSG_ETH_TSTAMP_MAGIC:
+        rpmsg_eth_rx_tstamp(q, data, len);
+        break;
+    case RPMSG_ETH_MCAST_MAGIC:
+        rpmsg_eth_rx_mcast(q, data, len);
+        break;
+    case RPMSG_ETH_STATS_MAGIC:
+        rpmsg_eth_rx_stats(q, data, len);
+        break;
+    default:
+        q->priv->stats.rx_frame_errors++;
+        break;
+    }
+}
+
+static int rpmsg_eth_rx_cb(struct rpmsg_device *rpdev, void *data, int len, void *drv_priv, u32 src)
+{
+    struct rpmsg_eth_private *priv = dev_get_drvdata(&rpdev->dev);
+    struct rpmsg_eth_queue *q = drv_priv;
+    const struct rpmsg_eth_frag_hdr *hdr;
+    unsigned int frame_len, offset, frag_len;
+    unsigned int remain = len;
+    const u8 *payload;
+    __be32 hash;
+
+    trace_rpmsg_eth_rx(q->index, len, skb_queue_len(&priv->rx_queue));
+    if (len < (int)sizeof(*hdr)) {
+        priv->stats.rx_length_errors++;
+        return 0;
+    }
+
+    // control messages are handled even while the interface is down
+    hdr = data;
+    if (hdr->frame_len == 0) {
+        rpmsg_eth_rx_ctrl(q, data, len);
+        return 0;
+    }
+
+    if (!netif_running(priv->netdev)) {
+        return 0;
+    }
+
+    if (q->ts_state == RPMSG_ETH_TS_PENDING) {
+        q->ts_cb = rpmsg_eth_ts_now();
+        q->ts_state = RPMSG_ETH_TS_FRAME;
+    }
+
+    // A message carries either one fragment, or several whole frames packed back to back. Each
+    // record's payload ends at its frame's end or at the end of the message, whichever is first.
+    while (remain >= sizeof(*hdr)) {
+        hdr = data;
+        frame_len = be16_to_cpu(hdr->frame_len);
+        offset = be16_to_cpu(hdr->offset);
+        payload = (const u8 *)(hdr + 1);
+        remain -= sizeof(*hdr);
+
+        hash = 0;
+        if (offset == RPMSG_ETH_HASH_OFFSET && remain >= sizeof(hash)) {
+            memcpy(&hash, payload, sizeof(hash));
+            payload += sizeof(hash);
+            remain -= sizeof(hash);
+            offset = 0;
+        }
+
+        if (offset >= frame_len) {
+            rpmsg_eth_rx_abort(q);
+            priv->stats.rx_frame_errors++;
+            return 0;
+        }
+        frag_len = min(remain, frame_len - offset);
+
+        rpmsg_eth_rx_record(q, frame_len, offset, be32_to_cpu(hash), payload, frag_len);
+
+        data = (u8 *)payload + frag_len;
+        remain -= frag_len;
+    }
+
+    return 0;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+static int rpmsg_eth_get_coalesce(struct net_device *ndev, struct ethtool_coalesce *ec,
+                                  struct kernel_ethtool_coalesce *kernel_coal,
+                                  struct netlink_ext_ack *extack)
+#else
+static int rpmsg_eth_get_coalesce(struct net_device *ndev, struct ethtool_coalesce *ec)
+#endif
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+
+    ec->tx_coalesce_usecs = READ_ONCE(priv->tx_coalesce_usecs);
+    ec->tx_max_coalesced_frames = READ_ONCE(priv->tx_coalesce_frames);
+    ec->rx_coalesce_usecs = priv->rx_coalesce_usecs;
+    ec->rx_max_coalesced_frames = priv->rx_coalesce_frames;
+    return 0;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+static int rpmsg_eth_set_coalesce(struct net_device *ndev, struct ethtool_coalesce *ec,
+                                  struct kernel_ethtool_coalesce *kernel_coal,
+                                  struct netlink_ext_ack *extack)
+#else
+static int rpmsg_eth_set_coalesce(struct net_device *ndev, struct ethtool_coalesce *ec)
+#endif
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    int err;
+
+    // a held back packet should not wait longer than a failed send waits for its retry, on
+    // either side
+    if (ec->tx_coalesce_usecs > 10 * USEC_PER_MSEC || ec->rx_coalesce_usecs > 10 * USEC_PER_MSEC) {
+        return -EINVAL;
+    }
+
+    if (ec->rx_coalesce_usecs != priv->rx_coalesce_usecs || ec->rx_max_coalesced_frames != priv->rx_coalesce_frames) {
+        err = rpmsg_eth_send_coalesce(priv, ec->rx_coalesce_usecs, ec->rx_max_coalesced_frames);
+        if (err) {
+            return err;
+        }
+        priv->rx_coalesce_usecs = ec->rx_coalesce_usecs;
+        priv->rx_coalesce_frames = ec->rx_max_coalesced_frames;
+    }
+
+    WRITE_ONCE(priv->tx_coalesce_usecs, ec->tx_coalesce_usecs);
+    WRITE_ONCE(priv->tx_coalesce_frames, ec->tx_max_coalesced_frames);
+    return 0;
+}
+
+// Bounds of ethtool -G. The TX ring is rounded up to a power of two.
+#define RPMSG_ETH_TX_RING_MAX 4096
+#define RPMSG_ETH_RX_RING_MAX 4096
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+static void rpmsg_eth_get_ringparam(struct net_device *ndev, struct ethtool_ringparam *ring,
+                                    struct kernel_ethtool_ringparam *kernel_ring,
+                                    struct netlink_ext_ack *extack)
+#else
+static void rpmsg_eth_get_ringparam(struct net_device *ndev, struct ethtool_ringparam *ring)
+#endif
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+
+    ring->rx_max_pending = RPMSG_ETH_RX_RING_MAX;
+    ring->tx_max_pending = RPMSG_ETH_TX_RING_MAX;
+    ring->rx_pending = READ_ONCE(priv->rx_ring_size);
+    ring->tx_pending = priv->queues[0].tx_ring_size;
+}
+
+// Swap every queue's tx_ring for one of size slots. Only while the interface is down and the rings
+// are empty, so neither rpmsg_eth_xmit() nor the drain side looks at them; the doorbell might, and
+// is kept out by shutdown_lock.
+static int rpmsg_eth_resize_tx_rings(struct rpmsg_eth_private *priv, unsigned int size)
+{
+    struct sk_buff **ring[RPMSG_ETH_MAX_QUEUES] = { NULL };
+    ktime_t *stamp[RPMSG_ETH_MAX_QUEUES] = { NULL };
+    u32 *mark[RPMSG_ETH_MAX_QUEUES] = { NULL };
+    struct rpmsg_eth_queue *q;
+    unsigned long flags;
+    unsigned int i;
+    int err = 0;
+
+    for (i = 0; i < priv->num_queues; i++) {
+        q = &priv->queues[i];
+        if (CIRC_CNT(READ_ONCE(q->tx_head), READ_ONCE(q->tx_clean), q->tx_ring_size) > 0) {
+            return -EBUSY;
+        }
+        ring[i] = kcalloc(size, sizeof(*q->tx_ring), GFP_KERNEL);
+        stamp[i] = kcalloc(size, sizeof(*q->tx_stamp), GFP_KERNEL);
+        mark[i] = kcalloc(size, sizeof(*q->tx_mark), GFP_KERNEL);
+        if (!ring[i] || !stamp[i] || !mark[i]) {
+            err = -ENOMEM;
+            goto out;
+        }
+    }
+
+    for (i = 0; i < priv->num_queues; i++) {
+        q = &priv->queues[i];
+        hrtimer_cancel(&q->tx_timer);
+        cancel_delayed_work_sync(&q->delayed);
+        cancel_work_sync(&q->immediate);
+
+        spin_lock_irqsave(&q->shutdown_lock, flags);
+        swap(q->tx_ring, ring[i]);
+        swap(q->tx_stamp, stamp[i]);
+        swap(q->tx_mark, mark[i]);
+        q->tx_ring_size = size;
+        q->tx_head = 0;
+        q->tx_tail = 0;
+        q->tx_clean = 0;
+        q->tx_offset = 0;
+        q->is_delayed = false;
+        spin_unlock_irqrestore(&q->shutdown_lock, flags);
+        netdev_tx_reset_queue(netdev_get_tx_queue(priv->netdev, i));
+    }
+
+out:
+    // the old rings after a swap, the new ones after a failure
+    for (i = 0; i < priv->num_queues; i++) {
+        kfree(ring[i]);
+        kfree(stamp[i]);
+        kfree(mark[i]);
+    }
+    return err;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+static int rpmsg_eth_set_ringparam(struct net_device *ndev, struct ethtool_ringparam *ring,
+                                   struct kernel_ethtool_ringparam *kernel_ring,
+                                   struct netlink_ext_ack *extack)
+#else
+static int rpmsg_eth_set_ringparam(struct net_device *ndev, struct ethtool_ringparam *ring)
+#endif
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    unsigned int tx_size = roundup_pow_of_two(max(ring->tx_pending, 2U));
+    int err;
 
+    if (ring->rx_pending == 0 || ring->rx_mini_pending || ring->rx_jumbo_pending) {
+        return -EINVAL;
+    }
 
+    if (tx_size != priv->queues[0].tx_ring_size) {
+        if (netif_running(ndev)) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+            NL_SET_ERR_MSG_MOD(extack, "bring the interface down to resize the TX ring");
+#endif
+            return -EBUSY;
+        }
+        err = rpmsg_eth_resize_tx_rings(priv, tx_size);
+        if (err) {
+            return err;
+        }
+    }
 
-struct rpmsg_eth_private {
-    struct rpmsg_device *rpdev;
-    struct net_device *netdev;
-    struct net_device_stats stats;
+    // only bounds the backlog, so it takes effect right away
+    WRITE_ONCE(priv->rx_ring_size, ring->rx_pending);
+    return 0;
+}
 
-    /**
-     * A work queue to process net device transmit events (Net->RPMsg) packets in a process context,
-     * rather than the ISR context provided by the net xmit callback.
-     */
-    struct work_struct immediate;
+// One RX channel, the remote sends on queue 0 only; a TX channel per endpoint
+static void rpmsg_eth_get_channels(struct net_device *ndev, struct ethtool_channels *ch)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
 
-    /**
-     * A work queue to provide for net device transmit retries in the event that the RPMsg ring
-     * buffer is full at the time we attempt to transmit.
-     */
-    struct delayed_work delayed;
+    ch->max_rx = 1;
+    ch->max_tx = priv->num_queues;
+    ch->rx_count = 1;
+    ch->tx_count = priv->tx_queues;
+}
 
-    /** The current skb that is being transmitted from net device to RPMsg */
-    struct sk_buff *skb;
+// All endpoints stay open, the stack just stops picking the ones past tx_count. Frames already
+// queued on them still go out.
+static int rpmsg_eth_set_channels(struct net_device *ndev, struct ethtool_channels *ch)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    int err;
 
-    /** A boolean indicating that we are retrying a failed skb transmission */
-    bool is_delayed;
+    if (ch->rx_count != 1 || ch->tx_count == 0 || ch->combined_count || ch->other_count) {
+        return -EINVAL;
+    }
 
-    /** A lock for the net device transmitter. Used to avoid race condition on shutdown */
-    spinlock_t shutdown_lock;
+    err = netif_set_real_num_tx_queues(ndev, min(ch->tx_count, priv->remote_queues));
+    if (err) {
+        return err;
+    }
+    priv->tx_queues = ch->tx_count;
+    return 0;
+}
 
-    /** A flag indicating whether the interface is shutdown, or not */
-    bool is_shutdown;
+static const char rpmsg_eth_gstrings[][ETH_GSTRING_LEN] = {
+    "tx_send_fail",
+    "tx_retries",
+    "tx_retry_drops",
+    "tx_shutdown_drops",
+    "tx_ring_full",
+    "tx_packed_msgs",
+    "tx_lat_lt_10us",
+    "tx_lat_lt_100us",
+    "tx_lat_lt_1ms",
+    "tx_lat_lt_10ms",
+    "tx_lat_ge_10ms",
+    "rx_alloc_fail",
+    "rx_backlog_drops",
+    "rx_pool_empty",
+    "xdp_drop",
+    "xdp_tx",
+    "xdp_redirect",
+    "tx_mcast_filtered",
+    "xsk_fill_empty",
+    "rx_gso_frames",
 };
 
-static void net_xmit_delayed_work_handler(struct work_struct *work);
-static void net_xmit_work_handler(struct work_struct *work);
-static netdev_tx_t rpmsg_eth_xmit(struct sk_buff *skb, struct net_device *ndev);
+#define RPMSG_ETH_QUEUE_NSTATS (sizeof(struct rpmsg_eth_queue_stats) / sizeof(u64))
+// the device's own counters, rx_alloc_fail on, that follow the queue ones
+#define RPMSG_ETH_DEV_NSTATS 9
+
+// The remote's lwIP counters, refreshed by every ethtool -S. Its counters are 16 bits wide unless it
+// is built with LWIP_STATS_LARGE, and wrap.
+static const char rpmsg_eth_remote_gstrings[RPMSG_ETH_REMOTE_NSTATS][ETH_GSTRING_LEN] = {
+    "remote_link_xmit",
+    "remote_link_recv",
+    "remote_link_drop",
+    "remote_link_chkerr",
+    "remote_link_memerr",
+    "remote_link_proterr",
+    "remote_link_err",
+    "remote_ip_xmit",
+    "remote_ip_recv",
+    "remote_ip_drop",
+    "remote_ip_chkerr",
+    "remote_ip_memerr",
+    "remote_ip_proterr",
+    "remote_ip_err",
+    "remote_udp_xmit",
+    "remote_udp_recv",
+    "remote_udp_drop",
+    "remote_udp_chkerr",
+    "remote_udp_memerr",
+    "remote_udp_proterr",
+    "remote_udp_err",
+    "remote_tcp_xmit",
+    "remote_tcp_recv",
+    "remote_tcp_drop",
+    "remote_tcp_chkerr",
+    "remote_tcp_memerr",
+    "remote_tcp_proterr",
+    "remote_tcp_err",
+    "remote_memp_err",
+    "remote_pbuf_pool_used",
+    "remote_pbuf_pool_max",
+    "remote_pbuf_pool_err",
+    "remote_heap_used",
+    "remote_heap_max",
+    "remote_heap_err",
+    "remote_mbox_used",
+    "remote_mbox_max",
+    "remote_mbox_full",
+};
 
+// With tstamp_rate, ts_samples and the histograms follow, named like ts_link_lt_2us
+static const char *const rpmsg_eth_ts_stages[RPMSG_ETH_TS_STAGES] = {
+    "remote_queue",
+    "link",
+    "host_rx",
+};
 
-static netdev_tx_t rpmsg_eth_xmit(struct sk_buff *skb,
-                            struct net_device *dev)
+#define RPMSG_ETH_TS_NSTATS (1 + RPMSG_ETH_TS_STAGES * RPMSG_ETH_TS_BUCKETS)
+
+static int rpmsg_eth_get_sset_count(struct net_device *ndev, int sset)
 {
-    struct rpmsg_eth_private *priv = netdev_priv(dev);
-    unsigned long flags;
+    BUILD_BUG_ON(ARRAY_SIZE(rpmsg_eth_gstrings) != RPMSG_ETH_QUEUE_NSTATS + RPMSG_ETH_DEV_NSTATS);
 
-    // stop the net device transmitter. will be re-enabled by the work queue.
-    netif_stop_queue(priv->netdev);
+    if (sset != ETH_SS_STATS) {
+        return -EOPNOTSUPP;
+    }
+    return ARRAY_SIZE(rpmsg_eth_gstrings) + RPMSG_ETH_REMOTE_NSTATS + (tstamp_rate ? RPMSG_ETH_TS_NSTATS : 0);
+}
 
-    // schedule work, unless we are shutdown
-    spin_lock_irqsave(&priv->shutdown_lock, flags);
-    if (!priv->is_shutdown) {
-        priv->skb = skb;
-        schedule_work(&priv->immediate);
-        spin_unlock_irqrestore(&priv->shutdown_lock, flags);
-    } else {
-        // we're shut down. drop packet. leave queue stopped.
-        spin_unlock_irqrestore(&priv->shutdown_lock, flags);
+static void rpmsg_eth_get_strings(struct net_device *ndev, u32 sset, u8 *data)
+{
+    unsigned int i, j;
 
-        dev_consume_skb_any(skb);
-        dev_info(&priv->rpdev->dev, "net_xmit: dropping packet due to shutdown request (race)\n");
+    if (sset != ETH_SS_STATS) {
+        return;
     }
 
-    priv->stats.tx_packets++;
-    priv->stats.tx_bytes += skb->len;
+    memcpy(data, rpmsg_eth_gstrings, sizeof(rpmsg_eth_gstrings));
+    data += sizeof(rpmsg_eth_gstrings);
+    memcpy(data, rpmsg_eth_remote_gstrings, sizeof(rpmsg_eth_remote_gstrings));
+    if (!tstamp_rate) {
+        return;
+    }
 
-    return NETDEV_TX_OK;
+    data += sizeof(rpmsg_eth_remote_gstrings);
+    strscpy((char *)data, "ts_samples", ETH_GSTRING_LEN);
+    data += ETH_GSTRING_LEN;
+    for (i = 0; i < RPMSG_ETH_TS_STAGES; i++) {
+        for (j = 0; j < RPMSG_ETH_TS_BUCKETS; j++) {
+            if (j == RPMSG_ETH_TS_BUCKETS - 1) {
+                snprintf((char *)data, ETH_GSTRING_LEN, "ts_%s_ge_%uus", rpmsg_eth_ts_stages[i], 1U << (j - 1));
+            } else {
+                snprintf((char *)data, ETH_GSTRING_LEN, "ts_%s_lt_%uus", rpmsg_eth_ts_stages[i], 1U << j);
+            }
+            data += ETH_GSTRING_LEN;
+        }
+    }
 }
 
-static void net_xmit_delayed_work_handler(struct work_struct *work)
+// Ask the remote for its counters without waiting: ethtool -S runs under RTNL and shows those of
+// the previous answer, rpmsg_eth_rx_stats() refreshes them when this one arrives. The answers come
+// back on queue 0 in the order of the requests, each one newer than the last.
+static void rpmsg_eth_request_remote_stats(struct rpmsg_eth_private *priv)
 {
-    struct rpmsg_eth_private *priv = container_of(work, struct rpmsg_eth_private, delayed.work);
-    unsigned long flags;
+    struct rpmsg_eth_queue *q = &priv->queues[0];
+    struct rpmsg_eth_stats req = {
+        .magic = cpu_to_be32(RPMSG_ETH_STATS_MAGIC),
+    };
 
-    spin_lock_irqsave(&priv->shutdown_lock, flags);
-    if (priv->is_delayed && !priv->is_shutdown) {
-        schedule_work(&priv->immediate);
-        spin_unlock_irqrestore(&priv->shutdown_lock, flags);
-    } else {
-        spin_unlock_irqrestore(&priv->shutdown_lock, flags);
+    if (!(READ_ONCE(priv->remote_features) & RPMSG_ETH_F_STATS) || READ_ONCE(priv->is_shutdown)) {
+        return;
+    }
+    if (rpmsg_trysendto(q->ept, &req, sizeof(req), q->dst)) {
+        q->xstats.send_fail++;
+    }
+}
 
-        dev_info(&priv->rpdev->dev, "delayed work handler skipping kick of immediate due to shutdown request\n");
+// TX counters are summed over all queues, in struct rpmsg_eth_queue_stats order
+static void rpmsg_eth_get_ethtool_stats(struct net_device *ndev, struct ethtool_stats *stats, u64 *data)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    const u64 dev[RPMSG_ETH_DEV_NSTATS] = {
+        READ_ONCE(priv->rx_alloc_fail),
+        READ_ONCE(priv->rx_backlog_drops),
+        READ_ONCE(priv->rx_pool_empty),
+        READ_ONCE(priv->xdp_drop),
+        READ_ONCE(priv->xdp_tx),
+        READ_ONCE(priv->xdp_redirect),
+        READ_ONCE(priv->tx_mcast_filtered),
+        READ_ONCE(priv->xsk_fill_empty),
+        READ_ONCE(priv->rx_gso_frames),
+    };
+    const u64 *qs;
+    unsigned int i, j;
+
+    memset(data, 0, sizeof(*data) * ARRAY_SIZE(rpmsg_eth_gstrings));
+    for (i = 0; i < priv->num_queues; i++) {
+        qs = (const u64 *)&priv->queues[i].xstats;
+        for (j = 0; j < RPMSG_ETH_QUEUE_NSTATS; j++) {
+            data[j] += READ_ONCE(qs[j]);
+        }
+    }
+    memcpy(data + RPMSG_ETH_QUEUE_NSTATS, dev, sizeof(dev));
+
+    data += ARRAY_SIZE(rpmsg_eth_gstrings);
+    for (i = 0; i < RPMSG_ETH_REMOTE_NSTATS; i++) {
+        data[i] = READ_ONCE(priv->remote_stats[i]);
+    }
+    rpmsg_eth_request_remote_stats(priv);
+
+    if (tstamp_rate) {
+        data += RPMSG_ETH_REMOTE_NSTATS;
+        data[0] = READ_ONCE(priv->ts_samples);
+        for (i = 0; i < RPMSG_ETH_TS_STAGES; i++) {
+            for (j = 0; j < RPMSG_ETH_TS_BUCKETS; j++) {
+                data[1 + i * RPMSG_ETH_TS_BUCKETS + j] = READ_ONCE(priv->ts_hist[i][j]);
+            }
+        }
     }
 }
 
-static void net_xmit_work_handler(struct work_struct *work)
+// Hardware timestamps are the shared counter: on TX when the frame is handed to RPMsg, on RX when
+// the remote handed it to RPMsg. Only frames the remote stamped have an RX stamp, all of them if
+// it is built with RPMSG_ETH_TSTAMP_RATE 1; frames through the shared-memory rings have none.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+static int rpmsg_eth_get_ts_info(struct net_device *ndev, struct kernel_ethtool_ts_info *info)
+#else
+static int rpmsg_eth_get_ts_info(struct net_device *ndev, struct ethtool_ts_info *info)
+#endif
 {
-    struct rpmsg_eth_private *priv = container_of(work, struct rpmsg_eth_private, immediate);
-    unsigned long flags;
-    int err;
+    info->so_timestamping = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE |
+                            SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_TX_HARDWARE |
+                            SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    info->phc_index = -1;
+    info->tx_types = BIT(HWTSTAMP_TX_OFF) | BIT(HWTSTAMP_TX_ON);
+    info->rx_filters = BIT(HWTSTAMP_FILTER_NONE) | BIT(HWTSTAMP_FILTER_ALL);
+    return 0;
+}
+
+static const struct ethtool_ops rpmsg_eth_ethtool_ops = {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 7, 0)
+    .supported_coalesce_params = ETHTOOL_COALESCE_TX_USECS | ETHTOOL_COALESCE_TX_MAX_FRAMES |
+                                 ETHTOOL_COALESCE_RX_USECS | ETHTOOL_COALESCE_RX_MAX_FRAMES,
+#endif
+    .get_link           = ethtool_op_get_link,
+    .get_coalesce       = rpmsg_eth_get_coalesce,
+    .set_coalesce       = rpmsg_eth_set_coalesce,
+    .get_ringparam      = rpmsg_eth_get_ringparam,
+    .set_ringparam      = rpmsg_eth_set_ringparam,
+    .get_channels       = rpmsg_eth_get_channels,
+    .set_channels       = rpmsg_eth_set_channels,
+    .get_sset_count     = rpmsg_eth_get_sset_count,
+    .get_strings        = rpmsg_eth_get_strings,
+    .get_ethtool_stats  = rpmsg_eth_get_ethtool_stats,
+    .get_ts_info        = rpmsg_eth_get_ts_info,
+};
+
+static int rpmsg_eth_hwtstamp_set(struct net_device *ndev, struct ifreq *ifr)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    struct hwtstamp_config config;
 
-    if (priv->skb == NULL) {
-        dev_err(&priv->rpdev->dev, "net_xmit_work_handler called with NULL skb\n");
-        goto cleanup;
+    if (copy_from_user(&config, ifr->ifr_data, sizeof(config))) {
+        return -EFAULT;
+    }
+    if (config.flags) {
+        return -EINVAL;
+    }
+    if (config.tx_type != HWTSTAMP_TX_OFF && config.tx_type != HWTSTAMP_TX_ON) {
+        return -ERANGE;
+    }
+    // there is no telling frames apart, whatever the remote stamped gets its stamp
+    if (config.rx_filter != HWTSTAMP_FILTER_NONE) {
+        config.rx_filter = HWTSTAMP_FILTER_ALL;
     }
 
-    err = rpmsg_trysend(priv->rpdev->ept, priv->skb->data, priv->skb->len);
-    if (err) {
-        if (priv->is_delayed) {
-            // this is already our second attempt
-            dev_err(&priv->rpdev->dev, "RPMsg send retry failed with error %d; dropping packet\n", err);
+    priv->hwts_config = config;
+    WRITE_ONCE(priv->hwts_tx, config.tx_type == HWTSTAMP_TX_ON);
+    WRITE_ONCE(priv->hwts_rx, config.rx_filter == HWTSTAMP_FILTER_ALL);
 
-            // normal cleanup
-            goto cleanup;
-        } else {
-            // first attempt failed; attempt retry if not shutdown
-            spin_lock_irqsave(&priv->shutdown_lock, flags);
-            if (!priv->is_shutdown) {
-                priv->is_delayed = true;
-                // Our goal is to sleep long enough to free at least one (1) packet in the RPMsg
-                // ring buffer. When HZ is 100 (lowest setting), our minimum resolution is 10ms (1
-                // jiffy). On Kestrel-M4, flood ping clocked in at ~600 1400-bytes packets per
-                // second on an unloaded system, and ~200 packets/sec on a loaded system. So, 10ms
-                // should give us at least one packet.
-                schedule_delayed_work(&priv->delayed, (unsigned long)(0.5 + (0.010 * HZ)));
-                spin_unlock_irqrestore(&priv->shutdown_lock, flags);
-
-                dev_err(&priv->rpdev->dev, "RPMsg send failed with error %d; will retry\n", err);
-            } else {
-                spin_unlock_irqrestore(&priv->shutdown_lock, flags);
+    return copy_to_user(ifr->ifr_data, &config, sizeof(config)) ? -EFAULT : 0;
+}
 
-                dev_info(&priv->rpdev->dev, "skipping RPMsg send retry due to shutdown request\n");
-            }
+static int rpmsg_eth_ioctl(struct net_device *ndev, struct ifreq *ifr, int cmd)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+
+    switch (cmd) {
+    case SIOCSHWTSTAMP:
+        return rpmsg_eth_hwtstamp_set(ndev, ifr);
+    case SIOCGHWTSTAMP:
+        return copy_to_user(ifr->ifr_data, &priv->hwts_config, sizeof(priv->hwts_config)) ? -EFAULT : 0;
+    default:
+        return -EOPNOTSUPP;
+    }
+}
 
-            // leave priv->skb populated, either for retry, or if under shutdown, to be freed by
-            // rpmsg_remove()
-            return;
+// mqprio in channel mode maps priorities to traffic classes and classes to ranges of queues, i.e.
+// of RPMsg endpoints. With more than one class the queues of the last are urgent: drained ahead of
+// the others here, and fed to the stack ahead of the others by the remote. The queues of a class
+// share nothing but the vring, so a bulk transfer no longer holds back control messages in our
+// tx_ring or in the remote's RX task; the vring buffers themselves are yielded, not reserved.
+static int rpmsg_eth_setup_tc(struct net_device *ndev, enum tc_setup_type type, void *type_data)
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    // the first member of struct tc_mqprio_qopt_offload on the kernels that have it
+    struct tc_mqprio_qopt *mqprio = type_data;
+    struct rpmsg_eth_queue *q;
+    unsigned int i, top;
+    u32 urgent = 0;
+    int err;
+
+    if (type != TC_SETUP_QDISC_MQPRIO) {
+        return -EOPNOTSUPP;
+    }
+
+    if (mqprio->num_tc > priv->num_queues) {
+        return -EINVAL;
+    }
+    if (mqprio->num_tc > 1) {
+        top = mqprio->num_tc - 1;
+        if (mqprio->count[top] == 0 || mqprio->offset[top] + mqprio->count[top] > priv->num_queues) {
+            return -EINVAL;
         }
+        urgent = GENMASK(mqprio->offset[top] + mqprio->count[top] - 1, mqprio->offset[top]);
+    }
+
+    // the remote cannot be told afterwards that the setup was refused
+    err = rpmsg_eth_send_prio(priv, urgent);
+    if (err) {
+        return err;
     }
 
-cleanup:
-    // return the skb to the network stack
-    if (priv->skb != NULL) {
-        dev_consume_skb_any(priv->skb);
-        priv->skb = NULL;
+    if (mqprio->num_tc == 0) {
+        netdev_reset_tc(ndev);
+    } else {
+        err = netdev_set_num_tc(ndev, mqprio->num_tc);
+        if (err) {
+            return err;
+        }
+        for (i = 0; i < mqprio->num_tc; i++) {
+            netdev_set_tc_queue(ndev, i, mqprio->count[i], mqprio->offset[i]);
+        }
+        for (i = 0; i <= TC_BITMASK; i++) {
+            netdev_set_prio_tc_map(ndev, i, mqprio->prio_tc_map[i]);
+        }
     }
+    mqprio->hw = TC_MQPRIO_HW_OFFLOAD_TCS;
+
+    for (i = 0; i < priv->num_queues; i++) {
+        q = &priv->queues[i];
+        WRITE_ONCE(q->urgent, !!(urgent & BIT(i)));
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+        // the scheduler then runs an urgent drain ahead of a bulk one on the same CPU
+        if (q->tx_task && urgent && !q->urgent) {
+            sched_set_fifo_low(q->tx_task);
+        } else if (q->tx_task) {
+            sched_set_fifo(q->tx_task);
+        }
+#endif
+    }
+    WRITE_ONCE(priv->urgent_queues, urgent);
+    return 0;
+}
 
-    priv->is_delayed = false;
+// How long a queue may stay stopped on a full tx_ring before rpmsg_eth_tx_timeout()
+#define RPMSG_ETH_TX_TIMEOUT (5 * HZ)
 
-    // if not shutdown, re-activate the network stack xmit queue
-    spin_lock_irqsave(&priv->shutdown_lock, flags);
-    if (!priv->is_shutdown) {
-        netif_wake_queue(priv->netdev);
+// The remote has not taken a frame from a full tx_ring for RPMSG_ETH_TX_TIMEOUT
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+static void rpmsg_eth_tx_timeout(struct net_device *ndev, unsigned int txqueue)
+#else
+static void rpmsg_eth_tx_timeout(struct net_device *ndev)
+#endif
+{
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    unsigned int i;
+
+    rpmsg_eth_peer_lost(priv);
+
+    // the drain side empties tx_ring, which wakes the queues
+    for (i = 0; i < priv->num_queues; i++) {
+        rpmsg_eth_tx_kick(&priv->queues[i]);
     }
-    spin_unlock_irqrestore(&priv->shutdown_lock, flags);
 }
 
-static int rpmsg_eth_open(struct net_device *ndev)
+// ip link set mtu, up to the MTU in the remote's hello. The remote's netif follows, and TCP
+// connections opened from then on use the new MSS on both sides. Frames in flight at the old size
+// are dropped as too long by whichever side went down.
+static int rpmsg_eth_change_mtu(struct net_device *ndev, int new_mtu)
 {
-    netif_start_queue(ndev);
+    struct rpmsg_eth_private *priv = netdev_priv(ndev);
+    struct xsk_buff_pool *pool = rtnl_dereference(priv->queues[0].xsk_pool);
+    int err;
+
+    if (pool && xsk_pool_get_rx_frame_size(pool) < new_mtu + ETH_HLEN) {
+        return -EINVAL;
+    }
+    // a remote that cannot follow keeps sending at the MTU of our hello
+    if (new_mtu < ndev->mtu && netif_carrier_ok(ndev) &&
+        !(READ_ONCE(priv->remote_features) & RPMSG_ETH_F_MTU)) {
+        return -EOPNOTSUPP;
+    }
+
+    if (netif_carrier_ok(ndev)) {
+        err = rpmsg_eth_send_mtu(priv, new_mtu);
+        if (err) {
+            return err;
+        }
+    }
+    WRITE_ONCE(ndev->mtu, new_mtu);
+    // the RX pool swaps smaller skbs for new ones as it hands them out
+    WRITE_ONCE(priv->rx_buf_len, new_mtu + ETH_HLEN);
     return 0;
 }
 
-int rpmsg_eth_stop (struct net_device *dev)
+static const struct net_device_ops netdev_ops = {
+    .ndo_open           = rpmsg_eth_open,
+    .ndo_stop           = rpmsg_eth_stop,
+    .ndo_start_xmit     = rpmsg_eth_xmit,
+    .ndo_tx_timeout     = rpmsg_eth_tx_timeout,
+    .ndo_change_mtu     = rpmsg_eth_change_mtu,
+    .ndo_validate_addr  = eth_validate_addr,
+    .ndo_set_mac_address = eth_mac_addr,
+    .ndo_get_stats64    = rpmsg_eth_get_stats64,
+    .ndo_bpf            = rpmsg_eth_bpf,
+    .ndo_xsk_wakeup     = rpmsg_eth_xsk_wakeup,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+    .ndo_eth_ioctl      = rpmsg_eth_ioctl,
+#else
+    .ndo_do_ioctl       = rpmsg_eth_ioctl,
+#endif
+    .ndo_setup_tc       = rpmsg_eth_setup_tc,
+};
+
+static void rpmsg_eth_free_queues(struct rpmsg_eth_private *priv)
+{
+    struct rpmsg_eth_queue *q;
+    unsigned int i;
+
+    for (i = 0; i < priv->num_queues; i++) {
+        q = &priv->queues[i];
+
+        if (q->tx_task) {
+            kthread_stop(q->tx_task);
+            q->tx_task = NULL;
+        }
+
+        // free skbs, in case they were abandoned by a cancelled work queue request
+        while (q->tx_ring && CIRC_CNT(q->tx_head, q->tx_clean, q->tx_ring_size) > 0) {
+            dev_consume_skb_any(q->tx_ring[q->tx_clean]);
+            q->tx_ring[q->tx_clean] = NULL;
+            q->tx_clean = (q->tx_clean + 1) & (q->tx_ring_size - 1);
+        }
+        // they never get completed, so BQL must forget about them
+        netdev_tx_reset_queue(netdev_get_tx_queue(priv->netdev, i));
+
+        rpmsg_eth_rx_abort(q);
+
+        if (i > 0 && q->ept) {
+            rpmsg_destroy_ept(q->ept);
+        }
+        q->ept = NULL;
+
+        kfree(q->tx_ring);
+        q->tx_ring = NULL;
+        kfree(q->tx_stamp);
+        q->tx_stamp = NULL;
+        kfree(q->tx_mark);
+        q->tx_mark = NULL;
+        kfree(q->tx_buf);
+        q->tx_buf = NULL;
+    }
+}
+
+static int rpmsg_eth_init_queue(struct rpmsg_eth_private *priv, unsigned int index)
 {
-    netif_stop_queue(dev);
+    struct rpmsg_device *rpdev = priv->rpdev;
+    struct rpmsg_eth_queue *q = &priv->queues[index];
+    struct rpmsg_channel_info chinfo = {
+        .src = RPMSG_ADDR_ANY,
+        .dst = rpdev->dst + index,
+    };
+
+    q->priv = priv;
+    q->index = index;
+    INIT_WORK(&q->immediate, net_xmit_work_handler);
+    INIT_DELAYED_WORK(&q->delayed, net_xmit_delayed_work_handler);
+    q->tx_ring_size = roundup_pow_of_two(clamp_t(unsigned int, tx_ring_size, 2, RPMSG_ETH_TX_RING_MAX));
+    q->tx_ring = kcalloc(q->tx_ring_size, sizeof(*q->tx_ring), GFP_KERNEL);
+    q->tx_stamp = kcalloc(q->tx_ring_size, sizeof(*q->tx_stamp), GFP_KERNEL);
+    q->tx_mark = kcalloc(q->tx_ring_size, sizeof(*q->tx_mark), GFP_KERNEL);
+    q->tx_buf = kmalloc(priv->buf_size, GFP_KERNEL);
+    if (!q->tx_ring || !q->tx_stamp || !q->tx_mark || !q->tx_buf) {
+        return -ENOMEM;
+    }
+    memset(&q->xstats, 0, sizeof(q->xstats));
+    q->tx_head = 0;
+    q->tx_tail = 0;
+    q->tx_clean = 0;
+    q->tx_offset = 0;
+    q->tx_reclaim = false;
+    q->rx_skb = NULL;
+    q->is_delayed = false;
+    q->urgent = false;
+    spin_lock_init(&q->shutdown_lock);
+    init_waitqueue_head(&q->tx_wq);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(&q->tx_timer, rpmsg_eth_tx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+    hrtimer_init(&q->tx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    q->tx_timer.function = rpmsg_eth_tx_timer;
+#endif
+    q->tx_task = NULL;
+
+    if (index == 0) {
+        q->ept = rpdev->ept;
+        q->ept->priv = q;
+    } else {
+        snprintf(chinfo.name, sizeof(chinfo.name), "rpmsg-eth-q%u", index);
+        q->ept = rpmsg_create_ept(rpdev, rpmsg_eth_rx_cb, q, chinfo);
+        if (!q->ept) {
+            return -ENOMEM;
+        }
+    }
+    q->dst = chinfo.dst;
+
     return 0;
 }
 
+// The remote answered us after it was lost, and offered its region again with both control blocks
+// reset. It is the same region, which stays mapped; only our indices start over.
+static void rpmsg_eth_shm_resync(struct rpmsg_eth_private *priv)
+{
+    struct rpmsg_eth_shm *shm = priv->shm;
+    struct rpmsg_eth_queue *q = &priv->queues[0];
+    bool running;
+    int err;
+
+    if (be32_to_cpu(priv->shm_offer.ring_size) != shm->ring_size) {
+        dev_err(&priv->rpdev->dev, "shared-memory offer changed, frames keep to RPMsg buffers\n");
+        return;
+    }
+
+    // keep the poll loop off ring 1 meanwhile
+    rtnl_lock();
+    running = use_napi && netif_running(priv->netdev);
+    if (running) {
+        napi_disable(&priv->napi);
+    }
+    shm->tx_head = le32_to_cpu(READ_ONCE(shm->tx->head));
+    shm->rx_tail = le32_to_cpu(READ_ONCE(shm->rx->tail));
+    WRITE_ONCE(shm->rx->cons_wait, cpu_to_le32(1));
+    if (running) {
+        napi_enable(&priv->napi);
+    }
+    rtnl_unlock();
+
+    // the drain side takes ring 0 again from its next frame
+    WRITE_ONCE(priv->shm_resync, false);
 
-struct net_device_stats *rpmsg_eth_stats(struct net_device *dev)
+    err = rpmsg_sendto(q->ept, &priv->shm_offer, sizeof(priv->shm_offer), q->dst);
+    if (err) {
+        dev_err(&priv->rpdev->dev, "cannot accept shared-memory offer: %d; only sending through it\n", err);
+    }
+}
+
+// Map the region the remote offered and accept it by echoing the offer
+static void rpmsg_eth_shm_work(struct work_struct *work)
 {
-    struct rpmsg_eth_private *priv = netdev_priv(dev);
-    return &priv->stats;
+    struct rpmsg_eth_private *priv = container_of(work, struct rpmsg_eth_private, shm_work);
+    const struct rpmsg_eth_shm_offer *offer = &priv->shm_offer;
+    struct rpmsg_eth_queue *q = &priv->queues[0];
+    phys_addr_t addr = ((u64)be32_to_cpu(offer->addr_hi) << 32) | be32_to_cpu(offer->addr_lo);
+    u32 size = be32_to_cpu(offer->size);
+    u32 ring_size = be32_to_cpu(offer->ring_size);
+    struct rpmsg_eth_shm *shm;
+    int err;
+
+    if (priv->shm) {
+        if (READ_ONCE(priv->shm_resync)) {
+            rpmsg_eth_shm_resync(priv);
+        }
+        return;
+    }
+
+    if (!is_power_of_2(ring_size) || ring_size < PAGE_SIZE ||
+        2 * sizeof(struct rpmsg_eth_shm_ring) + 2 * (u64)ring_size > size) {
+        dev_err(&priv->rpdev->dev, "ignoring shared-memory offer of %u bytes with %u byte rings\n", size, ring_size);
+        return;
+    }
+
+    shm = kzalloc(sizeof(*shm), GFP_KERNEL);
+    if (!shm) {
+        return;
+    }
+
+    // The region must be reserved memory that the kernel does not map itself. It is mapped
+    // uncached, since the remote does not snoop our caches.
+    shm->base = memremap(addr, size, MEMREMAP_WC);
+    if (!shm->base) {
+        dev_err(&priv->rpdev->dev, "cannot map shared memory at %pa\n", &addr);
+        kfree(shm);
+        return;
+    }
+    shm->tx = shm->base;
+    shm->rx = shm->tx + 1;
+    shm->tx_data = (u8 *)(shm->rx + 1);
+    shm->rx_data = shm->tx_data + ring_size;
+    shm->ring_size = ring_size;
+
+    // the remote has reset both control blocks before offering them
+    shm->tx_head = le32_to_cpu(READ_ONCE(shm->tx->head));
+    shm->rx_tail = le32_to_cpu(READ_ONCE(shm->rx->tail));
+    WRITE_ONCE(shm->rx->cons_wait, cpu_to_le32(1));
+
+    // Ring 0 may be used right away, the remote consumes it as soon as it has made the offer. It
+    // only produces on ring 1 once it has our echo, and its first doorbell must find shm set.
+    WRITE_ONCE(priv->shm, shm);
+
+    err = rpmsg_sendto(q->ept, &priv->shm_offer, sizeof(priv->shm_offer), q->dst);
+    if (err) {
+        dev_err(&priv->rpdev->dev, "cannot accept shared-memory offer: %d; only sending through it\n", err);
+        return;
+    }
+
+    dev_info(&priv->rpdev->dev, "using shared-memory rings of %u bytes at %pa\n", ring_size, &addr);
 }
 
-static int rpmsg_eth_rx_cb(struct rpmsg_device *rpdev, void *data, int len, void *drv_priv, u32 src)
+// Called once nothing can reach the rings any more
+static void rpmsg_eth_shm_free(struct rpmsg_eth_private *priv)
 {
-    struct rpmsg_eth_private *priv = dev_get_drvdata(&rpdev->dev);
-    struct sk_buff *skb;
+    if (priv->shm) {
+        memunmap(priv->shm->base);
+        kfree(priv->shm);
+        priv->shm = NULL;
+    }
+}
+
+static int rpmsg_eth_send_hello(struct rpmsg_eth_queue *q)
+{
+    struct rpmsg_eth_private *priv = q->priv;
+    struct rpmsg_eth_hello hello = {
+        .magic = cpu_to_be32(RPMSG_ETH_HELLO_MAGIC),
+        .version = cpu_to_be16(RPMSG_ETH_HELLO_VERSION),
+        .mtu = cpu_to_be16(priv->netdev->mtu),
+        .buf_size = cpu_to_be16(priv->buf_size),
+        .num_queues = priv->num_queues,
+        .features = cpu_to_be32(RPMSG_ETH_F_PACK | (csum_offload ? RPMSG_ETH_F_CSUM : 0) |
+                                (raw_ip ? RPMSG_ETH_F_RAW : 0) | RPMSG_ETH_F_TSTAMP | RPMSG_ETH_F_MCAST |
+                                RPMSG_ETH_F_HASH | (csum_offload && rx_gso ? RPMSG_ETH_F_TSO : 0)),
+        .tso_max = cpu_to_be16(csum_offload && rx_gso ? RPMSG_ETH_RX_TSO_MAX : 0),
+    };
+
+    memcpy(hello.mac, priv->netdev->dev_addr, ETH_ALEN);
+
+    // a remote that does not consume is probed again later rather than waited for
+    return rpmsg_trysendto(q->ept, &hello, sizeof(hello), q->dst);
+}
 
-    skb = dev_alloc_skb(len + 2);
+// The remote firmware may still be booting when we probe. The netdev is registered with the carrier
+// off, and the hello is repeated on every endpoint until the remote answers it; every hello also
+// tells the remote side the master node's return address. The carrier goes on in hello_work.
+#define RPMSG_ETH_HELLO_RETRY_MIN (HZ / 10)
+#define RPMSG_ETH_HELLO_RETRY_MAX (5 * HZ)
 
-    skb_reserve(skb, 2); /* align IP on 16B boundary */
-    memcpy(skb_put(skb, len), data, len);
+static void rpmsg_eth_hello_retry_work(struct work_struct *work)
+{
+    struct rpmsg_eth_private *priv = container_of(to_delayed_work(work), struct rpmsg_eth_private,
+                                                  hello_retry);
+    unsigned int i;
+    int err;
 
-    skb->dev = priv->netdev;
-    skb->protocol = eth_type_trans(skb, priv->netdev);
-    skb->ip_summed = CHECKSUM_UNNECESSARY; /* don't check it */
-    priv->stats.rx_packets++;
-    priv->stats.rx_bytes += len;
-    netif_rx(skb);
+    if (READ_ONCE(priv->hello_done) || READ_ONCE(priv->is_shutdown)) {
+        return;
+    }
 
-    return 0;
+    for (i = 0; i < priv->num_queues; i++) {
+        err = rpmsg_eth_send_hello(&priv->queues[i]);
+        if (err) {
+            dev_dbg(&priv->rpdev->dev, "hello on queue %u failed: %d\n", i, err);
+        }
+    }
+
+    schedule_delayed_work(&priv->hello_retry, priv->hello_delay);
+    priv->hello_delay = min_t(unsigned long, priv->hello_delay * 2, RPMSG_ETH_HELLO_RETRY_MAX);
 }
 
-static const struct net_device_ops netdev_ops = {
-    .ndo_open           = rpmsg_eth_open,
-    .ndo_stop           = rpmsg_eth_stop,
-    .ndo_start_xmit     = rpmsg_eth_xmit,
-    .ndo_validate_addr  = eth_validate_addr,
-    .ndo_get_stats      = rpmsg_eth_stats,
+// The remote stopped taking what we send: a send failed on its retry too, or a queue stayed stopped
+// for watchdog_timeo. Rather than retry and drop frame after frame, take the carrier down, drop
+// what is queued and probe with hellos, backing off as at probe time. The remote's answer brings
+// the link back up at full speed through hello_work.
+static void rpmsg_eth_peer_lost(struct rpmsg_eth_private *priv)
+{
+    if (READ_ONCE(priv->is_shutdown) || atomic_xchg(&priv->peer_lost, 1)) {
+        return;
+    }
 
-};
+    netdev_warn(priv->netdev, "the remote stopped taking frames, link down until it answers\n");
+    netif_carrier_off(priv->netdev);
+    // rpmsg_eth_poll() refills it once frames flow again
+    skb_queue_purge(&priv->rx_pool);
+    if (READ_ONCE(priv->shm)) {
+        WRITE_ONCE(priv->shm_resync, true);
+    }
+
+    WRITE_ONCE(priv->hello_done, false);
+    priv->hello_delay = RPMSG_ETH_HELLO_RETRY_MIN;
+    mod_delayed_work(system_wq, &priv->hello_retry, RPMSG_ETH_HELLO_RETRY_MIN);
+}
+
+// Payload size of the RPMsg buffers behind the channel endpoint, capped to what the 16 bit link
+// header and hello fields can describe.
+static unsigned int rpmsg_eth_buf_size(struct rpmsg_device *rpdev)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 14, 0)
+    ssize_t size = rpmsg_get_mtu(rpdev->ept);
+
+    if (size > (ssize_t)sizeof(struct rpmsg_eth_frag_hdr)) {
+        return min_t(size_t, size, U16_MAX);
+    }
+#endif
+    return RPMSG_SIZE;
+}
+
+// raw_ip: a point-to-point device without link-layer header or address, set up like tun's
+static void rpmsg_eth_raw_setup(struct net_device *ndev)
+{
+    ndev->type = ARPHRD_NONE;
+    ndev->header_ops = NULL;
+    ndev->hard_header_len = 0;
+    ndev->addr_len = 0;
+    ndev->flags = IFF_POINTOPOINT | IFF_NOARP | IFF_MULTICAST;
+}
+
+// A CPU from rx_cpu or tx_cpu, or -1 if it is unset or no CPU to bind to
+static int rpmsg_eth_check_cpu(struct device *dev, const char *name, int cpu)
+{
+    if (cpu < 0) {
+        return -1;
+    }
+    if (cpu >= nr_cpu_ids || !cpu_online(cpu)) {
+        dev_warn(dev, "ignoring %s %d, no such CPU online\n", name, cpu);
+        return -1;
+    }
+    return cpu;
+}
 
 static int rpmsg_eth_probe(struct rpmsg_device *rpdev)
 {
-    char dummy_payload[] = "dummy_payload";
     struct device *dev = &rpdev->dev;
     struct net_device *netdev;
     struct rpmsg_eth_private *priv;
-    char mac[ETH_ALEN] = {0};
+    u8 mac[ETH_ALEN] = {0};
+    unsigned int nq = clamp_t(unsigned int, num_queues, 1, RPMSG_ETH_MAX_QUEUES);
+    unsigned int buf_size = rpmsg_eth_buf_size(rpdev);
+    unsigned int link_mtu = mtu;
+    unsigned int i;
     int retval;
   
 
-    mac[ETH_ALEN - 1] = 1;
+    if (!mac_addr || !mac_pton(mac_addr, mac) || !is_valid_ether_addr(mac)) {
+        if (mac_addr) {
+            dev_warn(dev, "ignoring invalid mac_addr %s\n", mac_addr);
+        }
+        memset(mac, 0, sizeof(mac));
+        mac[ETH_ALEN - 1] = 1;
+    }
 
-    netdev = alloc_etherdev(sizeof(struct rpmsg_eth_private));
-    if (IS_ERR(netdev))
-        return PTR_ERR(netdev);
+    netdev = alloc_etherdev_mqs(sizeof(struct rpmsg_eth_private), nq, 1);
+    if (!netdev)
+        return -ENOMEM;
 
     netdev->netdev_ops = &netdev_ops;
-    netdev->mtu            = MTU_RPMSG;
+    netdev->ethtool_ops = &rpmsg_eth_ethtool_ops;
+    // SG and FRAGLIST: every fragment is gathered into tx_buf with skb_copy_bits(), so paged and
+    // chained skbs need no skb_linearize() in the core first. RXHASH: the remote's flow hash, see
+    // RPMSG_ETH_HASH_OFFSET; frames without one are hashed by RPS itself.
+    netdev->hw_features    = NETIF_F_SG | NETIF_F_FRAGLIST | NETIF_F_RXHASH;
+    netdev->features       = netdev->hw_features;
+    if (!link_mtu) {
+        link_mtu = max_t(int, ETH_DATA_LEN, (int)(buf_size - sizeof(struct rpmsg_eth_frag_hdr)) - ETH_HLEN);
+    }
+    netdev->mtu            = clamp_t(unsigned int, link_mtu, ETH_MIN_MTU, U16_MAX - ETH_HLEN);
+    netdev->max_mtu        = RPMSG_ETH_MAX_MTU;
+    netdev->watchdog_timeo = RPMSG_ETH_TX_TIMEOUT;
 
     strscpy(netdev->name, "rpmsg_net%d", sizeof(netdev->name));
 
     eth_hw_addr_set(netdev, mac);
+    // after the address is set; it stays in dev_addr for the hello
+    if (raw_ip) {
+        rpmsg_eth_raw_setup(netdev);
+    }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    // binding an AF_XDP socket in zero-copy mode checks for NETDEV_XDP_ACT_XSK_ZEROCOPY
+    if (use_napi && !raw_ip) {
+        netdev->xdp_features = NETDEV_XDP_ACT_BASIC | NETDEV_XDP_ACT_REDIRECT | NETDEV_XDP_ACT_XSK_ZEROCOPY;
+    }
+#endif
+
+    netdev->tstats = netdev_alloc_pcpu_stats(struct pcpu_sw_netstats);
+    if (!netdev->tstats) {
+        free_netdev(netdev);
+        return -ENOMEM;
+    }
 
     priv = netdev_priv(netdev);
 
     priv->rpdev = rpdev;
     priv->netdev = netdev;
-    INIT_WORK(&priv->immediate, net_xmit_work_handler);
-    INIT_DELAYED_WORK(&priv->delayed, net_xmit_delayed_work_handler);
-    priv->skb = NULL;
-    priv->is_delayed = false;
-    spin_lock_init(&priv->shutdown_lock);
     priv->is_shutdown = false;
-
-    dev_set_drvdata(dev, priv);
-
-    // RPMsg remote side expects a fake first packet to learn the master node's return address.
-    // The remote end will discard this packet
-    retval = rpmsg_send(rpdev->ept, dummy_payload, strlen(dummy_payload));
+    priv->rx_alloc_fail = 0;
+    priv->rx_backlog_drops = 0;
+    priv->tx_coalesce_usecs = 0;
+    priv->tx_coalesce_frames = 0;
+    priv->rx_coalesce_usecs = 0;
+    priv->rx_coalesce_frames = 0;
+    priv->rx_ring_size = clamp_t(unsigned int, rx_ring_size, 1, RPMSG_ETH_RX_RING_MAX);
+    priv->tx_queues = nq;
+    priv->urgent_queues = 0;
+    priv->remote_features = 0;
+    priv->csum_free = false;
+    spin_lock_init(&priv->mcast_lock);
+    priv->mcast_all = true;
+    priv->mcast_count = 0;
+    priv->tx_mcast_filtered = 0;
+    memset(priv->remote_stats, 0, sizeof(priv->remote_stats));
+    priv->buf_size = buf_size;
+    priv->tx_msg_size = buf_size;
+    priv->remote_mtu = netdev->max_mtu;
+    priv->rx_cpu = rpmsg_eth_check_cpu(dev, "rx_cpu", use_napi ? rx_cpu : -1);
+    priv->tx_cpu = rpmsg_eth_check_cpu(dev, "tx_cpu", tx_cpu);
+    priv->remote_queues = nq;
+    priv->remote_tso_max = 0;
+    INIT_WORK(&priv->hello_work, rpmsg_eth_hello_work);
+    INIT_DELAYED_WORK(&priv->hello_retry, rpmsg_eth_hello_retry_work);
+    priv->hello_delay = RPMSG_ETH_HELLO_RETRY_MIN;
+    priv->hello_done = false;
+    atomic_set(&priv->peer_lost, 0);
+    priv->shm = NULL;
+    priv->shm_resync = false;
+    INIT_WORK(&priv->shm_work, rpmsg_eth_shm_work);
+    priv->ts_skb = NULL;
+    spin_lock_init(&priv->ts_lock);
+    skb_queue_head_init(&priv->rx_queue);
+    skb_queue_head_init(&priv->rx_pool);
+    // The NAPI instance also serves SO_BUSY_POLL and busy_read/busy_poll: napi_gro_receive() tags
+    // every skb with its napi_id, so a spinning socket calls rpmsg_eth_poll() directly and picks
+    // up frames as soon as the RPMsg callback queues them, without waiting for the softirq.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+    netif_napi_add(netdev, &priv->napi, rpmsg_eth_poll);
+#else
+    netif_napi_add(netdev, &priv->napi, rpmsg_eth_poll, NAPI_POLL_WEIGHT);
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+    retval = xdp_rxq_info_reg(&priv->xdp_rxq, netdev, 0, 0);
+#else
+    retval = xdp_rxq_info_reg(&priv->xdp_rxq, netdev, 0);
+#endif
+    if (retval) {
+        free_percpu(netdev->tstats);
+        free_netdev(netdev);
+        return retval;
+    }
+    // the buffers of this one come from an AF_XDP socket's pool, see rpmsg_eth_run_xsk()
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+    retval = xdp_rxq_info_reg(&priv->xsk_rxq, netdev, 0, 0);
+#else
+    retval = xdp_rxq_info_reg(&priv->xsk_rxq, netdev, 0);
+#endif
+    if (retval == 0) {
+        retval = xdp_rxq_info_reg_mem_model(&priv->xsk_rxq, MEM_TYPE_XSK_BUFF_POOL, NULL);
+        if (retval) {
+            xdp_rxq_info_unreg(&priv->xsk_rxq);
+        }
+    }
     if (retval) {
-        dev_err(&rpdev->dev, "initial rpmsg_send failed: %d", retval);
+        xdp_rxq_info_unreg(&priv->xdp_rxq);
+        free_percpu(netdev->tstats);
         free_netdev(netdev);
-        netdev = NULL;
         return retval;
     }
 
+    dev_set_drvdata(dev, priv);
+
+    for (i = 0; i < nq; i++) {
+        priv->num_queues = i + 1;
+        retval = rpmsg_eth_init_queue(priv, i);
+        if (retval) {
+            goto err_free;
+        }
+    }
+
+    if (tx_thread) {
+        for (i = 0; i < priv->num_queues; i++) {
+            struct rpmsg_eth_queue *q = &priv->queues[i];
+
+            q->tx_task = kthread_create(rpmsg_eth_tx_thread, q, "rpmsg_eth_tx/%s-%u", dev_name(dev), i);
+            if (IS_ERR(q->tx_task)) {
+                retval = PTR_ERR(q->tx_task);
+                q->tx_task = NULL;
+                goto err_free;
+            }
+            if (priv->tx_cpu >= 0) {
+                kthread_bind(q->tx_task, priv->tx_cpu);
+            }
+            wake_up_process(q->tx_task);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+            sched_set_fifo(q->tx_task);
+#endif
+        }
+    }
+
+    netif_carrier_off(netdev);
+
     retval = register_netdev(netdev);
     if (retval) {
         pr_err("ERROR: %s %s %d\n", __FILE__, __FUNCTION__, __LINE__);
-	return retval;
+        goto err_free;
     }
 
+    // a kthread of its own for rx_cpu, bound in rpmsg_eth_open(); softirq NAPI runs wherever it
+    // was scheduled
+    if (priv->rx_cpu >= 0) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)
+        rtnl_lock();
+        retval = dev_set_threaded(netdev, true);
+        rtnl_unlock();
+        if (retval) {
+            dev_warn(dev, "cannot switch to threaded NAPI for rx_cpu: %d\n", retval);
+            priv->rx_cpu = -1;
+        }
+#else
+        dev_warn(dev, "rx_cpu needs threaded NAPI, Linux 5.12 or later\n");
+        priv->rx_cpu = -1;
+#endif
+    }
+
+    // one queue per CPU: let each CPU transmit on its own queue so they do not serialise
+    for (i = 0; i < priv->num_queues; i++) {
+        if (i < nr_cpu_ids && cpu_possible(i)) {
+            netif_set_xps_queue(netdev, cpumask_of(i), i);
+        }
+    }
+
+    schedule_delayed_work(&priv->hello_retry, 0);
+
     return 0;
+
+err_free:
+    rpmsg_eth_free_queues(priv);
+    rpmsg_eth_shm_free(priv);
+    xdp_rxq_info_unreg(&priv->xsk_rxq);
+    xdp_rxq_info_unreg(&priv->xdp_rxq);
+    free_percpu(netdev->tstats);
+    free_netdev(netdev);
+    return retval;
 }
 
 static void rpmsg_eth_remove(struct rpmsg_device *rpdev)
 {
-    struct rpmsg_eth_private *priv = (struct rpmsg_eth_private*)rpdev->ept->priv;
+    struct rpmsg_eth_private *priv = dev_get_drvdata(&rpdev->dev);
+    struct rpmsg_eth_queue *q;
     unsigned long flags;
+    unsigned int i;
+
+    // the remote is gone or going: the stack stops queueing to us right away
+    netif_carrier_off(priv->netdev);
+
+    // keep a pending retry or a doorbell from scheduling work once it has been cancelled
+    for (i = 0; i < priv->num_queues; i++) {
+        q = &priv->queues[i];
+        spin_lock_irqsave(&q->shutdown_lock, flags);
+        priv->is_shutdown = true;
+        spin_unlock_irqrestore(&q->shutdown_lock, flags);
+    }
 
-    // prevent any in-flight transmissions from being injected into the work queue
-    spin_lock_irqsave(&priv->shutdown_lock, flags);
-    priv->is_shutdown = true;
-    netif_stop_queue(priv->netdev);
-    spin_unlock_irqrestore(&priv->shutdown_lock, flags);
+    // waits for every rpmsg_eth_xmit() in flight, under the TX queue locks; the next one sees
+    // is_shutdown and drops its frame
+    netif_tx_disable(priv->netdev);
 
     // invariant: since is_shutdown=true and we are on other side of critical section, all work has
     //            already been scheduled, or will not be scheduled (frame dropped).
 
     // cancel all outstanding scheduled work and/or wait for existing work to finish
-    cancel_delayed_work_sync(&priv->delayed);
-    cancel_work_sync(&priv->immediate);
-
-    // invariant: there may still be a lingering net_xmit, but it won't start a work queue, and it
-    //            won't set priv->skb because is_shutdown is true.
-
-    // free skb, in case it was abandoned by a cancelled work queue request
-    if (priv->skb != NULL) {
-        dev_consume_skb_any(priv->skb);
-        priv->skb = NULL;
+    for (i = 0; i < priv->num_queues; i++) {
+        q = &priv->queues[i];
+        hrtimer_cancel(&q->tx_timer);
+        cancel_delayed_work_sync(&q->delayed);
+        cancel_work_sync(&q->immediate);
     }
 
+    // invariant: a transmit after this point sees is_shutdown, so it won't start a work queue, and
+    //            it won't touch tx_ring.
+
+    cancel_delayed_work_sync(&priv->hello_retry);
+    cancel_work_sync(&priv->hello_work);
+    cancel_work_sync(&priv->shm_work);
     unregister_netdev(priv->netdev);
+    netif_napi_del(&priv->napi);
+
+    // the TX kthreads notice is_shutdown after their current packet. that may take as long as one
+    // blocking rpmsg_send() if the remote has stopped consuming buffers.
+    rpmsg_eth_free_queues(priv);
+    rpmsg_eth_shm_free(priv);
 
+    // unregister_netdev() has already detached any XDP program and AF_XDP socket
+    xdp_rxq_info_unreg(&priv->xsk_rxq);
+    xdp_rxq_info_unreg(&priv->xdp_rxq);
+    free_percpu(priv->netdev->tstats);
     free_netdev(priv->netdev);
 }
 
@@ -0,0 +1,132 @@
+/*
+    Tracepoints of rpmsg_eth, for perf and bpftrace:
+
+      perf record -e 'rpmsg_eth:*' -a
+      bpftrace -e 'tracepoint:rpmsg_eth:rpmsg_eth_retry { @[args->queue] = count(); }'
+
+    Each carries the queue index and the depth of the queue it is about: frames waiting in tx_ring
+    on the TX side, skbs waiting for NAPI on the RX side.
+*/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM rpmsg_eth
+
+#if !defined(_RPMSG_ETH_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _RPMSG_ETH_TRACE_H
+
+#include <linux/tracepoint.h>
+
+// Why rpmsg_eth_drop dropped frames
+#define RPMSG_ETH_DROP_SHUTDOWN  0 // the interface is going away
+#define RPMSG_ETH_DROP_TOO_LONG  1 // does not fit the link header
+#define RPMSG_ETH_DROP_SEND_FAIL 2 // the vring had no buffer on the retry, or within the rpmsg timeout
+#define RPMSG_ETH_DROP_MCAST     3 // a multicast the remote did not ask for
+#define RPMSG_ETH_DROP_PEER_LOST 4 // the remote stopped taking frames, see rpmsg_eth_peer_lost()
+
+// A frame queued in tx_ring by ndo_start_xmit
+TRACE_EVENT(rpmsg_eth_xmit,
+    TP_PROTO(unsigned int queue, unsigned int len, unsigned int depth),
+    TP_ARGS(queue, len, depth),
+    TP_STRUCT__entry(
+        __field(unsigned int, queue)
+        __field(unsigned int, len)
+        __field(unsigned int, depth)
+    ),
+    TP_fast_assign(
+        __entry->queue = queue;
+        __entry->len = len;
+        __entry->depth = depth;
+    ),
+    TP_printk("queue=%u len=%u depth=%u", __entry->queue, __entry->len, __entry->depth)
+);
+
+// One RPMsg message handed to the vring, err is what rpmsg_(try)sendto returned
+TRACE_EVENT(rpmsg_eth_send,
+    TP_PROTO(unsigned int queue, unsigned int len, unsigned int depth, int err),
+    TP_ARGS(queue, len, depth, err),
+    TP_STRUCT__entry(
+        __field(unsigned int, queue)
+        __field(unsigned int, len)
+        __field(unsigned int, depth)
+        __field(int, err)
+    ),
+    TP_fast_assign(
+        __entry->queue = queue;
+        __entry->len = len;
+        __entry->depth = depth;
+        __entry->err = err;
+    ),
+    TP_printk("queue=%u len=%u depth=%u err=%d", __entry->queue, __entry->len, __entry->depth,
+              __entry->err)
+);
+
+// The vring was full, the drain worker tries again from the delayed work
+TRACE_EVENT(rpmsg_eth_retry,
+    TP_PROTO(unsigned int queue, unsigned int depth, int err),
+    TP_ARGS(queue, depth, err),
+    TP_STRUCT__entry(
+        __field(unsigned int, queue)
+        __field(unsigned int, depth)
+        __field(int, err)
+    ),
+    TP_fast_assign(
+        __entry->queue = queue;
+        __entry->depth = depth;
+        __entry->err = err;
+    ),
+    TP_printk("queue=%u depth=%u err=%d", __entry->queue, __entry->depth, __entry->err)
+);
+
+// frames transmit frames dropped, len bytes of them where known
+TRACE_EVENT(rpmsg_eth_drop,
+    TP_PROTO(unsigned int queue, unsigned int frames, unsigned int len, unsigned int depth, int reason),
+    TP_ARGS(queue, frames, len, depth, reason),
+    TP_STRUCT__entry(
+        __field(unsigned int, queue)
+        __field(unsigned int, frames)
+        __field(unsigned int, len)
+        __field(unsigned int, depth)
+        __field(int, reason)
+    ),
+    TP_fast_assign(
+        __entry->queue = queue;
+        __entry->frames = frames;
+        __entry->len = len;
+        __entry->depth = depth;
+        __entry->reason = reason;
+    ),
+    TP_printk("queue=%u frames=%u len=%u depth=%u reason=%s", __entry->queue, __entry->frames,
+              __entry->len, __entry->depth,
+              __print_symbolic(__entry->reason,
+                               { RPMSG_ETH_DROP_SHUTDOWN, "shutdown" },
+                               { RPMSG_ETH_DROP_TOO_LONG, "too_long" },
+                               { RPMSG_ETH_DROP_SEND_FAIL, "send_fail" },
+                               { RPMSG_ETH_DROP_MCAST, "mcast" },
+                               { RPMSG_ETH_DROP_PEER_LOST, "peer_lost" }))
+);
+
+// An RPMsg message from the remote, as the callback gets it
+TRACE_EVENT(rpmsg_eth_rx,
+    TP_PROTO(unsigned int queue, unsigned int len, unsigned int depth),
+    TP_ARGS(queue, len, depth),
+    TP_STRUCT__entry(
+        __field(unsigned int, queue)
+        __field(unsigned int, len)
+        __field(unsigned int, depth)
+    ),
+    TP_fast_assign(
+        __entry->queue = queue;
+        __entry->len = len;
+        __entry->depth = depth;
+    ),
+    TP_printk("queue=%u len=%u depth=%u", __entry->queue, __entry->len, __entry->depth)
+);
+
+#endif /* _RPMSG_ETH_TRACE_H */
+
+// The header is not in include/trace/events, tell define_trace.h where it is
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE rpmsg_eth_trace
+#include <trace/define_trace.h>
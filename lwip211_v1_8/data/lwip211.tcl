@@ -729,10 +729,9 @@ proc generate_lwip_opts {libhandle} {
 				error "ERROR: Wrong Tx checksum options. The selected Tx checksum does not match with the HW supported Tx csum offload option"
 				"" "mdt_error"
 			} else {
-				set tx_full_csum [expr ![common::get_property CONFIG.tcp_ip_tx_checksum_offload $libhandle]]
-				puts $lwipopts_fd "\#define CHECKSUM_GEN_TCP $tx_full_csum"
-				puts $lwipopts_fd "\#define CHECKSUM_GEN_UDP $tx_full_csum"
-				puts $lwipopts_fd "\#define CHECKSUM_GEN_IP $tx_full_csum"
+				puts $lwipopts_fd "\#define CHECKSUM_GEN_TCP 1"
+				puts $lwipopts_fd "\#define CHECKSUM_GEN_UDP 1"
+				puts $lwipopts_fd "\#define CHECKSUM_GEN_IP 1"
 			}
 		}
 		set rx_full_csum_temp [common::get_property CONFIG.tcp_ip_rx_checksum_offload $libhandle]
@@ -741,10 +740,9 @@ proc generate_lwip_opts {libhandle} {
 				error "ERROR: Wrong Rx checksum options. The selected Rx checksum does not match with the HW supported Rx csum offload option"
 				"" "mdt_error"
 			} else {
-				set rx_full_csum [expr ![common::get_property CONFIG.tcp_ip_rx_checksum_offload $libhandle]]
-				puts $lwipopts_fd "\#define CHECKSUM_CHECK_TCP $rx_full_csum"
-				puts $lwipopts_fd "\#define CHECKSUM_CHECK_UDP $rx_full_csum"
-				puts $lwipopts_fd "\#define CHECKSUM_CHECK_IP $rx_full_csum"
+				puts $lwipopts_fd "\#define CHECKSUM_CHECK_TCP 1"
+				puts $lwipopts_fd "\#define CHECKSUM_CHECK_UDP 1"
+				puts $lwipopts_fd "\#define CHECKSUM_CHECK_IP 1"
 			}
 		}
 
@@ -754,8 +752,7 @@ proc generate_lwip_opts {libhandle} {
 				error "ERROR: Wrong Tx checksum options. The selected Tx checksum does not match with the HW supported Tx csum offload option"
 				"" "mdt_error"
 			} else {
-				set tx_csum [expr ![common::get_property CONFIG.tcp_tx_checksum_offload $libhandle]]
-				puts $lwipopts_fd "\#define CHECKSUM_GEN_TCP $tx_csum"
+				puts $lwipopts_fd "\#define CHECKSUM_GEN_TCP 1"
 			}
 		}
 		set rx_csum_temp [common::get_property CONFIG.tcp_rx_checksum_offload $libhandle]
@@ -764,8 +761,7 @@ proc generate_lwip_opts {libhandle} {
 				error "ERROR: Wrong Rx checksum options. The selected Rx checksum does not match with the HW supported Rx csum offload option"
 				"" "mdt_error"
 			} else {
-				set rx_csum [expr ![common::get_property CONFIG.tcp_rx_checksum_offload $libhandle]]
-				puts $lwipopts_fd "\#define CHECKSUM_CHECK_TCP $rx_csum"
+				puts $lwipopts_fd "\#define CHECKSUM_CHECK_TCP 1"
 			}
 		}
 
@@ -792,6 +788,11 @@ proc generate_lwip_opts {libhandle} {
 		if {$rx_csum_temp == true} {
 			puts $lwipopts_fd "\#define LWIP_PARTIAL_CSUM_OFFLOAD_RX  1"
 		}
+		if {$tx_full_csum_temp == true || $rx_full_csum_temp == true ||
+		    $tx_csum_temp == true || $rx_csum_temp == true} {
+			# the netif clears the checksums its hardware handles
+			puts $lwipopts_fd "\#define LWIP_CHECKSUM_CTRL_PER_NETIF 1"
+		}
 
 	} else {
 		if {$have_emaclite == 1} {
@@ -802,12 +803,14 @@ proc generate_lwip_opts {libhandle} {
 			puts $lwipopts_fd "\#define CHECKSUM_CHECK_UDP  1"
 			puts $lwipopts_fd "\#define CHECKSUM_CHECK_IP 	1"
 		} else {
-			puts $lwipopts_fd "\#define CHECKSUM_GEN_TCP 	0"
-			puts $lwipopts_fd "\#define CHECKSUM_GEN_UDP 	0"
-			puts $lwipopts_fd "\#define CHECKSUM_GEN_IP  	0"
-			puts $lwipopts_fd "\#define CHECKSUM_CHECK_TCP  0"
-			puts $lwipopts_fd "\#define CHECKSUM_CHECK_UDP  0"
-			puts $lwipopts_fd "\#define CHECKSUM_CHECK_IP 	0"
+			puts $lwipopts_fd "\#define CHECKSUM_GEN_TCP 	1"
+			puts $lwipopts_fd "\#define CHECKSUM_GEN_UDP 	1"
+			puts $lwipopts_fd "\#define CHECKSUM_GEN_IP  	1"
+			puts $lwipopts_fd "\#define CHECKSUM_CHECK_TCP  1"
+			puts $lwipopts_fd "\#define CHECKSUM_CHECK_UDP  1"
+			puts $lwipopts_fd "\#define CHECKSUM_CHECK_IP 	1"
+			# the GEM netif clears the checksums its hardware handles
+			puts $lwipopts_fd "\#define LWIP_CHECKSUM_CTRL_PER_NETIF 1"
 			puts $lwipopts_fd "\#define LWIP_FULL_CSUM_OFFLOAD_RX  1"
 			puts $lwipopts_fd "\#define LWIP_FULL_CSUM_OFFLOAD_TX  1"
 		}
@@ -26,8 +26,16 @@
  *
  */
 
+#include <stddef.h>
+#include <string.h>
+
 #include "ff.h"
 #include "xil_printf.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include "lwip/apps/tftp_server.h"
+
+#include "freertos_lwip_example_tftp_platform_fs.h"
 
 int platform_init_fs()
 {
@@ -56,3 +64,235 @@ int platform_init_fs()
 
 	return 0;
 }
+
+/* tftp_context for the lwIP TFTP server (lwip/apps/tftp_server.h), which runs
+ * in tcpip_thread. Files are read by a read-ahead thread into a ring of
+ * blocks; read() only copies from the ring and never waits for the storage. If
+ * the ring runs dry it returns ERR_WOULDBLOCK, and the read-ahead thread calls
+ * tftp_read_ready() once it has filled a block.
+ * Writes go to the file directly.
+ */
+
+#define TFTP_FS_BLOCK_SIZE	512
+#define TFTP_FS_RING_SIZE	(TFTP_FS_RING_BLOCKS * TFTP_FS_BLOCK_SIZE)
+/* a transfer can still be closing while the next one opens */
+#define TFTP_FS_NUM_FILES	2
+#define TFTP_FS_MBOX_SIZE	(3 * TFTP_FS_NUM_FILES)
+
+struct tftp_fs_file {
+	FIL fil;
+	volatile int in_use;	/* cleared by the read-ahead thread */
+	int write;
+	/* read: set by tcpip_thread, the read-ahead thread opens and closes */
+	char fname[TFTP_FS_MAX_FILENAME];
+	volatile int closing;
+	int opened;
+	volatile int err;
+	volatile int eof;
+	/* bytes put into the ring by the read-ahead thread and taken out by
+	 * read(), each written by one side only */
+	volatile u32_t produced;
+	volatile u32_t consumed;
+	/* messages to the read-ahead thread: the file is free again when it
+	 * has handled all of them */
+	u32_t posted;
+	volatile u32_t handled;
+	volatile int filler_waiting;	/* ring full, wake it up on read() */
+	volatile int reader_waiting;	/* ring empty, call tftp_read_ready() */
+	u8_t ring[TFTP_FS_RING_SIZE];
+};
+
+static struct tftp_fs_file tftp_fs_files[TFTP_FS_NUM_FILES];
+static sys_mbox_t tftp_fs_mbox;
+
+static void tftp_fs_read_ready(void *arg)
+{
+	tftp_read_ready();
+}
+
+static void tftp_fs_post(struct tftp_fs_file *f)
+{
+	/* each file has at most three messages queued: open, close and one
+	 * wakeup, so this does not fail */
+	if (sys_mbox_trypost(&tftp_fs_mbox, f) == ERR_OK)
+		f->posted++;
+	else
+		xil_printf("TFTP fs: read-ahead mbox full\r\n");
+}
+
+/* read blocks of the file into the ring until it is full */
+static void tftp_fs_fill(struct tftp_fs_file *f)
+{
+	while (!f->closing && !f->err && !f->eof) {
+		unsigned int n;
+		u32_t pos = f->produced % TFTP_FS_RING_SIZE;
+
+		if (f->produced - f->consumed > TFTP_FS_RING_SIZE - TFTP_FS_BLOCK_SIZE) {
+			/* read() may have made room after the check */
+			f->filler_waiting = 1;
+			if (f->produced - f->consumed > TFTP_FS_RING_SIZE - TFTP_FS_BLOCK_SIZE)
+				return;
+			f->filler_waiting = 0;
+		}
+
+		if (f_read(&f->fil, &f->ring[pos], TFTP_FS_BLOCK_SIZE, &n) != FR_OK) {
+			f->err = 1;
+		} else {
+			/* read() takes eof to mean all data is in the ring */
+			f->produced += n;
+			if (n < TFTP_FS_BLOCK_SIZE)
+				f->eof = 1;
+		}
+
+		if (f->reader_waiting) {
+			f->reader_waiting = 0;
+			while (tcpip_callback(tftp_fs_read_ready, NULL) != ERR_OK)
+				sys_msleep(1);
+		}
+	}
+}
+
+static void tftp_fs_thread(void *arg)
+{
+	while (1) {
+		struct tftp_fs_file *f;
+		void *msg;
+
+		sys_mbox_fetch(&tftp_fs_mbox, &msg);
+		f = (struct tftp_fs_file *)msg;
+
+		if (!f->opened && !f->closing && !f->err) {
+			if (f_open(&f->fil, f->fname, FA_READ) == FR_OK)
+				f->opened = 1;
+			else
+				f->err = 1;
+		}
+		if (f->closing) {
+			if (f->opened)
+				f_close(&f->fil);
+			f->opened = 0;
+			/* wakeups posted before the close may still be queued */
+			if (++f->handled == f->posted)
+				f->in_use = 0;
+			continue;
+		}
+		f->handled++;
+		tftp_fs_fill(f);
+		if (f->err && f->reader_waiting) {
+			/* let read() report it */
+			f->reader_waiting = 0;
+			while (tcpip_callback(tftp_fs_read_ready, NULL) != ERR_OK)
+				sys_msleep(1);
+		}
+	}
+}
+
+static void *tftp_fs_open(const char *fname, const char *mode, u8_t write)
+{
+	struct tftp_fs_file *f = NULL;
+	int i;
+
+	if (strlen(fname) >= TFTP_FS_MAX_FILENAME)
+		return NULL;
+	for (i = 0; i < TFTP_FS_NUM_FILES; i++) {
+		if (!tftp_fs_files[i].in_use) {
+			f = &tftp_fs_files[i];
+			break;
+		}
+	}
+	if (f == NULL)
+		return NULL;
+
+	memset(f, 0, offsetof(struct tftp_fs_file, ring));
+	f->write = write;
+	if (write) {
+		if (f_open(&f->fil, fname, FA_CREATE_ALWAYS | FA_WRITE))
+			return NULL;
+		f->in_use = 1;
+		return f;
+	}
+
+	/* the read-ahead thread opens the file, an error shows on read() */
+	strcpy(f->fname, fname);
+	f->in_use = 1;
+	tftp_fs_post(f);
+	return f;
+}
+
+static void tftp_fs_close(void *handle)
+{
+	struct tftp_fs_file *f = (struct tftp_fs_file *)handle;
+
+	if (f->write) {
+		f_close(&f->fil);
+		f->in_use = 0;
+		return;
+	}
+	f->closing = 1;
+	tftp_fs_post(f);
+}
+
+static int tftp_fs_read(void *handle, void *buf, int bytes)
+{
+	struct tftp_fs_file *f = (struct tftp_fs_file *)handle;
+	u32_t avail = f->produced - f->consumed;
+	u32_t pos, n;
+
+	if (f->err)
+		return -1;
+	if (avail < (u32_t)bytes && !f->eof) {
+		f->reader_waiting = 1;
+		/* the read-ahead thread may have filled a block since */
+		if (f->produced - f->consumed < (u32_t)bytes && !f->eof && !f->err)
+			return ERR_WOULDBLOCK;
+		f->reader_waiting = 0;
+		if (f->err)
+			return -1;
+		avail = f->produced - f->consumed;
+	}
+
+	if ((u32_t)bytes > avail)
+		bytes = avail;
+	pos = f->consumed % TFTP_FS_RING_SIZE;
+	n = LWIP_MIN((u32_t)bytes, TFTP_FS_RING_SIZE - pos);
+	memcpy(buf, &f->ring[pos], n);
+	memcpy((u8_t *)buf + n, f->ring, bytes - n);
+	f->consumed += bytes;
+
+	if (f->filler_waiting) {
+		f->filler_waiting = 0;
+		tftp_fs_post(f);
+	}
+	return bytes;
+}
+
+static int tftp_fs_write(void *handle, struct pbuf *p)
+{
+	struct tftp_fs_file *f = (struct tftp_fs_file *)handle;
+	unsigned int n;
+
+	for (; p != NULL; p = p->next) {
+		if (f_write(&f->fil, p->payload, p->len, &n) || n != p->len)
+			return -1;
+	}
+	return 0;
+}
+
+const struct tftp_context tftp_platform_fs_ctx = {
+	tftp_fs_open,
+	tftp_fs_close,
+	tftp_fs_read,
+	tftp_fs_write,
+	NULL
+};
+
+int platform_init_tftp_fs()
+{
+	if (sys_mbox_new(&tftp_fs_mbox, TFTP_FS_MBOX_SIZE) != ERR_OK) {
+		xil_printf("TFTP fs: unable to create the read-ahead mbox\r\n");
+		return -1;
+	}
+	sys_thread_new("tftp_fs", tftp_fs_thread, NULL,
+			TFTP_FS_THREAD_STACKSIZE, DEFAULT_THREAD_PRIO);
+	return 0;
+}
@@ -29,6 +29,21 @@
 #ifndef __PLATFORM_FS_H_
 #define __PLATFORM_FS_H_
 
+struct tftp_context;
+
 int platform_init_fs();
 
+/* Blocks read ahead of the TFTP server, 512 bytes each. Must hold a full
+ * TFTP block (blksize), and should hold a window of them. */
+#define TFTP_FS_RING_BLOCKS		16
+#define TFTP_FS_MAX_FILENAME		256
+#define TFTP_FS_THREAD_STACKSIZE	1024
+
+/* tftp_context for the lwIP TFTP server: pass it to tftp_init() in
+ * tcpip_thread after platform_init_tftp_fs() */
+extern const struct tftp_context tftp_platform_fs_ctx;
+
+/* start the read-ahead thread */
+int platform_init_tftp_fs();
+
 #endif
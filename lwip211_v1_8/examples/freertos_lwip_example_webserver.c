@@ -34,6 +34,11 @@
 
 #include "freertos_lwip_example_webserver.h"
 #include "xil_printf.h"
+#if WEBSERVER_NUM_WORKERS > 0
+#include "ff.h"
+#endif
+
+#define WORKER_STACKSIZE 1024
 
 extern void print_ip(char *msg, ip_addr_t *ip);
 
@@ -59,11 +64,179 @@ void process_http_request(int sd)
 	close(sd);
 }
 
+#if WEBSERVER_NUM_WORKERS > 0
+/* a client connection of a worker */
+struct ws_conn {
+	int sd;			/* -1 if the slot is free */
+	int sending;		/* fil is open and being sent */
+	u32_t last_active;	/* sys_now() of the last progress */
+	FIL fil;
+};
+
+struct ws_worker {
+	struct ws_conn conns[WEBSERVER_CONNS_PER_WORKER];
+	/* all connections of a worker share one buffer: unsent file data is
+	 * not kept in it but read again from the file */
+	char buf[WEBSERVER_BUF_SIZE];
+};
+
+static struct ws_worker ws_workers[WEBSERVER_NUM_WORKERS];
+static int ws_listen_sd;
+
+static void ws_conn_close(struct ws_conn *c)
+{
+	if (c->sending)
+		f_close(&c->fil);
+	c->sending = 0;
+	close(c->sd);
+	c->sd = -1;
+}
+
+/* read the request and answer it: files are sent by ws_conn_send() as the
+ * socket drains, everything else is small and written right away */
+static void ws_conn_request(struct ws_worker *w, struct ws_conn *c)
+{
+	char filename[MAX_FILENAME];
+	int read_len, hlen;
+
+	if ((read_len = read(c->sd, w->buf, WEBSERVER_BUF_SIZE)) <= 0) {
+		ws_conn_close(c);
+		return;
+	}
+
+	if (strncmp(w->buf, "GET", 3)) {
+		generate_response(c->sd, w->buf, read_len);
+		ws_conn_close(c);
+		return;
+	}
+
+	extract_file_name(filename, w->buf, read_len, MAX_FILENAME);
+	if (f_open(&c->fil, filename, FA_READ)) {
+		xil_printf("file %s not found, returning 404\r\n", filename);
+		do_404(c->sd, w->buf, read_len);
+		ws_conn_close(c);
+		return;
+	}
+	c->sending = 1;
+
+	xil_printf("http GET: %s\r\n", filename);
+	hlen = generate_http_header(w->buf, get_file_extension(filename),
+				f_size(&c->fil));
+	if (lwip_write(c->sd, w->buf, hlen) != hlen) {
+		xil_printf("error writing http header to socket\r\n");
+		ws_conn_close(c);
+	}
+}
+
+/* send the next part of the file, as much as the socket takes */
+static void ws_conn_send(struct ws_worker *w, struct ws_conn *c)
+{
+	unsigned int n;
+	int sent;
+
+	if (f_read(&c->fil, w->buf, WEBSERVER_BUF_SIZE, &n) || n == 0) {
+		ws_conn_close(c);
+		return;
+	}
+
+	sent = lwip_send(c->sd, w->buf, n, MSG_DONTWAIT);
+	if (sent < 0) {
+		if (errno != EWOULDBLOCK) {
+			ws_conn_close(c);
+			return;
+		}
+		sent = 0;
+	}
+	if ((unsigned int)sent < n)
+		f_lseek(&c->fil, f_tell(&c->fil) - (n - sent));
+	else if (f_tell(&c->fil) == f_size(&c->fil))
+		ws_conn_close(c);
+}
+
+static void ws_worker_thread(void *arg)
+{
+	struct ws_worker *w = (struct ws_worker *)arg;
+	int i;
+
+	for (i = 0; i < WEBSERVER_CONNS_PER_WORKER; i++)
+		w->conns[i].sd = -1;
+
+	while (1) {
+		fd_set rset, wset;
+		struct timeval tv;
+		struct ws_conn *c;
+		int maxfd = -1, free_slot = -1;
+		u32_t now;
+
+		FD_ZERO(&rset);
+		FD_ZERO(&wset);
+		for (i = 0; i < WEBSERVER_CONNS_PER_WORKER; i++) {
+			c = &w->conns[i];
+			if (c->sd < 0) {
+				free_slot = i;
+				continue;
+			}
+			if (c->sending)
+				FD_SET(c->sd, &wset);
+			else
+				FD_SET(c->sd, &rset);
+			if (c->sd > maxfd)
+				maxfd = c->sd;
+		}
+		/* only take new clients while there is room for them, the
+		 * others wait in the listen backlog for any worker */
+		if (free_slot >= 0) {
+			FD_SET(ws_listen_sd, &rset);
+			if (ws_listen_sd > maxfd)
+				maxfd = ws_listen_sd;
+		}
+
+		tv.tv_sec = 1;
+		tv.tv_usec = 0;
+		if (lwip_select(maxfd + 1, &rset, &wset, NULL, &tv) < 0)
+			continue;
+
+		now = sys_now();
+		for (i = 0; i < WEBSERVER_CONNS_PER_WORKER; i++) {
+			c = &w->conns[i];
+			if (c->sd < 0)
+				continue;
+			if (FD_ISSET(c->sd, &rset)) {
+				c->last_active = now;
+				ws_conn_request(w, c);
+			} else if (FD_ISSET(c->sd, &wset)) {
+				c->last_active = now;
+				ws_conn_send(w, c);
+			} else if (now - c->last_active > WEBSERVER_IDLE_TIMEOUT_MS) {
+				ws_conn_close(c);
+			}
+		}
+
+		if (free_slot >= 0 && FD_ISSET(ws_listen_sd, &rset)) {
+			/* another worker may have taken it already */
+			int sd = lwip_accept(ws_listen_sd, NULL, NULL);
+			if (sd >= 0) {
+				c = &w->conns[free_slot];
+				c->sd = sd;
+				c->sending = 0;
+				c->last_active = now;
+			}
+		}
+	}
+}
+#endif /* WEBSERVER_NUM_WORKERS > 0 */
+
 void start_application()
 {
-	int sock, new_sd;
+	int sock;
+	struct sockaddr_in address;
+#if WEBSERVER_NUM_WORKERS > 0
+	int i;
+#else
+	int new_sd;
 	int size = sizeof(struct sockaddr_in);
-	struct sockaddr_in address, remote;
+	struct sockaddr_in remote;
+#endif
 
 	/* initialize FS */
 	if (platform_init_fs()) {
@@ -92,11 +265,23 @@ void start_application()
 		return;
 	}
 
+#if WEBSERVER_NUM_WORKERS > 0
+	/* the workers share the listen socket, a worker losing the race for a
+	 * client must not block in lwip_accept() */
+	lwip_fcntl(sock, F_SETFL, O_NONBLOCK);
+	ws_listen_sd = sock;
+	for (i = 0; i < WEBSERVER_NUM_WORKERS; i++) {
+		sys_thread_new("httpd_worker", ws_worker_thread,
+				&ws_workers[i], WORKER_STACKSIZE,
+				DEFAULT_THREAD_PRIO);
+	}
+#else
 	while (1) {
 		new_sd = lwip_accept(sock, (struct sockaddr *)&remote,
 					(socklen_t *)&size);
 		process_http_request(new_sd);
 	}
+#endif
 }
 
 void print_app_header()
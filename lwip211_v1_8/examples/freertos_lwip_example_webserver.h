@@ -32,6 +32,18 @@
 #define MAX_FILENAME 256
 #define HTTP_PORT    80
 
+/* Number of worker threads serving clients. Each worker multiplexes up to
+ * WEBSERVER_CONNS_PER_WORKER connections with lwip_select() and sends files
+ * without blocking, so many clients are served on a fixed memory budget.
+ * Set to 0 to handle one client at a time in the accepting thread.
+ */
+#define WEBSERVER_NUM_WORKERS      2
+#define WEBSERVER_CONNS_PER_WORKER 4
+/* request and file buffer, one per worker */
+#define WEBSERVER_BUF_SIZE         1400
+/* close connections that make no progress for this long */
+#define WEBSERVER_IDLE_TIMEOUT_MS  10000
+
 /* initialize file system layer */
 int platform_init_fs();
 
@@ -44,6 +56,7 @@ void extract_file_name(char *filename, char *req, int rlen, int maxlen);
 char *get_file_extension(char *buf);
 int is_cmd_print(char *buf);
 
+int do_404(int sd, char *req, int rlen);
 int generate_response(int sd, char *http_req, int http_req_len);
 int generate_http_header(char *buf, char *fext, int fsize);
 
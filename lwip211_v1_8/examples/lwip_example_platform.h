@@ -36,4 +36,7 @@ void timer_callback();
 #endif
 void platform_setup_timer();
 void platform_enable_interrupts();
+/* PLATFORM_TICKLESS: handle pending frames or sleep until the next lwIP timeout */
+struct netif;
+void platform_idle(struct netif *netif);
 #endif
@@ -35,6 +35,14 @@
 #define TFTP_APP
 #endif
 
+/* SELECT_TICKLESS: instead of the fixed rate timer tick, run lwIP's timeouts
+ * from sys_check_timeouts(), program the platform timer one-shot for
+ * sys_timeouts_sleeptime() and sleep in WFI until a frame or a timeout is
+ * due. Needs no_sys_no_timers set to false in the lwip211 BSP settings. */
+#if SELECT_TICKLESS
+#define PLATFORM_TICKLESS
+#endif
+
 #if SELECT_STDOUT16550
 #define STDOUT_IS_16550
 #endif
@@ -60,6 +60,14 @@
 #endif
 #ifdef PLATFORM_ZYNQ
 #include "xscutimer.h"
+#ifdef PLATFORM_TICKLESS
+#include "xtime_l.h"
+#include "xpseudo_asm.h"
+#include "lwip/timeouts.h"
+#if !LWIP_TIMERS
+#error "PLATFORM_TICKLESS needs lwIP timers, set no_sys_no_timers to false"
+#endif
+#endif
 
 #define INTC_DEVICE_ID		XPAR_SCUGIC_SINGLE_DEVICE_ID
 #define TIMER_DEVICE_ID		XPAR_SCUTIMER_DEVICE_ID
@@ -69,13 +77,22 @@
 
 #define RESET_RX_CNTR_LIMIT	400
 
+#ifdef PLATFORM_TICKLESS
+/* the SCU private timer runs at half the CPU clock */
+#define TIMER_COUNTS_PER_MS	(XPAR_CPU_CORTEXA9_0_CPU_CLK_FREQ_HZ / 2000)
+/* the Rx path check runs as often as it did with the 250 ms tick */
+#define RESET_RX_TMR_MS		(RESET_RX_CNTR_LIMIT * 250)
+#endif
+
 void tcp_fasttmr(void);
 void tcp_slowtmr(void);
 
 static XScuTimer TimerInstance;
 
 #ifndef USE_SOFTETH_ON_ZYNQ
+#ifndef PLATFORM_TICKLESS
 static int ResetRxCntr = 0;
+#endif
 extern struct netif server_netif;
 #endif
 
@@ -91,6 +108,7 @@ void dhcp_coarse_tmr();
 void
 timer_callback(XScuTimer * TimerInstance)
 {
+#ifndef PLATFORM_TICKLESS
 	/* we need to call tcp_fasttmr & tcp_slowtmr at intervals specified
 	 * by lwIP. It is not important that the timing is absoluetly accurate.
 	 */
@@ -133,14 +151,74 @@ timer_callback(XScuTimer * TimerInstance)
 		ResetRxCntr = 0;
 	}
 #endif
+#endif /* PLATFORM_TICKLESS */
+	/* with PLATFORM_TICKLESS the timer is one-shot and only ends WFI in
+	 * platform_idle(), lwIP's timeouts are run from the main loop */
 	XScuTimer_ClearInterruptStatus(TimerInstance);
 }
 
+#ifdef PLATFORM_TICKLESS
+/* NO_SYS: lwIP's timeouts run from the free-running XTime counter */
+u32_t sys_now(void)
+{
+	XTime Now;
+
+	XTime_GetTime(&Now);
+	return (u32_t)(Now / (COUNTS_PER_SECOND / 1000U));
+}
+
+#if LWIP_DHCP==1
+/* count dhcp_timoutcntr down every 500 ms, as the tick did */
+static void dhcp_timoutcntr_tmr(void *arg)
+{
+	LWIP_UNUSED_ARG(arg);
+	if (dhcp_timoutcntr > 0) {
+		dhcp_timoutcntr--;
+		sys_timeout(500, dhcp_timoutcntr_tmr, NULL);
+	}
+}
+#endif
+
+#ifndef USE_SOFTETH_ON_ZYNQ
+/* SW alternative for the SI #692601, see timer_callback() */
+static void resetrx_tmr(void *arg)
+{
+	LWIP_UNUSED_ARG(arg);
+	xemacpsif_resetrx_on_no_rxdata(&server_netif);
+	sys_timeout(RESET_RX_TMR_MS, resetrx_tmr, NULL);
+}
+#endif
+
+void platform_idle(struct netif *netif)
+{
+	u32_t SleepMs;
+
+	/* with IRQs masked, a frame or the timer arriving after the checks
+	 * below still ends WFI and is serviced once IRQs are unmasked */
+	Xil_ExceptionDisableMask(XIL_EXCEPTION_IRQ);
+	if (xemacif_input(netif) == 0) {
+		SleepMs = sys_timeouts_sleeptime();
+		if (SleepMs != 0) {
+			if (SleepMs > 0xFFFFFFFFU / TIMER_COUNTS_PER_MS) {
+				/* wake up early and sleep again */
+				SleepMs = 0xFFFFFFFFU / TIMER_COUNTS_PER_MS;
+			}
+			XScuTimer_LoadTimer(&TimerInstance, SleepMs * TIMER_COUNTS_PER_MS);
+			XScuTimer_Start(&TimerInstance);
+			wfi();
+		}
+	}
+	Xil_ExceptionEnableMask(XIL_EXCEPTION_IRQ);
+}
+#endif
+
 void platform_setup_timer(void)
 {
 	int Status = XST_SUCCESS;
 	XScuTimer_Config *ConfigPtr;
+#ifndef PLATFORM_TICKLESS
 	int TimerLoadValue = 0;
+#endif
 
 	ConfigPtr = XScuTimer_LookupConfig(TIMER_DEVICE_ID);
 	Status = XScuTimer_CfgInitialize(&TimerInstance, ConfigPtr,
@@ -160,6 +238,10 @@ void platform_setup_timer(void)
 
 	}
 
+#ifdef PLATFORM_TICKLESS
+	/* one-shot, loaded for every sleep in platform_idle() */
+	XScuTimer_DisableAutoReload(&TimerInstance);
+#else
 	XScuTimer_EnableAutoReload(&TimerInstance);
 	/*
 	 * Set for 250 milli seconds timeout.
@@ -167,6 +249,7 @@ void platform_setup_timer(void)
 	TimerLoadValue = XPAR_CPU_CORTEXA9_0_CPU_CLK_FREQ_HZ / 8;
 
 	XScuTimer_LoadTimer(&TimerInstance, TimerLoadValue);
+#endif
 	return;
 }
 
@@ -206,7 +289,16 @@ void platform_enable_interrupts()
 	 */
 	Xil_ExceptionEnableMask(XIL_EXCEPTION_IRQ);
 	XScuTimer_EnableInterrupt(&TimerInstance);
+#ifdef PLATFORM_TICKLESS
+#if LWIP_DHCP==1
+	sys_timeout(500, dhcp_timoutcntr_tmr, NULL);
+#endif
+#ifndef USE_SOFTETH_ON_ZYNQ
+	sys_timeout(RESET_RX_TMR_MS, resetrx_tmr, NULL);
+#endif
+#else
 	XScuTimer_Start(&TimerInstance);
+#endif
 	return;
 }
 
@@ -49,6 +49,14 @@
 #endif
 #ifdef PLATFORM_ZYNQMP
 #include "xttcps.h"
+#ifdef PLATFORM_TICKLESS
+#include "xtime_l.h"
+#include "xpseudo_asm.h"
+#include "lwip/timeouts.h"
+#if !LWIP_TIMERS
+#error "PLATFORM_TICKLESS needs lwIP timers, set no_sys_no_timers to false"
+#endif
+#endif
 
 #define INTC_DEVICE_ID		XPAR_SCUGIC_SINGLE_DEVICE_ID
 #define TIMER_DEVICE_ID		XPAR_XTTCPS_0_DEVICE_ID
@@ -61,6 +69,10 @@
 static XTtcPs TimerInstance;
 static XInterval Interval;
 static u8 Prescaler;
+#ifdef PLATFORM_TICKLESS
+/* TTC counts per millisecond with the prescaler calculated for the tick */
+static u32 TimerCountsPerMs;
+#endif
 
 volatile int TcpFastTmrFlag = 0;
 volatile int TcpSlowTmrFlag = 0;
@@ -76,6 +88,11 @@ void platform_clear_interrupt( XTtcPs * TimerInstance );
 void
 timer_callback(XTtcPs * TimerInstance)
 {
+#ifdef PLATFORM_TICKLESS
+	/* one-shot, this only ends WFI in platform_idle(), lwIP's timeouts
+	 * are run from the main loop */
+	XTtcPs_Stop(TimerInstance);
+#else
 	/* we need to call tcp_fasttmr & tcp_slowtmr at intervals specified
 	 * by lwIP. It is not important that the timing is absoluetly accurate.
 	 */
@@ -99,9 +116,57 @@ timer_callback(XTtcPs * TimerInstance)
 		}
 #endif
 	}
+#endif
 	platform_clear_interrupt(TimerInstance);
 }
 
+#ifdef PLATFORM_TICKLESS
+/* NO_SYS: lwIP's timeouts run from the free-running XTime counter */
+u32_t sys_now(void)
+{
+	XTime Now;
+
+	XTime_GetTime(&Now);
+	return (u32_t)(Now / (COUNTS_PER_SECOND / 1000U));
+}
+
+#if LWIP_DHCP==1
+/* count dhcp_timoutcntr down every 500 ms, as the tick did */
+static void dhcp_timoutcntr_tmr(void *arg)
+{
+	LWIP_UNUSED_ARG(arg);
+	if (dhcp_timoutcntr > 0) {
+		dhcp_timoutcntr--;
+		sys_timeout(500, dhcp_timoutcntr_tmr, NULL);
+	}
+}
+#endif
+
+void platform_idle(struct netif *netif)
+{
+	u32_t SleepMs;
+
+	/* with IRQs masked, a frame or the timer arriving after the checks
+	 * below still ends WFI and is serviced once IRQs are unmasked */
+	Xil_ExceptionDisableMask(XIL_EXCEPTION_IRQ);
+	if (xemacif_input(netif) == 0) {
+		SleepMs = sys_timeouts_sleeptime();
+		if (SleepMs != 0) {
+			if (SleepMs > XTTCPS_MAX_INTERVAL_COUNT / TimerCountsPerMs) {
+				/* wake up early and sleep again */
+				SleepMs = XTTCPS_MAX_INTERVAL_COUNT / TimerCountsPerMs;
+			}
+			XTtcPs_Stop(&TimerInstance);
+			XTtcPs_SetInterval(&TimerInstance, (XInterval)(SleepMs * TimerCountsPerMs));
+			XTtcPs_ResetCounterValue(&TimerInstance);
+			XTtcPs_Start(&TimerInstance);
+			wfi();
+		}
+	}
+	Xil_ExceptionEnableMask(XIL_EXCEPTION_IRQ);
+}
+#endif
+
 void platform_setup_timer(void)
 {
 	int Status;
@@ -121,6 +186,10 @@ void platform_setup_timer(void)
 	XTtcPs_CalcIntervalFromFreq(Timer, PLATFORM_TIMER_INTR_RATE_HZ, &Interval, &Prescaler);
 	XTtcPs_SetInterval(Timer, Interval);
 	XTtcPs_SetPrescaler(Timer, Prescaler);
+#ifdef PLATFORM_TICKLESS
+	/* the prescaler is kept, the interval is set for every sleep */
+	TimerCountsPerMs = Interval / (1000 / PLATFORM_TIMER_INTR_RATE_HZ);
+#endif
 }
 
 void platform_clear_interrupt( XTtcPs * TimerInstance )
@@ -168,7 +237,13 @@ void platform_enable_interrupts()
 	Xil_ExceptionEnableMask(XIL_EXCEPTION_IRQ);
 	XScuGic_EnableIntr(INTC_DIST_BASE_ADDR, TIMER_IRPT_INTR);
 	XTtcPs_EnableInterrupts(&TimerInstance, XTTCPS_IXR_INTERVAL_MASK);
+#ifdef PLATFORM_TICKLESS
+#if LWIP_DHCP==1
+	sys_timeout(500, dhcp_timoutcntr_tmr, NULL);
+#endif
+#else
 	XTtcPs_Start(&TimerInstance);
+#endif
 	return;
 }
 
@@ -36,6 +36,9 @@
 #include "sleep.h"
 #include "lwip/priv/tcp_priv.h"
 #include "lwip/init.h"
+#ifdef PLATFORM_TICKLESS
+#include "lwip/timeouts.h"
+#endif
 #include "lwip/inet.h"
 #include "xil_cache.h"
 #include "lwip_example_tftpclient_common.h"
@@ -160,8 +163,14 @@ int main(void)
 	 */
 	dhcp_start(netif);
 	dhcp_timoutcntr = 24;
-	while (((netif->ip_addr.addr) == 0) && (dhcp_timoutcntr > 0))
+	while (((netif->ip_addr.addr) == 0) && (dhcp_timoutcntr > 0)) {
+#ifdef PLATFORM_TICKLESS
+		sys_check_timeouts();
+		platform_idle(netif);
+#else
 		xemacif_input(netif);
+#endif
+	}
 
 	if (dhcp_timoutcntr <= 0) {
 		if ((netif->ip_addr.addr) == 0) {
@@ -191,6 +200,16 @@ int main(void)
 	}
 
 	while (1) {
+#ifdef PLATFORM_TICKLESS
+		sys_check_timeouts();
+		/* only sleep while a transfer is running, the next one is
+		 * started right away */
+		if (tftp_in_process) {
+			platform_idle(netif);
+			continue;
+		}
+		xemacif_input(netif);
+#else
 		if (TcpFastTmrFlag) {
 			tcp_fasttmr();
 			TcpFastTmrFlag = 0;
@@ -203,6 +222,7 @@ int main(void)
 
 		if (tftp_in_process)
 			continue;
+#endif
 
 		transfer_data(&host_ip);
 	}
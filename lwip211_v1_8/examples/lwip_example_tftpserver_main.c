@@ -36,6 +36,9 @@
 #include "sleep.h"
 #include "lwip/priv/tcp_priv.h"
 #include "lwip/init.h"
+#ifdef PLATFORM_TICKLESS
+#include "lwip/timeouts.h"
+#endif
 #include "lwip/inet.h"
 #include "xil_cache.h"
 
@@ -155,8 +158,14 @@ int main(void)
 	 */
 	dhcp_start(netif);
 	dhcp_timoutcntr = 24;
-	while (((netif->ip_addr.addr) == 0) && (dhcp_timoutcntr > 0))
+	while (((netif->ip_addr.addr) == 0) && (dhcp_timoutcntr > 0)) {
+#ifdef PLATFORM_TICKLESS
+		sys_check_timeouts();
+		platform_idle(netif);
+#else
 		xemacif_input(netif);
+#endif
+	}
 
 	if (dhcp_timoutcntr <= 0) {
 		if ((netif->ip_addr.addr) == 0) {
@@ -180,6 +189,10 @@ int main(void)
 	xil_printf("\r\n");
 
 	while (1) {
+#ifdef PLATFORM_TICKLESS
+		sys_check_timeouts();
+		platform_idle(netif);
+#else
 		if (TcpFastTmrFlag) {
 			tcp_fasttmr();
 			TcpFastTmrFlag = 0;
@@ -189,6 +202,7 @@ int main(void)
 			TcpSlowTmrFlag = 0;
 		}
 		xemacif_input(netif);
+#endif
 	}
 
 	/* never reached */
@@ -33,6 +33,9 @@
 #include "xil_printf.h"
 
 #include "lwip/init.h"
+#ifdef PLATFORM_TICKLESS
+#include "lwip/timeouts.h"
+#endif
 #include "lwip/tcp.h"
 #include "lwip/inet.h"
 #if (LWIP_DHCP == 1)
@@ -152,8 +155,14 @@ int main(void)
 	dhcp_start(&server_netif);
 	dhcp_timoutcntr = 24;
 
-	while (((server_netif.ip_addr.addr) == 0) && (dhcp_timoutcntr > 0))
+	while (((server_netif.ip_addr.addr) == 0) && (dhcp_timoutcntr > 0)) {
+#ifdef PLATFORM_TICKLESS
+		sys_check_timeouts();
+		platform_idle(&server_netif);
+#else
 		xemacif_input(&server_netif);
+#endif
+	}
 
 	if (dhcp_timoutcntr <= 0) {
 		if ((server_netif.ip_addr.addr) == 0) {
@@ -178,6 +187,10 @@ int main(void)
 
 	/* receive and process packets */
 	while (1) {
+#ifdef PLATFORM_TICKLESS
+		sys_check_timeouts();
+		platform_idle(&server_netif);
+#else
 		if (TcpFastTmrFlag) {
 			tcp_fasttmr();
 			TcpFastTmrFlag = 0;
@@ -187,6 +200,7 @@ int main(void)
 			TcpSlowTmrFlag = 0;
 		}
 		xemacif_input(&server_netif);
+#endif
 	}
 
 	/* never reached */
@@ -46,12 +46,47 @@ extern "C" {
 
 #include "netif/xtopology.h"
 
+/* Most frames the input functions take off the receive queue per protection window */
+#ifndef XEMAC_RX_BURST
+#define XEMAC_RX_BURST 32
+#endif
+
+/* Interrupt driven link detection: instead of reading the PHY every second, the link
+ * thread sleeps until xemac_link_irq() is called from the handler of the PHY's INT pin
+ * (through a GPIO) or of the GEM's PCS interrupt, and reads the PHY once it has been
+ * quiet for XEMAC_LINK_DEBOUNCE_MS. Enabling the interrupt in the PHY and hooking the
+ * handler up are left to the board. Needs an OS. */
+#ifndef XEMAC_LINK_IRQ
+#define XEMAC_LINK_IRQ 0
+#endif
+
+#ifndef XEMAC_LINK_DEBOUNCE_MS
+#define XEMAC_LINK_DEBOUNCE_MS 20
+#endif
+
+/* With XEMAC_LINK_IRQ, the link is also read after this many ms without an interrupt,
+ * in case one got lost. 0 relies on the interrupt alone. */
+#ifndef XEMAC_LINK_IRQ_RECHECK_MS
+#define XEMAC_LINK_IRQ_RECHECK_MS 0
+#endif
+
+/* Run by the link thread before it reads the link after an interrupt. Most PHYs keep
+ * INT asserted until their (vendor specific) interrupt status register is read, which
+ * this is the place for, e.g. XEmacPs_PhyRead(..., 0x13, &status) on a Marvell 88E1xxx. */
+#ifndef XEMAC_PHY_IRQ_ACK
+#define XEMAC_PHY_IRQ_ACK(netif)
+#endif
+
 struct xemac_s {
 	enum xemac_types type;
 	int  topology_index;
 	void *state;
 #if !NO_SYS
     sys_sem_t sem_rx_data_available;
+#if XEMAC_LINK_IRQ
+	/* signalled by xemac_link_irq() */
+	sys_sem_t sem_link_irq;
+#endif
 #if defined(__arm__) && !defined(ARMR5)
 	TimerHandle_t xTimer;
 #endif
@@ -66,6 +101,9 @@ enum ethernet_link_status {
 };
 
 void eth_link_detect(struct netif *netif);
+#if XEMAC_LINK_IRQ && !NO_SYS
+void xemac_link_irq(struct netif *netif);
+#endif
 void 		lwip_raw_init();
 int 		xemacif_input(struct netif *netif);
 void 		xemacif_input_thread(struct netif *netif);
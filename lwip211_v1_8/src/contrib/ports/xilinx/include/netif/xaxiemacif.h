@@ -65,6 +65,104 @@ extern "C" {
 #define INTC_DIST_BASE_ADDR     XPAR_SCUGIC_0_DIST_BASEADDR
 #endif
 
+/* Name of a linker section for the MCDMA BD rings, e.g. OCM, TCM or a region the linker
+ * script and MMU/MPU setup already map uncached or cache coherent. The rings are then
+ * sized from XLWIP_CONFIG_N_RX_DESC/N_TX_DESC and the memory attributes are left alone.
+ * Unset, a 1 MB (2 MB on A53) aligned bd_space is marked uncached at init. */
+/* #define XAXIEMACIF_BD_SECTION ".bd_ocm" */
+
+/* MCDMA RX steering: each MCDMA RX channel gets its own receive queue, drained by its
+ * own input task, instead of all channels feeding recv_q and xemacif_input_thread (which
+ * then stays idle). Which flows land on which channel is up to the TDEST the fabric
+ * assigns (by VLAN, 5-tuple, ...), the MCDMA demultiplexes on it. Channel n is drained
+ * by task (n - 1) % XAXIEMACIF_MCDMA_RX_TASKS. Needs an OS. */
+#ifndef XAXIEMACIF_MCDMA_RX_STEER
+#define XAXIEMACIF_MCDMA_RX_STEER 0
+#endif
+#if NO_SYS || !defined(XLWIP_CONFIG_INCLUDE_AXI_ETHERNET_MCDMA)
+#undef XAXIEMACIF_MCDMA_RX_STEER
+#define XAXIEMACIF_MCDMA_RX_STEER 0
+#endif
+
+#define XAXIEMACIF_MCDMA_MAX_RX_CHAN 16
+
+/* AXI FIFO data moved by an AXI CDMA instead of the CPU: received frames are read from
+ * the RX FIFO into their pbuf in the background and handed to recv_q when the CDMA is
+ * done, single pbuf frames to send are written to the TX FIFO the same way. The CDMA
+ * must be in simple mode with a 32 bit data width, and its interrupt connected as
+ * XAXIEMACIF_FIFO_CDMA_INTR. Frames shorter than XAXIEMACIF_FIFO_CDMA_MIN, chained
+ * ones, and any that come while the CDMA is busy in the other direction are still
+ * copied by the CPU. */
+#ifndef XAXIEMACIF_FIFO_CDMA
+#define XAXIEMACIF_FIFO_CDMA 0
+#endif
+#ifndef XLWIP_CONFIG_INCLUDE_AXI_ETHERNET_FIFO
+#undef XAXIEMACIF_FIFO_CDMA
+#define XAXIEMACIF_FIFO_CDMA 0
+#endif
+
+#if XAXIEMACIF_FIFO_CDMA
+#include "xaxicdma.h"
+
+#ifndef XAXIEMACIF_FIFO_CDMA_DEVICE_ID
+#define XAXIEMACIF_FIFO_CDMA_DEVICE_ID XPAR_AXICDMA_0_DEVICE_ID
+#endif
+
+#ifndef XAXIEMACIF_FIFO_CDMA_INTR
+#define XAXIEMACIF_FIFO_CDMA_INTR XPAR_INTC_0_AXICDMA_0_VEC_ID
+#endif
+
+#ifndef XAXIEMACIF_FIFO_CDMA_MIN
+#define XAXIEMACIF_FIFO_CDMA_MIN 256
+#endif
+
+/* Frames to send that wait for a CDMA transfer to the TX FIFO to complete */
+#ifndef XAXIEMACIF_FIFO_CDMA_TX_QUEUE_LEN
+#define XAXIEMACIF_FIFO_CDMA_TX_QUEUE_LEN 8
+#endif
+#endif
+
+#ifndef XAXIEMACIF_MCDMA_RX_TASKS
+#define XAXIEMACIF_MCDMA_RX_TASKS XAXIEMACIF_MCDMA_MAX_RX_CHAN
+#endif
+
+#ifndef XAXIEMACIF_MCDMA_RX_THREAD_STACKSIZE
+#define XAXIEMACIF_MCDMA_RX_THREAD_STACKSIZE 1024
+#endif
+
+#ifndef XAXIEMACIF_MCDMA_RX_THREAD_PRIO
+#define XAXIEMACIF_MCDMA_RX_THREAD_PRIO TCPIP_THREAD_PRIO
+#endif
+
+/* Checksums the AXI Ethernet offload takes over, skipped by lwIP on this netif with
+ * LWIP_CHECKSUM_CTRL_PER_NETIF. The core only handles IPv4, so with IPv6 enabled TCP and
+ * UDP stay in software and the partial TX engine, which just adds up the segment, is
+ * left unused. A bad checksum seen by the partial RX engine is only logged, so RX
+ * verification stays in software there. */
+#if LWIP_FULL_CSUM_OFFLOAD_TX==1
+#if LWIP_IPV6
+#define XAXIEMACIF_CSUM_HW_TX	NETIF_CHECKSUM_GEN_IP
+#else
+#define XAXIEMACIF_CSUM_HW_TX	(NETIF_CHECKSUM_GEN_IP | NETIF_CHECKSUM_GEN_UDP | \
+					 NETIF_CHECKSUM_GEN_TCP)
+#endif
+#elif LWIP_PARTIAL_CSUM_OFFLOAD_TX==1 && !LWIP_IPV6
+#define XAXIEMACIF_CSUM_HW_TX	NETIF_CHECKSUM_GEN_TCP
+#else
+#define XAXIEMACIF_CSUM_HW_TX	0
+#endif
+
+#if LWIP_FULL_CSUM_OFFLOAD_RX==1
+#if LWIP_IPV6
+#define XAXIEMACIF_CSUM_HW_RX	NETIF_CHECKSUM_CHECK_IP
+#else
+#define XAXIEMACIF_CSUM_HW_RX	(NETIF_CHECKSUM_CHECK_IP | NETIF_CHECKSUM_CHECK_UDP | \
+					 NETIF_CHECKSUM_CHECK_TCP)
+#endif
+#else
+#define XAXIEMACIF_CSUM_HW_RX	0
+#endif
+
 void 	xaxiemacif_setmac(u32_t index, u8_t *addr);
 u8_t*	xaxiemacif_getmac(u32_t index);
 err_t 	xaxiemacif_init(struct netif *netif);
@@ -95,6 +193,31 @@ typedef struct {
 	pq_queue_t *recv_q;
 	pq_queue_t *send_q;
 
+#if XAXIEMACIF_MCDMA_RX_STEER
+	/* one receive q per RX channel, so every channel ISR stays its q's only
+	 * producer, and the input tasks draining them, see XAXIEMACIF_MCDMA_RX_STEER */
+	pq_queue_t *chan_recv_q[XAXIEMACIF_MCDMA_MAX_RX_CHAN];
+	struct xaxiemacif_rx_task {
+		struct netif *netif;
+		u32_t first_chan;
+		sys_sem_t sem;
+	} rx_task[XAXIEMACIF_MCDMA_RX_TASKS];
+	u32_t n_rx_tasks;
+#endif
+
+#if XAXIEMACIF_FIFO_CDMA
+	/* see XAXIEMACIF_FIFO_CDMA */
+	XAxiCdma cdma;
+	struct xemac_s *cdma_xemac;
+	struct pbuf *cdma_rx;	/* frame the CDMA reads from the RX FIFO */
+	u32_t cdma_rx_len;
+	struct pbuf *cdma_tx;	/* frame the CDMA writes to the TX FIFO */
+	u32_t cdma_tx_len;
+	struct pbuf *tx_q[XAXIEMACIF_FIFO_CDMA_TX_QUEUE_LEN];
+	u16_t tx_head;
+	u16_t tx_count;
+#endif
+
 	/* pointers to memory holding buffer descriptors (used only with SDMA) */
 	void *rx_bdspace;
 	void *tx_bdspace;
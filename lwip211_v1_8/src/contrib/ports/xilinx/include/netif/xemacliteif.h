@@ -42,6 +42,12 @@ extern "C" {
 #include "xemaclite_i.h"
 #include "xstatus.h"
 
+/* Frames waiting for the ping or pong TX buffer to come free. They are held by
+ * reference and copied into the buffer from xemacif_send_handler. */
+#ifndef XEMACLITEIF_TX_QUEUE_LEN
+#define XEMACLITEIF_TX_QUEUE_LEN 8
+#endif
+
 /* structure within each netif, encapsulating all information required for
  * using a particular emaclite instance
  */
@@ -50,7 +56,11 @@ typedef struct {
 
 	/* queue to store overflow packets */
 	pq_queue_t *recv_q;
-	pq_queue_t *send_q;
+
+	/* see XEMACLITEIF_TX_QUEUE_LEN */
+	struct pbuf *tx_q[XEMACLITEIF_TX_QUEUE_LEN];
+	u16_t tx_head;
+	u16_t tx_count;
 } xemacliteif_s;
 
 void 	xemacliteif_setmac(u32_t index, u8_t *addr);
@@ -100,10 +100,180 @@ extern "C" {
 
 #define MAX_FRAME_SIZE_JUMBO (XEMACPS_MTU_JUMBO + XEMACPS_HDR_SIZE + XEMACPS_TRL_SIZE)
 
+/* Jumbo frames from PBUF_POOL: when a pool pbuf can't hold a whole jumbo frame, every
+ * RX BD gets a single pool pbuf, the GEM spreads a frame over as many BDs as it needs
+ * and their pbufs are chained into one frame again. */
+#if defined(ZYNQMP_USE_JUMBO) && (PBUF_POOL_BUFSIZE < MAX_FRAME_SIZE_JUMBO)
+#define XEMACPSIF_RX_CHAIN 1
+#else
+#define XEMACPSIF_RX_CHAIN 0
+#endif
+
+/* MTU advertised in jumbo mode */
+#ifndef XEMACPSIF_JUMBO_MTU
+#define XEMACPSIF_JUMBO_MTU 9000
+#endif
+
+/* Hybrid RX: the RX ISR only masks the RX interrupt and wakes the input thread, which
+ * harvests BDs XEMACPSIF_RX_POLL_BUDGET at a time and unmasks the interrupt again once
+ * the ring is idle. Needs an OS, NO_SYS builds always harvest in the ISR. */
+#ifndef XEMACPSIF_RX_POLL
+#define XEMACPSIF_RX_POLL 0
+#endif
+
+#ifndef XEMACPSIF_RX_POLL_BUDGET
+#define XEMACPSIF_RX_POLL_BUDGET 64
+#endif
+
+/* Free RX BDs are refilled once at least this many have piled up, in one batch */
+#ifndef XEMACPSIF_RX_REFILL_BATCH
+#define XEMACPSIF_RX_REFILL_BATCH 8
+#endif
+
+/* pbufs held back for RX BDs only, taken when PBUF_POOL is empty so the ring keeps
+ * buffers while the stack holds on to the pool */
+#ifndef XEMACPSIF_RX_RESERVE
+#define XEMACPSIF_RX_RESERVE 16
+#endif
+
+/* With PBUF_POOL_QUOTAS, RX buffers come from a partition of PBUF_POOL that keeps
+ * XEMACPSIF_POOL_RESERVED pbufs for this GEM alone and lets it hold at most
+ * XEMACPSIF_POOL_LIMIT (0: no limit), so other netifs sharing the pool, such as an
+ * RPMsg link, cannot drain the RX ring, and a flood on the GEM cannot drain theirs.
+ * When the pool cannot spare the reservation the GEM shares the rest of the pool. */
+#ifndef XEMACPSIF_POOL_RESERVED
+#define XEMACPSIF_POOL_RESERVED XLWIP_CONFIG_N_RX_DESC
+#endif
+
+#ifndef XEMACPSIF_POOL_LIMIT
+#define XEMACPSIF_POOL_LIMIT 0
+#endif
+
+/* RX interrupt moderation on GEMs that have it (ZynqMP and later): the RX interrupt is
+ * held back for up to this many 800 ns units after a frame, 0 turns it off */
+#ifndef XEMACPSIF_RX_INTR_MODERATION
+#define XEMACPSIF_RX_INTR_MODERATION 0
+#endif
+
+/* Priority RX queue on GEMs that have one (ZynqMP and later): frames the GEM screeners
+ * match (PTP by ethertype and UDP port with XEMACPSIF_RX_PRIO_PTP, plus whatever
+ * xemacpsif_rx_prio_*() adds) land in RX queue 1, a ring of XEMACPSIF_RX_PRIO_N_DESC
+ * BDs that is harvested in the ISR into its own receive q and drained by its own input
+ * task, so they don't wait behind bulk traffic in recv_q. Needs an OS, and not with
+ * jumbo frames chained from PBUF_POOL. */
+#ifndef XEMACPSIF_RX_PRIO_QUEUE
+#define XEMACPSIF_RX_PRIO_QUEUE 0
+#endif
+#if NO_SYS || XEMACPSIF_RX_CHAIN
+#undef XEMACPSIF_RX_PRIO_QUEUE
+#define XEMACPSIF_RX_PRIO_QUEUE 0
+#endif
+
+#ifndef XEMACPSIF_RX_PRIO_N_DESC
+#define XEMACPSIF_RX_PRIO_N_DESC 32
+#endif
+
+/* screen PTP (ethertype 0x88F7, UDP ports 319 and 320) to the priority queue */
+#ifndef XEMACPSIF_RX_PRIO_PTP
+#define XEMACPSIF_RX_PRIO_PTP 1
+#endif
+
+/* type 1 (DSCP, UDP port) and type 2 (VLAN priority, ethertype) screeners, and
+ * ethertype registers of the GEM */
+#ifndef XEMACPSIF_RX_PRIO_SCREENERS
+#define XEMACPSIF_RX_PRIO_SCREENERS 4
+#endif
+
+#ifndef XEMACPSIF_RX_PRIO_THREAD_STACKSIZE
+#define XEMACPSIF_RX_PRIO_THREAD_STACKSIZE 1024
+#endif
+
+/* keep this above the thread running xemacif_input_thread */
+#ifndef XEMACPSIF_RX_PRIO_THREAD_PRIO
+#define XEMACPSIF_RX_PRIO_THREAD_PRIO TCPIP_THREAD_PRIO
+#endif
+
+/* Cache coherent DMA: with the GEM routed through the CCI (A53 only, set up by
+ * psu_init when the design enables GEM coherency) BDs and frame buffers stay
+ * cacheable and no cache maintenance is done for it. The design export sets
+ * IsCacheCoherent for such a GEM; 1 here forces it, for designs where the routing
+ * is done outside of it. */
+#ifndef XEMACPSIF_COHERENT
+#define XEMACPSIF_COHERENT 0
+#endif
+
+/* Build xemacpsif_cache_bench(), which times the cache maintenance a non coherent
+ * GEM costs per frame, see XEMACPSIF_COHERENT */
+#ifndef XEMACPSIF_CACHE_BENCH
+#define XEMACPSIF_CACHE_BENCH 0
+#endif
+
+/* Name of a linker section for the BD rings, e.g. OCM, TCM or a region the linker
+ * script and MMU/MPU setup already map uncached or cache coherent. The rings are then
+ * sized from XLWIP_CONFIG_N_RX_DESC/N_TX_DESC and the memory attributes are left alone.
+ * Unset, a 1 MB (2 MB on A53) aligned bd_space is marked uncached at init. */
+/* #define XEMACPSIF_BD_SECTION ".bd_ocm" */
+
+/* Header/payload split on TX: leading pbufs of a frame adding up to at most this many
+ * bytes (the headers tcp_output_segment puts in front of PBUF_REF/ROM data, or a small
+ * frame as a whole) are copied into a buffer owned by the BD, so they take a single BD
+ * and flush. Larger pbufs still map to their own BDs. 0 maps every pbuf to a BD. */
+#ifndef XEMACPSIF_TX_INLINE_HDR
+#define XEMACPSIF_TX_INLINE_HDR 0
+#endif
+
+/* Sent BDs are reclaimed from low_level_output once fewer than this many are free */
+#ifndef XEMACPSIF_TX_RECLAIM_THRESH
+#define XEMACPSIF_TX_RECLAIM_THRESH 5
+#endif
+
+/* Clean on transmit: the TX-complete interrupt stays masked and sent BDs are only
+ * reclaimed from low_level_output, plus an XEMACPSIF_TX_RECLAIM_MS timer that collects
+ * what is left once TX goes quiet. LWIP_UDP_OPT_BLOCK_TX_TILL_COMPLETE waits for that
+ * interrupt, so it turns this off. */
+#ifndef XEMACPSIF_TX_LAZY_RECLAIM
+#define XEMACPSIF_TX_LAZY_RECLAIM 0
+#endif
+#if LWIP_UDP_OPT_BLOCK_TX_TILL_COMPLETE
+#undef XEMACPSIF_TX_LAZY_RECLAIM
+#define XEMACPSIF_TX_LAZY_RECLAIM 0
+#endif
+
+#ifndef XEMACPSIF_TX_RECLAIM_MS
+#define XEMACPSIF_TX_RECLAIM_MS 10
+#endif
+
+/* Checksums the GEM offload engines take over (IPv4 headers, TCP and UDP over IPv4 and
+ * IPv6); with LWIP_CHECKSUM_CTRL_PER_NETIF lwIP skips exactly these on a GEM netif */
+#if LWIP_FULL_CSUM_OFFLOAD_TX==1
+#define XEMACPSIF_CSUM_HW_TX	(NETIF_CHECKSUM_GEN_IP | NETIF_CHECKSUM_GEN_UDP | \
+					 NETIF_CHECKSUM_GEN_TCP)
+#else
+#define XEMACPSIF_CSUM_HW_TX	0
+#endif
+
+#if LWIP_FULL_CSUM_OFFLOAD_RX==1
+#define XEMACPSIF_CSUM_HW_RX	(NETIF_CHECKSUM_CHECK_IP | NETIF_CHECKSUM_CHECK_UDP | \
+					 NETIF_CHECKSUM_CHECK_TCP)
+#else
+#define XEMACPSIF_CSUM_HW_RX	0
+#endif
+
 void 	xemacpsif_setmac(u32_t index, u8_t *addr);
 u8_t*	xemacpsif_getmac(u32_t index);
 err_t 	xemacpsif_init(struct netif *netif);
 s32_t 	xemacpsif_input(struct netif *netif);
+#if XEMACPSIF_CACHE_BENCH
+void	xemacpsif_cache_bench(struct netif *netif);
+#endif
+#if XEMACPSIF_RX_PRIO_QUEUE
+/* Add a rule steering frames to the priority RX queue; ERR_MEM when the screeners of
+ * that type are used up. Rules stay for the life of the netif. */
+err_t	xemacpsif_rx_prio_dscp(struct netif *netif, u8_t dscp);
+err_t	xemacpsif_rx_prio_udp_port(struct netif *netif, u16_t port);
+err_t	xemacpsif_rx_prio_vlan_pcp(struct netif *netif, u8_t pcp);
+err_t	xemacpsif_rx_prio_ethertype(struct netif *netif, u16_t ethertype);
+#endif
 
 /* xaxiemacif_hw.c */
 void 	xemacps_error_handler(XEmacPs * Temac);
@@ -124,6 +294,51 @@ typedef struct {
 
 	unsigned int last_rx_frms_cntr;
 
+	/* the RX interrupt is masked and the input thread owns the RX ring */
+	volatile u32_t rx_polling;
+
+	/* see XEMACPSIF_RX_RESERVE */
+	struct pbuf *rx_reserve[XEMACPSIF_RX_RESERVE];
+	u32_t rx_reserve_cnt;
+
+	/* partition of PBUF_POOL for RX buffers, see XEMACPSIF_POOL_RESERVED */
+	u8_t pool_quota;
+
+#if XEMACPSIF_RX_CHAIN
+	/* frame being put together from RX BDs, see XEMACPSIF_RX_CHAIN */
+	struct pbuf *rx_chain;
+	u32_t rx_chain_len;
+#endif
+
+#if XEMACPSIF_RX_PRIO_QUEUE
+	/* RX queue 1 and what it feeds, see XEMACPSIF_RX_PRIO_QUEUE; the ring is
+	 * only in use when rx_prio_active is set */
+	XEmacPs_BdRing rx_prio_ring;
+	void *rx_prio_bdspace;
+	u32_t rx_prio_active;
+	pq_queue_t *rx_prio_q;
+	sys_sem_t rx_prio_sem;
+	struct netif *rx_prio_netif;
+
+	/* screener register values, written to the GEM at every init_dma */
+	u32_t rx_prio_scrt1[XEMACPSIF_RX_PRIO_SCREENERS];
+	u32_t rx_prio_scrt2[XEMACPSIF_RX_PRIO_SCREENERS];
+	u16_t rx_prio_etht[XEMACPSIF_RX_PRIO_SCREENERS];
+	u8_t rx_prio_n_scrt1;
+	u8_t rx_prio_n_scrt2;
+	u8_t rx_prio_n_etht;
+#endif
+
+#if XEMACPSIF_TX_LAZY_RECLAIM
+	/* the TX reclaim timer is pending */
+	u8_t tx_reclaim_armed;
+#endif
+
+#if LWIP_NETIF_LINKOUTPUT_BURST
+	/* a burst is being queued, emacps_sgsend() leaves starting TX to it */
+	u8_t tx_hold;
+#endif
+
 } xemacpsif_s;
 
 extern xemacpsif_s xemacpsif;
@@ -142,7 +357,20 @@ XStatus emacps_sgsend(xemacpsif_s *xemacpsif, struct pbuf *p,
 #else
 XStatus emacps_sgsend(xemacpsif_s *xemacpsif, struct pbuf *p);
 #endif
+void emacps_start_tx(xemacpsif_s *xemacpsif);
 void emacps_recv_handler(void *arg);
+#if XEMACPSIF_RX_POLL && !NO_SYS
+s32_t emacps_rx_poll(struct xemac_s *xemac, s32_t budget);
+#endif
+#if XEMACPSIF_RX_PRIO_QUEUE
+/* screener register fields */
+#define XEMACPSIF_SCRT1_DSCP(dscp)	(0x10000000U | ((u32_t)((dscp) & 0x3F) << 6))
+#define XEMACPSIF_SCRT1_UDP(port)	(0x20000000U | ((u32_t)(port) << 12))
+#define XEMACPSIF_SCRT2_VLAN_PCP(pcp)	(0x00000100U | ((u32_t)((pcp) & 0x7) << 4))
+#define XEMACPSIF_SCRT2_ETHT_EN		0x00001000U
+err_t emacps_rx_prio_add(xemacpsif_s *xemacpsif, u32_t scrt1, u32_t scrt2, u16_t ethertype);
+void emacps_rx_prio_screen(xemacpsif_s *xemacpsif);
+#endif
 void emacps_error_handler(void *arg,u8 Direction, u32 ErrorWord);
 void setup_rx_bds(xemacpsif_s *xemacpsif, XEmacPs_BdRing *rxring);
 void HandleTxErrors(struct xemac_s *xemac);
@@ -36,17 +36,33 @@ extern "C" {
 #endif
 
 #include "debug.h"
+#include "lwip/arch.h"
 
+/* Capacity of queues from pq_create_queue(), a power of two */
+#ifndef PQ_QUEUE_SIZE
 #define PQ_QUEUE_SIZE 4096
+#endif
+
+#ifndef PQ_CACHE_LINE
+#define PQ_CACHE_LINE 64
+#endif
 
+/* Lock-free single-producer/single-consumer ring. The producer only writes head, the consumer
+ * only writes tail, and each lives in its own cache line, so an ISR can enqueue while a task
+ * dequeues without either disabling interrupts. Queues with more than one producer or consumer
+ * must still serialise them. head and tail are free running; the slot is the counter & mask. */
 typedef struct {
-	void *data[PQ_QUEUE_SIZE];
-	int head, tail, len;
+	void **data;
+	u32_t mask;
+	volatile u32_t head __attribute__((aligned(PQ_CACHE_LINE)));
+	volatile u32_t tail __attribute__((aligned(PQ_CACHE_LINE)));
 } pq_queue_t;
 
 pq_queue_t*	pq_create_queue();
+pq_queue_t*	pq_create_queue_size(u32_t size);
 int 		pq_enqueue(pq_queue_t *q, void *p);
 void*		pq_dequeue(pq_queue_t *q);
+int		pq_dequeue_burst(pq_queue_t *q, void **p, int n);
 int		pq_qlength(pq_queue_t *q);
 
 #ifdef __cplusplus
@@ -58,6 +58,22 @@
 #include "netif/xemacpsif.h"
 #endif
 
+/* With a single MAC driver in the build, xemac_add() and xemacif_input() call it
+ * directly instead of looking at the MAC type */
+#if defined(XLWIP_CONFIG_INCLUDE_GEM) && (defined (__arm__) || defined (__aarch64__)) && \
+	!defined(XLWIP_CONFIG_INCLUDE_AXI_ETHERNET) && !defined(XLWIP_CONFIG_INCLUDE_EMACLITE)
+#define XEMAC_DRIVER_INIT	xemacpsif_init
+#define XEMAC_DRIVER_INPUT	xemacpsif_input
+#elif defined(XLWIP_CONFIG_INCLUDE_AXI_ETHERNET) && \
+	!defined(XLWIP_CONFIG_INCLUDE_GEM) && !defined(XLWIP_CONFIG_INCLUDE_EMACLITE)
+#define XEMAC_DRIVER_INIT	xaxiemacif_init
+#define XEMAC_DRIVER_INPUT	xaxiemacif_input
+#elif defined(XLWIP_CONFIG_INCLUDE_EMACLITE) && \
+	!defined(XLWIP_CONFIG_INCLUDE_GEM) && !defined(XLWIP_CONFIG_INCLUDE_AXI_ETHERNET)
+#define XEMAC_DRIVER_INIT	xemacliteif_init
+#define XEMAC_DRIVER_INPUT	xemacliteif_input
+#endif
+
 #if !NO_SYS
 #include "lwip/tcpip.h"
 
@@ -65,6 +81,10 @@
 #define LINK_DETECT_THREAD_INTERVAL 1000 /* one second */
 
 void link_detect_thread(void *p);
+
+#if XEMAC_LINK_IRQ
+extern u32 xInsideISR;
+#endif
 #endif
 
 /* global lwip debug variable used for debugging */
@@ -87,6 +107,7 @@ lwip_raw_init()
 #endif
 }
 
+#ifndef XEMAC_DRIVER_INIT
 static enum xemac_types
 find_mac_type(unsigned base)
 {
@@ -99,6 +120,7 @@ find_mac_type(unsigned base)
 
 	return xemac_type_unknown;
 }
+#endif
 
 int
 xtopology_find_index(unsigned base)
@@ -133,6 +155,17 @@ xemac_add(struct netif *netif,
 	for (i = 0; i < 6; i++)
 		netif->hwaddr[i] = mac_ethernet_address[i];
 
+#ifdef XEMAC_DRIVER_INIT
+	nif = netif_add(netif, ipaddr, netmask, gw,
+			(void*)(UINTPTR)mac_baseaddr,
+			XEMAC_DRIVER_INIT,
+#if NO_SYS
+			ethernet_input
+#else
+			tcpip_input
+#endif
+			);
+#else
 	/* initialize based on MAC type */
 		switch (find_mac_type(mac_baseaddr)) {
 			case xemac_type_xps_emaclite:
@@ -149,6 +182,7 @@ xemac_add(struct netif *netif,
 #else
 				nif = NULL;
 #endif
+				break;
 			case xemac_type_axi_ethernet:
 #ifdef XLWIP_CONFIG_INCLUDE_AXI_ETHERNET
 					nif = netif_add(netif, ipaddr, netmask, gw,
@@ -163,6 +197,7 @@ xemac_add(struct netif *netif,
 #else
 				nif = NULL;
 #endif
+				break;
 #if defined (__arm__) || defined (__aarch64__)
 			case xemac_type_emacps:
 #ifdef XLWIP_CONFIG_INCLUDE_GEM
@@ -176,14 +211,19 @@ xemac_add(struct netif *netif,
 #endif
 
 						);
+				break;
 #endif
 #endif
 			default:
 				xil_printf("unable to determine type of EMAC with baseaddress 0x%08x\r\n",
 						mac_baseaddr);
 	}
+#endif
 
 	#ifdef OS_IS_FREERTOS
+	#if XEMAC_LINK_IRQ
+		sys_sem_new(&((struct xemac_s *)netif->state)->sem_link_irq, 0);
+	#endif
 		/* Start thread to detect link periodically for Hot Plug autodetect */
 		sys_thread_new("link_detect_thread", link_detect_thread, netif,
 				THREAD_STACKSIZE, tskIDLE_PRIORITY);
@@ -196,7 +236,8 @@ xemac_add(struct netif *netif,
 /*
  * The input thread calls lwIP to process any received packets.
  * This thread waits until a packet is received (sem_rx_data_available),
- * and then calls xemacif_input which processes 1 packet at a time.
+ * and then calls xemacif_input which processes packets in bursts of up to
+ * XEMAC_RX_BURST.
  */
 void
 xemacif_input_thread(struct netif *netif)
@@ -209,6 +250,16 @@ xemacif_input_thread(struct netif *netif)
 		 */
 		sys_sem_wait(&emac->sem_rx_data_available);
 
+#if defined(XLWIP_CONFIG_INCLUDE_GEM) && XEMACPSIF_RX_POLL
+		/* the RX ISR only woke us: harvest with a budget and hand every
+		 * batch to lwIP, until the ring is idle and the ISR is back on */
+		if (emac->type == xemac_type_emacps) {
+			while (emacps_rx_poll(emac, XEMACPSIF_RX_POLL_BUDGET) == XEMACPSIF_RX_POLL_BUDGET) {
+				xemacif_input(netif);
+			}
+		}
+#endif
+
 		/* move all received packets to lwIP */
 		xemacif_input(netif);
 	}
@@ -218,6 +269,9 @@ xemacif_input_thread(struct netif *netif)
 int
 xemacif_input(struct netif *netif)
 {
+#ifdef XEMAC_DRIVER_INPUT
+	return XEMAC_DRIVER_INPUT(netif);
+#else
 	struct xemac_s *emac = (struct xemac_s *)netif->state;
 
 	int n_packets = 0;
@@ -259,6 +313,7 @@ xemacif_input(struct netif *netif)
 	}
 
 	return n_packets;
+#endif
 }
 
 #if defined(XLWIP_CONFIG_INCLUDE_GEM)
@@ -412,6 +467,48 @@ void eth_link_detect(struct netif *netif)
 }
 
 #if !NO_SYS
+#if XEMAC_LINK_IRQ
+/*
+ * To be called from the interrupt handler of the PHY's INT pin (edge triggered,
+ * the pin stays asserted until XEMAC_PHY_IRQ_ACK) or of the GEM's PCS interrupt:
+ * wakes the link thread, no MDIO access happens here.
+ */
+void xemac_link_irq(struct netif *netif)
+{
+	struct xemac_s *xemac = (struct xemac_s *)netif->state;
+
+	xInsideISR++;
+	sys_sem_signal(&xemac->sem_link_irq);
+	xInsideISR--;
+}
+
+void link_detect_thread(void *p)
+{
+	struct netif *netif = (struct netif *) p;
+	struct xemac_s *xemac = (struct xemac_s *)netif->state;
+
+	while (1) {
+		/* at start, for whatever happened before the interrupt was hooked
+		 * up, and after every interrupt */
+		eth_link_detect(netif);
+		/* A link that went down is negotiating now. If it is already back,
+		 * its interrupt came before that, so have another look right away;
+		 * otherwise link up raises the next interrupt. */
+		if (eth_link_status == ETH_LINK_NEGOTIATING)
+			eth_link_detect(netif);
+
+		if (sys_arch_sem_wait(&xemac->sem_link_irq,
+				XEMAC_LINK_IRQ_RECHECK_MS) == SYS_ARCH_TIMEOUT)
+			continue;
+		/* debounce: a connector that bounces costs one read, after it
+		 * settled */
+		while (sys_arch_sem_wait(&xemac->sem_link_irq,
+				XEMAC_LINK_DEBOUNCE_MS) != SYS_ARCH_TIMEOUT)
+			;
+		XEMAC_PHY_IRQ_ACK(netif);
+	}
+}
+#else
 void link_detect_thread(void *p)
 {
 	struct netif *netif = (struct netif *) p;
@@ -425,3 +522,4 @@ void link_detect_thread(void *p)
 	}
 }
 #endif
+#endif
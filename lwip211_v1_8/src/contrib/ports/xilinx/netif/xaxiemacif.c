@@ -40,12 +40,16 @@
 #include "lwip/pbuf.h"
 #include "lwip/sys.h"
 #include "lwip/stats.h"
+#if !NO_SYS
+#include "lwip/tcpip.h"
+#endif
 #include "lwip/igmp.h"
 
 #include "netif/etharp.h"
 #include "netif/xaxiemacif.h"
 #include "netif/xadapter.h"
 #include "netif/xpqueue.h"
+#include "arch/capture.h"
 
 #include "xaxiemacif_fifo.h"
 #include "xaxiemacif_hw.h"
@@ -127,7 +131,7 @@ static err_t _unbuffered_low_level_output(xaxiemacif_s *xaxiemacif,
 
 	if (status != XST_SUCCESS) {
 #if LINK_STATS
-		lwip_stats.link.drop++;
+		LINK_STATS_INC(link.drop);
 #endif
 	} else {
         err = ERR_OK;
@@ -138,7 +142,7 @@ static err_t _unbuffered_low_level_output(xaxiemacif_s *xaxiemacif,
 #endif
 
 #if LINK_STATS
-	lwip_stats.link.xmit++;
+	LINK_STATS_INC(link.xmit);
 #endif /* LINK_STATS */
 
 	return err;
@@ -166,6 +170,8 @@ static err_t low_level_output(struct netif *netif, struct pbuf *p)
         struct xemac_s *xemac = (struct xemac_s *)(netif->state);
         xaxiemacif_s *xaxiemacif = (xaxiemacif_s *)(xemac->state);
 
+	CAPTURE_TX(netif, p);
+
 #ifdef XLWIP_CONFIG_INCLUDE_AXI_ETHERNET_DMA
 	/*
 	 * With AXI Ethernet on Zynq, we observed unexplained delays for
@@ -198,7 +204,7 @@ static err_t low_level_output(struct netif *netif, struct pbuf *p)
 #endif
     } else {
 #if LINK_STATS
-			lwip_stats.link.drop++;
+			LINK_STATS_INC(link.drop);
 #endif
 #ifdef XLWIP_CONFIG_INCLUDE_AXI_ETHERNET_DMA
 			process_sent_bds(txring);
@@ -236,23 +242,13 @@ return_pack_dropped:
 /*
  * low_level_input():
  *
- * Should allocate a pbuf and transfer the bytes of the incoming
- * packet from the interface into the pbuf.
+ * Takes up to n received packets off recv_q at once.
+ * Returns how many were taken.
  *
  */
-static struct pbuf *low_level_input(struct netif *netif)
+static int low_level_input(pq_queue_t *recv_q, struct pbuf **p, int n)
 {
-	struct xemac_s *xemac = (struct xemac_s *)(netif->state);
-	xaxiemacif_s *xaxiemacif = (xaxiemacif_s *)(xemac->state);
-	struct pbuf *p;
-
-	/* see if there is data to process */
-	if (pq_qlength(xaxiemacif->recv_q) == 0)
-		return NULL;
-
-	/* return one packet from receive q */
-	p = (struct pbuf *)pq_dequeue(xaxiemacif->recv_q);
-	return p;
+	return pq_dequeue_burst(recv_q, (void **)p, n);
 }
 
 /*
@@ -271,6 +267,44 @@ static err_t xaxiemacif_output(struct netif *netif, struct pbuf *p,
 	return etharp_output(netif, p, ipaddr);
 }
 
+/* hand one received packet to input */
+static void xaxiemacif_input_frame(struct netif *netif, struct pbuf *p, netif_input_fn input)
+{
+	/* points to packet payload, which starts with an Ethernet header */
+	struct eth_hdr *ethhdr = p->payload;
+
+#if LINK_STATS
+	LINK_STATS_INC(link.recv);
+#endif /* LINK_STATS */
+
+	CAPTURE_RX(netif, p);
+
+	switch (htons(ethhdr->type)) {
+		/* IP or ARP packet? */
+		case ETHTYPE_IP:
+		case ETHTYPE_ARP:
+#if LWIP_IPV6
+		/*IPv6 Packet?*/
+		case ETHTYPE_IPV6:
+#endif
+#if PPPOE_SUPPORT
+			/* PPPoE packet? */
+		case ETHTYPE_PPPOEDISC:
+		case ETHTYPE_PPPOE:
+#endif /* PPPOE_SUPPORT */
+			/* full packet send to tcpip_thread to process */
+			if (input(p, netif) != ERR_OK) {
+				LWIP_DEBUGF(NETIF_DEBUG, ("xaxiemacif_input: IP input error\r\n"));
+				pbuf_free(p);
+			}
+			break;
+
+		default:
+			pbuf_free(p);
+			break;
+	}
+}
+
 /*
  * xaxiemacif_input():
  *
@@ -279,66 +313,145 @@ static err_t xaxiemacif_output(struct netif *netif, struct pbuf *p,
  * should handle the actual reception of bytes from the network
  * interface.
  *
- * Returns the number of packets read (max 1 packet on success,
- * 0 if there are no packets)
+ * Packets are taken off the receive q in bursts of up to XEMAC_RX_BURST,
+ * with one protection window per burst. Returns the number of packets read
+ * (0 if there are no packets)
  *
  */
 
-int xaxiemacif_input(struct netif *netif)
+static int xaxiemacif_input_queue(struct netif *netif, pq_queue_t *recv_q)
 {
-	struct eth_hdr *ethhdr;
-	struct pbuf *p;
+	struct pbuf *p[XEMAC_RX_BURST];
+	int n_packets = 0;
+	int n, i;
 	SYS_ARCH_DECL_PROTECT(lev);
 
 #if !NO_SYS
 	while (1)
 #endif
 	{
-		/* move received packet into a new pbuf */
+		/* move a burst of received packets out of the receive q */
 		SYS_ARCH_PROTECT(lev);
-		p = low_level_input(netif);
+		n = low_level_input(recv_q, p, XEMAC_RX_BURST);
 		SYS_ARCH_UNPROTECT(lev);
 
 		/* no packet could be read, silently ignore this */
-		if (p == NULL)
-			return 0;
+		if (n == 0)
+			return n_packets;
+
+#if !NO_SYS && LWIP_TCPIP_CORE_LOCKING
+		/* take the core lock once per burst and skip the message to tcpip_thread per packet */
+		if (netif->input == tcpip_input) {
+			LOCK_TCPIP_CORE();
+			for (i = 0; i < n; i++)
+				xaxiemacif_input_frame(netif, p[i], ethernet_input);
+			UNLOCK_TCPIP_CORE();
+		} else
+#endif
+		for (i = 0; i < n; i++)
+			xaxiemacif_input_frame(netif, p[i], netif->input);
+
+		n_packets += n;
+	}
 
-		/* points to packet payload, which starts with an Ethernet header */
-		ethhdr = p->payload;
+	return n_packets;
+}
 
-#if LINK_STATS
-		lwip_stats.link.recv++;
-#endif /* LINK_STATS */
+int xaxiemacif_input(struct netif *netif)
+{
+	struct xemac_s *xemac = (struct xemac_s *)(netif->state);
+	xaxiemacif_s *xaxiemacif = (xaxiemacif_s *)(xemac->state);
+#if XAXIEMACIF_MCDMA_RX_STEER
+	u32_t i;
+	int n_packets = 0;
 
-		switch (htons(ethhdr->type)) {
-			/* IP or ARP packet? */
-			case ETHTYPE_IP:
-			case ETHTYPE_ARP:
-#if LWIP_IPV6
-			/*IPv6 Packet?*/
-			case ETHTYPE_IPV6:
+	for (i = 0; i < xaxiemacif->axi_ethernet.Config.AxiMcDmaChan_Cnt; i++)
+		n_packets += xaxiemacif_input_queue(netif, xaxiemacif->chan_recv_q[i]);
+
+	return n_packets;
+#else
+	return xaxiemacif_input_queue(netif, xaxiemacif->recv_q);
 #endif
-#if PPPOE_SUPPORT
-				/* PPPoE packet? */
-			case ETHTYPE_PPPOEDISC:
-			case ETHTYPE_PPPOE:
-#endif /* PPPOE_SUPPORT */
-				/* full packet send to tcpip_thread to process */
-				if (netif->input(p, netif) != ERR_OK) {
-					LWIP_DEBUGF(NETIF_DEBUG, ("xaxiemacif_input: IP input error\r\n"));
-					pbuf_free(p);
-					p = NULL;
-				}
-				break;
+}
 
-			default:
-				pbuf_free(p);
-				p = NULL;
-				break;
-		}
+#if XAXIEMACIF_MCDMA_RX_STEER
+/*
+ * xaxiemacif_mcdma_rx_thread():
+ *
+ * Input task for the MCDMA RX channels mapped to one rx_task, woken by
+ * their RX interrupts.
+ *
+ */
+static void xaxiemacif_mcdma_rx_thread(void *arg)
+{
+	struct xaxiemacif_rx_task *task = arg;
+	struct xemac_s *xemac = (struct xemac_s *)(task->netif->state);
+	xaxiemacif_s *xaxiemacif = (xaxiemacif_s *)(xemac->state);
+	u32_t n_chan = xaxiemacif->axi_ethernet.Config.AxiMcDmaChan_Cnt;
+	u32_t i;
+
+	while (1) {
+		sys_sem_wait(&task->sem);
+
+		for (i = task->first_chan; i < n_chan; i += xaxiemacif->n_rx_tasks)
+			xaxiemacif_input_queue(task->netif, xaxiemacif->chan_recv_q[i]);
+	}
+}
+
+/*
+ * xaxiemacif_mcdma_rx_steer_init():
+ *
+ * Creates a receive q per MCDMA RX channel and the input tasks that
+ * drain them.
+ *
+ */
+static err_t xaxiemacif_mcdma_rx_steer_init(struct netif *netif,
+		xaxiemacif_s *xaxiemacif)
+{
+	u32_t n_chan = xaxiemacif->axi_ethernet.Config.AxiMcDmaChan_Cnt;
+	u32_t i;
+
+	if (n_chan > XAXIEMACIF_MCDMA_MAX_RX_CHAN) {
+		LWIP_DEBUGF(NETIF_DEBUG, ("xaxiemacif_init: too many MCDMA channels\r\n"));
+		return ERR_IF;
+	}
+
+	for (i = 0; i < n_chan; i++) {
+		xaxiemacif->chan_recv_q[i] = pq_create_queue();
+		if (!xaxiemacif->chan_recv_q[i])
+			return ERR_MEM;
 	}
-	return 1;
+
+	xaxiemacif->n_rx_tasks = LWIP_MIN(n_chan, XAXIEMACIF_MCDMA_RX_TASKS);
+	for (i = 0; i < xaxiemacif->n_rx_tasks; i++) {
+		struct xaxiemacif_rx_task *task = &xaxiemacif->rx_task[i];
+
+		task->netif = netif;
+		task->first_chan = i;
+		if (sys_sem_new(&task->sem, 0) != ERR_OK)
+			return ERR_MEM;
+	}
+
+	return ERR_OK;
+}
+
+/*
+ * xaxiemacif_mcdma_rx_steer_start():
+ *
+ * Starts the input tasks, once netif->state points at the xemac.
+ *
+ */
+static void xaxiemacif_mcdma_rx_steer_start(xaxiemacif_s *xaxiemacif)
+{
+	u32_t i;
+
+	for (i = 0; i < xaxiemacif->n_rx_tasks; i++)
+		sys_thread_new("xaxiemacif_rx", xaxiemacif_mcdma_rx_thread,
+				&xaxiemacif->rx_task[i],
+				XAXIEMACIF_MCDMA_RX_THREAD_STACKSIZE,
+				XAXIEMACIF_MCDMA_RX_THREAD_PRIO);
 }
+#endif
 
 static err_t low_level_init(struct netif *netif)
 {
@@ -394,6 +507,12 @@ static err_t low_level_init(struct netif *netif)
 	netif->flags |= NETIF_FLAG_IGMP;
 #endif
 
+#if LWIP_CHECKSUM_CTRL_PER_NETIF
+	/* leave lwIP only the checksums the hardware doesn't compute or verify */
+	NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL &
+				~(XAXIEMACIF_CSUM_HW_TX | XAXIEMACIF_CSUM_HW_RX));
+#endif
+
 #if !NO_SYS
 	sys_sem_new(&xemac->sem_rx_data_available, 0);
 #endif
@@ -421,6 +540,10 @@ static err_t low_level_init(struct netif *netif)
 #endif
 	} else if (XAxiEthernet_IsMcDma(&xaxiemacif->axi_ethernet)) {
 #ifdef XLWIP_CONFIG_INCLUDE_AXI_ETHERNET_MCDMA
+#if XAXIEMACIF_MCDMA_RX_STEER
+		if (xaxiemacif_mcdma_rx_steer_init(netif, xaxiemacif) != ERR_OK)
+			return ERR_MEM;
+#endif
 		/* Initialize MCDMA engine */
 		init_axi_mcdma(xemac);
 #endif
@@ -438,6 +561,11 @@ static err_t low_level_init(struct netif *netif)
 	 */
 	netif->state = (void *)xemac;
 
+#if XAXIEMACIF_MCDMA_RX_STEER
+	if (XAxiEthernet_IsMcDma(&xaxiemacif->axi_ethernet))
+		xaxiemacif_mcdma_rx_steer_start(xaxiemacif);
+#endif
+
 	return ERR_OK;
 }
 #if LWIP_IPV6 && LWIP_IPV6_MLD
@@ -323,8 +323,8 @@ static void setup_rx_bds(XAxiDma_BdRing *rxring)
 #endif
 		if (!p) {
 #if LINK_STATS
-			lwip_stats.link.memerr++;
-			lwip_stats.link.drop++;
+			LINK_STATS_INC(link.memerr);
+			LINK_STATS_INC(link.drop);
 #endif
 			xil_printf("unable to alloc pbuf in recv_handler\r\n");
 			return;
@@ -453,13 +453,15 @@ static void axidma_recv_handler(void *arg)
 				LWIP_DEBUGF(NETIF_DEBUG, ("Incorrect csum as calculated by the hw\r\n"));
 			}
 #endif
+			PBUF_SET_RX_TIME(p);
+
 			/* store it in the receive queue,
 			 * where it'll be processed by a different handler
 			 */
 			if (pq_enqueue(xaxiemacif->recv_q, (void*)p) < 0) {
 #if LINK_STATS
-				lwip_stats.link.memerr++;
-				lwip_stats.link.drop++;
+				LINK_STATS_INC(link.memerr);
+				LINK_STATS_INC(link.drop);
 #endif
 				pbuf_free(p);
 			}
@@ -588,6 +590,8 @@ XStatus axidma_sgsend(xaxiemacif_s *xaxiemacif, struct pbuf *p)
 #endif
 #if LWIP_PARTIAL_CSUM_OFFLOAD_TX==1
 	bd_csum_disable(txbdset);
+#if !LWIP_IPV6
+	/* with IPv6 the TCP checksum is already filled in by lwIP */
 	if (p->len > sizeof(struct ethip_hdr)) {
 		struct ethip_hdr *ehdr = p->payload;
 		u8_t proto = IPH_PROTO(&ehdr->ip);
@@ -623,6 +627,7 @@ XStatus axidma_sgsend(xaxiemacif_s *xaxiemacif, struct pbuf *p)
 		}
 	}
 #endif
+#endif
 
 #if LWIP_UDP_OPT_BLOCK_TX_TILL_COMPLETE
     if (block_till_tx_complete == 1) {
@@ -744,8 +749,8 @@ XStatus init_axi_dma(struct xemac_s *xemac)
 #endif
 		if (!p) {
 #if LINK_STATS
-			lwip_stats.link.memerr++;
-			lwip_stats.link.drop++;
+			LINK_STATS_INC(link.memerr);
+			LINK_STATS_INC(link.drop);
 #endif
 			LWIP_DEBUGF(NETIF_DEBUG, ("unable to alloc pbuf in recv_handler\r\n"));
 			return ERR_IF;
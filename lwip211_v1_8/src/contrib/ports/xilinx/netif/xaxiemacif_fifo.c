@@ -86,6 +86,90 @@ int is_tx_space_available(xaxiemacif_s *emac)
 	return ((XLlFifo_TxVacancy(&emac->axififo) * 4) > XAE_MAX_FRAME_SIZE);
 }
 
+#if XAXIEMACIF_FIFO_CDMA
+#include <string.h>
+#include "xil_cache.h"
+
+static XStatus init_axi_fifo_cdma(struct xemac_s *xemac);
+static void axififo_cdma_done(void *arg, u32 irq_mask, int *ignore);
+static void axififo_tx_kick(xaxiemacif_s *xaxiemacif);
+
+/* The FIFO's data ports, read and written over and over by a keyhole transfer */
+static UINTPTR axififo_rx_port(XLlFifo *llfifo)
+{
+	if (llfifo->Datainterface)
+		return llfifo->Axi4BaseAddress + XLLF_AXI4_RDFD_OFFSET;
+	return llfifo->BaseAddress + XLLF_RDFD_OFFSET;
+}
+
+static UINTPTR axififo_tx_port(XLlFifo *llfifo)
+{
+	if (llfifo->Datainterface)
+		return llfifo->Axi4BaseAddress + XLLF_AXI4_TDFD_OFFSET;
+	return llfifo->BaseAddress + XLLF_TDFD_OFFSET;
+}
+
+/* Start a simple transfer; keyhole is XAXICDMA_CR_KHOLE_RD_MASK for one that
+ * reads the RX FIFO, XAXICDMA_CR_KHOLE_WR_MASK for one that fills the TX FIFO */
+static int axififo_cdma_start(xaxiemacif_s *xaxiemacif, UINTPTR src, UINTPTR dst,
+		u32_t len, u32 keyhole)
+{
+	XAxiCdma *cdma = &xaxiemacif->cdma;
+	u32 cr;
+
+	cr = XAxiCdma_ReadReg(cdma->BaseAddr, XAXICDMA_CR_OFFSET);
+	cr &= ~(XAXICDMA_CR_KHOLE_RD_MASK | XAXICDMA_CR_KHOLE_WR_MASK);
+	XAxiCdma_WriteReg(cdma->BaseAddr, XAXICDMA_CR_OFFSET, cr | keyhole);
+
+	return XAxiCdma_SimpleTransfer(cdma, src, dst, (len + 3) & ~3U,
+			axififo_cdma_done, xaxiemacif) == XST_SUCCESS;
+}
+
+/* Have the CDMA read the frame at the head of the RX FIFO into p */
+static int axififo_cdma_rx(xaxiemacif_s *xaxiemacif, struct pbuf *p, u32_t len)
+{
+	if (xaxiemacif->cdma_xemac == NULL || len < XAXIEMACIF_FIFO_CDMA_MIN ||
+			p->next != NULL || XAxiCdma_IsBusy(&xaxiemacif->cdma))
+		return 0;
+
+	/* nothing of these lines may be written back over the frame */
+	Xil_DCacheFlushRange((UINTPTR)p->payload, (len + 3) & ~3U);
+	xaxiemacif->cdma_rx = p;
+	xaxiemacif->cdma_rx_len = len;
+	if (!axififo_cdma_start(xaxiemacif, axififo_rx_port(&xaxiemacif->axififo),
+			(UINTPTR)p->payload, len, XAXICDMA_CR_KHOLE_RD_MASK)) {
+		xaxiemacif->cdma_rx = NULL;
+		return 0;
+	}
+	return 1;
+}
+#endif
+
+/* Hand a received frame to the xemacif input thread */
+static void
+xllfifo_recv_queue(struct xemac_s *xemac, struct pbuf *p)
+{
+	xaxiemacif_s *xaxiemacif = (xaxiemacif_s *)(xemac->state);
+
+	/* store it in the receive queue, where it'll be processed by xemacif input thread */
+	if (pq_enqueue(xaxiemacif->recv_q, (void*)p) < 0) {
+#if LINK_STATS
+		LINK_STATS_INC(link.memerr);
+		LINK_STATS_INC(link.drop);
+#endif
+		pbuf_free(p);
+		return;
+	}
+
+#if !NO_SYS
+	sys_sem_signal(&xemac->sem_rx_data_available);
+#endif
+
+#if LINK_STATS
+	LINK_STATS_INC(link.recv);
+#endif
+}
+
 static void
 xllfifo_recv_handler(struct xemac_s *xemac)
 {
@@ -96,16 +180,30 @@ xllfifo_recv_handler(struct xemac_s *xemac)
 
 	/* While there is data in the fifo ... */
 	while (XLlFifo_RxOccupancy(llfifo)) {
+#if XAXIEMACIF_FIFO_CDMA
+		/* the CDMA is still reading a frame, its completion comes back here */
+		if (xaxiemacif->cdma_rx != NULL)
+			return;
+#endif
 		/* find packet length */
 		frame_length = XLlFifo_RxGetLen(llfifo);
 
 		/* allocate a pbuf */
+#if XAXIEMACIF_FIFO_CDMA
+		/* room for the whole last word, the CDMA moves words */
+		p = pbuf_alloc(PBUF_RAW, (frame_length + 3) & ~3U, PBUF_POOL);
+		if (p && axififo_cdma_rx(xaxiemacif, p, frame_length))
+			return;
+		if (p)
+			pbuf_realloc(p, frame_length);
+#else
 		p = pbuf_alloc(PBUF_RAW, frame_length, PBUF_POOL);
+#endif
 		if (!p) {
                         char tmp_frame[XAE_MAX_FRAME_SIZE];
 #if LINK_STATS
-			lwip_stats.link.memerr++;
-			lwip_stats.link.drop++;
+			LINK_STATS_INC(link.memerr);
+			LINK_STATS_INC(link.drop);
 #endif
 			/* receive and drop packet to keep data & len registers in sync */
 		        XLlFifo_Read(llfifo, tmp_frame, frame_length);
@@ -120,23 +218,7 @@ xllfifo_recv_handler(struct xemac_s *xemac)
 		len += ETH_PAD_SIZE;		/* allow room for Ethernet padding */
 #endif
 
-		/* store it in the receive queue, where it'll be processed by xemacif input thread */
-		if (pq_enqueue(xaxiemacif->recv_q, (void*)p) < 0) {
-#if LINK_STATS
-			lwip_stats.link.memerr++;
-			lwip_stats.link.drop++;
-#endif
-			pbuf_free(p);
-			continue;
-		}
-
-#if !NO_SYS
-		sys_sem_signal(&xemac->sem_rx_data_available);
-#endif
-
-#if LINK_STATS
-		lwip_stats.link.recv++;
-#endif
+		xllfifo_recv_queue(xemac, p);
 	}
 }
 
@@ -193,6 +275,10 @@ xllfifo_intr_handler(struct xemac_s *xemac)
 		} else if (pending_fifo_intr & XLLF_INT_TC_MASK) {
 			/* tx intr */
 			XLlFifo_IntClear(llfifo, XLLF_INT_TC_MASK);
+#if XAXIEMACIF_FIFO_CDMA
+			/* room in the TX FIFO for frames that waited for it */
+			axififo_tx_kick(xaxiemacif);
+#endif
 		} else {
 			XLlFifo_IntClear(llfifo, XLLF_INT_ALL_MASK &
 					 ~(XLLF_INT_RC_MASK |
@@ -227,6 +313,12 @@ XStatus init_axi_fifo(struct xemac_s *xemac)
 	/* enable fifo interrupts */
 	XLlFifo_IntEnable(&xaxiemacif->axififo, XLLF_INT_ALL_MASK);
 
+#if XAXIEMACIF_FIFO_CDMA
+	if (init_axi_fifo_cdma(xemac) != XST_SUCCESS) {
+		xil_printf("AXI FIFO: CDMA not found, frames are copied by the CPU\r\n");
+	}
+#endif
+
 #if XLWIP_CONFIG_INCLUDE_AXIETH_ON_ZYNQ == 1
 	XScuGic_RegisterHandler(xtopologyp->scugic_baseaddr,
 				xaxiemacif->axi_ethernet.Config.TemacIntr,
@@ -332,22 +424,198 @@ XStatus init_axi_fifo(struct xemac_s *xemac)
 	return 0;
 }
 
-XStatus axififo_send(xaxiemacif_s *xaxiemacif, struct pbuf *p)
+/* Write the frame in p to the TX FIFO and send it. The first skip bytes of p
+ * are not part of the frame. */
+static void axififo_write(XLlFifo *llfifo, struct pbuf *p, u32_t skip)
 {
-	XLlFifo *llfifo = &xaxiemacif->axififo;
 	u32_t l = 0;
 	struct pbuf *q;
 
 	for(q = p; q != NULL; q = q->next) {
 		/* write frame data to FIFO */
-		XLlFifo_Write(llfifo, q->payload, q->len);
-		l += q->len;
+		XLlFifo_Write(llfifo, (u8_t *)q->payload + skip, q->len - skip);
+		l += q->len - skip;
+		skip = 0;
 	}
 
 	/* initiate transmit */
 	XLlFifo_TxSetLen(llfifo, l);
+}
 
-	return 0;
+#if XAXIEMACIF_FIFO_CDMA
+/* Have the CDMA write the frame in p, minus skip bytes in front, to the TX FIFO */
+static int axififo_cdma_tx(xaxiemacif_s *xaxiemacif, struct pbuf *p, u32_t skip)
+{
+	UINTPTR data = (UINTPTR)p->payload + skip;
+	u32_t len = p->len - skip;
+
+	/* without a data realignment engine, the CDMA reads from word boundaries */
+	if (xaxiemacif->cdma_xemac == NULL || len < XAXIEMACIF_FIFO_CDMA_MIN ||
+			p->next != NULL || (data & 3) != 0 ||
+			XAxiCdma_IsBusy(&xaxiemacif->cdma))
+		return 0;
+
+	Xil_DCacheFlushRange(data, len);
+	pbuf_ref(p);
+	xaxiemacif->cdma_tx = p;
+	xaxiemacif->cdma_tx_len = len;
+	if (!axififo_cdma_start(xaxiemacif, data, axififo_tx_port(&xaxiemacif->axififo),
+			len, XAXICDMA_CR_KHOLE_WR_MASK)) {
+		xaxiemacif->cdma_tx = NULL;
+		pbuf_free(p);
+		return 0;
+	}
+	return 1;
+}
+
+/* Send frames that waited behind a CDMA transfer to the TX FIFO, as long as
+ * there is room for them. They still carry their ETH_PAD_SIZE bytes. */
+static void axififo_tx_kick(xaxiemacif_s *xaxiemacif)
+{
+	struct pbuf *p;
+
+	while (xaxiemacif->tx_count > 0 && xaxiemacif->cdma_tx == NULL &&
+			is_tx_space_available(xaxiemacif)) {
+		p = xaxiemacif->tx_q[xaxiemacif->tx_head];
+		xaxiemacif->tx_q[xaxiemacif->tx_head] = NULL;
+		xaxiemacif->tx_head = (xaxiemacif->tx_head + 1) %
+				XAXIEMACIF_FIFO_CDMA_TX_QUEUE_LEN;
+		xaxiemacif->tx_count--;
+		if (!axififo_cdma_tx(xaxiemacif, p, ETH_PAD_SIZE))
+			axififo_write(&xaxiemacif->axififo, p, ETH_PAD_SIZE);
+		pbuf_free(p);
+	}
+}
+
+/* CDMA interrupt: a frame is in its pbuf or in the TX FIFO now, and the CDMA
+ * can take the next one */
+static void axififo_cdma_done(void *arg, u32 irq_mask, int *ignore)
+{
+	xaxiemacif_s *xaxiemacif = (xaxiemacif_s *)arg;
+	int error = (irq_mask & XAXICDMA_XR_IRQ_ERROR_MASK) != 0;
+	struct pbuf *p;
+
+	(void)ignore;
+
+	if ((p = xaxiemacif->cdma_rx) != NULL) {
+		xaxiemacif->cdma_rx = NULL;
+		if (error) {
+			/* the FIFO stopped somewhere inside the frame */
+			XLlFifo_RxReset(&xaxiemacif->axififo);
+			pbuf_free(p);
+#if LINK_STATS
+			LINK_STATS_INC(link.drop);
+#endif
+		} else {
+			Xil_DCacheInvalidateRange((UINTPTR)p->payload,
+					(xaxiemacif->cdma_rx_len + 3) & ~3U);
+			pbuf_realloc(p, xaxiemacif->cdma_rx_len);
+			xllfifo_recv_queue(xaxiemacif->cdma_xemac, p);
+		}
+	}
+
+	if ((p = xaxiemacif->cdma_tx) != NULL) {
+		xaxiemacif->cdma_tx = NULL;
+		if (error) {
+			XLlFifo_TxReset(&xaxiemacif->axififo);
+#if LINK_STATS
+			LINK_STATS_INC(link.drop);
+#endif
+		} else {
+			XLlFifo_TxSetLen(&xaxiemacif->axififo, xaxiemacif->cdma_tx_len);
+		}
+		pbuf_free(p);
+	}
+
+	if (error) {
+		XAxiCdma_Reset(&xaxiemacif->cdma);
+		while (!XAxiCdma_ResetIsDone(&xaxiemacif->cdma))
+			;
+		XAxiCdma_IntrEnable(&xaxiemacif->cdma, XAXICDMA_XR_IRQ_ALL_MASK);
+	}
+
+	/* received frames first, the RX FIFO is the one that overflows */
+	xllfifo_recv_handler(xaxiemacif->cdma_xemac);
+	axififo_tx_kick(xaxiemacif);
+}
+
+static void axififo_cdma_intr_handler(void *arg)
+{
+	xaxiemacif_s *xaxiemacif = (xaxiemacif_s *)arg;
+
+#if !NO_SYS
+	xInsideISR++;
+#endif
+	XAxiCdma_IntrHandler(&xaxiemacif->cdma);
+#if !NO_SYS
+	xInsideISR--;
+#endif
+}
+
+static XStatus init_axi_fifo_cdma(struct xemac_s *xemac)
+{
+	xaxiemacif_s *xaxiemacif = (xaxiemacif_s *)(xemac->state);
+	struct xtopology_t *xtopologyp = &xtopology[xemac->topology_index];
+	XAxiCdma_Config *config;
+
+	/* a NULL cdma_xemac leaves all copying to the CPU */
+	xaxiemacif->cdma_xemac = NULL;
+	xaxiemacif->cdma_rx = NULL;
+	xaxiemacif->cdma_tx = NULL;
+	memset(xaxiemacif->tx_q, 0, sizeof(xaxiemacif->tx_q));
+	xaxiemacif->tx_head = 0;
+	xaxiemacif->tx_count = 0;
+
+	config = XAxiCdma_LookupConfig(XAXIEMACIF_FIFO_CDMA_DEVICE_ID);
+	if (config == NULL ||
+			XAxiCdma_CfgInitialize(&xaxiemacif->cdma, config,
+				config->BaseAddress) != XST_SUCCESS)
+		return XST_FAILURE;
+	xaxiemacif->cdma_xemac = xemac;
+
+	XAxiCdma_IntrEnable(&xaxiemacif->cdma, XAXICDMA_XR_IRQ_ALL_MASK);
+#if XLWIP_CONFIG_INCLUDE_AXIETH_ON_ZYNQ == 1
+	XScuGic_RegisterHandler(xtopologyp->scugic_baseaddr,
+				XAXIEMACIF_FIFO_CDMA_INTR,
+				(XInterruptHandler)axififo_cdma_intr_handler,
+				xaxiemacif);
+	XScuGic_SetPriTrigTypeByDistAddr(INTC_DIST_BASE_ADDR,
+			XAXIEMACIF_FIFO_CDMA_INTR,
+			AXIFIFO_INTR_PRIORITY_SET_IN_GIC,
+			TRIG_TYPE_RISING_EDGE_SENSITIVE);
+	XScuGic_EnableIntr(INTC_DIST_BASE_ADDR, XAXIEMACIF_FIFO_CDMA_INTR);
+#else
+	XIntc_RegisterHandler(xtopologyp->intc_baseaddr,
+			XAXIEMACIF_FIFO_CDMA_INTR,
+			(XInterruptHandler)axififo_cdma_intr_handler,
+			xaxiemacif);
+	XIntc_EnableIntr(xtopologyp->intc_baseaddr,
+			XIntc_In32(xtopologyp->intc_baseaddr + XIN_IER_OFFSET) |
+			(1 << XAXIEMACIF_FIFO_CDMA_INTR));
+#endif
+	return XST_SUCCESS;
+}
+#endif
+
+XStatus axififo_send(xaxiemacif_s *xaxiemacif, struct pbuf *p)
+{
+#if XAXIEMACIF_FIFO_CDMA
+	/* behind the frames waiting for the CDMA, in order */
+	if (xaxiemacif->cdma_tx != NULL || xaxiemacif->tx_count > 0) {
+		if (xaxiemacif->tx_count == XAXIEMACIF_FIFO_CDMA_TX_QUEUE_LEN)
+			return XST_FAILURE;
+		pbuf_ref(p);
+		xaxiemacif->tx_q[(xaxiemacif->tx_head + xaxiemacif->tx_count) %
+				XAXIEMACIF_FIFO_CDMA_TX_QUEUE_LEN] = p;
+		xaxiemacif->tx_count++;
+		return XST_SUCCESS;
+	}
+	if (axififo_cdma_tx(xaxiemacif, p, 0))
+		return XST_SUCCESS;
+#endif
+	axififo_write(&xaxiemacif->axififo, p, 0);
+
+	return XST_SUCCESS;
 }
 
 #if XPAR_INTC_0_HAS_FAST == 1
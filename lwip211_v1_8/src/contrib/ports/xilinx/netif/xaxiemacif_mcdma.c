@@ -86,7 +86,15 @@
 #define BLOCK_SIZE_2MB          0x200000
 #define BLOCK_SIZE_1MB          0x100000
 
-#if defined (__aarch64__)
+#ifdef XAXIEMACIF_BD_SECTION
+/* RX and TX rings of every channel, see XAXIEMACIF_BD_SECTION */
+#define BD_SIZE                 ((XLWIP_CONFIG_N_RX_DESC + XLWIP_CONFIG_N_TX_DESC) * \
+				 (XMCDMA_MAX_CHAN_PER_DEVICE / 2) * \
+				 ((sizeof(XMcdma_Bd) + XMCDMA_BD_MINIMUM_ALIGNMENT - 1) & \
+				  ~(XMCDMA_BD_MINIMUM_ALIGNMENT - 1)))
+static u8_t bd_space[BD_SIZE] __attribute__ ((aligned (XMCDMA_BD_MINIMUM_ALIGNMENT),
+					       section (XAXIEMACIF_BD_SECTION)));
+#elif defined (__aarch64__)
 #define BD_SIZE                 BLOCK_SIZE_2MB
 static u8_t bd_space[BD_SIZE] __attribute__ ((aligned (BLOCK_SIZE_2MB)));
 #else
@@ -392,6 +400,11 @@ static void axi_mcdma_recv_handler(void *CallBackRef, u32 ChanId)
 	xaxiemacif_s *xaxiemacif = (xaxiemacif_s *)(xemac->state);
 	XMcdma *McDmaInstPtr = &xaxiemacif->aximcdma;
 	XMcdma_ChanCtrl *Rx_Chan;
+#if XAXIEMACIF_MCDMA_RX_STEER
+	pq_queue_t *recv_q = xaxiemacif->chan_recv_q[ChanId - 1];
+#else
+	pq_queue_t *recv_q = xaxiemacif->recv_q;
+#endif
 
 #if !NO_SYS
 	xInsideISR++;
@@ -422,10 +435,10 @@ static void axi_mcdma_recv_handler(void *CallBackRef, u32 ChanId)
 		/* store it in the receive queue,
 		 * where it'll be processed by a different handler
 		 */
-		if (pq_enqueue(xaxiemacif->recv_q, (void*)p) < 0) {
+		if (pq_enqueue(recv_q, (void*)p) < 0) {
 #if LINK_STATS
-			lwip_stats.link.memerr++;
-			lwip_stats.link.drop++;
+			LINK_STATS_INC(link.memerr);
+			LINK_STATS_INC(link.drop);
 #endif
 			pbuf_free(p);
 		}
@@ -437,7 +450,11 @@ static void axi_mcdma_recv_handler(void *CallBackRef, u32 ChanId)
 
 	/* return all the processed bd's back to the stack */
 	setup_rx_bds(Rx_Chan, Rx_Chan->BdCnt);
-#if !NO_SYS
+#if XAXIEMACIF_MCDMA_RX_STEER
+	sys_sem_signal(&xaxiemacif->rx_task[(ChanId - 1) %
+				xaxiemacif->n_rx_tasks].sem);
+	xInsideISR--;
+#elif !NO_SYS
 	sys_sem_signal(&xemac->sem_rx_data_available);
 	xInsideISR--;
 #endif
@@ -487,7 +504,7 @@ s32_t process_sent_bds(XMcdma_ChanCtrl *Tx_Chan)
 	return XST_SUCCESS;
 }
 
-#if LWIP_PARTIAL_CSUM_OFFLOAD_TX==1
+#if LWIP_PARTIAL_CSUM_OFFLOAD_TX==1 && !LWIP_IPV6
 static void update_partial_cksum_offload(XMcdma_Bd *txbdset, struct pbuf *p)
 {
 	if (p->len > sizeof(struct ethip_hdr)) {
@@ -599,7 +616,10 @@ XStatus axi_mcdma_sgsend(xaxiemacif_s *xaxiemacif, struct pbuf *p)
 
 #if LWIP_PARTIAL_CSUM_OFFLOAD_TX==1
 	bd_csum_disable(txbdset);
+#if !LWIP_IPV6
+	/* with IPv6 the TCP checksum is already filled in by lwIP */
 	update_partial_cksum_offload(txbdset, p);
+#endif
 #endif
 	DATA_SYNC;
 	/* enq to h/w */
@@ -786,7 +806,9 @@ XStatus init_axi_mcdma(struct xemac_s *xemac)
 	}
 
 	/* Mark the BD Region as uncacheable */
-#if defined(__aarch64__)
+#ifdef XAXIEMACIF_BD_SECTION
+	/* the section comes uncached or coherent from the memory map */
+#elif defined(__aarch64__)
 	Xil_SetTlbAttributes((UINTPTR)bd_space,
 					NORM_NONCACHE | INNER_SHAREABLE);
 #elif defined (ARMR5)
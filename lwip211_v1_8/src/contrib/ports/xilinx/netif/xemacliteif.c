@@ -123,10 +123,8 @@ static err_t xemacliteif_output(struct netif *netif, struct pbuf *p,
 unsigned get_IEEE_phy_speed_emaclite(XEmacLite *xemaclitep);
 unsigned configure_IEEE_phy_speed_emaclite(XEmacLite *xemaclitep, unsigned speed);
 
-/* The payload from multiple pbufs is assembled into a single contiguous
- * area for transmission. Currently this is a global variable (it should really
- * belong in the per netif structure), but that is ok since this can be used
- * only in a protected context
+/* Frames that can't be received for lack of a pbuf are read in here and
+ * dropped. Only touched by the receive interrupt.
  */
 unsigned char xemac_tx_frame[XEL_MAX_FRAME_SIZE] __attribute__((aligned(64)));
 
@@ -173,8 +171,8 @@ xemacif_recv_handler(void *arg) {
 	p = pbuf_alloc(PBUF_RAW, XEL_MAX_FRAME_SIZE, PBUF_POOL);
 	if (!p) {
 #if LINK_STATS
-		lwip_stats.link.memerr++;
-		lwip_stats.link.drop++;
+		LINK_STATS_INC(link.memerr);
+		LINK_STATS_INC(link.drop);
 #endif
 		/* receive and just ignore the frame.
 		 * we need to receive the frame because otherwise emaclite will
@@ -193,7 +191,7 @@ xemacif_recv_handler(void *arg) {
 
 	if (len == 0) {
 #if LINK_STATS
-		lwip_stats.link.drop++;
+		LINK_STATS_INC(link.drop);
 #endif
 		pbuf_free(p);
 #if !NO_SYS
@@ -202,11 +200,13 @@ xemacif_recv_handler(void *arg) {
 		return;
 	}
 
+	PBUF_SET_RX_TIME(p);
+
 	/* store it in the receive queue, where it'll be processed by xemacif input thread */
 	if (pq_enqueue(xemacliteif->recv_q, (void*)p) < 0) {
 #if LINK_STATS
-		lwip_stats.link.memerr++;
-		lwip_stats.link.drop++;
+		LINK_STATS_INC(link.memerr);
+		LINK_STATS_INC(link.drop);
 #endif
 		pbuf_free(p);
 #if !NO_SYS
@@ -236,42 +236,91 @@ int transmit_packet(XEmacLite *instancep, void *packet, unsigned len)
 }
 
 /*
- * this function is always called with interrupts off
- * this function also assumes that there is space to send in the Emaclite buffer
+ * Copy len bytes of a frame from its pbuf chain straight into the TX buffer at
+ * buf. The buffer only takes 32 bit writes; word aligned runs of a payload go
+ * in as they are, anything else is put together a byte at a time.
  */
-static err_t
-_unbuffered_low_level_output(XEmacLite *instancep, struct pbuf *p)
+static void
+xemaclite_write_frame(UINTPTR buf, struct pbuf *p, u32_t len)
 {
+	union {
+		u32 word;
+		u8_t bytes[4];
+	} w;
+	u32_t fill = 0;
 	struct pbuf *q;
-	int total_len = 0;
-
-#if ETH_PAD_SIZE
-	pbuf_header(p, -ETH_PAD_SIZE);			/* drop the padding word */
-#endif
 
-	for(q = p, total_len = 0; q != NULL; q = q->next) {
-		/* Send the data from the pbuf to the interface, one pbuf at a
-		   time. The size of the data in each pbuf is kept in the ->len
-		   variable. */
-		memcpy(xemac_tx_frame + total_len, q->payload, q->len);
-		total_len += q->len;
+	for (q = p; q != NULL && len > 0; q = q->next) {
+		const u8_t *src = (const u8_t *)q->payload;
+		u32_t n = LWIP_MIN(q->len, len);
+
+		len -= n;
+		while (n > 0) {
+			if (fill == 0 && n >= 4 && ((UINTPTR)src & 3) == 0) {
+				Xil_Out32(buf, *(const u32 *)src);
+				buf += 4;
+				src += 4;
+				n -= 4;
+				continue;
+			}
+			w.bytes[fill++] = *src++;
+			n--;
+			if (fill == 4) {
+				Xil_Out32(buf, w.word);
+				buf += 4;
+				fill = 0;
+			}
+		}
 	}
+	if (fill > 0)
+		Xil_Out32(buf, w.word);
+}
 
-	if (transmit_packet(instancep, xemac_tx_frame, total_len) < 0) {
-#if LINK_STATS
-		lwip_stats.link.drop++;
-#endif
+/*
+ * Start sending p from the ping or the pong buffer, whichever is free, in the
+ * order XEmacLite_Send() uses them. Returns 0 when both are still busy.
+ * Called with interrupts off.
+ */
+static int
+xemaclite_send(XEmacLite *instancep, struct pbuf *p)
+{
+	UINTPTR base = instancep->EmacLiteConfig.BaseAddress;
+	UINTPTR buf = base + instancep->NextTxBufferToUse;
+	u32_t len;
+	u32 reg;
+
+	if (XEmacLite_GetTxStatus(buf) &
+			(XEL_TSR_XMIT_BUSY_MASK | XEL_TSR_XMIT_ACTIVE_MASK)) {
+		if (instancep->EmacLiteConfig.TxPingPong == 0)
+			return 0;
+		buf ^= XEL_BUFFER_OFFSET;
+		if (XEmacLite_GetTxStatus(buf) &
+				(XEL_TSR_XMIT_BUSY_MASK | XEL_TSR_XMIT_ACTIVE_MASK))
+			return 0;
+	} else if (instancep->EmacLiteConfig.TxPingPong != 0) {
+		instancep->NextTxBufferToUse ^= XEL_BUFFER_OFFSET;
 	}
 
+#if ETH_PAD_SIZE
+	pbuf_header(p, -ETH_PAD_SIZE);			/* drop the padding word */
+#endif
+	len = LWIP_MIN(p->tot_len, XEL_MAX_FRAME_SIZE);
+	xemaclite_write_frame(buf, p, len);
 #if ETH_PAD_SIZE
 	pbuf_header(p, ETH_PAD_SIZE);			/* reclaim the padding word */
 #endif
 
+	XEmacLite_WriteReg(buf, XEL_TPLR_OFFSET,
+			len & (XEL_TPLR_LENGTH_MASK_HI | XEL_TPLR_LENGTH_MASK_LO));
+	reg = XEmacLite_GetTxStatus(buf) | XEL_TSR_XMIT_BUSY_MASK;
+	if (XEmacLite_GetTxStatus(base) & XEL_TSR_XMIT_IE_MASK)
+		reg |= XEL_TSR_XMIT_IE_MASK;
+	XEmacLite_SetTxStatus(buf, reg);
+
 #if LINK_STATS
-	lwip_stats.link.xmit++;
+	LINK_STATS_INC(link.xmit);
 #endif /* LINK_STATS */
-
-	return ERR_OK;
+	return 1;
 }
 
 /*
@@ -281,6 +330,8 @@ _unbuffered_low_level_output(XEmacLite *instancep, struct pbuf *p)
  * contained in the pbuf that is passed to the function. This pbuf
  * might be chained.
  *
+ * The frame is copied into a free ping or pong buffer right away. When both
+ * are busy it waits in tx_q for xemacif_send_handler instead.
  */
 static err_t
 low_level_output(struct netif *netif, struct pbuf *p)
@@ -289,46 +340,28 @@ low_level_output(struct netif *netif, struct pbuf *p)
 	struct xemac_s *xemac = (struct xemac_s *)(netif->state);
 	xemacliteif_s *xemacliteif = (xemacliteif_s *)(xemac->state);
 	XEmacLite *instance = xemacliteif->instance;
-	struct pbuf *q;
 
 	SYS_ARCH_PROTECT(lev);
 
-	/* check if space is available to send */
-        if (XEmacLite_TxBufferAvailable(instance) == TRUE) {
-		if (pq_qlength(xemacliteif->send_q)) {  	/* send backlog */
-			_unbuffered_low_level_output(instance, (struct pbuf *)pq_dequeue(xemacliteif->send_q));
-		} else { 				/* send current */
-			_unbuffered_low_level_output(instance, p);
-			SYS_ARCH_UNPROTECT(lev);
-			return ERR_OK;
-		}
-	}
-
-	/* if we cannot send the packet immediately, then make a copy of the whole packet
-	 * into a separate pbuf and store it in send_q. We cannot enqueue the pbuf as is
-	 * since parts of the pbuf may be modified inside lwIP.
-	 */
-	q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_POOL);
-	if (!q) {
-#if LINK_STATS
-		lwip_stats.link.drop++;
-#endif
+	/* frames already waiting go first */
+	if (xemacliteif->tx_count == 0 && xemaclite_send(instance, p)) {
 		SYS_ARCH_UNPROTECT(lev);
-		return ERR_MEM;
+		return ERR_OK;
 	}
 
-	for (q->len = 0; p; p = p->next) {
-		memcpy(q->payload + q->len, p->payload, p->len);
-		q->len += p->len;
-	}
-	if (pq_enqueue(xemacliteif->send_q, (void *)q) < 0) {
+	if (xemacliteif->tx_count == XEMACLITEIF_TX_QUEUE_LEN) {
 #if LINK_STATS
-		lwip_stats.link.drop++;
+		LINK_STATS_INC(link.drop);
 #endif
 		SYS_ARCH_UNPROTECT(lev);
 		return ERR_MEM;
 	}
 
+	pbuf_ref(p);
+	xemacliteif->tx_q[(xemacliteif->tx_head + xemacliteif->tx_count) %
+			XEMACLITEIF_TX_QUEUE_LEN] = p;
+	xemacliteif->tx_count++;
+
 	SYS_ARCH_UNPROTECT(lev);
 
 	return ERR_OK;
@@ -340,6 +373,7 @@ xemacif_send_handler(void *arg) {
 	xemacliteif_s *xemacliteif = (xemacliteif_s *)(xemac->state);
 	XEmacLite *instance = xemacliteif->instance;
 	struct xtopology_t *xtopologyp = &xtopology[xemac->topology_index];
+	struct pbuf *p;
 
 #if !NO_SYS
 	xInsideISR++;
@@ -349,9 +383,14 @@ xemacif_send_handler(void *arg) {
 	XIntc_AckIntr(xtopologyp->intc_baseaddr, 1 << xtopologyp->intc_emac_intr);
 #endif
 
-	if (pq_qlength(xemacliteif->send_q) && (XEmacLite_TxBufferAvailable(instance) == TRUE)) {
-		struct pbuf *p = pq_dequeue(xemacliteif->send_q);
-		_unbuffered_low_level_output(instance, p);
+	/* refill both buffers if that many frames are waiting */
+	while (xemacliteif->tx_count > 0) {
+		p = xemacliteif->tx_q[xemacliteif->tx_head];
+		if (!xemaclite_send(instance, p))
+			break;
+		xemacliteif->tx_q[xemacliteif->tx_head] = NULL;
+		xemacliteif->tx_head = (xemacliteif->tx_head + 1) % XEMACLITEIF_TX_QUEUE_LEN;
+		xemacliteif->tx_count--;
 		pbuf_free(p);
 	}
 #if !NO_SYS
@@ -433,7 +472,7 @@ xemacliteif_input(struct netif *netif)
 		ethhdr = p->payload;
 
 	#if LINK_STATS
-		lwip_stats.link.recv++;
+		LINK_STATS_INC(link.recv);
 	#endif /* LINK_STATS */
 
 		switch (htons(ethhdr->type)) {
@@ -611,9 +650,9 @@ static err_t low_level_init(struct netif *netif)
 	if (!xemacliteif->recv_q)
 		return ERR_MEM;
 
-	xemacliteif->send_q = pq_create_queue();
-	if (!xemacliteif->send_q)
-		return ERR_MEM;
+	memset(xemacliteif->tx_q, 0, sizeof(xemacliteif->tx_q));
+	xemacliteif->tx_head = 0;
+	xemacliteif->tx_count = 0;
 
 	/* Initialize PHY */
 
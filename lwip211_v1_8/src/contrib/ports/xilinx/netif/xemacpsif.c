@@ -40,12 +40,17 @@
 #include "lwip/pbuf.h"
 #include "lwip/sys.h"
 #include "lwip/stats.h"
+#include "lwip/timeouts.h"
+#if !NO_SYS
+#include "lwip/tcpip.h"
+#endif
 #include "lwip/igmp.h"
 
 #include "netif/etharp.h"
 #include "netif/xemacpsif.h"
 #include "netif/xadapter.h"
 #include "netif/xpqueue.h"
+#include "arch/capture.h"
 #include "xparameters.h"
 #include "xscugic.h"
 #include "xemacps.h"
@@ -116,7 +121,7 @@ static err_t _unbuffered_low_level_output(xemacpsif_s *xemacpsif,
 #endif
 	if (status != XST_SUCCESS) {
 #if LINK_STATS
-		lwip_stats.link.drop++;
+		LINK_STATS_INC(link.drop);
 #endif
 	} else {
 		err = ERR_OK;
@@ -127,13 +132,43 @@ static err_t _unbuffered_low_level_output(xemacpsif_s *xemacpsif,
 #endif
 
 #if LINK_STATS
-	lwip_stats.link.xmit++;
+	LINK_STATS_INC(link.xmit);
 #endif /* LINK_STATS */
 
 	return err;
 
 }
 
+#if XEMACPSIF_TX_LAZY_RECLAIM
+/*
+ * xemacpsif_tx_reclaim_timeout():
+ *
+ * Reclaims the BDs sent since the last low_level_output and keeps
+ * running until the TX ring is empty.
+ *
+ */
+static void xemacpsif_tx_reclaim_timeout(void *arg)
+{
+	struct netif *netif = (struct netif *)arg;
+	struct xemac_s *xemac = (struct xemac_s *)(netif->state);
+	xemacpsif_s *xemacpsif = (xemacpsif_s *)(xemac->state);
+	XEmacPs_BdRing *txring = &(XEmacPs_GetTxRing(&xemacpsif->emacps));
+	s32_t freecnt;
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	process_sent_bds(xemacpsif, txring);
+	freecnt = is_tx_space_available(xemacpsif);
+	SYS_ARCH_UNPROTECT(lev);
+
+	if (freecnt < XLWIP_CONFIG_N_TX_DESC) {
+		sys_timeout(XEMACPSIF_TX_RECLAIM_MS, xemacpsif_tx_reclaim_timeout, netif);
+	} else {
+		xemacpsif->tx_reclaim_armed = 0;
+	}
+}
+#endif
+
 /*
  * low_level_output():
  *
@@ -157,10 +192,12 @@ static err_t low_level_output(struct netif *netif, struct pbuf *p)
 	struct xemac_s *xemac = (struct xemac_s *)(netif->state);
 	xemacpsif_s *xemacpsif = (xemacpsif_s *)(xemac->state);
 
+	CAPTURE_TX(netif, p);
+
 	SYS_ARCH_PROTECT(lev);
 	/* check if space is available to send */
     freecnt = is_tx_space_available(xemacpsif);
-    if (freecnt <= 5) {
+    if (freecnt <= XEMACPSIF_TX_RECLAIM_THRESH) {
 	txring = &(XEmacPs_GetTxRing(&xemacpsif->emacps));
 		process_sent_bds(xemacpsif, txring);
 	}
@@ -177,7 +214,7 @@ static err_t low_level_output(struct netif *netif, struct pbuf *p)
 #endif
 	} else {
 #if LINK_STATS
-		lwip_stats.link.drop++;
+		LINK_STATS_INC(link.drop);
 #endif
 		xil_printf("pack dropped, no space\r\n");
 		SYS_ARCH_UNPROTECT(lev);
@@ -185,6 +222,14 @@ static err_t low_level_output(struct netif *netif, struct pbuf *p)
 	}
 	SYS_ARCH_UNPROTECT(lev);
 
+#if XEMACPSIF_TX_LAZY_RECLAIM
+	/* no TX-complete interrupt: make sure the last frames are reclaimed too */
+	if (!xemacpsif->tx_reclaim_armed) {
+		xemacpsif->tx_reclaim_armed = 1;
+		sys_timeout(XEMACPSIF_TX_RECLAIM_MS, xemacpsif_tx_reclaim_timeout, netif);
+	}
+#endif
+
 #if LWIP_UDP_OPT_BLOCK_TX_TILL_COMPLETE
 	if (netif_is_opt_block_tx_set(netif, NETIF_ENABLE_BLOCKING_TX_FOR_PACKET)) {
 		/* Wait for approx 1 second before timing out */
@@ -204,26 +249,79 @@ return_pack_dropped:
 	return err;
 }
 
+#if LWIP_NETIF_LINKOUTPUT_BURST
 /*
- * low_level_input():
+ * low_level_output_burst():
  *
- * Should allocate a pbuf and transfer the bytes of the incoming
- * packet from the interface into the pbuf.
+ * Queues the frames of a burst on the TX BD ring and starts the
+ * transmitter once for all of them.
  *
  */
-static struct pbuf * low_level_input(struct netif *netif)
+static err_t low_level_output_burst(struct netif *netif, struct pbuf **frames, u16_t n)
 {
+	err_t err = ERR_OK, e;
+	u16_t i;
+	XEmacPs_BdRing *txring;
+#if LWIP_UDP_OPT_BLOCK_TX_TILL_COMPLETE
+	u32_t to_block_index;
+#endif
+
+	SYS_ARCH_DECL_PROTECT(lev);
 	struct xemac_s *xemac = (struct xemac_s *)(netif->state);
 	xemacpsif_s *xemacpsif = (xemacpsif_s *)(xemac->state);
-	struct pbuf *p;
 
-	/* see if there is data to process */
-	if (pq_qlength(xemacpsif->recv_q) == 0)
-		return NULL;
+	for (i = 0; i < n; i++) {
+		CAPTURE_TX(netif, frames[i]);
+	}
 
-	/* return one packet from receive q */
-	p = (struct pbuf *)pq_dequeue(xemacpsif->recv_q);
-	return p;
+	SYS_ARCH_PROTECT(lev);
+	txring = &(XEmacPs_GetTxRing(&xemacpsif->emacps));
+	xemacpsif->tx_hold = 1;
+	for (i = 0; i < n; i++) {
+		if (is_tx_space_available(xemacpsif) <= XEMACPSIF_TX_RECLAIM_THRESH) {
+			process_sent_bds(xemacpsif, txring);
+		}
+		if (!is_tx_space_available(xemacpsif)) {
+#if LINK_STATS
+			LINK_STATS_INC(link.drop);
+#endif
+			err = ERR_MEM;
+			continue;
+		}
+#if LWIP_UDP_OPT_BLOCK_TX_TILL_COMPLETE
+		e = _unbuffered_low_level_output(xemacpsif, frames[i], 0, &to_block_index);
+#else
+		e = _unbuffered_low_level_output(xemacpsif, frames[i]);
+#endif
+		if (e != ERR_OK) {
+			err = e;
+		}
+	}
+	xemacpsif->tx_hold = 0;
+	emacps_start_tx(xemacpsif);
+	SYS_ARCH_UNPROTECT(lev);
+
+#if XEMACPSIF_TX_LAZY_RECLAIM
+	if (!xemacpsif->tx_reclaim_armed) {
+		xemacpsif->tx_reclaim_armed = 1;
+		sys_timeout(XEMACPSIF_TX_RECLAIM_MS, xemacpsif_tx_reclaim_timeout, netif);
+	}
+#endif
+
+	return err;
+}
+#endif
+
+/*
+ * low_level_input():
+ *
+ * Takes up to n received packets off the receive q at once.
+ * Returns how many were taken.
+ *
+ */
+static int low_level_input(pq_queue_t *recv_q, struct pbuf **p, int n)
+{
+	return pq_dequeue_burst(recv_q, (void **)p, n);
 }
 
 /*
@@ -242,6 +340,44 @@ static err_t xemacpsif_output(struct netif *netif, struct pbuf *p,
 	return etharp_output(netif, p, ipaddr);
 }
 
+/* hand one received packet to input */
+static void xemacpsif_input_frame(struct netif *netif, struct pbuf *p, netif_input_fn input)
+{
+	/* points to packet payload, which starts with an Ethernet header */
+	struct eth_hdr *ethhdr = p->payload;
+
+#if LINK_STATS
+	LINK_STATS_INC(link.recv);
+#endif /* LINK_STATS */
+
+	CAPTURE_RX(netif, p);
+
+	switch (htons(ethhdr->type)) {
+		/* IP or ARP packet? */
+		case ETHTYPE_IP:
+		case ETHTYPE_ARP:
+#if LWIP_IPV6
+		/*IPv6 Packet?*/
+		case ETHTYPE_IPV6:
+#endif
+#if PPPOE_SUPPORT
+			/* PPPoE packet? */
+		case ETHTYPE_PPPOEDISC:
+		case ETHTYPE_PPPOE:
+#endif /* PPPOE_SUPPORT */
+			/* full packet send to tcpip_thread to process */
+			if (input(p, netif) != ERR_OK) {
+				LWIP_DEBUGF(NETIF_DEBUG, ("xemacpsif_input: IP input error\r\n"));
+				pbuf_free(p);
+			}
+			break;
+
+		default:
+			pbuf_free(p);
+			break;
+	}
+}
+
 /*
  * xemacpsif_input():
  *
@@ -250,68 +386,107 @@ static err_t xemacpsif_output(struct netif *netif, struct pbuf *p,
  * should handle the actual reception of bytes from the network
  * interface.
  *
- * Returns the number of packets read (max 1 packet on success,
- * 0 if there are no packets)
+ * Packets are taken off the receive q in bursts of up to XEMAC_RX_BURST,
+ * with one protection window per burst. Returns the number of packets read
+ * (0 if there are no packets)
  *
  */
 
-s32_t xemacpsif_input(struct netif *netif)
+static s32_t xemacpsif_input_queue(struct netif *netif, pq_queue_t *recv_q)
 {
-	struct eth_hdr *ethhdr;
-	struct pbuf *p;
+	struct pbuf *p[XEMAC_RX_BURST];
+	s32_t n_packets = 0;
+	int n, i;
 	SYS_ARCH_DECL_PROTECT(lev);
 
 #if !NO_SYS
 	while (1)
 #endif
 	{
-		/* move received packet into a new pbuf */
+		/* move a burst of received packets out of the receive q */
 		SYS_ARCH_PROTECT(lev);
-		p = low_level_input(netif);
+		n = low_level_input(recv_q, p, XEMAC_RX_BURST);
 		SYS_ARCH_UNPROTECT(lev);
 
 		/* no packet could be read, silently ignore this */
-		if (p == NULL) {
-			return 0;
-		}
+		if (n == 0)
+			return n_packets;
+
+#if !NO_SYS && LWIP_TCPIP_CORE_LOCKING
+		/* take the core lock once per burst and skip the message to tcpip_thread per packet */
+		if (netif->input == tcpip_input) {
+			LOCK_TCPIP_CORE();
+			for (i = 0; i < n; i++)
+				xemacpsif_input_frame(netif, p[i], ethernet_input);
+			UNLOCK_TCPIP_CORE();
+		} else
+#endif
+		for (i = 0; i < n; i++)
+			xemacpsif_input_frame(netif, p[i], netif->input);
 
-		/* points to packet payload, which starts with an Ethernet header */
-		ethhdr = p->payload;
-
-	#if LINK_STATS
-		lwip_stats.link.recv++;
-	#endif /* LINK_STATS */
-
-		switch (htons(ethhdr->type)) {
-			/* IP or ARP packet? */
-			case ETHTYPE_IP:
-			case ETHTYPE_ARP:
-	#if LWIP_IPV6
-			/*IPv6 Packet?*/
-			case ETHTYPE_IPV6:
-	#endif
-	#if PPPOE_SUPPORT
-				/* PPPoE packet? */
-			case ETHTYPE_PPPOEDISC:
-			case ETHTYPE_PPPOE:
-	#endif /* PPPOE_SUPPORT */
-				/* full packet send to tcpip_thread to process */
-				if (netif->input(p, netif) != ERR_OK) {
-					LWIP_DEBUGF(NETIF_DEBUG, ("xemacpsif_input: IP input error\r\n"));
-					pbuf_free(p);
-					p = NULL;
-				}
-				break;
+		n_packets += n;
+	}
 
-			default:
-				pbuf_free(p);
-				p = NULL;
-				break;
-		}
+	return n_packets;
+}
+
+s32_t xemacpsif_input(struct netif *netif)
+{
+	struct xemac_s *xemac = (struct xemac_s *)(netif->state);
+	xemacpsif_s *xemacpsif = (xemacpsif_s *)(xemac->state);
+
+	return xemacpsif_input_queue(netif, xemacpsif->recv_q);
+}
+
+#if XEMACPSIF_RX_PRIO_QUEUE
+/*
+ * xemacpsif_rx_prio_thread():
+ *
+ * Input task for the priority RX queue, woken by its ISR.
+ *
+ */
+static void xemacpsif_rx_prio_thread(void *arg)
+{
+	xemacpsif_s *xemacpsif = (xemacpsif_s *)arg;
+
+	while (1) {
+		sys_sem_wait(&xemacpsif->rx_prio_sem);
+
+		xemacpsif_input_queue(xemacpsif->rx_prio_netif, xemacpsif->rx_prio_q);
 	}
+}
+
+/*
+ * xemacpsif_rx_prio_init():
+ *
+ * Creates the receive q of the priority RX queue and the default screener
+ * rules, before init_dma sets the queue up.
+ *
+ */
+static err_t xemacpsif_rx_prio_init(struct netif *netif, xemacpsif_s *xemacpsif)
+{
+	xemacpsif->rx_prio_active = 0;
+	xemacpsif->rx_prio_netif = netif;
+	xemacpsif->rx_prio_n_scrt1 = 0;
+	xemacpsif->rx_prio_n_scrt2 = 0;
+	xemacpsif->rx_prio_n_etht = 0;
+
+	xemacpsif->rx_prio_q = pq_create_queue();
+	if (!xemacpsif->rx_prio_q)
+		return ERR_MEM;
+	if (sys_sem_new(&xemacpsif->rx_prio_sem, 0) != ERR_OK)
+		return ERR_MEM;
+
+#if XEMACPSIF_RX_PRIO_PTP
+	/* PTP over Ethernet, and the event and general ports of PTP over UDP */
+	emacps_rx_prio_add(xemacpsif, 0, XEMACPSIF_SCRT2_ETHT_EN, 0x88F7);
+	emacps_rx_prio_add(xemacpsif, XEMACPSIF_SCRT1_UDP(319), 0, 0);
+	emacps_rx_prio_add(xemacpsif, XEMACPSIF_SCRT1_UDP(320), 0, 0);
+#endif
 
-	return 1;
+	return ERR_OK;
 }
+#endif
 
 #if !NO_SYS
 #if defined(__arm__) && !defined(ARMR5)
@@ -361,10 +536,26 @@ static err_t low_level_init(struct netif *netif)
 	xemacpsif->recv_q = pq_create_queue();
 	if (!xemacpsif->recv_q)
 		return ERR_MEM;
+#if PBUF_POOL_QUOTAS
+	xemacpsif->pool_quota = pbuf_pool_quota_new(XEMACPSIF_POOL_RESERVED,
+						XEMACPSIF_POOL_LIMIT);
+#else
+	xemacpsif->pool_quota = 0;
+#endif
+#if XEMACPSIF_TX_LAZY_RECLAIM
+	xemacpsif->tx_reclaim_armed = 0;
+#endif
+#if LWIP_NETIF_LINKOUTPUT_BURST
+	xemacpsif->tx_hold = 0;
+#endif
+#if XEMACPSIF_RX_PRIO_QUEUE
+	if (xemacpsif_rx_prio_init(netif, xemacpsif) != ERR_OK)
+		return ERR_MEM;
+#endif
 
 	/* maximum transfer unit */
 #ifdef ZYNQMP_USE_JUMBO
-	netif->mtu = XEMACPS_MTU_JUMBO - XEMACPS_HDR_SIZE;
+	netif->mtu = XEMACPSIF_JUMBO_MTU;
 #else
 	netif->mtu = XEMACPS_MTU - XEMACPS_HDR_SIZE;
 #endif
@@ -388,6 +579,12 @@ static err_t low_level_init(struct netif *netif)
 	netif->flags |= NETIF_FLAG_IGMP;
 #endif
 
+#if LWIP_CHECKSUM_CTRL_PER_NETIF
+	/* leave lwIP only the checksums the hardware doesn't compute or verify */
+	NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL &
+				~(XEMACPSIF_CSUM_HW_TX | XEMACPSIF_CSUM_HW_RX));
+#endif
+
 #if !NO_SYS
 	sys_sem_new(&xemac->sem_rx_data_available, 0);
 #endif
@@ -440,6 +637,13 @@ static err_t low_level_init(struct netif *netif)
 	 */
 	netif->state = (void *)xemac;
 
+#if XEMACPSIF_RX_PRIO_QUEUE
+	if (xemacpsif->rx_prio_active)
+		sys_thread_new("xemacpsif_rx_prio", xemacpsif_rx_prio_thread, xemacpsif,
+				XEMACPSIF_RX_PRIO_THREAD_STACKSIZE,
+				XEMACPSIF_RX_PRIO_THREAD_PRIO);
+#endif
+
 	return ERR_OK;
 }
 
@@ -552,7 +756,7 @@ static void xemacpsif_mld6_mac_hash_update (struct netif *netif, u8_t *ip_addr,
 	reset_dma(xemac);
 
 	/* Start Ethernet */
-	XEmacPs_Start(&xemacpsif->emacps);
+	start_emacps(xemacpsif);
 
 	SYS_ARCH_UNPROTECT(lev);
 }
@@ -659,7 +863,7 @@ static void xemacpsif_mac_hash_update (struct netif *netif, u8_t *ip_addr,
 	reset_dma(xemac);
 
 	/* Start Ethernet */
-	XEmacPs_Start(&xemacpsif->emacps);
+	start_emacps(xemacpsif);
 
 	SYS_ARCH_UNPROTECT(lev);
 }
@@ -767,6 +971,9 @@ err_t xemacpsif_init(struct netif *netif)
 	netif->name[1] = IFNAME1;
 	netif->output = xemacpsif_output;
 	netif->linkoutput = low_level_output;
+#if LWIP_NETIF_LINKOUTPUT_BURST
+	netif->linkoutput_burst = low_level_output_burst;
+#endif
 #if LWIP_IPV6
 	netif->output_ip6 = ethip6_output;
 #endif
@@ -82,6 +82,18 @@ void init_emacps(xemacpsif_s *xemacps, struct netif *netif)
 	XEmacPs_SetOptions(xemacpsp, XEMACPS_MULTICAST_OPTION);
 #endif
 
+	/* the checksum offload engines follow the lwIP options, see XEMACPSIF_CSUM_HW_* */
+#if LWIP_FULL_CSUM_OFFLOAD_TX==1
+	XEmacPs_SetOptions(xemacpsp, XEMACPS_TX_CHKSUM_ENABLE_OPTION);
+#else
+	XEmacPs_ClearOptions(xemacpsp, XEMACPS_TX_CHKSUM_ENABLE_OPTION);
+#endif
+#if LWIP_FULL_CSUM_OFFLOAD_RX==1
+	XEmacPs_SetOptions(xemacpsp, XEMACPS_RX_CHKSUM_ENABLE_OPTION);
+#else
+	XEmacPs_ClearOptions(xemacpsp, XEMACPS_RX_CHKSUM_ENABLE_OPTION);
+#endif
+
 	/* set mac address */
 	status = XEmacPs_SetMacAddress(xemacpsp, (void*)(netif->hwaddr), 1);
 	if (status != XST_SUCCESS) {
@@ -196,6 +208,18 @@ void start_emacps (xemacpsif_s *xemacps)
 {
 	/* start the temac */
 	XEmacPs_Start(&xemacps->emacps);
+#if XEMACPSIF_TX_LAZY_RECLAIM
+	/* sent BDs are reclaimed from the xmit path and a timer instead */
+	XEmacPs_WriteReg(xemacps->emacps.Config.BaseAddress, XEMACPS_IDR_OFFSET,
+					XEMACPS_IXR_TXCOMPL_MASK);
+#endif
+#if XEMACPSIF_RX_PRIO_QUEUE
+	/* XEmacPs_Start only enables TX completion on queue 1 */
+	if (xemacps->rx_prio_active) {
+		XEmacPs_WriteReg(xemacps->emacps.Config.BaseAddress, XEMACPS_INTQ1_IER_OFFSET,
+						XEMACPS_IXR_FRAMERX_MASK);
+	}
+#endif
 }
 
 void restart_emacps_transmitter (xemacpsif_s *xemacps) {
@@ -235,15 +259,18 @@ void emacps_error_handler(void *arg,u8 Direction, u32 ErrorWord)
 				LWIP_DEBUGF(NETIF_DEBUG, ("Receive DMA error\r\n"));
 				HandleEmacPsError(xemac);
 			}
+			/* while polling, the input thread owns the RX ring and refills it */
 			if (ErrorWord & XEMACPS_RXSR_RXOVR_MASK) {
 				LWIP_DEBUGF(NETIF_DEBUG, ("Receive over run\r\n"));
 				emacps_recv_handler(arg);
-				setup_rx_bds(xemacpsif, rxring);
+				if (!xemacpsif->rx_polling)
+					setup_rx_bds(xemacpsif, rxring);
 			}
 			if (ErrorWord & XEMACPS_RXSR_BUFFNA_MASK) {
 				LWIP_DEBUGF(NETIF_DEBUG, ("Receive buffer not available\r\n"));
 				emacps_recv_handler(arg);
-				setup_rx_bds(xemacpsif, rxring);
+				if (!xemacpsif->rx_polling)
+					setup_rx_bds(xemacpsif, rxring);
 			}
 			break;
 			case XEMACPS_SEND:
@@ -32,61 +32,97 @@
 
 #include "netif/xpqueue.h"
 
-#define NUM_QUEUES	2
-
-pq_queue_t pq_queue[NUM_QUEUES];
+#if (PQ_QUEUE_SIZE & (PQ_QUEUE_SIZE - 1)) != 0
+#error "PQ_QUEUE_SIZE must be a power of two"
+#endif
 
 pq_queue_t *
 pq_create_queue()
 {
-	static int i;
-	pq_queue_t *q = NULL;
+	return pq_create_queue_size(PQ_QUEUE_SIZE);
+}
 
-	if (i >= NUM_QUEUES) {
-		LWIP_DEBUGF(NETIF_DEBUG, ("ERR: Max Queues allocated\n\r"));
-		return q;
-	}
+/* size is rounded up to a power of two */
+pq_queue_t *
+pq_create_queue_size(u32_t size)
+{
+	pq_queue_t *q;
+	u32_t cap = 1;
 
-	q = &pq_queue[i++];
+	while (cap < size)
+		cap <<= 1;
 
-	if (!q)
-		return q;
+	q = (pq_queue_t *)malloc(sizeof(pq_queue_t));
+	if (!q) {
+		LWIP_DEBUGF(NETIF_DEBUG, ("ERR: cannot allocate queue\n\r"));
+		return NULL;
+	}
+
+	q->data = (void **)malloc(cap * sizeof(void *));
+	if (!q->data) {
+		LWIP_DEBUGF(NETIF_DEBUG, ("ERR: cannot allocate %u queue slots\n\r", (unsigned)cap));
+		free(q);
+		return NULL;
+	}
 
-	q->head = q->tail = q->len = 0;
+	q->mask = cap - 1;
+	q->head = q->tail = 0;
 
 	return q;
 }
 
+/* producer side */
 int
 pq_enqueue(pq_queue_t *q, void *p)
 {
-	if (q->len == PQ_QUEUE_SIZE)
+	u32_t head = q->head;
+
+	if (head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) > q->mask)
 		return -1;
 
-	q->data[q->head] = p;
-	q->head = (q->head + 1)%PQ_QUEUE_SIZE;
-	q->len++;
+	q->data[head & q->mask] = p;
+	__atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
 
 	return 0;
 }
 
+/* consumer side */
 void*
 pq_dequeue(pq_queue_t *q)
 {
-	int ptail;
+	u32_t tail = q->tail;
+	void *p;
 
-	if (q->len == 0)
+	if (__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == tail)
 		return NULL;
 
-	ptail = q->tail;
-	q->tail = (q->tail + 1)%PQ_QUEUE_SIZE;
-	q->len--;
+	p = q->data[tail & q->mask];
+	__atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return p;
+}
+
+/* consumer side: take up to n entries at once, with a single release of the slots */
+int
+pq_dequeue_burst(pq_queue_t *q, void **p, int n)
+{
+	u32_t tail = q->tail;
+	u32_t avail = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - tail;
+	int i;
+
+	if ((u32_t)n > avail)
+		n = (int)avail;
+
+	for (i = 0; i < n; i++)
+		p[i] = q->data[(tail + i) & q->mask];
+
+	__atomic_store_n(&q->tail, tail + n, __ATOMIC_RELEASE);
 
-	return q->data[ptail];
+	return n;
 }
 
 int
 pq_qlength(pq_queue_t *q)
 {
-	return q->len;
+	return (int)(__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE));
 }
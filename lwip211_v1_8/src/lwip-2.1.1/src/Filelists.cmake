@@ -48,6 +48,7 @@ set(lwipcore_SRCS
     ${LWIP_DIR}/src/core/altcp_alloc.c
     ${LWIP_DIR}/src/core/altcp_tcp.c
     ${LWIP_DIR}/src/core/tcp.c
+    ${LWIP_DIR}/src/core/tcp_cc.c
     ${LWIP_DIR}/src/core/tcp_in.c
     ${LWIP_DIR}/src/core/tcp_out.c
     ${LWIP_DIR}/src/core/timeouts.c
@@ -82,6 +83,7 @@ set(lwipapi_SRCS
     ${LWIP_DIR}/src/api/err.c
     ${LWIP_DIR}/src/api/if_api.c
     ${LWIP_DIR}/src/api/netbuf.c
+    ${LWIP_DIR}/src/api/netconn_async.c
     ${LWIP_DIR}/src/api/netdb.c
     ${LWIP_DIR}/src/api/netifapi.c
     ${LWIP_DIR}/src/api/sockets.c
@@ -46,6 +46,7 @@ COREFILES=$(LWIPDIR)/core/init.c \
 	$(LWIPDIR)/core/altcp_alloc.c \
 	$(LWIPDIR)/core/altcp_tcp.c \
 	$(LWIPDIR)/core/tcp.c \
+	$(LWIPDIR)/core/tcp_cc.c \
 	$(LWIPDIR)/core/tcp_in.c \
 	$(LWIPDIR)/core/tcp_out.c \
 	$(LWIPDIR)/core/timeouts.c \
@@ -76,6 +77,7 @@ APIFILES=$(LWIPDIR)/api/api_lib.c \
 	$(LWIPDIR)/api/err.c \
 	$(LWIPDIR)/api/if_api.c \
 	$(LWIPDIR)/api/netbuf.c \
+	$(LWIPDIR)/api/netconn_async.c \
 	$(LWIPDIR)/api/netdb.c \
 	$(LWIPDIR)/api/netifapi.c \
 	$(LWIPDIR)/api/sockets.c \
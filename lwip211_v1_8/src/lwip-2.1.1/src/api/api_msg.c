@@ -59,6 +59,14 @@
 /* netconns are polled once per second (e.g. continue write on memory error) */
 #define NETCONN_TCP_POLL_INTERVAL 2
 
+#if TCP_TMR_COALESCE
+/* netconns are only polled while a write, close or writespace check is
+   pending, so idle connections do not keep the TCP timer running */
+#define NETCONN_TCP_POLL_START(conn) tcp_poll((conn)->pcb.tcp, poll_tcp, NETCONN_TCP_POLL_INTERVAL)
+#else /* TCP_TMR_COALESCE */
+#define NETCONN_TCP_POLL_START(conn)
+#endif /* TCP_TMR_COALESCE */
+
 #define SET_NONBLOCKING_CONNECT(conn, val)  do { if (val) { \
   netconn_set_flags(conn, NETCONN_FLAG_IN_NONBLOCKING_CONNECT); \
 } else { \
@@ -294,7 +302,8 @@ recv_tcp(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
 {
   struct netconn *conn;
   u16_t len;
-  void *msg;
+  err_t post_err;
+  u8_t merged = 0;
 
   LWIP_UNUSED_ARG(pcb);
   LWIP_ASSERT("recv_tcp must have a pcb argument", pcb != NULL);
@@ -321,22 +330,25 @@ recv_tcp(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
      (data is already ACKed) */
 
   if (p != NULL) {
-    msg = p;
     len = p->tot_len;
+    post_err = sys_mbox_trypost_pbuf(&conn->recvmbox, p, &merged);
   } else {
-    msg = LWIP_CONST_CAST(void *, &netconn_closed);
     len = 0;
+    post_err = sys_mbox_trypost(&conn->recvmbox, LWIP_CONST_CAST(void *, &netconn_closed));
   }
 
-  if (sys_mbox_trypost(&conn->recvmbox, msg) != ERR_OK) {
+  if (post_err != ERR_OK) {
     /* don't deallocate p: it is presented to us later again from tcp_fasttmr! */
     return ERR_MEM;
   } else {
 #if LWIP_SO_RCVBUF
     SYS_ARCH_INC(conn->recv_avail, len);
 #endif /* LWIP_SO_RCVBUF */
-    /* Register event with callback */
-    API_EVENT(conn, NETCONN_EVT_RCVPLUS, len);
+    /* Register event with callback, unless p was chained to an entry that
+       has had its event already: there is one RCVMINUS per entry fetched */
+    if (!merged) {
+      API_EVENT(conn, NETCONN_EVT_RCVPLUS, len);
+    }
   }
 
   return ERR_OK;
@@ -384,9 +396,92 @@ poll_tcp(void *arg, struct tcp_pcb *pcb)
     }
   }
 
+#if TCP_TMR_COALESCE
+  /* nothing left to poll for (a finished close has freed the pcb) */
+  if ((conn->pcb.tcp == pcb) && (conn->state == NETCONN_NONE) &&
+      !(conn->flags & NETCONN_FLAG_CHECK_WRITESPACE)) {
+    tcp_poll(pcb, NULL, 0);
+  }
+#endif /* TCP_TMR_COALESCE */
+
   return ERR_OK;
 }
 
+#if LWIP_NETCONN_ZEROCOPY
+/**
+ * Remember where a NETCONN_ZEROCOPY write ended, so sent_tcp() can report it
+ * once the peer has acked that far.
+ *
+ * @param conn the TCP netconn written to
+ * @param len bytes the write queued
+ */
+static void
+netconn_zerocopy_queued(struct netconn *conn, size_t len)
+{
+  u8_t i = conn->zerocopy_pending;
+
+  conn->zerocopy_written += (u32_t)len;
+  if (i == LWIP_NETCONN_ZEROCOPY_PENDING) {
+    /* all slots in use: extend the newest write */
+    i--;
+  } else {
+    conn->zerocopy_pending++;
+  }
+  conn->zerocopy_ends[i].seqno = conn->pcb.tcp->snd_lbb;
+  conn->zerocopy_ends[i].written = conn->zerocopy_written;
+}
+
+/**
+ * Report the NETCONN_ZEROCOPY writes covered by the peer's ack (err == ERR_OK)
+ * or all of them when the pcb is gone (err != ERR_OK).
+ *
+ * @param conn the TCP netconn
+ * @param pcb its pcb, NULL if err != ERR_OK
+ * @param err ERR_OK or the error the connection was aborted with
+ */
+static void
+netconn_zerocopy_acked(struct netconn *conn, struct tcp_pcb *pcb, err_t err)
+{
+  u8_t done = 0;
+
+  if (err != ERR_OK) {
+    done = conn->zerocopy_pending;
+  } else {
+    while ((done < conn->zerocopy_pending) &&
+           ((s32_t)(pcb->lastack - conn->zerocopy_ends[done].seqno) >= 0)) {
+      done++;
+    }
+  }
+  if (done > 0) {
+    u32_t released = conn->zerocopy_ends[done - 1].written;
+    u8_t i;
+
+    conn->zerocopy_pending = (u8_t)(conn->zerocopy_pending - done);
+    for (i = 0; i < conn->zerocopy_pending; i++) {
+      conn->zerocopy_ends[i] = conn->zerocopy_ends[i + done];
+    }
+    if (conn->zerocopy_fn != NULL) {
+      conn->zerocopy_fn(conn, released, err, conn->zerocopy_arg);
+    }
+  }
+}
+#endif /* LWIP_NETCONN_ZEROCOPY */
+
+#if LWIP_NETCONN_WRITE_RESUME_MSS
+/**
+ * Whether sent_tcp should resume the write in progress: once a full segment
+ * fits into the send buffer, or the rest of the write does.
+ */
+static int
+netconn_write_resumable(struct netconn *conn, struct tcp_pcb *pcb)
+{
+  size_t left = conn->current_msg->msg.w.len - conn->current_msg->msg.w.offset;
+  u16_t want = (u16_t)LWIP_MIN(tcp_mss(pcb), TCP_SND_BUF);
+
+  return (tcp_sndbuf(pcb) >= want) || (tcp_sndbuf(pcb) >= left);
+}
+#endif /* LWIP_NETCONN_WRITE_RESUME_MSS */
+
 /**
  * Sent callback function for TCP netconns.
  * Signals the conn->sem and calls API_EVENT.
@@ -403,8 +498,16 @@ sent_tcp(void *arg, struct tcp_pcb *pcb, u16_t len)
   LWIP_ASSERT("conn != NULL", (conn != NULL));
 
   if (conn) {
+#if LWIP_NETCONN_ZEROCOPY
+    netconn_zerocopy_acked(conn, pcb, ERR_OK);
+#endif /* LWIP_NETCONN_ZEROCOPY */
     if (conn->state == NETCONN_WRITE) {
-      lwip_netconn_do_writemore(conn  WRITE_DELAYED);
+#if LWIP_NETCONN_WRITE_RESUME_MSS
+      if (netconn_write_resumable(conn, pcb))
+#endif /* LWIP_NETCONN_WRITE_RESUME_MSS */
+      {
+        lwip_netconn_do_writemore(conn  WRITE_DELAYED);
+      }
     } else if (conn->state == NETCONN_CLOSE) {
       lwip_netconn_do_close_internal(conn  WRITE_DELAYED);
     }
@@ -454,6 +557,11 @@ err_tcp(void *arg, err_t err)
 
   SYS_ARCH_UNPROTECT(lev);
 
+#if LWIP_NETCONN_ZEROCOPY
+  /* the pcb's segments are freed, nothing references the data any more */
+  netconn_zerocopy_acked(conn, NULL, err);
+#endif /* LWIP_NETCONN_ZEROCOPY */
+
   /* Notify the user layer about a connection error. Used to signal select. */
   API_EVENT(conn, NETCONN_EVT_ERROR, 0);
   /* Try to release selects pending on 'read' or 'write', too.
@@ -519,7 +627,9 @@ setup_tcp(struct netconn *conn)
   tcp_arg(pcb, conn);
   tcp_recv(pcb, recv_tcp);
   tcp_sent(pcb, sent_tcp);
+#if !TCP_TMR_COALESCE
   tcp_poll(pcb, poll_tcp, NETCONN_TCP_POLL_INTERVAL);
+#endif /* !TCP_TMR_COALESCE */
   tcp_err(pcb, err_tcp);
 }
 
@@ -742,7 +852,7 @@ netconn_alloc(enum netconn_type t, netconn_callback callback)
       goto free_and_return;
   }
 
-  if (sys_mbox_new(&conn->recvmbox, size) != ERR_OK) {
+  if (sys_mbox_new_recv(&conn->recvmbox, size) != ERR_OK) {
     goto free_and_return;
   }
 #if !LWIP_NETCONN_SEM_PER_THREAD
@@ -764,6 +874,19 @@ netconn_alloc(enum netconn_type t, netconn_callback callback)
 #if LWIP_TCP
   conn->current_msg  = NULL;
 #endif /* LWIP_TCP */
+#if LWIP_TCP && LWIP_NETCONN_ZEROCOPY
+  conn->zerocopy_fn      = NULL;
+  conn->zerocopy_arg     = NULL;
+  conn->zerocopy_written = 0;
+  conn->zerocopy_pending = 0;
+#endif /* LWIP_TCP && LWIP_NETCONN_ZEROCOPY */
+#if LWIP_NETCONN_ASYNC
+  conn->async_cq     = NULL;
+  conn->async_rx     = NULL;
+  conn->async_tx     = NULL;
+  conn->async_next   = NULL;
+  conn->async_kicked = 0;
+#endif /* LWIP_NETCONN_ASYNC */
 #if LWIP_SO_SNDTIMEO
   conn->send_timeout = 0;
 #endif /* LWIP_SO_SNDTIMEO */
@@ -1490,7 +1613,7 @@ lwip_netconn_do_listen(void *m)
             }
             err = ERR_OK;
             if (!sys_mbox_valid(&msg->conn->acceptmbox)) {
-              err = sys_mbox_new(&msg->conn->acceptmbox, DEFAULT_ACCEPTMBOX_SIZE);
+              err = sys_mbox_new_accept(&msg->conn->acceptmbox, DEFAULT_ACCEPTMBOX_SIZE);
             }
             if (err == ERR_OK) {
               msg->conn->state = NETCONN_LISTEN;
@@ -1686,6 +1809,17 @@ lwip_netconn_do_writemore(struct netconn *conn  WRITE_DELAYED_PARAM)
     do {
       dataptr = (const u8_t *)conn->current_msg->msg.w.vector->ptr + conn->current_msg->msg.w.vector_off;
       diff = conn->current_msg->msg.w.vector->len - conn->current_msg->msg.w.vector_off;
+      /* flags are per tcp_write(): only the last vector goes out without
+         TCP_WRITE_FLAG_MORE, so its segment gets PSH */
+      apiflags = conn->current_msg->msg.w.apiflags;
+#if LWIP_NETCONN_ZEROCOPY
+      if ((apiflags & NETCONN_ZEROCOPY) && (diff < LWIP_NETCONN_ZEROCOPY_MIN)) {
+        /* a short vector (e.g. a message header) is cheaper copied into the
+           oversized pbuf the next vector is appended to than referenced by
+           a pbuf (and a descriptor) of its own */
+        apiflags |= NETCONN_COPY;
+      }
+#endif /* LWIP_NETCONN_ZEROCOPY */
       if (diff > 0xffffUL) { /* max_u16_t */
         len = 0xffff;
         apiflags |= TCP_WRITE_FLAG_MORE;
@@ -1742,6 +1876,7 @@ err_mem:
            and let poll_tcp check writable space to mark the pcb writable again */
         API_EVENT(conn, NETCONN_EVT_SENDMINUS, 0);
         conn->flags |= NETCONN_FLAG_CHECK_WRITESPACE;
+        NETCONN_TCP_POLL_START(conn);
       } else if ((tcp_sndbuf(conn->pcb.tcp) <= TCP_SNDLOWAT) ||
                  (tcp_sndqueuelen(conn->pcb.tcp) >= TCP_SNDQUEUELOWAT)) {
         /* The queued byte- or pbuf-count exceeds the configured low-water limit,
@@ -1794,6 +1929,12 @@ err_mem:
     /* everything was written: set back connection state
        and back to application task */
     sys_sem_t *op_completed_sem = LWIP_API_MSG_SEM(conn->current_msg);
+#if LWIP_NETCONN_ZEROCOPY
+    if ((conn->current_msg->msg.w.apiflags & NETCONN_ZEROCOPY) &&
+        (conn->current_msg->msg.w.offset > 0)) {
+      netconn_zerocopy_queued(conn, conn->current_msg->msg.w.offset);
+    }
+#endif /* LWIP_NETCONN_ZEROCOPY */
     conn->current_msg->err = err;
     conn->current_msg = NULL;
     conn->state = NETCONN_NONE;
@@ -1833,6 +1974,7 @@ lwip_netconn_do_write(void *m)
         err = ERR_INPROGRESS;
       } else if (msg->conn->pcb.tcp != NULL) {
         msg->conn->state = NETCONN_WRITE;
+        NETCONN_TCP_POLL_START(msg->conn);
         /* set all the variables used by lwip_netconn_do_writemore */
         LWIP_ASSERT("already writing or closing", msg->conn->current_msg == NULL);
         LWIP_ASSERT("msg->msg.w.len != 0", msg->msg.w.len != 0);
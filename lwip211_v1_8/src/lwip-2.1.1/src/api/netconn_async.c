@@ -0,0 +1,425 @@
+/**
+ * @file
+ * Asynchronous netconn API
+ *
+ * @defgroup netconn_async Asynchronous netconn
+ * @ingroup netconn
+ * Completion based front-end to the netconn API for an application task
+ * that serves many connections from one event loop.\n
+ * Operations (accept, connect, recv, write, send, close) are submitted with
+ * netconn_async_submit() and returned by netconn_cq_wait() once they have
+ * completed. Each operation is tried as a non-blocking netconn call when it
+ * is submitted and again whenever its netconn reports an event, so the task
+ * only blocks in netconn_cq_wait() and no operation ever waits for
+ * tcpip_thread.\n
+ * A completion queue, its netconns and operations must only be used from
+ * the task that calls netconn_cq_wait(); only the event callback runs in
+ * tcpip_thread.
+ */
+
+/*
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_NETCONN && LWIP_NETCONN_ASYNC /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/netconn_async.h"
+#include "lwip/sys.h"
+
+#include <string.h>
+
+/**
+ * Event callback of asynchronous netconns (called from tcpip_thread or with
+ * the core locked): queues the netconn on its completion queue if it has
+ * operations to retry and wakes the task waiting there.
+ */
+static void
+netconn_async_event(struct netconn *conn, enum netconn_evt evt, u16_t len)
+{
+  struct netconn_cq *cq;
+  u8_t wake = 0;
+  SYS_ARCH_DECL_PROTECT(lev);
+  LWIP_UNUSED_ARG(len);
+
+  if ((evt != NETCONN_EVT_RCVPLUS) && (evt != NETCONN_EVT_SENDPLUS) &&
+      (evt != NETCONN_EVT_ERROR)) {
+    return;
+  }
+
+  SYS_ARCH_PROTECT(lev);
+  cq = conn->async_cq;
+  if ((cq != NULL) && !conn->async_kicked &&
+      ((conn->async_rx != NULL) || (conn->async_tx != NULL))) {
+    conn->async_kicked = 1;
+    conn->async_next = NULL;
+    if (cq->kicked_tail != NULL) {
+      cq->kicked_tail->async_next = conn;
+    } else {
+      cq->kicked_head = conn;
+    }
+    cq->kicked_tail = conn;
+    if (cq->waiting) {
+      cq->waiting = 0;
+      wake = 1;
+    }
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  if (wake) {
+    sys_sem_signal(&cq->sem);
+  }
+}
+
+/** Append a finished operation to the completion list */
+static void
+netconn_async_complete(struct netconn_cq *cq, struct netconn_async_op *op, err_t err)
+{
+  op->err = err;
+  op->next = NULL;
+  if (cq->done_tail != NULL) {
+    cq->done_tail->next = op;
+  } else {
+    cq->done_head = op;
+  }
+  cq->done_tail = op;
+}
+
+/**
+ * Try an operation once without blocking.
+ *
+ * @return ERR_WOULDBLOCK or ERR_INPROGRESS to retry it on the next event,
+ *         the result of the operation otherwise
+ */
+static err_t
+netconn_async_exec(struct netconn_async_op *op)
+{
+  struct netconn *conn = op->conn;
+  size_t written;
+  err_t err;
+
+  switch (op->type) {
+#if LWIP_TCP
+    case NETCONN_ASYNC_ACCEPT:
+      err = netconn_accept(conn, &op->newconn);
+      if (err == ERR_OK) {
+        /* the new netconn inherited our callback, put it on our queue, too */
+        netconn_set_nonblocking(op->newconn, 1);
+        op->newconn->async_cq = conn->async_cq;
+      }
+      return err;
+    case NETCONN_ASYNC_WRITE:
+      written = 0;
+      err = netconn_write_partly(conn, (const u8_t *)op->data + op->done, op->len - op->done,
+                                 (u8_t)(op->apiflags | NETCONN_DONTBLOCK), &written);
+      op->done += written;
+      if ((err == ERR_OK) && (op->done < op->len)) {
+        /* wait for more send buffer */
+        return ERR_WOULDBLOCK;
+      }
+      return err;
+#endif /* LWIP_TCP */
+    case NETCONN_ASYNC_RECV:
+#if LWIP_TCP
+      if (NETCONNTYPE_GROUP(netconn_type(conn)) == NETCONN_TCP) {
+        return netconn_recv_tcp_pbuf_flags(conn, &op->p, NETCONN_DONTBLOCK);
+      }
+#endif /* LWIP_TCP */
+      return netconn_recv(conn, &op->buf);
+    case NETCONN_ASYNC_CONNECT:
+      if (op->done == 0) {
+        err = netconn_connect(conn, op->addr, op->port);
+        if (err == ERR_INPROGRESS) {
+          /* SYN sent, completed by the event of lwip_netconn_do_connected or err_tcp */
+          op->done = 1;
+        }
+        return err;
+      }
+      if (netconn_is_flag_set(conn, NETCONN_FLAG_IN_NONBLOCKING_CONNECT)) {
+        return ERR_INPROGRESS;
+      }
+      return netconn_err(conn);
+    case NETCONN_ASYNC_SEND:
+      return netconn_send(conn, op->buf);
+    default:
+      return ERR_ARG;
+  }
+}
+
+/** Run the operations of one queue of a netconn in order until one would block */
+static void
+netconn_async_run_queue(struct netconn *conn, struct netconn_async_op **queue)
+{
+  struct netconn_async_op *op;
+  err_t err;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  while ((op = *queue) != NULL) {
+    err = netconn_async_exec(op);
+    if ((err == ERR_WOULDBLOCK) || (err == ERR_INPROGRESS)) {
+      return;
+    }
+    SYS_ARCH_PROTECT(lev);
+    *queue = op->next;
+    SYS_ARCH_UNPROTECT(lev);
+    netconn_async_complete(conn->async_cq, op, err);
+  }
+}
+
+/** Complete all pending operations of a netconn with 'err' and detach it */
+static void
+netconn_async_cancel(struct netconn *conn, err_t err)
+{
+  struct netconn_cq *cq = conn->async_cq;
+  struct netconn_async_op *op, *rx, *tx;
+  struct netconn *prev;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  rx = conn->async_rx;
+  tx = conn->async_tx;
+  conn->async_rx = NULL;
+  conn->async_tx = NULL;
+  conn->async_cq = NULL;
+  if (conn->async_kicked) {
+    conn->async_kicked = 0;
+    if (cq->kicked_head == conn) {
+      cq->kicked_head = conn->async_next;
+      prev = NULL;
+    } else {
+      for (prev = cq->kicked_head; prev->async_next != conn; prev = prev->async_next);
+      prev->async_next = conn->async_next;
+    }
+    if (cq->kicked_tail == conn) {
+      cq->kicked_tail = prev;
+    }
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  while (rx != NULL) {
+    op = rx;
+    rx = rx->next;
+    netconn_async_complete(cq, op, err);
+  }
+  while (tx != NULL) {
+    op = tx;
+    tx = tx->next;
+    netconn_async_complete(cq, op, err);
+  }
+}
+
+/**
+ * @ingroup netconn_async
+ * Initialize a completion queue.
+ *
+ * @param cq the completion queue to initialize
+ * @return ERR_OK or ERR_MEM if the semaphore could not be created
+ */
+err_t
+netconn_cq_new(struct netconn_cq *cq)
+{
+  LWIP_ERROR("netconn_cq_new: invalid cq", (cq != NULL), return ERR_ARG;);
+
+  memset(cq, 0, sizeof(*cq));
+  if (sys_sem_new(&cq->sem, 0) != ERR_OK) {
+    return ERR_MEM;
+  }
+  return ERR_OK;
+}
+
+/**
+ * @ingroup netconn_async
+ * Free the resources of a completion queue. All its netconns must have been
+ * closed and the completions collected.
+ *
+ * @param cq the completion queue to free
+ */
+void
+netconn_cq_free(struct netconn_cq *cq)
+{
+  LWIP_ERROR("netconn_cq_free: invalid cq", (cq != NULL), return;);
+  LWIP_ASSERT("netconn_cq_free: netconns left", cq->kicked_head == NULL);
+
+  sys_sem_free(&cq->sem);
+}
+
+/**
+ * @ingroup netconn_async
+ * Create a new non-blocking netconn that reports to a completion queue.
+ *
+ * @param cq the completion queue for the operations on the new netconn
+ * @param t the type of the netconn
+ * @return the new netconn or NULL on memory error
+ */
+struct netconn *
+netconn_async_new(struct netconn_cq *cq, enum netconn_type t)
+{
+  struct netconn *conn;
+
+  LWIP_ERROR("netconn_async_new: invalid cq", (cq != NULL), return NULL;);
+
+  conn = netconn_new_with_callback(t, netconn_async_event);
+  if (conn != NULL) {
+    netconn_set_nonblocking(conn, 1);
+    conn->async_cq = cq;
+  }
+  return conn;
+}
+
+/**
+ * @ingroup netconn_async
+ * Submit an operation on op->conn. It is tried at once and returned by
+ * netconn_cq_wait() when it has completed; operations of the same direction
+ * (accept/recv and connect/write/send) complete in submission order.
+ * NETCONN_ASYNC_CLOSE completes all pending operations of the netconn with
+ * ERR_CLSD and deletes it; op->conn must not be used afterwards.
+ *
+ * @param op the operation, which must stay valid until it is returned
+ * @return ERR_OK if the operation was submitted, ERR_ARG if op->conn was not
+ *         created by netconn_async_new() or netconn_accept on one
+ */
+err_t
+netconn_async_submit(struct netconn_async_op *op)
+{
+  struct netconn *conn;
+  struct netconn_cq *cq;
+  struct netconn_async_op **queue;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_ERROR("netconn_async_submit: invalid op", (op != NULL) && (op->conn != NULL), return ERR_ARG;);
+  conn = op->conn;
+  cq = conn->async_cq;
+  LWIP_ERROR("netconn_async_submit: not an async netconn", (cq != NULL), return ERR_ARG;);
+
+  op->next = NULL;
+  op->done = 0;
+  op->p = NULL;
+  op->newconn = NULL;
+  if (op->type == NETCONN_ASYNC_RECV) {
+    op->buf = NULL;
+  }
+
+  if (op->type == NETCONN_ASYNC_CLOSE) {
+    netconn_async_cancel(conn, ERR_CLSD);
+    netconn_async_complete(cq, op, netconn_delete(conn));
+    return ERR_OK;
+  }
+
+  if ((op->type == NETCONN_ASYNC_ACCEPT) || (op->type == NETCONN_ASYNC_RECV)) {
+    queue = &conn->async_rx;
+  } else {
+    queue = &conn->async_tx;
+  }
+  SYS_ARCH_PROTECT(lev);
+  while (*queue != NULL) {
+    queue = &(*queue)->next;
+  }
+  *queue = op;
+  SYS_ARCH_UNPROTECT(lev);
+
+  /* Only try the new operation if nothing is queued before it: the others
+     are retried when the netconn reports progress */
+  if (queue == &conn->async_rx || queue == &conn->async_tx) {
+    netconn_async_run_queue(conn, queue);
+  }
+  return ERR_OK;
+}
+
+/**
+ * @ingroup netconn_async
+ * Return the next completed operation, running the operations of netconns
+ * that had an event in the meantime.
+ *
+ * @param cq the completion queue
+ * @param op receives the completed operation
+ * @param timeout maximum time in milliseconds to block, 0 for no limit and
+ *        NETCONN_CQ_NOWAIT to not block at all
+ * @return ERR_OK if an operation was returned, ERR_TIMEOUT if the timeout
+ *         expired, ERR_WOULDBLOCK if nothing completed with NETCONN_CQ_NOWAIT
+ */
+err_t
+netconn_cq_wait(struct netconn_cq *cq, struct netconn_async_op **op, u32_t timeout)
+{
+  struct netconn *conn;
+  u32_t start = 0;
+  u32_t elapsed;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_ERROR("netconn_cq_wait: invalid cq", (cq != NULL) && (op != NULL), return ERR_ARG;);
+
+  if ((timeout != 0) && (timeout != NETCONN_CQ_NOWAIT)) {
+    start = sys_now();
+  }
+  for (;;) {
+    if (cq->done_head != NULL) {
+      *op = cq->done_head;
+      cq->done_head = (*op)->next;
+      if (cq->done_head == NULL) {
+        cq->done_tail = NULL;
+      }
+      (*op)->next = NULL;
+      return ERR_OK;
+    }
+
+    SYS_ARCH_PROTECT(lev);
+    conn = cq->kicked_head;
+    if (conn != NULL) {
+      cq->kicked_head = conn->async_next;
+      if (cq->kicked_head == NULL) {
+        cq->kicked_tail = NULL;
+      }
+      conn->async_next = NULL;
+      conn->async_kicked = 0;
+    } else if (timeout != NETCONN_CQ_NOWAIT) {
+      cq->waiting = 1;
+    }
+    SYS_ARCH_UNPROTECT(lev);
+
+    if (conn != NULL) {
+      netconn_async_run_queue(conn, &conn->async_rx);
+      netconn_async_run_queue(conn, &conn->async_tx);
+      continue;
+    }
+    if (timeout == NETCONN_CQ_NOWAIT) {
+      return ERR_WOULDBLOCK;
+    }
+    if (timeout != 0) {
+      elapsed = sys_now() - start;
+      if ((elapsed >= timeout) ||
+          (sys_arch_sem_wait(&cq->sem, timeout - elapsed) == SYS_ARCH_TIMEOUT)) {
+        SYS_ARCH_PROTECT(lev);
+        cq->waiting = 0;
+        SYS_ARCH_UNPROTECT(lev);
+        return ERR_TIMEOUT;
+      }
+    } else {
+      sys_arch_sem_wait(&cq->sem, 0);
+    }
+  }
+}
+
+#endif /* LWIP_NETCONN && LWIP_NETCONN_ASYNC */
@@ -47,6 +47,7 @@
 #include "lwip/igmp.h"
 #include "lwip/inet.h"
 #include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
 #include "lwip/raw.h"
 #include "lwip/udp.h"
 #include "lwip/memp.h"
@@ -158,6 +159,13 @@ static void sockaddr_to_ipaddr_port(const struct sockaddr *sockaddr, ip_addr_t *
                                                     SOCK_ADDR_TYPE_MATCH(name, sock))
 #define IS_SOCK_ADDR_ALIGNED(name)      ((((mem_ptr_t)(name)) % 4) == 0)
 
+/* MSG_ZEROCOPY sends hand the caller's buffer to tcp_write() instead of a copy */
+#if LWIP_NETCONN_ZEROCOPY
+#define SOCK_WRITE_COPY_FLAG(flags)     (((flags) & MSG_ZEROCOPY) ? NETCONN_ZEROCOPY : NETCONN_COPY)
+#else
+#define SOCK_WRITE_COPY_FLAG(flags)     NETCONN_COPY
+#endif
+
 
 #define LWIP_SOCKOPT_CHECK_OPTLEN(sock, optlen, opttype) do { if ((optlen) < sizeof(opttype)) { done_socket(sock); return EINVAL; }}while(0)
 #define LWIP_SOCKOPT_CHECK_OPTLEN_CONN(sock, optlen, opttype) do { \
@@ -278,6 +286,27 @@ static volatile int select_cb_ctr;
 static struct lwip_select_cb *select_cb_list;
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
 
+#if LWIP_SOCKET_EPOLL
+/** An epoll instance. The ready list and the epoll_* members of the sockets
+    are protected by SYS_ARCH_PROTECT, like the socket event counters. */
+struct lwip_epoll {
+  /** instance is allocated */
+  u8_t used;
+  /** a task is blocked in lwip_epoll_wait() and wants sem signalled */
+  u8_t waiting;
+  /** number of sockets on the ready list */
+  u16_t nready;
+  struct lwip_sock *ready_head;
+  struct lwip_sock *ready_tail;
+  sys_sem_t sem;
+};
+
+static struct lwip_epoll epolls[LWIP_SOCKET_EPOLL_MAX];
+
+/** epoll file descriptors follow the sockets */
+#define LWIP_EPOLL_FD_OFFSET (LWIP_SOCKET_OFFSET + NUM_SOCKETS)
+#endif /* LWIP_SOCKET_EPOLL */
+
 #define sock_set_errno(sk, e) do { \
   const int sockerr = (e); \
   set_errno(sockerr); \
@@ -300,6 +329,10 @@ static int lwip_setsockopt_impl(int s, int level, int optname, const void *optva
 static int free_socket_locked(struct lwip_sock *sock, int is_tcp, struct netconn **conn,
                               union lwip_sock_lastdata *lastdata);
 static void free_socket_free_elements(int is_tcp, struct netconn *conn, union lwip_sock_lastdata *lastdata);
+#if LWIP_SOCKET_EPOLL
+static void lwip_epoll_sock_remove(struct lwip_sock *sock);
+static int lwip_epoll_close(int epfd);
+#endif /* LWIP_SOCKET_EPOLL */
 
 #if LWIP_IPV4 && LWIP_IPV6
 static void
@@ -530,6 +563,9 @@ alloc_socket(struct netconn *newconn, int accepted)
       sockets[i].sendevent  = (NETCONNTYPE_GROUP(newconn->type) == NETCONN_TCP ? (accepted != 0) : 1);
       sockets[i].errevent   = 0;
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
+#if LWIP_SOCKET_EPOLL
+      LWIP_ASSERT("sockets[i].epoll_idx == 0", sockets[i].epoll_idx == 0);
+#endif /* LWIP_SOCKET_EPOLL */
       return i + LWIP_SOCKET_OFFSET;
     }
     SYS_ARCH_UNPROTECT(lev);
@@ -559,6 +595,9 @@ free_socket_locked(struct lwip_sock *sock, int is_tcp, struct netconn **conn,
   LWIP_UNUSED_ARG(is_tcp);
 #endif /* LWIP_NETCONN_FULLDUPLEX */
 
+#if LWIP_SOCKET_EPOLL
+  lwip_epoll_sock_remove(sock);
+#endif /* LWIP_SOCKET_EPOLL */
   *lastdata = sock->lastdata;
   sock->lastdata.pbuf = NULL;
   *conn = sock->conn;
@@ -777,6 +816,12 @@ lwip_close(int s)
 
   LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_close(%d)\n", s));
 
+#if LWIP_SOCKET_EPOLL
+  if (s >= LWIP_EPOLL_FD_OFFSET) {
+    return lwip_epoll_close(s);
+  }
+#endif /* LWIP_SOCKET_EPOLL */
+
   sock = get_socket(s);
   if (!sock) {
     return -1;
@@ -1277,6 +1322,117 @@ lwip_recv(int s, void *mem, size_t len, int flags)
   return lwip_recvfrom(s, mem, len, flags, NULL, NULL);
 }
 
+#if LWIP_SOCKET_RECV_PBUF
+/**
+ * Receive without copying: the next received pbuf chain is lent to the
+ * application instead of being copied into a buffer. For TCP this is what is
+ * left of the current segment chain (after a partial lwip_recv()) or the next
+ * one, for UDP and RAW the next datagram. The chain must be handed back with
+ * lwip_recv_pbuf_free() and its tot_len left unchanged: TCP only opens the
+ * receive window for the data then, so the peer is held back while the
+ * application holds on to pool pbufs (or rx DMA buffers).
+ *
+ * @param s socket
+ * @param p returns the lent pbuf chain
+ * @param flags MSG_DONTWAIT or 0
+ * @return number of bytes in the chain, 0 if the TCP connection was closed by
+ *         the peer, -1 on error (errno set)
+ */
+ssize_t
+lwip_recv_pbuf(int s, struct pbuf **p, int flags)
+{
+  struct lwip_sock *sock;
+  u8_t apiflags;
+  err_t err;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_pbuf(%d, 0x%x)\n", s, flags));
+  LWIP_ERROR("lwip_recv_pbuf: invalid pbuf pointer", p != NULL, set_errno(EINVAL); return -1;);
+  LWIP_ERROR("lwip_recv_pbuf: unsupported flags", (flags & ~MSG_DONTWAIT) == 0,
+             set_errno(EOPNOTSUPP); return -1;);
+  *p = NULL;
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+
+  apiflags = (flags & MSG_DONTWAIT) ? NETCONN_DONTBLOCK : 0;
+#if LWIP_TCP
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    if (sock->lastdata.pbuf) {
+      *p = sock->lastdata.pbuf;
+      sock->lastdata.pbuf = NULL;
+      err = ERR_OK;
+    } else {
+      err = netconn_recv_tcp_pbuf_flags(sock->conn, p, (u8_t)(apiflags | NETCONN_NOAUTORCVD));
+    }
+    if (err == ERR_CLSD) {
+      sock_set_errno(sock, err_to_errno(err));
+      done_socket(sock);
+      return 0;
+    }
+  } else
+#endif /* LWIP_TCP */
+  {
+    struct netbuf *buf = sock->lastdata.netbuf;
+    if (buf != NULL) {
+      sock->lastdata.netbuf = NULL;
+      err = ERR_OK;
+    } else {
+      err = netconn_recv_udp_raw_netbuf_flags(sock->conn, &buf, apiflags);
+    }
+    if (err == ERR_OK) {
+      /* keep the pbuf, only the netbuf wrapper goes */
+      *p = buf->p;
+      buf->p = buf->ptr = NULL;
+      netbuf_delete(buf);
+    }
+  }
+
+  if (err != ERR_OK) {
+    LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_pbuf(%d): error is \"%s\"!\n", s, lwip_strerr(err)));
+    *p = NULL;
+    sock_set_errno(sock, err_to_errno(err));
+    done_socket(sock);
+    return -1;
+  }
+  LWIP_ASSERT("p != NULL", *p != NULL);
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recv_pbuf(%d): pbuf=%p len=%"U16_F"\n", s, (void *)*p, (*p)->tot_len));
+
+  sock_set_errno(sock, 0);
+  done_socket(sock);
+  return (ssize_t)(*p)->tot_len;
+}
+
+/**
+ * Hand back a pbuf chain returned by lwip_recv_pbuf(). For TCP this also
+ * updates the receive window; if the socket has been closed meanwhile the
+ * chain is only freed.
+ *
+ * @param s the socket the chain was received on
+ * @param p the chain, NULL is ignored
+ */
+void
+lwip_recv_pbuf_free(int s, struct pbuf *p)
+{
+  struct lwip_sock *sock;
+
+  if (p == NULL) {
+    return;
+  }
+  sock = tryget_socket(s);
+  if (sock != NULL) {
+#if LWIP_TCP
+    if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+      netconn_tcp_recvd(sock->conn, p->tot_len);
+    }
+#endif /* LWIP_TCP */
+    done_socket(sock);
+  }
+  pbuf_free(p);
+}
+#endif /* LWIP_SOCKET_RECV_PBUF */
+
 ssize_t
 lwip_recvmsg(int s, struct msghdr *message, int flags)
 {
@@ -1378,6 +1534,33 @@ lwip_recvmsg(int s, struct msghdr *message, int flags)
 #endif /* LWIP_UDP || LWIP_RAW */
 }
 
+#if LWIP_TCP && LWIP_NETCONN_ZEROCOPY
+/**
+ * Set the callback reporting how much of the data sent with MSG_ZEROCOPY the
+ * stack has released (see netconn_zerocopy_fn). Until then the buffers passed
+ * to lwip_send()/lwip_sendmsg() must not be changed.
+ */
+int
+lwip_set_zerocopy_callback(int s, netconn_zerocopy_fn fn, void *arg)
+{
+  struct lwip_sock *sock;
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP) {
+    sock_set_errno(sock, EOPNOTSUPP);
+    done_socket(sock);
+    return -1;
+  }
+  netconn_set_zerocopy_callback(sock->conn, fn, arg);
+  sock_set_errno(sock, 0);
+  done_socket(sock);
+  return 0;
+}
+#endif /* LWIP_TCP && LWIP_NETCONN_ZEROCOPY */
+
 ssize_t
 lwip_send(int s, const void *data, size_t size, int flags)
 {
@@ -1409,7 +1592,7 @@ lwip_send(int s, const void *data, size_t size, int flags)
 #endif /* (LWIP_UDP || LWIP_RAW) */
   }
 
-  write_flags = (u8_t)(NETCONN_COPY |
+  write_flags = (u8_t)(SOCK_WRITE_COPY_FLAG(flags) |
                        ((flags & MSG_MORE)     ? NETCONN_MORE      : 0) |
                        ((flags & MSG_DONTWAIT) ? NETCONN_DONTBLOCK : 0));
   written = 0;
@@ -1443,7 +1626,7 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
              sock_set_errno(sock, err_to_errno(ERR_ARG)); done_socket(sock); return -1;);
   LWIP_ERROR("lwip_sendmsg: maximum iovs exceeded", (msg->msg_iovlen > 0) && (msg->msg_iovlen <= IOV_MAX),
              sock_set_errno(sock, EMSGSIZE); done_socket(sock); return -1;);
-  LWIP_ERROR("lwip_sendmsg: unsupported flags", (flags & ~(MSG_DONTWAIT | MSG_MORE)) == 0,
+  LWIP_ERROR("lwip_sendmsg: unsupported flags", (flags & ~(MSG_DONTWAIT | MSG_MORE | MSG_ZEROCOPY)) == 0,
              sock_set_errno(sock, EOPNOTSUPP); done_socket(sock); return -1;);
 
   LWIP_UNUSED_ARG(msg->msg_control);
@@ -1452,7 +1635,7 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
 
   if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
 #if LWIP_TCP
-    write_flags = (u8_t)(NETCONN_COPY |
+    write_flags = (u8_t)(SOCK_WRITE_COPY_FLAG(flags) |
                          ((flags & MSG_MORE)     ? NETCONN_MORE      : 0) |
                          ((flags & MSG_DONTWAIT) ? NETCONN_DONTBLOCK : 0));
 
@@ -1505,15 +1688,22 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
     } else {
       /* flatten the IO vectors */
       size_t offset = 0;
+#if LWIP_CHECKSUM_ON_COPY
+      /* sum each IO vector while copying it, swapped if it starts at an odd offset */
+      u32_t acc = 0;
+      u16_t chksum;
       for (i = 0; i < msg->msg_iovlen; i++) {
-        MEMCPY(&((u8_t *)chain_buf.p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+        chksum = LWIP_CHKSUM_COPY(&((u8_t *)chain_buf.p->payload)[offset], msg->msg_iov[i].iov_base, (u16_t)msg->msg_iov[i].iov_len);
+        acc += (offset & 1) ? SWAP_BYTES_IN_WORD(chksum) : chksum;
+        acc = FOLD_U32T(acc);
         offset += msg->msg_iov[i].iov_len;
       }
-#if LWIP_CHECKSUM_ON_COPY
-      {
-        /* This can be improved by using LWIP_CHKSUM_COPY() and aggregating the checksum for each IO vector */
-        u16_t chksum = ~inet_chksum_pbuf(chain_buf.p);
-        netbuf_set_chksum(&chain_buf, chksum);
+      chksum = (u16_t)FOLD_U32T(acc);
+      netbuf_set_chksum(&chain_buf, chksum);
+#else /* LWIP_CHECKSUM_ON_COPY */
+      for (i = 0; i < msg->msg_iovlen; i++) {
+        MEMCPY(&((u8_t *)chain_buf.p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+        offset += msg->msg_iov[i].iov_len;
       }
 #endif /* LWIP_CHECKSUM_ON_COPY */
       err = ERR_OK;
@@ -2491,6 +2681,347 @@ lwip_poll_should_wake(const struct lwip_select_cb *scb, int fd, int has_recveven
 }
 #endif /* LWIP_SOCKET_POLL */
 
+#if LWIP_SOCKET_EPOLL
+/* Translate an epoll file descriptor into its instance */
+static struct lwip_epoll *
+get_epoll(int epfd)
+{
+  int i = epfd - LWIP_EPOLL_FD_OFFSET;
+  if ((i < 0) || (i >= LWIP_SOCKET_EPOLL_MAX) || !epolls[i].used) {
+    LWIP_DEBUGF(SOCKETS_DEBUG, ("get_epoll(%d): invalid\n", epfd));
+    set_errno(EBADF);
+    return NULL;
+  }
+  return &epolls[i];
+}
+
+/* The EPOLL* events pending on a socket that its instance waits for
+   (call with SYS_ARCH_PROTECT held) */
+static u32_t
+lwip_epoll_sock_events(const struct lwip_sock *sock)
+{
+  u32_t events = 0;
+
+  if (sock->epoll_events == 0) {
+    return 0;
+  }
+  if ((sock->lastdata.pbuf != NULL) || (sock->rcvevent > 0)) {
+    events |= EPOLLIN;
+  }
+  if (sock->sendevent) {
+    events |= EPOLLOUT;
+  }
+  if (sock->errevent) {
+    events |= EPOLLERR;
+  }
+  return events & (sock->epoll_events | EPOLLERR);
+}
+
+/* Append a socket to the ready list of its instance (SYS_ARCH_PROTECT held) */
+static void
+lwip_epoll_link(struct lwip_epoll *ep, struct lwip_sock *sock)
+{
+  sock->epoll_ready = 1;
+  sock->epoll_next = NULL;
+  sock->epoll_prev = ep->ready_tail;
+  if (ep->ready_tail != NULL) {
+    ep->ready_tail->epoll_next = sock;
+  } else {
+    ep->ready_head = sock;
+  }
+  ep->ready_tail = sock;
+  ep->nready++;
+}
+
+/* Take a socket off the ready list of its instance (SYS_ARCH_PROTECT held) */
+static void
+lwip_epoll_unlink(struct lwip_epoll *ep, struct lwip_sock *sock)
+{
+  if (sock->epoll_prev != NULL) {
+    sock->epoll_prev->epoll_next = sock->epoll_next;
+  } else {
+    ep->ready_head = sock->epoll_next;
+  }
+  if (sock->epoll_next != NULL) {
+    sock->epoll_next->epoll_prev = sock->epoll_prev;
+  } else {
+    ep->ready_tail = sock->epoll_prev;
+  }
+  sock->epoll_ready = 0;
+  ep->nready--;
+}
+
+/**
+ * Queue a registered socket on its instance's ready list if it has an event
+ * the instance waits for (SYS_ARCH_PROTECT held).
+ *
+ * @return the instance if its waiter must be woken (signal ep->sem after
+ *         SYS_ARCH_UNPROTECT), NULL otherwise
+ */
+static struct lwip_epoll *
+lwip_epoll_sock_ready(struct lwip_sock *sock)
+{
+  struct lwip_epoll *ep = &epolls[sock->epoll_idx - 1];
+
+  if (sock->epoll_ready || (lwip_epoll_sock_events(sock) == 0)) {
+    return NULL;
+  }
+  lwip_epoll_link(ep, sock);
+  if (ep->waiting) {
+    ep->waiting = 0;
+    return ep;
+  }
+  return NULL;
+}
+
+/* Deregister a socket that is being freed (SYS_ARCH_PROTECT held) */
+static void
+lwip_epoll_sock_remove(struct lwip_sock *sock)
+{
+  if (sock->epoll_idx) {
+    if (sock->epoll_ready) {
+      lwip_epoll_unlink(&epolls[sock->epoll_idx - 1], sock);
+    }
+    sock->epoll_idx = 0;
+  }
+}
+
+/**
+ * Report up to maxevents ready sockets. Each socket on the ready list is
+ * visited at most once; those without an event left are dropped, the others
+ * are re-queued unless they use EPOLLET or EPOLLONESHOT.
+ */
+static int
+lwip_epoll_collect(struct lwip_epoll *ep, struct epoll_event *events, int maxevents)
+{
+  int n = 0;
+  u16_t todo;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  for (todo = ep->nready; (todo > 0) && (n < maxevents); todo--) {
+    struct lwip_sock *sock = ep->ready_head;
+    u32_t revents = lwip_epoll_sock_events(sock);
+
+    lwip_epoll_unlink(ep, sock);
+    if (revents != 0) {
+      events[n].events = revents;
+      events[n].data = sock->epoll_data;
+      n++;
+      if (sock->epoll_events & EPOLLONESHOT) {
+        /* disabled until EPOLL_CTL_MOD */
+        sock->epoll_events = 0;
+      } else if (!(sock->epoll_events & EPOLLET)) {
+        lwip_epoll_link(ep, sock);
+      }
+    }
+  }
+  SYS_ARCH_UNPROTECT(lev);
+  return n;
+}
+
+/**
+ * @ingroup socket
+ * Create an epoll instance. 'size' is only checked to be positive.
+ * The instance is freed with lwip_close().
+ */
+int
+lwip_epoll_create(int size)
+{
+  int i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (size <= 0) {
+    set_errno(EINVAL);
+    return -1;
+  }
+
+  for (i = 0; i < LWIP_SOCKET_EPOLL_MAX; i++) {
+    SYS_ARCH_PROTECT(lev);
+    if (!epolls[i].used) {
+      epolls[i].used = 1;
+      SYS_ARCH_UNPROTECT(lev);
+      epolls[i].waiting = 0;
+      epolls[i].nready = 0;
+      epolls[i].ready_head = NULL;
+      epolls[i].ready_tail = NULL;
+      if (sys_sem_new(&epolls[i].sem, 0) != ERR_OK) {
+        epolls[i].used = 0;
+        set_errno(ENOMEM);
+        return -1;
+      }
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_create() = %d\n", i + LWIP_EPOLL_FD_OFFSET));
+      set_errno(0);
+      return i + LWIP_EPOLL_FD_OFFSET;
+    }
+    SYS_ARCH_UNPROTECT(lev);
+  }
+  set_errno(ENFILE);
+  return -1;
+}
+
+/* lwip_close() for an epoll instance: deregisters its sockets */
+static int
+lwip_epoll_close(int epfd)
+{
+  struct lwip_epoll *ep = get_epoll(epfd);
+  int i;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (ep == NULL) {
+    return -1;
+  }
+  SYS_ARCH_PROTECT(lev);
+  for (i = 0; i < NUM_SOCKETS; i++) {
+    if (sockets[i].epoll_idx == (u8_t)(ep - epolls + 1)) {
+      lwip_epoll_sock_remove(&sockets[i]);
+    }
+  }
+  ep->used = 0;
+  SYS_ARCH_UNPROTECT(lev);
+  sys_sem_free(&ep->sem);
+  set_errno(0);
+  return 0;
+}
+
+/**
+ * @ingroup socket
+ * Add (EPOLL_CTL_ADD), change (EPOLL_CTL_MOD) or remove (EPOLL_CTL_DEL) the
+ * registration of socket 'fd' with an epoll instance. event->events takes
+ * EPOLLIN, EPOLLOUT, EPOLLET and EPOLLONESHOT; EPOLLERR is always reported.
+ */
+int
+lwip_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+  struct lwip_epoll *ep, *wake = NULL;
+  struct lwip_sock *sock;
+  u8_t idx;
+  int err = 0;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_ctl(%d, %d, %d)\n", epfd, op, fd));
+
+  ep = get_epoll(epfd);
+  if (ep == NULL) {
+    return -1;
+  }
+  if ((op != EPOLL_CTL_DEL) && (event == NULL)) {
+    set_errno(EINVAL);
+    return -1;
+  }
+  sock = get_socket(fd);
+  if (sock == NULL) {
+    return -1;
+  }
+  idx = (u8_t)(ep - epolls + 1);
+
+  SYS_ARCH_PROTECT(lev);
+  switch (op) {
+    case EPOLL_CTL_ADD:
+      if (sock->epoll_idx != 0) {
+        err = EEXIST;
+        break;
+      }
+      sock->epoll_idx = idx;
+      sock->epoll_ready = 0;
+      /* fall through */
+    case EPOLL_CTL_MOD:
+      if (sock->epoll_idx != idx) {
+        err = ENOENT;
+        break;
+      }
+      sock->epoll_events = event->events | EPOLLERR;
+      sock->epoll_data = event->data;
+      wake = lwip_epoll_sock_ready(sock);
+      break;
+    case EPOLL_CTL_DEL:
+      if (sock->epoll_idx != idx) {
+        err = ENOENT;
+        break;
+      }
+      lwip_epoll_sock_remove(sock);
+      break;
+    default:
+      err = EINVAL;
+      break;
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  if (wake != NULL) {
+    sys_sem_signal(&wake->sem);
+  }
+  done_socket(sock);
+  if (err != 0) {
+    set_errno(err);
+    return -1;
+  }
+  set_errno(0);
+  return 0;
+}
+
+/**
+ * @ingroup socket
+ * Wait up to 'timeout' ms (-1: forever, 0: don't block) for registered
+ * sockets to become ready and store up to 'maxevents' of them in 'events'.
+ * Sockets are reported level-triggered unless registered with EPOLLET.
+ *
+ * @return the number of events stored, 0 on timeout, -1 on error
+ */
+int
+lwip_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+  struct lwip_epoll *ep;
+  u32_t start = sys_now();
+  int n;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  ep = get_epoll(epfd);
+  if (ep == NULL) {
+    return -1;
+  }
+  if ((events == NULL) || (maxevents <= 0)) {
+    set_errno(EINVAL);
+    return -1;
+  }
+
+  for (;;) {
+    u32_t msectimeout = 0;
+
+    n = lwip_epoll_collect(ep, events, maxevents);
+    if ((n > 0) || (timeout == 0)) {
+      break;
+    }
+    if (timeout > 0) {
+      u32_t elapsed = sys_now() - start;
+      if (elapsed >= (u32_t)timeout) {
+        break;
+      }
+      msectimeout = (u32_t)timeout - elapsed;
+    }
+
+    SYS_ARCH_PROTECT(lev);
+    if (ep->ready_head != NULL) {
+      /* became ready while we were collecting */
+      SYS_ARCH_UNPROTECT(lev);
+      continue;
+    }
+    ep->waiting = 1;
+    SYS_ARCH_UNPROTECT(lev);
+
+    /* a signal left over from an earlier wait only causes another pass */
+    sys_arch_sem_wait(&ep->sem, msectimeout);
+
+    SYS_ARCH_PROTECT(lev);
+    ep->waiting = 0;
+    SYS_ARCH_UNPROTECT(lev);
+  }
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_epoll_wait(%d): %d ready\n", epfd, n));
+  set_errno(0);
+  return n;
+}
+#endif /* LWIP_SOCKET_EPOLL */
+
 #if LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL
 /**
  * Callback registered in the netconn layer for each socket-netconn.
@@ -2509,6 +3040,9 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
 {
   int s, check_waiters;
   struct lwip_sock *sock;
+#if LWIP_SOCKET_EPOLL
+  struct lwip_epoll *ep = NULL;
+#endif /* LWIP_SOCKET_EPOLL */
   SYS_ARCH_DECL_PROTECT(lev);
 
   LWIP_UNUSED_ARG(len);
@@ -2576,6 +3110,12 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
       break;
   }
 
+#if LWIP_SOCKET_EPOLL
+  if (sock->epoll_idx && check_waiters) {
+    ep = lwip_epoll_sock_ready(sock);
+  }
+#endif /* LWIP_SOCKET_EPOLL */
+
   if (sock->select_waiting && check_waiters) {
     /* Save which events are active */
     int has_recvevent, has_sendevent, has_errevent;
@@ -2588,6 +3128,11 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
   } else {
     SYS_ARCH_UNPROTECT(lev);
   }
+#if LWIP_SOCKET_EPOLL
+  if (ep != NULL) {
+    sys_sem_signal(&ep->sem);
+  }
+#endif /* LWIP_SOCKET_EPOLL */
   done_socket(sock);
 }
 
@@ -3142,6 +3687,13 @@ lwip_getsockopt_impl(int s, int level, int optname, void *optval, socklen_t *opt
                                       s, *(int *)optval));
           break;
 #endif /* LWIP_TCP_KEEPALIVE */
+#if LWIP_TCP_AUTOCORK
+        case TCP_AUTOCORK:
+          *(int *)optval = tcp_autocork_enabled(sock->conn->pcb.tcp) ? 1 : 0;
+          LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, TCP_AUTOCORK) = %s\n",
+                                      s, (*(int *)optval) ? "on" : "off") );
+          break;
+#endif /* LWIP_TCP_AUTOCORK */
         default:
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, UNIMPL: optname=0x%x, ..)\n",
                                       s, optname));
@@ -3373,6 +3925,12 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
           } else {
             ip_reset_option(sock->conn->pcb.ip, optname);
           }
+#if LWIP_TCP && TCP_TMR_COALESCE
+          if (NETCONNTYPE_GROUP(sock->conn->type) == NETCONN_TCP) {
+            /* the TCP timer may be asleep past the first keepalive */
+            tcp_timer_needed();
+          }
+#endif /* LWIP_TCP && TCP_TMR_COALESCE */
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, SOL_SOCKET, optname=0x%x, ..) -> %s\n",
                                       s, optname, (*(const int *)optval ? "on" : "off")));
           break;
@@ -3619,12 +4177,29 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
                                       s, sock->conn->pcb.tcp->keep_cnt));
           break;
 #endif /* LWIP_TCP_KEEPALIVE */
+#if LWIP_TCP_AUTOCORK
+        case TCP_AUTOCORK:
+          if (*(const int *)optval) {
+            tcp_autocork_enable(sock->conn->pcb.tcp);
+          } else if (tcp_autocork_enabled(sock->conn->pcb.tcp)) {
+            /* send what was held back, this is how an application flushes */
+            tcp_autocork_disable(sock->conn->pcb.tcp);
+            tcp_output(sock->conn->pcb.tcp);
+          }
+          LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_AUTOCORK) -> %s\n",
+                                      s, (*(const int *)optval) ? "on" : "off") );
+          break;
+#endif /* LWIP_TCP_AUTOCORK */
         default:
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, UNIMPL: optname=0x%x, ..)\n",
                                       s, optname));
           err = ENOPROTOOPT;
           break;
       }  /* switch (optname) */
+#if TCP_TMR_COALESCE
+      /* the TCP timer may be asleep past a new keepalive time */
+      tcp_timer_needed();
+#endif /* TCP_TMR_COALESCE */
       break;
 #endif /* LWIP_TCP*/
 
@@ -59,6 +59,14 @@
 static tcpip_init_done_fn tcpip_init_done;
 static void *tcpip_init_done_arg;
 static sys_mbox_t tcpip_mbox;
+#if TCPIP_MBOX_BULK
+/** Packets from tcpip_inpkt(), kept out of tcpip_mbox so they cannot delay other messages */
+static sys_mbox_t tcpip_bulk_mbox;
+/** Posted to tcpip_mbox to wake up tcpip_thread when packets are queued */
+static struct tcpip_msg tcpip_bulk_msg;
+/** Set from posting a wakeup until tcpip_thread finds tcpip_bulk_mbox empty */
+static u8_t tcpip_bulk_pending;
+#endif /* TCPIP_MBOX_BULK */
 
 #if LWIP_TCPIP_CORE_LOCKING
 /** The global semaphore to lock the stack. */
@@ -67,6 +75,55 @@ sys_mutex_t lock_tcpip_core;
 
 static void tcpip_thread_handle_msg(struct tcpip_msg *msg);
 
+#if TCPIP_MBOX_BULK
+/**
+ * Process up to TCPIP_MBOX_BULK_BATCH packets from tcpip_bulk_mbox.
+ *
+ * @return 1 if more packets may be queued, 0 if tcpip_bulk_mbox was found empty
+ */
+static u8_t
+tcpip_bulk_process(void)
+{
+  struct tcpip_msg *msg;
+  u16_t n;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  for (n = 0; n < TCPIP_MBOX_BULK_BATCH; n++) {
+    if (sys_arch_mbox_tryfetch(&tcpip_bulk_mbox, (void **)&msg) == SYS_MBOX_EMPTY) {
+      /* a packet queued from here on posts a new wakeup, one queued just
+         before may not have: check once more after clearing the flag */
+      SYS_ARCH_PROTECT(lev);
+      tcpip_bulk_pending = 0;
+      SYS_ARCH_UNPROTECT(lev);
+      if (sys_arch_mbox_tryfetch(&tcpip_bulk_mbox, (void **)&msg) == SYS_MBOX_EMPTY) {
+        return 0;
+      }
+    }
+    tcpip_thread_handle_msg(msg);
+  }
+  return 1;
+}
+
+/**
+ * Wake up tcpip_thread after queueing a packet, unless a wakeup is pending.
+ */
+static void
+tcpip_bulk_wakeup(void)
+{
+  u8_t wake;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  wake = !tcpip_bulk_pending;
+  tcpip_bulk_pending = 1;
+  SYS_ARCH_UNPROTECT(lev);
+  if (wake) {
+    /* if tcpip_mbox is full, tcpip_thread gets to the packets after its next message */
+    sys_mbox_trypost(&tcpip_mbox, &tcpip_bulk_msg);
+  }
+}
+#endif /* TCPIP_MBOX_BULK */
+
 #if !LWIP_TIMERS
 /* wait for a message with timers disabled (e.g. pass a timer-check trigger into tcpip_thread) */
 #define TCPIP_MBOX_FETCH(mbox, msg) sys_mbox_fetch(mbox, msg)
@@ -127,9 +184,16 @@ static void
 tcpip_thread(void *arg)
 {
   struct tcpip_msg *msg;
+#if MEMP_MAGAZINE
+  /* tcpip_thread frees most of the RX pbufs and allocates the TX segments */
+  static struct memp_magazine tcpip_magazine;
+#endif /* MEMP_MAGAZINE */
   LWIP_UNUSED_ARG(arg);
 
   LWIP_MARK_TCPIP_THREAD();
+#if MEMP_MAGAZINE
+  memp_magazine_thread_init(&tcpip_magazine);
+#endif /* MEMP_MAGAZINE */
 
   LOCK_TCPIP_CORE();
   if (tcpip_init_done != NULL) {
@@ -146,6 +210,23 @@ tcpip_thread(void *arg)
       continue;
     }
     tcpip_thread_handle_msg(msg);
+#if TCPIP_MBOX_BULK
+    /* handle queued packets in batches, with the messages and timeouts
+       that arrived meanwhile in between */
+    while (tcpip_bulk_process()) {
+      /* let tasks waiting for the core lock in */
+      UNLOCK_TCPIP_CORE();
+      LOCK_TCPIP_CORE();
+      while (sys_arch_mbox_tryfetch(&tcpip_mbox, (void **)&msg) != SYS_MBOX_EMPTY) {
+        LWIP_ASSERT("tcpip_thread: invalid message", msg != NULL);
+        tcpip_thread_handle_msg(msg);
+      }
+#if LWIP_TIMERS
+      sys_check_timeouts();
+#endif /* LWIP_TIMERS */
+      LWIP_TCPIP_THREAD_ALIVE();
+    }
+#endif /* TCPIP_MBOX_BULK */
   }
 }
 
@@ -176,6 +257,12 @@ tcpip_thread_handle_msg(struct tcpip_msg *msg)
       }
       memp_free(MEMP_TCPIP_MSG_INPKT, msg);
       break;
+#if TCPIP_MBOX_BULK
+    case TCPIP_MSG_BULK:
+      /* nothing to do, queued packets are processed after every message */
+      LWIP_DEBUGF(TCPIP_DEBUG, ("tcpip_thread: BULK wakeup\n"));
+      break;
+#endif /* TCPIP_MBOX_BULK */
 #endif /* !LWIP_TCPIP_CORE_LOCKING_INPUT */
 
 #if LWIP_TCPIP_TIMEOUT && LWIP_TIMERS
@@ -260,10 +347,18 @@ tcpip_inpkt(struct pbuf *p, struct netif *inp, netif_input_fn input_fn)
   msg->msg.inp.p = p;
   msg->msg.inp.netif = inp;
   msg->msg.inp.input_fn = input_fn;
+#if TCPIP_MBOX_BULK
+  if (sys_mbox_trypost(&tcpip_bulk_mbox, msg) != ERR_OK) {
+    memp_free(MEMP_TCPIP_MSG_INPKT, msg);
+    return ERR_MEM;
+  }
+  tcpip_bulk_wakeup();
+#else /* TCPIP_MBOX_BULK */
   if (sys_mbox_trypost(&tcpip_mbox, msg) != ERR_OK) {
     memp_free(MEMP_TCPIP_MSG_INPKT, msg);
     return ERR_MEM;
   }
+#endif /* TCPIP_MBOX_BULK */
   return ERR_OK;
 #endif /* LWIP_TCPIP_CORE_LOCKING_INPUT */
 }
@@ -612,6 +707,12 @@ tcpip_init(tcpip_init_done_fn initfunc, void *arg)
   if (sys_mbox_new(&tcpip_mbox, TCPIP_MBOX_SIZE) != ERR_OK) {
     LWIP_ASSERT("failed to create tcpip_thread mbox", 0);
   }
+#if TCPIP_MBOX_BULK
+  if (sys_mbox_new(&tcpip_bulk_mbox, TCPIP_MBOX_BULK_SIZE) != ERR_OK) {
+    LWIP_ASSERT("failed to create tcpip_thread bulk mbox", 0);
+  }
+  tcpip_bulk_msg.type = TCPIP_MSG_BULK;
+#endif /* TCPIP_MBOX_BULK */
 #if LWIP_TCPIP_CORE_LOCKING
   if (sys_mutex_new(&lock_tcpip_core) != ERR_OK) {
     LWIP_ASSERT("failed to create lock_tcpip_core", 0);
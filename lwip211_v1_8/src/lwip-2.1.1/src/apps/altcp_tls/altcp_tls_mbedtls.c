@@ -62,6 +62,8 @@
 #include "lwip/altcp.h"
 #include "lwip/altcp_tls.h"
 #include "lwip/priv/altcp_priv.h"
+#include "lwip/sys.h"
+#include "lwip/timeouts.h"
 
 #include "altcp_tls_mbedtls_structs.h"
 #include "altcp_tls_mbedtls_mem.h"
@@ -78,11 +80,18 @@
 #include "mbedtls/platform.h"
 #include "mbedtls/memory_buffer_alloc.h"
 #include "mbedtls/ssl_cache.h"
+#if defined(MBEDTLS_SSL_TICKET_C) && ALTCP_MBEDTLS_SESSION_TICKET_TIMEOUT_SECONDS
+#include "mbedtls/ssl_ticket.h"
+#endif
 
 #include "mbedtls/ssl_internal.h" /* to call mbedtls_flush_output after ERR_MEM */
 
 #include <string.h>
 
+#if ALTCP_MBEDTLS_RX_ZEROCOPY && !LWIP_SUPPORT_CUSTOM_PBUF
+#error "ALTCP_MBEDTLS_RX_ZEROCOPY needs LWIP_SUPPORT_CUSTOM_PBUF"
+#endif
+
 #ifndef ALTCP_MBEDTLS_ENTROPY_PTR
 #define ALTCP_MBEDTLS_ENTROPY_PTR   NULL
 #endif
@@ -106,6 +115,17 @@ struct altcp_tls_config {
   /** Inter-connection cache for fast connection startup */
   struct mbedtls_ssl_cache_context cache;
 #endif
+#if defined(MBEDTLS_SSL_TICKET_C) && ALTCP_MBEDTLS_SESSION_TICKET_TIMEOUT_SECONDS
+  /** Keys protecting the session tickets handed to clients */
+  mbedtls_ssl_ticket_context ticket;
+#endif
+#if ALTCP_MBEDTLS_CLIENT_SESSION_RESUME
+  /** Session of the last handshake of a client, and the server it was made with */
+  mbedtls_ssl_session session;
+  ip_addr_t session_addr;
+  u16_t session_port;
+  u8_t session_valid;
+#endif
 };
 
 static err_t altcp_mbedtls_lower_recv(void *arg, struct altcp_pcb *inner_conn, struct pbuf *p, err_t err);
@@ -113,6 +133,9 @@ static err_t altcp_mbedtls_setup(void *conf, struct altcp_pcb *conn, struct altc
 static err_t altcp_mbedtls_lower_recv_process(struct altcp_pcb *conn, altcp_mbedtls_state_t *state);
 static err_t altcp_mbedtls_handle_rx_appldata(struct altcp_pcb *conn, altcp_mbedtls_state_t *state);
 static int altcp_mbedtls_bio_send(void *ctx, const unsigned char *dataptr, size_t size);
+#if ALTCP_MBEDTLS_CLIENT_SESSION_RESUME
+static void altcp_mbedtls_session_save(struct altcp_pcb *conn, altcp_mbedtls_state_t *state);
+#endif
 
 
 /* callback functions from inner/lower connection: */
@@ -281,6 +304,9 @@ altcp_mbedtls_lower_recv_process(struct altcp_pcb *conn, altcp_mbedtls_state_t *
     LWIP_ASSERT("state", state->bio_bytes_read == 0);
     LWIP_ASSERT("state", state->bio_bytes_appl == 0);
     state->flags |= ALTCP_MBEDTLS_FLAGS_HANDSHAKE_DONE;
+#if ALTCP_MBEDTLS_CLIENT_SESSION_RESUME
+    altcp_mbedtls_session_save(conn, state);
+#endif
     /* issue "connect" callback" to upper connection (this can only happen for active open) */
     if (conn->connected) {
       err_t err;
@@ -344,9 +370,99 @@ altcp_mbedtls_pass_rx_data(struct altcp_pcb *conn, altcp_mbedtls_state_t *state)
     /* return error code to ensure altcp_mbedtls_handle_rx_appldata() exits the loop */
     return ERR_CLSD;
   }
+#if ALTCP_MBEDTLS_RX_ZEROCOPY
+  if ((state->flags & ALTCP_MBEDTLS_FLAGS_RX_LENT) && (state->rx_app == NULL)) {
+    /* accepted but not freed yet: reading goes on when it is */
+    state->flags |= ALTCP_MBEDTLS_FLAGS_RX_HELD;
+  }
+#endif
   return ERR_OK;
 }
 
+#if ALTCP_MBEDTLS_RX_ZEROCOPY
+/* Continue reading after the application freed plaintext it held on to */
+static void
+altcp_mbedtls_rx_resume(void *arg)
+{
+  struct altcp_pcb *conn = (struct altcp_pcb *)arg;
+  if (conn->state != NULL) {
+    altcp_mbedtls_handle_rx_appldata(conn, (altcp_mbedtls_state_t *)conn->state);
+  }
+}
+
+/* Free callback of the lent plaintext pbuf: the input buffer of mbedTLS is ours again */
+static void
+altcp_mbedtls_rx_lent_free(struct pbuf *p)
+{
+  altcp_mbedtls_state_t *state = (altcp_mbedtls_state_t *)(void *)((u8_t *)p - offsetof(altcp_mbedtls_state_t, rx_lent));
+  u8_t flags = state->flags;
+
+  state->flags &= (u8_t)~(ALTCP_MBEDTLS_FLAGS_RX_LENT | ALTCP_MBEDTLS_FLAGS_RX_HELD);
+  if (flags & ALTCP_MBEDTLS_FLAGS_FREE_PENDING) {
+    /* the connection is gone already and left freeing the TLS context to us */
+    mbedtls_ssl_free(&state->ssl_context);
+    altcp_mbedtls_free(state->conf, state);
+  } else if (flags & ALTCP_MBEDTLS_FLAGS_RX_HELD) {
+    /* encrypted data may be waiting, but we might be deep inside the application here */
+    sys_timeout(0, altcp_mbedtls_rx_resume, state->ssl_context.p_bio);
+  }
+}
+#endif /* ALTCP_MBEDTLS_RX_ZEROCOPY */
+
+/* Decrypt the next piece of application data into a pbuf.
+ * Returns NULL if there is none, *ret is the result of mbedtls_ssl_read() then.
+ */
+static struct pbuf *
+altcp_mbedtls_read(altcp_mbedtls_state_t *state, int *ret)
+{
+#if ALTCP_MBEDTLS_RX_ZEROCOPY
+  mbedtls_ssl_context *ssl = &state->ssl_context;
+  unsigned char dummy;
+  size_t avail;
+  struct pbuf *p;
+
+  /* reading 0 bytes decrypts the next record in place and leaves it in the input buffer */
+  *ret = mbedtls_ssl_read(ssl, &dummy, 0);
+  if (*ret < 0) {
+    return NULL;
+  }
+  avail = mbedtls_ssl_get_bytes_avail(ssl);
+  if ((avail == 0) || (ssl->in_offt == NULL)) {
+    *ret = 0;
+    return NULL;
+  }
+  LWIP_ASSERT("record too long", avail <= 0xFFFF);
+  state->rx_lent.custom_free_function = altcp_mbedtls_rx_lent_free;
+  p = pbuf_alloced_custom(PBUF_RAW, (u16_t)avail, PBUF_REF, &state->rx_lent, ssl->in_offt, (u16_t)avail);
+  LWIP_ASSERT("pbuf_alloced_custom failed", p != NULL);
+  /* consumed as far as mbedTLS is concerned, it does not touch the buffer before the next read */
+  ssl->in_msglen = 0;
+  ssl->in_offt = NULL;
+  ssl->keep_current_message = 0;
+  state->flags |= ALTCP_MBEDTLS_FLAGS_RX_LENT;
+  *ret = (int)avail;
+  return p;
+#else /* ALTCP_MBEDTLS_RX_ZEROCOPY */
+  /* allocate a full-sized unchained PBUF_POOL: this is for RX! */
+  struct pbuf *buf = pbuf_alloc(PBUF_RAW, PBUF_POOL_BUFSIZE, PBUF_POOL);
+  if (buf == NULL) {
+    /* We're short on pbufs, try again later from 'poll' or 'recv' callbacks.
+       @todo: close on excessive allocation failures or leave this up to upper conn? */
+    *ret = MBEDTLS_ERR_SSL_WANT_READ;
+    return NULL;
+  }
+  *ret = mbedtls_ssl_read(&state->ssl_context, (unsigned char *)buf->payload, PBUF_POOL_BUFSIZE);
+  if (*ret <= 0) {
+    pbuf_free(buf);
+    return NULL;
+  }
+  LWIP_ASSERT("bogus receive length", *ret <= PBUF_POOL_BUFSIZE);
+  /* trim pool pbuf to actually decoded length */
+  pbuf_realloc(buf, (u16_t)*ret);
+  return buf;
+#endif /* ALTCP_MBEDTLS_RX_ZEROCOPY */
+}
+
 /* Helper function that processes rx application data stored in rx pbuf chain */
 static err_t
 altcp_mbedtls_handle_rx_appldata(struct altcp_pcb *conn, altcp_mbedtls_state_t *state)
@@ -358,16 +474,26 @@ altcp_mbedtls_handle_rx_appldata(struct altcp_pcb *conn, altcp_mbedtls_state_t *
     return ERR_VAL;
   }
   do {
-    /* allocate a full-sized unchained PBUF_POOL: this is for RX! */
-    struct pbuf *buf = pbuf_alloc(PBUF_RAW, PBUF_POOL_BUFSIZE, PBUF_POOL);
-    if (buf == NULL) {
-      /* We're short on pbufs, try again later from 'poll' or 'recv' callbacks.
-         @todo: close on excessive allocation failures or leave this up to upper conn? */
-      return ERR_OK;
+    struct pbuf *buf;
+#if ALTCP_MBEDTLS_RX_ZEROCOPY
+    if (state->flags & ALTCP_MBEDTLS_FLAGS_RX_LENT) {
+      /* the input buffer holds plaintext the application did not free yet */
+      err_t err;
+      if (state->rx_app == NULL) {
+        return ERR_OK;
+      }
+      err = altcp_mbedtls_pass_rx_data(conn, state);
+      if (err != ERR_OK) {
+        return (err == ERR_ABRT) ? ERR_ABRT : ERR_OK;
+      }
+      if (state->flags & ALTCP_MBEDTLS_FLAGS_RX_LENT) {
+        return ERR_OK;
+      }
     }
+#endif
 
     /* decrypt application data, this pulls encrypted RX data off state->rx pbuf chain */
-    ret = mbedtls_ssl_read(&state->ssl_context, (unsigned char *)buf->payload, PBUF_POOL_BUFSIZE);
+    buf = altcp_mbedtls_read(state, &ret);
     if (ret < 0) {
       if (ret == MBEDTLS_ERR_SSL_CLIENT_RECONNECT) {
         /* client is initiating a new connection using the same source port -> close connection or make handshake */
@@ -379,22 +505,15 @@ altcp_mbedtls_handle_rx_appldata(struct altcp_pcb *conn, altcp_mbedtls_state_t *
         } else if (ret == MBEDTLS_ERR_NET_CONN_RESET) {
           LWIP_DEBUGF(ALTCP_MBEDTLS_DEBUG, ("connection was reset by peer\n"));
         }
-        pbuf_free(buf);
         return ERR_OK;
       } else {
-        pbuf_free(buf);
         return ERR_OK;
       }
-      pbuf_free(buf);
       altcp_abort(conn);
       return ERR_ABRT;
     } else {
       err_t err;
       if (ret) {
-        LWIP_ASSERT("bogus receive length", ret <= PBUF_POOL_BUFSIZE);
-        /* trim pool pbuf to actually decoded length */
-        pbuf_realloc(buf, (u16_t)ret);
-
         state->bio_bytes_appl += ret;
         if (mbedtls_ssl_get_bytes_avail(&state->ssl_context) == 0) {
           /* Record is done, now we know the share between application and protocol bytes
@@ -413,9 +532,6 @@ altcp_mbedtls_handle_rx_appldata(struct altcp_pcb *conn, altcp_mbedtls_state_t *
         } else {
           pbuf_cat(state->rx_app, buf);
         }
-      } else {
-        pbuf_free(buf);
-        buf = NULL;
       }
       err = altcp_mbedtls_pass_rx_data(conn, state);
       if (err != ERR_OK) {
@@ -636,6 +752,49 @@ altcp_tls_context(struct altcp_pcb *conn)
   return NULL;
 }
 
+#if ALTCP_MBEDTLS_CLIENT_SESSION_RESUME
+/** Offer the session remembered by the config if the connection goes to the same server */
+static void
+altcp_mbedtls_session_offer(struct altcp_pcb *conn, const ip_addr_t *ipaddr, u16_t port)
+{
+  altcp_mbedtls_state_t *state = (altcp_mbedtls_state_t *)conn->state;
+  struct altcp_tls_config *config;
+
+  if (state == NULL) {
+    return;
+  }
+  config = (struct altcp_tls_config *)state->conf;
+  if (config->session_valid && (config->session_port == port) &&
+      ip_addr_cmp(&config->session_addr, ipaddr)) {
+    /* a session the server does not know anymore only costs the full handshake */
+    int ret = mbedtls_ssl_set_session(&state->ssl_context, &config->session);
+    if (ret != 0) {
+      LWIP_DEBUGF(ALTCP_MBEDTLS_DEBUG, ("mbedtls_ssl_set_session failed: %d\n", ret));
+    }
+  }
+}
+
+/** Remember the session of a finished client handshake for the next connection */
+static void
+altcp_mbedtls_session_save(struct altcp_pcb *conn, altcp_mbedtls_state_t *state)
+{
+  struct altcp_tls_config *config = (struct altcp_tls_config *)state->conf;
+  ip_addr_t addr;
+  u16_t port;
+
+  if ((config->conf.endpoint != MBEDTLS_SSL_IS_CLIENT) ||
+      (altcp_get_tcp_addrinfo(conn->inner_conn, 0, &addr, &port) != ERR_OK)) {
+    return;
+  }
+  config->session_valid = 0;
+  if (mbedtls_ssl_get_session(&state->ssl_context, &config->session) == 0) {
+    ip_addr_copy(config->session_addr, addr);
+    config->session_port = port;
+    config->session_valid = 1;
+  }
+}
+#endif /* ALTCP_MBEDTLS_CLIENT_SESSION_RESUME */
+
 #if ALTCP_MBEDTLS_DEBUG != LWIP_DBG_OFF
 static void
 altcp_mbedtls_debug(void *ctx, int level, const char *file, int line, const char *str)
@@ -739,9 +898,28 @@ altcp_tls_create_config(int is_server, int have_cert, int have_pkey, int have_ca
   mbedtls_ssl_conf_dbg(&conf->conf, altcp_mbedtls_debug, stdout);
 #endif
 #if defined(MBEDTLS_SSL_CACHE_C) && ALTCP_MBEDTLS_SESSION_CACHE_TIMEOUT_SECONDS
-  mbedtls_ssl_conf_session_cache(&conf->conf, &conf->cache, mbedtls_ssl_cache_get, mbedtls_ssl_cache_set);
-  mbedtls_ssl_cache_set_timeout(&conf->cache, 30);
-  mbedtls_ssl_cache_set_max_entries(&conf->cache, 30);
+  mbedtls_ssl_cache_init(&conf->cache);
+  if (is_server) {
+    mbedtls_ssl_conf_session_cache(&conf->conf, &conf->cache, mbedtls_ssl_cache_get, mbedtls_ssl_cache_set);
+    mbedtls_ssl_cache_set_timeout(&conf->cache, ALTCP_MBEDTLS_SESSION_CACHE_TIMEOUT_SECONDS);
+    mbedtls_ssl_cache_set_max_entries(&conf->cache, ALTCP_MBEDTLS_SESSION_CACHE_SIZE);
+  }
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C) && ALTCP_MBEDTLS_SESSION_TICKET_TIMEOUT_SECONDS
+  mbedtls_ssl_ticket_init(&conf->ticket);
+  if (is_server) {
+    ret = mbedtls_ssl_ticket_setup(&conf->ticket, mbedtls_ctr_drbg_random, &conf->ctr_drbg,
+                                   MBEDTLS_CIPHER_AES_256_GCM, ALTCP_MBEDTLS_SESSION_TICKET_TIMEOUT_SECONDS);
+    if (ret != 0) {
+      LWIP_DEBUGF(ALTCP_MBEDTLS_DEBUG, ("mbedtls_ssl_ticket_setup failed: %d\n", ret));
+      altcp_mbedtls_free_config(conf);
+      return NULL;
+    }
+    mbedtls_ssl_conf_session_tickets_cb(&conf->conf, mbedtls_ssl_ticket_write, mbedtls_ssl_ticket_parse, &conf->ticket);
+  }
+#endif
+#if ALTCP_MBEDTLS_CLIENT_SESSION_RESUME
+  mbedtls_ssl_session_init(&conf->session);
 #endif
 
   return conf;
@@ -821,6 +999,10 @@ altcp_tls_create_config_client_common(const u8_t *ca, size_t ca_len, int is_2way
 
     mbedtls_ssl_conf_ca_chain(&conf->conf, conf->ca, NULL);
   }
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH) && ALTCP_MBEDTLS_MAX_FRAG_LEN
+  /* ask the server for records that don't need the whole TCP window to be decrypted */
+  mbedtls_ssl_conf_max_frag_len(&conf->conf, ALTCP_MBEDTLS_MAX_FRAG_LEN);
+#endif
   return conf;
 }
 
@@ -887,6 +1069,15 @@ altcp_tls_free_config(struct altcp_tls_config *conf)
   if (conf->ca) {
     mbedtls_x509_crt_free(conf->ca);
   }
+#if defined(MBEDTLS_SSL_CACHE_C) && ALTCP_MBEDTLS_SESSION_CACHE_TIMEOUT_SECONDS
+  mbedtls_ssl_cache_free(&conf->cache);
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C) && ALTCP_MBEDTLS_SESSION_TICKET_TIMEOUT_SECONDS
+  mbedtls_ssl_ticket_free(&conf->ticket);
+#endif
+#if ALTCP_MBEDTLS_CLIENT_SESSION_RESUME
+  mbedtls_ssl_session_free(&conf->session);
+#endif
   altcp_mbedtls_free_config(conf);
 }
 
@@ -932,6 +1123,9 @@ altcp_mbedtls_connect(struct altcp_pcb *conn, const ip_addr_t *ipaddr, u16_t por
     return ERR_VAL;
   }
   conn->connected = connected;
+#if ALTCP_MBEDTLS_CLIENT_SESSION_RESUME
+  altcp_mbedtls_session_offer(conn, ipaddr, port);
+#endif
   return altcp_connect(conn->inner_conn, ipaddr, port, altcp_mbedtls_lower_connected);
 }
 
@@ -985,6 +1179,31 @@ altcp_mbedtls_close(struct altcp_pcb *conn)
   return ERR_OK;
 }
 
+#if ALTCP_MBEDTLS_DYNAMIC_RECORD_SIZE
+/** Application bytes per record for the next write: a record fitting one TCP
+ * segment while the connection starts or after it was idle (the peer can decrypt
+ * it as soon as that segment arrives), as much as mbedTLS takes otherwise.
+ */
+static u16_t
+altcp_mbedtls_record_len(struct altcp_pcb *conn, altcp_mbedtls_state_t *state)
+{
+  u16_t mss;
+  int ssl_expan;
+
+  if ((state->small_sent >= ALTCP_MBEDTLS_RECORD_BOOST_BYTES) &&
+      ((u32_t)(sys_now() - state->last_write) <= ALTCP_MBEDTLS_RECORD_IDLE_MS)) {
+    return 0xFFFF;
+  }
+  mss = altcp_mss(conn->inner_conn);
+  ssl_expan = mbedtls_ssl_get_record_expansion(&state->ssl_context);
+  if ((ssl_expan > 0) && (ssl_expan < mss / 2)) {
+    return (u16_t)(mss - ssl_expan);
+  }
+  /* tiny MSS: records spanning two segments are still better than 16 KB */
+  return (mss != 0) ? mss : 0xFFFF;
+}
+#endif /* ALTCP_MBEDTLS_DYNAMIC_RECORD_SIZE */
+
 /** Allow caller of altcp_write() to limit to negotiated chunk size
  *  or remaining sndbuf space of inner_conn.
  */
@@ -1011,6 +1230,17 @@ altcp_mbedtls_sndbuf(struct altcp_pcb *conn)
           /* @todo: adjust ssl_added to real value related to negotiated cipher */
           size_t max_frag_len = mbedtls_ssl_get_max_frag_len(&state->ssl_context);
           max_len = LWIP_MIN(max_frag_len, max_len);
+#endif
+#if ALTCP_MBEDTLS_DYNAMIC_RECORD_SIZE
+          {
+            /* small records: each of them adds the expansion */
+            u16_t rec_len = altcp_mbedtls_record_len(conn, state);
+            size_t records = sndbuf / (rec_len + ssl_added) + 1;
+            if (records * ssl_added >= sndbuf) {
+              return 0;
+            }
+            ssl_added *= records;
+          }
 #endif
           /* Adjust sndbuf of inner_conn with what added by SSL */
           ret = LWIP_MIN(sndbuf - ssl_added, max_len);
@@ -1031,6 +1261,8 @@ static err_t
 altcp_mbedtls_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags)
 {
   int ret;
+  u16_t written;
+  u16_t rec_len = 0xFFFF;
   altcp_mbedtls_state_t *state;
 
   LWIP_UNUSED_ARG(apiflags);
@@ -1058,26 +1290,58 @@ altcp_mbedtls_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t
       return ERR_MEM;
     }
   }
-  ret = mbedtls_ssl_write(&state->ssl_context, (const unsigned char *)dataptr, len);
-  /* try to send data... */
-  altcp_output(conn->inner_conn);
-  if (ret >= 0) {
-    if (ret == len) {
-      state->flags |= ALTCP_MBEDTLS_FLAGS_APPLDATA_SENT;
-      return ERR_OK;
-    } else {
-      /* @todo/@fixme: assumption: either everything sent or error */
-      LWIP_ASSERT("ret <= 0", 0);
+#if ALTCP_MBEDTLS_DYNAMIC_RECORD_SIZE
+  rec_len = altcp_mbedtls_record_len(conn, state);
+  if (rec_len < len) {
+    /* all records must fit or none is written: altcp_write() cannot report partial writes */
+    int ssl_expan = mbedtls_ssl_get_record_expansion(&state->ssl_context);
+    u32_t records = ((u32_t)len + rec_len - 1) / rec_len;
+    if ((ssl_expan > 0) && ((u32_t)len + records * (u32_t)ssl_expan > altcp_sndbuf(conn->inner_conn))) {
       return ERR_MEM;
     }
-  } else {
-    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
-      /* @todo: convert error to err_t */
+    /* a record needs at most two pbufs when it straddles a segment */
+    if (altcp_sndqueuelen(conn->inner_conn) + 2 * records > TCP_SND_QUEUELEN) {
       return ERR_MEM;
     }
-    LWIP_ASSERT("unhandled error", 0);
-    return ERR_VAL;
   }
+#endif
+  written = 0;
+  do {
+    ret = mbedtls_ssl_write(&state->ssl_context, (const unsigned char *)dataptr + written,
+                            (size_t)LWIP_MIN(len - written, rec_len));
+    if (ret <= 0) {
+      break;
+    }
+    written = (u16_t)(written + ret);
+    /* a record mbedTLS could not pass on blocks its output buffer, later ones would overwrite it */
+  } while ((written < len) && (state->ssl_context.out_left == 0));
+  /* try to send data... */
+  altcp_output(conn->inner_conn);
+  if (written == len) {
+#if ALTCP_MBEDTLS_DYNAMIC_RECORD_SIZE
+    u32_t now = sys_now();
+    if ((u32_t)(now - state->last_write) > ALTCP_MBEDTLS_RECORD_IDLE_MS) {
+      state->small_sent = 0;
+    }
+    if (state->small_sent < ALTCP_MBEDTLS_RECORD_BOOST_BYTES) {
+      state->small_sent += len;
+    }
+    state->last_write = now;
+#endif
+    state->flags |= ALTCP_MBEDTLS_FLAGS_APPLDATA_SENT;
+    return ERR_OK;
+  }
+  if (written > 0) {
+    /* @todo/@fixme: assumption: either everything sent or error */
+    LWIP_ASSERT("ret <= 0", 0);
+    return ERR_MEM;
+  }
+  if (ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+    /* @todo: convert error to err_t */
+    return ERR_MEM;
+  }
+  LWIP_ASSERT("unhandled error", 0);
+  return ERR_VAL;
 }
 
 /** Send callback function called from mbedtls (set via mbedtls_ssl_set_bio)
@@ -1134,15 +1398,28 @@ altcp_mbedtls_dealloc(struct altcp_pcb *conn)
   if (conn) {
     altcp_mbedtls_state_t *state = (altcp_mbedtls_state_t *)conn->state;
     if (state) {
-      mbedtls_ssl_free(&state->ssl_context);
-      state->flags = 0;
       if (state->rx) {
         /* free leftover (unhandled) rx pbufs */
         pbuf_free(state->rx);
         state->rx = NULL;
       }
-      altcp_mbedtls_free(state->conf, state);
+      if (state->rx_app) {
+        /* decrypted but not taken by the application */
+        pbuf_free(state->rx_app);
+        state->rx_app = NULL;
+      }
       conn->state = NULL;
+#if ALTCP_MBEDTLS_RX_ZEROCOPY
+      sys_untimeout(altcp_mbedtls_rx_resume, conn);
+      if (state->flags & ALTCP_MBEDTLS_FLAGS_RX_LENT) {
+        /* the application still holds plaintext in our input buffer, its free does the rest */
+        state->flags = ALTCP_MBEDTLS_FLAGS_RX_LENT | ALTCP_MBEDTLS_FLAGS_FREE_PENDING;
+        return;
+      }
+#endif
+      mbedtls_ssl_free(&state->ssl_context);
+      state->flags = 0;
+      altcp_mbedtls_free(state->conf, state);
     }
   }
 }
@@ -68,7 +68,18 @@
 #define ALTCP_MBEDTLS_MEM_DEBUG   LWIP_DBG_OFF
 #endif
 
-#if defined(MBEDTLS_PLATFORM_MEMORY) && \
+#if ALTCP_MBEDTLS_MEM_ARENA_SESSIONS
+#if !defined(MBEDTLS_MEMORY_BUFFER_ALLOC_C)
+#error "ALTCP_MBEDTLS_MEM_ARENA_SESSIONS needs MBEDTLS_MEMORY_BUFFER_ALLOC_C"
+#endif
+#include "mbedtls/memory_buffer_alloc.h"
+
+/** All mbedTLS allocations come from here instead of the lwIP heap */
+static LWIP_DECLARE_MEMORY_ALIGNED(altcp_mbedtls_arena, ALTCP_MBEDTLS_MEM_ARENA_SESSIONS * ALTCP_MBEDTLS_MEM_SESSION_SIZE);
+static u8_t altcp_mbedtls_arena_ready;
+#endif /* ALTCP_MBEDTLS_MEM_ARENA_SESSIONS */
+
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !ALTCP_MBEDTLS_MEM_ARENA_SESSIONS && \
    (!defined(MBEDTLS_PLATFORM_FREE_MACRO) || \
     defined(MBEDTLS_PLATFORM_CALLOC_MACRO))
 #define ALTCP_MBEDTLS_PLATFORM_ALLOC 1
@@ -162,7 +173,14 @@ altcp_mbedtls_mem_init(void)
 {
   /* not much to do here when using the heap */
 
-#if ALTCP_MBEDTLS_PLATFORM_ALLOC
+#if ALTCP_MBEDTLS_MEM_ARENA_SESSIONS
+  if (!altcp_mbedtls_arena_ready) {
+    /* this sets the mbedtls allocation methods to the buffer allocator */
+    mbedtls_memory_buffer_alloc_init(LWIP_MEM_ALIGN(altcp_mbedtls_arena),
+                                     ALTCP_MBEDTLS_MEM_ARENA_SESSIONS * ALTCP_MBEDTLS_MEM_SESSION_SIZE);
+    altcp_mbedtls_arena_ready = 1;
+  }
+#elif ALTCP_MBEDTLS_PLATFORM_ALLOC
   /* set mbedtls allocation methods */
   mbedtls_platform_set_calloc_free(&tls_malloc, &tls_free);
 #endif
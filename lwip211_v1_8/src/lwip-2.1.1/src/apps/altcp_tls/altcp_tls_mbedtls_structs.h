@@ -61,6 +61,9 @@ extern "C" {
 #define ALTCP_MBEDTLS_FLAGS_RX_CLOSE_QUEUED   0x04
 #define ALTCP_MBEDTLS_FLAGS_RX_CLOSED         0x08
 #define ALTCP_MBEDTLS_FLAGS_APPLDATA_SENT     0x10
+#define ALTCP_MBEDTLS_FLAGS_RX_LENT           0x20
+#define ALTCP_MBEDTLS_FLAGS_RX_HELD           0x40
+#define ALTCP_MBEDTLS_FLAGS_FREE_PENDING      0x80
 
 typedef struct altcp_mbedtls_state_s {
   void *conf;
@@ -68,10 +71,20 @@ typedef struct altcp_mbedtls_state_s {
   /* chain of rx pbufs (before decryption) */
   struct pbuf *rx;
   struct pbuf *rx_app;
+#if ALTCP_MBEDTLS_RX_ZEROCOPY
+  /* plaintext of the last record, lent to the application */
+  struct pbuf_custom rx_lent;
+#endif
   u8_t flags;
   int rx_passed_unrecved;
   int bio_bytes_read;
   int bio_bytes_appl;
+#if ALTCP_MBEDTLS_DYNAMIC_RECORD_SIZE
+  /* application bytes sent in small records since start or the last idle time */
+  u32_t small_sent;
+  /* sys_now() of the last write */
+  u32_t last_write;
+#endif
 } altcp_mbedtls_state_t;
 
 #ifdef __cplusplus
@@ -50,8 +50,64 @@ int fs_read_async_custom(struct fs_file *file, char *buffer, int count, fs_wait_
 #else /* LWIP_HTTPD_FS_ASYNC_READ */
 int fs_read_custom(struct fs_file *file, char *buffer, int count);
 #endif /* LWIP_HTTPD_FS_ASYNC_READ */
+#if LWIP_HTTPD_DYNAMIC_FILE_READ && LWIP_HTTPD_FS_SENDFILE
+int fs_map_custom(struct fs_file *file, const char **data, int count);
+#endif /* LWIP_HTTPD_DYNAMIC_FILE_READ && LWIP_HTTPD_FS_SENDFILE */
 #endif /* LWIP_HTTPD_CUSTOM_FILES */
 
+/*-----------------------------------------------------------------------------------*/
+/** Find the first fsdata file called 'name'. Files of the same name
+ * (encoded variants) follow it in the list. */
+static const struct fsdata_file *
+fs_find(const char *name)
+{
+#ifdef FS_SORTED_INDEX
+  /* makefsdata sorted one entry per name by strcmp(): binary search */
+  size_t lo = 0;
+  size_t hi = FS_SORTED_NUMFILES;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = strcmp((const char *)FS_SORTED_INDEX[mid]->name, name);
+    if (cmp == 0) {
+      return FS_SORTED_INDEX[mid];
+    } else if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+#else /* FS_SORTED_INDEX */
+  const struct fsdata_file *f;
+
+  for (f = FS_ROOT; f != NULL; f = f->next) {
+    if (!strcmp(name, (const char *)f->name)) {
+      return f;
+    }
+  }
+#endif /* FS_SORTED_INDEX */
+  return NULL;
+}
+
+/*-----------------------------------------------------------------------------------*/
+static void
+fs_open_fsdata(struct fs_file *file, const struct fsdata_file *f, const char *name)
+{
+  file->data = (const char *)f->data;
+  file->len = f->len;
+  file->index = f->len;
+  file->pextension = NULL;
+  file->flags = f->flags;
+#if HTTPD_PRECALCULATED_CHECKSUM
+  file->chksum_count = f->chksum_count;
+  file->chksum = f->chksum;
+#endif /* HTTPD_PRECALCULATED_CHECKSUM */
+#if LWIP_HTTPD_FILE_STATE
+  file->state = fs_state_init(file, name);
+#else /* LWIP_HTTPD_FILE_STATE */
+  LWIP_UNUSED_ARG(name);
+#endif /* LWIP_HTTPD_FILE_STATE */
+}
+
 /*-----------------------------------------------------------------------------------*/
 err_t
 fs_open(struct fs_file *file, const char *name)
@@ -70,26 +126,66 @@ fs_open(struct fs_file *file, const char *name)
   file->is_custom_file = 0;
 #endif /* LWIP_HTTPD_CUSTOM_FILES */
 
-  for (f = FS_ROOT; f != NULL; f = f->next) {
-    if (!strcmp(name, (const char *)f->name)) {
-      file->data = (const char *)f->data;
-      file->len = f->len;
-      file->index = f->len;
-      file->pextension = NULL;
-      file->flags = f->flags;
-#if HTTPD_PRECALCULATED_CHECKSUM
-      file->chksum_count = f->chksum_count;
-      file->chksum = f->chksum;
-#endif /* HTTPD_PRECALCULATED_CHECKSUM */
-#if LWIP_HTTPD_FILE_STATE
-      file->state = fs_state_init(file, name);
-#endif /* #if LWIP_HTTPD_FILE_STATE */
-      return ERR_OK;
+  f = fs_find(name);
+#if LWIP_HTTPD_ACCEPT_ENCODING
+  /* skip encoded variants */
+  while ((f != NULL) && ((f->flags & FS_FILE_FLAGS_ENC_MASK) != 0)) {
+    f = f->next;
+    if ((f != NULL) && strcmp(name, (const char *)f->name)) {
+      f = NULL;
+    }
+  }
+#endif /* LWIP_HTTPD_ACCEPT_ENCODING */
+  if (f == NULL) {
+    /* file not found */
+    return ERR_VAL;
+  }
+  fs_open_fsdata(file, f, name);
+  return ERR_OK;
+}
+
+#if LWIP_HTTPD_ACCEPT_ENCODING
+/*-----------------------------------------------------------------------------------*/
+/**
+ * Like fs_open(), but return a pre-compressed variant of the file if the
+ * client accepts its encoding.
+ *
+ * @param accept mask of FS_FILE_FLAGS_ENC_* the client accepts
+ */
+err_t
+fs_open_encoded(struct fs_file *file, const char *name, u8_t accept)
+{
+  const struct fsdata_file *f;
+  const struct fsdata_file *best = NULL;
+
+  if ((file == NULL) || (name == NULL)) {
+    return ERR_ARG;
+  }
+
+#if LWIP_HTTPD_CUSTOM_FILES
+  if (fs_open_custom(file, name)) {
+    file->is_custom_file = 1;
+    return ERR_OK;
+  }
+  file->is_custom_file = 0;
+#endif /* LWIP_HTTPD_CUSTOM_FILES */
+
+  for (f = fs_find(name); (f != NULL) && !strcmp(name, (const char *)f->name); f = f->next) {
+    u8_t enc = f->flags & FS_FILE_FLAGS_ENC_MASK;
+    /* the higher flag is the better compression */
+    if (((enc & accept) == enc) &&
+        ((best == NULL) || (enc > (best->flags & FS_FILE_FLAGS_ENC_MASK)))) {
+      best = f;
     }
   }
-  /* file not found */
-  return ERR_VAL;
+  if (best == NULL) {
+    /* file not found */
+    return ERR_VAL;
+  }
+  fs_open_fsdata(file, best, name);
+  return ERR_OK;
 }
+#endif /* LWIP_HTTPD_ACCEPT_ENCODING */
 
 /*-----------------------------------------------------------------------------------*/
 void
@@ -145,6 +241,43 @@ fs_read(struct fs_file *file, char *buffer, int count)
 }
 #endif /* LWIP_HTTPD_DYNAMIC_FILE_READ */
 /*-----------------------------------------------------------------------------------*/
+#if LWIP_HTTPD_DYNAMIC_FILE_READ && LWIP_HTTPD_FS_SENDFILE
+/**
+ * Like fs_read(), but instead of copying return a pointer to the next block
+ * of the file image in *data. The block must stay valid until the file is
+ * closed.
+ *
+ * @return the number of bytes at *data (at most count), FS_READ_EOF at the
+ *         end of the file or 0 if the file cannot be mapped (use fs_read)
+ */
+int
+fs_map(struct fs_file *file, const char **data, int count)
+{
+  int read;
+  if (file->index == file->len) {
+    return FS_READ_EOF;
+  }
+#if LWIP_HTTPD_CUSTOM_FILES
+  if (file->is_custom_file && (file->data == NULL)) {
+    return fs_map_custom(file, data, count);
+  }
+#endif /* LWIP_HTTPD_CUSTOM_FILES */
+  if (file->data == NULL) {
+    return 0;
+  }
+
+  read = file->len - file->index;
+  if (read > count) {
+    read = count;
+  }
+
+  *data = file->data + file->index;
+  file->index += read;
+
+  return read;
+}
+#endif /* LWIP_HTTPD_DYNAMIC_FILE_READ && LWIP_HTTPD_FS_SENDFILE */
+/*-----------------------------------------------------------------------------------*/
 #if LWIP_HTTPD_FS_ASYNC_READ
 int
 fs_is_file_ready(struct fs_file *file, fs_wait_cb callback_fn, void *callback_arg)
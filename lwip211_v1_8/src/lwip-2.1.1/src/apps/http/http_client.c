@@ -53,6 +53,10 @@
 #include "lwip/mem.h"
 #include "lwip/altcp_tls.h"
 #include "lwip/init.h"
+#if LWIP_HTTPC_STREAM
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#endif /* LWIP_HTTPC_STREAM */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -60,6 +64,10 @@
 
 #if LWIP_TCP && LWIP_CALLBACK_API
 
+#if LWIP_HTTPC_STREAM && NO_SYS
+#error "LWIP_HTTPC_STREAM needs NO_SYS==0"
+#endif
+
 /**
  * HTTPC_DEBUG: Enable debugging for HTTP client.
  */
@@ -94,8 +102,9 @@
     "User-Agent: %s\r\n" /* User-Agent */ \
     "Accept: */*\r\n" \
     "Connection: Close\r\n" /* we don't support persistent connections, yet */ \
+    "%s" /* Range */ \
     "\r\n"
-#define HTTPC_REQ_11_FORMAT(uri) HTTPC_REQ_11, uri, HTTPC_CLIENT_AGENT
+#define HTTPC_REQ_11_FORMAT(uri, range) HTTPC_REQ_11, uri, HTTPC_CLIENT_AGENT, range
 
 /* GET request with host */
 #define HTTPC_REQ_11_HOST "GET %s HTTP/1.1\r\n" /* URI */\
@@ -103,8 +112,9 @@
     "Accept: */*\r\n" \
     "Host: %s\r\n" /* server name */ \
     "Connection: Close\r\n" /* we don't support persistent connections, yet */ \
+    "%s" /* Range */ \
     "\r\n"
-#define HTTPC_REQ_11_HOST_FORMAT(uri, srv_name) HTTPC_REQ_11_HOST, uri, HTTPC_CLIENT_AGENT, srv_name
+#define HTTPC_REQ_11_HOST_FORMAT(uri, srv_name, range) HTTPC_REQ_11_HOST, uri, HTTPC_CLIENT_AGENT, srv_name, range
 
 /* GET request with proxy */
 #define HTTPC_REQ_11_PROXY "GET http://%s%s HTTP/1.1\r\n" /* HOST, URI */\
@@ -112,8 +122,9 @@
     "Accept: */*\r\n" \
     "Host: %s\r\n" /* server name */ \
     "Connection: Close\r\n" /* we don't support persistent connections, yet */ \
+    "%s" /* Range */ \
     "\r\n"
-#define HTTPC_REQ_11_PROXY_FORMAT(host, uri, srv_name) HTTPC_REQ_11_PROXY, host, uri, HTTPC_CLIENT_AGENT, srv_name
+#define HTTPC_REQ_11_PROXY_FORMAT(host, uri, srv_name, range) HTTPC_REQ_11_PROXY, host, uri, HTTPC_CLIENT_AGENT, srv_name, range
 
 /* GET request with proxy (non-default server port) */
 #define HTTPC_REQ_11_PROXY_PORT "GET http://%s:%d%s HTTP/1.1\r\n" /* HOST, host-port, URI */\
@@ -121,8 +132,12 @@
     "Accept: */*\r\n" \
     "Host: %s\r\n" /* server name */ \
     "Connection: Close\r\n" /* we don't support persistent connections, yet */ \
+    "%s" /* Range */ \
     "\r\n"
-#define HTTPC_REQ_11_PROXY_PORT_FORMAT(host, host_port, uri, srv_name) HTTPC_REQ_11_PROXY_PORT, host, host_port, uri, HTTPC_CLIENT_AGENT, srv_name
+/* Range header to resume a download */
+#define HTTPC_REQ_RANGE "Range: bytes=%"U32_F"-\r\n"
+
+#define HTTPC_REQ_11_PROXY_PORT_FORMAT(host, host_port, uri, srv_name, range) HTTPC_REQ_11_PROXY_PORT, host, host_port, uri, HTTPC_CLIENT_AGENT, srv_name, range
 
 typedef enum ehttpc_parse_state {
   HTTPC_PARSE_WAIT_FIRST_LINE = 0,
@@ -336,6 +351,8 @@ httpc_tcp_recv(void *arg, struct altcp_pcb *pcb, struct pbuf *p, err_t r)
     }
   }
   if ((p != NULL) && (req->parse_state == HTTPC_PARSE_RX_DATA)) {
+    /* the timeout is for a stalled transfer, not for the whole file */
+    req->timeout_ticks = HTTPC_POLL_TIMEOUT;
     req->rx_content_len += p->tot_len;
     if (req->recv_fn != NULL) {
       /* directly return here: the connection might already be aborted from the callback! */
@@ -487,18 +504,24 @@ static int
 httpc_create_request_string(const httpc_connection_t *settings, const char* server_name, int server_port, const char* uri,
                             int use_host, char *buffer, size_t buffer_size)
 {
+  char range[32];
+
+  range[0] = 0;
+  if (settings->range_start != 0) {
+    snprintf(range, sizeof(range), HTTPC_REQ_RANGE, settings->range_start);
+  }
   if (settings->use_proxy) {
     LWIP_ASSERT("server_name != NULL", server_name != NULL);
     if (server_port != HTTP_DEFAULT_PORT) {
-      return snprintf(buffer, buffer_size, HTTPC_REQ_11_PROXY_PORT_FORMAT(server_name, server_port, uri, server_name));
+      return snprintf(buffer, buffer_size, HTTPC_REQ_11_PROXY_PORT_FORMAT(server_name, server_port, uri, server_name, range));
     } else {
-      return snprintf(buffer, buffer_size, HTTPC_REQ_11_PROXY_FORMAT(server_name, uri, server_name));
+      return snprintf(buffer, buffer_size, HTTPC_REQ_11_PROXY_FORMAT(server_name, uri, server_name, range));
     }
   } else if (use_host) {
     LWIP_ASSERT("server_name != NULL", server_name != NULL);
-    return snprintf(buffer, buffer_size, HTTPC_REQ_11_HOST_FORMAT(uri, server_name));
+    return snprintf(buffer, buffer_size, HTTPC_REQ_11_HOST_FORMAT(uri, server_name, range));
   } else {
-    return snprintf(buffer, buffer_size, HTTPC_REQ_11_FORMAT(uri));
+    return snprintf(buffer, buffer_size, HTTPC_REQ_11_FORMAT(uri, range));
   }
 }
 
@@ -703,6 +726,400 @@ httpc_get_file_dns(const char* server_name, u16_t port, const char* uri, const h
   return ERR_OK;
 }
 
+#if LWIP_HTTPC_STREAM
+/* Streamed download: the body is passed to a sink function on a thread of its
+ * own. While the sink writes one chain, the next one is received and queued;
+ * the data is only acknowledged (altcp_recved) once the sink is done with it. */
+
+typedef struct _httpc_streamstate
+{
+  httpc_state_t *req;         /* NULL once the connection is closed */
+  httpc_sink_fn sink;
+  httpc_connection_t settings;
+  const httpc_connection_t *client_settings;
+  void *callback_arg;
+  struct pbuf *queued;        /* received, not yet passed to the sink */
+  struct pbuf *writing;       /* with the sink thread */
+  u32_t offset;               /* file offset of the first body byte */
+  u32_t written;              /* body bytes the sink has accepted */
+  err_t err;                  /* first error returned by the sink */
+  u8_t svr_err;               /* the server answered neither 200 nor 206 */
+  /* result of the connection, reported when the sink is done */
+  httpc_result_t result;
+  u32_t srv_res;
+  err_t result_err;
+} httpc_streamstate_t;
+
+/* Body data waiting for the sink thread. Each download has at most one message
+ * in flight, so limiting them to the mbox size keeps posting from failing. */
+static sys_mbox_t httpc_stream_mbox;
+static u8_t httpc_stream_thread_running;
+static u8_t httpc_stream_count;
+
+static void httpc_stream_result(void *arg, httpc_result_t httpc_result, u32_t rx_content_len,
+  u32_t srv_res, err_t err);
+
+/** Report the result and free the stream state, when both the connection and
+ * the sink are done */
+static void
+httpc_stream_finish(httpc_streamstate_t *ss)
+{
+  httpc_result_t result = ss->result;
+  err_t err = ss->result_err;
+
+  LWIP_ASSERT("connection still open", ss->req == NULL);
+  LWIP_ASSERT("sink still writing", ss->writing == NULL);
+
+  if (ss->queued != NULL) {
+    pbuf_free(ss->queued);
+  }
+  if (ss->err != ERR_OK) {
+    result = HTTPC_RESULT_LOCAL_ABORT;
+    err = ss->err;
+  } else if (ss->svr_err) {
+    result = HTTPC_RESULT_ERR_SVR_RESP;
+  }
+  if (ss->client_settings->result_fn != NULL) {
+    ss->client_settings->result_fn(ss->callback_arg, result, ss->written, ss->srv_res, err);
+  }
+  mem_free(ss);
+  httpc_stream_count--;
+}
+
+/** Pass what has been queued to the sink thread unless it still has data of
+ * this download */
+static void
+httpc_stream_kick(httpc_streamstate_t *ss)
+{
+  if ((ss->writing == NULL) && (ss->queued != NULL) && (ss->err == ERR_OK)) {
+    ss->writing = ss->queued;
+    ss->queued = NULL;
+    if (sys_mbox_trypost(&httpc_stream_mbox, ss) != ERR_OK) {
+      LWIP_ASSERT("httpc_stream_kick: sink mbox full", 0);
+      ss->queued = ss->writing;
+      ss->writing = NULL;
+    }
+  }
+}
+
+/** Called in tcpip_thread when the sink thread is done with ss->writing */
+static void
+httpc_stream_written(void *arg)
+{
+  httpc_streamstate_t *ss = (httpc_streamstate_t *)arg;
+  u32_t len = ss->writing->tot_len;
+
+  pbuf_free(ss->writing);
+  ss->writing = NULL;
+  if (ss->err != ERR_OK) {
+    if (ss->req != NULL) {
+      /* calls httpc_stream_result(), which finishes the download */
+      httpc_close(ss->req, HTTPC_RESULT_LOCAL_ABORT, ss->req->rx_status, ss->err);
+    } else {
+      httpc_stream_finish(ss);
+    }
+    return;
+  }
+  ss->written += len;
+  if ((ss->req != NULL) && (ss->req->pcb != NULL)) {
+    /* a slow sink keeps the window shut, this is not a stalled transfer */
+    ss->req->timeout_ticks = HTTPC_POLL_TIMEOUT;
+    while (len > 0xFFFF) {
+      altcp_recved(ss->req->pcb, 0xFFFF);
+      len -= 0xFFFF;
+    }
+    altcp_recved(ss->req->pcb, (u16_t)len);
+  }
+  httpc_stream_kick(ss);
+  if ((ss->req == NULL) && (ss->writing == NULL)) {
+    httpc_stream_finish(ss);
+  }
+}
+
+static void
+httpc_stream_thread(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  for (;;) {
+    void *msg;
+    httpc_streamstate_t *ss;
+
+    sys_mbox_fetch(&httpc_stream_mbox, &msg);
+    ss = (httpc_streamstate_t *)msg;
+    ss->err = ss->sink(ss->callback_arg, ss->offset + ss->written, ss->writing);
+    while (tcpip_callback(httpc_stream_written, ss) != ERR_OK) {
+      sys_msleep(1);
+    }
+  }
+}
+
+/** Parse the first byte position of "Content-Range: bytes first-last/length" */
+static err_t
+httpc_stream_parse_range(struct pbuf *hdr, u16_t hdr_len, u32_t *first)
+{
+  u16_t off = pbuf_memfind(hdr, "Content-Range: bytes ", 21, 0);
+  u32_t val = 0;
+  u16_t digits = 0;
+
+  if ((off == 0xFFFF) || (off >= hdr_len)) {
+    return ERR_VAL;
+  }
+  for (off += 21; off < hdr_len; off++, digits++) {
+    u8_t c = pbuf_get_at(hdr, off);
+    if ((c < '0') || (c > '9')) {
+      break;
+    }
+    if (val > (0xFFFFFFFFUL - 9) / 10) {
+      return ERR_VAL;
+    }
+    val = val * 10 + (u32_t)(c - '0');
+  }
+  if ((digits == 0) || (off >= hdr_len) || (pbuf_get_at(hdr, off) != '-')) {
+    return ERR_VAL;
+  }
+  *first = val;
+  return ERR_OK;
+}
+
+/** Headers received: find where in the file the body starts */
+static err_t
+httpc_stream_headers_done(httpc_state_t *connection, void *arg, struct pbuf *hdr, u16_t hdr_len, u32_t content_len)
+{
+  httpc_streamstate_t *ss = (httpc_streamstate_t *)arg;
+
+  if (ss->client_settings->headers_done_fn != NULL) {
+    err_t err = ss->client_settings->headers_done_fn(connection, ss->callback_arg, hdr, hdr_len, content_len);
+    if (err != ERR_OK) {
+      return err;
+    }
+  }
+  if (connection->rx_status == 200) {
+    /* the whole file, the server may have ignored the Range header */
+    ss->offset = 0;
+  } else if (connection->rx_status == 206) {
+    if (httpc_stream_parse_range(hdr, hdr_len, &ss->offset) != ERR_OK) {
+      LWIP_DEBUGF(HTTPC_DEBUG_WARN_STATE, ("httpc_stream_headers_done: invalid Content-Range\n"));
+      ss->svr_err = 1;
+      return ERR_VAL;
+    }
+  } else {
+    /* don't pass an error page to the sink */
+    ss->svr_err = 1;
+    return ERR_VAL;
+  }
+  return ERR_OK;
+}
+
+/** Connection closed (success or error): finish once the sink is done */
+static void
+httpc_stream_result(void *arg, httpc_result_t httpc_result, u32_t rx_content_len,
+                    u32_t srv_res, err_t err)
+{
+  httpc_streamstate_t *ss = (httpc_streamstate_t *)arg;
+  LWIP_UNUSED_ARG(rx_content_len);
+
+  ss->req = NULL;
+  ss->result = httpc_result;
+  ss->srv_res = srv_res;
+  ss->result_err = err;
+  if (ss->err == ERR_OK) {
+    /* data received before the connection closed is still written */
+    httpc_stream_kick(ss);
+  }
+  if (ss->writing == NULL) {
+    httpc_stream_finish(ss);
+  }
+}
+
+/** tcp recv callback: queue body data for the sink, it stays unrecved */
+static err_t
+httpc_stream_tcp_recv(void *arg, struct altcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  httpc_streamstate_t *ss = (httpc_streamstate_t *)arg;
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(err);
+
+  LWIP_ASSERT("p != NULL", p != NULL);
+
+  if ((p->tot_len == 0) || (ss->err != ERR_OK)) {
+    /* nothing to write, or the download is being aborted */
+    altcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+  }
+  if (ss->queued == NULL) {
+    ss->queued = p;
+  } else {
+    pbuf_cat(ss->queued, p);
+  }
+  httpc_stream_kick(ss);
+  return ERR_OK;
+}
+
+/** Initialize http client state for a streamed download */
+static err_t
+httpc_stream_init(httpc_streamstate_t **streamstate_out, httpc_sink_fn sink,
+                  const httpc_connection_t *settings, void* callback_arg)
+{
+  httpc_streamstate_t *ss;
+
+  if (httpc_stream_count >= HTTPC_STREAM_MBOX_SIZE) {
+    return ERR_MEM;
+  }
+  if (!httpc_stream_thread_running) {
+    if (sys_mbox_new(&httpc_stream_mbox, HTTPC_STREAM_MBOX_SIZE) != ERR_OK) {
+      return ERR_MEM;
+    }
+    sys_thread_new("httpc_stream", httpc_stream_thread, NULL,
+                   HTTPC_STREAM_THREAD_STACKSIZE, HTTPC_STREAM_THREAD_PRIO);
+    httpc_stream_thread_running = 1;
+  }
+
+  ss = (httpc_streamstate_t *)mem_malloc(sizeof(httpc_streamstate_t));
+  if (ss == NULL) {
+    return ERR_MEM;
+  }
+  memset(ss, 0, sizeof(httpc_streamstate_t));
+  ss->sink = sink;
+  ss->client_settings = settings;
+  ss->callback_arg = callback_arg;
+  /* copy client settings but override the callbacks */
+  memcpy(&ss->settings, settings, sizeof(httpc_connection_t));
+  ss->settings.result_fn = httpc_stream_result;
+  ss->settings.headers_done_fn = httpc_stream_headers_done;
+  httpc_stream_count++;
+  *streamstate_out = ss;
+  return ERR_OK;
+}
+
+/** Free the stream state of a download that could not be started */
+static void
+httpc_stream_free(httpc_streamstate_t *ss)
+{
+  mem_free(ss);
+  httpc_stream_count--;
+}
+
+/**
+ * @ingroup httpc
+ * HTTP client API: get a file by passing server IP address, streaming the body
+ * to 'sink', which runs on the sink thread. Body data is acknowledged to the
+ * server (the TCP window opens) once the sink returns, so receiving and writing
+ * overlap, bounded by the TCP window. Set settings->range_start to resume an
+ * interrupted download.
+ * The result callback is called once the sink is done with all received data;
+ * its rx_content_len is the number of bytes the sink has accepted. Only 200
+ * and 206 responses are passed to the sink, others end with
+ * HTTPC_RESULT_ERR_SVR_RESP.
+ *
+ * @param server_addr IP address of the server to connect
+ * @param port tcp port of the server
+ * @param uri uri to get from the server, remember leading "/"!
+ * @param settings connection settings (callbacks, proxy, etc.)
+ * @param sink the http body (not the headers) is passed to this function
+ * @param callback_arg argument passed to all the callbacks
+ * @param connection retreives the connection handle (to match in callbacks)
+ * @return ERR_OK if starting the request succeeds (callback_fn will be called later)
+ *         or an error code (ERR_MEM if HTTPC_STREAM_MBOX_SIZE downloads are
+ *         in progress)
+ */
+err_t
+httpc_get_file_stream(const ip_addr_t* server_addr, u16_t port, const char* uri, const httpc_connection_t *settings,
+                      httpc_sink_fn sink, void* callback_arg, httpc_state_t **connection)
+{
+  err_t err;
+  httpc_state_t* req;
+  httpc_streamstate_t *ss;
+
+  LWIP_ERROR("invalid parameters", (server_addr != NULL) && (uri != NULL) && (sink != NULL), return ERR_ARG;);
+
+  err = httpc_stream_init(&ss, sink, settings, callback_arg);
+  if (err != ERR_OK) {
+    return err;
+  }
+
+  err = httpc_init_connection_addr(&req, &ss->settings, server_addr, port,
+    uri, httpc_stream_tcp_recv, ss);
+  if (err != ERR_OK) {
+    httpc_stream_free(ss);
+    return err;
+  }
+  ss->req = req;
+
+  if (settings->use_proxy) {
+    err = httpc_get_internal_addr(req, &settings->proxy_addr);
+  } else {
+    err = httpc_get_internal_addr(req, server_addr);
+  }
+  if(err != ERR_OK) {
+    httpc_stream_free(ss);
+    httpc_free_state(req);
+    return err;
+  }
+
+  if (connection != NULL) {
+    *connection = req;
+  }
+  return ERR_OK;
+}
+
+/**
+ * @ingroup httpc
+ * HTTP client API: get a file by passing server name as string (DNS name or IP
+ * address string), streaming the body to 'sink'. See httpc_get_file_stream().
+ *
+ * @param server_name server name as string (DNS name or IP address string)
+ * @param port tcp port of the server
+ * @param uri uri to get from the server, remember leading "/"!
+ * @param settings connection settings (callbacks, proxy, etc.)
+ * @param sink the http body (not the headers) is passed to this function
+ * @param callback_arg argument passed to all the callbacks
+ * @param connection retreives the connection handle (to match in callbacks)
+ * @return ERR_OK if starting the request succeeds (callback_fn will be called later)
+ *         or an error code
+ */
+err_t
+httpc_get_file_dns_stream(const char* server_name, u16_t port, const char* uri, const httpc_connection_t *settings,
+                          httpc_sink_fn sink, void* callback_arg, httpc_state_t **connection)
+{
+  err_t err;
+  httpc_state_t* req;
+  httpc_streamstate_t *ss;
+
+  LWIP_ERROR("invalid parameters", (server_name != NULL) && (uri != NULL) && (sink != NULL), return ERR_ARG;);
+
+  err = httpc_stream_init(&ss, sink, settings, callback_arg);
+  if (err != ERR_OK) {
+    return err;
+  }
+
+  err = httpc_init_connection(&req, &ss->settings, server_name, port,
+    uri, httpc_stream_tcp_recv, ss);
+  if (err != ERR_OK) {
+    httpc_stream_free(ss);
+    return err;
+  }
+  ss->req = req;
+
+  if (settings->use_proxy) {
+    err = httpc_get_internal_addr(req, &settings->proxy_addr);
+  } else {
+    err = httpc_get_internal_dns(req, server_name);
+  }
+  if(err != ERR_OK) {
+    httpc_stream_free(ss);
+    httpc_free_state(req);
+    return err;
+  }
+
+  if (connection != NULL) {
+    *connection = req;
+  }
+  return ERR_OK;
+}
+#endif /* LWIP_HTTPC_STREAM */
+
 #if LWIP_HTTPC_HAVE_FILE_IO
 /* Implementation to disk via fopen/fwrite/fclose follows */
 
@@ -104,9 +104,12 @@
 #ifdef LWIP_HOOK_FILENAME
 #include LWIP_HOOK_FILENAME
 #endif
-#if LWIP_HTTPD_TIMING
+#if LWIP_HTTPD_TIMING || LWIP_HTTPD_POST_STREAM
 #include "lwip/sys.h"
-#endif /* LWIP_HTTPD_TIMING */
+#endif /* LWIP_HTTPD_TIMING || LWIP_HTTPD_POST_STREAM */
+#if LWIP_HTTPD_POST_STREAM
+#include "lwip/tcpip.h"
+#endif /* LWIP_HTTPD_POST_STREAM */
 
 #include <string.h> /* memset */
 #include <stdlib.h> /* atoi */
@@ -123,6 +126,18 @@
 #define HTTP11_CONNECTIONKEEPALIVE2 "Connection: Keep-Alive"
 #endif
 
+#if LWIP_HTTPD_PIPELINING && !(LWIP_HTTPD_SUPPORT_11_KEEPALIVE && LWIP_HTTPD_SUPPORT_REQUESTLIST)
+#error "LWIP_HTTPD_PIPELINING needs LWIP_HTTPD_SUPPORT_11_KEEPALIVE and LWIP_HTTPD_SUPPORT_REQUESTLIST"
+#endif
+#if LWIP_HTTPD_POST_STREAM && !(LWIP_HTTPD_SUPPORT_POST && LWIP_HTTPD_POST_MANUAL_WND && !NO_SYS)
+#error "LWIP_HTTPD_POST_STREAM needs LWIP_HTTPD_SUPPORT_POST, LWIP_HTTPD_POST_MANUAL_WND and NO_SYS==0"
+#endif
+
+/** Limit the number of idle persistent connections? */
+#define HTTPD_LIMIT_IDLE_KEEPALIVE (LWIP_HTTPD_SUPPORT_11_KEEPALIVE && (LWIP_HTTPD_MAX_IDLE_KEEPALIVE > 0))
+/** Keep all connections on a list (most recently used first)? */
+#define HTTPD_USE_CONNECTION_LIST  (LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED || HTTPD_LIMIT_IDLE_KEEPALIVE)
+
 #if LWIP_HTTPD_DYNAMIC_FILE_READ
 #define HTTP_IS_DYNAMIC_FILE(hs) ((hs)->buf != NULL)
 #else
@@ -229,6 +244,10 @@ struct http_ssi_state {
   char tag_name[LWIP_HTTPD_MAX_TAG_NAME_LEN + 1]; /* Last tag name extracted */
   char tag_insert[LWIP_HTTPD_MAX_TAG_INSERT_LEN + 1]; /* Insert string for tag_name */
   enum tag_check_state tag_state; /* State of the tag processor */
+#if LWIP_HTTPD_SSI_ASYNC
+  u8_t tag_pending; /* The handler returned HTTPD_SSI_TAG_PENDING */
+  struct http_state *pending_next; /* Next connection on http_ssi_pending */
+#endif /* LWIP_HTTPD_SSI_ASYNC */
 };
 
 struct http_ssi_tag_description {
@@ -239,9 +258,9 @@ struct http_ssi_tag_description {
 #endif /* LWIP_HTTPD_SSI */
 
 struct http_state {
-#if LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED
+#if HTTPD_USE_CONNECTION_LIST
   struct http_state *next;
-#endif /* LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED */
+#endif /* HTTPD_USE_CONNECTION_LIST */
   struct fs_file file_handle;
   struct fs_file *handle;
   const char *file;       /* Pointer to first unsent byte in buf. */
@@ -250,6 +269,15 @@ struct http_state {
 #if LWIP_HTTPD_SUPPORT_REQUESTLIST
   struct pbuf *req;
 #endif /* LWIP_HTTPD_SUPPORT_REQUESTLIST */
+#if LWIP_HTTPD_WEBSOCKET
+  struct http_state *ws_next; /* Next connection on http_ws_conns */
+  struct pbuf *ws_rx;       /* Received data of an incomplete frame */
+  u8_t websocket;           /* Upgraded to a WebSocket */
+#endif /* LWIP_HTTPD_WEBSOCKET */
+#if LWIP_HTTPD_PIPELINING
+  struct pbuf *pipe;        /* Requests received after the current one. */
+  u8_t *pipe_closed;        /* Set to 1 when hs is freed while parsing 'pipe'. */
+#endif /* LWIP_HTTPD_PIPELINING */
 
 #if LWIP_HTTPD_DYNAMIC_FILE_READ
   char *buf;        /* File read buffer. */
@@ -260,6 +288,9 @@ struct http_state {
 #if LWIP_HTTPD_SUPPORT_11_KEEPALIVE
   u8_t keepalive;
 #endif /* LWIP_HTTPD_SUPPORT_11_KEEPALIVE */
+#if LWIP_HTTPD_ACCEPT_ENCODING
+  u8_t accept_enc;  /* FS_FILE_FLAGS_ENC_* accepted by the client */
+#endif /* LWIP_HTTPD_ACCEPT_ENCODING */
 #if LWIP_HTTPD_SSI
   struct http_ssi_state *ssi;
 #endif /* LWIP_HTTPD_SSI */
@@ -284,9 +315,25 @@ struct http_state {
   u8_t no_auto_wnd;
   u8_t post_finished;
 #endif /* LWIP_HTTPD_POST_MANUAL_WND */
+#if LWIP_HTTPD_POST_STREAM
+  struct http_post_stream *post_stream;
+#endif /* LWIP_HTTPD_POST_STREAM */
 #endif /* LWIP_HTTPD_SUPPORT_POST*/
 };
 
+#if LWIP_HTTPD_POST_STREAM
+/** A POST body being streamed to a sink. It outlives its connection while the
+ * sink thread still has data of it. */
+struct http_post_stream {
+  struct http_state *hs;  /* NULL once the connection is gone */
+  httpd_post_sink_fn sink;
+  void *sink_arg;
+  struct pbuf *queued;    /* received, not yet passed to the sink */
+  struct pbuf *writing;   /* with the sink thread */
+  err_t err;              /* first error returned by the sink */
+};
+#endif /* LWIP_HTTPD_POST_STREAM */
+
 #if HTTPD_USE_MEM_POOL
 LWIP_MEMPOOL_DECLARE(HTTPD_STATE,     MEMP_NUM_PARALLEL_HTTPD_CONNS,     sizeof(struct http_state),     "HTTPD_STATE")
 #if LWIP_HTTPD_SSI
@@ -311,9 +358,26 @@ static err_t http_find_file(struct http_state *hs, const char *uri, int is_09);
 static err_t http_init_file(struct http_state *hs, struct fs_file *file, int is_09, const char *uri, u8_t tag_check, char *params);
 static err_t http_poll(void *arg, struct altcp_pcb *pcb);
 static u8_t http_check_eof(struct altcp_pcb *pcb, struct http_state *hs);
+#if LWIP_HTTPD_POST_STREAM
+static void http_post_stream_rx(struct http_state *hs, struct pbuf *p);
+static void http_post_stream_detach(struct http_state *hs);
+/* Body data waiting for the POST sink thread */
+static sys_mbox_t http_post_sink_mbox;
+#endif /* LWIP_HTTPD_POST_STREAM */
 #if LWIP_HTTPD_FS_ASYNC_READ
 static void http_continue(void *connection);
 #endif /* LWIP_HTTPD_FS_ASYNC_READ */
+#if LWIP_HTTPD_PIPELINING
+static void http_recv_pipelined(struct altcp_pcb *pcb, struct http_state *hs);
+#endif /* LWIP_HTTPD_PIPELINING */
+#if LWIP_HTTPD_WEBSOCKET
+static void http_ws_closed(struct http_state *hs);
+
+/* WebSocket handlers and the list of WebSocket connections */
+static tWsConnectHandler httpd_ws_connect_handler;
+static tWsRecvHandler httpd_ws_recv_handler;
+static struct http_state *http_ws_conns;
+#endif /* LWIP_HTTPD_WEBSOCKET */
 
 #if LWIP_HTTPD_SSI
 /* SSI insert handler function pointer. */
@@ -322,6 +386,10 @@ static tSSIHandler httpd_ssi_handler;
 static int httpd_num_tags;
 static const char **httpd_tags;
 #endif /* !LWIP_HTTPD_SSI_RAW */
+#if LWIP_HTTPD_SSI_ASYNC
+/* Connections waiting for httpd_ssi_continue() */
+static struct http_state *http_ssi_pending;
+#endif /* LWIP_HTTPD_SSI_ASYNC */
 
 /* Define the available tag lead-ins and corresponding lead-outs.
  * ATTENTION: for the algorithm below using this array, it is essential
@@ -345,9 +413,9 @@ static char *http_cgi_params[LWIP_HTTPD_MAX_CGI_PARAMETERS]; /* Params extracted
 static char *http_cgi_param_vals[LWIP_HTTPD_MAX_CGI_PARAMETERS]; /* Values for each extracted param */
 #endif /* LWIP_HTTPD_CGI */
 
-#if LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED
+#if HTTPD_USE_CONNECTION_LIST
 /** global list of active HTTP connections, use to kill the oldest when
-    running out of memory */
+    running out of memory or when too many persistent connections are idle */
 static struct http_state *http_connections;
 
 static void
@@ -376,12 +444,90 @@ http_remove_connection(struct http_state *hs)
     }
   }
 }
+#else /* HTTPD_USE_CONNECTION_LIST */
+
+#define http_add_connection(hs)
+#define http_remove_connection(hs)
+
+#endif /* HTTPD_USE_CONNECTION_LIST */
+
+#if HTTPD_LIMIT_IDLE_KEEPALIVE || (LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED && LWIP_HTTPD_SUPPORT_11_KEEPALIVE)
+/** A persistent connection waiting for its next request */
+static u8_t
+http_is_idle(struct http_state *hs)
+{
+  if (!hs->keepalive || (hs->handle != NULL)) {
+    return 0;
+  }
+#if LWIP_HTTPD_SUPPORT_REQUESTLIST
+  if (hs->req != NULL) {
+    return 0;
+  }
+#endif /* LWIP_HTTPD_SUPPORT_REQUESTLIST */
+#if LWIP_HTTPD_PIPELINING
+  if (hs->pipe != NULL) {
+    return 0;
+  }
+#endif /* LWIP_HTTPD_PIPELINING */
+  return 1;
+}
+
+/** Find the least recently used idle persistent connection */
+static struct http_state *
+http_find_oldest_idle(void)
+{
+  struct http_state *hs;
+  struct http_state *oldest = NULL;
+  for (hs = http_connections; hs != NULL; hs = hs->next) {
+    if (http_is_idle(hs)) {
+      oldest = hs;
+    }
+  }
+  return oldest;
+}
+#endif /* HTTPD_LIMIT_IDLE_KEEPALIVE || (LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED && LWIP_HTTPD_SUPPORT_11_KEEPALIVE) */
 
+#if HTTPD_LIMIT_IDLE_KEEPALIVE
+/** Close the least recently used idle persistent connections until no more
+ * than LWIP_HTTPD_MAX_IDLE_KEEPALIVE are left. */
+static void
+http_limit_idle_connections(void)
+{
+  struct http_state *hs;
+  u16_t idle = 0;
+  for (hs = http_connections; hs != NULL; hs = hs->next) {
+    if (http_is_idle(hs)) {
+      idle++;
+    }
+  }
+  while (idle > LWIP_HTTPD_MAX_IDLE_KEEPALIVE) {
+    hs = http_find_oldest_idle();
+    LWIP_ASSERT("idle connection not found", hs != NULL);
+    LWIP_DEBUGF(HTTPD_DEBUG, ("Closing idle connection %p\n", (void *)hs->pcb));
+    http_close_conn(hs->pcb, hs); /* this also unlinks the http_state from the list */
+    idle--;
+  }
+}
+#endif /* HTTPD_LIMIT_IDLE_KEEPALIVE */
+
+#if LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED
 static void
 http_kill_oldest_connection(u8_t ssi_required)
 {
   struct http_state *hs = http_connections;
   struct http_state *hs_free_next = NULL;
+#if LWIP_HTTPD_SUPPORT_11_KEEPALIVE
+  if (!ssi_required) {
+    /* idle persistent connections are the cheapest to lose */
+    hs = http_find_oldest_idle();
+    if (hs != NULL) {
+      /* send RST when killing a connection because of memory shortage */
+      http_close_or_abort_conn(hs->pcb, hs, 1);
+      return;
+    }
+    hs = http_connections;
+  }
+#endif /* LWIP_HTTPD_SUPPORT_11_KEEPALIVE */
   while (hs && hs->next) {
 #if LWIP_HTTPD_SSI
     if (ssi_required) {
@@ -405,11 +551,6 @@ http_kill_oldest_connection(u8_t ssi_required)
     http_close_or_abort_conn(hs_free_next->next->pcb, hs_free_next->next, 1); /* this also unlinks the http_state from the list */
   }
 }
-#else /* LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED */
-
-#define http_add_connection(hs)
-#define http_remove_connection(hs)
-
 #endif /* LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED */
 
 #if LWIP_HTTPD_SSI
@@ -438,6 +579,23 @@ http_ssi_state_free(struct http_ssi_state *ssi)
     HTTP_FREE_SSI_STATE(ssi);
   }
 }
+
+#if LWIP_HTTPD_SSI_ASYNC
+/** Take a connection off the list of connections waiting for an SSI insert */
+static void
+http_ssi_unlink_pending(struct http_state *hs)
+{
+  struct http_state **pp;
+  for (pp = &http_ssi_pending; *pp != NULL; pp = &(*pp)->ssi->pending_next) {
+    if (*pp == hs) {
+      *pp = hs->ssi->pending_next;
+      break;
+    }
+  }
+  hs->ssi->pending_next = NULL;
+  hs->ssi->tag_pending = 0;
+}
+#endif /* LWIP_HTTPD_SSI_ASYNC */
 #endif /* LWIP_HTTPD_SSI */
 
 /** Initialize a struct http_state.
@@ -495,6 +653,11 @@ http_state_eof(struct http_state *hs)
 #endif /* LWIP_HTTPD_DYNAMIC_FILE_READ */
 #if LWIP_HTTPD_SSI
   if (hs->ssi) {
+#if LWIP_HTTPD_SSI_ASYNC
+    if (hs->ssi->tag_pending) {
+      http_ssi_unlink_pending(hs);
+    }
+#endif /* LWIP_HTTPD_SSI_ASYNC */
     http_ssi_state_free(hs->ssi);
     hs->ssi = NULL;
   }
@@ -514,7 +677,23 @@ static void
 http_state_free(struct http_state *hs)
 {
   if (hs != NULL) {
+#if LWIP_HTTPD_WEBSOCKET
+    if (hs->websocket) {
+      http_ws_closed(hs);
+    }
+#endif /* LWIP_HTTPD_WEBSOCKET */
     http_state_eof(hs);
+#if LWIP_HTTPD_POST_STREAM
+    http_post_stream_detach(hs);
+#endif /* LWIP_HTTPD_POST_STREAM */
+#if LWIP_HTTPD_PIPELINING
+    if (hs->pipe != NULL) {
+      pbuf_free(hs->pipe);
+    }
+    if (hs->pipe_closed != NULL) {
+      *hs->pipe_closed = 1;
+    }
+#endif /* LWIP_HTTPD_PIPELINING */
     http_remove_connection(hs);
     HTTP_FREE_HTTP_STATE(hs);
   }
@@ -657,6 +836,10 @@ http_eof(struct altcp_pcb *pcb, struct http_state *hs)
   /* HTTP/1.1 persistent connection? (Not supported for SSI) */
 #if LWIP_HTTPD_SUPPORT_11_KEEPALIVE
   if (hs->keepalive) {
+#if LWIP_HTTPD_PIPELINING
+    struct pbuf *pipe = hs->pipe;
+    u8_t *pipe_closed = hs->pipe_closed;
+#endif /* LWIP_HTTPD_PIPELINING */
     http_remove_connection(hs);
 
     http_state_eof(hs);
@@ -664,9 +847,24 @@ http_eof(struct altcp_pcb *pcb, struct http_state *hs)
     /* restore state: */
     hs->pcb = pcb;
     hs->keepalive = 1;
+#if LWIP_HTTPD_PIPELINING
+    hs->pipe = pipe;
+    hs->pipe_closed = pipe_closed;
+#endif /* LWIP_HTTPD_PIPELINING */
+    /* move to the front of the list: this is the most recently used one */
     http_add_connection(hs);
     /* ensure nagle doesn't interfere with sending all data as fast as possible: */
     altcp_nagle_disable(pcb);
+#if LWIP_HTTPD_PIPELINING
+    if ((pipe != NULL) && (pipe_closed == NULL)) {
+      /* the next request has already been received */
+      http_recv_pipelined(pcb, hs);
+      return;
+    }
+#endif /* LWIP_HTTPD_PIPELINING */
+#if HTTPD_LIMIT_IDLE_KEEPALIVE
+    http_limit_idle_connections();
+#endif /* HTTPD_LIMIT_IDLE_KEEPALIVE */
   } else
 #endif /* LWIP_HTTPD_SUPPORT_11_KEEPALIVE */
   {
@@ -802,7 +1000,23 @@ get_tag_insert(struct http_state *hs)
 #if LWIP_HTTPD_FILE_STATE
                                               , (hs->handle ? hs->handle->state : NULL)
 #endif /* LWIP_HTTPD_FILE_STATE */
+#if LWIP_HTTPD_SSI_ASYNC
+                                              , hs
+#endif /* LWIP_HTTPD_SSI_ASYNC */
                                              );
+#if LWIP_HTTPD_SSI_ASYNC
+        if (ssi->tag_insert_len == HTTPD_SSI_TAG_PENDING) {
+          /* stop sending until httpd_ssi_continue() asks for this part again */
+#if LWIP_HTTPD_SSI_MULTIPART
+          ssi->tag_part = current_tag_part;
+#endif /* LWIP_HTTPD_SSI_MULTIPART */
+          ssi->tag_insert_len = 0;
+          ssi->tag_pending = 1;
+          ssi->pending_next = http_ssi_pending;
+          http_ssi_pending = hs;
+          return;
+        }
+#endif /* LWIP_HTTPD_SSI_ASYNC */
 #if LWIP_HTTPD_SSI_RAW
         if (ssi->tag_insert_len != HTTPD_SSI_TAG_UNKNOWN)
 #endif /* LWIP_HTTPD_SSI_RAW */
@@ -1114,6 +1328,24 @@ http_check_eof(struct altcp_pcb *pcb, struct http_state *hs)
     return 0;
   }
 #if LWIP_HTTPD_DYNAMIC_FILE_READ
+#if LWIP_HTTPD_FS_SENDFILE
+  /* Send from the file image if the file system can map it: hs->buf stays
+     NULL, so HTTP_IS_DATA_VOLATILE() lets altcp_write reference the data */
+  if ((hs->buf == NULL)
+#if LWIP_HTTPD_SSI
+      && (hs->ssi == NULL)
+#endif /* LWIP_HTTPD_SSI */
+     ) {
+    const char *data;
+    count = fs_map(hs->handle, &data, bytes_left);
+    if (count > 0) {
+      LWIP_DEBUGF(HTTPD_DEBUG, ("Mapped %d bytes.\n", count));
+      hs->left = (u32_t)count;
+      hs->file = data;
+      return 1;
+    }
+  }
+#endif /* LWIP_HTTPD_FS_SENDFILE */
   /* Do we already have a send buffer allocated? */
   if (hs->buf) {
     /* Yes - get the length of the buffer */
@@ -1470,6 +1702,12 @@ http_send_data_ssi(struct altcp_pcb *pcb, struct http_state *hs)
             hs->left -= len;
           }
         } else {
+#if LWIP_HTTPD_SSI_ASYNC
+          if (ssi->tag_pending) {
+            /* the insert is not ready yet */
+            return data_to_send;
+          }
+#endif /* LWIP_HTTPD_SSI_ASYNC */
 #if LWIP_HTTPD_SSI_MULTIPART
           if (ssi->tag_index >= ssi->tag_insert_len) {
             /* Did the last SSIHandler have more to send? */
@@ -1547,6 +1785,28 @@ http_send_data_ssi(struct altcp_pcb *pcb, struct http_state *hs)
   }
   return data_to_send;
 }
+
+/** Check if the insert string of the current tag has not been sent completely
+ * (so the connection must not be closed even if the file has been sent) */
+static u8_t
+http_ssi_tag_busy(struct http_state *hs)
+{
+  struct http_ssi_state *ssi = hs->ssi;
+  if ((ssi == NULL) || (ssi->tag_state != TAG_SENDING)) {
+    return 0;
+  }
+#if LWIP_HTTPD_SSI_ASYNC
+  if (ssi->tag_pending) {
+    return 1;
+  }
+#endif /* LWIP_HTTPD_SSI_ASYNC */
+#if LWIP_HTTPD_SSI_MULTIPART
+  if (ssi->tag_part != HTTPD_LAST_TAG_PART) {
+    return 1;
+  }
+#endif /* LWIP_HTTPD_SSI_MULTIPART */
+  return ssi->tag_index < ssi->tag_insert_len;
+}
 #endif /* LWIP_HTTPD_SSI */
 
 /**
@@ -1596,7 +1856,11 @@ http_send(struct altcp_pcb *pcb, struct http_state *hs)
 
   /* Have we run out of file data to send? If so, we need to read the next
    * block from the file. */
-  if (hs->left == 0) {
+  if ((hs->left == 0)
+#if LWIP_HTTPD_SSI
+      && !http_ssi_tag_busy(hs)
+#endif /* LWIP_HTTPD_SSI */
+     ) {
     if (!http_check_eof(pcb, hs)) {
       return 0;
     }
@@ -1611,7 +1875,11 @@ http_send(struct altcp_pcb *pcb, struct http_state *hs)
     data_to_send = http_send_data_nonssi(pcb, hs);
   }
 
-  if ((hs->left == 0) && (fs_bytes_left(hs->handle) <= 0)) {
+  if ((hs->left == 0) && (fs_bytes_left(hs->handle) <= 0)
+#if LWIP_HTTPD_SSI
+      && !http_ssi_tag_busy(hs)
+#endif /* LWIP_HTTPD_SSI */
+     ) {
     /* We reached the end of the file so this request is done.
      * This adds the FIN flag right into the last data segment. */
     LWIP_DEBUGF(HTTPD_DEBUG, ("End of file.\n"));
@@ -1709,6 +1977,9 @@ http_handle_post_finished(struct http_state *hs)
   }
   hs->post_finished = 1;
 #endif /* LWIP_HTTPD_POST_MANUAL_WND */
+#if LWIP_HTTPD_POST_STREAM
+  http_post_stream_detach(hs);
+#endif /* LWIP_HTTPD_POST_STREAM */
   /* application error or POST finished */
   /* NULL-terminate the buffer */
   http_uri_buf[0] = 0;
@@ -1743,7 +2014,15 @@ http_post_rxpbuf(struct http_state *hs, struct pbuf *p)
   hs->unrecved_bytes++;
 #endif
   if (p != NULL) {
-    err = httpd_post_receive_data(hs, p);
+#if LWIP_HTTPD_POST_STREAM
+    if (hs->post_stream != NULL) {
+      http_post_stream_rx(hs, p);
+      err = ERR_OK;
+    } else
+#endif /* LWIP_HTTPD_POST_STREAM */
+    {
+      err = httpd_post_receive_data(hs, p);
+    }
   } else {
     err = ERR_OK;
   }
@@ -1822,6 +2101,12 @@ http_post_request(struct pbuf *inp, struct http_state *hs,
             /* try to pass in data of the first pbuf(s) */
             struct pbuf *q = inp;
             u16_t start_offset = hdr_len;
+#if LWIP_HTTPD_POST_STREAM
+            if (hs->post_stream != NULL) {
+              /* the window opens as the sink consumes the body */
+              post_auto_wnd = 0;
+            }
+#endif /* LWIP_HTTPD_POST_STREAM */
 #if LWIP_HTTPD_POST_MANUAL_WND
             hs->no_auto_wnd = !post_auto_wnd;
 #endif /* LWIP_HTTPD_POST_MANUAL_WND */
@@ -1851,6 +2136,9 @@ http_post_request(struct pbuf *inp, struct http_state *hs,
               return ERR_OK;
             }
           } else {
+#if LWIP_HTTPD_POST_STREAM
+            http_post_stream_detach(hs);
+#endif /* LWIP_HTTPD_POST_STREAM */
             /* return file passed from application */
             return http_find_file(hs, http_uri_buf, 0);
           }
@@ -1914,6 +2202,160 @@ void httpd_post_data_recved(void *connection, u16_t recved_len)
 }
 #endif /* LWIP_HTTPD_POST_MANUAL_WND */
 
+#if LWIP_HTTPD_POST_STREAM
+/** Pass what has been queued to the sink thread unless it still has data of
+ * this stream. If its mbox is full, http_poll() tries again. */
+static void
+http_post_stream_kick(struct http_post_stream *ps)
+{
+  if ((ps->writing == NULL) && (ps->queued != NULL)) {
+    ps->writing = ps->queued;
+    ps->queued = NULL;
+    if (sys_mbox_trypost(&http_post_sink_mbox, ps) != ERR_OK) {
+      LWIP_DEBUGF(HTTPD_DEBUG | LWIP_DBG_LEVEL_WARNING, ("http_post_stream_kick: sink mbox full\n"));
+      ps->queued = ps->writing;
+      ps->writing = NULL;
+    }
+  }
+}
+
+/** Queue received body data of a streamed POST for the sink. The data stays
+ * unrecved until the sink is done with it. */
+static void
+http_post_stream_rx(struct http_state *hs, struct pbuf *p)
+{
+  struct http_post_stream *ps = hs->post_stream;
+
+  if (p->tot_len == 0) {
+    /* nothing to write */
+    pbuf_free(p);
+    return;
+  }
+  if (ps->queued == NULL) {
+    ps->queued = p;
+  } else {
+    pbuf_cat(ps->queued, p);
+  }
+  http_post_stream_kick(ps);
+}
+
+/** Called in tcpip_thread when the sink thread is done with ps->writing */
+static void
+http_post_stream_written(void *arg)
+{
+  struct http_post_stream *ps = (struct http_post_stream *)arg;
+  struct http_state *hs = ps->hs;
+  u32_t len = ps->writing->tot_len;
+
+  pbuf_free(ps->writing);
+  ps->writing = NULL;
+  if (hs == NULL) {
+    /* the connection is gone */
+    if (ps->queued != NULL) {
+      pbuf_free(ps->queued);
+    }
+    mem_free(ps);
+    return;
+  }
+  if (ps->err != ERR_OK) {
+    /* discard the rest of the body, the window has to open for it, too */
+    hs->post_content_len_left = 0;
+    if (ps->queued != NULL) {
+      len += ps->queued->tot_len;
+      pbuf_free(ps->queued);
+      ps->queued = NULL;
+    }
+  } else {
+    http_post_stream_kick(ps);
+  }
+  /* a slow sink keeps the window shut, this is not an idle connection */
+  hs->retries = 0;
+  /* the last call may finish the POST and free both ps and hs */
+  while (len > 0xFFFF) {
+    httpd_post_data_recved(hs, 0xFFFF);
+    len -= 0xFFFF;
+  }
+  httpd_post_data_recved(hs, (u16_t)len);
+}
+
+/** Free the stream of a connection, or leave that to http_post_stream_written()
+ * if the sink thread still has data of it */
+static void
+http_post_stream_detach(struct http_state *hs)
+{
+  struct http_post_stream *ps = hs->post_stream;
+
+  if (ps != NULL) {
+    hs->post_stream = NULL;
+    if (ps->writing != NULL) {
+      ps->hs = NULL;
+    } else {
+      if (ps->queued != NULL) {
+        pbuf_free(ps->queued);
+      }
+      mem_free(ps);
+    }
+  }
+}
+
+static void
+http_post_sink_thread(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  for (;;) {
+    void *msg;
+    struct http_post_stream *ps;
+
+    sys_mbox_fetch(&http_post_sink_mbox, &msg);
+    ps = (struct http_post_stream *)msg;
+    if (ps->err == ERR_OK) {
+      ps->err = ps->sink(ps->sink_arg, ps->writing);
+    }
+    while (tcpip_callback(http_post_stream_written, ps) != ERR_OK) {
+      sys_msleep(1);
+    }
+  }
+}
+
+/**
+ * @ingroup httpd
+ * Stream the body of this POST to 'sink', which runs on the POST sink thread,
+ * instead of passing it to httpd_post_receive_data(). Call this from
+ * httpd_post_begin(). Body data is acknowledged to the TCP peer (the window
+ * opens) once the sink returns, so receiving and writing overlap, bounded by
+ * the TCP window. httpd_post_finished() is called after the sink has consumed
+ * the whole body; if the connection closes early, it may be called while the
+ * sink still runs.
+ *
+ * @param connection the 'connection' argument passed to httpd_post_begin()
+ * @param sink function consuming the body data
+ * @param arg passed to 'sink'
+ * @return ERR_OK, or ERR_MEM if no stream state could be allocated
+ */
+err_t
+httpd_post_stream(void *connection, httpd_post_sink_fn sink, void *arg)
+{
+  struct http_state *hs = (struct http_state *)connection;
+  struct http_post_stream *ps;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("httpd_post_stream: invalid arguments", (hs != NULL) && (sink != NULL), return ERR_ARG;);
+
+  ps = (struct http_post_stream *)mem_malloc(sizeof(struct http_post_stream));
+  if (ps == NULL) {
+    return ERR_MEM;
+  }
+  memset(ps, 0, sizeof(struct http_post_stream));
+  ps->hs = hs;
+  ps->sink = sink;
+  ps->sink_arg = arg;
+  http_post_stream_detach(hs);
+  hs->post_stream = ps;
+  return ERR_OK;
+}
+#endif /* LWIP_HTTPD_POST_STREAM */
+
 #endif /* LWIP_HTTPD_SUPPORT_POST */
 
 #if LWIP_HTTPD_FS_ASYNC_READ
@@ -1937,6 +2379,379 @@ http_continue(void *connection)
 }
 #endif /* LWIP_HTTPD_FS_ASYNC_READ */
 
+#if LWIP_HTTPD_WEBSOCKET
+#define HTTP_WS_UPGRADE   "Upgrade: websocket"
+#define HTTP_WS_KEY       "Sec-WebSocket-Key: "
+#define HTTP_WS_GUID      "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define HTTP_WS_RESPONSE  "HTTP/1.1 101 Switching Protocols" CRLF \
+                          "Upgrade: websocket" CRLF \
+                          "Connection: Upgrade" CRLF \
+                          "Sec-WebSocket-Accept: "
+
+struct http_ws_sha1 {
+  u32_t h[5];
+  u32_t len;
+  u8_t block[64];
+};
+
+#define HTTP_WS_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void
+http_ws_sha1_block(struct http_ws_sha1 *ctx)
+{
+  u32_t w[80];
+  u32_t a, b, c, d, e, f, k, t;
+  int i;
+
+  for (i = 0; i < 16; i++) {
+    w[i] = ((u32_t)ctx->block[4 * i] << 24) | ((u32_t)ctx->block[4 * i + 1] << 16) |
+           ((u32_t)ctx->block[4 * i + 2] << 8) | ctx->block[4 * i + 3];
+  }
+  for (; i < 80; i++) {
+    t = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+    w[i] = HTTP_WS_ROL(t, 1);
+  }
+  a = ctx->h[0];
+  b = ctx->h[1];
+  c = ctx->h[2];
+  d = ctx->h[3];
+  e = ctx->h[4];
+  for (i = 0; i < 80; i++) {
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999UL;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1UL;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDCUL;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6UL;
+    }
+    t = HTTP_WS_ROL(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = HTTP_WS_ROL(b, 30);
+    b = a;
+    a = t;
+  }
+  ctx->h[0] += a;
+  ctx->h[1] += b;
+  ctx->h[2] += c;
+  ctx->h[3] += d;
+  ctx->h[4] += e;
+}
+
+static void
+http_ws_sha1_update(struct http_ws_sha1 *ctx, const char *data, size_t len)
+{
+  while (len--) {
+    ctx->block[ctx->len++ & 63] = (u8_t)*data++;
+    if ((ctx->len & 63) == 0) {
+      http_ws_sha1_block(ctx);
+    }
+  }
+}
+
+static void
+http_ws_sha1_finish(struct http_ws_sha1 *ctx, u8_t digest[20])
+{
+  u32_t bits = ctx->len * 8;
+  int i;
+
+  ctx->block[ctx->len++ & 63] = 0x80;
+  if ((ctx->len & 63) == 0) {
+    http_ws_sha1_block(ctx);
+  }
+  while ((ctx->len & 63) != 56) {
+    ctx->block[ctx->len++ & 63] = 0;
+    if ((ctx->len & 63) == 0) {
+      http_ws_sha1_block(ctx);
+    }
+  }
+  /* the key is short: the upper half of the 64 bit length is always 0 */
+  memset(&ctx->block[56], 0, 4);
+  for (i = 0; i < 4; i++) {
+    ctx->block[60 + i] = (u8_t)(bits >> (24 - 8 * i));
+  }
+  http_ws_sha1_block(ctx);
+  for (i = 0; i < 20; i++) {
+    digest[i] = (u8_t)(ctx->h[i / 4] >> (24 - 8 * (i % 4)));
+  }
+}
+
+/** Calculate the Sec-WebSocket-Accept value for a key (28 chars + NUL) */
+static void
+http_ws_accept_key(const char *key, u16_t key_len, char *accept)
+{
+  static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  struct http_ws_sha1 ctx;
+  u8_t digest[21];
+  int i;
+
+  ctx.h[0] = 0x67452301UL;
+  ctx.h[1] = 0xEFCDAB89UL;
+  ctx.h[2] = 0x98BADCFEUL;
+  ctx.h[3] = 0x10325476UL;
+  ctx.h[4] = 0xC3D2E1F0UL;
+  ctx.len = 0;
+  http_ws_sha1_update(&ctx, key, key_len);
+  http_ws_sha1_update(&ctx, HTTP_WS_GUID, sizeof(HTTP_WS_GUID) - 1);
+  http_ws_sha1_finish(&ctx, digest);
+  digest[20] = 0;
+
+  /* base64: 20 bytes -> 6 full groups + 2 bytes padded with one '=' */
+  for (i = 0; i < 7; i++) {
+    u32_t v = ((u32_t)digest[3 * i] << 16) | ((u32_t)digest[3 * i + 1] << 8) | digest[3 * i + 2];
+    accept[4 * i]     = b64[(v >> 18) & 0x3F];
+    accept[4 * i + 1] = b64[(v >> 12) & 0x3F];
+    accept[4 * i + 2] = b64[(v >> 6) & 0x3F];
+    accept[4 * i + 3] = b64[v & 0x3F];
+  }
+  accept[27] = '=';
+  accept[28] = 0;
+}
+
+/** Write one unmasked frame (does not call altcp_output) */
+static err_t
+http_ws_write(struct http_state *hs, const void *data, u16_t len, u8_t opcode)
+{
+  u8_t hdr[4];
+  u16_t hdr_len = 2;
+  err_t err;
+
+  hdr[0] = (u8_t)(0x80 | opcode); /* FIN */
+  if (len < 126) {
+    hdr[1] = (u8_t)len;
+  } else {
+    hdr[1] = 126;
+    hdr[2] = (u8_t)(len >> 8);
+    hdr[3] = (u8_t)len;
+    hdr_len = 4;
+  }
+  if (altcp_sndbuf(hs->pcb) < hdr_len + len) {
+    return ERR_MEM;
+  }
+  err = altcp_write(hs->pcb, hdr, hdr_len, TCP_WRITE_FLAG_COPY | (len ? TCP_WRITE_FLAG_MORE : 0));
+  if ((err == ERR_OK) && (len != 0)) {
+    err = altcp_write(hs->pcb, data, len, TCP_WRITE_FLAG_COPY);
+    if (err != ERR_OK) {
+      /* half a frame has been queued: the stream cannot be continued */
+      LWIP_DEBUGF(HTTPD_DEBUG, ("http_ws_write: failed to queue frame, close\n"));
+      http_close_or_abort_conn(hs->pcb, hs, 1);
+      return ERR_ABRT;
+    }
+  }
+  return err;
+}
+
+/** Answer a WebSocket upgrade request ('data' holds the header lines) */
+static err_t
+http_ws_upgrade(struct http_state *hs, struct altcp_pcb *pcb, char *data, u16_t data_len, const char *uri)
+{
+  char accept[29];
+  char *key, *key_end;
+  u16_t len;
+
+  key = lwip_strnstr(data, HTTP_WS_KEY, data_len);
+  if (key == NULL) {
+    return http_find_error_file(hs, 400);
+  }
+  key += sizeof(HTTP_WS_KEY) - 1;
+  key_end = lwip_strnstr(key, CRLF, data_len - (key - data));
+  if ((key_end == NULL) || (key_end == key)) {
+    return http_find_error_file(hs, 400);
+  }
+  if (httpd_ws_connect_handler(hs, uri) != ERR_OK) {
+    return http_find_file(hs, uri, 0);
+  }
+  hs->websocket = 1;
+  hs->ws_next = http_ws_conns;
+  http_ws_conns = hs;
+
+  http_ws_accept_key(key, (u16_t)(key_end - key), accept);
+  len = sizeof(HTTP_WS_RESPONSE) - 1;
+  if ((altcp_write(pcb, HTTP_WS_RESPONSE, len, TCP_WRITE_FLAG_MORE) != ERR_OK) ||
+      (altcp_write(pcb, accept, 28, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE) != ERR_OK) ||
+      (altcp_write(pcb, CRLF CRLF, 4, 0) != ERR_OK)) {
+    return ERR_ARG;
+  }
+  altcp_output(pcb);
+  LWIP_DEBUGF(HTTPD_DEBUG, ("WebSocket connection on %s\n", uri));
+  return ERR_OK;
+}
+
+/** Take a connection off the WebSocket list and tell the application */
+static void
+http_ws_closed(struct http_state *hs)
+{
+  struct http_state **pp;
+  for (pp = &http_ws_conns; *pp != NULL; pp = &(*pp)->ws_next) {
+    if (*pp == hs) {
+      *pp = hs->ws_next;
+      break;
+    }
+  }
+  if (hs->ws_rx != NULL) {
+    pbuf_free(hs->ws_rx);
+    hs->ws_rx = NULL;
+  }
+  hs->websocket = 0;
+  httpd_ws_recv_handler(hs, NULL, 0, HTTPD_WS_OPCODE_CLOSE);
+}
+
+/** Received data on a WebSocket: decode all complete frames */
+static void
+http_ws_recv(struct altcp_pcb *pcb, struct http_state *hs, struct pbuf *p)
+{
+  static u8_t http_ws_buf[LWIP_HTTPD_WS_MAX_RX_LEN];
+  u8_t hdr[8];
+  u8_t opcode;
+  u16_t hdr_len, len, i;
+
+  if (hs->ws_rx == NULL) {
+    hs->ws_rx = p;
+  } else {
+    pbuf_cat(hs->ws_rx, p);
+  }
+  while ((hs->ws_rx != NULL) && (hs->ws_rx->tot_len >= 2)) {
+    pbuf_copy_partial(hs->ws_rx, hdr, (u16_t)LWIP_MIN(sizeof(hdr), hs->ws_rx->tot_len), 0);
+    opcode = hdr[0] & 0x0F;
+    len = hdr[1] & 0x7F;
+    hdr_len = 2 + 4; /* client frames are always masked */
+    if (len == 126) {
+      if (hs->ws_rx->tot_len < 4) {
+        return;
+      }
+      len = (u16_t)((hdr[2] << 8) | hdr[3]);
+      hdr_len += 2;
+    }
+    if (((hdr[1] & 0x80) == 0) || ((hdr[1] & 0x7F) == 127) || (len > LWIP_HTTPD_WS_MAX_RX_LEN)) {
+      LWIP_DEBUGF(HTTPD_DEBUG, ("http_ws_recv: invalid or too long frame, close\n"));
+      http_close_conn(pcb, hs);
+      return;
+    }
+    if (hs->ws_rx->tot_len < (u32_t)hdr_len + len) {
+      /* wait for the rest of the frame */
+      return;
+    }
+    pbuf_copy_partial(hs->ws_rx, hdr + 4, 4, (u16_t)(hdr_len - 4));
+    pbuf_copy_partial(hs->ws_rx, http_ws_buf, len, hdr_len);
+    for (i = 0; i < len; i++) {
+      http_ws_buf[i] ^= hdr[4 + (i & 3)];
+    }
+    hs->ws_rx = pbuf_free_header(hs->ws_rx, (u16_t)(hdr_len + len));
+
+    switch (opcode) {
+      case HTTPD_WS_OPCODE_CLOSE:
+        /* echo the status code and close */
+        if (http_ws_write(hs, http_ws_buf, (u16_t)LWIP_MIN(len, 2), HTTPD_WS_OPCODE_CLOSE) != ERR_ABRT) {
+          http_close_conn(pcb, hs);
+        }
+        return;
+      case HTTPD_WS_OPCODE_PING:
+        if (http_ws_write(hs, http_ws_buf, len, HTTPD_WS_OPCODE_PONG) == ERR_ABRT) {
+          return;
+        }
+        altcp_output(pcb);
+        break;
+      case HTTPD_WS_OPCODE_PONG:
+        break;
+      default:
+        if (httpd_ws_recv_handler(hs, http_ws_buf, len, opcode) != ERR_OK) {
+          http_close_conn(pcb, hs);
+          return;
+        }
+        break;
+    }
+  }
+}
+#endif /* LWIP_HTTPD_WEBSOCKET */
+
+#if LWIP_HTTPD_ACCEPT_ENCODING
+/** Reduce the Accept-Encoding header of a request to the FS_FILE_FLAGS_ENC_*
+ * it lists (q-values are not evaluated).
+ *
+ * @param hdrs request headers, starting with the CRLF of the request line
+ * @param hdrs_len length of hdrs
+ */
+static u8_t
+http_get_accept_encoding(const char *hdrs, u16_t hdrs_len)
+{
+  const char *val, *end;
+  u8_t accept = 0;
+
+  val = lwip_strnstr(hdrs, CRLF "Accept-Encoding:", hdrs_len);
+  if (val == NULL) {
+    val = lwip_strnstr(hdrs, CRLF "accept-encoding:", hdrs_len);
+  }
+  if (val == NULL) {
+    return 0;
+  }
+  val += 2 + 16;
+  end = lwip_strnstr(val, CRLF, hdrs_len - (u16_t)(val - hdrs));
+  if (end == NULL) {
+    return 0;
+  }
+  while (val < end) {
+    const char *tok;
+    size_t tok_len;
+    while ((val < end) && ((*val == ' ') || (*val == ','))) {
+      val++;
+    }
+    tok = val;
+    while ((val < end) && (*val != ',') && (*val != ';') && (*val != ' ')) {
+      val++;
+    }
+    tok_len = (size_t)(val - tok);
+    if ((tok_len == 4) && !lwip_strnicmp(tok, "gzip", 4)) {
+      accept |= FS_FILE_FLAGS_ENC_GZIP;
+    } else if ((tok_len == 2) && !lwip_strnicmp(tok, "br", 2)) {
+      accept |= FS_FILE_FLAGS_ENC_BR;
+    } else if ((tok_len == 1) && (*tok == '*')) {
+      accept |= FS_FILE_FLAGS_ENC_MASK;
+    }
+    /* skip parameters */
+    while ((val < end) && (*val != ',')) {
+      val++;
+    }
+  }
+  return accept;
+}
+
+/** fs_open() for the file a request asked for: use an encoded variant if possible */
+#define http_fs_open(hs, name) fs_open_encoded(&(hs)->file_handle, name, (hs)->accept_enc)
+#else /* LWIP_HTTPD_ACCEPT_ENCODING */
+#define http_fs_open(hs, name) fs_open(&(hs)->file_handle, name)
+#endif /* LWIP_HTTPD_ACCEPT_ENCODING */
+
+#if LWIP_HTTPD_PIPELINING
+/** If hs->req contains more than one complete request header, move everything
+ * after the first one to the front of hs->pipe (POST bodies are left alone).
+ */
+static void
+http_split_pipelined(struct http_state *hs)
+{
+  u16_t end = pbuf_memfind(hs->req, CRLF CRLF, 4, 0);
+  if ((end != 0xFFFF) && (end + 4 < hs->req->tot_len) &&
+      (pbuf_memcmp(hs->req, 0, "POST ", 5) != 0)) {
+    u16_t head_len = (u16_t)(end + 4);
+    u16_t tail_len = (u16_t)(hs->req->tot_len - head_len);
+    struct pbuf *tail = pbuf_alloc(PBUF_RAW, tail_len, PBUF_RAM);
+    if (tail != NULL) {
+      pbuf_copy_partial(hs->req, tail->payload, tail_len, head_len);
+      if (hs->pipe != NULL) {
+        pbuf_cat(tail, hs->pipe);
+      }
+      hs->pipe = tail;
+      pbuf_realloc(hs->req, head_len);
+    }
+  }
+}
+#endif /* LWIP_HTTPD_PIPELINING */
+
 /**
  * When data has been received in the correct state, try to parse it
  * as a HTTP request.
@@ -1990,6 +2805,11 @@ http_parse_request(struct pbuf *inp, struct http_state *hs, struct altcp_pcb *pc
   /* increase pbuf ref counter as it is freed when we return but we want to
      keep it on the req list */
   pbuf_ref(p);
+#if LWIP_HTTPD_PIPELINING
+  http_split_pipelined(hs);
+  /* p might have been moved to hs->pipe */
+  p = hs->req;
+#endif /* LWIP_HTTPD_PIPELINING */
 
   if (hs->req->next != NULL) {
     data_len = LWIP_MIN(hs->req->tot_len, LWIP_HTTPD_MAX_REQ_LENGTH);
@@ -2069,6 +2889,9 @@ http_parse_request(struct pbuf *inp, struct http_state *hs, struct altcp_pcb *pc
             hs->keepalive = 0;
           }
 #endif /* LWIP_HTTPD_SUPPORT_11_KEEPALIVE */
+#if LWIP_HTTPD_ACCEPT_ENCODING
+          hs->accept_enc = http_get_accept_encoding(crlf, (u16_t)(data_len - (crlf - data)));
+#endif /* LWIP_HTTPD_ACCEPT_ENCODING */
           /* null-terminate the METHOD (pbuf is freed anyway wen returning) */
           *sp1 = 0;
           uri[uri_len] = 0;
@@ -2095,6 +2918,12 @@ http_parse_request(struct pbuf *inp, struct http_state *hs, struct altcp_pcb *pc
           } else
 #endif /* LWIP_HTTPD_SUPPORT_POST */
           {
+#if LWIP_HTTPD_WEBSOCKET
+            if (!is_09 && (httpd_ws_connect_handler != NULL) &&
+                (lwip_strnstr(crlf, HTTP_WS_UPGRADE, data_len - (crlf - data)) != NULL)) {
+              return http_ws_upgrade(hs, pcb, crlf, (u16_t)(data_len - (crlf - data)), uri);
+            }
+#endif /* LWIP_HTTPD_WEBSOCKET */
             return http_find_file(hs, uri, is_09);
           }
         }
@@ -2221,7 +3050,7 @@ http_find_file(struct http_state *hs, const char *uri, int is_09)
         file_name = httpd_default_filenames[loop].name;
       }
       LWIP_DEBUGF(HTTPD_DEBUG | LWIP_DBG_TRACE, ("Looking for %s...\n", file_name));
-      err = fs_open(&hs->file_handle, file_name);
+      err = http_fs_open(hs, file_name);
       if (err == ERR_OK) {
         uri = file_name;
         file = &hs->file_handle;
@@ -2264,7 +3093,7 @@ http_find_file(struct http_state *hs, const char *uri, int is_09)
 
     LWIP_DEBUGF(HTTPD_DEBUG | LWIP_DBG_TRACE, ("Opening %s\n", uri));
 
-    err = fs_open(&hs->file_handle, uri);
+    err = http_fs_open(hs, uri);
     if (err == ERR_OK) {
       file = &hs->file_handle;
     } else {
@@ -2452,6 +3281,12 @@ http_sent(void *arg, struct altcp_pcb *pcb, u16_t len)
 
   hs->retries = 0;
 
+#if LWIP_HTTPD_WEBSOCKET
+  if (hs->websocket) {
+    return ERR_OK;
+  }
+#endif /* LWIP_HTTPD_WEBSOCKET */
+
   http_send(pcb, hs);
 
   return ERR_OK;
@@ -2485,6 +3320,29 @@ http_poll(void *arg, struct altcp_pcb *pcb)
 #endif /* LWIP_HTTPD_ABORT_ON_CLOSE_MEM_ERROR */
     return ERR_OK;
   } else {
+#if LWIP_HTTPD_WEBSOCKET
+    if (hs->websocket) {
+      /* long-lived: ping an idle peer instead of closing (a dead peer makes
+         the ping time out in TCP) */
+      if (++hs->retries >= HTTPD_MAX_RETRIES) {
+        hs->retries = 0;
+        if (http_ws_write(hs, NULL, 0, HTTPD_WS_OPCODE_PING) == ERR_OK) {
+          altcp_output(pcb);
+        }
+      }
+      return ERR_OK;
+    }
+#endif /* LWIP_HTTPD_WEBSOCKET */
+#if LWIP_HTTPD_POST_STREAM
+    if (hs->post_stream != NULL) {
+      if (hs->post_stream->writing != NULL) {
+        /* waiting for a slow sink, not idle */
+        return ERR_OK;
+      }
+      /* the sink mbox may have been full */
+      http_post_stream_kick(hs->post_stream);
+    }
+#endif /* LWIP_HTTPD_POST_STREAM */
     hs->retries++;
     if (hs->retries == HTTPD_MAX_RETRIES) {
       LWIP_DEBUGF(HTTPD_DEBUG, ("http_poll: too many retries, close\n"));
@@ -2508,6 +3366,72 @@ http_poll(void *arg, struct altcp_pcb *pcb)
   return ERR_OK;
 }
 
+/** Parse a request received while no file is being sent and start sending
+ * the response. hs may be freed when this returns. */
+static void
+http_recv_request(struct altcp_pcb *pcb, struct http_state *hs, struct pbuf *p)
+{
+  err_t parsed = http_parse_request(p, hs, pcb);
+  LWIP_ASSERT("http_parse_request: unexpected return value", parsed == ERR_OK
+              || parsed == ERR_INPROGRESS || parsed == ERR_ARG || parsed == ERR_USE);
+#if LWIP_HTTPD_SUPPORT_REQUESTLIST
+  if (parsed != ERR_INPROGRESS) {
+    /* request fully parsed or error */
+    if (hs->req != NULL) {
+      pbuf_free(hs->req);
+      hs->req = NULL;
+    }
+  }
+#endif /* LWIP_HTTPD_SUPPORT_REQUESTLIST */
+  pbuf_free(p);
+  if (parsed == ERR_OK) {
+#if LWIP_HTTPD_WEBSOCKET
+    if (hs->websocket) {
+      /* handshake answered, frames follow */
+    } else
+#endif /* LWIP_HTTPD_WEBSOCKET */
+#if LWIP_HTTPD_SUPPORT_POST
+    if (hs->post_content_len_left == 0)
+#endif /* LWIP_HTTPD_SUPPORT_POST */
+    {
+      LWIP_DEBUGF(HTTPD_DEBUG | LWIP_DBG_TRACE, ("http_recv: data %p len %"S32_F"\n", (const void *)hs->file, hs->left));
+      http_send(pcb, hs);
+    }
+  } else if (parsed == ERR_ARG) {
+    /* @todo: close on ERR_USE? */
+    http_close_conn(pcb, hs);
+  }
+}
+
+#if LWIP_HTTPD_PIPELINING
+/** Parse the requests that were received while the previous response was
+ * being sent. Responses finishing right away are handled in this loop
+ * instead of recursing through http_eof(). */
+static void
+http_recv_pipelined(struct altcp_pcb *pcb, struct http_state *hs)
+{
+  u8_t closed = 0;
+  hs->pipe_closed = &closed;
+  while ((hs->pipe != NULL) && (hs->handle == NULL)
+#if LWIP_HTTPD_SUPPORT_POST
+         && (hs->post_content_len_left == 0)
+#endif /* LWIP_HTTPD_SUPPORT_POST */
+        ) {
+    struct pbuf *p = hs->pipe;
+    hs->pipe = NULL;
+    http_recv_request(pcb, hs, p);
+    if (closed) {
+      /* hs has been freed */
+      return;
+    }
+  }
+  hs->pipe_closed = NULL;
+#if HTTPD_LIMIT_IDLE_KEEPALIVE
+  http_limit_idle_connections();
+#endif /* HTTPD_LIMIT_IDLE_KEEPALIVE */
+}
+#endif /* LWIP_HTTPD_PIPELINING */
+
 /**
  * Data has been received on this pcb.
  * For HTTP 1.0, this should normally only happen once (if the request fits in one packet).
@@ -2544,6 +3468,14 @@ http_recv(void *arg, struct altcp_pcb *pcb, struct pbuf *p, err_t err)
     altcp_recved(pcb, p->tot_len);
   }
 
+#if LWIP_HTTPD_WEBSOCKET
+  if (hs->websocket) {
+    /* the pbuf is kept until its frames are complete */
+    http_ws_recv(pcb, hs, p);
+    return ERR_OK;
+  }
+#endif /* LWIP_HTTPD_WEBSOCKET */
+
 #if LWIP_HTTPD_SUPPORT_POST
   if (hs->post_content_len_left > 0) {
     /* reset idle counter when POST data is received */
@@ -2560,32 +3492,26 @@ http_recv(void *arg, struct altcp_pcb *pcb, struct pbuf *p, err_t err)
 #endif /* LWIP_HTTPD_SUPPORT_POST */
   {
     if (hs->handle == NULL) {
-      err_t parsed = http_parse_request(p, hs, pcb);
-      LWIP_ASSERT("http_parse_request: unexpected return value", parsed == ERR_OK
-                  || parsed == ERR_INPROGRESS || parsed == ERR_ARG || parsed == ERR_USE);
-#if LWIP_HTTPD_SUPPORT_REQUESTLIST
-      if (parsed != ERR_INPROGRESS) {
-        /* request fully parsed or error */
-        if (hs->req != NULL) {
-          pbuf_free(hs->req);
-          hs->req = NULL;
+      http_recv_request(pcb, hs, p);
+    } else {
+#if LWIP_HTTPD_PIPELINING
+      if (hs->keepalive) {
+        /* pipelined request: parse it when the current response is done */
+        if ((hs->pipe != NULL) &&
+            (hs->pipe->tot_len + (u32_t)p->tot_len > LWIP_HTTPD_REQ_BUFSIZE)) {
+          LWIP_DEBUGF(HTTPD_DEBUG, ("http_recv: too many pipelined requests, close\n"));
+          pbuf_free(p);
+          http_close_conn(pcb, hs);
+          return ERR_OK;
         }
-      }
-#endif /* LWIP_HTTPD_SUPPORT_REQUESTLIST */
-      pbuf_free(p);
-      if (parsed == ERR_OK) {
-#if LWIP_HTTPD_SUPPORT_POST
-        if (hs->post_content_len_left == 0)
-#endif /* LWIP_HTTPD_SUPPORT_POST */
-        {
-          LWIP_DEBUGF(HTTPD_DEBUG | LWIP_DBG_TRACE, ("http_recv: data %p len %"S32_F"\n", (const void *)hs->file, hs->left));
-          http_send(pcb, hs);
+        if (hs->pipe == NULL) {
+          hs->pipe = p;
+        } else {
+          pbuf_cat(hs->pipe, p);
         }
-      } else if (parsed == ERR_ARG) {
-        /* @todo: close on ERR_USE? */
-        http_close_conn(pcb, hs);
+        return ERR_OK;
       }
-    } else {
+#endif /* LWIP_HTTPD_PIPELINING */
       LWIP_DEBUGF(HTTPD_DEBUG, ("http_recv: already sending data\n"));
       /* already sending but still receiving data, we might want to RST here? */
       pbuf_free(p);
@@ -2667,6 +3593,13 @@ httpd_init(void)
 #endif
 #endif
   LWIP_DEBUGF(HTTPD_DEBUG, ("httpd_init\n"));
+#if LWIP_HTTPD_POST_STREAM
+  if (sys_mbox_new(&http_post_sink_mbox, HTTPD_POST_SINK_MBOX_SIZE) != ERR_OK) {
+    LWIP_ASSERT("httpd_init: failed to create the POST sink mbox", 0);
+  }
+  sys_thread_new("httpd_post_sink", http_post_sink_thread, NULL,
+                 HTTPD_POST_SINK_THREAD_STACKSIZE, HTTPD_POST_SINK_THREAD_PRIO);
+#endif /* LWIP_HTTPD_POST_STREAM */
 
   /* LWIP_ASSERT_CORE_LOCKED(); is checked by tcp_new() */
 
@@ -2724,6 +3657,125 @@ http_set_ssi_handler(tSSIHandler ssi_handler, const char **tags, int num_tags)
 }
 #endif /* LWIP_HTTPD_SSI */
 
+#if LWIP_HTTPD_WEBSOCKET
+/**
+ * @ingroup httpd
+ * Set the handlers for WebSocket connections. Upgrade requests are only
+ * accepted after this has been called.
+ *
+ * @param connect_handler called for upgrade requests
+ * @param recv_handler called for received data frames and when closed
+ */
+void
+http_set_websocket_handlers(tWsConnectHandler connect_handler, tWsRecvHandler recv_handler)
+{
+  LWIP_ASSERT("no handlers given", (connect_handler != NULL) && (recv_handler != NULL));
+  httpd_ws_recv_handler = recv_handler;
+  httpd_ws_connect_handler = connect_handler;
+}
+
+/**
+ * @ingroup httpd
+ * Send a frame on a WebSocket. Must be called from tcpip_thread.
+ * If only part of the frame could be queued, the connection is aborted
+ * (reported to the receive handler) and ERR_ABRT is returned.
+ *
+ * @param connection connection passed to the WebSocket handlers
+ * @param data payload (copied)
+ * @param len length of the payload
+ * @param opcode HTTPD_WS_OPCODE_TEXT or HTTPD_WS_OPCODE_BINARY
+ * @return ERR_OK, ERR_MEM if there is no room in the send buffer right now
+ */
+err_t
+httpd_websocket_write(void *connection, const void *data, u16_t len, u8_t opcode)
+{
+  struct http_state *hs = (struct http_state *)connection;
+  err_t err;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("httpd_websocket_write: not a WebSocket", (hs != NULL) && hs->websocket, return ERR_ARG;);
+
+  err = http_ws_write(hs, data, len, opcode);
+  if (err == ERR_OK) {
+    altcp_output(hs->pcb);
+  }
+  return err;
+}
+
+/**
+ * @ingroup httpd
+ * Send a frame on all WebSockets (e.g. for telemetry). Connections without
+ * room in their send buffer skip this frame. Must be called from tcpip_thread.
+ */
+void
+httpd_websocket_broadcast(const void *data, u16_t len, u8_t opcode)
+{
+  struct http_state *hs, *next;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  for (hs = http_ws_conns; hs != NULL; hs = next) {
+    next = hs->ws_next;
+    if (http_ws_write(hs, data, len, opcode) == ERR_OK) {
+      altcp_output(hs->pcb);
+    }
+  }
+}
+
+/**
+ * @ingroup httpd
+ * Close a WebSocket (sends a close frame). Must be called from tcpip_thread.
+ */
+void
+httpd_websocket_close(void *connection)
+{
+  struct http_state *hs = (struct http_state *)connection;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("httpd_websocket_close: not a WebSocket", (hs != NULL) && hs->websocket, return;);
+
+  if (http_ws_write(hs, NULL, 0, HTTPD_WS_OPCODE_CLOSE) != ERR_ABRT) {
+    http_close_conn(hs->pcb, hs);
+  }
+}
+#endif /* LWIP_HTTPD_WEBSOCKET */
+
+#if LWIP_HTTPD_SSI_ASYNC
+/**
+ * @ingroup httpd
+ * Resume a connection for which the SSI handler returned
+ * HTTPD_SSI_TAG_PENDING: the handler is called again for the same tag.
+ * Must be called from tcpip_thread (e.g. via tcpip_callback()). Connections
+ * that have been closed in the meantime are ignored.
+ *
+ * @param connection the 'connection' argument passed to the SSI handler
+ */
+void
+httpd_ssi_continue(void *connection)
+{
+  struct http_state *hs;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  for (hs = http_ssi_pending; hs != NULL; hs = hs->ssi->pending_next) {
+    if (hs == connection) {
+      break;
+    }
+  }
+  if (hs == NULL) {
+    LWIP_DEBUGF(HTTPD_DEBUG, ("httpd_ssi_continue: connection %p not pending\n", connection));
+    return;
+  }
+  http_ssi_unlink_pending(hs);
+  get_tag_insert(hs);
+  if (hs->pcb != NULL) {
+    if (http_send(hs->pcb, hs)) {
+      /* If we wrote anything to be sent, go ahead and send it now. */
+      LWIP_DEBUGF(HTTPD_DEBUG | LWIP_DBG_TRACE, ("tcp_output\n"));
+      altcp_output(hs->pcb);
+    }
+  }
+}
+#endif /* LWIP_HTTPD_SSI_ASYNC */
+
 #if LWIP_HTTPD_CGI
 /**
  * @ingroup httpd
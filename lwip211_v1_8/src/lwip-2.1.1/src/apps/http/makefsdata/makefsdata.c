@@ -115,7 +115,8 @@ struct file_entry {
 int process_sub(FILE *data_file, FILE *struct_file);
 int process_file(FILE *data_file, FILE *struct_file, const char *filename);
 int file_write_http_header(FILE *data_file, const char *filename, int file_size, u16_t *http_hdr_len,
-                           u16_t *http_hdr_chksum, u8_t provide_content_len, int is_compressed);
+                           u16_t *http_hdr_chksum, u8_t provide_content_len, int is_compressed,
+                           const char *extra_hdrs);
 int file_put_ascii(FILE *file, const char *ascii_string, int len, int *i);
 int s_put_ascii(char *buf, const char *ascii_string, int len, int *i);
 void concat_files(const char *file1, const char *file2, const char *targetfile);
@@ -124,6 +125,8 @@ static int checkSsiByFilelist(const char* filename_listfile);
 static int ext_in_list(const char* filename, const char *ext_list);
 static int file_to_exclude(const char* filename);
 static int file_can_be_compressed(const char* filename);
+static int file_is_encoded_variant(const char* filename);
+static void write_sorted_index(FILE *struct_file);
 
 /* 5 bytes per char + 3 bytes per line */
 static char file_buffer_c[COPY_BUFSIZE * 5 + ((COPY_BUFSIZE / HEX_BYTES_PER_LINE) * 3)];
@@ -143,19 +146,42 @@ unsigned char deflateNonSsiFiles = 0;
 size_t deflatedBytesReduced = 0;
 size_t overallDataBytes = 0;
 #endif
+unsigned char encodedVariants = 0;
 const char *exclude_list = NULL;
 const char *ncompress_list = NULL;
 
+/** Pre-compressed variants picked up by -enc: "x.gz" next to "x" is served
+ * as "x" with "Content-Encoding: gzip" to clients accepting gzip */
+struct file_encoding {
+  const char *suffix;
+  const char *name;
+  u8_t flag;
+  const char *flag_name;
+};
+static const struct file_encoding file_encodings[] = {
+  { ".gz", "gzip", FS_FILE_FLAGS_ENC_GZIP, "FS_FILE_FLAGS_ENC_GZIP" },
+  { ".br", "br",   FS_FILE_FLAGS_ENC_BR,   "FS_FILE_FLAGS_ENC_BR" }
+};
+#define NUM_FILE_ENCODINGS (sizeof(file_encodings) / sizeof(file_encodings[0]))
+
 struct file_entry *first_file = NULL;
 struct file_entry *last_file = NULL;
 
+/** One entry per served file name for the sorted FS_SORTED_INDEX */
+struct index_entry {
+  char *name;
+  char *varname;
+};
+struct index_entry *index_entries = NULL;
+size_t index_count = 0;
+
 static char *ssi_file_buffer;
 static char **ssi_file_lines;
 static size_t ssi_file_num_lines;
 
 static void print_usage(void)
 {
-  printf(" Usage: htmlgen [targetdir] [-s] [-e] [-11] [-nossi] [-ssi:<filename>] [-c] [-f:<filename>] [-m] [-svr:<name>] [-x:<ext_list>] [-xc:<ext_list>" USAGE_ARG_DEFLATE NEWLINE NEWLINE);
+  printf(" Usage: htmlgen [targetdir] [-s] [-e] [-11] [-nossi] [-ssi:<filename>] [-c] [-f:<filename>] [-m] [-svr:<name>] [-x:<ext_list>] [-xc:<ext_list>] [-enc]" USAGE_ARG_DEFLATE NEWLINE NEWLINE);
   printf("   targetdir: relative or absolute path to files to convert" NEWLINE);
   printf("   switch -s: toggle processing of subdirectories (default is on)" NEWLINE);
   printf("   switch -e: exclude HTTP header from file (header is created at runtime, default is off)" NEWLINE);
@@ -168,6 +194,8 @@ static void print_usage(void)
   printf("   switch -svr: server identifier sent in HTTP response header ('Server' field)" NEWLINE);
   printf("   switch -x: comma separated list of extensions of files to exclude (e.g., -x:json,txt)" NEWLINE);
   printf("   switch -xc: comma separated list of extensions of files to not compress (e.g., -xc:mp3,jpg)" NEWLINE);
+  printf("   switch -enc: serve pre-compressed <file>.gz/<file>.br as encoded variants of <file>" NEWLINE);
+  printf("                (adds ETag and Vary headers, clients get them by Accept-Encoding)" NEWLINE);
 #if MAKEFS_SUPPORT_DEFLATE
   printf("   switch -defl: deflate-compress all non-SSI files (with opt. compr.-level, default=10)" NEWLINE);
   printf("                 ATTENTION: browser has to support \"Content-Encoding: deflate\"!" NEWLINE);
@@ -248,6 +276,9 @@ int main(int argc, char *argv[])
 #else
         printf("WARNING: Deflate support is disabled\n");
 #endif
+      } else if (!strcmp(argv[i], "-enc")) {
+        encodedVariants = 1;
+        printf("Serving pre-compressed .gz/.br files as encoded variants" NEWLINE);
       } else if (strstr(argv[i], "-x:") == argv[i]) {
         exclude_list = &argv[i][3];
         printf("Excluding files with extensions %s" NEWLINE, exclude_list);
@@ -336,6 +367,7 @@ int main(int argc, char *argv[])
   fprintf(data_file, NEWLINE NEWLINE);
   fprintf(struct_file, "#define FS_ROOT file_%s" NEWLINE, lastFileVar);
   fprintf(struct_file, "#define FS_NUMFILES %d" NEWLINE NEWLINE, filesProcessed);
+  write_sorted_index(struct_file);
 
   fclose(data_file);
   fclose(struct_file);
@@ -508,6 +540,10 @@ int process_sub(FILE *data_file, FILE *struct_file)
             if (strcmp(curName, "fshdr.tmp") == 0) {
               continue;
             }
+            if (file_is_encoded_variant(curName)) {
+              /* processed together with the plain file */
+              continue;
+            }
             if (file_to_exclude(curName)) {
               printf("skipping %s/%s by exclude list (-x option)..." NEWLINE, curSubdir, curName);
               continue;
@@ -738,6 +774,47 @@ static void fix_filename_for_c(char *qualifiedName, size_t max_len)
   free(new_name);
 }
 
+/** Remember the list entry to look up 'name' by. Variants of the same name
+ * are written one after the other, so the last of them heads their run in
+ * the FS_ROOT list. */
+static void register_index(const char *name, const char *varname)
+{
+  if ((index_count > 0) && !strcmp(index_entries[index_count - 1].name, name)) {
+    free(index_entries[index_count - 1].varname);
+    index_entries[index_count - 1].varname = strdup(varname);
+    return;
+  }
+  index_entries = (struct index_entry *)realloc(index_entries, (index_count + 1) * sizeof(struct index_entry));
+  LWIP_ASSERT("index_entries != NULL", index_entries != NULL);
+  index_entries[index_count].name = strdup(name);
+  index_entries[index_count].varname = strdup(varname);
+  index_count++;
+}
+
+static int index_entry_cmp(const void *a, const void *b)
+{
+  return strcmp(((const struct index_entry *)a)->name, ((const struct index_entry *)b)->name);
+}
+
+/** Write the index sorted like fs.c searches it (strcmp() order) */
+static void write_sorted_index(FILE *struct_file)
+{
+  size_t k;
+  qsort(index_entries, index_count, sizeof(struct index_entry), index_entry_cmp);
+  fprintf(struct_file, "#define FS_SORTED_NUMFILES %d" NEWLINE, (int)index_count);
+  fprintf(struct_file, "#define FS_SORTED_INDEX fs_sorted_index" NEWLINE);
+  fprintf(struct_file, "static const struct fsdata_file *const fs_sorted_index[FS_SORTED_NUMFILES] = {" NEWLINE);
+  for (k = 0; k < index_count; k++) {
+    fprintf(struct_file, "file_%s, /* %s */" NEWLINE, index_entries[k].varname, index_entries[k].name);
+    free(index_entries[k].name);
+    free(index_entries[k].varname);
+  }
+  fprintf(struct_file, "};" NEWLINE NEWLINE);
+  free(index_entries);
+  index_entries = NULL;
+  index_count = 0;
+}
+
 static void register_filename(const char *qualifiedName)
 {
   struct file_entry *fe = (struct file_entry *)malloc(sizeof(struct file_entry));
@@ -902,11 +979,116 @@ static int file_can_be_compressed(const char *filename)
     return (ncompress_list == NULL) || !ext_in_list(filename, ncompress_list);
 }
 
+static int file_exists(const char *filename)
+{
+  FILE *f = fopen(filename, "rb");
+  if (f != NULL) {
+    fclose(f);
+    return 1;
+  }
+  return 0;
+}
+
+/** With -enc, "x.gz" and "x.br" are not served on their own if "x" exists */
+static int file_is_encoded_variant(const char *filename)
+{
+  size_t k;
+  if (encodedVariants) {
+    size_t len = strlen(filename);
+    for (k = 0; k < NUM_FILE_ENCODINGS; k++) {
+      size_t suffix_len = strlen(file_encodings[k].suffix);
+      if ((len > suffix_len) && !strcmp(&filename[len - suffix_len], file_encodings[k].suffix)) {
+        char plain[MAX_PATH_LEN];
+        if (len - suffix_len >= sizeof(plain)) {
+          return 0;
+        }
+        memcpy(plain, filename, len - suffix_len);
+        plain[len - suffix_len] = 0;
+        if (!file_to_exclude(plain) && file_exists(plain)) {
+          return 1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+/** FNV-1a hash of the file contents, used as ETag */
+static u32_t file_etag(const char *filename)
+{
+  u32_t hash = 2166136261UL;
+  int c;
+  FILE *f = fopen(filename, "rb");
+  if (f == NULL) {
+    printf("Failed to open file \"%s\"\n", filename);
+    exit(-1);
+  }
+  while ((c = fgetc(f)) != EOF) {
+    hash = (hash ^ (u8_t)c) * 16777619UL;
+  }
+  fclose(f);
+  return hash;
+}
+
+static int process_file_variant(FILE *data_file, FILE *struct_file, const char *filename,
+                                const char *qualifiedName, int is_ssi,
+                                const struct file_encoding *enc, const char *extra_hdrs);
+
 int process_file(FILE *data_file, FILE *struct_file, const char *filename)
+{
+  char qualifiedName[MAX_PATH_LEN];
+  char variant_name[MAX_PATH_LEN];
+  char extra_hdrs[256];
+  const char *vary = "";
+  int is_ssi;
+  u8_t variants = 0;
+  u32_t etag;
+  size_t k;
+
+  /* create qualified name (@todo: prepend slash or not?) */
+  sprintf(qualifiedName, "%s/%s", curSubdir, filename);
+  is_ssi = is_ssi_file(filename);
+
+  if (!encodedVariants || !includeHttpHeader || is_ssi) {
+    return process_file_variant(data_file, struct_file, filename, qualifiedName, is_ssi, NULL, NULL);
+  }
+
+  for (k = 0; k < NUM_FILE_ENCODINGS; k++) {
+    snprintf(variant_name, sizeof(variant_name), "%s%s", filename, file_encodings[k].suffix);
+    if (file_exists(variant_name)) {
+      variants |= file_encodings[k].flag;
+      vary = "Vary: Accept-Encoding\r\n";
+    }
+  }
+  /* the plain file's hash identifies all variants, suffixed like the encoding */
+  etag = file_etag(filename);
+  snprintf(extra_hdrs, sizeof(extra_hdrs), "ETag: \"%08x\"\r\n%s", (unsigned)etag, vary);
+  if (process_file_variant(data_file, struct_file, filename, qualifiedName, is_ssi, NULL, extra_hdrs) < 0) {
+    return -1;
+  }
+  for (k = 0; k < NUM_FILE_ENCODINGS; k++) {
+    if (variants & file_encodings[k].flag) {
+      snprintf(variant_name, sizeof(variant_name), "%s%s", filename, file_encodings[k].suffix);
+      snprintf(extra_hdrs, sizeof(extra_hdrs), "ETag: \"%08x-%s\"\r\n%sContent-Encoding: %s\r\n",
+               (unsigned)etag, file_encodings[k].name, vary, file_encodings[k].name);
+      printf(" - %s variant: %s" NEWLINE, file_encodings[k].name, variant_name);
+      if (process_file_variant(data_file, struct_file, variant_name, qualifiedName, 0,
+                               &file_encodings[k], extra_hdrs) < 0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/** Write one fsdata_file: 'filename' is the source file, 'qualifiedName' the
+ * name it is served as, 'enc' NULL for the plain file or its encoding */
+static int process_file_variant(FILE *data_file, FILE *struct_file, const char *filename,
+                                const char *qualifiedName, int is_ssi,
+                                const struct file_encoding *enc, const char *extra_hdrs)
 {
   char varname[MAX_PATH_LEN];
   int i = 0;
-  char qualifiedName[MAX_PATH_LEN];
   int file_size;
   u16_t http_hdr_chksum = 0;
   u16_t http_hdr_len = 0;
@@ -914,15 +1096,12 @@ int process_file(FILE *data_file, FILE *struct_file, const char *filename)
   u8_t flags = 0;
   u8_t has_content_len;
   u8_t *file_data;
-  int is_ssi;
   int can_be_compressed;
   int is_compressed = 0;
   int flags_printed;
 
-  /* create qualified name (@todo: prepend slash or not?) */
-  sprintf(qualifiedName, "%s/%s", curSubdir, filename);
-  /* create C variable name */
-  strcpy(varname, qualifiedName);
+  /* create C variable name (from the source file to keep variants apart) */
+  sprintf(varname, "%s/%s", curSubdir, filename);
   /* convert slashes & dots to underscores */
   fix_filename_for_c(varname, MAX_PATH_LEN);
   register_filename(varname);
@@ -945,15 +1124,19 @@ int process_file(FILE *data_file, FILE *struct_file, const char *filename)
 #endif /* ALIGN_PAYLOAD */
   fprintf(data_file, NEWLINE);
 
-  is_ssi = is_ssi_file(filename);
   if (is_ssi) {
     flags |= FS_FILE_FLAGS_SSI;
   }
+  if (enc != NULL) {
+    flags |= enc->flag;
+  }
   has_content_len = !is_ssi;
-  can_be_compressed = includeHttpHeader && !is_ssi && file_can_be_compressed(filename);
+  can_be_compressed = includeHttpHeader && !is_ssi && (enc == NULL) && file_can_be_compressed(filename);
   file_data = get_file_data(filename, &file_size, can_be_compressed, &is_compressed);
   if (includeHttpHeader) {
-    file_write_http_header(data_file, filename, file_size, &http_hdr_len, &http_hdr_chksum, has_content_len, is_compressed);
+    /* content type by the served name, not by the ".gz" of the source file */
+    file_write_http_header(data_file, &qualifiedName[strlen(curSubdir) + 1], file_size, &http_hdr_len, &http_hdr_chksum,
+                           has_content_len, is_compressed, extra_hdrs);
     flags |= FS_FILE_FLAGS_HEADER_INCLUDED;
     if (has_content_len) {
       flags |= FS_FILE_FLAGS_HEADER_PERSISTENT;
@@ -999,6 +1182,13 @@ int process_file(FILE *data_file, FILE *struct_file, const char *filename)
     fputs("FS_FILE_FLAGS_SSI", struct_file);
     flags_printed = 1;
   }
+  if (enc != NULL) {
+    if (flags_printed) {
+      fputs(" | ", struct_file);
+    }
+    fputs(enc->flag_name, struct_file);
+    flags_printed = 1;
+  }
   if (!flags_printed) {
     fputs("0", struct_file);
   }
@@ -1010,6 +1200,7 @@ int process_file(FILE *data_file, FILE *struct_file, const char *filename)
   }
   fprintf(struct_file, "}};" NEWLINE NEWLINE);
   strcpy(lastFileVar, varname);
+  register_index(qualifiedName, varname);
 
   /* write actual file contents */
   i = 0;
@@ -1021,7 +1212,8 @@ int process_file(FILE *data_file, FILE *struct_file, const char *filename)
 }
 
 int file_write_http_header(FILE *data_file, const char *filename, int file_size, u16_t *http_hdr_len,
-                           u16_t *http_hdr_chksum, u8_t provide_content_len, int is_compressed)
+                           u16_t *http_hdr_chksum, u8_t provide_content_len, int is_compressed,
+                           const char *extra_hdrs)
 {
   int i = 0;
   int response_type = HTTP_HDR_OK;
@@ -1198,6 +1390,19 @@ int file_write_http_header(FILE *data_file, const char *filename, int file_size,
   LWIP_UNUSED_ARG(is_compressed);
 #endif
 
+  if (extra_hdrs != NULL) {
+    /* ETag, Vary and Content-Encoding of -enc */
+    cur_string = extra_hdrs;
+    cur_len = strlen(cur_string);
+    fprintf(data_file, NEWLINE "/* \"%s\" (%"SZT_F" bytes) */" NEWLINE, cur_string, cur_len);
+    written += file_put_ascii(data_file, cur_string, cur_len, &i);
+    i = 0;
+    if (precalcChksum) {
+      memcpy(&hdr_buf[hdr_len], cur_string, cur_len);
+      hdr_len += cur_len;
+    }
+  }
+
   /* write content-type, ATTENTION: this includes the double-CRLF! */
   cur_string = file_type;
   cur_len = strlen(cur_string);
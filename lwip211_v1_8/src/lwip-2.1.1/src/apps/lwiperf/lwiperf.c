@@ -9,10 +9,10 @@
  *
  * This is a simple performance measuring client/server to check your bandwidth using
  * iPerf2 on a PC as server/client.
- * It is currently a minimal implementation providing a TCP client/server only.
+ * It implements TCP and UDP (iperf -u, with loss and jitter reporting) clients and
+ * servers, parallel client streams (iperf -P) and the dual/tradeoff modes (iperf -d/-r).
  *
  * @todo:
- * - implement UDP mode
  * - protect combined sessions handling (via 'related_master_state') against reallocation
  *   (this is a pointer address, currently, so if the same memory is allocated again,
  *    session pairs (tx/rx) can be confused on reallocation)
@@ -52,7 +52,9 @@
 #include "lwip/apps/lwiperf.h"
 
 #include "lwip/tcp.h"
+#include "lwip/udp.h"
 #include "lwip/sys.h"
+#include "lwip/timeouts.h"
 
 #include <string.h>
 
@@ -122,6 +124,8 @@ typedef struct _lwiperf_state_tcp {
   u8_t next_num;
   /* 1=start server when client is closed */
   u8_t client_tradeoff_mode;
+  /* listener of a client: connections to accept before closing */
+  u8_t accepts_left;
   u32_t bytes_transferred;
   lwiperf_settings_t settings;
   u8_t have_settings_buf;
@@ -301,7 +305,7 @@ lwiperf_tcp_client_send_more(lwiperf_state_tcp_t *conn)
       /* this session is byte-limited */
       u32_t amount_bytes = lwip_htonl(conn->settings.amount);
       /* @todo: this can send up to 1*MSS more than requested... */
-      if (amount_bytes >= conn->bytes_transferred) {
+      if (conn->bytes_transferred >= amount_bytes) {
         /* all requested bytes transferred -> close the connection */
         lwiperf_tcp_close(conn, LWIPERF_TCP_DONE_CLIENT);
         return ERR_OK;
@@ -632,11 +636,14 @@ lwiperf_tcp_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
   if (s->specific_remote) {
     /* this listener belongs to a client, so make the client the master of the newly created connection */
     conn->base.related_master_state = s->base.related_master_state;
-    /* if dual mode or (tradeoff mode AND client is done): close the listener */
-    if (!s->client_tradeoff_mode || !lwiperf_list_find(s->base.related_master_state)) {
+    /* if all streams are back and (dual mode or (tradeoff mode AND client is done)): close the listener */
+    if ((s->accepts_left <= 1) &&
+        (!s->client_tradeoff_mode || !lwiperf_list_find(s->base.related_master_state))) {
       /* prevent report when closing: this is expected */
       s->report_fn = NULL;
       lwiperf_tcp_close(s, LWIPERF_TCP_ABORTED_LOCAL);
+    } else {
+      s->accepts_left--;
     }
   }
   lwiperf_list_add(&conn->base);
@@ -758,36 +765,72 @@ void* lwiperf_start_tcp_client_default(const ip_addr_t* remote_addr,
 void* lwiperf_start_tcp_client(const ip_addr_t* remote_addr, u16_t remote_port,
   enum lwiperf_client_type type, lwiperf_report_fn report_fn, void* report_arg)
 {
-  err_t ret;
-  lwiperf_settings_t settings;
-  lwiperf_state_tcp_t *state = NULL;
+  return lwiperf_start_tcp_client_streams(remote_addr, remote_port, type, 1, 10000,
+                                          report_fn, report_arg);
+}
 
-  memset(&settings, 0, sizeof(settings));
+/** Fill in the settings a client sends to the server */
+static err_t
+lwiperf_client_settings(lwiperf_settings_t *settings, enum lwiperf_client_type type, u8_t num_streams, u32_t duration_ms)
+{
+  memset(settings, 0, sizeof(*settings));
   switch (type) {
   case LWIPERF_CLIENT:
     /* Unidirectional tx only test */
-    settings.flags = 0;
+    settings->flags = 0;
     break;
   case LWIPERF_DUAL:
     /* Do a bidirectional test simultaneously */
-    settings.flags = htonl(LWIPERF_FLAGS_ANSWER_TEST | LWIPERF_FLAGS_ANSWER_NOW);
+    settings->flags = htonl(LWIPERF_FLAGS_ANSWER_TEST | LWIPERF_FLAGS_ANSWER_NOW);
     break;
   case LWIPERF_TRADEOFF:
     /* Do a bidirectional test individually */
-    settings.flags = htonl(LWIPERF_FLAGS_ANSWER_TEST);
+    settings->flags = htonl(LWIPERF_FLAGS_ANSWER_TEST);
     break;
   default:
     /* invalid argument */
+    return ERR_ARG;
+  }
+  settings->num_threads = htonl(num_streams);
+  settings->remote_port = htonl(LWIPERF_TCP_PORT_DEFAULT);
+  /* time-limited, in units of 10ms */
+  settings->amount = htonl((u32_t)-(s32_t)(duration_ms / 10));
+  return ERR_OK;
+}
+
+/**
+ * @ingroup iperf
+ * Start a TCP iperf client with num_streams parallel connections (iperf -P)
+ * sending for duration_ms to a specific IP address and port.
+ *
+ * @returns a connection handle that can be used to abort all streams
+ *          by calling @ref lwiperf_abort()
+ */
+void* lwiperf_start_tcp_client_streams(const ip_addr_t* remote_addr, u16_t remote_port,
+  enum lwiperf_client_type type, u8_t num_streams, u32_t duration_ms,
+  lwiperf_report_fn report_fn, void* report_arg)
+{
+  err_t ret;
+  lwiperf_settings_t settings;
+  lwiperf_state_tcp_t *state = NULL;
+  u8_t i;
+
+  if ((num_streams == 0) || (lwiperf_client_settings(&settings, type, num_streams, duration_ms) != ERR_OK)) {
     return NULL;
   }
-  settings.num_threads = htonl(1);
-  settings.remote_port = htonl(LWIPERF_TCP_PORT_DEFAULT);
-  /* TODO: implement passing duration/amount of bytes to transfer */
-  settings.amount = htonl((u32_t)-1000);
 
   ret = lwiperf_tx_start_impl(remote_addr, remote_port, &settings, report_fn, report_arg, NULL, &state);
   if (ret == ERR_OK) {
     LWIP_ASSERT("state != NULL", state != NULL);
+    /* the other streams are aborted together with the first one */
+    for (i = 1; i < num_streams; i++) {
+      lwiperf_state_tcp_t *stream = NULL;
+      if (lwiperf_tx_start_impl(remote_addr, remote_port, &settings, report_fn, report_arg,
+                                (lwiperf_state_base_t *)state, &stream) != ERR_OK) {
+        lwiperf_abort(state);
+        return NULL;
+      }
+    }
     if (type != LWIPERF_CLIENT) {
       /* start corresponding server now */
       lwiperf_state_tcp_t *server = NULL;
@@ -798,8 +841,9 @@ void* lwiperf_start_tcp_client(const ip_addr_t* remote_addr, u16_t remote_port,
         lwiperf_abort(state);
         return NULL;
       }
-      /* make this server accept one connection only */
+      /* make this server accept one connection per stream only */
       server->specific_remote = 1;
+      server->accepts_left = num_streams;
       server->remote_addr = state->conn_pcb->remote_ip;
       if (type == LWIPERF_TRADEOFF) {
         /* tradeoff means that the remote host connects only after the client is done,
@@ -812,6 +856,582 @@ void* lwiperf_start_tcp_client(const ip_addr_t* remote_addr, u16_t remote_port,
   return NULL;
 }
 
+#if LWIPERF_UDP
+
+/** Datagram length of the UDP client (iperf's default, fits a 1500 byte MTU) */
+#ifndef LWIPERF_UDP_DATAGRAM_LEN
+#define LWIPERF_UDP_DATAGRAM_LEN    1470
+#endif
+
+/** UDP client rate in bits per second if none is given (iperf's default) */
+#ifndef LWIPERF_UDP_RATE_DEFAULT
+#define LWIPERF_UDP_RATE_DEFAULT    1000000UL
+#endif
+
+/** UDP client pacing interval in milliseconds */
+#ifndef LWIPERF_UDP_TX_INTERVAL_MS
+#define LWIPERF_UDP_TX_INTERVAL_MS  1
+#endif
+
+/** Maximum number of datagrams a UDP client sends per pacing interval */
+#ifndef LWIPERF_UDP_TX_BURST
+#define LWIPERF_UDP_TX_BURST        32
+#endif
+
+/** A UDP client signals the end of the test this often while waiting for the server report */
+#define LWIPERF_UDP_FIN_RETRIES     10
+#define LWIPERF_UDP_FIN_INTERVAL_MS 250
+
+/** Header at the start of each iperf UDP datagram, followed by lwiperf_settings_t */
+typedef struct _lwiperf_udp_hdr {
+  /* sequence number, negative: end of test */
+  s32_t id;
+  u32_t tv_sec;
+  u32_t tv_usec;
+} lwiperf_udp_hdr_t;
+
+/** Report the server sends back after the lwiperf_udp_hdr_t of the last datagram */
+typedef struct _lwiperf_udp_server_hdr {
+#define LWIPERF_UDP_SERVER_HDR_VERSION1 0x80000000UL
+  u32_t flags;
+  u32_t total_len1;
+  u32_t total_len2;
+  u32_t stop_sec;
+  u32_t stop_usec;
+  u32_t error_cnt;
+  u32_t outorder_cnt;
+  u32_t datagrams;
+  u32_t jitter1;
+  u32_t jitter2;
+} lwiperf_udp_server_hdr_t;
+
+#define LWIPERF_UDP_HDR_LEN         (sizeof(lwiperf_udp_hdr_t) + sizeof(lwiperf_settings_t))
+
+/** Connection handle for a UDP iperf session */
+typedef struct _lwiperf_state_udp {
+  lwiperf_state_base_t base;
+  /* client and listener: own pcb, server session: NULL (the listener's is used) */
+  struct udp_pcb *pcb;
+  /* server session: the listener it belongs to */
+  struct _lwiperf_state_udp *listener;
+  ip_addr_t remote_addr;
+  u16_t remote_port;
+  lwiperf_udp_report_fn report_fn;
+  void *report_arg;
+  lwiperf_settings_t settings;
+  u32_t time_started;
+  u32_t time_last;
+  u32_t duration_ms;
+  u32_t bytes_transferred;
+  struct lwiperf_udp_report stats;
+  /* server: next expected sequence number, client: next to send */
+  s32_t next_id;
+  /* server: transit time of the last datagram, for the jitter */
+  s32_t prev_transit;
+  /* client: bits per second */
+  u32_t rate_bps;
+  u8_t fin_count;
+  /* client: all data sent, server session: end of test received */
+  u8_t done;
+} lwiperf_state_udp_t;
+
+static void lwiperf_udp_client_tmr(void *arg);
+static err_t lwiperf_udp_client_start_impl(const ip_addr_t *remote_ip, u16_t remote_port, const lwiperf_settings_t *settings,
+                                           u32_t rate_bps, lwiperf_udp_report_fn report_fn, void *report_arg,
+                                           lwiperf_state_base_t *related_master_state, lwiperf_state_udp_t **new_conn);
+
+/** Call the report function of an iperf udp session */
+static void
+lwiperf_udp_report(lwiperf_state_udp_t *conn, enum lwiperf_report_type report_type)
+{
+  if (conn->report_fn != NULL) {
+    struct udp_pcb *pcb = (conn->pcb != NULL) ? conn->pcb : conn->listener->pcb;
+    u32_t bandwidth_kbitpsec = 0;
+    if (conn->duration_ms != 0) {
+      bandwidth_kbitpsec = (conn->bytes_transferred / conn->duration_ms) * 8U;
+    }
+    conn->report_fn(conn->report_arg, report_type, &pcb->local_ip, pcb->local_port,
+                    &conn->remote_addr, conn->remote_port, conn->bytes_transferred,
+                    conn->duration_ms, bandwidth_kbitpsec, &conn->stats);
+  }
+}
+
+/** Close an iperf udp session */
+static void
+lwiperf_udp_close(lwiperf_state_udp_t *conn)
+{
+  lwiperf_list_remove(&conn->base);
+  if (conn->pcb != NULL) {
+    udp_remove(conn->pcb);
+    if (!conn->base.server) {
+      sys_untimeout(lwiperf_udp_client_tmr, conn);
+    } else {
+      /* listener: its sessions reply through its pcb, so close them, too */
+      lwiperf_state_base_t *iter;
+      do {
+        for (iter = lwiperf_all_connections; iter != NULL; iter = iter->next) {
+          if (!iter->tcp && (((lwiperf_state_udp_t *)iter)->listener == conn)) {
+            lwiperf_udp_close((lwiperf_state_udp_t *)iter);
+            break;
+          }
+        }
+      } while (iter != NULL);
+    }
+  }
+  LWIPERF_FREE(lwiperf_state_udp_t, conn);
+}
+
+/** Send the server report in answer to the end of test datagram */
+static void
+lwiperf_udp_send_report(lwiperf_state_udp_t *conn, const lwiperf_udp_hdr_t *fin)
+{
+  lwiperf_udp_server_hdr_t hdr;
+  struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, sizeof(lwiperf_udp_hdr_t) + sizeof(hdr), PBUF_RAM);
+  if (p == NULL) {
+    return;
+  }
+  hdr.flags = PP_HTONL(LWIPERF_UDP_SERVER_HDR_VERSION1);
+  hdr.total_len1 = 0;
+  hdr.total_len2 = lwip_htonl(conn->bytes_transferred);
+  hdr.stop_sec = lwip_htonl(conn->duration_ms / 1000);
+  hdr.stop_usec = lwip_htonl((conn->duration_ms % 1000) * 1000);
+  hdr.error_cnt = lwip_htonl(conn->stats.lost);
+  hdr.outorder_cnt = lwip_htonl(conn->stats.out_of_order);
+  hdr.datagrams = lwip_htonl((u32_t)conn->next_id);
+  hdr.jitter1 = lwip_htonl(conn->stats.jitter_us / 1000000);
+  hdr.jitter2 = lwip_htonl(conn->stats.jitter_us % 1000000);
+  pbuf_take(p, fin, sizeof(lwiperf_udp_hdr_t));
+  pbuf_take_at(p, &hdr, sizeof(hdr), sizeof(lwiperf_udp_hdr_t));
+  udp_sendto(conn->listener->pcb, p, &conn->remote_addr, conn->remote_port);
+  pbuf_free(p);
+}
+
+/** Count a data datagram received by a server session */
+static void
+lwiperf_udp_count(lwiperf_state_udp_t *conn, s32_t id, const lwiperf_udp_hdr_t *hdr, u16_t len, u32_t now)
+{
+  s32_t transit;
+
+  if (id >= conn->next_id) {
+    conn->stats.lost += (u32_t)(id - conn->next_id);
+    conn->next_id = id + 1;
+  } else {
+    /* counted as lost when the gap was seen */
+    conn->stats.out_of_order++;
+    if (conn->stats.lost > 0) {
+      conn->stats.lost--;
+    }
+  }
+  conn->stats.datagrams++;
+  conn->bytes_transferred += len;
+
+  /* RFC 1889 interarrival jitter: the clock offset of both sides cancels out */
+  transit = (s32_t)(now - (lwip_ntohl(hdr->tv_sec) * 1000 + lwip_ntohl(hdr->tv_usec) / 1000));
+  if (conn->stats.datagrams > 1) {
+    s32_t d = transit - conn->prev_transit;
+    if (d < 0) {
+      d = -d;
+    }
+    conn->stats.jitter_us = (u32_t)((s32_t)conn->stats.jitter_us + (d * 1000 - (s32_t)conn->stats.jitter_us) / 16);
+  }
+  conn->prev_transit = transit;
+}
+
+/** Find the server session of a remote, closing idle ones on the way */
+static lwiperf_state_udp_t *
+lwiperf_udp_find_session(lwiperf_state_udp_t *listener, const ip_addr_t *addr, u16_t port, u32_t now)
+{
+  lwiperf_state_base_t *iter, *next;
+  lwiperf_state_udp_t *found = NULL;
+
+  for (iter = lwiperf_all_connections; iter != NULL; iter = next) {
+    lwiperf_state_udp_t *conn = (lwiperf_state_udp_t *)iter;
+    next = iter->next;
+    if (iter->tcp || !iter->server || (conn->listener != listener)) {
+      continue;
+    }
+    if ((conn->remote_port == port) && ip_addr_cmp(&conn->remote_addr, addr)) {
+      found = conn;
+    } else if ((now - conn->time_last) >= LWIPERF_TCP_MAX_IDLE_SEC * 1000U) {
+      if (!conn->done) {
+        conn->duration_ms = conn->time_last - conn->time_started;
+        lwiperf_udp_report(conn, LWIPERF_UDP_ABORTED_IDLE);
+      }
+      lwiperf_udp_close(conn);
+    }
+  }
+  return found;
+}
+
+/** Start a UDP client sending back to the remote of a server session */
+static void
+lwiperf_udp_answer(lwiperf_state_udp_t *conn)
+{
+  lwiperf_state_udp_t *client = NULL;
+  lwiperf_settings_t settings;
+  u32_t rate_bps = lwip_ntohl(conn->settings.win_band);
+
+  memcpy(&settings, &conn->settings, sizeof(settings));
+  /* prevent the remote side starting back as client again */
+  settings.flags = 0;
+  lwiperf_udp_client_start_impl(&conn->remote_addr, (u16_t)lwip_ntohl(conn->settings.remote_port), &settings,
+                                rate_bps, conn->report_fn, conn->report_arg, conn->listener->base.related_master_state,
+                                &client);
+}
+
+/** Receive a datagram on a UDP iperf server */
+static void
+lwiperf_udp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+  lwiperf_state_udp_t *listener = (lwiperf_state_udp_t *)arg;
+  lwiperf_state_udp_t *conn;
+  lwiperf_udp_hdr_t hdr;
+  u32_t now = sys_now();
+  s32_t id;
+
+  LWIP_ASSERT("pcb mismatch", listener->pcb == pcb);
+  LWIP_UNUSED_ARG(pcb);
+
+  if (pbuf_copy_partial(p, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+    pbuf_free(p);
+    return;
+  }
+  id = (s32_t)lwip_ntohl((u32_t)hdr.id);
+
+  conn = lwiperf_udp_find_session(listener, addr, port, now);
+  if (conn == NULL) {
+    if (id < 0) {
+      /* end of a test we don't know (any more) */
+      pbuf_free(p);
+      return;
+    }
+    conn = (lwiperf_state_udp_t *)LWIPERF_ALLOC(lwiperf_state_udp_t);
+    if (conn == NULL) {
+      pbuf_free(p);
+      return;
+    }
+    memset(conn, 0, sizeof(lwiperf_state_udp_t));
+    conn->base.server = 1;
+    conn->base.related_master_state = &listener->base;
+    conn->listener = listener;
+    ip_addr_copy(conn->remote_addr, *addr);
+    conn->remote_port = port;
+    conn->report_fn = listener->report_fn;
+    conn->report_arg = listener->report_arg;
+    conn->time_started = now;
+    pbuf_copy_partial(p, &conn->settings, sizeof(lwiperf_settings_t), sizeof(hdr));
+    lwiperf_list_add(&conn->base);
+    if ((conn->settings.flags & PP_HTONL(LWIPERF_FLAGS_ANSWER_TEST | LWIPERF_FLAGS_ANSWER_NOW)) ==
+        PP_HTONL(LWIPERF_FLAGS_ANSWER_TEST | LWIPERF_FLAGS_ANSWER_NOW)) {
+      /* client requested parallel transmission test */
+      lwiperf_udp_answer(conn);
+    }
+  }
+
+  if (conn->done) {
+    /* our report got lost: send it again */
+    if (id < 0) {
+      lwiperf_udp_send_report(conn, &hdr);
+    }
+  } else if (id >= 0) {
+    conn->time_last = now;
+    lwiperf_udp_count(conn, id, &hdr, p->tot_len, now);
+  } else {
+    /* end of test */
+    conn->done = 1;
+    conn->time_last = now;
+    conn->duration_ms = now - conn->time_started;
+    lwiperf_udp_report(conn, LWIPERF_UDP_DONE_SERVER);
+    lwiperf_udp_send_report(conn, &hdr);
+    if ((conn->settings.flags & PP_HTONL(LWIPERF_FLAGS_ANSWER_TEST | LWIPERF_FLAGS_ANSWER_NOW)) ==
+        PP_HTONL(LWIPERF_FLAGS_ANSWER_TEST)) {
+      /* client requested transmission after end of test */
+      lwiperf_udp_answer(conn);
+    }
+  }
+  pbuf_free(p);
+}
+
+/** Send one datagram of a UDP client */
+static err_t
+lwiperf_udp_client_send(lwiperf_state_udp_t *conn, s32_t id, u32_t now)
+{
+  err_t err;
+  lwiperf_udp_hdr_t hdr;
+  struct pbuf *p, *data;
+
+  p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)LWIPERF_UDP_HDR_LEN, PBUF_RAM);
+  if (p == NULL) {
+    return ERR_MEM;
+  }
+  /* the rest references the const buffer: we want to measure sending, not copying! */
+  data = pbuf_alloc(PBUF_RAW, (u16_t)(LWIPERF_UDP_DATAGRAM_LEN - LWIPERF_UDP_HDR_LEN), PBUF_ROM);
+  if (data == NULL) {
+    pbuf_free(p);
+    return ERR_MEM;
+  }
+  data->payload = LWIP_CONST_CAST(void *, lwiperf_txbuf_const);
+  pbuf_cat(p, data);
+
+  hdr.id = (s32_t)lwip_htonl((u32_t)id);
+  hdr.tv_sec = lwip_htonl(now / 1000);
+  hdr.tv_usec = lwip_htonl((now % 1000) * 1000);
+  pbuf_take(p, &hdr, sizeof(hdr));
+  pbuf_take_at(p, &conn->settings, sizeof(lwiperf_settings_t), sizeof(hdr));
+
+  err = udp_send(conn->pcb, p);
+  pbuf_free(p);
+  return err;
+}
+
+/** Check if the time or amount of a UDP client test is over */
+static u8_t
+lwiperf_udp_client_finished(lwiperf_state_udp_t *conn, u32_t diff_ms)
+{
+  if (conn->settings.amount & PP_HTONL(0x80000000)) {
+    u32_t time = (u32_t) - (s32_t)lwip_htonl(conn->settings.amount);
+    return diff_ms >= time * 10;
+  }
+  return conn->bytes_transferred >= lwip_htonl(conn->settings.amount);
+}
+
+/** Timer of a UDP client: send at the configured rate, then wait for the server report */
+static void
+lwiperf_udp_client_tmr(void *arg)
+{
+  lwiperf_state_udp_t *conn = (lwiperf_state_udp_t *)arg;
+  u32_t now = sys_now();
+  u32_t diff_ms = now - conn->time_started;
+
+  if (!conn->done) {
+    if (lwiperf_udp_client_finished(conn, diff_ms)) {
+      conn->done = 1;
+      conn->duration_ms = diff_ms;
+    } else {
+      /* bytes allowed by now at rate_bps */
+      u64_t allowed = ((u64_t)diff_ms * conn->rate_bps) / 8000U;
+      u8_t burst;
+      for (burst = 0; (burst < LWIPERF_UDP_TX_BURST) && (conn->bytes_transferred <= allowed); burst++) {
+        if (lwiperf_udp_client_send(conn, conn->next_id, now) != ERR_OK) {
+          /* out of buffers: try again next time */
+          break;
+        }
+        conn->next_id++;
+        conn->bytes_transferred += LWIPERF_UDP_DATAGRAM_LEN;
+        conn->stats.datagrams++;
+      }
+      sys_timeout(LWIPERF_UDP_TX_INTERVAL_MS, lwiperf_udp_client_tmr, conn);
+      return;
+    }
+  }
+
+  if (conn->fin_count < LWIPERF_UDP_FIN_RETRIES) {
+    /* signal the end of the test until the server report arrives */
+    conn->fin_count++;
+    lwiperf_udp_client_send(conn, -conn->next_id, now);
+    sys_timeout(LWIPERF_UDP_FIN_INTERVAL_MS, lwiperf_udp_client_tmr, conn);
+  } else {
+    /* no server report */
+    lwiperf_udp_report(conn, LWIPERF_UDP_DONE_CLIENT);
+    lwiperf_udp_close(conn);
+  }
+}
+
+/** Receive the server report on a UDP client */
+static void
+lwiperf_udp_client_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+  lwiperf_state_udp_t *conn = (lwiperf_state_udp_t *)arg;
+  lwiperf_udp_server_hdr_t hdr;
+
+  LWIP_ASSERT("pcb mismatch", conn->pcb == pcb);
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(addr);
+  LWIP_UNUSED_ARG(port);
+
+  if (conn->done &&
+      (pbuf_copy_partial(p, &hdr, sizeof(hdr), sizeof(lwiperf_udp_hdr_t)) == sizeof(hdr))) {
+    pbuf_free(p);
+    conn->stats.lost = lwip_ntohl(hdr.error_cnt);
+    conn->stats.out_of_order = lwip_ntohl(hdr.outorder_cnt);
+    conn->stats.jitter_us = lwip_ntohl(hdr.jitter1) * 1000000 + lwip_ntohl(hdr.jitter2);
+    conn->stats.server_report = 1;
+    lwiperf_udp_report(conn, LWIPERF_UDP_DONE_CLIENT);
+    lwiperf_udp_close(conn);
+    return;
+  }
+  pbuf_free(p);
+}
+
+/** Start a UDP client session */
+static err_t
+lwiperf_udp_client_start_impl(const ip_addr_t *remote_ip, u16_t remote_port, const lwiperf_settings_t *settings,
+                              u32_t rate_bps, lwiperf_udp_report_fn report_fn, void *report_arg,
+                              lwiperf_state_base_t *related_master_state, lwiperf_state_udp_t **new_conn)
+{
+  err_t err;
+  lwiperf_state_udp_t *client_conn;
+  struct udp_pcb *newpcb;
+
+  LWIP_ASSERT("remote_ip != NULL", remote_ip != NULL);
+  LWIP_ASSERT("new_conn != NULL", new_conn != NULL);
+  *new_conn = NULL;
+
+  client_conn = (lwiperf_state_udp_t *)LWIPERF_ALLOC(lwiperf_state_udp_t);
+  if (client_conn == NULL) {
+    return ERR_MEM;
+  }
+  newpcb = udp_new_ip_type(IP_GET_TYPE(remote_ip));
+  if (newpcb == NULL) {
+    LWIPERF_FREE(lwiperf_state_udp_t, client_conn);
+    return ERR_MEM;
+  }
+  memset(client_conn, 0, sizeof(lwiperf_state_udp_t));
+  client_conn->base.related_master_state = related_master_state;
+  client_conn->pcb = newpcb;
+  ip_addr_copy(client_conn->remote_addr, *remote_ip);
+  client_conn->remote_port = remote_port;
+  client_conn->report_fn = report_fn;
+  client_conn->report_arg = report_arg;
+  client_conn->rate_bps = (rate_bps != 0) ? rate_bps : LWIPERF_UDP_RATE_DEFAULT;
+  memcpy(&client_conn->settings, settings, sizeof(*settings));
+  /* UDP: the rate is passed in the window field */
+  client_conn->settings.win_band = lwip_htonl(client_conn->rate_bps);
+
+  udp_recv(newpcb, lwiperf_udp_client_recv, client_conn);
+  err = udp_connect(newpcb, remote_ip, remote_port);
+  if (err != ERR_OK) {
+    udp_remove(newpcb);
+    LWIPERF_FREE(lwiperf_state_udp_t, client_conn);
+    return err;
+  }
+  client_conn->time_started = sys_now();
+  lwiperf_list_add(&client_conn->base);
+  sys_timeout(LWIPERF_UDP_TX_INTERVAL_MS, lwiperf_udp_client_tmr, client_conn);
+  *new_conn = client_conn;
+  return ERR_OK;
+}
+
+static err_t
+lwiperf_start_udp_server_impl(const ip_addr_t *local_addr, u16_t local_port,
+                              lwiperf_udp_report_fn report_fn, void *report_arg,
+                              lwiperf_state_base_t *related_master_state, lwiperf_state_udp_t **state)
+{
+  err_t err;
+  lwiperf_state_udp_t *s;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ASSERT("state != NULL", state != NULL);
+
+  if (local_addr == NULL) {
+    return ERR_ARG;
+  }
+
+  s = (lwiperf_state_udp_t *)LWIPERF_ALLOC(lwiperf_state_udp_t);
+  if (s == NULL) {
+    return ERR_MEM;
+  }
+  memset(s, 0, sizeof(lwiperf_state_udp_t));
+  s->base.server = 1;
+  s->base.related_master_state = related_master_state;
+  s->report_fn = report_fn;
+  s->report_arg = report_arg;
+
+  s->pcb = udp_new_ip_type(LWIPERF_SERVER_IP_TYPE);
+  if (s->pcb == NULL) {
+    LWIPERF_FREE(lwiperf_state_udp_t, s);
+    return ERR_MEM;
+  }
+  err = udp_bind(s->pcb, local_addr, local_port);
+  if (err != ERR_OK) {
+    udp_remove(s->pcb);
+    LWIPERF_FREE(lwiperf_state_udp_t, s);
+    return err;
+  }
+  udp_recv(s->pcb, lwiperf_udp_recv, s);
+
+  lwiperf_list_add(&s->base);
+  *state = s;
+  return ERR_OK;
+}
+
+/**
+ * @ingroup iperf
+ * Start a UDP iperf server on a specific IP address and port and wait for
+ * datagrams from iperf clients (iperf -u -c). Each client (or stream) gets
+ * its own session that reports loss and jitter when the client ends it.
+ *
+ * @returns a connection handle that can be used to abort the server
+ *          by calling @ref lwiperf_abort()
+ */
+void *
+lwiperf_start_udp_server(const ip_addr_t *local_addr, u16_t local_port,
+                         lwiperf_udp_report_fn report_fn, void *report_arg)
+{
+  lwiperf_state_udp_t *state = NULL;
+
+  if (lwiperf_start_udp_server_impl(local_addr, local_port, report_fn, report_arg,
+                                    NULL, &state) == ERR_OK) {
+    return state;
+  }
+  return NULL;
+}
+
+/**
+ * @ingroup iperf
+ * Start a UDP iperf client with num_streams parallel streams (iperf -P), each
+ * sending at rate_bps (iperf -b, 0 for 1 Mbit/s) for duration_ms to a
+ * specific IP address and port (iperf -u -s).
+ * For LWIPERF_DUAL and LWIPERF_TRADEOFF, a server receiving the streams sent
+ * back is started on LWIPERF_UDP_PORT_DEFAULT; it is closed together with the
+ * client by @ref lwiperf_abort().
+ *
+ * @returns a connection handle that can be used to abort all streams
+ *          by calling @ref lwiperf_abort()
+ */
+void *
+lwiperf_start_udp_client(const ip_addr_t *remote_addr, u16_t remote_port,
+                         enum lwiperf_client_type type, u8_t num_streams, u32_t duration_ms,
+                         u32_t rate_bps, lwiperf_udp_report_fn report_fn, void *report_arg)
+{
+  lwiperf_settings_t settings;
+  lwiperf_state_udp_t *state = NULL;
+  u8_t i;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  if ((remote_addr == NULL) || (num_streams == 0) ||
+      (lwiperf_client_settings(&settings, type, num_streams, duration_ms) != ERR_OK)) {
+    return NULL;
+  }
+  settings.remote_port = htonl(LWIPERF_UDP_PORT_DEFAULT);
+  settings.buffer_len = htonl(LWIPERF_UDP_DATAGRAM_LEN);
+
+  if (lwiperf_udp_client_start_impl(remote_addr, remote_port, &settings, rate_bps, report_fn, report_arg,
+                                    NULL, &state) != ERR_OK) {
+    return NULL;
+  }
+  /* the other streams (and the server) are aborted together with the first one */
+  for (i = 1; i < num_streams; i++) {
+    lwiperf_state_udp_t *stream = NULL;
+    if (lwiperf_udp_client_start_impl(remote_addr, remote_port, &settings, rate_bps, report_fn, report_arg,
+                                      &state->base, &stream) != ERR_OK) {
+      lwiperf_abort(state);
+      return NULL;
+    }
+  }
+  if (type != LWIPERF_CLIENT) {
+    lwiperf_state_udp_t *server = NULL;
+    if (lwiperf_start_udp_server_impl(IP_ANY_TYPE, LWIPERF_UDP_PORT_DEFAULT, report_fn, report_arg,
+                                      &state->base, &server) != ERR_OK) {
+      lwiperf_abort(state);
+      return NULL;
+    }
+  }
+  return state;
+}
+#endif /* LWIPERF_UDP */
+
 /**
  * @ingroup iperf
  * Abort an iperf session (handle returned by lwiperf_start_tcp_server*())
@@ -819,23 +1439,33 @@ void* lwiperf_start_tcp_client(const ip_addr_t* remote_addr, u16_t remote_port,
 void
 lwiperf_abort(void *lwiperf_session)
 {
-  lwiperf_state_base_t *i, *dealloc, *last = NULL;
+  lwiperf_state_base_t *i;
 
   LWIP_ASSERT_CORE_LOCKED();
 
-  for (i = lwiperf_all_connections; i != NULL; ) {
-    if ((i == lwiperf_session) || (i->related_master_state == lwiperf_session)) {
-      dealloc = i;
-      i = i->next;
-      if (last != NULL) {
-        last->next = i;
+  /* closing a session removes it from the list, so search again after each one */
+  do {
+    for (i = lwiperf_all_connections; i != NULL; i = i->next) {
+      if ((i == lwiperf_session) || (i->related_master_state == lwiperf_session)) {
+        break;
       }
-      LWIPERF_FREE(lwiperf_state_tcp_t, dealloc); /* @todo: type? */
-    } else {
-      last = i;
-      i = i->next;
     }
-  }
+    if (i != NULL) {
+      if (i->tcp) {
+        lwiperf_state_tcp_t *conn = (lwiperf_state_tcp_t *)i;
+        /* no report for aborted sessions */
+        conn->report_fn = NULL;
+        lwiperf_tcp_close(conn, LWIPERF_TCP_ABORTED_LOCAL);
+      }
+#if LWIPERF_UDP
+      else {
+        lwiperf_state_udp_t *conn = (lwiperf_state_udp_t *)i;
+        conn->report_fn = NULL;
+        lwiperf_udp_close(conn);
+      }
+#endif /* LWIPERF_UDP */
+    }
+  } while (i != NULL);
 }
 
 #endif /* LWIP_TCP && LWIP_CALLBACK_API */
@@ -177,6 +177,24 @@ struct mdns_service {
   u16_t port;
 };
 
+#if MDNS_REPLY_CACHE_SIZE
+/** What a reply consists of: the records asked for and how they are sent */
+struct mdns_reply_key {
+  u8_t flags;
+  u8_t cache_flush;
+  u8_t host_replies;
+  u8_t host_reverse_v6_replies;
+  u8_t serv_replies[MDNS_MAX_SERVICES];
+};
+
+/** An encoded reply packet, header included */
+struct mdns_reply_cache_entry {
+  struct mdns_reply_key key;
+  u16_t len;
+  u8_t *data;
+};
+#endif /* MDNS_REPLY_CACHE_SIZE */
+
 /** Description of a host/netif */
 struct mdns_host {
   /** Hostname */
@@ -189,6 +207,12 @@ struct mdns_host {
   u8_t probes_sent;
   /** State in probing sequence */
   u8_t probing_state;
+#if MDNS_REPLY_CACHE_SIZE
+  /** Slot the next reply is stored in */
+  u8_t reply_cache_next;
+  /** Replies sent recently, for queries asking the same again */
+  struct mdns_reply_cache_entry reply_cache[MDNS_REPLY_CACHE_SIZE];
+#endif
 };
 
 /** Information about received packet */
@@ -1298,6 +1322,109 @@ mdns_init_outpacket(struct mdns_outpacket *out, struct mdns_packet *in)
   }
 }
 
+/**
+ * Send the finished packet in outpkt, multicast or unicast as chosen
+ */
+static err_t
+mdns_send_pbuf(struct mdns_outpacket *outpkt)
+{
+  const ip_addr_t *mcast_destaddr;
+
+  if (IP_IS_V6_VAL(outpkt->dest_addr)) {
+#if LWIP_IPV6
+    mcast_destaddr = &v6group;
+#endif
+  } else {
+#if LWIP_IPV4
+    mcast_destaddr = &v4group;
+#endif
+  }
+  /* Send created packet */
+  LWIP_DEBUGF(MDNS_DEBUG, ("MDNS: Sending packet, len=%d, unicast=%d\n", outpkt->write_offset, outpkt->unicast_reply));
+  if (outpkt->unicast_reply) {
+    return udp_sendto_if(mdns_pcb, outpkt->pbuf, &outpkt->dest_addr, outpkt->dest_port, outpkt->netif);
+  }
+  return udp_sendto_if(mdns_pcb, outpkt->pbuf, mcast_destaddr, LWIP_IANA_PORT_MDNS, outpkt->netif);
+}
+
+#if MDNS_REPLY_CACHE_SIZE
+static void
+mdns_reply_key(const struct mdns_outpacket *outpkt, u8_t flags, struct mdns_reply_key *key)
+{
+  key->flags = flags;
+  key->cache_flush = outpkt->cache_flush;
+  key->host_replies = outpkt->host_replies;
+  key->host_reverse_v6_replies = outpkt->host_reverse_v6_replies;
+  MEMCPY(key->serv_replies, outpkt->serv_replies, sizeof(key->serv_replies));
+}
+
+/**
+ * Drop all cached replies of a host. Called whenever anything they are
+ * made of changes: name, services, TXT data or addresses.
+ */
+static void
+mdns_reply_cache_flush(struct mdns_host *mdns)
+{
+  int i;
+
+  for (i = 0; i < MDNS_REPLY_CACHE_SIZE; i++) {
+    if (mdns->reply_cache[i].data != NULL) {
+      mem_free(mdns->reply_cache[i].data);
+      mdns->reply_cache[i].data = NULL;
+    }
+  }
+  mdns->reply_cache_next = 0;
+}
+
+/**
+ * Send a reply made earlier for the same records instead of building it again
+ * @return 1 if a cached reply was found, *res is the result of sending it
+ */
+static int
+mdns_reply_cache_send(struct mdns_host *mdns, struct mdns_outpacket *outpkt, u8_t flags, err_t *res)
+{
+  struct mdns_reply_key key;
+  int i;
+
+  mdns_reply_key(outpkt, flags, &key);
+  for (i = 0; i < MDNS_REPLY_CACHE_SIZE; i++) {
+    struct mdns_reply_cache_entry *entry = &mdns->reply_cache[i];
+    if (entry->data != NULL && memcmp(&entry->key, &key, sizeof(key)) == 0) {
+      outpkt->pbuf = pbuf_alloc(PBUF_TRANSPORT, entry->len, PBUF_RAM);
+      if (outpkt->pbuf == NULL) {
+        *res = ERR_MEM;
+        return 1;
+      }
+      pbuf_take(outpkt->pbuf, entry->data, entry->len);
+      outpkt->write_offset = entry->len;
+      *res = mdns_send_pbuf(outpkt);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Keep a copy of the finished packet in outpkt, replacing the oldest entry
+ */
+static void
+mdns_reply_cache_store(struct mdns_host *mdns, const struct mdns_outpacket *outpkt, u8_t flags)
+{
+  struct mdns_reply_cache_entry *entry = &mdns->reply_cache[mdns->reply_cache_next];
+
+  if (entry->data != NULL) {
+    mem_free(entry->data);
+  }
+  entry->data = (u8_t *)mem_malloc(outpkt->write_offset);
+  if (entry->data == NULL) {
+    return;
+  }
+  entry->len = pbuf_copy_partial(outpkt->pbuf, entry->data, outpkt->write_offset, 0);
+  mdns_reply_key(outpkt, flags, &entry->key);
+  mdns->reply_cache_next = (u8_t)((mdns->reply_cache_next + 1) % MDNS_REPLY_CACHE_SIZE);
+}
+#endif /* MDNS_REPLY_CACHE_SIZE */
+
 /**
  * Send chosen answers as a reply
  *
@@ -1314,6 +1441,14 @@ mdns_send_outpacket(struct mdns_outpacket *outpkt, u8_t flags)
   struct mdns_host *mdns = NETIF_TO_HOST(outpkt->netif);
   u16_t answers = 0;
 
+#if MDNS_REPLY_CACHE_SIZE
+  /* Legacy replies repeat the question and id, nothing else depends on the query */
+  if (!outpkt->legacy_query && outpkt->pbuf == NULL &&
+      mdns_reply_cache_send(mdns, outpkt, flags, &res)) {
+    goto cleanup;
+  }
+#endif
+
   /* Write answers to host questions */
 #if LWIP_IPV4
   if (outpkt->host_replies & REPLY_HOST_A) {
@@ -1468,7 +1603,6 @@ mdns_send_outpacket(struct mdns_outpacket *outpkt, u8_t flags)
   }
 
   if (outpkt->pbuf) {
-    const ip_addr_t *mcast_destaddr;
     struct dns_hdr hdr;
 
     /* Write header */
@@ -1484,22 +1618,12 @@ mdns_send_outpacket(struct mdns_outpacket *outpkt, u8_t flags)
     /* Shrink packet */
     pbuf_realloc(outpkt->pbuf, outpkt->write_offset);
 
-    if (IP_IS_V6_VAL(outpkt->dest_addr)) {
-#if LWIP_IPV6
-      mcast_destaddr = &v6group;
-#endif
-    } else {
-#if LWIP_IPV4
-      mcast_destaddr = &v4group;
-#endif
-    }
-    /* Send created packet */
-    LWIP_DEBUGF(MDNS_DEBUG, ("MDNS: Sending packet, len=%d, unicast=%d\n", outpkt->write_offset, outpkt->unicast_reply));
-    if (outpkt->unicast_reply) {
-      res = udp_sendto_if(mdns_pcb, outpkt->pbuf, &outpkt->dest_addr, outpkt->dest_port, outpkt->netif);
-    } else {
-      res = udp_sendto_if(mdns_pcb, outpkt->pbuf, mcast_destaddr, LWIP_IANA_PORT_MDNS, outpkt->netif);
+#if MDNS_REPLY_CACHE_SIZE
+    if (!outpkt->legacy_query) {
+      mdns_reply_cache_store(mdns, outpkt, flags);
     }
+#endif
+    res = mdns_send_pbuf(outpkt);
   }
 
 cleanup:
@@ -1957,28 +2081,10 @@ mdns_send_probe(struct netif* netif, const ip_addr_t *destination)
 
   memset(&pkt, 0, sizeof(pkt));
   pkt.netif = netif;
+  pkt.dest_port = LWIP_IANA_PORT_MDNS;
+  SMEMCPY(&pkt.dest_addr, destination, sizeof(pkt.dest_addr));
 
-  /* Add unicast questions with rtype ANY for all our desired records */
-  mdns_build_host_domain(&domain, mdns);
-  res = mdns_add_question(&pkt, &domain, DNS_RRTYPE_ANY, DNS_RRCLASS_IN, 1);
-  if (res != ERR_OK) {
-    goto cleanup;
-  }
-  pkt.questions++;
-  for (i = 0; i < MDNS_MAX_SERVICES; i++) {
-    struct mdns_service* service = mdns->services[i];
-    if (!service) {
-      continue;
-    }
-    mdns_build_service_domain(&domain, service, 1);
-    res = mdns_add_question(&pkt, &domain, DNS_RRTYPE_ANY, DNS_RRCLASS_IN, 1);
-    if (res != ERR_OK) {
-      goto cleanup;
-    }
-    pkt.questions++;
-  }
-
-  /* Add answers to the questions above into the authority section for tiebreaking */
+  /* Answers to the questions below go into the authority section for tiebreaking */
 #if LWIP_IPV4
   if (!ip4_addr_isany_val(*netif_ip4_addr(netif))) {
     pkt.host_replies = REPLY_HOST_A;
@@ -1999,9 +2105,33 @@ mdns_send_probe(struct netif* netif, const ip_addr_t *destination)
     }
   }
 
-  pkt.tx_id = 0;
-  pkt.dest_port = LWIP_IANA_PORT_MDNS;
-  SMEMCPY(&pkt.dest_addr, destination, sizeof(pkt.dest_addr));
+#if MDNS_REPLY_CACHE_SIZE
+  /* The probes on the other family and the following rounds are the same packet */
+  if (mdns_reply_cache_send(mdns, &pkt, 0, &res)) {
+    goto cleanup;
+  }
+#endif
+
+  /* Add unicast questions with rtype ANY for all our desired records */
+  mdns_build_host_domain(&domain, mdns);
+  res = mdns_add_question(&pkt, &domain, DNS_RRTYPE_ANY, DNS_RRCLASS_IN, 1);
+  if (res != ERR_OK) {
+    goto cleanup;
+  }
+  pkt.questions++;
+  for (i = 0; i < MDNS_MAX_SERVICES; i++) {
+    struct mdns_service* service = mdns->services[i];
+    if (!service) {
+      continue;
+    }
+    mdns_build_service_domain(&domain, service, 1);
+    res = mdns_add_question(&pkt, &domain, DNS_RRTYPE_ANY, DNS_RRCLASS_IN, 1);
+    if (res != ERR_OK) {
+      goto cleanup;
+    }
+    pkt.questions++;
+  }
+
   res = mdns_send_outpacket(&pkt, 0);
 
 cleanup:
@@ -2129,6 +2259,9 @@ mdns_resp_remove_netif(struct netif *netif)
       mem_free(service);
     }
   }
+#if MDNS_REPLY_CACHE_SIZE
+  mdns_reply_cache_flush(mdns);
+#endif
 
   /* Leave multicast groups */
 #if LWIP_IPV4
@@ -2184,7 +2317,8 @@ mdns_resp_rename_netif(struct netif *netif, const char *hostname)
  * @param port The port the service listens to
  * @param dns_ttl Validity time in seconds to send out for service data in DNS replies
  * @param txt_fn Callback to get TXT data. Will be called each time a TXT reply is created to
- *               allow dynamic replies.
+ *               allow dynamic replies. Replies are reused while nothing changes, call
+ *               mdns_resp_announce() when the TXT data did.
  * @param txt_data Userdata pointer for txt_fn
  * @return service_id if the service was added to the netif, an err_t otherwise
  */
@@ -2252,6 +2386,9 @@ mdns_resp_del_service(struct netif *netif, s8_t slot)
   srv = mdns->services[slot];
   mdns->services[slot] = NULL;
   mem_free(srv);
+#if MDNS_REPLY_CACHE_SIZE
+  mdns_reply_cache_flush(mdns);
+#endif
   return ERR_OK;
 }
 
@@ -2324,6 +2461,10 @@ mdns_resp_announce(struct netif *netif)
   if (mdns == NULL) {
     return;
   }
+#if MDNS_REPLY_CACHE_SIZE
+  /* Addresses or TXT data may have changed, that is what announcing is for */
+  mdns_reply_cache_flush(mdns);
+#endif
 
   if (mdns->probing_state == MDNS_PROBING_COMPLETE) {
     /* Announce on IPv6 and IPv4 */
@@ -2367,6 +2508,9 @@ mdns_resp_restart(struct netif *netif)
   if (mdns->probing_state == MDNS_PROBING_ONGOING) {
     sys_untimeout(mdns_probe, netif);
   }
+#if MDNS_REPLY_CACHE_SIZE
+  mdns_reply_cache_flush(mdns);
+#endif
   /* @todo if we've failed 15 times within a 10 second period we MUST wait 5 seconds (or wait 5 seconds every time except first)*/
   mdns->probes_sent = 0;
   mdns->probing_state = MDNS_PROBING_ONGOING;
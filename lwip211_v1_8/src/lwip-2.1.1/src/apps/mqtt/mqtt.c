@@ -226,21 +226,24 @@ mqtt_ringbuf_len(struct mqtt_ringbuf_t *rb)
 #define mqtt_ringbuf_linear_read_length(rb) LWIP_MIN(mqtt_ringbuf_len(rb), (MQTT_OUTPUT_RINGBUF_SIZE - (rb)->get))
 
 /**
- * Try send as many bytes as possible from output ring buffer
+ * Pass as many bytes as possible (up to max_len) from output ring buffer to TCP
  * @param rb Output ring buffer
  * @param tpcb TCP connection handle
+ * @param max_len Maximum number of bytes to send
+ * @return Number of bytes passed to TCP
  */
-static void
-mqtt_output_send(struct mqtt_ringbuf_t *rb, struct altcp_pcb *tpcb)
+static u16_t
+mqtt_output_send_ring(struct mqtt_ringbuf_t *rb, struct altcp_pcb *tpcb, u16_t max_len)
 {
   err_t err;
   u8_t wrap = 0;
-  u16_t ringbuf_lin_len = mqtt_ringbuf_linear_read_length(rb);
+  u16_t sent = 0;
+  u16_t ringbuf_lin_len = LWIP_MIN(mqtt_ringbuf_linear_read_length(rb), max_len);
   u16_t send_len = altcp_sndbuf(tpcb);
   LWIP_ASSERT("mqtt_output_send: tpcb != NULL", tpcb != NULL);
 
   if (send_len == 0 || ringbuf_lin_len == 0) {
-    return;
+    return 0;
   }
 
   LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_output_send: tcp_sndbuf: %d bytes, ringbuf_linear_available: %d, get %d, put %d\n",
@@ -250,55 +253,214 @@ mqtt_output_send(struct mqtt_ringbuf_t *rb, struct altcp_pcb *tpcb)
     /* Space in TCP output buffer is larger than available in ring buffer linear portion */
     send_len = ringbuf_lin_len;
     /* Wrap around if more data in ring buffer after linear portion */
-    wrap = (mqtt_ringbuf_len(rb) > ringbuf_lin_len);
+    wrap = (LWIP_MIN(mqtt_ringbuf_len(rb), max_len) > ringbuf_lin_len);
   }
   err = altcp_write(tpcb, mqtt_ringbuf_get_ptr(rb), send_len, TCP_WRITE_FLAG_COPY | (wrap ? TCP_WRITE_FLAG_MORE : 0));
   if ((err == ERR_OK) && wrap) {
     mqtt_ringbuf_advance_get_idx(rb, send_len);
+    sent = send_len;
     /* Use the lesser one of ring buffer linear length and TCP send buffer size */
-    send_len = LWIP_MIN(altcp_sndbuf(tpcb), mqtt_ringbuf_linear_read_length(rb));
+    send_len = LWIP_MIN(altcp_sndbuf(tpcb), LWIP_MIN(mqtt_ringbuf_linear_read_length(rb), max_len - sent));
     err = altcp_write(tpcb, mqtt_ringbuf_get_ptr(rb), send_len, TCP_WRITE_FLAG_COPY);
   }
 
   if (err == ERR_OK) {
     mqtt_ringbuf_advance_get_idx(rb, send_len);
-    /* Flush */
-    altcp_output(tpcb);
+    sent += send_len;
   } else {
     LWIP_DEBUGF(MQTT_DEBUG_WARN, ("mqtt_output_send: Send failed with err %d (\"%s\")\n", err, lwip_strerr(err)));
   }
+  return sent;
+}
+
+#if MQTT_OUTPUT_NOCOPY
+/**
+ * Pass as much as possible of the output ring buffer and the zero-copy
+ * payloads to TCP, in the order they were queued
+ * @param client MQTT client
+ * @return Number of bytes passed to TCP
+ */
+static u32_t
+mqtt_output_send_nocopy(mqtt_client_t *client)
+{
+  struct altcp_pcb *tpcb = client->conn;
+  u32_t start = client->tx_written;
+
+  for (;;) {
+    struct mqtt_output_ref *ref = NULL;
+    u32_t ring_len = mqtt_ringbuf_len(&client->output);
+    u32_t len;
+    u16_t sent;
+
+    if (client->out_ref_written < client->out_ref_num) {
+      ref = &client->out_ref[(client->out_ref_first + client->out_ref_written) % MQTT_OUTPUT_NOCOPY];
+      ring_len = ref->ring_pos - client->ring_sent;
+    }
+    if (ring_len > 0) {
+      /* header bytes in front of the payload (or everything if no payload is waiting) */
+      sent = mqtt_output_send_ring(&client->output, tpcb, (u16_t)ring_len);
+      client->ring_sent += sent;
+      client->tx_written += sent;
+      if (sent < ring_len) {
+        break;
+      }
+    }
+    if (ref == NULL) {
+      break;
+    }
+    len = LWIP_MIN(ref->len - ref->written, altcp_sndbuf(tpcb));
+    if (len == 0) {
+      break;
+    }
+    /* no TCP_WRITE_FLAG_COPY: TCP references the payload until it is acked */
+    if (altcp_write(tpcb, ref->payload + ref->written, (u16_t)len,
+                    (ref->written + len < ref->len) ? TCP_WRITE_FLAG_MORE : 0) != ERR_OK) {
+      break;
+    }
+    ref->written += len;
+    client->tx_written += len;
+    if (ref->written == ref->len) {
+      ref->end = client->tx_written;
+      client->out_ref_written++;
+    }
+  }
+  return client->tx_written - start;
+}
+
+/**
+ * Call the free callback of zero-copy payloads not referenced by TCP any more
+ * @param client MQTT client
+ * @param all 1 to release all payloads (the connection is gone)
+ */
+static void
+mqtt_output_ref_release(mqtt_client_t *client, u8_t all)
+{
+  while (client->out_ref_num > 0) {
+    struct mqtt_output_ref *ref = &client->out_ref[client->out_ref_first];
+    if (!all && ((client->out_ref_written == 0) || ((s32_t)(client->tx_acked - ref->end) < 0))) {
+      break;
+    }
+    client->out_ref_first = (u8_t)((client->out_ref_first + 1) % MQTT_OUTPUT_NOCOPY);
+    client->out_ref_num--;
+    if (client->out_ref_written > 0) {
+      client->out_ref_written--;
+    }
+    if (ref->free_cb != NULL) {
+      ref->free_cb(ref->arg, ref->payload);
+    }
+  }
+}
+#endif /* MQTT_OUTPUT_NOCOPY */
+
+/**
+ * Pass as many bytes as possible from output ring buffer to TCP without
+ * sending them yet
+ * @param client MQTT client
+ * @return Number of bytes passed to TCP
+ */
+static u32_t
+mqtt_output_write(mqtt_client_t *client)
+{
+#if MQTT_OUTPUT_NOCOPY
+  return mqtt_output_send_nocopy(client);
+#else /* MQTT_OUTPUT_NOCOPY */
+  return mqtt_output_send_ring(&client->output, client->conn, 0xFFFF);
+#endif /* MQTT_OUTPUT_NOCOPY */
+}
+
+#if MQTT_OUTPUT_BATCH_LEN
+static void mqtt_output_batch_timeout(void *arg);
+#endif /* MQTT_OUTPUT_BATCH_LEN */
+
+/**
+ * Try send as many bytes as possible from output ring buffer
+ * @param client MQTT client
+ */
+static void
+mqtt_output_send(mqtt_client_t *client)
+{
+  u32_t queued = mqtt_output_write(client);
+#if MQTT_OUTPUT_BATCH_LEN
+  /* deferred publishes go out with it */
+  queued += client->batch_len;
+  client->batch_len = 0;
+  if (client->batch_timer) {
+    client->batch_timer = 0;
+    sys_untimeout(mqtt_output_batch_timeout, client);
+  }
+#endif /* MQTT_OUTPUT_BATCH_LEN */
+  if (queued > 0) {
+    /* Flush */
+    altcp_output(client->conn);
+  }
+}
+
+#if MQTT_OUTPUT_BATCH_LEN
+/**
+ * Send publishes that have waited MQTT_OUTPUT_BATCH_DELAY
+ * @param arg MQTT client
+ */
+static void
+mqtt_output_batch_timeout(void *arg)
+{
+  mqtt_client_t *client = (mqtt_client_t *)arg;
+  client->batch_timer = 0;
+  if (client->conn != NULL) {
+    mqtt_output_send(client);
+  }
+}
+
+/**
+ * Pass a publish to TCP, but only send once MQTT_OUTPUT_BATCH_LEN bytes
+ * have been collected or MQTT_OUTPUT_BATCH_DELAY has passed
+ * @param client MQTT client
+ */
+static void
+mqtt_output_batch(mqtt_client_t *client)
+{
+  client->batch_len += mqtt_output_write(client);
+  if ((client->batch_len >= MQTT_OUTPUT_BATCH_LEN) || (mqtt_ringbuf_len(&client->output) > 0)
+#if MQTT_OUTPUT_NOCOPY
+      || (client->out_ref_written < client->out_ref_num)
+#endif /* MQTT_OUTPUT_NOCOPY */
+     ) {
+    /* Enough for a full segment, or the TCP send buffer is full */
+    mqtt_output_send(client);
+  } else if (!client->batch_timer) {
+    client->batch_timer = 1;
+    sys_timeout(MQTT_OUTPUT_BATCH_DELAY, mqtt_output_batch_timeout, client);
+  }
 }
+#endif /* MQTT_OUTPUT_BATCH_LEN */
 
 
 
 /*--------------------------------------------------------------------------------------------------------------------- */
 /* Request queue */
 
+/** Index bucket of requests with packet identifier pkt_id (not 0) */
+#define MQTT_REQ_INDEX(pkt_id) ((pkt_id) % MQTT_REQ_MAX_IN_FLIGHT)
+
 /**
  * Create request item
- * @param r_objs Pointer to request objects
- * @param r_objs_len Number of array entries
+ * @param client MQTT client
  * @param pkt_id Packet identifier of request
  * @param cb Packet callback to call when requests lifetime ends
  * @param arg Parameter following callback
  * @return Request or NULL if failed to create
  */
 static struct mqtt_request_t *
-mqtt_create_request(struct mqtt_request_t *r_objs, size_t r_objs_len, u16_t pkt_id, mqtt_request_cb_t cb, void *arg)
+mqtt_create_request(mqtt_client_t *client, u16_t pkt_id, mqtt_request_cb_t cb, void *arg)
 {
-  struct mqtt_request_t *r = NULL;
-  u8_t n;
-  LWIP_ASSERT("mqtt_create_request: r_objs != NULL", r_objs != NULL);
-  for (n = 0; n < r_objs_len; n++) {
-    /* Item point to itself if not in use */
-    if (r_objs[n].next == &r_objs[n]) {
-      r = &r_objs[n];
-      r->next = NULL;
-      r->cb = cb;
-      r->arg = arg;
-      r->pkt_id = pkt_id;
-      break;
-    }
+  struct mqtt_request_t *r = client->req_free;
+  if (r != NULL) {
+    client->req_free = r->next;
+    r->next = NULL;
+    r->prev = NULL;
+    r->id_next = NULL;
+    r->cb = cb;
+    r->arg = arg;
+    r->pkt_id = pkt_id;
   }
   return r;
 }
@@ -306,140 +468,169 @@ mqtt_create_request(struct mqtt_request_t *r_objs, size_t r_objs_len, u16_t pkt_
 
 /**
  * Append request to pending request queue
- * @param tail Pointer to request queue tail pointer
+ * @param client MQTT client
  * @param r Request to append
  */
 static void
-mqtt_append_request(struct mqtt_request_t **tail, struct mqtt_request_t *r)
+mqtt_append_request(mqtt_client_t *client, struct mqtt_request_t *r)
 {
-  struct mqtt_request_t *head = NULL;
-  s16_t time_before = 0;
-  struct mqtt_request_t *iter;
-
-  LWIP_ASSERT("mqtt_append_request: tail != NULL", tail != NULL);
-
-  /* Iterate trough queue to find head, and count total timeout time */
-  for (iter = *tail; iter != NULL; iter = iter->next) {
-    time_before += iter->timeout_diff;
-    head = iter;
+  /* QoS 0 publishes are completed in order and not looked up by pkt_id */
+  struct mqtt_request_queue_t *q = (r->pkt_id == 0) ? &client->pend_qos0 : &client->pend_req;
+
+  /* All requests have the same timeout, so each queue stays sorted by it */
+  r->timeout = client->req_time + MQTT_REQ_TIMEOUT;
+  r->next = NULL;
+  r->prev = q->tail;
+  if (q->tail == NULL) {
+    q->head = r;
+  } else {
+    q->tail->next = r;
   }
+  q->tail = r;
 
-  LWIP_ASSERT("mqtt_append_request: time_before <= MQTT_REQ_TIMEOUT", time_before <= MQTT_REQ_TIMEOUT);
-  r->timeout_diff = MQTT_REQ_TIMEOUT - time_before;
-  if (head == NULL) {
-    *tail = r;
-  } else {
-    head->next = r;
+  if (r->pkt_id != 0) {
+    struct mqtt_request_t **bucket = &client->pend_req_index[MQTT_REQ_INDEX(r->pkt_id)];
+    r->id_next = *bucket;
+    *bucket = r;
   }
 }
 
 
 /**
  * Delete request item
+ * @param client MQTT client
  * @param r Request item to delete
  */
 static void
-mqtt_delete_request(struct mqtt_request_t *r)
+mqtt_delete_request(mqtt_client_t *client, struct mqtt_request_t *r)
 {
   if (r != NULL) {
-    r->next = r;
+    r->next = client->req_free;
+    client->req_free = r;
+  }
+}
+
+/**
+ * Remove a request item from its pending request queue
+ * @param client MQTT client
+ * @param r Request item to unchain
+ */
+static void
+mqtt_unchain_request(mqtt_client_t *client, struct mqtt_request_t *r)
+{
+  struct mqtt_request_queue_t *q = (r->pkt_id == 0) ? &client->pend_qos0 : &client->pend_req;
+
+  if (r->prev == NULL) {
+    q->head = r->next;
+  } else {
+    r->prev->next = r->next;
+  }
+  if (r->next == NULL) {
+    q->tail = r->prev;
+  } else {
+    r->next->prev = r->prev;
+  }
+  r->next = NULL;
+  r->prev = NULL;
+
+  if (r->pkt_id != 0) {
+    struct mqtt_request_t **iter = &client->pend_req_index[MQTT_REQ_INDEX(r->pkt_id)];
+    while (*iter != r) {
+      LWIP_ASSERT("mqtt_unchain_request: request not indexed", *iter != NULL);
+      iter = &(*iter)->id_next;
+    }
+    *iter = r->id_next;
+    r->id_next = NULL;
   }
 }
 
 /**
  * Remove a request item with a specific packet identifier from request queue
- * @param tail Pointer to request queue tail pointer
- * @param pkt_id Packet identifier of request to take
+ * @param client MQTT client
+ * @param pkt_id Packet identifier of request to take, 0 takes the oldest QoS 0 publish
  * @return Request item if found, NULL if not
  */
 static struct mqtt_request_t *
-mqtt_take_request(struct mqtt_request_t **tail, u16_t pkt_id)
+mqtt_take_request(mqtt_client_t *client, u16_t pkt_id)
 {
-  struct mqtt_request_t *iter = NULL, *prev = NULL;
-  LWIP_ASSERT("mqtt_take_request: tail != NULL", tail != NULL);
-  /* Search all request for pkt_id */
-  for (iter = *tail; iter != NULL; iter = iter->next) {
-    if (iter->pkt_id == pkt_id) {
-      break;
+  struct mqtt_request_t *iter;
+  if (pkt_id == 0) {
+    iter = client->pend_qos0.head;
+  } else {
+    for (iter = client->pend_req_index[MQTT_REQ_INDEX(pkt_id)]; iter != NULL; iter = iter->id_next) {
+      if (iter->pkt_id == pkt_id) {
+        break;
+      }
     }
-    prev = iter;
   }
-
-  /* If request was found */
   if (iter != NULL) {
-    /* unchain */
-    if (prev == NULL) {
-      *tail = iter->next;
-    } else {
-      prev->next = iter->next;
-    }
-    /* If exists, add remaining timeout time for the request to next */
-    if (iter->next != NULL) {
-      iter->next->timeout_diff += iter->timeout_diff;
-    }
-    iter->next = NULL;
+    mqtt_unchain_request(client, iter);
   }
   return iter;
 }
 
 /**
- * Handle requests timeout
- * @param tail Pointer to request queue tail pointer
- * @param t Time since last call in seconds
+ * Time out the expired requests at the head of a pending request queue
+ * @param client MQTT client
+ * @param q Pending request queue
  */
 static void
-mqtt_request_time_elapsed(struct mqtt_request_t **tail, u8_t t)
+mqtt_request_queue_expire(mqtt_client_t *client, struct mqtt_request_queue_t *q)
 {
   struct mqtt_request_t *r;
-  LWIP_ASSERT("mqtt_request_time_elapsed: tail != NULL", tail != NULL);
-  r = *tail;
-  while (t > 0 && r != NULL) {
-    if (t >= r->timeout_diff) {
-      t -= (u8_t)r->timeout_diff;
-      /* Unchain */
-      *tail = r->next;
-      /* Notify upper layer about timeout */
-      if (r->cb != NULL) {
-        r->cb(r->arg, ERR_TIMEOUT);
-      }
-      mqtt_delete_request(r);
-      /* Tail might be be modified in callback, so re-read it in every iteration */
-      r = *(struct mqtt_request_t *const volatile *)tail;
-    } else {
-      r->timeout_diff -= t;
-      t = 0;
+  /* Head might be be modified in callback, so re-read it in every iteration */
+  while (((r = *(struct mqtt_request_t *const volatile *)&q->head) != NULL) &&
+         ((s32_t)(client->req_time - r->timeout) >= 0)) {
+    mqtt_unchain_request(client, r);
+    /* Notify upper layer about timeout */
+    if (r->cb != NULL) {
+      r->cb(r->arg, ERR_TIMEOUT);
     }
+    mqtt_delete_request(client, r);
   }
 }
 
+/**
+ * Handle requests timeout
+ * @param client MQTT client
+ * @param t Time since last call in seconds
+ */
+static void
+mqtt_request_time_elapsed(mqtt_client_t *client, u8_t t)
+{
+  client->req_time += t;
+  mqtt_request_queue_expire(client, &client->pend_req);
+  mqtt_request_queue_expire(client, &client->pend_qos0);
+}
+
 /**
  * Free all request items
- * @param tail Pointer to request queue tail pointer
+ * @param client MQTT client
  */
 static void
-mqtt_clear_requests(struct mqtt_request_t **tail)
+mqtt_clear_requests(mqtt_client_t *client)
 {
-  struct mqtt_request_t *iter, *next;
-  LWIP_ASSERT("mqtt_clear_requests: tail != NULL", tail != NULL);
-  for (iter = *tail; iter != NULL; iter = next) {
-    next = iter->next;
-    mqtt_delete_request(iter);
+  struct mqtt_request_t *r;
+  while ((r = client->pend_req.head) != NULL) {
+    mqtt_unchain_request(client, r);
+    mqtt_delete_request(client, r);
+  }
+  while ((r = client->pend_qos0.head) != NULL) {
+    mqtt_unchain_request(client, r);
+    mqtt_delete_request(client, r);
   }
-  *tail = NULL;
 }
 /**
  * Initialize all request items
- * @param r_objs Pointer to request objects
- * @param r_objs_len Number of array entries
+ * @param client MQTT client
  */
 static void
-mqtt_init_requests(struct mqtt_request_t *r_objs, size_t r_objs_len)
+mqtt_init_requests(mqtt_client_t *client)
 {
-  u8_t n;
-  LWIP_ASSERT("mqtt_init_requests: r_objs != NULL", r_objs != NULL);
-  for (n = 0; n < r_objs_len; n++) {
-    /* Item pointing to itself indicates unused */
-    r_objs[n].next = &r_objs[n];
+  size_t n;
+  client->req_free = NULL;
+  for (n = LWIP_ARRAYSIZE(client->req_list); n > 0; n--) {
+    mqtt_delete_request(client, &client->req_list[n - 1]);
   }
 }
 
@@ -492,7 +683,7 @@ mqtt_output_append_string(struct mqtt_ringbuf_t *rb, const char *str, u16_t leng
 
 static void
 mqtt_output_append_fixed_header(struct mqtt_ringbuf_t *rb, u8_t msg_type, u8_t fdup,
-                                u8_t fqos, u8_t fretain, u16_t r_length)
+                                u8_t fqos, u8_t fretain, u32_t r_length)
 {
   /* Start with control byte */
   mqtt_output_append_u8(rb, (((msg_type & 0x0f) << 4) | ((fdup & 1) << 3) | ((fqos & 3) << 1) | (fretain & 1)));
@@ -544,18 +735,34 @@ mqtt_close(mqtt_client_t *client, mqtt_connection_status_t reason)
     altcp_recv(client->conn, NULL);
     altcp_err(client->conn,  NULL);
     altcp_sent(client->conn, NULL);
-    res = altcp_close(client->conn);
-    if (res != ERR_OK) {
+#if MQTT_OUTPUT_NOCOPY
+    if (client->out_ref_num > 0) {
+      /* queued segments reference application payloads: drop them now */
       altcp_abort(client->conn);
-      LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_close: Close err=%s\n", lwip_strerr(res)));
+    } else
+#endif /* MQTT_OUTPUT_NOCOPY */
+    {
+      res = altcp_close(client->conn);
+      if (res != ERR_OK) {
+        altcp_abort(client->conn);
+        LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_close: Close err=%s\n", lwip_strerr(res)));
+      }
     }
     client->conn = NULL;
   }
+#if MQTT_OUTPUT_NOCOPY
+  mqtt_output_ref_release(client, 1);
+#endif /* MQTT_OUTPUT_NOCOPY */
 
   /* Remove all pending requests */
-  mqtt_clear_requests(&client->pend_req_queue);
+  mqtt_clear_requests(client);
   /* Stop cyclic timer */
   sys_untimeout(mqtt_cyclic_timer, client);
+#if MQTT_OUTPUT_BATCH_LEN
+  sys_untimeout(mqtt_output_batch_timeout, client);
+  client->batch_timer = 0;
+  client->batch_len = 0;
+#endif /* MQTT_OUTPUT_BATCH_LEN */
 
   /* Notify upper layer of disconnection if changed state */
   if (client->conn_state != TCP_DISCONNECTED) {
@@ -589,7 +796,7 @@ mqtt_cyclic_timer(void *arg)
     }
   } else if (client->conn_state == MQTT_CONNECTED) {
     /* Handle timeout for pending requests */
-    mqtt_request_time_elapsed(&client->pend_req_queue, MQTT_CYCLIC_TIMER_INTERVAL);
+    mqtt_request_time_elapsed(client, MQTT_CYCLIC_TIMER_INTERVAL);
 
     /* keep_alive > 0 means keep alive functionality shall be used */
     if (client->keep_alive > 0) {
@@ -638,7 +845,7 @@ pub_ack_rec_rel_response(mqtt_client_t *client, u8_t msg, u16_t pkt_id, u8_t qos
   if (mqtt_output_check_space(&client->output, 2)) {
     mqtt_output_append_fixed_header(&client->output, msg, 0, qos, 0, 2);
     mqtt_output_append_u16(&client->output, pkt_id);
-    mqtt_output_send(&client->output, client->conn);
+    mqtt_output_send(client);
   } else {
     LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("pub_ack_rec_rel_response: OOM creating response: %s with pkt_id: %d\n",
                                    mqtt_msg_type_to_str(msg), pkt_id));
@@ -801,7 +1008,7 @@ mqtt_message_received(mqtt_client_t *client, u8_t fixed_hdr_idx, u16_t length, u
 
     } else if (pkt_type == MQTT_MSG_TYPE_SUBACK || pkt_type == MQTT_MSG_TYPE_UNSUBACK ||
                pkt_type == MQTT_MSG_TYPE_PUBCOMP || pkt_type == MQTT_MSG_TYPE_PUBACK) {
-      struct mqtt_request_t *r = mqtt_take_request(&client->pend_req_queue, pkt_id);
+      struct mqtt_request_t *r = mqtt_take_request(client, pkt_id);
       if (r != NULL) {
         LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_message_received: %s response with id %d\n", mqtt_msg_type_to_str(pkt_type), pkt_id));
         if (pkt_type == MQTT_MSG_TYPE_SUBACK) {
@@ -814,7 +1021,7 @@ mqtt_message_received(mqtt_client_t *client, u8_t fixed_hdr_idx, u16_t length, u
         } else if (r->cb != NULL) {
           r->cb(r->arg, ERR_OK);
         }
-        mqtt_delete_request(r);
+        mqtt_delete_request(client, r);
       } else {
         LWIP_DEBUGF(MQTT_DEBUG_WARN, ( "mqtt_message_received: Received %s reply, with wrong pkt_id: %d\n", mqtt_msg_type_to_str(pkt_type), pkt_id));
       }
@@ -980,6 +1187,11 @@ mqtt_tcp_sent_cb(void *arg, struct altcp_pcb *tpcb, u16_t len)
   LWIP_UNUSED_ARG(tpcb);
   LWIP_UNUSED_ARG(len);
 
+#if MQTT_OUTPUT_NOCOPY
+  client->tx_acked += len;
+  mqtt_output_ref_release(client, 0);
+#endif /* MQTT_OUTPUT_NOCOPY */
+
   if (client->conn_state == MQTT_CONNECTED) {
     struct mqtt_request_t *r;
 
@@ -987,15 +1199,15 @@ mqtt_tcp_sent_cb(void *arg, struct altcp_pcb *tpcb, u16_t len)
     client->cyclic_tick = 0;
     client->server_watchdog = 0;
     /* QoS 0 publish has no response from server, so call its callbacks here */
-    while ((r = mqtt_take_request(&client->pend_req_queue, 0)) != NULL) {
+    while ((r = mqtt_take_request(client, 0)) != NULL) {
       LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_tcp_sent_cb: Calling QoS 0 publish complete callback\n"));
       if (r->cb != NULL) {
         r->cb(r->arg, ERR_OK);
       }
-      mqtt_delete_request(r);
+      mqtt_delete_request(client, r);
     }
     /* Try send any remaining buffers from output queue */
-    mqtt_output_send(&client->output, client->conn);
+    mqtt_output_send(client);
   }
   return ERR_OK;
 }
@@ -1029,7 +1241,7 @@ mqtt_tcp_poll_cb(void *arg, struct altcp_pcb *tpcb)
   mqtt_client_t *client = (mqtt_client_t *)arg;
   if (client->conn_state == MQTT_CONNECTED) {
     /* Try send any remaining buffers from output queue */
-    mqtt_output_send(&client->output, tpcb);
+    mqtt_output_send(client);
   }
   return ERR_OK;
 }
@@ -1067,7 +1279,7 @@ mqtt_tcp_connect_cb(void *arg, struct altcp_pcb *tpcb, err_t err)
   client->cyclic_tick = 0;
 
   /* Start transmission from output queue, connect message is the first one out*/
-  mqtt_output_send(&client->output, client->conn);
+  mqtt_output_send(client);
 
   return ERR_OK;
 }
@@ -1127,13 +1339,13 @@ mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_
 
   LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_publish: Publish with payload length %d to topic \"%s\"\n", payload_length, topic));
 
-  r = mqtt_create_request(client->req_list, LWIP_ARRAYSIZE(client->req_list), pkt_id, cb, arg);
+  r = mqtt_create_request(client, pkt_id, cb, arg);
   if (r == NULL) {
     return ERR_MEM;
   }
 
   if (mqtt_output_check_space(&client->output, remaining_length) == 0) {
-    mqtt_delete_request(r);
+    mqtt_delete_request(client, r);
     return ERR_MEM;
   }
   /* Append fixed header */
@@ -1152,10 +1364,109 @@ mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_
     mqtt_output_append_buf(&client->output, payload, payload_length);
   }
 
-  mqtt_append_request(&client->pend_req_queue, r);
-  mqtt_output_send(&client->output, client->conn);
+  mqtt_append_request(client, r);
+#if MQTT_OUTPUT_BATCH_LEN
+  mqtt_output_batch(client);
+#else /* MQTT_OUTPUT_BATCH_LEN */
+  mqtt_output_send(client);
+#endif /* MQTT_OUTPUT_BATCH_LEN */
+  return ERR_OK;
+}
+
+#if MQTT_OUTPUT_NOCOPY
+/**
+ * @ingroup mqtt
+ * MQTT publish function that does not copy the payload: only the header goes
+ * through the output ring buffer, the payload is passed to TCP by reference.
+ * It must stay unchanged until free_cb is called. The payload may be larger
+ * than MQTT_OUTPUT_RINGBUF_SIZE.
+ * @param client MQTT client
+ * @param topic Publish topic string
+ * @param payload Data to publish
+ * @param payload_length Length of payload (> 0)
+ * @param qos Quality of service, 0 1 or 2
+ * @param retain MQTT retain flag
+ * @param cb Callback to call when publish is complete or has timed out
+ * @param arg User supplied argument to publish and free callback
+ * @param free_cb Callback to call when the payload is not referenced any more
+ * @return ERR_OK if successful (free_cb will be called)
+ *         ERR_CONN if client is disconnected
+ *         ERR_MEM if short on memory
+ */
+err_t
+mqtt_publish_nocopy(mqtt_client_t *client, const char *topic, const void *payload, u32_t payload_length, u8_t qos,
+                    u8_t retain, mqtt_request_cb_t cb, void *arg, mqtt_payload_free_cb_t free_cb)
+{
+  struct mqtt_request_t *r;
+  struct mqtt_output_ref *ref;
+  u16_t pkt_id;
+  size_t topic_strlen;
+  u16_t topic_len;
+  u16_t header_len;
+  u32_t remaining_length;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ASSERT("mqtt_publish_nocopy: client != NULL", client);
+  LWIP_ASSERT("mqtt_publish_nocopy: topic != NULL", topic);
+  LWIP_ERROR("mqtt_publish_nocopy: no payload", (payload != NULL) && (payload_length > 0), return ERR_ARG);
+  LWIP_ERROR("mqtt_publish_nocopy: TCP disconnected", (client->conn_state != TCP_DISCONNECTED), return ERR_CONN);
+
+  topic_strlen = strlen(topic);
+  LWIP_ERROR("mqtt_publish_nocopy: topic length overflow", (topic_strlen <= (0xFFFF - 4 - 3)), return ERR_ARG);
+  topic_len = (u16_t)topic_strlen;
+  header_len = (u16_t)(2 + topic_len + ((qos > 0) ? 2 : 0));
+  /* Maximum value of the remaining length field (4 bytes) */
+  LWIP_ERROR("mqtt_publish_nocopy: total length overflow", (payload_length <= 0x0FFFFFFFUL - header_len), return ERR_ARG);
+  remaining_length = header_len + payload_length;
+
+  if (client->out_ref_num >= MQTT_OUTPUT_NOCOPY) {
+    return ERR_MEM;
+  }
+  /* the remaining length field may need up to 3 more bytes than checked for header_len */
+  if (mqtt_output_check_space(&client->output, (u16_t)(header_len + 3)) == 0) {
+    return ERR_MEM;
+  }
+  if (qos > 0) {
+    /* Generate pkt_id id for QoS1 and 2 */
+    pkt_id = msg_generate_packet_id(client);
+  } else {
+    /* Use reserved value pkt_id 0 for QoS 0 in request handle */
+    pkt_id = 0;
+  }
+
+  LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_publish_nocopy: Publish with payload length %"U32_F" to topic \"%s\"\n", payload_length, topic));
+
+  r = mqtt_create_request(client, pkt_id, cb, arg);
+  if (r == NULL) {
+    return ERR_MEM;
+  }
+
+  mqtt_output_append_fixed_header(&client->output, MQTT_MSG_TYPE_PUBLISH, 0, qos, retain, remaining_length);
+  mqtt_output_append_string(&client->output, topic, topic_len);
+  if (qos > 0) {
+    mqtt_output_append_u16(&client->output, pkt_id);
+  }
+
+  /* The payload follows the header just appended */
+  ref = &client->out_ref[(client->out_ref_first + client->out_ref_num) % MQTT_OUTPUT_NOCOPY];
+  ref->payload = (const u8_t *)payload;
+  ref->len = payload_length;
+  ref->written = 0;
+  ref->ring_pos = client->ring_sent + mqtt_ringbuf_len(&client->output);
+  ref->end = 0;
+  ref->free_cb = free_cb;
+  ref->arg = arg;
+  client->out_ref_num++;
+
+  mqtt_append_request(client, r);
+#if MQTT_OUTPUT_BATCH_LEN
+  mqtt_output_batch(client);
+#else /* MQTT_OUTPUT_BATCH_LEN */
+  mqtt_output_send(client);
+#endif /* MQTT_OUTPUT_BATCH_LEN */
   return ERR_OK;
 }
+#endif /* MQTT_OUTPUT_NOCOPY */
 
 
 /**
@@ -1198,13 +1509,13 @@ mqtt_sub_unsub(mqtt_client_t *client, const char *topic, u8_t qos, mqtt_request_
   }
 
   pkt_id = msg_generate_packet_id(client);
-  r = mqtt_create_request(client->req_list, LWIP_ARRAYSIZE(client->req_list), pkt_id, cb, arg);
+  r = mqtt_create_request(client, pkt_id, cb, arg);
   if (r == NULL) {
     return ERR_MEM;
   }
 
   if (mqtt_output_check_space(&client->output, remaining_length) == 0) {
-    mqtt_delete_request(r);
+    mqtt_delete_request(client, r);
     return ERR_MEM;
   }
 
@@ -1220,8 +1531,8 @@ mqtt_sub_unsub(mqtt_client_t *client, const char *topic, u8_t qos, mqtt_request_
     mqtt_output_append_u8(&client->output, LWIP_MIN(qos, 2));
   }
 
-  mqtt_append_request(&client->pend_req_queue, r);
-  mqtt_output_send(&client->output, client->conn);
+  mqtt_append_request(client, r);
+  mqtt_output_send(client);
   return ERR_OK;
 }
 
@@ -1307,7 +1618,7 @@ mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *ip_addr, u16_t port,
   client->connect_arg = arg;
   client->connect_cb = cb;
   client->keep_alive = client_info->keep_alive;
-  mqtt_init_requests(client->req_list, LWIP_ARRAYSIZE(client->req_list));
+  mqtt_init_requests(client);
 
   /* Build connect message */
   if (client_info->will_topic != NULL && client_info->will_msg != NULL) {
@@ -1428,6 +1739,23 @@ tcp_fail:
 }
 
 
+#if MQTT_OUTPUT_BATCH_LEN
+/**
+ * @ingroup mqtt
+ * Send publishes deferred by MQTT_OUTPUT_BATCH_LEN now
+ * @param client MQTT client
+ */
+void
+mqtt_flush(mqtt_client_t *client)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ASSERT("mqtt_flush: client != NULL", client);
+  if (client->conn != NULL) {
+    mqtt_output_send(client);
+  }
+}
+#endif /* MQTT_OUTPUT_BATCH_LEN */
+
 /**
  * @ingroup mqtt
  * Disconnect from MQTT server
@@ -45,11 +45,29 @@
 
  smtp_send_mail_bodycback("sender", "recipient", "subject",
                 my_smtp_bodydh_fn, my_smtp_result_fn, some_argument);
+@endcode
+ *
+ * SMTP_BODY_REGIONS usage (the first region continues the header, so it has to
+ * end the header with an empty line; regions and data must stay untouched
+ * until the result callback is called):
+@code{.c}
+ static const char my_head[] = "MIME-Version: 1.0\r\n"
+   "Content-Type: multipart/mixed; boundary=\"b\"\r\n\r\n"
+   "--b\r\nContent-Type: text/plain\r\n\r\nlogs attached\r\n"
+   "--b\r\nContent-Type: application/octet-stream\r\n"
+   "Content-Transfer-Encoding: base64\r\n\r\n";
+ static const char my_tail[] = "--b--\r\n";
+ static const struct smtp_body_region my_regions[] = {
+   { my_head, sizeof(my_head) - 1, 0 },
+   { log_buffer, sizeof(log_buffer), 1 },
+   { my_tail, sizeof(my_tail) - 1, 0 }
+ };
+
+ smtp_send_mail_regions("sender", "recipient", "subject", my_regions,
+                LWIP_ARRAYSIZE(my_regions), my_smtp_result_fn, some_argument);
 @endcode
  *
  * @todo:
- * - attachments (the main difficulty here is streaming base64-encoding to
- *   prevent having to allocate a buffer for the whole encoded file at once)
  * - test with more mail servers...
  *
  */
@@ -137,6 +155,7 @@
 #define SMTP_CMD_HEADER_3_LEN     12
 #define SMTP_CMD_HEADER_4         "\r\n\r\n"
 #define SMTP_CMD_HEADER_4_LEN     4
+#define SMTP_CMD_HEADER_4_REGIONS_LEN 2
 #define SMTP_CMD_BODY_FINISHED    "\r\n.\r\n"
 #define SMTP_CMD_BODY_FINISHED_LEN 5
 #define SMTP_CMD_QUIT             "QUIT\r\n"
@@ -176,6 +195,17 @@ enum bdh_handler_state {
 };
 #endif
 
+#if SMTP_BODY_REGIONS
+/** base64 lines are 76 characters (57 source bytes) plus CRLF */
+#define SMTP_B64_LINE_SRC_LEN     57
+#define SMTP_B64_LINE_LEN         76
+#define SMTP_B64_BLOCK_SRC_LEN    (SMTP_BODY_B64_LINES * SMTP_B64_LINE_SRC_LEN)
+#define SMTP_B64_BLOCK_LEN        (SMTP_BODY_B64_LINES * (SMTP_B64_LINE_LEN + SMTP_CRLF_LEN))
+#if SMTP_B64_BLOCK_LEN > 0xffff
+#error "SMTP_BODY_B64_LINES is too big"
+#endif
+#endif /* SMTP_BODY_REGIONS */
+
 /** State for SMTP client state machine */
 enum smtp_session_state {
   SMTP_NULL,
@@ -273,6 +303,22 @@ struct smtp_session {
 #if SMTP_BODYDH
   struct smtp_bodydh_state *bodydh;
 #endif /* SMTP_BODYDH */
+#if SMTP_BODY_REGIONS
+  /** body regions for smtp_send_mail_regions, NULL otherwise */
+  const struct smtp_body_region *regions;
+  /** number of body regions */
+  u16_t num_regions;
+  /** index of the region currently being sent */
+  u16_t region;
+  /** amount of data from the current region already written (raw) or encoded (base64) */
+  size_t region_off;
+  /** base64 encode buffer, SMTP_B64_BLOCK_LEN bytes allocated behind the session */
+  char *b64_block;
+  /** length of the encoded data in b64_block */
+  u16_t b64_len;
+  /** amount of data from b64_block already written */
+  u16_t b64_sent;
+#endif /* SMTP_BODY_REGIONS */
 };
 
 /** IP address or DNS name of the server to use for next SMTP request */
@@ -312,6 +358,9 @@ static void   smtp_process(void *arg, struct altcp_pcb *pcb, struct pbuf *p);
 #if SMTP_BODYDH
 static void   smtp_send_body_data_handler(struct smtp_session *s, struct altcp_pcb *pcb);
 #endif /* SMTP_BODYDH */
+#if SMTP_BODY_REGIONS
+static u8_t   smtp_send_body_regions(struct smtp_session *s, struct altcp_pcb *pcb);
+#endif /* SMTP_BODY_REGIONS */
 
 
 #ifdef LWIP_DEBUG
@@ -516,6 +565,18 @@ smtp_send_mail_alloced(struct smtp_session *s)
       goto leave;
     }
   }
+#if SMTP_BODY_REGIONS
+  if (s->regions != NULL) {
+    u16_t i;
+    for (i = 0; i < s->num_regions; i++) {
+      if (!s->regions[i].base64 &&
+          (smtp_verify((const char*)s->regions[i].data, s->regions[i].len, 1) != ERR_OK)) {
+        err = ERR_ARG;
+        goto leave;
+      }
+    }
+  }
+#endif /* SMTP_BODY_REGIONS */
 #endif /* SMTP_CHECK_DATA */
 
 #if SMTP_COPY_AUTHDATA
@@ -896,7 +957,7 @@ smtp_dns_found(const char* hostname, const ip_addr_t *ipaddr, void *arg)
 }
 #endif /* LWIP_DNS */
 
-#if SMTP_SUPPORT_AUTH_PLAIN || SMTP_SUPPORT_AUTH_LOGIN
+#if SMTP_SUPPORT_AUTH_PLAIN || SMTP_SUPPORT_AUTH_LOGIN || SMTP_BODY_REGIONS
 
 /** Table 6-bit-index-to-ASCII used for base64-encoding */
 static const char base64_table[] = {
@@ -909,6 +970,9 @@ static const char base64_table[] = {
   '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
   '+', '/'
 };
+#endif /* SMTP_SUPPORT_AUTH_PLAIN || SMTP_SUPPORT_AUTH_LOGIN || SMTP_BODY_REGIONS */
+
+#if SMTP_SUPPORT_AUTH_PLAIN || SMTP_SUPPORT_AUTH_LOGIN
 
 /** Base64 encoding */
 static size_t
@@ -1176,8 +1240,16 @@ static enum smtp_session_state
 smtp_prepare_header(struct smtp_session *s, u16_t *tx_buf_len)
 {
   char *target = s->tx_buf;
-  int len = SMTP_CMD_HEADER_1_LEN + SMTP_CMD_HEADER_2_LEN +
-    SMTP_CMD_HEADER_3_LEN + SMTP_CMD_HEADER_4_LEN + s->from_len + s->to_len +
+  int header_4_len = SMTP_CMD_HEADER_4_LEN;
+  int len;
+#if SMTP_BODY_REGIONS
+  if (s->regions != NULL) {
+    /* only end the Subject line, the first region ends the header */
+    header_4_len = SMTP_CMD_HEADER_4_REGIONS_LEN;
+  }
+#endif /* SMTP_BODY_REGIONS */
+  len = SMTP_CMD_HEADER_1_LEN + SMTP_CMD_HEADER_2_LEN +
+    SMTP_CMD_HEADER_3_LEN + header_4_len + s->from_len + s->to_len +
     s->subject_len;
   LWIP_ASSERT("tx_buf overflow detected", len > 0 && len <= SMTP_TX_BUF_LEN);
   *tx_buf_len = (u16_t)len;
@@ -1195,7 +1267,7 @@ smtp_prepare_header(struct smtp_session *s, u16_t *tx_buf_len)
   target += SMTP_CMD_HEADER_3_LEN;
   MEMCPY(target, s->subject, s->subject_len);
   target += s->subject_len;
-  SMEMCPY(target, SMTP_CMD_HEADER_4, SMTP_CMD_HEADER_4_LEN);
+  SMEMCPY(target, SMTP_CMD_HEADER_4, header_4_len);
 
   return SMTP_BODY;
 }
@@ -1218,6 +1290,14 @@ smtp_send_body(struct smtp_session *s, struct altcp_pcb *pcb)
   err_t err;
 
   if (s->state == SMTP_BODY) {
+#if SMTP_BODY_REGIONS
+    if (s->regions != NULL) {
+      if (!smtp_send_body_regions(s, pcb)) {
+        /* wait for more sndbuf */
+        return;
+      }
+    } else
+#endif /* SMTP_BODY_REGIONS */
 #if SMTP_BODYDH
     if (s->bodydh) {
       smtp_send_body_data_handler(s, pcb);
@@ -1553,4 +1633,169 @@ smtp_send_body_data_handler(struct smtp_session *s, struct altcp_pcb *pcb)
 }
 #endif /* SMTP_BODYDH */
 
+#if SMTP_BODY_REGIONS
+/** Same as smtp_send_mail_static, but the body is built from a list of
+ * memory regions that are streamed out without being copied into an internal
+ * buffer. Regions with 'base64' set are encoded in blocks of
+ * SMTP_BODY_B64_LINES lines of 76 characters each.
+ * The first region follows the 'Subject' header line, so it must end the
+ * header with an empty line (after adding e.g. MIME headers).
+ * WARNING: the strings, the region array and the data it points to must
+ *          stay untouched until the callback function is called (unless
+ *          the function returns != ERR_OK)
+ */
+err_t
+smtp_send_mail_regions(const char *from, const char* to, const char* subject,
+  const struct smtp_body_region *regions, u16_t num_regions,
+  smtp_result_fn callback_fn, void* callback_arg)
+{
+  struct smtp_session* s;
+  size_t len;
+  size_t mem_len = sizeof(struct smtp_session) + SMTP_B64_BLOCK_LEN;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("smtp_send_mail_regions: invalid regions", (regions != NULL) && (num_regions > 0),
+             return ERR_ARG;);
+
+  if (mem_len > 0xffff) {
+    /* too long! */
+    return ERR_MEM;
+  }
+  s = (struct smtp_session*)SMTP_STATE_MALLOC((mem_size_t)mem_len);
+  if (s == NULL) {
+    return ERR_MEM;
+  }
+  memset(s, 0, sizeof(struct smtp_session));
+  /* initialize the structure */
+  s->from = from;
+  len = strlen(from);
+  LWIP_ASSERT("string is too long", len <= 0xffff);
+  s->from_len = (u16_t)len;
+  s->to = to;
+  len = strlen(to);
+  LWIP_ASSERT("string is too long", len <= 0xffff);
+  s->to_len = (u16_t)len;
+  s->subject = subject;
+  len = strlen(subject);
+  LWIP_ASSERT("string is too long", len <= 0xffff);
+  s->subject_len = (u16_t)len;
+  s->regions = regions;
+  s->num_regions = num_regions;
+  s->b64_block = (char*)s + sizeof(struct smtp_session);
+  s->callback_fn = callback_fn;
+  s->callback_arg = callback_arg;
+  /* call the actual implementation of this function */
+  return smtp_send_mail_alloced(s);
+}
+
+/** Base64-encode the next block of a region into s->b64_block: up to
+ * SMTP_BODY_B64_LINES lines of 76 characters, each terminated by CRLF.
+ * The last line of a region is padded and terminated, too.
+ */
+static void
+smtp_base64_encode_block(struct smtp_session *s, const struct smtp_body_region *r)
+{
+  const u8_t *src = (const u8_t*)r->data + s->region_off;
+  size_t src_len = LWIP_MIN(r->len - s->region_off, SMTP_B64_BLOCK_SRC_LEN);
+  char *target = s->b64_block;
+  size_t i;
+  u16_t t = 0;
+  u8_t col = 0;
+
+  for (i = 0; i + 3 <= src_len; i += 3) {
+    u32_t v = ((u32_t)src[i] << 16) | ((u32_t)src[i + 1] << 8) | src[i + 2];
+    target[t++] = base64_table[(v >> 18) & 0x3f];
+    target[t++] = base64_table[(v >> 12) & 0x3f];
+    target[t++] = base64_table[(v >> 6) & 0x3f];
+    target[t++] = base64_table[v & 0x3f];
+    col = (u8_t)(col + 4);
+    if (col == SMTP_B64_LINE_LEN) {
+      target[t++] = '\r';
+      target[t++] = '\n';
+      col = 0;
+    }
+  }
+  if (i < src_len) {
+    /* 1 or 2 bytes left: only at the end of the region since the block
+       source length is a multiple of 3 */
+    u32_t v = (u32_t)src[i] << 16;
+    if (i + 1 < src_len) {
+      v |= (u32_t)src[i + 1] << 8;
+    }
+    target[t++] = base64_table[(v >> 18) & 0x3f];
+    target[t++] = base64_table[(v >> 12) & 0x3f];
+    target[t++] = (i + 1 < src_len) ? base64_table[(v >> 6) & 0x3f] : '=';
+    target[t++] = '=';
+    col = (u8_t)(col + 4);
+  }
+  if (col != 0) {
+    target[t++] = '\r';
+    target[t++] = '\n';
+  }
+  LWIP_ASSERT("b64_block overflow detected", t <= SMTP_B64_BLOCK_LEN);
+  s->region_off += src_len;
+  s->b64_len = t;
+  s->b64_sent = 0;
+}
+
+/** Send as much of the body regions as fits into sndbuf.
+ * Plain regions are passed to altcp_write without TCP_WRITE_FLAG_COPY, so
+ * the segments reference the application memory, base64 regions are encoded
+ * block by block and the block is copied (it is reused for the next block).
+ *
+ * @returns 1 if all regions have been written, 0 if waiting for sndbuf
+ */
+static u8_t
+smtp_send_body_regions(struct smtp_session *s, struct altcp_pcb *pcb)
+{
+  while (s->region < s->num_regions) {
+    const struct smtp_body_region *r = &s->regions[s->region];
+    u16_t snd_buf = altcp_sndbuf(pcb);
+    u16_t len;
+    err_t err;
+
+    if (r->base64) {
+      if (s->b64_sent == s->b64_len) {
+        if (s->region_off == r->len) {
+          s->region++;
+          s->region_off = 0;
+          s->b64_len = s->b64_sent = 0;
+          continue;
+        }
+        smtp_base64_encode_block(s, r);
+      }
+      len = (u16_t)LWIP_MIN((u16_t)(s->b64_len - s->b64_sent), snd_buf);
+      if (len == 0) {
+        return 0;
+      }
+      err = altcp_write(pcb, &s->b64_block[s->b64_sent], len,
+                        TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+      if (err != ERR_OK) {
+        return 0;
+      }
+      s->b64_sent = (u16_t)(s->b64_sent + len);
+    } else {
+      if (s->region_off == r->len) {
+        s->region++;
+        s->region_off = 0;
+        continue;
+      }
+      len = (u16_t)LWIP_MIN(r->len - s->region_off, snd_buf);
+      if (len == 0) {
+        return 0;
+      }
+      err = altcp_write(pcb, (const u8_t*)r->data + s->region_off, len, TCP_WRITE_FLAG_MORE);
+      if (err != ERR_OK) {
+        return 0;
+      }
+      s->region_off += len;
+    }
+    s->timer = SMTP_TIMEOUT_DATABLOCK;
+    LWIP_DEBUGF(SMTP_DEBUG_TRACE, ("smtp_send_body_regions: region %"U16_F": %"U16_F" bytes written\n",
+      s->region, len));
+  }
+  return 1;
+}
+#endif /* SMTP_BODY_REGIONS */
+
 #endif /* LWIP_TCP && LWIP_CALLBACK_API */
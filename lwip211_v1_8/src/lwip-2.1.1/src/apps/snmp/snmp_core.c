@@ -222,6 +222,18 @@ static u8_t snmp_num_mibs                          = 0;
 /* List of known mibs */
 static struct snmp_mib const *const *snmp_mibs = default_mibs;
 
+/* The leaf node the last GetNext lookup of the current request ended in. A walk asks for the
+ * instance after the one it got last, so the next lookup usually starts below the same node. */
+struct snmp_walk_cursor {
+  const struct snmp_mib *mib;
+  const struct snmp_node *node;
+  struct snmp_obj_id node_oid;
+};
+
+static u32_t snmp_walk_id;
+static u8_t snmp_walking;
+static struct snmp_walk_cursor snmp_walk_cursor;
+
 /**
  * @ingroup snmp_core
  * Sets the MIBs to use.
@@ -807,6 +819,37 @@ snmp_get_node_instance_from_oid(const u32_t *oid, u8_t oid_len, struct snmp_node
   return result;
 }
 
+/**
+ * Marks the start of a GetNext or GetBulk request. Until snmp_walk_end(), lookups resume at the
+ * leaf node the previous one ended in, and tables may keep a snapshot of their rows
+ * (see snmp_table_snapshot_next()).
+ */
+void
+snmp_walk_begin(void)
+{
+  snmp_walk_id++;
+  if (snmp_walk_id == 0) {
+    /* 0 means "no walk" to snmp_walk_current() */
+    snmp_walk_id++;
+  }
+  snmp_walking = 1;
+  snmp_walk_cursor.node = NULL;
+}
+
+void
+snmp_walk_end(void)
+{
+  snmp_walking = 0;
+  snmp_walk_cursor.node = NULL;
+}
+
+/** Returns an ID unique to the running GetNext or GetBulk request, or 0 outside of one */
+u32_t
+snmp_walk_current(void)
+{
+  return snmp_walking ? snmp_walk_id : 0;
+}
+
 u8_t
 snmp_get_next_node_instance_from_oid(const u32_t *oid, u8_t oid_len, snmp_validate_node_instance_method validate_node_instance_method, void *validate_node_instance_arg, struct snmp_obj_id *node_oid, struct snmp_node_instance *node_instance)
 {
@@ -835,7 +878,15 @@ snmp_get_next_node_instance_from_oid(const u32_t *oid, u8_t oid_len, snmp_valida
     u8_t oid_instance_len;
 
     /* check if OID directly references a node inside current MIB, in this case we have to ask this node for the next instance */
-    mn = snmp_mib_tree_resolve_exact(mib, start_oid, start_oid_len, &oid_instance_len);
+    if ((snmp_walk_cursor.node != NULL) && (snmp_walk_cursor.mib == mib) &&
+        (start_oid_len >= snmp_walk_cursor.node_oid.len) &&
+        (snmp_oid_compare(start_oid, snmp_walk_cursor.node_oid.len, snmp_walk_cursor.node_oid.id, snmp_walk_cursor.node_oid.len) == 0)) {
+      /* still below the node of the last lookup, no need to descend the tree again */
+      mn = snmp_walk_cursor.node;
+      oid_instance_len = start_oid_len - snmp_walk_cursor.node_oid.len;
+    } else {
+      mn = snmp_mib_tree_resolve_exact(mib, start_oid, start_oid_len, &oid_instance_len);
+    }
     if (mn != NULL) {
       snmp_oid_assign(node_oid, start_oid, start_oid_len - oid_instance_len); /* set oid to node */
       snmp_oid_assign(&node_instance->instance_oid, start_oid + (start_oid_len - oid_instance_len), oid_instance_len); /* set (relative) instance oid */
@@ -972,6 +1023,12 @@ snmp_get_next_node_instance_from_oid(const u32_t *oid, u8_t oid_len, snmp_valida
     return SNMP_ERR_ENDOFMIBVIEW;
   }
 
+  if (snmp_walking) {
+    snmp_walk_cursor.mib  = mib;
+    snmp_walk_cursor.node = mn;
+    snmp_oid_assign(&snmp_walk_cursor.node_oid, node_oid->id, node_oid->len - node_instance->instance_oid.len);
+  }
+
   return SNMP_ERR_NOERROR;
 }
 
@@ -72,6 +72,10 @@ const struct snmp_node *snmp_mib_tree_resolve_next(const struct snmp_mib *mib, c
 typedef u8_t (*snmp_validate_node_instance_method)(struct snmp_node_instance *, void *);
 
 u8_t snmp_get_node_instance_from_oid(const u32_t *oid, u8_t oid_len, struct snmp_node_instance *node_instance);
+void snmp_walk_begin(void);
+void snmp_walk_end(void);
+u32_t snmp_walk_current(void);
+
 u8_t snmp_get_next_node_instance_from_oid(const u32_t *oid, u8_t oid_len, snmp_validate_node_instance_method validate_node_instance_method, void *validate_node_instance_arg, struct snmp_obj_id *node_oid, struct snmp_node_instance *node_instance);
 
 #ifdef __cplusplus
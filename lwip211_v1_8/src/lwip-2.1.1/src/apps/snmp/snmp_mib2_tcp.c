@@ -161,35 +161,56 @@ static const struct snmp_oid_range tcp_ConnTable_oid_ranges[] = {
   { 0, 0xffff }  /* Port */
 };
 
+/* row OID of a pcb, returns 0 if the pcb is not part of the table */
+static u8_t
+tcp_ConnTable_row_oid(struct tcp_pcb *pcb, u32_t *oid)
+{
+  if (!IP_IS_V4_VAL(pcb->local_ip)) {
+    return 0;
+  }
+  snmp_ip4_to_oid(ip_2_ip4(&pcb->local_ip), &oid[0]);
+  oid[4] = pcb->local_port;
+
+  /* PCBs in state LISTEN are not connected and have no remote_ip or remote_port */
+  if (pcb->state == LISTEN) {
+    snmp_ip4_to_oid(IP4_ADDR_ANY4, &oid[5]);
+    oid[9] = 0;
+  } else {
+    if (IP_IS_V6_VAL(pcb->remote_ip)) { /* should never happen */
+      return 0;
+    }
+    snmp_ip4_to_oid(ip_2_ip4(&pcb->remote_ip), &oid[5]);
+    oid[9] = pcb->remote_port;
+  }
+  return 1;
+}
+
+/* everything but the state is in the row OID, which is what a snapshot keeps of a row */
 static snmp_err_t
-tcp_ConnTable_get_cell_value_core(struct tcp_pcb *pcb, const u32_t *column, union snmp_variant_value *value, u32_t *value_len)
+tcp_ConnTable_get_cell_value_core(const u32_t *row_oid, u32_t state, const u32_t *column, union snmp_variant_value *value, u32_t *value_len)
 {
+  ip4_addr_t ip;
+
   LWIP_UNUSED_ARG(value_len);
 
   /* value */
   switch (*column) {
     case 1: /* tcpConnState */
-      value->u32 = pcb->state + 1;
+      value->u32 = state;
       break;
     case 2: /* tcpConnLocalAddress */
-      value->u32 = ip_2_ip4(&pcb->local_ip)->addr;
+      snmp_oid_to_ip4(&row_oid[0], &ip);
+      value->u32 = ip.addr;
       break;
     case 3: /* tcpConnLocalPort */
-      value->u32 = pcb->local_port;
+      value->u32 = row_oid[4];
       break;
     case 4: /* tcpConnRemAddress */
-      if (pcb->state == LISTEN) {
-        value->u32 = IP4_ADDR_ANY4->addr;
-      } else {
-        value->u32 = ip_2_ip4(&pcb->remote_ip)->addr;
-      }
+      snmp_oid_to_ip4(&row_oid[5], &ip);
+      value->u32 = ip.addr;
       break;
     case 5: /* tcpConnRemPort */
-      if (pcb->state == LISTEN) {
-        value->u32 = 0;
-      } else {
-        value->u32 = pcb->remote_port;
-      }
+      value->u32 = row_oid[9];
       break;
     default:
       LWIP_ASSERT("invalid id", 0);
@@ -233,13 +254,13 @@ tcp_ConnTable_get_cell_value(const u32_t *column, const u32_t *row_oid, u8_t row
         if (pcb->state == LISTEN) {
           if (ip4_addr_cmp(&remote_ip, IP4_ADDR_ANY4) && (remote_port == 0)) {
             /* fill in object properties */
-            return tcp_ConnTable_get_cell_value_core(pcb, column, value, value_len);
+            return tcp_ConnTable_get_cell_value_core(row_oid, pcb->state + 1, column, value, value_len);
           }
         } else {
           if (IP_IS_V4_VAL(pcb->remote_ip) &&
               ip4_addr_cmp(&remote_ip, ip_2_ip4(&pcb->remote_ip)) && (remote_port == pcb->remote_port)) {
             /* fill in object properties */
-            return tcp_ConnTable_get_cell_value_core(pcb, column, value, value_len);
+            return tcp_ConnTable_get_cell_value_core(row_oid, pcb->state + 1, column, value, value_len);
           }
         }
       }
@@ -252,6 +273,24 @@ tcp_ConnTable_get_cell_value(const u32_t *column, const u32_t *row_oid, u8_t row
   return SNMP_ERR_NOSUCHINSTANCE;
 }
 
+#if SNMP_TABLE_SNAPSHOT_ROWS
+static void
+tcp_ConnTable_snapshot_fill(void)
+{
+  u8_t i;
+  struct tcp_pcb *pcb;
+  u32_t oid[LWIP_ARRAYSIZE(tcp_ConnTable_oid_ranges)];
+
+  for (i = 0; i < LWIP_ARRAYSIZE(tcp_pcb_lists); i++) {
+    for (pcb = *tcp_pcb_lists[i]; pcb != NULL; pcb = pcb->next) {
+      if (tcp_ConnTable_row_oid(pcb, oid)) {
+        snmp_table_snapshot_add(oid, LWIP_ARRAYSIZE(oid), pcb->state + 1);
+      }
+    }
+  }
+}
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
+
 static snmp_err_t
 tcp_ConnTable_get_next_cell_instance_and_value(const u32_t *column, struct snmp_obj_id *row_oid, union snmp_variant_value *value, u32_t *value_len)
 {
@@ -259,6 +298,18 @@ tcp_ConnTable_get_next_cell_instance_and_value(const u32_t *column, struct snmp_
   struct tcp_pcb *pcb;
   struct snmp_next_oid_state state;
   u32_t result_temp[LWIP_ARRAYSIZE(tcp_ConnTable_oid_ranges)];
+#if SNMP_TABLE_SNAPSHOT_ROWS
+  u32_t row_state;
+
+  switch (snmp_table_snapshot_next(tcp_ConnTable_snapshot_fill, row_oid, &row_state)) {
+    case SNMP_TABLE_SNAPSHOT_FOUND:
+      return tcp_ConnTable_get_cell_value_core(row_oid->id, row_state, column, value, value_len);
+    case SNMP_TABLE_SNAPSHOT_END:
+      return SNMP_ERR_NOSUCHINSTANCE;
+    default:
+      break;
+  }
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
 
   /* init struct to search next oid */
   snmp_next_oid_init(&state, row_oid->id, row_oid->len, result_temp, LWIP_ARRAYSIZE(tcp_ConnTable_oid_ranges));
@@ -269,22 +320,7 @@ tcp_ConnTable_get_next_cell_instance_and_value(const u32_t *column, struct snmp_
     while (pcb != NULL) {
       u32_t test_oid[LWIP_ARRAYSIZE(tcp_ConnTable_oid_ranges)];
 
-      if (IP_IS_V4_VAL(pcb->local_ip)) {
-        snmp_ip4_to_oid(ip_2_ip4(&pcb->local_ip), &test_oid[0]);
-        test_oid[4] = pcb->local_port;
-
-        /* PCBs in state LISTEN are not connected and have no remote_ip or remote_port */
-        if (pcb->state == LISTEN) {
-          snmp_ip4_to_oid(IP4_ADDR_ANY4, &test_oid[5]);
-          test_oid[9] = 0;
-        } else {
-          if (IP_IS_V6_VAL(pcb->remote_ip)) { /* should never happen */
-            continue;
-          }
-          snmp_ip4_to_oid(ip_2_ip4(&pcb->remote_ip), &test_oid[5]);
-          test_oid[9] = pcb->remote_port;
-        }
-
+      if (tcp_ConnTable_row_oid(pcb, test_oid)) {
         /* check generated OID: is it a candidate for the next one? */
         snmp_next_oid_check(&state, test_oid, LWIP_ARRAYSIZE(tcp_ConnTable_oid_ranges), pcb);
       }
@@ -297,7 +333,7 @@ tcp_ConnTable_get_next_cell_instance_and_value(const u32_t *column, struct snmp_
   if (state.status == SNMP_NEXT_OID_STATUS_SUCCESS) {
     snmp_oid_assign(row_oid, state.next_oid, state.next_oid_len);
     /* fill in object properties */
-    return tcp_ConnTable_get_cell_value_core((struct tcp_pcb *)state.reference, column, value, value_len);
+    return tcp_ConnTable_get_cell_value_core(row_oid->id, ((struct tcp_pcb *)state.reference)->state + 1, column, value, value_len);
   }
 
   /* not found */
@@ -309,12 +345,12 @@ tcp_ConnTable_get_next_cell_instance_and_value(const u32_t *column, struct snmp_
 /* --- tcpConnectionTable --- */
 
 static snmp_err_t
-tcp_ConnectionTable_get_cell_value_core(const u32_t *column, struct tcp_pcb *pcb, union snmp_variant_value *value)
+tcp_ConnectionTable_get_cell_value_core(const u32_t *column, u32_t state, union snmp_variant_value *value)
 {
   /* all items except tcpConnectionState and tcpConnectionProcess are declared as not-accessible */
   switch (*column) {
     case 7: /* tcpConnectionState */
-      value->u32 = pcb->state + 1;
+      value->u32 = state;
       break;
     case 8: /* tcpConnectionProcess */
       value->u32 = 0; /* not supported */
@@ -360,7 +396,7 @@ tcp_ConnectionTable_get_cell_value(const u32_t *column, const u32_t *row_oid, u8
           ip_addr_cmp(&remote_ip, &pcb->remote_ip) &&
           (remote_port == pcb->remote_port)) {
         /* fill in object properties */
-        return tcp_ConnectionTable_get_cell_value_core(column, pcb, value);
+        return tcp_ConnectionTable_get_cell_value_core(column, pcb->state + 1, value);
       }
       pcb = pcb->next;
     }
@@ -370,6 +406,27 @@ tcp_ConnectionTable_get_cell_value(const u32_t *column, const u32_t *row_oid, u8
   return SNMP_ERR_NOSUCHINSTANCE;
 }
 
+#if SNMP_TABLE_SNAPSHOT_ROWS
+static void
+tcp_ConnectionTable_snapshot_fill(void)
+{
+  struct tcp_pcb *pcb;
+  u8_t i;
+  struct tcp_pcb **const tcp_pcb_nonlisten_lists[] = {&tcp_bound_pcbs, &tcp_active_pcbs, &tcp_tw_pcbs};
+
+  for (i = 0; i < LWIP_ARRAYSIZE(tcp_pcb_nonlisten_lists); i++) {
+    for (pcb = *tcp_pcb_nonlisten_lists[i]; pcb != NULL; pcb = pcb->next) {
+      u8_t idx = 0;
+      u32_t oid[38];
+
+      idx += snmp_ip_port_to_oid(&pcb->local_ip, pcb->local_port, &oid[idx]);
+      idx += snmp_ip_port_to_oid(&pcb->remote_ip, pcb->remote_port, &oid[idx]);
+      snmp_table_snapshot_add(oid, idx, pcb->state + 1);
+    }
+  }
+}
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
+
 static snmp_err_t
 tcp_ConnectionTable_get_next_cell_instance_and_value(const u32_t *column, struct snmp_obj_id *row_oid, union snmp_variant_value *value, u32_t *value_len)
 {
@@ -380,9 +437,23 @@ tcp_ConnectionTable_get_next_cell_instance_and_value(const u32_t *column, struct
   u32_t  result_temp[38];
   u8_t i;
   struct tcp_pcb **const tcp_pcb_nonlisten_lists[] = {&tcp_bound_pcbs, &tcp_active_pcbs, &tcp_tw_pcbs};
+#if SNMP_TABLE_SNAPSHOT_ROWS
+  u32_t row_state;
+#endif
 
   LWIP_UNUSED_ARG(value_len);
 
+#if SNMP_TABLE_SNAPSHOT_ROWS
+  switch (snmp_table_snapshot_next(tcp_ConnectionTable_snapshot_fill, row_oid, &row_state)) {
+    case SNMP_TABLE_SNAPSHOT_FOUND:
+      return tcp_ConnectionTable_get_cell_value_core(column, row_state, value);
+    case SNMP_TABLE_SNAPSHOT_END:
+      return SNMP_ERR_NOSUCHINSTANCE;
+    default:
+      break;
+  }
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
+
   /* init struct to search next oid */
   snmp_next_oid_init(&state, row_oid->id, row_oid->len, result_temp, LWIP_ARRAYSIZE(result_temp));
 
@@ -411,7 +482,7 @@ tcp_ConnectionTable_get_next_cell_instance_and_value(const u32_t *column, struct
   if (state.status == SNMP_NEXT_OID_STATUS_SUCCESS) {
     snmp_oid_assign(row_oid, state.next_oid, state.next_oid_len);
     /* fill in object properties */
-    return tcp_ConnectionTable_get_cell_value_core(column, (struct tcp_pcb *)state.reference, value);
+    return tcp_ConnectionTable_get_cell_value_core(column, ((struct tcp_pcb *)state.reference)->state + 1, value);
   } else {
     /* not found */
     return SNMP_ERR_NOSUCHINSTANCE;
@@ -466,6 +537,20 @@ tcp_ListenerTable_get_cell_value(const u32_t *column, const u32_t *row_oid, u8_t
   return SNMP_ERR_NOSUCHINSTANCE;
 }
 
+#if SNMP_TABLE_SNAPSHOT_ROWS
+static void
+tcp_ListenerTable_snapshot_fill(void)
+{
+  struct tcp_pcb_listen *pcb;
+
+  for (pcb = tcp_listen_pcbs.listen_pcbs; pcb != NULL; pcb = pcb->next) {
+    u32_t oid[19];
+
+    snmp_table_snapshot_add(oid, snmp_ip_port_to_oid(&pcb->local_ip, pcb->local_port, oid), 0);
+  }
+}
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
+
 static snmp_err_t
 tcp_ListenerTable_get_next_cell_instance_and_value(const u32_t *column, struct snmp_obj_id *row_oid, union snmp_variant_value *value, u32_t *value_len)
 {
@@ -473,9 +558,23 @@ tcp_ListenerTable_get_next_cell_instance_and_value(const u32_t *column, struct s
   struct snmp_next_oid_state state;
   /* 1x tcpListenerLocalAddressType + 1x OID len + 16x tcpListenerLocalAddress  + 1x tcpListenerLocalPort */
   u32_t  result_temp[19];
+#if SNMP_TABLE_SNAPSHOT_ROWS
+  u32_t unused;
+#endif
 
   LWIP_UNUSED_ARG(value_len);
 
+#if SNMP_TABLE_SNAPSHOT_ROWS
+  switch (snmp_table_snapshot_next(tcp_ListenerTable_snapshot_fill, row_oid, &unused)) {
+    case SNMP_TABLE_SNAPSHOT_FOUND:
+      return tcp_ListenerTable_get_cell_value_core(column, value);
+    case SNMP_TABLE_SNAPSHOT_END:
+      return SNMP_ERR_NOSUCHINSTANCE;
+    default:
+      break;
+  }
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
+
   /* init struct to search next oid */
   snmp_next_oid_init(&state, row_oid->id, row_oid->len, result_temp, LWIP_ARRAYSIZE(result_temp));
 
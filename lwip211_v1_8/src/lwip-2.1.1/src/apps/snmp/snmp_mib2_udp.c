@@ -161,6 +161,36 @@ udp_endpointTable_get_cell_value(const u32_t *column, const u32_t *row_oid, u8_t
   return SNMP_ERR_NOSUCHINSTANCE;
 }
 
+/* udpEndpointLocalAddressType + udpEndpointLocalAddress + udpEndpointLocalPort +
+ * udpEndpointRemoteAddressType + udpEndpointRemoteAddress + udpEndpointRemotePort +
+ * udpEndpointInstance */
+static u8_t
+udp_endpointTable_row_oid(struct udp_pcb *pcb, u32_t *oid)
+{
+  u8_t idx = 0;
+
+  idx += snmp_ip_port_to_oid(&pcb->local_ip, pcb->local_port, &oid[idx]);
+  idx += snmp_ip_port_to_oid(&pcb->remote_ip, pcb->remote_port, &oid[idx]);
+  oid[idx] = 0;
+  idx++;
+
+  return idx;
+}
+
+#if SNMP_TABLE_SNAPSHOT_ROWS
+static void
+udp_endpointTable_snapshot_fill(void)
+{
+  struct udp_pcb *pcb;
+
+  for (pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+    u32_t oid[39];
+
+    snmp_table_snapshot_add(oid, udp_endpointTable_row_oid(pcb, oid), 0);
+  }
+}
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
+
 static snmp_err_t
 udp_endpointTable_get_next_cell_instance_and_value(const u32_t *column, struct snmp_obj_id *row_oid, union snmp_variant_value *value, u32_t *value_len)
 {
@@ -171,9 +201,23 @@ udp_endpointTable_get_next_cell_instance_and_value(const u32_t *column, struct s
    * 1x udpEndpointInstance = 39
    */
   u32_t  result_temp[39];
+#if SNMP_TABLE_SNAPSHOT_ROWS
+  u32_t unused;
+#endif
 
   LWIP_UNUSED_ARG(value_len);
 
+#if SNMP_TABLE_SNAPSHOT_ROWS
+  switch (snmp_table_snapshot_next(udp_endpointTable_snapshot_fill, row_oid, &unused)) {
+    case SNMP_TABLE_SNAPSHOT_FOUND:
+      return udp_endpointTable_get_cell_value_core(column, value);
+    case SNMP_TABLE_SNAPSHOT_END:
+      return SNMP_ERR_NOSUCHINSTANCE;
+    default:
+      break;
+  }
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
+
   /* init struct to search next oid */
   snmp_next_oid_init(&state, row_oid->id, row_oid->len, result_temp, LWIP_ARRAYSIZE(result_temp));
 
@@ -181,16 +225,7 @@ udp_endpointTable_get_next_cell_instance_and_value(const u32_t *column, struct s
   pcb = udp_pcbs;
   while (pcb != NULL) {
     u32_t test_oid[LWIP_ARRAYSIZE(result_temp)];
-    u8_t idx = 0;
-
-    /* udpEndpointLocalAddressType + udpEndpointLocalAddress + udpEndpointLocalPort */
-    idx += snmp_ip_port_to_oid(&pcb->local_ip, pcb->local_port, &test_oid[idx]);
-
-    /* udpEndpointRemoteAddressType + udpEndpointRemoteAddress + udpEndpointRemotePort */
-    idx += snmp_ip_port_to_oid(&pcb->remote_ip, pcb->remote_port, &test_oid[idx]);
-
-    test_oid[idx] = 0; /* udpEndpointInstance */
-    idx++;
+    u8_t idx = udp_endpointTable_row_oid(pcb, test_oid);
 
     /* check generated OID: is it a candidate for the next one? */
     snmp_next_oid_check(&state, test_oid, idx, NULL);
@@ -222,19 +257,21 @@ static const struct snmp_oid_range udp_Table_oid_ranges[] = {
   { 1, 0xffff }  /* Port        */
 };
 
+/* both columns are the row OID, which is what a snapshot keeps of a row */
 static snmp_err_t
-udp_Table_get_cell_value_core(struct udp_pcb *pcb, const u32_t *column, union snmp_variant_value *value, u32_t *value_len)
+udp_Table_get_cell_value_core(const u32_t *row_oid, const u32_t *column, union snmp_variant_value *value, u32_t *value_len)
 {
+  ip4_addr_t ip;
+
   LWIP_UNUSED_ARG(value_len);
 
   switch (*column) {
     case 1: /* udpLocalAddress */
-      /* set reference to PCB local IP and return a generic node that copies IP4 addresses */
-      value->u32 = ip_2_ip4(&pcb->local_ip)->addr;
+      snmp_oid_to_ip4(&row_oid[0], &ip);
+      value->u32 = ip.addr;
       break;
     case 2: /* udpLocalPort */
-      /* set reference to PCB local port and return a generic node that copies u16_t values */
-      value->u32 = pcb->local_port;
+      value->u32 = row_oid[4];
       break;
     default:
       return SNMP_ERR_NOSUCHINSTANCE;
@@ -265,7 +302,7 @@ udp_Table_get_cell_value(const u32_t *column, const u32_t *row_oid, u8_t row_oid
     if (IP_IS_V4_VAL(pcb->local_ip)) {
       if (ip4_addr_cmp(&ip, ip_2_ip4(&pcb->local_ip)) && (port == pcb->local_port)) {
         /* fill in object properties */
-        return udp_Table_get_cell_value_core(pcb, column, value, value_len);
+        return udp_Table_get_cell_value_core(row_oid, column, value, value_len);
       }
     }
     pcb = pcb->next;
@@ -275,12 +312,42 @@ udp_Table_get_cell_value(const u32_t *column, const u32_t *row_oid, u8_t row_oid
   return SNMP_ERR_NOSUCHINSTANCE;
 }
 
+#if SNMP_TABLE_SNAPSHOT_ROWS
+static void
+udp_Table_snapshot_fill(void)
+{
+  struct udp_pcb *pcb;
+
+  for (pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+    u32_t oid[LWIP_ARRAYSIZE(udp_Table_oid_ranges)];
+
+    if (IP_IS_V4_VAL(pcb->local_ip)) {
+      snmp_ip4_to_oid(ip_2_ip4(&pcb->local_ip), &oid[0]);
+      oid[4] = pcb->local_port;
+      snmp_table_snapshot_add(oid, LWIP_ARRAYSIZE(oid), 0);
+    }
+  }
+}
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
+
 static snmp_err_t
 udp_Table_get_next_cell_instance_and_value(const u32_t *column, struct snmp_obj_id *row_oid, union snmp_variant_value *value, u32_t *value_len)
 {
   struct udp_pcb *pcb;
   struct snmp_next_oid_state state;
   u32_t  result_temp[LWIP_ARRAYSIZE(udp_Table_oid_ranges)];
+#if SNMP_TABLE_SNAPSHOT_ROWS
+  u32_t unused;
+
+  switch (snmp_table_snapshot_next(udp_Table_snapshot_fill, row_oid, &unused)) {
+    case SNMP_TABLE_SNAPSHOT_FOUND:
+      return udp_Table_get_cell_value_core(row_oid->id, column, value, value_len);
+    case SNMP_TABLE_SNAPSHOT_END:
+      return SNMP_ERR_NOSUCHINSTANCE;
+    default:
+      break;
+  }
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
 
   /* init struct to search next oid */
   snmp_next_oid_init(&state, row_oid->id, row_oid->len, result_temp, LWIP_ARRAYSIZE(udp_Table_oid_ranges));
@@ -305,7 +372,7 @@ udp_Table_get_next_cell_instance_and_value(const u32_t *column, struct snmp_obj_
   if (state.status == SNMP_NEXT_OID_STATUS_SUCCESS) {
     snmp_oid_assign(row_oid, state.next_oid, state.next_oid_len);
     /* fill in object properties */
-    return udp_Table_get_cell_value_core((struct udp_pcb *)state.reference, column, value, value_len);
+    return udp_Table_get_cell_value_core(row_oid->id, column, value, value_len);
   } else {
     /* not found */
     return SNMP_ERR_NOSUCHINSTANCE;
@@ -292,9 +292,13 @@ snmp_receive(void *handle, struct pbuf *p, const ip_addr_t *source_ip, u16_t por
         if (request.request_type == SNMP_ASN1_CONTEXT_PDU_GET_REQ) {
           err = snmp_process_get_request(&request);
         } else if (request.request_type == SNMP_ASN1_CONTEXT_PDU_GET_NEXT_REQ) {
+          snmp_walk_begin();
           err = snmp_process_getnext_request(&request);
+          snmp_walk_end();
         } else if (request.request_type == SNMP_ASN1_CONTEXT_PDU_GET_BULK_REQ) {
+          snmp_walk_begin();
           err = snmp_process_getbulk_request(&request);
+          snmp_walk_end();
         } else if (request.request_type == SNMP_ASN1_CONTEXT_PDU_SET_REQ) {
           err = snmp_process_set_request(&request);
         }
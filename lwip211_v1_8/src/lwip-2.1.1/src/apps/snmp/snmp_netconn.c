@@ -43,6 +43,8 @@
 #include "snmp_msg.h"
 #include "lwip/sys.h"
 #include "lwip/prot/iana.h"
+#include "lwip/tcpip.h"
+#include "lwip/apps/snmp_mib2.h"
 
 /** SNMP netconn API worker thread */
 static void
@@ -98,25 +100,47 @@ snmp_get_local_ip_for_dst(void *handle, const ip_addr_t *dst, ip_addr_t *result)
   struct netif *dst_if;
   const ip_addr_t *dst_ip;
 
+  u8_t found = 0;
+
   LWIP_UNUSED_ARG(conn); /* unused in case of IPV4 only configuration */
 
+  /* routing reads the netif list, which belongs to tcpip_thread */
+#if LWIP_TCPIP_CORE_LOCKING
+  LOCK_TCPIP_CORE();
+#endif
   ip_route_get_local_ip(&conn->pcb.udp->local_ip, dst, dst_if, dst_ip);
 
   if ((dst_if != NULL) && (dst_ip != NULL)) {
     ip_addr_copy(*result, *dst_ip);
-    return 1;
-  } else {
-    return 0;
+    found = 1;
   }
+#if LWIP_TCPIP_CORE_LOCKING
+  UNLOCK_TCPIP_CORE();
+#endif
+  return found;
 }
 
 /**
  * Starts SNMP Agent.
+ * Decoding, MIB processing and encoding all run in the worker thread. The
+ * lwIP MIB2 nodes reach stack state through snmp_mib2_lwip_locks, which is
+ * set up here unless the application did so before. With
+ * LWIP_TCPIP_CORE_LOCKING every node access is a short LOCK_TCPIP_CORE()
+ * section in the worker thread, tcpip_thread does none of the work.
  */
 void
 snmp_init(void)
 {
   LWIP_ASSERT_CORE_LOCKED();
+#if SNMP_LWIP_MIB2
+  if (!sys_mutex_valid(&snmp_mib2_lwip_locks.sem_usage_mutex)) {
+#if LWIP_TCPIP_CORE_LOCKING
+    snmp_threadsync_init_direct(&snmp_mib2_lwip_locks, snmp_mib2_lwip_synchronizer);
+#else
+    snmp_threadsync_init(&snmp_mib2_lwip_locks, snmp_mib2_lwip_synchronizer);
+#endif
+  }
+#endif /* SNMP_LWIP_MIB2 */
   sys_thread_new("snmp_netconn", snmp_netconn_thread, NULL, SNMP_STACK_SIZE, SNMP_THREAD_PRIO);
 }
 
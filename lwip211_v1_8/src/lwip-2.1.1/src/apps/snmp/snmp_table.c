@@ -41,6 +41,7 @@
 
 #include "lwip/apps/snmp_core.h"
 #include "lwip/apps/snmp_table.h"
+#include "snmp_core_priv.h"
 #include <string.h>
 
 snmp_err_t snmp_table_get_instance(const u32_t *root_oid, u8_t root_oid_len, struct snmp_node_instance *instance)
@@ -339,4 +340,122 @@ snmp_table_extract_value_from_refconstptr(struct snmp_node_instance *instance, v
   return (u16_t)instance->reference_len;
 }
 
+#if SNMP_TABLE_SNAPSHOT_ROWS
+
+struct snmp_table_snapshot
+{
+  snmp_table_snapshot_fill_fn fill;   /* table the rows belong to */
+  u32_t walk;                         /* snmp_walk_current() when they were taken */
+  u32_t last_use;
+  u16_t count;
+  u8_t overflow;                      /* the table has more rows than fit */
+  struct snmp_table_snapshot_row rows[SNMP_TABLE_SNAPSHOT_ROWS];
+};
+
+static struct snmp_table_snapshot snmp_table_snapshots[SNMP_TABLE_SNAPSHOTS];
+static struct snmp_table_snapshot *snmp_table_snapshot_filling;
+static u32_t snmp_table_snapshot_uses;
+
+/**
+ * Adds a row to the snapshot being taken, only to be called from a snmp_table_snapshot_fill_fn.
+ * Rows may come in any order.
+ */
+void
+snmp_table_snapshot_add(const u32_t *oid, u8_t oid_len, u32_t value)
+{
+  struct snmp_table_snapshot *snap = snmp_table_snapshot_filling;
+  u16_t i;
+
+  LWIP_ASSERT("snmp_table_snapshot_add outside of a fill function", snap != NULL);
+
+  if ((snap->count == SNMP_TABLE_SNAPSHOT_ROWS) || (oid_len > SNMP_TABLE_SNAPSHOT_OID_LEN)) {
+    snap->overflow = 1;
+    return;
+  }
+
+  /* keep the rows sorted, there are only a few */
+  i = snap->count;
+  while ((i > 0) && (snmp_oid_compare(oid, oid_len, snap->rows[i - 1].oid, snap->rows[i - 1].oid_len) < 0)) {
+    snap->rows[i] = snap->rows[i - 1];
+    i--;
+  }
+  MEMCPY(snap->rows[i].oid, oid, oid_len * sizeof(u32_t));
+  snap->rows[i].oid_len = oid_len;
+  snap->rows[i].value   = value;
+  snap->count++;
+}
+
+/**
+ * Looks up the row following row_oid in a snapshot of the table that fill lists. The snapshot
+ * is taken at the first lookup of a GetNext or GetBulk request and is used until the request is
+ * done, so a walk over the table scans it once instead of once per varbind.
+ * Outside of such a request, or if the table does not fit, SNMP_TABLE_SNAPSHOT_NONE is
+ * returned and the caller searches the table itself.
+ */
+snmp_table_snapshot_status_t
+snmp_table_snapshot_next(snmp_table_snapshot_fill_fn fill, struct snmp_obj_id *row_oid, u32_t *value)
+{
+  struct snmp_table_snapshot *snap = NULL;
+  u32_t walk = snmp_walk_current();
+  u16_t lo, hi;
+  u8_t i;
+
+  if (walk == 0) {
+    return SNMP_TABLE_SNAPSHOT_NONE;
+  }
+
+  for (i = 0; i < SNMP_TABLE_SNAPSHOTS; i++) {
+    if ((snmp_table_snapshots[i].fill == fill) && (snmp_table_snapshots[i].walk == walk)) {
+      snap = &snmp_table_snapshots[i];
+      break;
+    }
+  }
+  if (snap == NULL) {
+    /* take a snapshot in the slot of a finished request, or else in the one used least recently */
+    snap = &snmp_table_snapshots[0];
+    for (i = 0; i < SNMP_TABLE_SNAPSHOTS; i++) {
+      if (snmp_table_snapshots[i].walk != walk) {
+        snap = &snmp_table_snapshots[i];
+        break;
+      }
+      if (snmp_table_snapshots[i].last_use < snap->last_use) {
+        snap = &snmp_table_snapshots[i];
+      }
+    }
+    snap->fill     = fill;
+    snap->walk     = walk;
+    snap->count    = 0;
+    snap->overflow = 0;
+    snmp_table_snapshot_filling = snap;
+    fill();
+    snmp_table_snapshot_filling = NULL;
+  }
+  snap->last_use = ++snmp_table_snapshot_uses;
+
+  if (snap->overflow) {
+    return SNMP_TABLE_SNAPSHOT_NONE;
+  }
+
+  /* first row greater than row_oid */
+  lo = 0;
+  hi = snap->count;
+  while (lo < hi) {
+    u16_t mid = (u16_t)((lo + hi) / 2);
+    if (snmp_oid_compare(snap->rows[mid].oid, snap->rows[mid].oid_len, row_oid->id, row_oid->len) <= 0) {
+      lo = (u16_t)(mid + 1);
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == snap->count) {
+    return SNMP_TABLE_SNAPSHOT_END;
+  }
+
+  snmp_oid_assign(row_oid, snap->rows[lo].oid, snap->rows[lo].oid_len);
+  *value = snap->rows[lo].value;
+  return SNMP_TABLE_SNAPSHOT_FOUND;
+}
+
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
+
 #endif /* LWIP_SNMP */
@@ -46,10 +46,21 @@ call_synced_function(struct threadsync_data *call_data, snmp_threadsync_called_f
 {
   sys_mutex_lock(&call_data->threadsync_node->instance->sem_usage_mutex);
   call_data->threadsync_node->instance->sync_fn(fn, call_data);
-  sys_sem_wait(&call_data->threadsync_node->instance->sem);
+  if (!call_data->threadsync_node->instance->direct) {
+    sys_sem_wait(&call_data->threadsync_node->instance->sem);
+  }
   sys_mutex_unlock(&call_data->threadsync_node->instance->sem_usage_mutex);
 }
 
+/* A direct synchronizer has run fn before it returned, nobody waits for the semaphore */
+static void
+synced_function_done(struct threadsync_data *call_data)
+{
+  if (!call_data->threadsync_node->instance->direct) {
+    synced_function_done(call_data);
+  }
+}
+
 static void
 threadsync_get_value_synced(void *ctx)
 {
@@ -61,7 +72,7 @@ threadsync_get_value_synced(void *ctx)
     call_data->retval.s16 = -1;
   }
 
-  sys_sem_signal(&call_data->threadsync_node->instance->sem);
+  synced_function_done(call_data);
 }
 
 static s16_t
@@ -86,7 +97,7 @@ threadsync_set_test_synced(void *ctx)
     call_data->retval.err = SNMP_ERR_NOTWRITABLE;
   }
 
-  sys_sem_signal(&call_data->threadsync_node->instance->sem);
+  synced_function_done(call_data);
 }
 
 static snmp_err_t
@@ -112,7 +123,7 @@ threadsync_set_value_synced(void *ctx)
     call_data->retval.err = SNMP_ERR_NOTWRITABLE;
   }
 
-  sys_sem_signal(&call_data->threadsync_node->instance->sem);
+  synced_function_done(call_data);
 }
 
 static snmp_err_t
@@ -134,7 +145,7 @@ threadsync_release_instance_synced(void *ctx)
 
   call_data->proxy_instance.release_instance(&call_data->proxy_instance);
 
-  sys_sem_signal(&call_data->threadsync_node->instance->sem);
+  synced_function_done(call_data);
 }
 
 static void
@@ -155,7 +166,7 @@ get_instance_synced(void *ctx)
 
   call_data->retval.err = leaf->get_instance(call_data->arg1.root_oid, call_data->arg2.root_oid_len, &call_data->proxy_instance);
 
-  sys_sem_signal(&call_data->threadsync_node->instance->sem);
+  synced_function_done(call_data);
 }
 
 static void
@@ -166,7 +177,7 @@ get_next_instance_synced(void *ctx)
 
   call_data->retval.err = leaf->get_next_instance(call_data->arg1.root_oid, call_data->arg2.root_oid_len, &call_data->proxy_instance);
 
-  sys_sem_signal(&call_data->threadsync_node->instance->sem);
+  synced_function_done(call_data);
 }
 
 static snmp_err_t
@@ -226,6 +237,22 @@ void snmp_threadsync_init(struct snmp_threadsync_instance *instance, snmp_thread
   LWIP_UNUSED_ARG(err); /* in case of LWIP_NOASSERT */
   LWIP_ASSERT("Failed to set up semaphore", err == ERR_OK);
   instance->sync_fn = sync_fn;
+  instance->direct  = 0;
+}
+
+/**
+ * Initializes thread synchronization instance for a synchronizer that runs
+ * the function in the calling thread before it returns, e.g. under
+ * LOCK_TCPIP_CORE(). Saves the semaphore handshake on every node access.
+ */
+void snmp_threadsync_init_direct(struct snmp_threadsync_instance *instance, snmp_threadsync_synchronizer_fn sync_fn)
+{
+  err_t err = sys_mutex_new(&instance->sem_usage_mutex);
+  LWIP_UNUSED_ARG(err); /* in case of LWIP_NOASSERT */
+  LWIP_ASSERT("Failed to set up mutex", err == ERR_OK);
+  sys_sem_set_invalid(&instance->sem);
+  instance->sync_fn = sync_fn;
+  instance->direct  = 1;
 }
 
 #endif /* LWIP_SNMP */
@@ -53,6 +53,7 @@
 
 #include "lwip/opt.h"
 #include "lwip/timeouts.h"
+#include "lwip/sys.h"
 #include "lwip/udp.h"
 #include "lwip/dns.h"
 #include "lwip/ip_addr.h"
@@ -281,9 +282,10 @@ sntp_format_time(s32_t sec)
 
 /**
  * SNTP processing of received timestamp
+ * @param rx_age_us time the reply spent between the netif and sntp_recv()
  */
 static void
-sntp_process(const struct sntp_timestamps *timestamps)
+sntp_process(const struct sntp_timestamps *timestamps, u32_t rx_age_us)
 {
   s32_t sec;
   u32_t frac;
@@ -291,6 +293,23 @@ sntp_process(const struct sntp_timestamps *timestamps)
   sec  = (s32_t)lwip_ntohl(timestamps->xmit.sec);
   frac = lwip_ntohl(timestamps->xmit.frac);
 
+  if (rx_age_us != 0) {
+    /* Move the transmit timestamp forward by the time the reply waited for
+     * tcpip_thread, so that it pairs with the current system time read below
+     * and set by SNTP_SET_SYSTEM_TIME_NTP. With round-trip compensation,
+     * (t3 + age) - t4 equals t3 - (t4 - age): the offset is taken against the
+     * receive time. */
+    u32_t age_frac;
+
+    sec += (s32_t)(rx_age_us / 1000000UL);
+    rx_age_us %= 1000000UL;
+    age_frac = rx_age_us * 4295 - ((rx_age_us * 2143) >> 16);
+    frac += age_frac;
+    if (frac < age_frac) {
+      sec++;
+    }
+  }
+
 #if SNTP_COMP_ROUNDTRIP
 # if SNTP_CHECK_RESPONSE >= 2
   if (timestamps->recv.sec != 0 || timestamps->recv.frac != 0)
@@ -439,10 +458,17 @@ sntp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
   u8_t mode;
   u8_t stratum;
   err_t err;
+  u32_t rx_age_us = 0;
 
   LWIP_UNUSED_ARG(arg);
   LWIP_UNUSED_ARG(pcb);
 
+#if LWIP_PBUF_RX_TIMESTAMP
+  if (p->rx_time != 0) {
+    rx_age_us = LWIP_PBUF_RX_TIME_US() - p->rx_time;
+  }
+#endif /* LWIP_PBUF_RX_TIMESTAMP */
+
   err = ERR_ARG;
 #if SNTP_CHECK_RESPONSE >= 1
   /* check server address and port */
@@ -501,7 +527,7 @@ sntp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
 
   if (err == ERR_OK) {
     /* correct packet received: process it it */
-    sntp_process(&timestamps);
+    sntp_process(&timestamps, rx_age_us);
 
 #if SNTP_MONITOR_SERVER_REACHABILITY
     /* indicate that server responded */
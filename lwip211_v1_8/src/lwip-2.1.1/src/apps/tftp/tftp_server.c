@@ -5,7 +5,8 @@
  * @author   Logan Gunthorpe <logang@deltatee.com>
  *           Dirk Ziegelmeier <dziegel@gmx.de>
  *
- * @brief    Trivial File Transfer Protocol (RFC 1350)
+ * @brief    Trivial File Transfer Protocol (RFC 1350), with the block size
+ *           (RFC 2348) and window size (RFC 7440) options
  *
  * Copyright (c) Deltatee Enterprises Ltd. 2013
  * All rights reserved.
@@ -45,6 +46,8 @@
  * @ingroup apps
  *
  * This is simple TFTP server for the lwIP raw API.
+ * Clients may ask for larger blocks (RFC 2348) and for several blocks in
+ * flight per acknowledgement (RFC 7440), see @ref tftp_opts.
  */
 
 #include "lwip/apps/tftp_server.h"
@@ -52,6 +55,8 @@
 #if LWIP_UDP
 
 #include "lwip/udp.h"
+#include "lwip/ip.h"
+#include "lwip/mem.h"
 #include "lwip/timeouts.h"
 #include "lwip/debug.h"
 
@@ -63,6 +68,14 @@
 #define TFTP_DATA  3
 #define TFTP_ACK   4
 #define TFTP_ERROR 5
+#define TFTP_OACK  6
+
+/* Options the client asked for, they are repeated in the OACK */
+#define TFTP_OPT_BLKSIZE    0x01
+#define TFTP_OPT_WINDOWSIZE 0x02
+
+#define TFTP_MIN_BLKSIZE    8
+#define TFTP_MAX_OPT_LEN    10
 
 enum tftp_error {
   TFTP_ERROR_FILE_NOT_FOUND    = 1,
@@ -76,18 +89,43 @@ enum tftp_error {
 
 #include <string.h>
 
+/* A block of a read transfer, kept until the client acknowledged it */
+struct tftp_block {
+  const u8_t *data;
+  u16_t len;
+};
+
+/* Block numbers are counted in 32 bits, the protocol sees the lower 16 of them */
 struct tftp_state {
   const struct tftp_context *ctx;
   void *handle;
-  struct pbuf *last_data;
   struct udp_pcb *upcb;
   ip_addr_t addr;
   u16_t port;
   int timer;
   int last_pkt;
-  u16_t blknum;
+  /* read: oldest unacknowledged block, write: next expected block */
+  u32_t blknum;
+  /* read: next block to send */
+  u32_t next;
+  /* read: next block to get from the file */
+  u32_t fetched;
+  /* read: the short block that ends the file, 0 while not yet read */
+  u32_t last_blk;
+  u16_t blksize;
+  u16_t windowsize;
+  /* write: blocks received since the last ACK */
+  u16_t window_cnt;
   u8_t retries;
   u8_t mode_write;
+  /* TFTP_OPT_*, non-zero until the client confirmed the OACK */
+  u8_t oack;
+  u8_t options;
+  /* write: a gap was reported, don't ACK every block after it */
+  u8_t gap_acked;
+  /* read: window buffer for ctx->read(), NULL with ctx->read_ref() */
+  u8_t *buf;
+  struct tftp_block blocks[TFTP_MAX_WINDOWSIZE];
 };
 
 static struct tftp_state tftp_state;
@@ -100,10 +138,11 @@ close_handle(void)
   tftp_state.port = 0;
   ip_addr_set_any(0, &tftp_state.addr);
 
-  if (tftp_state.last_data != NULL) {
-    pbuf_free(tftp_state.last_data);
-    tftp_state.last_data = NULL;
+  if (tftp_state.buf != NULL) {
+    mem_free(tftp_state.buf);
+    tftp_state.buf = NULL;
   }
+  tftp_state.oack = 0;
 
   sys_untimeout(tftp_tmr, NULL);
 
@@ -153,51 +192,225 @@ send_ack(u16_t blknum)
   pbuf_free(p);
 }
 
+/* Append "name\0value\0" to an OACK */
+static u16_t
+oack_add(char *buf, u16_t off, const char *name, u16_t value)
+{
+  u16_t len = (u16_t)(strlen(name) + 1);
+
+  MEMCPY(&buf[off], name, len);
+  off = (u16_t)(off + len);
+  lwip_itoa(&buf[off], TFTP_MAX_OPT_LEN, value);
+  return (u16_t)(off + strlen(&buf[off]) + 1);
+}
+
 static void
-resend_data(void)
+send_oack(void)
 {
-  struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, tftp_state.last_data->len, PBUF_RAM);
-  if (p == NULL) {
-    return;
+  char buf[2 + sizeof("blksize") + sizeof("windowsize") + 2 * TFTP_MAX_OPT_LEN];
+  struct pbuf *p;
+  u16_t len = 2;
+
+  buf[0] = 0;
+  buf[1] = TFTP_OACK;
+  if (tftp_state.options & TFTP_OPT_BLKSIZE) {
+    len = oack_add(buf, len, "blksize", tftp_state.blksize);
+  }
+  if (tftp_state.options & TFTP_OPT_WINDOWSIZE) {
+    len = oack_add(buf, len, "windowsize", tftp_state.windowsize);
   }
 
-  if (pbuf_copy(p, tftp_state.last_data) != ERR_OK) {
-    pbuf_free(p);
+  p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+  if (p == NULL) {
     return;
   }
-
+  MEMCPY(p->payload, buf, len);
   udp_sendto(tftp_state.upcb, p, &tftp_state.addr, tftp_state.port);
   pbuf_free(p);
 }
 
-static void
-send_data(void)
+/* Send a block of a read transfer. The data is only referenced: it stays in
+ * place until the client acknowledged it, and by then it has left the netif. */
+static err_t
+send_block(u32_t blknum)
 {
+  const struct tftp_block *block = &tftp_state.blocks[blknum % tftp_state.windowsize];
+  struct pbuf *p, *data;
   u16_t *payload;
-  int ret;
+  err_t err;
 
-  if (tftp_state.last_data != NULL) {
-    pbuf_free(tftp_state.last_data);
+  p = pbuf_alloc(PBUF_TRANSPORT, TFTP_HEADER_LENGTH, PBUF_RAM);
+  if (p == NULL) {
+    return ERR_MEM;
   }
+  payload = (u16_t *) p->payload;
+  payload[0] = PP_HTONS(TFTP_DATA);
+  payload[1] = lwip_htons((u16_t)blknum);
 
-  tftp_state.last_data = pbuf_alloc(PBUF_TRANSPORT, TFTP_HEADER_LENGTH + TFTP_MAX_PAYLOAD_SIZE, PBUF_RAM);
-  if (tftp_state.last_data == NULL) {
-    return;
+  if (block->len > 0) {
+    data = pbuf_alloc(PBUF_RAW, block->len, PBUF_REF);
+    if (data == NULL) {
+      pbuf_free(p);
+      return ERR_MEM;
+    }
+    data->payload = LWIP_CONST_CAST(u8_t *, block->data);
+    pbuf_cat(p, data);
   }
 
-  payload = (u16_t *) tftp_state.last_data->payload;
-  payload[0] = PP_HTONS(TFTP_DATA);
-  payload[1] = lwip_htons(tftp_state.blknum);
+  err = udp_sendto(tftp_state.upcb, p, &tftp_state.addr, tftp_state.port);
+  pbuf_free(p);
+  return err;
+}
 
-  ret = tftp_state.ctx->read(tftp_state.handle, &payload[2], TFTP_MAX_PAYLOAD_SIZE);
+/* Get the next block from the file into the window.
+ * Returns 1 if the file has no data for it yet, see tftp_read_ready(). */
+static int
+fetch_block(void)
+{
+  struct tftp_block *block = &tftp_state.blocks[tftp_state.fetched % tftp_state.windowsize];
+  int ret;
+
+  if (tftp_state.ctx->read_ref != NULL) {
+    block->data = (const u8_t *)tftp_state.ctx->read_ref(tftp_state.handle, tftp_state.blksize, &ret);
+    if (block->data == NULL) {
+      ret = -1;
+    }
+  } else {
+    block->data = &tftp_state.buf[(tftp_state.fetched % tftp_state.windowsize) * tftp_state.blksize];
+    ret = tftp_state.ctx->read(tftp_state.handle, LWIP_CONST_CAST(u8_t *, block->data), tftp_state.blksize);
+    if (ret == ERR_WOULDBLOCK) {
+      return 1;
+    }
+  }
   if (ret < 0) {
-    send_error(&tftp_state.addr, tftp_state.port, TFTP_ERROR_ACCESS_VIOLATION, "Error occurred while reading the file.");
-    close_handle();
-    return;
+    return -1;
+  }
+
+  block->len = (u16_t)LWIP_MIN(ret, tftp_state.blksize);
+  if (block->len < tftp_state.blksize) {
+    tftp_state.last_blk = tftp_state.fetched;
+  }
+  tftp_state.fetched++;
+  return 0;
+}
+
+/* Fill the window from the file and send what has not been sent yet */
+static void
+send_window(void)
+{
+  while ((tftp_state.next < tftp_state.blknum + tftp_state.windowsize) &&
+         ((tftp_state.last_blk == 0) || (tftp_state.next <= tftp_state.last_blk))) {
+    if (tftp_state.next == tftp_state.fetched) {
+      int ret = fetch_block();
+      if (ret < 0) {
+        send_error(&tftp_state.addr, tftp_state.port, TFTP_ERROR_ACCESS_VIOLATION, "Error occurred while reading the file.");
+        close_handle();
+        return;
+      }
+      if (ret > 0) {
+        /* tftp_read_ready() goes on from here */
+        return;
+      }
+    }
+    if (send_block(tftp_state.next) != ERR_OK) {
+      /* the timer sends it again */
+      return;
+    }
+    tftp_state.next++;
+  }
+}
+
+/* Largest block that fits the netif towards the client without fragmenting */
+static u16_t
+max_blksize(const ip_addr_t *addr)
+{
+  struct netif *netif = ip_route(IP_ANY_TYPE, addr);
+  u16_t hlen = IP_IS_V6(addr) ? 40 : 20;
+  u16_t max = TFTP_MAX_BLKSIZE;
+
+  if ((netif != NULL) && (netif->mtu > hlen + UDP_HLEN + TFTP_HEADER_LENGTH + TFTP_MIN_BLKSIZE)) {
+    max = LWIP_MIN(max, (u16_t)(netif->mtu - hlen - UDP_HLEN - TFTP_HEADER_LENGTH));
+  }
+  return max;
+}
+
+/* Options are "name\0value\0" pairs after the mode, RFC 2347. Unknown ones are ignored. */
+static void
+parse_options(struct pbuf *p, u16_t offset, const ip_addr_t *addr)
+{
+  const char tftp_null = 0;
+  char name[TFTP_MAX_OPT_LEN + 1];
+  char value[TFTP_MAX_OPT_LEN + 1];
+  u16_t name_end, value_end;
+  u32_t val;
+  int i;
+
+  while (offset < p->tot_len) {
+    name_end = pbuf_memfind(p, &tftp_null, sizeof(tftp_null), offset);
+    if (name_end == 0xFFFF) {
+      return;
+    }
+    value_end = pbuf_memfind(p, &tftp_null, sizeof(tftp_null), (u16_t)(name_end + 1));
+    if (value_end == 0xFFFF) {
+      return;
+    }
+    if (((name_end - offset) > TFTP_MAX_OPT_LEN) || ((value_end - name_end - 1) > TFTP_MAX_OPT_LEN)) {
+      offset = (u16_t)(value_end + 1);
+      continue;
+    }
+    pbuf_copy_partial(p, name, (u16_t)(name_end - offset + 1), offset);
+    pbuf_copy_partial(p, value, (u16_t)(value_end - name_end), (u16_t)(name_end + 1));
+    offset = (u16_t)(value_end + 1);
+
+    val = 0;
+    for (i = 0; value[i] >= '0' && value[i] <= '9'; i++) {
+      val = val * 10 + (u32_t)(value[i] - '0');
+    }
+    if ((i == 0) || (value[i] != 0)) {
+      continue;
+    }
+
+    if (lwip_stricmp(name, "blksize") == 0) {
+      if (val >= TFTP_MIN_BLKSIZE) {
+        tftp_state.blksize = (u16_t)LWIP_MIN(val, max_blksize(addr));
+        tftp_state.options |= TFTP_OPT_BLKSIZE;
+      }
+    } else if (lwip_stricmp(name, "windowsize") == 0) {
+      if (val >= 1) {
+        tftp_state.windowsize = (u16_t)LWIP_MIN(val, TFTP_MAX_WINDOWSIZE);
+        tftp_state.options |= TFTP_OPT_WINDOWSIZE;
+      }
+    }
+  }
+}
+
+/* Set up the window of a read transfer and start sending */
+static void
+start_read(void)
+{
+  tftp_state.next     = 1;
+  tftp_state.fetched  = 1;
+  tftp_state.last_blk = 0;
+
+  if (tftp_state.ctx->read_ref == NULL) {
+    /* with less memory, the window gets smaller */
+    while ((tftp_state.buf = (u8_t *)mem_malloc((mem_size_t)tftp_state.windowsize * tftp_state.blksize)) == NULL) {
+      if (tftp_state.windowsize == 1) {
+        send_error(&tftp_state.addr, tftp_state.port, TFTP_ERROR_DISK_FULL, "Out of memory");
+        close_handle();
+        return;
+      }
+      tftp_state.windowsize = (u16_t)(tftp_state.windowsize / 2);
+    }
   }
 
-  pbuf_realloc(tftp_state.last_data, (u16_t)(TFTP_HEADER_LENGTH + ret));
-  resend_data();
+  if (tftp_state.options != 0) {
+    /* data starts when the client acknowledged the OACK with block 0 */
+    tftp_state.oack = 1;
+    send_oack();
+  } else {
+    send_window();
+  }
 }
 
 static void
@@ -253,6 +466,11 @@ recv(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16
       }
       pbuf_copy_partial(p, mode, mode_end_offset - filename_end_offset, filename_end_offset + 1);
 
+      tftp_state.blksize    = TFTP_MAX_PAYLOAD_SIZE;
+      tftp_state.windowsize = 1;
+      tftp_state.options    = 0;
+      parse_options(p, (u16_t)(mode_end_offset + 1), addr);
+
       tftp_state.handle = tftp_state.ctx->open(filename, mode, opcode == PP_HTONS(TFTP_WRQ));
       tftp_state.blknum = 1;
 
@@ -263,17 +481,26 @@ recv(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16
 
       LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("tftp: %s request from ", (opcode == PP_HTONS(TFTP_WRQ)) ? "write" : "read"));
       ip_addr_debug_print(TFTP_DEBUG | LWIP_DBG_STATE, addr);
-      LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, (" for '%s' mode '%s'\n", filename, mode));
+      LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, (" for '%s' mode '%s' blksize %"U16_F" windowsize %"U16_F"\n",
+                  filename, mode, tftp_state.blksize, tftp_state.windowsize));
 
       ip_addr_copy(tftp_state.addr, *addr);
       tftp_state.port = port;
 
       if (opcode == PP_HTONS(TFTP_WRQ)) {
         tftp_state.mode_write = 1;
-        send_ack(0);
+        tftp_state.window_cnt = 0;
+        tftp_state.gap_acked  = 0;
+        if (tftp_state.options != 0) {
+          /* the OACK takes the place of ACK 0 */
+          tftp_state.oack = 1;
+          send_oack();
+        } else {
+          send_ack(0);
+        }
       } else {
         tftp_state.mode_write = 0;
-        send_data();
+        start_read();
       }
 
       break;
@@ -294,25 +521,36 @@ recv(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16
       }
 
       blknum = lwip_ntohs(sbuf[1]);
-      if (blknum == tftp_state.blknum) {
+      if (blknum == (u16_t)tftp_state.blknum) {
+        tftp_state.oack = 0;
+        tftp_state.gap_acked = 0;
         pbuf_remove_header(p, TFTP_HEADER_LENGTH);
 
         ret = tftp_state.ctx->write(tftp_state.handle, p);
         if (ret < 0) {
           send_error(addr, port, TFTP_ERROR_ACCESS_VIOLATION, "error writing file");
           close_handle();
-        } else {
+        } else if (p->tot_len < tftp_state.blksize) {
           send_ack(blknum);
-        }
-
-        if (p->tot_len < TFTP_MAX_PAYLOAD_SIZE) {
           close_handle();
         } else {
           tftp_state.blknum++;
+          /* one ACK per window, RFC 7440 */
+          if (++tftp_state.window_cnt >= tftp_state.windowsize) {
+            tftp_state.window_cnt = 0;
+            send_ack(blknum);
+          }
         }
-      } else if ((u16_t)(blknum + 1) == tftp_state.blknum) {
+      } else if ((u16_t)(blknum + 1) == (u16_t)tftp_state.blknum) {
         /* retransmit of previous block, ack again (casting to u16_t to care for overflow) */
         send_ack(blknum);
+      } else if (tftp_state.windowsize > 1) {
+        /* a block got lost, or the ACK of a window did: tell once where to resume */
+        if (!tftp_state.gap_acked) {
+          tftp_state.gap_acked = 1;
+          tftp_state.window_cnt = 0;
+          send_ack((u16_t)(tftp_state.blknum - 1));
+        }
       } else {
         send_error(addr, port, TFTP_ERROR_UNKNOWN_TRFR_ID, "Wrong block number");
       }
@@ -321,7 +559,7 @@ recv(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16
 
     case PP_HTONS(TFTP_ACK): {
       u16_t blknum;
-      int lastpkt;
+      u16_t acked;
 
       if (tftp_state.handle == NULL) {
         send_error(addr, port, TFTP_ERROR_ACCESS_VIOLATION, "No connection");
@@ -334,24 +572,37 @@ recv(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16
       }
 
       blknum = lwip_ntohs(sbuf[1]);
-      if (blknum != tftp_state.blknum) {
-        send_error(addr, port, TFTP_ERROR_UNKNOWN_TRFR_ID, "Wrong block number");
+      if (tftp_state.oack) {
+        if (blknum == 0) {
+          tftp_state.oack = 0;
+          send_window();
+        }
         break;
       }
 
-      lastpkt = 0;
-
-      if (tftp_state.last_data != NULL) {
-        lastpkt = tftp_state.last_data->tot_len != (TFTP_MAX_PAYLOAD_SIZE + TFTP_HEADER_LENGTH);
+      /* how many blocks of those in flight this acknowledges */
+      acked = (u16_t)(blknum - (u16_t)(tftp_state.blknum - 1));
+      if (acked > tftp_state.next - tftp_state.blknum) {
+        if (tftp_state.windowsize == 1) {
+          send_error(addr, port, TFTP_ERROR_UNKNOWN_TRFR_ID, "Wrong block number");
+        }
+        /* an old ACK that crossed a retransmission */
+        break;
+      }
+      if ((acked == 0) && (tftp_state.windowsize == 1)) {
+        /* no retransmit on a duplicate ACK, that is the sorcerer's apprentice */
+        break;
       }
 
-      if (!lastpkt) {
-        tftp_state.blknum++;
-        send_data();
-      } else {
+      tftp_state.blknum += acked;
+      if ((tftp_state.last_blk != 0) && (tftp_state.blknum > tftp_state.last_blk)) {
         close_handle();
+        break;
       }
 
+      /* anything not acknowledged got lost, go back to it, RFC 7440 */
+      tftp_state.next = tftp_state.blknum;
+      send_window();
       break;
     }
 
@@ -377,10 +628,18 @@ tftp_tmr(void *arg)
   sys_timeout(TFTP_TIMER_MSECS, tftp_tmr, NULL);
 
   if ((tftp_state.timer - tftp_state.last_pkt) > (TFTP_TIMEOUT_MSECS / TFTP_TIMER_MSECS)) {
-    if ((tftp_state.last_data != NULL) && (tftp_state.retries < TFTP_MAX_RETRIES)) {
+    if (tftp_state.retries < TFTP_MAX_RETRIES) {
       LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("tftp: timeout, retrying\n"));
-      resend_data();
       tftp_state.retries++;
+      if (tftp_state.oack) {
+        send_oack();
+      } else if (tftp_state.mode_write) {
+        tftp_state.window_cnt = 0;
+        send_ack((u16_t)(tftp_state.blknum - 1));
+      } else {
+        tftp_state.next = tftp_state.blknum;
+        send_window();
+      }
     } else {
       LWIP_DEBUGF(TFTP_DEBUG | LWIP_DBG_STATE, ("tftp: timeout\n"));
       close_handle();
@@ -413,7 +672,8 @@ tftp_init(const struct tftp_context *ctx)
   tftp_state.port      = 0;
   tftp_state.ctx       = ctx;
   tftp_state.timer     = 0;
-  tftp_state.last_data = NULL;
+  tftp_state.buf       = NULL;
+  tftp_state.oack      = 0;
   tftp_state.upcb      = pcb;
 
   udp_recv(pcb, recv, NULL);
@@ -421,6 +681,20 @@ tftp_init(const struct tftp_context *ctx)
   return ERR_OK;
 }
 
+/** @ingroup tftp
+ * Go on with a read transfer after tftp_context::read() returned
+ * ERR_WOULDBLOCK: call this (in tcpip_thread, e.g. via tcpip_callback()) when
+ * the file has data again.
+ */
+void
+tftp_read_ready(void)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  if ((tftp_state.handle != NULL) && !tftp_state.mode_write && !tftp_state.oack) {
+    send_window();
+  }
+}
+
 /** @ingroup tftp
  * Deinitialize ("turn off") TFTP server.
  */
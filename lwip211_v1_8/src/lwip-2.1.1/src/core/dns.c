@@ -216,22 +216,39 @@ typedef enum {
   DNS_STATE_DONE             = 3
 } dns_state_enum_t;
 
+/* DNS table entry flags */
+/** the name does not exist, or has no address of the requested type */
+#define DNS_ENTRY_NEGATIVE 0x01
+/** a lookup was answered from the entry since it was last resolved */
+#define DNS_ENTRY_USED     0x02
+/** being refreshed, ipaddr still answers lookups until then */
+#define DNS_ENTRY_CACHED   0x04
+
+/** Buckets of the name hash, entries of a bucket are chained through hash_next */
+#define DNS_HASH_SIZE      DNS_TABLE_SIZE
+
 /** DNS table entry */
 struct dns_table_entry {
   u32_t ttl;
   ip_addr_t ipaddr;
   u16_t txid;
+  u16_t hash;
   u8_t  state;
+  u8_t  flags;
   u8_t  server_idx;
   u8_t  tmr;
   u8_t  retries;
   u8_t  seqno;
+  /* index + 1 of the next entry in the hash bucket, 0 ends the chain */
+  u8_t  hash_next;
 #if ((LWIP_DNS_SECURE & LWIP_DNS_SECURE_RAND_SRC_PORT) != 0)
   u8_t pcb_idx;
 #endif
   char name[DNS_MAX_NAME_LENGTH];
 #if LWIP_IPV4 && LWIP_IPV6
   u8_t reqaddrtype;
+  /* what the caller asked for, reqaddrtype changes with the fallback */
+  u8_t addrtype;
 #endif /* LWIP_IPV4 && LWIP_IPV6 */
 #if LWIP_DNS_SUPPORT_MDNS_QUERIES
   u8_t is_mdns;
@@ -297,6 +314,8 @@ static u8_t                   dns_last_pcb_idx;
 #endif
 static u8_t                   dns_seqno;
 static struct dns_table_entry dns_table[DNS_TABLE_SIZE];
+/* index + 1 of the first entry in each bucket, 0 for an empty one */
+static u8_t                   dns_hash_heads[DNS_HASH_SIZE];
 static struct dns_req_entry   dns_requests[DNS_MAX_REQUESTS];
 static ip_addr_t              dns_servers[DNS_MAX_SERVERS];
 
@@ -583,6 +602,79 @@ dns_local_addhost(const char *hostname, const ip_addr_t *addr)
 #endif /* DNS_LOCAL_HOSTLIST_IS_DYNAMIC*/
 #endif /* DNS_LOCAL_HOSTLIST */
 
+/**
+ * Case insensitive hash of a host name, names that lwip_strnicmp() finds
+ * equal hash the same.
+ */
+static u16_t
+dns_hash_name(const char *name)
+{
+  u32_t hash = 2166136261UL;
+  char c;
+
+  while ((c = *name++) != 0) {
+    if ((c >= 'A') && (c <= 'Z')) {
+      c = (char)(c | 0x20);
+    }
+    hash = (hash ^ (u8_t)c) * 16777619UL;
+  }
+  return (u16_t)(hash ^ (hash >> 16));
+}
+
+/** Put an entry whose name was just set into its hash bucket */
+static void
+dns_hash_add(u8_t idx)
+{
+  struct dns_table_entry *entry = &dns_table[idx];
+  u8_t bucket;
+
+  entry->hash = dns_hash_name(entry->name);
+  bucket = (u8_t)(entry->hash % DNS_HASH_SIZE);
+  entry->hash_next = dns_hash_heads[bucket];
+  dns_hash_heads[bucket] = (u8_t)(idx + 1);
+}
+
+/** Take an entry out of its hash bucket */
+static void
+dns_hash_remove(u8_t idx)
+{
+  u8_t *link = &dns_hash_heads[dns_table[idx].hash % DNS_HASH_SIZE];
+
+  while (*link != 0) {
+    if (*link == idx + 1) {
+      *link = dns_table[idx].hash_next;
+      return;
+    }
+    link = &dns_table[*link - 1].hash_next;
+  }
+}
+
+/** Flush an entry from the table */
+static void
+dns_entry_flush(u8_t idx)
+{
+  dns_hash_remove(idx);
+  dns_table[idx].state = DNS_STATE_UNUSED;
+}
+
+/**
+ * A query of an entry failed. Callers get NULL, a refreshed entry keeps
+ * answering with the address it had until its TTL runs out.
+ */
+static void
+dns_entry_failed(u8_t idx)
+{
+  struct dns_table_entry *entry = &dns_table[idx];
+
+  dns_call_found(idx, NULL);
+  if ((entry->flags & DNS_ENTRY_CACHED) && (entry->ttl > 0)) {
+    entry->flags = 0;
+    entry->state = DNS_STATE_DONE;
+  } else {
+    dns_entry_flush(idx);
+  }
+}
+
 /**
  * @ingroup dns
  * Look up a hostname in the array of known hostnames.
@@ -596,11 +688,13 @@ dns_local_addhost(const char *hostname, const ip_addr_t *addr)
  * @param addr the hostname's IP address, as u32_t (instead of ip_addr_t to
  *         better check for failure: != IPADDR_NONE) or IPADDR_NONE if the hostname
  *         was not found in the cached dns_table.
- * @return ERR_OK if found, ERR_ARG if not found
+ * @return ERR_OK if found, ERR_VAL if known not to exist, ERR_ARG if not found
  */
 static err_t
 dns_lookup(const char *name, ip_addr_t *addr LWIP_DNS_ADDRTYPE_ARG(u8_t dns_addrtype))
 {
+  struct dns_table_entry *entry;
+  u16_t hash;
   u8_t i;
 #if DNS_LOCAL_HOSTLIST
   if (dns_lookup_local(name, addr LWIP_DNS_ADDRTYPE_ARG(dns_addrtype)) == ERR_OK) {
@@ -613,17 +707,32 @@ dns_lookup(const char *name, ip_addr_t *addr LWIP_DNS_ADDRTYPE_ARG(u8_t dns_addr
   }
 #endif /* DNS_LOOKUP_LOCAL_EXTERN */
 
-  /* Walk through name list, return entry if found. If not, return NULL. */
-  for (i = 0; i < DNS_TABLE_SIZE; ++i) {
-    if ((dns_table[i].state == DNS_STATE_DONE) &&
-        (lwip_strnicmp(name, dns_table[i].name, sizeof(dns_table[i].name)) == 0) &&
-        LWIP_DNS_ADDRTYPE_MATCH_IP(dns_addrtype, dns_table[i].ipaddr)) {
+  /* Walk through the name's hash bucket, return entry if found. */
+  hash = dns_hash_name(name);
+  for (i = dns_hash_heads[hash % DNS_HASH_SIZE]; i != 0; i = entry->hash_next) {
+    entry = &dns_table[i - 1];
+    if ((entry->hash != hash) ||
+        ((entry->state != DNS_STATE_DONE) && !(entry->flags & DNS_ENTRY_CACHED)) ||
+        (lwip_strnicmp(name, entry->name, sizeof(entry->name)) != 0)) {
+      continue;
+    }
+    if (entry->flags & DNS_ENTRY_NEGATIVE) {
+#if LWIP_IPV4 && LWIP_IPV6
+      if (entry->addrtype != dns_addrtype) {
+        continue;
+      }
+#endif /* LWIP_IPV4 && LWIP_IPV6 */
+      LWIP_DEBUGF(DNS_DEBUG, ("dns_lookup: \"%s\": known not to exist\n", name));
+      return ERR_VAL;
+    }
+    if (LWIP_DNS_ADDRTYPE_MATCH_IP(dns_addrtype, entry->ipaddr)) {
       LWIP_DEBUGF(DNS_DEBUG, ("dns_lookup: \"%s\": found = ", name));
-      ip_addr_debug_print_val(DNS_DEBUG, dns_table[i].ipaddr);
+      ip_addr_debug_print_val(DNS_DEBUG, entry->ipaddr);
       LWIP_DEBUGF(DNS_DEBUG, ("\n"));
       if (addr) {
-        ip_addr_copy(*addr, dns_table[i].ipaddr);
+        ip_addr_copy(*addr, entry->ipaddr);
       }
+      entry->flags |= DNS_ENTRY_USED;
       return ERR_OK;
     }
   }
@@ -766,10 +875,8 @@ dns_send(u8_t idx)
 #endif
      ) {
     /* DNS server not valid anymore, e.g. PPP netif has been shut down */
-    /* call specified callback function if provided */
-    dns_call_found(idx, NULL);
-    /* flush this entry */
-    entry->state = DNS_STATE_UNUSED;
+    /* call specified callback function if provided, flush this entry */
+    dns_entry_failed(idx);
     return ERR_OK;
   }
 
@@ -1081,10 +1188,8 @@ dns_check_entry(u8_t i)
             entry->retries = 0;
           } else {
             LWIP_DEBUGF(DNS_DEBUG, ("dns_check_entry: \"%s\": timeout\n", entry->name));
-            /* call specified callback function if provided */
-            dns_call_found(i, NULL);
-            /* flush this entry */
-            entry->state = DNS_STATE_UNUSED;
+            /* call specified callback function if provided, flush this entry */
+            dns_entry_failed(i);
             break;
           }
         } else {
@@ -1105,8 +1210,29 @@ dns_check_entry(u8_t i)
       if ((entry->ttl == 0) || (--entry->ttl == 0)) {
         LWIP_DEBUGF(DNS_DEBUG, ("dns_check_entry: \"%s\": flush\n", entry->name));
         /* flush this entry, there cannot be any related pending entries in this state */
-        entry->state = DNS_STATE_UNUSED;
+        dns_entry_flush(i);
+      }
+#if DNS_PREFETCH_TIME
+      else if ((entry->ttl <= DNS_PREFETCH_TIME) &&
+               ((entry->flags & (DNS_ENTRY_USED | DNS_ENTRY_NEGATIVE)) == DNS_ENTRY_USED)
+#if LWIP_DNS_SUPPORT_MDNS_QUERIES
+               && !entry->is_mdns
+#endif /* LWIP_DNS_SUPPORT_MDNS_QUERIES */
+              ) {
+        /* still in use and about to expire: ask again, lookups are answered
+           from the entry meanwhile, so nobody waits for the round trip */
+#if ((LWIP_DNS_SECURE & LWIP_DNS_SECURE_RAND_SRC_PORT) != 0)
+        entry->pcb_idx = dns_alloc_pcb();
+        if (entry->pcb_idx >= DNS_MAX_SOURCE_PORTS) {
+          break;
+        }
+#endif
+        LWIP_DEBUGF(DNS_DEBUG, ("dns_check_entry: \"%s\": refresh\n", entry->name));
+        entry->flags = DNS_ENTRY_CACHED;
+        entry->state = DNS_STATE_NEW;
+        dns_check_entry(i);
       }
+#endif /* DNS_PREFETCH_TIME */
       break;
     case DNS_STATE_UNUSED:
       /* nothing to do */
@@ -1139,6 +1265,7 @@ dns_correct_response(u8_t idx, u32_t ttl)
   struct dns_table_entry *entry = &dns_table[idx];
 
   entry->state = DNS_STATE_DONE;
+  entry->flags = 0;
 
   LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": response = ", entry->name));
   ip_addr_debug_print_val(DNS_DEBUG, entry->ipaddr);
@@ -1158,11 +1285,29 @@ dns_correct_response(u8_t idx, u32_t ttl)
        -> flush this entry now */
     /* entry reused during callback? */
     if (entry->state == DNS_STATE_DONE) {
-      entry->state = DNS_STATE_UNUSED;
+      dns_entry_flush(idx);
     }
   }
 }
 
+#if DNS_NEG_TTL
+/**
+ * Remember that the name of an entry does not exist, or has no address of
+ * the requested type, and tell the callers.
+ */
+static void
+dns_negative_response(u8_t idx)
+{
+  struct dns_table_entry *entry = &dns_table[idx];
+
+  LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": does not exist\n", entry->name));
+  entry->state = DNS_STATE_DONE;
+  entry->flags = DNS_ENTRY_NEGATIVE;
+  entry->ttl   = DNS_NEG_TTL;
+  dns_call_found(idx, NULL);
+}
+#endif /* DNS_NEG_TTL */
+
 /**
  * Receive input function for DNS response packets arriving for the dns UDP pcb.
  */
@@ -1349,8 +1494,19 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
         }
         /* call callback to indicate error, clean up memory and return */
         pbuf_free(p);
-        dns_call_found(i, NULL);
-        dns_table[i].state = DNS_STATE_UNUSED;
+#if DNS_NEG_TTL
+        /* NXDOMAIN, or a complete answer without an address: asking again won't help */
+        if ((((hdr.flags2 & DNS_FLAG2_ERR_MASK) == DNS_FLAG2_ERR_NAME) ||
+             (((hdr.flags2 & DNS_FLAG2_ERR_MASK) == DNS_FLAG2_ERR_NONE) && !(hdr.flags1 & DNS_FLAG1_TRUNC)))
+#if LWIP_DNS_SUPPORT_MDNS_QUERIES
+            && !entry->is_mdns
+#endif /* LWIP_DNS_SUPPORT_MDNS_QUERIES */
+           ) {
+          dns_negative_response(i);
+          return;
+        }
+#endif /* DNS_NEG_TTL */
+        dns_entry_failed(i);
         return;
       }
     }
@@ -1383,9 +1539,10 @@ dns_enqueue(const char *name, size_t hostnamelen, dns_found_callback found,
 
 #if ((LWIP_DNS_SECURE & LWIP_DNS_SECURE_NO_MULTIPLE_OUTSTANDING) != 0)
   u8_t r;
-  /* check for duplicate entries */
-  for (i = 0; i < DNS_TABLE_SIZE; i++) {
-    if ((dns_table[i].state == DNS_STATE_ASKING) &&
+  u16_t hash = dns_hash_name(name);
+  /* check for duplicate entries, the hash chain holds index + 1 */
+  for (i = dns_hash_heads[hash % DNS_HASH_SIZE]; i-- != 0; i = dns_table[i].hash_next) {
+    if ((dns_table[i].state == DNS_STATE_ASKING) && (dns_table[i].hash == hash) &&
         (lwip_strnicmp(name, dns_table[i].name, sizeof(dns_table[i].name)) == 0)) {
 #if LWIP_IPV4 && LWIP_IPV6
       if (dns_table[i].reqaddrtype != dns_addrtype) {
@@ -1440,6 +1597,7 @@ dns_enqueue(const char *name, size_t hostnamelen, dns_found_callback found,
       /* use the oldest completed one */
       i = lseqi;
       entry = &dns_table[i];
+      dns_hash_remove(i);
     }
   }
 
@@ -1468,21 +1626,24 @@ dns_enqueue(const char *name, size_t hostnamelen, dns_found_callback found,
 
   /* fill the entry */
   entry->state = DNS_STATE_NEW;
+  entry->flags = 0;
   entry->seqno = dns_seqno;
   LWIP_DNS_SET_ADDRTYPE(entry->reqaddrtype, dns_addrtype);
+  LWIP_DNS_SET_ADDRTYPE(entry->addrtype, dns_addrtype);
   LWIP_DNS_SET_ADDRTYPE(req->reqaddrtype, dns_addrtype);
   req->found = found;
   req->arg   = callback_arg;
   namelen = LWIP_MIN(hostnamelen, DNS_MAX_NAME_LENGTH - 1);
   MEMCPY(entry->name, name, namelen);
   entry->name[namelen] = 0;
+  dns_hash_add(i);
 
 #if ((LWIP_DNS_SECURE & LWIP_DNS_SECURE_RAND_SRC_PORT) != 0)
   entry->pcb_idx = dns_alloc_pcb();
   if (entry->pcb_idx >= DNS_MAX_SOURCE_PORTS) {
     /* failed to get a UDP pcb */
     LWIP_DEBUGF(DNS_DEBUG, ("dns_enqueue: \"%s\": failed to allocate a pcb\n", name));
-    entry->state = DNS_STATE_UNUSED;
+    dns_entry_flush(i);
     req->found = NULL;
     return ERR_MEM;
   }
@@ -1513,6 +1674,8 @@ dns_enqueue(const char *name, size_t hostnamelen, dns_found_callback found,
  * - ERR_INPROGRESS enqueue a request to be sent to the DNS server
  *   for resolution if no errors are present.
  * - ERR_ARG: dns client not initialized or invalid hostname
+ * - ERR_VAL: no DNS server, or the server said recently that the name
+ *   does not exist (see DNS_NEG_TTL)
  *
  * @param hostname the hostname that is to be queried
  * @param addr pointer to a ip_addr_t where to store the address if it is already
@@ -1548,6 +1711,7 @@ dns_gethostbyname_addrtype(const char *hostname, ip_addr_t *addr, dns_found_call
                            void *callback_arg, u8_t dns_addrtype)
 {
   size_t hostnamelen;
+  err_t err;
 #if LWIP_DNS_SUPPORT_MDNS_QUERIES
   u8_t is_mdns;
 #endif
@@ -1586,9 +1750,10 @@ dns_gethostbyname_addrtype(const char *hostname, ip_addr_t *addr, dns_found_call
       return ERR_OK;
     }
   }
-  /* already have this address cached? */
-  if (dns_lookup(hostname, addr LWIP_DNS_ADDRTYPE_ARG(dns_addrtype)) == ERR_OK) {
-    return ERR_OK;
+  /* already have this address cached, or know that there is none? */
+  err = dns_lookup(hostname, addr LWIP_DNS_ADDRTYPE_ARG(dns_addrtype));
+  if ((err == ERR_OK) || (err == ERR_VAL)) {
+    return err;
   }
 #if LWIP_IPV4 && LWIP_IPV6
   if ((dns_addrtype == LWIP_DNS_ADDRTYPE_IPV4_IPV6) || (dns_addrtype == LWIP_DNS_ADDRTYPE_IPV6_IPV4)) {
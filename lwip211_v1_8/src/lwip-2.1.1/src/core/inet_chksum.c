@@ -76,7 +76,7 @@ u16_t lwip_standard_chksum(const void *dataptr, int len);
  * @note accumulator size limits summable length to 64k
  * @note host endianness is irrelevant (p3 RFC1071)
  */
-u16_t
+LWIP_HOT_TEXT u16_t
 lwip_standard_chksum(const void *dataptr, int len)
 {
   u32_t acc;
@@ -129,7 +129,7 @@ lwip_standard_chksum(const void *dataptr, int len)
  * @param len length of data to be summed
  * @return host order (!) lwip checksum (non-inverted Internet sum)
  */
-u16_t
+LWIP_HOT_TEXT u16_t
 lwip_standard_chksum(const void *dataptr, int len)
 {
   const u8_t *pb = (const u8_t *)dataptr;
@@ -185,7 +185,7 @@ lwip_standard_chksum(const void *dataptr, int len)
  *
  * by Curt McDowell, Broadcom Corp. December 8th, 2005
  */
-u16_t
+LWIP_HOT_TEXT u16_t
 lwip_standard_chksum(const void *dataptr, int len)
 {
   const u8_t *pb = (const u8_t *)dataptr;
@@ -306,7 +306,7 @@ inet_cksum_pseudo_base(struct pbuf *p, u8_t proto, u16_t proto_len, u32_t acc)
  * @param proto_len length of the ip data part (used for checksum of pseudo header)
  * @return checksum (as u16_t) to be saved directly in the protocol header
  */
-u16_t
+LWIP_HOT_TEXT u16_t
 inet_chksum_pseudo(struct pbuf *p, u8_t proto, u16_t proto_len,
                    const ip4_addr_t *src, const ip4_addr_t *dest)
 {
@@ -551,7 +551,7 @@ ip_chksum_pseudo_partial(struct pbuf *p, u8_t proto, u16_t proto_len,
  * @return checksum (as u16_t) to be saved directly in the protocol header
  */
 
-u16_t
+LWIP_HOT_TEXT u16_t
 inet_chksum(const void *dataptr, u16_t len)
 {
   return (u16_t)~(unsigned int)LWIP_CHKSUM(dataptr, len);
@@ -139,6 +139,39 @@ PACK_STRUCT_END
 #error "MEMP_NUM_REASSDATA > IP_REASS_MAX_PBUFS doesn't make sense since each struct ip_reassdata must hold 2 pbufs at least!"
 #endif
 #endif /* !MEMP_MEM_MALLOC */
+#if PBUF_POOL_QUOTAS && MEMP_MEM_MALLOC
+#error "PBUF_POOL_QUOTAS needs the pbuf pool in memp, it cannot be used with MEMP_MEM_MALLOC"
+#endif
+#if PBUF_POOL_SMALL_SIZE && PBUF_POOL_MEDIUM_SIZE && (PBUF_POOL_SMALL_BUFSIZE >= PBUF_POOL_MEDIUM_BUFSIZE)
+#error "PBUF_POOL_SMALL_BUFSIZE must be smaller than PBUF_POOL_MEDIUM_BUFSIZE"
+#endif
+#if (PBUF_POOL_SMALL_SIZE && (PBUF_POOL_SMALL_BUFSIZE >= PBUF_POOL_BUFSIZE)) || (PBUF_POOL_MEDIUM_SIZE && (PBUF_POOL_MEDIUM_BUFSIZE >= PBUF_POOL_BUFSIZE))
+#error "PBUF_POOL_SMALL_BUFSIZE and PBUF_POOL_MEDIUM_BUFSIZE must be smaller than PBUF_POOL_BUFSIZE"
+#endif
+#if PBUF_POOL_QUOTAS > 255
+#error "PBUF_POOL_QUOTAS must be at most 255"
+#endif
+#if PBUF_POOL_PAYLOAD_ALIGNMENT && MEMP_MEM_MALLOC
+#error "PBUF_POOL_PAYLOAD_ALIGNMENT needs the pbuf pool in memp, it cannot be used with MEMP_MEM_MALLOC"
+#endif
+#if PBUF_POOL_PAYLOAD_ALIGNMENT && (((PBUF_POOL_PAYLOAD_ALIGNMENT) & ((PBUF_POOL_PAYLOAD_ALIGNMENT) - 1)) || (PBUF_POOL_PAYLOAD_ALIGNMENT < MEM_ALIGNMENT))
+#error "PBUF_POOL_PAYLOAD_ALIGNMENT must be a power of 2 and at least MEM_ALIGNMENT"
+#endif
+#if MEM_TLSF && (MEM_LIBC_MALLOC || MEM_USE_POOLS || MEM_OVERFLOW_CHECK)
+#error "MEM_TLSF cannot be used with MEM_LIBC_MALLOC, MEM_USE_POOLS or MEM_OVERFLOW_CHECK"
+#endif
+#if MEMP_MAGAZINE && (MEMP_MEM_MALLOC || MEMP_OVERFLOW_CHECK || defined(LWIP_HOOK_MEMP_AVAILABLE))
+#error "MEMP_MAGAZINE cannot be used with MEMP_MEM_MALLOC, MEMP_OVERFLOW_CHECK or LWIP_HOOK_MEMP_AVAILABLE"
+#endif
+#if MEMP_MAGAZINE && ((MEMP_MAGAZINE_SIZE < 2) || (MEMP_MAGAZINE_SIZE > 255))
+#error "MEMP_MAGAZINE_SIZE must be between 2 and 255"
+#endif
+#if MEMP_LAZY_INIT && (MEMP_MEM_MALLOC || MEMP_LOCKFREE || (MEMP_OVERFLOW_CHECK >= 2) || defined(LWIP_HOOK_MEMP_AVAILABLE))
+#error "MEMP_LAZY_INIT cannot be used with MEMP_MEM_MALLOC, MEMP_LOCKFREE, MEMP_OVERFLOW_CHECK >= 2 or LWIP_HOOK_MEMP_AVAILABLE"
+#endif
+#if MEMP_LOCKFREE && (MEMP_MEM_MALLOC || MEMP_OVERFLOW_CHECK || MEMP_SANITY_CHECK || defined(LWIP_HOOK_MEMP_AVAILABLE))
+#error "MEMP_LOCKFREE cannot be used with MEMP_MEM_MALLOC, MEMP_OVERFLOW_CHECK, MEMP_SANITY_CHECK or LWIP_HOOK_MEMP_AVAILABLE"
+#endif
 #if LWIP_WND_SCALE
 #if (LWIP_TCP && (TCP_WND > 0xffffffff))
 #error "If you want to use TCP, TCP_WND must fit in an u32_t, so, you have to reduce it in your lwipopts.h"
@@ -175,12 +208,45 @@ PACK_STRUCT_END
 #if (LWIP_TCP && LWIP_TCP_SACK_OUT && (LWIP_TCP_MAX_SACK_NUM < 1))
 #error "LWIP_TCP_MAX_SACK_NUM must be greater than 0"
 #endif
+#if (LWIP_TCP && LWIP_TCP_SACK_IN && !LWIP_TCP_SACK_OUT)
+#error "To use LWIP_TCP_SACK_IN, LWIP_TCP_SACK_OUT needs to be enabled"
+#endif
+#if (LWIP_TCP && LWIP_TCP_CC && !LWIP_HAVE_INT64)
+#error "LWIP_TCP_CC needs LWIP_HAVE_INT64 (CUBIC uses 64-bit arithmetic)"
+#endif
+#if (LWIP_TCP && LWIP_TCP_SYN_COOKIES && !defined(LWIP_RAND))
+#error "LWIP_TCP_SYN_COOKIES needs LWIP_RAND() for the cookie secret"
+#endif
+#if (LWIP_TCP && ((LWIP_TCP_SYN_COOKIES < 0) || (LWIP_TCP_SYN_COOKIES > 2)))
+#error "LWIP_TCP_SYN_COOKIES must be 0, 1 or 2"
+#endif
+#if (LWIP_TCP && LWIP_TCP_FASTOPEN && !defined(LWIP_RAND))
+#error "LWIP_TCP_FASTOPEN needs LWIP_RAND() for the cookie secret"
+#endif
+#if (LWIP_TCP && TCP_PCB_HASH && ((TCP_PCB_HASH_SIZE & (TCP_PCB_HASH_SIZE - 1)) != 0))
+#error "TCP_PCB_HASH_SIZE must be a power of 2"
+#endif
+#if (LWIP_TCP && TCP_TW_COMPACT && ((TCP_TW_HASH_SIZE & (TCP_TW_HASH_SIZE - 1)) != 0))
+#error "TCP_TW_HASH_SIZE must be a power of 2"
+#endif
+#if (LWIP_TCP && TCP_TW_COMPACT && (MEMP_NUM_TCP_TW <= 0))
+#error "TCP_TW_COMPACT needs MEMP_NUM_TCP_TW > 0"
+#endif
+#if (LWIP_UDP && UDP_PCB_HASH && ((UDP_PCB_HASH_SIZE & (UDP_PCB_HASH_SIZE - 1)) != 0))
+#error "UDP_PCB_HASH_SIZE must be a power of 2"
+#endif
 #if (LWIP_NETIF_API && (NO_SYS==1))
 #error "If you want to use NETIF API, you have to define NO_SYS=0 in your lwipopts.h"
 #endif
 #if ((LWIP_SOCKET || LWIP_NETCONN) && (NO_SYS==1))
 #error "If you want to use Sequential API, you have to define NO_SYS=0 in your lwipopts.h"
 #endif
+#if (LWIP_SOCKET && LWIP_SOCKET_EPOLL && !LWIP_SOCKET_SELECT && !LWIP_SOCKET_POLL)
+#error "LWIP_SOCKET_EPOLL needs LWIP_SOCKET_SELECT or LWIP_SOCKET_POLL"
+#endif
+#if (LWIP_SOCKET && LWIP_SOCKET_EPOLL && (LWIP_SOCKET_EPOLL_MAX > 254))
+#error "LWIP_SOCKET_EPOLL_MAX must be below 255"
+#endif
 #if (LWIP_PPP_API && (NO_SYS==1))
 #error "If you want to use PPP API, you have to define NO_SYS=0 in your lwipopts.h"
 #endif
@@ -235,6 +301,12 @@ PACK_STRUCT_END
 #if LWIP_TCPIP_CORE_LOCKING_INPUT && !LWIP_TCPIP_CORE_LOCKING
 #error "When using LWIP_TCPIP_CORE_LOCKING_INPUT, LWIP_TCPIP_CORE_LOCKING must be enabled, too"
 #endif
+#if TCPIP_MBOX_BULK && LWIP_TCPIP_CORE_LOCKING_INPUT
+#error "TCPIP_MBOX_BULK has no effect with LWIP_TCPIP_CORE_LOCKING_INPUT, disable one of them"
+#endif
+#if TCPIP_MBOX_BULK && (TCPIP_MBOX_BULK_BATCH < 1)
+#error "TCPIP_MBOX_BULK_BATCH must be at least 1"
+#endif
 #if LWIP_TCP && LWIP_NETIF_TX_SINGLE_PBUF && !TCP_OVERSIZE
 #error "LWIP_NETIF_TX_SINGLE_PBUF needs TCP_OVERSIZE enabled to create single-pbuf TCP packets"
 #endif
@@ -100,10 +100,19 @@ struct etharp_entry {
   struct eth_addr ethaddr;
   u16_t ctime;
   u8_t state;
+#if ETHARP_TABLE_HASH
+  /** index + 1 of the next entry in the same hash bucket, 0 at the end */
+  netif_addr_idx_t hash_next;
+#endif /* ETHARP_TABLE_HASH */
 };
 
 static struct etharp_entry arp_table[ARP_TABLE_SIZE];
 
+#if ETHARP_TABLE_HASH
+/** index + 1 of the first entry of each bucket, 0 if it is empty */
+static netif_addr_idx_t arp_hash[ETHARP_TABLE_HASH_SIZE];
+#endif /* ETHARP_TABLE_HASH */
+
 #if !LWIP_NETIF_HWADDRHINT
 static netif_addr_idx_t etharp_cached_entry;
 #endif /* !LWIP_NETIF_HWADDRHINT */
@@ -137,6 +146,67 @@ static err_t etharp_raw(struct netif *netif,
                         const struct eth_addr *hwdst_addr, const ip4_addr_t *ipdst_addr,
                         const u16_t opcode);
 
+#if ETHARP_TABLE_HASH
+static netif_addr_idx_t *
+etharp_hash_bucket(const ip4_addr_t *ipaddr)
+{
+  u32_t h = ip4_addr_get_u32(ipaddr);
+  h ^= h >> 16;
+  h *= 0x45d9f3bUL;
+  h ^= h >> 16;
+  return &arp_hash[h & (ETHARP_TABLE_HASH_SIZE - 1)];
+}
+
+/** Add an entry to the hash table once its IP address is set */
+static void
+etharp_hash_add(s16_t i)
+{
+  netif_addr_idx_t *bucket = etharp_hash_bucket(&arp_table[i].ipaddr);
+  arp_table[i].hash_next = *bucket;
+  *bucket = (netif_addr_idx_t)(i + 1);
+}
+
+/** Remove an entry from the hash table (if it is in it) */
+static void
+etharp_hash_remove(s16_t i)
+{
+  netif_addr_idx_t *p = etharp_hash_bucket(&arp_table[i].ipaddr);
+  for (; *p != 0; p = &arp_table[*p - 1].hash_next) {
+    if (*p == i + 1) {
+      *p = arp_table[i].hash_next;
+      break;
+    }
+  }
+  arp_table[i].hash_next = 0;
+}
+
+/**
+ * Find the pending or stable entry of an IP address.
+ *
+ * @param netif netif the entry must belong to, NULL for any
+ *              (only used with ETHARP_TABLE_MATCH_NETIF)
+ * @return the entry index or ARP_TABLE_SIZE
+ */
+static s16_t
+etharp_hash_find(const ip4_addr_t *ipaddr, struct netif *netif)
+{
+  netif_addr_idx_t n;
+
+  LWIP_UNUSED_ARG(netif);
+  for (n = *etharp_hash_bucket(ipaddr); n != 0; n = arp_table[n - 1].hash_next) {
+    struct etharp_entry *e = &arp_table[n - 1];
+    if ((e->state != ETHARP_STATE_EMPTY) && ip4_addr_cmp(ipaddr, &e->ipaddr)
+#if ETHARP_TABLE_MATCH_NETIF
+        && ((netif == NULL) || (netif == e->netif))
+#endif /* ETHARP_TABLE_MATCH_NETIF */
+       ) {
+      return (s16_t)(n - 1);
+    }
+  }
+  return ARP_TABLE_SIZE;
+}
+#endif /* ETHARP_TABLE_HASH */
+
 #if ARP_QUEUEING
 /**
  * Free a complete queue of etharp entries
@@ -169,6 +239,9 @@ etharp_free_entry(int i)
 {
   /* remove from SNMP ARP index tree */
   mib2_remove_arp_entry(arp_table[i].netif, &arp_table[i].ipaddr);
+#if ETHARP_TABLE_HASH
+  etharp_hash_remove((s16_t)i);
+#endif /* ETHARP_TABLE_HASH */
   /* and empty packet queue */
   if (arp_table[i].q != NULL) {
     /* remove all queued packets */
@@ -176,6 +249,10 @@ etharp_free_entry(int i)
     free_etharp_q(arp_table[i].q);
     arp_table[i].q = NULL;
   }
+  if (arp_table[i].state >= ETHARP_STATE_STABLE) {
+    /* forwarded packets may be going there */
+    IP4_FORWARD_CACHE_FLUSH();
+  }
   /* recycle entry for re-use */
   arp_table[i].state = ETHARP_STATE_EMPTY;
 #ifdef LWIP_DEBUG
@@ -265,6 +342,20 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
 
   LWIP_UNUSED_ARG(netif);
 
+#if ETHARP_TABLE_HASH
+  if (ipaddr != NULL) {
+    i = etharp_hash_find(ipaddr, netif);
+    if (i < ARP_TABLE_SIZE) {
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: found matching entry %d\n", (int)i));
+      return i;
+    }
+    /* the sweep below only looks for an entry to (re)use */
+    if ((flags & ETHARP_FLAG_FIND_ONLY) != 0) {
+      return (s16_t)ERR_MEM;
+    }
+  }
+#endif /* ETHARP_TABLE_HASH */
+
   /**
    * a) do a search through the cache, remember candidates
    * b) select candidate entry
@@ -392,6 +483,9 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
   if (ipaddr != NULL) {
     /* set IP address */
     ip4_addr_copy(arp_table[i].ipaddr, *ipaddr);
+#if ETHARP_TABLE_HASH
+    etharp_hash_add(i);
+#endif /* ETHARP_TABLE_HASH */
   }
   arp_table[i].ctime = 0;
 #if ETHARP_TABLE_MATCH_NETIF
@@ -462,6 +556,9 @@ etharp_update_arp_entry(struct netif *netif, const ip4_addr_t *ipaddr, struct et
 
   LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_update_arp_entry: updating stable entry %"S16_F"\n", i));
   /* update address */
+  if (memcmp(&arp_table[i].ethaddr, ethaddr, ETH_HWADDR_LEN) != 0) {
+    IP4_FORWARD_CACHE_FLUSH();
+  }
   SMEMCPY(&arp_table[i].ethaddr, ethaddr, ETH_HWADDR_LEN);
   /* reset time stamp */
   arp_table[i].ctime = 0;
@@ -874,6 +971,13 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
 
     /* find stable entry: do this here since this is a critical path for
        throughput and etharp_find_entry() is kind of slow */
+#if ETHARP_TABLE_HASH
+    i = (netif_addr_idx_t)etharp_hash_find(dst_addr, netif);
+    if ((i < ARP_TABLE_SIZE) && (arp_table[i].state >= ETHARP_STATE_STABLE)) {
+      ETHARP_SET_ADDRHINT(netif, i);
+      return etharp_output_to_arp_index(netif, q, i);
+    }
+#else /* ETHARP_TABLE_HASH */
     for (i = 0; i < ARP_TABLE_SIZE; i++) {
       if ((arp_table[i].state >= ETHARP_STATE_STABLE) &&
 #if ETHARP_TABLE_MATCH_NETIF
@@ -885,6 +989,7 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
         return etharp_output_to_arp_index(netif, q, i);
       }
     }
+#endif /* ETHARP_TABLE_HASH */
     /* no stable entry found, use the (slower) query function:
        queue on destination Ethernet address belonging to ipaddr */
     return etharp_query(netif, dst_addr, q);
@@ -56,6 +56,8 @@
 #include "lwip/autoip.h"
 #include "lwip/stats.h"
 #include "lwip/prot/iana.h"
+#include "lwip/etharp.h"
+#include "netif/ethernet.h"
 
 #include <string.h>
 
@@ -117,6 +119,7 @@ void
 ip4_set_default_multicast_netif(struct netif *default_multicast_netif)
 {
   ip4_default_multicast_netif = default_multicast_netif;
+  IP4_ROUTE_CACHE_FLUSH();
 }
 #endif /* LWIP_MULTICAST_TX_OPTIONS */
 
@@ -139,6 +142,110 @@ ip4_route_src(const ip4_addr_t *src, const ip4_addr_t *dest)
 }
 #endif /* LWIP_HOOK_IP4_ROUTE_SRC */
 
+#if LWIP_IPV4_ROUTE_CACHE || LWIP_IPV4_FORWARD_CACHE
+/** Fold an address into the low bits, to index the caches below */
+static u32_t
+ip4_addr_fold(const ip4_addr_t *addr)
+{
+  u32_t h = ip4_addr_get_u32(addr);
+
+  h ^= h >> 16;
+  h ^= h >> 8;
+  return h;
+}
+#endif /* LWIP_IPV4_ROUTE_CACHE || LWIP_IPV4_FORWARD_CACHE */
+
+#if LWIP_IPV4_ROUTE_CACHE
+/** A destination ip4_route() has found a netif for, see IP_ROUTE_CACHE */
+struct ip4_route_entry {
+  ip4_addr_t dest;
+  /** NULL for an unused entry */
+  struct netif *netif;
+};
+
+static struct ip4_route_entry ip4_route_cache[IP_ROUTE_CACHE];
+/** Bumped by every flush, invalidates all struct ip4_route_hint */
+static u32_t ip4_route_gen = 1;
+
+/**
+ * Forget all routes. Called when a netif changes in a way that may change
+ * where packets go.
+ */
+void
+ip4_route_cache_flush(void)
+{
+  memset(ip4_route_cache, 0, sizeof(ip4_route_cache));
+  ip4_route_gen++;
+  if (ip4_route_gen == 0) {
+    /* a zeroed hint must never look valid */
+    ip4_route_gen = 1;
+  }
+}
+
+/**
+ * Like ip4_route(), but first looks at the netif the same caller found for
+ * dest last time (a pcb keeps it for its remote address), which is good
+ * until the route cache is flushed.
+ *
+ * @param dest the destination IP address for which to find the route
+ * @param hint the caller's last result, updated
+ * @return the netif on which to send to reach dest
+ */
+struct netif *
+ip4_route_hinted(const ip4_addr_t *dest, struct ip4_route_hint *hint)
+{
+  struct netif *netif;
+
+  if ((hint->gen == ip4_route_gen) && ip4_addr_cmp(&hint->dest, dest)) {
+    return hint->netif;
+  }
+  netif = ip4_route(dest);
+  if (netif != NULL) {
+    ip4_addr_copy(hint->dest, *dest);
+    hint->netif = netif;
+    hint->gen = ip4_route_gen;
+  }
+  return netif;
+}
+#endif /* LWIP_IPV4_ROUTE_CACHE */
+
+#if LWIP_IPV4_ROUTE_CACHE
+static struct netif *ip4_route_scan(const ip4_addr_t *dest);
+
+/**
+ * Finds the appropriate network interface for a given IP address. It
+ * searches the list of network interfaces linearly. A match is found
+ * if the masked IP address of the network interface equals the masked
+ * IP address given to the function. The result is cached per destination
+ * until a netif changes.
+ *
+ * @param dest the destination IP address for which to find the route
+ * @return the netif on which to send to reach dest
+ */
+struct netif *
+ip4_route(const ip4_addr_t *dest)
+{
+  struct ip4_route_entry *entry;
+  struct netif *netif;
+
+  LWIP_ASSERT("IP_ROUTE_CACHE must be a power of two",
+              (IP_ROUTE_CACHE & (IP_ROUTE_CACHE - 1)) == 0);
+  entry = &ip4_route_cache[ip4_addr_fold(dest) & (IP_ROUTE_CACHE - 1)];
+  if ((entry->netif != NULL) && ip4_addr_cmp(&entry->dest, dest)) {
+    return entry->netif;
+  }
+  netif = ip4_route_scan(dest);
+  if (netif != NULL) {
+    ip4_addr_copy(entry->dest, *dest);
+    entry->netif = netif;
+  }
+  return netif;
+}
+
+/** ip4_route() without the cache */
+static struct netif *
+ip4_route_scan(const ip4_addr_t *dest)
+#else /* LWIP_IPV4_ROUTE_CACHE */
 /**
  * Finds the appropriate network interface for a given IP address. It
  * searches the list of network interfaces linearly. A match is found
@@ -150,6 +257,7 @@ ip4_route_src(const ip4_addr_t *src, const ip4_addr_t *dest)
  */
 struct netif *
 ip4_route(const ip4_addr_t *dest)
+#endif /* LWIP_IPV4_ROUTE_CACHE */
 {
 #if !LWIP_SINGLE_NETIF
   struct netif *netif;
@@ -268,6 +376,197 @@ ip4_canforward(struct pbuf *p)
   return 1;
 }
 
+/** Decrement the TTL, updating the header checksum incrementally */
+static void
+ip4_forward_dec_ttl(struct ip_hdr *iphdr)
+{
+  IPH_TTL_SET(iphdr, IPH_TTL(iphdr) - 1);
+  if (IPH_CHKSUM(iphdr) >= PP_HTONS(0xffffU - 0x100)) {
+    IPH_CHKSUM_SET(iphdr, (u16_t)(IPH_CHKSUM(iphdr) + PP_HTONS(0x100) + 1));
+  } else {
+    IPH_CHKSUM_SET(iphdr, (u16_t)(IPH_CHKSUM(iphdr) + PP_HTONS(0x100)));
+  }
+}
+
+#if LWIP_IPV4_FORWARD_CACHE
+/** A destination ip4_forward() has sent packets to, see IP_FORWARD_FLOW_CACHE */
+struct ip4_forward_flow {
+  ip4_addr_t dest;
+  /** netif the packets arrived on */
+  struct netif *inp;
+  /** netif they go out on, NULL for an unused entry */
+  struct netif *netif;
+#if LWIP_ARP
+  /** 1 if netif->output is etharp_output(), which is skipped: mac is the next hop */
+  u8_t use_mac;
+  struct eth_addr mac;
+#endif /* LWIP_ARP */
+};
+
+static struct ip4_forward_flow ip4_forward_flows[IP_FORWARD_FLOW_CACHE];
+#if LWIP_NETIF_LINKOUTPUT_BURST
+/** nesting depth of ip4_forward_batch_begin() */
+static u8_t ip4_forward_batch_depth;
+/** the netif with a burst open for forwarded packets */
+static struct netif *ip4_forward_burst_netif;
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
+
+static struct ip4_forward_flow *
+ip4_forward_flow_slot(const ip4_addr_t *dest, const struct netif *inp)
+{
+  LWIP_ASSERT("IP_FORWARD_FLOW_CACHE must be a power of two",
+              (IP_FORWARD_FLOW_CACHE & (IP_FORWARD_FLOW_CACHE - 1)) == 0);
+  return &ip4_forward_flows[(ip4_addr_fold(dest) ^ inp->num) & (IP_FORWARD_FLOW_CACHE - 1)];
+}
+
+#if LWIP_NETIF_LINKOUTPUT_BURST
+static void
+ip4_forward_burst_close(void)
+{
+  struct netif *netif = ip4_forward_burst_netif;
+
+  if (netif != NULL) {
+    ip4_forward_burst_netif = NULL;
+    netif_burst_end(netif);
+  }
+}
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
+
+/**
+ * Forget all destinations. Called when a netif or an ARP entry changes, as
+ * either may change where packets go or whether they are for us.
+ */
+void
+ip4_forward_cache_flush(void)
+{
+  memset(ip4_forward_flows, 0, sizeof(ip4_forward_flows));
+#if LWIP_NETIF_LINKOUTPUT_BURST
+  /* the netif may be on its way out */
+  ip4_forward_burst_close();
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
+}
+
+/**
+ * Start a batch of received packets: packets forwarded from the flow cache
+ * until ip4_forward_batch_end() are staged for one netif->linkoutput_burst
+ * call per outgoing netif (see netif_burst_begin()). A driver that passes
+ * several received frames to the stack at once puts this around them.
+ */
+void
+ip4_forward_batch_begin(void)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+#if LWIP_NETIF_LINKOUTPUT_BURST
+  ip4_forward_batch_depth++;
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
+}
+
+/**
+ * End a batch started with ip4_forward_batch_begin(), sending the staged packets.
+ */
+void
+ip4_forward_batch_end(void)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+#if LWIP_NETIF_LINKOUTPUT_BURST
+  LWIP_ASSERT("ip4_forward_batch_end: no batch", ip4_forward_batch_depth > 0);
+  if (--ip4_forward_batch_depth == 0) {
+    ip4_forward_burst_close();
+  }
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
+}
+
+/** Remember where ip4_forward() has just sent a packet to */
+static void
+ip4_forward_flow_add(struct netif *inp, struct netif *netif, const ip4_addr_t *dest)
+{
+  struct ip4_forward_flow *flow = ip4_forward_flow_slot(dest, inp);
+
+#if LWIP_ARP
+  flow->use_mac = 0;
+  if (netif->output == etharp_output) {
+    /* the next hop as etharp_output() chooses it, packets are only cached once it is resolved */
+    const ip4_addr_t *nexthop = dest;
+    struct eth_addr *eth_ret;
+    const ip4_addr_t *ip_ret;
+
+    if (!ip4_addr_netcmp(dest, netif_ip4_addr(netif), netif_ip4_netmask(netif)) &&
+        !ip4_addr_islinklocal(dest)) {
+#ifdef LWIP_HOOK_ETHARP_GET_GW
+      return;
+#else /* LWIP_HOOK_ETHARP_GET_GW */
+      if (ip4_addr_isany_val(*netif_ip4_gw(netif))) {
+        return;
+      }
+      nexthop = netif_ip4_gw(netif);
+#endif /* LWIP_HOOK_ETHARP_GET_GW */
+    }
+    if (etharp_find_addr(netif, nexthop, &eth_ret, &ip_ret) < 0) {
+      return;
+    }
+    flow->use_mac = 1;
+    SMEMCPY(&flow->mac, eth_ret, ETH_HWADDR_LEN);
+  }
+#endif /* LWIP_ARP */
+  ip4_addr_copy(flow->dest, *dest);
+  flow->inp = inp;
+  flow->netif = netif;
+}
+
+/**
+ * Forward p from the flow cache, right after ip4_input() has checked the header.
+ * Skips the local address checks and the route lookup, and ARP if the outgoing netif
+ * uses it. Anything ip4_forward() would treat differently is left to the normal path.
+ *
+ * @return 1 if p was sent (the caller still frees it), 0 if it takes the normal path
+ */
+static int
+ip4_forward_fast(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp)
+{
+  struct ip4_forward_flow *flow = ip4_forward_flow_slot(ip4_current_dest_addr(), inp);
+  struct netif *netif = flow->netif;
+
+  if ((netif == NULL) || (flow->inp != inp) || !ip4_addr_cmp(&flow->dest, ip4_current_dest_addr())) {
+    return 0;
+  }
+  /* link-layer broadcasts, expiring TTL, fragmentation, invalid sources */
+  if ((p->flags & (PBUF_FLAG_LLBCAST | PBUF_FLAG_LLMCAST)) || (IPH_TTL(iphdr) <= 1) ||
+      (netif->mtu && (p->tot_len > netif->mtu)) ||
+      ip4_addr_ismulticast(ip4_current_src_addr()) || ip4_addr_isbroadcast(ip4_current_src_addr(), inp)) {
+    return 0;
+  }
+#if IP_ACCEPT_LINK_LAYER_ADDRESSING
+  if (IPH_PROTO(iphdr) == IP_PROTO_UDP) {
+    const struct udp_hdr *udphdr = (const struct udp_hdr *)((const u8_t *)iphdr + IPH_HL_BYTES(iphdr));
+    if (IP_ACCEPT_LINK_LAYER_ADDRESSED_PORT(udphdr->dest)) {
+      return 0;
+    }
+  }
+#endif /* IP_ACCEPT_LINK_LAYER_ADDRESSING */
+
+  ip4_forward_dec_ttl(iphdr);
+  IP_STATS_INC(ip.fw);
+  MIB2_STATS_INC(mib2.ipforwdatagrams);
+  IP_STATS_INC(ip.xmit);
+
+#if LWIP_NETIF_LINKOUTPUT_BURST
+  if ((ip4_forward_batch_depth > 0) && (ip4_forward_burst_netif != netif)) {
+    ip4_forward_burst_close();
+    netif_burst_begin(netif);
+    ip4_forward_burst_netif = netif;
+  }
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
+#if LWIP_ARP
+  if (flow->use_mac) {
+    ethernet_output(netif, p, (const struct eth_addr *)(netif->hwaddr), &flow->mac, ETHTYPE_IP);
+    return 1;
+  }
+#endif /* LWIP_ARP */
+  netif->output(netif, p, ip4_current_dest_addr());
+  return 1;
+}
+#endif /* LWIP_IPV4_FORWARD_CACHE */
+
 /**
  * Forwards an IP packet. It finds an appropriate route for the
  * packet, decrements the TTL value of the packet, adjusts the
@@ -316,7 +615,7 @@ ip4_forward(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp)
 #endif /* IP_FORWARD_ALLOW_TX_ON_RX_NETIF */
 
   /* decrement TTL */
-  IPH_TTL_SET(iphdr, IPH_TTL(iphdr) - 1);
+  ip4_forward_dec_ttl(iphdr);
   /* send ICMP if TTL == 0 */
   if (IPH_TTL(iphdr) == 0) {
     MIB2_STATS_INC(mib2.ipinhdrerrors);
@@ -329,13 +628,6 @@ ip4_forward(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp)
     return;
   }
 
-  /* Incrementally update the IP checksum. */
-  if (IPH_CHKSUM(iphdr) >= PP_HTONS(0xffffU - 0x100)) {
-    IPH_CHKSUM_SET(iphdr, (u16_t)(IPH_CHKSUM(iphdr) + PP_HTONS(0x100) + 1));
-  } else {
-    IPH_CHKSUM_SET(iphdr, (u16_t)(IPH_CHKSUM(iphdr) + PP_HTONS(0x100)));
-  }
-
   LWIP_DEBUGF(IP_DEBUG, ("ip4_forward: forwarding packet to %"U16_F".%"U16_F".%"U16_F".%"U16_F"\n",
                          ip4_addr1_16(ip4_current_dest_addr()), ip4_addr2_16(ip4_current_dest_addr()),
                          ip4_addr3_16(ip4_current_dest_addr()), ip4_addr4_16(ip4_current_dest_addr())));
@@ -363,6 +655,9 @@ ip4_forward(struct pbuf *p, struct ip_hdr *iphdr, struct netif *inp)
   }
   /* transmit pbuf on chosen interface */
   netif->output(netif, p, ip4_current_dest_addr());
+#if LWIP_IPV4_FORWARD_CACHE
+  ip4_forward_flow_add(inp, netif, ip4_current_dest_addr());
+#endif /* LWIP_IPV4_FORWARD_CACHE */
   return;
 return_noroute:
   MIB2_STATS_INC(mib2.ipoutnoroutes);
@@ -422,7 +717,7 @@ ip4_input_accept(struct netif *netif)
  * @return ERR_OK if the packet was processed (could return ERR_* if it wasn't
  *         processed, but currently always returns ERR_OK)
  */
-err_t
+LWIP_HOT_TEXT err_t
 ip4_input(struct pbuf *p, struct netif *inp)
 {
   const struct ip_hdr *iphdr;
@@ -438,6 +733,8 @@ ip4_input(struct pbuf *p, struct netif *inp)
 
   LWIP_ASSERT_CORE_LOCKED();
 
+  PERF_START;
+
   IP_STATS_INC(ip.recv);
   MIB2_STATS_INC(mib2.ipinreceives);
 
@@ -515,6 +812,13 @@ ip4_input(struct pbuf *p, struct netif *inp)
   ip_addr_copy_from_ip4(ip_data.current_iphdr_dest, iphdr->dest);
   ip_addr_copy_from_ip4(ip_data.current_iphdr_src, iphdr->src);
 
+#if LWIP_IPV4_FORWARD_CACHE
+  if (ip4_forward_fast(p, (struct ip_hdr *)p->payload, inp)) {
+    pbuf_free(p);
+    return ERR_OK;
+  }
+#endif /* LWIP_IPV4_FORWARD_CACHE */
+
   /* match packet against an interface, i.e. is this packet for us? */
   if (ip4_addr_ismulticast(ip4_current_dest_addr())) {
 #if LWIP_IGMP
@@ -755,6 +1059,7 @@ ip4_input(struct pbuf *p, struct netif *inp)
   ip4_addr_set_any(ip4_current_src_addr());
   ip4_addr_set_any(ip4_current_dest_addr());
 
+  PERF_STOP("ip4_input");
   return ERR_OK;
 }
 
@@ -836,7 +1141,7 @@ ip4_output_if_src(struct pbuf *p, const ip4_addr_t *src, const ip4_addr_t *dest,
  * Same as ip_output_if_opt() but 'src' address is not replaced by netif address
  * when it is 'any'.
  */
-err_t
+LWIP_HOT_TEXT err_t
 ip4_output_if_opt_src(struct pbuf *p, const ip4_addr_t *src, const ip4_addr_t *dest,
                       u8_t ttl, u8_t tos, u8_t proto, struct netif *netif, void *ip_options,
                       u16_t optlen)
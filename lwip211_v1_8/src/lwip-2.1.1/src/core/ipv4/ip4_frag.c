@@ -113,6 +113,13 @@ PACK_STRUCT_END
 /* global variables */
 static struct ip_reassdata *reassdatagrams;
 static u16_t ip_reass_pbufcount;
+static u32_t ip_reass_bytecount;
+
+#if IP_REASS_MAX_BYTES
+#define IP_REASS_BYTES_EXCEEDED(len) ((ip_reass_bytecount + (len)) > IP_REASS_MAX_BYTES)
+#else
+#define IP_REASS_BYTES_EXCEEDED(len) 0
+#endif
 
 /* function prototypes */
 static void ip_reass_dequeue_datagram(struct ip_reassdata *ipr, struct ip_reassdata *prev);
@@ -205,6 +212,8 @@ ip_reass_free_complete_datagram(struct ip_reassdata *ipr, struct ip_reassdata *p
     pbufs_freed = (u16_t)(pbufs_freed + clen);
     pbuf_free(pcur);
   }
+  LWIP_ASSERT("ip_reass_bytecount >= ipr->recv_len", ip_reass_bytecount >= ipr->recv_len);
+  ip_reass_bytecount -= ipr->recv_len;
   /* Then, unchain the struct ip_reassdata from the list and free it. */
   ip_reass_dequeue_datagram(ipr, prev);
   LWIP_ASSERT("ip_reass_pbufcount >= pbufs_freed", ip_reass_pbufcount >= pbufs_freed);
@@ -221,10 +230,12 @@ ip_reass_free_complete_datagram(struct ip_reassdata *ipr, struct ip_reassdata *p
  * @param fraghdr IP header of the current fragment
  * @param pbufs_needed number of pbufs needed to enqueue
  *        (used for freeing other datagrams if not enough space)
+ * @param bytes_needed number of payload bytes needed to enqueue
+ *        (checked against IP_REASS_MAX_BYTES)
  * @return the number of pbufs freed
  */
 static int
-ip_reass_remove_oldest_datagram(struct ip_hdr *fraghdr, int pbufs_needed)
+ip_reass_remove_oldest_datagram(struct ip_hdr *fraghdr, int pbufs_needed, u16_t bytes_needed)
 {
   /* @todo Can't we simply remove the last datagram in the
    *       linked list behind reassdatagrams?
@@ -232,6 +243,9 @@ ip_reass_remove_oldest_datagram(struct ip_hdr *fraghdr, int pbufs_needed)
   struct ip_reassdata *r, *oldest, *prev, *oldest_prev;
   int pbufs_freed = 0, pbufs_freed_current;
   int other_datagrams;
+#if !IP_REASS_MAX_BYTES
+  LWIP_UNUSED_ARG(bytes_needed);
+#endif
 
   /* Free datagrams until being allowed to enqueue 'pbufs_needed' pbufs,
    * but don't free the datagram that 'fraghdr' belongs to! */
@@ -263,7 +277,8 @@ ip_reass_remove_oldest_datagram(struct ip_hdr *fraghdr, int pbufs_needed)
       pbufs_freed_current = ip_reass_free_complete_datagram(oldest, oldest_prev);
       pbufs_freed += pbufs_freed_current;
     }
-  } while ((pbufs_freed < pbufs_needed) && (other_datagrams > 1));
+  } while (((pbufs_freed < pbufs_needed) || IP_REASS_BYTES_EXCEEDED(bytes_needed)) &&
+           (other_datagrams > 1));
   return pbufs_freed;
 }
 #endif /* IP_REASS_FREE_OLDEST */
@@ -286,7 +301,7 @@ ip_reass_enqueue_new_datagram(struct ip_hdr *fraghdr, int clen)
   ipr = (struct ip_reassdata *)memp_malloc(MEMP_REASSDATA);
   if (ipr == NULL) {
 #if IP_REASS_FREE_OLDEST
-    if (ip_reass_remove_oldest_datagram(fraghdr, clen) >= clen) {
+    if (ip_reass_remove_oldest_datagram(fraghdr, clen, 0) >= clen) {
       ipr = (struct ip_reassdata *)memp_malloc(MEMP_REASSDATA);
     }
     if (ipr == NULL)
@@ -333,8 +348,10 @@ ip_reass_dequeue_datagram(struct ip_reassdata *ipr, struct ip_reassdata *prev)
 /**
  * Chain a new pbuf into the pbuf list that composes the datagram.  The pbuf list
  * will grow over time as  new pbufs are rx.
- * Also checks that the datagram passes basic continuity checks (if the last
- * fragment was received at least once).
+ * Fragments mostly arrive in order, so they are appended behind ipr->p_tail
+ * without walking the list; only out-of-order fragments search for their slot.
+ * Since fragments never overlap and never extend beyond the last fragment,
+ * the datagram is complete once ipr->recv_len reaches the datagram length.
  * @param ipr points to the reassembly state
  * @param new_p points to the pbuf for the current fragment
  * @param is_last is 1 if this pbuf has MF==0 (ipr->flags not updated yet)
@@ -343,12 +360,11 @@ ip_reass_dequeue_datagram(struct ip_reassdata *ipr, struct ip_reassdata *prev)
 static int
 ip_reass_chain_frag_into_datagram_and_validate(struct ip_reassdata *ipr, struct pbuf *new_p, int is_last)
 {
-  struct ip_reass_helper *iprh, *iprh_tmp, *iprh_prev = NULL;
+  struct ip_reass_helper *iprh, *iprh_tmp = NULL, *iprh_prev = NULL;
   struct pbuf *q;
   u16_t offset, len;
   u8_t hlen;
   struct ip_hdr *fraghdr;
-  int valid = 1;
 
   /* Extract length and fragment offset from current fragment */
   fraghdr = (struct ip_hdr *)new_p->payload;
@@ -375,119 +391,74 @@ ip_reass_chain_frag_into_datagram_and_validate(struct ip_reassdata *ipr, struct
     return IP_REASS_VALIDATE_PBUF_DROPPED;
   }
 
-  /* Iterate through until we either get to the end of the list (append),
-   * or we find one with a larger offset (insert). */
-  for (q = ipr->p; q != NULL;) {
-    iprh_tmp = (struct ip_reass_helper *)q->payload;
-    if (iprh->start < iprh_tmp->start) {
-      /* the new pbuf should be inserted before this */
-      iprh->next_pbuf = q;
-      if (iprh_prev != NULL) {
-        /* not the fragment with the lowest offset */
+  if ((ipr->flags & IP_REASS_FLAG_LASTFRAG) != 0) {
+    if (is_last || (iprh->end > ipr->datagram_len)) {
+      /* a second last fragment or data beyond the end: inconsistent */
+      return IP_REASS_VALIDATE_PBUF_DROPPED;
+    }
+  }
+
+  if (ipr->p_tail == NULL) {
+    /* this is the first fragment we ever received for this ip datagram */
+    LWIP_ASSERT("no tail, this must be the first fragment!", ipr->p == NULL);
+    ipr->p = new_p;
+    ipr->p_tail = new_p;
+  } else if (iprh->start >= ((struct ip_reass_helper *)ipr->p_tail->payload)->end) {
+    /* this is (for now), the fragment with the highest offset:
+     * chain it to the last fragment */
+    ((struct ip_reass_helper *)ipr->p_tail->payload)->next_pbuf = new_p;
+    ipr->p_tail = new_p;
+  } else if (is_last) {
+    /* fragments beyond the end of the datagram were received */
+    return IP_REASS_VALIDATE_PBUF_DROPPED;
+  } else {
+    /* Iterate through until we find one with a larger offset (insert). */
+    for (q = ipr->p; q != NULL; q = iprh_tmp->next_pbuf) {
+      iprh_tmp = (struct ip_reass_helper *)q->payload;
+      if (iprh->start < iprh_tmp->start) {
 #if IP_REASS_CHECK_OVERLAP
-        if ((iprh->start < iprh_prev->end) || (iprh->end > iprh_tmp->start)) {
+        if ((iprh->end > iprh_tmp->start) ||
+            ((iprh_prev != NULL) && (iprh->start < iprh_prev->end))) {
           /* fragment overlaps with previous or following, throw away */
           return IP_REASS_VALIDATE_PBUF_DROPPED;
         }
 #endif /* IP_REASS_CHECK_OVERLAP */
-        iprh_prev->next_pbuf = new_p;
-        if (iprh_prev->end != iprh->start) {
-          /* There is a fragment missing between the current
-           * and the previous fragment */
-          valid = 0;
-        }
-      } else {
-#if IP_REASS_CHECK_OVERLAP
-        if (iprh->end > iprh_tmp->start) {
-          /* fragment overlaps with following, throw away */
-          return IP_REASS_VALIDATE_PBUF_DROPPED;
+        /* the new pbuf should be inserted before this */
+        iprh->next_pbuf = q;
+        if (iprh_prev != NULL) {
+          iprh_prev->next_pbuf = new_p;
+        } else {
+          /* fragment with the lowest offset */
+          ipr->p = new_p;
         }
-#endif /* IP_REASS_CHECK_OVERLAP */
-        /* fragment with the lowest offset */
-        ipr->p = new_p;
-      }
-      break;
-    } else if (iprh->start == iprh_tmp->start) {
-      /* received the same datagram twice: no need to keep the datagram */
-      return IP_REASS_VALIDATE_PBUF_DROPPED;
+        break;
+      } else if (iprh->start == iprh_tmp->start) {
+        /* received the same datagram twice: no need to keep the datagram */
+        return IP_REASS_VALIDATE_PBUF_DROPPED;
 #if IP_REASS_CHECK_OVERLAP
-    } else if (iprh->start < iprh_tmp->end) {
-      /* overlap: no need to keep the new datagram */
-      return IP_REASS_VALIDATE_PBUF_DROPPED;
+      } else if (iprh->start < iprh_tmp->end) {
+        /* overlap: no need to keep the new datagram */
+        return IP_REASS_VALIDATE_PBUF_DROPPED;
 #endif /* IP_REASS_CHECK_OVERLAP */
-    } else {
-      /* Check if the fragments received so far have no holes. */
-      if (iprh_prev != NULL) {
-        if (iprh_prev->end != iprh_tmp->start) {
-          /* There is a fragment missing between the current
-           * and the previous fragment */
-          valid = 0;
-        }
       }
+      iprh_prev = iprh_tmp;
     }
-    q = iprh_tmp->next_pbuf;
-    iprh_prev = iprh_tmp;
-  }
-
-  /* If q is NULL, then we made it to the end of the list. Determine what to do now */
-  if (q == NULL) {
-    if (iprh_prev != NULL) {
-      /* this is (for now), the fragment with the highest offset:
-       * chain it to the last fragment */
-#if IP_REASS_CHECK_OVERLAP
-      LWIP_ASSERT("check fragments don't overlap", iprh_prev->end <= iprh->start);
-#endif /* IP_REASS_CHECK_OVERLAP */
+    if (q == NULL) {
+      /* only reached with overlap checking disabled: chain behind the tail */
+      LWIP_ASSERT("sanity check", iprh_prev != NULL);
       iprh_prev->next_pbuf = new_p;
-      if (iprh_prev->end != iprh->start) {
-        valid = 0;
-      }
-    } else {
-#if IP_REASS_CHECK_OVERLAP
-      LWIP_ASSERT("no previous fragment, this must be the first fragment!",
-                  ipr->p == NULL);
-#endif /* IP_REASS_CHECK_OVERLAP */
-      /* this is the first fragment we ever received for this ip datagram */
-      ipr->p = new_p;
+      ipr->p_tail = new_p;
     }
   }
+  ipr->recv_len = (u16_t)(ipr->recv_len + len);
 
-  /* At this point, the validation part begins: */
-  /* If we already received the last fragment */
-  if (is_last || ((ipr->flags & IP_REASS_FLAG_LASTFRAG) != 0)) {
-    /* and had no holes so far */
-    if (valid) {
-      /* then check if the rest of the fragments is here */
-      /* Check if the queue starts with the first datagram */
-      if ((ipr->p == NULL) || (((struct ip_reass_helper *)ipr->p->payload)->start != 0)) {
-        valid = 0;
-      } else {
-        /* and check that there are no holes after this datagram */
-        iprh_prev = iprh;
-        q = iprh->next_pbuf;
-        while (q != NULL) {
-          iprh = (struct ip_reass_helper *)q->payload;
-          if (iprh_prev->end != iprh->start) {
-            valid = 0;
-            break;
-          }
-          iprh_prev = iprh;
-          q = iprh->next_pbuf;
-        }
-        /* if still valid, all fragments are received
-         * (because to the MF==0 already arrived */
-        if (valid) {
-          LWIP_ASSERT("sanity check", ipr->p != NULL);
-          LWIP_ASSERT("sanity check",
-                      ((struct ip_reass_helper *)ipr->p->payload) != iprh);
-          LWIP_ASSERT("validate_datagram:next_pbuf!=NULL",
-                      iprh->next_pbuf == NULL);
-        }
-      }
-    }
-    /* If valid is 0 here, there are some fragments missing in the middle
-     * (since MF == 0 has already arrived). Such datagrams simply time out if
-     * no more fragments are received... */
-    return valid ? IP_REASS_VALIDATE_TELEGRAM_FINISHED : IP_REASS_VALIDATE_PBUF_QUEUED;
+  /* If we already received the last fragment and no bytes are missing,
+   * all fragments are here */
+  if (is_last) {
+    return (ipr->recv_len == iprh->end) ? IP_REASS_VALIDATE_TELEGRAM_FINISHED : IP_REASS_VALIDATE_PBUF_QUEUED;
+  }
+  if ((ipr->flags & IP_REASS_FLAG_LASTFRAG) != 0) {
+    return (ipr->recv_len == ipr->datagram_len) ? IP_REASS_VALIDATE_TELEGRAM_FINISHED : IP_REASS_VALIDATE_PBUF_QUEUED;
   }
   /* If we come here, not all fragments were received, yet! */
   return IP_REASS_VALIDATE_PBUF_QUEUED; /* not yet valid! */
@@ -504,7 +475,7 @@ ip4_reass(struct pbuf *p)
 {
   struct pbuf *r;
   struct ip_hdr *fraghdr;
-  struct ip_reassdata *ipr;
+  struct ip_reassdata *ipr, *ipr_prev = NULL;
   struct ip_reass_helper *iprh;
   u16_t offset, len, clen;
   u8_t hlen;
@@ -531,12 +502,41 @@ ip4_reass(struct pbuf *p)
   }
   len = (u16_t)(len - hlen);
 
+  /* Look for the datagram the fragment belongs to in the current datagram queue,
+   * remembering the previous in the queue for later dequeueing. */
+  for (ipr = reassdatagrams; ipr != NULL; ipr = ipr->next) {
+    /* Check if the incoming fragment matches the one currently present
+       in the reassembly buffer. If so, we proceed with copying the
+       fragment into the buffer. */
+    if (IP_ADDRESSES_AND_ID_MATCH(&ipr->iphdr, fraghdr)) {
+      LWIP_DEBUGF(IP_REASS_DEBUG, ("ip4_reass: matching previous fragment ID=%"X16_F"\n",
+                                   lwip_ntohs(IPH_ID(fraghdr))));
+      IPFRAG_STATS_INC(ip_frag.cachehit);
+      break;
+    }
+    ipr_prev = ipr;
+  }
+
+#if IP_REASS_MAX_BYTES
+  if (((u32_t)offset + len) > IP_REASS_MAX_BYTES) {
+    /* This datagram can never be completed within the byte budget: drop it
+     * early instead of letting it hold pbufs until it times out */
+    LWIP_DEBUGF(IP_REASS_DEBUG, ("ip4_reass: datagram exceeds IP_REASS_MAX_BYTES\n"));
+    IPFRAG_STATS_INC(ip_frag.memerr);
+    if (ipr != NULL) {
+      ip_reass_free_complete_datagram(ipr, ipr_prev);
+    }
+    goto nullreturn;
+  }
+#endif /* IP_REASS_MAX_BYTES */
+
   /* Check if we are allowed to enqueue more datagrams. */
   clen = pbuf_clen(p);
-  if ((ip_reass_pbufcount + clen) > IP_REASS_MAX_PBUFS) {
+  if (((ip_reass_pbufcount + clen) > IP_REASS_MAX_PBUFS) || IP_REASS_BYTES_EXCEEDED(len)) {
 #if IP_REASS_FREE_OLDEST
-    if (!ip_reass_remove_oldest_datagram(fraghdr, clen) ||
-        ((ip_reass_pbufcount + clen) > IP_REASS_MAX_PBUFS))
+    /* this never frees the datagram 'ipr' points to, but may free 'ipr_prev' */
+    if (!ip_reass_remove_oldest_datagram(fraghdr, clen, len) ||
+        ((ip_reass_pbufcount + clen) > IP_REASS_MAX_PBUFS) || IP_REASS_BYTES_EXCEEDED(len))
 #endif /* IP_REASS_FREE_OLDEST */
     {
       /* No datagram could be freed and still too many pbufs enqueued */
@@ -549,20 +549,6 @@ ip4_reass(struct pbuf *p)
     }
   }
 
-  /* Look for the datagram the fragment belongs to in the current datagram queue,
-   * remembering the previous in the queue for later dequeueing. */
-  for (ipr = reassdatagrams; ipr != NULL; ipr = ipr->next) {
-    /* Check if the incoming fragment matches the one currently present
-       in the reassembly buffer. If so, we proceed with copying the
-       fragment into the buffer. */
-    if (IP_ADDRESSES_AND_ID_MATCH(&ipr->iphdr, fraghdr)) {
-      LWIP_DEBUGF(IP_REASS_DEBUG, ("ip4_reass: matching previous fragment ID=%"X16_F"\n",
-                                   lwip_ntohs(IPH_ID(fraghdr))));
-      IPFRAG_STATS_INC(ip_frag.cachehit);
-      break;
-    }
-  }
-
   if (ipr == NULL) {
     /* Enqueue a new datagram into the datagram queue */
     ipr = ip_reass_enqueue_new_datagram(fraghdr, clen);
@@ -605,6 +591,7 @@ ip4_reass(struct pbuf *p)
      the number of fragments that may be enqueued at any one time
      (overflow checked by testing against IP_REASS_MAX_PBUFS) */
   ip_reass_pbufcount = (u16_t)(ip_reass_pbufcount + clen);
+  ip_reass_bytecount += len;
   if (is_last) {
     u16_t datagram_len = (u16_t)(offset + len);
     ipr->datagram_len = datagram_len;
@@ -615,7 +602,6 @@ ip4_reass(struct pbuf *p)
   }
 
   if (valid == IP_REASS_VALIDATE_TELEGRAM_FINISHED) {
-    struct ip_reassdata *ipr_prev;
     /* the totally last fragment (flag more fragments = 0) was received at least
      * once AND all fragments are received */
     u16_t datagram_len = (u16_t)(ipr->datagram_len + IP_HLEN);
@@ -660,6 +646,8 @@ ip4_reass(struct pbuf *p)
     }
 
     /* release the sources allocate for the fragment queue entry */
+    LWIP_ASSERT("ip_reass_bytecount >= ipr->recv_len", ip_reass_bytecount >= ipr->recv_len);
+    ip_reass_bytecount -= ipr->recv_len;
     ip_reass_dequeue_datagram(ipr, ipr_prev);
 
     /* and adjust the number of pbufs currently queued for reassembly. */
@@ -722,6 +710,36 @@ ipfrag_free_pbuf_custom(struct pbuf *p)
   }
   ip_frag_free_pbuf_custom_ref(pcr);
 }
+
+#if MEMP_NUM_FRAG_HDR
+/** Free-callback function to free a 'struct ip_frag_hdr', called by
+ * pbuf_free. */
+static void
+ipfrag_free_hdr_pbuf(struct pbuf *p)
+{
+  LWIP_ASSERT("p != NULL", p != NULL);
+  memp_free(MEMP_FRAG_HDR, p);
+}
+#endif /* MEMP_NUM_FRAG_HDR */
+
+/** Allocate the pbuf for the link and IP header of a fragment:
+ * from MEMP_FRAG_HDR while it lasts, then from the heap. */
+static struct pbuf *
+ip_frag_alloc_hdr_pbuf(void)
+{
+#if MEMP_NUM_FRAG_HDR
+  struct ip_frag_hdr *fh = (struct ip_frag_hdr *)memp_malloc(MEMP_FRAG_HDR);
+  if (fh != NULL) {
+    struct pbuf *p;
+    fh->pc.custom_free_function = ipfrag_free_hdr_pbuf;
+    p = pbuf_alloced_custom(PBUF_LINK, IP_HLEN, PBUF_RAM, &fh->pc,
+                            LWIP_MEM_ALIGN(fh->hdr), IP_FRAG_HDR_MEM_LEN);
+    LWIP_ASSERT("fragment header does not fit", p != NULL);
+    return p;
+  }
+#endif /* MEMP_NUM_FRAG_HDR */
+  return pbuf_alloc(PBUF_LINK, IP_HLEN, PBUF_RAM);
+}
 #endif /* !LWIP_NETIF_TX_SINGLE_PBUF */
 
 /**
@@ -771,6 +789,8 @@ ip4_frag(struct pbuf *p, struct netif *netif, const ip4_addr_t *dest)
 
   left = (u16_t)(p->tot_len - IP_HLEN);
 
+  /* the fragments go to the driver in one burst */
+  NETIF_BURST_BEGIN(netif);
   while (left) {
     /* Fill this fragment */
     fragsize = LWIP_MIN(left, (u16_t)(nfb * 8));
@@ -793,11 +813,12 @@ ip4_frag(struct pbuf *p, struct netif *netif, const ip4_addr_t *dest)
     iphdr = (struct ip_hdr *)rambuf->payload;
 #else /* LWIP_NETIF_TX_SINGLE_PBUF */
     /* When not using a static buffer, create a chain of pbufs.
-     * The first will be a PBUF_RAM holding the link and IP header.
+     * The first will be a PBUF_RAM holding the link and IP header,
+     * taken from MEMP_FRAG_HDR if configured.
      * The rest will be PBUF_REFs mirroring the pbuf chain to be fragged,
      * but limited to the size of an mtu.
      */
-    rambuf = pbuf_alloc(PBUF_LINK, IP_HLEN, PBUF_RAM);
+    rambuf = ip_frag_alloc_hdr_pbuf();
     if (rambuf == NULL) {
       goto memerr;
     }
@@ -883,9 +904,11 @@ ip4_frag(struct pbuf *p, struct netif *netif, const ip4_addr_t *dest)
     left = (u16_t)(left - fragsize);
     ofo = (u16_t)(ofo + nfb);
   }
+  NETIF_BURST_END(netif);
   MIB2_STATS_INC(mib2.ipfragoks);
   return ERR_OK;
 memerr:
+  NETIF_BURST_END(netif);
   MIB2_STATS_INC(mib2.ipfragfails);
   return ERR_MEM;
 }
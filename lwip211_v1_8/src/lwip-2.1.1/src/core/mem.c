@@ -339,6 +339,355 @@ mem_free(void *rmem)
   memp_free(hmem->poolnr, hmem);
 }
 
+#elif MEM_TLSF
+/* lwIP heap as a TLSF (two-level segregated fit) allocator: free blocks are
+ * kept in lists by size class, the class to take from is found with two bit
+ * scans and neighbours are merged through boundary tags, so mem_malloc(),
+ * mem_free() and mem_trim() take constant time however fragmented the heap is.
+ * Every operation is short, so they all run under SYS_ARCH_PROTECT and, like
+ * LWIP_ALLOW_MEM_FREE_FROM_OTHER_CONTEXT, allow mem_free() from interrupts. */
+
+#if MEM_ALIGNMENT == 4
+#define MEM_TLSF_ALIGN_LOG2 2
+#elif MEM_ALIGNMENT == 8
+#define MEM_TLSF_ALIGN_LOG2 3
+#elif MEM_ALIGNMENT == 16
+#define MEM_TLSF_ALIGN_LOG2 4
+#elif MEM_ALIGNMENT == 32
+#define MEM_TLSF_ALIGN_LOG2 5
+#elif MEM_ALIGNMENT == 64
+#define MEM_TLSF_ALIGN_LOG2 6
+#elif MEM_ALIGNMENT == 128
+#define MEM_TLSF_ALIGN_LOG2 7
+#else
+#error "MEM_TLSF needs MEM_ALIGNMENT to be a power of 2 between 4 and 128"
+#endif
+
+/* second level: each power of 2 is split into 16 classes */
+#define MEM_TLSF_SL_LOG2    4
+#define MEM_TLSF_SL_COUNT   (1U << MEM_TLSF_SL_LOG2)
+/* blocks below MEM_TLSF_SMALL all go to first level 0, in steps of MEM_ALIGNMENT */
+#define MEM_TLSF_FL_SHIFT   (MEM_TLSF_SL_LOG2 + MEM_TLSF_ALIGN_LOG2)
+#define MEM_TLSF_SMALL      (1U << MEM_TLSF_FL_SHIFT)
+/* highest bit set in any block size */
+#if MEM_SIZE <= 0x10000L
+#define MEM_TLSF_FL_INDEX_MAX 16
+#elif MEM_SIZE <= 0x100000L
+#define MEM_TLSF_FL_INDEX_MAX 20
+#elif MEM_SIZE <= 0x1000000L
+#define MEM_TLSF_FL_INDEX_MAX 24
+#else
+#define MEM_TLSF_FL_INDEX_MAX 31
+#endif
+#define MEM_TLSF_FL_COUNT   (MEM_TLSF_FL_INDEX_MAX - MEM_TLSF_FL_SHIFT + 2)
+
+/* flags in the low bits of struct mem_tlsf::size */
+#define MEM_TLSF_FREE       1U
+#define MEM_TLSF_PREV_FREE  2U
+#define MEM_TLSF_FLAGS      (MEM_TLSF_FREE | MEM_TLSF_PREV_FREE)
+
+/** Block header. Only prev_phys and size are kept for used blocks, the free
+ * list links overlay the start of the payload. */
+struct mem_tlsf {
+  /** the block before this one in memory, only valid with MEM_TLSF_PREV_FREE */
+  struct mem_tlsf *prev_phys;
+  /** payload size, a multiple of MEM_ALIGNMENT, plus MEM_TLSF_* flags */
+  mem_size_t size;
+  /** free list of this block's size class */
+  struct mem_tlsf *next_free;
+  struct mem_tlsf *prev_free;
+};
+
+#define SIZEOF_MEM_TLSF_HDR  LWIP_MEM_ALIGN_SIZE(offsetof(struct mem_tlsf, next_free))
+#define MEM_TLSF_MIN_SIZE    LWIP_MAX(MEM_ALIGNMENT, LWIP_MEM_ALIGN_SIZE(sizeof(struct mem_tlsf) - SIZEOF_MEM_TLSF_HDR))
+#define MEM_SIZE_ALIGNED     LWIP_MEM_ALIGN_SIZE(MEM_SIZE)
+
+#ifndef LWIP_RAM_HEAP_POINTER
+/** the heap: one block covering MEM_SIZE plus the header of the end marker */
+LWIP_DECLARE_MEMORY_ALIGNED(ram_heap, MEM_SIZE_ALIGNED + (2U * SIZEOF_MEM_TLSF_HDR));
+#define LWIP_RAM_HEAP_POINTER ram_heap
+#endif /* LWIP_RAM_HEAP_POINTER */
+
+static u8_t *ram;
+/** zero sized, always used block at the end of the heap */
+static struct mem_tlsf *ram_end;
+
+static u32_t mem_tlsf_fl_bitmap;
+static u32_t mem_tlsf_sl_bitmap[MEM_TLSF_FL_COUNT];
+static struct mem_tlsf *mem_tlsf_free[MEM_TLSF_FL_COUNT][MEM_TLSF_SL_COUNT];
+
+#define MEM_TLSF_SIZE(b)   ((b)->size & ~(mem_size_t)MEM_TLSF_FLAGS)
+#define MEM_TLSF_FLS(x)    (31 - __builtin_clz((unsigned int)(x)))
+#define MEM_TLSF_FFS(x)    __builtin_ctz((unsigned int)(x))
+
+static struct mem_tlsf *
+mem_tlsf_next_phys(struct mem_tlsf *b)
+{
+  return (struct mem_tlsf *)(void *)((u8_t *)b + SIZEOF_MEM_TLSF_HDR + MEM_TLSF_SIZE(b));
+}
+
+static void
+mem_tlsf_mapping(mem_size_t size, unsigned int *fl, unsigned int *sl)
+{
+  unsigned int f;
+
+  if (size < MEM_TLSF_SMALL) {
+    *fl = 0;
+    *sl = (unsigned int)size >> MEM_TLSF_ALIGN_LOG2;
+  } else {
+    f = (unsigned int)MEM_TLSF_FLS(size);
+    *sl = ((unsigned int)size >> (f - MEM_TLSF_SL_LOG2)) ^ MEM_TLSF_SL_COUNT;
+    *fl = f - MEM_TLSF_FL_SHIFT + 1;
+  }
+}
+
+static void
+mem_tlsf_insert(struct mem_tlsf *b)
+{
+  unsigned int fl, sl;
+
+  mem_tlsf_mapping(MEM_TLSF_SIZE(b), &fl, &sl);
+  b->prev_free = NULL;
+  b->next_free = mem_tlsf_free[fl][sl];
+  if (b->next_free != NULL) {
+    b->next_free->prev_free = b;
+  }
+  mem_tlsf_free[fl][sl] = b;
+  mem_tlsf_fl_bitmap |= 1U << fl;
+  mem_tlsf_sl_bitmap[fl] |= 1U << sl;
+}
+
+static void
+mem_tlsf_remove(struct mem_tlsf *b)
+{
+  unsigned int fl, sl;
+
+  mem_tlsf_mapping(MEM_TLSF_SIZE(b), &fl, &sl);
+  if (b->next_free != NULL) {
+    b->next_free->prev_free = b->prev_free;
+  }
+  if (b->prev_free != NULL) {
+    b->prev_free->next_free = b->next_free;
+  } else {
+    mem_tlsf_free[fl][sl] = b->next_free;
+    if (b->next_free == NULL) {
+      mem_tlsf_sl_bitmap[fl] &= ~(1U << sl);
+      if (mem_tlsf_sl_bitmap[fl] == 0) {
+        mem_tlsf_fl_bitmap &= ~(1U << fl);
+      }
+    }
+  }
+}
+
+/* free block of at least 'size' bytes, the first of the next class that only
+ * holds big enough blocks */
+static struct mem_tlsf *
+mem_tlsf_find(mem_size_t size)
+{
+  unsigned int fl, sl;
+  u32_t map;
+
+  if (size >= MEM_TLSF_SMALL) {
+    size = (mem_size_t)(size + (1U << (MEM_TLSF_FLS(size) - MEM_TLSF_SL_LOG2)) - 1);
+  }
+  mem_tlsf_mapping(size, &fl, &sl);
+  if (fl >= MEM_TLSF_FL_COUNT) {
+    return NULL;
+  }
+
+  map = mem_tlsf_sl_bitmap[fl] & (~0U << sl);
+  if (map == 0) {
+    map = mem_tlsf_fl_bitmap & (~0U << (fl + 1));
+    if (map == 0) {
+      return NULL;
+    }
+    fl = (unsigned int)MEM_TLSF_FFS(map);
+    map = mem_tlsf_sl_bitmap[fl];
+  }
+  sl = (unsigned int)MEM_TLSF_FFS(map);
+  return mem_tlsf_free[fl][sl];
+}
+
+/* turn the part of used block b beyond 'size' into a free block */
+static void
+mem_tlsf_split_free(struct mem_tlsf *b, mem_size_t size)
+{
+  struct mem_tlsf *rest, *next;
+
+  rest = (struct mem_tlsf *)(void *)((u8_t *)b + SIZEOF_MEM_TLSF_HDR + size);
+  rest->size = (mem_size_t)((MEM_TLSF_SIZE(b) - size - SIZEOF_MEM_TLSF_HDR) | MEM_TLSF_FREE);
+  b->size = (mem_size_t)(size | (b->size & MEM_TLSF_PREV_FREE));
+
+  next = mem_tlsf_next_phys(rest);
+  if (next->size & MEM_TLSF_FREE) {
+    mem_tlsf_remove(next);
+    rest->size = (mem_size_t)(rest->size + SIZEOF_MEM_TLSF_HDR + MEM_TLSF_SIZE(next));
+    next = mem_tlsf_next_phys(rest);
+  }
+  next->prev_phys = rest;
+  next->size |= MEM_TLSF_PREV_FREE;
+  mem_tlsf_insert(rest);
+}
+
+/**
+ * Zero the heap and hand all of it to the allocator as one free block.
+ */
+void
+mem_init(void)
+{
+  struct mem_tlsf *b;
+
+  LWIP_ASSERT("MEM_TLSF: MEM_ALIGNMENT must keep pointers aligned",
+              MEM_ALIGNMENT >= sizeof(void *));
+
+  ram = (u8_t *)LWIP_MEM_ALIGN(LWIP_RAM_HEAP_POINTER);
+  b = (struct mem_tlsf *)(void *)ram;
+  b->prev_phys = NULL;
+  b->size = (mem_size_t)(MEM_SIZE_ALIGNED | MEM_TLSF_FREE);
+
+  ram_end = mem_tlsf_next_phys(b);
+  ram_end->prev_phys = b;
+  ram_end->size = MEM_TLSF_PREV_FREE;
+
+  mem_tlsf_insert(b);
+
+  MEM_STATS_AVAIL(avail, MEM_SIZE_ALIGNED);
+}
+
+/**
+ * Allocate a block of memory with a minimum of 'size' bytes.
+ *
+ * @param size_in is the minimum size of the requested block in bytes.
+ * @return pointer to allocated memory or NULL if no free memory was found.
+ *
+ * Note that the returned value will always be aligned (as defined by MEM_ALIGNMENT).
+ */
+void *
+mem_malloc(mem_size_t size_in)
+{
+  struct mem_tlsf *b;
+  mem_size_t size;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (size_in == 0) {
+    return NULL;
+  }
+  size = (mem_size_t)LWIP_MAX(LWIP_MEM_ALIGN_SIZE(size_in), MEM_TLSF_MIN_SIZE);
+  if ((size < size_in) || (size > MEM_SIZE_ALIGNED)) {
+    return NULL;
+  }
+
+  SYS_ARCH_PROTECT(lev);
+  b = mem_tlsf_find(size);
+  if (b == NULL) {
+    MEM_STATS_INC(err);
+    SYS_ARCH_UNPROTECT(lev);
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("mem_malloc: could not allocate %"S16_F" bytes\n", (s16_t)size));
+    return NULL;
+  }
+  mem_tlsf_remove(b);
+  b->size &= ~(mem_size_t)MEM_TLSF_FREE;
+  if (MEM_TLSF_SIZE(b) >= size + SIZEOF_MEM_TLSF_HDR + MEM_TLSF_MIN_SIZE) {
+    mem_tlsf_split_free(b, size);
+  } else {
+    mem_tlsf_next_phys(b)->size &= ~(mem_size_t)MEM_TLSF_PREV_FREE;
+  }
+  MEM_STATS_INC_USED(used, MEM_TLSF_SIZE(b) + SIZEOF_MEM_TLSF_HDR);
+  SYS_ARCH_UNPROTECT(lev);
+
+  LWIP_ASSERT("mem_malloc: allocated memory properly aligned.",
+              ((mem_ptr_t)b + SIZEOF_MEM_TLSF_HDR) % MEM_ALIGNMENT == 0);
+  return (u8_t *)b + SIZEOF_MEM_TLSF_HDR;
+}
+
+/**
+ * Put a struct mem back on the heap
+ *
+ * @param rmem is the data portion of a struct mem as returned by a previous
+ *             call to mem_malloc()
+ */
+void
+mem_free(void *rmem)
+{
+  struct mem_tlsf *b, *prev, *next;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (rmem == NULL) {
+    LWIP_DEBUGF(MEM_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_LEVEL_SERIOUS, ("mem_free(p == NULL) was called.\n"));
+    return;
+  }
+  b = (struct mem_tlsf *)(void *)((u8_t *)rmem - SIZEOF_MEM_TLSF_HDR);
+  if (((((mem_ptr_t)rmem) & (MEM_ALIGNMENT - 1)) != 0) ||
+      ((u8_t *)b < ram) || ((u8_t *)rmem >= (u8_t *)ram_end)) {
+    LWIP_MEM_ILLEGAL_FREE("mem_free: illegal memory");
+    MEM_STATS_INC_LOCKED(illegal);
+    return;
+  }
+
+  SYS_ARCH_PROTECT(lev);
+  if (b->size & MEM_TLSF_FREE) {
+    SYS_ARCH_UNPROTECT(lev);
+    LWIP_MEM_ILLEGAL_FREE("mem_free: illegal memory: double free");
+    MEM_STATS_INC_LOCKED(illegal);
+    return;
+  }
+  MEM_STATS_DEC_USED(used, MEM_TLSF_SIZE(b) + SIZEOF_MEM_TLSF_HDR);
+  b->size |= MEM_TLSF_FREE;
+
+  if (b->size & MEM_TLSF_PREV_FREE) {
+    prev = b->prev_phys;
+    mem_tlsf_remove(prev);
+    prev->size = (mem_size_t)(prev->size + SIZEOF_MEM_TLSF_HDR + MEM_TLSF_SIZE(b));
+    b = prev;
+  }
+  next = mem_tlsf_next_phys(b);
+  if (next->size & MEM_TLSF_FREE) {
+    mem_tlsf_remove(next);
+    b->size = (mem_size_t)(b->size + SIZEOF_MEM_TLSF_HDR + MEM_TLSF_SIZE(next));
+    next = mem_tlsf_next_phys(b);
+  }
+  next->prev_phys = b;
+  next->size |= MEM_TLSF_PREV_FREE;
+  mem_tlsf_insert(b);
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+/**
+ * Shrink memory returned by mem_malloc(). The tail is only given back if it
+ * is big enough to form a block of its own.
+ *
+ * @param rmem pointer to memory allocated by mem_malloc the is to be shrinked
+ * @param new_size required size after shrinking (needs to be smaller than or
+ *                equal to the previous size)
+ * @return for compatibility reasons: is always == rmem, at the moment
+ *         or NULL if newsize is > old size, in which case rmem is NOT touched
+ *         or freed!
+ */
+void *
+mem_trim(void *rmem, mem_size_t new_size)
+{
+  struct mem_tlsf *b;
+  mem_size_t size;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  size = (mem_size_t)LWIP_MAX(LWIP_MEM_ALIGN_SIZE(new_size), MEM_TLSF_MIN_SIZE);
+  if (size < new_size) {
+    return NULL;
+  }
+  b = (struct mem_tlsf *)(void *)((u8_t *)rmem - SIZEOF_MEM_TLSF_HDR);
+  if (size > MEM_TLSF_SIZE(b)) {
+    return NULL;
+  }
+
+  SYS_ARCH_PROTECT(lev);
+  if (MEM_TLSF_SIZE(b) >= size + SIZEOF_MEM_TLSF_HDR + MEM_TLSF_MIN_SIZE) {
+    MEM_STATS_DEC_USED(used, MEM_TLSF_SIZE(b) - size);
+    mem_tlsf_split_free(b, size);
+  }
+  SYS_ARCH_UNPROTECT(lev);
+  return rmem;
+}
+
 #else /* MEM_USE_POOLS */
 /* lwIP replacement for your libc malloc() */
 
@@ -978,6 +1327,39 @@ mem_malloc_adjust_lfree:
 
 #endif /* MEM_USE_POOLS */
 
+#if MEM_ARENA_SIZE
+LWIP_DECLARE_MEMORY_ALIGNED(mem_arena, MEM_ARENA_SIZE);
+static size_t mem_arena_used;
+
+/**
+ * Allocate memory that is never freed from the MEM_ARENA_SIZE region.
+ * Falls back to mem_malloc() once the region is used up.
+ *
+ * @param size is the minimum size of the requested block in bytes.
+ * @return pointer to allocated memory or NULL if no free memory was found.
+ */
+void *
+mem_arena_malloc(mem_size_t size)
+{
+  void *ret = NULL;
+  size_t aligned = LWIP_MEM_ALIGN_SIZE((size_t)size);
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  if (aligned <= (size_t)MEM_ARENA_SIZE - mem_arena_used) {
+    ret = (u8_t *)LWIP_MEM_ALIGN(mem_arena) + mem_arena_used;
+    mem_arena_used += aligned;
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  if (ret == NULL) {
+    LWIP_DEBUGF(MEM_DEBUG, ("mem_arena_malloc: arena full, %"SZT_F" bytes from the heap\n", (size_t)size));
+    ret = mem_malloc(size);
+  }
+  return ret;
+}
+#endif /* MEM_ARENA_SIZE */
+
 #if MEM_LIBC_MALLOC && (!LWIP_STATS || !MEM_STATS)
 void *
 mem_calloc(mem_size_t count, mem_size_t size)
@@ -165,6 +165,94 @@ memp_overflow_check_all(void)
 #endif /* MEMP_OVERFLOW_CHECK >= 2 */
 #endif /* MEMP_OVERFLOW_CHECK */
 
+#if MEMP_LOCKFREE
+/* Elements are addressed by index so that index and ABA tag fit one u64_t
+ * compare-and-swap. The tag changes on every update, so a pop that read a
+ * stale 'next' fails its CAS even if the same element is back on top. */
+#define MEMP_LF_STRIDE(desc)  (MEMP_SIZE + (desc)->size)
+#define MEMP_LF_HEAD(tag, idx) (((u64_t)(tag) << 32) | (u32_t)(idx))
+
+static struct memp *
+memp_lf_element(const struct memp_desc *desc, u32_t idx)
+{
+  if (idx == 0) {
+    return NULL;
+  }
+  return (struct memp *)(void *)((u8_t *)LWIP_MEM_ALIGN(desc->base) + (idx - 1) * MEMP_LF_STRIDE(desc));
+}
+
+static u32_t
+memp_lf_index(const struct memp_desc *desc, struct memp *memp)
+{
+  if (memp == NULL) {
+    return 0;
+  }
+  return (u32_t)(((u8_t *)memp - (u8_t *)LWIP_MEM_ALIGN(desc->base)) / MEMP_LF_STRIDE(desc)) + 1;
+}
+
+static struct memp *
+memp_lf_pop(const struct memp_desc *desc)
+{
+  u64_t old_head, new_head;
+  struct memp *memp;
+
+  old_head = __atomic_load_n(desc->lf_head, __ATOMIC_ACQUIRE);
+  do {
+    memp = memp_lf_element(desc, (u32_t)old_head);
+    if (memp == NULL) {
+      return NULL;
+    }
+    /* may be stale if another context got here first, the tag catches that */
+    new_head = MEMP_LF_HEAD((old_head >> 32) + 1, memp_lf_index(desc, memp->next));
+  } while (!__atomic_compare_exchange_n(desc->lf_head, &old_head, new_head, 0,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+  return memp;
+}
+
+static void
+memp_lf_push(const struct memp_desc *desc, struct memp *memp)
+{
+  u64_t old_head, new_head;
+  u32_t idx = memp_lf_index(desc, memp);
+
+  old_head = __atomic_load_n(desc->lf_head, __ATOMIC_RELAXED);
+  do {
+    memp->next = memp_lf_element(desc, (u32_t)old_head);
+    new_head = MEMP_LF_HEAD((old_head >> 32) + 1, idx);
+  } while (!__atomic_compare_exchange_n(desc->lf_head, &old_head, new_head, 0,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+#endif /* MEMP_LOCKFREE */
+
+#if MEMP_LAZY_INIT
+/**
+ * Take an element the pool has never handed out, for when its free list is
+ * empty. Called with the pool protected.
+ *
+ * @return the element, as the only one of a list, or NULL if all were carved
+ */
+static struct memp *
+memp_lazy_carve(const struct memp_desc *desc)
+{
+  struct memp *memp;
+
+  if (*desc->carved >= desc->num) {
+    return NULL;
+  }
+  memp = (struct memp *)(void *)((u8_t *)LWIP_MEM_ALIGN(desc->base) +
+                                 (size_t)*desc->carved * (MEMP_SIZE + MEMP_ALIGN_SIZE(desc->size)));
+  (*desc->carved)++;
+#if MEMP_MEM_INIT
+  memset(memp, 0, MEMP_SIZE + MEMP_ALIGN_SIZE(desc->size));
+#endif
+#if MEMP_OVERFLOW_CHECK
+  memp_overflow_init_element(memp, desc);
+#endif /* MEMP_OVERFLOW_CHECK */
+  memp->next = NULL;
+  return memp;
+}
+#endif /* MEMP_LAZY_INIT */
+
 /**
  * Initialize custom memory pool.
  * Related functions: memp_malloc_pool, memp_free_pool
@@ -176,6 +264,10 @@ memp_init_pool(const struct memp_desc *desc)
 {
 #if MEMP_MEM_MALLOC
   LWIP_UNUSED_ARG(desc);
+#elif MEMP_LAZY_INIT
+  /* elements are carved on first use, see memp_lazy_carve() */
+  *desc->tab = NULL;
+  *desc->carved = 0;
 #else
   int i;
   struct memp *memp;
@@ -204,10 +296,13 @@ memp_init_pool(const struct memp_desc *desc)
 #endif
                                   );
   }
-#if MEMP_STATS
+#if MEMP_LOCKFREE
+  *desc->lf_head = MEMP_LF_HEAD(0, memp_lf_index(desc, *desc->tab));
+#endif /* MEMP_LOCKFREE */
+#endif /* MEMP_MEM_MALLOC */
+#if MEMP_STATS && !MEMP_MEM_MALLOC
   desc->stats->avail = desc->num;
-#endif /* MEMP_STATS */
-#endif /* !MEMP_MEM_MALLOC */
+#endif /* MEMP_STATS && !MEMP_MEM_MALLOC */
 
 #if MEMP_STATS && (defined(LWIP_DEBUG) || LWIP_STATS_DISPLAY)
   desc->stats->name  = desc->desc;
@@ -240,7 +335,32 @@ memp_init(void)
 #endif /* MEMP_OVERFLOW_CHECK >= 2 */
 }
 
-static void *
+#if MEMP_LOCKFREE
+static LWIP_HOT_TEXT void *
+do_memp_malloc_pool(const struct memp_desc *desc)
+{
+  struct memp *memp = memp_lf_pop(desc);
+
+  if (memp != NULL) {
+    LWIP_ASSERT("memp_malloc: memp properly aligned",
+                ((mem_ptr_t)memp % MEM_ALIGNMENT) == 0);
+#if MEMP_STATS
+    /* max is racy between contexts, which is fine for a statistic */
+    if (__atomic_add_fetch(&desc->stats->used, 1, __ATOMIC_RELAXED) > desc->stats->max) {
+      desc->stats->max = desc->stats->used;
+    }
+#endif
+    /* cast through u8_t* to get rid of alignment warnings */
+    return ((u8_t *)memp + MEMP_SIZE);
+  }
+#if MEMP_STATS
+  __atomic_add_fetch(&desc->stats->err, 1, __ATOMIC_RELAXED);
+#endif
+  LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("memp_malloc: out of memory in pool %s\n", desc->desc));
+  return NULL;
+}
+#else /* MEMP_LOCKFREE */
+static LWIP_HOT_TEXT void *
 #if !MEMP_OVERFLOW_CHECK
 do_memp_malloc_pool(const struct memp_desc *desc)
 #else
@@ -257,6 +377,11 @@ do_memp_malloc_pool_fn(const struct memp_desc *desc, const char *file, const int
   SYS_ARCH_PROTECT(old_level);
 
   memp = *desc->tab;
+#if MEMP_LAZY_INIT
+  if (memp == NULL) {
+    memp = memp_lazy_carve(desc);
+  }
+#endif /* MEMP_LAZY_INIT */
 #endif /* MEMP_MEM_MALLOC */
 
   if (memp != NULL) {
@@ -298,6 +423,7 @@ do_memp_malloc_pool_fn(const struct memp_desc *desc, const char *file, const int
 
   return NULL;
 }
+#endif /* MEMP_LOCKFREE */
 
 /**
  * Get an element from a custom pool.
@@ -325,6 +451,143 @@ memp_malloc_pool_fn(const struct memp_desc *desc, const char *file, const int li
 #endif
 }
 
+#if MEMP_MAGAZINE
+static void do_memp_free_pool(const struct memp_desc *desc, void *mem);
+
+static const memp_t memp_magazine_types[MEMP_MAGAZINE_POOLS] = {
+  MEMP_PBUF_POOL,
+  MEMP_PBUF,
+#if LWIP_TCP
+  MEMP_TCP_SEG
+#else
+  MEMP_MAX
+#endif
+};
+
+static int
+memp_magazine_slot(memp_t type)
+{
+  int i;
+
+  for (i = 0; i < MEMP_MAGAZINE_POOLS; i++) {
+    if (memp_magazine_types[i] == type) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* take up to half a magazine from the pool in one go */
+static void
+memp_magazine_refill(struct memp_magazine *mag, int slot)
+{
+  const struct memp_desc *desc = memp_pools[memp_magazine_types[slot]];
+#if MEMP_LOCKFREE
+  void *mem;
+
+  while (mag->count[slot] < MEMP_MAGAZINE_SIZE / 2) {
+    mem = do_memp_malloc_pool(desc);
+    if (mem == NULL) {
+      break;
+    }
+    mag->elem[slot][mag->count[slot]++] = mem;
+  }
+#else /* MEMP_LOCKFREE */
+  struct memp *memp;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+  while (mag->count[slot] < MEMP_MAGAZINE_SIZE / 2) {
+    memp = *desc->tab;
+#if MEMP_LAZY_INIT
+    if (memp == NULL) {
+      memp = memp_lazy_carve(desc);
+    }
+#endif /* MEMP_LAZY_INIT */
+    if (memp == NULL) {
+      break;
+    }
+    *desc->tab = memp->next;
+    mag->elem[slot][mag->count[slot]++] = (u8_t *)memp + MEMP_SIZE;
+#if MEMP_STATS
+    desc->stats->used++;
+#endif
+  }
+#if MEMP_STATS
+  if (mag->count[slot] == 0) {
+    desc->stats->err++;
+  } else if (desc->stats->used > desc->stats->max) {
+    desc->stats->max = desc->stats->used;
+  }
+#endif
+  SYS_ARCH_UNPROTECT(old_level);
+  if (mag->count[slot] == 0) {
+    LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("memp_malloc: out of memory in pool %s\n", desc->desc));
+  }
+#endif /* MEMP_LOCKFREE */
+}
+
+/* give elements back to the pool until 'keep' are left */
+static void
+memp_magazine_flush(struct memp_magazine *mag, int slot, u8_t keep)
+{
+  const struct memp_desc *desc = memp_pools[memp_magazine_types[slot]];
+#if MEMP_LOCKFREE
+  while (mag->count[slot] > keep) {
+    do_memp_free_pool(desc, mag->elem[slot][--mag->count[slot]]);
+  }
+#else /* MEMP_LOCKFREE */
+  struct memp *memp;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+  while (mag->count[slot] > keep) {
+    memp = (struct memp *)(void *)((u8_t *)mag->elem[slot][--mag->count[slot]] - MEMP_SIZE);
+    memp->next = *desc->tab;
+    *desc->tab = memp;
+#if MEMP_STATS
+    desc->stats->used--;
+#endif
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+#endif /* MEMP_LOCKFREE */
+}
+
+/**
+ * Give the calling thread a magazine. From now on its PBUF_POOL, PBUF and
+ * TCP_SEG allocations are served from it. The memory must stay valid until
+ * memp_magazine_thread_deinit().
+ *
+ * @param mag the magazine (uninitialized)
+ */
+void
+memp_magazine_thread_init(struct memp_magazine *mag)
+{
+  memset(mag, 0, sizeof(*mag));
+  LWIP_MEMP_MAGAZINE_SET(mag);
+}
+
+/**
+ * Return everything in the calling thread's magazine to the pools and stop
+ * using it.
+ */
+void
+memp_magazine_thread_deinit(void)
+{
+  struct memp_magazine *mag = LWIP_MEMP_MAGAZINE_GET();
+  int i;
+
+  if (mag != NULL) {
+    LWIP_MEMP_MAGAZINE_SET(NULL);
+    for (i = 0; i < MEMP_MAGAZINE_POOLS; i++) {
+      if (memp_magazine_types[i] != MEMP_MAX) {
+        memp_magazine_flush(mag, i, 0);
+      }
+    }
+  }
+}
+#endif /* MEMP_MAGAZINE */
+
 /**
  * Get an element from a specific pool.
  *
@@ -332,7 +595,7 @@ memp_malloc_pool_fn(const struct memp_desc *desc, const char *file, const int li
  *
  * @return a pointer to the allocated memory or a NULL pointer on error
  */
-void *
+LWIP_HOT_TEXT void *
 #if !MEMP_OVERFLOW_CHECK
 memp_malloc(memp_t type)
 #else
@@ -340,12 +603,29 @@ memp_malloc_fn(memp_t type, const char *file, const int line)
 #endif
 {
   void *memp;
+#if MEMP_MAGAZINE
+  struct memp_magazine *mag;
+  int slot;
+#endif /* MEMP_MAGAZINE */
   LWIP_ERROR("memp_malloc: type < MEMP_MAX", (type < MEMP_MAX), return NULL;);
 
 #if MEMP_OVERFLOW_CHECK >= 2
   memp_overflow_check_all();
 #endif /* MEMP_OVERFLOW_CHECK >= 2 */
 
+#if MEMP_MAGAZINE
+  mag = LWIP_MEMP_MAGAZINE_GET();
+  if ((mag != NULL) && ((slot = memp_magazine_slot(type)) >= 0)) {
+    if (mag->count[slot] == 0) {
+      memp_magazine_refill(mag, slot);
+      if (mag->count[slot] == 0) {
+        return NULL;
+      }
+    }
+    return mag->elem[slot][--mag->count[slot]];
+  }
+#endif /* MEMP_MAGAZINE */
+
 #if !MEMP_OVERFLOW_CHECK
   memp = do_memp_malloc_pool(memp_pools[type]);
 #else
@@ -355,7 +635,25 @@ memp_malloc_fn(memp_t type, const char *file, const int line)
   return memp;
 }
 
-static void
+#if MEMP_LOCKFREE
+static LWIP_HOT_TEXT void
+do_memp_free_pool(const struct memp_desc *desc, void *mem)
+{
+  struct memp *memp;
+
+  LWIP_ASSERT("memp_free: mem properly aligned",
+              ((mem_ptr_t)mem % MEM_ALIGNMENT) == 0);
+
+  /* cast through void* to get rid of alignment warnings */
+  memp = (struct memp *)(void *)((u8_t *)mem - MEMP_SIZE);
+
+#if MEMP_STATS
+  __atomic_sub_fetch(&desc->stats->used, 1, __ATOMIC_RELAXED);
+#endif
+  memp_lf_push(desc, memp);
+}
+#else /* MEMP_LOCKFREE */
+static LWIP_HOT_TEXT void
 do_memp_free_pool(const struct memp_desc *desc, void *mem)
 {
   struct memp *memp;
@@ -392,6 +690,7 @@ do_memp_free_pool(const struct memp_desc *desc, void *mem)
   SYS_ARCH_UNPROTECT(old_level);
 #endif /* !MEMP_MEM_MALLOC */
 }
+#endif /* MEMP_LOCKFREE */
 
 /**
  * Put a custom pool element back into its pool.
@@ -416,12 +715,16 @@ memp_free_pool(const struct memp_desc *desc, void *mem)
  * @param type the pool where to put mem
  * @param mem the memp element to free
  */
-void
+LWIP_HOT_TEXT void
 memp_free(memp_t type, void *mem)
 {
 #ifdef LWIP_HOOK_MEMP_AVAILABLE
   struct memp *old_first;
 #endif
+#if MEMP_MAGAZINE
+  struct memp_magazine *mag;
+  int slot;
+#endif /* MEMP_MAGAZINE */
 
   LWIP_ERROR("memp_free: type < MEMP_MAX", (type < MEMP_MAX), return;);
 
@@ -429,6 +732,17 @@ memp_free(memp_t type, void *mem)
     return;
   }
 
+#if MEMP_MAGAZINE
+  mag = LWIP_MEMP_MAGAZINE_GET();
+  if ((mag != NULL) && ((slot = memp_magazine_slot(type)) >= 0)) {
+    if (mag->count[slot] == MEMP_MAGAZINE_SIZE) {
+      memp_magazine_flush(mag, slot, MEMP_MAGAZINE_SIZE / 2);
+    }
+    mag->elem[slot][mag->count[slot]++] = mem;
+    return;
+  }
+#endif /* MEMP_MAGAZINE */
+
 #if MEMP_OVERFLOW_CHECK >= 2
   memp_overflow_check_all();
 #endif /* MEMP_OVERFLOW_CHECK >= 2 */
@@ -445,3 +759,26 @@ memp_free(memp_t type, void *mem)
   }
 #endif
 }
+
+#if !MEMP_MEM_MALLOC
+/**
+ * Get the position of an element in its pool, e.g. to find data kept for it
+ * in a parallel array.
+ *
+ * @param type the pool mem was allocated from
+ * @param mem a memp element of that pool
+ * @return the index of mem, 0 to the pool's number of elements - 1
+ */
+u16_t
+memp_index(memp_t type, const void *mem)
+{
+  const struct memp_desc *desc;
+  mem_ptr_t off;
+
+  LWIP_ASSERT("memp_index: type < MEMP_MAX", type < MEMP_MAX);
+  desc = memp_pools[type];
+  off = (mem_ptr_t)((const u8_t *)mem - MEMP_SIZE - (const u8_t *)LWIP_MEM_ALIGN(desc->base));
+  LWIP_ASSERT("memp_index: mem not in pool", off < (mem_ptr_t)desc->num * (MEMP_SIZE + MEMP_ALIGN_SIZE(desc->size)));
+  return (u16_t)(off / (MEMP_SIZE + MEMP_ALIGN_SIZE(desc->size)));
+}
+#endif /* !MEMP_MEM_MALLOC */
@@ -107,9 +107,9 @@ static netif_ext_callback_t *ext_callback;
 #endif
 
 #if !LWIP_SINGLE_NETIF
-struct netif *netif_list;
+struct netif *netif_list LWIP_HOT_DATA;
 #endif /* !LWIP_SINGLE_NETIF */
-struct netif *netif_default;
+struct netif *netif_default LWIP_HOT_DATA;
 
 #define netif_index_to_num(index)   ((index) - 1)
 static u8_t netif_num;
@@ -229,6 +229,74 @@ netif_input(struct pbuf *p, struct netif *inp)
     return ip_input(p, inp);
 }
 
+#if LWIP_NETIF_LINKOUTPUT_BURST
+/** Pass the staged frames to netif->linkoutput_burst and drop our references */
+static void
+netif_burst_flush(struct netif *netif)
+{
+  u8_t i, n = netif->burst_len;
+
+  if (n == 0) {
+    return;
+  }
+  netif->burst_len = 0;
+  netif->linkoutput_burst(netif, netif->burst, n);
+  for (i = 0; i < n; i++) {
+    pbuf_free(netif->burst[i]);
+    netif->burst[i] = NULL;
+  }
+}
+
+/**
+ * Start staging the frames ethernet_output() sends on this netif, for one
+ * netif->linkoutput_burst call at netif_burst_end(). Calls may nest; the
+ * burst goes out when the outermost one ends. Frames must not be changed
+ * until then, so begin and end belong in the same function.
+ */
+void
+netif_burst_begin(struct netif *netif)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ASSERT("netif_burst_begin: invalid netif", netif != NULL);
+
+  netif->burst_depth++;
+}
+
+/**
+ * End a burst started with netif_burst_begin(), sending the staged frames.
+ */
+void
+netif_burst_end(struct netif *netif)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ASSERT("netif_burst_end: invalid netif", netif != NULL);
+  LWIP_ASSERT("netif_burst_end: no burst", netif->burst_depth > 0);
+
+  if (--netif->burst_depth == 0) {
+    netif_burst_flush(netif);
+  }
+}
+
+/**
+ * Send a frame with netif->linkoutput, or stage it for
+ * netif->linkoutput_burst while a burst is open.
+ * Staged frames are reported as sent.
+ */
+err_t
+netif_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  if ((netif->burst_depth == 0) || (netif->linkoutput_burst == NULL)) {
+    return netif->linkoutput(netif, p);
+  }
+  if (netif->burst_len == NETIF_BURST_MAX) {
+    netif_burst_flush(netif);
+  }
+  pbuf_ref(p);
+  netif->burst[netif->burst_len++] = p;
+  return ERR_OK;
+}
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
+
 /**
  * @ingroup netif
  * Add a network interface to the list of lwIP netifs.
@@ -326,6 +394,15 @@ netif_add(struct netif *netif,
   NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL);
   netif->mtu = 0;
   netif->flags = 0;
+#if LWIP_NETIF_LINKOUTPUT_BURST
+  netif->linkoutput_burst = NULL;
+  netif->burst_len = 0;
+  netif->burst_depth = 0;
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
+#if LWIP_TCP && TCP_ACK_STRETCH
+  netif->ack_stretch_segs = TCP_ACK_STRETCH_SEGS;
+  netif->ack_stretch_bytes = TCP_ACK_STRETCH_BYTES;
+#endif /* LWIP_TCP && TCP_ACK_STRETCH */
 #ifdef netif_get_client_data
   memset(netif->client_data, 0, sizeof(netif->client_data));
 #endif /* LWIP_NUM_NETIF_CLIENT_DATA */
@@ -438,9 +515,20 @@ netif_add(struct netif *netif,
   return netif;
 }
 
+/** Something packets are routed by has changed: an address, a netif's or its link's state */
+static void
+netif_route_changed(void)
+{
+#if LWIP_IPV4
+  IP4_ROUTE_CACHE_FLUSH();
+  IP4_FORWARD_CACHE_FLUSH();
+#endif /* LWIP_IPV4 */
+}
+
 static void
 netif_do_ip_addr_changed(const ip_addr_t *old_addr, const ip_addr_t *new_addr)
 {
+  netif_route_changed();
 #if LWIP_TCP
   tcp_netif_ip_addr_changed(old_addr, new_addr);
 #endif /* LWIP_TCP */
@@ -535,6 +623,7 @@ netif_do_set_netmask(struct netif *netif, const ip4_addr_t *netmask, ip_addr_t *
     ip4_addr_set(ip_2_ip4(&netif->netmask), netmask);
     IP_SET_TYPE_VAL(netif->netmask, IPADDR_TYPE_V4);
     mib2_add_route_ip4(0, netif);
+    netif_route_changed();
     LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("netif: netmask of interface %c%c set to %"U16_F".%"U16_F".%"U16_F".%"U16_F"\n",
                 netif->name[0], netif->name[1],
                 ip4_addr1_16(netif_ip4_netmask(netif)),
@@ -597,6 +686,7 @@ netif_do_set_gw(struct netif *netif, const ip4_addr_t *gw, ip_addr_t *old_gw)
 
     ip4_addr_set(ip_2_ip4(&netif->gw), gw);
     IP_SET_TYPE_VAL(netif->gw, IPADDR_TYPE_V4);
+    netif_route_changed();
     LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("netif: GW address of interface %c%c set to %"U16_F".%"U16_F".%"U16_F".%"U16_F"\n",
                 netif->name[0], netif->name[1],
                 ip4_addr1_16(netif_ip4_gw(netif)),
@@ -747,6 +837,7 @@ netif_remove(struct netif *netif)
   }
 
   netif_invoke_ext_callback(netif, LWIP_NSC_NETIF_REMOVED, NULL);
+  netif_route_changed();
 
 #if LWIP_IPV4
   if (!ip4_addr_isany_val(*netif_ip4_addr(netif))) {
@@ -831,6 +922,7 @@ netif_set_default(struct netif *netif)
     mib2_add_route_ip4(1, netif);
   }
   netif_default = netif;
+  netif_route_changed();
   LWIP_DEBUGF(NETIF_DEBUG, ("netif: setting default interface %c%c\n",
                             netif ? netif->name[0] : '\'', netif ? netif->name[1] : '\''));
 }
@@ -849,6 +941,7 @@ netif_set_up(struct netif *netif)
 
   if (!(netif->flags & NETIF_FLAG_UP)) {
     netif_set_flags(netif, NETIF_FLAG_UP);
+    netif_route_changed();
 
     MIB2_COPY_SYSUPTIME_TO(&netif->ts);
 
@@ -933,6 +1026,7 @@ netif_set_down(struct netif *netif)
 
     netif_clear_flags(netif, NETIF_FLAG_UP);
     MIB2_COPY_SYSUPTIME_TO(&netif->ts);
+    netif_route_changed();
 
 #if LWIP_IPV4 && LWIP_ARP
     if (netif->flags & NETIF_FLAG_ETHARP) {
@@ -993,6 +1087,7 @@ netif_set_link_up(struct netif *netif)
 
   if (!(netif->flags & NETIF_FLAG_LINK_UP)) {
     netif_set_flags(netif, NETIF_FLAG_LINK_UP);
+    netif_route_changed();
 
 #if LWIP_DHCP
     dhcp_network_changed(netif);
@@ -1031,6 +1126,7 @@ netif_set_link_down(struct netif *netif)
 
   if (netif->flags & NETIF_FLAG_LINK_UP) {
     netif_clear_flags(netif, NETIF_FLAG_LINK_UP);
+    netif_route_changed();
     NETIF_LINK_CALLBACK(netif);
 #if LWIP_NETIF_EXT_STATUS_CALLBACK
     {
@@ -1059,10 +1155,130 @@ netif_set_link_callback(struct netif *netif, netif_status_callback_fn link_callb
 #endif /* LWIP_NETIF_LINK_CALLBACK */
 
 #if ENABLE_LOOPBACK
+#if LWIP_NETIF_LOOPBACK_ZEROCOPY
+/** Free-callback of a looped pbuf: drop the reference on the sent pbuf */
+static void
+netif_loop_free_ref(struct pbuf *p)
+{
+  struct pbuf_custom_ref *pcr = (struct pbuf_custom_ref *)p;
+
+  pbuf_free(pcr->original);
+  memp_free(MEMP_LOOP_PBUF, pcr);
+}
+
+/**
+ * Length of the IP and TCP/UDP headers at the front of p. The receiving side
+ * rewrites these in place, so the looped packet needs its own copy of them.
+ * Returns 0 if p should be copied whole.
+ */
+static u16_t
+netif_loop_hdr_len(const struct pbuf *p)
+{
+  const u8_t *hdr = (const u8_t *)p->payload;
+  u16_t iphlen;
+  u16_t thlen;
+  u8_t proto;
+
+  if (p->len == 0) {
+    return 0;
+  }
+  switch (hdr[0] >> 4) {
+#if LWIP_IPV4
+    case 4:
+      if ((p->len < IP_HLEN) ||
+          ((lwip_ntohs(IPH_OFFSET((const struct ip_hdr *)hdr)) & (IP_OFFMASK | IP_MF)) != 0)) {
+        return 0;
+      }
+      iphlen = IPH_HL_BYTES((const struct ip_hdr *)hdr);
+      proto = IPH_PROTO((const struct ip_hdr *)hdr);
+      break;
+#endif /* LWIP_IPV4 */
+#if LWIP_IPV6
+    case 6:
+      if (p->len < IP6_HLEN) {
+        return 0;
+      }
+      iphlen = IP6_HLEN;
+      proto = IP6H_NEXTH((const struct ip6_hdr *)hdr);
+      break;
+#endif /* LWIP_IPV6 */
+    default:
+      return 0;
+  }
+  switch (proto) {
+#if LWIP_TCP
+    case IP_PROTO_TCP:
+      if (p->len < iphlen + TCP_HLEN) {
+        return 0;
+      }
+      thlen = (u16_t)TCPH_HDRLEN_BYTES((const struct tcp_hdr *)(hdr + iphlen));
+      break;
+#endif /* LWIP_TCP */
+#if LWIP_UDP
+    case IP_PROTO_UDP:
+      thlen = UDP_HLEN;
+      break;
+#endif /* LWIP_UDP */
+    default:
+      return 0;
+  }
+  if (iphlen + thlen > p->len) {
+    return 0;
+  }
+  return (u16_t)(iphlen + thlen);
+}
+
+/**
+ * Build the looped copy of p from a copy of its headers and custom pbufs that
+ * reference its payload. Returns NULL if p must be copied instead: its payload
+ * is not in memory the stack owns, or a pool ran dry.
+ */
+static struct pbuf *
+netif_loop_ref(struct pbuf *p)
+{
+  struct pbuf *r, *q;
+  u16_t off = netif_loop_hdr_len(p);
+
+  if (off == 0) {
+    return NULL;
+  }
+  for (q = p; q != NULL; q = q->next) {
+    if (!(q->type_internal & PBUF_TYPE_FLAG_STRUCT_DATA_CONTIGUOUS) ||
+        (q->flags & PBUF_FLAG_IS_CUSTOM)) {
+      return NULL;
+    }
+  }
+  r = pbuf_alloc(PBUF_LINK, off, PBUF_RAM);
+  if (r == NULL) {
+    return NULL;
+  }
+  MEMCPY(r->payload, p->payload, off);
+  for (q = p; q != NULL; q = q->next, off = 0) {
+    struct pbuf_custom_ref *pcr;
+    u16_t len = (u16_t)(q->len - off);
+
+    if (len == 0) {
+      continue;
+    }
+    pcr = (struct pbuf_custom_ref *)memp_malloc(MEMP_LOOP_PBUF);
+    if (pcr == NULL) {
+      pbuf_free(r);
+      return NULL;
+    }
+    pcr->pc.custom_free_function = netif_loop_free_ref;
+    pcr->original = q;
+    pbuf_ref(q);
+    pbuf_cat(r, pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &pcr->pc, (u8_t *)q->payload + off, len));
+  }
+  return r;
+}
+#endif /* LWIP_NETIF_LOOPBACK_ZEROCOPY */
+
 /**
  * @ingroup netif
  * Send an IP packet to be received on the same netif (loopif-like).
- * The pbuf is simply copied and handed back to netif->input.
+ * The pbuf is simply copied and handed back to netif->input (with
+ * LWIP_NETIF_LOOPBACK_ZEROCOPY, only its headers are copied).
  * In multithreaded mode, this is done directly since netif->input must put
  * the packet on a queue.
  * In callback mode, the packet is put on an internal queue and is fed to
@@ -1099,13 +1315,27 @@ netif_loop_output(struct netif *netif, struct pbuf *p)
   LWIP_ASSERT("netif_loop_output: invalid netif", netif != NULL);
   LWIP_ASSERT("netif_loop_output: invalid pbuf", p != NULL);
 
-  /* Allocate a new pbuf */
-  r = pbuf_alloc(PBUF_LINK, p->tot_len, PBUF_RAM);
-  if (r == NULL) {
-    LINK_STATS_INC(link.memerr);
-    LINK_STATS_INC(link.drop);
-    MIB2_STATS_NETIF_INC(stats_if, ifoutdiscards);
-    return ERR_MEM;
+#if LWIP_NETIF_LOOPBACK_ZEROCOPY
+  r = netif_loop_ref(p);
+  if (r == NULL)
+#endif /* LWIP_NETIF_LOOPBACK_ZEROCOPY */
+  {
+    /* Allocate a new pbuf */
+    r = pbuf_alloc(PBUF_LINK, p->tot_len, PBUF_RAM);
+    if (r == NULL) {
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+      MIB2_STATS_NETIF_INC(stats_if, ifoutdiscards);
+      return ERR_MEM;
+    }
+    /* Copy the whole pbuf queue p into the single pbuf r */
+    if ((err = pbuf_copy(r, p)) != ERR_OK) {
+      pbuf_free(r);
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+      MIB2_STATS_NETIF_INC(stats_if, ifoutdiscards);
+      return err;
+    }
   }
 #if LWIP_LOOPBACK_MAX_PBUFS
   clen = pbuf_clen(r);
@@ -1121,15 +1351,6 @@ netif_loop_output(struct netif *netif, struct pbuf *p)
   netif->loop_cnt_current = (u16_t)(netif->loop_cnt_current + clen);
 #endif /* LWIP_LOOPBACK_MAX_PBUFS */
 
-  /* Copy the whole pbuf queue p into the single pbuf r */
-  if ((err = pbuf_copy(r, p)) != ERR_OK) {
-    pbuf_free(r);
-    LINK_STATS_INC(link.memerr);
-    LINK_STATS_INC(link.drop);
-    MIB2_STATS_NETIF_INC(stats_if, ifoutdiscards);
-    return err;
-  }
-
   /* Put the packet on a linked list which gets emptied through calling
      netif_poll(). */
 
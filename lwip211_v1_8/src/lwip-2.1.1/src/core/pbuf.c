@@ -87,9 +87,30 @@
 #include <string.h>
 
 #define SIZEOF_STRUCT_PBUF        LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf))
+#if PBUF_POOL_PAYLOAD_ALIGNMENT
+#define PBUF_POOL_PAYLOAD_ALIGN_SIZE(size) (((size) + PBUF_POOL_PAYLOAD_ALIGNMENT - 1U) & ~(PBUF_POOL_PAYLOAD_ALIGNMENT - 1U))
+#define PBUF_POOL_PAYLOAD_ALIGN(addr)      ((u8_t *)(((mem_ptr_t)(addr) + PBUF_POOL_PAYLOAD_ALIGNMENT - 1) & ~(mem_ptr_t)(PBUF_POOL_PAYLOAD_ALIGNMENT - 1)))
+#define PBUF_POOL_BUFSIZE_ALIGNED PBUF_POOL_PAYLOAD_ALIGN_SIZE(PBUF_POOL_BUFSIZE)
+
+/** Payloads of the PBUF_POOL pbufs, at the struct pbuf's index in its pool */
+static u8_t pbuf_pool_payload_mem[PBUF_POOL_SIZE * PBUF_POOL_BUFSIZE_ALIGNED + PBUF_POOL_PAYLOAD_ALIGNMENT - 1];
+
+static u8_t *
+pbuf_pool_payload(const struct pbuf *p)
+{
+  u8_t *base = PBUF_POOL_PAYLOAD_ALIGN(pbuf_pool_payload_mem);
+  return base + (mem_ptr_t)memp_index(MEMP_PBUF_POOL, p) * PBUF_POOL_BUFSIZE_ALIGNED;
+}
+
+/* first byte a header may be added at */
+#define PBUF_PAYLOAD_START(p) ((pbuf_get_allocsrc(p) == PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF_POOL) ? \
+                               pbuf_pool_payload(p) : (u8_t *)(p) + SIZEOF_STRUCT_PBUF)
+#else /* PBUF_POOL_PAYLOAD_ALIGNMENT */
 /* Since the pool is created in memp, PBUF_POOL_BUFSIZE will be automatically
    aligned there. Therefore, PBUF_POOL_BUFSIZE_ALIGNED can be used here. */
 #define PBUF_POOL_BUFSIZE_ALIGNED LWIP_MEM_ALIGN_SIZE(PBUF_POOL_BUFSIZE)
+#define PBUF_PAYLOAD_START(p)     ((u8_t *)(p) + SIZEOF_STRUCT_PBUF)
+#endif /* PBUF_POOL_PAYLOAD_ALIGNMENT */
 
 static const struct pbuf *
 pbuf_skip_const(const struct pbuf *in, u16_t in_offset, u16_t *out_offset);
@@ -132,10 +153,10 @@ pbuf_free_ooseq(void)
 
   for (pcb = tcp_active_pcbs; NULL != pcb; pcb = pcb->next) {
     if (pcb->ooseq != NULL) {
-      /** Free the ooseq pbufs of one PCB only */
+      /** Drop the highest ooseq interval of every PCB that queues any,
+          instead of one PCB's whole queue */
       LWIP_DEBUGF(PBUF_DEBUG | LWIP_DBG_TRACE, ("pbuf_free_ooseq: freeing out-of-sequence pbufs\n"));
-      tcp_free_ooseq(pcb);
-      return;
+      tcp_free_ooseq_tail(pcb);
     }
   }
 }
@@ -174,8 +195,139 @@ pbuf_pool_is_empty(void)
 }
 #endif /* !LWIP_TCP || !TCP_QUEUE_OOSEQ || !PBUF_POOL_FREE_OOSEQ */
 
-/* Initialize members of struct pbuf after allocation */
+#if PBUF_POOL_QUOTAS
+/** A partition of the PBUF_POOL, see PBUF_POOL_QUOTAS */
+struct pbuf_pool_quota {
+  u16_t reserved;
+  u16_t limit;
+  u16_t used;
+  u32_t denied;
+};
+
+/** Quota 0 is not used, it stands for the shared part of the pool */
+static struct pbuf_pool_quota pbuf_pool_quotas[PBUF_POOL_QUOTAS + 1];
+static u8_t pbuf_pool_num_quotas;
+/** Pool pbufs not covered by a reservation, and how many of them are taken */
+static u16_t pbuf_pool_shared = PBUF_POOL_SIZE;
+static u16_t pbuf_pool_shared_used;
+/** The quota each pool pbuf was allocated for, at its index in the pool */
+static u8_t pbuf_pool_owner[PBUF_POOL_SIZE];
+
+/**
+ * @ingroup pbuf
+ * Create a partition of the PBUF_POOL for one netif's receive buffers.
+ *
+ * @param reserved pbufs nobody else can take; they must be free in the
+ *                 shared part of the pool right now
+ * @param limit most pbufs the partition may hold at once, 0 for no limit
+ * @return the quota to pass to pbuf_alloc_quota(), 0 if the pool or the
+ *         PBUF_POOL_QUOTAS slots are used up
+ */
+u8_t
+pbuf_pool_quota_new(u16_t reserved, u16_t limit)
+{
+  u8_t quota = 0;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  LWIP_ERROR("pbuf_pool_quota_new: limit below reserved", (limit == 0) || (limit >= reserved), return 0;);
+
+  SYS_ARCH_PROTECT(old_level);
+  if ((pbuf_pool_num_quotas < PBUF_POOL_QUOTAS) &&
+      (reserved <= pbuf_pool_shared - pbuf_pool_shared_used)) {
+    quota = ++pbuf_pool_num_quotas;
+    pbuf_pool_quotas[quota].reserved = reserved;
+    pbuf_pool_quotas[quota].limit = limit;
+    pbuf_pool_shared = (u16_t)(pbuf_pool_shared - reserved);
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+
+  return quota;
+}
+
+/**
+ * @ingroup pbuf
+ * How many pbufs a quota holds, and how many allocations it turned down.
+ */
+void
+pbuf_pool_quota_get(u8_t quota, u16_t *used, u32_t *denied)
+{
+  LWIP_ASSERT("pbuf_pool_quota_get: invalid quota", quota <= pbuf_pool_num_quotas);
+  *used = pbuf_pool_quotas[quota].used;
+  *denied = pbuf_pool_quotas[quota].denied;
+}
+
+/* Account a pool pbuf to quota: from its reservation, else from the shared part */
+static int
+pbuf_pool_quota_take(u8_t quota)
+{
+  struct pbuf_pool_quota *pq = &pbuf_pool_quotas[quota];
+  int ok = 1;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+  if ((pq->limit != 0) && (pq->used >= pq->limit)) {
+    ok = 0;
+  } else if ((quota == 0) || (pq->used >= pq->reserved)) {
+    if (pbuf_pool_shared_used < pbuf_pool_shared) {
+      pbuf_pool_shared_used++;
+    } else {
+      ok = 0;
+    }
+  }
+  if (ok) {
+    pq->used++;
+  } else {
+    pq->denied++;
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+
+  return ok;
+}
+
 static void
+pbuf_pool_quota_give(u8_t quota)
+{
+  struct pbuf_pool_quota *pq = &pbuf_pool_quotas[quota];
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  SYS_ARCH_PROTECT(old_level);
+  pq->used--;
+  if ((quota == 0) || (pq->used >= pq->reserved)) {
+    pbuf_pool_shared_used--;
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+}
+
+static struct pbuf *
+pbuf_pool_malloc(u8_t quota)
+{
+  struct pbuf *q;
+
+  if (!pbuf_pool_quota_take(quota)) {
+    return NULL;
+  }
+  q = (struct pbuf *)memp_malloc(MEMP_PBUF_POOL);
+  if (q == NULL) {
+    pbuf_pool_quota_give(quota);
+    return NULL;
+  }
+  pbuf_pool_owner[memp_index(MEMP_PBUF_POOL, q)] = quota;
+  return q;
+}
+
+static void
+pbuf_pool_free(struct pbuf *p)
+{
+  pbuf_pool_quota_give(pbuf_pool_owner[memp_index(MEMP_PBUF_POOL, p)]);
+  memp_free(MEMP_PBUF_POOL, p);
+}
+#else /* PBUF_POOL_QUOTAS */
+#define pbuf_pool_malloc(quota) ((struct pbuf *)memp_malloc(MEMP_PBUF_POOL))
+#define pbuf_pool_free(p)       memp_free(MEMP_PBUF_POOL, p)
+#endif /* PBUF_POOL_QUOTAS */
+
+/* Initialize members of struct pbuf after allocation */
+static LWIP_HOT_TEXT void
 pbuf_init_alloced_pbuf(struct pbuf *p, void *payload, u16_t tot_len, u16_t len, pbuf_type type, u8_t flags)
 {
   p->next = NULL;
@@ -186,7 +338,118 @@ pbuf_init_alloced_pbuf(struct pbuf *p, void *payload, u16_t tot_len, u16_t len,
   p->flags = flags;
   p->ref = 1;
   p->if_idx = NETIF_NO_INDEX;
+#if LWIP_PBUF_RX_TIMESTAMP
+  p->rx_time = 0;
+#endif
+}
+
+#if PBUF_POOL_SMALL_SIZE || PBUF_POOL_MEDIUM_SIZE
+/* A pbuf from the smallest size class that holds size bytes after the
+   struct pbuf, see PBUF_POOL_SMALL_SIZE. NULL if it must come from PBUF_POOL. */
+static struct pbuf *
+pbuf_pool_class_malloc(mem_size_t size)
+{
+  struct pbuf *q;
+
+#if PBUF_POOL_SMALL_SIZE
+  if (size <= LWIP_MEM_ALIGN_SIZE(PBUF_POOL_SMALL_BUFSIZE)) {
+    q = (struct pbuf *)memp_malloc(MEMP_PBUF_POOL_SMALL);
+    if (q != NULL) {
+      q->type_internal = PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF_POOL_SMALL;
+      return q;
+    }
+  }
+#endif /* PBUF_POOL_SMALL_SIZE */
+#if PBUF_POOL_MEDIUM_SIZE
+  if (size <= LWIP_MEM_ALIGN_SIZE(PBUF_POOL_MEDIUM_BUFSIZE)) {
+    q = (struct pbuf *)memp_malloc(MEMP_PBUF_POOL_MEDIUM);
+    if (q != NULL) {
+      q->type_internal = PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF_POOL_MEDIUM;
+      return q;
+    }
+  }
+#endif /* PBUF_POOL_MEDIUM_SIZE */
+  return NULL;
 }
+#endif /* PBUF_POOL_SMALL_SIZE || PBUF_POOL_MEDIUM_SIZE */
+
+/* Allocate a PBUF_POOL chain, accounted to quota with PBUF_POOL_QUOTAS */
+static LWIP_HOT_TEXT struct pbuf *
+pbuf_alloc_pool(u16_t offset, u16_t length, u8_t quota)
+{
+  struct pbuf *p, *q, *last;
+  u16_t rem_len; /* remaining length */
+
+  LWIP_UNUSED_ARG(quota);
+#if PBUF_POOL_SMALL_SIZE || PBUF_POOL_MEDIUM_SIZE
+  if (length > 0) {
+    q = pbuf_pool_class_malloc((mem_size_t)(LWIP_MEM_ALIGN_SIZE(offset) + length));
+    if (q != NULL) {
+      /* keep the alloc source pbuf_pool_class_malloc() stored */
+      pbuf_init_alloced_pbuf(q, LWIP_MEM_ALIGN((void *)((u8_t *)q + SIZEOF_STRUCT_PBUF + offset)),
+                             length, length,
+                             (pbuf_type)((PBUF_POOL & ~PBUF_TYPE_ALLOC_SRC_MASK) | q->type_internal), 0);
+      return q;
+    }
+  }
+#endif /* PBUF_POOL_SMALL_SIZE || PBUF_POOL_MEDIUM_SIZE */
+  p = NULL;
+  last = NULL;
+  rem_len = length;
+  do {
+    u16_t qlen;
+    q = pbuf_pool_malloc(quota);
+    if (q == NULL) {
+      PBUF_POOL_IS_EMPTY();
+      /* free chain so far allocated */
+      if (p) {
+        pbuf_free(p);
+      }
+      /* bail out unsuccessfully */
+      return NULL;
+    }
+    qlen = LWIP_MIN(rem_len, (u16_t)(PBUF_POOL_BUFSIZE_ALIGNED - LWIP_MEM_ALIGN_SIZE(offset)));
+#if PBUF_POOL_PAYLOAD_ALIGNMENT
+    pbuf_init_alloced_pbuf(q, pbuf_pool_payload(q) + LWIP_MEM_ALIGN_SIZE(offset),
+                           rem_len, qlen, PBUF_POOL, 0);
+#else /* PBUF_POOL_PAYLOAD_ALIGNMENT */
+    pbuf_init_alloced_pbuf(q, LWIP_MEM_ALIGN((void *)((u8_t *)q + SIZEOF_STRUCT_PBUF + offset)),
+                           rem_len, qlen, PBUF_POOL, 0);
+#endif /* PBUF_POOL_PAYLOAD_ALIGNMENT */
+    LWIP_ASSERT("pbuf_alloc: pbuf q->payload properly aligned",
+                ((mem_ptr_t)q->payload % MEM_ALIGNMENT) == 0);
+    LWIP_ASSERT("PBUF_POOL_BUFSIZE must be bigger than MEM_ALIGNMENT",
+                (PBUF_POOL_BUFSIZE_ALIGNED - LWIP_MEM_ALIGN_SIZE(offset)) > 0 );
+    if (p == NULL) {
+      /* allocated head of pbuf chain (into p) */
+      p = q;
+    } else {
+      /* make previous pbuf point to this pbuf */
+      last->next = q;
+    }
+    last = q;
+    rem_len = (u16_t)(rem_len - qlen);
+    offset = 0;
+  } while (rem_len > 0);
+
+  return p;
+}
+
+#if PBUF_POOL_QUOTAS
+/**
+ * @ingroup pbuf
+ * Allocates a PBUF_POOL pbuf (chain) like pbuf_alloc(), from the partition
+ * of the pool created by pbuf_pool_quota_new().
+ *
+ * @return the pbuf, or NULL if the pool is empty or quota is at its limit
+ */
+struct pbuf *
+pbuf_alloc_quota(pbuf_layer layer, u16_t length, u8_t quota)
+{
+  LWIP_ASSERT("pbuf_alloc_quota: invalid quota", quota <= pbuf_pool_num_quotas);
+  return pbuf_alloc_pool((u16_t)layer, length, quota);
+}
+#endif /* PBUF_POOL_QUOTAS */
 
 /**
  * @ingroup pbuf
@@ -220,7 +483,7 @@ pbuf_init_alloced_pbuf(struct pbuf *p, void *payload, u16_t tot_len, u16_t len,
  * @return the allocated pbuf. If multiple pbufs where allocated, this
  * is the first pbuf of a pbuf chain.
  */
-struct pbuf *
+LWIP_HOT_TEXT struct pbuf *
 pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
 {
   struct pbuf *p;
@@ -232,44 +495,9 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
     case PBUF_ROM:
       p = pbuf_alloc_reference(NULL, length, type);
       break;
-    case PBUF_POOL: {
-      struct pbuf *q, *last;
-      u16_t rem_len; /* remaining length */
-      p = NULL;
-      last = NULL;
-      rem_len = length;
-      do {
-        u16_t qlen;
-        q = (struct pbuf *)memp_malloc(MEMP_PBUF_POOL);
-        if (q == NULL) {
-          PBUF_POOL_IS_EMPTY();
-          /* free chain so far allocated */
-          if (p) {
-            pbuf_free(p);
-          }
-          /* bail out unsuccessfully */
-          return NULL;
-        }
-        qlen = LWIP_MIN(rem_len, (u16_t)(PBUF_POOL_BUFSIZE_ALIGNED - LWIP_MEM_ALIGN_SIZE(offset)));
-        pbuf_init_alloced_pbuf(q, LWIP_MEM_ALIGN((void *)((u8_t *)q + SIZEOF_STRUCT_PBUF + offset)),
-                               rem_len, qlen, type, 0);
-        LWIP_ASSERT("pbuf_alloc: pbuf q->payload properly aligned",
-                    ((mem_ptr_t)q->payload % MEM_ALIGNMENT) == 0);
-        LWIP_ASSERT("PBUF_POOL_BUFSIZE must be bigger than MEM_ALIGNMENT",
-                    (PBUF_POOL_BUFSIZE_ALIGNED - LWIP_MEM_ALIGN_SIZE(offset)) > 0 );
-        if (p == NULL) {
-          /* allocated head of pbuf chain (into p) */
-          p = q;
-        } else {
-          /* make previous pbuf point to this pbuf */
-          last->next = q;
-        }
-        last = q;
-        rem_len = (u16_t)(rem_len - qlen);
-        offset = 0;
-      } while (rem_len > 0);
+    case PBUF_POOL:
+      p = pbuf_alloc_pool(offset, length, 0);
       break;
-    }
     case PBUF_RAM: {
       u16_t payload_len = (u16_t)(LWIP_MEM_ALIGN_SIZE(offset) + LWIP_MEM_ALIGN_SIZE(length));
       mem_size_t alloc_len = (mem_size_t)(LWIP_MEM_ALIGN_SIZE(SIZEOF_STRUCT_PBUF) + payload_len);
@@ -497,10 +725,10 @@ pbuf_add_header_impl(struct pbuf *p, size_t header_size_increment, u8_t force)
     /* set new payload pointer */
     payload = (u8_t *)p->payload - header_size_increment;
     /* boundary check fails? */
-    if ((u8_t *)payload < (u8_t *)p + SIZEOF_STRUCT_PBUF) {
+    if ((u8_t *)payload < PBUF_PAYLOAD_START(p)) {
       LWIP_DEBUGF( PBUF_DEBUG | LWIP_DBG_TRACE,
                    ("pbuf_add_header: failed as %p < %p (not enough space for new header size)\n",
-                    (void *)payload, (void *)((u8_t *)p + SIZEOF_STRUCT_PBUF)));
+                    (void *)payload, (void *)PBUF_PAYLOAD_START(p)));
       /* bail out unsuccessfully */
       return 1;
     }
@@ -721,7 +949,7 @@ pbuf_free_header(struct pbuf *q, u16_t size)
  * 1->1->1 becomes .......
  *
  */
-u8_t
+LWIP_HOT_TEXT u8_t
 pbuf_free(struct pbuf *p)
 {
   u8_t alloc_src;
@@ -744,16 +972,12 @@ pbuf_free(struct pbuf *p)
    * obtain a zero reference count after decrementing*/
   while (p != NULL) {
     LWIP_PBUF_REF_T ref;
-    SYS_ARCH_DECL_PROTECT(old_level);
-    /* Since decrementing ref cannot be guaranteed to be a single machine operation
-     * we must protect it. We put the new ref into a local variable to prevent
-     * further protection. */
-    SYS_ARCH_PROTECT(old_level);
     /* all pbufs in a chain are referenced at least once */
     LWIP_ASSERT("pbuf_free: p->ref > 0", p->ref > 0);
-    /* decrease reference count (number of pointers to pbuf) */
-    ref = --(p->ref);
-    SYS_ARCH_UNPROTECT(old_level);
+    /* Since decrementing ref cannot be guaranteed to be a single machine operation
+     * we must protect it (or let the port do it atomically). We put the new ref
+     * into a local variable to prevent further protection. */
+    SYS_ARCH_DEC_FETCH(p->ref, 1, ref);
     /* this pbuf is no longer referenced to? */
     if (ref == 0) {
       /* remember next pbuf in chain for next iteration */
@@ -771,7 +995,15 @@ pbuf_free(struct pbuf *p)
       {
         /* is this a pbuf from the pool? */
         if (alloc_src == PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF_POOL) {
-          memp_free(MEMP_PBUF_POOL, p);
+          pbuf_pool_free(p);
+#if PBUF_POOL_SMALL_SIZE
+        } else if (alloc_src == PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF_POOL_SMALL) {
+          memp_free(MEMP_PBUF_POOL_SMALL, p);
+#endif /* PBUF_POOL_SMALL_SIZE */
+#if PBUF_POOL_MEDIUM_SIZE
+        } else if (alloc_src == PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF_POOL_MEDIUM) {
+          memp_free(MEMP_PBUF_POOL_MEDIUM, p);
+#endif /* PBUF_POOL_MEDIUM_SIZE */
           /* is this a ROM or RAM referencing pbuf? */
         } else if (alloc_src == PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF) {
           memp_free(MEMP_PBUF, p);
@@ -830,7 +1062,7 @@ pbuf_ref(struct pbuf *p)
 {
   /* pbuf given? */
   if (p != NULL) {
-    SYS_ARCH_SET(p->ref, (LWIP_PBUF_REF_T)(p->ref + 1));
+    SYS_ARCH_INC(p->ref, 1);
     LWIP_ASSERT("pbuf ref overflow", p->ref > 0);
   }
 }
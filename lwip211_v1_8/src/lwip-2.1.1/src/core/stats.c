@@ -46,8 +46,101 @@
 #include "lwip/debug.h"
 
 #include <string.h>
+#include <stddef.h>
 
-struct stats_ lwip_stats;
+struct stats_ lwip_stats LWIP_HOT_DATA;
+
+#if LWIP_STATS_CORES > 1
+/* one more block than needed, to align them to a cache line */
+static u8_t stats_cores_mem[(LWIP_STATS_CORES + 1) * sizeof(union stats_core)];
+union stats_core *lwip_stats_cores;
+
+/** Sum the STAT_COUNTERs (or u32_t with MIB2) at 'offset' in all per-core blocks into lwip_stats */
+static void
+stats_collect_ctrs(size_t offset, size_t size)
+{
+  size_t i;
+  int core;
+
+  for (i = 0; i < size; i += sizeof(STAT_COUNTER)) {
+    STAT_COUNTER sum = 0;
+    for (core = 0; core < LWIP_STATS_CORES; core++) {
+      sum = (STAT_COUNTER)(sum + *(STAT_COUNTER *)((u8_t *)&lwip_stats_cores[core].s + offset + i));
+    }
+    *(STAT_COUNTER *)((u8_t *)&lwip_stats + offset + i) = sum;
+  }
+}
+
+#if MIB2_STATS
+static void
+stats_collect_mib2(void)
+{
+  size_t i;
+  int core;
+
+  for (i = 0; i < sizeof(struct stats_mib2) / sizeof(u32_t); i++) {
+    u32_t sum = 0;
+    for (core = 0; core < LWIP_STATS_CORES; core++) {
+      sum += ((u32_t *)&lwip_stats_cores[core].s.mib2)[i];
+    }
+    ((u32_t *)&lwip_stats.mib2)[i] = sum;
+  }
+}
+#endif /* MIB2_STATS */
+
+#define STATS_COLLECT(x) stats_collect_ctrs(offsetof(struct stats_, x), sizeof(lwip_stats.x))
+
+/**
+ * Sum the event counters of all cores into lwip_stats. Call this before
+ * reading them from lwip_stats directly; STATS_GET() and stats_display() do.
+ */
+void
+stats_collect(void)
+{
+#if LINK_STATS
+  STATS_COLLECT(link);
+#endif
+#if ETHARP_STATS
+  STATS_COLLECT(etharp);
+#endif
+#if IPFRAG_STATS
+  STATS_COLLECT(ip_frag);
+#endif
+#if IP_STATS
+  STATS_COLLECT(ip);
+#endif
+#if ICMP_STATS
+  STATS_COLLECT(icmp);
+#endif
+#if IGMP_STATS
+  STATS_COLLECT(igmp);
+#endif
+#if UDP_STATS
+  STATS_COLLECT(udp);
+#endif
+#if TCP_STATS
+  STATS_COLLECT(tcp);
+#endif
+#if IP6_STATS
+  STATS_COLLECT(ip6);
+#endif
+#if ICMP6_STATS
+  STATS_COLLECT(icmp6);
+#endif
+#if IP6_FRAG_STATS
+  STATS_COLLECT(ip6_frag);
+#endif
+#if MLD6_STATS
+  STATS_COLLECT(mld6);
+#endif
+#if ND6_STATS
+  STATS_COLLECT(nd6);
+#endif
+#if MIB2_STATS
+  stats_collect_mib2();
+#endif
+}
+#endif /* LWIP_STATS_CORES > 1 */
 
 void
 stats_init(void)
@@ -57,6 +150,12 @@ stats_init(void)
   lwip_stats.mem.name = "MEM";
 #endif /* MEM_STATS */
 #endif /* LWIP_DEBUG */
+#if LWIP_STATS_CORES > 1
+  LWIP_ASSERT("LWIP_STATS_CACHE_LINE must be a power of 2",
+              (LWIP_STATS_CACHE_LINE & (LWIP_STATS_CACHE_LINE - 1)) == 0);
+  lwip_stats_cores = (union stats_core *)(((mem_ptr_t)stats_cores_mem + LWIP_STATS_CACHE_LINE - 1) &
+                     ~(mem_ptr_t)(LWIP_STATS_CACHE_LINE - 1));
+#endif /* LWIP_STATS_CORES > 1 */
 }
 
 #if LWIP_STATS_DISPLAY
@@ -144,6 +243,7 @@ stats_display(void)
 {
   s16_t i;
 
+  stats_collect();
   LINK_STATS_DISPLAY();
   ETHARP_STATS_DISPLAY();
   IPFRAG_STATS_DISPLAY();
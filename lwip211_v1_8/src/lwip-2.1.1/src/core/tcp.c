@@ -108,9 +108,11 @@
 #include "lwip/priv/tcp_priv.h"
 #include "lwip/debug.h"
 #include "lwip/stats.h"
+#include "lwip/sys.h"
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
 #include "lwip/nd6.h"
+#include "lwip/timeouts.h"
 
 #include <string.h>
 
@@ -176,6 +178,10 @@ union tcp_listen_pcbs_t tcp_listen_pcbs;
 struct tcp_pcb *tcp_active_pcbs;
 /** List of all TCP PCBs in TIME-WAIT state */
 struct tcp_pcb *tcp_tw_pcbs;
+#if TCP_TW_COMPACT
+/** List of all compact TIME-WAIT records */
+struct tcp_tw *tcp_tw_records;
+#endif /* TCP_TW_COMPACT */
 
 /** An array with all (non-temporary) PCB lists, mainly used for smaller code size */
 struct tcp_pcb **const tcp_pcb_lists[] = {&tcp_listen_pcbs.pcbs, &tcp_bound_pcbs,
@@ -187,9 +193,16 @@ u8_t tcp_active_pcbs_changed;
 /** Timer counter to handle calling slow-timer from tcp_tmr() */
 static u8_t tcp_timer;
 static u8_t tcp_timer_ctr;
+#if TCP_TMR_COALESCE
+/** sys_now() at which tcp_ticks was last incremented */
+static u32_t tcp_ticks_time;
+#endif /* TCP_TMR_COALESCE */
 static u16_t tcp_new_port(void);
 
 static err_t tcp_close_shutdown_fin(struct tcp_pcb *pcb);
+#if TCP_TW_COMPACT
+static void tcp_tw_free(struct tcp_tw *tw, struct tcp_tw *prev);
+#endif /* TCP_TW_COMPACT */
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
 static void tcp_ext_arg_invoke_callbacks_destroyed(struct tcp_pcb_ext_args *ext_args);
 #endif
@@ -203,6 +216,9 @@ tcp_init(void)
 #ifdef LWIP_RAND
   tcp_port = TCP_ENSURE_LOCAL_PORT_RANGE(LWIP_RAND());
 #endif /* LWIP_RAND */
+#if TCP_TMR_COALESCE
+  tcp_ticks_time = sys_now();
+#endif /* TCP_TMR_COALESCE */
 }
 
 /** Free a tcp pcb */
@@ -362,6 +378,7 @@ tcp_close_shutdown(struct tcp_pcb *pcb, u8_t rst_on_unacked_data)
 
       tcp_pcb_purge(pcb);
       TCP_RMV_ACTIVE(pcb);
+      TCP_PCB_HASH_RMV(pcb);
       /* Deallocate the pcb since we already sent a RST for it */
       if (tcp_input_pcb == pcb) {
         /* prevent using a deallocated pcb: free it from tcp_input later */
@@ -449,6 +466,7 @@ tcp_close_shutdown_fin(struct tcp_pcb *pcb)
   } else if (err == ERR_MEM) {
     /* Mark this pcb for closing. Closing is retried from tcp_tmr. */
     tcp_set_flags(pcb, TF_CLOSEPEND);
+    TCP_TMR_NEEDED();
     /* We have to return ERR_OK from here to indicate to the callers that this
        pcb should not be used any more as it will be freed soon via tcp_tmr.
        This is OK here since sending FIN does not guarantee a time frime for
@@ -493,7 +511,15 @@ tcp_close(struct tcp_pcb *pcb)
   if (pcb->state != LISTEN) {
     /* Set a flag not to receive any more data... */
     tcp_set_flags(pcb, TF_RXCLOSED);
+    /* (starts the FIN-WAIT-2 timeout) */
+    TCP_TMR_NEEDED();
   }
+#if TCP_TW_COMPACT
+  /* (from within tcp_input, it compacts the pcb once done with it) */
+  if ((pcb->state == TIME_WAIT) && (pcb != tcp_input_pcb) && tcp_tw_compact(pcb)) {
+    return ERR_OK;
+  }
+#endif /* TCP_TW_COMPACT */
   /* ... and close */
   return tcp_close_shutdown(pcb, 1);
 }
@@ -524,6 +550,7 @@ tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx)
   if (shut_rx) {
     /* shut down the receive side: set a flag not to receive any more data... */
     tcp_set_flags(pcb, TF_RXCLOSED);
+    TCP_TMR_NEEDED();
     if (shut_tx) {
       /* shutting down the tx AND rx side is the same as closing for the raw API */
       return tcp_close_shutdown(pcb, 1);
@@ -734,6 +761,20 @@ tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
         }
       }
     }
+#if TCP_TW_COMPACT
+    if (max_pcb_list == NUM_TCP_PCB_LISTS) {
+      struct tcp_tw *tw;
+      for (tw = tcp_tw_records; tw != NULL; tw = tw->next) {
+        if ((tw->local_port == port) &&
+            (IP_IS_V6(ipaddr) == IP_IS_V6_VAL(tw->local_ip)) &&
+            (ip_addr_isany(&tw->local_ip) ||
+             ip_addr_isany(ipaddr) ||
+             ip_addr_cmp(&tw->local_ip, ipaddr))) {
+          return ERR_USE;
+        }
+      }
+    }
+#endif /* TCP_TW_COMPACT */
   }
 
   if (!ip_addr_isany(ipaddr)
@@ -911,6 +952,9 @@ tcp_listen_with_backlog_and_err(struct tcp_pcb *pcb, u8_t backlog, err_t *err)
   lpcb->accepts_pending = 0;
   tcp_backlog_set(lpcb, backlog);
 #endif /* TCP_LISTEN_BACKLOG */
+#if LWIP_TCP_FASTOPEN
+  lpcb->fastopen = 0;
+#endif /* LWIP_TCP_FASTOPEN */
   TCP_REG(&tcp_listen_pcbs.pcbs, (struct tcp_pcb *)lpcb);
   res = ERR_OK;
 done:
@@ -992,8 +1036,9 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
   } else if (rcv_wnd <= TCP_WND_MAX(pcb)) {
     pcb->rcv_wnd = rcv_wnd;
   } else {
+    /* the netconn API also acknowledges the FIN that tcp_input credited */
     LWIP_ASSERT("tcp_recved: len overflowed TCP_WND_MAX",
-		rcv_wnd <= TCP_WND_MAX(pcb));
+		TCP_STATE_IS_CLOSING(pcb->state) && (len == 1));
     pcb->rcv_wnd = TCP_WND_MAX(pcb);
   }
 
@@ -1004,6 +1049,14 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
    * Otherwise wait for a packet to be sent in the normal course of
    * events (or more window to be available later) */
   if (wnd_inflation >= TCP_WND_UPDATE_THRESHOLD) {
+#if TCP_ACK_STRETCH
+    /* A stretched ACK is due shortly: let it carry the update unless the
+       window the peer has left is getting short. */
+    if ((pcb->flags & TF_ACK_DELAY) && (pcb->ack_pend_segs > 1) &&
+        ((u32_t)(pcb->rcv_ann_right_edge - pcb->rcv_nxt) > TCP_WND_MAX(pcb) / 2)) {
+      return;
+    }
+#endif /* TCP_ACK_STRETCH */
     tcp_ack_now(pcb);
     tcp_output(pcb);
   }
@@ -1041,6 +1094,20 @@ again:
       }
     }
   }
+#if TCP_TW_COMPACT
+  {
+    struct tcp_tw *tw;
+    for (tw = tcp_tw_records; tw != NULL; tw = tw->next) {
+      if (tw->local_port == tcp_port) {
+        n++;
+        if (n > (TCP_LOCAL_PORT_RANGE_END - TCP_LOCAL_PORT_RANGE_START)) {
+          return 0;
+        }
+        goto again;
+      }
+    }
+  }
+#endif /* TCP_TW_COMPACT */
   return tcp_port;
 }
 
@@ -1097,7 +1164,7 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
     netif = netif_get_by_index(pcb->netif_idx);
   } else {
     /* check if we have a route to the remote host */
-    netif = ip_route(&pcb->local_ip, &pcb->remote_ip);
+    netif = ip_route_hinted(&pcb->local_ip, &pcb->remote_ip, &pcb->route_hint);
   }
   if (netif == NULL) {
     /* Don't even try to send a SYN packet if we have no route since that will fail. */
@@ -1147,6 +1214,11 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
           }
         }
       }
+#if TCP_TW_COMPACT
+      if (tcp_tw_lookup(&pcb->local_ip, pcb->local_port, ipaddr, port, pcb->netif_idx) != NULL) {
+        return ERR_USE;
+      }
+#endif /* TCP_TW_COMPACT */
     }
 #endif /* SO_REUSE */
   }
@@ -1209,7 +1281,11 @@ tcp_slowtmr(void)
 
   err = ERR_OK;
 
+#if TCP_TMR_COALESCE
+  tcp_update_ticks();
+#else /* TCP_TMR_COALESCE */
   ++tcp_ticks;
+#endif /* TCP_TMR_COALESCE */
   ++tcp_timer_ctr;
 
 tcp_slowtmr_start:
@@ -1303,10 +1379,17 @@ tcp_slowtmr_start:
             pcb->rtime = 0;
 
             /* Reduce congestion window and ssthresh. */
-            eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
-            pcb->ssthresh = eff_wnd >> 1;
-            if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
-              pcb->ssthresh = (tcpwnd_size_t)(pcb->mss << 1);
+#if LWIP_TCP_CC
+            if (pcb->cc != NULL) {
+              pcb->cc->loss(pcb, 1);
+            } else
+#endif /* LWIP_TCP_CC */
+            {
+              eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
+              pcb->ssthresh = eff_wnd >> 1;
+              if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
+                pcb->ssthresh = (tcpwnd_size_t)(pcb->mss << 1);
+              }
             }
             pcb->cwnd = pcb->mss;
             LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
@@ -1403,6 +1486,7 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_active_pcbs", tcp_active_pcbs == pcb);
         tcp_active_pcbs = pcb->next;
       }
+      TCP_PCB_HASH_RMV(pcb);
 
       if (pcb_reset) {
         tcp_rst(pcb, pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
@@ -1469,6 +1553,7 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_tw_pcbs", tcp_tw_pcbs == pcb);
         tcp_tw_pcbs = pcb->next;
       }
+      TCP_PCB_HASH_RMV(pcb);
       pcb2 = pcb;
       pcb = pcb->next;
       tcp_free(pcb2);
@@ -1477,6 +1562,22 @@ tcp_slowtmr_start:
       pcb = pcb->next;
     }
   }
+
+#if TCP_TW_COMPACT
+  /* Steps through all of the compact TIME-WAIT records. */
+  {
+    struct tcp_tw *tw = tcp_tw_records, *tw_prev = NULL;
+    while (tw != NULL) {
+      struct tcp_tw *tw_next = tw->next;
+      if ((u32_t)(tcp_ticks - tw->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+        tcp_tw_free(tw, tw_prev);
+      } else {
+        tw_prev = tw;
+      }
+      tw = tw_next;
+    }
+  }
+#endif /* TCP_TW_COMPACT */
 }
 
 /**
@@ -1531,6 +1632,184 @@ tcp_fasttmr_start:
   }
 }
 
+#if TCP_ACK_STRETCH && TCP_ACK_STRETCH_DELAY && LWIP_TIMERS
+static u8_t tcp_ack_stretch_armed;
+
+/** Send the ACKs that have been stretched beyond the classic two segments */
+static void
+tcp_ack_stretch_timeout(void *arg)
+{
+  struct tcp_pcb *pcb;
+  LWIP_UNUSED_ARG(arg);
+
+  tcp_ack_stretch_armed = 0;
+  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+    if ((pcb->flags & TF_ACK_DELAY) && (pcb->ack_pend_segs > 1)) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_ack_stretch_timeout: stretched ACK\n"));
+      tcp_ack_now(pcb);
+      tcp_output(pcb);
+    }
+  }
+}
+
+/**
+ * Called by tcp_receive() when it holds back an ACK the classic delayed ACK
+ * would have sent: bounds the delay to TCP_ACK_STRETCH_DELAY.
+ */
+void
+tcp_ack_stretch_arm(void)
+{
+  if (!tcp_ack_stretch_armed) {
+    tcp_ack_stretch_armed = 1;
+    sys_timeout(TCP_ACK_STRETCH_DELAY, tcp_ack_stretch_timeout, NULL);
+  }
+}
+#endif /* TCP_ACK_STRETCH && TCP_ACK_STRETCH_DELAY && LWIP_TIMERS */
+
+#if TCP_ACK_STRETCH
+/**
+ * @ingroup tcp_raw
+ * Send one ACK per 'segs' received segments or 'bytes' received bytes
+ * (0: no byte limit) on this pcb, whatever the netif is set to.
+ * segs == 0 goes back to the limits of the netif the data arrives on.
+ *
+ * @param pcb tcp_pcb to change
+ * @param segs segments per ACK (2: classic delayed ACK)
+ * @param bytes bytes per ACK
+ */
+void
+tcp_set_ack_stretch(struct tcp_pcb *pcb, u8_t segs, u32_t bytes)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_set_ack_stretch: invalid pcb", pcb != NULL, return);
+  LWIP_ERROR("tcp_set_ack_stretch: called on listen-pcb", pcb->state != LISTEN, return);
+
+  pcb->ack_stretch_segs = segs;
+  pcb->ack_stretch_bytes = bytes;
+}
+#endif /* TCP_ACK_STRETCH */
+
+#if LWIP_TCP_FASTOPEN
+/**
+ * @ingroup tcp_raw
+ * Enable or disable TCP Fast Open on a listening pcb: hand out cookies to
+ * clients asking for one and accept the data of SYNs that carry a valid
+ * cookie. Such a connection is passed to the accept callback while still in
+ * SYN_RCVD, and its data to the recv callback, before the client has
+ * acknowledged the SYN|ACK.
+ *
+ * @param pcb listening tcp_pcb
+ * @param enable 1 to enable, 0 to disable
+ */
+void
+tcp_fastopen(struct tcp_pcb *pcb, u8_t enable)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_fastopen: invalid pcb", pcb != NULL, return);
+  LWIP_ERROR("tcp_fastopen: not a listen-pcb", pcb->state == LISTEN, return);
+
+  ((struct tcp_pcb_listen *)pcb)->fastopen = enable;
+}
+#endif /* LWIP_TCP_FASTOPEN */
+
+#if TCP_TMR_COALESCE
+/**
+ * Advance tcp_ticks to sys_now(). With TCP_TMR_COALESCE, tcp_slowtmr() is not
+ * called at fixed intervals, so tcp_ticks is kept from the clock instead and
+ * brought up to date before it is read.
+ */
+void
+tcp_update_ticks(void)
+{
+  u32_t ticks = (sys_now() - tcp_ticks_time) / TCP_SLOW_INTERVAL;
+
+  tcp_ticks += ticks;
+  tcp_ticks_time += ticks * TCP_SLOW_INTERVAL;
+}
+
+/** Ticks until tcp_slowtmr() acts on a pcb for having been idle longer than
+ * 'timeout' ticks (tcp_ticks - pcb->tmr > timeout) */
+static u32_t
+tcp_idle_ticks_left(u32_t tmr, u32_t timeout)
+{
+  s32_t left = (s32_t)(tmr + timeout + 1 - tcp_ticks);
+
+  return (left > 0) ? (u32_t)left : 1;
+}
+
+/**
+ * Returns the time in ms after which tcp_tmr() has to be called next:
+ * TCP_TMR_INTERVAL while a pcb has work for tcp_fasttmr() or a timer counted
+ * in tcp_slowtmr() calls (retransmission, persist, poll), otherwise the time
+ * to the first timeout counted from pcb->tmr, or 0 if there is nothing to do.
+ * In the latter case the next tcp_tmr() runs tcp_slowtmr().
+ */
+u32_t
+tcp_tmr_next(void)
+{
+  struct tcp_pcb *pcb;
+  u32_t ticks = LWIP_UINT32_MAX;
+
+  tcp_update_ticks();
+
+  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+    if ((pcb->flags & (TF_ACK_DELAY | TF_CLOSEPEND)) || (pcb->refused_data != NULL) ||
+        (pcb->rtime >= 0) || (pcb->persist_backoff > 0) ||
+#if LWIP_CALLBACK_API
+        (pcb->poll != NULL)
+#else /* LWIP_CALLBACK_API */
+        1 /* LWIP_EVENT_POLL is always sent */
+#endif /* LWIP_CALLBACK_API */
+       ) {
+      return TCP_TMR_INTERVAL;
+    }
+    if ((pcb->state == FIN_WAIT_2) && (pcb->flags & TF_RXCLOSED)) {
+      ticks = LWIP_MIN(ticks, tcp_idle_ticks_left(pcb->tmr, TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL));
+    }
+    if (ip_get_option(pcb, SOF_KEEPALIVE) &&
+        ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT))) {
+      ticks = LWIP_MIN(ticks, tcp_idle_ticks_left(pcb->tmr,
+                       LWIP_MIN(pcb->keep_idle + TCP_KEEP_DUR(pcb),
+                                pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
+                       / TCP_SLOW_INTERVAL));
+    }
+#if TCP_QUEUE_OOSEQ
+    if (pcb->ooseq != NULL) {
+      ticks = LWIP_MIN(ticks, tcp_idle_ticks_left(pcb->tmr, (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT - 1));
+    }
+#endif /* TCP_QUEUE_OOSEQ */
+    if (pcb->state == SYN_RCVD) {
+      ticks = LWIP_MIN(ticks, tcp_idle_ticks_left(pcb->tmr, TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL));
+    }
+    if (pcb->state == LAST_ACK) {
+      ticks = LWIP_MIN(ticks, tcp_idle_ticks_left(pcb->tmr, 2 * TCP_MSL / TCP_SLOW_INTERVAL));
+    }
+  }
+  for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
+    ticks = LWIP_MIN(ticks, tcp_idle_ticks_left(pcb->tmr, 2 * TCP_MSL / TCP_SLOW_INTERVAL));
+  }
+#if TCP_TW_COMPACT
+  {
+    struct tcp_tw *tw;
+    for (tw = tcp_tw_records; tw != NULL; tw = tw->next) {
+      ticks = LWIP_MIN(ticks, tcp_idle_ticks_left(tw->tmr, 2 * TCP_MSL / TCP_SLOW_INTERVAL));
+    }
+  }
+#endif /* TCP_TW_COMPACT */
+
+  if (ticks == LWIP_UINT32_MAX) {
+    return 0;
+  }
+  /* let the tcp_tmr() at the deadline call tcp_slowtmr() */
+  tcp_timer = (u8_t)(tcp_timer & ~1);
+  /* stay well within LWIP_MAX_TIMEOUT (a keepalive may be days away) */
+  ticks = LWIP_MIN(ticks, 0x100000UL);
+  return tcp_ticks_time + ticks * TCP_SLOW_INTERVAL - sys_now();
+}
+#endif /* TCP_TMR_COALESCE */
+
 /** Call tcp_output for all active pcbs that have TF_NAGLEMEMERR set */
 void
 tcp_txnow(void)
@@ -1633,6 +1912,13 @@ void
 tcp_seg_free(struct tcp_seg *seg)
 {
   if (seg != NULL) {
+#if TCP_SEG_IN_PBUF
+    if (seg->flags & TF_SEG_IN_PBUF) {
+      /* seg is gone with its pbuf (or when the netif lets go of it) */
+      pbuf_free(seg->p);
+      return;
+    }
+#endif /* TCP_SEG_IN_PBUF */
     if (seg->p != NULL) {
       pbuf_free(seg->p);
 #if TCP_DEBUG
@@ -1680,6 +1966,9 @@ tcp_seg_copy(struct tcp_seg *seg)
     return NULL;
   }
   SMEMCPY((u8_t *)cseg, (const u8_t *)seg, sizeof(struct tcp_seg));
+#if TCP_SEG_IN_PBUF
+  cseg->flags &= (u8_t)~TF_SEG_IN_PBUF;
+#endif /* TCP_SEG_IN_PBUF */
   pbuf_ref(cseg->p);
   return cseg;
 }
@@ -1911,6 +2200,9 @@ tcp_alloc(u8_t prio)
     pcb->sv = 3000 / TCP_SLOW_INTERVAL;
     pcb->rtime = -1;
     pcb->cwnd = 1;
+#if TCP_TMR_COALESCE
+    tcp_update_ticks();
+#endif /* TCP_TMR_COALESCE */
     pcb->tmr = tcp_ticks;
     pcb->last_timer = tcp_timer_ctr;
 
@@ -2125,6 +2417,7 @@ tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
   LWIP_UNUSED_ARG(poll);
 #endif /* LWIP_CALLBACK_API */
   pcb->pollinterval = interval;
+  TCP_TMR_NEEDED();
 }
 
 /**
@@ -2190,6 +2483,11 @@ tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
   LWIP_ASSERT("tcp_pcb_remove: invalid pcblist", pcblist != NULL);
 
   TCP_RMV(pcblist, pcb);
+#if TCP_PCB_HASH
+  if ((pcblist == &tcp_active_pcbs) || (pcblist == &tcp_tw_pcbs)) {
+    tcp_pcb_hash_remove(pcb);
+  }
+#endif /* TCP_PCB_HASH */
 
   tcp_pcb_purge(pcb);
 
@@ -2216,6 +2514,248 @@ tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
   LWIP_ASSERT("tcp_pcb_remove: tcp_pcbs_sane()", tcp_pcbs_sane());
 }
 
+#if TCP_PCB_HASH || TCP_TW_COMPACT
+static u32_t
+tcp_pcb_hash_ip(const ip_addr_t *ip)
+{
+#if LWIP_IPV6
+  if (IP_IS_V6(ip)) {
+    const u32_t *a = ip_2_ip6(ip)->addr;
+    return a[0] ^ a[1] ^ a[2] ^ a[3];
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  return ip4_addr_get_u32(ip_2_ip4(ip));
+#else
+  return 0;
+#endif /* LWIP_IPV4 */
+}
+
+/** Hash of a connection's 4-tuple, for TCP_PCB_HASH and TCP_TW_COMPACT */
+static u32_t
+tcp_4tuple_hash(const ip_addr_t *local_ip, u16_t local_port,
+                const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t h = tcp_pcb_hash_ip(local_ip) ^ tcp_pcb_hash_ip(remote_ip) ^
+            (((u32_t)local_port << 16) | remote_port);
+  h ^= h >> 16;
+  h *= 0x45d9f3bUL;
+  h ^= h >> 16;
+  return h;
+}
+#endif /* TCP_PCB_HASH || TCP_TW_COMPACT */
+
+#if TCP_PCB_HASH
+static struct tcp_pcb *tcp_pcb_hash[TCP_PCB_HASH_SIZE];
+
+static struct tcp_pcb **
+tcp_pcb_hash_bucket(const ip_addr_t *local_ip, u16_t local_port,
+                    const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t h = tcp_4tuple_hash(local_ip, local_port, remote_ip, remote_port);
+  return &tcp_pcb_hash[h & (TCP_PCB_HASH_SIZE - 1)];
+}
+
+/** Add an active pcb to the hash table. Its addresses and ports must not change
+ * until it is removed again. */
+void
+tcp_pcb_hash_add(struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **bucket = tcp_pcb_hash_bucket(&pcb->local_ip, pcb->local_port,
+                                                &pcb->remote_ip, pcb->remote_port);
+  pcb->hash_next = *bucket;
+  *bucket = pcb;
+}
+
+/** Remove a pcb from the hash table (if it is in it) */
+void
+tcp_pcb_hash_remove(struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **p = tcp_pcb_hash_bucket(&pcb->local_ip, pcb->local_port,
+                                           &pcb->remote_ip, pcb->remote_port);
+  for (; *p != NULL; p = &(*p)->hash_next) {
+    if (*p == pcb) {
+      *p = pcb->hash_next;
+      break;
+    }
+  }
+  pcb->hash_next = NULL;
+}
+
+/**
+ * Find the active or TIME-WAIT pcb of a connection. The match is moved to the
+ * front of its bucket, since the next segment is likely for the same connection.
+ *
+ * @param netif_idx index of the netif the segment came in on
+ * @return the pcb or NULL
+ */
+struct tcp_pcb *
+tcp_pcb_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                    const ip_addr_t *remote_ip, u16_t remote_port,
+                    u8_t netif_idx)
+{
+  struct tcp_pcb **bucket = tcp_pcb_hash_bucket(local_ip, local_port, remote_ip, remote_port);
+  struct tcp_pcb *pcb, *prev = NULL;
+
+  for (pcb = *bucket; pcb != NULL; prev = pcb, pcb = pcb->hash_next) {
+    LWIP_ASSERT("tcp_pcb_hash_lookup: pcb->state != CLOSED", pcb->state != CLOSED);
+    LWIP_ASSERT("tcp_pcb_hash_lookup: pcb->state != LISTEN", pcb->state != LISTEN);
+
+    /* check if PCB is bound to specific netif */
+    if ((pcb->netif_idx != NETIF_NO_INDEX) && (pcb->netif_idx != netif_idx)) {
+      continue;
+    }
+    if (pcb->remote_port == remote_port &&
+        pcb->local_port == local_port &&
+        ip_addr_cmp(&pcb->remote_ip, remote_ip) &&
+        ip_addr_cmp(&pcb->local_ip, local_ip)) {
+      if (prev != NULL) {
+        prev->hash_next = pcb->hash_next;
+        pcb->hash_next = *bucket;
+        *bucket = pcb;
+      } else {
+        TCP_STATS_INC(tcp.cachehit);
+      }
+      return pcb;
+    }
+  }
+  return NULL;
+}
+#endif /* TCP_PCB_HASH */
+
+#if TCP_TW_COMPACT
+static struct tcp_tw *tcp_tw_hash[TCP_TW_HASH_SIZE];
+
+static struct tcp_tw **
+tcp_tw_hash_bucket(const ip_addr_t *local_ip, u16_t local_port,
+                   const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t h = tcp_4tuple_hash(local_ip, local_port, remote_ip, remote_port);
+  return &tcp_tw_hash[h & (TCP_TW_HASH_SIZE - 1)];
+}
+
+/** Unlink a record from tcp_tw_records (prev is its predecessor there, or
+ * NULL) and from its hash bucket, and free it */
+static void
+tcp_tw_free(struct tcp_tw *tw, struct tcp_tw *prev)
+{
+  struct tcp_tw **p = tcp_tw_hash_bucket(&tw->local_ip, tw->local_port,
+                                         &tw->remote_ip, tw->remote_port);
+  for (; *p != NULL; p = &(*p)->hash_next) {
+    if (*p == tw) {
+      *p = tw->hash_next;
+      break;
+    }
+  }
+  if (prev != NULL) {
+    prev->next = tw->next;
+  } else {
+    LWIP_ASSERT("tcp_tw_free: first record", tcp_tw_records == tw);
+    tcp_tw_records = tw->next;
+  }
+  memp_free(MEMP_TCP_TW, tw);
+}
+
+/** Drop the oldest record to make room for a new one */
+static void
+tcp_tw_kill_oldest(void)
+{
+  struct tcp_tw *tw, *prev, *oldest = NULL, *oldest_prev = NULL;
+  u32_t inactivity = 0;
+
+  for (prev = NULL, tw = tcp_tw_records; tw != NULL; prev = tw, tw = tw->next) {
+    if ((u32_t)(tcp_ticks - tw->tmr) >= inactivity) {
+      inactivity = tcp_ticks - tw->tmr;
+      oldest = tw;
+      oldest_prev = prev;
+    }
+  }
+  if (oldest != NULL) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_tw_kill_oldest: dropping TIME-WAIT record %p (%"U32_F")\n",
+                            (void *)oldest, inactivity));
+    tcp_tw_free(oldest, oldest_prev);
+  }
+}
+
+/**
+ * Replace a TIME-WAIT pcb by a compact record and free the pcb, unless the
+ * application may still reference it (TF_RXCLOSED not set), it has refused
+ * data or uses timestamps (which a record does not keep).
+ *
+ * @return 1 if the pcb has been freed, 0 if it stays in tcp_tw_pcbs
+ */
+u8_t
+tcp_tw_compact(struct tcp_pcb *pcb)
+{
+  struct tcp_tw *tw, **bucket;
+
+  LWIP_ASSERT("tcp_tw_compact: pcb->state == TIME-WAIT", pcb->state == TIME_WAIT);
+
+  if (!(pcb->flags & TF_RXCLOSED) || (pcb->refused_data != NULL)
+#if LWIP_TCP_TIMESTAMPS
+      || (pcb->flags & TF_TIMESTAMP)
+#endif /* LWIP_TCP_TIMESTAMPS */
+     ) {
+    return 0;
+  }
+  tw = (struct tcp_tw *)memp_malloc(MEMP_TCP_TW);
+  if (tw == NULL) {
+    tcp_tw_kill_oldest();
+    tw = (struct tcp_tw *)memp_malloc(MEMP_TCP_TW);
+    if (tw == NULL) {
+      return 0;
+    }
+  }
+  ip_addr_copy(tw->local_ip, pcb->local_ip);
+  ip_addr_copy(tw->remote_ip, pcb->remote_ip);
+  tw->local_port = pcb->local_port;
+  tw->remote_port = pcb->remote_port;
+  tw->snd_nxt = pcb->snd_nxt;
+  tw->rcv_nxt = pcb->rcv_nxt;
+  tw->rcv_wnd = pcb->rcv_wnd;
+  tw->tmr = pcb->tmr;
+  tw->wnd = (u16_t)RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd);
+  tw->netif_idx = pcb->netif_idx;
+
+  bucket = tcp_tw_hash_bucket(&tw->local_ip, tw->local_port, &tw->remote_ip, tw->remote_port);
+  tw->hash_next = *bucket;
+  *bucket = tw;
+  tw->next = tcp_tw_records;
+  tcp_tw_records = tw;
+
+  tcp_pcb_remove(&tcp_tw_pcbs, pcb);
+  tcp_free(pcb);
+  tcp_timer_needed();
+  return 1;
+}
+
+/**
+ * Find the compact TIME-WAIT record of a connection.
+ *
+ * @param netif_idx index of the netif the segment came in on
+ * @return the record or NULL
+ */
+struct tcp_tw *
+tcp_tw_lookup(const ip_addr_t *local_ip, u16_t local_port,
+              const ip_addr_t *remote_ip, u16_t remote_port,
+              u8_t netif_idx)
+{
+  struct tcp_tw *tw;
+
+  for (tw = *tcp_tw_hash_bucket(local_ip, local_port, remote_ip, remote_port);
+       tw != NULL; tw = tw->hash_next) {
+    if (((tw->netif_idx == NETIF_NO_INDEX) || (tw->netif_idx == netif_idx)) &&
+        tw->remote_port == remote_port &&
+        tw->local_port == local_port &&
+        ip_addr_cmp(&tw->remote_ip, remote_ip) &&
+        ip_addr_cmp(&tw->local_ip, local_ip)) {
+      return tw;
+    }
+  }
+  return NULL;
+}
+#endif /* TCP_TW_COMPACT */
+
 /**
  * Calculates a new initial sequence number for new connections.
  *
@@ -2403,6 +2943,74 @@ tcp_free_ooseq(struct tcp_pcb *pcb)
 #endif /* LWIP_TCP_SACK_OUT */
   }
 }
+
+/**
+ * Free the highest interval on ooseq only. The data furthest away from
+ * rcv_nxt is the least likely to be delivered soon, so this reclaims pool
+ * pbufs without throwing away what the holes below it are waiting for.
+ */
+void
+tcp_free_ooseq_tail(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg, *prev = NULL;
+
+  if (pcb->ooseq == NULL) {
+    return;
+  }
+  for (seg = pcb->ooseq; seg->next != NULL; seg = seg->next) {
+    prev = seg;
+  }
+  if (prev == NULL) {
+    tcp_free_ooseq(pcb);
+    return;
+  }
+#if LWIP_TCP_SACK_OUT
+  tcp_remove_sacks_gt(pcb, seg->tcphdr->seqno);
+#endif /* LWIP_TCP_SACK_OUT */
+  prev->next = NULL;
+  tcp_seg_free(seg);
+}
+
+#if LWIP_TCP_SACK_OUT
+/**
+ * Called to remove a range of SACKs.
+ *
+ * SACK entries will be removed or adjusted to not acknowledge any sequence
+ * numbers that are greater than (or equal to) 'seq' passed. It not only invalidates entries,
+ * but also moves all entries that are still valid to the beginning.
+ *
+ * @param pcb the tcp_pcb to modify
+ * @param seq the highest sequence number to keep in SACK entries
+ */
+void
+tcp_remove_sacks_gt(struct tcp_pcb *pcb, u32_t seq)
+{
+  u8_t i;
+  u8_t unused_idx;
+
+  /* We run this loop for all entries, until we find the first invalid one.
+     There is no point checking after that. */
+  for (i = unused_idx = 0; (i < LWIP_TCP_MAX_SACK_NUM) && LWIP_TCP_SACK_VALID(pcb, i); ++i) {
+    /* We only want to use SACK at index [i] if its left side is < 'seq'. */
+    if (TCP_SEQ_LT(pcb->rcv_sacks[i].left, seq)) {
+      if (unused_idx != i) {
+        /* We only copy it if it's not in the right spot already. */
+        pcb->rcv_sacks[unused_idx] = pcb->rcv_sacks[i];
+      }
+      /* NOTE: It is possible that its right side is > 'seq', in which case we should adjust it. */
+      if (TCP_SEQ_GT(pcb->rcv_sacks[unused_idx].right, seq)) {
+        pcb->rcv_sacks[unused_idx].right = seq;
+      }
+      ++unused_idx;
+    }
+  }
+
+  /* We also need to invalidate everything from 'unused_idx' till the end */
+  for (i = unused_idx; i < LWIP_TCP_MAX_SACK_NUM; ++i) {
+    pcb->rcv_sacks[i].left = pcb->rcv_sacks[i].right = 0;
+  }
+}
+#endif /* LWIP_TCP_SACK_OUT */
 #endif /* TCP_QUEUE_OOSEQ */
 
 #if TCP_DEBUG || TCP_INPUT_DEBUG || TCP_OUTPUT_DEBUG
@@ -2518,6 +3126,15 @@ tcp_debug_print_pcbs(void)
                             pcb->snd_nxt, pcb->rcv_nxt));
     tcp_debug_print_state(pcb->state);
   }
+#if TCP_TW_COMPACT
+  {
+    struct tcp_tw *tw;
+    for (tw = tcp_tw_records; tw != NULL; tw = tw->next) {
+      LWIP_DEBUGF(TCP_DEBUG, ("Local port %"U16_F", foreign port %"U16_F" snd_nxt %"U32_F" rcv_nxt %"U32_F" (compact)\n",
+                              tw->local_port, tw->remote_port, tw->snd_nxt, tw->rcv_nxt));
+    }
+  }
+#endif /* TCP_TW_COMPACT */
 }
 
 /**
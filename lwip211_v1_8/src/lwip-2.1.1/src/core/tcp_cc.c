@@ -0,0 +1,234 @@
+/**
+ * @file
+ * Transmission Control Protocol, congestion control
+ *
+ * Alternatives to the built-in Reno congestion control, selected per pcb
+ * with tcp_set_cc(). tcp_receive() passes them the bytes acked outside of
+ * fast recovery; tcp_rexmit_fast() and tcp_slowtmr() ask them for ssthresh
+ * when they detect a loss and then set cwnd as they do for Reno.
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_CC /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/sys.h"
+
+#define TCP_CC_WND_MAX  ((u32_t)(tcpwnd_size_t)-1)
+#define TCP_CC_WND(w)   ((tcpwnd_size_t)LWIP_MIN((u32_t)(w), TCP_CC_WND_MAX))
+
+/* CUBIC (RFC 8312) with beta 0.7 and C 0.4 MSS/s^3. With time in ms,
+ * C * t^3 [MSS] is t^3 * mss / 2.5e9 bytes, and K = cbrt((W_max - cwnd) [MSS] * 2.5e9). */
+#define TCP_CC_CUBIC_BETA(w)      ((u32_t)(((u64_t)(w) * 7) / 10))
+#define TCP_CC_CUBIC_CONVERGE(w)  ((u32_t)(((u64_t)(w) * 17) / 20))
+#define TCP_CC_CUBIC_SCALE        2500000000LL
+/* |t - K| in ms is clamped to keep (t - K)^3 * mss within 64 bits */
+#define TCP_CC_CUBIC_T_MAX        30000
+/* the Reno estimate grows by 3 * (1 - beta) / (1 + beta) MSS per window acked */
+#define TCP_CC_CUBIC_RENO_NUM     529
+#define TCP_CC_CUBIC_RENO_DEN     1000
+
+/** RFC 3465 slow start, as tcp_receive() does it for Reno */
+static void
+tcp_cc_slow_start(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  tcpwnd_size_t increase;
+  /* limit to 1 SMSS segment during period following RTO */
+  u8_t num_seg = (pcb->flags & TF_RTO) ? 1 : 2;
+
+  increase = LWIP_MIN(acked, (tcpwnd_size_t)(num_seg * pcb->mss));
+  TCP_WND_INC(pcb->cwnd, increase);
+}
+
+/** Integer cube root, rounded down */
+static u32_t
+tcp_cc_cbrt(u64_t a)
+{
+  u64_t y = 0;
+  u64_t b;
+  int s;
+
+  for (s = 63; s >= 0; s -= 3) {
+    y <<= 1;
+    b = 3 * y * (y + 1) + 1;
+    if ((a >> s) >= b) {
+      a -= b << s;
+      y++;
+    }
+  }
+  return (u32_t)y;
+}
+
+static void
+tcp_cc_cubic_acked(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  u32_t now, cwnd, target, cnt, n;
+  s32_t t;
+  s64_t w;
+
+  if (pcb->cwnd < pcb->ssthresh) {
+    tcp_cc_slow_start(pcb, acked);
+    return;
+  }
+
+  now = sys_now();
+  cwnd = pcb->cwnd;
+  if (pcb->cc_epoch == 0) {
+    /* first ack in congestion avoidance since the last loss */
+    pcb->cc_epoch = (now != 0) ? now : 1;
+    pcb->cc_west = pcb->cwnd;
+    pcb->bytes_acked = 0;
+    if (cwnd < pcb->cc_wmax) {
+      pcb->cc_k = tcp_cc_cbrt((u64_t)(pcb->cc_wmax - cwnd) * TCP_CC_CUBIC_SCALE / pcb->mss);
+      pcb->cc_origin = pcb->cc_wmax;
+    } else {
+      pcb->cc_k = 0;
+      pcb->cc_origin = pcb->cwnd;
+    }
+  }
+
+  /* W_cubic(t) = C * (t - K)^3 + W_max */
+  t = (s32_t)(now - pcb->cc_epoch) - (s32_t)pcb->cc_k;
+  t = LWIP_MAX(LWIP_MIN(t, TCP_CC_CUBIC_T_MAX), -TCP_CC_CUBIC_T_MAX);
+  w = (s64_t)t * t * t * pcb->mss / TCP_CC_CUBIC_SCALE + pcb->cc_origin;
+  target = (u32_t)LWIP_MIN(LWIP_MAX(w, 0), (s64_t)TCP_CC_WND_MAX);
+
+  /* bytes to be acked per MSS of cwnd growth */
+  if (target > cwnd) {
+    cnt = (u32_t)LWIP_MIN((u64_t)cwnd * pcb->mss / (target - cwnd), 0xFFFFFFFFUL);
+  } else {
+    /* on the plateau: probe very slowly */
+    cnt = (u32_t)LWIP_MIN((u64_t)cwnd * 100, 0xFFFFFFFFUL);
+  }
+
+  /* TCP-friendly region: never grow slower than Reno would */
+  pcb->cc_west = TCP_CC_WND(pcb->cc_west + (u32_t)((u64_t)acked * pcb->mss * TCP_CC_CUBIC_RENO_NUM /
+                                                   ((u64_t)cwnd * TCP_CC_CUBIC_RENO_DEN)));
+  if (pcb->cc_west > cwnd) {
+    cnt = LWIP_MIN(cnt, (u32_t)((u64_t)cwnd * pcb->mss / (pcb->cc_west - cwnd)));
+  }
+
+  /* at most 1.5 * cwnd per RTT */
+  cnt = LWIP_MAX(cnt, 2U * pcb->mss);
+
+  TCP_WND_INC(pcb->bytes_acked, acked);
+  if (pcb->bytes_acked >= cnt) {
+    n = pcb->bytes_acked / cnt;
+    pcb->bytes_acked = (tcpwnd_size_t)(pcb->bytes_acked - n * cnt);
+    TCP_WND_INC(pcb->cwnd, TCP_CC_WND(n * pcb->mss));
+  }
+  LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_cc_cubic_acked: cwnd %"TCPWNDSIZE_F" target %"U32_F"\n",
+                               pcb->cwnd, target));
+}
+
+static void
+tcp_cc_cubic_loss(struct tcp_pcb *pcb, u8_t timeout)
+{
+  u32_t wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
+
+  LWIP_UNUSED_ARG(timeout);
+
+  /* fast convergence: a flow losing below its last W_max leaves room for new ones */
+  if (wnd < pcb->cc_wmax) {
+    pcb->cc_wmax = TCP_CC_WND(TCP_CC_CUBIC_CONVERGE(wnd));
+  } else {
+    pcb->cc_wmax = TCP_CC_WND(wnd);
+  }
+  pcb->ssthresh = TCP_CC_WND(LWIP_MAX(TCP_CC_CUBIC_BETA(wnd), 2U * pcb->mss));
+  pcb->cc_epoch = 0;
+}
+
+/** @ingroup tcp_raw
+ * CUBIC (RFC 8312): grows cwnd with the time since the last loss rather than
+ * with the RTT, which fills long fat pipes much faster than Reno. */
+const struct tcp_cc_ops tcp_cc_cubic = {
+  "cubic",
+  tcp_cc_cubic_acked,
+  tcp_cc_cubic_loss
+};
+
+static void
+tcp_cc_local_acked(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  /* nothing to probe for: keep cwnd out of the way of the peer's window */
+  if (pcb->cwnd < pcb->snd_wnd_max) {
+    TCP_WND_INC(pcb->cwnd, acked);
+  }
+}
+
+static void
+tcp_cc_local_loss(struct tcp_pcb *pcb, u8_t timeout)
+{
+  LWIP_UNUSED_ARG(timeout);
+
+  /* The segment was dropped by a full ring at either end, not a congested
+   * queue: keep the window. After an RTO cwnd restarts at one MSS and slow
+   * start takes it straight back. */
+  pcb->ssthresh = LWIP_MAX(LWIP_MIN(pcb->cwnd, pcb->snd_wnd), (tcpwnd_size_t)(2 * pcb->mss));
+}
+
+/** @ingroup tcp_raw
+ * For point-to-point links without queues of their own (rpmsg), where a
+ * loss means a full vring rather than congestion: losses are retransmitted
+ * but do not shrink the window, and cwnd grows to the peer's window at once. */
+const struct tcp_cc_ops tcp_cc_local = {
+  "local",
+  tcp_cc_local_acked,
+  tcp_cc_local_loss
+};
+
+/**
+ * @ingroup tcp_raw
+ * Select the congestion control of a pcb: &tcp_cc_cubic, &tcp_cc_local or
+ * NULL for the built-in Reno. Accepted pcbs start with Reno, so a listener
+ * sets it from its accept callback. The new algorithm starts from the
+ * current cwnd and ssthresh.
+ *
+ * @param pcb tcp_pcb to change
+ * @param cc congestion control algorithm
+ */
+void
+tcp_set_cc(struct tcp_pcb *pcb, const struct tcp_cc_ops *cc)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_set_cc: invalid pcb", pcb != NULL, return);
+  LWIP_ERROR("tcp_set_cc: called on listen-pcb", pcb->state != LISTEN, return);
+
+  pcb->cc = cc;
+  pcb->cc_epoch = 0;
+  pcb->cc_wmax = 0;
+}
+
+#endif /* LWIP_TCP && LWIP_TCP_CC */
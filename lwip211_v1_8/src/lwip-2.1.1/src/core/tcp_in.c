@@ -53,6 +53,7 @@
 #include "lwip/memp.h"
 #include "lwip/inet_chksum.h"
 #include "lwip/stats.h"
+#include "lwip/sys.h"
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
 #if LWIP_ND6_TCP_REACHABILITY_HINTS
@@ -92,18 +93,55 @@ static err_t tcp_process(struct tcp_pcb *pcb);
 static void tcp_receive(struct tcp_pcb *pcb);
 static void tcp_parseopt(struct tcp_pcb *pcb);
 
-static void tcp_listen_input(struct tcp_pcb_listen *pcb);
+static struct tcp_pcb *tcp_listen_input(struct tcp_pcb_listen *pcb);
 static void tcp_timewait_input(struct tcp_pcb *pcb);
+#if TCP_TW_COMPACT
+static void tcp_tw_input(struct tcp_tw *tw);
+#endif /* TCP_TW_COMPACT */
+#if LWIP_TCP_SYN_COOKIES
+static void tcp_syn_cookie_send(struct tcp_pcb_listen *pcb);
+static int tcp_syn_cookie_check(u8_t *data);
+#endif /* LWIP_TCP_SYN_COOKIES */
 
 static int tcp_input_delayed_close(struct tcp_pcb *pcb);
 
 #if LWIP_TCP_SACK_OUT
 static void tcp_add_sack(struct tcp_pcb *pcb, u32_t left, u32_t right);
 static void tcp_remove_sacks_lt(struct tcp_pcb *pcb, u32_t seq);
-#if defined(TCP_OOSEQ_BYTES_LIMIT) || defined(TCP_OOSEQ_PBUFS_LIMIT)
-static void tcp_remove_sacks_gt(struct tcp_pcb *pcb, u32_t seq);
-#endif /* TCP_OOSEQ_BYTES_LIMIT || TCP_OOSEQ_PBUFS_LIMIT */
 #endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_SACK_IN
+static void tcp_sack_mark(struct tcp_pcb *pcb, u32_t left, u32_t right);
+#endif /* LWIP_TCP_SACK_IN */
+#if TCP_ACK_STRETCH
+static void tcp_ack_stretched(struct tcp_pcb *pcb, u16_t len);
+#endif /* TCP_ACK_STRETCH */
+
+#if LWIP_TCP_SYN_COOKIES
+/* What a SYN cookie keeps of the SYN's options, in the low bits of its hashed
+   24 bits: the MSS as an index into tcp_syn_cookie_mss, SACK_PERM and the
+   window scale + 1 (0 for no window scale option). */
+#define TCP_SYN_COOKIE_MSS          0x03U
+#define TCP_SYN_COOKIE_SACK         0x04U
+#define TCP_SYN_COOKIE_WS_SHIFT     3
+#define TCP_SYN_COOKIE_DATA_MAX     (16U << TCP_SYN_COOKIE_WS_SHIFT)
+/* The cookie counter advances every 2^16 ms (about a minute), cookies of the
+   last TCP_SYN_COOKIE_MAX_AGE periods are accepted too. */
+#define TCP_SYN_COOKIE_PERIOD_SHIFT 16
+#define TCP_SYN_COOKIE_MAX_AGE      2
+
+/* The peer MSS values a cookie can keep, the last one for 9000 byte MTUs */
+static const u16_t tcp_syn_cookie_mss[] = { 536, 1300, 1460, 8960 };
+#endif /* LWIP_TCP_SYN_COOKIES */
+
+#if LWIP_TCP_FASTOPEN
+/* The Fast Open option of the SYN being processed, set by tcp_parseopt() */
+#define TCP_FASTOPEN_NONE           0
+#define TCP_FASTOPEN_OPT            1 /* cookie request, or a cookie that is not ours */
+#define TCP_FASTOPEN_VALID          2
+static u8_t tcp_fastopen_opt;
+/* The pcb opened by the segment being processed, whose SYN data was accepted */
+static struct tcp_pcb *tcp_fastopen_pcb;
+#endif /* LWIP_TCP_FASTOPEN */
 
 /**
  * The initial input processing of TCP. It verifies the TCP header, demultiplexes
@@ -114,7 +152,7 @@ static void tcp_remove_sacks_gt(struct tcp_pcb *pcb, u32_t seq);
  * @param p received TCP segment to process (p->payload pointing to the TCP header)
  * @param inp network interface on which this segment was received
  */
-void
+LWIP_HOT_TEXT void
 tcp_input(struct pbuf *p, struct netif *inp)
 {
   struct tcp_pcb *pcb, *prev;
@@ -135,7 +173,15 @@ tcp_input(struct pbuf *p, struct netif *inp)
   TCP_STATS_INC(tcp.recv);
   MIB2_STATS_INC(mib2.tcpinsegs);
 
+#if TCP_TMR_COALESCE
+  /* pcb->tmr and RTT measurements read tcp_ticks */
+  tcp_update_ticks();
+#endif /* TCP_TMR_COALESCE */
+
   tcphdr = (struct tcp_hdr *)p->payload;
+#if LWIP_TCP_FASTOPEN
+  tcp_fastopen_pcb = NULL;
+#endif /* LWIP_TCP_FASTOPEN */
 
 #if TCP_INPUT_DEBUG
   tcp_debug_print(tcphdr);
@@ -247,6 +293,23 @@ tcp_input(struct pbuf *p, struct netif *inp)
      for an active connection. */
   prev = NULL;
 
+#if TCP_PCB_HASH
+  pcb = tcp_pcb_hash_lookup(ip_current_dest_addr(), tcphdr->dest,
+                            ip_current_src_addr(), tcphdr->src,
+                            netif_get_index(ip_data.current_input_netif));
+  if ((pcb != NULL) && (pcb->state == TIME_WAIT)) {
+    LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for TIME_WAITing connection.\n"));
+#ifdef LWIP_HOOK_TCP_INPACKET_PCB
+    if (LWIP_HOOK_TCP_INPACKET_PCB(pcb, tcphdr, tcphdr_optlen, tcphdr_opt1len,
+                                   tcphdr_opt2, p) == ERR_OK)
+#endif
+    {
+      tcp_timewait_input(pcb);
+    }
+    pbuf_free(p);
+    return;
+  }
+#else /* TCP_PCB_HASH */
   for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
     LWIP_ASSERT("tcp_input: active pcb->state != CLOSED", pcb->state != CLOSED);
     LWIP_ASSERT("tcp_input: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
@@ -279,8 +342,10 @@ tcp_input(struct pbuf *p, struct netif *inp)
     }
     prev = pcb;
   }
+#endif /* TCP_PCB_HASH */
 
   if (pcb == NULL) {
+#if !TCP_PCB_HASH
     /* If it did not go to an active connection, we check the connections
        in the TIME-WAIT state. */
     for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
@@ -311,6 +376,20 @@ tcp_input(struct pbuf *p, struct netif *inp)
         return;
       }
     }
+#endif /* !TCP_PCB_HASH */
+#if TCP_TW_COMPACT
+    {
+      struct tcp_tw *tw = tcp_tw_lookup(ip_current_dest_addr(), tcphdr->dest,
+                                        ip_current_src_addr(), tcphdr->src,
+                                        netif_get_index(ip_data.current_input_netif));
+      if (tw != NULL) {
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for TIME_WAITing connection (compact).\n"));
+        tcp_tw_input(tw);
+        pbuf_free(p);
+        return;
+      }
+    }
+#endif /* TCP_TW_COMPACT */
 
     /* Finally, if we still did not get a match, we check all PCBs that
        are LISTENing for incoming connections. */
@@ -377,10 +456,14 @@ tcp_input(struct pbuf *p, struct netif *inp)
                                      tcphdr_opt1len, tcphdr_opt2, p) == ERR_OK)
 #endif
       {
-        tcp_listen_input(lpcb);
+        pcb = tcp_listen_input(lpcb);
       }
-      pbuf_free(p);
-      return;
+      if (pcb == NULL) {
+        pbuf_free(p);
+        return;
+      }
+      /* the ACK of a SYN cookie or a Fast Open SYN opened pcb, process the
+         segment for it */
     }
   }
 
@@ -516,6 +599,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
             }
 #endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
             pcb->refused_data = recv_data;
+            TCP_TMR_NEEDED();
             LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: keep incoming packet, because pcb is \"full\"\n"));
 #if TCP_QUEUE_OOSEQ && LWIP_WND_SCALE
             break;
@@ -551,6 +635,11 @@ tcp_input(struct pbuf *p, struct netif *inp)
         }
         /* Try to send something out. */
         tcp_output(pcb);
+#if TCP_TW_COMPACT
+        if ((pcb->state == TIME_WAIT) && tcp_tw_compact(pcb)) {
+          goto aborted;
+        }
+#endif /* TCP_TW_COMPACT */
 #if TCP_INPUT_DEBUG
 #if TCP_DEBUG
         tcp_debug_print_state(pcb->state);
@@ -617,25 +706,76 @@ tcp_input_delayed_close(struct tcp_pcb *pcb)
   return 0;
 }
 
+/**
+ * Allocate and register the pcb of a connection to a listening pcb, for the
+ * segment being processed: in SYN_RCVD, with the peer's ISN irs, a new ISS
+ * and the listener's settings.
+ *
+ * @return the new pcb or NULL if none could be allocated
+ */
+static struct tcp_pcb *
+tcp_listen_pcb_new(struct tcp_pcb_listen *pcb, u32_t irs)
+{
+  struct tcp_pcb *npcb;
+  u32_t iss;
+
+  npcb = tcp_alloc(pcb->prio);
+  if (npcb == NULL) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_listen_input: could not allocate PCB\n"));
+    TCP_STATS_INC(tcp.memerr);
+    return NULL;
+  }
+#if TCP_LISTEN_BACKLOG
+  pcb->accepts_pending++;
+  tcp_set_flags(npcb, TF_BACKLOGPEND);
+#endif /* TCP_LISTEN_BACKLOG */
+  /* Set up the new PCB. */
+  ip_addr_copy(npcb->local_ip, *ip_current_dest_addr());
+  ip_addr_copy(npcb->remote_ip, *ip_current_src_addr());
+  npcb->local_port = pcb->local_port;
+  npcb->remote_port = tcphdr->src;
+  npcb->state = SYN_RCVD;
+  npcb->rcv_nxt = irs + 1;
+  npcb->rcv_ann_right_edge = npcb->rcv_nxt;
+  iss = tcp_next_iss(npcb);
+  npcb->snd_wl2 = iss;
+  npcb->snd_nxt = iss;
+  npcb->lastack = iss;
+  npcb->snd_lbb = iss;
+  npcb->snd_wl1 = irs - 1;/* initialise to irs-1 to force window update */
+  npcb->callback_arg = pcb->callback_arg;
+#if LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG
+  npcb->listener = pcb;
+#endif /* LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG */
+  /* inherit socket options */
+  npcb->so_options = pcb->so_options & SOF_INHERITED;
+  npcb->netif_idx = pcb->netif_idx;
+  /* Register the new PCB so that we can begin receiving segments
+     for it. */
+  TCP_REG_ACTIVE(npcb);
+  return npcb;
+}
+
 /**
  * Called by tcp_input() when a segment arrives for a listening
  * connection (from tcp_input()).
  *
  * @param pcb the tcp_pcb_listen for which a segment arrived
+ * @return the pcb opened by the ACK of a SYN cookie or by a SYN with Fast
+ *         Open data, for which tcp_input() then processes the segment, NULL else
  *
  * @note the segment which arrived is saved in global variables, therefore only the pcb
  *       involved is passed as a parameter to this function
  */
-static void
+static struct tcp_pcb *
 tcp_listen_input(struct tcp_pcb_listen *pcb)
 {
   struct tcp_pcb *npcb;
-  u32_t iss;
   err_t rc;
 
   if (flags & TCP_RST) {
     /* An incoming RST should be ignored. Return. */
-    return;
+    return NULL;
   }
 
   LWIP_ASSERT("tcp_listen_input: invalid pcb", pcb != NULL);
@@ -643,6 +783,61 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
   /* In the LISTEN state, we check for incoming SYN segments,
      creates a new PCB, and responds with a SYN|ACK. */
   if (flags & TCP_ACK) {
+#if LWIP_TCP_SYN_COOKIES
+    u8_t data;
+
+    if (!(flags & TCP_SYN) && tcp_syn_cookie_check(&data)) {
+      /* The ACK of one of our SYN cookies: open the connection now. If
+         that is not possible the ACK is dropped, the peer retransmits
+         with its first data or gets a RST once it is too late. */
+#if TCP_LISTEN_BACKLOG
+      if (pcb->accepts_pending >= pcb->backlog) {
+        LWIP_DEBUGF(TCP_DEBUG, ("tcp_listen_input: listen backlog exceeded for port %"U16_F"\n", tcphdr->dest));
+        return NULL;
+      }
+#endif /* TCP_LISTEN_BACKLOG */
+      npcb = tcp_listen_pcb_new(pcb, seqno - 1);
+      if (npcb == NULL) {
+        return NULL;
+      }
+      /* Our ISS was the cookie, and the ACK acknowledges the SYN|ACK */
+      npcb->snd_wl2 = ackno - 1;
+      npcb->lastack = ackno - 1;
+      npcb->snd_nxt = ackno;
+      npcb->snd_lbb = ackno;
+      npcb->rcv_ann_right_edge = npcb->rcv_nxt + npcb->rcv_ann_wnd;
+      npcb->mss = LWIP_MIN(tcp_syn_cookie_mss[data & TCP_SYN_COOKIE_MSS], TCP_MSS);
+#if LWIP_TCP_SACK_OUT
+      if (data & TCP_SYN_COOKIE_SACK) {
+        tcp_set_flags(npcb, TF_SACK);
+      }
+#endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_WND_SCALE
+      if (data >> TCP_SYN_COOKIE_WS_SHIFT) {
+        npcb->snd_scale = (u8_t)((data >> TCP_SYN_COOKIE_WS_SHIFT) - 1);
+        npcb->rcv_scale = TCP_RCV_SCALE;
+        tcp_set_flags(npcb, TF_WND_SCALE);
+        npcb->rcv_wnd = npcb->rcv_ann_wnd = TCP_WND;
+      }
+#endif /* LWIP_WND_SCALE */
+      npcb->snd_wnd = SND_WND_SCALE(npcb, tcphdr->wnd);
+      npcb->snd_wnd_max = npcb->snd_wnd;
+#if TCP_CALCULATE_EFF_SEND_MSS
+      npcb->mss = tcp_eff_send_mss(npcb->mss, &npcb->local_ip, &npcb->remote_ip);
+#endif /* TCP_CALCULATE_EFF_SEND_MSS */
+
+      MIB2_STATS_INC(mib2.tcppassiveopens);
+
+#if LWIP_TCP_PCB_NUM_EXT_ARGS
+      if (tcp_ext_arg_invoke_callbacks_passive_open(pcb, npcb) != ERR_OK) {
+        tcp_abandon(npcb, 0);
+        return NULL;
+      }
+#endif
+      LWIP_DEBUGF(TCP_DEBUG, ("TCP connection %"U16_F" -> %"U16_F" opened by a SYN cookie.\n", tcphdr->src, tcphdr->dest));
+      return npcb;
+    }
+#endif /* LWIP_TCP_SYN_COOKIES */
     /* For incoming segments with the ACK flag set, respond with a
        RST. */
     LWIP_DEBUGF(TCP_RST_DEBUG, ("tcp_listen_input: ACK in LISTEN, sending reset\n"));
@@ -650,52 +845,35 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
             ip_current_src_addr(), tcphdr->dest, tcphdr->src);
   } else if (flags & TCP_SYN) {
     LWIP_DEBUGF(TCP_DEBUG, ("TCP connection request %"U16_F" -> %"U16_F".\n", tcphdr->src, tcphdr->dest));
+#if LWIP_TCP_SYN_COOKIES == 2
+    /* Half-open connections never hold a pcb */
+    tcp_syn_cookie_send(pcb);
+    return NULL;
+#endif /* LWIP_TCP_SYN_COOKIES == 2 */
 #if TCP_LISTEN_BACKLOG
     if (pcb->accepts_pending >= pcb->backlog) {
       LWIP_DEBUGF(TCP_DEBUG, ("tcp_listen_input: listen backlog exceeded for port %"U16_F"\n", tcphdr->dest));
-      return;
+#if LWIP_TCP_SYN_COOKIES
+      tcp_syn_cookie_send(pcb);
+#endif /* LWIP_TCP_SYN_COOKIES */
+      return NULL;
     }
 #endif /* TCP_LISTEN_BACKLOG */
-    npcb = tcp_alloc(pcb->prio);
+    npcb = tcp_listen_pcb_new(pcb, seqno);
     /* If a new PCB could not be created (probably due to lack of memory),
        we don't do anything, but rely on the sender will retransmit the
-       SYN at a time when we have more memory available. */
+       SYN at a time when we have more memory available. With SYN cookies,
+       the connection is opened without a PCB instead. */
     if (npcb == NULL) {
+#if LWIP_TCP_SYN_COOKIES
+      tcp_syn_cookie_send(pcb);
+#else /* LWIP_TCP_SYN_COOKIES */
       err_t err;
-      LWIP_DEBUGF(TCP_DEBUG, ("tcp_listen_input: could not allocate PCB\n"));
-      TCP_STATS_INC(tcp.memerr);
       TCP_EVENT_ACCEPT(pcb, NULL, pcb->callback_arg, ERR_MEM, err);
       LWIP_UNUSED_ARG(err); /* err not useful here */
-      return;
+#endif /* LWIP_TCP_SYN_COOKIES */
+      return NULL;
     }
-#if TCP_LISTEN_BACKLOG
-    pcb->accepts_pending++;
-    tcp_set_flags(npcb, TF_BACKLOGPEND);
-#endif /* TCP_LISTEN_BACKLOG */
-    /* Set up the new PCB. */
-    ip_addr_copy(npcb->local_ip, *ip_current_dest_addr());
-    ip_addr_copy(npcb->remote_ip, *ip_current_src_addr());
-    npcb->local_port = pcb->local_port;
-    npcb->remote_port = tcphdr->src;
-    npcb->state = SYN_RCVD;
-    npcb->rcv_nxt = seqno + 1;
-    npcb->rcv_ann_right_edge = npcb->rcv_nxt;
-    iss = tcp_next_iss(npcb);
-    npcb->snd_wl2 = iss;
-    npcb->snd_nxt = iss;
-    npcb->lastack = iss;
-    npcb->snd_lbb = iss;
-    npcb->snd_wl1 = seqno - 1;/* initialise to seqno-1 to force window update */
-    npcb->callback_arg = pcb->callback_arg;
-#if LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG
-    npcb->listener = pcb;
-#endif /* LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG */
-    /* inherit socket options */
-    npcb->so_options = pcb->so_options & SOF_INHERITED;
-    npcb->netif_idx = pcb->netif_idx;
-    /* Register the new PCB so that we can begin receiving segments
-       for it. */
-    TCP_REG_ACTIVE(npcb);
 
     /* Parse any options in the SYN. */
     tcp_parseopt(npcb);
@@ -711,19 +889,45 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
     if (tcp_ext_arg_invoke_callbacks_passive_open(pcb, npcb) != ERR_OK) {
       tcp_abandon(npcb, 0);
-      return;
+      return NULL;
     }
 #endif
 
+#if LWIP_TCP_FASTOPEN
+    if (pcb->fastopen && (tcp_fastopen_opt != TCP_FASTOPEN_NONE)) {
+      /* Give the client a cookie in the SYN|ACK */
+      tcp_set_flags(npcb, TF_FASTOPEN);
+    }
+#endif /* LWIP_TCP_FASTOPEN */
+
     /* Send a SYN|ACK together with the MSS option. */
     rc = tcp_enqueue_flags(npcb, TCP_SYN | TCP_ACK);
     if (rc != ERR_OK) {
       tcp_abandon(npcb, 0);
-      return;
+      return NULL;
     }
+#if LWIP_TCP_FASTOPEN
+    if ((npcb->flags & TF_FASTOPEN) && (tcp_fastopen_opt == TCP_FASTOPEN_VALID) &&
+        (tcplen > 1) && !(flags & TCP_FIN)) {
+      /* The SYN carries data and a valid cookie: tcp_input() goes on to
+         process the segment for npcb without its SYN, tcp_process() accepts
+         the connection and takes the data, and the SYN|ACK goes out after the
+         application has seen it, acknowledging it. */
+      seqno++;
+      tcphdr->seqno = seqno;
+      tcplen--;
+      flags &= (u8_t)~TCP_SYN;
+      TCPH_UNSET_FLAG(tcphdr, TCP_SYN);
+      tcp_fastopen_pcb = npcb;
+      LWIP_DEBUGF(TCP_DEBUG, ("TCP connection %"U16_F" -> %"U16_F" opened with %"U16_F" bytes of Fast Open data.\n", tcphdr->src, tcphdr->dest, tcplen));
+      return npcb;
+    }
+    /* Only pcbs that took SYN data keep the flag */
+    tcp_clear_flags(npcb, TF_FASTOPEN);
+#endif /* LWIP_TCP_FASTOPEN */
     tcp_output(npcb);
   }
-  return;
+  return NULL;
 }
 
 /**
@@ -773,6 +977,40 @@ tcp_timewait_input(struct tcp_pcb *pcb)
   return;
 }
 
+#if TCP_TW_COMPACT
+/**
+ * Called by tcp_input() when a segment arrives for a connection in
+ * TIME-WAIT that is kept as a compact record: tcp_timewait_input() for it.
+ *
+ * @param tw the tcp_tw for which a segment arrived
+ */
+static void
+tcp_tw_input(struct tcp_tw *tw)
+{
+  /* RFC 1337: ignore RST */
+  if (flags & TCP_RST) {
+    return;
+  }
+
+  if (flags & TCP_SYN) {
+    if (TCP_SEQ_BETWEEN(seqno, tw->rcv_nxt, tw->rcv_nxt + tw->rcv_wnd)) {
+      /* If the SYN is in the window it is an error, send a reset */
+      tcp_rst(NULL, ackno, seqno + tcplen, ip_current_dest_addr(),
+              ip_current_src_addr(), tcphdr->dest, tcphdr->src);
+      return;
+    }
+  } else if (flags & TCP_FIN) {
+    /* Restart the 2 MSL time-wait timeout. */
+    tw->tmr = tcp_ticks;
+  }
+
+  if (tcplen > 0) {
+    /* Acknowledge data, FIN or out-of-window SYN */
+    tcp_tw_ack(tw);
+  }
+}
+#endif /* TCP_TW_COMPACT */
+
 /**
  * Implements the TCP state machine. Called by tcp_input. In some
  * states tcp_receive() is called to receive data. The tcp_seg
@@ -784,7 +1022,7 @@ tcp_timewait_input(struct tcp_pcb *pcb)
  * @note the segment which arrived is saved in global variables, therefore only the pcb
  *       involved is passed as a parameter to this function
  */
-static err_t
+static LWIP_HOT_TEXT err_t
 tcp_process(struct tcp_pcb *pcb)
 {
   struct tcp_seg *rseg;
@@ -920,11 +1158,39 @@ tcp_process(struct tcp_pcb *pcb)
       }
       break;
     case SYN_RCVD:
+#if LWIP_TCP_FASTOPEN
+      if (pcb == tcp_fastopen_pcb) {
+        /* The SYN just opened pcb with data and a valid Fast Open cookie:
+           accept the connection before the handshake completes and pass
+           the data on. The response may go out right behind the SYN|ACK. */
+        tcp_fastopen_pcb = NULL;
+        pcb->cwnd = LWIP_TCP_CALC_INITIAL_CWND(pcb->mss);
+#if LWIP_CALLBACK_API
+        LWIP_ASSERT("pcb->listener->accept != NULL", pcb->listener->accept != NULL);
+#endif
+        tcp_backlog_accepted(pcb);
+        TCP_EVENT_ACCEPT(pcb->listener, pcb, pcb->callback_arg, ERR_OK, err);
+        if (err != ERR_OK) {
+          if (err != ERR_ABRT) {
+            tcp_abort(pcb);
+          }
+          return ERR_ABRT;
+        }
+        tcp_receive(pcb);
+        break;
+      }
+#endif /* LWIP_TCP_FASTOPEN */
       if (flags & TCP_ACK) {
         /* expected ACK number? */
         if (TCP_SEQ_BETWEEN(ackno, pcb->lastack + 1, pcb->snd_nxt)) {
           pcb->state = ESTABLISHED;
           LWIP_DEBUGF(TCP_DEBUG, ("TCP connection established %"U16_F" -> %"U16_F".\n", inseg.tcphdr->src, inseg.tcphdr->dest));
+#if LWIP_TCP_FASTOPEN
+          if (pcb->flags & TF_FASTOPEN) {
+            /* Accepted already, with the data of its SYN */
+            tcp_clear_flags(pcb, TF_FASTOPEN);
+          } else
+#endif /* LWIP_TCP_FASTOPEN */
 #if LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG
           if (pcb->listener == NULL) {
             /* listen pcb might be closed by now */
@@ -1081,6 +1347,37 @@ tcp_oos_insert_segment(struct tcp_seg *cseg, struct tcp_seg *next)
   }
   cseg->next = next;
 }
+
+/**
+ * Coalesce segments on ooseq that are contiguous in sequence space, so the
+ * queue holds one tcp_seg (with a chained pbuf) per interval and the
+ * insertion walk in tcp_receive() is bounded by the number of holes rather
+ * than the number of segments received.
+ *
+ * Called from tcp_receive()
+ */
+static void
+tcp_oos_merge(struct tcp_seg *seg)
+{
+  struct tcp_seg *next;
+
+  for (; seg != NULL; seg = seg->next) {
+    while (((next = seg->next) != NULL) &&
+           !(TCPH_FLAGS(seg->tcphdr) & TCP_FIN) &&
+           (seg->tcphdr->seqno + seg->len == next->tcphdr->seqno) &&
+           ((u32_t)seg->len + next->len <= 0xFFFF)) {
+      pbuf_cat(seg->p, next->p);
+      seg->len = (u16_t)(seg->len + next->len);
+      if (TCPH_FLAGS(next->tcphdr) & TCP_FIN) {
+        TCPH_SET_FLAG(seg->tcphdr, TCP_FIN);
+      }
+      seg->next = next->next;
+      /* the pbuf now belongs to seg */
+      next->p = NULL;
+      tcp_seg_free(next);
+    }
+  }
+}
 #endif /* TCP_QUEUE_OOSEQ */
 
 /** Remove segments from a list if the incoming ACK acknowledges them */
@@ -1125,6 +1422,42 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
   return seg_list;
 }
 
+#if TCP_ACK_STRETCH
+/**
+ * tcp_ack() for 'len' bytes of in-sequence data, acking once the segment or
+ * byte limit of the pcb (or, if it has none, of the input netif) is reached
+ * or the peer is about to run out of window.
+ */
+static void
+tcp_ack_stretched(struct tcp_pcb *pcb, u16_t len)
+{
+  u8_t segs = pcb->ack_stretch_segs;
+  u32_t bytes = pcb->ack_stretch_bytes;
+
+  if (segs == 0) {
+    struct netif *inp = ip_current_input_netif();
+    segs = inp->ack_stretch_segs;
+    bytes = inp->ack_stretch_bytes;
+  }
+
+  pcb->ack_pend_segs++;
+  pcb->ack_pend_bytes += len;
+  if ((pcb->ack_pend_segs >= segs) ||
+      ((bytes != 0) && (pcb->ack_pend_bytes >= bytes)) ||
+      (pcb->ack_pend_bytes >= pcb->rcv_ann_wnd)) {
+    tcp_clear_flags(pcb, TF_ACK_DELAY);
+    tcp_ack_now(pcb);
+  } else {
+    tcp_set_flags(pcb, TF_ACK_DELAY);
+    TCP_TMR_NEEDED();
+    if (pcb->ack_pend_segs > 1) {
+      /* held back beyond the classic delayed ACK */
+      TCP_ACK_STRETCH_ARM();
+    }
+  }
+}
+#endif /* TCP_ACK_STRETCH */
+
 /**
  * Called by tcp_process. Checks if the given segment is an ACK for outstanding
  * data, and if so frees the memory of the buffered data. Next, it places the
@@ -1137,7 +1470,7 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
  *
  * Called from tcp_process().
  */
-static void
+static LWIP_HOT_TEXT void
 tcp_receive(struct tcp_pcb *pcb)
 {
   s16_t m;
@@ -1145,7 +1478,12 @@ tcp_receive(struct tcp_pcb *pcb)
   int found_dupack = 0;
 
   LWIP_ASSERT("tcp_receive: invalid pcb", pcb != NULL);
+#if LWIP_TCP_FASTOPEN
+  /* Fast Open data is received in SYN_RCVD */
+  LWIP_ASSERT("tcp_receive: wrong state", (pcb->state >= ESTABLISHED) || (pcb->flags & TF_FASTOPEN));
+#else /* LWIP_TCP_FASTOPEN */
   LWIP_ASSERT("tcp_receive: wrong state", pcb->state >= ESTABLISHED);
+#endif /* LWIP_TCP_FASTOPEN */
 
   if (flags & TCP_ACK) {
     right_wnd_edge = pcb->snd_wnd + pcb->snd_wl2;
@@ -1208,6 +1546,12 @@ tcp_receive(struct tcp_pcb *pcb)
               if ((u8_t)(pcb->dupacks + 1) > pcb->dupacks) {
                 ++pcb->dupacks;
               }
+#if LWIP_TCP_SACK_IN
+              if (pcb->flags & TF_INFR) {
+                /* another segment has left the network: fill the next hole */
+                tcp_rexmit_sack(pcb);
+              }
+#endif /* LWIP_TCP_SACK_IN */
               if (pcb->dupacks > 3) {
                 /* Inflate the congestion window */
                 TCP_WND_INC(pcb->cwnd, pcb->mss);
@@ -1229,9 +1573,23 @@ tcp_receive(struct tcp_pcb *pcb)
       /* We come here when the ACK acknowledges new data. */
       tcpwnd_size_t acked;
 
+#if LWIP_TCP_SACK_IN
+      if ((pcb->flags & TF_SACKED) && TCP_SEQ_GEQ(ackno, pcb->sack_high)) {
+        /* every SACKed segment is cumulatively acked now */
+        tcp_clear_flags(pcb, TF_SACKED);
+      }
+#endif /* LWIP_TCP_SACK_IN */
+
       /* Reset the "IN Fast Retransmit" flag, since we are no longer
          in fast retransmit. Also reset the congestion window to the
          slow start threshold. */
+#if LWIP_TCP_SACK_IN
+      /* With SACK, a partial ACK that leaves holes below the highest
+         SACKed byte keeps us in fast recovery (RFC 6675). */
+      if ((pcb->flags & (TF_INFR | TF_SACKED)) == (TF_INFR | TF_SACKED)) {
+        /* tcp_rexmit_sack() below, once the acked segments are freed */
+      } else
+#endif /* LWIP_TCP_SACK_IN */
       if (pcb->flags & TF_INFR) {
         tcp_clear_flags(pcb, TF_INFR);
         pcb->cwnd = pcb->ssthresh;
@@ -1254,6 +1612,11 @@ tcp_receive(struct tcp_pcb *pcb)
       /* Update the congestion control variables (cwnd and
          ssthresh). */
       if (pcb->state >= ESTABLISHED) {
+#if LWIP_TCP_CC
+        if (pcb->cc != NULL) {
+          pcb->cc->acked(pcb, acked);
+        } else
+#endif /* LWIP_TCP_CC */
         if (pcb->cwnd < pcb->ssthresh) {
           tcpwnd_size_t increase;
           /* limit to 1 SMSS segment during period following RTO */
@@ -1290,6 +1653,13 @@ tcp_receive(struct tcp_pcb *pcb)
          in fact have been sent once. */
       pcb->unsent = tcp_free_acked_segments(pcb, pcb->unsent, "unsent", pcb->unacked);
 
+#if LWIP_TCP_SACK_IN
+      if (pcb->flags & TF_INFR) {
+        /* partial ACK in SACK recovery: retransmit the next hole */
+        tcp_rexmit_sack(pcb);
+      }
+#endif /* LWIP_TCP_SACK_IN */
+
       /* If there's nothing left to acknowledge, stop the retransmit
          timer, otherwise reset it to start again */
       if (pcb->unacked == NULL) {
@@ -1622,7 +1992,11 @@ tcp_receive(struct tcp_pcb *pcb)
 
 
         /* Acknowledge the segment(s). */
+#if TCP_ACK_STRETCH
+        tcp_ack_stretched(pcb, tcplen);
+#else /* TCP_ACK_STRETCH */
         tcp_ack(pcb);
+#endif /* TCP_ACK_STRETCH */
 
 #if LWIP_TCP_SACK_OUT
         if (LWIP_TCP_SACK_VALID(pcb, 0)) {
@@ -1648,6 +2022,7 @@ tcp_receive(struct tcp_pcb *pcb)
         /* We queue the segment on the ->ooseq queue. */
         if (pcb->ooseq == NULL) {
           pcb->ooseq = tcp_seg_copy(&inseg);
+          TCP_TMR_NEEDED();
 #if LWIP_TCP_SACK_OUT
           if (pcb->flags & TF_SACK) {
             /* All the SACKs should be invalid, so we can simply store the most recent one: */
@@ -1723,7 +2098,13 @@ tcp_receive(struct tcp_pcb *pcb)
                      the next segment on ->ooseq. We trim trim the previous
                      segment, delete next segments that included in received segment
                      and trim received, if needed. */
-                  struct tcp_seg *cseg = tcp_seg_copy(&inseg);
+                  struct tcp_seg *cseg;
+                  if (TCP_SEQ_GEQ(prev->tcphdr->seqno + prev->len, seqno + inseg.len)) {
+                    /* 'prev' is a merged interval that already holds all of
+                       it; trimming 'prev' would lose the rest of the interval */
+                    break;
+                  }
+                  cseg = tcp_seg_copy(&inseg);
                   if (cseg != NULL) {
                     if (TCP_SEQ_GT(prev->tcphdr->seqno + prev->len, seqno)) {
                       /* We need to trim the prev segment. */
@@ -1755,7 +2136,8 @@ tcp_receive(struct tcp_pcb *pcb)
                  of the list. */
               if (next->next == NULL &&
                   TCP_SEQ_GT(seqno, next->tcphdr->seqno)) {
-                if (TCPH_FLAGS(next->tcphdr) & TCP_FIN) {
+                if ((TCPH_FLAGS(next->tcphdr) & TCP_FIN) ||
+                    TCP_SEQ_GEQ(next->tcphdr->seqno + next->len, seqno + inseg.len)) {
                   /* segment "next" already contains all data */
                   break;
                 }
@@ -1815,11 +2197,13 @@ tcp_receive(struct tcp_pcb *pcb)
             }
           }
 #endif /* LWIP_TCP_SACK_OUT */
+          tcp_oos_merge(pcb->ooseq);
         }
 #if defined(TCP_OOSEQ_BYTES_LIMIT) || defined(TCP_OOSEQ_PBUFS_LIMIT)
         {
           /* Check that the data on ooseq doesn't exceed one of the limits
-             and throw away everything above that limit. */
+             and throw away everything above that limit. The interval that
+             crosses the byte limit keeps the part that still fits. */
 #ifdef TCP_OOSEQ_BYTES_LIMIT
           const u32_t ooseq_max_blen = TCP_OOSEQ_BYTES_LIMIT(pcb);
           u32_t ooseq_blen = 0;
@@ -1845,12 +2229,29 @@ tcp_receive(struct tcp_pcb *pcb)
             }
 #endif
             if (stop_here) {
+              u32_t keep = 0;
+#ifdef TCP_OOSEQ_BYTES_LIMIT
+              keep = ooseq_max_blen - (ooseq_blen - p->tot_len);
+#endif
+#ifdef TCP_OOSEQ_PBUFS_LIMIT
+              if (ooseq_qlen > ooseq_max_qlen) {
+                keep = 0;
+              }
+#endif
 #if LWIP_TCP_SACK_OUT
               if (pcb->flags & TF_SACK) {
-                /* Let's remove all SACKs from next's seqno up. */
-                tcp_remove_sacks_gt(pcb, next->tcphdr->seqno);
+                /* Let's remove all SACKs from the cut-off seqno up. */
+                tcp_remove_sacks_gt(pcb, next->tcphdr->seqno + keep);
               }
 #endif /* LWIP_TCP_SACK_OUT */
+              if (keep > 0) {
+                /* keep the head of this interval, it ends below the limit */
+                TCPH_FLAGS_SET(next->tcphdr, TCPH_FLAGS(next->tcphdr) & ~TCP_FIN);
+                next->len = (u16_t)keep;
+                pbuf_realloc(next->p, next->len);
+                prev = next;
+                next = next->next;
+              }
               /* too much ooseq data, dump this and everything after it */
               tcp_segs_free(next);
               if (prev == NULL) {
@@ -1916,6 +2317,10 @@ tcp_parseopt(struct tcp_pcb *pcb)
 
   LWIP_ASSERT("tcp_parseopt: invalid pcb", pcb != NULL);
 
+#if LWIP_TCP_FASTOPEN
+  tcp_fastopen_opt = TCP_FASTOPEN_NONE;
+#endif /* LWIP_TCP_FASTOPEN */
+
   /* Parse the TCP MSS option, if present. */
   if (tcphdr_optlen != 0) {
     for (tcp_optidx = 0; tcp_optidx < tcphdr_optlen; ) {
@@ -2008,6 +2413,58 @@ tcp_parseopt(struct tcp_pcb *pcb)
           }
           break;
 #endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_SACK_IN
+        case LWIP_TCP_OPT_SACK:
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK\n"));
+          data = tcp_get_next_optbyte();
+          if ((data < 10) || (((data - 2) & 7) != 0) || (tcp_optidx - 2 + data) > tcphdr_optlen) {
+            /* Bad length */
+            LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+            return;
+          }
+          for (data = (u8_t)(data - 2); data > 0; data = (u8_t)(data - 8)) {
+            u32_t left, right;
+            u8_t i;
+            left = right = 0;
+            for (i = 0; i < 4; i++) {
+              left = (left << 8) | tcp_get_next_optbyte();
+            }
+            for (i = 0; i < 4; i++) {
+              right = (right << 8) | tcp_get_next_optbyte();
+            }
+            tcp_sack_mark(pcb, left, right);
+          }
+          break;
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_FASTOPEN
+        case LWIP_TCP_OPT_FASTOPEN:
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: FASTOPEN\n"));
+          data = tcp_get_next_optbyte();
+          if ((data < 2) || (tcp_optidx - 2 + data) > tcphdr_optlen) {
+            /* Bad length */
+            LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+            return;
+          }
+          if (flags & TCP_SYN) {
+            /* An empty option asks for a cookie */
+            tcp_fastopen_opt = TCP_FASTOPEN_OPT;
+            if (data == 2 + LWIP_TCP_FASTOPEN_COOKIE_LEN) {
+              u8_t cookie[LWIP_TCP_FASTOPEN_COOKIE_LEN];
+              u8_t diff = 0;
+              u8_t i;
+              tcp_fastopen_cookie(ip_current_src_addr(), cookie);
+              for (i = 0; i < LWIP_TCP_FASTOPEN_COOKIE_LEN; i++) {
+                diff |= (u8_t)(cookie[i] ^ tcp_get_next_optbyte());
+              }
+              if (diff == 0) {
+                tcp_fastopen_opt = TCP_FASTOPEN_VALID;
+              }
+              data = 2;
+            }
+          }
+          tcp_optidx += data - 2;
+          break;
+#endif /* LWIP_TCP_FASTOPEN */
         default:
           LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: other\n"));
           data = tcp_get_next_optbyte();
@@ -2025,6 +2482,205 @@ tcp_parseopt(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_TCP_SYN_COOKIES || LWIP_TCP_FASTOPEN
+#define TCP_SYN_COOKIE_ROL(x, k) (((x) << (k)) | ((x) >> (32 - (k))))
+
+/* The final mix of Bob Jenkins' lookup3 hash */
+#define TCP_SYN_COOKIE_FINAL(a, b, c) do { \
+    c ^= b; c -= TCP_SYN_COOKIE_ROL(b, 14); \
+    a ^= c; a -= TCP_SYN_COOKIE_ROL(c, 11); \
+    b ^= a; b -= TCP_SYN_COOKIE_ROL(a, 25); \
+    c ^= b; c -= TCP_SYN_COOKIE_ROL(b, 16); \
+    a ^= c; a -= TCP_SYN_COOKIE_ROL(c, 4);  \
+    b ^= a; b -= TCP_SYN_COOKIE_ROL(a, 14); \
+    c ^= b; c -= TCP_SYN_COOKIE_ROL(b, 24); \
+  } while (0)
+#endif /* LWIP_TCP_SYN_COOKIES || LWIP_TCP_FASTOPEN */
+
+#if LWIP_TCP_SYN_COOKIES
+static u32_t tcp_syn_cookie_secret[4];
+static u8_t tcp_syn_cookie_seeded;
+
+/**
+ * Keyed hash of the 4-tuple of the segment being processed and count, with
+ * one of two secrets.
+ */
+static u32_t
+tcp_syn_cookie_hash(u8_t n, u32_t count)
+{
+  const ip_addr_t *src = ip_current_src_addr();
+  const ip_addr_t *dst = ip_current_dest_addr();
+  u32_t a, b, c;
+
+  if (!tcp_syn_cookie_seeded) {
+    for (a = 0; a < LWIP_ARRAYSIZE(tcp_syn_cookie_secret); a++) {
+      tcp_syn_cookie_secret[a] = (u32_t)LWIP_RAND();
+    }
+    tcp_syn_cookie_seeded = 1;
+  }
+
+  a = tcp_syn_cookie_secret[2 * n] ^ count;
+  b = ((u32_t)tcphdr->src << 16) | tcphdr->dest;
+  c = tcp_syn_cookie_secret[2 * n + 1];
+#if LWIP_IPV6
+  if (IP_IS_V6(src)) {
+    int i;
+    for (i = 0; i < 3; i++) {
+      a += ip_2_ip6(src)->addr[i];
+      b += ip_2_ip6(dst)->addr[i];
+      TCP_SYN_COOKIE_FINAL(a, b, c);
+    }
+    a += ip_2_ip6(src)->addr[3];
+    b += ip_2_ip6(dst)->addr[3];
+  } else
+#endif /* LWIP_IPV6 */
+  {
+#if LWIP_IPV4
+    a += ip4_addr_get_u32(ip_2_ip4(src));
+    b += ip4_addr_get_u32(ip_2_ip4(dst));
+#endif /* LWIP_IPV4 */
+  }
+  TCP_SYN_COOKIE_FINAL(a, b, c);
+  LWIP_UNUSED_ARG(src);
+  LWIP_UNUSED_ARG(dst);
+  return c;
+}
+
+/* The cookie counter, low 16 bits */
+#define TCP_SYN_COOKIE_COUNT() ((sys_now() >> TCP_SYN_COOKIE_PERIOD_SHIFT) & 0xffffU)
+
+/**
+ * Called by tcp_listen_input() to answer the SYN being processed with a SYN
+ * cookie. The cookie is
+ *   hash0 + ISN + (count << 24) + ((hash1(count) + data) & 0xffffff)
+ * where data keeps what the SYN's options negotiate, see TCP_SYN_COOKIE_MSS.
+ */
+static void
+tcp_syn_cookie_send(struct tcp_pcb_listen *pcb)
+{
+  u32_t count = TCP_SYN_COOKIE_COUNT();
+  u32_t cookie;
+  u16_t mss = 536;
+  u8_t data = 0;
+  u8_t optflags = 0;
+  u8_t i;
+
+  /* Parse the options of the SYN we can keep */
+  for (tcp_optidx = 0; tcp_optidx < tcphdr_optlen; ) {
+    u8_t opt = tcp_get_next_optbyte();
+    u8_t len;
+
+    if (opt == LWIP_TCP_OPT_EOL) {
+      break;
+    }
+    if (opt == LWIP_TCP_OPT_NOP) {
+      continue;
+    }
+    len = tcp_get_next_optbyte();
+    if ((len < 2) || ((tcp_optidx - 2 + len) > tcphdr_optlen)) {
+      /* Bad length */
+      break;
+    }
+    if ((opt == LWIP_TCP_OPT_MSS) && (len == LWIP_TCP_OPT_LEN_MSS)) {
+      mss = (u16_t)(tcp_get_next_optbyte() << 8);
+      mss |= tcp_get_next_optbyte();
+#if LWIP_WND_SCALE
+    } else if ((opt == LWIP_TCP_OPT_WS) && (len == LWIP_TCP_OPT_LEN_WS)) {
+      data |= (u8_t)((LWIP_MIN(tcp_get_next_optbyte(), 14U) + 1) << TCP_SYN_COOKIE_WS_SHIFT);
+      optflags |= TF_SEG_OPTS_WND_SCALE;
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+    } else if ((opt == LWIP_TCP_OPT_SACK_PERM) && (len == LWIP_TCP_OPT_LEN_SACK_PERM)) {
+      data |= TCP_SYN_COOKIE_SACK;
+      optflags |= TF_SEG_OPTS_SACK_PERM;
+#endif /* LWIP_TCP_SACK_OUT */
+    } else {
+      tcp_optidx = (u16_t)(tcp_optidx + len - 2);
+    }
+  }
+  for (i = LWIP_ARRAYSIZE(tcp_syn_cookie_mss) - 1; (i > 0) && (tcp_syn_cookie_mss[i] > mss); i--);
+  data |= i;
+
+  cookie = tcp_syn_cookie_hash(0, 0) + seqno + (count << 24) +
+           ((tcp_syn_cookie_hash(1, count) + data) & 0xffffffUL);
+  tcp_syn_cookie_synack(pcb, cookie, seqno + 1, optflags, ip_current_dest_addr(),
+                        ip_current_src_addr(), tcphdr->dest, tcphdr->src);
+}
+
+/**
+ * Called by tcp_listen_input() for an ACK: does it acknowledge a SYN cookie
+ * of ours that is no older than TCP_SYN_COOKIE_MAX_AGE periods?
+ *
+ * @param data returns what the cookie keeps of the SYN's options
+ * @return 1 if so, 0 if not
+ */
+static int
+tcp_syn_cookie_check(u8_t *data)
+{
+  u32_t count = TCP_SYN_COOKIE_COUNT();
+  u32_t cookie = (ackno - 1) - tcp_syn_cookie_hash(0, 0) - (seqno - 1);
+  u32_t age = (count - (cookie >> 24)) & 0xffU;
+  u32_t d;
+
+  if (age > TCP_SYN_COOKIE_MAX_AGE) {
+    return 0;
+  }
+  d = ((cookie & 0xffffffUL) - tcp_syn_cookie_hash(1, (count - age) & 0xffffU)) & 0xffffffUL;
+  if (d >= TCP_SYN_COOKIE_DATA_MAX) {
+    return 0;
+  }
+  *data = (u8_t)d;
+  return 1;
+}
+#endif /* LWIP_TCP_SYN_COOKIES */
+
+#if LWIP_TCP_FASTOPEN
+static u32_t tcp_fastopen_secret[3];
+static u8_t tcp_fastopen_seeded;
+
+/**
+ * The Fast Open cookie of a client: a keyed hash of its address, so it does
+ * not need to be stored and stays valid until reboot.
+ *
+ * @param client address of the client
+ * @param cookie where to store the LWIP_TCP_FASTOPEN_COOKIE_LEN bytes
+ */
+void
+tcp_fastopen_cookie(const ip_addr_t *client, u8_t *cookie)
+{
+  u32_t a, b, c;
+
+  if (!tcp_fastopen_seeded) {
+    for (a = 0; a < LWIP_ARRAYSIZE(tcp_fastopen_secret); a++) {
+      tcp_fastopen_secret[a] = (u32_t)LWIP_RAND();
+    }
+    tcp_fastopen_seeded = 1;
+  }
+
+  a = tcp_fastopen_secret[0];
+  b = tcp_fastopen_secret[1];
+  c = tcp_fastopen_secret[2];
+#if LWIP_IPV6
+  if (IP_IS_V6(client)) {
+    a += ip_2_ip6(client)->addr[0];
+    b += ip_2_ip6(client)->addr[1];
+    c += ip_2_ip6(client)->addr[2];
+    TCP_SYN_COOKIE_FINAL(a, b, c);
+    a += ip_2_ip6(client)->addr[3];
+  } else
+#endif /* LWIP_IPV6 */
+  {
+#if LWIP_IPV4
+    a += ip4_addr_get_u32(ip_2_ip4(client));
+#endif /* LWIP_IPV4 */
+  }
+  TCP_SYN_COOKIE_FINAL(a, b, c);
+  LWIP_UNUSED_ARG(client);
+  SMEMCPY(cookie, &b, sizeof(b));
+  SMEMCPY(cookie + sizeof(b), &c, sizeof(c));
+}
+#endif /* LWIP_TCP_FASTOPEN */
+
 void
 tcp_trigger_input_pcb_close(void)
 {
@@ -2132,47 +2788,44 @@ tcp_remove_sacks_lt(struct tcp_pcb *pcb, u32_t seq)
   }
 }
 
-#if defined(TCP_OOSEQ_BYTES_LIMIT) || defined(TCP_OOSEQ_PBUFS_LIMIT)
+#endif /* LWIP_TCP_SACK_OUT */
+
+#if LWIP_TCP_SACK_IN
 /**
- * Called to remove a range of SACKs.
+ * Called by tcp_parseopt() for each block of a received SACK option: marks
+ * the unacked segments the block covers, so they are skipped when holes are
+ * retransmitted. Blocks at or below the cumulative ACK (D-SACK) or beyond
+ * snd_nxt are ignored.
  *
- * SACK entries will be removed or adjusted to not acknowledge any sequence
- * numbers that are greater than (or equal to) 'seq' passed. It not only invalidates entries,
- * but also moves all entries that are still valid to the beginning.
- *
- * @param pcb the tcp_pcb to modify
- * @param seq the highest sequence number to keep in SACK entries
+ * @param pcb the tcp_pcb for which a segment arrived
+ * @param left the left edge of the block (the first sequence number)
+ * @param right the right edge of the block (the first sequence number past it)
  */
 static void
-tcp_remove_sacks_gt(struct tcp_pcb *pcb, u32_t seq)
+tcp_sack_mark(struct tcp_pcb *pcb, u32_t left, u32_t right)
 {
-  u8_t i;
-  u8_t unused_idx;
+  struct tcp_seg *seg;
 
-  /* We run this loop for all entries, until we find the first invalid one.
-     There is no point checking after that. */
-  for (i = unused_idx = 0; (i < LWIP_TCP_MAX_SACK_NUM) && LWIP_TCP_SACK_VALID(pcb, i); ++i) {
-    /* We only want to use SACK at index [i] if its left side is < 'seq'. */
-    if (TCP_SEQ_LT(pcb->rcv_sacks[i].left, seq)) {
-      if (unused_idx != i) {
-        /* We only copy it if it's not in the right spot already. */
-        pcb->rcv_sacks[unused_idx] = pcb->rcv_sacks[i];
-      }
-      /* NOTE: It is possible that its right side is > 'seq', in which case we should adjust it. */
-      if (TCP_SEQ_GT(pcb->rcv_sacks[unused_idx].right, seq)) {
-        pcb->rcv_sacks[unused_idx].right = seq;
+  if (((pcb->flags & TF_SACK) == 0) || !TCP_SEQ_LT(left, right) ||
+      !TCP_SEQ_GT(left, ackno) || TCP_SEQ_GT(right, pcb->snd_nxt)) {
+    return;
+  }
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    u32_t seg_left = lwip_ntohl(seg->tcphdr->seqno);
+    u32_t seg_right = seg_left + TCP_TCPLEN(seg);
+    if (TCP_SEQ_GEQ(seg_left, right)) {
+      /* unacked is sorted */
+      break;
+    }
+    if (TCP_SEQ_GEQ(seg_left, left) && TCP_SEQ_LEQ(seg_right, right)) {
+      seg->flags |= TF_SEG_SACKED;
+      if (!(pcb->flags & TF_SACKED) || TCP_SEQ_GT(seg_right, pcb->sack_high)) {
+        pcb->sack_high = seg_right;
       }
-      ++unused_idx;
+      tcp_set_flags(pcb, TF_SACKED);
     }
   }
-
-  /* We also need to invalidate everything from 'unused_idx' till the end */
-  for (i = unused_idx; i < LWIP_TCP_MAX_SACK_NUM; ++i) {
-    pcb->rcv_sacks[i].left = pcb->rcv_sacks[i].right = 0;
-  }
 }
-#endif /* TCP_OOSEQ_BYTES_LIMIT || TCP_OOSEQ_PBUFS_LIMIT */
-
-#endif /* LWIP_TCP_SACK_OUT */
+#endif /* LWIP_TCP_SACK_IN */
 
 #endif /* LWIP_TCP */
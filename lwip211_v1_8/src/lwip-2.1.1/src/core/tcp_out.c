@@ -99,15 +99,23 @@
 /* Define some copy-macros for checksum-on-copy so that the code looks
    nicer by preventing too many ifdef's. */
 #if TCP_CHECKSUM_ON_COPY
-#define TCP_DATA_COPY(dst, src, len, seg) do { \
-  tcp_seg_add_chksum(LWIP_CHKSUM_COPY(dst, src, len), \
-                     len, &seg->chksum, &seg->chksum_swapped); \
-  seg->flags |= TF_SEG_DATA_CHECKSUMMED; } while(0)
-#define TCP_DATA_COPY2(dst, src, len, chksum, chksum_swapped)  \
-  tcp_seg_add_chksum(LWIP_CHKSUM_COPY(dst, src, len), len, chksum, chksum_swapped);
+#define TCP_DATA_COPY(dst, src, len, seg, sum) do { \
+  if (sum) { \
+    tcp_seg_add_chksum(LWIP_CHKSUM_COPY(dst, src, len), \
+                       len, &seg->chksum, &seg->chksum_swapped); \
+  } else { \
+    MEMCPY(dst, src, len); \
+    seg->flags &= (u8_t)~TF_SEG_DATA_CHECKSUMMED; \
+  } } while(0)
+#define TCP_DATA_COPY2(dst, src, len, chksum, chksum_swapped, sum) do { \
+  if (sum) { \
+    tcp_seg_add_chksum(LWIP_CHKSUM_COPY(dst, src, len), len, chksum, chksum_swapped); \
+  } else { \
+    MEMCPY(dst, src, len); \
+  } } while(0)
 #else /* TCP_CHECKSUM_ON_COPY*/
-#define TCP_DATA_COPY(dst, src, len, seg)                     MEMCPY(dst, src, len)
-#define TCP_DATA_COPY2(dst, src, len, chksum, chksum_swapped) MEMCPY(dst, src, len)
+#define TCP_DATA_COPY(dst, src, len, seg, sum)                     MEMCPY(dst, src, len)
+#define TCP_DATA_COPY2(dst, src, len, chksum, chksum_swapped, sum) MEMCPY(dst, src, len)
 #endif /* TCP_CHECKSUM_ON_COPY*/
 
 /** Define this to 1 for an extra check that the output checksum is valid
@@ -140,11 +148,33 @@ tcp_route(const struct tcp_pcb *pcb, const ip_addr_t *src, const ip_addr_t *dst)
 
   if ((pcb != NULL) && (pcb->netif_idx != NETIF_NO_INDEX)) {
     return netif_get_by_index(pcb->netif_idx);
+  } else if (pcb != NULL) {
+    return ip_route_hinted(src, dst, LWIP_CONST_CAST(struct ip4_route_hint *, &pcb->route_hint));
   } else {
     return ip_route(src, dst);
   }
 }
 
+#if TCP_SEG_IN_PBUF
+/**
+ * Where a tcp_seg for p goes in its headroom, or NULL if p was not allocated
+ * with PBUF_TCP_SEG (or is not ours alone to put it in).
+ */
+static struct tcp_seg *
+tcp_seg_in_pbuf(struct pbuf *p)
+{
+  u8_t *seg = (u8_t *)LWIP_MEM_ALIGN((u8_t *)p + LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf)));
+
+  if (!pbuf_match_allocsrc(p, PBUF_RAM) || (p->flags & PBUF_FLAG_IS_CUSTOM) || (p->ref != 1)) {
+    return NULL;
+  }
+  if ((u8_t *)p->payload < seg + TCP_SEG_PBUF_HLEN + PBUF_TRANSPORT) {
+    return NULL;
+  }
+  return (struct tcp_seg *)(void *)seg;
+}
+#endif /* TCP_SEG_IN_PBUF */
+
 /**
  * Create a TCP segment with prefilled header.
  *
@@ -170,12 +200,20 @@ tcp_create_segment(const struct tcp_pcb *pcb, struct pbuf *p, u8_t hdrflags, u32
 
   optlen = LWIP_TCP_OPT_LENGTH_SEGMENT(optflags, pcb);
 
-  if ((seg = (struct tcp_seg *)memp_malloc(MEMP_TCP_SEG)) == NULL) {
-    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_create_segment: no memory.\n"));
-    pbuf_free(p);
-    return NULL;
+#if TCP_SEG_IN_PBUF
+  seg = tcp_seg_in_pbuf(p);
+  if (seg != NULL) {
+    seg->flags = optflags | TF_SEG_IN_PBUF;
+  } else
+#endif /* TCP_SEG_IN_PBUF */
+  {
+    if ((seg = (struct tcp_seg *)memp_malloc(MEMP_TCP_SEG)) == NULL) {
+      LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_create_segment: no memory.\n"));
+      pbuf_free(p);
+      return NULL;
+    }
+    seg->flags = optflags;
   }
-  seg->flags = optflags;
   seg->next = NULL;
   seg->p = p;
   LWIP_ASSERT("p->tot_len >= optlen", p->tot_len >= optlen);
@@ -257,7 +295,7 @@ tcp_pbuf_prealloc(pbuf_layer layer, u16_t length, u16_t max_length,
      * Will the Nagle algorithm defer transmission of this segment?
      */
     if ((apiflags & TCP_WRITE_FLAG_MORE) ||
-        (!(pcb->flags & TF_NODELAY) &&
+        (!tcp_nodelay_now(pcb) &&
          (!first_seg ||
           pcb->unsent != NULL ||
           pcb->unacked != NULL))) {
@@ -298,6 +336,54 @@ tcp_seg_add_chksum(u16_t chksum, u16_t len, u16_t *seg_chksum,
   }
   *seg_chksum = chksum;
 }
+
+/** Checksum all data of a segment, for retransmissions to reuse.
+ *
+ * Called by tcp_split_unsent_seg and by tcp_output_segment for segments
+ * that tcp_write did not sum.
+ */
+static void
+tcp_seg_chksum_data(struct tcp_seg *seg)
+{
+  struct pbuf *q = seg->p;
+  u16_t offset = q->tot_len - seg->len; /* Offset due to exposed headers */
+
+  seg->chksum = 0;
+  seg->chksum_swapped = 0;
+  /* Advance to the pbuf where the offset ends */
+  while (q != NULL && offset > q->len) {
+    offset -= q->len;
+    q = q->next;
+  }
+  LWIP_ASSERT("Found start of payload pbuf", q != NULL);
+  /* Checksum the first payload pbuf accounting for offset, then other pbufs are all payload */
+  for (; q != NULL; offset = 0, q = q->next) {
+    tcp_seg_add_chksum(~inet_chksum((const u8_t *)q->payload + offset, q->len - offset), q->len - offset,
+                       &seg->chksum, &seg->chksum_swapped);
+  }
+  seg->flags |= TF_SEG_DATA_CHECKSUMMED;
+}
+
+/** Whether tcp_write should sum the data it queues.
+ *
+ * Not when the pcb goes out through a netif that leaves TCP checksums to
+ * its hardware or peer. Should the route change before the data is sent,
+ * tcp_output_segment sums what tcp_write left out.
+ */
+static u8_t
+tcp_write_chksum(const struct tcp_pcb *pcb)
+{
+#if LWIP_CHECKSUM_CTRL_PER_NETIF
+  struct netif *netif = tcp_route(pcb, &pcb->local_ip, &pcb->remote_ip);
+
+  if ((netif != NULL) && ((netif->chksum_flags & NETIF_CHECKSUM_GEN_TCP) == 0)) {
+    return 0;
+  }
+#else /* LWIP_CHECKSUM_CTRL_PER_NETIF */
+  LWIP_UNUSED_ARG(pcb);
+#endif /* LWIP_CHECKSUM_CTRL_PER_NETIF */
+  return 1;
+}
 #endif /* TCP_CHECKSUM_ON_COPY */
 
 /** Checks if tcp_write is allowed or not (checks state, snd_buf and snd_queuelen).
@@ -412,6 +498,9 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
   u16_t concat_chksum = 0;
   u8_t concat_chksum_swapped = 0;
   u16_t concat_chksummed = 0;
+  /* sum the data into new segments, and into last_unsent if its data is summed */
+  u8_t chksum_new;
+  u8_t chksum_last;
 #endif /* TCP_CHECKSUM_ON_COPY */
   err_t err;
   u16_t mss_local;
@@ -439,6 +528,10 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     return err;
   }
   queuelen = pcb->snd_queuelen;
+#if TCP_CHECKSUM_ON_COPY
+  chksum_new = tcp_write_chksum(pcb);
+  chksum_last = chksum_new;
+#endif /* TCP_CHECKSUM_ON_COPY */
 
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP)) {
@@ -485,6 +578,11 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     /* @todo: this could be sped up by keeping last_unsent in the pcb */
     for (last_unsent = pcb->unsent; last_unsent->next != NULL;
          last_unsent = last_unsent->next);
+#if TCP_CHECKSUM_ON_COPY
+    if ((last_unsent->len > 0) && !(last_unsent->flags & TF_SEG_DATA_CHECKSUMMED)) {
+      chksum_last = 0;
+    }
+#endif /* TCP_CHECKSUM_ON_COPY */
 
     /* Usable space at the end of the last unsent segment */
     unsent_optlen = LWIP_TCP_OPT_LENGTH_SEGMENT(last_unsent->flags, pcb);
@@ -551,9 +649,12 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 #if TCP_OVERSIZE_DBGCHECK
         oversize_add = oversize;
 #endif /* TCP_OVERSIZE_DBGCHECK */
-        TCP_DATA_COPY2(concat_p->payload, (const u8_t *)arg + pos, seglen, &concat_chksum, &concat_chksum_swapped);
+        TCP_DATA_COPY2(concat_p->payload, (const u8_t *)arg + pos, seglen, &concat_chksum, &concat_chksum_swapped,
+                       chksum_last);
 #if TCP_CHECKSUM_ON_COPY
-        concat_chksummed += seglen;
+        if (chksum_last) {
+          concat_chksummed += seglen;
+        }
 #endif /* TCP_CHECKSUM_ON_COPY */
         queuelen += pbuf_clen(concat_p);
       } else {
@@ -576,10 +677,12 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
           queuelen += pbuf_clen(concat_p);
         }
 #if TCP_CHECKSUM_ON_COPY
-        /* calculate the checksum of nocopy-data */
-        tcp_seg_add_chksum(~inet_chksum((const u8_t *)arg + pos, seglen), seglen,
-                           &concat_chksum, &concat_chksum_swapped);
-        concat_chksummed += seglen;
+        if (chksum_last) {
+          /* calculate the checksum of nocopy-data */
+          tcp_seg_add_chksum(~inet_chksum((const u8_t *)arg + pos, seglen), seglen,
+                             &concat_chksum, &concat_chksum_swapped);
+          concat_chksummed += seglen;
+        }
 #endif /* TCP_CHECKSUM_ON_COPY */
       }
 
@@ -612,13 +715,14 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     if (apiflags & TCP_WRITE_FLAG_COPY) {
       /* If copy is set, memory should be allocated and data copied
        * into pbuf */
-      if ((p = tcp_pbuf_prealloc(PBUF_TRANSPORT, seglen + optlen, mss_local, &oversize, pcb, apiflags, queue == NULL)) == NULL) {
+      if ((p = tcp_pbuf_prealloc(PBUF_TCP_SEG, seglen + optlen, mss_local, &oversize, pcb, apiflags, queue == NULL)) == NULL) {
         LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_write : could not allocate memory for pbuf copy size %"U16_F"\n", seglen));
         goto memerr;
       }
       LWIP_ASSERT("tcp_write: check that first pbuf can hold the complete seglen",
                   (p->len >= seglen));
-      TCP_DATA_COPY2((char *)p->payload + optlen, (const u8_t *)arg + pos, seglen, &chksum, &chksum_swapped);
+      TCP_DATA_COPY2((char *)p->payload + optlen, (const u8_t *)arg + pos, seglen, &chksum, &chksum_swapped,
+                     chksum_new);
     } else {
       /* Copy is not set: First allocate a pbuf for holding the data.
        * Since the referenced data is available at least until it is
@@ -634,18 +738,20 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
         goto memerr;
       }
 #if TCP_CHECKSUM_ON_COPY
-      /* calculate the checksum of nocopy-data */
-      chksum = ~inet_chksum((const u8_t *)arg + pos, seglen);
-      if (seglen & 1) {
-        chksum_swapped = 1;
-        chksum = SWAP_BYTES_IN_WORD(chksum);
+      if (chksum_new) {
+        /* calculate the checksum of nocopy-data */
+        chksum = ~inet_chksum((const u8_t *)arg + pos, seglen);
+        if (seglen & 1) {
+          chksum_swapped = 1;
+          chksum = SWAP_BYTES_IN_WORD(chksum);
+        }
       }
 #endif /* TCP_CHECKSUM_ON_COPY */
       /* reference the non-volatile payload data */
       ((struct pbuf_rom *)p2)->payload = (const u8_t *)arg + pos;
 
       /* Second, allocate a pbuf for the headers. */
-      if ((p = pbuf_alloc(PBUF_TRANSPORT, optlen, PBUF_RAM)) == NULL) {
+      if ((p = pbuf_alloc(PBUF_TCP_SEG, optlen, PBUF_RAM)) == NULL) {
         /* If allocation fails, we have to deallocate the data pbuf as
          * well. */
         pbuf_free(p2);
@@ -675,9 +781,11 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     seg->oversize_left = oversize;
 #endif /* TCP_OVERSIZE_DBGCHECK */
 #if TCP_CHECKSUM_ON_COPY
-    seg->chksum = chksum;
-    seg->chksum_swapped = chksum_swapped;
-    seg->flags |= TF_SEG_DATA_CHECKSUMMED;
+    if (chksum_new) {
+      seg->chksum = chksum;
+      seg->chksum_swapped = chksum_swapped;
+      seg->flags |= TF_SEG_DATA_CHECKSUMMED;
+    }
 #endif /* TCP_CHECKSUM_ON_COPY */
 
     /* first segment of to-be-queued data? */
@@ -719,7 +827,7 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     for (p = last_unsent->p; p; p = p->next) {
       p->tot_len += oversize_used;
       if (p->next == NULL) {
-        TCP_DATA_COPY((char *)p->payload + p->len, arg, oversize_used, last_unsent);
+        TCP_DATA_COPY((char *)p->payload + p->len, arg, oversize_used, last_unsent, chksum_last);
         p->len += oversize_used;
       }
     }
@@ -765,6 +873,9 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     tcp_seg_add_chksum(concat_chksum, concat_chksummed, &last_unsent->chksum,
                        &last_unsent->chksum_swapped);
     last_unsent->flags |= TF_SEG_DATA_CHECKSUMMED;
+  } else if ((concat_p != NULL) || (extendlen > 0)) {
+    /* not summed, tcp_output_segment sums the whole segment if needed */
+    last_unsent->flags &= (u8_t)~TF_SEG_DATA_CHECKSUMMED;
   }
 #endif /* TCP_CHECKSUM_ON_COPY */
 
@@ -842,7 +953,6 @@ tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split)
 #if TCP_CHECKSUM_ON_COPY
   u16_t chksum = 0;
   u8_t chksum_swapped = 0;
-  struct pbuf *q;
 #endif /* TCP_CHECKSUM_ON_COPY */
 
   LWIP_ASSERT("tcp_split_unsent_seg: invalid pcb", pcb != NULL);
@@ -875,11 +985,15 @@ tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split)
   /* Remove since checksum is not stored until after tcp_create_segment() */
   optflags &= ~TF_SEG_DATA_CHECKSUMMED;
 #endif /* TCP_CHECKSUM_ON_COPY */
+#if TCP_SEG_IN_PBUF
+  /* Where the remainder lives is up to tcp_create_segment() */
+  optflags &= ~TF_SEG_IN_PBUF;
+#endif /* TCP_SEG_IN_PBUF */
   optlen = LWIP_TCP_OPT_LENGTH(optflags);
   remainder = useg->len - split;
 
   /* Create new pbuf for the remainder of the split */
-  p = pbuf_alloc(PBUF_TRANSPORT, remainder + optlen, PBUF_RAM);
+  p = pbuf_alloc(PBUF_TCP_SEG, remainder + optlen, PBUF_RAM);
   if (p == NULL) {
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS,
                 ("tcp_split_unsent_seg: could not allocate memory for pbuf remainder %u\n", remainder));
@@ -895,9 +1009,11 @@ tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split)
     goto memerr;
   }
 #if TCP_CHECKSUM_ON_COPY
-  /* calculate the checksum on remainder data */
-  tcp_seg_add_chksum(~inet_chksum((const u8_t *)p->payload + optlen, remainder), remainder,
-                     &chksum, &chksum_swapped);
+  if (useg->flags & TF_SEG_DATA_CHECKSUMMED) {
+    /* calculate the checksum on remainder data */
+    tcp_seg_add_chksum(~inet_chksum((const u8_t *)p->payload + optlen, remainder), remainder,
+                       &chksum, &chksum_swapped);
+  }
 #endif /* TCP_CHECKSUM_ON_COPY */
 
   /* Options are created when calling tcp_output() */
@@ -924,9 +1040,11 @@ tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split)
   }
 
 #if TCP_CHECKSUM_ON_COPY
-  seg->chksum = chksum;
-  seg->chksum_swapped = chksum_swapped;
-  seg->flags |= TF_SEG_DATA_CHECKSUMMED;
+  if (useg->flags & TF_SEG_DATA_CHECKSUMMED) {
+    seg->chksum = chksum;
+    seg->chksum_swapped = chksum_swapped;
+    seg->flags |= TF_SEG_DATA_CHECKSUMMED;
+  }
 #endif /* TCP_CHECKSUM_ON_COPY */
 
   /* Remove this segment from the queue since trimming it may free pbufs */
@@ -946,22 +1064,9 @@ tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split)
   pcb->snd_queuelen += pbuf_clen(useg->p);
 
 #if TCP_CHECKSUM_ON_COPY
-  /* The checksum on the split segment is now incorrect. We need to re-run it over the split */
-  useg->chksum = 0;
-  useg->chksum_swapped = 0;
-  q = useg->p;
-  offset = q->tot_len - useg->len; /* Offset due to exposed headers */
-
-  /* Advance to the pbuf where the offset ends */
-  while (q != NULL && offset > q->len) {
-    offset -= q->len;
-    q = q->next;
-  }
-  LWIP_ASSERT("Found start of payload pbuf", q != NULL);
-  /* Checksum the first payload pbuf accounting for offset, then other pbufs are all payload */
-  for (; q != NULL; offset = 0, q = q->next) {
-    tcp_seg_add_chksum(~inet_chksum((const u8_t *)q->payload + offset, q->len - offset), q->len - offset,
-                       &useg->chksum, &useg->chksum_swapped);
+  if (useg->flags & TF_SEG_DATA_CHECKSUMMED) {
+    /* The checksum on the split segment is now incorrect. We need to re-run it over the split */
+    tcp_seg_chksum_data(useg);
   }
 #endif /* TCP_CHECKSUM_ON_COPY */
 
@@ -1067,6 +1172,12 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
       optflags |= TF_SEG_OPTS_SACK_PERM;
     }
 #endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_FASTOPEN
+    if (pcb->flags & TF_FASTOPEN) {
+      /* The SYN asked for (or carried) a Fast Open cookie */
+      optflags |= TF_SEG_OPTS_FASTOPEN;
+    }
+#endif /* LWIP_TCP_FASTOPEN */
   }
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP) || ((flags & TCP_SYN) && (pcb->state != SYN_RCVD))) {
@@ -1078,7 +1189,7 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
   optlen = LWIP_TCP_OPT_LENGTH_SEGMENT(optflags, pcb);
 
   /* Allocate pbuf with room for TCP header + options */
-  if ((p = pbuf_alloc(PBUF_TRANSPORT, optlen, PBUF_RAM)) == NULL) {
+  if ((p = pbuf_alloc(PBUF_TCP_SEG, optlen, PBUF_RAM)) == NULL) {
     tcp_set_flags(pcb, TF_NAGLEMEMERR);
     TCP_STATS_INC(tcp.memerr);
     return ERR_MEM;
@@ -1238,7 +1349,7 @@ tcp_build_wnd_scale_option(u32_t *opts)
  * @return ERR_OK if data has been sent or nothing to send
  *         another err_t on error
  */
-err_t
+LWIP_HOT_TEXT err_t
 tcp_output(struct tcp_pcb *pcb)
 {
   struct tcp_seg *seg, *useg;
@@ -1256,6 +1367,8 @@ tcp_output(struct tcp_pcb *pcb)
   LWIP_ASSERT("don't call tcp_output for listen-pcbs",
               pcb->state != LISTEN);
 
+  PERF_START;
+
   /* First, check if we are invoked by the TCP input processing
      code. If so, we do not output anything. Instead, we rely on the
      input processing code to call us when input processing is done
@@ -1318,6 +1431,7 @@ tcp_output(struct tcp_pcb *pcb)
       pcb->persist_cnt = 0;
       pcb->persist_backoff = 1;
       pcb->persist_probe = 0;
+      TCP_TMR_NEEDED();
     }
     /* We need an ACK, but can't send data now, so send an empty ACK */
     if (pcb->flags & TF_ACK_NOW) {
@@ -1333,6 +1447,8 @@ tcp_output(struct tcp_pcb *pcb)
   if (useg != NULL) {
     for (; useg->next != NULL; useg = useg->next);
   }
+  /* the segments sent below go to the driver in one burst */
+  NETIF_BURST_BEGIN(netif);
   /* data available and window allows it to be sent? */
   while (seg != NULL &&
          lwip_ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len <= wnd) {
@@ -1365,6 +1481,7 @@ tcp_output(struct tcp_pcb *pcb)
     err = tcp_output_segment(seg, pcb, netif);
     if (err != ERR_OK) {
       /* segment could not be sent, for whatever reason */
+      NETIF_BURST_END(netif);
       tcp_set_flags(pcb, TF_NAGLEMEMERR);
       return err;
     }
@@ -1374,6 +1491,7 @@ tcp_output(struct tcp_pcb *pcb)
     pcb->unsent = seg->next;
     if (pcb->state != SYN_SENT) {
       tcp_clear_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+      tcp_ack_sent(pcb);
     }
     snd_nxt = lwip_ntohl(seg->tcphdr->seqno) + TCP_TCPLEN(seg);
     if (TCP_SEQ_LT(pcb->snd_nxt, snd_nxt)) {
@@ -1412,6 +1530,7 @@ tcp_output(struct tcp_pcb *pcb)
     }
     seg = pcb->unsent;
   }
+  NETIF_BURST_END(netif);
 #if TCP_OVERSIZE
   if (pcb->unsent == NULL) {
     /* last unsent has been removed, reset unsent_oversize */
@@ -1421,6 +1540,7 @@ tcp_output(struct tcp_pcb *pcb)
 
 output_done:
   tcp_clear_flags(pcb, TF_NAGLEMEMERR);
+  PERF_STOP("tcp_output");
   return ERR_OK;
 }
 
@@ -1456,7 +1576,7 @@ tcp_output_segment_busy(const struct tcp_seg *seg)
  * @param pcb the tcp_pcb for the TCP connection used to send the segment
  * @param netif the netif used to send the segment
  */
-static err_t
+static LWIP_HOT_TEXT err_t
 tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif)
 {
   err_t err;
@@ -1533,14 +1653,26 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
     *(opts++) = PP_HTONL(0x01010402);
   }
 #endif
+#if LWIP_TCP_FASTOPEN
+  if (seg->flags & TF_SEG_OPTS_FASTOPEN) {
+    /* Pad with two NOP options to make everything nicely aligned */
+    *(opts++) = PP_HTONL(0x01010000 | (LWIP_TCP_OPT_FASTOPEN << 8) | (2 + LWIP_TCP_FASTOPEN_COOKIE_LEN));
+    tcp_fastopen_cookie(&pcb->remote_ip, (u8_t *)opts);
+    opts += LWIP_TCP_FASTOPEN_COOKIE_LEN / 4;
+  }
+#endif /* LWIP_TCP_FASTOPEN */
 
   /* Set retransmission timer running if it is not currently enabled
      This must be set before checking the route. */
   if (pcb->rtime < 0) {
     pcb->rtime = 0;
+    TCP_TMR_NEEDED();
   }
 
   if (pcb->rttest == 0) {
+#if TCP_TMR_COALESCE
+    tcp_update_ticks();
+#endif /* TCP_TMR_COALESCE */
     pcb->rttest = tcp_ticks;
     pcb->rtseq = lwip_ntohl(seg->tcphdr->seqno);
 
@@ -1576,9 +1708,10 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
     u16_t chksum_slow = ip_chksum_pseudo(seg->p, IP_PROTO_TCP,
                                          seg->p->tot_len, &pcb->local_ip, &pcb->remote_ip);
 #endif /* TCP_CHECKSUM_ON_COPY_SANITY_CHECK */
-    if ((seg->flags & TF_SEG_DATA_CHECKSUMMED) == 0) {
-      LWIP_ASSERT("data included but not checksummed",
-                  seg->p->tot_len == TCPH_HDRLEN_BYTES(seg->tcphdr));
+    if (((seg->flags & TF_SEG_DATA_CHECKSUMMED) == 0) && (seg->len > 0)) {
+      /* tcp_write did not sum the data (see tcp_write_chksum), do it once
+         here so that retransmissions only redo the header */
+      tcp_seg_chksum_data(seg);
     }
 
     /* rebuild TCP header checksum (TCP header changes for retransmissions!) */
@@ -1657,6 +1790,16 @@ tcp_rexmit_rto_prepare(struct tcp_pcb *pcb)
     LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_rexmit_rto: segment busy\n"));
     return ERR_VAL;
   }
+#if LWIP_TCP_SACK_IN
+  /* everything goes out again: forget the SACK scoreboard (RFC 6675, section 5.1) */
+  if (pcb->flags & TF_SACKED) {
+    struct tcp_seg *sseg;
+    for (sseg = pcb->unacked; sseg != NULL; sseg = sseg->next) {
+      sseg->flags &= (u8_t)~TF_SEG_SACKED;
+    }
+    tcp_clear_flags(pcb, TF_SACKED);
+  }
+#endif /* LWIP_TCP_SACK_IN */
   /* concatenate unsent queue after unacked queue */
   seg->next = pcb->unsent;
 #if TCP_OVERSIZE_DBGCHECK
@@ -1718,6 +1861,37 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
   }
 }
 
+/**
+ * Insert a segment taken off the unacked queue into the unsent queue, sorted
+ * by sequence number, for tcp_output() to send it again.
+ */
+static void
+tcp_rexmit_requeue(struct tcp_pcb *pcb, struct tcp_seg *seg)
+{
+  struct tcp_seg **cur_seg;
+
+  /* Keep the unsent queue sorted. */
+  cur_seg = &(pcb->unsent);
+  while (*cur_seg &&
+         TCP_SEQ_LT(lwip_ntohl((*cur_seg)->tcphdr->seqno), lwip_ntohl(seg->tcphdr->seqno))) {
+    cur_seg = &((*cur_seg)->next );
+  }
+  seg->next = *cur_seg;
+  *cur_seg = seg;
+#if TCP_OVERSIZE
+  if (seg->next == NULL) {
+    /* the retransmitted segment is last in unsent, so reset unsent_oversize */
+    pcb->unsent_oversize = 0;
+  }
+#endif /* TCP_OVERSIZE */
+#if LWIP_TCP_SACK_IN
+  pcb->sack_rexmit = lwip_ntohl(seg->tcphdr->seqno) + TCP_TCPLEN(seg);
+#endif /* LWIP_TCP_SACK_IN */
+
+  /* Don't take any rtt measurements after retransmitting. */
+  pcb->rttest = 0;
+}
+
 /**
  * Requeue the first unacked segment for retransmission
  *
@@ -1729,7 +1903,6 @@ err_t
 tcp_rexmit(struct tcp_pcb *pcb)
 {
   struct tcp_seg *seg;
-  struct tcp_seg **cur_seg;
 
   LWIP_ASSERT("tcp_rexmit: invalid pcb", pcb != NULL);
 
@@ -1747,30 +1920,13 @@ tcp_rexmit(struct tcp_pcb *pcb)
   }
 
   /* Move the first unacked segment to the unsent queue */
-  /* Keep the unsent queue sorted. */
   pcb->unacked = seg->next;
-
-  cur_seg = &(pcb->unsent);
-  while (*cur_seg &&
-         TCP_SEQ_LT(lwip_ntohl((*cur_seg)->tcphdr->seqno), lwip_ntohl(seg->tcphdr->seqno))) {
-    cur_seg = &((*cur_seg)->next );
-  }
-  seg->next = *cur_seg;
-  *cur_seg = seg;
-#if TCP_OVERSIZE
-  if (seg->next == NULL) {
-    /* the retransmitted segment is last in unsent, so reset unsent_oversize */
-    pcb->unsent_oversize = 0;
-  }
-#endif /* TCP_OVERSIZE */
+  tcp_rexmit_requeue(pcb, seg);
 
   if (pcb->nrtx < 0xFF) {
     ++pcb->nrtx;
   }
 
-  /* Don't take any rtt measurements after retransmitting. */
-  pcb->rttest = 0;
-
   /* Do the actual retransmission. */
   MIB2_STATS_INC(mib2.tcpretranssegs);
   /* No need to call tcp_output: we are always called from tcp_input()
@@ -1778,6 +1934,51 @@ tcp_rexmit(struct tcp_pcb *pcb)
   return ERR_OK;
 }
 
+#if LWIP_TCP_SACK_IN
+/**
+ * Requeue the first hole for retransmission: the first unacked segment below
+ * the highest SACKed byte that is neither SACKed nor retransmitted yet in
+ * this fast recovery.
+ *
+ * Called by tcp_receive() for each duplicate or partial ACK in fast recovery.
+ *
+ * @param pcb the tcp_pcb for which to retransmit a hole
+ * @return ERR_OK if a segment was requeued, ERR_VAL if there is no hole to fill
+ */
+err_t
+tcp_rexmit_sack(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  struct tcp_seg **prev;
+
+  LWIP_ASSERT("tcp_rexmit_sack: invalid pcb", pcb != NULL);
+
+  if ((pcb->flags & TF_SACKED) == 0) {
+    return ERR_VAL;
+  }
+  for (prev = &pcb->unacked; (seg = *prev) != NULL; prev = &seg->next) {
+    u32_t seqno = lwip_ntohl(seg->tcphdr->seqno);
+    if (!TCP_SEQ_LT(seqno, pcb->sack_high)) {
+      return ERR_VAL;
+    }
+    if (!(seg->flags & TF_SEG_SACKED) && TCP_SEQ_GEQ(seqno, pcb->sack_rexmit)) {
+      break;
+    }
+  }
+  if ((seg == NULL) || tcp_output_segment_busy(seg)) {
+    return ERR_VAL;
+  }
+
+  LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rexmit_sack: hole %"U32_F" (sack_high %"U32_F")\n",
+                             lwip_ntohl(seg->tcphdr->seqno), pcb->sack_high));
+  *prev = seg->next;
+  tcp_rexmit_requeue(pcb, seg);
+
+  MIB2_STATS_INC(mib2.tcpretranssegs);
+  return ERR_OK;
+}
+#endif /* LWIP_TCP_SACK_IN */
+
 
 /**
  * Handle retransmission after three dupacks received
@@ -1797,9 +1998,16 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                  (u16_t)pcb->dupacks, pcb->lastack,
                  lwip_ntohl(pcb->unacked->tcphdr->seqno)));
     if (tcp_rexmit(pcb) == ERR_OK) {
-      /* Set ssthresh to half of the minimum of the current
-       * cwnd and the advertised window */
-      pcb->ssthresh = LWIP_MIN(pcb->cwnd, pcb->snd_wnd) / 2;
+#if LWIP_TCP_CC
+      if (pcb->cc != NULL) {
+        pcb->cc->loss(pcb, 0);
+      } else
+#endif /* LWIP_TCP_CC */
+      {
+        /* Set ssthresh to half of the minimum of the current
+         * cwnd and the advertised window */
+        pcb->ssthresh = LWIP_MIN(pcb->cwnd, pcb->snd_wnd) / 2;
+      }
 
       /* The minimum value for ssthresh should be 2 MSS */
       if (pcb->ssthresh < (2U * pcb->mss)) {
@@ -2015,6 +2223,105 @@ tcp_rst(const struct tcp_pcb *pcb, u32_t seqno, u32_t ackno,
   LWIP_DEBUGF(TCP_RST_DEBUG, ("tcp_rst: seqno %"U32_F" ackno %"U32_F".\n", seqno, ackno));
 }
 
+#if LWIP_TCP_SYN_COOKIES
+/**
+ * Send the SYN|ACK of a SYN cookie: like the one tcp_enqueue_flags() queues
+ * in SYN_RCVD, but without a pcb and never retransmitted.
+ *
+ * Called by tcp_listen_input().
+ *
+ * @param lpcb the listening pcb the SYN arrived for
+ * @param iss the cookie, sent as sequence number
+ * @param ackno the acknowledge number (the peer's ISN + 1)
+ * @param optflags TF_SEG_OPTS_WND_SCALE and/or TF_SEG_OPTS_SACK_PERM to echo
+ *                 the peer's options, the MSS option is always sent
+ * @param local_ip the local IP address to send the segment from
+ * @param remote_ip the remote IP address to send the segment to
+ * @param local_port the local TCP port to send the segment from
+ * @param remote_port the remote TCP port to send the segment to
+ */
+void
+tcp_syn_cookie_synack(const struct tcp_pcb_listen *lpcb, u32_t iss, u32_t ackno, u8_t optflags,
+                      const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
+                      u16_t local_port, u16_t remote_port)
+{
+  struct pbuf *p;
+  u32_t *opts;
+  u16_t mss;
+  u8_t optlen;
+
+  LWIP_ASSERT("tcp_syn_cookie_synack: invalid local_ip", local_ip != NULL);
+  LWIP_ASSERT("tcp_syn_cookie_synack: invalid remote_ip", remote_ip != NULL);
+
+  optflags = (u8_t)(TF_SEG_OPTS_MSS | (optflags & (TF_SEG_OPTS_WND_SCALE | TF_SEG_OPTS_SACK_PERM)));
+  optlen = LWIP_TCP_OPT_LENGTH(optflags);
+
+  /* the window of a SYN is never scaled */
+  p = tcp_output_alloc_header_common(ackno, optlen, 0, lwip_htonl(iss), local_port,
+    remote_port, TCP_SYN | TCP_ACK, TCPWND_MIN16(TCP_WND));
+  if (p == NULL) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_syn_cookie_synack: could not allocate memory for pbuf\n"));
+    return;
+  }
+
+  opts = (u32_t *)(void *)((struct tcp_hdr *)p->payload + 1);
+#if TCP_CALCULATE_EFF_SEND_MSS
+  mss = tcp_eff_send_mss(TCP_MSS, local_ip, remote_ip);
+#else /* TCP_CALCULATE_EFF_SEND_MSS */
+  mss = TCP_MSS;
+#endif /* TCP_CALCULATE_EFF_SEND_MSS */
+  *(opts++) = TCP_BUILD_MSS_OPTION(mss);
+#if LWIP_WND_SCALE
+  if (optflags & TF_SEG_OPTS_WND_SCALE) {
+    tcp_build_wnd_scale_option(opts);
+    opts += 1;
+  }
+#endif
+#if LWIP_TCP_SACK_OUT
+  if (optflags & TF_SEG_OPTS_SACK_PERM) {
+    *(opts++) = PP_HTONL(0x01010402);
+  }
+#endif
+  LWIP_ASSERT("options not filled", (u8_t *)opts == ((u8_t *)p->payload) + TCP_HLEN + optlen);
+  LWIP_UNUSED_ARG(opts); /* for LWIP_NOASSERT */
+
+  tcp_output_control_segment((const struct tcp_pcb *)lpcb, p, local_ip, remote_ip);
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_syn_cookie_synack: cookie %"U32_F" ackno %"U32_F".\n", iss, ackno));
+}
+#endif /* LWIP_TCP_SYN_COOKIES */
+
+#if TCP_TW_COMPACT
+/**
+ * Send an ACK for a compact TIME-WAIT record, the empty ACK its pcb would
+ * have sent.
+ *
+ * Called by tcp_input() for segments of a connection in TIME-WAIT.
+ *
+ * @param tw the record of the connection
+ */
+void
+tcp_tw_ack(const struct tcp_tw *tw)
+{
+  struct pbuf *p;
+  u8_t optlen;
+
+  LWIP_ASSERT("tcp_tw_ack: invalid tw", tw != NULL);
+
+  optlen = LWIP_TCP_OPT_LENGTH_SEGMENT(0, NULL);
+  p = tcp_output_alloc_header_common(tw->rcv_nxt, optlen, 0, lwip_htonl(tw->snd_nxt),
+                                     tw->local_port, tw->remote_port, TCP_ACK,
+                                     lwip_htons(tw->wnd));
+  if (p == NULL) {
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_tw_ack: could not allocate pbuf\n"));
+    return;
+  }
+  tcp_output_fill_options(NULL, p, 0, 0);
+
+  LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_tw_ack: sending ACK for %"U32_F"\n", tw->rcv_nxt));
+  tcp_output_control_segment(NULL, p, &tw->local_ip, &tw->remote_ip);
+}
+#endif /* TCP_TW_COMPACT */
+
 /**
  * Send an ACK without data.
  *
@@ -2048,6 +2355,7 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   if (p == NULL) {
     /* let tcp_fasttmr retry sending this ACK */
     tcp_set_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+    TCP_TMR_NEEDED();
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output: (ACK) could not allocate pbuf\n"));
     return ERR_BUF;
   }
@@ -2063,9 +2371,11 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   if (err != ERR_OK) {
     /* let tcp_fasttmr retry sending this ACK */
     tcp_set_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+    TCP_TMR_NEEDED();
   } else {
     /* remove ACK flags from the PCB, as we sent an empty ACK now */
     tcp_clear_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+    tcp_ack_sent(pcb);
   }
 
   return err;
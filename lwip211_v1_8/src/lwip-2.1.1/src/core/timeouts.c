@@ -118,12 +118,172 @@ const int lwip_num_cyclic_timers = LWIP_ARRAYSIZE(lwip_cyclic_timers);
 
 #if LWIP_TIMERS && !LWIP_TIMERS_CUSTOM
 
+#if LWIP_TIMERS_WHEEL
+#define SYS_TIMEO_WHEEL_BITS    5
+#define SYS_TIMEO_WHEEL_SLOTS   (1UL << SYS_TIMEO_WHEEL_BITS)
+#define SYS_TIMEO_WHEEL_LEVELS  6
+#define SYS_TIMEO_HASH_SIZE     16
+
+#define SYS_TIMEO_HASH(h, arg) \
+  ((((mem_ptr_t)(h) >> 2) ^ ((mem_ptr_t)(arg) >> 2)) & (SYS_TIMEO_HASH_SIZE - 1))
+
+/** The timer wheel: slot s of level n holds the timeouts due in the block of
+ * 32^n ms numbered s (modulo 32) from the start of time. Level 0 blocks are
+ * single ms; the blocks of a higher level are moved down once they start. */
+static struct sys_timeo *timeo_wheel[SYS_TIMEO_WHEEL_LEVELS][SYS_TIMEO_WHEEL_SLOTS];
+/** Bit s is set if timeo_wheel[n][s] is not empty */
+static u32_t timeo_wheel_used[SYS_TIMEO_WHEEL_LEVELS];
+/** Time the wheel has been run up to: all earlier timeouts have been handled */
+static u32_t timeo_wheel_now;
+/** The blocks starting at timeo_wheel_now have been moved down a level */
+static u8_t timeo_wheel_cascaded;
+/** All timeouts again, by handler and argument, for sys_untimeout() */
+static struct sys_timeo *timeo_hash[SYS_TIMEO_HASH_SIZE];
+
+/** Number of slots from 'from' to the first used one, going round */
+static u32_t
+sys_timeo_wheel_first(u32_t used, u32_t from)
+{
+  if (from != 0) {
+    used = (used >> from) | (used << (SYS_TIMEO_WHEEL_SLOTS - from));
+  }
+#if defined(__GNUC__)
+  return (u32_t)__builtin_ctz(used);
+#else
+  {
+    u32_t n = 0;
+    while ((used & 1) == 0) {
+      used >>= 1;
+      n++;
+    }
+    return n;
+  }
+#endif
+}
+
+static void
+sys_timeo_wheel_add(struct sys_timeo *t)
+{
+  struct sys_timeo **slot;
+  u32_t due = t->time;
+  u32_t level = 0;
+  u32_t s;
+
+  /* overdue timeouts go in the slot run next */
+  if (TIME_LESS_THAN(due, timeo_wheel_now)) {
+    due = timeo_wheel_now;
+  }
+  /* the top level wraps for timeouts beyond its range: they are moved down
+     too early and land on it again */
+  while ((level < SYS_TIMEO_WHEEL_LEVELS - 1) &&
+         (((due - timeo_wheel_now) >> (SYS_TIMEO_WHEEL_BITS * (level + 1))) != 0)) {
+    level++;
+  }
+  s = (due >> (SYS_TIMEO_WHEEL_BITS * level)) & (SYS_TIMEO_WHEEL_SLOTS - 1);
+
+  slot = &timeo_wheel[level][s];
+  t->next = *slot;
+  if (t->next != NULL) {
+    t->next->pprev = &t->next;
+  }
+  t->pprev = slot;
+  *slot = t;
+  t->slot = (u8_t)(level * SYS_TIMEO_WHEEL_SLOTS + s);
+  timeo_wheel_used[level] |= 1UL << s;
+}
+
+static void
+sys_timeo_wheel_remove(struct sys_timeo *t)
+{
+  u32_t level = t->slot / SYS_TIMEO_WHEEL_SLOTS;
+  u32_t s = t->slot % SYS_TIMEO_WHEEL_SLOTS;
+
+  *t->pprev = t->next;
+  if (t->next != NULL) {
+    t->next->pprev = t->pprev;
+  }
+  if (timeo_wheel[level][s] == NULL) {
+    timeo_wheel_used[level] &= ~(1UL << s);
+  }
+}
+
+static void
+sys_timeo_hash_add(struct sys_timeo *t)
+{
+  struct sys_timeo **bucket = &timeo_hash[SYS_TIMEO_HASH(t->h, t->arg)];
+
+  t->hash_next = *bucket;
+  if (t->hash_next != NULL) {
+    t->hash_next->hash_pprev = &t->hash_next;
+  }
+  t->hash_pprev = bucket;
+  *bucket = t;
+}
+
+static void
+sys_timeo_hash_remove(struct sys_timeo *t)
+{
+  *t->hash_pprev = t->hash_next;
+  if (t->hash_next != NULL) {
+    t->hash_next->hash_pprev = t->hash_pprev;
+  }
+}
+
+/** Move the timeouts of the blocks starting at timeo_wheel_now down a level */
+static void
+sys_timeo_wheel_cascade(void)
+{
+  struct sys_timeo *t, *next;
+  u32_t level, shift, s;
+
+  for (level = SYS_TIMEO_WHEEL_LEVELS - 1; level > 0; level--) {
+    shift = SYS_TIMEO_WHEEL_BITS * level;
+    if ((timeo_wheel_now & ((1UL << shift) - 1)) == 0) {
+      s = (timeo_wheel_now >> shift) & (SYS_TIMEO_WHEEL_SLOTS - 1);
+      t = timeo_wheel[level][s];
+      timeo_wheel[level][s] = NULL;
+      timeo_wheel_used[level] &= ~(1UL << s);
+      for (; t != NULL; t = next) {
+        next = t->next;
+        sys_timeo_wheel_add(t);
+      }
+    }
+  }
+  timeo_wheel_cascaded = 1;
+}
+
+/** Time from timeo_wheel_now to the next slot to run or block to move down,
+ * LWIP_UINT32_MAX if there are no timeouts */
+static u32_t
+sys_timeo_wheel_next(void)
+{
+  u32_t next = LWIP_UINT32_MAX;
+  u32_t level, shift, block;
+
+  for (level = 0; level < SYS_TIMEO_WHEEL_LEVELS; level++) {
+    if (timeo_wheel_used[level] == 0) {
+      continue;
+    }
+    shift = SYS_TIMEO_WHEEL_BITS * level;
+    block = timeo_wheel_now >> shift;
+    if ((level > 0) &&
+        (timeo_wheel_cascaded || ((timeo_wheel_now & ((1UL << shift) - 1)) != 0))) {
+      /* the current block has already been moved down */
+      block++;
+    }
+    block += sys_timeo_wheel_first(timeo_wheel_used[level], block & (SYS_TIMEO_WHEEL_SLOTS - 1));
+    next = LWIP_MIN(next, (u32_t)((block << shift) - timeo_wheel_now));
+  }
+  return next;
+}
+#else /* LWIP_TIMERS_WHEEL */
 /** The one and only timeout list */
 static struct sys_timeo *next_timeout;
+#endif /* LWIP_TIMERS_WHEEL */
 
 static u32_t current_timeout_due_time;
 
-#if LWIP_TESTMODE
+#if LWIP_TESTMODE && !LWIP_TIMERS_WHEEL
 struct sys_timeo**
 sys_timeouts_get_next_timeout(void)
 {
@@ -134,6 +294,20 @@ sys_timeouts_get_next_timeout(void)
 #if LWIP_TCP
 /** global variable that shows if the tcp timer is currently scheduled or not */
 static int tcpip_tcp_timer_active;
+#if TCP_TMR_COALESCE
+/** when the scheduled tcp timer is due */
+static u32_t tcpip_tcp_timer_due;
+
+static void tcpip_tcp_timer(void *arg);
+
+static void
+tcpip_tcp_timer_start(u32_t msecs)
+{
+  tcpip_tcp_timer_active = 1;
+  tcpip_tcp_timer_due = sys_now() + msecs;
+  sys_timeout(msecs, tcpip_tcp_timer, NULL);
+}
+#endif /* TCP_TMR_COALESCE */
 
 /**
  * Timer callback function that calls tcp_tmr() and reschedules itself.
@@ -147,32 +321,58 @@ tcpip_tcp_timer(void *arg)
 
   /* call TCP timer handler */
   tcp_tmr();
+#if TCP_TMR_COALESCE
+  {
+    /* sleep until a pcb needs the timer again */
+    u32_t next = tcp_tmr_next();
+    if (next != 0) {
+      tcpip_tcp_timer_start(next);
+    } else {
+      tcpip_tcp_timer_active = 0;
+    }
+  }
+#else /* TCP_TMR_COALESCE */
   /* timer still needed? */
-  if (tcp_active_pcbs || tcp_tw_pcbs) {
+  if (tcp_active_pcbs || tcp_tw_pcbs || TCP_TW_RECORDS()) {
     /* restart timer */
     sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
   } else {
     /* disable timer */
     tcpip_tcp_timer_active = 0;
   }
+#endif /* TCP_TMR_COALESCE */
 }
 
 /**
  * Called from TCP_REG when registering a new PCB:
  * the reason is to have the TCP timer only running when
  * there are active (or time-wait) PCBs.
+ * With TCP_TMR_COALESCE also called when a pcb starts a timer of its own:
+ * a timer sleeping longer than TCP_TMR_INTERVAL is brought forward.
  */
 void
 tcp_timer_needed(void)
 {
   LWIP_ASSERT_CORE_LOCKED();
 
+#if TCP_TMR_COALESCE
+  if (tcpip_tcp_timer_active) {
+    /* (while tcpip_tcp_timer() runs, the due time has passed) */
+    if (TIME_LESS_THAN(sys_now() + TCP_TMR_INTERVAL, tcpip_tcp_timer_due)) {
+      sys_untimeout(tcpip_tcp_timer, NULL);
+      tcpip_tcp_timer_start(TCP_TMR_INTERVAL);
+    }
+  } else if (tcp_active_pcbs || tcp_tw_pcbs || TCP_TW_RECORDS()) {
+    tcpip_tcp_timer_start(TCP_TMR_INTERVAL);
+  }
+#else /* TCP_TMR_COALESCE */
   /* timer is off but needed again? */
-  if (!tcpip_tcp_timer_active && (tcp_active_pcbs || tcp_tw_pcbs)) {
+  if (!tcpip_tcp_timer_active && (tcp_active_pcbs || tcp_tw_pcbs || TCP_TW_RECORDS())) {
     /* enable and start timer */
     tcpip_tcp_timer_active = 1;
     sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
   }
+#endif /* TCP_TMR_COALESCE */
 }
 #endif /* LWIP_TCP */
 
@@ -202,6 +402,11 @@ sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg)
                              (void *)timeout, abs_time, handler_name, (void *)arg));
 #endif /* LWIP_DEBUG_TIMERNAMES */
 
+#if LWIP_TIMERS_WHEEL
+  LWIP_UNUSED_ARG(t);
+  sys_timeo_wheel_add(timeout);
+  sys_timeo_hash_add(timeout);
+#else /* LWIP_TIMERS_WHEEL */
   if (next_timeout == NULL) {
     next_timeout = timeout;
     return;
@@ -218,6 +423,7 @@ sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg)
       }
     }
   }
+#endif /* LWIP_TIMERS_WHEEL */
 }
 
 /**
@@ -264,6 +470,9 @@ lwip_cyclic_timer(void *arg)
 void sys_timeouts_init(void)
 {
   size_t i;
+#if LWIP_TIMERS_WHEEL
+  timeo_wheel_now = sys_now();
+#endif /* LWIP_TIMERS_WHEEL */
   /* tcp_tmr() at index 0 is started on demand */
   for (i = (LWIP_TCP ? 1 : 0); i < LWIP_ARRAYSIZE(lwip_cyclic_timers); i++) {
     /* we have to cast via size_t to get rid of const warning
@@ -305,6 +514,171 @@ sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
 #endif
 }
 
+#if LWIP_TIMERS_WHEEL
+/**
+ * Remove the matching timeout that would trigger first (others remain
+ * untouched), even though it has not triggered yet.
+ *
+ * @param handler callback function that would be called by the timeout
+ * @param arg callback argument that would be passed to handler
+*/
+void
+sys_untimeout(sys_timeout_handler handler, void *arg)
+{
+  struct sys_timeo *t, *first = NULL;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  for (t = timeo_hash[SYS_TIMEO_HASH(handler, arg)]; t != NULL; t = t->hash_next) {
+    if ((t->h == handler) && (t->arg == arg) &&
+        ((first == NULL) || TIME_LESS_THAN(t->time, first->time))) {
+      first = t;
+    }
+  }
+  if (first != NULL) {
+    sys_timeo_wheel_remove(first);
+    sys_timeo_hash_remove(first);
+    memp_free(MEMP_SYS_TIMEOUT, first);
+  }
+}
+
+/**
+ * @ingroup lwip_nosys
+ * Handle timeouts for NO_SYS==1 (i.e. without using
+ * tcpip_thread/sys_timeouts_mbox_fetch(). Uses sys_now() to call timeout
+ * handler functions when timeouts expire.
+ *
+ * Must be called periodically from your main loop.
+ */
+void
+sys_check_timeouts(void)
+{
+  u32_t now;
+  u32_t next;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  /* Process only timers expired at the start of the function. */
+  now = sys_now();
+
+  do {
+    struct sys_timeo *tmptimeout;
+    sys_timeout_handler handler;
+    void *arg;
+
+    PBUF_CHECK_FREE_OOSEQ();
+
+    if (!timeo_wheel_cascaded) {
+      sys_timeo_wheel_cascade();
+    }
+    tmptimeout = timeo_wheel[0][timeo_wheel_now & (SYS_TIMEO_WHEEL_SLOTS - 1)];
+    if (tmptimeout == NULL) {
+      /* this ms is done: go on to the next one with something to do */
+      next = sys_timeo_wheel_next();
+      if ((next == LWIP_UINT32_MAX) || TIME_LESS_THAN(now, timeo_wheel_now + next)) {
+        if (TIME_LESS_THAN(timeo_wheel_now, now)) {
+          timeo_wheel_now = now;
+          timeo_wheel_cascaded = 0;
+        }
+        return;
+      }
+      timeo_wheel_now += next;
+      timeo_wheel_cascaded = 0;
+      continue;
+    }
+
+    /* Timeout has expired */
+    sys_timeo_wheel_remove(tmptimeout);
+    sys_timeo_hash_remove(tmptimeout);
+    handler = tmptimeout->h;
+    arg = tmptimeout->arg;
+    current_timeout_due_time = tmptimeout->time;
+#if LWIP_DEBUG_TIMERNAMES
+    if (handler != NULL) {
+      LWIP_DEBUGF(TIMERS_DEBUG, ("sct calling h=%s t=%"U32_F" arg=%p\n",
+                                 tmptimeout->handler_name, sys_now() - tmptimeout->time, arg));
+    }
+#endif /* LWIP_DEBUG_TIMERNAMES */
+    memp_free(MEMP_SYS_TIMEOUT, tmptimeout);
+    if (handler != NULL) {
+      handler(arg);
+    }
+    LWIP_TCPIP_THREAD_ALIVE();
+
+    /* Repeat until all expired timers have been called */
+  } while (1);
+}
+
+/** Rebase the timeout times to the current time.
+ * This is necessary if sys_check_timeouts() hasn't been called for a long
+ * time (e.g. while saving energy) to prevent all timer functions of that
+ * period being called.
+ */
+void
+sys_restart_timeouts(void)
+{
+  struct sys_timeo *all = NULL;
+  struct sys_timeo *t, *next;
+  u32_t level, s;
+  u32_t base = 0;
+  u32_t now;
+
+  /* take all timeouts off the wheel */
+  for (level = 0; level < SYS_TIMEO_WHEEL_LEVELS; level++) {
+    for (s = 0; s < SYS_TIMEO_WHEEL_SLOTS; s++) {
+      for (t = timeo_wheel[level][s]; t != NULL; t = next) {
+        next = t->next;
+        if ((all == NULL) || TIME_LESS_THAN(t->time, base)) {
+          base = t->time;
+        }
+        t->next = all;
+        all = t;
+      }
+      timeo_wheel[level][s] = NULL;
+    }
+    timeo_wheel_used[level] = 0;
+  }
+  if (all == NULL) {
+    return;
+  }
+
+  now = sys_now();
+  timeo_wheel_now = now;
+  timeo_wheel_cascaded = 0;
+  for (t = all; t != NULL; t = next) {
+    next = t->next;
+    t->time = (t->time - base) + now;
+    sys_timeo_wheel_add(t);
+  }
+}
+
+/** Return the time left before the next timeout is due, or before timeouts
+ * have to be moved down the wheel. If no timeouts are enqueued, returns 0xffffffff
+ */
+u32_t
+sys_timeouts_sleeptime(void)
+{
+  u32_t now;
+  u32_t next;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  next = sys_timeo_wheel_next();
+  if (next == LWIP_UINT32_MAX) {
+    return SYS_TIMEOUTS_SLEEPTIME_INFINITE;
+  }
+  now = sys_now();
+  next += timeo_wheel_now;
+  if (TIME_LESS_THAN(next, now)) {
+    return 0;
+  } else {
+    u32_t ret = (u32_t)(next - now);
+    LWIP_ASSERT("invalid sleeptime", ret <= LWIP_MAX_TIMEOUT);
+    return ret;
+  }
+}
+
+#else /* LWIP_TIMERS_WHEEL */
 /**
  * Go through timeout list (for this task only) and remove the first matching
  * entry (subsequent entries remain untouched), even though the timeout has not
@@ -441,6 +815,7 @@ sys_timeouts_sleeptime(void)
     return ret;
   }
 }
+#endif /* LWIP_TIMERS_WHEEL */
 
 #else /* LWIP_TIMERS && !LWIP_TIMERS_CUSTOM */
 /* Satisfy the TCP code which calls this function */
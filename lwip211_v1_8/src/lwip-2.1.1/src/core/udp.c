@@ -80,6 +80,42 @@ static u16_t udp_port = UDP_LOCAL_PORT_RANGE_START;
 /* exported in udp.h (was static) */
 struct udp_pcb *udp_pcbs;
 
+#if UDP_PCB_HASH
+/* The pcbs on udp_pcbs again, by local port */
+static struct udp_pcb *udp_pcb_hash[UDP_PCB_HASH_SIZE];
+#define UDP_PCB_HASH_HEAD(port)   (&udp_pcb_hash[((port) ^ ((port) >> 8)) & (UDP_PCB_HASH_SIZE - 1)])
+
+/* udp_input() only needs the pcbs bound to the destination port */
+#define UDP_INPUT_PCBS(port)      UDP_PCB_HASH_HEAD(port)
+#define UDP_INPUT_NEXT(pcb)       ((pcb)->hash_next)
+
+static void
+udp_pcb_hash_add(struct udp_pcb *pcb)
+{
+  struct udp_pcb **head = UDP_PCB_HASH_HEAD(pcb->local_port);
+  pcb->hash_next = *head;
+  *head = pcb;
+}
+
+static void
+udp_pcb_hash_remove(struct udp_pcb *pcb)
+{
+  struct udp_pcb **p;
+  for (p = UDP_PCB_HASH_HEAD(pcb->local_port); *p != NULL; p = &(*p)->hash_next) {
+    if (*p == pcb) {
+      *p = pcb->hash_next;
+      break;
+    }
+  }
+  pcb->hash_next = NULL;
+}
+#else /* UDP_PCB_HASH */
+#define UDP_INPUT_PCBS(port)      (&udp_pcbs)
+#define UDP_INPUT_NEXT(pcb)       ((pcb)->next)
+#define udp_pcb_hash_add(pcb)
+#define udp_pcb_hash_remove(pcb)
+#endif /* UDP_PCB_HASH */
+
 /**
  * Initialize this module.
  */
@@ -195,6 +231,7 @@ udp_input(struct pbuf *p, struct netif *inp)
 {
   struct udp_hdr *udphdr;
   struct udp_pcb *pcb, *prev;
+  struct udp_pcb **pcbs;
   struct udp_pcb *uncon_pcb;
   u16_t src, dest;
   u8_t broadcast;
@@ -250,7 +287,8 @@ udp_input(struct pbuf *p, struct netif *inp)
    * 'Perfect match' pcbs (connected to the remote port & ip address) are
    * preferred. If no perfect match is found, the first unconnected pcb that
    * matches the local port and ip address gets the datagram. */
-  for (pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+  pcbs = UDP_INPUT_PCBS(dest);
+  for (pcb = *pcbs; pcb != NULL; pcb = UDP_INPUT_NEXT(pcb)) {
     /* print the PCB local and remote address */
     LWIP_DEBUGF(UDP_DEBUG, ("pcb ("));
     ip_addr_debug_print_val(UDP_DEBUG, pcb->local_ip);
@@ -291,11 +329,11 @@ udp_input(struct pbuf *p, struct netif *inp)
            ip_addr_cmp(&pcb->remote_ip, ip_current_src_addr()))) {
         /* the first fully matching PCB */
         if (prev != NULL) {
-          /* move the pcb to the front of udp_pcbs so that is
+          /* move the pcb to the front of the list so that is
              found faster next time */
-          prev->next = pcb->next;
-          pcb->next = udp_pcbs;
-          udp_pcbs = pcb;
+          UDP_INPUT_NEXT(prev) = UDP_INPUT_NEXT(pcb);
+          UDP_INPUT_NEXT(pcb) = *pcbs;
+          *pcbs = pcb;
         } else {
           UDP_STATS_INC(udp.cachehit);
         }
@@ -380,7 +418,7 @@ udp_input(struct pbuf *p, struct netif *inp)
         /* pass broadcast- or multicast packets to all multicast pcbs
            if SOF_REUSEADDR is set on the first match */
         struct udp_pcb *mpcb;
-        for (mpcb = udp_pcbs; mpcb != NULL; mpcb = mpcb->next) {
+        for (mpcb = *pcbs; mpcb != NULL; mpcb = UDP_INPUT_NEXT(mpcb)) {
           if (mpcb != pcb) {
             /* compare PCB local addr+port to UDP destination addr+port */
             if ((mpcb->local_port == dest) &&
@@ -636,7 +674,7 @@ udp_sendto_chksum(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *dst_ip,
 #endif /* LWIP_MULTICAST_TX_OPTIONS */
     {
       /* find the outgoing network interface for this packet */
-      netif = ip_route(&pcb->local_ip, dst_ip);
+      netif = ip_route_hinted(&pcb->local_ip, dst_ip, &pcb->route_hint);
     }
   }
 
@@ -1072,6 +1110,10 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
 
   ip_addr_set_ipaddr(&pcb->local_ip, ipaddr);
 
+  if (rebind) {
+    /* the port is about to change */
+    udp_pcb_hash_remove(pcb);
+  }
   pcb->local_port = port;
   mib2_udp_bind(pcb);
   /* pcb not active yet? */
@@ -1080,6 +1122,7 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
     pcb->next = udp_pcbs;
     udp_pcbs = pcb;
   }
+  udp_pcb_hash_add(pcb);
   LWIP_DEBUGF(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("udp_bind: bound to "));
   ip_addr_debug_print_val(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, pcb->local_ip);
   LWIP_DEBUGF(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, (", port %"U16_F")\n", pcb->local_port));
@@ -1172,6 +1215,7 @@ udp_connect(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
   /* PCB not yet on the list, add PCB now */
   pcb->next = udp_pcbs;
   udp_pcbs = pcb;
+  udp_pcb_hash_add(pcb);
   return ERR_OK;
 }
 
@@ -1245,6 +1289,7 @@ udp_remove(struct udp_pcb *pcb)
   LWIP_ERROR("udp_remove: invalid pcb", pcb != NULL, return);
 
   mib2_udp_unbind(pcb);
+  udp_pcb_hash_remove(pcb);
   /* pcb to be removed is first in list? */
   if (udp_pcbs == pcb) {
     /* make list start at 2nd pcb */
@@ -65,6 +65,7 @@ extern "C" {
 #define NETCONN_DONTBLOCK   0x04
 #define NETCONN_NOAUTORCVD  0x08 /* prevent netconn_recv_data_tcp() from updating the tcp window - must be done manually via netconn_tcp_recvd() */
 #define NETCONN_NOFIN       0x10 /* upper layer already received data, leave FIN in queue until called again */
+#define NETCONN_ZEROCOPY    0x20 /* like NETCONN_NOCOPY, and report when the data is acked (see netconn_set_zerocopy_callback()) */
 
 /* Flags for struct netconn.flags (u8_t) */
 /** This netconn had an error, don't block on recvmbox/acceptmbox any more */
@@ -210,10 +211,22 @@ struct udp_pcb;
 struct raw_pcb;
 struct netconn;
 struct api_msg;
+#if LWIP_NETCONN_ASYNC
+struct netconn_cq;
+struct netconn_async_op;
+#endif /* LWIP_NETCONN_ASYNC */
 
 /** A callback prototype to inform about events for a netconn */
 typedef void (* netconn_callback)(struct netconn *, enum netconn_evt, u16_t len);
 
+#if LWIP_TCP && LWIP_NETCONN_ZEROCOPY
+/** A callback prototype to report NETCONN_ZEROCOPY data the stack is done with.
+ * 'released' counts all NETCONN_ZEROCOPY bytes written to the netconn so far
+ * that are no longer referenced (wrapping at 2^32), err is ERR_OK when they
+ * were acked or the error that aborted the connection. Called from tcpip_thread. */
+typedef void (* netconn_zerocopy_fn)(struct netconn *conn, u32_t released, err_t err, void *arg);
+#endif /* LWIP_TCP && LWIP_NETCONN_ZEROCOPY */
+
 /** A netconn descriptor */
 struct netconn {
   /** type of the netconn (TCP, UDP or RAW) */
@@ -281,6 +294,31 @@ struct netconn {
       Also used during connect and close. */
   struct api_msg *current_msg;
 #endif /* LWIP_TCP */
+#if LWIP_TCP && LWIP_NETCONN_ZEROCOPY
+  /** TCP: NETCONN_ZEROCOPY completion callback and its argument */
+  netconn_zerocopy_fn zerocopy_fn;
+  void *zerocopy_arg;
+  /** TCP: NETCONN_ZEROCOPY bytes written so far */
+  u32_t zerocopy_written;
+  /** TCP: NETCONN_ZEROCOPY writes not yet acked, oldest first: the sequence
+      number following each write and zerocopy_written after it */
+  u8_t zerocopy_pending;
+  struct {
+    u32_t seqno;
+    u32_t written;
+  } zerocopy_ends[LWIP_NETCONN_ZEROCOPY_PENDING];
+#endif /* LWIP_TCP && LWIP_NETCONN_ZEROCOPY */
+#if LWIP_NETCONN_ASYNC
+  /** completion queue of an asynchronous netconn (NULL: none) */
+  struct netconn_cq *async_cq;
+  /** submitted operations not completed yet: accept/recv and the others */
+  struct netconn_async_op *async_rx;
+  struct netconn_async_op *async_tx;
+  /** next netconn with an event on async_cq */
+  struct netconn *async_next;
+  /** netconn is on the event list of async_cq */
+  u8_t async_kicked;
+#endif /* LWIP_NETCONN_ASYNC */
   /** A callback function that is informed about events for this netconn */
   netconn_callback callback;
 };
@@ -395,6 +433,15 @@ err_t   netconn_err(struct netconn *conn);
 #define netconn_get_ipv6only(conn)        (((conn)->flags & NETCONN_FLAG_IPV6_V6ONLY) != 0)
 #endif /* LWIP_IPV6 */
 
+#if LWIP_TCP && LWIP_NETCONN_ZEROCOPY
+/** Set the callback reporting acked NETCONN_ZEROCOPY data. Set it before the
+ * first NETCONN_ZEROCOPY write; a netconn that is closed with zero-copy data
+ * still queued reports nothing more, so shut down tx and wait for the last
+ * bytes to be released before closing it. */
+#define netconn_set_zerocopy_callback(conn, fn, arg) do { \
+  (conn)->zerocopy_fn = (fn); (conn)->zerocopy_arg = (arg); } while (0)
+#endif /* LWIP_TCP && LWIP_NETCONN_ZEROCOPY */
+
 #if LWIP_SO_SNDTIMEO
 /** Set the send timeout in milliseconds */
 #define netconn_set_sendtimeout(conn, timeout)      ((conn)->send_timeout = (timeout))
@@ -62,6 +62,85 @@
 #define ALTCP_MBEDTLS_SESSION_CACHE_TIMEOUT_SECONDS   0
 #endif
 
+/** Maximum number of sessions kept by the server session cache
+ * (only used if ALTCP_MBEDTLS_SESSION_CACHE_TIMEOUT_SECONDS != 0)
+ */
+#ifndef ALTCP_MBEDTLS_SESSION_CACHE_SIZE
+#define ALTCP_MBEDTLS_SESSION_CACHE_SIZE              30
+#endif
+
+/** Lifetime in seconds of session tickets issued by a server configuration,
+ * 0 disables tickets. Needs MBEDTLS_SSL_TICKET_C.
+ * ATTENTION: Session tickets can lower security by reusing keys!
+ */
+#ifndef ALTCP_MBEDTLS_SESSION_TICKET_TIMEOUT_SECONDS
+#define ALTCP_MBEDTLS_SESSION_TICKET_TIMEOUT_SECONDS  0
+#endif
+
+/** ALTCP_MBEDTLS_CLIENT_SESSION_RESUME==1: a client configuration remembers the
+ * session (ID or ticket) of its last successful handshake and offers it when the
+ * next connection goes to the same address and port, saving the key exchange.
+ * ATTENTION: Resuming sessions can lower security by reusing keys!
+ */
+#ifndef ALTCP_MBEDTLS_CLIENT_SESSION_RESUME
+#define ALTCP_MBEDTLS_CLIENT_SESSION_RESUME           0
+#endif
+
+/** Maximum fragment length a client asks the server for (one of
+ * MBEDTLS_SSL_MAX_FRAG_LEN_512..4096), 0 leaves the records of the server at
+ * 16 KB. Smaller records can be decrypted as soon as a few segments arrived.
+ * Needs MBEDTLS_SSL_MAX_FRAGMENT_LENGTH and a server supporting the extension.
+ */
+#ifndef ALTCP_MBEDTLS_MAX_FRAG_LEN
+#define ALTCP_MBEDTLS_MAX_FRAG_LEN                    0
+#endif
+
+/** ALTCP_MBEDTLS_DYNAMIC_RECORD_SIZE==1: send application data in records that
+ * fit one TCP segment while a connection starts or after it was idle, so the
+ * peer can decrypt the first bytes without waiting for a full 16 KB record.
+ * Larger records are used once ALTCP_MBEDTLS_RECORD_BOOST_BYTES went out.
+ */
+#ifndef ALTCP_MBEDTLS_DYNAMIC_RECORD_SIZE
+#define ALTCP_MBEDTLS_DYNAMIC_RECORD_SIZE             1
+#endif
+
+/** Application bytes sent in small records before switching to large ones */
+#ifndef ALTCP_MBEDTLS_RECORD_BOOST_BYTES
+#define ALTCP_MBEDTLS_RECORD_BOOST_BYTES              (16 * 1024)
+#endif
+
+/** Time in milliseconds without writes after which small records are used again */
+#ifndef ALTCP_MBEDTLS_RECORD_IDLE_MS
+#define ALTCP_MBEDTLS_RECORD_IDLE_MS                  1000
+#endif
+
+/** ALTCP_MBEDTLS_RX_ZEROCOPY==1: hand received plaintext to the application in a
+ * pbuf pointing into the mbedTLS input buffer, where the record was decrypted,
+ * instead of copying it into a PBUF_POOL pbuf. The next record is only read once
+ * the application freed that pbuf, so applications holding on to received pbufs
+ * stall the connection while they do. Needs LWIP_SUPPORT_CUSTOM_PBUF.
+ */
+#ifndef ALTCP_MBEDTLS_RX_ZEROCOPY
+#define ALTCP_MBEDTLS_RX_ZEROCOPY                     0
+#endif
+
+/** Number of TLS sessions a fixed mbedTLS arena is sized for, 0 lets mbedTLS
+ * allocate from the lwIP heap. With an arena, TLS buffers cannot exhaust the heap
+ * the rest of the stack depends on, and vice versa.
+ * Needs MBEDTLS_MEMORY_BUFFER_ALLOC_C.
+ */
+#ifndef ALTCP_MBEDTLS_MEM_ARENA_SESSIONS
+#define ALTCP_MBEDTLS_MEM_ARENA_SESSIONS              0
+#endif
+
+/** Arena bytes per session: the input and output record buffers plus the
+ * handshake and peer certificate data. Configurations and their certificates
+ * come from the arena as well, leave some room for them.
+ */
+#ifndef ALTCP_MBEDTLS_MEM_SESSION_SIZE
+#define ALTCP_MBEDTLS_MEM_SESSION_SIZE                (40 * 1024)
+#endif
+
 #endif /* LWIP_ALTCP */
 
 #endif /* LWIP_HDR_ALTCP_TLS_OPTS_H */
@@ -54,6 +54,10 @@ struct fsdata_chksum {
 #define FS_FILE_FLAGS_HEADER_PERSISTENT   0x02
 #define FS_FILE_FLAGS_HEADER_HTTPVER_1_1  0x04
 #define FS_FILE_FLAGS_SSI                 0x08
+/** pre-compressed variant of the file with the same name (makefsdata -enc) */
+#define FS_FILE_FLAGS_ENC_GZIP            0x10
+#define FS_FILE_FLAGS_ENC_BR              0x20
+#define FS_FILE_FLAGS_ENC_MASK            (FS_FILE_FLAGS_ENC_GZIP | FS_FILE_FLAGS_ENC_BR)
 
 /** Define FS_FILE_EXTENSION_T_DEFINED if you have typedef'ed to your private
  * pointer type (defaults to 'void' so the default usage is 'void*')
@@ -87,6 +91,9 @@ typedef void (*fs_wait_cb)(void *arg);
 #endif /* LWIP_HTTPD_FS_ASYNC_READ */
 
 err_t fs_open(struct fs_file *file, const char *name);
+#if LWIP_HTTPD_ACCEPT_ENCODING
+err_t fs_open_encoded(struct fs_file *file, const char *name, u8_t accept);
+#endif /* LWIP_HTTPD_ACCEPT_ENCODING */
 void fs_close(struct fs_file *file);
 #if LWIP_HTTPD_DYNAMIC_FILE_READ
 #if LWIP_HTTPD_FS_ASYNC_READ
@@ -95,6 +102,9 @@ int fs_read_async(struct fs_file *file, char *buffer, int count, fs_wait_cb call
 int fs_read(struct fs_file *file, char *buffer, int count);
 #endif /* LWIP_HTTPD_FS_ASYNC_READ */
 #endif /* LWIP_HTTPD_DYNAMIC_FILE_READ */
+#if LWIP_HTTPD_DYNAMIC_FILE_READ && LWIP_HTTPD_FS_SENDFILE
+int fs_map(struct fs_file *file, const char **data, int count);
+#endif /* LWIP_HTTPD_DYNAMIC_FILE_READ && LWIP_HTTPD_FS_SENDFILE */
 #if LWIP_HTTPD_FS_ASYNC_READ
 int fs_is_file_ready(struct fs_file *file, fs_wait_cb callback_fn, void *callback_arg);
 #endif /* LWIP_HTTPD_FS_ASYNC_READ */
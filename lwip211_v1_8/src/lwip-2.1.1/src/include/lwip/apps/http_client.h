@@ -61,6 +61,43 @@ extern "C" {
 #define LWIP_HTTPC_HAVE_FILE_IO   0
 #endif
 
+/**
+ * @ingroup httpc
+ * LWIP_HTTPC_STREAM==1: enable httpc_get_file_stream(), which passes the body
+ * to a sink function on a thread of its own (e.g. a flash writer). The TCP
+ * window opens as the sink consumes the data, so the next part of the file is
+ * received while the last one is written.
+ * Needs NO_SYS==0.
+ */
+#ifndef LWIP_HTTPC_STREAM
+#define LWIP_HTTPC_STREAM         0
+#endif
+
+/**
+ * @ingroup httpc
+ * Stack size of the thread running the download sinks
+ */
+#ifndef HTTPC_STREAM_THREAD_STACKSIZE
+#define HTTPC_STREAM_THREAD_STACKSIZE  DEFAULT_THREAD_STACKSIZE
+#endif
+
+/**
+ * @ingroup httpc
+ * Priority of the thread running the download sinks
+ */
+#ifndef HTTPC_STREAM_THREAD_PRIO
+#define HTTPC_STREAM_THREAD_PRIO       DEFAULT_THREAD_PRIO
+#endif
+
+/**
+ * @ingroup httpc
+ * Mailbox size of the sink thread: the number of streamed downloads that may
+ * be in progress at the same time
+ */
+#ifndef HTTPC_STREAM_MBOX_SIZE
+#define HTTPC_STREAM_MBOX_SIZE         2
+#endif
+
 /**
  * @ingroup httpc
  * The default TCP port used for HTTP
@@ -132,6 +169,10 @@ typedef struct _httpc_connection {
   altcp_allocator_t *altcp_allocator;
 #endif
 
+  /* if != 0, only request the file from this byte offset on (Range header),
+     e.g. to resume an interrupted download */
+  u32_t range_start;
+
   /* this callback is called when the transfer is finished (or aborted) */
   httpc_result_fn result_fn;
   /* this callback is called after receiving the http headers
@@ -144,6 +185,29 @@ err_t httpc_get_file(const ip_addr_t* server_addr, u16_t port, const char* uri,
 err_t httpc_get_file_dns(const char* server_name, u16_t port, const char* uri, const httpc_connection_t *settings,
                      altcp_recv_fn recv_fn, void* callback_arg, httpc_state_t **connection);
 
+#if LWIP_HTTPC_STREAM
+/**
+ * @ingroup httpc
+ * Sink for a streamed download, see httpc_get_file_stream(). Called on the
+ * sink thread (not tcpip_thread) with the body data received since the last
+ * call, as a pbuf chain it must not free or keep.
+ *
+ * @param arg argument specified when initiating the request
+ * @param offset position of the first byte of 'p' in the file: for a resumed
+ *               download this starts at the offset the server answered with
+ *               (0 if it ignored the Range header)
+ * @param p body data
+ * @return ERR_OK: continue.
+ *         another err_t: abort the download.
+ */
+typedef err_t (*httpc_sink_fn)(void *arg, u32_t offset, struct pbuf *p);
+
+err_t httpc_get_file_stream(const ip_addr_t* server_addr, u16_t port, const char* uri, const httpc_connection_t *settings,
+                     httpc_sink_fn sink, void* callback_arg, httpc_state_t **connection);
+err_t httpc_get_file_dns_stream(const char* server_name, u16_t port, const char* uri, const httpc_connection_t *settings,
+                     httpc_sink_fn sink, void* callback_arg, httpc_state_t **connection);
+#endif /* LWIP_HTTPC_STREAM */
+
 #if LWIP_HTTPC_HAVE_FILE_IO
 err_t httpc_get_file_to_disk(const ip_addr_t* server_addr, u16_t port, const char* uri, const httpc_connection_t *settings,
                      void* callback_arg, const char* local_file_name, httpc_state_t **connection);
@@ -166,6 +166,9 @@ typedef u16_t (*tSSIHandler)(
 #if defined(LWIP_HTTPD_FILE_STATE) && LWIP_HTTPD_FILE_STATE
                              , void *connection_state
 #endif /* LWIP_HTTPD_FILE_STATE */
+#if LWIP_HTTPD_SSI_ASYNC
+                             , void *connection
+#endif /* LWIP_HTTPD_SSI_ASYNC */
                              );
 
 /** Set the SSI handler function
@@ -180,6 +183,16 @@ void http_set_ssi_handler(tSSIHandler pfnSSIHandler,
  */
 #define HTTPD_SSI_TAG_UNKNOWN 0xFFFF
 
+#if LWIP_HTTPD_SSI_ASYNC
+/** For LWIP_HTTPD_SSI_ASYNC==1, return this when the insert string is not
+ * ready yet. Call httpd_ssi_continue() with the 'connection' argument when it
+ * is: the handler is then called again for the same tag.
+ */
+#define HTTPD_SSI_TAG_PENDING 0xFFFE
+
+void httpd_ssi_continue(void *connection);
+#endif /* LWIP_HTTPD_SSI_ASYNC */
+
 #endif /* LWIP_HTTPD_SSI */
 
 #if LWIP_HTTPD_SUPPORT_POST
@@ -239,8 +252,68 @@ void httpd_post_finished(void *connection, char *response_uri, u16_t response_ur
 void httpd_post_data_recved(void *connection, u16_t recved_len);
 #endif /* LWIP_HTTPD_POST_MANUAL_WND */
 
+#if LWIP_HTTPD_POST_STREAM
+/**
+ * @ingroup httpd
+ * Sink for the body of a streamed POST, see httpd_post_stream(). Called on
+ * the POST sink thread (not tcpip_thread) with the body data received since
+ * the last call, as a pbuf chain it must not free or keep.
+ *
+ * @param arg the 'arg' passed to httpd_post_stream()
+ * @param p body data
+ * @return ERR_OK: continue.
+ *         another err_t: abort, the rest of the body is discarded and
+ *         httpd_post_finished() is called.
+ */
+typedef err_t (*httpd_post_sink_fn)(void *arg, struct pbuf *p);
+
+err_t httpd_post_stream(void *connection, httpd_post_sink_fn sink, void *arg);
+#endif /* LWIP_HTTPD_POST_STREAM */
+
 #endif /* LWIP_HTTPD_SUPPORT_POST */
 
+#if LWIP_HTTPD_WEBSOCKET
+/** WebSocket frame opcodes */
+#define HTTPD_WS_OPCODE_CONTINUE  0x0
+#define HTTPD_WS_OPCODE_TEXT      0x1
+#define HTTPD_WS_OPCODE_BINARY    0x2
+#define HTTPD_WS_OPCODE_CLOSE     0x8
+#define HTTPD_WS_OPCODE_PING      0x9
+#define HTTPD_WS_OPCODE_PONG      0xA
+
+/**
+ * @ingroup httpd
+ * Called for a GET request asking to upgrade to the WebSocket protocol.
+ * Return ERR_OK to accept it: 'connection' then identifies the WebSocket
+ * until the receive handler is called with data == NULL. Any other return
+ * value serves 'uri' as a normal file.
+ *
+ * @param connection Unique connection identifier.
+ * @param uri The URI of the request
+ */
+typedef err_t (*tWsConnectHandler)(void *connection, const char *uri);
+
+/**
+ * @ingroup httpd
+ * Called for every data frame (HTTPD_WS_OPCODE_TEXT, _BINARY or _CONTINUE
+ * for fragmented messages) received on a WebSocket. Ping and close frames are
+ * handled by httpd. Return anything but ERR_OK to close the connection (don't
+ * call httpd_websocket_close() from here).
+ * data == NULL means the connection has been closed.
+ *
+ * @param connection Unique connection identifier.
+ * @param data Unmasked payload of the frame
+ * @param len Length of the payload
+ * @param opcode Opcode of the frame
+ */
+typedef err_t (*tWsRecvHandler)(void *connection, const u8_t *data, u16_t len, u8_t opcode);
+
+void http_set_websocket_handlers(tWsConnectHandler connect_handler, tWsRecvHandler recv_handler);
+err_t httpd_websocket_write(void *connection, const void *data, u16_t len, u8_t opcode);
+void httpd_websocket_broadcast(const void *data, u16_t len, u8_t opcode);
+void httpd_websocket_close(void *connection);
+#endif /* LWIP_HTTPD_WEBSOCKET */
+
 void httpd_init(void);
 
 #if HTTPD_ENABLE_HTTPS
@@ -139,6 +139,17 @@
 #define LWIP_HTTPD_SSI_MULTIPART    0
 #endif
 
+/** LWIP_HTTPD_SSI_ASYNC==1: SSI handler function is called with one more
+ * argument identifying the connection and may return HTTPD_SSI_TAG_PENDING
+ * when the insert string is not ready yet (e.g. because it is produced by
+ * another task). Sending stops until httpd_ssi_continue() is called for that
+ * connection; the handler is then called again for the same tag (part).
+ * Together with LWIP_HTTPD_SSI_MULTIPART, long inserts can be streamed in
+ * chunks without blocking tcpip_thread. */
+#if !defined LWIP_HTTPD_SSI_ASYNC || defined __DOXYGEN__
+#define LWIP_HTTPD_SSI_ASYNC        0
+#endif
+
 /* The maximum length of the string comprising the SSI tag name
  * ATTENTION: tags longer than this are ignored, not truncated!
  */
@@ -157,6 +168,32 @@
 #define LWIP_HTTPD_POST_MANUAL_WND  0
 #endif
 
+/** LWIP_HTTPD_POST_STREAM==1: httpd_post_begin() may call httpd_post_stream()
+ * to have the body of that POST passed to a sink function on a thread of its
+ * own (e.g. a flash writer) instead of to httpd_post_receive_data(). The TCP
+ * window opens as the sink consumes the data, so the next part of the body is
+ * received while the last one is written.
+ * Needs LWIP_HTTPD_POST_MANUAL_WND and NO_SYS==0. */
+#if !defined LWIP_HTTPD_POST_STREAM || defined __DOXYGEN__
+#define LWIP_HTTPD_POST_STREAM      0
+#endif
+
+/** Stack size of the thread running the POST sinks */
+#if !defined HTTPD_POST_SINK_THREAD_STACKSIZE || defined __DOXYGEN__
+#define HTTPD_POST_SINK_THREAD_STACKSIZE  DEFAULT_THREAD_STACKSIZE
+#endif
+
+/** Priority of the thread running the POST sinks */
+#if !defined HTTPD_POST_SINK_THREAD_PRIO || defined __DOXYGEN__
+#define HTTPD_POST_SINK_THREAD_PRIO       DEFAULT_THREAD_PRIO
+#endif
+
+/** Mailbox size of the POST sink thread: the number of streamed POSTs that
+ * may be in progress at the same time */
+#if !defined HTTPD_POST_SINK_MBOX_SIZE || defined __DOXYGEN__
+#define HTTPD_POST_SINK_MBOX_SIZE         4
+#endif
+
 /** This string is passed in the HTTP header as "Server: " */
 #if !defined HTTPD_SERVER_AGENT || defined __DOXYGEN__
 #define HTTPD_SERVER_AGENT "lwIP/" LWIP_VERSION_STRING " (http://savannah.nongnu.org/projects/lwip)"
@@ -248,6 +285,40 @@
 #define LWIP_HTTPD_SUPPORT_11_KEEPALIVE     0
 #endif
 
+/** Set this to 1 to accept pipelined HTTP/1.1 requests: a request received
+ * while the previous response is still being sent is queued (up to
+ * LWIP_HTTPD_REQ_BUFSIZE bytes) and parsed as soon as that response is done.
+ * The connection is closed if the queue overflows.
+ * Needs LWIP_HTTPD_SUPPORT_11_KEEPALIVE and LWIP_HTTPD_SUPPORT_REQUESTLIST.
+ */
+#if !defined LWIP_HTTPD_PIPELINING || defined __DOXYGEN__
+#define LWIP_HTTPD_PIPELINING               0
+#endif
+
+/** Maximum number of idle HTTP/1.1 persistent connections kept open.
+ * When a response finishes and more connections than this are idle, the
+ * least recently used idle ones are closed. 0 means no limit.
+ */
+#if !defined LWIP_HTTPD_MAX_IDLE_KEEPALIVE || defined __DOXYGEN__
+#define LWIP_HTTPD_MAX_IDLE_KEEPALIVE       0
+#endif
+
+/** Set this to 1 to accept WebSocket upgrade requests (RFC 6455). Frames are
+ * received and sent through the handlers set by http_set_websocket_handlers()
+ * and httpd_websocket_write().
+ */
+#if !defined LWIP_HTTPD_WEBSOCKET || defined __DOXYGEN__
+#define LWIP_HTTPD_WEBSOCKET                0
+#endif
+
+/** Maximum payload length of a received WebSocket frame. Received frames are
+ * unmasked into a static buffer of this size; longer frames close the
+ * connection.
+ */
+#if !defined LWIP_HTTPD_WS_MAX_RX_LEN || defined __DOXYGEN__
+#define LWIP_HTTPD_WS_MAX_RX_LEN            512
+#endif
+
 /** Set this to 1 to support HTTP request coming in in multiple packets/pbufs */
 #if !defined LWIP_HTTPD_SUPPORT_REQUESTLIST || defined __DOXYGEN__
 #define LWIP_HTTPD_SUPPORT_REQUESTLIST      1
@@ -358,6 +429,27 @@
 #define LWIP_HTTPD_DYNAMIC_FILE_READ  0
 #endif
 
+/** Set this to 1 to send memory-mapped files straight from the file image
+ * (sendfile): instead of fs_read() copying each block into a buffer,
+ * fs_map() returns a pointer into the image that is queued as PBUF_ROM
+ * references, so no file data is copied. Custom files provide
+ * "int fs_map_custom(struct fs_file *file, const char **data, int count)"
+ * (return 0 to fall back to fs_read_custom()). SSI-processed files are still
+ * read into a buffer. Only useful with LWIP_HTTPD_DYNAMIC_FILE_READ.
+ */
+#if !defined LWIP_HTTPD_FS_SENDFILE || defined __DOXYGEN__
+#define LWIP_HTTPD_FS_SENDFILE        0
+#endif
+
+/** Set this to 1 to serve pre-compressed variants of fsdata files
+ * (makefsdata -enc): the Accept-Encoding header of a request is reduced to
+ * a mask of FS_FILE_FLAGS_ENC_* once, and fs_open_encoded() picks the
+ * best variant of the requested file it allows (br, then gzip, then plain).
+ */
+#if !defined LWIP_HTTPD_ACCEPT_ENCODING || defined __DOXYGEN__
+#define LWIP_HTTPD_ACCEPT_ENCODING    0
+#endif
+
 /** Set this to 1 to include an application state argument per file
  * that is opened. This allows to keep a state per connection/file.
  */
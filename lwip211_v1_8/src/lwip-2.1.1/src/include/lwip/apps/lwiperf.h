@@ -45,6 +45,12 @@ extern "C" {
 #endif
 
 #define LWIPERF_TCP_PORT_DEFAULT  5001
+#define LWIPERF_UDP_PORT_DEFAULT  5001
+
+/** Set this to 0 to leave out the UDP tests */
+#ifndef LWIPERF_UDP
+#define LWIPERF_UDP               (LWIP_UDP && LWIP_TIMERS)
+#endif
 
 /** lwIPerf test results */
 enum lwiperf_report_type
@@ -60,7 +66,13 @@ enum lwiperf_report_type
   /** Transmit error lead to test abort */
   LWIPERF_TCP_ABORTED_LOCAL_TXERROR,
   /** Remote side aborted the test */
-  LWIPERF_TCP_ABORTED_REMOTE
+  LWIPERF_TCP_ABORTED_REMOTE,
+  /** The UDP server side test is done */
+  LWIPERF_UDP_DONE_SERVER,
+  /** The UDP client side test is done */
+  LWIPERF_UDP_DONE_CLIENT,
+  /** A UDP server session was idle for too long */
+  LWIPERF_UDP_ABORTED_IDLE
 };
 
 /** Control */
@@ -70,7 +82,8 @@ enum lwiperf_client_type
   LWIPERF_CLIENT,
   /** Do a bidirectional test simultaneously */
   LWIPERF_DUAL,
-  /** Do a bidirectional test individually */
+  /** Do a bidirectional test individually (the remote side sends after the
+      client is done, i.e. a reverse test following the normal one) */
   LWIPERF_TRADEOFF
 };
 
@@ -89,6 +102,38 @@ void* lwiperf_start_tcp_client(const ip_addr_t* remote_addr, u16_t remote_port,
                                lwiperf_report_fn report_fn, void* report_arg);
 void* lwiperf_start_tcp_client_default(const ip_addr_t* remote_addr,
                                lwiperf_report_fn report_fn, void* report_arg);
+void* lwiperf_start_tcp_client_streams(const ip_addr_t* remote_addr, u16_t remote_port,
+                               enum lwiperf_client_type type, u8_t num_streams, u32_t duration_ms,
+                               lwiperf_report_fn report_fn, void* report_arg);
+
+#if LWIPERF_UDP
+/** UDP test results not covered by the lwiperf_report_fn arguments */
+struct lwiperf_udp_report
+{
+  /** Datagrams received (server) or sent (client) */
+  u32_t datagrams;
+  /** Datagrams lost, out of order and the interarrival jitter (RFC 1889):
+      measured by the server, for a client as reported back by the server */
+  u32_t lost;
+  u32_t out_of_order;
+  u32_t jitter_us;
+  /** Client: 1 if the server report has been received */
+  u8_t server_report;
+};
+
+/** Prototype of the report function of UDP sessions, like lwiperf_report_fn
+    with the loss and jitter statistics added */
+typedef void (*lwiperf_udp_report_fn)(void *arg, enum lwiperf_report_type report_type,
+  const ip_addr_t* local_addr, u16_t local_port, const ip_addr_t* remote_addr, u16_t remote_port,
+  u32_t bytes_transferred, u32_t ms_duration, u32_t bandwidth_kbitpsec,
+  const struct lwiperf_udp_report *udp);
+
+void* lwiperf_start_udp_server(const ip_addr_t* local_addr, u16_t local_port,
+                               lwiperf_udp_report_fn report_fn, void* report_arg);
+void* lwiperf_start_udp_client(const ip_addr_t* remote_addr, u16_t remote_port,
+                               enum lwiperf_client_type type, u8_t num_streams, u32_t duration_ms,
+                               u32_t rate_bps, lwiperf_udp_report_fn report_fn, void* report_arg);
+#endif /* LWIPERF_UDP */
 
 void  lwiperf_abort(void* lwiperf_session);
 
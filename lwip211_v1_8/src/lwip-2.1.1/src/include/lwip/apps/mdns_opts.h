@@ -59,6 +59,17 @@
 #define MDNS_MAX_SERVICES               1
 #endif
 
+/** The number of encoded reply packets kept per netif. A query asking for the
+ * same set of records as an earlier one, the second family of an announcement
+ * and repeated probes are sent from this cache instead of encoding and
+ * compressing every record again. Entries are dropped when the host name,
+ * services or addresses change (through mdns_resp_restart() or
+ * mdns_resp_announce()). Set to 0 to build every reply from scratch.
+ */
+#ifndef MDNS_REPLY_CACHE_SIZE
+#define MDNS_REPLY_CACHE_SIZE           4
+#endif
+
 /** MDNS_RESP_USENETIF_EXTCALLBACK==1: register an ext_callback on the netif
  * to automatically restart probing/announcing on status or address change.
  */
@@ -198,6 +198,25 @@ err_t mqtt_sub_unsub(mqtt_client_t *client, const char *topic, u8_t qos, mqtt_re
 err_t mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_t payload_length, u8_t qos, u8_t retain,
                                     mqtt_request_cb_t cb, void *arg);
 
+#if MQTT_OUTPUT_NOCOPY
+/**
+ * @ingroup mqtt
+ * Function prototype for the payload callback of mqtt_publish_nocopy(). Called
+ * when the stack does not reference the payload any more (it has been
+ * acknowledged by the server's TCP, or the connection has been closed).
+ * @param arg Pointer to user data supplied to mqtt_publish_nocopy()
+ * @param payload The payload passed to mqtt_publish_nocopy()
+ */
+typedef void (*mqtt_payload_free_cb_t)(void *arg, const void *payload);
+
+err_t mqtt_publish_nocopy(mqtt_client_t *client, const char *topic, const void *payload, u32_t payload_length, u8_t qos,
+                          u8_t retain, mqtt_request_cb_t cb, void *arg, mqtt_payload_free_cb_t free_cb);
+#endif /* MQTT_OUTPUT_NOCOPY */
+
+#if MQTT_OUTPUT_BATCH_LEN
+void mqtt_flush(mqtt_client_t *client);
+#endif /* MQTT_OUTPUT_BATCH_LEN */
+
 #ifdef __cplusplus
 }
 #endif
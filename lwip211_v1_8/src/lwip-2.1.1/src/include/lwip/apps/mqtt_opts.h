@@ -56,6 +56,15 @@ extern "C" {
 #define MQTT_OUTPUT_RINGBUF_SIZE 256
 #endif
 
+/**
+ * Number of publishes sent with mqtt_publish_nocopy() that can be queued or
+ * waiting for their payload to be acknowledged at the same time.
+ * 0 disables mqtt_publish_nocopy().
+ */
+#ifndef MQTT_OUTPUT_NOCOPY
+#define MQTT_OUTPUT_NOCOPY 0
+#endif
+
 /**
  * Number of bytes in receive buffer, must be at least the size of the longest incoming topic + 8
  * If one wants to avoid fragmented incoming publish, set length to max incoming topic length + max payload length + 8
@@ -65,12 +74,32 @@ extern "C" {
 #endif
 
 /**
- * Maximum number of pending subscribe, unsubscribe and publish requests to server .
+ * Maximum number of pending subscribe, unsubscribe and publish requests to server.
+ * Requests are looked up by packet identifier in a table of this size, so the
+ * window can be made large (hundreds) for high QoS 1/2 publish rates.
  */
 #ifndef MQTT_REQ_MAX_IN_FLIGHT
 #define MQTT_REQ_MAX_IN_FLIGHT 4
 #endif
 
+/**
+ * Defer sending publishes until this many bytes (e.g. TCP_MSS) have been
+ * passed to TCP, so that many small publishes share one segment. Publishes
+ * are sent at once when the TCP send buffer is full, and with everything
+ * else the client sends or mqtt_flush(). 0 sends each publish at once.
+ */
+#ifndef MQTT_OUTPUT_BATCH_LEN
+#define MQTT_OUTPUT_BATCH_LEN 0
+#endif
+
+/**
+ * Milliseconds a deferred publish waits at most for MQTT_OUTPUT_BATCH_LEN.
+ * Each connected client uses one more sys_timeout (MEMP_NUM_SYS_TIMEOUT).
+ */
+#ifndef MQTT_OUTPUT_BATCH_DELAY
+#define MQTT_OUTPUT_BATCH_DELAY 5
+#endif
+
 /**
  * Seconds between each cyclic timer call.
  */
@@ -47,16 +47,25 @@ extern "C" {
 /** Pending request item, binds application callback to pending server requests */
 struct mqtt_request_t
 {
-  /** Next item in list, NULL means this is the last in chain,
-      next pointing at itself means request is unallocated */
+  /** Next item in pending queue or free list, NULL means this is the last in chain */
   struct mqtt_request_t *next;
+  struct mqtt_request_t *prev;
+  /** Next item in the same pend_req_index bucket */
+  struct mqtt_request_t *id_next;
   /** Callback to upper layer */
   mqtt_request_cb_t cb;
   void *arg;
+  /** Expire time, compared to mqtt_client_s::req_time */
+  u32_t timeout;
   /** MQTT packet identifier */
   u16_t pkt_id;
-  /** Expire time relative to element before this  */
-  u16_t timeout_diff;
+};
+
+/** Pending requests, oldest (first to expire) at head */
+struct mqtt_request_queue_t
+{
+  struct mqtt_request_t *head;
+  struct mqtt_request_t *tail;
 };
 
 /** Ring buffer */
@@ -66,6 +75,23 @@ struct mqtt_ringbuf_t {
   u8_t buf[MQTT_OUTPUT_RINGBUF_SIZE];
 };
 
+#if MQTT_OUTPUT_NOCOPY
+/** Payload of mqtt_publish_nocopy(), sent by reference after the ring buffer
+    bytes preceding it */
+struct mqtt_output_ref {
+  const u8_t *payload;
+  u32_t len;
+  /** Bytes of payload passed to TCP */
+  u32_t written;
+  /** Ring buffer bytes (counted like mqtt_client_s::ring_sent) to send before the payload */
+  u32_t ring_pos;
+  /** TCP stream position (counted like mqtt_client_s::tx_written) after the payload */
+  u32_t end;
+  mqtt_payload_free_cb_t free_cb;
+  void *arg;
+};
+#endif /* MQTT_OUTPUT_NOCOPY */
+
 /** MQTT client */
 struct mqtt_client_s
 {
@@ -83,8 +109,16 @@ struct mqtt_client_s
   /** Connection callback */
   void *connect_arg;
   mqtt_connection_cb_t connect_cb;
-  /** Pending requests to server */
-  struct mqtt_request_t *pend_req_queue;
+  /** Pending requests to server that are answered by pkt_id */
+  struct mqtt_request_queue_t pend_req;
+  /** Pending QoS 0 publishes, completed when TCP data is acknowledged */
+  struct mqtt_request_queue_t pend_qos0;
+  /** pend_req items by pkt_id */
+  struct mqtt_request_t *pend_req_index[MQTT_REQ_MAX_IN_FLIGHT];
+  /** Unused items of req_list */
+  struct mqtt_request_t *req_free;
+  /** Seconds spent connected, for request timeouts */
+  u32_t req_time;
   struct mqtt_request_t req_list[MQTT_REQ_MAX_IN_FLIGHT];
   void *inpub_arg;
   /** Incoming data callback */
@@ -95,6 +129,24 @@ struct mqtt_client_s
   u8_t rx_buffer[MQTT_VAR_HEADER_BUFFER_LEN];
   /** Output ring-buffer */
   struct mqtt_ringbuf_t output;
+#if MQTT_OUTPUT_NOCOPY
+  /** Zero-copy payloads, oldest first */
+  struct mqtt_output_ref out_ref[MQTT_OUTPUT_NOCOPY];
+  u8_t out_ref_first;
+  u8_t out_ref_num;
+  /** Number of out_ref entries (from out_ref_first) completely passed to TCP */
+  u8_t out_ref_written;
+  /** Bytes taken from the ring buffer, passed to TCP and acknowledged */
+  u32_t ring_sent;
+  u32_t tx_written;
+  u32_t tx_acked;
+#endif /* MQTT_OUTPUT_NOCOPY */
+#if MQTT_OUTPUT_BATCH_LEN
+  /** Bytes passed to TCP but not sent yet */
+  u32_t batch_len;
+  /** mqtt_output_batch_timeout is scheduled */
+  u8_t batch_timer;
+#endif /* MQTT_OUTPUT_BATCH_LEN */
 };
 
 #ifdef __cplusplus
@@ -104,6 +104,26 @@ err_t smtp_send_mail_bodycback(const char *from, const char* to, const char* sub
 
 #endif /* SMTP_BODYDH */
 
+#if SMTP_BODY_REGIONS
+
+/** One piece of a body sent by smtp_send_mail_regions() */
+struct smtp_body_region {
+  /** start of the data, must stay untouched until the callback is called */
+  const void *data;
+  /** length of the data */
+  size_t len;
+  /** If this is != 0, the data is sent base64-encoded in lines of 76
+   * characters (e.g. an attachment), else it is sent as it is and must
+   * conform to the SMTP rules (7-bit, CRLF line endings). */
+  u8_t base64;
+};
+
+err_t smtp_send_mail_regions(const char *from, const char* to, const char* subject,
+                     const struct smtp_body_region *regions, u16_t num_regions,
+                     smtp_result_fn callback_fn, void* callback_arg);
+
+#endif /* SMTP_BODY_REGIONS */
+
 
 err_t smtp_set_server_addr(const char* server);
 void smtp_set_server_port(u16_t port);
@@ -19,6 +19,21 @@ extern "C" {
 #define SMTP_BODYDH             0
 #endif
 
+/** Set this to 1 to enable smtp_send_mail_regions(): the body is streamed
+ * from application memory regions (e.g. log buffers) that are referenced by
+ * the TCP segments instead of being copied, regions marked as base64 are
+ * encoded in blocks of SMTP_BODY_B64_LINES lines. */
+#ifndef SMTP_BODY_REGIONS
+#define SMTP_BODY_REGIONS       0
+#endif
+
+/** Number of 76 character base64 lines encoded in one go for
+ * SMTP_BODY_REGIONS, the encode buffer (78 bytes per line) is allocated
+ * together with the session. */
+#ifndef SMTP_BODY_B64_LINES
+#define SMTP_BODY_B64_LINES     32
+#endif
+
 /** SMTP_DEBUG: Enable debugging for SNTP. */
 #ifndef SMTP_DEBUG
 #define SMTP_DEBUG              LWIP_DBG_OFF
@@ -60,7 +60,10 @@
 /**
  * SNMP_USE_NETCONN: Use netconn API instead of raw API.
  * Makes SNMP agent run in a worker thread, so blocking operations
- * can be done in MIB calls.
+ * can be done in MIB calls. Parsing, processing and encoding of requests
+ * all happen there, the lwIP MIB2 nodes take the stack state under
+ * short locks (see snmp_init()), so bulk walks don't delay packet
+ * processing in tcpip_thread.
  */
 #if !defined SNMP_USE_NETCONN || defined __DOXYGEN__
 #define SNMP_USE_NETCONN           0
@@ -93,6 +96,8 @@
 
 /**
  * SNMP_THREAD_PRIO: SNMP netconn worker thread priority
+ * Below TCPIP_THREAD_PRIO, management traffic should wait for the
+ * stack and not the other way round.
  */
 #if !defined SNMP_THREAD_PRIO || defined __DOXYGEN__
 #define SNMP_THREAD_PRIO           DEFAULT_THREAD_PRIO
@@ -263,6 +268,25 @@
 #define SNMP_LWIP_GETBULK_MAX_REPETITIONS 0
 #endif
 
+/**
+ * Dynamic tables (the TCP and UDP connection and listener tables of MIB2) are searched
+ * anew for every GetNext, which means one scan of the PCB lists per varbind of a walk.
+ * While a GetNext or GetBulk request is processed, a table may instead take a sorted
+ * snapshot of its rows once and answer from that. This is the number of rows a snapshot
+ * holds, tables with more rows are still scanned. 0 disables snapshots.
+ */
+#if !defined SNMP_TABLE_SNAPSHOT_ROWS || defined __DOXYGEN__
+#define SNMP_TABLE_SNAPSHOT_ROWS          16
+#endif
+
+/**
+ * Number of snapshots, i.e. of tables that one request can walk side by side without
+ * taking their snapshots again and again.
+ */
+#if !defined SNMP_TABLE_SNAPSHOTS || defined __DOXYGEN__
+#define SNMP_TABLE_SNAPSHOTS              2
+#endif
+
 /**
  * @}
  */
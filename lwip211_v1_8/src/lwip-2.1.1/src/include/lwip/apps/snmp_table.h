@@ -125,6 +125,38 @@ s16_t snmp_table_extract_value_from_s32ref(struct snmp_node_instance* instance,
 s16_t snmp_table_extract_value_from_u32ref(struct snmp_node_instance* instance, void* value);
 s16_t snmp_table_extract_value_from_refconstptr(struct snmp_node_instance* instance, void* value);
 
+#if SNMP_TABLE_SNAPSHOT_ROWS
+
+/** Longest row OID of a table that uses snapshots, that of udpEndpointTable */
+#if LWIP_IPV6
+#define SNMP_TABLE_SNAPSHOT_OID_LEN 39
+#else
+#define SNMP_TABLE_SNAPSHOT_OID_LEN 15
+#endif
+
+/** One row of a table snapshot */
+struct snmp_table_snapshot_row
+{
+  u32_t oid[SNMP_TABLE_SNAPSHOT_OID_LEN];
+  u8_t oid_len;
+  /** whatever the table needs besides the row OID to answer for the row */
+  u32_t value;
+};
+
+typedef enum {
+  SNMP_TABLE_SNAPSHOT_NONE,   /* no snapshot, search the table as without */
+  SNMP_TABLE_SNAPSHOT_FOUND,  /* row_oid and value are the next row */
+  SNMP_TABLE_SNAPSHOT_END     /* there is no row after row_oid */
+} snmp_table_snapshot_status_t;
+
+/** Adds all rows of a table to a snapshot with snmp_table_snapshot_add() */
+typedef void (*snmp_table_snapshot_fill_fn)(void);
+
+void snmp_table_snapshot_add(const u32_t* oid, u8_t oid_len, u32_t value);
+snmp_table_snapshot_status_t snmp_table_snapshot_next(snmp_table_snapshot_fill_fn fill, struct snmp_obj_id* row_oid, u32_t* value);
+
+#endif /* SNMP_TABLE_SNAPSHOT_ROWS */
+
 #endif /* LWIP_SNMP */
 
 #ifdef __cplusplus
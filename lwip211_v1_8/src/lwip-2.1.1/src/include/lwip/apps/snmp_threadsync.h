@@ -78,6 +78,8 @@ struct snmp_threadsync_instance
   sys_sem_t                       sem;
   sys_mutex_t                     sem_usage_mutex;
   snmp_threadsync_synchronizer_fn sync_fn;
+  /** sync_fn runs the function before it returns, sem is not used */
+  u8_t                            direct;
   struct threadsync_data          data;
 };
 
@@ -104,6 +106,8 @@ snmp_err_t snmp_threadsync_get_next_instance(const u32_t *root_oid, u8_t root_oi
 
 /** Create thread sync instance data */
 void snmp_threadsync_init(struct snmp_threadsync_instance *instance, snmp_threadsync_synchronizer_fn sync_fn);
+/** Create thread sync instance data for a synchronous sync_fn */
+void snmp_threadsync_init_direct(struct snmp_threadsync_instance *instance, snmp_threadsync_synchronizer_fn sync_fn);
 
 #endif /* LWIP_SNMP */
 
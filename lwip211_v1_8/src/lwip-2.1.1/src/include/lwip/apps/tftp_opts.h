@@ -99,6 +99,25 @@
 #define TFTP_MAX_MODE_LEN     7
 #endif
 
+/**
+ * Largest block size (RFC 2348) granted to a client. Larger requests are cut
+ * down to this, and to what fits the MTU of the netif towards the client.
+ * Clients that don't ask get the 512 bytes of RFC 1350.
+ */
+#if !defined TFTP_MAX_BLKSIZE || defined __DOXYGEN__
+#define TFTP_MAX_BLKSIZE      1468
+#endif
+
+/**
+ * Largest window size (RFC 7440) granted to a client, in blocks. A read
+ * transfer keeps that many blocks for retransmission, in one buffer of
+ * window size * block size from the heap, unless tftp_context::read_ref
+ * provides the data in place.
+ */
+#if !defined TFTP_MAX_WINDOWSIZE || defined __DOXYGEN__
+#define TFTP_MAX_WINDOWSIZE   8
+#endif
+
 /**
  * @}
  */
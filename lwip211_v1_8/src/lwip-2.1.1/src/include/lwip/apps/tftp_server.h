@@ -71,7 +71,9 @@ struct tftp_context {
    * @param handle File handle returned by open()
    * @param buf Target buffer to copy read data to
    * @param bytes Number of bytes to copy to buf
-   * @returns &gt;= 0: Success; &lt; 0: Error
+   * @returns &gt;= 0: Success; &lt; 0: Error;
+   *          ERR_WOULDBLOCK: no data yet, e.g. while it is read from slow
+   *          storage by another thread. Call tftp_read_ready() when there is.
    */
   int (*read)(void* handle, void* buf, int bytes);
   /**
@@ -83,10 +85,20 @@ struct tftp_context {
    * @returns &gt;= 0: Success; &lt; 0: Error
    */
   int (*write)(void* handle, struct pbuf* p);
+  /**
+   * Optional: read from a file that is in memory, without copying.
+   * Advances the file position like read().
+   * @param handle File handle returned by open()
+   * @param bytes Maximum number of bytes wanted
+   * @param len Returns the number of bytes available, &lt; bytes at the end of the file
+   * @returns Pointer to the data, which must stay valid until close(); NULL on error
+   */
+  const void* (*read_ref)(void* handle, int bytes, int* len);
 };
 
 err_t tftp_init(const struct tftp_context* ctx);
 void tftp_cleanup(void);
+void tftp_read_ready(void);
 
 #ifdef __cplusplus
 }
@@ -368,6 +368,20 @@ extern "C" {
 #define PACK_STRUCT_USE_INCLUDES
 #endif
 
+/** LWIP_HOT_TEXT: attribute for the functions every packet runs through (the
+ * netif drivers' receive and send, ethernet_input, ip4_input, tcp_input and
+ * tcp_output, the checksum, memp and pbuf allocation), e.g.
+ * __attribute__((section(".tcm_text"))) to link them into tightly coupled
+ * memory. LWIP_HOT_DATA does the same for the data those touch on every packet:
+ * the memp free lists, lwip_stats and the netif list. Both are empty by default.
+ */
+#ifndef LWIP_HOT_TEXT
+#define LWIP_HOT_TEXT
+#endif
+#ifndef LWIP_HOT_DATA
+#define LWIP_HOT_DATA
+#endif
+
 /** Eliminates compiler warning about unused arguments (GCC -Wextra -Wunused). */
 #ifndef LWIP_UNUSED_ARG
 #define LWIP_UNUSED_ARG(x) (void)x
@@ -69,6 +69,12 @@ extern "C" {
 #define IP_PCB_NETIFHINT
 #endif /* LWIP_NETIF_USE_HINTS */
 
+#if LWIP_IPV4 && LWIP_IPV4_ROUTE_CACHE
+#define IP_PCB_ROUTEHINT ;struct ip4_route_hint route_hint
+#else /* LWIP_IPV4 && LWIP_IPV4_ROUTE_CACHE */
+#define IP_PCB_ROUTEHINT
+#endif /* LWIP_IPV4 && LWIP_IPV4_ROUTE_CACHE */
+
 /** This is the common part of all PCB types. It needs to be at the
    beginning of a PCB type definition. It is located here so that
    changes to this common part are made in one location instead of
@@ -86,7 +92,9 @@ extern "C" {
   /* Time To Live */                       \
   u8_t ttl                                 \
   /* link layer address resolution hint */ \
-  IP_PCB_NETIFHINT
+  IP_PCB_NETIFHINT                         \
+  /* netif found for remote_ip */          \
+  IP_PCB_ROUTEHINT
 
 struct ip_pcb {
   /* Common members of all PCB types */
@@ -316,6 +324,26 @@ err_t ip_input(struct pbuf *p, struct netif *inp);
 
 #endif /* LWIP_IPV6 */
 
+/**
+ * @ingroup ip
+ * ip_route() for a pcb: hint is where it keeps the netif found for its
+ * remote address. See \ref ip4_route_hinted
+ */
+#if LWIP_IPV4 && LWIP_IPV4_ROUTE_CACHE
+#if LWIP_IPV6
+#define ip_route_hinted(src, dest, hint) \
+        (IP_IS_V6(dest) ? \
+        ip6_route(ip_2_ip6(src), ip_2_ip6(dest)) : \
+        ip4_route_hinted(ip_2_ip4(dest), hint))
+#else /* LWIP_IPV6 */
+#define ip_route_hinted(src, dest, hint) \
+        ip4_route_hinted(dest, hint)
+#endif /* LWIP_IPV6 */
+#else /* LWIP_IPV4 && LWIP_IPV4_ROUTE_CACHE */
+#define ip_route_hinted(src, dest, hint) \
+        ip_route(src, dest)
+#endif /* LWIP_IPV4 && LWIP_IPV4_ROUTE_CACHE */
+
 #define ip_route_get_local_ip(src, dest, netif, ipaddr) do { \
   (netif) = ip_route(src, dest); \
   (ipaddr) = ip_netif_get_local_ip(netif, dest); \
@@ -94,6 +94,46 @@ void  ip4_set_default_multicast_netif(struct netif* default_multicast_netif);
 
 #define ip4_netif_get_local_ip(netif) (((netif) != NULL) ? netif_ip_addr4(netif) : NULL)
 
+#if IP_FORWARD && IP_FORWARD_FLOW_CACHE && !defined(LWIP_HOOK_IP4_ROUTE) && \
+    !defined(LWIP_HOOK_IP4_ROUTE_SRC) && !defined(LWIP_HOOK_IP4_CANFORWARD)
+#define LWIP_IPV4_FORWARD_CACHE 1
+#else
+#define LWIP_IPV4_FORWARD_CACHE 0
+#endif
+
+#if LWIP_IPV4_FORWARD_CACHE
+void ip4_forward_cache_flush(void);
+void ip4_forward_batch_begin(void);
+void ip4_forward_batch_end(void);
+#define IP4_FORWARD_CACHE_FLUSH() ip4_forward_cache_flush()
+#else /* LWIP_IPV4_FORWARD_CACHE */
+#define IP4_FORWARD_CACHE_FLUSH()
+#define ip4_forward_batch_begin()
+#define ip4_forward_batch_end()
+#endif /* LWIP_IPV4_FORWARD_CACHE */
+
+#if IP_ROUTE_CACHE && !LWIP_SINGLE_NETIF && !defined(LWIP_HOOK_IP4_ROUTE) && \
+    !defined(LWIP_HOOK_IP4_ROUTE_SRC)
+#define LWIP_IPV4_ROUTE_CACHE 1
+#else
+#define LWIP_IPV4_ROUTE_CACHE 0
+#endif
+
+#if LWIP_IPV4_ROUTE_CACHE
+/** The netif a pcb found for its remote address, see ip4_route_hinted() */
+struct ip4_route_hint {
+  ip4_addr_t dest;
+  struct netif *netif;
+  u32_t gen;
+};
+
+struct netif *ip4_route_hinted(const ip4_addr_t *dest, struct ip4_route_hint *hint);
+void ip4_route_cache_flush(void);
+#define IP4_ROUTE_CACHE_FLUSH() ip4_route_cache_flush()
+#else /* LWIP_IPV4_ROUTE_CACHE */
+#define IP4_ROUTE_CACHE_FLUSH()
+#endif /* LWIP_IPV4_ROUTE_CACHE */
+
 #if IP_DEBUG
 void ip4_debug_print(struct pbuf *p);
 #else
@@ -61,8 +61,12 @@ extern "C" {
 struct ip_reassdata {
   struct ip_reassdata *next;
   struct pbuf *p;
+  /* fragment with the highest offset, in-order fragments are appended here */
+  struct pbuf *p_tail;
   struct ip_hdr iphdr;
   u16_t datagram_len;
+  /* payload bytes received so far (fragments never overlap) */
+  u16_t recv_len;
   u8_t flags;
   u8_t timer;
 };
@@ -86,6 +90,19 @@ struct pbuf_custom_ref {
   struct pbuf *original;
 };
 #endif /* LWIP_PBUF_CUSTOM_REF_DEFINED */
+
+#if MEMP_NUM_FRAG_HDR
+/** Room for the link and IP header of one fragment */
+#define IP_FRAG_HDR_MEM_LEN (LWIP_MEM_ALIGN_SIZE(PBUF_LINK_ENCAPSULATION_HLEN + PBUF_LINK_HLEN) + IP_HLEN)
+
+/** A custom PBUF_RAM holding the headers of one fragment in the same memp
+ * element, so that fragmenting takes nothing from the heap. */
+struct ip_frag_hdr {
+  /** 'base class' */
+  struct pbuf_custom pc;
+  u8_t hdr[LWIP_MEM_ALIGN_BUFFER(IP_FRAG_HDR_MEM_LEN)];
+};
+#endif /* MEMP_NUM_FRAG_HDR */
 #endif /* !LWIP_NETIF_TX_SINGLE_PBUF */
 
 err_t ip4_frag(struct pbuf *p, struct netif *netif, const ip4_addr_t *dest);
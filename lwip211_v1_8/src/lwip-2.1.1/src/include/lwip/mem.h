@@ -75,6 +75,12 @@ void *mem_malloc(mem_size_t size);
 void *mem_calloc(mem_size_t count, mem_size_t size);
 void  mem_free(void *mem);
 
+#if MEM_ARENA_SIZE
+void *mem_arena_malloc(mem_size_t size);
+#else
+#define mem_arena_malloc(size) mem_malloc(size)
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -97,7 +97,11 @@ extern const struct memp_desc* const memp_pools[MEMP_MAX];
     \
   LWIP_MEMPOOL_DECLARE_STATS_INSTANCE(memp_stats_ ## name) \
     \
-  static struct memp *memp_tab_ ## name; \
+  static struct memp *memp_tab_ ## name LWIP_HOT_DATA; \
+    \
+  LWIP_MEMPOOL_DECLARE_LOCKFREE_INSTANCE(memp_lf_ ## name) \
+    \
+  LWIP_MEMPOOL_DECLARE_LAZY_INSTANCE(memp_carved_ ## name) \
     \
   const struct memp_desc memp_ ## name = { \
     DECLARE_LWIP_MEMPOOL_DESC(desc) \
@@ -106,6 +110,8 @@ extern const struct memp_desc* const memp_pools[MEMP_MAX];
     (num), \
     memp_memory_ ## name ## _base, \
     &memp_tab_ ## name \
+    LWIP_MEMPOOL_DECLARE_LOCKFREE_REFERENCE(memp_lf_ ## name) \
+    LWIP_MEMPOOL_DECLARE_LAZY_REFERENCE(memp_carved_ ## name) \
   };
 
 #endif /* MEMP_MEM_MALLOC */
@@ -147,6 +153,23 @@ void *memp_malloc_fn(memp_t type, const char* file, const int line);
 void *memp_malloc(memp_t type);
 #endif
 void  memp_free(memp_t type, void *mem);
+#if !MEMP_MEM_MALLOC
+u16_t memp_index(memp_t type, const void *mem);
+#endif /* !MEMP_MEM_MALLOC */
+
+#if MEMP_MAGAZINE
+/** Pools cached by MEMP_MAGAZINE: PBUF_POOL, PBUF and TCP_SEG */
+#define MEMP_MAGAZINE_POOLS 3
+
+/** Per-thread cache, provided by the thread (e.g. as a static variable) */
+struct memp_magazine {
+  void *elem[MEMP_MAGAZINE_POOLS][MEMP_MAGAZINE_SIZE];
+  u8_t count[MEMP_MAGAZINE_POOLS];
+};
+
+void memp_magazine_thread_init(struct memp_magazine *mag);
+void memp_magazine_thread_deinit(void);
+#endif /* MEMP_MAGAZINE */
 
 #ifdef __cplusplus
 }
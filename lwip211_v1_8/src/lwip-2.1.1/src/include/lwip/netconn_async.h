@@ -0,0 +1,128 @@
+/**
+ * @file
+ * Asynchronous netconn API (to be used from non-TCPIP threads)
+ */
+
+/*
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+#ifndef LWIP_HDR_NETCONN_ASYNC_H
+#define LWIP_HDR_NETCONN_ASYNC_H
+
+#include "lwip/opt.h"
+
+#if LWIP_NETCONN && LWIP_NETCONN_ASYNC /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/api.h"
+#include "lwip/sys.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Operations of the asynchronous netconn API */
+enum netconn_async_type {
+  /** TCP: accept a connection on a listening netconn (result: newconn) */
+  NETCONN_ASYNC_ACCEPT,
+  /** receive data (result: p for TCP, buf for UDP and RAW) */
+  NETCONN_ASYNC_RECV,
+  /** connect to addr/port */
+  NETCONN_ASYNC_CONNECT,
+  /** TCP: write len bytes from data with apiflags (result: done) */
+  NETCONN_ASYNC_WRITE,
+  /** UDP/RAW: send buf */
+  NETCONN_ASYNC_SEND,
+  /** complete the other operations with ERR_CLSD and delete the netconn */
+  NETCONN_ASYNC_CLOSE
+};
+
+/** @ingroup netconn_async
+ * An operation. It belongs to the application, which must keep it and the
+ * data it points to until netconn_cq_wait() returns it.
+ */
+struct netconn_async_op {
+  /** internal: next operation of the same netconn or completion queue */
+  struct netconn_async_op *next;
+  enum netconn_async_type type;
+  struct netconn *conn;
+  /** not used by the stack */
+  void *arg;
+
+  /* NETCONN_ASYNC_CONNECT */
+  const ip_addr_t *addr;
+  u16_t port;
+  /* NETCONN_ASYNC_WRITE: NETCONN_DONTBLOCK is added to apiflags */
+  const void *data;
+  size_t len;
+  u8_t apiflags;
+  /* NETCONN_ASYNC_SEND, or the result of NETCONN_ASYNC_RECV on UDP/RAW */
+  struct netbuf *buf;
+
+  /** result: ERR_OK or the error the operation ended with */
+  err_t err;
+  /** NETCONN_ASYNC_WRITE: bytes written */
+  size_t done;
+  /** NETCONN_ASYNC_RECV on TCP: received data, NULL with ERR_CLSD at the end */
+  struct pbuf *p;
+  /** NETCONN_ASYNC_ACCEPT: the new netconn, on the same completion queue */
+  struct netconn *newconn;
+};
+
+/** @ingroup netconn_async
+ * A completion queue. It and its netconns are used by one task.
+ */
+struct netconn_cq {
+  /** signalled when a waiting task has something to do */
+  sys_sem_t sem;
+  /** a task is blocked in netconn_cq_wait() */
+  u8_t waiting;
+  /** netconns with pending operations that had an event (linked by async_next) */
+  struct netconn *kicked_head;
+  struct netconn *kicked_tail;
+  /** completed operations not returned yet */
+  struct netconn_async_op *done_head;
+  struct netconn_async_op *done_tail;
+};
+
+err_t netconn_cq_new(struct netconn_cq *cq);
+void  netconn_cq_free(struct netconn_cq *cq);
+struct netconn *netconn_async_new(struct netconn_cq *cq, enum netconn_type t);
+err_t netconn_async_submit(struct netconn_async_op *op);
+err_t netconn_cq_wait(struct netconn_cq *cq, struct netconn_async_op **op, u32_t timeout);
+/** @ingroup netconn_async
+ * Return a completed operation without blocking (ERR_WOULDBLOCK if none) */
+#define netconn_cq_poll(cq, op) netconn_cq_wait(cq, op, NETCONN_CQ_NOWAIT)
+
+/** netconn_cq_wait() timeout that does not block */
+#define NETCONN_CQ_NOWAIT 0xffffffffUL
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_NETCONN && LWIP_NETCONN_ASYNC */
+
+#endif /* LWIP_HDR_NETCONN_ASYNC_H */
@@ -213,6 +213,18 @@ typedef err_t (*netif_output_ip6_fn)(struct netif *netif, struct pbuf *p,
  * @param p The packet to send (raw ethernet packet)
  */
 typedef err_t (*netif_linkoutput_fn)(struct netif *netif, struct pbuf *p);
+#if LWIP_NETIF_LINKOUTPUT_BURST
+/** Function prototype for netif->linkoutput_burst functions. Like
+ * netif->linkoutput, for n frames at once. The frames still belong to the
+ * caller: pbuf_ref() the ones kept after returning.
+ *
+ * @param netif The netif which shall send the frames
+ * @param frames The frames to send, in order (raw ethernet packets)
+ * @param n The number of frames
+ * @return ERR_OK if all frames were sent or queued, an error if one was dropped
+ */
+typedef err_t (*netif_linkoutput_burst_fn)(struct netif *netif, struct pbuf **frames, u16_t n);
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
 /** Function prototype for netif status- or link-callback functions. */
 typedef void (*netif_status_callback_fn)(struct netif *netif);
 #if LWIP_IPV4 && LWIP_IGMP
@@ -300,6 +312,22 @@ struct netif {
    *  to send a packet on the interface. This function outputs
    *  the pbuf as-is on the link medium. */
   netif_linkoutput_fn linkoutput;
+#if LWIP_NETIF_LINKOUTPUT_BURST
+  /** Optional: called by ethernet_output() instead of linkoutput for the
+   *  frames staged between netif_burst_begin() and netif_burst_end() */
+  netif_linkoutput_burst_fn linkoutput_burst;
+  /** frames staged for linkoutput_burst */
+  struct pbuf *burst[NETIF_BURST_MAX];
+  u8_t burst_len;
+  /** nesting depth of netif_burst_begin() */
+  u8_t burst_depth;
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
+#if LWIP_TCP && TCP_ACK_STRETCH
+  /** segments and bytes per ACK for TCP data received on this netif,
+   *  see netif_set_ack_stretch() */
+  u8_t ack_stretch_segs;
+  u32_t ack_stretch_bytes;
+#endif /* LWIP_TCP && TCP_ACK_STRETCH */
 #if LWIP_IPV6
   /** This function is called by the IPv6 module when it wants
    *  to send a packet on the interface. This function typically
@@ -510,6 +538,21 @@ void netif_set_link_callback(struct netif *netif, netif_status_callback_fn link_
 #endif /* LWIP_IPV6 && LWIP_IPV6_MLD */
 
 #if ENABLE_LOOPBACK
+#if LWIP_NETIF_LOOPBACK_ZEROCOPY
+#ifndef LWIP_PBUF_CUSTOM_REF_DEFINED
+#define LWIP_PBUF_CUSTOM_REF_DEFINED
+/** A custom pbuf that holds a reference to another pbuf, which is freed
+ * when this custom pbuf is freed. This is used to create a custom PBUF_REF
+ * that points into the original pbuf. */
+struct pbuf_custom_ref {
+  /** 'base class' */
+  struct pbuf_custom pc;
+  /** pointer to the original pbuf that is referenced */
+  struct pbuf *original;
+};
+#endif /* LWIP_PBUF_CUSTOM_REF_DEFINED */
+#endif /* LWIP_NETIF_LOOPBACK_ZEROCOPY */
+
 err_t netif_loop_output(struct netif *netif, struct pbuf *p);
 void netif_poll(struct netif *netif);
 #if !LWIP_NETIF_LOOPBACK_MULTITHREADING
@@ -519,6 +562,26 @@ void netif_poll_all(void);
 
 err_t netif_input(struct pbuf *p, struct netif *inp);
 
+#if LWIP_NETIF_LINKOUTPUT_BURST
+void  netif_burst_begin(struct netif *netif);
+void  netif_burst_end(struct netif *netif);
+err_t netif_linkoutput(struct netif *netif, struct pbuf *p);
+#define NETIF_BURST_BEGIN(netif) netif_burst_begin(netif)
+#define NETIF_BURST_END(netif)   netif_burst_end(netif)
+#else /* LWIP_NETIF_LINKOUTPUT_BURST */
+#define netif_linkoutput(netif, p) (netif)->linkoutput(netif, p)
+#define NETIF_BURST_BEGIN(netif)
+#define NETIF_BURST_END(netif)
+#endif /* LWIP_NETIF_LINKOUTPUT_BURST */
+
+#if LWIP_TCP && TCP_ACK_STRETCH
+/** @ingroup netif
+ * Send one ACK per 'segs' full segments or 'bytes' bytes (0: no byte limit)
+ * for TCP data received on this netif. Pcbs may override it with
+ * tcp_set_ack_stretch(). */
+#define netif_set_ack_stretch(netif, segs, bytes) do { if((netif) != NULL) { (netif)->ack_stretch_segs = (segs); (netif)->ack_stretch_bytes = (bytes); }}while(0)
+#endif /* LWIP_TCP && TCP_ACK_STRETCH */
+
 #if LWIP_IPV6
 /** @ingroup netif_ip6 */
 #define netif_ip_addr6(netif, i)  ((const ip_addr_t*)(&((netif)->ip6_addr[i])))
@@ -124,6 +124,18 @@
 #if !defined LWIP_TIMERS_CUSTOM || defined __DOXYGEN__
 #define LWIP_TIMERS_CUSTOM              0
 #endif
+
+/**
+ * LWIP_TIMERS_WHEEL==1: Keep timeouts in a hierarchical timer wheel (6 levels
+ * of 32 slots, 1 ms resolution) instead of one sorted list, so sys_timeout()
+ * and sys_untimeout() take constant time however many timeouts are pending.
+ * Timeouts more than 32 ms away are moved down a level up to 5 times before
+ * they expire, and sys_timeouts_sleeptime() may wake the caller at those
+ * points.
+ */
+#if !defined LWIP_TIMERS_WHEEL || defined __DOXYGEN__
+#define LWIP_TIMERS_WHEEL               0
+#endif
 /**
  * @}
  */
@@ -262,6 +274,28 @@
 #define MEM_LIBC_MALLOC                 0
 #endif
 
+/**
+ * MEM_TLSF==1: Manage the MEM_SIZE heap with a TLSF (two-level segregated fit)
+ * allocator instead of the first-fit list walk. mem_malloc()/mem_free() then
+ * take constant time however fragmented the heap is, at the cost of a few
+ * hundred bytes of free list heads. mem_free() may be called from interrupts.
+ * Needs MEM_ALIGNMENT between 4 and 128, and GCC's __builtin_clz/ctz.
+ */
+#if !defined MEM_TLSF || defined __DOXYGEN__
+#define MEM_TLSF                        0
+#endif
+
+/**
+ * MEM_ARENA_SIZE > 0: Reserve a region of this many bytes for
+ * mem_arena_malloc(), a bump allocator for memory taken once at init and never
+ * freed (netif private state, driver buffers). Keeping those out of the heap
+ * leaves it to the allocations that come and go. With 0, mem_arena_malloc()
+ * is mem_malloc().
+ */
+#if !defined MEM_ARENA_SIZE || defined __DOXYGEN__
+#define MEM_ARENA_SIZE                  0
+#endif
+
 /**
  * MEMP_MEM_MALLOC==1: Use mem_malloc/mem_free instead of the lwip pool allocator.
  * Especially useful with MEM_LIBC_MALLOC but handle with care regarding execution
@@ -284,6 +318,54 @@
 #define MEMP_MEM_INIT                   0
 #endif
 
+/**
+ * MEMP_LAZY_INIT==1: Don't thread every element onto its pool's free list in
+ * memp_init(). A pool hands out elements it has never handed out before from
+ * a bump pointer into its memory once the free list is empty, so memp_init()
+ * touches none of the pool memory and boot gets to the first packet sooner.
+ * With MEMP_MEM_INIT, elements are cleared as they are carved.
+ * Not compatible with MEMP_MEM_MALLOC, MEMP_LOCKFREE, MEMP_OVERFLOW_CHECK >= 2
+ * or LWIP_HOOK_MEMP_AVAILABLE.
+ */
+#if !defined MEMP_LAZY_INIT || defined __DOXYGEN__
+#define MEMP_LAZY_INIT                  0
+#endif
+
+/**
+ * MEMP_LOCKFREE==1: Keep each pool's free list as a lock-free LIFO (Treiber
+ * stack) instead of protecting it with SYS_ARCH_PROTECT, so memp_malloc() and
+ * memp_free() never mask interrupts. The list head packs an element index and
+ * an ABA tag into an u64_t, so this needs the GCC __atomic builtins and a
+ * lock-free 64 bit compare-and-swap (LDREXD/STREXD on ARMv7-A/R, LDXR/STXR on
+ * ARMv8). Not compatible with MEMP_MEM_MALLOC, MEMP_OVERFLOW_CHECK,
+ * MEMP_SANITY_CHECK or LWIP_HOOK_MEMP_AVAILABLE.
+ */
+#if !defined MEMP_LOCKFREE || defined __DOXYGEN__
+#define MEMP_LOCKFREE                   0
+#endif
+
+/**
+ * MEMP_MAGAZINE==1: Put a small per-thread cache ("magazine") in front of the
+ * PBUF_POOL, PBUF and TCP_SEG pools. A thread that called
+ * memp_magazine_thread_init() allocates from and frees to its own magazine
+ * without any locking, and only goes to the pool to refill or flush half a
+ * magazine at a time. Elements held in magazines count as used in the pool
+ * stats. The port provides LWIP_MEMP_MAGAZINE_GET() (the calling thread's
+ * magazine, NULL from interrupts or unregistered threads) and
+ * LWIP_MEMP_MAGAZINE_SET(mag). Not compatible with MEMP_MEM_MALLOC,
+ * MEMP_OVERFLOW_CHECK or LWIP_HOOK_MEMP_AVAILABLE.
+ */
+#if !defined MEMP_MAGAZINE || defined __DOXYGEN__
+#define MEMP_MAGAZINE                   0
+#endif
+
+/**
+ * MEMP_MAGAZINE_SIZE: elements a magazine holds per pool (at most 255)
+ */
+#if !defined MEMP_MAGAZINE_SIZE || defined __DOXYGEN__
+#define MEMP_MAGAZINE_SIZE              8
+#endif
+
 /**
  * MEM_ALIGNMENT: should be set to the alignment of the CPU
  *    4 byte alignment -> \#define MEM_ALIGNMENT 4
@@ -448,6 +530,15 @@
 #define MEMP_NUM_TCP_PCB_LISTEN         8
 #endif
 
+/**
+ * MEMP_NUM_TCP_TW: the number of connections in TIME-WAIT kept as compact
+ * records (requires the TCP_TW_COMPACT option). When all are in use, the
+ * oldest one is dropped.
+ */
+#if !defined MEMP_NUM_TCP_TW || defined __DOXYGEN__
+#define MEMP_NUM_TCP_TW                 MEMP_NUM_TCP_PCB
+#endif
+
 /**
  * MEMP_NUM_TCP_SEG: the number of simultaneously queued TCP segments.
  * (requires the LWIP_TCP option)
@@ -485,6 +576,27 @@
 #define MEMP_NUM_FRAG_PBUF              15
 #endif
 
+/**
+ * MEMP_NUM_LOOP_PBUF: the number of looped-back pbufs that reference the
+ * payload of a sent pbuf at the same time. A looped packet holds one per pbuf
+ * in its chain until the receiver frees it; when none is left, the packet is
+ * copied. Only used with LWIP_NETIF_LOOPBACK_ZEROCOPY==1.
+ */
+#if !defined MEMP_NUM_LOOP_PBUF || defined __DOXYGEN__
+#define MEMP_NUM_LOOP_PBUF              16
+#endif
+
+/**
+ * MEMP_NUM_FRAG_HDR: the number of IPv4 fragment headers simultaneously sent.
+ * ip4_frag() builds each fragment as a header pbuf from this pool followed
+ * by PBUF_REFs into the original datagram, and only takes the header from
+ * the heap once the pool is empty. 0 always uses the heap.
+ * This is only used with LWIP_NETIF_TX_SINGLE_PBUF==0.
+ */
+#if !defined MEMP_NUM_FRAG_HDR || defined __DOXYGEN__
+#define MEMP_NUM_FRAG_HDR               0
+#endif
+
 /**
  * MEMP_NUM_ARP_QUEUE: the number of simultaneously queued outgoing
  * packets (pbufs) that are waiting for an ARP request (to resolve
@@ -509,7 +621,7 @@
  * The number of sys timeouts used by the core stack (not apps)
  * The default number of timeouts is calculated here for all enabled modules.
  */
-#define LWIP_NUM_SYS_TIMEOUT_INTERNAL   (LWIP_TCP + IP_REASSEMBLY + LWIP_ARP + (2*LWIP_DHCP) + LWIP_AUTOIP + LWIP_IGMP + LWIP_DNS + PPP_NUM_TIMEOUTS + (LWIP_IPV6 * (1 + LWIP_IPV6_REASS + LWIP_IPV6_MLD)))
+#define LWIP_NUM_SYS_TIMEOUT_INTERNAL   (LWIP_TCP + (LWIP_TCP && TCP_ACK_STRETCH && TCP_ACK_STRETCH_DELAY) + IP_REASSEMBLY + LWIP_ARP + (2*LWIP_DHCP) + LWIP_AUTOIP + LWIP_IGMP + LWIP_DNS + PPP_NUM_TIMEOUTS + (LWIP_IPV6 * (1 + LWIP_IPV6_REASS + LWIP_IPV6_MLD)))
 
 /**
  * MEMP_NUM_SYS_TIMEOUT: the number of simultaneously active timeouts.
@@ -710,6 +822,22 @@
 #if !defined ETHARP_TABLE_MATCH_NETIF || defined __DOXYGEN__
 #define ETHARP_TABLE_MATCH_NETIF        !LWIP_SINGLE_NETIF
 #endif
+
+/** ETHARP_TABLE_HASH==1: Chain the ARP table entries in a hash table on
+ * their IP address, so etharp_output() and etharp_find_entry() find an
+ * existing entry without walking the whole table. Creating an entry still
+ * scans the table for one to recycle. Costs one index per entry and
+ * ETHARP_TABLE_HASH_SIZE indexes.
+ */
+#if !defined ETHARP_TABLE_HASH || defined __DOXYGEN__
+#define ETHARP_TABLE_HASH               0
+#endif
+
+/** ETHARP_TABLE_HASH_SIZE: Number of buckets for ETHARP_TABLE_HASH, a power of 2.
+ */
+#if !defined ETHARP_TABLE_HASH_SIZE || defined __DOXYGEN__
+#define ETHARP_TABLE_HASH_SIZE          16
+#endif
 /**
  * @}
  */
@@ -798,6 +926,17 @@
 #define IP_REASS_MAX_PBUFS              10
 #endif
 
+/**
+ * IP_REASS_MAX_BYTES: Total maximum amount of fragment payload (in bytes)
+ * waiting to be reassembled, on top of IP_REASS_MAX_PBUFS. When a new fragment
+ * would exceed it, the oldest incomplete datagrams are dropped first; fragments
+ * of datagrams that could never fit are dropped (with their datagram) at once.
+ * 0 disables the byte budget.
+ */
+#if !defined IP_REASS_MAX_BYTES || defined __DOXYGEN__
+#define IP_REASS_MAX_BYTES              0
+#endif
+
 /**
  * IP_DEFAULT_TTL: Default value for Time-To-Live used by transport layers.
  */
@@ -832,6 +971,33 @@
 #if !defined IP_FORWARD_ALLOW_TX_ON_RX_NETIF || defined __DOXYGEN__
 #define IP_FORWARD_ALLOW_TX_ON_RX_NETIF 0
 #endif
+
+/**
+ * IP_FORWARD_FLOW_CACHE: Number of destinations (a power of two) for which
+ * ip4_forward() remembers the outgoing netif and next hop MAC address, per
+ * netif the packets arrive on. Packets to a remembered destination skip the
+ * local address checks, the route lookup and ARP, and are handed to
+ * ethernet_output() right after the IP header checks. The cache is emptied
+ * whenever a netif or ARP entry changes. Not used when one of the
+ * LWIP_HOOK_IP4_ROUTE, LWIP_HOOK_IP4_ROUTE_SRC or LWIP_HOOK_IP4_CANFORWARD
+ * hooks is defined, as they may decide per packet. 0 disables the cache.
+ */
+#if !defined IP_FORWARD_FLOW_CACHE || defined __DOXYGEN__
+#define IP_FORWARD_FLOW_CACHE           8
+#endif
+
+/**
+ * IP_ROUTE_CACHE: Number of destinations (a power of two) for which
+ * ip4_route() remembers the netif it found, so that it does not walk the
+ * netif list for every packet sent. On top of that, TCP and UDP pcbs keep
+ * the netif for their remote address. Both are forgotten whenever an
+ * address, the default netif or the state of a netif or its link changes.
+ * Not used with LWIP_SINGLE_NETIF or when LWIP_HOOK_IP4_ROUTE or
+ * LWIP_HOOK_IP4_ROUTE_SRC is defined. 0 disables the cache.
+ */
+#if !defined IP_ROUTE_CACHE || defined __DOXYGEN__
+#define IP_ROUTE_CACHE                  8
+#endif
 /**
  * @}
  */
@@ -1122,6 +1288,21 @@
 #define DNS_MAX_RETRIES                 4
 #endif
 
+/** DNS_NEG_TTL: Seconds to remember that a name does not exist (NXDOMAIN), or
+ * has no address of the requested type. Lookups fail at once meanwhile,
+ * instead of asking the server again. 0 turns negative caching off. */
+#if !defined DNS_NEG_TTL || defined __DOXYGEN__
+#define DNS_NEG_TTL                     30
+#endif
+
+/** DNS_PREFETCH_TIME: An entry that answered a lookup since it was resolved
+ * is asked for again this many seconds before its TTL runs out. It keeps
+ * answering lookups while the query is out, so names in regular use don't
+ * expire and make a caller wait for the server. 0 turns this off. */
+#if !defined DNS_PREFETCH_TIME || defined __DOXYGEN__
+#define DNS_PREFETCH_TIME               10
+#endif
+
 /** DNS do a name checking between the query and the response. */
 #if !defined DNS_DOES_NAME_CHECK || defined __DOXYGEN__
 #define DNS_DOES_NAME_CHECK             1
@@ -1204,6 +1385,22 @@
 #if !defined LWIP_NETBUF_RECVINFO || defined __DOXYGEN__
 #define LWIP_NETBUF_RECVINFO            0
 #endif
+
+/**
+ * UDP_PCB_HASH==1: udp_input() only looks at the pcbs bound to the
+ * destination port, kept in UDP_PCB_HASH_SIZE buckets by local port, instead
+ * of walking all of udp_pcbs. Costs one pointer per pcb.
+ */
+#if !defined UDP_PCB_HASH || defined __DOXYGEN__
+#define UDP_PCB_HASH                    0
+#endif
+
+/**
+ * UDP_PCB_HASH_SIZE: Number of buckets for UDP_PCB_HASH, a power of 2.
+ */
+#if !defined UDP_PCB_HASH_SIZE || defined __DOXYGEN__
+#define UDP_PCB_HASH_SIZE               16
+#endif
 /**
  * @}
  */
@@ -1272,6 +1469,40 @@
 #define LWIP_TCP_SACK_OUT               0
 #endif
 
+/**
+ * LWIP_TCP_SACK_IN==1: TCP will act on the SACKs it receives: acknowledged
+ * segments are marked on the unacked queue, and during fast recovery every
+ * further duplicate or partial ACK retransmits the next hole below the highest
+ * SACKed byte, so a burst of losses is repaired in one round trip instead of
+ * one per lost segment. Requires LWIP_TCP_SACK_OUT (which negotiates SACK).
+ */
+#if !defined LWIP_TCP_SACK_IN || defined __DOXYGEN__
+#define LWIP_TCP_SACK_IN                0
+#endif
+
+/**
+ * LWIP_TCP_CC==1: Allow each TCP pcb to use its own congestion control
+ * (see tcp_set_cc()). Pcbs start with the built-in Reno algorithm;
+ * tcp_cc_cubic (RFC 8312) suits high-BDP paths, tcp_cc_local links where
+ * losses come from full rings rather than congestion.
+ */
+#if !defined LWIP_TCP_CC || defined __DOXYGEN__
+#define LWIP_TCP_CC                     0
+#endif
+
+/**
+ * LWIP_TCP_AUTOCORK==1: Allow TCP pcbs to cork small writes (see
+ * tcp_autocork_enable() and the TCP_AUTOCORK socket option). While data is
+ * in flight, a segment shorter than the MSS is held back even with
+ * TF_NODELAY, so that the writes that follow can fill it. It goes out with
+ * the next ACK, once it is full, or when corking is turned off again. An
+ * application that waits for an answer after its last write should flush
+ * that way, or the peer's delayed ACK holds the tail of the request back.
+ */
+#if !defined LWIP_TCP_AUTOCORK || defined __DOXYGEN__
+#define LWIP_TCP_AUTOCORK               0
+#endif
+
 /**
  * LWIP_TCP_MAX_SACK_NUM: The maximum number of SACK values to include in TCP segments.
  * Must be at least 1, but is only used if LWIP_TCP_SACK_OUT is enabled.
@@ -1406,6 +1637,124 @@
 #define TCP_DEFAULT_LISTEN_BACKLOG      0xff
 #endif
 
+/**
+ * LWIP_TCP_SYN_COOKIES==1: When the listen backlog is full or no tcp_pcb is
+ * left, answer a SYN with a SYN cookie (RFC 4987) instead of dropping it: the
+ * SYN|ACK's sequence number encodes the connection, and the tcp_pcb is only
+ * allocated once the ACK of it comes back. ==2: always use cookies, so
+ * half-open connections never hold a tcp_pcb.
+ * The cookie keeps the peer's MSS rounded down to one of four values, its
+ * window scale and SACK_PERM; timestamps are not negotiated for connections
+ * opened through a cookie. A cookie is accepted for 2 to 3 minutes.
+ */
+#if !defined LWIP_TCP_SYN_COOKIES || defined __DOXYGEN__
+#define LWIP_TCP_SYN_COOKIES            0
+#endif
+
+/**
+ * LWIP_TCP_FASTOPEN==1: Server side TCP Fast Open (RFC 7413) for listeners
+ * enabled with tcp_fastopen(). A SYN asking for a cookie gets one in the
+ * SYN|ACK; a SYN carrying a valid cookie has its data accepted at once, the
+ * connection is passed to the accept callback and the data to the recv
+ * callback before the handshake completes, so the response can go out with
+ * (or right after) the SYN|ACK. The cookie is a keyed hash of the client
+ * address. Connections accepted this way but not yet acknowledged by the
+ * client are bounded by the listen backlog.
+ */
+#if !defined LWIP_TCP_FASTOPEN || defined __DOXYGEN__
+#define LWIP_TCP_FASTOPEN               0
+#endif
+
+/**
+ * TCP_PCB_HASH==1: Find the pcb of an incoming segment in a hash table on
+ * its 4-tuple instead of walking tcp_active_pcbs and tcp_tw_pcbs. Each
+ * bucket keeps its last match in front. Worth it with more than a few dozen
+ * connections; costs one pointer per pcb and TCP_PCB_HASH_SIZE pointers.
+ */
+#if !defined TCP_PCB_HASH || defined __DOXYGEN__
+#define TCP_PCB_HASH                    0
+#endif
+
+/**
+ * TCP_PCB_HASH_SIZE: Number of buckets for TCP_PCB_HASH, a power of 2.
+ */
+#if !defined TCP_PCB_HASH_SIZE || defined __DOXYGEN__
+#define TCP_PCB_HASH_SIZE               64
+#endif
+
+/**
+ * TCP_TW_COMPACT==1: Once the application has closed a connection that
+ * enters TIME-WAIT, keep only a compact record of it (the 4-tuple, sequence
+ * numbers, window and timer, a few dozen bytes) from the MEMP_NUM_TCP_TW
+ * pool and free its tcp_pcb, so short-lived connections do not hold
+ * MEMP_NUM_TCP_PCB pcbs for 2*TCP_MSL. Records are found through a hash
+ * table of TCP_TW_HASH_SIZE buckets. Connections using timestamps, or whose
+ * pcb the application still holds (shut down for TX only), stay full pcbs.
+ */
+#if !defined TCP_TW_COMPACT || defined __DOXYGEN__
+#define TCP_TW_COMPACT                  0
+#endif
+
+/**
+ * TCP_TW_HASH_SIZE: Number of buckets for TCP_TW_COMPACT, a power of 2.
+ */
+#if !defined TCP_TW_HASH_SIZE || defined __DOXYGEN__
+#define TCP_TW_HASH_SIZE                32
+#endif
+
+/**
+ * TCP_TMR_COALESCE==1: Run the TCP timer only while a pcb needs it. It ticks
+ * every TCP_TMR_INTERVAL while a pcb has a retransmission or persist timer
+ * running, a delayed ACK, refused data or a poll callback; otherwise it
+ * sleeps until the next timeout counted from the last segment (keepalive,
+ * TIME-WAIT, FIN-WAIT-2, SYN-RCVD, LAST-ACK, out-of-sequence data) and stops
+ * if there is none, so idle connections cost no wakeups. tcp_ticks then
+ * follows sys_now(). Netconns only install their poll callback while a
+ * write or close is pending.
+ */
+#if !defined TCP_TMR_COALESCE || defined __DOXYGEN__
+#define TCP_TMR_COALESCE                0
+#endif
+
+/**
+ * TCP_ACK_STRETCH==1: Let the receiver delay its ACK for more than two
+ * segments. An ACK goes out once TCP_ACK_STRETCH_SEGS segments or
+ * TCP_ACK_STRETCH_BYTES bytes are pending, once the pending data reaches the
+ * window the peer has left, or TCP_ACK_STRETCH_DELAY ms after the classic
+ * rule would have sent it. Netifs carry the limits for connections they
+ * receive on (see netif_set_ack_stretch()); tcp_set_ack_stretch() overrides
+ * them per pcb. Worth it on links where every ACK costs a message and an
+ * interrupt; on lossy paths it slows down the sender's cwnd growth.
+ */
+#if !defined TCP_ACK_STRETCH || defined __DOXYGEN__
+#define TCP_ACK_STRETCH                 0
+#endif
+
+/**
+ * TCP_ACK_STRETCH_SEGS: Default number of full segments per ACK for new
+ * netifs. 2 is the classic delayed ACK.
+ */
+#if !defined TCP_ACK_STRETCH_SEGS || defined __DOXYGEN__
+#define TCP_ACK_STRETCH_SEGS            2
+#endif
+
+/**
+ * TCP_ACK_STRETCH_BYTES: Default number of received bytes after which an ACK
+ * is sent regardless of the segment count (0: no byte limit).
+ */
+#if !defined TCP_ACK_STRETCH_BYTES || defined __DOXYGEN__
+#define TCP_ACK_STRETCH_BYTES           0
+#endif
+
+/**
+ * TCP_ACK_STRETCH_DELAY: Longest time in ms a stretched ACK is held back.
+ * Without it, the ACK would wait for the next tcp_fasttmr() (up to
+ * TCP_TMR_INTERVAL). Needs LWIP_TIMERS; 0 leaves it to tcp_fasttmr().
+ */
+#if !defined TCP_ACK_STRETCH_DELAY || defined __DOXYGEN__
+#define TCP_ACK_STRETCH_DELAY           20
+#endif
+
 /**
  * TCP_OVERSIZE: The maximum number of bytes that tcp_write may
  * allocate ahead of time in an attempt to create shorter pbuf chains
@@ -1424,6 +1773,20 @@
 #define TCP_OVERSIZE                    TCP_MSS
 #endif
 
+/**
+ * TCP_SEG_IN_PBUF==1: Put the struct tcp_seg of an outgoing segment into the
+ * headroom of the PBUF_RAM pbuf that carries its header, instead of taking it
+ * from MEMP_TCP_SEG. tcp_write() then does one allocation per segment and
+ * freeing an acked segment is a single pbuf_free(). The headroom grows by
+ * the size of a tcp_seg, so a netif must not prepend more than
+ * PBUF_LINK_ENCAPSULATION_HLEN + PBUF_LINK_HLEN of its own headers.
+ * MEMP_NUM_TCP_SEG is then only needed for received out-of-sequence
+ * segments and can be sized for TCP_QUEUE_OOSEQ alone.
+ */
+#if !defined TCP_SEG_IN_PBUF || defined __DOXYGEN__
+#define TCP_SEG_IN_PBUF                 0
+#endif
+
 /**
  * LWIP_TCP_TIMESTAMPS==1: support the TCP timestamp option.
  * The timestamp option is currently only used to help remote hosts, it is not
@@ -1552,6 +1915,55 @@
 #define PBUF_POOL_BUFSIZE               LWIP_MEM_ALIGN_SIZE(TCP_MSS+40+PBUF_LINK_ENCAPSULATION_HLEN+PBUF_LINK_HLEN)
 #endif
 
+/**
+ * PBUF_POOL_SMALL_SIZE, PBUF_POOL_MEDIUM_SIZE: number of buffers in two
+ * more pools of PBUF_POOL pbufs, with PBUF_POOL_SMALL_BUFSIZE and
+ * PBUF_POOL_MEDIUM_BUFSIZE bytes each. pbuf_alloc(PBUF_POOL) takes a pbuf
+ * from the smallest of them that holds the header room and the requested
+ * length in one piece, and only uses PBUF_POOL when none does or they are
+ * empty. This way ARP, TCP ACKs and short messages don't pin a full size
+ * buffer each. A length of 0 still gets a PBUF_POOL pbuf, since callers
+ * use that to fill a whole buffer. Pbufs from these pools are not counted
+ * against PBUF_POOL_QUOTAS. 0 disables a pool.
+ */
+#if !defined PBUF_POOL_SMALL_SIZE || defined __DOXYGEN__
+#define PBUF_POOL_SMALL_SIZE            0
+#endif
+#if !defined PBUF_POOL_SMALL_BUFSIZE || defined __DOXYGEN__
+#define PBUF_POOL_SMALL_BUFSIZE         256
+#endif
+#if !defined PBUF_POOL_MEDIUM_SIZE || defined __DOXYGEN__
+#define PBUF_POOL_MEDIUM_SIZE           0
+#endif
+#if !defined PBUF_POOL_MEDIUM_BUFSIZE || defined __DOXYGEN__
+#define PBUF_POOL_MEDIUM_BUFSIZE        512
+#endif
+
+/**
+ * PBUF_POOL_PAYLOAD_ALIGNMENT: if != 0, PBUF_POOL payloads are kept apart from
+ * their struct pbuf, in an array of PBUF_POOL_BUFSIZE buffers each aligned to
+ * (and a multiple of) this many bytes, e.g. a cache line for DMA. The pool
+ * itself then only holds the small struct pbuf, so MEM_ALIGNMENT can stay at
+ * the CPU alignment instead of padding every memp element and heap block to
+ * the cache line. Must be a power of 2 and at least MEM_ALIGNMENT.
+ * Not available with MEMP_MEM_MALLOC.
+ */
+#if !defined PBUF_POOL_PAYLOAD_ALIGNMENT || defined __DOXYGEN__
+#define PBUF_POOL_PAYLOAD_ALIGNMENT     0
+#endif
+
+/**
+ * PBUF_POOL_QUOTAS: number of partitions of the PBUF_POOL that netif drivers
+ * can create with pbuf_pool_quota_new(). A partition has pbufs reserved for
+ * it that nobody else can take, and beyond those draws from the rest of the
+ * pool, shared with plain pbuf_alloc(PBUF_POOL), up to an optional limit.
+ * This way a flood on one netif can't starve the receive rings of another.
+ * 0 disables them. Not available with MEMP_MEM_MALLOC.
+ */
+#if !defined PBUF_POOL_QUOTAS || defined __DOXYGEN__
+#define PBUF_POOL_QUOTAS                0
+#endif
+
 /**
  * LWIP_PBUF_REF_T: Refcount type in pbuf.
  * Default width of u8_t can be increased if 255 refs are not enough for you.
@@ -1559,6 +1971,26 @@
 #if !defined LWIP_PBUF_REF_T || defined __DOXYGEN__
 #define LWIP_PBUF_REF_T                 u8_t
 #endif
+
+/**
+ * LWIP_PBUF_RX_TIMESTAMP==1: struct pbuf carries the time a frame was received,
+ * in microseconds from LWIP_PBUF_RX_TIME_US(). Netif drivers set it with
+ * PBUF_SET_RX_TIME() where the frame comes off the wire, before it is queued
+ * for tcpip_thread, and SNTP takes its destination timestamp from it instead of
+ * from the time sntp_recv() happens to run.
+ */
+#if !defined LWIP_PBUF_RX_TIMESTAMP || defined __DOXYGEN__
+#define LWIP_PBUF_RX_TIMESTAMP          0
+#endif
+
+/**
+ * LWIP_PBUF_RX_TIME_US: Free-running microsecond clock (u32_t, wrapping) used
+ * for LWIP_PBUF_RX_TIMESTAMP. Ports with a finer clock than sys_now() should
+ * point this at it; the default only has the resolution of sys_now().
+ */
+#if !defined LWIP_PBUF_RX_TIME_US || defined __DOXYGEN__
+#define LWIP_PBUF_RX_TIME_US()          ((u32_t)(sys_now() * 1000UL))
+#endif
 /**
  * @}
  */
@@ -1662,6 +2094,26 @@
 #define LWIP_NETIF_TX_SINGLE_PBUF       0
 #endif /* LWIP_NETIF_TX_SINGLE_PBUF */
 
+/**
+ * LWIP_NETIF_LINKOUTPUT_BURST==1: Support netif->linkoutput_burst. While
+ * tcp_output() or ip4_frag() send several frames in one go, ethernet_output()
+ * stages them and passes them to the driver in one linkoutput_burst call, so
+ * that it can notify the hardware (or peer) once for all of them.
+ * Netifs that leave linkoutput_burst NULL keep getting one linkoutput call
+ * per frame.
+ */
+#if !defined LWIP_NETIF_LINKOUTPUT_BURST || defined __DOXYGEN__
+#define LWIP_NETIF_LINKOUTPUT_BURST     0
+#endif
+
+/**
+ * NETIF_BURST_MAX: The maximum number of frames staged for one
+ * linkoutput_burst call. A burst that grows larger is passed on in pieces.
+ */
+#if !defined NETIF_BURST_MAX || defined __DOXYGEN__
+#define NETIF_BURST_MAX                 8
+#endif
+
 /**
  * LWIP_NUM_NETIF_CLIENT_DATA: Number of clients that may store
  * data in client_data member array of struct netif (max. 256).
@@ -1715,6 +2167,20 @@
 #define LWIP_LOOPBACK_MAX_PBUFS         0
 #endif
 
+/**
+ * LWIP_NETIF_LOOPBACK_ZEROCOPY==1: netif_loop_output() copies only the IP and
+ * TCP/UDP headers of a looped packet and passes the payload on by reference
+ * (custom pbufs holding a pbuf_ref() on the sent pbufs), instead of copying the
+ * whole packet. Payload in application memory (PBUF_REF/PBUF_ROM) is still
+ * copied. Receivers must not write into the payload of looped packets, and
+ * senders must not change a pbuf after handing it to the stack.
+ * Checksums are skipped for traffic over the loop interface (127.0.0.1) with
+ * LWIP_CHECKSUM_CTRL_PER_NETIF.
+ */
+#if !defined LWIP_NETIF_LOOPBACK_ZEROCOPY || defined __DOXYGEN__
+#define LWIP_NETIF_LOOPBACK_ZEROCOPY    0
+#endif
+
 /**
  * LWIP_NETIF_LOOPBACK_MULTITHREADING: Indicates whether threading is enabled in
  * the system, as netifs must change how they behave depending on this setting
@@ -1779,6 +2245,33 @@
 #define TCPIP_MBOX_SIZE                 0
 #endif
 
+/**
+ * TCPIP_MBOX_BULK==1: Queue packets passed to tcpip_input() in a separate
+ * "bulk" mailbox instead of tcpip_mbox. tcpip_mbox then only carries API,
+ * callback and timeout messages, which tcpip_thread handles before the next
+ * batch of queued packets, so a burst of RX frames does not delay them.
+ * Has no effect with LWIP_TCPIP_CORE_LOCKING_INPUT.
+ */
+#if !defined TCPIP_MBOX_BULK || defined __DOXYGEN__
+#define TCPIP_MBOX_BULK                 0
+#endif
+
+/**
+ * TCPIP_MBOX_BULK_SIZE: The mailbox size for packets queued to tcpip_thread
+ * when TCPIP_MBOX_BULK is enabled. Passed to sys_mbox_new().
+ */
+#if !defined TCPIP_MBOX_BULK_SIZE || defined __DOXYGEN__
+#define TCPIP_MBOX_BULK_SIZE            TCPIP_MBOX_SIZE
+#endif
+
+/**
+ * TCPIP_MBOX_BULK_BATCH: The maximum number of queued packets tcpip_thread
+ * processes before it checks tcpip_mbox (and the timeouts) again.
+ */
+#if !defined TCPIP_MBOX_BULK_BATCH || defined __DOXYGEN__
+#define TCPIP_MBOX_BULK_BATCH           8
+#endif
+
 /**
  * Define this to something that triggers a watchdog. This is called from
  * tcpip_thread after processing a message.
@@ -1867,7 +2360,7 @@
 /**
  * DEFAULT_ACCEPTMBOX_SIZE: The mailbox size for the incoming connections.
  * The queue size value itself is platform-dependent, but is passed to
- * sys_mbox_new() when the acceptmbox is created.
+ * sys_mbox_new_accept() when the acceptmbox is created.
  */
 #if !defined DEFAULT_ACCEPTMBOX_SIZE || defined __DOXYGEN__
 #define DEFAULT_ACCEPTMBOX_SIZE         0
@@ -1925,6 +2418,53 @@
 #if !defined LWIP_NETCONN_FULLDUPLEX || defined __DOXYGEN__
 #define LWIP_NETCONN_FULLDUPLEX         0
 #endif
+
+/** LWIP_NETCONN_ZEROCOPY==1: Enable NETCONN_ZEROCOPY writes (MSG_ZEROCOPY for
+ * sockets) on TCP netconns. The data is queued as PBUF_ROM segments pointing
+ * at the caller's buffer, and a callback set with
+ * netconn_set_zerocopy_callback() reports when the peer has acked it and the
+ * buffer may be reused.
+ */
+#if !defined LWIP_NETCONN_ZEROCOPY || defined __DOXYGEN__
+#define LWIP_NETCONN_ZEROCOPY           0
+#endif
+
+/** LWIP_NETCONN_ZEROCOPY_PENDING: number of NETCONN_ZEROCOPY writes per netconn
+ * whose completion is tracked separately. Further writes are merged into the
+ * last one: they complete together with it.
+ */
+#if !defined LWIP_NETCONN_ZEROCOPY_PENDING || defined __DOXYGEN__
+#define LWIP_NETCONN_ZEROCOPY_PENDING   4
+#endif
+
+/** LWIP_NETCONN_ZEROCOPY_MIN: vectors of a NETCONN_ZEROCOPY write shorter
+ * than this are copied anyway, so a small header in front of the payload
+ * shares the payload's segment instead of costing a pbuf of its own.
+ */
+#if !defined LWIP_NETCONN_ZEROCOPY_MIN || defined __DOXYGEN__
+#define LWIP_NETCONN_ZEROCOPY_MIN       64
+#endif
+
+/** LWIP_NETCONN_WRITE_RESUME_MSS==1: A blocking TCP write that ran out of
+ * send buffer is resumed from the sent callback only once a full segment, or
+ * all that is left of the write, fits again. Resuming on every ACK queues a
+ * short segment for the few bytes each ACK frees, which then goes out on its
+ * own with TCP_NODELAY. The next ACK or poll_tcp picks it up otherwise.
+ */
+#if !defined LWIP_NETCONN_WRITE_RESUME_MSS || defined __DOXYGEN__
+#define LWIP_NETCONN_WRITE_RESUME_MSS   1
+#endif
+
+/** LWIP_NETCONN_ASYNC==1: Enable the asynchronous netconn front-end
+ * (lwip/netconn_async.h): operations are submitted without blocking and
+ * their completions collected from one queue per application task, so one
+ * task can drive many connections. Best with LWIP_TCPIP_CORE_LOCKING, where
+ * running an operation takes the core lock instead of a message to
+ * tcpip_thread and a semaphore wait.
+ */
+#if !defined LWIP_NETCONN_ASYNC || defined __DOXYGEN__
+#define LWIP_NETCONN_ASYNC              0
+#endif
 /**
  * @}
  */
@@ -2082,6 +2622,34 @@
 #if !defined LWIP_SOCKET_POLL || defined __DOXYGEN__
 #define LWIP_SOCKET_POLL                1
 #endif
+
+/**
+ * LWIP_SOCKET_EPOLL==1: enable lwip_epoll_create()/_ctl()/_wait(). Each
+ * instance keeps a list of its ready sockets, so a socket event costs the
+ * same however many sockets and waiters there are, and a wait only visits
+ * ready sockets. A socket can be registered with one instance at a time.
+ * Needs LWIP_SOCKET_SELECT or LWIP_SOCKET_POLL (for the socket events).
+ */
+#if !defined LWIP_SOCKET_EPOLL || defined __DOXYGEN__
+#define LWIP_SOCKET_EPOLL               0
+#endif
+
+/**
+ * LWIP_SOCKET_EPOLL_MAX: the number of epoll instances. Their file
+ * descriptors follow the sockets (LWIP_SOCKET_OFFSET + NUM_SOCKETS + i).
+ */
+#if !defined LWIP_SOCKET_EPOLL_MAX || defined __DOXYGEN__
+#define LWIP_SOCKET_EPOLL_MAX           2
+#endif
+
+/**
+ * LWIP_SOCKET_RECV_PBUF==1: enable lwip_recv_pbuf()/lwip_recv_pbuf_free(),
+ * a zero-copy receive that lends the received pbuf chain to the application.
+ * TCP only updates the receive window once the chain is handed back.
+ */
+#if !defined LWIP_SOCKET_RECV_PBUF || defined __DOXYGEN__
+#define LWIP_SOCKET_RECV_PBUF           0
+#endif
 /**
  * @}
  */
@@ -2112,6 +2680,36 @@
 #define LWIP_STATS_DISPLAY              0
 #endif
 
+/**
+ * LWIP_STATS_CORES: with lwIP running on several cores at once (SMP), the
+ * number of cores. If > 1, the event counters (the protocol stats and MIB2)
+ * are counted in a block of their own per core, padded to whole
+ * LWIP_STATS_CACHE_LINE lines, so the RX and TX paths on different cores do
+ * not bounce a shared cache line. stats_collect() sums them into lwip_stats;
+ * STATS_GET() and stats_display() do so themselves. The mem, memp and sys
+ * stats (used/max) stay global.
+ */
+#if !defined LWIP_STATS_CORES || defined __DOXYGEN__
+#define LWIP_STATS_CORES                1
+#endif
+
+/**
+ * LWIP_STATS_CORE_ID(): the core the caller runs on, 0 to LWIP_STATS_CORES - 1.
+ * Callers are not kept from migrating while they count: a count can be lost,
+ * as with the plain global counters.
+ */
+#if !defined LWIP_STATS_CORE_ID || defined __DOXYGEN__
+#define LWIP_STATS_CORE_ID()            0
+#endif
+
+/**
+ * LWIP_STATS_CACHE_LINE: cache line size the per-core counter blocks are
+ * aligned and padded to, a power of 2.
+ */
+#if !defined LWIP_STATS_CACHE_LINE || defined __DOXYGEN__
+#define LWIP_STATS_CACHE_LINE           64
+#endif
+
 /**
  * LINK_STATS==1: Enable link stats.
  */
@@ -2248,6 +2846,7 @@
 #define MEMP_STATS                      0
 #define SYS_STATS                       0
 #define LWIP_STATS_DISPLAY              0
+#define LWIP_STATS_CORES                1
 #define IP6_STATS                       0
 #define ICMP6_STATS                     0
 #define IP6_FRAG_STATS                  0
@@ -52,7 +52,8 @@ extern "C" {
  * Currently, the pbuf_custom code is only needed for one specific configuration
  * of IP_FRAG, unless required by external driver/application code. */
 #ifndef LWIP_SUPPORT_CUSTOM_PBUF
-#define LWIP_SUPPORT_CUSTOM_PBUF ((IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG))
+#define LWIP_SUPPORT_CUSTOM_PBUF ((IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG) || \
+                                  ((LWIP_NETIF_LOOPBACK || LWIP_HAVE_LOOPIF) && LWIP_NETIF_LOOPBACK_ZEROCOPY))
 #endif
 
 /** @ingroup pbuf
@@ -121,7 +122,8 @@ typedef enum {
  * to be queued, it must be copied/duplicated. */
 #define PBUF_TYPE_FLAG_DATA_VOLATILE                0x40
 /** 4 bits are reserved for 16 allocation sources (e.g. heap, pool1, pool2, etc)
- * Internally, we use: 0=heap, 1=MEMP_PBUF, 2=MEMP_PBUF_POOL -> 13 types free*/
+ * Internally, we use: 0=heap, 1=MEMP_PBUF, 2=MEMP_PBUF_POOL,
+ * 3=MEMP_PBUF_POOL_SMALL, 4=MEMP_PBUF_POOL_MEDIUM -> 11 types free*/
 #define PBUF_TYPE_ALLOC_SRC_MASK                    0x0F
 /** Indicates this pbuf is used for RX (if not set, indicates use for TX).
  * This information can be used to keep some spare RX buffers e.g. for
@@ -133,8 +135,10 @@ typedef enum {
 #define PBUF_TYPE_ALLOC_SRC_MASK_STD_HEAP           0x00
 #define PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF      0x01
 #define PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF_POOL 0x02
+#define PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF_POOL_SMALL  0x03
+#define PBUF_TYPE_ALLOC_SRC_MASK_STD_MEMP_PBUF_POOL_MEDIUM 0x04
 /** First pbuf allocation type for applications */
-#define PBUF_TYPE_ALLOC_SRC_MASK_APP_MIN            0x03
+#define PBUF_TYPE_ALLOC_SRC_MASK_APP_MIN            0x05
 /** Last pbuf allocation type for applications */
 #define PBUF_TYPE_ALLOC_SRC_MASK_APP_MAX            PBUF_TYPE_ALLOC_SRC_MASK
 
@@ -219,6 +223,12 @@ struct pbuf {
 
   /** For incoming packets, this contains the input netif's index */
   u8_t if_idx;
+
+#if LWIP_PBUF_RX_TIMESTAMP
+  /** For incoming packets, LWIP_PBUF_RX_TIME_US() when the netif received it,
+      0 if the netif did not set it (see PBUF_SET_RX_TIME) */
+  u32_t rx_time;
+#endif /* LWIP_PBUF_RX_TIMESTAMP */
 };
 
 
@@ -234,6 +244,14 @@ struct pbuf_rom {
   const void *payload;
 };
 
+/** Stamp an incoming pbuf with the receive time, for netif drivers to call as
+ * early as possible. The low bit is forced so a stamp is never 0 (unset). */
+#if LWIP_PBUF_RX_TIMESTAMP
+#define PBUF_SET_RX_TIME(p) do { (p)->rx_time = LWIP_PBUF_RX_TIME_US() | 1U; } while (0)
+#else
+#define PBUF_SET_RX_TIME(p)
+#endif
+
 #if LWIP_SUPPORT_CUSTOM_PBUF
 /** Prototype for a function to free a custom pbuf */
 typedef void (*pbuf_free_custom_fn)(struct pbuf *p);
@@ -271,6 +289,13 @@ void pbuf_free_ooseq(void);
 
 struct pbuf *pbuf_alloc(pbuf_layer l, u16_t length, pbuf_type type);
 struct pbuf *pbuf_alloc_reference(void *payload, u16_t length, pbuf_type type);
+#if PBUF_POOL_QUOTAS
+u8_t pbuf_pool_quota_new(u16_t reserved, u16_t limit);
+struct pbuf *pbuf_alloc_quota(pbuf_layer l, u16_t length, u8_t quota);
+void pbuf_pool_quota_get(u8_t quota, u16_t *used, u32_t *denied);
+#else /* PBUF_POOL_QUOTAS */
+#define pbuf_alloc_quota(l, length, quota) pbuf_alloc(l, length, PBUF_POOL)
+#endif /* PBUF_POOL_QUOTAS */
 #if LWIP_SUPPORT_CUSTOM_PBUF
 struct pbuf *pbuf_alloced_custom(pbuf_layer l, u16_t length, pbuf_type type,
                                  struct pbuf_custom *p, void *payload_mem,
@@ -127,6 +127,17 @@ struct memp_desc {
 
   /** First free element of each pool. Elements form a linked list. */
   struct memp **tab;
+
+#if MEMP_LOCKFREE
+  /** MEMP_LOCKFREE list head: ABA tag in the upper half, index + 1 of the
+   * first free element in the lower half (0: pool empty) */
+  u64_t *lf_head;
+#endif /* MEMP_LOCKFREE */
+
+#if MEMP_LAZY_INIT
+  /** MEMP_LAZY_INIT: number of elements carved from base so far */
+  u16_t *carved;
+#endif /* MEMP_LAZY_INIT */
 #endif /* MEMP_MEM_MALLOC */
 };
 
@@ -144,6 +155,22 @@ struct memp_desc {
 #define LWIP_MEMPOOL_DECLARE_STATS_REFERENCE(name)
 #endif
 
+#if MEMP_LOCKFREE
+#define LWIP_MEMPOOL_DECLARE_LOCKFREE_INSTANCE(name) static u64_t name;
+#define LWIP_MEMPOOL_DECLARE_LOCKFREE_REFERENCE(name) , &name
+#else
+#define LWIP_MEMPOOL_DECLARE_LOCKFREE_INSTANCE(name)
+#define LWIP_MEMPOOL_DECLARE_LOCKFREE_REFERENCE(name)
+#endif
+
+#if MEMP_LAZY_INIT
+#define LWIP_MEMPOOL_DECLARE_LAZY_INSTANCE(name) static u16_t name;
+#define LWIP_MEMPOOL_DECLARE_LAZY_REFERENCE(name) , &name
+#else
+#define LWIP_MEMPOOL_DECLARE_LAZY_INSTANCE(name)
+#define LWIP_MEMPOOL_DECLARE_LAZY_REFERENCE(name)
+#endif
+
 void memp_init_pool(const struct memp_desc *desc);
 
 #if MEMP_OVERFLOW_CHECK
@@ -50,6 +50,9 @@ LWIP_MEMPOOL(UDP_PCB,        MEMP_NUM_UDP_PCB,         sizeof(struct udp_pcb),
 LWIP_MEMPOOL(TCP_PCB,        MEMP_NUM_TCP_PCB,         sizeof(struct tcp_pcb),        "TCP_PCB")
 LWIP_MEMPOOL(TCP_PCB_LISTEN, MEMP_NUM_TCP_PCB_LISTEN,  sizeof(struct tcp_pcb_listen), "TCP_PCB_LISTEN")
 LWIP_MEMPOOL(TCP_SEG,        MEMP_NUM_TCP_SEG,         sizeof(struct tcp_seg),        "TCP_SEG")
+#if TCP_TW_COMPACT
+LWIP_MEMPOOL(TCP_TW,         MEMP_NUM_TCP_TW,          sizeof(struct tcp_tw),         "TCP_TW")
+#endif /* TCP_TW_COMPACT */
 #endif /* LWIP_TCP */
 
 #if LWIP_ALTCP && LWIP_TCP
@@ -62,6 +65,12 @@ LWIP_MEMPOOL(REASSDATA,      MEMP_NUM_REASSDATA,       sizeof(struct ip_reassdat
 #if (IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG)
 LWIP_MEMPOOL(FRAG_PBUF,      MEMP_NUM_FRAG_PBUF,       sizeof(struct pbuf_custom_ref),"FRAG_PBUF")
 #endif /* IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF || (LWIP_IPV6 && LWIP_IPV6_FRAG) */
+#if (LWIP_NETIF_LOOPBACK || LWIP_HAVE_LOOPIF) && LWIP_NETIF_LOOPBACK_ZEROCOPY
+LWIP_MEMPOOL(LOOP_PBUF,      MEMP_NUM_LOOP_PBUF,       sizeof(struct pbuf_custom_ref),"LOOP_PBUF")
+#endif /* (LWIP_NETIF_LOOPBACK || LWIP_HAVE_LOOPIF) && LWIP_NETIF_LOOPBACK_ZEROCOPY */
+#if LWIP_IPV4 && IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF && MEMP_NUM_FRAG_HDR
+LWIP_MEMPOOL(FRAG_HDR,       MEMP_NUM_FRAG_HDR,        sizeof(struct ip_frag_hdr),    "FRAG_HDR")
+#endif /* LWIP_IPV4 && IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF && MEMP_NUM_FRAG_HDR */
 
 #if LWIP_NETCONN || LWIP_SOCKET
 LWIP_MEMPOOL(NETBUF,         MEMP_NUM_NETBUF,          sizeof(struct netbuf),         "NETBUF")
@@ -131,7 +140,18 @@ LWIP_MEMPOOL(MLD6_GROUP,     MEMP_NUM_MLD6_GROUP,      sizeof(struct mld_group),
  *     (Example: pbuf_payload_size=0 allocates only size for the struct)
  */
 LWIP_MEMPOOL(PBUF,           MEMP_NUM_PBUF,            sizeof(struct pbuf),           "PBUF_REF/ROM")
+#if PBUF_POOL_PAYLOAD_ALIGNMENT
+/* the payloads are in pbuf.c */
+LWIP_MEMPOOL(PBUF_POOL,      PBUF_POOL_SIZE,           sizeof(struct pbuf),           "PBUF_POOL")
+#else /* PBUF_POOL_PAYLOAD_ALIGNMENT */
 LWIP_PBUF_MEMPOOL(PBUF_POOL, PBUF_POOL_SIZE,           PBUF_POOL_BUFSIZE,             "PBUF_POOL")
+#endif /* PBUF_POOL_PAYLOAD_ALIGNMENT */
+#if PBUF_POOL_SMALL_SIZE
+LWIP_PBUF_MEMPOOL(PBUF_POOL_SMALL, PBUF_POOL_SMALL_SIZE, PBUF_POOL_SMALL_BUFSIZE,     "PBUF_POOL_SMALL")
+#endif /* PBUF_POOL_SMALL_SIZE */
+#if PBUF_POOL_MEDIUM_SIZE
+LWIP_PBUF_MEMPOOL(PBUF_POOL_MEDIUM, PBUF_POOL_MEDIUM_SIZE, PBUF_POOL_MEDIUM_BUFSIZE,  "PBUF_POOL_MEDIUM")
+#endif /* PBUF_POOL_MEDIUM_SIZE */
 
 
 /*
@@ -81,6 +81,18 @@ struct lwip_sock {
   /** counter of how many threads are waiting for this socket using select */
   SELWAIT_T select_waiting;
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
+#if LWIP_SOCKET_EPOLL
+  /** epoll instance this socket is registered with (index + 1, 0: none) */
+  u8_t epoll_idx;
+  /** socket is on the ready list of that instance */
+  u8_t epoll_ready;
+  /** EPOLL* events the instance waits for (0: disabled by EPOLLONESHOT) */
+  u32_t epoll_events;
+  epoll_data_t epoll_data;
+  /** links in the ready list */
+  struct lwip_sock *epoll_prev;
+  struct lwip_sock *epoll_next;
+#endif /* LWIP_SOCKET_EPOLL */
 #if LWIP_NETCONN_FULLDUPLEX
   /* counter of how many threads are using a struct lwip_sock (not the 'int') */
   u8_t fd_used;
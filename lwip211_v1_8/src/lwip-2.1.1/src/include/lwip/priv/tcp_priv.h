@@ -85,6 +85,9 @@ err_t            tcp_rexmit_rto_prepare(struct tcp_pcb *pcb);
 void             tcp_rexmit_rto_commit(struct tcp_pcb *pcb);
 void             tcp_rexmit_rto  (struct tcp_pcb *pcb);
 void             tcp_rexmit_fast (struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK_IN
+err_t            tcp_rexmit_sack (struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK_IN */
 u32_t            tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb);
 err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
@@ -92,13 +95,19 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
  * This is the Nagle algorithm: try to combine user data to send as few TCP
  * segments as possible. Only send if
  * - no previously transmitted data on the connection remains unacknowledged or
- * - the TF_NODELAY flag is set (nagle algorithm turned off for this pcb) or
+ * - the TF_NODELAY flag is set (nagle algorithm turned off for this pcb) and
+ *   TF_AUTOCORK is not or
  * - the only unsent segment is at least pcb->mss bytes long (or there is more
  *   than one unsent segment - with lwIP, this can happen although unsent->len < mss)
  * - or if we are in fast-retransmit (TF_INFR)
  */
+#if LWIP_TCP_AUTOCORK
+#define tcp_nodelay_now(tpcb) (((tpcb)->flags & (TF_NODELAY | TF_AUTOCORK)) == TF_NODELAY)
+#else /* LWIP_TCP_AUTOCORK */
+#define tcp_nodelay_now(tpcb) (((tpcb)->flags & TF_NODELAY) != 0)
+#endif /* LWIP_TCP_AUTOCORK */
 #define tcp_do_output_nagle(tpcb) ((((tpcb)->unacked == NULL) || \
-                            ((tpcb)->flags & (TF_NODELAY | TF_INFR)) || \
+                            ((tpcb)->flags & TF_INFR) || tcp_nodelay_now(tpcb) || \
                             (((tpcb)->unsent != NULL) && (((tpcb)->unsent->next != NULL) || \
                               ((tpcb)->unsent->len >= (tpcb)->mss))) || \
                             ((tcp_sndbuf(tpcb) == 0) || (tcp_sndqueuelen(tpcb) >= TCP_SND_QUEUELEN)) \
@@ -270,15 +279,29 @@ struct tcp_seg {
                                                checksummed into 'chksum' */
 #define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include WND SCALE option (only used in SYN segments) */
 #define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK Permitted option (only used in SYN segments) */
+#define TF_SEG_SACKED           (u8_t)0x20U /* Unacked segment covered by a received SACK (LWIP_TCP_SACK_IN) */
+#define TF_SEG_IN_PBUF          (u8_t)0x40U /* The segment lives in the headroom of p (TCP_SEG_IN_PBUF) */
+#define TF_SEG_OPTS_FASTOPEN    (u8_t)0x80U /* Include a Fast Open cookie (only used in SYN|ACK segments) */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
+#if TCP_SEG_IN_PBUF
+/** Headroom a tcp_seg takes in front of the protocol headers */
+#define TCP_SEG_PBUF_HLEN       LWIP_MEM_ALIGN_SIZE(sizeof(struct tcp_seg))
+/** Layer to allocate segment pbufs with, leaves room for the tcp_seg */
+#define PBUF_TCP_SEG            ((pbuf_layer)(PBUF_TRANSPORT + TCP_SEG_PBUF_HLEN))
+#else /* TCP_SEG_IN_PBUF */
+#define PBUF_TCP_SEG            PBUF_TRANSPORT
+#endif /* TCP_SEG_IN_PBUF */
+
 #define LWIP_TCP_OPT_EOL        0
 #define LWIP_TCP_OPT_NOP        1
 #define LWIP_TCP_OPT_MSS        2
 #define LWIP_TCP_OPT_WS         3
 #define LWIP_TCP_OPT_SACK_PERM  4
+#define LWIP_TCP_OPT_SACK       5
 #define LWIP_TCP_OPT_TS         8
+#define LWIP_TCP_OPT_FASTOPEN   34
 
 #define LWIP_TCP_OPT_LEN_MSS    4
 #if LWIP_TCP_TIMESTAMPS
@@ -301,11 +324,19 @@ struct tcp_seg {
 #define LWIP_TCP_OPT_LEN_SACK_PERM_OUT 0
 #endif
 
+#if LWIP_TCP_FASTOPEN
+#define LWIP_TCP_FASTOPEN_COOKIE_LEN  8
+#define LWIP_TCP_OPT_LEN_FASTOPEN_OUT 12 /* aligned for output (includes NOP padding) */
+#else
+#define LWIP_TCP_OPT_LEN_FASTOPEN_OUT 0
+#endif
+
 #define LWIP_TCP_OPT_LENGTH(flags) \
   ((flags) & TF_SEG_OPTS_MSS       ? LWIP_TCP_OPT_LEN_MSS           : 0) + \
   ((flags) & TF_SEG_OPTS_TS        ? LWIP_TCP_OPT_LEN_TS_OUT        : 0) + \
   ((flags) & TF_SEG_OPTS_WND_SCALE ? LWIP_TCP_OPT_LEN_WS_OUT        : 0) + \
-  ((flags) & TF_SEG_OPTS_SACK_PERM ? LWIP_TCP_OPT_LEN_SACK_PERM_OUT : 0)
+  ((flags) & TF_SEG_OPTS_SACK_PERM ? LWIP_TCP_OPT_LEN_SACK_PERM_OUT : 0) + \
+  ((flags) & TF_SEG_OPTS_FASTOPEN  ? LWIP_TCP_OPT_LEN_FASTOPEN_OUT  : 0)
 
 /** This returns a TCP header option for MSS in an u32_t */
 #define TCP_BUILD_MSS_OPTION(mss) lwip_htonl(0x02040000 | ((mss) & 0xFFFF))
@@ -417,9 +448,61 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
 
 #endif /* LWIP_DEBUG */
 
+/* Active and TIME-WAIT pcbs are also in the TCP_PCB_HASH table: they enter
+   it with TCP_REG_ACTIVE and leave it when they are removed from either list,
+   but stay in it when moving from tcp_active_pcbs to tcp_tw_pcbs. */
+#if TCP_PCB_HASH
+void tcp_pcb_hash_add(struct tcp_pcb *pcb);
+void tcp_pcb_hash_remove(struct tcp_pcb *pcb);
+struct tcp_pcb *tcp_pcb_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                                    const ip_addr_t *remote_ip, u16_t remote_port,
+                                    u8_t netif_idx);
+#define TCP_PCB_HASH_ADD(pcb) tcp_pcb_hash_add(pcb)
+#define TCP_PCB_HASH_RMV(pcb) tcp_pcb_hash_remove(pcb)
+#else /* TCP_PCB_HASH */
+#define TCP_PCB_HASH_ADD(pcb)
+#define TCP_PCB_HASH_RMV(pcb)
+#endif /* TCP_PCB_HASH */
+
+#if TCP_TW_COMPACT
+/** A connection in TIME-WAIT whose tcp_pcb has been freed: just enough of it
+    to acknowledge retransmitted FINs, reset SYNs in the window and keep the
+    4-tuple in use for 2*TCP_MSL. */
+struct tcp_tw {
+  /** next record in tcp_tw_records */
+  struct tcp_tw *next;
+  /** next record in the same hash bucket */
+  struct tcp_tw *hash_next;
+  ip_addr_t local_ip;
+  ip_addr_t remote_ip;
+  u16_t local_port;
+  u16_t remote_port;
+  u32_t snd_nxt;
+  u32_t rcv_nxt;
+  tcpwnd_size_t rcv_wnd;
+  /** tcp_ticks when TIME-WAIT was (re)started */
+  u32_t tmr;
+  /** window field of the ACKs we send, already scaled */
+  u16_t wnd;
+  u8_t netif_idx;
+};
+
+extern struct tcp_tw *tcp_tw_records;  /* List of all compact TIME-WAIT records. */
+
+u8_t tcp_tw_compact(struct tcp_pcb *pcb);
+struct tcp_tw *tcp_tw_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                             const ip_addr_t *remote_ip, u16_t remote_port,
+                             u8_t netif_idx);
+void tcp_tw_ack(const struct tcp_tw *tw);
+#define TCP_TW_RECORDS() (tcp_tw_records != NULL)
+#else /* TCP_TW_COMPACT */
+#define TCP_TW_RECORDS() 0
+#endif /* TCP_TW_COMPACT */
+
 #define TCP_REG_ACTIVE(npcb)                       \
   do {                                             \
     TCP_REG(&tcp_active_pcbs, npcb);               \
+    TCP_PCB_HASH_ADD(npcb);                        \
     tcp_active_pcbs_changed = 1;                   \
   } while (0)
 
@@ -453,12 +536,30 @@ struct tcp_seg *tcp_seg_copy(struct tcp_seg *seg);
     }                                              \
     else {                                         \
       tcp_set_flags(pcb, TF_ACK_DELAY);            \
+      TCP_TMR_NEEDED();                            \
     }                                              \
   } while (0)
 
 #define tcp_ack_now(pcb)                           \
   tcp_set_flags(pcb, TF_ACK_NOW)
 
+#if TCP_ACK_STRETCH
+/* an ACK is going out: restart counting for the next one */
+#define tcp_ack_sent(pcb)                          \
+  do {                                             \
+    (pcb)->ack_pend_segs = 0;                      \
+    (pcb)->ack_pend_bytes = 0;                     \
+  } while (0)
+#if TCP_ACK_STRETCH_DELAY && LWIP_TIMERS
+void tcp_ack_stretch_arm(void);
+#define TCP_ACK_STRETCH_ARM() tcp_ack_stretch_arm()
+#else
+#define TCP_ACK_STRETCH_ARM()
+#endif
+#else /* TCP_ACK_STRETCH */
+#define tcp_ack_sent(pcb)
+#endif /* TCP_ACK_STRETCH */
+
 err_t tcp_send_fin(struct tcp_pcb *pcb);
 err_t tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags);
 
@@ -467,6 +568,14 @@ void tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg);
 void tcp_rst(const struct tcp_pcb* pcb, u32_t seqno, u32_t ackno,
        const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
        u16_t local_port, u16_t remote_port);
+#if LWIP_TCP_SYN_COOKIES
+void tcp_syn_cookie_synack(const struct tcp_pcb_listen *lpcb, u32_t iss, u32_t ackno, u8_t optflags,
+       const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
+       u16_t local_port, u16_t remote_port);
+#endif /* LWIP_TCP_SYN_COOKIES */
+#if LWIP_TCP_FASTOPEN
+void tcp_fastopen_cookie(const ip_addr_t *client, u8_t *cookie);
+#endif /* LWIP_TCP_FASTOPEN */
 
 u32_t tcp_next_iss(struct tcp_pcb *pcb);
 
@@ -504,10 +613,23 @@ s16_t tcp_pcbs_sane(void);
  * that a timer is needed (i.e. active- or time-wait-pcb found). */
 void tcp_timer_needed(void);
 
+#if TCP_TMR_COALESCE
+void tcp_update_ticks(void);
+u32_t tcp_tmr_next(void);
+/** A pcb has started work tcp_tmr() has to see within TCP_TMR_INTERVAL */
+#define TCP_TMR_NEEDED() tcp_timer_needed()
+#else /* TCP_TMR_COALESCE */
+#define TCP_TMR_NEEDED()
+#endif /* TCP_TMR_COALESCE */
+
 void tcp_netif_ip_addr_changed(const ip_addr_t* old_addr, const ip_addr_t* new_addr);
 
 #if TCP_QUEUE_OOSEQ
 void tcp_free_ooseq(struct tcp_pcb *pcb);
+void tcp_free_ooseq_tail(struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK_OUT
+void tcp_remove_sacks_gt(struct tcp_pcb *pcb, u32_t seq);
+#endif /* LWIP_TCP_SACK_OUT */
 #endif
 
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
@@ -117,6 +117,9 @@ enum tcpip_msg_type {
 #endif /* !LWIP_TCPIP_CORE_LOCKING */
 #if !LWIP_TCPIP_CORE_LOCKING_INPUT
   TCPIP_MSG_INPKT,
+#if TCPIP_MBOX_BULK
+  TCPIP_MSG_BULK,
+#endif /* TCPIP_MBOX_BULK */
 #endif /* !LWIP_TCPIP_CORE_LOCKING_INPUT */
 #if LWIP_TCPIP_TIMEOUT && LWIP_TIMERS
   TCPIP_MSG_TIMEOUT,
@@ -48,6 +48,9 @@
 #include "lwip/err.h"
 #include "lwip/inet.h"
 #include "lwip/errno.h"
+#if LWIP_TCP && LWIP_NETCONN_ZEROCOPY
+#include "lwip/api.h" /* netconn_zerocopy_fn */
+#endif
 
 #include <string.h>
 
@@ -263,6 +266,7 @@ struct linger {
 #define MSG_DONTWAIT   0x08    /* Nonblocking i/o for this operation only */
 #define MSG_MORE       0x10    /* Sender will send more */
 #define MSG_NOSIGNAL   0x20    /* Uninmplemented: Requests not to send the SIGPIPE signal if an attempt to send is made on a stream-oriented socket that is no longer connected. */
+#define MSG_ZEROCOPY   0x40    /* TCP: send without copying, the buffer is in use until lwip_set_zerocopy_callback() reports it (LWIP_NETCONN_ZEROCOPY, copied otherwise) */
 
 
 /*
@@ -281,6 +285,7 @@ struct linger {
 #define TCP_KEEPIDLE   0x03    /* set pcb->keep_idle  - Same as TCP_KEEPALIVE, but use seconds for get/setsockopt */
 #define TCP_KEEPINTVL  0x04    /* set pcb->keep_intvl - Use seconds for get/setsockopt */
 #define TCP_KEEPCNT    0x05    /* set pcb->keep_cnt   - Use number of probes sent for get/setsockopt */
+#define TCP_AUTOCORK   0x06    /* hold back short segments while data is in flight, clearing it sends them (LWIP_TCP_AUTOCORK) */
 #endif /* LWIP_TCP */
 
 #if LWIP_IPV6
@@ -512,6 +517,34 @@ struct pollfd
 };
 #endif
 
+#if LWIP_SOCKET_EPOLL
+/* epoll-related defines and types */
+#if !defined(EPOLLIN) && !defined(EPOLLOUT)
+#define EPOLLIN       0x001
+#define EPOLLOUT      0x004
+#define EPOLLERR      0x008
+/* never reported: a closed connection is readable (recv returns 0) */
+#define EPOLLHUP      0x010
+#define EPOLLONESHOT  (1UL << 30)
+#define EPOLLET       (1UL << 31)
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+typedef union epoll_data {
+  void *ptr;
+  int fd;
+  u32_t u32;
+} epoll_data_t;
+
+struct epoll_event {
+  u32_t events;
+  epoll_data_t data;
+};
+#endif
+#endif /* LWIP_SOCKET_EPOLL */
+
 /** LWIP_TIMEVAL_PRIVATE: if you want to use the struct timeval provided
  * by your system, set this to 0 and include <sys/time.h> in cc.h */
 #ifndef LWIP_TIMEVAL_PRIVATE
@@ -554,6 +587,11 @@ void lwip_socket_thread_cleanup(void); /* LWIP_NETCONN_SEM_PER_THREAD==1: destro
 #if LWIP_SOCKET_POLL
 #define lwip_poll         poll
 #endif
+#if LWIP_SOCKET_EPOLL
+#define lwip_epoll_create epoll_create
+#define lwip_epoll_ctl    epoll_ctl
+#define lwip_epoll_wait   epoll_wait
+#endif
 #define lwip_ioctl        ioctlsocket
 #define lwip_inet_ntop    inet_ntop
 #define lwip_inet_pton    inet_pton
@@ -589,6 +627,10 @@ ssize_t lwip_readv(int s, const struct iovec *iov, int iovcnt);
 ssize_t lwip_recvfrom(int s, void *mem, size_t len, int flags,
       struct sockaddr *from, socklen_t *fromlen);
 ssize_t lwip_recvmsg(int s, struct msghdr *message, int flags);
+#if LWIP_SOCKET_RECV_PBUF
+ssize_t lwip_recv_pbuf(int s, struct pbuf **p, int flags);
+void lwip_recv_pbuf_free(int s, struct pbuf *p);
+#endif
 ssize_t lwip_sendto(int s, const void *data, size_t size, int flags,
     const struct sockaddr *to, socklen_t tolen);
 ssize_t lwip_send(int s, const void *dataptr, size_t size, int flags);
@@ -598,6 +640,9 @@ ssize_t lwip_sendto_blocking(int s, const void *data, size_t size, int flags,
     const struct sockaddr *to, socklen_t tolen);
 #endif
 ssize_t lwip_sendmsg(int s, const struct msghdr *message, int flags);
+#if LWIP_TCP && LWIP_NETCONN_ZEROCOPY
+int lwip_set_zerocopy_callback(int s, netconn_zerocopy_fn fn, void *arg);
+#endif
 int lwip_socket(int domain, int type, int protocol);
 ssize_t lwip_write(int s, const void *dataptr, size_t size);
 ssize_t lwip_writev(int s, const struct iovec *iov, int iovcnt);
@@ -608,6 +653,11 @@ int lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptse
 #if LWIP_SOCKET_POLL
 int lwip_poll(struct pollfd *fds, nfds_t nfds, int timeout);
 #endif
+#if LWIP_SOCKET_EPOLL
+int lwip_epoll_create(int size);
+int lwip_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int lwip_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+#endif
 int lwip_ioctl(int s, long cmd, void *argp);
 int lwip_fcntl(int s, int cmd, int val);
 const char *lwip_inet_ntop(int af, const void *src, char *dst, socklen_t size);
@@ -657,6 +707,14 @@ int lwip_inet_pton(int af, const char *src, void *dst);
 /** @ingroup socket */
 #define poll(fds,nfds,timeout)                    lwip_poll(fds,nfds,timeout)
 #endif
+#if LWIP_SOCKET_EPOLL
+/** @ingroup socket */
+#define epoll_create(size)                        lwip_epoll_create(size)
+/** @ingroup socket */
+#define epoll_ctl(epfd,op,fd,event)               lwip_epoll_ctl(epfd,op,fd,event)
+/** @ingroup socket */
+#define epoll_wait(epfd,events,maxevents,timeout) lwip_epoll_wait(epfd,events,maxevents,timeout)
+#endif
 /** @ingroup socket */
 #define ioctlsocket(s,cmd,argp)                   lwip_ioctl(s,cmd,argp)
 /** @ingroup socket */
@@ -41,6 +41,9 @@
 
 #include "lwip/mem.h"
 #include "lwip/memp.h"
+#if LWIP_STATS_CORES > 1
+#include "lwip/sys.h" /* LWIP_STATS_CORE_ID() */
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -313,16 +316,36 @@ void stats_init(void);
                                     lwip_stats.x.max = lwip_stats.x.used; \
                                 } \
                              } while(0)
+
+#if LWIP_STATS_CORES > 1
+/** The event counters of one core, on cache lines of their own (only the
+ * protocol and MIB2 members are used) */
+union stats_core {
+  struct stats_ s;
+  u8_t pad[(sizeof(struct stats_) + LWIP_STATS_CACHE_LINE - 1) & ~(LWIP_STATS_CACHE_LINE - 1)];
+};
+extern union stats_core *lwip_stats_cores;
+
+/** Sum the event counters of all cores into lwip_stats */
+void stats_collect(void);
+
+#define STATS_CORE_INC(x) ++lwip_stats_cores[LWIP_STATS_CORE_ID()].s.x
+#define STATS_GET(x) (stats_collect(), lwip_stats.x)
+#else /* LWIP_STATS_CORES > 1 */
+#define stats_collect()
+#define STATS_CORE_INC(x) STATS_INC(x)
 #define STATS_GET(x) lwip_stats.x
+#endif /* LWIP_STATS_CORES > 1 */
 #else /* LWIP_STATS */
 #define stats_init()
+#define stats_collect()
 #define STATS_INC(x)
 #define STATS_DEC(x)
 #define STATS_INC_USED(x, y, type)
 #endif /* LWIP_STATS */
 
 #if TCP_STATS
-#define TCP_STATS_INC(x) STATS_INC(x)
+#define TCP_STATS_INC(x) STATS_CORE_INC(x)
 #define TCP_STATS_DISPLAY() stats_display_proto(&lwip_stats.tcp, "TCP")
 #else
 #define TCP_STATS_INC(x)
@@ -330,7 +353,7 @@ void stats_init(void);
 #endif
 
 #if UDP_STATS
-#define UDP_STATS_INC(x) STATS_INC(x)
+#define UDP_STATS_INC(x) STATS_CORE_INC(x)
 #define UDP_STATS_DISPLAY() stats_display_proto(&lwip_stats.udp, "UDP")
 #else
 #define UDP_STATS_INC(x)
@@ -338,7 +361,7 @@ void stats_init(void);
 #endif
 
 #if ICMP_STATS
-#define ICMP_STATS_INC(x) STATS_INC(x)
+#define ICMP_STATS_INC(x) STATS_CORE_INC(x)
 #define ICMP_STATS_DISPLAY() stats_display_proto(&lwip_stats.icmp, "ICMP")
 #else
 #define ICMP_STATS_INC(x)
@@ -346,7 +369,7 @@ void stats_init(void);
 #endif
 
 #if IGMP_STATS
-#define IGMP_STATS_INC(x) STATS_INC(x)
+#define IGMP_STATS_INC(x) STATS_CORE_INC(x)
 #define IGMP_STATS_DISPLAY() stats_display_igmp(&lwip_stats.igmp, "IGMP")
 #else
 #define IGMP_STATS_INC(x)
@@ -354,7 +377,7 @@ void stats_init(void);
 #endif
 
 #if IP_STATS
-#define IP_STATS_INC(x) STATS_INC(x)
+#define IP_STATS_INC(x) STATS_CORE_INC(x)
 #define IP_STATS_DISPLAY() stats_display_proto(&lwip_stats.ip, "IP")
 #else
 #define IP_STATS_INC(x)
@@ -362,7 +385,7 @@ void stats_init(void);
 #endif
 
 #if IPFRAG_STATS
-#define IPFRAG_STATS_INC(x) STATS_INC(x)
+#define IPFRAG_STATS_INC(x) STATS_CORE_INC(x)
 #define IPFRAG_STATS_DISPLAY() stats_display_proto(&lwip_stats.ip_frag, "IP_FRAG")
 #else
 #define IPFRAG_STATS_INC(x)
@@ -370,7 +393,7 @@ void stats_init(void);
 #endif
 
 #if ETHARP_STATS
-#define ETHARP_STATS_INC(x) STATS_INC(x)
+#define ETHARP_STATS_INC(x) STATS_CORE_INC(x)
 #define ETHARP_STATS_DISPLAY() stats_display_proto(&lwip_stats.etharp, "ETHARP")
 #else
 #define ETHARP_STATS_INC(x)
@@ -378,7 +401,7 @@ void stats_init(void);
 #endif
 
 #if LINK_STATS
-#define LINK_STATS_INC(x) STATS_INC(x)
+#define LINK_STATS_INC(x) STATS_CORE_INC(x)
 #define LINK_STATS_DISPLAY() stats_display_proto(&lwip_stats.link, "LINK")
 #else
 #define LINK_STATS_INC(x)
@@ -422,7 +445,7 @@ void stats_init(void);
 #endif
 
 #if IP6_STATS
-#define IP6_STATS_INC(x) STATS_INC(x)
+#define IP6_STATS_INC(x) STATS_CORE_INC(x)
 #define IP6_STATS_DISPLAY() stats_display_proto(&lwip_stats.ip6, "IPv6")
 #else
 #define IP6_STATS_INC(x)
@@ -430,7 +453,7 @@ void stats_init(void);
 #endif
 
 #if ICMP6_STATS
-#define ICMP6_STATS_INC(x) STATS_INC(x)
+#define ICMP6_STATS_INC(x) STATS_CORE_INC(x)
 #define ICMP6_STATS_DISPLAY() stats_display_proto(&lwip_stats.icmp6, "ICMPv6")
 #else
 #define ICMP6_STATS_INC(x)
@@ -438,7 +461,7 @@ void stats_init(void);
 #endif
 
 #if IP6_FRAG_STATS
-#define IP6_FRAG_STATS_INC(x) STATS_INC(x)
+#define IP6_FRAG_STATS_INC(x) STATS_CORE_INC(x)
 #define IP6_FRAG_STATS_DISPLAY() stats_display_proto(&lwip_stats.ip6_frag, "IPv6 FRAG")
 #else
 #define IP6_FRAG_STATS_INC(x)
@@ -446,7 +469,7 @@ void stats_init(void);
 #endif
 
 #if MLD6_STATS
-#define MLD6_STATS_INC(x) STATS_INC(x)
+#define MLD6_STATS_INC(x) STATS_CORE_INC(x)
 #define MLD6_STATS_DISPLAY() stats_display_igmp(&lwip_stats.mld6, "MLDv1")
 #else
 #define MLD6_STATS_INC(x)
@@ -454,7 +477,7 @@ void stats_init(void);
 #endif
 
 #if ND6_STATS
-#define ND6_STATS_INC(x) STATS_INC(x)
+#define ND6_STATS_INC(x) STATS_CORE_INC(x)
 #define ND6_STATS_DISPLAY() stats_display_proto(&lwip_stats.nd6, "ND")
 #else
 #define ND6_STATS_INC(x)
@@ -462,7 +485,7 @@ void stats_init(void);
 #endif
 
 #if MIB2_STATS
-#define MIB2_STATS_INC(x) STATS_INC(x)
+#define MIB2_STATS_INC(x) STATS_CORE_INC(x)
 #else
 #define MIB2_STATS_INC(x)
 #endif
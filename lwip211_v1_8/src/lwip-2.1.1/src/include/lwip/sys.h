@@ -405,6 +405,30 @@ void sys_mbox_set_invalid(sys_mbox_t *mbox);
  */
 #define sys_mbox_set_invalid_val(mbox) sys_mbox_set_invalid(&(mbox))
 #endif
+#ifndef sys_mbox_new_recv
+/**
+ * Create the recvmbox of a netconn. Only the tcpip_thread, or whoever holds
+ * the core lock, posts to it, and one application thread at a time fetches
+ * from it, so a port may implement it lighter than a general mbox. Every
+ * sys_mbox_* call must then work on both kinds.
+ */
+#define sys_mbox_new_recv(mbox, size)  sys_mbox_new(mbox, size)
+#endif
+#ifndef sys_mbox_new_accept
+/**
+ * Create the acceptmbox of a listening netconn. Posted to and fetched from
+ * like a recvmbox, see sys_mbox_new_recv(), but never with TCP data.
+ */
+#define sys_mbox_new_accept(mbox, size) sys_mbox_new(mbox, size)
+#endif
+#ifndef sys_mbox_trypost_pbuf
+/**
+ * Post TCP data to a recvmbox from sys_mbox_new_recv(). A port may instead
+ * chain p to TCP data posted before that is still waiting in the mbox, and
+ * then sets *merged so that no new entry is signalled.
+ */
+#define sys_mbox_trypost_pbuf(mbox, p, merged) (*(merged) = 0, sys_mbox_trypost(mbox, p))
+#endif
 
 
 /**
@@ -543,6 +567,16 @@ void sys_arch_unprotect(sys_prot_t pval);
                               } while(0)
 #endif /* SYS_ARCH_DEC */
 
+#ifndef SYS_ARCH_DEC_FETCH
+/* like SYS_ARCH_DEC, and returns the new value in ret */
+#define SYS_ARCH_DEC_FETCH(var, val, ret) do { \
+                                SYS_ARCH_DECL_PROTECT(old_level); \
+                                SYS_ARCH_PROTECT(old_level); \
+                                ret = (var -= val); \
+                                SYS_ARCH_UNPROTECT(old_level); \
+                              } while(0)
+#endif /* SYS_ARCH_DEC_FETCH */
+
 #ifndef SYS_ARCH_GET
 #define SYS_ARCH_GET(var, ret) do { \
                                 SYS_ARCH_DECL_PROTECT(old_level); \
@@ -57,6 +57,7 @@ extern "C" {
 
 struct tcp_pcb;
 struct tcp_pcb_listen;
+struct tcp_cc_ops;
 
 /** Function prototype for tcp accept callback functions. Called when a new
  * connection can be accepted on a listening pcb.
@@ -235,6 +236,10 @@ struct tcp_pcb_listen {
   u8_t backlog;
   u8_t accepts_pending;
 #endif /* TCP_LISTEN_BACKLOG */
+#if LWIP_TCP_FASTOPEN
+  /* accept SYN data with a valid Fast Open cookie, see tcp_fastopen() */
+  u8_t fastopen;
+#endif /* LWIP_TCP_FASTOPEN */
 };
 
 
@@ -245,6 +250,11 @@ struct tcp_pcb {
 /** protocol specific PCB members */
   TCP_PCB_COMMON(struct tcp_pcb);
 
+#if TCP_PCB_HASH
+  /* next pcb in the same TCP_PCB_HASH bucket */
+  struct tcp_pcb *hash_next;
+#endif /* TCP_PCB_HASH */
+
   /* ports are in host byte order */
   u16_t remote_port;
 
@@ -269,6 +279,15 @@ struct tcp_pcb {
 #define TF_RTO         0x0800U /* RTO timer has fired, in-flight data moved to unsent and being retransmitted */
 #if LWIP_TCP_SACK_OUT
 #define TF_SACK        0x1000U /* Selective ACKs enabled */
+#endif
+#if LWIP_TCP_SACK_IN
+#define TF_SACKED      0x2000U /* SACKs received for data above lastack, sack_high is valid */
+#endif
+#if LWIP_TCP_AUTOCORK
+#define TF_AUTOCORK    0x4000U /* Hold back short segments while data is in flight, even with TF_NODELAY */
+#endif
+#if LWIP_TCP_FASTOPEN
+#define TF_FASTOPEN    0x8000U /* Fast Open: SYN|ACK carries a cookie, connection accepted with the SYN's data */
 #endif
 
   /* the rest of the fields are in host byte order
@@ -315,6 +334,36 @@ struct tcp_pcb {
   /* first byte following last rto byte */
   u32_t rto_end;
 
+#if LWIP_TCP_CC
+  /* congestion control, NULL for Reno */
+  const struct tcp_cc_ops *cc;
+  /* CUBIC: sys_now() at the start of the current epoch (0: none yet) */
+  u32_t cc_epoch;
+  /* CUBIC: ms from cc_epoch until cwnd is back at cc_origin */
+  u32_t cc_k;
+  /* CUBIC: cwnd before the last reduction, and the plateau of the curve */
+  tcpwnd_size_t cc_wmax;
+  tcpwnd_size_t cc_origin;
+  /* CUBIC: cwnd Reno would have reached in this epoch */
+  tcpwnd_size_t cc_west;
+#endif /* LWIP_TCP_CC */
+
+#if TCP_ACK_STRETCH
+  /* segments and bytes per ACK (0: use the limits of the input netif) */
+  u8_t ack_stretch_segs;
+  u32_t ack_stretch_bytes;
+  /* received since the last ACK went out */
+  u8_t ack_pend_segs;
+  u32_t ack_pend_bytes;
+#endif /* TCP_ACK_STRETCH */
+
+#if LWIP_TCP_SACK_IN
+  /* first byte following the highest SACKed segment (if TF_SACKED) */
+  u32_t sack_high;
+  /* holes below this have been retransmitted in the current fast recovery */
+  u32_t sack_rexmit;
+#endif /* LWIP_TCP_SACK_IN */
+
   /* sender variables */
   u32_t snd_nxt;   /* next new seqno to be sent */
   u32_t snd_wl1, snd_wl2; /* Sequence and acknowledgement numbers of last
@@ -440,6 +489,15 @@ void             tcp_poll    (struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interv
 #define          tcp_nagle_enable(pcb)    tcp_clear_flags(pcb, TF_NODELAY)
 /** @ingroup tcp_raw */
 #define          tcp_nagle_disabled(pcb)  tcp_is_flag_set(pcb, TF_NODELAY)
+#if LWIP_TCP_AUTOCORK
+/** @ingroup tcp_raw */
+#define          tcp_autocork_enable(pcb)   tcp_set_flags(pcb, TF_AUTOCORK)
+/** @ingroup tcp_raw
+ * A segment held back so far is sent by the next tcp_output() */
+#define          tcp_autocork_disable(pcb)  tcp_clear_flags(pcb, TF_AUTOCORK)
+/** @ingroup tcp_raw */
+#define          tcp_autocork_enabled(pcb)  tcp_is_flag_set(pcb, TF_AUTOCORK)
+#endif /* LWIP_TCP_AUTOCORK */
 
 #if TCP_LISTEN_BACKLOG
 #define          tcp_backlog_set(pcb, new_backlog) do { \
@@ -484,6 +542,31 @@ err_t            tcp_tcp_get_tcp_addrinfo(struct tcp_pcb *pcb, int local, ip_add
 /* for compatibility with older implementation */
 #define tcp_new_ip6() tcp_new_ip_type(IPADDR_TYPE_V6)
 
+#if LWIP_TCP_CC
+/** Congestion control algorithm, see tcp_set_cc() */
+struct tcp_cc_ops {
+  const char *name;
+  /** new data was acked outside of fast recovery: grow cwnd */
+  void (*acked)(struct tcp_pcb *pcb, tcpwnd_size_t acked);
+  /** loss was detected by fast retransmit or (timeout != 0) an RTO: set
+   * ssthresh; the caller then sets cwnd as Reno does */
+  void (*loss)(struct tcp_pcb *pcb, u8_t timeout);
+};
+
+extern const struct tcp_cc_ops tcp_cc_cubic;
+extern const struct tcp_cc_ops tcp_cc_local;
+
+void             tcp_set_cc  (struct tcp_pcb *pcb, const struct tcp_cc_ops *cc);
+#endif /* LWIP_TCP_CC */
+
+#if LWIP_TCP_FASTOPEN
+void             tcp_fastopen(struct tcp_pcb *pcb, u8_t enable);
+#endif /* LWIP_TCP_FASTOPEN */
+
+#if TCP_ACK_STRETCH
+void             tcp_set_ack_stretch(struct tcp_pcb *pcb, u8_t segs, u32_t bytes);
+#endif /* TCP_ACK_STRETCH */
+
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
 u8_t tcp_ext_arg_alloc_id(void);
 void tcp_ext_arg_set_callbacks(struct tcp_pcb *pcb, uint8_t id, const struct tcp_ext_arg_callbacks * const callbacks);
@@ -95,6 +95,15 @@ struct sys_timeo {
   u32_t time;
   sys_timeout_handler h;
   void *arg;
+#if LWIP_TIMERS_WHEEL
+  /* where 'next' is stored: the wheel slot or the previous timeout */
+  struct sys_timeo **pprev;
+  /* timeouts with the same (h, arg) hash, for sys_untimeout() */
+  struct sys_timeo *hash_next;
+  struct sys_timeo **hash_pprev;
+  /* level * 32 + slot in the wheel */
+  u8_t slot;
+#endif /* LWIP_TIMERS_WHEEL */
 #if LWIP_DEBUG_TIMERNAMES
   const char* handler_name;
 #endif /* LWIP_DEBUG_TIMERNAMES */
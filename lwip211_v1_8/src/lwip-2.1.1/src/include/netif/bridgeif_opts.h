@@ -68,6 +68,36 @@
 #define BRIDGEIF_MAX_PORTS                  7
 #endif
 
+/** BRIDGEIF_FDB_WAYS: the dynamic FDB is a hash table in which an address
+ * can live in the slot its hash selects or in the (BRIDGEIF_FDB_WAYS - 1)
+ * slots after it. A lookup compares at most this many entries; when all of
+ * them are taken, learning an address replaces the one seen longest ago.
+ */
+#ifndef BRIDGEIF_FDB_WAYS
+#define BRIDGEIF_FDB_WAYS                   8
+#endif
+
+/** BRIDGEIF_FDB_BARRIER(): dynamic FDB lookups take no lock, they detect an
+ * entry that changed while it was read by a sequence count. The accesses are
+ * volatile, which orders them for one core; define this to a memory barrier
+ * when port netifs deliver frames from more than one core
+ * (BRIDGEIF_PORT_NETIFS_OUTPUT_DIRECT on an SMP port).
+ */
+#ifndef BRIDGEIF_FDB_BARRIER
+#define BRIDGEIF_FDB_BARRIER()
+#endif
+
+/** BRIDGEIF_SHARED_PBUFS: number of frames that can be handed to the bridge
+ * netif while a port netif still holds them queued for transmission. Group
+ * addressed frames go to both; instead of copying, the stack gets a PBUF_REF
+ * on the received data that keeps a reference on the original frame. Only
+ * used with LWIP_SUPPORT_CUSTOM_PBUF; without it, with 0, or when they run
+ * out, such frames are copied.
+ */
+#ifndef BRIDGEIF_SHARED_PBUFS
+#define BRIDGEIF_SHARED_PBUFS               8
+#endif
+
 /** BRIDGEIF_DEBUG: Enable generic debugging in bridgeif.c. */
 #ifndef BRIDGEIF_DEBUG
 #define BRIDGEIF_DEBUG                      LWIP_DBG_OFF
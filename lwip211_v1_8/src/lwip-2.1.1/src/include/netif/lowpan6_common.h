@@ -71,6 +71,9 @@ err_t lowpan6_compress_headers(struct netif *netif, u8_t *inbuf, size_t inbuf_si
                                const struct lowpan6_link_addr *src, const struct lowpan6_link_addr *dst);
 struct pbuf *lowpan6_decompress(struct pbuf *p, u16_t datagram_size, ip6_addr_t *lowpan6_contexts,
                                 struct lowpan6_link_addr *src, struct lowpan6_link_addr *dest);
+#if LWIP_6LOWPAN_HC_CACHE_SIZE > 0
+void lowpan6_hc_cache_flush(void);
+#endif /* LWIP_6LOWPAN_HC_CACHE_SIZE > 0 */
 #endif /* LWIP_6LOWPAN_IPHC */
 
 #ifdef __cplusplus
@@ -64,6 +64,17 @@
 #define LWIP_6LOWPAN_IPHC                1
 #endif
 
+/** LWIP_6LOWPAN_HC_CACHE_SIZE: number of neighbors (link layer addresses)
+ * for which IPHC keeps the interface identifier derived from the link address
+ * and the context and address mode of the IPv6 address last compressed
+ * against it, so steady-state traffic skips the context search and the IID
+ * derivation. The cache is direct mapped on the last link address byte.
+ * 0 disables it.
+ */
+#ifndef LWIP_6LOWPAN_HC_CACHE_SIZE
+#define LWIP_6LOWPAN_HC_CACHE_SIZE       0
+#endif
+
 /** Set this to 1 if your IEEE 802.15.4 interface can calculate and check the
  * CRC in hardware. This means TX packets get 2 zero bytes added on transmission
  * which are to be filled with the CRC.
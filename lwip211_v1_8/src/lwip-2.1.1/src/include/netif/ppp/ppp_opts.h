@@ -198,6 +198,16 @@
 #define PPP_FCS_TABLE                   1
 #endif
 
+/**
+ * PPPOS_FAST_HDLC==1: PPPoS looks for the bytes to escape or unescape a 32-bit
+ * word at a time and copies the runs in between in bulk, and computes the FCS
+ * over them slicing-by-8. The tables take 8*256*2 bytes of RAM and are filled
+ * by the first pppos_create().
+ */
+#ifndef PPPOS_FAST_HDLC
+#define PPPOS_FAST_HDLC                 0
+#endif
+
 /**
  * PAP_SUPPORT==1: Support PAP.
  */
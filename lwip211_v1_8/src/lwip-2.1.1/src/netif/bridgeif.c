@@ -86,6 +86,7 @@
 #include "lwip/ethip6.h"
 #include "lwip/snmp.h"
 #include "lwip/timeouts.h"
+#include "lwip/memp.h"
 #include <string.h>
 
 #if LWIP_NUM_NETIF_CLIENT_DATA
@@ -278,7 +279,8 @@ bridgeif_send_to_ports(bridgeif_private_t *br, struct pbuf *p, bridgeif_portmask
   bridgeif_portmask_t mask = 1;
   BRIDGEIF_DECL_PROTECT(lev);
   BRIDGEIF_READ_PROTECT(lev);
-  for (i = 0; i < BRIDGEIF_MAX_PORTS; i++, mask = (bridgeif_portmask_t)(mask << 1)) {
+  /* the cpu port bit is handled by the callers, and ports are added from index 0 on */
+  for (i = 0; i < br->num_ports; i++, mask = (bridgeif_portmask_t)(mask << 1)) {
     if (dstports & mask) {
       err = bridgeif_send_to_port(br, p, i);
       if (err != ERR_OK) {
@@ -319,6 +321,58 @@ bridgeif_output(struct netif *netif, struct pbuf *p)
   return err;
 }
 
+#if BRIDGEIF_SHARED_PBUFS && LWIP_SUPPORT_CUSTOM_PBUF
+/** A PBUF_REF on a received frame that a port netif still holds */
+typedef struct bridgeif_shared_pbuf_s {
+  struct pbuf_custom pc;
+  struct pbuf *frame;
+} bridgeif_shared_pbuf_t;
+
+LWIP_MEMPOOL_DECLARE(BRIDGEIF_SHARED, BRIDGEIF_SHARED_PBUFS, sizeof(bridgeif_shared_pbuf_t), "BRIDGEIF_SHARED")
+
+static void
+bridgeif_shared_free(struct pbuf *p)
+{
+  bridgeif_shared_pbuf_t *sp = (bridgeif_shared_pbuf_t *)p;
+  pbuf_free(sp->frame);
+  LWIP_MEMPOOL_FREE(BRIDGEIF_SHARED, sp);
+}
+#endif /* BRIDGEIF_SHARED_PBUFS && LWIP_SUPPORT_CUSTOM_PBUF */
+
+/** Get a frame that was just flooded ready for the cpu port. Ports queue what they cannot
+ * send at once with a reference on it, and the stack moves p->payload while it parses the
+ * headers, so while a port holds p the stack must get its own pbuf. That is a PBUF_REF on
+ * the same data when possible, a copy otherwise. Takes over the reference on p.
+ */
+static struct pbuf *
+bridgeif_share_rx(struct pbuf *p)
+{
+  struct pbuf *q;
+
+  if (p->ref == 1) {
+    /* nobody else has it */
+    return p;
+  }
+#if BRIDGEIF_SHARED_PBUFS && LWIP_SUPPORT_CUSTOM_PBUF
+  if (p->next == NULL) {
+    bridgeif_shared_pbuf_t *sp = (bridgeif_shared_pbuf_t *)LWIP_MEMPOOL_ALLOC(BRIDGEIF_SHARED);
+    if (sp != NULL) {
+      sp->pc.custom_free_function = bridgeif_shared_free;
+      sp->frame = p;
+      q = pbuf_alloced_custom(PBUF_RAW, p->len, PBUF_REF, &sp->pc, p->payload, p->len);
+      q->if_idx = p->if_idx;
+      return q;
+    }
+  }
+#endif /* BRIDGEIF_SHARED_PBUFS && LWIP_SUPPORT_CUSTOM_PBUF */
+  q = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+  if (q != NULL) {
+    q->if_idx = p->if_idx;
+  }
+  pbuf_free(p);
+  return q;
+}
+
 /** The actual bridge input function. Port netif's input is changed to call
  * here. This function decides where the frame is forwarded.
  */
@@ -357,9 +411,14 @@ bridgeif_input(struct pbuf *p, struct netif *netif)
     bridgeif_send_to_ports(br, p, dstports);
     if (dstports & (1 << BRIDGEIF_MAX_PORTS)) {
       /* we pass the reference to ->input or have to free it */
-      LWIP_DEBUGF(BRIDGEIF_FW_DEBUG, ("br -> input(%p)\n", (void *)p));
-      if (br->netif->input(p, br->netif) != ERR_OK) {
+      struct pbuf *q = bridgeif_share_rx(p);
+      if (q == NULL) {
         pbuf_free(p);
+        return ERR_OK;
+      }
+      LWIP_DEBUGF(BRIDGEIF_FW_DEBUG, ("br -> input(%p)\n", (void *)q));
+      if (br->netif->input(q, br->netif) != ERR_OK) {
+        pbuf_free(q);
       }
     } else {
       /* all references done */
@@ -427,6 +486,9 @@ bridgeif_init(struct netif *netif)
 
   if (bridgeif_netif_client_id == 0xFF) {
     bridgeif_netif_client_id = netif_alloc_client_data_id();
+#if BRIDGEIF_SHARED_PBUFS && LWIP_SUPPORT_CUSTOM_PBUF
+    LWIP_MEMPOOL_INIT(BRIDGEIF_SHARED);
+#endif
   }
 
   init_data = (bridgeif_initdata_t *)netif->state;
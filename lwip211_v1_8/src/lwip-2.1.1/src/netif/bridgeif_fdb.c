@@ -41,6 +41,7 @@
  * This file implements an example for an FDB (Forwarding DataBase)
  */
 
+
 #include "netif/bridgeif.h"
 #include "lwip/sys.h"
 #include "lwip/mem.h"
@@ -52,96 +53,149 @@
 #define BR_FDB_TIMEOUT_SEC  (60*5) /* 5 minutes FDB timeout */
 
 typedef struct bridgeif_dfdb_entry_s {
+  /* odd while the entry is rewritten, see bridgeif_fdb_find() */
+  u16_t seq;
   u8_t used;
   u8_t port;
-  u32_t ts;
-  struct eth_addr addr;
+  /* the mac address as three halfwords, compared without memcmp */
+  u16_t key[3];
+  /* bridgeif_dfdb_t::now when last seen as source */
+  u16_t seen;
 } bridgeif_dfdb_entry_t;
 
 typedef struct bridgeif_dfdb_s {
-  u16_t max_fdb_entries;
-  bridgeif_dfdb_entry_t *fdb;
+  /* table size - 1, the size is a power of two */
+  u32_t mask;
+  u8_t shift;
+  /* seconds, counted by the aging timer */
+  u16_t now;
+  volatile bridgeif_dfdb_entry_t *fdb;
 } bridgeif_dfdb_t;
 
+static u32_t
+bridgeif_fdb_hash(const bridgeif_dfdb_t *fdb, const u16_t *key)
+{
+  /* the vendor part (first 3 bytes) is shared by many stations, so the lower
+     halfwords carry most of the entropy; multiply to spread it into the top bits */
+  u32_t h = (((u32_t)key[2] << 16) | key[1]) ^ key[0];
+  return (u32_t)(h * 0x9E3779B1UL) >> fdb->shift;
+}
+
+/* Lock-free lookup: returns the slot of 'key' and its port, or -1 if not found.
+ * An entry that is rewritten while it is read counts as not found; the callers
+ * flood or learn again, which is never wrong. */
+static int
+bridgeif_fdb_find(const bridgeif_dfdb_t *fdb, const u16_t *key, u8_t *port)
+{
+  u32_t idx = bridgeif_fdb_hash(fdb, key);
+  int i;
+
+  for (i = 0; i < BRIDGEIF_FDB_WAYS; i++, idx = (idx + 1) & fdb->mask) {
+    volatile bridgeif_dfdb_entry_t *e = &fdb->fdb[idx];
+    u16_t seq = e->seq;
+    BRIDGEIF_FDB_BARRIER();
+    if (e->used && (e->key[0] == key[0]) && (e->key[1] == key[1]) && (e->key[2] == key[2])) {
+      u8_t p = e->port;
+      BRIDGEIF_FDB_BARRIER();
+      if (((seq & 1) == 0) && (e->seq == seq)) {
+        *port = p;
+        return (int)idx;
+      }
+      return -1;
+    }
+  }
+  return -1;
+}
+
+/* Writers hold BRIDGEIF_WRITE_PROTECT, readers detect them by the odd sequence count */
+static void
+bridgeif_fdb_write(volatile bridgeif_dfdb_entry_t *e, const u16_t *key, u8_t port, u8_t used, u16_t now)
+{
+  e->seq++;
+  BRIDGEIF_FDB_BARRIER();
+  e->used = used;
+  e->port = port;
+  e->key[0] = key[0];
+  e->key[1] = key[1];
+  e->key[2] = key[2];
+  e->seen = now;
+  BRIDGEIF_FDB_BARRIER();
+  e->seq++;
+}
+
 /**
  * @ingroup bridgeif_fdb
- * A real simple and slow implementation of an auto-learning forwarding database that
- * remembers known src mac addresses to know which port to send frames destined for that
- * mac address.
- *
- * ATTENTION: This is meant as an example only, in real-world use, you should
- * provide a better implementation :-)
+ * An auto-learning forwarding database that remembers known src mac addresses
+ * to know which port to send frames destined for that mac address.
+ * Addresses are hashed into a table; an address can be in one of
+ * BRIDGEIF_FDB_WAYS slots, so lookups and learning take constant time.
+ * A known station seen again on the same port, which is what nearly every
+ * frame is, only refreshes its timestamp and takes no lock.
  */
 void
 bridgeif_fdb_update_src(void *fdb_ptr, struct eth_addr *src_addr, u8_t port_idx)
 {
-  int i;
+  int i, idx;
+  u8_t port;
+  u16_t key[3];
+  u32_t slot;
+  volatile bridgeif_dfdb_entry_t *victim = NULL;
   bridgeif_dfdb_t *fdb = (bridgeif_dfdb_t *)fdb_ptr;
   BRIDGEIF_DECL_PROTECT(lev);
-  BRIDGEIF_READ_PROTECT(lev);
-  for (i = 0; i < fdb->max_fdb_entries; i++) {
-    bridgeif_dfdb_entry_t *e = &fdb->fdb[i];
-    if (e->used && e->ts) {
-      if (!memcmp(&e->addr, src_addr, sizeof(struct eth_addr))) {
-        LWIP_DEBUGF(BRIDGEIF_FDB_DEBUG, ("br: update src %02x:%02x:%02x:%02x:%02x:%02x (from %d) @ idx %d\n",
-                                         src_addr->addr[0], src_addr->addr[1], src_addr->addr[2], src_addr->addr[3], src_addr->addr[4], src_addr->addr[5],
-                                         port_idx, i));
-        BRIDGEIF_WRITE_PROTECT(lev);
-        e->ts = BR_FDB_TIMEOUT_SEC;
-        e->port = port_idx;
-        BRIDGEIF_WRITE_UNPROTECT(lev);
-        BRIDGEIF_READ_UNPROTECT(lev);
-        return;
-      }
+
+  SMEMCPY(key, src_addr, sizeof(key));
+  idx = bridgeif_fdb_find(fdb, key, &port);
+  if ((idx >= 0) && (port == port_idx)) {
+    if (fdb->fdb[idx].seen != fdb->now) {
+      fdb->fdb[idx].seen = fdb->now;
     }
+    return;
   }
-  /* not found, allocate new entry from free */
-  for (i = 0; i < fdb->max_fdb_entries; i++) {
-    bridgeif_dfdb_entry_t *e = &fdb->fdb[i];
-    if (!e->used || !e->ts) {
-      BRIDGEIF_WRITE_PROTECT(lev);
-      /* check again when protected */
-      if (!e->used || !e->ts) {
-        LWIP_DEBUGF(BRIDGEIF_FDB_DEBUG, ("br: create src %02x:%02x:%02x:%02x:%02x:%02x (from %d) @ idx %d\n",
-                                         src_addr->addr[0], src_addr->addr[1], src_addr->addr[2], src_addr->addr[3], src_addr->addr[4], src_addr->addr[5],
-                                         port_idx, i));
-        memcpy(&e->addr, src_addr, sizeof(struct eth_addr));
-        e->ts = BR_FDB_TIMEOUT_SEC;
-        e->port = port_idx;
-        e->used = 1;
-        BRIDGEIF_WRITE_UNPROTECT(lev);
-        BRIDGEIF_READ_UNPROTECT(lev);
-        return;
+
+  /* new station, or it moved to another port */
+  BRIDGEIF_READ_PROTECT(lev);
+  BRIDGEIF_WRITE_PROTECT(lev);
+  slot = bridgeif_fdb_hash(fdb, key);
+  for (i = 0; i < BRIDGEIF_FDB_WAYS; i++, slot = (slot + 1) & fdb->mask) {
+    volatile bridgeif_dfdb_entry_t *e = &fdb->fdb[slot];
+    if (e->used && (e->key[0] == key[0]) && (e->key[1] == key[1]) && (e->key[2] == key[2])) {
+      victim = e;
+      break;
+    }
+    if (!e->used) {
+      if ((victim == NULL) || victim->used) {
+        victim = e;
       }
-      BRIDGEIF_WRITE_UNPROTECT(lev);
+    } else if ((victim == NULL) ||
+               (victim->used && ((u16_t)(fdb->now - e->seen) > (u16_t)(fdb->now - victim->seen)))) {
+      /* all taken so far: replace the one seen longest ago */
+      victim = e;
     }
   }
+  LWIP_DEBUGF(BRIDGEIF_FDB_DEBUG, ("br: %s src %02x:%02x:%02x:%02x:%02x:%02x (from %d) @ idx %d\n",
+                                   (victim->used ? "update" : "create"),
+                                   src_addr->addr[0], src_addr->addr[1], src_addr->addr[2], src_addr->addr[3], src_addr->addr[4], src_addr->addr[5],
+                                   port_idx, (int)(victim - fdb->fdb)));
+  bridgeif_fdb_write(victim, key, port_idx, 1, fdb->now);
+  BRIDGEIF_WRITE_UNPROTECT(lev);
   BRIDGEIF_READ_UNPROTECT(lev);
-  /* not found, no free entry -> flood */
 }
 
 /**
  * @ingroup bridgeif_fdb
- * Walk our list of auto-learnt fdb entries and return a port to forward or BR_FLOOD if unknown
+ * Look up an auto-learnt fdb entry and return a port to forward or BR_FLOOD if unknown
  */
 bridgeif_portmask_t
 bridgeif_fdb_get_dst_ports(void *fdb_ptr, struct eth_addr *dst_addr)
 {
-  int i;
+  u8_t port;
+  u16_t key[3];
   bridgeif_dfdb_t *fdb = (bridgeif_dfdb_t *)fdb_ptr;
-  BRIDGEIF_DECL_PROTECT(lev);
-  BRIDGEIF_READ_PROTECT(lev);
-  for (i = 0; i < fdb->max_fdb_entries; i++) {
-    bridgeif_dfdb_entry_t *e = &fdb->fdb[i];
-    if (e->used && e->ts) {
-      if (!memcmp(&e->addr, dst_addr, sizeof(struct eth_addr))) {
-        bridgeif_portmask_t ret = (bridgeif_portmask_t)(1 << e->port);
-        BRIDGEIF_READ_UNPROTECT(lev);
-        return ret;
-      }
-    }
+
+  SMEMCPY(key, dst_addr, sizeof(key));
+  if (bridgeif_fdb_find(fdb, key, &port) >= 0) {
+    return (bridgeif_portmask_t)(1 << port);
   }
-  BRIDGEIF_READ_UNPROTECT(lev);
   return BR_FLOOD;
 }
 
@@ -152,27 +206,30 @@ bridgeif_fdb_get_dst_ports(void *fdb_ptr, struct eth_addr *dst_addr)
 static void
 bridgeif_fdb_age_one_second(void *fdb_ptr)
 {
-  int i;
+  u32_t i;
   bridgeif_dfdb_t *fdb;
   BRIDGEIF_DECL_PROTECT(lev);
 
   fdb = (bridgeif_dfdb_t *)fdb_ptr;
-  BRIDGEIF_READ_PROTECT(lev);
+  fdb->now++;
 
-  for (i = 0; i < fdb->max_fdb_entries; i++) {
-    bridgeif_dfdb_entry_t *e = &fdb->fdb[i];
-    if (e->used && e->ts) {
+  for (i = 0; i <= fdb->mask; i++) {
+    volatile bridgeif_dfdb_entry_t *e = &fdb->fdb[i];
+    if (e->used && ((u16_t)(fdb->now - e->seen) >= BR_FDB_TIMEOUT_SEC)) {
+      BRIDGEIF_READ_PROTECT(lev);
       BRIDGEIF_WRITE_PROTECT(lev);
       /* check again when protected */
-      if (e->used && e->ts) {
-        if (--e->ts == 0) {
-          e->used = 0;
-        }
+      if (e->used && ((u16_t)(fdb->now - e->seen) >= BR_FDB_TIMEOUT_SEC)) {
+        u16_t key[3];
+        key[0] = e->key[0];
+        key[1] = e->key[1];
+        key[2] = e->key[2];
+        bridgeif_fdb_write(e, key, e->port, 0, e->seen);
       }
       BRIDGEIF_WRITE_UNPROTECT(lev);
+      BRIDGEIF_READ_UNPROTECT(lev);
     }
   }
-  BRIDGEIF_READ_UNPROTECT(lev);
 }
 
 /** Timer callback for fdb aging, called once per second */
@@ -189,22 +246,36 @@ bridgeif_age_tmr(void *arg)
 
 /**
  * @ingroup bridgeif_fdb
- * Init our simple fdb list
+ * Init our fdb hash table. It has the next power of two of max_fdb_entries slots
+ * (at least BRIDGEIF_FDB_WAYS).
  */
 void *
 bridgeif_fdb_init(u16_t max_fdb_entries)
 {
   bridgeif_dfdb_t *fdb;
-  size_t alloc_len_sizet = sizeof(bridgeif_dfdb_t) + (max_fdb_entries * sizeof(bridgeif_dfdb_entry_t));
-  mem_size_t alloc_len = (mem_size_t)alloc_len_sizet;
+  u32_t size = BRIDGEIF_FDB_WAYS;
+  u8_t shift = 32;
+  size_t alloc_len_sizet;
+  mem_size_t alloc_len;
+
+  LWIP_ASSERT("BRIDGEIF_FDB_WAYS must be a power of two", (BRIDGEIF_FDB_WAYS & (BRIDGEIF_FDB_WAYS - 1)) == 0);
+  while (size < max_fdb_entries) {
+    size <<= 1;
+  }
+  while ((1UL << (32 - shift)) < size) {
+    shift--;
+  }
+  alloc_len_sizet = sizeof(bridgeif_dfdb_t) + (size * sizeof(bridgeif_dfdb_entry_t));
+  alloc_len = (mem_size_t)alloc_len_sizet;
   LWIP_ASSERT("alloc_len == alloc_len_sizet", alloc_len == alloc_len_sizet);
   LWIP_DEBUGF(BRIDGEIF_DEBUG, ("bridgeif_fdb_init: allocating %d bytes for private FDB data\n", (int)alloc_len));
   fdb = (bridgeif_dfdb_t *)mem_calloc(1, alloc_len);
   if (fdb == NULL) {
     return NULL;
   }
-  fdb->max_fdb_entries = max_fdb_entries;
-  fdb->fdb = (bridgeif_dfdb_entry_t *)(fdb + 1);
+  fdb->mask = size - 1;
+  fdb->shift = shift;
+  fdb->fdb = (volatile bridgeif_dfdb_entry_t *)(fdb + 1);
 
   sys_timeout(BRIDGEIF_AGE_TIMER_MS, bridgeif_age_tmr, fdb);
 
@@ -506,6 +506,9 @@ lowpan6_set_context(u8_t idx, const ip6_addr_t *context)
   IP6_ADDR_ZONECHECK(context);
 
   ip6_addr_set(&lowpan6_data.lowpan6_context[idx], context);
+#if LWIP_6LOWPAN_IPHC && (LWIP_6LOWPAN_HC_CACHE_SIZE > 0)
+  lowpan6_hc_cache_flush();
+#endif
 
   return ERR_OK;
 #else
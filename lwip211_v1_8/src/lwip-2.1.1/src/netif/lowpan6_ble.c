@@ -306,6 +306,9 @@ rfc7668_set_context(u8_t idx, const ip6_addr_t *context)
   }
   /* copy IPv6 address to context storage */
   ip6_addr_set(&rfc7668_context[idx], context);
+#if LWIP_6LOWPAN_IPHC && (LWIP_6LOWPAN_HC_CACHE_SIZE > 0)
+  lowpan6_hc_cache_flush();
+#endif
   return ERR_OK;
 #else
   LWIP_UNUSED_ARG(idx);
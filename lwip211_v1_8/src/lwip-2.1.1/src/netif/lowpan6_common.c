@@ -125,6 +125,137 @@ lowpan6_context_lookup(const ip6_addr_t *lowpan6_contexts, const ip6_addr_t *ip6
 }
 #endif /* LWIP_6LOWPAN_NUM_CONTEXTS > 0 */
 
+/* Interface identifier (the low 64 bits of an IPv6 address) derived from a
+ * link layer address as per RFC 4944 ch 6 / RFC 6282 ch 3.2.2. */
+static err_t
+lowpan6_link_addr_iid(const struct lowpan6_link_addr *lladdr, u32_t *iid)
+{
+  if (lladdr->addr_len == 2) {
+    iid[0] = PP_HTONL(0x000000ffUL);
+    iid[1] = lwip_htonl(0xfe000000UL | (lladdr->addr[0] << 8) | lladdr->addr[1]);
+  } else if (lladdr->addr_len == 8) {
+    iid[0] = lwip_htonl(((lladdr->addr[0] ^ 2) << 24) | (lladdr->addr[1] << 16) |
+                        (lladdr->addr[2] << 8) | lladdr->addr[3]);
+    iid[1] = lwip_htonl((lladdr->addr[4] << 24) | (lladdr->addr[5] << 16) |
+                        (lladdr->addr[6] << 8) | lladdr->addr[7]);
+  } else {
+    return ERR_VAL;
+  }
+  return ERR_OK;
+}
+
+#if LWIP_6LOWPAN_HC_CACHE_SIZE > 0
+/** Compression state kept per link layer address */
+struct lowpan6_hc_entry {
+  /* key, addr_len 0 marks an unused entry */
+  struct lowpan6_link_addr lladdr;
+  /* interface identifier derived from lladdr, network order */
+  u32_t iid[2];
+  /* IPv6 address last compressed against lladdr, and the contexts it was looked up in */
+  ip6_addr_t ip6addr;
+  const ip6_addr_t *contexts;
+  /* what that address compressed to: context index (-1 for none) and address mode */
+  s8_t context;
+  s8_t mode;
+};
+
+static struct lowpan6_hc_entry lowpan6_hc_cache[LWIP_6LOWPAN_HC_CACHE_SIZE];
+
+/**
+ * Forget all cached compression state. Must be called when a context changes,
+ * lowpan6_set_context() and rfc7668_set_context() do so.
+ */
+void
+lowpan6_hc_cache_flush(void)
+{
+  memset(lowpan6_hc_cache, 0, sizeof(lowpan6_hc_cache));
+}
+
+/* The cache entry of a link layer address, taken over from whichever
+ * address used its slot before. NULL if the address has no IID. */
+static struct lowpan6_hc_entry *
+lowpan6_hc_get(const struct lowpan6_link_addr *lladdr)
+{
+  struct lowpan6_hc_entry *entry;
+
+  if ((lladdr->addr_len != 2) && (lladdr->addr_len != 8)) {
+    return NULL;
+  }
+  entry = &lowpan6_hc_cache[lladdr->addr[lladdr->addr_len - 1] % LWIP_6LOWPAN_HC_CACHE_SIZE];
+  if ((entry->lladdr.addr_len != lladdr->addr_len) ||
+      (memcmp(entry->lladdr.addr, lladdr->addr, lladdr->addr_len) != 0)) {
+    SMEMCPY(&entry->lladdr, lladdr, sizeof(entry->lladdr));
+    lowpan6_link_addr_iid(lladdr, entry->iid);
+    entry->contexts = NULL;
+  }
+  return entry;
+}
+#endif /* LWIP_6LOWPAN_HC_CACHE_SIZE > 0 */
+
+/* Context index (-1 for none) and unicast address mode (see
+ * lowpan6_get_address_mode) an address compresses to against a link address. */
+static void
+lowpan6_hc_lookup(const ip6_addr_t *lowpan6_contexts, const ip6_addr_t *ip6addr,
+                  const struct lowpan6_link_addr *lladdr, s8_t *context, s8_t *mode)
+{
+#if LWIP_6LOWPAN_HC_CACHE_SIZE > 0
+  struct lowpan6_hc_entry *entry = lowpan6_hc_get(lladdr);
+
+  if (entry != NULL) {
+    if ((entry->contexts != lowpan6_contexts) || !ip6_addr_cmp(&entry->ip6addr, ip6addr)) {
+#if LWIP_6LOWPAN_NUM_CONTEXTS > 0
+      entry->context = lowpan6_context_lookup(lowpan6_contexts, ip6addr);
+#else
+      entry->context = -1;
+#endif
+      if ((ip6addr->addr[2] == entry->iid[0]) && (ip6addr->addr[3] == entry->iid[1])) {
+        entry->mode = 3;
+      } else if ((ip6addr->addr[2] == PP_HTONL(0x000000ffUL)) &&
+                 ((ip6addr->addr[3] & PP_HTONL(0xffff0000)) == PP_NTOHL(0xfe000000UL))) {
+        entry->mode = 2;
+      } else {
+        entry->mode = 1;
+      }
+      ip6_addr_copy(entry->ip6addr, *ip6addr);
+      entry->contexts = lowpan6_contexts;
+    }
+    *context = entry->context;
+    *mode = entry->mode;
+    return;
+  }
+#endif /* LWIP_6LOWPAN_HC_CACHE_SIZE > 0 */
+
+#if LWIP_6LOWPAN_NUM_CONTEXTS > 0
+  *context = lowpan6_context_lookup(lowpan6_contexts, ip6addr);
+#else
+  LWIP_UNUSED_ARG(lowpan6_contexts);
+  *context = -1;
+#endif
+  *mode = lowpan6_get_address_mode(ip6addr, lladdr);
+}
+
+/* Set the interface identifier of an address elided against a link address */
+static err_t
+lowpan6_hc_iid(const struct lowpan6_link_addr *lladdr, ip6_addr_p_t *ip6addr)
+{
+  u32_t iid[2];
+#if LWIP_6LOWPAN_HC_CACHE_SIZE > 0
+  struct lowpan6_hc_entry *entry = lowpan6_hc_get(lladdr);
+
+  if (entry != NULL) {
+    ip6addr->addr[2] = entry->iid[0];
+    ip6addr->addr[3] = entry->iid[1];
+    return ERR_OK;
+  }
+#endif /* LWIP_6LOWPAN_HC_CACHE_SIZE > 0 */
+  if (lowpan6_link_addr_iid(lladdr, iid) != ERR_OK) {
+    return ERR_VAL;
+  }
+  ip6addr->addr[2] = iid[0];
+  ip6addr->addr[3] = iid[1];
+  return ERR_OK;
+}
+
 /*
  * Compress IPv6 and/or UDP headers.
  * */
@@ -137,6 +268,7 @@ lowpan6_compress_headers(struct netif *netif, u8_t *inbuf, size_t inbuf_size, u8
   u8_t lowpan6_header_len;
   u8_t hidden_header_len = 0;
   s8_t i;
+  s8_t src_context, src_mode, dst_context, dst_mode;
   struct ip6_hdr *ip6hdr;
   ip_addr_t ip6src, ip6dst;
 
@@ -166,6 +298,10 @@ lowpan6_compress_headers(struct netif *netif, u8_t *inbuf, size_t inbuf_size, u8
   ip_addr_copy_from_ip6_packed(ip6src, ip6hdr->src);
   ip6_addr_assign_zone(ip_2_ip6(&ip6src), IP6_UNKNOWN, netif);
 
+  /* Look up contexts and address modes, cached per neighbor if enabled */
+  lowpan6_hc_lookup(lowpan6_contexts, ip_2_ip6(&ip6src), src, &src_context, &src_mode);
+  lowpan6_hc_lookup(lowpan6_contexts, ip_2_ip6(&ip6dst), dst, &dst_context, &dst_mode);
+
   /* Basic length of 6LowPAN header, set dispatch and clear fields. */
   lowpan6_header_len = 2;
   buffer[0] = 0x60;
@@ -176,18 +312,16 @@ lowpan6_compress_headers(struct netif *netif, u8_t *inbuf, size_t inbuf_size, u8
 #if LWIP_6LOWPAN_NUM_CONTEXTS > 0
   buffer[2] = 0;
 
-  i = lowpan6_context_lookup(lowpan6_contexts, ip_2_ip6(&ip6src));
-  if (i >= 0) {
+  if (src_context >= 0) {
     /* Stateful source address compression. */
     buffer[1] |= 0x40;
-    buffer[2] |= (i & 0x0f) << 4;
+    buffer[2] |= (src_context & 0x0f) << 4;
   }
 
-  i = lowpan6_context_lookup(lowpan6_contexts, ip_2_ip6(&ip6dst));
-  if (i >= 0) {
+  if (dst_context >= 0) {
     /* Stateful destination address compression. */
     buffer[1] |= 0x04;
-    buffer[2] |= i & 0x0f;
+    buffer[2] |= dst_context & 0x0f;
   }
 
   if (buffer[2] != 0x00) {
@@ -196,7 +330,8 @@ lowpan6_compress_headers(struct netif *netif, u8_t *inbuf, size_t inbuf_size, u8
     lowpan6_header_len++;
   }
 #else /* LWIP_6LOWPAN_NUM_CONTEXTS > 0 */
-  LWIP_UNUSED_ARG(lowpan6_contexts);
+  LWIP_UNUSED_ARG(src_context);
+  LWIP_UNUSED_ARG(dst_context);
 #endif /* LWIP_6LOWPAN_NUM_CONTEXTS > 0 */
 
   /* Determine TF field: Traffic Class, Flow Label */
@@ -253,7 +388,7 @@ lowpan6_compress_headers(struct netif *netif, u8_t *inbuf, size_t inbuf_size, u8
   if (((buffer[1] & 0x40) != 0) ||
       (ip6_addr_islinklocal(ip_2_ip6(&ip6src)))) {
     /* Context-based or link-local source address compression. */
-    i = lowpan6_get_address_mode(ip_2_ip6(&ip6src), src);
+    i = src_mode;
     buffer[1] |= (i & 0x03) << 4;
     if (i == 1) {
       MEMCPY(buffer + lowpan6_header_len, inptr + 16, 8);
@@ -296,7 +431,7 @@ lowpan6_compress_headers(struct netif *netif, u8_t *inbuf, size_t inbuf_size, u8
   } else if (((buffer[1] & 0x04) != 0) ||
               (ip6_addr_islinklocal(ip_2_ip6(&ip6dst)))) {
     /* Context-based or link-local destination address compression. */
-    i = lowpan6_get_address_mode(ip_2_ip6(&ip6dst), dst);
+    i = dst_mode;
     buffer[1] |= i & 0x03;
     if (i == 1) {
       MEMCPY(buffer + lowpan6_header_len, inptr + 32, 8);
@@ -526,15 +661,7 @@ lowpan6_decompress_hdr(u8_t *lowpan6_buffer, size_t lowpan6_bufsize,
       /* no information avalaible, using other layers, see RFC6282 ch 3.2.2 */
       ip6hdr->src.addr[0] = PP_HTONL(0xfe800000UL);
       ip6hdr->src.addr[1] = 0;
-      if (src->addr_len == 2) {
-        ip6hdr->src.addr[2] = PP_HTONL(0x000000ffUL);
-        ip6hdr->src.addr[3] = lwip_htonl(0xfe000000UL | (src->addr[0] << 8) | src->addr[1]);
-      } else if (src->addr_len == 8) {
-        ip6hdr->src.addr[2] = lwip_htonl(((src->addr[0] ^ 2) << 24) | (src->addr[1] << 16) |
-                                         (src->addr[2] << 8) | src->addr[3]);
-        ip6hdr->src.addr[3] = lwip_htonl((src->addr[4] << 24) | (src->addr[5] << 16) |
-                                         (src->addr[6] << 8) | src->addr[7]);
-      } else {
+      if (lowpan6_hc_iid(src, &ip6hdr->src) != ERR_OK) {
         /* invalid source address length */
         LWIP_DEBUGF(LWIP_LOWPAN6_DECOMPRESSION_DEBUG, ("Invalid source address length\n"));
         return ERR_VAL;
@@ -585,13 +712,7 @@ lowpan6_decompress_hdr(u8_t *lowpan6_buffer, size_t lowpan6_bufsize,
     } else if ((lowpan6_buffer[1] & 0x30) == 0x30) {
       /* SAM=11, address is fully elided, load from other layers */
       LWIP_DEBUGF(LWIP_LOWPAN6_DECOMPRESSION_DEBUG, ("SAM == 11, context compression, 0bits inline, using other headers\n"));
-      if (src->addr_len == 2) {
-        ip6hdr->src.addr[2] = PP_HTONL(0x000000ffUL);
-        ip6hdr->src.addr[3] = lwip_htonl(0xfe000000UL | (src->addr[0] << 8) | src->addr[1]);
-      } else if (src->addr_len == 8) {
-        ip6hdr->src.addr[2] = lwip_htonl(((src->addr[0] ^ 2) << 24) | (src->addr[1] << 16) | (src->addr[2] << 8) | src->addr[3]);
-        ip6hdr->src.addr[3] = lwip_htonl((src->addr[4] << 24) | (src->addr[5] << 16) | (src->addr[6] << 8) | src->addr[7]);
-      } else {
+      if (lowpan6_hc_iid(src, &ip6hdr->src) != ERR_OK) {
         /* invalid source address length */
         LWIP_DEBUGF(LWIP_LOWPAN6_DECOMPRESSION_DEBUG, ("Invalid source address length\n"));
         return ERR_VAL;
@@ -685,13 +806,7 @@ lowpan6_decompress_hdr(u8_t *lowpan6_buffer, size_t lowpan6_bufsize,
     } else if ((lowpan6_buffer[1] & 0x03) == 0x03) {
       /* DAM=11, no bits available, use other headers (not done here) */
       LWIP_DEBUGF(LWIP_LOWPAN6_DECOMPRESSION_DEBUG,("DAM == 01, dst compression, 0bits inline, using other headers\n"));
-      if (dest->addr_len == 2) {
-        ip6hdr->dest.addr[2] = PP_HTONL(0x000000ffUL);
-        ip6hdr->dest.addr[3] = lwip_htonl(0xfe000000UL | (dest->addr[0] << 8) | dest->addr[1]);
-      } else if (dest->addr_len == 8) {
-        ip6hdr->dest.addr[2] = lwip_htonl(((dest->addr[0] ^ 2) << 24) | (dest->addr[1] << 16) | dest->addr[2] << 8 | dest->addr[3]);
-        ip6hdr->dest.addr[3] = lwip_htonl((dest->addr[4] << 24) | (dest->addr[5] << 16) | dest->addr[6] << 8 | dest->addr[7]);
-      } else {
+      if (lowpan6_hc_iid(dest, &ip6hdr->dest) != ERR_OK) {
         /* invalid destination address length */
         LWIP_DEBUGF(LWIP_LOWPAN6_DECOMPRESSION_DEBUG, ("Invalid destination address length\n"));
         return ERR_VAL;
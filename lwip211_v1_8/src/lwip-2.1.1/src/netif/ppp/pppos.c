@@ -74,6 +74,9 @@ static void pppos_input_free_current_packet(pppos_pcb *pppos);
 static void pppos_input_drop(pppos_pcb *pppos);
 static err_t pppos_output_append(pppos_pcb *pppos, err_t err, struct pbuf *nb, u8_t c, u8_t accm, u16_t *fcs);
 static err_t pppos_output_last(pppos_pcb *pppos, err_t err, struct pbuf *nb, u16_t *fcs);
+#if PPPOS_FAST_HDLC
+static err_t pppos_output_append_run(pppos_pcb *pppos, err_t err, struct pbuf *nb, const u8_t *s, u16_t n, u16_t *fcs);
+#endif /* PPPOS_FAST_HDLC */
 
 /* Callbacks structure for PPP core */
 static const struct link_callbacks pppos_callbacks = {
@@ -155,6 +158,88 @@ ppp_get_fcs(u8_t byte)
 #define PPP_INITFCS     0xffff  /* Initial FCS value */
 #define PPP_GOODFCS     0xf0b8  /* Good final FCS value */
 
+#if PPPOS_FAST_HDLC
+/*
+ * Slicing-by-8 FCS: pppos_fcstab8[k][c] is the FCS contribution of byte c
+ * followed by k more bytes, pppos_fcstab8[0] is the usual table.
+ */
+static u16_t pppos_fcstab8[8][256];
+static u8_t pppos_fcstab8_ready;
+
+static void
+pppos_fcs_init(void)
+{
+  unsigned int c, k;
+  int bit;
+
+  if (pppos_fcstab8_ready) {
+    return;
+  }
+  for (c = 0; c < 256; c++) {
+    unsigned int octet = c;
+    for (bit = 8; bit-- > 0; ) {
+      octet = (octet & 0x01) ? ((octet >> 1) ^ 0x8408) : (octet >> 1);
+    }
+    pppos_fcstab8[0][c] = (u16_t)octet;
+  }
+  for (k = 1; k < 8; k++) {
+    for (c = 0; c < 256; c++) {
+      u16_t prev = pppos_fcstab8[k - 1][c];
+      pppos_fcstab8[k][c] = (u16_t)((prev >> 8) ^ pppos_fcstab8[0][prev & 0xff]);
+    }
+  }
+  pppos_fcstab8_ready = 1;
+}
+
+/* PPP_FCS over n bytes, 8 of them per step */
+static u16_t
+pppos_fcs_block(u16_t fcs, const u8_t *s, u16_t n)
+{
+  while (n >= 8) {
+    fcs ^= (u16_t)(s[0] | ((u16_t)s[1] << 8));
+    fcs = pppos_fcstab8[7][fcs & 0xff] ^ pppos_fcstab8[6][fcs >> 8] ^
+          pppos_fcstab8[5][s[2]] ^ pppos_fcstab8[4][s[3]] ^
+          pppos_fcstab8[3][s[4]] ^ pppos_fcstab8[2][s[5]] ^
+          pppos_fcstab8[1][s[6]] ^ pppos_fcstab8[0][s[7]];
+    s += 8;
+    n -= 8;
+  }
+  while (n-- > 0) {
+    fcs = (fcs >> 8) ^ pppos_fcstab8[0][(fcs ^ *s++) & 0xff];
+  }
+  return fcs;
+}
+
+/* Nonzero if a byte of w is below n (n <= 0x80), may also be for one above */
+#define PPPOS_WORD_HASLESS(w, n) (((w) - 0x01010101UL * (n)) & ~(w) & 0x80808080UL)
+/* Only control characters and 0x7d/0x7e are ever in an ACCM (see pppos_send_config()
+ * and pppos_recv_config()), a word without them needs no escaping */
+#define PPPOS_WORD_MAY_ESCAPE(w) (PPPOS_WORD_HASLESS(w, 0x20) | PPPOS_WORD_HASLESS((w) ^ 0x7e7e7e7eUL, 4))
+
+/* Number of bytes at the start of s that need no escaping under accm */
+static u16_t
+pppos_run_len(const u8_t *accm, const u8_t *s, u16_t n)
+{
+  u16_t i = 0;
+
+  while (i < n) {
+    if (n - i >= 4) {
+      u32_t w;
+      MEMCPY(&w, s + i, sizeof(w));
+      if (!PPPOS_WORD_MAY_ESCAPE(w)) {
+        i += 4;
+        continue;
+      }
+    }
+    if (ESCAPE_P(accm, s[i])) {
+      break;
+    }
+    i++;
+  }
+  return i;
+}
+#endif /* PPPOS_FAST_HDLC */
+
 #if PPP_INPROC_IRQ_SAFE
 #define PPPOS_DECL_PROTECT(lev) SYS_ARCH_DECL_PROTECT(lev)
 #define PPPOS_PROTECT(lev) SYS_ARCH_PROTECT(lev)
@@ -182,6 +267,9 @@ ppp_pcb *pppos_create(struct netif *pppif, pppos_output_cb_fn output_cb,
   if (pppos == NULL) {
     return NULL;
   }
+#if PPPOS_FAST_HDLC
+  pppos_fcs_init();
+#endif /* PPPOS_FAST_HDLC */
 
   ppp = ppp_new(pppif, &pppos_callbacks, pppos, link_status_cb, ctx_cb);
   if (ppp == NULL) {
@@ -234,9 +322,13 @@ pppos_write(ppp_pcb *ppp, void *ctx, struct pbuf *p)
   fcs_out = PPP_INITFCS;
   s = (u8_t*)p->payload;
   n = p->len;
+#if PPPOS_FAST_HDLC
+  err = pppos_output_append_run(pppos, err, nb, s, n, &fcs_out);
+#else /* PPPOS_FAST_HDLC */
   while (n-- > 0) {
     err = pppos_output_append(pppos, err,  nb, *s++, 1, &fcs_out);
   }
+#endif /* PPPOS_FAST_HDLC */
 
   err = pppos_output_last(pppos, err, nb, &fcs_out);
   if (err == ERR_OK) {
@@ -295,9 +387,13 @@ pppos_netif_output(ppp_pcb *ppp, void *ctx, struct pbuf *pb, u16_t protocol)
     u16_t n = p->len;
     u8_t *s = (u8_t*)p->payload;
 
+#if PPPOS_FAST_HDLC
+    err = pppos_output_append_run(pppos, err, nb, s, n, &fcs_out);
+#else /* PPPOS_FAST_HDLC */
     while (n-- > 0) {
       err = pppos_output_append(pppos, err,  nb, *s++, 1, &fcs_out);
     }
+#endif /* PPPOS_FAST_HDLC */
   }
 
   err = pppos_output_last(pppos, err, nb, &fcs_out);
@@ -488,6 +584,30 @@ pppos_input(ppp_pcb *ppp, u8_t *s, int l)
 
   PPPDEBUG(LOG_DEBUG, ("pppos_input[%d]: got %d bytes\n", ppp->netif->num, l));
   while (l-- > 0) {
+#if PPPOS_FAST_HDLC
+    /* Inside a packet, take the bytes up to the next one to unescape (or
+     * flag) in one go, as far as they fit the current pbuf. */
+    if (pppos->in_state == PDDATA && !pppos->in_escaped &&
+        pppos->in_tail != NULL && pppos->in_tail->len < PBUF_POOL_BUFSIZE) {
+      u16_t run = (u16_t)LWIP_MIN(l + 1, PBUF_POOL_BUFSIZE - pppos->in_tail->len);
+
+      PPPOS_PROTECT(lev);
+      if (!pppos->open) {
+        PPPOS_UNPROTECT(lev);
+        return;
+      }
+      run = pppos_run_len(pppos->in_accm, s, run);
+      PPPOS_UNPROTECT(lev);
+      if (run > 0) {
+        MEMCPY((u8_t*)pppos->in_tail->payload + pppos->in_tail->len, s, run);
+        pppos->in_tail->len += run;
+        pppos->in_fcs = pppos_fcs_block(pppos->in_fcs, s, run);
+        s += run;
+        l -= run - 1;
+        continue;
+      }
+    }
+#endif /* PPPOS_FAST_HDLC */
     cur_char = *s++;
 
     PPPOS_PROTECT(lev);
@@ -853,6 +973,53 @@ pppos_output_append(pppos_pcb *pppos, err_t err, struct pbuf *nb, u8_t c, u8_t a
   return ERR_OK;
 }
 
+#if PPPOS_FAST_HDLC
+/*
+ * pppos_output_append_run - append n data bytes, escaped as out_accm says.
+ * The runs in between the bytes to escape are copied as a whole, the FCS is
+ * computed over all of them at once.
+ */
+static err_t
+pppos_output_append_run(pppos_pcb *pppos, err_t err, struct pbuf *nb, const u8_t *s, u16_t n, u16_t *fcs)
+{
+  if (err != ERR_OK) {
+    return err;
+  }
+
+  *fcs = pppos_fcs_block(*fcs, s, n);
+  while (n > 0) {
+    u16_t run = pppos_run_len(pppos->out_accm, s, n);
+
+    n -= run;
+    while (run > 0) {
+      u16_t chunk;
+
+      if (nb->len == PBUF_POOL_BUFSIZE) {
+        u32_t l = pppos->output_cb(pppos->ppp, (u8_t*)nb->payload, nb->len, pppos->ppp->ctx_cb);
+        if (l != nb->len) {
+          return ERR_IF;
+        }
+        nb->len = 0;
+      }
+      chunk = LWIP_MIN(run, PBUF_POOL_BUFSIZE - nb->len);
+      MEMCPY((u8_t*)nb->payload + nb->len, s, chunk);
+      nb->len += chunk;
+      s += chunk;
+      run -= chunk;
+    }
+    if (n > 0) {
+      /* the FCS already has it */
+      err = pppos_output_append(pppos, err, nb, *s++, 1, NULL);
+      if (err != ERR_OK) {
+        return err;
+      }
+      n--;
+    }
+  }
+  return ERR_OK;
+}
+#endif /* PPPOS_FAST_HDLC */
+
 static err_t
 pppos_output_last(pppos_pcb *pppos, err_t err, struct pbuf *nb, u16_t *fcs)
 {
@@ -0,0 +1,59 @@
+/*
+ * lwIP port for POSIX hosts (Linux userspace), used to build the remote-side stack and
+ * rpmsg_eth on a workstation against the in-process transport in sim/. Only what differs from
+ * lwip_arch_xilinx lives here; lwipopts.h, arch/capture.h and arch/perf.h are shared with it.
+ */
+
+#ifndef __ARCH_CC_H__
+#define __ARCH_CC_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lwipopts.h"
+
+#define LWIP_TIMEVAL_PRIVATE 0
+#include <sys/time.h>
+
+/* The host's errno, the lwIP one would clash with the C library's thread local errno */
+#define LWIP_ERRNO_STDINCLUDE 1
+
+typedef uintptr_t mem_ptr_t;
+
+/* IN_ADDR_T_DEFINED is set for all targets, see CMakeLists.txt */
+typedef uint32_t in_addr_t;
+
+#define LWIP_RAND() ((u32_t)rand())
+
+#define PACK_STRUCT_FIELD(x) x
+#define PACK_STRUCT_STRUCT __attribute__((packed))
+#define PACK_STRUCT_BEGIN
+#define PACK_STRUCT_END
+
+/* Unlike on the target, assertions are fatal: the point of the host build is to find bugs */
+#define LWIP_PLATFORM_DIAG(x) do { printf x; } while (0)
+#define LWIP_PLATFORM_ASSERT(x) do { fprintf(stderr, "lwIP assertion \"%s\" failed at line %d in %s\n", \
+                                             x, __LINE__, __FILE__); fflush(NULL); abort(); } while (0)
+
+/* LWIP_PERF probes count TSC ticks on x86 and nanoseconds elsewhere */
+#ifndef PERF_CYCLES
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PERF_CYCLES() ((u32_t)__rdtsc())
+#else
+#include <time.h>
+static inline uint32_t sys_arch_perf_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec);
+}
+#define PERF_CYCLES() sys_arch_perf_ns()
+#endif
+#endif
+
+#define SYS_ARCH_CHKSUM 0
+
+#endif /* __ARCH_CC_H__ */
@@ -0,0 +1,56 @@
+#ifndef __SYS_POSIX_ARCH_H__
+#define __SYS_POSIX_ARCH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "lwipopts.h"
+
+#if !NO_SYS
+
+/* Everything is a pthread object behind a pointer, NULL is the invalid value as on the target */
+typedef struct sys_arch_sem *sys_sem_t;
+typedef struct sys_arch_mutex *sys_mutex_t;
+typedef struct sys_arch_mbox *sys_mbox_t;
+typedef struct sys_arch_thread *sys_thread_t;
+
+typedef int sys_prot_t;
+
+/* lwip/sys.h only maps these for the target CPUs */
+#define SYS_ARCH_DECL_PROTECT(lev) sys_prot_t lev
+#define SYS_ARCH_PROTECT(lev) lev = sys_arch_protect()
+#define SYS_ARCH_UNPROTECT(lev) sys_arch_unprotect(lev)
+sys_prot_t sys_arch_protect(void);
+void sys_arch_unprotect(sys_prot_t pval);
+
+/* sys_arch_in_isr(): there are no interrupts on the host. The simulated RPMsg transport runs the
+ * endpoint callbacks from a thread of its own that stands in for the IPI handler and counts its
+ * way in and out of sys_arch_isr_nesting, so rpmsg_eth takes the same FromISR paths as on the
+ * target. */
+extern __thread int sys_arch_isr_nesting;
+#define sys_arch_in_isr() (sys_arch_isr_nesting != 0)
+#define sys_arch_isr_enter() (sys_arch_isr_nesting++)
+#define sys_arch_isr_exit() (sys_arch_isr_nesting--)
+
+/* The FreeRTOS task notification: a counter per thread, see sim/include/task.h. Threads that
+ * were not created with sys_thread_new() get their entry on first use. */
+sys_thread_t sys_arch_thread_self(void);
+void sys_arch_thread_notify(sys_thread_t thread);
+u32_t sys_arch_thread_notify_take(int clear, u32_t timeout_ms);
+
+/* Microseconds since sys_init(), wrapping at 32 bits, for LWIP_PBUF_RX_TIME_US() */
+u32_t sys_now_us(void);
+
+#define sys_mbox_valid(x) (*(x) != NULL)
+#define sys_mbox_set_invalid(x) (*(x) = NULL)
+#define sys_sem_valid(x) (*(x) != NULL)
+#define sys_sem_set_invalid(x) (*(x) = NULL)
+#define sys_mutex_valid(x) (*(x) != NULL)
+#define sys_mutex_set_invalid(x) (*(x) = NULL)
+#endif /* !NO_SYS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SYS_POSIX_ARCH_H__ */
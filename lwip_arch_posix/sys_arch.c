@@ -0,0 +1,484 @@
+/* sys_arch.c - lwIP sys_arch on top of pthreads, for the host build (LWIP_HOST_SIM).
+ * Priorities and stack sizes are ignored: every lwIP thread is a normal pthread and Linux
+ * schedules them, so pin the process with taskset when timing it. */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lwip/opt.h"
+
+#if !NO_SYS
+
+#include "lwip/debug.h"
+#include "lwip/def.h"
+#include "lwip/stats.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include "lwip/priv/tcpip_priv.h"
+
+struct sys_arch_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    u32_t count;
+};
+
+struct sys_arch_mutex {
+    pthread_mutex_t lock;
+    pthread_t owner;        // valid while locked, for sys_check_core_locking()
+    int locked;
+};
+
+struct sys_arch_mbox {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    int size;
+    int head;
+    int count;
+    void* msgs[];
+};
+
+struct sys_arch_thread {
+    pthread_t pthread;
+    lwip_thread_fn fn;
+    void* arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    u32_t notify;
+};
+
+__thread int sys_arch_isr_nesting;
+
+static __thread struct sys_arch_thread* sys_arch_self;
+
+static pthread_mutex_t sys_arch_prot_lock;
+static pthread_once_t sys_arch_prot_once = PTHREAD_ONCE_INIT;
+
+static struct timespec sys_arch_start;
+
+/* CLOCK_MONOTONIC for all timed waits, so changing the wall clock does not disturb them */
+static void sys_arch_cond_init(pthread_cond_t* cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void sys_arch_deadline(struct timespec* ts, u32_t timeout_ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static u32_t sys_arch_elapsed_ms(const struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u32_t)((now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
+/* Wait on cond until the deadline; timeout_ms 0 waits forever as in lwIP. Returns ETIMEDOUT. */
+static int sys_arch_cond_wait(pthread_cond_t* cond, pthread_mutex_t* lock, u32_t timeout_ms,
+                              const struct timespec* deadline)
+{
+    if (timeout_ms == 0) {
+        return pthread_cond_wait(cond, lock);
+    }
+    return pthread_cond_timedwait(cond, lock, deadline);
+}
+
+err_t sys_sem_new(sys_sem_t* sem, u8_t count)
+{
+    struct sys_arch_sem* s = calloc(1, sizeof(*s));
+
+    if (s == NULL) {
+        SYS_STATS_INC(sem.err);
+        return ERR_MEM;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    sys_arch_cond_init(&s->cond);
+    s->count = count;
+    SYS_STATS_INC_USED(sem);
+    *sem = s;
+    return ERR_OK;
+}
+
+void sys_sem_signal(sys_sem_t* sem)
+{
+    struct sys_arch_sem* s = *sem;
+
+    pthread_mutex_lock(&s->lock);
+    s->count++;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+u32_t sys_arch_sem_wait(sys_sem_t* sem, u32_t timeout)
+{
+    struct sys_arch_sem* s = *sem;
+    struct timespec start, deadline;
+    u32_t ret;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sys_arch_deadline(&deadline, timeout);
+    pthread_mutex_lock(&s->lock);
+    while (s->count == 0) {
+        if (sys_arch_cond_wait(&s->cond, &s->lock, timeout, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&s->lock);
+            return SYS_ARCH_TIMEOUT;
+        }
+    }
+    s->count--;
+    pthread_mutex_unlock(&s->lock);
+    ret = sys_arch_elapsed_ms(&start);
+    return (ret == SYS_ARCH_TIMEOUT) ? ret - 1 : ret;
+}
+
+void sys_sem_free(sys_sem_t* sem)
+{
+    struct sys_arch_sem* s = *sem;
+
+    SYS_STATS_DEC(sem.used);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+err_t sys_mutex_new(sys_mutex_t* mutex)
+{
+    struct sys_arch_mutex* m = calloc(1, sizeof(*m));
+
+    if (m == NULL) {
+        SYS_STATS_INC(mutex.err);
+        return ERR_MEM;
+    }
+    pthread_mutex_init(&m->lock, NULL);
+    SYS_STATS_INC_USED(mutex);
+    *mutex = m;
+    return ERR_OK;
+}
+
+void sys_mutex_lock(sys_mutex_t* mutex)
+{
+    struct sys_arch_mutex* m = *mutex;
+
+    pthread_mutex_lock(&m->lock);
+    m->owner = pthread_self();
+    m->locked = 1;
+}
+
+void sys_mutex_unlock(sys_mutex_t* mutex)
+{
+    struct sys_arch_mutex* m = *mutex;
+
+    m->locked = 0;
+    pthread_mutex_unlock(&m->lock);
+}
+
+void sys_mutex_free(sys_mutex_t* mutex)
+{
+    struct sys_arch_mutex* m = *mutex;
+
+    SYS_STATS_DEC(mutex.used);
+    pthread_mutex_destroy(&m->lock);
+    free(m);
+}
+
+#if LWIP_TCPIP_CORE_LOCKING
+/* Unlike the target, the host always knows who holds the core lock */
+void sys_check_core_locking(void)
+{
+    LWIP_ASSERT("lwIP core called from an ISR", !sys_arch_in_isr());
+    if (lock_tcpip_core != NULL) {
+        LWIP_ASSERT("lwIP core called without the core lock",
+                    lock_tcpip_core->locked && pthread_equal(lock_tcpip_core->owner, pthread_self()));
+    }
+}
+#endif /* LWIP_TCPIP_CORE_LOCKING */
+
+err_t sys_mbox_new(sys_mbox_t* mbox, int size)
+{
+    struct sys_arch_mbox* mb;
+
+    if (size <= 0) {
+        size = 128;
+    }
+    mb = calloc(1, sizeof(*mb) + (size_t)size * sizeof(void*));
+    if (mb == NULL) {
+        SYS_STATS_INC(mbox.err);
+        return ERR_MEM;
+    }
+    pthread_mutex_init(&mb->lock, NULL);
+    sys_arch_cond_init(&mb->not_empty);
+    sys_arch_cond_init(&mb->not_full);
+    mb->size = size;
+    SYS_STATS_INC_USED(mbox);
+    *mbox = mb;
+    return ERR_OK;
+}
+
+void sys_mbox_free(sys_mbox_t* mbox)
+{
+    struct sys_arch_mbox* mb = *mbox;
+
+    if (mb->count != 0) {
+        /* Line for breakpoint.  Should never break here! */
+        SYS_STATS_INC(mbox.err);
+    }
+    SYS_STATS_DEC(mbox.used);
+    pthread_cond_destroy(&mb->not_full);
+    pthread_cond_destroy(&mb->not_empty);
+    pthread_mutex_destroy(&mb->lock);
+    free(mb);
+}
+
+static void sys_arch_mbox_put(struct sys_arch_mbox* mb, void* msg)
+{
+    mb->msgs[(mb->head + mb->count) % mb->size] = msg;
+    mb->count++;
+    pthread_cond_signal(&mb->not_empty);
+}
+
+void sys_mbox_post(sys_mbox_t* mbox, void* msg)
+{
+    struct sys_arch_mbox* mb = *mbox;
+
+    pthread_mutex_lock(&mb->lock);
+    while (mb->count == mb->size) {
+        pthread_cond_wait(&mb->not_full, &mb->lock);
+    }
+    sys_arch_mbox_put(mb, msg);
+    pthread_mutex_unlock(&mb->lock);
+}
+
+err_t sys_mbox_trypost(sys_mbox_t* mbox, void* msg)
+{
+    struct sys_arch_mbox* mb = *mbox;
+    err_t ret = ERR_OK;
+
+    pthread_mutex_lock(&mb->lock);
+    if (mb->count == mb->size) {
+        SYS_STATS_INC(mbox.err);
+        ret = ERR_MEM;
+    } else {
+        sys_arch_mbox_put(mb, msg);
+    }
+    pthread_mutex_unlock(&mb->lock);
+    return ret;
+}
+
+err_t sys_mbox_trypost_fromisr(sys_mbox_t* mbox, void* msg)
+{
+    return sys_mbox_trypost(mbox, msg);
+}
+
+static void* sys_arch_mbox_get(struct sys_arch_mbox* mb)
+{
+    void* msg = mb->msgs[mb->head];
+
+    mb->head = (mb->head + 1) % mb->size;
+    mb->count--;
+    pthread_cond_signal(&mb->not_full);
+    return msg;
+}
+
+u32_t sys_arch_mbox_fetch(sys_mbox_t* mbox, void** msg, u32_t timeout)
+{
+    struct sys_arch_mbox* mb = *mbox;
+    struct timespec start, deadline;
+    void* m;
+    u32_t ret;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sys_arch_deadline(&deadline, timeout);
+    pthread_mutex_lock(&mb->lock);
+    while (mb->count == 0) {
+        if (sys_arch_cond_wait(&mb->not_empty, &mb->lock, timeout, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&mb->lock);
+            if (msg != NULL) {
+                *msg = NULL;
+            }
+            return SYS_ARCH_TIMEOUT;
+        }
+    }
+    m = sys_arch_mbox_get(mb);
+    pthread_mutex_unlock(&mb->lock);
+    if (msg != NULL) {
+        *msg = m;
+    }
+    ret = sys_arch_elapsed_ms(&start);
+    return (ret == SYS_ARCH_TIMEOUT) ? ret - 1 : ret;
+}
+
+u32_t sys_arch_mbox_tryfetch(sys_mbox_t* mbox, void** msg)
+{
+    struct sys_arch_mbox* mb = *mbox;
+    void* m;
+
+    pthread_mutex_lock(&mb->lock);
+    if (mb->count == 0) {
+        pthread_mutex_unlock(&mb->lock);
+        return SYS_MBOX_EMPTY;
+    }
+    m = sys_arch_mbox_get(mb);
+    pthread_mutex_unlock(&mb->lock);
+    if (msg != NULL) {
+        *msg = m;
+    }
+    return 0;
+}
+
+static struct sys_arch_thread* sys_arch_thread_alloc(void)
+{
+    struct sys_arch_thread* t = calloc(1, sizeof(*t));
+
+    if (t != NULL) {
+        pthread_mutex_init(&t->lock, NULL);
+        sys_arch_cond_init(&t->cond);
+    }
+    return t;
+}
+
+static void* sys_arch_thread_main(void* arg)
+{
+    struct sys_arch_thread* t = arg;
+
+    sys_arch_self = t;
+    t->fn(t->arg);
+    return NULL;
+}
+
+sys_thread_t sys_thread_new(const char* name, lwip_thread_fn thread, void* arg, int stacksize, int prio)
+{
+    struct sys_arch_thread* t = sys_arch_thread_alloc();
+
+    LWIP_UNUSED_ARG(stacksize);
+    LWIP_UNUSED_ARG(prio);
+
+    if (t == NULL) {
+        return NULL;
+    }
+    t->fn = thread;
+    t->arg = arg;
+    if (pthread_create(&t->pthread, NULL, sys_arch_thread_main, t) != 0) {
+        free(t);
+        return NULL;
+    }
+    pthread_detach(t->pthread);
+#ifdef __GLIBC__
+    if (name != NULL) {
+        char comm[16];
+
+        /* the kernel keeps 15 characters, enough to tell the threads apart in perf and top */
+        strncpy(comm, name, sizeof(comm) - 1);
+        comm[sizeof(comm) - 1] = '\0';
+        pthread_setname_np(t->pthread, comm);
+    }
+#else
+    LWIP_UNUSED_ARG(name);
+#endif
+    return t;
+}
+
+sys_thread_t sys_arch_thread_self(void)
+{
+    if (sys_arch_self == NULL) {
+        sys_arch_self = sys_arch_thread_alloc();
+        LWIP_ASSERT("out of memory", sys_arch_self != NULL);
+        sys_arch_self->pthread = pthread_self();
+    }
+    return sys_arch_self;
+}
+
+void sys_arch_thread_notify(sys_thread_t thread)
+{
+    pthread_mutex_lock(&thread->lock);
+    thread->notify++;
+    pthread_cond_signal(&thread->cond);
+    pthread_mutex_unlock(&thread->lock);
+}
+
+/* ulTaskNotifyTake(): 0xFFFFFFFF waits forever, 0 does not wait */
+u32_t sys_arch_thread_notify_take(int clear, u32_t timeout_ms)
+{
+    struct sys_arch_thread* t = sys_arch_thread_self();
+    struct timespec deadline;
+    u32_t ret;
+
+    sys_arch_deadline(&deadline, timeout_ms);
+    pthread_mutex_lock(&t->lock);
+    while (t->notify == 0 && timeout_ms != 0) {
+        if (timeout_ms == 0xFFFFFFFFUL) {
+            pthread_cond_wait(&t->cond, &t->lock);
+        } else if (pthread_cond_timedwait(&t->cond, &t->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    ret = t->notify;
+    if (ret != 0) {
+        t->notify = clear ? 0 : ret - 1;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return ret;
+}
+
+static void sys_arch_prot_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&sys_arch_prot_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/* The target masks interrupts; here one recursive mutex keeps out every other thread, the
+ * simulated interrupt included */
+sys_prot_t sys_arch_protect(void)
+{
+    pthread_once(&sys_arch_prot_once, sys_arch_prot_init);
+    pthread_mutex_lock(&sys_arch_prot_lock);
+    return 0;
+}
+
+void sys_arch_unprotect(sys_prot_t pval)
+{
+    LWIP_UNUSED_ARG(pval);
+    pthread_mutex_unlock(&sys_arch_prot_lock);
+}
+
+void sys_init(void)
+{
+    pthread_once(&sys_arch_prot_once, sys_arch_prot_init);
+    clock_gettime(CLOCK_MONOTONIC, &sys_arch_start);
+}
+
+u32_t sys_now(void)
+{
+    return sys_arch_elapsed_ms(&sys_arch_start);
+}
+
+u32_t sys_now_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u32_t)((now.tv_sec - sys_arch_start.tv_sec) * 1000000 + (now.tv_nsec - sys_arch_start.tv_nsec) / 1000);
+}
+
+#endif /* !NO_SYS */
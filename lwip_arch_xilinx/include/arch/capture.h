@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * Copyright (C) 2007 - 2019 Xilinx, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ * Author: Adam Dunkels <adam@sics.se>
+ *
+ */
+
+
+#ifndef __ARCH_CAPTURE_H__
+#define __ARCH_CAPTURE_H__
+
+/*
+ * With LWIP_CAPTURE, network drivers mirror the frames of one netif into a
+ * trace ring: CAPTURE_RX() on every frame received, CAPTURE_TX() on every
+ * frame handed to linkoutput. While nothing is captured each of them is one
+ * compare. A classic BPF program, as printed by tcpdump -ddd, selects the
+ * frames and how much of them is kept, like with libpcap. Any number of
+ * contexts may add frames, including interrupts, without taking a lock; one
+ * task takes them out again with capture_read(), e.g. freertos/net_capture.c,
+ * which sends them to Linux.
+ */
+
+#include "lwip/opt.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+
+#ifndef LWIP_CAPTURE
+#define LWIP_CAPTURE         0
+#endif
+
+/* Size of the trace ring in bytes, a power of two */
+#ifndef CAPTURE_RING_SIZE
+#define CAPTURE_RING_SIZE    8192
+#endif
+
+/* Longest filter program accepted */
+#ifndef CAPTURE_MAX_INSNS
+#define CAPTURE_MAX_INSNS    64
+#endif
+
+/* Timestamp of captured frames in microseconds, sys_now() unless the board
+ * has something finer */
+#ifndef CAPTURE_NOW_US
+#define CAPTURE_NOW_US()     ((u64_t)sys_now() * 1000)
+#endif
+
+#define CAPTURE_DIR_RX       0
+#define CAPTURE_DIR_TX       1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One classic BPF instruction, as in struct sock_filter */
+struct capture_insn {
+	u16_t code;
+	u8_t jt;
+	u8_t jf;
+	u32_t k;
+};
+
+/* What capture_read() returns, followed by caplen bytes of the frame */
+struct capture_record {
+	u64_t ts_us;
+	u16_t caplen;
+	u16_t len;                   /* of the whole frame */
+	u8_t dir;                    /* CAPTURE_DIR_* */
+};
+
+struct capture_stats {
+	u32_t captured;              /* records added to the ring */
+	u32_t dropped;               /* frames that passed the filter but did not fit */
+};
+
+#if LWIP_CAPTURE
+
+extern struct netif *volatile capture_netif;
+
+#define CAPTURE_RX(netif, p) do { \
+                               if (capture_netif == (netif)) { \
+                                 capture_frame(p, CAPTURE_DIR_RX); \
+                               } \
+                             } while (0)
+#define CAPTURE_TX(netif, p) do { \
+                               if (capture_netif == (netif)) { \
+                                 capture_frame(p, CAPTURE_DIR_TX); \
+                               } \
+                             } while (0)
+
+/* Start capturing on netif, replacing any running capture. A program of
+ * length 0 takes every frame. At most snaplen bytes of a frame are kept, 0
+ * keeps them whole. Returns 0, or -1 if the program is invalid. */
+int capture_start(struct netif *netif, const struct capture_insn *prog, u16_t len, u16_t snaplen);
+void capture_stop(void);
+void capture_frame(struct pbuf *p, u8_t dir);
+/* Take the oldest record out of the ring. Its data goes to buf, which must
+ * hold snaplen bytes. Returns 0 if the ring is empty. */
+int capture_read(struct capture_record *rec, void *buf, u16_t size);
+void capture_get_stats(struct capture_stats *stats, int reset);
+
+#else /* LWIP_CAPTURE */
+
+#define CAPTURE_RX(netif, p)
+#define CAPTURE_TX(netif, p)
+
+#endif /* LWIP_CAPTURE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ARCH_CAPTURE_H__ */
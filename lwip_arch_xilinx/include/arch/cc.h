@@ -58,6 +58,7 @@ typedef unsigned   int    u32_t;
 typedef signed     int    s32_t;
 typedef unsigned   long long    u64_t;
 typedef signed     long long    s64_t;
+#define LWIP_HAVE_INT64 1
 
 #define S16_F "d"
 #define U16_F "d"
@@ -79,4 +80,31 @@ typedef unsigned long mem_ptr_t;
 #define LWIP_PLATFORM_ASSERT(x)
 #define LWIP_PLATFORM_DIAG(x) do { xil_printf x; } while(0)
 
+/* LWIP_TCM_HOT_PATH is set by the CMake option of the same name: the packet
+ * fast path goes to sections that lwip_tcm.ld links into the R5 TCM. */
+#if defined(LWIP_TCM_HOT_PATH) && LWIP_TCM_HOT_PATH
+#define LWIP_HOT_TEXT __attribute__((section(".lwip_hot_text")))
+#define LWIP_HOT_DATA __attribute__((section(".lwip_hot_data")))
+#endif
+
+/* LWIP_CHKSUM from sys_arch_chksum.c: NEON on the A53 (and ARMv7-A built
+ * with NEON), an LDM/ADC loop on the R5. Other CPUs use the generic
+ * LWIP_CHKSUM_ALGORITHM. */
+#ifndef SYS_ARCH_CHKSUM
+#if defined (__ARM_NEON) || defined (__arm__)
+#define SYS_ARCH_CHKSUM 1
+#else
+#define SYS_ARCH_CHKSUM 0
+#endif
+#endif
+
+#if SYS_ARCH_CHKSUM
+u16_t sys_arch_chksum(const void *dataptr, int len);
+#define LWIP_CHKSUM sys_arch_chksum
+#if LWIP_CHECKSUM_ON_COPY
+u16_t sys_arch_chksum_copy(void *dst, const void *src, u16_t len);
+#define LWIP_CHKSUM_COPY(dst, src, len) sys_arch_chksum_copy(dst, src, len)
+#endif
+#endif
+
 #endif /* __ARCH_CC_H__ */
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * Copyright (C) 2007 - 2022 Xilinx, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#ifndef __ARCH_MBEDTLS_ACCEL_H__
+#define __ARCH_MBEDTLS_ACCEL_H__
+
+/*
+ * Hardware AES and SHA for mbedTLS, used by altcp_tls_mbedtls.c and
+ * snmpv3_mbedtls.c. Include this file at the end of the mbedTLS
+ * configuration (MBEDTLS_CONFIG_FILE or MBEDTLS_USER_CONFIG_FILE), so that
+ * the library and sys_arch_mbedtls.c are built with the same ALT macros.
+ *
+ * The block functions are replaced, everything built on top of them (GCM,
+ * CCM, CBC, HMAC, the PRNG) follows without changes. On the A53 they run on
+ * the ARMv8 Crypto Extensions; the CSU AES-GCM engine cannot take additional
+ * authenticated data and is a one-shot DMA device, and the CSU hash is SHA-3
+ * only, so neither can serve a TLS record or an SNMPv3 digest. The R5 has no
+ * crypto instructions and keeps the software implementation.
+ */
+#ifndef SYS_ARCH_MBEDTLS_ACCEL
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+#define SYS_ARCH_MBEDTLS_ACCEL 1
+#else
+#define SYS_ARCH_MBEDTLS_ACCEL 0
+#endif
+#endif
+
+#if SYS_ARCH_MBEDTLS_ACCEL
+#define MBEDTLS_AES_ENCRYPT_ALT
+#define MBEDTLS_AES_DECRYPT_ALT
+#define MBEDTLS_SHA1_PROCESS_ALT
+#define MBEDTLS_SHA256_PROCESS_ALT
+#endif
+
+#endif /* __ARCH_MBEDTLS_ACCEL_H__ */
@@ -35,14 +35,85 @@
 #ifndef __ARCH_PERF_H__
 #define __ARCH_PERF_H__
 
-#define PERF_START    /* null definition */
-#define PERF_STOP(x)  /* null definition */
+/*
+ * With LWIP_PERF, PERF_START/PERF_STOP time the code between them with the
+ * CPU cycle counter. Every PERF_STOP name is a probe point that keeps a count,
+ * min/max/sum and a log2 histogram of the cycles spent, and each measurement
+ * also goes into a trace ring. Probes nest, so the time of an outer one
+ * includes that of the ones called from it. perf_init() starts the counter and
+ * must be called before the first measurement.
+ */
+
+/* Number of distinct probe names, later ones are not recorded */
+#ifndef PERF_MAX_PROBES
+#define PERF_MAX_PROBES      16
+#endif
+
+/* Entries in the trace ring, 0 keeps no trace */
+#ifndef PERF_TRACE_LEN
+#define PERF_TRACE_LEN       256
+#endif
+
+/* Histogram bucket n counts measurements of 2^n up to 2^(n+1)-1 cycles, the
+ * last one everything longer */
+#define PERF_HIST_BUCKETS    24
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Current value of the free running cycle counter, override for other CPUs */
+#ifndef PERF_CYCLES
+#if defined(__aarch64__)
+static inline u32_t perf_cycles(void)
+{
+	u64_t v;
+	__asm__ volatile ("mrs %0, pmccntr_el0" : "=r" (v));
+	return (u32_t)v;
+}
+#elif defined(__arm__)
+static inline u32_t perf_cycles(void)
+{
+	u32_t v;
+	__asm__ volatile ("mrc p15, 0, %0, c9, c13, 0" : "=r" (v));
+	return v;
+}
+#else
+#error "arch/perf.h: define PERF_CYCLES() for this CPU"
+#endif
+#define PERF_CYCLES()        perf_cycles()
+#endif
+
+#define PERF_START           u32_t perf_start_cycles = PERF_CYCLES()
+#define PERF_STOP(x)         do { \
+                               static u8_t perf_probe_id; \
+                               perf_record(&perf_probe_id, x, perf_start_cycles); \
+                             } while (0)
+
+struct perf_probe {
+	const char *name;
+	u32_t count;
+	u32_t min;
+	u32_t max;
+	u64_t sum;
+	u32_t hist[PERF_HIST_BUCKETS];
+};
+
+struct perf_trace_entry {
+	u32_t start;                 /* cycle counter at PERF_START */
+	u32_t cycles;
+	u8_t probe;                  /* index for perf_get_probe() */
+};
+
 void perf_init(char *fname);
+void perf_record(u8_t *id, const char *name, u32_t start);
+void perf_reset(void);
+/* Copy probe index out, returns 0 if there is none */
+int perf_get_probe(u8_t index, struct perf_probe *out);
+/* Copy up to max trace entries, oldest first, starting at *pos (0 for the
+ * oldest one kept). *pos is advanced past the entries returned; entries
+ * already overwritten are skipped. Returns the number copied. */
+u32_t perf_get_trace(u32_t *pos, struct perf_trace_entry *out, u32_t max);
 
 #ifdef __cplusplus
 }
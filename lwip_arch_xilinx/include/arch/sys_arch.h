@@ -60,6 +60,197 @@ typedef xTaskHandle sys_thread_t;
 
 typedef unsigned long sys_prot_t;
 
+/* Make SYS_ARCH_PROTECT safe with lwIP running on several cores at once
+ * (FreeRTOS SMP on the A53 cluster): the interrupt mask is paired with a
+ * spinlock, and the SYS_ARCH_INC/DEC/GET/SET counters (pbuf refs, netconn
+ * recv_avail) become atomics that do not take it. */
+#ifndef SYS_ARCH_PROTECT_SMP
+#define SYS_ARCH_PROTECT_SMP 0
+#endif
+
+#if SYS_ARCH_PROTECT_SMP
+#if !defined (__aarch64__) && !defined (__arm__)
+#error "SYS_ARCH_PROTECT_SMP is only implemented for ARM"
+#endif
+#define SYS_ARCH_INC(var, val)	((void)__atomic_add_fetch(&(var), (val), __ATOMIC_RELAXED))
+#define SYS_ARCH_DEC(var, val)	((void)__atomic_sub_fetch(&(var), (val), __ATOMIC_ACQ_REL))
+#define SYS_ARCH_DEC_FETCH(var, val, ret)	((ret) = __atomic_sub_fetch(&(var), (val), __ATOMIC_ACQ_REL))
+#define SYS_ARCH_GET(var, ret)	((ret) = __atomic_load_n(&(var), __ATOMIC_ACQUIRE))
+#define SYS_ARCH_SET(var, val)	__atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+
+#include "xpseudo_asm.h"
+/* The core this runs on: Aff0 of the MPIDR, also used for LWIP_STATS_CORE_ID() */
+static inline u32_t sys_arch_core_id( void )
+{
+#ifdef __aarch64__
+	return (u32_t)(mfcp(MPIDR_EL1) & 0xFFU);
+#else
+	return (u32_t)(mfcp(XREG_CP15_MULTI_PROC_AFFINITY) & 0xFFU);
+#endif
+}
+#endif /* SYS_ARCH_PROTECT_SMP */
+
+/* sys_arch_in_isr(): lwIP is being called from an interrupt handler, so
+ * sys_arch has to use the FromISR calls. On ARM this comes from the CPU state:
+ * FreeRTOS tasks run on SP_EL0 (A53) or in System mode (R5), its IRQ handler on
+ * SP_ELx or in IRQ/Supervisor mode. Other CPUs still rely on the drivers
+ * counting their way in and out of xInsideISR. */
+#if defined (__aarch64__)
+#include "xpseudo_asm.h"
+static inline int sys_arch_in_isr( void )
+{
+	/* main() runs on SP_ELx too before the scheduler starts */
+	return ( ( mfcp( SPSel ) & 1U ) != 0U ) &&
+		( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED );
+}
+#elif defined (__arm__)
+#include "xpseudo_asm.h"
+static inline int sys_arch_in_isr( void )
+{
+	unsigned long ulMode = mfcpsr() & 0x1FU;
+
+	return ( ulMode != 0x1FU ) && ( ulMode != 0x10U );
+}
+#else
+extern u32 xInsideISR;
+#define sys_arch_in_isr()	( xInsideISR != 0 )
+#endif
+
+/* Create mailboxes, semaphores, mutexes and threads with the FreeRTOS *Static
+ * calls, from pools in sys_arch.c sized by the SYS_ARCH_STATIC_* options,
+ * instead of from the FreeRTOS heap. Needs configSUPPORT_STATIC_ALLOCATION. */
+#ifndef SYS_ARCH_STATIC_ALLOC
+#define SYS_ARCH_STATIC_ALLOC 0
+#endif
+
+#if SYS_ARCH_STATIC_ALLOC && !configSUPPORT_STATIC_ALLOCATION
+#error "SYS_ARCH_STATIC_ALLOC needs configSUPPORT_STATIC_ALLOCATION in FreeRTOSConfig.h"
+#endif
+
+/* sys_now() reads XTime_GetTime() instead of the FreeRTOS tick count */
+#ifndef SYS_ARCH_NOW_XTIME
+#define SYS_ARCH_NOW_XTIME 0
+#endif
+
+/* Free-running microseconds from XTime whatever SYS_ARCH_NOW_XTIME is, wrapping
+ * at 32 bits; the clock behind LWIP_PBUF_RX_TIME_US() */
+u32_t sys_now_us( void );
+
+/* Statistics per mailbox, semaphore and mutex: mailbox high-water marks and
+ * failed posts, and a histogram of the time threads block in fetch, sem wait
+ * and mutex lock, measured with XTime. Objects are counted together by type,
+ * size and the name of the task that created them, so the recvmboxes of all
+ * netconns a task opens share one entry. The entry is found through the
+ * FreeRTOS queue number, which needs configUSE_TRACE_FACILITY. */
+#ifndef SYS_ARCH_STATS
+#define SYS_ARCH_STATS 0
+#endif
+
+#if SYS_ARCH_STATS
+#if !configUSE_TRACE_FACILITY
+#error "SYS_ARCH_STATS needs configUSE_TRACE_FACILITY in FreeRTOSConfig.h"
+#endif
+
+#ifndef SYS_ARCH_STATS_NUM
+#define SYS_ARCH_STATS_NUM 16	/* entries; objects created once it is full are not counted */
+#endif
+#define SYS_ARCH_STATS_HIST 8	/* wait time buckets: < 4 us, < 16 us, ... < 16 ms, longer */
+
+#define SYS_ARCH_STATS_MBOX		0
+#define SYS_ARCH_STATS_SEM		1
+#define SYS_ARCH_STATS_MUTEX	2
+
+struct sys_arch_stats
+{
+	char name[configMAX_TASK_NAME_LEN];	/* creating task, "main" before the scheduler runs */
+	uint8_t type;						/* SYS_ARCH_STATS_MBOX/SEM/MUTEX */
+	uint16_t size;						/* mailbox depth, 0 for semaphores and mutexes */
+	uint32_t created;
+	uint32_t max_used;					/* mailbox high-water mark */
+	uint32_t full;						/* failed sys_mbox_trypost() calls */
+	uint32_t waits;						/* blocking fetch/wait/lock calls */
+	uint32_t timeouts;
+	uint32_t wait_max_us;
+	uint64_t wait_total_us;
+	uint32_t hist[SYS_ARCH_STATS_HIST];
+};
+
+int sys_arch_stats_get( int iIndex, struct sys_arch_stats *pxStats );
+void sys_arch_stats_reset( void );
+void sys_arch_stats_dump( void );
+#endif /* SYS_ARCH_STATS */
+
+#if MEMP_MAGAZINE
+/* A thread's memp magazine is kept in one of its FreeRTOS thread local
+ * storage pointers. Interrupts, and main() before the scheduler runs, have none. */
+#ifndef SYS_ARCH_MEMP_MAGAZINE_TLS_INDEX
+#define SYS_ARCH_MEMP_MAGAZINE_TLS_INDEX 0
+#endif
+
+#if SYS_ARCH_MEMP_MAGAZINE_TLS_INDEX >= configNUM_THREAD_LOCAL_STORAGE_POINTERS
+#error "MEMP_MAGAZINE needs configNUM_THREAD_LOCAL_STORAGE_POINTERS > SYS_ARCH_MEMP_MAGAZINE_TLS_INDEX"
+#endif
+
+struct memp_magazine;
+static inline struct memp_magazine *sys_arch_memp_magazine_get( void )
+{
+	if( ( xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED ) || sys_arch_in_isr() )
+	{
+		return NULL;
+	}
+	return ( struct memp_magazine * ) pvTaskGetThreadLocalStoragePointer( NULL, SYS_ARCH_MEMP_MAGAZINE_TLS_INDEX );
+}
+
+#define LWIP_MEMP_MAGAZINE_GET()		sys_arch_memp_magazine_get()
+#define LWIP_MEMP_MAGAZINE_SET( mag )	vTaskSetThreadLocalStoragePointer( NULL, SYS_ARCH_MEMP_MAGAZINE_TLS_INDEX, ( mag ) )
+#endif /* MEMP_MAGAZINE */
+
+#if LWIP_NETCONN_SEM_PER_THREAD
+/* The per-thread netconn semaphore is the thread's FreeRTOS task notification
+ * (ulTaskNotifyTake/xTaskNotifyGive), so a thread using the sequential or
+ * socket API must not use its notification value for anything else. */
+#ifndef SYS_ARCH_NETCONN_SEM_NUM
+#define SYS_ARCH_NETCONN_SEM_NUM 8	/* threads using netconn/sockets at once */
+#endif
+
+sys_sem_t *sys_arch_netconn_sem_get(void);
+void sys_arch_netconn_sem_alloc(void);
+void sys_arch_netconn_sem_free(void);
+
+#define LWIP_NETCONN_THREAD_SEM_GET()	sys_arch_netconn_sem_get()
+#define LWIP_NETCONN_THREAD_SEM_ALLOC()	sys_arch_netconn_sem_alloc()
+#define LWIP_NETCONN_THREAD_SEM_FREE()	sys_arch_netconn_sem_free()
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+/* Netconn recvmboxes and acceptmboxes become a ring of pointers under
+ * SYS_ARCH_PROTECT, with the reading thread woken through its task
+ * notification, instead of a FreeRTOS queue and its event lists. TCP data posted while earlier data still
+ * waits in the ring is chained to it, so that a slow reader fetches one entry
+ * per burst rather than one per segment. The ring only keeps one reader
+ * blocked at a time, which rules out LWIP_NETCONN_FULLDUPLEX, and rings are
+ * not counted by SYS_ARCH_STATS. The notification is shared with
+ * LWIP_NETCONN_SEM_PER_THREAD, never given when nobody waits. */
+#ifndef SYS_ARCH_MBOX_RING
+#define SYS_ARCH_MBOX_RING 0
+#endif
+
+#if SYS_ARCH_MBOX_RING
+#if defined( LWIP_NETCONN_FULLDUPLEX ) && LWIP_NETCONN_FULLDUPLEX
+#error "SYS_ARCH_MBOX_RING cannot wake several threads waiting on one recvmbox, as LWIP_NETCONN_FULLDUPLEX needs"
+#endif
+
+#include "lwip/err.h"
+
+struct pbuf;
+
+err_t sys_arch_mbox_new_ring( sys_mbox_t *pxMailBox, int iSize );
+err_t sys_arch_mbox_trypost_pbuf( sys_mbox_t *pxMailBox, struct pbuf *pxBuf, u8_t *pucMerged );
+
+#define sys_mbox_new_recv( pxMailBox, iSize )					sys_arch_mbox_new_ring( pxMailBox, iSize )
+#define sys_mbox_new_accept( pxMailBox, iSize )					sys_arch_mbox_new_ring( pxMailBox, iSize )
+#define sys_mbox_trypost_pbuf( pxMailBox, pxBuf, pucMerged )	sys_arch_mbox_trypost_pbuf( pxMailBox, pxBuf, pucMerged )
+#endif /* SYS_ARCH_MBOX_RING */
+
 #define sys_mbox_valid( x ) ( ( ( *x ) == NULL) ? pdFALSE : pdTRUE )
 #define sys_mbox_set_invalid( x ) ( ( *x ) = NULL )
 #define sys_sem_valid( x ) ( ( ( *x ) == NULL) ? pdFALSE : pdTRUE )
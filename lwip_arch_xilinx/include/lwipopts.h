@@ -34,47 +34,164 @@
 #ifndef __LWIPOPTS_H__
 #define __LWIPOPTS_H__
 
+/* Profiles are sets of the tuning options below chosen together for one goal, see
+ * lwipopts_profile_*.h. CMake selects one with its LWIP_PROFILE cache variable; options a
+ * profile leaves out keep the values here. LWIP_TCP_SMALL_WINDOW is the old name of the low
+ * memory profile. */
+#define LWIP_PROFILE_DEFAULT         0
+#define LWIP_PROFILE_LOW_LATENCY     1
+#define LWIP_PROFILE_HIGH_THROUGHPUT 2
+#define LWIP_PROFILE_LOW_MEMORY      3
+
+#ifndef LWIP_PROFILE
+#ifdef LWIP_TCP_SMALL_WINDOW
+#define LWIP_PROFILE LWIP_PROFILE_LOW_MEMORY
+#else
+#define LWIP_PROFILE LWIP_PROFILE_DEFAULT
+#endif
+#endif
+
+#if LWIP_PROFILE == LWIP_PROFILE_LOW_LATENCY
+#include "lwipopts_profile_low_latency.h"
+#elif LWIP_PROFILE == LWIP_PROFILE_HIGH_THROUGHPUT
+#include "lwipopts_profile_high_throughput.h"
+#elif LWIP_PROFILE == LWIP_PROFILE_LOW_MEMORY
+#include "lwipopts_profile_low_memory.h"
+#elif LWIP_PROFILE != LWIP_PROFILE_DEFAULT
+#error "unknown LWIP_PROFILE"
+#endif
+
 #define SYS_LIGHTWEIGHT_PROT 1
 
 
 #define NO_SYS_NO_TIMERS 1
+/* sys_timeout()/sys_untimeout() in constant time through a timer wheel */
+#define LWIP_TIMERS_WHEEL 1
 
 #define DEFAULT_THREAD_PRIO 2
 #define TCPIP_THREAD_PRIO (2 + 1)
 #define TCPIP_THREAD_STACKSIZE (16*1024)
+#ifndef DEFAULT_TCP_RECVMBOX_SIZE
 #define DEFAULT_TCP_RECVMBOX_SIZE 	200
-#define DEFAULT_ACCEPTMBOX_SIZE 	5
+#endif
+/* room for every pcb, so a burst of accepted connections never finds the acceptmbox full */
+#define DEFAULT_ACCEPTMBOX_SIZE 	MEMP_NUM_TCP_PCB
+#ifndef TCPIP_MBOX_SIZE
 #define TCPIP_MBOX_SIZE		200
+#endif
+#ifndef DEFAULT_UDP_RECVMBOX_SIZE
 #define DEFAULT_UDP_RECVMBOX_SIZE 	100
+#endif
 #define DEFAULT_RAW_RECVMBOX_SIZE	30
 #define LWIP_COMPAT_MUTEX 0
+
+/* Other tasks call into the stack under a priority-inheriting mutex, instead of posting a message
+ * to tcpip_thread and waiting for it to get scheduled */
+#define LWIP_TCPIP_CORE_LOCKING 1
+/* tcpip_input() runs ethernet_input() in the caller's task under the core lock. Inputs must then
+ * never be called from an ISR; for rpmsg_eth that means RPMSG_ETH_RX_THREAD, or dispatching
+ * vring notifications from a task. */
+#ifndef LWIP_TCPIP_CORE_LOCKING_INPUT
+#define LWIP_TCPIP_CORE_LOCKING_INPUT 0
+#endif
+/* Queued RX packets get their own mailbox, so callbacks posted to tcpip_thread don't wait
+ * behind a burst of frames */
+#if !LWIP_TCPIP_CORE_LOCKING_INPUT
+#define TCPIP_MBOX_BULK 1
+#endif
+
+/* catch calls into the core from an ISR or without the core lock */
+#if LWIP_TCPIP_CORE_LOCKING && !defined(__ASSEMBLER__)
+void sys_check_core_locking(void);
+#define LWIP_ASSERT_CORE_LOCKED() sys_check_core_locking()
+#endif
 #define LWIP_ALLOW_MEM_FREE_FROM_OTHER_CONTEXT 1
 
 #define LWIP_TCP_KEEPALIVE 0
 
-#define MEM_ALIGNMENT 64
+/* Only the DMA receive buffers need cache line alignment: the pool pbufs keep their payload in
+ * separate 64 byte aligned buffers, so the struct pbufs, memp elements and heap blocks are not
+ * padded to a cache line */
+#define MEM_ALIGNMENT 8
+#define PBUF_POOL_PAYLOAD_ALIGNMENT 64
+#ifndef MEM_SIZE
 #define MEM_SIZE 131072
+#endif
+/* leave the pools untouched in memp_init() and carve elements on first use, so the netif is
+ * registered and the host's hello answered without first walking every pool in DDR */
+#define MEMP_LAZY_INIT 1
 #define MEMP_NUM_PBUF 16
-#define MEMP_NUM_UDP_PCB 4
+#define MEMP_NUM_UDP_PCB 16
+#ifndef MEMP_NUM_TCP_PCB
 #define MEMP_NUM_TCP_PCB 32
+#endif
 #define MEMP_NUM_TCP_PCB_LISTEN 8
-#define MEMP_NUM_TCP_SEG 256
-#define MEMP_NUM_SYS_TIMEOUT 8
+/* demultiplex incoming segments through a hash table instead of the pcb lists */
+#define TCP_PCB_HASH 1
+#define TCP_PCB_HASH_SIZE 64
+/* closed HTTP/CGI connections wait out TIME-WAIT as compact records, not pcbs */
+#define TCP_TW_COMPACT 1
+#define MEMP_NUM_TCP_TW 64
+/* run the TCP timer only while a connection needs it, so idle ones let the core sleep */
+#define TCP_TMR_COALESCE 1
+/* netifs can ACK less than every second segment (netif_set_ack_stretch()); the rpmsg link does */
+#define TCP_ACK_STRETCH 1
+#ifndef MEMP_NUM_TCP_SEG
+/* a full send queue plus a receive window of out-of-sequence segments, for two connections */
+#define MEMP_NUM_TCP_SEG (TCP_SND_QUEUELEN + 2 * (TCP_WND / TCP_MSS))
+#endif
+#define MEMP_NUM_SYS_TIMEOUT (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 8)
 #define MEMP_NUM_NETBUF 8
 #define MEMP_NUM_NETCONN 16
 #define MEMP_NUM_TCPIP_MSG_API 16
+#ifndef MEMP_NUM_TCPIP_MSG_INPKT
 #define MEMP_NUM_TCPIP_MSG_INPKT 64
-
-#define MEMP_NUM_NETBUF     8
-#define MEMP_NUM_NETCONN    16
+#endif
+/* the host build uses the C library's errno, see lwip_arch_posix/include/arch/cc.h */
+#ifndef LWIP_HOST_SIM
 #define LWIP_PROVIDE_ERRNO  1
-#define MEMP_NUM_SYS_TIMEOUT 8
+#endif
+
+#ifndef PBUF_POOL_SIZE
+/* 256 pool pbufs hold the 64 KB receive windows of a few connections, out-of-sequence
+ * segments included */
 #define PBUF_POOL_SIZE 256
+#endif
 #define PBUF_POOL_BUFSIZE 1700
+/* ARP, bare TCP ACKs and the short messages of the rpmsg link take 256 and 512 byte
+ * pbufs instead of pinning 1700 bytes each */
+#ifndef PBUF_POOL_SMALL_SIZE
+#define PBUF_POOL_SMALL_SIZE 128
+#endif
+#ifndef PBUF_POOL_MEDIUM_SIZE
+#define PBUF_POOL_MEDIUM_SIZE 64
+#endif
 #define PBUF_LINK_HLEN 16
+/* room for the rpmsg_eth link header and flow hash in front of a frame, so that a frame
+ * built in one pbuf is sent from where it lies instead of being staged first */
+#define PBUF_LINK_ENCAPSULATION_HLEN 8
+/* Applications running SNTP set LWIP_PBUF_RX_TIMESTAMP to 1: the netifs then stamp
+ * received frames with the microsecond clock of sys_arch rather than sys_now() */
+#define LWIP_PBUF_RX_TIME_US() sys_now_us()
+/* lwIP on all four A53s (SYS_ARCH_PROTECT_SMP): count the protocol stats per core */
+#if defined(SYS_ARCH_PROTECT_SMP) && SYS_ARCH_PROTECT_SMP
+#define LWIP_STATS_CORES 4
+#define LWIP_STATS_CORE_ID() sys_arch_core_id()
+#endif
 
 #define ARP_TABLE_SIZE 10
 #define ARP_QUEUEING 1
+/* find ARP entries through a hash table, and let every pcb remember its own entry */
+#define ETHARP_TABLE_HASH 1
+#define ETHARP_TABLE_HASH_SIZE 16
+#define LWIP_NETIF_HWADDRHINT 1
+/* tcp_output() and ip4_frag() hand their frames to the driver in bursts */
+#define LWIP_NETIF_LINKOUTPUT_BURST 1
+/* tasks on this core reach each other over 127.0.0.1: the loop netif skips checksums and
+ * passes payload by reference, copying only the headers */
+#define LWIP_NETIF_LOOPBACK 1
+#define LWIP_NETIF_LOOPBACK_ZEROCOPY 1
+#define MEMP_NUM_LOOP_PBUF 64
 
 #define ICMP_TTL 255
 
@@ -82,35 +199,98 @@
 #define IP_FORWARD 0
 #define IP_REASSEMBLY 1
 #define IP_FRAG 1
+#ifndef IP_REASS_MAX_PBUFS
 #define IP_REASS_MAX_PBUFS 128
+#endif
+/* cap queued fragment payload at one maximum-size datagram, the oldest
+ * incomplete datagrams are dropped first */
+#define IP_REASS_MAX_BYTES 65535
+#ifdef USE_JUMBO_FRAMES
+#define IP_FRAG_MAX_MTU 9000
+#else
 #define IP_FRAG_MAX_MTU 1500
+#endif
 #define IP_DEFAULT_TTL 255
 #define LWIP_CHKSUM_ALGORITHM 3
 
 #define LWIP_UDP 1
 #define UDP_TTL 255
 #define LWIP_UDP_OPT_BLOCK_TX_TILL_COMPLETE 0
+/* udp_input() only scans the pcbs bound to the destination port */
+#define UDP_PCB_HASH 1
+#define UDP_PCB_HASH_SIZE 16
+/* lwip_recv_pbuf(): bulk receivers take the rx pbufs instead of a copy */
+#define LWIP_SOCKET_RECV_PBUF 1
+/* epoll_wait(): tasks serving many sockets only visit the ready ones */
+#define LWIP_SOCKET_EPOLL 1
+/* MSG_ZEROCOPY: large frames are queued from the caller's buffer and reported once acked */
+#define LWIP_NETCONN_ZEROCOPY 1
+/* completion queue netconn API: one event-loop task drives many connections */
+#define LWIP_NETCONN_ASYNC 1
 
 #define LWIP_TCP 1
+#ifdef USE_JUMBO_FRAMES
+/* segments fill the 9000 byte GEM MTU */
+#define TCP_MSS 8960
+#else
 #define TCP_MSS 1460
-#define TCP_SND_BUF 8192
-#define TCP_WND 2048
+#endif
+/* Bulk transfers to the host need a window covering the rpmsg link's bandwidth-delay
+ * product, where the delay is mostly the Linux workqueue latency: 64 KB each way, with
+ * window scaling for the receive side. */
+#ifndef TCP_WND
+#define LWIP_WND_SCALE 1
+#define TCP_RCV_SCALE 1
+#define TCP_WND (64 * 1024)
+#define TCP_SND_BUF (64 * 1024)
+/* writable again (select, poll) once more than a quarter of it is free: the lwIP default of half
+ * fails the init.c sanity check with jumbo segments */
+#define TCP_SNDLOWAT (TCP_SND_BUF / 4)
+#endif
 #define TCP_TTL 255
 #define TCP_MAXRTX 12
 #define TCP_SYNMAXRTX 4
 #define TCP_QUEUE_OOSEQ 1
-#define TCP_SND_QUEUELEN   16 * TCP_SND_BUF/TCP_MSS
+/* one connection behind a lossy link may pin at most half a window of pool pbufs out of order */
+#define TCP_OOSEQ_MAX_BYTES (TCP_WND / 2)
+/* SACK both ways: frames dropped in bursts on a full vring are retransmitted within a round
+ * trip instead of one per fast retransmit or RTO */
+#define LWIP_TCP_SACK_OUT 1
+#define LWIP_TCP_SACK_IN 1
+/* tcp_set_cc(): tcp_cc_local for connections over rpmsg, tcp_cc_cubic over the EMAC */
+#define LWIP_TCP_CC 1
+/* TCP_AUTOCORK for TCP_NODELAY sockets that send a message in many small writes */
+#define LWIP_TCP_AUTOCORK 1
+/* SYN cookies once no pcb is left, a SYN flood then cannot lock out new connections */
+#define LWIP_TCP_SYN_COOKIES 1
+#ifndef TCP_SND_QUEUELEN
+/* room for a header pbuf and a payload pbuf or two per segment */
+#define TCP_SND_QUEUELEN (4 * TCP_SND_BUF / TCP_MSS)
+#endif
 #define CHECKSUM_GEN_TCP 	1
 #define CHECKSUM_GEN_UDP 	1
 #define CHECKSUM_GEN_IP  	1
-#define CHECKSUM_CHECK_TCP  0
-#define CHECKSUM_CHECK_UDP  0
-#define CHECKSUM_CHECK_IP 	0
+#define CHECKSUM_CHECK_TCP  1
+#define CHECKSUM_CHECK_UDP  1
+#define CHECKSUM_CHECK_IP 	1
+/* checksums are compiled in and each netif (GEM, AXI Ethernet, rpmsg_eth) turns off
+ * the ones its hardware or peer already covers */
+#define LWIP_CHECKSUM_CTRL_PER_NETIF 1
+/* tcp_write() and the socket send calls sum the payload while copying it in
+ * (LWIP_CHKSUM_COPY), instead of walking it again when the segment goes out or
+ * is retransmitted. Skipped for a netif that does not generate TCP checksums. */
+#define LWIP_CHECKSUM_ON_COPY 1
 #define LWIP_FULL_CSUM_OFFLOAD_RX  1
 #define LWIP_FULL_CSUM_OFFLOAD_TX  1
 
 #define MEMP_SEPARATE_POOLS 1
+#ifndef MEMP_NUM_FRAG_PBUF
 #define MEMP_NUM_FRAG_PBUF 256
+#endif
+/* fragment headers come from their own pool, not the heap */
+#ifndef MEMP_NUM_FRAG_HDR
+#define MEMP_NUM_FRAG_HDR 64
+#endif
 #define IP_OPTIONS_ALLOWED 0
 #define TCP_OVERSIZE TCP_MSS
 
@@ -119,9 +299,33 @@
 
 #define CONFIG_LINKSPEED_AUTODETECT 1
 
+/* assertions and the debug message framework; the tuned profiles leave them out */
+#if LWIP_PROFILE == LWIP_PROFILE_DEFAULT
 #define LWIP_DEBUG 1
+#endif
 #define NETIF_DEBUGF         LWIP_DBG_OFF
 #define UDP_DEBUG            LWIP_DBG_OFF
 #define IP_DEBUG             LWIP_DBG_OFF
 #define ETHARP_DEBUG         LWIP_DBG_OFF
+
+/* Invariants between the options above that init.c does not check. They hold for every
+ * profile, and keep one that is edited from silently losing what it was tuned for. */
+#if TCP_WND < 2 * TCP_MSS
+#error "TCP_WND must hold two segments, or the peer's delayed ACKs stall every transfer"
+#endif
+#if (TCP_WND / TCP_MSS + 1) * ((TCP_MSS + 40 + PBUF_LINK_HLEN + PBUF_POOL_BUFSIZE - 1) / PBUF_POOL_BUFSIZE) > PBUF_POOL_SIZE
+#error "PBUF_POOL_SIZE cannot hold a full TCP receive window"
+#endif
+#if MEMP_NUM_TCP_SEG < TCP_SND_QUEUELEN + TCP_WND / TCP_MSS
+#error "MEMP_NUM_TCP_SEG must cover a full send queue and a window of out-of-sequence segments"
+#endif
+#if DEFAULT_TCP_RECVMBOX_SIZE < TCP_WND / TCP_MSS
+#error "DEFAULT_TCP_RECVMBOX_SIZE must take a receive window of segments"
+#endif
+#if MEM_SIZE < 2 * TCP_SND_BUF
+#error "MEM_SIZE must hold the send buffer of two connections"
+#endif
+#if TCPIP_MBOX_SIZE < MEMP_NUM_TCPIP_MSG_INPKT
+#error "TCPIP_MBOX_SIZE must take every queued input packet"
+#endif
 #endif /* __LWIPOPTS_H__ */
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2007 - 2019 Xilinx, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#ifndef __LWIPOPTS_PROFILE_HIGH_THROUGHPUT_H__
+#define __LWIPOPTS_PROFILE_HIGH_THROUGHPUT_H__
+
+/* LWIP_PROFILE_HIGH_THROUGHPUT: bulk TCP transfers over the rpmsg link and the EMAC.
+ *
+ * 128 KB windows and send buffers each way, twice the default, cover the bandwidth-delay
+ * product of the link when the Linux side's workqueue adds a millisecond or more. The pbuf
+ * pool, segment pool and heap grow to match. The rpmsg_eth RX task feeds the stack in batches
+ * under the core lock, and merges in-order segments of one connection (RPMSG_ETH_RX_GRO) before
+ * they reach tcp_input(); a longer TX queue rides out short stalls of the host.
+ *
+ * Benchmark: build freertos/net_bench.c into the firmware and run
+ *   linux/bench/rpmsg_bench -m throughput > high_throughput.json
+ * on the host, together with iperf3 -c against freertos/iperf_bench.c for TCP, then compare
+ * with the default profile using rpmsg_bench -b. */
+
+#define LWIP_TCPIP_CORE_LOCKING_INPUT 1
+#define RPMSG_ETH_RX_THREAD 1
+#define RPMSG_ETH_TX_QUEUE_LEN 64
+
+#define LWIP_WND_SCALE 1
+#define TCP_RCV_SCALE 2
+#define TCP_WND (128 * 1024)
+#define TCP_SND_BUF (128 * 1024)
+/* an eighth: init.c wants it 4 jumbo segments below 64 KB */
+#define TCP_SNDLOWAT (TCP_SND_BUF / 8)
+
+#define MEM_SIZE (512 * 1024)
+#define PBUF_POOL_SIZE 384
+#define TCPIP_MBOX_SIZE 256
+#define MEMP_NUM_TCPIP_MSG_INPKT 128
+#define DEFAULT_TCP_RECVMBOX_SIZE 256
+
+#endif /* __LWIPOPTS_PROFILE_HIGH_THROUGHPUT_H__ */
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2007 - 2019 Xilinx, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#ifndef __LWIPOPTS_PROFILE_LOW_LATENCY_H__
+#define __LWIPOPTS_PROFILE_LOW_LATENCY_H__
+
+/* LWIP_PROFILE_LOW_LATENCY: request/response and control traffic over the rpmsg link.
+ *
+ * Received frames reach the stack without a hop through tcpip_thread: the rpmsg_eth RX task
+ * runs ethernet_input() itself under the core lock, and applications can claim UDP ports with
+ * rpmsg_eth_udp_claim() to skip the stack altogether. Send buffers and mailboxes are a few
+ * segments deep, so a bulk transfer sharing the link queues little in front of a request; a
+ * receive window of 8 segments still keeps one connection streaming.
+ *
+ * Benchmark: build freertos/net_bench.c into the firmware and run
+ *   linux/bench/rpmsg_bench -m latency > low_latency.json
+ * on the host, then the same with the default profile, and compare the p50/p99 round trips
+ * with rpmsg_bench -b. */
+
+#define LWIP_TCPIP_CORE_LOCKING_INPUT 1
+#define RPMSG_ETH_RX_THREAD 1
+#define RPMSG_ETH_RX_BATCH 4
+#define RPMSG_ETH_EARLY_DEMUX 1
+
+#define LWIP_WND_SCALE 1
+#define TCP_RCV_SCALE 1
+#define TCP_WND (8 * TCP_MSS)
+#define TCP_SND_BUF (4 * TCP_MSS)
+
+#define TCPIP_MBOX_SIZE 64
+#define MEMP_NUM_TCPIP_MSG_INPKT 32
+#define DEFAULT_TCP_RECVMBOX_SIZE 32
+#define DEFAULT_UDP_RECVMBOX_SIZE 32
+
+#define PBUF_POOL_SIZE 128
+
+#endif /* __LWIPOPTS_PROFILE_LOW_LATENCY_H__ */
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2007 - 2019 Xilinx, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#ifndef __LWIPOPTS_PROFILE_LOW_MEMORY_H__
+#define __LWIPOPTS_PROFILE_LOW_MEMORY_H__
+
+/* LWIP_PROFILE_LOW_MEMORY: a few connections on a core with little RAM to spare, what
+ * LWIP_TCP_SMALL_WINDOW used to select.
+ *
+ * Windows and send buffers of 4 segments, and pools and mailboxes sized for 8 connections,
+ * cut the heap and the pbuf pool to a fraction of the default. Throughput of one connection
+ * is bounded by 4 segments per round trip.
+ *
+ * Benchmark: build freertos/net_bench.c into the firmware and run
+ *   linux/bench/rpmsg_bench > low_memory.json
+ * on the host, compare with the default profile using rpmsg_bench -b, and compare the size of
+ * the .bss and .data output sections of both builds. */
+
+#define TCP_WND (4 * TCP_MSS)
+#define TCP_SND_BUF (4 * TCP_MSS)
+#define TCP_SND_QUEUELEN (4 * TCP_SND_BUF / TCP_MSS)
+#define MEMP_NUM_TCP_SEG (TCP_SND_QUEUELEN + 2 * (TCP_WND / TCP_MSS))
+
+#define MEM_SIZE (2 * TCP_SND_BUF + 16 * 1024)
+#define MEMP_NUM_TCP_PCB 8
+#define PBUF_POOL_SIZE 32
+#define PBUF_POOL_SMALL_SIZE 32
+#define PBUF_POOL_MEDIUM_SIZE 16
+#define IP_REASS_MAX_PBUFS 16
+#define MEMP_NUM_FRAG_PBUF 32
+#define MEMP_NUM_FRAG_HDR 8
+
+#define TCPIP_MBOX_SIZE 32
+#define MEMP_NUM_TCPIP_MSG_INPKT 16
+#define DEFAULT_TCP_RECVMBOX_SIZE 16
+#define DEFAULT_UDP_RECVMBOX_SIZE 16
+
+#endif /* __LWIPOPTS_PROFILE_LOW_MEMORY_H__ */
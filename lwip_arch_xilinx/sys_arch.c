@@ -51,12 +51,640 @@
 #include "lwip/def.h"
 #include "lwip/sys.h"
 #include "lwip/mem.h"
+#include "lwip/pbuf.h"
 #include "lwip/stats.h"
+#include "lwip/tcpip.h"
 
-/* Very crude mechanism used to determine if the critical section handling
-functions are being called from an interrupt context or not.  This relies on
-the interrupt handler setting this variable manually. */
-extern u32 xInsideISR;
+#include "xtime_l.h"
+
+#if SYS_ARCH_STATS
+#include <string.h>
+#endif
+
+/* Round timeouts up to whole ticks. Rounding down turned a timeout shorter
+ * than a tick into a poll, and tcpip_thread then spun until the next lwIP
+ * timer was due. */
+#define prvMsToTicks( ulMs )	( ( portTickType ) ( ( ( u64_t ) ( ulMs ) * configTICK_RATE_HZ + 999U ) / 1000U ) )
+
+#if SYS_ARCH_STATIC_ALLOC
+/* Pools for SYS_ARCH_STATIC_ALLOC. Mailboxes come in two depths: the small
+ * slots cover the netconn recv and accept mboxes, the large ones tcpip_thread's
+ * mbox. A mailbox takes the shallowest free slot deep enough for it. */
+#ifndef SYS_ARCH_STATIC_NUM_MBOX
+#define SYS_ARCH_STATIC_NUM_MBOX		( 2 * MEMP_NUM_NETCONN )
+#endif
+#ifndef SYS_ARCH_STATIC_MBOX_DEPTH
+#define SYS_ARCH_STATIC_MBOX_DEPTH		LWIP_MAX( LWIP_MAX( DEFAULT_TCP_RECVMBOX_SIZE, DEFAULT_UDP_RECVMBOX_SIZE ), \
+							LWIP_MAX( DEFAULT_RAW_RECVMBOX_SIZE, DEFAULT_ACCEPTMBOX_SIZE ) )
+#endif
+/* tcpip_mbox, and tcpip_bulk_mbox with TCPIP_MBOX_BULK */
+#ifndef SYS_ARCH_STATIC_NUM_MBOX_LARGE
+#define SYS_ARCH_STATIC_NUM_MBOX_LARGE	( 1 + TCPIP_MBOX_BULK )
+#endif
+#ifndef SYS_ARCH_STATIC_MBOX_LARGE_DEPTH
+#if TCPIP_MBOX_BULK
+#define SYS_ARCH_STATIC_MBOX_LARGE_DEPTH	LWIP_MAX( TCPIP_MBOX_SIZE, TCPIP_MBOX_BULK_SIZE )
+#else
+#define SYS_ARCH_STATIC_MBOX_LARGE_DEPTH	TCPIP_MBOX_SIZE
+#endif
+#endif
+/* semaphores and mutexes share one pool */
+#ifndef SYS_ARCH_STATIC_NUM_SEM
+#define SYS_ARCH_STATIC_NUM_SEM			( MEMP_NUM_NETCONN + 8 )
+#endif
+#ifndef SYS_ARCH_STATIC_NUM_THREAD
+#define SYS_ARCH_STATIC_NUM_THREAD		8
+#endif
+/* thread stacks are never returned, they are carved from one arena (in words) */
+#ifndef SYS_ARCH_STATIC_STACK_WORDS
+#define SYS_ARCH_STATIC_STACK_WORDS		( TCPIP_THREAD_STACKSIZE + 8 * 1024 )
+#endif
+
+#define SYS_ARCH_STATIC_NUM_MBOX_ALL	( SYS_ARCH_STATIC_NUM_MBOX + SYS_ARCH_STATIC_NUM_MBOX_LARGE )
+
+static StaticQueue_t xMboxBuf[SYS_ARCH_STATIC_NUM_MBOX_ALL];
+static u8_t ucMboxUsed[SYS_ARCH_STATIC_NUM_MBOX_ALL];
+static void *pvMboxStorage[SYS_ARCH_STATIC_NUM_MBOX][SYS_ARCH_STATIC_MBOX_DEPTH];
+static void *pvMboxLargeStorage[SYS_ARCH_STATIC_NUM_MBOX_LARGE][SYS_ARCH_STATIC_MBOX_LARGE_DEPTH];
+
+static StaticSemaphore_t xSemBuf[SYS_ARCH_STATIC_NUM_SEM];
+static u8_t ucSemUsed[SYS_ARCH_STATIC_NUM_SEM];
+
+static StaticTask_t xThreadBuf[SYS_ARCH_STATIC_NUM_THREAD];
+static StackType_t xStackArena[SYS_ARCH_STATIC_STACK_WORDS];
+static u32_t ulThreadsUsed;
+static u32_t ulStackWordsUsed;
+
+static int prvMboxSlotAlloc( int iSize )
+{
+int i, iFirst, iLast;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	/* small slots first, the large ones only if the small are too shallow or gone */
+	if( iSize <= SYS_ARCH_STATIC_MBOX_DEPTH )
+	{
+		iFirst = 0;
+	}
+	else if( iSize <= SYS_ARCH_STATIC_MBOX_LARGE_DEPTH )
+	{
+		iFirst = SYS_ARCH_STATIC_NUM_MBOX;
+	}
+	else
+	{
+		return -1;
+	}
+	iLast = ( iSize <= SYS_ARCH_STATIC_MBOX_LARGE_DEPTH ) ? SYS_ARCH_STATIC_NUM_MBOX_ALL : SYS_ARCH_STATIC_NUM_MBOX;
+
+	SYS_ARCH_PROTECT( lev );
+	for( i = iFirst; i < iLast; i++ )
+	{
+		if( ucMboxUsed[i] == 0 )
+		{
+			ucMboxUsed[i] = 1;
+			SYS_ARCH_UNPROTECT( lev );
+			return i;
+		}
+	}
+	SYS_ARCH_UNPROTECT( lev );
+	return -1;
+}
+
+static void prvMboxSlotFree( sys_mbox_t xMailBox )
+{
+int i;
+
+	for( i = 0; i < SYS_ARCH_STATIC_NUM_MBOX_ALL; i++ )
+	{
+		if( xMailBox == ( sys_mbox_t ) &xMboxBuf[i] )
+		{
+			ucMboxUsed[i] = 0;
+			return;
+		}
+	}
+	configASSERT( 0 );
+}
+
+static StaticSemaphore_t *prvSemBufAlloc( void )
+{
+int i;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	SYS_ARCH_PROTECT( lev );
+	for( i = 0; i < SYS_ARCH_STATIC_NUM_SEM; i++ )
+	{
+		if( ucSemUsed[i] == 0 )
+		{
+			ucSemUsed[i] = 1;
+			SYS_ARCH_UNPROTECT( lev );
+			return &xSemBuf[i];
+		}
+	}
+	SYS_ARCH_UNPROTECT( lev );
+	return NULL;
+}
+
+static void prvSemBufFree( sys_sem_t xSemaphore )
+{
+int i;
+
+	for( i = 0; i < SYS_ARCH_STATIC_NUM_SEM; i++ )
+	{
+		if( xSemaphore == ( sys_sem_t ) &xSemBuf[i] )
+		{
+			ucSemUsed[i] = 0;
+			return;
+		}
+	}
+	configASSERT( 0 );
+}
+#endif /* SYS_ARCH_STATIC_ALLOC */
+
+#if SYS_ARCH_STATS
+static struct sys_arch_stats xStats[SYS_ARCH_STATS_NUM];
+static int iStatsUsed;
+
+/* Count the new object in the entry for its type, size and creating task. The
+ * entry index + 1 is kept as the queue number, 0 leaves the object uncounted. */
+static void prvStatsAttach( xQueueHandle xQueue, uint8_t ucType, int iSize )
+{
+const char *pcName = "main";
+int i, iFound = -1;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	if( ( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED ) && !sys_arch_in_isr() )
+	{
+		pcName = pcTaskGetName( NULL );
+	}
+
+	SYS_ARCH_PROTECT( lev );
+	for( i = 0; i < iStatsUsed; i++ )
+	{
+		if( ( xStats[i].type == ucType ) && ( xStats[i].size == ( uint16_t ) iSize ) &&
+			( strncmp( xStats[i].name, pcName, configMAX_TASK_NAME_LEN - 1 ) == 0 ) )
+		{
+			iFound = i;
+			break;
+		}
+	}
+	if( ( iFound < 0 ) && ( iStatsUsed < SYS_ARCH_STATS_NUM ) )
+	{
+		iFound = iStatsUsed++;
+		strncpy( xStats[iFound].name, pcName, configMAX_TASK_NAME_LEN - 1 );
+		xStats[iFound].type = ucType;
+		xStats[iFound].size = ( uint16_t ) iSize;
+	}
+	if( iFound >= 0 )
+	{
+		xStats[iFound].created++;
+	}
+	SYS_ARCH_UNPROTECT( lev );
+
+	vQueueSetQueueNumber( xQueue, ( UBaseType_t ) ( iFound + 1 ) );
+}
+
+static struct sys_arch_stats *prvStatsEntry( xQueueHandle xQueue )
+{
+UBaseType_t uxNumber = uxQueueGetQueueNumber( xQueue );
+
+	return ( uxNumber != 0U ) ? &xStats[uxNumber - 1U] : NULL;
+}
+
+/* After a post: the queue's fill level, or a failed trypost */
+static void prvStatsPosted( xQueueHandle xQueue, portBASE_TYPE xPassed )
+{
+struct sys_arch_stats *pxEntry = prvStatsEntry( xQueue );
+uint32_t ulUsed;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	if( pxEntry == NULL )
+	{
+		return;
+	}
+	ulUsed = sys_arch_in_isr() ? uxQueueMessagesWaitingFromISR( xQueue ) : uxQueueMessagesWaiting( xQueue );
+
+	SYS_ARCH_PROTECT( lev );
+	if( xPassed != pdPASS )
+	{
+		pxEntry->full++;
+	}
+	else if( ulUsed > pxEntry->max_used )
+	{
+		pxEntry->max_used = ulUsed;
+	}
+	SYS_ARCH_UNPROTECT( lev );
+}
+
+/* After a blocking fetch, wait or lock that started at xStart */
+static void prvStatsWaited( xQueueHandle xQueue, XTime xStart, int iTimedOut )
+{
+struct sys_arch_stats *pxEntry = prvStatsEntry( xQueue );
+XTime xNow;
+uint32_t ulUs, ulScaled;
+int iBucket = 0;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	if( pxEntry == NULL )
+	{
+		return;
+	}
+	XTime_GetTime( &xNow );
+	ulUs = ( uint32_t ) LWIP_MIN( ( ( xNow - xStart ) * 1000000U ) / COUNTS_PER_SECOND, 0xFFFFFFFFU );
+	for( ulScaled = ulUs; ( ulScaled >= 4U ) && ( iBucket < SYS_ARCH_STATS_HIST - 1 ); ulScaled >>= 2 )
+	{
+		iBucket++;
+	}
+
+	SYS_ARCH_PROTECT( lev );
+	pxEntry->waits++;
+	if( iTimedOut )
+	{
+		pxEntry->timeouts++;
+	}
+	pxEntry->wait_total_us += ulUs;
+	if( ulUs > pxEntry->wait_max_us )
+	{
+		pxEntry->wait_max_us = ulUs;
+	}
+	pxEntry->hist[iBucket]++;
+	SYS_ARCH_UNPROTECT( lev );
+}
+
+#define prvStatsDeclStart( x )	XTime x
+#define prvStatsStart( x )		XTime_GetTime( &( x ) )
+
+/** Copy entry iIndex of the statistics
+ * @return 0 on success, -1 past the last entry */
+int sys_arch_stats_get( int iIndex, struct sys_arch_stats *pxStats )
+{
+int iReturn = -1;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	SYS_ARCH_PROTECT( lev );
+	if( ( iIndex >= 0 ) && ( iIndex < iStatsUsed ) )
+	{
+		*pxStats = xStats[iIndex];
+		iReturn = 0;
+	}
+	SYS_ARCH_UNPROTECT( lev );
+	return iReturn;
+}
+
+/** Clear the counters. Entries stay assigned to the objects counted in them. */
+void sys_arch_stats_reset( void )
+{
+int i;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	SYS_ARCH_PROTECT( lev );
+	for( i = 0; i < iStatsUsed; i++ )
+	{
+		xStats[i].max_used = 0;
+		xStats[i].full = 0;
+		xStats[i].waits = 0;
+		xStats[i].timeouts = 0;
+		xStats[i].wait_max_us = 0;
+		xStats[i].wait_total_us = 0;
+		memset( xStats[i].hist, 0, sizeof( xStats[i].hist ) );
+	}
+	SYS_ARCH_UNPROTECT( lev );
+}
+
+/** Print the statistics with LWIP_PLATFORM_DIAG */
+void sys_arch_stats_dump( void )
+{
+static const char * const pcTypes[] = { "mbox", "sem", "mutex" };
+struct sys_arch_stats xEntry;
+int i, j;
+
+	for( i = 0; sys_arch_stats_get( i, &xEntry ) == 0; i++ )
+	{
+		LWIP_PLATFORM_DIAG( ( "%s %s/%d x%d: max %d full %d waits %d timeouts %d wait max %d us total %d ms\r\n",
+			pcTypes[xEntry.type], xEntry.name, ( int ) xEntry.size, ( int ) xEntry.created,
+			( int ) xEntry.max_used, ( int ) xEntry.full, ( int ) xEntry.waits, ( int ) xEntry.timeouts,
+			( int ) xEntry.wait_max_us, ( int ) ( xEntry.wait_total_us / 1000U ) ) );
+		for( j = 0; j < SYS_ARCH_STATS_HIST; j++ )
+		{
+			LWIP_PLATFORM_DIAG( ( " %d", ( int ) xEntry.hist[j] ) );
+		}
+		LWIP_PLATFORM_DIAG( ( "\r\n" ) );
+	}
+}
+#else
+#define prvStatsAttach( xQueue, ucType, iSize )
+#define prvStatsPosted( xQueue, xPassed )
+#define prvStatsWaited( xQueue, xStart, iTimedOut )
+#define prvStatsDeclStart( x )
+#define prvStatsStart( x )
+#endif /* SYS_ARCH_STATS */
+
+#if LWIP_NETCONN_SEM_PER_THREAD
+/* A notification semaphore is the owning task's handle with bit 0 set. Queue
+ * handles are word aligned, so sys_arch_sem_wait() and sys_sem_signal() can
+ * tell the two kinds apart. */
+#define prvIsNotifySem( xSem )		( ( ( uintptr_t ) ( xSem ) & 1U ) != 0U )
+#define prvNotifySemTask( xSem )	( ( xTaskHandle ) ( ( uintptr_t ) ( xSem ) & ~( uintptr_t ) 1U ) )
+
+static struct
+{
+	xTaskHandle xTask;
+	sys_sem_t xSem;
+} xNetconnSem[SYS_ARCH_NETCONN_SEM_NUM];
+
+/** LWIP_NETCONN_THREAD_SEM_GET(): the calling thread's semaphore, set up on first
+ * use if the thread did not call LWIP_NETCONN_THREAD_SEM_ALLOC() */
+sys_sem_t *sys_arch_netconn_sem_get( void )
+{
+xTaskHandle xTask = xTaskGetCurrentTaskHandle();
+int i;
+
+	for( i = 0; i < SYS_ARCH_NETCONN_SEM_NUM; i++ )
+	{
+		if( xNetconnSem[i].xTask == xTask )
+		{
+			return &xNetconnSem[i].xSem;
+		}
+	}
+	sys_arch_netconn_sem_alloc();
+	for( i = 0; i < SYS_ARCH_NETCONN_SEM_NUM; i++ )
+	{
+		if( xNetconnSem[i].xTask == xTask )
+		{
+			return &xNetconnSem[i].xSem;
+		}
+	}
+	LWIP_ASSERT( "out of netconn semaphores, raise SYS_ARCH_NETCONN_SEM_NUM", 0 );
+	return NULL;
+}
+
+void sys_arch_netconn_sem_alloc( void )
+{
+xTaskHandle xTask = xTaskGetCurrentTaskHandle();
+int i;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	SYS_ARCH_PROTECT( lev );
+	for( i = 0; i < SYS_ARCH_NETCONN_SEM_NUM; i++ )
+	{
+		if( xNetconnSem[i].xTask == xTask )
+		{
+			break;
+		}
+		if( xNetconnSem[i].xTask == NULL )
+		{
+			xNetconnSem[i].xTask = xTask;
+			xNetconnSem[i].xSem = ( sys_sem_t ) ( ( uintptr_t ) xTask | 1U );
+			SYS_STATS_INC_USED( sem );
+			break;
+		}
+	}
+	SYS_ARCH_UNPROTECT( lev );
+	/* drop a notification left over from before */
+	ulTaskNotifyTake( pdTRUE, 0 );
+}
+
+void sys_arch_netconn_sem_free( void )
+{
+xTaskHandle xTask = xTaskGetCurrentTaskHandle();
+int i;
+
+	for( i = 0; i < SYS_ARCH_NETCONN_SEM_NUM; i++ )
+	{
+		if( xNetconnSem[i].xTask == xTask )
+		{
+			xNetconnSem[i].xSem = NULL;
+			xNetconnSem[i].xTask = NULL;
+			SYS_STATS_DEC( sem.used );
+			break;
+		}
+	}
+}
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+#if SYS_ARCH_MBOX_RING
+/* A ring mailbox handle is the ring's address with bit 0 set, which no queue
+ * handle has, the same way as the notification semaphores above. Everything
+ * but the cat of merged TCP data happens under SYS_ARCH_PROTECT. */
+#define prvIsRing( xMailBox )	( ( ( uintptr_t ) ( xMailBox ) & 1U ) != 0U )
+#define prvRingOf( xMailBox )	( ( SysArchRing_t * ) ( ( uintptr_t ) ( xMailBox ) & ~( uintptr_t ) 1U ) )
+
+typedef struct
+{
+	void **ppvSlots;
+	u32_t ulSize;
+	u32_t ulHead;				/* next slot to fill */
+	u32_t ulCount;
+	xTaskHandle xWaiter;		/* reader blocked in sys_arch_mbox_fetch(), NULL if none */
+	struct pbuf *pxLastData;	/* the newest entry, if it is TCP data more may be chained to */
+} SysArchRing_t;
+
+#if SYS_ARCH_STATIC_ALLOC
+/* a ring takes a mailbox slot's storage, with its own header */
+static SysArchRing_t xRingBuf[SYS_ARCH_STATIC_NUM_MBOX_ALL];
+#endif
+
+/** sys_mbox_new_recv() and sys_mbox_new_accept(): a ring of iSize entries */
+err_t sys_arch_mbox_new_ring( sys_mbox_t *pxMailBox, int iSize )
+{
+SysArchRing_t *pxRing;
+
+#if SYS_ARCH_STATIC_ALLOC
+int iSlot = prvMboxSlotAlloc( iSize );
+
+	pxRing = NULL;
+	if( iSlot >= 0 )
+	{
+		pxRing = &xRingBuf[iSlot];
+		pxRing->ppvSlots = ( iSlot < SYS_ARCH_STATIC_NUM_MBOX ) ?
+			pvMboxStorage[iSlot] : pvMboxLargeStorage[iSlot - SYS_ARCH_STATIC_NUM_MBOX];
+	}
+#else
+	pxRing = ( SysArchRing_t * ) pvPortMalloc( sizeof( SysArchRing_t ) + ( size_t ) iSize * sizeof( void * ) );
+	if( pxRing != NULL )
+	{
+		pxRing->ppvSlots = ( void ** ) ( pxRing + 1 );
+	}
+#endif
+
+	*pxMailBox = NULL;
+	if( pxRing == NULL )
+	{
+		SYS_STATS_INC( mbox.err );
+		return ERR_MEM;
+	}
+	pxRing->ulSize = ( u32_t ) iSize;
+	pxRing->ulHead = 0;
+	pxRing->ulCount = 0;
+	pxRing->xWaiter = NULL;
+	pxRing->pxLastData = NULL;
+	*pxMailBox = ( sys_mbox_t ) ( ( uintptr_t ) pxRing | 1U );
+	SYS_STATS_INC_USED( mbox );
+	return ERR_OK;
+}
+
+static void prvRingFree( SysArchRing_t *pxRing )
+{
+	configASSERT( pxRing->ulCount == 0 );
+	#if SYS_STATS
+	{
+		if( pxRing->ulCount != 0UL )
+		{
+			SYS_STATS_INC( mbox.err );
+		}
+		SYS_STATS_DEC( mbox.used );
+	}
+	#endif /* SYS_STATS */
+
+#if SYS_ARCH_STATIC_ALLOC
+	ucMboxUsed[pxRing - xRingBuf] = 0;
+#else
+	vPortFree( pxRing );
+#endif
+}
+
+/* Queue pvMsg and wake the reader, pxData is pvMsg if further TCP data may be
+ * chained to it */
+static err_t prvRingPost( SysArchRing_t *pxRing, void *pvMsg, struct pbuf *pxData )
+{
+xTaskHandle xWaiter;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	SYS_ARCH_PROTECT( lev );
+	if( pxRing->ulCount == pxRing->ulSize )
+	{
+		SYS_ARCH_UNPROTECT( lev );
+		SYS_STATS_INC( mbox.err );
+		return ERR_MEM;
+	}
+	pxRing->ppvSlots[pxRing->ulHead] = pvMsg;
+	pxRing->ulHead = ( pxRing->ulHead + 1U == pxRing->ulSize ) ? 0U : pxRing->ulHead + 1U;
+	pxRing->ulCount++;
+	pxRing->pxLastData = pxData;
+	/* taking the reader off the ring here is what tells it a notification comes */
+	xWaiter = pxRing->xWaiter;
+	pxRing->xWaiter = NULL;
+	SYS_ARCH_UNPROTECT( lev );
+
+	if( xWaiter != NULL )
+	{
+		if( sys_arch_in_isr() )
+		{
+			portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+			vTaskNotifyGiveFromISR( xWaiter, &xHigherPriorityTaskWoken );
+			portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+		}
+		else
+		{
+			xTaskNotifyGive( xWaiter );
+		}
+	}
+	return ERR_OK;
+}
+
+/* The oldest entry, under SYS_ARCH_PROTECT. Returns 0 if there is none. */
+static int prvRingTake( SysArchRing_t *pxRing, void **ppvBuffer )
+{
+u32_t ulTail;
+
+	if( pxRing->ulCount == 0U )
+	{
+		return 0;
+	}
+	ulTail = ( pxRing->ulHead >= pxRing->ulCount ) ? pxRing->ulHead - pxRing->ulCount :
+		pxRing->ulHead + pxRing->ulSize - pxRing->ulCount;
+	*ppvBuffer = pxRing->ppvSlots[ulTail];
+	if( --pxRing->ulCount == 0U )
+	{
+		pxRing->pxLastData = NULL;
+	}
+	return 1;
+}
+
+static u32_t prvRingFetch( SysArchRing_t *pxRing, void **ppvBuffer, u32_t ulTimeOut )
+{
+portTickType xStartTime = xTaskGetTickCount();
+portTickType xTicks = prvMsToTicks( ulTimeOut );
+portTickType xElapsed;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	for( ;; )
+	{
+		SYS_ARCH_PROTECT( lev );
+		if( prvRingTake( pxRing, ppvBuffer ) )
+		{
+			SYS_ARCH_UNPROTECT( lev );
+			break;
+		}
+		pxRing->xWaiter = xTaskGetCurrentTaskHandle();
+		SYS_ARCH_UNPROTECT( lev );
+
+		/* a wakeup without an entry was meant for the netconn semaphore, wait on */
+		xElapsed = xTaskGetTickCount() - xStartTime;
+		if( ulTimeOut == 0UL )
+		{
+			ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+		}
+		else if( ( xElapsed >= xTicks ) || ( ulTaskNotifyTake( pdTRUE, xTicks - xElapsed ) == 0U ) )
+		{
+			SYS_ARCH_PROTECT( lev );
+			if( pxRing->xWaiter != NULL )
+			{
+				pxRing->xWaiter = NULL;
+				SYS_ARCH_UNPROTECT( lev );
+				*ppvBuffer = NULL;
+				return SYS_ARCH_TIMEOUT;
+			}
+			SYS_ARCH_UNPROTECT( lev );
+			/* an entry came in as we gave up, take it and its notification */
+			ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+		}
+	}
+
+	xElapsed = ( xTaskGetTickCount() - xStartTime ) * portTICK_RATE_MS;
+	return ( ( ulTimeOut == 0UL ) && ( xElapsed == 0U ) ) ? 1U : xElapsed;
+}
+
+/** sys_mbox_trypost_pbuf(): post TCP data, chained to the newest entry if
+ * that is TCP data too and the chain stays within a u16_t */
+err_t sys_arch_mbox_trypost_pbuf( sys_mbox_t *pxMailBox, struct pbuf *pxBuf, u8_t *pucMerged )
+{
+SysArchRing_t *pxRing;
+struct pbuf *pxLast = NULL;
+err_t xReturn;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	*pucMerged = 0;
+	if( !prvIsRing( *pxMailBox ) )
+	{
+		return sys_mbox_trypost( pxMailBox, pxBuf );
+	}
+	pxRing = prvRingOf( *pxMailBox );
+
+	/* Take the newest entry back, pbuf_cat() walks its chain and is better
+	 * done with interrupts on. A reader finding the ring empty meanwhile is
+	 * woken when it goes back in. Only tcpip_thread posts, so the slot stays
+	 * free for it. */
+	SYS_ARCH_PROTECT( lev );
+	if( ( pxRing->pxLastData != NULL ) &&
+		( ( u32_t ) pxRing->pxLastData->tot_len + pxBuf->tot_len <= 0xFFFFU ) )
+	{
+		pxLast = pxRing->pxLastData;
+		pxRing->ulHead = ( ( pxRing->ulHead == 0U ) ? pxRing->ulSize : pxRing->ulHead ) - 1U;
+		pxRing->ulCount--;
+		pxRing->pxLastData = NULL;
+	}
+	SYS_ARCH_UNPROTECT( lev );
+
+	if( pxLast != NULL )
+	{
+		pbuf_cat( pxLast, pxBuf );
+		pxBuf = pxLast;
+		*pucMerged = 1;
+	}
+	xReturn = prvRingPost( pxRing, pxBuf, pxBuf );
+	LWIP_ASSERT( "merged TCP data lost its slot", ( xReturn == ERR_OK ) || ( *pucMerged == 0 ) );
+	return xReturn;
+}
+#endif /* SYS_ARCH_MBOX_RING */
 
 /*---------------------------------------------------------------------------*
  * Routine:  sys_mbox_new
@@ -72,12 +700,31 @@ err_t sys_mbox_new( sys_mbox_t *pxMailBox, int iSize )
 {
 err_t xReturn = ERR_MEM;
 
+#if SYS_ARCH_STATIC_ALLOC
+int iSlot = prvMboxSlotAlloc( iSize );
+
+	*pxMailBox = NULL;
+	if( iSlot >= 0 )
+	{
+		uint8_t *pucStorage = ( iSlot < SYS_ARCH_STATIC_NUM_MBOX ) ?
+			( uint8_t * ) pvMboxStorage[iSlot] :
+			( uint8_t * ) pvMboxLargeStorage[iSlot - SYS_ARCH_STATIC_NUM_MBOX];
+
+		*pxMailBox = xQueueCreateStatic( iSize, sizeof( void * ), pucStorage, &xMboxBuf[iSlot] );
+	}
+	else
+	{
+		SYS_STATS_INC( mbox.err );
+	}
+#else
 	*pxMailBox = xQueueCreate( iSize, sizeof( void * ) );
+#endif
 
 	if( *pxMailBox != NULL )
 	{
 		xReturn = ERR_OK;
 		SYS_STATS_INC_USED( mbox );
+		prvStatsAttach( *pxMailBox, SYS_ARCH_STATS_MBOX, iSize );
 	}
 	return xReturn;
 }
@@ -99,6 +746,14 @@ void sys_mbox_free( sys_mbox_t *pxMailBox )
 {
 unsigned long ulMessagesWaiting;
 
+#if SYS_ARCH_MBOX_RING
+	if( prvIsRing( *pxMailBox ) )
+	{
+		prvRingFree( prvRingOf( *pxMailBox ) );
+		return;
+	}
+#endif
+
 	ulMessagesWaiting = uxQueueMessagesWaiting( *pxMailBox );
 	configASSERT( ( ulMessagesWaiting == 0 ) );
 
@@ -114,6 +769,9 @@ unsigned long ulMessagesWaiting;
 	#endif /* SYS_STATS */
 
 	vQueueDelete( *pxMailBox );
+#if SYS_ARCH_STATIC_ALLOC
+	prvMboxSlotFree( *pxMailBox );
+#endif
 }
 
 /*---------------------------------------------------------------------------*
@@ -128,7 +786,18 @@ unsigned long ulMessagesWaiting;
 void sys_mbox_post( sys_mbox_t *pxMailBox, void *pxMessageToPost )
 {
 	portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
-	if( xInsideISR != pdFALSE ) {
+#if SYS_ARCH_MBOX_RING
+	if( prvIsRing( *pxMailBox ) )
+	{
+		/* lwIP only ever tries posting to a recvmbox, this is for completeness */
+		while( prvRingPost( prvRingOf( *pxMailBox ), pxMessageToPost, NULL ) != ERR_OK )
+		{
+			vTaskDelay( 1 );
+		}
+		return;
+	}
+#endif
+	if( sys_arch_in_isr() ) {
 		xQueueSendToBackFromISR( *pxMailBox, &pxMessageToPost, &xHigherPriorityTaskWoken );
 		if (xHigherPriorityTaskWoken == pdTRUE) {
 			portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
@@ -136,6 +805,7 @@ void sys_mbox_post( sys_mbox_t *pxMailBox, void *pxMessageToPost )
 	}
 	else
 		xQueueSendToBack( *pxMailBox, &pxMessageToPost, portMAX_DELAY );
+	prvStatsPosted( *pxMailBox, pdPASS );
 }
 
 /*---------------------------------------------------------------------------*
@@ -156,7 +826,14 @@ err_t sys_mbox_trypost( sys_mbox_t *pxMailBox, void *pxMessageToPost )
 err_t xReturn;
 portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 
-	if( xInsideISR != pdFALSE )
+#if SYS_ARCH_MBOX_RING
+	if( prvIsRing( *pxMailBox ) )
+	{
+		return prvRingPost( prvRingOf( *pxMailBox ), pxMessageToPost, NULL );
+	}
+#endif
+
+	if( sys_arch_in_isr() )
 	{
 		xReturn = xQueueSendFromISR( *pxMailBox, &pxMessageToPost, &xHigherPriorityTaskWoken );
 		if (xHigherPriorityTaskWoken == pdTRUE) {
@@ -167,6 +844,7 @@ portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 	{
 		xReturn = xQueueSend( *pxMailBox, &pxMessageToPost, ( portTickType ) 0 );
 	}
+	prvStatsPosted( *pxMailBox, xReturn );
 
 	if( xReturn == pdPASS )
 	{
@@ -214,8 +892,17 @@ void *pvDummy;
 portTickType xStartTime, xEndTime, xElapsed;
 unsigned long ulReturn;
 portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+prvStatsDeclStart( xStatsStart );
+
+#if SYS_ARCH_MBOX_RING
+	if( prvIsRing( *pxMailBox ) )
+	{
+		return prvRingFetch( prvRingOf( *pxMailBox ), ( ppvBuffer != NULL ) ? ppvBuffer : &pvDummy, ulTimeOut );
+	}
+#endif
 
 	xStartTime = xTaskGetTickCount();
+	prvStatsStart( xStatsStart );
 
 	if( NULL == ppvBuffer )
 	{
@@ -224,7 +911,7 @@ portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 
 	if( ulTimeOut != 0UL )
 	{
-		if( xInsideISR != pdFALSE ) {
+		if( sys_arch_in_isr() ) {
 			if( pdTRUE == xQueueReceiveFromISR( *pxMailBox, &( *ppvBuffer ), &xHigherPriorityTaskWoken ) )
 			{
 				xEndTime = xTaskGetTickCount();
@@ -240,7 +927,7 @@ portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 				ulReturn = SYS_ARCH_TIMEOUT;
 			}
 		} else {
-		if( pdTRUE == xQueueReceive( *pxMailBox, &( *ppvBuffer ), ulTimeOut/ portTICK_RATE_MS ) )
+		if( pdTRUE == xQueueReceive( *pxMailBox, &( *ppvBuffer ), prvMsToTicks( ulTimeOut ) ) )
 		{
 			xEndTime = xTaskGetTickCount();
 			xElapsed = ( xEndTime - xStartTime ) * portTICK_RATE_MS;
@@ -253,18 +940,22 @@ portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 			*ppvBuffer = NULL;
 			ulReturn = SYS_ARCH_TIMEOUT;
 		}
+		prvStatsWaited( *pxMailBox, xStatsStart, ulReturn == SYS_ARCH_TIMEOUT );
 	}
 	}
 	else
 	{
-		if( xInsideISR != pdFALSE ) {
+		if( sys_arch_in_isr() ) {
 			xQueueReceiveFromISR( *pxMailBox, &( *ppvBuffer ), &xHigherPriorityTaskWoken );
 			if (xHigherPriorityTaskWoken == pdTRUE) {
 				portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 			}
 		}
 		else
+		{
 			xQueueReceive( *pxMailBox, &( *ppvBuffer ), portMAX_DELAY );
+			prvStatsWaited( *pxMailBox, xStatsStart, 0 );
+		}
 		xEndTime = xTaskGetTickCount();
 		xElapsed = ( xEndTime - xStartTime ) * portTICK_RATE_MS;
 
@@ -305,7 +996,19 @@ portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 		ppvBuffer = &pvDummy;
 	}
 
-	if( xInsideISR != pdFALSE )
+#if SYS_ARCH_MBOX_RING
+	if( prvIsRing( *pxMailBox ) )
+	{
+		SYS_ARCH_DECL_PROTECT( lev );
+
+		SYS_ARCH_PROTECT( lev );
+		lResult = prvRingTake( prvRingOf( *pxMailBox ), ppvBuffer );
+		SYS_ARCH_UNPROTECT( lev );
+		return lResult ? ERR_OK : SYS_MBOX_EMPTY;
+	}
+#endif
+
+	if( sys_arch_in_isr() )
 	{
 		lResult = xQueueReceiveFromISR( *pxMailBox, &( *ppvBuffer ), &xHigherPriorityTaskWoken );
 		if (xHigherPriorityTaskWoken == pdTRUE) {
@@ -347,12 +1050,19 @@ err_t sys_sem_new( sys_sem_t *pxSemaphore, u8_t ucCount )
 	(void) ucCount;
 err_t xReturn = ERR_MEM;
 
+#if SYS_ARCH_STATIC_ALLOC
+StaticSemaphore_t *pxBuf = prvSemBufAlloc();
+
+	*pxSemaphore = ( pxBuf != NULL ) ? xSemaphoreCreateBinaryStatic( pxBuf ) : NULL;
+#else
 	*pxSemaphore = xSemaphoreCreateBinary();
+#endif
 
 	if( *pxSemaphore != NULL )
 	{
 		xReturn = ERR_OK;
 		SYS_STATS_INC_USED( sem );
+		prvStatsAttach( *pxSemaphore, SYS_ARCH_STATS_SEM, 0 );
 	}
 	else
 	{
@@ -391,12 +1101,31 @@ u32_t sys_arch_sem_wait( sys_sem_t *pxSemaphore, u32_t ulTimeout )
 portTickType xStartTime, xEndTime, xElapsed;
 unsigned long ulReturn;
 portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+prvStatsDeclStart( xStatsStart );
 
 	xStartTime = xTaskGetTickCount();
 
+#if LWIP_NETCONN_SEM_PER_THREAD
+	if( prvIsNotifySem( *pxSemaphore ) )
+	{
+		/* only the owning task waits on its notification */
+		if( ulTaskNotifyTake( pdTRUE, ( ulTimeout != 0UL ) ? prvMsToTicks( ulTimeout ) : portMAX_DELAY ) == 0UL )
+		{
+			return SYS_ARCH_TIMEOUT;
+		}
+		xElapsed = ( xTaskGetTickCount() - xStartTime ) * portTICK_RATE_MS;
+		if( ( ulTimeout == 0UL ) && ( xElapsed == 0UL ) )
+		{
+			xElapsed = 1UL;
+		}
+		return xElapsed;
+	}
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+	prvStatsStart( xStatsStart );
 	if( ulTimeout != 0UL )
 	{
-		if( xInsideISR != pdFALSE ) {
+		if( sys_arch_in_isr() ) {
 			if( xSemaphoreTakeFromISR( *pxSemaphore, &xHigherPriorityTaskWoken ) == pdTRUE )
 			{
 				xEndTime = xTaskGetTickCount();
@@ -411,7 +1140,7 @@ portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 				ulReturn = SYS_ARCH_TIMEOUT;
 			}
 		} else {
-		if( xSemaphoreTake( *pxSemaphore, ulTimeout / portTICK_RATE_MS ) == pdTRUE )
+		if( xSemaphoreTake( *pxSemaphore, prvMsToTicks( ulTimeout ) ) == pdTRUE )
 		{
 			xEndTime = xTaskGetTickCount();
 			xElapsed = (xEndTime - xStartTime) * portTICK_RATE_MS;
@@ -421,18 +1150,22 @@ portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 		{
 			ulReturn = SYS_ARCH_TIMEOUT;
 		}
+		prvStatsWaited( *pxSemaphore, xStatsStart, ulReturn == SYS_ARCH_TIMEOUT );
 	}
 	}
 	else
 	{
-		if( xInsideISR != pdFALSE ) {
+		if( sys_arch_in_isr() ) {
 			xSemaphoreTakeFromISR( *pxSemaphore, &xHigherPriorityTaskWoken );
 			if (xHigherPriorityTaskWoken == pdTRUE) {
 				portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 			}
 		}
 		else
+		{
 			xSemaphoreTake( *pxSemaphore, portMAX_DELAY );
+			prvStatsWaited( *pxSemaphore, xStatsStart, 0 );
+		}
 		xEndTime = xTaskGetTickCount();
 		xElapsed = ( xEndTime - xStartTime ) * portTICK_RATE_MS;
 
@@ -447,19 +1180,27 @@ portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 	return ulReturn;
 }
 
-/** Create a new mutex
+/** Create a new mutex. FreeRTOS mutexes inherit priority, so a low priority task holding the
+ * core lock is raised to the priority of tcpip_thread while that waits for it.
  * @param mutex pointer to the mutex to create
  * @return a new mutex */
 err_t sys_mutex_new( sys_mutex_t *pxMutex )
 {
 err_t xReturn = ERR_MEM;
 
+#if SYS_ARCH_STATIC_ALLOC
+StaticSemaphore_t *pxBuf = prvSemBufAlloc();
+
+	*pxMutex = ( pxBuf != NULL ) ? xSemaphoreCreateMutexStatic( pxBuf ) : NULL;
+#else
 	*pxMutex = xSemaphoreCreateMutex();
+#endif
 
 	if( *pxMutex != NULL )
 	{
 		xReturn = ERR_OK;
 		SYS_STATS_INC_USED( mutex );
+		prvStatsAttach( *pxMutex, SYS_ARCH_STATS_MUTEX, 0 );
 	}
 	else
 	{
@@ -475,14 +1216,20 @@ err_t xReturn = ERR_MEM;
 void sys_mutex_lock( sys_mutex_t *pxMutex )
 {
 	portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
-	if( xInsideISR != pdFALSE ) {
+	prvStatsDeclStart( xStatsStart );
+	if( sys_arch_in_isr() ) {
 		xSemaphoreTakeFromISR( *pxMutex, &xHigherPriorityTaskWoken );
 		if (xHigherPriorityTaskWoken == pdTRUE) {
 			portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 		}
 	}
 	else
+	{
+		/* an uncontended lock lands in the first histogram bucket */
+		prvStatsStart( xStatsStart );
 		xSemaphoreTake( *pxMutex, portMAX_DELAY );
+		prvStatsWaited( *pxMutex, xStatsStart, 0 );
+	}
 }
 
 /** Unlock a mutex
@@ -490,7 +1237,7 @@ void sys_mutex_lock( sys_mutex_t *pxMutex )
 void sys_mutex_unlock(sys_mutex_t *pxMutex )
 {
 	portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
-	if( xInsideISR != pdFALSE ) {
+	if( sys_arch_in_isr() ) {
 		xSemaphoreGiveFromISR( *pxMutex, &xHigherPriorityTaskWoken );
 		if (xHigherPriorityTaskWoken == pdTRUE)
 			portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
@@ -506,7 +1253,27 @@ void sys_mutex_free( sys_mutex_t *pxMutex )
 {
 	SYS_STATS_DEC( mutex.used );
 	vQueueDelete( *pxMutex );
+#if SYS_ARCH_STATIC_ALLOC
+	prvSemBufFree( *pxMutex );
+#endif
+}
+
+#if LWIP_TCPIP_CORE_LOCKING
+/** LWIP_ASSERT_CORE_LOCKED(): the core lock is a mutex and cannot be taken from an ISR, and
+ * once tcpip_init() has created it, the calling task must hold it. tcpip_thread holds it
+ * whenever it is not waiting for a message. */
+void sys_check_core_locking( void )
+{
+	LWIP_ASSERT( "lwIP core called from an ISR", !sys_arch_in_isr() );
+#if INCLUDE_xSemaphoreGetMutexHolder && INCLUDE_xTaskGetCurrentTaskHandle
+	if( lock_tcpip_core != NULL )
+	{
+		LWIP_ASSERT( "lwIP core called without the core lock",
+			xSemaphoreGetMutexHolder( lock_tcpip_core ) == xTaskGetCurrentTaskHandle() );
+	}
+#endif
 }
+#endif /* LWIP_TCPIP_CORE_LOCKING */
 
 
 /*---------------------------------------------------------------------------*
@@ -521,7 +1288,23 @@ void sys_sem_signal( sys_sem_t *pxSemaphore )
 {
 portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 
-	if( xInsideISR != pdFALSE )
+#if LWIP_NETCONN_SEM_PER_THREAD
+	if( prvIsNotifySem( *pxSemaphore ) )
+	{
+		if( sys_arch_in_isr() )
+		{
+			vTaskNotifyGiveFromISR( prvNotifySemTask( *pxSemaphore ), &xHigherPriorityTaskWoken );
+			portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+		}
+		else
+		{
+			xTaskNotifyGive( prvNotifySemTask( *pxSemaphore ) );
+		}
+		return;
+	}
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
+	if( sys_arch_in_isr() )
 	{
 		xSemaphoreGiveFromISR( *pxSemaphore, &xHigherPriorityTaskWoken );
 		if (xHigherPriorityTaskWoken == pdTRUE) {
@@ -546,6 +1329,9 @@ void sys_sem_free( sys_sem_t *pxSemaphore )
 {
 	SYS_STATS_DEC(sem.used);
 	vQueueDelete( *pxSemaphore );
+#if SYS_ARCH_STATIC_ALLOC
+	prvSemBufFree( *pxSemaphore );
+#endif
 }
 
 /*---------------------------------------------------------------------------*
@@ -558,9 +1344,28 @@ void sys_init(void)
 {
 }
 
+/* With SYS_ARCH_NOW_XTIME, lwIP's timers run from the free-running XTime counter
+ * (the generic timer on A53, the TTC sleep timer on R5) at 1 ms resolution
+ * whatever configTICK_RATE_HZ is. The tick count is the fallback; it is widened
+ * so ticks * 1000 does not wrap long before the 32 bit millisecond count. */
 u32_t sys_now(void)
 {
-	return ((xTaskGetTickCount() * 1000) / configTICK_RATE_HZ);
+#if SYS_ARCH_NOW_XTIME
+	XTime xNow;
+
+	XTime_GetTime( &xNow );
+	return ( u32_t ) ( xNow / ( COUNTS_PER_SECOND / 1000U ) );
+#else
+	return ( u32_t ) ( ( ( u64_t ) xTaskGetTickCount() * 1000U ) / configTICK_RATE_HZ );
+#endif
+}
+
+u32_t sys_now_us( void )
+{
+	XTime xNow;
+
+	XTime_GetTime( &xNow );
+	return ( u32_t ) ( xNow / ( COUNTS_PER_SECOND / 1000000U ) );
 }
 
 /*---------------------------------------------------------------------------*
@@ -587,7 +1392,30 @@ xTaskHandle xCreatedTask;
 portBASE_TYPE xResult;
 sys_thread_t xReturn;
 
+#if SYS_ARCH_STATIC_ALLOC
+StackType_t *pxStack = NULL;
+StaticTask_t *pxTaskBuf = NULL;
+SYS_ARCH_DECL_PROTECT( lev );
+
+	SYS_ARCH_PROTECT( lev );
+	if( ( ulThreadsUsed < SYS_ARCH_STATIC_NUM_THREAD ) &&
+		( ( u32_t ) iStackSize <= SYS_ARCH_STATIC_STACK_WORDS - ulStackWordsUsed ) )
+	{
+		pxTaskBuf = &xThreadBuf[ulThreadsUsed++];
+		pxStack = &xStackArena[ulStackWordsUsed];
+		ulStackWordsUsed += iStackSize;
+	}
+	SYS_ARCH_UNPROTECT( lev );
+
+	xCreatedTask = NULL;
+	if( pxTaskBuf != NULL )
+	{
+		xCreatedTask = xTaskCreateStatic( pxThread, ( const char * const) pcName, iStackSize, pvArg, iPriority, pxStack, pxTaskBuf );
+	}
+	xResult = ( xCreatedTask != NULL ) ? pdPASS : pdFAIL;
+#else
 	xResult = xTaskCreate( pxThread, ( const char * const) pcName, iStackSize, pvArg, iPriority, &xCreatedTask );
+#endif
 
 	if( xResult == pdPASS )
 	{
@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * Copyright (C) 2007 - 2022 Xilinx, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+/*
+ * Frame capture behind CAPTURE_RX/CAPTURE_TX, see arch/capture.h.
+ *
+ * The ring holds variable-sized slots. A producer reserves one by moving
+ * capture_head forward with compare-and-swap, fills it and then marks it
+ * ready; the consumer takes ready slots in order, clears them and moves
+ * capture_tail. A slot that would cross the end of the ring is preceded by a
+ * pad slot up to the end. Slots are cleared when they are taken, so a slot
+ * reserved but not yet ready always reads as free.
+ */
+
+#include <string.h>
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/sys.h"
+#include "arch/capture.h"
+
+#if LWIP_CAPTURE
+
+#if (CAPTURE_RING_SIZE & (CAPTURE_RING_SIZE - 1)) != 0
+#error "CAPTURE_RING_SIZE must be a power of two"
+#endif
+
+/* classic BPF opcodes, as in linux/filter.h */
+#define BPF_CLASS(code)  ((code) & 0x07)
+#define BPF_LD           0x00
+#define BPF_LDX          0x01
+#define BPF_ST           0x02
+#define BPF_STX          0x03
+#define BPF_ALU          0x04
+#define BPF_JMP          0x05
+#define BPF_RET          0x06
+#define BPF_MISC         0x07
+#define BPF_W            0x00
+#define BPF_H            0x08
+#define BPF_B            0x10
+#define BPF_IMM          0x00
+#define BPF_ABS          0x20
+#define BPF_IND          0x40
+#define BPF_MEM          0x60
+#define BPF_LEN          0x80
+#define BPF_MSH          0xa0
+#define BPF_ADD          0x00
+#define BPF_SUB          0x10
+#define BPF_MUL          0x20
+#define BPF_DIV          0x30
+#define BPF_OR           0x40
+#define BPF_AND          0x50
+#define BPF_LSH          0x60
+#define BPF_RSH          0x70
+#define BPF_NEG          0x80
+#define BPF_MOD          0x90
+#define BPF_XOR          0xa0
+#define BPF_JA           0x00
+#define BPF_JEQ          0x10
+#define BPF_JGT          0x20
+#define BPF_JGE          0x30
+#define BPF_JSET         0x40
+#define BPF_K            0x00
+#define BPF_X            0x08
+#define BPF_A            0x10
+#define BPF_TAX          0x00
+#define BPF_TXA          0x80
+#define BPF_MEMWORDS     16
+
+#define CAPTURE_SLOT_FREE    0
+#define CAPTURE_SLOT_READY   1
+#define CAPTURE_SLOT_PAD     2
+
+/* Slot header in the ring, followed by caplen bytes. Slots are 4-byte
+ * aligned and a pad slot only has size and state. */
+struct capture_slot {
+	u16_t size;                  /* header included, a multiple of 4 */
+	u8_t state;                  /* CAPTURE_SLOT_* */
+	u8_t dir;
+	u16_t caplen;
+	u16_t len;
+	u32_t ts_lo;
+	u32_t ts_hi;
+};
+
+struct netif *volatile capture_netif;
+
+static u32_t capture_ring[CAPTURE_RING_SIZE / 4];
+static u32_t capture_head;           /* bytes ever reserved */
+static u32_t capture_tail;           /* bytes ever taken, written by the consumer only */
+static struct capture_insn capture_prog[CAPTURE_MAX_INSNS];
+static u16_t capture_prog_len;
+static u16_t capture_snaplen;
+static struct capture_stats capture_stats;
+
+/* Load size bytes at offset k in network order; returns 0 past the end */
+static int
+capture_load(const struct pbuf *p, u32_t k, u8_t size, u32_t *v)
+{
+	const u8_t *b;
+	u32_t r = 0;
+	int c;
+	u8_t i;
+
+	if (k > p->tot_len || size > p->tot_len - k) {
+		return 0;
+	}
+	if (k + size <= p->len) {
+		b = (const u8_t *)p->payload + k;
+		for (i = 0; i < size; i++) {
+			r = (r << 8) | b[i];
+		}
+	} else {
+		for (i = 0; i < size; i++) {
+			c = pbuf_try_get_at(p, (u16_t)(k + i));
+			if (c < 0) {
+				return 0;
+			}
+			r = (r << 8) | (u8_t)c;
+		}
+	}
+	*v = r;
+	return 1;
+}
+
+/* Run the filter on p, returns how many bytes to keep, 0 to skip it. Other
+ * contexts may replace the program at the same time, so the program counter
+ * and scratch memory are checked on every use; at worst a frame is filtered
+ * by a mix of the two programs. */
+static u32_t
+capture_filter(const struct pbuf *p)
+{
+	const struct capture_insn *insn;
+	u32_t mem[BPF_MEMWORDS];
+	u32_t a = 0, x = 0, v, k;
+	u16_t len = capture_prog_len;
+	u16_t pc = 0;
+
+	if (len == 0) {
+		return 0xFFFFFFFFUL;
+	}
+
+	while (pc < len && pc < CAPTURE_MAX_INSNS) {
+		insn = &capture_prog[pc++];
+		k = insn->k;
+
+		switch (insn->code) {
+		case BPF_LD | BPF_W | BPF_ABS:
+		case BPF_LD | BPF_H | BPF_ABS:
+		case BPF_LD | BPF_B | BPF_ABS:
+		case BPF_LD | BPF_W | BPF_IND:
+		case BPF_LD | BPF_H | BPF_IND:
+		case BPF_LD | BPF_B | BPF_IND:
+			if ((insn->code & 0xe0) == BPF_IND) {
+				k += x;
+			}
+			if (!capture_load(p, k, (insn->code & 0x18) == BPF_W ? 4 : (insn->code & 0x18) == BPF_H ? 2 : 1, &a)) {
+				return 0;
+			}
+			break;
+		case BPF_LDX | BPF_B | BPF_MSH:
+			if (!capture_load(p, k, 1, &v)) {
+				return 0;
+			}
+			x = (v & 0xf) << 2;
+			break;
+		case BPF_LD | BPF_W | BPF_LEN:
+			a = p->tot_len;
+			break;
+		case BPF_LDX | BPF_W | BPF_LEN:
+			x = p->tot_len;
+			break;
+		case BPF_LD | BPF_IMM:
+			a = k;
+			break;
+		case BPF_LDX | BPF_IMM:
+			x = k;
+			break;
+		case BPF_LD | BPF_MEM:
+			a = mem[k % BPF_MEMWORDS];
+			break;
+		case BPF_LDX | BPF_MEM:
+			x = mem[k % BPF_MEMWORDS];
+			break;
+		case BPF_ST:
+			mem[k % BPF_MEMWORDS] = a;
+			break;
+		case BPF_STX:
+			mem[k % BPF_MEMWORDS] = x;
+			break;
+		case BPF_ALU | BPF_NEG:
+			a = 0 - a;
+			break;
+		case BPF_JMP | BPF_JA:
+			pc = (u16_t)(pc + k);
+			break;
+		case BPF_RET | BPF_K:
+			return k;
+		case BPF_RET | BPF_A:
+			return a;
+		case BPF_MISC | BPF_TAX:
+			x = a;
+			break;
+		case BPF_MISC | BPF_TXA:
+			a = x;
+			break;
+		default:
+			v = (insn->code & BPF_X) ? x : k;
+			if (BPF_CLASS(insn->code) == BPF_ALU) {
+				switch (insn->code & 0xf0) {
+				case BPF_ADD: a += v; break;
+				case BPF_SUB: a -= v; break;
+				case BPF_MUL: a *= v; break;
+				case BPF_DIV: if (v == 0) return 0; a /= v; break;
+				case BPF_MOD: if (v == 0) return 0; a %= v; break;
+				case BPF_OR:  a |= v; break;
+				case BPF_AND: a &= v; break;
+				case BPF_XOR: a ^= v; break;
+				case BPF_LSH: a = v < 32 ? a << v : 0; break;
+				case BPF_RSH: a = v < 32 ? a >> v : 0; break;
+				default: return 0;
+				}
+			} else if (BPF_CLASS(insn->code) == BPF_JMP) {
+				switch (insn->code & 0xf0) {
+				case BPF_JEQ:  pc = (u16_t)(pc + ((a == v) ? insn->jt : insn->jf)); break;
+				case BPF_JGT:  pc = (u16_t)(pc + ((a > v) ? insn->jt : insn->jf)); break;
+				case BPF_JGE:  pc = (u16_t)(pc + ((a >= v) ? insn->jt : insn->jf)); break;
+				case BPF_JSET: pc = (u16_t)(pc + ((a & v) ? insn->jt : insn->jf)); break;
+				default: return 0;
+				}
+			} else {
+				return 0;
+			}
+			break;
+		}
+	}
+	/* fell off the end, which a validated program cannot */
+	return 0;
+}
+
+/* Like the kernel's sk_chk_filter(): only known instructions, jumps that
+ * stay inside, and a return at the end */
+static int
+capture_check(const struct capture_insn *prog, u16_t len)
+{
+	u16_t pc;
+	u16_t code;
+
+	if (len > CAPTURE_MAX_INSNS || (len > 0 && BPF_CLASS(prog[len - 1].code) != BPF_RET)) {
+		return 0;
+	}
+	for (pc = 0; pc < len; pc++) {
+		code = prog[pc].code;
+		switch (BPF_CLASS(code)) {
+		case BPF_LD:
+		case BPF_LDX:
+			if ((code & 0xe0) == BPF_MEM && prog[pc].k >= BPF_MEMWORDS) {
+				return 0;
+			}
+			break;
+		case BPF_ST:
+		case BPF_STX:
+			if (prog[pc].k >= BPF_MEMWORDS) {
+				return 0;
+			}
+			break;
+		case BPF_JMP:
+			if ((code & 0xf0) == BPF_JA) {
+				if (prog[pc].k >= (u32_t)(len - pc - 1)) {
+					return 0;
+				}
+			} else if (prog[pc].jt >= len - pc - 1 || prog[pc].jf >= len - pc - 1) {
+				return 0;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return 1;
+}
+
+int
+capture_start(struct netif *netif, const struct capture_insn *prog, u16_t len, u16_t snaplen)
+{
+	if (!capture_check(prog, len)) {
+		return -1;
+	}
+
+	capture_netif = NULL;
+	capture_prog_len = 0;
+	memcpy(capture_prog, prog, len * sizeof(*prog));
+	/* a slot must fit in half the ring, so that it can always be placed */
+	if (snaplen == 0 || snaplen > CAPTURE_RING_SIZE / 2 - sizeof(struct capture_slot)) {
+		snaplen = (u16_t)(CAPTURE_RING_SIZE / 2 - sizeof(struct capture_slot));
+	}
+	capture_snaplen = snaplen;
+	__atomic_store_n(&capture_prog_len, len, __ATOMIC_RELEASE);
+	memset(&capture_stats, 0, sizeof(capture_stats));
+	capture_netif = netif;
+
+	return 0;
+}
+
+void
+capture_stop(void)
+{
+	capture_netif = NULL;
+}
+
+void
+capture_frame(struct pbuf *p, u8_t dir)
+{
+	struct capture_slot *slot;
+	u32_t head, tail, off, size, need;
+	u64_t ts;
+	u16_t caplen;
+	u32_t snap;
+
+	snap = capture_filter(p);
+	if (snap == 0) {
+		return;
+	}
+	caplen = (u16_t)LWIP_MIN(LWIP_MIN(snap, capture_snaplen), p->tot_len);
+	size = (sizeof(struct capture_slot) + caplen + 3) & ~3UL;
+
+	head = __atomic_load_n(&capture_head, __ATOMIC_RELAXED);
+	do {
+		tail = __atomic_load_n(&capture_tail, __ATOMIC_ACQUIRE);
+		off = head & (CAPTURE_RING_SIZE - 1);
+		need = size;
+		if (off + size > CAPTURE_RING_SIZE) {
+			need += CAPTURE_RING_SIZE - off;
+		}
+		if (need > CAPTURE_RING_SIZE - (head - tail)) {
+			__atomic_fetch_add(&capture_stats.dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&capture_head, &head, head + need, 1,
+	                                      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	if (need != size) {
+		slot = (struct capture_slot *)((u8_t *)capture_ring + off);
+		slot->size = (u16_t)(CAPTURE_RING_SIZE - off);
+		__atomic_store_n(&slot->state, CAPTURE_SLOT_PAD, __ATOMIC_RELEASE);
+		off = 0;
+	}
+
+	ts = CAPTURE_NOW_US();
+	slot = (struct capture_slot *)((u8_t *)capture_ring + off);
+	slot->size = (u16_t)size;
+	slot->dir = dir;
+	slot->caplen = caplen;
+	slot->len = p->tot_len;
+	slot->ts_lo = (u32_t)ts;
+	slot->ts_hi = (u32_t)(ts >> 32);
+	pbuf_copy_partial(p, slot + 1, caplen, 0);
+	__atomic_store_n(&slot->state, CAPTURE_SLOT_READY, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&capture_stats.captured, 1, __ATOMIC_RELAXED);
+}
+
+int
+capture_read(struct capture_record *rec, void *buf, u16_t size)
+{
+	struct capture_slot *slot;
+	u32_t tail, off;
+	u16_t slot_size;
+	u8_t state;
+
+	for (;;) {
+		tail = capture_tail;
+		if (tail == __atomic_load_n(&capture_head, __ATOMIC_ACQUIRE)) {
+			return 0;
+		}
+		off = tail & (CAPTURE_RING_SIZE - 1);
+		slot = (struct capture_slot *)((u8_t *)capture_ring + off);
+		state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+		if (state == CAPTURE_SLOT_FREE) {
+			/* reserved, but its producer is not done yet */
+			return 0;
+		}
+		slot_size = slot->size;
+		if (state == CAPTURE_SLOT_READY) {
+			rec->ts_us = ((u64_t)slot->ts_hi << 32) | slot->ts_lo;
+			rec->caplen = LWIP_MIN(slot->caplen, size);
+			rec->len = slot->len;
+			rec->dir = slot->dir;
+			memcpy(buf, slot + 1, rec->caplen);
+		}
+		memset(slot, 0, slot_size);
+		__atomic_store_n(&capture_tail, tail + slot_size, __ATOMIC_RELEASE);
+		if (state == CAPTURE_SLOT_READY) {
+			return 1;
+		}
+	}
+}
+
+void
+capture_get_stats(struct capture_stats *stats, int reset)
+{
+	stats->captured = __atomic_load_n(&capture_stats.captured, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&capture_stats.dropped, __ATOMIC_RELAXED);
+	if (reset) {
+		__atomic_fetch_sub(&capture_stats.captured, stats->captured, __ATOMIC_RELAXED);
+		__atomic_fetch_sub(&capture_stats.dropped, stats->dropped, __ATOMIC_RELAXED);
+	}
+}
+
+#endif /* LWIP_CAPTURE */
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * Copyright (C) 2007 - 2022 Xilinx, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+/*
+ * Internet checksum kernels for LWIP_CHKSUM, selected in arch/cc.h with
+ * SYS_ARCH_CHKSUM. They return the same folded, non-inverted sum as
+ * lwip_standard_chksum(), odd start addresses included.
+ */
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/inet_chksum.h"
+
+#if SYS_ARCH_CHKSUM
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+
+/* A 32 bit lane takes two 16 bit words per vpadal, so it cannot overflow
+ * within this many 32 byte blocks */
+#define SYS_ARCH_CHKSUM_NEON_BLOCKS 32768
+#endif /* __ARM_NEON */
+
+LWIP_HOT_TEXT u16_t
+sys_arch_chksum(const void *dataptr, int len)
+{
+	const u8_t *pb = (const u8_t *)dataptr;
+	u64_t sum = 0;
+	u32_t fold;
+	u16_t t = 0;
+	/* as in LWIP_CHKSUM_ALGORITHM 3, an odd start is summed from the next
+	 * halfword and the result swapped back at the end */
+	int odd = ((mem_ptr_t)pb & 1);
+#ifdef __ARM_NEON
+	uint32x4_t acc0, acc1;
+	uint64x2_t wide;
+	int blocks;
+#else
+	u32_t acc = 0;
+#endif
+
+	if (odd && len > 0) {
+		((u8_t *)&t)[1] = *pb++;
+		len--;
+	}
+
+#ifdef __ARM_NEON
+	while (len >= 32) {
+		acc0 = vdupq_n_u32(0);
+		acc1 = vdupq_n_u32(0);
+		for (blocks = 0; (len >= 32) && (blocks < SYS_ARCH_CHKSUM_NEON_BLOCKS); blocks++) {
+			acc0 = vpadalq_u16(acc0, vld1q_u16((const uint16_t *)(const void *)pb));
+			acc1 = vpadalq_u16(acc1, vld1q_u16((const uint16_t *)(const void *)(pb + 16)));
+			pb += 32;
+			len -= 32;
+		}
+		wide = vaddq_u64(vpaddlq_u32(acc0), vpaddlq_u32(acc1));
+		sum += vgetq_lane_u64(wide, 0) + vgetq_lane_u64(wide, 1);
+	}
+#else /* __ARM_NEON */
+	/* The R5 has no NEON: add 32 bytes per iteration from two 4 register
+	 * LDMs with the carry chained through ADCS. r7 and r11 are left alone,
+	 * either may be the frame pointer. LDM needs a word aligned address. */
+	if (((mem_ptr_t)pb & 2) && (len > 1)) {
+		sum += *(const u16_t *)(const void *)pb;
+		pb += 2;
+		len -= 2;
+	}
+	while (len >= 32) {
+		__asm__ volatile (
+			"ldmia	%[p]!, {r4, r5, r6, r8}\n\t"
+			"adds	%[s], %[s], r4\n\t"
+			"adcs	%[s], %[s], r5\n\t"
+			"adcs	%[s], %[s], r6\n\t"
+			"adcs	%[s], %[s], r8\n\t"
+			"ldmia	%[p]!, {r4, r5, r6, r8}\n\t"
+			"adcs	%[s], %[s], r4\n\t"
+			"adcs	%[s], %[s], r5\n\t"
+			"adcs	%[s], %[s], r6\n\t"
+			"adcs	%[s], %[s], r8\n\t"
+			"adc	%[s], %[s], #0\n\t"
+			: [s] "+r" (acc), [p] "+r" (pb)
+			:
+			: "r4", "r5", "r6", "r8", "cc", "memory");
+		len -= 32;
+	}
+	sum += acc;
+#endif /* __ARM_NEON */
+
+	/* pb is halfword aligned here */
+	while (len > 1) {
+		sum += *(const u16_t *)(const void *)pb;
+		pb += 2;
+		len -= 2;
+	}
+
+	/* dangling tail byte remaining? */
+	if (len > 0) {
+		((u8_t *)&t)[0] = *pb;
+	}
+	sum += t;
+
+	sum = (sum & 0xFFFFFFFFULL) + (sum >> 32);
+	sum = (sum & 0xFFFFFFFFULL) + (sum >> 32);
+	fold = (u32_t)sum;
+	fold = FOLD_U32T(fold);
+	fold = FOLD_U32T(fold);
+
+	if (odd) {
+		fold = SWAP_BYTES_IN_WORD(fold);
+	}
+
+	return (u16_t)fold;
+}
+
+#if LWIP_CHECKSUM_ON_COPY
+/* LWIP_CHKSUM_COPY: MEMCPY that returns the checksum of the data, as
+ * LWIP_CHKSUM(dst, len) would, reading each byte once. The sum is taken
+ * from the start of the data, so no odd address fixup is needed. */
+LWIP_HOT_TEXT u16_t
+sys_arch_chksum_copy(void *dst, const void *src, u16_t len)
+{
+	u8_t *pd = (u8_t *)dst;
+	const u8_t *ps = (const u8_t *)src;
+	u32_t sum = 0;
+	u16_t w, t = 0;
+#ifdef __ARM_NEON
+	uint32x4_t acc0 = vdupq_n_u32(0), acc1 = vdupq_n_u32(0);
+	uint8x16_t v0, v1;
+	uint64x2_t wide;
+	u64_t wsum;
+
+	/* at most 2047 blocks, the 32 bit lanes cannot overflow */
+	while (len >= 32) {
+		v0 = vld1q_u8(ps);
+		v1 = vld1q_u8(ps + 16);
+		vst1q_u8(pd, v0);
+		vst1q_u8(pd + 16, v1);
+		acc0 = vpadalq_u16(acc0, vreinterpretq_u16_u8(v0));
+		acc1 = vpadalq_u16(acc1, vreinterpretq_u16_u8(v1));
+		ps += 32;
+		pd += 32;
+		len -= 32;
+	}
+	wide = vaddq_u64(vpaddlq_u32(acc0), vpaddlq_u32(acc1));
+	wsum = vgetq_lane_u64(wide, 0) + vgetq_lane_u64(wide, 1);
+	wsum = (wsum & 0xFFFFFFFFULL) + (wsum >> 32);
+	wsum = (wsum & 0xFFFFFFFFULL) + (wsum >> 32);
+	sum = FOLD_U32T((u32_t)wsum);
+#else /* __ARM_NEON */
+	if (((mem_ptr_t)pd | (mem_ptr_t)ps) & 3) {
+		/* LDM/STM need both sides word aligned */
+		MEMCPY(dst, src, len);
+		return sys_arch_chksum(dst, len);
+	}
+	while (len >= 32) {
+		__asm__ volatile (
+			"ldmia	%[s]!, {r4, r5, r6, r8}\n\t"
+			"stmia	%[d]!, {r4, r5, r6, r8}\n\t"
+			"adds	%[a], %[a], r4\n\t"
+			"adcs	%[a], %[a], r5\n\t"
+			"adcs	%[a], %[a], r6\n\t"
+			"adcs	%[a], %[a], r8\n\t"
+			"ldmia	%[s]!, {r4, r5, r6, r8}\n\t"
+			"stmia	%[d]!, {r4, r5, r6, r8}\n\t"
+			"adcs	%[a], %[a], r4\n\t"
+			"adcs	%[a], %[a], r5\n\t"
+			"adcs	%[a], %[a], r6\n\t"
+			"adcs	%[a], %[a], r8\n\t"
+			"adc	%[a], %[a], #0\n\t"
+			: [a] "+r" (sum), [s] "+r" (ps), [d] "+r" (pd)
+			:
+			: "r4", "r5", "r6", "r8", "cc", "memory");
+		len -= 32;
+	}
+	sum = FOLD_U32T(sum);
+#endif /* __ARM_NEON */
+
+	while (len > 1) {
+		SMEMCPY(&w, ps, 2);
+		SMEMCPY(pd, &w, 2);
+		sum += w;
+		ps += 2;
+		pd += 2;
+		len -= 2;
+	}
+	if (len > 0) {
+		*pd = *ps;
+		((u8_t *)&t)[0] = *ps;
+	}
+	sum += t;
+
+	sum = FOLD_U32T(sum);
+	sum = FOLD_U32T(sum);
+	return (u16_t)sum;
+}
+#endif /* LWIP_CHECKSUM_ON_COPY */
+
+#endif /* SYS_ARCH_CHKSUM */
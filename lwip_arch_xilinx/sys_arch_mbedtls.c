@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * Copyright (C) 2007 - 2022 Xilinx, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+/*
+ * mbedTLS block functions on the ARMv8 Crypto Extensions, selected by
+ * arch/mbedtls_accel.h. They work on the contexts the software key schedule
+ * and mbedtls_shaX_starts() set up, so only the inner loops change.
+ */
+
+#include "lwip/opt.h"
+#include "lwip/apps/altcp_tls_mbedtls_opts.h"
+#include "lwip/apps/snmp_opts.h"
+
+#if LWIP_ALTCP_TLS_MBEDTLS || LWIP_SNMP_V3_MBEDTLS
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#include "arch/mbedtls_accel.h"
+
+#if SYS_ARCH_MBEDTLS_ACCEL
+
+#include <arm_neon.h>
+
+#if defined(MBEDTLS_AES_C)
+#include "mbedtls/aes.h"
+
+#if defined(MBEDTLS_AES_ENCRYPT_ALT)
+/* mbedtls_aes_setkey_enc() stores the round keys as little endian words,
+ * which is the byte order AESE expects */
+int
+mbedtls_internal_aes_encrypt(mbedtls_aes_context *ctx, const unsigned char input[16],
+                             unsigned char output[16])
+{
+	const uint8_t *rk = (const uint8_t *)ctx->rk;
+	uint8x16_t s = vld1q_u8(input);
+	int i;
+
+	for (i = 0; i < ctx->nr - 1; i++, rk += 16) {
+		s = vaesmcq_u8(vaeseq_u8(s, vld1q_u8(rk)));
+	}
+	s = vaeseq_u8(s, vld1q_u8(rk));
+	s = veorq_u8(s, vld1q_u8(rk + 16));
+	vst1q_u8(output, s);
+
+	return 0;
+}
+#endif /* MBEDTLS_AES_ENCRYPT_ALT */
+
+#if defined(MBEDTLS_AES_DECRYPT_ALT)
+/* mbedtls_aes_setkey_dec() already builds the equivalent inverse cipher
+ * schedule (reversed, InvMixColumns applied to the inner keys), which is
+ * what AESD/AESIMC take */
+int
+mbedtls_internal_aes_decrypt(mbedtls_aes_context *ctx, const unsigned char input[16],
+                             unsigned char output[16])
+{
+	const uint8_t *rk = (const uint8_t *)ctx->rk;
+	uint8x16_t s = vld1q_u8(input);
+	int i;
+
+	for (i = 0; i < ctx->nr - 1; i++, rk += 16) {
+		s = vaesimcq_u8(vaesdq_u8(s, vld1q_u8(rk)));
+	}
+	s = vaesdq_u8(s, vld1q_u8(rk));
+	s = veorq_u8(s, vld1q_u8(rk + 16));
+	vst1q_u8(output, s);
+
+	return 0;
+}
+#endif /* MBEDTLS_AES_DECRYPT_ALT */
+#endif /* MBEDTLS_AES_C */
+
+#if defined(MBEDTLS_SHA256_C) && defined(MBEDTLS_SHA256_PROCESS_ALT)
+#include "mbedtls/sha256.h"
+
+static const uint32_t sys_arch_sha256_k[64] = {
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+int
+mbedtls_internal_sha256_process(mbedtls_sha256_context *ctx, const unsigned char data[64])
+{
+	uint32x4_t abcd = vld1q_u32(&ctx->state[0]);
+	uint32x4_t efgh = vld1q_u32(&ctx->state[4]);
+	uint32x4_t abcd_in = abcd, efgh_in = efgh;
+	uint32x4_t m[4], wk, prev;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+	}
+	/* four rounds per step, the schedule is extended in place from the fifth on */
+	for (i = 0; i < 16; i++) {
+		if (i >= 4) {
+			m[i & 3] = vsha256su1q_u32(vsha256su0q_u32(m[i & 3], m[(i + 1) & 3]),
+			                           m[(i + 2) & 3], m[(i + 3) & 3]);
+		}
+		wk = vaddq_u32(m[i & 3], vld1q_u32(&sys_arch_sha256_k[4 * i]));
+		prev = abcd;
+		abcd = vsha256hq_u32(abcd, efgh, wk);
+		efgh = vsha256h2q_u32(efgh, prev, wk);
+	}
+	vst1q_u32(&ctx->state[0], vaddq_u32(abcd, abcd_in));
+	vst1q_u32(&ctx->state[4], vaddq_u32(efgh, efgh_in));
+
+	return 0;
+}
+#endif /* MBEDTLS_SHA256_C && MBEDTLS_SHA256_PROCESS_ALT */
+
+#if defined(MBEDTLS_SHA1_C) && defined(MBEDTLS_SHA1_PROCESS_ALT)
+#include "mbedtls/sha1.h"
+
+static const uint32_t sys_arch_sha1_k[4] = {
+	0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6
+};
+
+int
+mbedtls_internal_sha1_process(mbedtls_sha1_context *ctx, const unsigned char data[64])
+{
+	uint32x4_t abcd = vld1q_u32(&ctx->state[0]);
+	uint32x4_t abcd_in = abcd;
+	uint32_t e = ctx->state[4];
+	uint32x4_t m[4], wk;
+	uint32_t e_next;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+	}
+	/* four rounds per step: Ch for rounds 0-19, Maj for 40-59, parity otherwise */
+	for (i = 0; i < 20; i++) {
+		if (i >= 4) {
+			m[i & 3] = vsha1su1q_u32(vsha1su0q_u32(m[i & 3], m[(i + 1) & 3], m[(i + 2) & 3]),
+			                         m[(i + 3) & 3]);
+		}
+		wk = vaddq_u32(m[i & 3], vdupq_n_u32(sys_arch_sha1_k[i / 5]));
+		e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		if (i < 5) {
+			abcd = vsha1cq_u32(abcd, e, wk);
+		} else if (i >= 10 && i < 15) {
+			abcd = vsha1mq_u32(abcd, e, wk);
+		} else {
+			abcd = vsha1pq_u32(abcd, e, wk);
+		}
+		e = e_next;
+	}
+	vst1q_u32(&ctx->state[0], vaddq_u32(abcd, abcd_in));
+	ctx->state[4] += e;
+
+	return 0;
+}
+#endif /* MBEDTLS_SHA1_C && MBEDTLS_SHA1_PROCESS_ALT */
+
+#endif /* SYS_ARCH_MBEDTLS_ACCEL */
+
+#endif /* LWIP_ALTCP_TLS_MBEDTLS || LWIP_SNMP_V3_MBEDTLS */
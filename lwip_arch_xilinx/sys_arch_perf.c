@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2001-2003 Swedish Institute of Computer Science.
+ * Copyright (C) 2007 - 2022 Xilinx, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+/*
+ * Cycle counter probes behind PERF_START/PERF_STOP, see arch/perf.h. The
+ * statistics can be read back with perf_get_probe() and perf_get_trace(),
+ * e.g. by freertos/net_bench.c, which sends them over the rpmsg link.
+ */
+
+#include <string.h>
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/sys.h"
+
+#if LWIP_PERF
+
+static struct perf_probe perf_probes[PERF_MAX_PROBES];
+static u8_t perf_num_probes;
+#if PERF_TRACE_LEN
+static struct perf_trace_entry perf_trace[PERF_TRACE_LEN];
+static u32_t perf_trace_next;        /* entries ever written */
+#endif
+
+void
+perf_init(char *fname)
+{
+	LWIP_UNUSED_ARG(fname);
+
+#if defined(PERF_CYCLES_INIT)
+	PERF_CYCLES_INIT();
+#elif defined(__aarch64__)
+	u64_t pmcr;
+
+	/* enable the counters, reset and start the cycle counter */
+	__asm__ volatile ("mrs %0, pmcr_el0" : "=r" (pmcr));
+	__asm__ volatile ("msr pmcr_el0, %0" : : "r" (pmcr | 0x5));
+	__asm__ volatile ("msr pmcntenset_el0, %0" : : "r" ((u64_t)1 << 31));
+	__asm__ volatile ("isb");
+#elif defined(__arm__)
+	u32_t pmcr;
+
+	__asm__ volatile ("mrc p15, 0, %0, c9, c12, 0" : "=r" (pmcr));
+	__asm__ volatile ("mcr p15, 0, %0, c9, c12, 0" : : "r" (pmcr | 0x5));
+	__asm__ volatile ("mcr p15, 0, %0, c9, c12, 1" : : "r" (1UL << 31));
+	__asm__ volatile ("isb");
+#endif
+
+	perf_reset();
+}
+
+/* Find or add the probe called name, returns its id (index + 1) or 0 */
+static u8_t
+perf_probe_lookup(const char *name)
+{
+	u8_t i;
+
+	/* the same name at several PERF_STOPs makes one probe */
+	for (i = 0; i < perf_num_probes; i++) {
+		if (strcmp(perf_probes[i].name, name) == 0) {
+			return (u8_t)(i + 1);
+		}
+	}
+	if (perf_num_probes == PERF_MAX_PROBES) {
+		return 0;
+	}
+	perf_probes[perf_num_probes].name = name;
+	perf_probes[perf_num_probes].min = 0xFFFFFFFFUL;
+	return ++perf_num_probes;
+}
+
+void
+perf_record(u8_t *id, const char *name, u32_t start)
+{
+	u32_t cycles = PERF_CYCLES() - start;
+	struct perf_probe *probe;
+	u8_t bucket = 0;
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	/* probes run in the tcpip thread and in the RPMsg callback */
+	SYS_ARCH_PROTECT(lev);
+	if (*id == 0) {
+		*id = perf_probe_lookup(name);
+		if (*id == 0) {
+			SYS_ARCH_UNPROTECT(lev);
+			return;
+		}
+	}
+	probe = &perf_probes[*id - 1];
+
+	probe->count++;
+	probe->sum += cycles;
+	if (cycles < probe->min) {
+		probe->min = cycles;
+	}
+	if (cycles > probe->max) {
+		probe->max = cycles;
+	}
+	while (bucket < PERF_HIST_BUCKETS - 1 && (cycles >> (bucket + 1)) != 0) {
+		bucket++;
+	}
+	probe->hist[bucket]++;
+
+#if PERF_TRACE_LEN
+	{
+		struct perf_trace_entry *e = &perf_trace[perf_trace_next % PERF_TRACE_LEN];
+
+		e->start = start;
+		e->cycles = cycles;
+		e->probe = (u8_t)(*id - 1);
+		perf_trace_next++;
+	}
+#endif
+	SYS_ARCH_UNPROTECT(lev);
+}
+
+/* Probe names and ids stay, only what they measured is cleared */
+void
+perf_reset(void)
+{
+	u8_t i;
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	for (i = 0; i < perf_num_probes; i++) {
+		struct perf_probe *probe = &perf_probes[i];
+
+		probe->count = 0;
+		probe->min = 0xFFFFFFFFUL;
+		probe->max = 0;
+		probe->sum = 0;
+		memset(probe->hist, 0, sizeof(probe->hist));
+	}
+#if PERF_TRACE_LEN
+	perf_trace_next = 0;
+#endif
+	SYS_ARCH_UNPROTECT(lev);
+}
+
+int
+perf_get_probe(u8_t index, struct perf_probe *out)
+{
+	int ret = 0;
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	if (index < perf_num_probes) {
+		*out = perf_probes[index];
+		if (out->count == 0) {
+			out->min = 0;
+		}
+		ret = 1;
+	}
+	SYS_ARCH_UNPROTECT(lev);
+
+	return ret;
+}
+
+u32_t
+perf_get_trace(u32_t *pos, struct perf_trace_entry *out, u32_t max)
+{
+	u32_t n = 0;
+#if PERF_TRACE_LEN
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	if (perf_trace_next > PERF_TRACE_LEN && *pos < perf_trace_next - PERF_TRACE_LEN) {
+		*pos = perf_trace_next - PERF_TRACE_LEN;
+	}
+	while (n < max && *pos < perf_trace_next) {
+		out[n++] = perf_trace[*pos % PERF_TRACE_LEN];
+		(*pos)++;
+	}
+	SYS_ARCH_UNPROTECT(lev);
+#else
+	LWIP_UNUSED_ARG(pos);
+	LWIP_UNUSED_ARG(out);
+	LWIP_UNUSED_ARG(max);
+#endif
+
+	return n;
+}
+
+#endif /* LWIP_PERF */
@@ -36,6 +36,50 @@
 #include "arch/cc.h"
 #include "lwip/sys.h"
 
+#if SYS_ARCH_PROTECT_SMP
+/*
+ * With SYS_ARCH_PROTECT_SMP the interrupt mask only keeps out this core, so the
+ * region is also guarded by a spinlock shared by all cores. The lock remembers
+ * the core holding it, which lets that core nest protected regions as lwIP
+ * expects. Most counters never get here: sys_arch.h maps SYS_ARCH_INC/DEC/
+ * GET/SET to atomics in this mode.
+ */
+#define SYS_ARCH_LOCK_FREE 0xFFFFFFFFU
+
+static u32_t sys_arch_lock_owner = SYS_ARCH_LOCK_FREE;
+static u32_t sys_arch_lock_depth;
+
+sys_prot_t
+sys_arch_protect()
+{
+	sys_prot_t cur;
+	u32_t core;
+	u32_t expected;
+
+	cur = mfcpsr();
+	mtcpsr(cur | 0xC0);
+
+	core = sys_arch_core_id();
+	if (__atomic_load_n(&sys_arch_lock_owner, __ATOMIC_RELAXED) != core) {
+		do {
+			expected = SYS_ARCH_LOCK_FREE;
+		} while (!__atomic_compare_exchange_n(&sys_arch_lock_owner, &expected, core,
+				0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+	}
+	sys_arch_lock_depth++;
+
+	return cur;
+}
+
+void
+sys_arch_unprotect(sys_prot_t lev)
+{
+	if (--sys_arch_lock_depth == 0) {
+		__atomic_store_n(&sys_arch_lock_owner, SYS_ARCH_LOCK_FREE, __ATOMIC_RELEASE);
+	}
+	mtcpsr(lev);
+}
+#else
 /*
  * This optional function does a "fast" critical region protection and returns
  * the previous protection level. This function is only called during very short
@@ -80,3 +124,4 @@ sys_arch_unprotect(sys_prot_t lev)
 	mtmsr(lev);
 #endif
 }
+#endif /* SYS_ARCH_PROTECT_SMP */
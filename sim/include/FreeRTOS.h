@@ -0,0 +1,25 @@
+#pragma once
+
+/* The part of the FreeRTOS API the remote-side code uses, for the host build (LWIP_HOST_SIM).
+ * Tasks are lwIP sys_arch threads, see lwip_arch_posix. */
+
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define configTICK_RATE_HZ 1000
+#define configMINIMAL_STACK_SIZE 1024
+#define configGENERATE_RUN_TIME_STATS 0
+
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+
+/* The woken thread runs when Linux schedules it */
+#define portYIELD_FROM_ISR(x) ((void)(x))
@@ -0,0 +1,3 @@
+#pragma once
+
+/* Included by rpmsg_eth.c, nothing in it is used on the host */
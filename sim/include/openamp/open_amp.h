@@ -0,0 +1,75 @@
+#pragma once
+
+/* The part of the OpenAMP RPMsg API the remote-side code uses, for the host build
+ * (LWIP_HOST_SIM). Implemented by the in-process link in sim/rpmsg_sim.c; signatures and error
+ * codes are those of OpenAMP. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RPMSG_ADDR_ANY 0xFFFFFFFFU
+#define RPMSG_NAME_SIZE 32
+
+#define RPMSG_SUCCESS 0
+#define RPMSG_ERROR_BASE -2000
+#define RPMSG_ERR_NO_MEM (RPMSG_ERROR_BASE - 1)
+#define RPMSG_ERR_NO_BUFF (RPMSG_ERROR_BASE - 2)
+#define RPMSG_ERR_PARAM (RPMSG_ERROR_BASE - 3)
+#define RPMSG_ERR_DEV_STATE (RPMSG_ERROR_BASE - 4)
+#define RPMSG_ERR_BUFF_SIZE (RPMSG_ERROR_BASE - 5)
+#define RPMSG_ERR_INIT (RPMSG_ERROR_BASE - 6)
+#define RPMSG_ERR_ADDR (RPMSG_ERROR_BASE - 7)
+
+#define metal_container_of(ptr, structure, member) \
+    (void*)((uintptr_t)(ptr) - offsetof(structure, member))
+
+struct rpmsg_endpoint;
+
+typedef int (*rpmsg_ept_cb)(struct rpmsg_endpoint* ept, void* data, size_t len, uint32_t src, void* priv);
+typedef void (*rpmsg_ns_unbind_cb)(struct rpmsg_endpoint* ept);
+
+struct rpmsg_device {
+    void* link;             // struct rpmsg_sim
+};
+
+struct rpmsg_endpoint {
+    char name[RPMSG_NAME_SIZE];
+    struct rpmsg_device* rdev;
+    uint32_t addr;
+    uint32_t dest_addr;     // learned from the first message when created with RPMSG_ADDR_ANY
+    rpmsg_ept_cb cb;
+    rpmsg_ns_unbind_cb ns_unbind_cb;
+    void* priv;
+};
+
+/* One direction of the link, see sim/rpmsg_sim.c */
+struct virtqueue;
+
+struct rpmsg_virtio_device {
+    struct rpmsg_device rdev;
+    struct virtqueue* rvq;  // host to remote, drained by virtqueue_notification()
+    struct virtqueue* svq;  // remote to host
+};
+
+int rpmsg_create_ept(struct rpmsg_endpoint* ept, struct rpmsg_device* rdev, const char* name,
+                     uint32_t src, uint32_t dest, rpmsg_ept_cb cb, rpmsg_ns_unbind_cb ns_unbind_cb);
+void rpmsg_destroy_ept(struct rpmsg_endpoint* ept);
+
+int rpmsg_send(struct rpmsg_endpoint* ept, const void* data, int len);
+int rpmsg_sendto(struct rpmsg_endpoint* ept, const void* data, int len, uint32_t dst);
+int rpmsg_trysend(struct rpmsg_endpoint* ept, const void* data, int len);
+
+void* rpmsg_get_tx_payload_buffer(struct rpmsg_endpoint* ept, uint32_t* len, int wait);
+int rpmsg_send_nocopy(struct rpmsg_endpoint* ept, const void* data, int len);
+
+void rpmsg_hold_rx_buffer(struct rpmsg_endpoint* ept, void* rxbuf);
+void rpmsg_release_rx_buffer(struct rpmsg_endpoint* ept, void* rxbuf);
+
+int rpmsg_virtio_get_buffer_size(struct rpmsg_device* rdev);
+
+/* Runs the endpoint callbacks for every message waiting in vq, the IPI handler's job */
+void virtqueue_notification(struct virtqueue* vq);
+
+/* Stop and restart kicks for vq; enabling returns nonzero when messages are already waiting */
+void virtqueue_disable_cb(struct virtqueue* vq);
+int virtqueue_enable_cb(struct virtqueue* vq);
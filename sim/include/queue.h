@@ -0,0 +1,3 @@
+#pragma once
+
+/* Nothing the remote-side code uses directly; lwIP mailboxes are in lwip_arch_posix */
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <sched.h>
+
+#include "FreeRTOS.h"
+#include "lwip/sys.h"
+
+typedef sys_thread_t TaskHandle_t;
+
+#define tskIDLE_PRIORITY 0
+
+#define xTaskNotifyGive(t) (sys_arch_thread_notify(t), pdPASS)
+#define vTaskNotifyGiveFromISR(t, woken) do { sys_arch_thread_notify(t); *(woken) = pdTRUE; } while (0)
+#define ulTaskNotifyTake(clear, ticks) sys_arch_thread_notify_take((clear), (ticks))
+#define taskYIELD() sched_yield()
@@ -0,0 +1,1226 @@
+// The remote-side network stack on a workstation: lwIP, rpmsg_eth and net_bench built for Linux
+// userspace (LWIP_HOST_SIM) and linked over the in-process link of rpmsg_sim.c, with this program
+// as the host end in place of the Linux driver. The point is to measure and profile the stack's
+// hot path with the usual tools (perf record -g, flamegraphs, valgrind) and to catch regressions
+// before the firmware goes onto a board. Numbers are those of the workstation, not of the R5 or
+// the A53; compare runs with each other, not with the hardware.
+//
+// By default the host end runs the tests of linux/bench/rpmsg_bench.c itself, crafting the UDP
+// frames for net_bench: one JSON object per line on stdout, same keys, and -b compares with an
+// earlier run the same way. With -I, frames are bridged to a TAP interface instead, so that
+// rpmsg_bench, ping or iperf can talk to the stack through the Linux stack:
+//
+//     ip tuntap add tap0 mode tap user $USER
+//     ip addr add 10.43.0.1/16 dev tap0 && ip link set tap0 up
+//     rpmsg_eth_sim -I tap0 &
+//     rpmsg_bench 10.43.0.3
+//
+// With -r, a capture of real traffic is played into the stack instead, see run_replay():
+//
+//     rpmsg_pcap -Q in -w prod.pcap       # on the board, Linux side
+//     rpmsg_eth_sim -r prod.pcap -t 5
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/if_tun.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lwip/def.h"
+#include "lwip/ip.h"
+#include "lwip/memp.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/stats.h"
+#include "lwip/tcpip.h"
+#include "netif/ethernet.h"
+
+#include "net_bench.h"
+#include "network.h"
+#include "rpmsg_sim.h"
+
+// Link protocol, must match freertos/rpmsg_eth.c
+#define RPMSG_ETH_HELLO_MAGIC 0x52455448
+#define RPMSG_ETH_HELLO_VERSION 1
+#define RPMSG_ETH_F_PACK 0x00000001UL
+#define RPMSG_ETH_F_CSUM 0x00000002UL
+
+struct rpmsg_eth_frag_hdr {
+    uint16_t frame_len;
+    uint16_t offset;
+};
+
+struct rpmsg_eth_hello {
+    struct rpmsg_eth_frag_hdr hdr;
+    uint32_t magic;
+    uint16_t version;
+    uint16_t mtu;
+    uint16_t buf_size;
+    uint8_t num_queues;
+    uint8_t reserved;
+    uint32_t features;
+    uint8_t mac[6];
+    uint16_t tso_max;
+} __attribute__((packed));
+
+// Control protocol of freertos/net_bench.c, all fields in network order
+#define NET_BENCH_MAGIC 0x52424354
+#define NET_BENCH_CMD_RESET 1
+#define NET_BENCH_CMD_QUERY 2
+#define NET_BENCH_F_LINK 0x02
+
+struct net_bench_request {
+    uint32_t magic;
+    uint32_t cmd;
+    uint32_t seq;
+    uint32_t arg;
+};
+
+struct net_bench_reply {
+    uint32_t magic;
+    uint32_t cmd;
+    uint32_t seq;
+    uint32_t flags;
+    uint32_t sink_packets;
+    uint32_t sink_bytes_lo;
+    uint32_t sink_bytes_hi;
+    uint32_t echo_packets;
+    uint32_t rx_msgs;
+    uint32_t rx_frames;
+    uint32_t tx_msgs;
+    uint32_t tx_frames;
+    uint32_t cpu_idle;
+    uint32_t cpu_total;
+};
+
+#define ETH_HDR_LEN 14
+#define IP_HDR_LEN 20
+#define UDP_HDR_LEN 8
+#define UDP_IP_HDR_LEN (IP_HDR_LEN + UDP_HDR_LEN)
+#define MAX_FRAME 65535
+#define MAX_SIZES 32
+
+#define HOST_IP 0x0A2B0001UL     // 10.43.0.1, the gateway of network_init()
+#define REMOTE_IP 0x0A2B0003UL   // 10.43.0.3
+#define HOST_PORT 40000
+
+struct sim_opts {
+    uint32_t num_bufs;
+    uint32_t buf_size;
+    const char* tap;
+    int echo_port;
+    int sink_port;
+    int mtu;
+    int sizes[MAX_SIZES];
+    int num_sizes;
+    double duration;
+    int samples;
+    int timeout_ms;
+    int run_throughput;
+    int run_latency;
+    const char* baseline;
+    double tolerance;
+    const char* replay;
+    int direct;
+};
+
+// The host end of the link: the hello, and frames cut into and put together from messages
+struct peer {
+    struct rpmsg_sim* sim;
+    uint32_t ept;               // the remote's queue 0
+    uint32_t max_msg;           // largest message the remote takes
+    uint8_t mac[6];
+    uint8_t remote_mac[6];
+    int builtin;                // answer ARP for HOST_IP
+    uint8_t msg[MAX_FRAME];     // message being taken apart
+    int msg_len;
+    int msg_pos;
+    uint8_t frame[MAX_FRAME];   // frame being put together
+    int frame_len;
+    int frame_have;
+    uint8_t arp[64];
+};
+
+static uint32_t ctl_seq;
+static uint16_t ip_id;
+static int regressions;
+
+static double ts_diff(const struct timespec* a, const struct timespec* b)
+{
+    return (double)(b->tv_sec - a->tv_sec) + (double)(b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static double cpu_seconds(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+           (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static void put16(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    put16(p, (uint16_t)(v >> 16));
+    put16(p + 2, (uint16_t)v);
+}
+
+static uint16_t get16(const uint8_t* p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+static int peer_send_msg(struct peer* peer, const void* msg, uint32_t len)
+{
+    return rpmsg_sim_send(peer->sim, peer->ept, msg, len, 1000);
+}
+
+// One frame, in as many messages as it takes
+static int peer_send_frame(struct peer* peer, const uint8_t* frame, int len)
+{
+    uint8_t msg[MAX_FRAME];
+    uint32_t chunk = peer->max_msg - sizeof(struct rpmsg_eth_frag_hdr);
+    int offset;
+
+    for (offset = 0; offset < len; offset += (int)chunk) {
+        struct rpmsg_eth_frag_hdr* hdr = (struct rpmsg_eth_frag_hdr*)msg;
+        uint32_t n = (uint32_t)(len - offset) < chunk ? (uint32_t)(len - offset) : chunk;
+
+        hdr->frame_len = lwip_htons((uint16_t)len);
+        hdr->offset = lwip_htons((uint16_t)offset);
+        memcpy(hdr + 1, frame + offset, n);
+        if (peer_send_msg(peer, msg, (uint32_t)sizeof(*hdr) + n) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void peer_send_hello(struct peer* peer, uint32_t features)
+{
+    struct rpmsg_eth_hello hello;
+
+    memset(&hello, 0, sizeof(hello));
+    hello.magic = lwip_htonl(RPMSG_ETH_HELLO_MAGIC);
+    hello.version = lwip_htons(RPMSG_ETH_HELLO_VERSION);
+    hello.mtu = lwip_htons(1500);
+    hello.buf_size = lwip_htons((uint16_t)peer->max_msg);
+    hello.num_queues = 1;
+    hello.features = lwip_htonl(features);
+    memcpy(hello.mac, peer->mac, sizeof(hello.mac));
+    peer_send_msg(peer, &hello, sizeof(hello));
+}
+
+static void peer_control(struct peer* peer, const uint8_t* msg, int len)
+{
+    const struct rpmsg_eth_hello* hello = (const struct rpmsg_eth_hello*)msg;
+
+    // the multicast filter and everything else is of no interest here
+    if (len < (int)sizeof(*hello) || lwip_ntohl(hello->magic) != RPMSG_ETH_HELLO_MAGIC) {
+        return;
+    }
+    memcpy(peer->remote_mac, hello->mac, sizeof(peer->remote_mac));
+    if (lwip_ntohs(hello->buf_size) > sizeof(struct rpmsg_eth_frag_hdr) &&
+        lwip_ntohs(hello->buf_size) < peer->max_msg) {
+        peer->max_msg = lwip_ntohs(hello->buf_size);
+    }
+}
+
+// Answer who-has HOST_IP, the remote asks before it sends anything to us
+static int peer_arp(struct peer* peer, const uint8_t* f, int len)
+{
+    uint8_t* r = peer->arp;
+
+    if (len < ETH_HDR_LEN + 28 || get16(f + 12) != 0x0806 || get16(f + 20) != 1 ||
+        get32(f + 38) != HOST_IP) {
+        return 0;
+    }
+    memcpy(r, f + 6, 6);
+    memcpy(r + 6, peer->mac, 6);
+    put16(r + 12, 0x0806);
+    put16(r + 14, 1);           // Ethernet
+    put16(r + 16, 0x0800);      // IPv4
+    r[18] = 6;
+    r[19] = 4;
+    put16(r + 20, 2);           // reply
+    memcpy(r + 22, peer->mac, 6);
+    put32(r + 28, HOST_IP);
+    memcpy(r + 32, f + 22, 10); // sender's MAC and IP
+    peer_send_frame(peer, r, ETH_HDR_LEN + 28);
+    return 1;
+}
+
+// The next frame from the remote, -1 if none came within timeout_ms
+static int peer_recv_frame(struct peer* peer, uint8_t** frame, int timeout_ms)
+{
+    for (;;) {
+        const struct rpmsg_eth_frag_hdr* hdr;
+        int frame_len, offset, frag_len, remain;
+
+        if (peer->msg_pos + (int)sizeof(*hdr) > peer->msg_len) {
+            peer->msg_len = rpmsg_sim_recv(peer->sim, peer->msg, sizeof(peer->msg), NULL, timeout_ms);
+            peer->msg_pos = 0;
+            if (peer->msg_len < 0) {
+                peer->msg_len = 0;
+                return -1;
+            }
+            continue;
+        }
+
+        hdr = (const struct rpmsg_eth_frag_hdr*)(peer->msg + peer->msg_pos);
+        frame_len = lwip_ntohs(hdr->frame_len);
+        offset = lwip_ntohs(hdr->offset);
+        if (frame_len == 0) {
+            peer_control(peer, peer->msg, peer->msg_len);
+            peer->msg_len = 0;
+            continue;
+        }
+
+        // records are back to back, each ends at its frame's end or the message's
+        remain = peer->msg_len - peer->msg_pos - (int)sizeof(*hdr);
+        frag_len = frame_len - offset < remain ? frame_len - offset : remain;
+        if (offset == 0) {
+            peer->frame_have = 0;
+            peer->frame_len = frame_len;
+        }
+        if (offset != peer->frame_have || frame_len != peer->frame_len || frag_len < 0) {
+            peer->frame_have = -1;  // lost the start, skip up to the next one
+        } else {
+            memcpy(peer->frame + offset, hdr + 1, (size_t)frag_len);
+            peer->frame_have += frag_len;
+        }
+        peer->msg_pos += (int)sizeof(*hdr) + (frag_len > 0 ? frag_len : remain);
+
+        if (peer->frame_have == peer->frame_len) {
+            peer->frame_have = -1;
+            if (peer->builtin && peer_arp(peer, peer->frame, peer->frame_len)) {
+                continue;
+            }
+            *frame = peer->frame;
+            return peer->frame_len;
+        }
+    }
+}
+
+static uint16_t ip_chksum(const uint8_t* p, int len)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i + 1 < len; i += 2) {
+        sum += get16(p + i);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+// An unfragmented datagram to the remote, without UDP checksum
+static int build_udp(const struct peer* peer, uint8_t* f, int dport, const void* payload, int len)
+{
+    uint8_t* ip = f + ETH_HDR_LEN;
+    uint8_t* udp = ip + IP_HDR_LEN;
+
+    memcpy(f, peer->remote_mac, 6);
+    memcpy(f + 6, peer->mac, 6);
+    put16(f + 12, 0x0800);
+    memset(ip, 0, IP_HDR_LEN);
+    ip[0] = 0x45;
+    put16(ip + 2, (uint16_t)(UDP_IP_HDR_LEN + len));
+    put16(ip + 4, ip_id++);
+    put16(ip + 6, 0x4000);      // DF
+    ip[8] = 64;
+    ip[9] = 17;
+    put32(ip + 12, HOST_IP);
+    put32(ip + 16, REMOTE_IP);
+    put16(ip + 10, ip_chksum(ip, IP_HDR_LEN));
+    put16(udp, HOST_PORT);
+    put16(udp + 2, (uint16_t)dport);
+    put16(udp + 4, (uint16_t)(UDP_HDR_LEN + len));
+    put16(udp + 6, 0);
+    memcpy(udp + UDP_HDR_LEN, payload, (size_t)len);
+    return ETH_HDR_LEN + UDP_IP_HDR_LEN + len;
+}
+
+// The payload of a datagram from the remote's port sport to us, NULL for anything else
+static const uint8_t* parse_udp(const uint8_t* f, int len, int sport, int* payload_len)
+{
+    const uint8_t* ip = f + ETH_HDR_LEN;
+    const uint8_t* udp;
+    int ihl;
+
+    if (len < ETH_HDR_LEN + UDP_IP_HDR_LEN || get16(f + 12) != 0x0800 || ip[9] != 17) {
+        return NULL;
+    }
+    ihl = (ip[0] & 0x0F) * 4;
+    udp = ip + ihl;
+    if (ETH_HDR_LEN + ihl + UDP_HDR_LEN > len || get16(udp) != sport || get16(udp + 2) != HOST_PORT) {
+        return NULL;
+    }
+    *payload_len = get16(udp + 4) - UDP_HDR_LEN;
+    if (*payload_len < 0 || udp + UDP_HDR_LEN + *payload_len > f + len) {
+        return NULL;
+    }
+    return udp + UDP_HDR_LEN;
+}
+
+// One control request, retried a few times as in rpmsg_bench
+static int ctl_request(struct peer* peer, const struct sim_opts* opts, uint32_t cmd, struct net_bench_reply* r)
+{
+    static uint8_t f[ETH_HDR_LEN + UDP_IP_HDR_LEN + sizeof(struct net_bench_request)];
+    struct net_bench_request req;
+    int tries;
+
+    for (tries = 0; tries < 5; tries++) {
+        struct timespec t0, now;
+        uint8_t* frame;
+        int len;
+
+        req.magic = lwip_htonl(NET_BENCH_MAGIC);
+        req.cmd = lwip_htonl(cmd);
+        req.seq = lwip_htonl(++ctl_seq);
+        req.arg = 0;
+        if (peer_send_frame(peer, f, build_udp(peer, f, opts->sink_port, &req, sizeof(req))) < 0) {
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        do {
+            const uint8_t* p;
+            int plen;
+
+            if ((len = peer_recv_frame(peer, &frame, 500)) < 0) {
+                break;
+            }
+            p = parse_udp(frame, len, opts->sink_port, &plen);
+            if (p != NULL && plen >= 16 && get32(p) == NET_BENCH_MAGIC && get32(p + 8) == ctl_seq) {
+                memset(r, 0, sizeof(*r));
+                memcpy(r, p, (size_t)plen < sizeof(*r) ? (size_t)plen : sizeof(*r));
+                return 0;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        } while (ts_diff(&t0, &now) < 0.5);
+    }
+    fprintf(stderr, "rpmsg_eth_sim: no answer from net_bench\n");
+    return -1;
+}
+
+// Let the stack settle, then read its counters less the query's own message and frame
+static int ctl_finish(struct peer* peer, const struct sim_opts* opts, struct net_bench_reply* r)
+{
+    struct timespec drain = { 0, 200 * 1000 * 1000 };
+
+    nanosleep(&drain, NULL);
+    if (ctl_request(peer, opts, NET_BENCH_CMD_QUERY, r) < 0) {
+        return -1;
+    }
+    r->rx_msgs = lwip_ntohl(r->rx_msgs);
+    r->tx_msgs = lwip_ntohl(r->tx_msgs);
+    r->rx_msgs -= r->rx_msgs > 0;
+    r->tx_msgs -= r->tx_msgs > 0;
+    return 0;
+}
+
+// Messages the remote took and sent per packet, and what the whole process spent on it
+static void print_costs(const struct net_bench_reply* r, double cpu, unsigned long long packets)
+{
+    double pkts = packets ? (double)packets : 1.0;
+
+    printf(",\"cpu_us_per_pkt\":%.3f", cpu * 1e6 / pkts);
+    if (lwip_ntohl(r->flags) & NET_BENCH_F_LINK) {
+        printf(",\"remote_rx_msgs_per_pkt\":%.3f,\"remote_tx_msgs_per_pkt\":%.3f",
+               (double)r->rx_msgs / pkts, (double)r->tx_msgs / pkts);
+    }
+}
+
+// Same as in rpmsg_bench, so either one's output can be the baseline of the other
+static void check_baseline(const struct sim_opts* opts, const char* test, int size, const char* key,
+                           double value, int higher_is_better)
+{
+    char line[1024], prefix[64], field[64];
+    FILE* f;
+
+    if (opts->baseline == NULL || (f = fopen(opts->baseline, "r")) == NULL) {
+        return;
+    }
+    snprintf(prefix, sizeof(prefix), "{\"test\":\"%s\",\"size\":%d,", test, size);
+    snprintf(field, sizeof(field), "\"%s\":", key);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char* p;
+        double base, change;
+
+        if (strncmp(line, prefix, strlen(prefix)) != 0 || (p = strstr(line, field)) == NULL) {
+            continue;
+        }
+        base = strtod(p + strlen(field), NULL);
+        if (base <= 0) {
+            break;
+        }
+        change = (value - base) * 100.0 / base;
+        if (higher_is_better ? change < -opts->tolerance : change > opts->tolerance) {
+            fprintf(stderr, "rpmsg_eth_sim: %s %d bytes: %s %.3f against %.3f (%+.1f%%)\n",
+                    test, size, key, value, base, change);
+            regressions++;
+        }
+        break;
+    }
+    fclose(f);
+}
+
+static int run_throughput(struct peer* peer, const struct sim_opts* opts, int size)
+{
+    static uint8_t f[MAX_FRAME];
+    struct net_bench_reply r0, r1;
+    struct timespec t0, t1;
+    unsigned long long sent = 0, received, rx_bytes;
+    uint8_t payload[MAX_FRAME];
+    double seconds, cpu;
+
+    memset(payload, 0, (size_t)size);
+    if (ctl_request(peer, opts, NET_BENCH_CMD_RESET, &r0) < 0) {
+        return -1;
+    }
+
+    cpu = cpu_seconds();
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do {
+        for (int i = 0; i < 64; i++) {
+            memcpy(payload, &sent, sizeof(sent) < (size_t)size ? sizeof(sent) : (size_t)size);
+            if (peer_send_frame(peer, f, build_udp(peer, f, opts->sink_port, payload, size)) == 0) {
+                sent++;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+    } while (ts_diff(&t0, &t1) < opts->duration);
+    cpu = cpu_seconds() - cpu;
+
+    if (ctl_finish(peer, opts, &r1) < 0) {
+        return -1;
+    }
+    received = lwip_ntohl(r1.sink_packets);
+    rx_bytes = ((unsigned long long)lwip_ntohl(r1.sink_bytes_hi) << 32) | lwip_ntohl(r1.sink_bytes_lo);
+    seconds = ts_diff(&t0, &t1);
+
+    printf("{\"test\":\"throughput\",\"size\":%d,\"seconds\":%.3f,\"sent\":%llu,\"received\":%llu,"
+           "\"lost\":%llu,\"tx_pps\":%.0f,\"rx_pps\":%.0f,\"rx_mbps\":%.3f",
+           size, seconds, sent, received, sent > received ? sent - received : 0,
+           (double)sent / seconds, (double)received / seconds, (double)rx_bytes * 8 / seconds / 1e6);
+    print_costs(&r1, cpu, received);
+    printf("}\n");
+    fflush(stdout);
+
+    check_baseline(opts, "throughput", size, "rx_mbps", (double)rx_bytes * 8 / seconds / 1e6, 1);
+    return 0;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const uint64_t* ns, int n, int permille)
+{
+    int rank = (int)(((long long)n * permille + 999) / 1000);
+
+    return (double)ns[rank > 0 ? rank - 1 : 0] / 1000.0;
+}
+
+static int run_latency(struct peer* peer, const struct sim_opts* opts, int size)
+{
+    static uint8_t f[MAX_FRAME];
+    struct net_bench_reply r0, r1;
+    struct timespec start, t0, t1;
+    uint8_t payload[MAX_FRAME];
+    uint64_t* ns;
+    int n = 0, lost = 0;
+    uint32_t seq;
+    double cpu;
+
+    ns = calloc((size_t)opts->samples, sizeof(*ns));
+    memset(payload, 0, (size_t)size);
+    if (ns == NULL || ctl_request(peer, opts, NET_BENCH_CMD_RESET, &r0) < 0) {
+        free(ns);
+        return -1;
+    }
+
+    cpu = cpu_seconds();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (seq = 0; seq < (uint32_t)opts->samples; seq++) {
+        size_t cmp = sizeof(seq) < (size_t)size ? sizeof(seq) : (size_t)size;
+        const uint8_t* p = NULL;
+        uint8_t* frame;
+        int len, plen = 0;
+
+        memcpy(payload, &seq, cmp);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (peer_send_frame(peer, f, build_udp(peer, f, opts->echo_port, payload, size)) < 0) {
+            lost++;
+            continue;
+        }
+        // answers to round trips that already timed out are skipped
+        while ((len = peer_recv_frame(peer, &frame, opts->timeout_ms)) >= 0) {
+            p = parse_udp(frame, len, opts->echo_port, &plen);
+            if (p != NULL && plen == size && memcmp(p, payload, cmp) == 0) {
+                break;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (len < 0) {
+            lost++;
+            continue;
+        }
+        ns[n++] = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000ULL + (uint64_t)(t1.tv_nsec - t0.tv_nsec);
+    }
+    cpu = cpu_seconds() - cpu;
+
+    if (ctl_finish(peer, opts, &r1) < 0 || n == 0) {
+        free(ns);
+        return -1;
+    }
+    qsort(ns, (size_t)n, sizeof(*ns), cmp_u64);
+
+    printf("{\"test\":\"latency\",\"size\":%d,\"seconds\":%.3f,\"samples\":%d,\"lost\":%d,"
+           "\"min_us\":%.3f,\"p50_us\":%.3f,\"p99_us\":%.3f,\"p999_us\":%.3f,\"max_us\":%.3f",
+           size, ts_diff(&start, &t1), n, lost, (double)ns[0] / 1000.0,
+           percentile_us(ns, n, 500), percentile_us(ns, n, 990), percentile_us(ns, n, 999),
+           (double)ns[n - 1] / 1000.0);
+    print_costs(&r1, cpu, (unsigned long long)n);
+    printf("}\n");
+    fflush(stdout);
+
+    check_baseline(opts, "latency", size, "p99_us", percentile_us(ns, n, 990), 0);
+    free(ns);
+    return 0;
+}
+
+// Replay (-r): the frames of a pcap file go into netif->input of the rpmsg_eth netif as fast as
+// the stack takes them, past the driver and the link, to see what the stack alone costs on real
+// traffic. Captures of linux/capture/rpmsg_pcap -Q in are the intended input; Ethernet and raw IP
+// link types are taken, and unicast frames are readdressed to the netif's MAC. The capture is
+// played over and over for -t seconds. With -d the frames are handed to ethernet_input() under
+// the core lock instead, which leaves the tcpip mbox out and adds a replay_input probe around
+// each frame. Besides the rate, the PERF_STOP probes (a build with LWIP_PERF) and the high-water
+// marks of the pools during the run are listed, one JSON object per line.
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_LINKTYPE_RAW 101
+#define REPLAY_BATCH 32
+
+struct pcap_file_header {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct pcap_rec_header {
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t caplen;
+    uint32_t len;
+};
+
+struct replay_frame {
+    uint32_t offset;
+    uint16_t len;
+};
+
+// The whole capture in memory, as Ethernet frames
+struct replay {
+    uint8_t* data;
+    size_t data_size;
+    size_t data_used;
+    struct replay_frame* frames;
+    int num_frames;
+    int max_frames;
+    unsigned long long bytes;
+};
+
+static const char* const replay_pool_names[] = {
+#define LWIP_MEMPOOL(name, num, size, desc) #name,
+#include "lwip/priv/memp_std.h"
+};
+
+static uint32_t pcap32(uint32_t v, int swap)
+{
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static uint8_t* replay_add(struct replay* rp, uint16_t len)
+{
+    struct replay_frame* fr;
+
+    if (rp->num_frames == rp->max_frames) {
+        rp->max_frames = rp->max_frames ? rp->max_frames * 2 : 1024;
+        rp->frames = realloc(rp->frames, (size_t)rp->max_frames * sizeof(*rp->frames));
+    }
+    while (rp->data_used + len > rp->data_size) {
+        rp->data_size = rp->data_size ? rp->data_size * 2 : 1 << 20;
+        rp->data = realloc(rp->data, rp->data_size);
+    }
+    if (rp->frames == NULL || rp->data == NULL) {
+        return NULL;
+    }
+    fr = &rp->frames[rp->num_frames++];
+    fr->offset = (uint32_t)rp->data_used;
+    fr->len = len;
+    rp->data_used += len;
+    rp->bytes += len;
+    return rp->data + fr->offset;
+}
+
+static int replay_load(const char* path, const uint8_t* mac, const uint8_t* src_mac, struct replay* rp)
+{
+    static uint8_t buf[MAX_FRAME];
+    struct pcap_file_header fh;
+    struct pcap_rec_header rh;
+    uint32_t linktype;
+    int swap, cut = 0, other = 0;
+    FILE* f;
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&fh, sizeof(fh), 1, f) == 1) {
+        swap = fh.magic == __builtin_bswap32(PCAP_MAGIC) || fh.magic == __builtin_bswap32(PCAP_MAGIC_NS);
+    } else {
+        fh.magic = 0;
+        swap = 0;
+    }
+    if (!swap && fh.magic != PCAP_MAGIC && fh.magic != PCAP_MAGIC_NS) {
+        fprintf(stderr, "rpmsg_eth_sim: %s: not a pcap file\n", path);
+        fclose(f);
+        return -1;
+    }
+    // the upper bits carry the FCS length
+    linktype = pcap32(fh.linktype, swap) & 0xFFFF;
+    if (linktype != PCAP_LINKTYPE_ETHERNET && linktype != PCAP_LINKTYPE_RAW) {
+        fprintf(stderr, "rpmsg_eth_sim: %s: link type %u, only Ethernet and raw IP are taken\n", path,
+                linktype);
+        fclose(f);
+        return -1;
+    }
+
+    while (fread(&rh, sizeof(rh), 1, f) == 1) {
+        uint32_t caplen = pcap32(rh.caplen, swap);
+        uint32_t hdr_len = linktype == PCAP_LINKTYPE_RAW ? ETH_HDR_LEN : 0;
+        uint8_t* frame;
+
+        if (caplen > sizeof(buf) - ETH_HDR_LEN || fread(buf, caplen, 1, f) != 1) {
+            fprintf(stderr, "rpmsg_eth_sim: %s: truncated or corrupt\n", path);
+            fclose(f);
+            return -1;
+        }
+        // frames not captured whole would only show up as errors
+        if (caplen < pcap32(rh.len, swap)) {
+            cut++;
+            continue;
+        }
+        if (hdr_len == 0 ? caplen <= ETH_HDR_LEN : caplen == 0 || (buf[0] >> 4 != 4 && buf[0] >> 4 != 6)) {
+            other++;
+            continue;
+        }
+        frame = replay_add(rp, (uint16_t)(hdr_len + caplen));
+        if (frame == NULL) {
+            fprintf(stderr, "rpmsg_eth_sim: out of memory\n");
+            fclose(f);
+            return -1;
+        }
+        memcpy(frame + hdr_len, buf, caplen);
+        if (hdr_len != 0) {
+            memcpy(frame + 6, src_mac, 6);
+            put16(frame + 12, buf[0] >> 4 == 4 ? 0x0800 : 0x86DD);
+            memcpy(frame, mac, 6);
+        } else if (!(frame[0] & 1)) {
+            memcpy(frame, mac, 6);
+        }
+    }
+    fclose(f);
+
+    if (cut != 0 || other != 0) {
+        fprintf(stderr, "rpmsg_eth_sim: %s: skipped %d frames cut short and %d others\n", path, cut, other);
+    }
+    if (rp->num_frames == 0) {
+        fprintf(stderr, "rpmsg_eth_sim: %s: no frames to replay\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Start the high-water marks over from what is in use now
+static void replay_reset_stats(void)
+{
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    SYS_ARCH_PROTECT(lev);
+#if MEMP_STATS
+    for (int i = 0; i < MEMP_MAX; i++) {
+        lwip_stats.memp[i]->max = lwip_stats.memp[i]->used;
+        lwip_stats.memp[i]->err = 0;
+    }
+#endif
+#if MEM_STATS
+    lwip_stats.mem.max = lwip_stats.mem.used;
+    lwip_stats.mem.err = 0;
+#endif
+    SYS_ARCH_UNPROTECT(lev);
+#if LWIP_PERF
+    perf_reset();
+#endif
+}
+
+static void replay_print_stats(int size, unsigned long long packets)
+{
+    double pkts = packets ? (double)packets : 1.0;
+
+#if LWIP_PERF
+    struct perf_probe probe;
+
+    for (u8_t i = 0; perf_get_probe(i, &probe); i++) {
+        printf("{\"test\":\"perf\",\"run\":\"replay\",\"size\":%d,\"probe\":\"%s\",\"count\":%u,"
+               "\"per_pkt\":%.3f,\"min_cycles\":%u,\"mean_cycles\":%llu,\"max_cycles\":%u,\"hist_log2\":[",
+               size, probe.name, probe.count, (double)probe.count / pkts, probe.min,
+               probe.count ? (unsigned long long)(probe.sum / probe.count) : 0, probe.max);
+        for (int b = 0; b < PERF_HIST_BUCKETS; b++) {
+            printf("%s%u", b ? "," : "", probe.hist[b]);
+        }
+        printf("]}\n");
+    }
+#else
+    LWIP_UNUSED_ARG(pkts);
+#endif
+#if MEMP_STATS
+    for (int i = 0; i < MEMP_MAX; i++) {
+        const struct stats_mem* m = lwip_stats.memp[i];
+
+        printf("{\"test\":\"pool\",\"run\":\"replay\",\"size\":%d,\"pool\":\"%s\",\"avail\":%u,"
+               "\"max\":%u,\"err\":%u}\n",
+               size, replay_pool_names[i], (unsigned)m->avail, (unsigned)m->max, (unsigned)m->err);
+    }
+#endif
+#if MEM_STATS
+    printf("{\"test\":\"pool\",\"run\":\"replay\",\"size\":%d,\"pool\":\"MEM_HEAP\",\"avail\":%u,"
+           "\"max\":%u,\"err\":%u}\n",
+           size, (unsigned)lwip_stats.mem.avail, (unsigned)lwip_stats.mem.max, (unsigned)lwip_stats.mem.err);
+#endif
+}
+
+// A pool pbuf holding frame i, as a driver would pass it up. The stack may hold on to all of
+// them for a while (reassembly, out of order segments); after timeout_ms the frame is dropped.
+static struct pbuf* replay_pbuf(const struct replay* rp, int i, int timeout_ms)
+{
+    const struct replay_frame* fr = &rp->frames[i];
+    struct timespec t0, now;
+    struct pbuf* p;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while ((p = pbuf_alloc(PBUF_RAW, fr->len, PBUF_POOL)) == NULL) {
+        sched_yield();
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (ts_diff(&t0, &now) * 1000 >= timeout_ms) {
+            return NULL;
+        }
+    }
+    pbuf_take(p, rp->data + fr->offset, fr->len);
+    return p;
+}
+
+static void replay_done(void* arg)
+{
+    sys_sem_signal((sys_sem_t*)arg);
+}
+
+struct replay_drain {
+    struct peer* peer;
+    volatile int stop;
+};
+
+// Whatever the stack answers goes out over the link and is thrown away here
+static void* replay_drain(void* arg)
+{
+    struct replay_drain* d = arg;
+
+    while (!d->stop) {
+        uint8_t* frame;
+
+        peer_recv_frame(d->peer, &frame, 100);
+    }
+    return NULL;
+}
+
+static int run_replay(struct peer* peer, const struct sim_opts* opts)
+{
+    struct netif* netif = netif_default;
+    netif_input_fn input_fn;
+    struct replay rp;
+    struct timespec t0, t1;
+    unsigned long long packets = 0, bytes = 0, no_pbuf = 0, busy = 0;
+    double seconds, cpu;
+    sys_sem_t done;
+    int i = 0, size;
+
+    memset(&rp, 0, sizeof(rp));
+    if (replay_load(opts->replay, netif->hwaddr, peer->mac, &rp) < 0 || sys_sem_new(&done, 0) != ERR_OK) {
+        return -1;
+    }
+    size = (int)(rp.bytes / (unsigned long long)rp.num_frames);
+    // as tcpip_input() picks it for the direct mode
+    input_fn = (netif->flags & (NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET)) ? ethernet_input : ip_input;
+    replay_reset_stats();
+
+    cpu = cpu_seconds();
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do {
+        struct pbuf* batch[REPLAY_BATCH];
+        int n = 0;
+
+        for (; n < REPLAY_BATCH; n++, i = (i + 1) % rp.num_frames) {
+            batch[n] = replay_pbuf(&rp, i, opts->timeout_ms);
+            if (batch[n] == NULL) {
+                no_pbuf++;
+                break;
+            }
+            bytes += batch[n]->tot_len;
+        }
+        if (opts->direct) {
+            // allocated outside the lock, the tcpip thread's timers may have to free some first
+            LOCK_TCPIP_CORE();
+            for (int k = 0; k < n; k++) {
+                PERF_START;
+                if (input_fn(batch[k], netif) != ERR_OK) {
+                    pbuf_free(batch[k]);
+                }
+                PERF_STOP("replay_input");
+            }
+            UNLOCK_TCPIP_CORE();
+        } else {
+            for (int k = 0; k < n; k++) {
+                // the mbox or the input messages ran out, the tcpip thread catches up
+                while (netif->input(batch[k], netif) != ERR_OK) {
+                    busy++;
+                    sched_yield();
+                }
+            }
+        }
+        packets += (unsigned long long)n;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+    } while (ts_diff(&t0, &t1) < opts->duration);
+    // behind everything queued so far
+    while (tcpip_callback(replay_done, &done) != ERR_OK) {
+        sched_yield();
+    }
+    sys_arch_sem_wait(&done, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    cpu = cpu_seconds() - cpu;
+    seconds = ts_diff(&t0, &t1);
+    sys_sem_free(&done);
+
+    printf("{\"test\":\"replay\",\"size\":%d,\"seconds\":%.3f,\"frames\":%d,\"packets\":%llu,"
+           "\"no_pbuf\":%llu,\"busy\":%llu,\"pps\":%.0f,\"mbps\":%.3f,\"cpu_us_per_pkt\":%.3f}\n",
+           size, seconds, rp.num_frames, packets, no_pbuf, busy, (double)packets / seconds,
+           (double)bytes * 8 / seconds / 1e6, cpu * 1e6 / (packets ? (double)packets : 1.0));
+    replay_print_stats(size, packets);
+    fflush(stdout);
+
+    check_baseline(opts, "replay", size, "pps", (double)packets / seconds, 1);
+    free(rp.frames);
+    free(rp.data);
+    return 0;
+}
+
+// The IPI handler of a firmware that leaves the dispatching to rpmsg_eth's poll task, when it has
+// one that sleeps (RPMSG_ETH_BUSY_POLL_IDLE)
+static int sim_irq(void* arg)
+{
+    return rpmsg_eth_rx_notify((struct netif*)arg);
+}
+
+static int tap_open(const char* name, uint8_t* mac)
+{
+    struct ifreq ifr;
+    int fd, s;
+
+    fd = open("/dev/net/tun", O_RDWR);
+    if (fd < 0) {
+        perror("/dev/net/tun");
+        return -1;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+        perror("TUNSETIFF");
+        close(fd);
+        return -1;
+    }
+    // the remote addresses its frames to the MAC in our hello, it has to be the interface's
+    s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0 || ioctl(s, SIOCGIFHWADDR, &ifr) < 0) {
+        perror("SIOCGIFHWADDR");
+        if (s >= 0) {
+            close(s);
+        }
+        close(fd);
+        return -1;
+    }
+    close(s);
+    memcpy(mac, ifr.ifr_hwaddr.sa_data, 6);
+    return fd;
+}
+
+struct tap_bridge {
+    struct peer* peer;
+    int fd;
+};
+
+static void* tap_to_link(void* arg)
+{
+    struct tap_bridge* b = arg;
+    static uint8_t frame[MAX_FRAME];
+    ssize_t len;
+
+    while ((len = read(b->fd, frame, sizeof(frame))) >= 0) {
+        if (len > 0) {
+            peer_send_frame(b->peer, frame, (int)len);
+        }
+    }
+    perror("read");
+    exit(1);
+    return NULL;
+}
+
+static int run_tap(struct peer* peer, int fd)
+{
+    struct tap_bridge b = { peer, fd };
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, tap_to_link, &b) != 0) {
+        return -1;
+    }
+    for (;;) {
+        uint8_t* frame;
+        int len = peer_recv_frame(peer, &frame, -1);
+
+        if (len > 0 && write(fd, frame, (size_t)len) < 0) {
+            perror("write");
+            return -1;
+        }
+    }
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -I TAP           bridge to the TAP interface instead of running the tests\n"
+            "  -N COUNT         RPMsg buffers per direction, a power of two, default %d\n"
+            "  -S SIZE          RPMsg payload size, default %d\n"
+            "  -m MODE          throughput, latency or all (default)\n"
+            "  -s SIZES         comma separated UDP payload sizes, default 64 up to the MTU\n"
+            "  -M MTU           link MTU the default sizes go up to, default 1500\n"
+            "  -t SECONDS       length of each throughput run, default 2\n"
+            "  -n COUNT         round trips per latency run, default 10000\n"
+            "  -w MS            a round trip taking longer is lost, default 100\n"
+            "  -b FILE          compare with the output of an earlier run, exit 1 on a regression\n"
+            "  -T PERCENT       tolerance for -b, default 5\n"
+            "  -r FILE          replay a pcap file into the stack for -t seconds instead of the tests\n"
+            "  -d               with -r, call the input function under the core lock, not netif->input\n",
+            prog, RPMSG_SIM_NUM_BUFS, RPMSG_SIM_BUF_SIZE);
+}
+
+int main(int argc, char** argv)
+{
+    static struct peer peer = {
+        .mac = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+        .remote_mac = { 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFE },
+        .frame_have = -1,
+    };
+    struct sim_opts opts = {
+        .num_bufs = RPMSG_SIM_NUM_BUFS,
+        .buf_size = RPMSG_SIM_BUF_SIZE,
+        .echo_port = NET_BENCH_ECHO_PORT,
+        .sink_port = NET_BENCH_SINK_PORT,
+        .mtu = 1500,
+        .duration = 2.0,
+        .samples = 10000,
+        .timeout_ms = 100,
+        .run_throughput = 1,
+        .run_latency = 1,
+        .tolerance = 5.0,
+    };
+    const char* sizes = NULL;
+    struct net_bench_reply r;
+    int c, i, fd = -1, failed = 0;
+
+    while ((c = getopt(argc, argv, "I:N:S:m:s:M:t:n:w:b:T:r:dh")) != -1) {
+        switch (c) {
+        case 'I':
+            opts.tap = optarg;
+            break;
+        case 'N':
+            opts.num_bufs = (uint32_t)atoi(optarg);
+            break;
+        case 'S':
+            opts.buf_size = (uint32_t)atoi(optarg);
+            break;
+        case 'm':
+            opts.run_throughput = strcmp(optarg, "latency") != 0;
+            opts.run_latency = strcmp(optarg, "throughput") != 0;
+            break;
+        case 's':
+            sizes = optarg;
+            break;
+        case 'M':
+            opts.mtu = atoi(optarg);
+            break;
+        case 't':
+            opts.duration = atof(optarg);
+            break;
+        case 'n':
+            opts.samples = atoi(optarg);
+            break;
+        case 'w':
+            opts.timeout_ms = atoi(optarg);
+            break;
+        case 'b':
+            opts.baseline = optarg;
+            break;
+        case 'T':
+            opts.tolerance = atof(optarg);
+            break;
+        case 'r':
+            opts.replay = optarg;
+            break;
+        case 'd':
+            opts.direct = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (opts.samples <= 0 || opts.duration <= 0 || opts.mtu <= UDP_IP_HDR_LEN + 64 ||
+        opts.buf_size <= sizeof(struct rpmsg_eth_frag_hdr) || opts.buf_size > 0xFFFF) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (sizes != NULL) {
+        for (char* p = (char*)sizes; *p != '\0' && opts.num_sizes < MAX_SIZES; p++) {
+            int size = (int)strtol(p, &p, 10);
+
+            // the frames are built unfragmented
+            if (size <= 0 || size > opts.mtu - UDP_IP_HDR_LEN) {
+                fprintf(stderr, "rpmsg_eth_sim: bad size list %s\n", sizes);
+                return 2;
+            }
+            opts.sizes[opts.num_sizes++] = size;
+            if (*p != ',') {
+                break;
+            }
+        }
+    } else {
+        for (int size = 64; size < opts.mtu - UDP_IP_HDR_LEN; size *= 2) {
+            opts.sizes[opts.num_sizes++] = size;
+        }
+        opts.sizes[opts.num_sizes++] = opts.mtu - UDP_IP_HDR_LEN;
+    }
+
+    if (opts.tap != NULL && (fd = tap_open(opts.tap, peer.mac)) < 0) {
+        return 2;
+    }
+
+    peer.sim = rpmsg_sim_new(opts.num_bufs, opts.buf_size);
+    if (peer.sim == NULL) {
+        fprintf(stderr, "rpmsg_eth_sim: cannot set up the link\n");
+        return 2;
+    }
+    peer.max_msg = opts.buf_size;
+    peer.builtin = (opts.tap == NULL);
+
+    if (network_init(rpmsg_sim_rdev(peer.sim)) < 0 ||
+        net_bench_start((u16_t)opts.echo_port, (u16_t)opts.sink_port) < 0) {
+        fprintf(stderr, "rpmsg_eth_sim: cannot start the stack\n");
+        return 2;
+    }
+    rpmsg_sim_set_irq_handler(peer.sim, sim_irq, netif_default);
+    peer.ept = rpmsg_sim_wait_ept(peer.sim, "rpmsg-eth", 5000);
+    if (peer.ept == RPMSG_ADDR_ANY) {
+        fprintf(stderr, "rpmsg_eth_sim: no rpmsg-eth endpoint\n");
+        return 2;
+    }
+    // the TAP gets frames with valid checksums only, our own frames are fine either way; a
+    // replay has the stack check them as it would without offload
+    peer_send_hello(&peer, RPMSG_ETH_F_PACK |
+                    (peer.builtin && opts.replay == NULL ? RPMSG_ETH_F_CSUM : 0));
+
+    if (opts.tap != NULL) {
+        return run_tap(&peer, fd) < 0 ? 2 : 0;
+    }
+    if (opts.replay != NULL) {
+        struct replay_drain drain = { &peer, 0 };
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, replay_drain, &drain) != 0) {
+            return 2;
+        }
+        // up once the remote has the hello
+        for (i = 0; i < 500 && !netif_is_link_up(netif_default); i++) {
+            usleep(10000);
+        }
+        if (!netif_is_link_up(netif_default)) {
+            fprintf(stderr, "rpmsg_eth_sim: the link did not come up\n");
+            return 2;
+        }
+        failed = run_replay(&peer, &opts) < 0;
+        drain.stop = 1;
+        pthread_join(thread, NULL);
+        return failed ? 2 : regressions ? 1 : 0;
+    }
+
+    // the answer to the first request also brings the remote's hello in
+    if (ctl_request(&peer, &opts, NET_BENCH_CMD_QUERY, &r) < 0) {
+        return 2;
+    }
+    for (i = 0; i < opts.num_sizes; i++) {
+        if (opts.run_throughput && run_throughput(&peer, &opts, opts.sizes[i]) < 0) {
+            failed = 1;
+        }
+        if (opts.run_latency && run_latency(&peer, &opts, opts.sizes[i]) < 0) {
+            failed = 1;
+        }
+    }
+
+    return failed ? 2 : regressions ? 1 : 0;
+}
@@ -0,0 +1,573 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lwip/sys.h"
+
+#include "rpmsg_sim.h"
+
+#define RPMSG_SIM_MAX_EPTS 16
+#define RPMSG_SIM_FIRST_ADDR 0x400  // after the reserved addresses, as OpenAMP
+#define RPMSG_SIM_SEND_TIMEOUT_MS 15000  // rpmsg_send() gives up after this, as OpenAMP
+#define RPMSG_SIM_NONE 0xFFFFFFFFU
+
+/* A buffer, the payload follows the header */
+struct rpmsg_sim_buf {
+    uint32_t index;
+    uint32_t src;
+    uint32_t dst;
+    uint32_t len;
+    uint32_t held;          // rpmsg_hold_rx_buffer() was called from the callback
+    uint32_t pad[3];        // the payload is 32 byte aligned, as in the shared memory
+    uint8_t data[];
+};
+
+/* Buffer indices going one way. head is only written by the producer and tail by the consumer;
+ * the rings hold every buffer of the pool, so they never fill up. */
+struct rpmsg_sim_ring {
+    uint32_t* idx;
+    uint32_t mask;
+    uint32_t head __attribute__((aligned(64)));
+    uint32_t tail __attribute__((aligned(64)));
+};
+
+/* Lets a side sleep on an empty ring. The producer only takes the lock when someone waits. */
+struct rpmsg_sim_event {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int waiters;
+};
+
+/* One direction of the link */
+struct virtqueue {
+    struct rpmsg_sim* sim;
+    uint8_t* bufs;
+    size_t stride;
+    struct rpmsg_sim_ring used;     // filled, sender to receiver
+    struct rpmsg_sim_ring avail;    // free, receiver back to sender
+    struct rpmsg_sim_event used_ev;
+    struct rpmsg_sim_event avail_ev;
+    pthread_mutex_t send_lock;      // the sending end: taking free buffers and queueing them
+    pthread_mutex_t free_lock;      // returning buffers, held ones come back from any thread
+    pthread_mutex_t recv_lock;      // the receiving end, e.g. the IPI thread and a busy poller
+    int cb_disabled;                // no kicks, virtqueue_disable_cb()
+};
+
+struct rpmsg_sim {
+    struct rpmsg_virtio_device rvdev;
+    struct virtqueue to_remote;
+    struct virtqueue to_host;
+    uint32_t buf_size;
+    pthread_mutex_t ept_lock;
+    struct rpmsg_endpoint* epts[RPMSG_SIM_MAX_EPTS];
+    uint32_t next_addr;
+    pthread_t irq_thread;
+    int (*irq_fn)(void* arg);       // rpmsg_sim_set_irq_handler()
+    void* irq_arg;
+};
+
+static uint32_t rpmsg_sim_ring_pop(struct rpmsg_sim_ring* r)
+{
+    uint32_t tail = r->tail;
+    uint32_t i;
+
+    if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail) {
+        return RPMSG_SIM_NONE;
+    }
+    i = r->idx[tail & r->mask];
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return i;
+}
+
+static int rpmsg_sim_ring_empty(struct rpmsg_sim_ring* r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+}
+
+static void rpmsg_sim_signal(struct rpmsg_sim_event* ev)
+{
+    /* pairs with the increment of waiters in rpmsg_sim_wait() */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ev->waiters, __ATOMIC_RELAXED) != 0) {
+        pthread_mutex_lock(&ev->lock);
+        pthread_cond_broadcast(&ev->cond);
+        pthread_mutex_unlock(&ev->lock);
+    }
+}
+
+static void rpmsg_sim_ring_push(struct rpmsg_sim_ring* r, struct rpmsg_sim_event* ev, uint32_t i)
+{
+    uint32_t head = r->head;
+
+    r->idx[head & r->mask] = i;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    rpmsg_sim_signal(ev);
+}
+
+/* Sleep until r has an entry or timeout_ms passed, -1 waits forever. Returns 0 if it has one. */
+static int rpmsg_sim_wait(struct rpmsg_sim_event* ev, struct rpmsg_sim_ring* r, int timeout_ms)
+{
+    struct timespec deadline;
+
+    if (!rpmsg_sim_ring_empty(r)) {
+        return 0;
+    }
+    if (timeout_ms == 0) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if (timeout_ms > 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    pthread_mutex_lock(&ev->lock);
+    __atomic_add_fetch(&ev->waiters, 1, __ATOMIC_SEQ_CST);
+    while (rpmsg_sim_ring_empty(r)) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&ev->cond, &ev->lock);
+        } else if (pthread_cond_timedwait(&ev->cond, &ev->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    __atomic_sub_fetch(&ev->waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ev->lock);
+    return rpmsg_sim_ring_empty(r) ? -1 : 0;
+}
+
+static void rpmsg_sim_event_init(struct rpmsg_sim_event* ev)
+{
+    pthread_condattr_t attr;
+
+    pthread_mutex_init(&ev->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ev->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    ev->waiters = 0;
+}
+
+static int rpmsg_sim_vq_init(struct rpmsg_sim* sim, struct virtqueue* vq, uint32_t num, uint32_t buf_size)
+{
+    uint32_t i;
+
+    vq->sim = sim;
+    vq->stride = (sizeof(struct rpmsg_sim_buf) + buf_size + 31) & ~(size_t)31;
+    vq->bufs = aligned_alloc(64, vq->stride * num);
+    vq->used.idx = calloc(num, sizeof(uint32_t));
+    vq->avail.idx = calloc(num, sizeof(uint32_t));
+    if (vq->bufs == NULL || vq->used.idx == NULL || vq->avail.idx == NULL) {
+        return -1;
+    }
+    vq->used.mask = num - 1;
+    vq->avail.mask = num - 1;
+    for (i = 0; i < num; i++) {
+        struct rpmsg_sim_buf* buf = (struct rpmsg_sim_buf*)(vq->bufs + i * vq->stride);
+
+        memset(buf, 0, sizeof(*buf));
+        buf->index = i;
+        vq->avail.idx[i] = i;
+    }
+    vq->avail.head = num;
+    rpmsg_sim_event_init(&vq->used_ev);
+    rpmsg_sim_event_init(&vq->avail_ev);
+    pthread_mutex_init(&vq->send_lock, NULL);
+    pthread_mutex_init(&vq->free_lock, NULL);
+    pthread_mutex_init(&vq->recv_lock, NULL);
+    return 0;
+}
+
+static struct rpmsg_sim_buf* rpmsg_sim_buf(struct virtqueue* vq, uint32_t i)
+{
+    return (struct rpmsg_sim_buf*)(vq->bufs + i * vq->stride);
+}
+
+static struct rpmsg_sim_buf* rpmsg_sim_get(struct virtqueue* vq, int timeout_ms)
+{
+    uint32_t i;
+
+    for (;;) {
+        pthread_mutex_lock(&vq->send_lock);
+        i = rpmsg_sim_ring_pop(&vq->avail);
+        pthread_mutex_unlock(&vq->send_lock);
+        if (i != RPMSG_SIM_NONE) {
+            return rpmsg_sim_buf(vq, i);
+        }
+        /* a timeout restarts when another sender took the buffer that came free, close enough */
+        if (rpmsg_sim_wait(&vq->avail_ev, &vq->avail, timeout_ms) < 0) {
+            return NULL;
+        }
+    }
+}
+
+static void rpmsg_sim_put(struct virtqueue* vq, struct rpmsg_sim_buf* buf)
+{
+    pthread_mutex_lock(&vq->send_lock);
+    rpmsg_sim_ring_push(&vq->used, &vq->used_ev, buf->index);
+    pthread_mutex_unlock(&vq->send_lock);
+}
+
+static void rpmsg_sim_free(struct virtqueue* vq, struct rpmsg_sim_buf* buf)
+{
+    pthread_mutex_lock(&vq->free_lock);
+    rpmsg_sim_ring_push(&vq->avail, &vq->avail_ev, buf->index);
+    pthread_mutex_unlock(&vq->free_lock);
+}
+
+static struct rpmsg_sim* rpmsg_sim_of(struct rpmsg_device* rdev)
+{
+    return (struct rpmsg_sim*)rdev->link;
+}
+
+static struct rpmsg_endpoint* rpmsg_sim_find_ept(struct rpmsg_sim* sim, uint32_t addr)
+{
+    int i;
+
+    for (i = 0; i < RPMSG_SIM_MAX_EPTS; i++) {
+        struct rpmsg_endpoint* ept = __atomic_load_n(&sim->epts[i], __ATOMIC_ACQUIRE);
+
+        if (ept != NULL && ept->addr == addr) {
+            return ept;
+        }
+    }
+    return NULL;
+}
+
+/* Stands in for the IPI handler: runs the callbacks whenever the host queued something */
+static void* rpmsg_sim_irq_thread(void* arg)
+{
+    struct rpmsg_sim* sim = arg;
+    struct virtqueue* vq = &sim->to_remote;
+
+    for (;;) {
+        struct timespec pause = { 0, 20 * 1000 };
+        int (*fn)(void*);
+
+        if (rpmsg_sim_wait(&vq->used_ev, &vq->used, -1) < 0) {
+            continue;
+        }
+        /* whoever turned the kicks off polls the ring */
+        if (__atomic_load_n(&vq->cb_disabled, __ATOMIC_ACQUIRE)) {
+            nanosleep(&pause, NULL);
+            continue;
+        }
+        fn = __atomic_load_n(&sim->irq_fn, __ATOMIC_ACQUIRE);
+        sys_arch_isr_enter();
+        if (fn == NULL || fn(sim->irq_arg) != 0) {
+            virtqueue_notification(vq);
+        }
+        sys_arch_isr_exit();
+        /* someone else is draining the ring, let them */
+        if (!rpmsg_sim_ring_empty(&vq->used)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+struct rpmsg_sim* rpmsg_sim_new(uint32_t num_bufs, uint32_t buf_size)
+{
+    struct rpmsg_sim* sim;
+
+    if (num_bufs == 0 || (num_bufs & (num_bufs - 1)) != 0 || buf_size == 0) {
+        return NULL;
+    }
+    sim = calloc(1, sizeof(*sim));
+    if (sim == NULL) {
+        return NULL;
+    }
+    sim->buf_size = buf_size;
+    sim->next_addr = RPMSG_SIM_FIRST_ADDR;
+    sim->rvdev.rdev.link = sim;
+    sim->rvdev.rvq = &sim->to_remote;
+    sim->rvdev.svq = &sim->to_host;
+    pthread_mutex_init(&sim->ept_lock, NULL);
+    if (rpmsg_sim_vq_init(sim, &sim->to_remote, num_bufs, buf_size) < 0 ||
+        rpmsg_sim_vq_init(sim, &sim->to_host, num_bufs, buf_size) < 0) {
+        return NULL;
+    }
+    if (pthread_create(&sim->irq_thread, NULL, rpmsg_sim_irq_thread, sim) != 0) {
+        return NULL;
+    }
+    pthread_setname_np(sim->irq_thread, "rpmsg_sim_irq");
+    pthread_detach(sim->irq_thread);
+    return sim;
+}
+
+struct rpmsg_device* rpmsg_sim_rdev(struct rpmsg_sim* sim)
+{
+    return &sim->rvdev.rdev;
+}
+
+void rpmsg_sim_set_irq_handler(struct rpmsg_sim* sim, int (*fn)(void* arg), void* arg)
+{
+    sim->irq_arg = arg;
+    __atomic_store_n(&sim->irq_fn, fn, __ATOMIC_RELEASE);
+}
+
+uint32_t rpmsg_sim_wait_ept(struct rpmsg_sim* sim, const char* name, int timeout_ms)
+{
+    struct timespec pause = { 0, 1000 * 1000 };
+    int waited = 0;
+
+    for (;;) {
+        uint32_t addr = RPMSG_ADDR_ANY;
+        int i;
+
+        pthread_mutex_lock(&sim->ept_lock);
+        for (i = 0; i < RPMSG_SIM_MAX_EPTS; i++) {
+            if (sim->epts[i] != NULL && strncmp(sim->epts[i]->name, name, RPMSG_NAME_SIZE) == 0) {
+                addr = sim->epts[i]->addr;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&sim->ept_lock);
+        if (addr != RPMSG_ADDR_ANY || (timeout_ms >= 0 && waited >= timeout_ms)) {
+            return addr;
+        }
+        nanosleep(&pause, NULL);
+        waited++;
+    }
+}
+
+int rpmsg_sim_send(struct rpmsg_sim* sim, uint32_t dst, const void* data, uint32_t len, int timeout_ms)
+{
+    struct rpmsg_sim_buf* buf;
+
+    if (len > sim->buf_size) {
+        return RPMSG_ERR_PARAM;
+    }
+    buf = rpmsg_sim_get(&sim->to_remote, timeout_ms);
+    if (buf == NULL) {
+        return RPMSG_ERR_NO_BUFF;
+    }
+    buf->src = RPMSG_SIM_HOST_ADDR;
+    buf->dst = dst;
+    buf->len = len;
+    memcpy(buf->data, data, len);
+    rpmsg_sim_put(&sim->to_remote, buf);
+    return 0;
+}
+
+int rpmsg_sim_recv(struct rpmsg_sim* sim, void* data, uint32_t size, uint32_t* src, int timeout_ms)
+{
+    struct virtqueue* vq = &sim->to_host;
+    struct rpmsg_sim_buf* buf;
+    uint32_t i;
+    int len;
+
+    for (;;) {
+        pthread_mutex_lock(&vq->recv_lock);
+        i = rpmsg_sim_ring_pop(&vq->used);
+        pthread_mutex_unlock(&vq->recv_lock);
+        if (i != RPMSG_SIM_NONE) {
+            break;
+        }
+        if (rpmsg_sim_wait(&vq->used_ev, &vq->used, timeout_ms) < 0) {
+            return -1;
+        }
+    }
+    buf = rpmsg_sim_buf(vq, i);
+    len = (int)buf->len;
+    memcpy(data, buf->data, buf->len < size ? buf->len : size);
+    if (src != NULL) {
+        *src = buf->src;
+    }
+    rpmsg_sim_free(vq, buf);
+    return len;
+}
+
+/* The remote side, OpenAMP */
+
+int rpmsg_create_ept(struct rpmsg_endpoint* ept, struct rpmsg_device* rdev, const char* name,
+                     uint32_t src, uint32_t dest, rpmsg_ept_cb cb, rpmsg_ns_unbind_cb ns_unbind_cb)
+{
+    struct rpmsg_sim* sim = rpmsg_sim_of(rdev);
+    int i, slot = -1;
+
+    pthread_mutex_lock(&sim->ept_lock);
+    if (src == RPMSG_ADDR_ANY) {
+        src = sim->next_addr;
+    }
+    for (i = 0; i < RPMSG_SIM_MAX_EPTS; i++) {
+        if (sim->epts[i] == NULL) {
+            if (slot < 0) {
+                slot = i;
+            }
+        } else if (sim->epts[i]->addr == src) {
+            pthread_mutex_unlock(&sim->ept_lock);
+            return RPMSG_ERR_ADDR;
+        }
+    }
+    if (slot < 0) {
+        pthread_mutex_unlock(&sim->ept_lock);
+        return RPMSG_ERR_NO_MEM;
+    }
+    if (src >= sim->next_addr) {
+        sim->next_addr = src + 1;
+    }
+    memset(ept->name, 0, sizeof(ept->name));
+    if (name != NULL) {
+        strncpy(ept->name, name, sizeof(ept->name) - 1);
+    }
+    ept->rdev = rdev;
+    ept->addr = src;
+    ept->dest_addr = dest;
+    ept->cb = cb;
+    ept->ns_unbind_cb = ns_unbind_cb;
+    __atomic_store_n(&sim->epts[slot], ept, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sim->ept_lock);
+    return RPMSG_SUCCESS;
+}
+
+void rpmsg_destroy_ept(struct rpmsg_endpoint* ept)
+{
+    struct rpmsg_sim* sim = rpmsg_sim_of(ept->rdev);
+    int i;
+
+    pthread_mutex_lock(&sim->ept_lock);
+    for (i = 0; i < RPMSG_SIM_MAX_EPTS; i++) {
+        if (sim->epts[i] == ept) {
+            __atomic_store_n(&sim->epts[i], NULL, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&sim->ept_lock);
+}
+
+static int rpmsg_sim_send_remote(struct rpmsg_endpoint* ept, uint32_t dst, const void* data, int len,
+                                 int timeout_ms)
+{
+    struct rpmsg_sim* sim = rpmsg_sim_of(ept->rdev);
+    struct rpmsg_sim_buf* buf;
+
+    if (dst == RPMSG_ADDR_ANY) {
+        return RPMSG_ERR_ADDR;
+    }
+    if (len < 0 || (uint32_t)len > sim->buf_size) {
+        return RPMSG_ERR_PARAM;
+    }
+    buf = rpmsg_sim_get(&sim->to_host, timeout_ms);
+    if (buf == NULL) {
+        return RPMSG_ERR_NO_BUFF;
+    }
+    buf->src = ept->addr;
+    buf->dst = dst;
+    buf->len = (uint32_t)len;
+    memcpy(buf->data, data, (size_t)len);
+    rpmsg_sim_put(&sim->to_host, buf);
+    return len;
+}
+
+int rpmsg_send(struct rpmsg_endpoint* ept, const void* data, int len)
+{
+    return rpmsg_sim_send_remote(ept, ept->dest_addr, data, len, RPMSG_SIM_SEND_TIMEOUT_MS);
+}
+
+int rpmsg_sendto(struct rpmsg_endpoint* ept, const void* data, int len, uint32_t dst)
+{
+    return rpmsg_sim_send_remote(ept, dst, data, len, RPMSG_SIM_SEND_TIMEOUT_MS);
+}
+
+int rpmsg_trysend(struct rpmsg_endpoint* ept, const void* data, int len)
+{
+    return rpmsg_sim_send_remote(ept, ept->dest_addr, data, len, 0);
+}
+
+void* rpmsg_get_tx_payload_buffer(struct rpmsg_endpoint* ept, uint32_t* len, int wait)
+{
+    struct rpmsg_sim* sim = rpmsg_sim_of(ept->rdev);
+    struct rpmsg_sim_buf* buf;
+
+    buf = rpmsg_sim_get(&sim->to_host, wait ? RPMSG_SIM_SEND_TIMEOUT_MS : 0);
+    if (buf == NULL) {
+        return NULL;
+    }
+    *len = sim->buf_size;
+    return buf->data;
+}
+
+int rpmsg_send_nocopy(struct rpmsg_endpoint* ept, const void* data, int len)
+{
+    struct rpmsg_sim* sim = rpmsg_sim_of(ept->rdev);
+    struct rpmsg_sim_buf* buf = metal_container_of(data, struct rpmsg_sim_buf, data);
+
+    if (ept->dest_addr == RPMSG_ADDR_ANY) {
+        return RPMSG_ERR_ADDR;
+    }
+    if (len < 0 || (uint32_t)len > sim->buf_size) {
+        return RPMSG_ERR_PARAM;
+    }
+    buf->src = ept->addr;
+    buf->dst = ept->dest_addr;
+    buf->len = (uint32_t)len;
+    rpmsg_sim_put(&sim->to_host, buf);
+    return len;
+}
+
+void rpmsg_hold_rx_buffer(struct rpmsg_endpoint* ept, void* rxbuf)
+{
+    struct rpmsg_sim_buf* buf = metal_container_of(rxbuf, struct rpmsg_sim_buf, data);
+
+    (void)ept;
+    buf->held = 1;
+}
+
+void rpmsg_release_rx_buffer(struct rpmsg_endpoint* ept, void* rxbuf)
+{
+    struct rpmsg_sim* sim = rpmsg_sim_of(ept->rdev);
+    struct rpmsg_sim_buf* buf = metal_container_of(rxbuf, struct rpmsg_sim_buf, data);
+
+    buf->held = 0;
+    rpmsg_sim_free(&sim->to_remote, buf);
+}
+
+int rpmsg_virtio_get_buffer_size(struct rpmsg_device* rdev)
+{
+    return (int)rpmsg_sim_of(rdev)->buf_size;
+}
+
+void virtqueue_notification(struct virtqueue* vq)
+{
+    struct rpmsg_sim* sim = vq->sim;
+    uint32_t i;
+
+    /* nothing to do for the remote when the host took its messages */
+    if (vq != &sim->to_remote || pthread_mutex_trylock(&vq->recv_lock) != 0) {
+        return;
+    }
+    while ((i = rpmsg_sim_ring_pop(&vq->used)) != RPMSG_SIM_NONE) {
+        struct rpmsg_sim_buf* buf = rpmsg_sim_buf(vq, i);
+        struct rpmsg_endpoint* ept = rpmsg_sim_find_ept(sim, buf->dst);
+
+        buf->held = 0;
+        if (ept != NULL && ept->cb != NULL) {
+            if (ept->dest_addr == RPMSG_ADDR_ANY) {
+                ept->dest_addr = buf->src;
+            }
+            ept->cb(ept, buf->data, buf->len, buf->src, ept->priv);
+        }
+        if (!buf->held) {
+            rpmsg_sim_free(vq, buf);
+        }
+    }
+    pthread_mutex_unlock(&vq->recv_lock);
+}
+
+void virtqueue_disable_cb(struct virtqueue* vq)
+{
+    __atomic_store_n(&vq->cb_disabled, 1, __ATOMIC_RELEASE);
+}
+
+int virtqueue_enable_cb(struct virtqueue* vq)
+{
+    __atomic_store_n(&vq->cb_disabled, 0, __ATOMIC_SEQ_CST);
+    return !rpmsg_sim_ring_empty(&vq->used);
+}
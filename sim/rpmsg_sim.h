@@ -0,0 +1,41 @@
+#pragma once
+
+/* In-process stand-in for the RPMsg link between Linux and the remote, for running the
+ * remote-side stack on a workstation (LWIP_HOST_SIM). Each direction is a pool of fixed-size
+ * buffers and two single-producer single-consumer rings of buffer indices, filled and free, like
+ * the used and available rings of a vring. The remote side gets the OpenAMP calls in
+ * <openamp/open_amp.h>; its endpoint callbacks run from a thread that plays the IPI handler, as
+ * an interrupt (sys_arch_in_isr()). The host side is the API below, to be called from one thread
+ * for sending and one for receiving. */
+
+#include <stdint.h>
+
+#include <openamp/open_amp.h>
+
+#define RPMSG_SIM_NUM_BUFS 256      // per direction, as the Linux vring
+#define RPMSG_SIM_BUF_SIZE 496      // payload, 512 byte OpenAMP buffers less the RPMsg header
+#define RPMSG_SIM_HOST_ADDR 0x800   // source address of everything the host sends
+
+struct rpmsg_sim;
+
+/* num_bufs must be a power of two */
+struct rpmsg_sim* rpmsg_sim_new(uint32_t num_bufs, uint32_t buf_size);
+
+/* The device to give to network_init() */
+struct rpmsg_device* rpmsg_sim_rdev(struct rpmsg_sim* sim);
+
+/* Have the IPI thread call fn(arg) for a kick, as an interrupt, instead of dispatching the
+ * messages itself; it still does when fn returns nonzero */
+void rpmsg_sim_set_irq_handler(struct rpmsg_sim* sim, int (*fn)(void* arg), void* arg);
+
+/* Address of the remote endpoint called name, RPMSG_ADDR_ANY if it was not created within
+ * timeout_ms (-1 waits forever), the name service announcement */
+uint32_t rpmsg_sim_wait_ept(struct rpmsg_sim* sim, const char* name, int timeout_ms);
+
+/* Send one message to remote address dst. Returns 0, or RPMSG_ERR_NO_BUFF when no buffer came
+ * free within timeout_ms and RPMSG_ERR_PARAM when it does not fit one. */
+int rpmsg_sim_send(struct rpmsg_sim* sim, uint32_t dst, const void* data, uint32_t len, int timeout_ms);
+
+/* Copy out the next message from the remote. Returns its length, which may be more than size
+ * when it was cut, or -1 when none arrived within timeout_ms. */
+int rpmsg_sim_recv(struct rpmsg_sim* sim, void* data, uint32_t size, uint32_t* src, int timeout_ms);
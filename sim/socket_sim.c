@@ -0,0 +1,63 @@
+// Opens, binds and closes a few lwIP sockets on the host build (LWIP_HOST_SIM), checking the
+// errno they leave behind. rpmsg_eth_sim links nothing from the sockets API; this program makes
+// sure it still builds, links and reports errors through the C library's errno, see
+// lwip_arch_posix/include/arch/cc.h. Exits with 0 when all is well.
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lwip/sockets.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+
+#define SOCKET_SIM_PORT 7000
+
+static void tcpip_ready(void* arg)
+{
+    sys_sem_signal((sys_sem_t*)arg);
+}
+
+static int check(int ok, const char* what)
+{
+    if (!ok)
+        fprintf(stderr, "socket_sim: %s (errno %d, %s)\n", what, errno, strerror(errno));
+    return ok ? 0 : -1;
+}
+
+int main(void)
+{
+    struct sockaddr_in addr;
+    sys_sem_t ready;
+    int err = 0;
+    int a, b;
+
+    if (sys_sem_new(&ready, 0) != ERR_OK)
+        return 1;
+    tcpip_init(tcpip_ready, &ready);
+    sys_sem_wait(&ready);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_len = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = lwip_htons(SOCKET_SIM_PORT);
+    addr.sin_addr.s_addr = PP_HTONL(INADDR_ANY);
+
+    a = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+    b = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+    err |= check(a >= 0 && b >= 0, "cannot open a socket");
+    err |= check(lwip_bind(a, (struct sockaddr*)&addr, sizeof(addr)) == 0, "cannot bind");
+
+    errno = 0;
+    err |= check(lwip_bind(b, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno == EADDRINUSE,
+                 "second bind to the same port did not fail with EADDRINUSE");
+
+    err |= check(lwip_close(a) == 0 && lwip_close(b) == 0, "cannot close");
+
+    errno = 0;
+    err |= check(lwip_close(a) < 0 && errno == EBADF, "closing twice did not fail with EBADF");
+
+    if (!err)
+        printf("socket_sim: ok\n");
+    return err ? 1 : 0;
+}